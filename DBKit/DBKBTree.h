@@ -26,6 +26,7 @@
 #define DBK_BTREE_H
 
 #import <Foundation/Foundation.h>
+#include <pthread.h>
 
 @class DBKBTreeNode;
 @class DBKFreeNodesPage;
@@ -53,6 +54,23 @@ extern NSRecursiveLock *dbkbtree_lock;
   unsigned long nodesize;  
   
   BOOL begin;
+
+  /* one writer between -begin and -end, or readers in between
+     -beginReading and -endReading */
+  pthread_rwlock_t accessLock;
+  NSThread *writer;
+  unsigned readers;
+  NSRecursiveLock *nodesLock;
+
+  /* decoded nodes, most recently used first */
+  DBKBTreeNode *cacheHead;
+  DBKBTreeNode *cacheTail;
+  unsigned long cachedNodes;
+  unsigned long cacheBudget;
+  unsigned pinnedLevels;
+  unsigned long long cacheHits;
+  unsigned long long cacheMisses;
+  unsigned long long cacheEvictions;
   
   unsigned ulen;  
   unsigned llen;  
@@ -68,6 +86,16 @@ extern NSRecursiveLock *dbkbtree_lock;
 
 - (void)end;
 
+/** Shared access for lookups.  Between -beginReading and -endReading
+    several threads may use -nodeOfKey: and its variants, cursors and
+    -keysGreaterThenKey:andLesserThenKey:, while -begin waits for
+    them to end.  The delegate must then compare keys thread safely. */
+- (void)beginReading;
+
+- (void)endReading;
+
+- (BOOL)isReading;
+
 - (void)readHeader;
 
 - (void)writeHeader;
@@ -127,6 +155,16 @@ extern NSRecursiveLock *dbkbtree_lock;
 - (void)saveNodes;
 
 - (void)synchronize;
+
+/** Logs the pages written by -end and -synchronize before they are
+    written in place, so that a crash leaves the tree as of the last
+    of them.  Pages are kept in memory until then. */
+- (void)setWriteAheadLog:(BOOL)value;
+
+- (BOOL)writeAheadLog;
+
+/** Syncs the tree file and empties its log. */
+- (void)checkpoint;
                          
 - (void)saveNode:(DBKBTreeNode *)node;
 
@@ -134,6 +172,46 @@ extern NSRecursiveLock *dbkbtree_lock;
 
 - (void)checkBegin;
 
+/** Sets how many bytes of decoded nodes are kept across -end.
+    A node counts as nodesize bytes.  Nodes are only dropped at -end,
+    least recently used first, so a transaction can exceed the budget. */
+- (void)setCacheBudget:(unsigned long)bytes;
+
+- (unsigned long)cacheBudget;
+
+/** Sets how many levels from the root stay decoded regardless of the
+    budget.  1 keeps only the root. */
+- (void)setPinnedLevels:(unsigned)levels;
+
+- (unsigned)pinnedLevels;
+
+- (unsigned long)cachedBytes;
+
+/** hits, misses, evictions, nodes, bytes, budget and hitrate */
+- (NSDictionary *)cacheStatistics;
+
+- (void)resetCacheStatistics;
+
+- (void)useNode:(DBKBTreeNode *)node;
+
+- (void)nodeDidLoad:(DBKBTreeNode *)node;
+
+- (void)nodeWillUnload:(DBKBTreeNode *)node;
+
+- (void)trimCache;
+
+- (BOOL)isEmpty;
+
+/** Fills an empty tree from keys in ascending order,
+    see DBKBTreeBuilder for adding keys one at a time. */
+- (void)bulkLoadSortedKeys:(NSArray *)keys;
+
+- (NSNumber *)writeNodeWithKeys:(NSArray *)keys
+                 subnodeOffsets:(NSArray *)offsets;
+
+- (void)writeRootWithKeys:(NSArray *)keys
+           subnodeOffsets:(NSArray *)offsets;
+
 @end
 
 @protocol DBKBTreeDelegate
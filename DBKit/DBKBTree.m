@@ -24,10 +24,15 @@
 
 #import "DBKBTree.h"
 #import "DBKBTreeNode.h"
+#import "DBKBTreeBuilder.h"
+#import "DBKBTreeCursor.h"
 #import "DBKFreeNodesPage.h"
 #import "DBKFixLenRecordsFile.h"
 
 #define MIN_ORDER 3
+#define CACHE_BUDGET (256 * 1024)
+#define PINNED_LEVELS 2
+#define BULK_FILL 0.8
 #define HEADLEN 512
 #define FREE_NPAGE_LEN 512
 
@@ -60,6 +65,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
   RELEASE (rootOffset);
   RELEASE (freeNodesPage);
   RELEASE (unsavedNodes);
+  RELEASE (nodesLock);
+  pthread_rwlock_destroy(&accessLock);
   
   [super dealloc];
 }
@@ -71,6 +78,9 @@ NSRecursiveLock *dbkbtree_lock = nil;
   self = [super init];
 
   if (self) {
+    pthread_rwlock_init(&accessLock, NULL);
+    nodesLock = [NSRecursiveLock new];
+
     if (ord < MIN_ORDER) {
       DESTROY (self);
       [NSException raise: NSInvalidArgumentException
@@ -106,6 +116,12 @@ NSRecursiveLock *dbkbtree_lock = nil;
     nodesize = [delegate nodesize];
 
     unsavedNodes = [[NSMutableSet alloc] initWithCapacity: 1];
+
+    cacheHead = nil;
+    cacheTail = nil;
+    cachedNodes = 0;
+    cacheBudget = CACHE_BUDGET;
+    pinnedLevels = PINNED_LEVELS;
             
     ASSIGN (rootOffset, [NSNumber numberWithUnsignedLong: HEADLEN]);
     fnpageOffset = HEADLEN + nodesize;
@@ -117,6 +133,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
     [self createFreeNodesPage];
     
     begin = NO;
+    writer = nil;
+    readers = 0;
   }
   
   return self;
@@ -124,19 +142,18 @@ NSRecursiveLock *dbkbtree_lock = nil;
 
 - (void)begin
 {
-  if (begin == YES) {
+  if (begin && (writer == [NSThread currentThread])) {
     [NSException raise: NSInternalInconsistencyException
 		            format: @"begin already called"];     
   }
 
+  pthread_rwlock_wrlock(&accessLock);
+  writer = [NSThread currentThread];
   begin = YES;
 }
 
 - (void)end
 {
-  NSArray *subnodes = [root subnodes];
-  int i;
-
   if (begin == NO) {
     [NSException raise: NSInternalInconsistencyException
 		            format: @"end without begin"];     
@@ -144,12 +161,44 @@ NSRecursiveLock *dbkbtree_lock = nil;
   
   [self saveNodes];
   [file flush];
-  
-  for (i = 0; i < [subnodes count]; i++) { 
-    [[subnodes objectAtIndex: i] unload];
-  }
+  [self trimCache];
 
   begin = NO;  
+  writer = nil;
+  pthread_rwlock_unlock(&accessLock);
+}
+
+- (void)beginReading
+{
+  pthread_rwlock_rdlock(&accessLock);
+  [nodesLock lock];
+  readers++;
+  [nodesLock unlock];
+}
+
+- (void)endReading
+{
+  [nodesLock lock];
+
+  if (readers == 0) {
+    [nodesLock unlock];
+    [NSException raise: NSInternalInconsistencyException
+		            format: @"endReading without beginReading"];     
+  }
+
+  /* the last reader out trims what the others have loaded */
+  readers--;
+  if (readers == 0) {
+    [self trimCache];
+  }
+
+  [nodesLock unlock];
+  pthread_rwlock_unlock(&accessLock);
+}
+
+- (BOOL)isReading
+{
+  return (readers > 0);
 }
 
 - (void)readHeader
@@ -260,9 +309,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
 - (DBKBTreeNode *)insertKey:(id)key
                      inNode:(DBKBTreeNode *)node
 {
-  if ([node isLoaded] == NO) {
-    [node loadNodeData];
-  }
+  [self useNode: node];
 
   if ([node isLeaf]) {
     if ([node insertKey: key]) {
@@ -282,9 +329,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
       DBKBTreeNode *subnode = [[node subnodes] objectAtIndex: index];
       BOOL insert = NO;
           
-      if ([subnode isLoaded] == NO) {
-        [subnode loadNodeData];
-      }
+      [self useNode: subnode];
           
       if ([[subnode keys] count] == maxkeys) {
         [subnode indexForKey: key existing: &exists];
@@ -294,9 +339,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
           index = [node indexForKey: key existing: &exists];
           subnode = [[node subnodes] objectAtIndex: index];
           
-          if ([subnode isLoaded] == NO) {
-            [subnode loadNodeData];
-          }
+          [self useNode: subnode];
           
           insert = YES;
         }
@@ -330,9 +373,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
     if ([subnodes count]) {
       node = [subnodes objectAtIndex: *index];
       
-      if ([node isLoaded] == NO) {
-        [node loadNodeData];
-      }
+      [self useNode: node];
       
       *index = [node indexForKey: key existing: &exists];
     } else {
@@ -364,9 +405,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
     if ([subnodes count]) {
       node = [subnodes objectAtIndex: *index];
       
-      if ([node isLoaded] == NO) {
-        [node loadNodeData];
-      }
+      [self useNode: node];
       
       *index = [node indexForKey: key existing: exists];
       
@@ -403,51 +442,37 @@ NSRecursiveLock *dbkbtree_lock = nil;
 {
   CREATE_AUTORELEASE_POOL(pool);
   NSMutableArray *keys = [NSMutableArray array];
-  DBKBTreeNode *node;
+  DBKBTreeCursor *cursor;
   id key;
-  BOOL exists;
-  NSUInteger index;
   
   [self checkBegin];
-    
-  key = akey;
-  node = [self nodeOfKey: key getIndex: &index didExist: &exists];
-  
-  if (exists == NO) {
-    key = [node predecessorKeyInNode: &node forKeyAtIndex: index];
-    
-    if (key == nil) {
-      key = [node minKeyInSubnode: &node];
-      [keys addObject: key]; 
-    } else {
-      node = [self nodeOfKey: key getIndex: &index didExist: &exists];
-    }
+
+  cursor = [[DBKBTreeCursor alloc] initWithTree: self];
+  key = [cursor seekToKey: akey];
+
+  if (key && ([delegate compareNodeKey: key withKey: akey] == NSOrderedSame)) {
+    key = [cursor nextKey];
   }
 
-  while (node != nil)
+  while (key != nil)
     { 
       CREATE_AUTORELEASE_POOL(arp);
     
-      key = [node successorKeyInNode: &node forKeyAtIndex: index];
-    
-      if (key == nil)
-        {
-          RELEASE(arp);
-          break;
-        }
-    
       if (bkey && ([delegate compareNodeKey: key withKey: bkey] != NSOrderedAscending))
         {
           RELEASE(arp);
           break;
         }
     
-      index = [node indexOfKey: key];
       [keys addObject: key]; 
+      key = [cursor nextKey];
     
+      RETAIN (key);
       RELEASE (arp);
+      AUTORELEASE (key);
   }
 
+  RELEASE (cursor);
   RETAIN (keys);
   RELEASE (pool);
     
@@ -497,9 +522,7 @@ NSRecursiveLock *dbkbtree_lock = nil;
         if ([subnodes count]) {
           DBKBTreeNode *nd = [subnodes objectAtIndex: 0];
 
-          if ([nd isLoaded] == NO) {
-            [nd loadNodeData];
-          }
+          [self useNode: nd];
 
           RETAIN (nd);
           [root removeSubnodeAtIndex: 0];
@@ -563,8 +586,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
       if (chkind == 0) { 
         sibling = [chknode rightSibling];
         
-        if (sibling && ([sibling isLoaded] == NO)) {
-          [sibling loadNodeData];
+        if (sibling) {
+          [self useNode: sibling];
         }
       
         if (sibling && ([[sibling keys] count] > minkeys)) {
@@ -575,8 +598,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
       } else if (chkind == ([[chkparent subnodes] count] - 1)) {
         sibling = [chknode leftSibling];
 
-        if (sibling && ([sibling isLoaded] == NO)) {
-          [sibling loadNodeData];
+        if (sibling) {
+          [self useNode: sibling];
         }
       
         if (sibling && ([[sibling keys] count] > minkeys)) {
@@ -590,8 +613,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
         
         sibling = [chknode leftSibling];
 
-        if (sibling && ([sibling isLoaded] == NO)) {
-          [sibling loadNodeData];
+        if (sibling) {
+          [self useNode: sibling];
         }
 
         if (sibling && ([[sibling keys] count] > minkeys)) {
@@ -601,8 +624,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
         } else {
           sibling = [chknode rightSibling];
 
-          if (sibling && ([sibling isLoaded] == NO)) {
-            [sibling loadNodeData];
+          if (sibling) {
+            [self useNode: sibling];
           }
           
           if (sibling && ([[sibling keys] count] > minkeys)) {
@@ -711,6 +734,8 @@ NSRecursiveLock *dbkbtree_lock = nil;
 {
   NSData *data = [file dataOfLength: nodesize atOffset: [node offset]];
 
+  cacheMisses++;
+
   if ([data length] == nodesize) {
     unsigned keyscount;
 
@@ -747,6 +772,23 @@ NSRecursiveLock *dbkbtree_lock = nil;
   [file flush];
 }
 
+- (void)setWriteAheadLog:(BOOL)value
+{
+  [file setWriteAheadLog: value];
+  /* a page flushed in the middle of an update could not be undone */
+  [file setAutoflush: (value == NO)];
+}
+
+- (BOOL)writeAheadLog
+{
+  return [file writeAheadLog];
+}
+
+- (void)checkpoint
+{
+  [file checkpoint];
+}
+
 - (void)saveNode:(DBKBTreeNode *)node
 {
   CREATE_AUTORELEASE_POOL (arp);
@@ -766,12 +808,221 @@ NSRecursiveLock *dbkbtree_lock = nil;
 
 - (void)checkBegin
 {
-  if (begin == NO) {
+  if ((begin == NO) && (readers == 0)) {
     [NSException raise: NSInternalInconsistencyException
 		            format: @"begin not called!"];     
   }
 }
 
+- (void)setCacheBudget:(unsigned long)bytes
+{
+  cacheBudget = bytes;
+}
+
+- (unsigned long)cacheBudget
+{
+  return cacheBudget;
+}
+
+- (void)setPinnedLevels:(unsigned)levels
+{
+  pinnedLevels = (levels > 0) ? levels : 1;
+}
+
+- (unsigned)pinnedLevels
+{
+  return pinnedLevels;
+}
+
+- (unsigned long)cachedBytes
+{
+  return cachedNodes * nodesize;
+}
+
+- (NSDictionary *)cacheStatistics
+{
+  unsigned long long lookups = cacheHits + cacheMisses;
+  double hitrate = lookups ? ((double)cacheHits / (double)lookups) : 0.0;
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithUnsignedLongLong: cacheHits], @"hits",
+                [NSNumber numberWithUnsignedLongLong: cacheMisses], @"misses",
+                [NSNumber numberWithUnsignedLongLong: cacheEvictions], @"evictions",
+                [NSNumber numberWithUnsignedLong: cachedNodes], @"nodes",
+                [NSNumber numberWithUnsignedLong: [self cachedBytes]], @"bytes",
+                [NSNumber numberWithUnsignedLong: cacheBudget], @"budget",
+                [NSNumber numberWithDouble: hitrate], @"hitrate",
+                nil];
+}
+
+- (void)resetCacheStatistics
+{
+  cacheHits = 0;
+  cacheMisses = 0;
+  cacheEvictions = 0;
+}
+
+- (void)unlinkCachedNode:(DBKBTreeNode *)node
+{
+  DBKBTreeNode *prev = [node cachePrev];
+  DBKBTreeNode *next = [node cacheNext];
+
+  if (prev) {
+    [prev setCacheNext: next];
+  } else {
+    cacheHead = next;
+  }
+
+  if (next) {
+    [next setCachePrev: prev];
+  } else {
+    cacheTail = prev;
+  }
+
+  [node setCachePrev: nil];
+  [node setCacheNext: nil];
+}
+
+- (void)moveNodeToCacheHead:(DBKBTreeNode *)node
+{
+  if ([node isCached] == NO) {
+    [node setCached: YES];
+    cachedNodes++;
+  } else if (node == cacheHead) {
+    return;
+  } else {
+    [self unlinkCachedNode: node];
+  }
+
+  [node setCacheNext: cacheHead];
+
+  if (cacheHead) {
+    [cacheHead setCachePrev: node];
+  }
+
+  cacheHead = node;
+
+  if (cacheTail == nil) {
+    cacheTail = node;
+  }
+}
+
+- (void)useNode:(DBKBTreeNode *)node
+{
+  [nodesLock lock];
+
+  if ([node isLoaded]) {
+    cacheHits++;
+  } else {
+    [node loadNodeData];
+  }
+
+  /* the ancestors are touched after the node, so a parent is never
+     older than its children and the cache tail holds the outer nodes */
+  while (node) {
+    if ([node isCached]) {
+      [self moveNodeToCacheHead: node];
+    }
+    node = [node parent];
+  }
+
+  [nodesLock unlock];
+}
+
+- (void)nodeDidLoad:(DBKBTreeNode *)node
+{
+  [self moveNodeToCacheHead: node];
+}
+
+- (void)nodeWillUnload:(DBKBTreeNode *)node
+{
+  if ([node isCached]) {
+    [self unlinkCachedNode: node];
+    [node setCached: NO];
+    cachedNodes--;
+  }
+}
+
+- (void)trimCache
+{
+  unsigned long skipped = 0;
+
+  /* unloading a node also unloads its loaded subnodes */
+  while (cacheTail && (skipped < cachedNodes)
+                   && ((cachedNodes * nodesize) > cacheBudget)) {
+    DBKBTreeNode *node = cacheTail;
+
+    if ((node == root) || ([node depth] < pinnedLevels)) {
+      [self moveNodeToCacheHead: node];
+      skipped++;
+    } else {
+      [node unload];
+      cacheEvictions++;
+      skipped = 0;
+    }
+  }
+}
+
+- (BOOL)isEmpty
+{
+  return (([[root keys] count] == 0) && ([[root subnodes] count] == 0));
+}
+
+- (void)bulkLoadSortedKeys:(NSArray *)keys
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  DBKBTreeBuilder *builder;
+
+  builder = [[DBKBTreeBuilder alloc] initWithTree: self fillFactor: BULK_FILL];
+  [builder addKeysFromEnumerator: [keys objectEnumerator]];
+  [builder finish];
+  RELEASE (builder);
+
+  RELEASE (arp);
+}
+
+- (NSData *)dataWithKeys:(NSArray *)keys
+          subnodeOffsets:(NSArray *)offsets
+{
+  NSMutableData *data = [NSMutableData dataWithCapacity: nodesize];
+  unsigned subcount = [offsets count];
+  unsigned i;
+
+  [data appendData: [self dataFromKeys: keys]];
+  [data appendData: [NSData dataWithBytes: &subcount length: ulen]];
+
+  for (i = 0; i < subcount; i++) {
+    unsigned long offs = [[offsets objectAtIndex: i] unsignedLongValue];
+
+    [data appendData: [NSData dataWithBytes: &offs length: llen]];
+  }
+
+  [data setLength: nodesize];
+
+  return data;
+}
+
+- (NSNumber *)writeNodeWithKeys:(NSArray *)keys
+                 subnodeOffsets:(NSArray *)offsets
+{
+  NSNumber *offset = [file offsetForNewData];
+
+  [file writeData: [self dataWithKeys: keys subnodeOffsets: offsets]
+         atOffset: offset];
+
+  return offset;
+}
+
+- (void)writeRootWithKeys:(NSArray *)keys
+           subnodeOffsets:(NSArray *)offsets
+{
+  [file writeData: [self dataWithKeys: keys subnodeOffsets: offsets]
+         atOffset: rootOffset];
+
+  [root unload];
+  [root loadNodeData];
+}
+
 @end
 
 
@@ -0,0 +1,78 @@
+/* DBKBTreeBuilder.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_BTREE_BUILDER_H
+#define DBK_BTREE_BUILDER_H
+
+#include <Foundation/Foundation.h>
+
+@class DBKBTree;
+
+/*
+ * Fills an empty DBKBTree from keys given in ascending order.
+ *
+ * The leaves are packed to the fill factor and written as the keys
+ * arrive, then each upper level is built from the separators of the
+ * level below, so every node is written once and in file order.
+ * Only one separator key per written node is kept in memory.
+ * Keys equal to the previous one are skipped, as -insertKey: does.
+ */
+@interface DBKBTreeBuilder: NSObject 
+{
+  DBKBTree *tree;
+
+  unsigned order;
+  unsigned minkeys;
+  unsigned maxkeys;
+  unsigned fillkeys;
+
+  NSMutableArray *leafKeys;
+  NSMutableArray *prevLeafKeys;
+  id separator;
+  id lastKey;
+  BOOL needsSeparator;
+
+  NSMutableArray *offsets;     /* written leaves */
+  NSMutableArray *separators;  /* separators[i] follows offsets[i] */
+
+  unsigned long keyscount;
+  BOOL finished;
+}
+
+/** The tree must be empty and inside -begin.
+    fill is the share of the maximum number of keys put in each node. */
+- (id)initWithTree:(DBKBTree *)atree
+        fillFactor:(float)fill;
+
+/** Raises NSInvalidArgumentException for a key lower than the previous one. */
+- (void)addKey:(id)key;
+
+- (void)addKeysFromEnumerator:(NSEnumerator *)enumerator;
+
+/** Writes the upper levels and the root.  No key can be added after. */
+- (void)finish;
+
+- (unsigned long)keyscount;
+
+@end
+
+#endif // DBK_BTREE_BUILDER_H
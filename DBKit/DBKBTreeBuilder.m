@@ -0,0 +1,266 @@
+/* DBKBTreeBuilder.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#import "DBKBTreeBuilder.h"
+#import "DBKBTree.h"
+
+@implementation	DBKBTreeBuilder
+
+- (void)dealloc
+{
+  RELEASE (leafKeys);
+  RELEASE (prevLeafKeys);
+  RELEASE (separator);
+  RELEASE (lastKey);
+  RELEASE (offsets);
+  RELEASE (separators);
+  RELEASE (tree);
+
+  [super dealloc];
+}
+
+- (id)initWithTree:(DBKBTree *)atree
+        fillFactor:(float)fill
+{
+  self = [super init];
+
+  if (self) {
+    [atree checkBegin];
+
+    if ([atree isEmpty] == NO) {
+      DESTROY (self);
+      [NSException raise: NSInternalInconsistencyException
+		              format: @"bulk loading needs an empty tree"];     
+      return self;
+    }
+
+    ASSIGN (tree, atree);
+
+    order = [tree order];
+    minkeys = order - 1;
+    maxkeys = order * 2 - 1;
+
+    fillkeys = (unsigned)(fill * maxkeys + 0.5);
+    fillkeys = (fillkeys < minkeys) ? minkeys : fillkeys;
+    fillkeys = (fillkeys > maxkeys) ? maxkeys : fillkeys;
+
+    leafKeys = [NSMutableArray new];
+    prevLeafKeys = nil;
+    separator = nil;
+    lastKey = nil;
+    needsSeparator = NO;
+
+    offsets = [NSMutableArray new];
+    separators = [NSMutableArray new];
+
+    keyscount = 0;
+    finished = NO;
+  }
+
+  return self;
+}
+
+- (void)writePrevLeaf
+{
+  [offsets addObject: [tree writeNodeWithKeys: prevLeafKeys
+                               subnodeOffsets: nil]];
+  [separators addObject: separator];
+  DESTROY (prevLeafKeys);
+  DESTROY (separator);
+}
+
+- (void)addKey:(id)key
+{
+  if (finished) {
+    [NSException raise: NSInternalInconsistencyException
+		            format: @"the tree is already built"];     
+  }
+
+  if (lastKey) {
+    NSComparisonResult result = [tree compareNodeKey: lastKey withKey: key];
+
+    if (result == NSOrderedSame) {
+      return;
+    }
+    if (result == NSOrderedDescending) {
+      [NSException raise: NSInvalidArgumentException
+		              format: @"keys must be added in ascending order"];     
+    }
+  }
+
+  ASSIGN (lastKey, key);
+  keyscount++;
+
+  /* the key after a full leaf goes up as the separator */
+  if (needsSeparator) {
+    ASSIGN (separator, key);
+    needsSeparator = NO;
+    return;
+  }
+
+  [leafKeys addObject: key];
+
+  /* a full leaf waits for the next one, so the last two can be
+     balanced in -finish */
+  if ([leafKeys count] == fillkeys) {
+    if (prevLeafKeys) {
+      [self writePrevLeaf];
+    }
+    prevLeafKeys = leafKeys;
+    leafKeys = [NSMutableArray new];
+    needsSeparator = YES;
+  }
+}
+
+- (void)addKeysFromEnumerator:(NSEnumerator *)enumerator
+{
+  id key;
+
+  while (1) {
+    CREATE_AUTORELEASE_POOL (arp);
+
+    key = [enumerator nextObject];
+
+    if (key == nil) {
+      RELEASE (arp);
+      break;
+    }
+
+    [self addKey: key];
+    RELEASE (arp);
+  }
+}
+
+- (void)finishLeaves
+{
+  NSMutableArray *flat = [NSMutableArray array];
+  NSUInteger count;
+
+  if (prevLeafKeys) {
+    [flat addObjectsFromArray: prevLeafKeys];
+  }
+  if (separator) {
+    [flat addObject: separator];
+  }
+  [flat addObjectsFromArray: leafKeys];
+
+  DESTROY (prevLeafKeys);
+  DESTROY (separator);
+  [leafKeys removeAllObjects];
+
+  count = [flat count];
+
+  if (count <= maxkeys) {
+    if ([offsets count] == 0) {
+      if (count) {
+        [tree writeRootWithKeys: flat subnodeOffsets: nil];
+      }
+    } else {
+      [offsets addObject: [tree writeNodeWithKeys: flat subnodeOffsets: nil]];
+    }
+
+  } else {
+    /* both halves get at least minkeys, as count > 2 * minkeys */
+    NSUInteger half = (count - 1) / 2;
+
+    [offsets addObject: [tree writeNodeWithKeys: [flat subarrayWithRange: NSMakeRange(0, half)]
+                                 subnodeOffsets: nil]];
+    [separators addObject: [flat objectAtIndex: half]];
+    [offsets addObject: [tree writeNodeWithKeys: [flat subarrayWithRange: NSMakeRange(half + 1, count - half - 1)]
+                                 subnodeOffsets: nil]];
+  }
+}
+
+- (void)buildLevel
+{
+  NSMutableArray *upOffsets = [NSMutableArray array];
+  NSMutableArray *upSeparators = [NSMutableArray array];
+  NSUInteger count = [offsets count];
+  NSUInteger ncount, lo, hi;
+  NSUInteger base, extra;
+  NSUInteger pos = 0;
+  NSUInteger i;
+
+  /* every node but the root needs order to 2 * order subnodes */
+  ncount = (count + fillkeys / 2) / (fillkeys + 1);
+  lo = (count + 2 * order - 1) / (2 * order);
+  hi = count / order;
+  hi = (hi < 1) ? 1 : hi;
+  ncount = (ncount < lo) ? lo : ncount;
+  ncount = (ncount > hi) ? hi : ncount;
+  ncount = (ncount < 1) ? 1 : ncount;
+
+  base = count / ncount;
+  extra = count % ncount;
+
+  for (i = 0; i < ncount; i++) {
+    CREATE_AUTORELEASE_POOL (arp);
+    NSUInteger subcount = base + ((i < extra) ? 1 : 0);
+    NSArray *subs = [offsets subarrayWithRange: NSMakeRange(pos, subcount)];
+    NSArray *keys = [separators subarrayWithRange: NSMakeRange(pos, subcount - 1)];
+
+    if (ncount == 1) {
+      [tree writeRootWithKeys: keys subnodeOffsets: subs];
+    } else {
+      [upOffsets addObject: [tree writeNodeWithKeys: keys subnodeOffsets: subs]];
+
+      if (i < (ncount - 1)) {
+        [upSeparators addObject: [separators objectAtIndex: pos + subcount - 1]];
+      }
+    }
+
+    pos += subcount;
+    RELEASE (arp);
+  }
+
+  [offsets setArray: upOffsets];
+  [separators setArray: upSeparators];
+}
+
+- (void)finish
+{
+  CREATE_AUTORELEASE_POOL (arp);
+
+  if (finished) {
+    RELEASE (arp);
+    return;
+  }
+
+  [self finishLeaves];
+
+  while ([offsets count] > 1) {
+    [self buildLevel];
+  }
+
+  [offsets removeAllObjects];
+  [separators removeAllObjects];
+  finished = YES;
+
+  RELEASE (arp);
+}
+
+- (unsigned long)keyscount
+{
+  return keyscount;
+}
+
+@end
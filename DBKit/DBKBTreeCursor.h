@@ -0,0 +1,73 @@
+/* DBKBTreeCursor.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_BTREE_CURSOR_H
+#define DBK_BTREE_CURSOR_H
+
+#include <Foundation/Foundation.h>
+
+@class DBKBTree;
+@class DBKBTreeNode;
+
+#define DBK_CURSOR_MAX_DEPTH 64
+
+/*
+ * Walks the keys of a DBKBTree in order, one at a time.
+ *
+ * The cursor holds the path from the root to the current key.  Nodes it
+ * had to load are unloaded again when it leaves them, so a scan of any
+ * length keeps only one path in memory.  It must be used between -begin
+ * and -end, and changing the tree makes it invalid: -seekToKey: again.
+ * Moving past either end leaves the cursor without a current key.
+ */
+@interface DBKBTreeCursor: NSObject 
+{
+  DBKBTree *tree;
+  NSMutableArray *nodes;
+  NSUInteger indexes[DBK_CURSOR_MAX_DEPTH];
+  BOOL unloads[DBK_CURSOR_MAX_DEPTH];
+  NSUInteger depth;
+}
+
+- (id)initWithTree:(DBKBTree *)atree;
+
+/** Moves to the first key not lower than key. */
+- (id)seekToKey:(id)key;
+
+- (id)seekToFirstKey;
+
+- (id)seekToLastKey;
+
+- (id)nextKey;
+
+- (id)prevKey;
+
+- (id)currentKey;
+
+- (BOOL)isValid;
+
+/** Drops the path, unloading what the cursor loaded. */
+- (void)reset;
+
+@end
+
+#endif // DBK_BTREE_CURSOR_H
@@ -0,0 +1,281 @@
+/* DBKBTreeCursor.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#import "DBKBTreeCursor.h"
+#import "DBKBTree.h"
+#import "DBKBTreeNode.h"
+
+/* Each level of the path holds a node and an index.  The index of the
+   last level is the current key.  Above it, the index is the subnode
+   the path goes through, which is also the key that follows it. */
+
+@implementation	DBKBTreeCursor
+
+- (void)dealloc
+{
+  [self reset];
+  RELEASE (nodes);
+  RELEASE (tree);
+
+  [super dealloc];
+}
+
+- (id)initWithTree:(DBKBTree *)atree
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (tree, atree);
+    nodes = [[NSMutableArray alloc] initWithCapacity: 8];
+    depth = 0;
+  }
+
+  return self;
+}
+
+- (void)pushNode:(DBKBTreeNode *)node
+{
+  if (depth == DBK_CURSOR_MAX_DEPTH) {
+    [NSException raise: NSInternalInconsistencyException
+		            format: @"tree too deep for the cursor"];     
+  }
+
+  /* a node loaded for one reader may be in use by another */
+  unloads[depth] = (([node isLoaded] == NO) && ([tree isReading] == NO));
+  [tree useNode: node];
+  [nodes addObject: node];
+  indexes[depth] = 0;
+  depth++;
+}
+
+- (void)popNode
+{
+  DBKBTreeNode *node;
+
+  depth--;
+  node = [nodes objectAtIndex: depth];
+
+  if (unloads[depth]) {
+    [node unload];
+  }
+
+  [nodes removeLastObject];
+}
+
+- (void)reset
+{
+  while (depth) {
+    [self popNode];
+  }
+}
+
+- (BOOL)isValid
+{
+  return (depth != 0);
+}
+
+- (id)currentKey
+{
+  if (depth) {
+    DBKBTreeNode *node = [nodes objectAtIndex: depth - 1];
+
+    /* the node can be unloaded before the caller is done with the key */
+    return AUTORELEASE (RETAIN ([node keyAtIndex: indexes[depth - 1]]));
+  }
+
+  return nil;
+}
+
+- (id)descendToFirstKeyFrom:(DBKBTreeNode *)node
+{
+  while (1) {
+    [self pushNode: node];
+
+    if ([node isLeaf]) {
+      break;
+    }
+
+    node = [node subnodeAtIndex: 0];
+  }
+
+  if ([[node keys] count] == 0) {
+    [self reset];
+    return nil;
+  }
+
+  return [self currentKey];
+}
+
+- (id)descendToLastKeyFrom:(DBKBTreeNode *)node
+{
+  while (1) {
+    [self pushNode: node];
+
+    if ([node isLeaf]) {
+      break;
+    }
+
+    indexes[depth - 1] = [[node subnodes] count] - 1;
+    node = [node subnodeAtIndex: indexes[depth - 1]];
+  }
+
+  if ([[node keys] count] == 0) {
+    [self reset];
+    return nil;
+  }
+
+  indexes[depth - 1] = [[node keys] count] - 1;
+
+  return [self currentKey];
+}
+
+- (id)seekToKey:(id)key
+{
+  DBKBTreeNode *node = [tree root];
+
+  [tree checkBegin];
+  [self reset];
+
+  while (1) {
+    NSUInteger index;
+    BOOL exists;
+
+    [self pushNode: node];
+    index = [node indexForKey: key existing: &exists];
+    indexes[depth - 1] = index;
+
+    if (exists) {
+      return [self currentKey];
+    }
+
+    if ([node isLeaf]) {
+      if (index < [[node keys] count]) {
+        return [self currentKey];
+      }
+      if (index == 0) {
+        [self reset];
+        return nil;
+      }
+
+      /* past the end of the leaf: the key is the successor of its last one */
+      indexes[depth - 1] = index - 1;
+
+      return [self nextKey];
+    }
+
+    node = [node subnodeAtIndex: index];
+  }
+
+  return nil;
+}
+
+- (id)seekToFirstKey
+{
+  [tree checkBegin];
+  [self reset];
+
+  return [self descendToFirstKeyFrom: [tree root]];
+}
+
+- (id)seekToLastKey
+{
+  [tree checkBegin];
+  [self reset];
+
+  return [self descendToLastKeyFrom: [tree root]];
+}
+
+- (id)nextKey
+{
+  DBKBTreeNode *node;
+  NSUInteger index;
+
+  if (depth == 0) {
+    return nil;
+  }
+
+  node = [nodes objectAtIndex: depth - 1];
+  index = indexes[depth - 1];
+
+  if ([node isLeaf] == NO) {
+    indexes[depth - 1] = index + 1;
+    return [self descendToFirstKeyFrom: [node subnodeAtIndex: index + 1]];
+  }
+
+  if ((index + 1) < [[node keys] count]) {
+    indexes[depth - 1] = index + 1;
+    return [self currentKey];
+  }
+
+  [self popNode];
+
+  while (depth) {
+    node = [nodes objectAtIndex: depth - 1];
+
+    if (indexes[depth - 1] < [[node keys] count]) {
+      return [self currentKey];
+    }
+
+    [self popNode];
+  }
+
+  return nil;
+}
+
+- (id)prevKey
+{
+  DBKBTreeNode *node;
+  NSUInteger index;
+
+  if (depth == 0) {
+    return nil;
+  }
+
+  node = [nodes objectAtIndex: depth - 1];
+  index = indexes[depth - 1];
+
+  if ([node isLeaf] == NO) {
+    return [self descendToLastKeyFrom: [node subnodeAtIndex: index]];
+  }
+
+  if (index > 0) {
+    indexes[depth - 1] = index - 1;
+    return [self currentKey];
+  }
+
+  [self popNode];
+
+  while (depth) {
+    index = indexes[depth - 1];
+
+    if (index > 0) {
+      indexes[depth - 1] = index - 1;
+      return [self currentKey];
+    }
+
+    [self popNode];
+  }
+
+  return nil;
+}
+
+@end
@@ -48,6 +48,11 @@
   BOOL loaded;
   
   DBKBTreeNode *parent;
+
+  /* links in the tree's node cache, not retained */
+  DBKBTreeNode *cachePrev;
+  DBKBTreeNode *cacheNext;
+  BOOL cached;
 }
 
 - (id)initInTree:(DBKBTree *)atree
@@ -163,6 +168,23 @@
 
 - (BOOL)isLeaf;
 
+/** the number of levels above the node, 0 for the root */
+- (unsigned)depth;
+
+/* node cache links, managed by the tree */
+
+- (BOOL)isCached;
+
+- (void)setCached:(BOOL)value;
+
+- (DBKBTreeNode *)cachePrev;
+
+- (void)setCachePrev:(DBKBTreeNode *)anode;
+
+- (DBKBTreeNode *)cacheNext;
+
+- (void)setCacheNext:(DBKBTreeNode *)anode;
+
 @end
 
 #endif // DBK_BTREE_NODE_H
@@ -29,6 +29,21 @@
 
 - (void)dealloc
 {
+  NSUInteger i;
+
+  if (cached) {
+    [tree nodeWillUnload: self];
+  }
+
+  /* the subnodes still pointing to us could outlive us */
+  for (i = 0; i < [subnodes count]; i++) {
+    DBKBTreeNode *node = [subnodes objectAtIndex: i];
+
+    if ([node parent] == self) {
+      [node setParent: nil];
+    }
+  }
+
   RELEASE (offset);
   RELEASE (keys);
   RELEASE (subnodes);
@@ -87,6 +102,7 @@
 - (void)setLoaded
 {
   loaded = YES;
+  [tree nodeDidLoad: self];
 }
 
 - (void)loadNodeData
@@ -96,6 +112,17 @@
 
 - (BOOL)unload
 {
+  NSUInteger i;
+
+  for (i = 0; i < [subnodes count]; i++) {
+    DBKBTreeNode *node = [subnodes objectAtIndex: i];
+
+    if ([node isLoaded]) {
+      [node unload];
+    }
+  }
+
+  [tree nodeWillUnload: self];
   [keys removeAllObjects];
   [subnodes removeAllObjects];
   loaded = NO;
@@ -138,6 +165,7 @@
   }      
   
   loaded = YES;
+  [tree nodeDidLoad: self];
   
   RELEASE (pool);  
 }
@@ -857,6 +885,49 @@
   return (parent == nil);
 }
 
+- (unsigned)depth
+{
+  DBKBTreeNode *node = parent;
+  unsigned depth = 0;
+
+  while (node) {
+    node = [node parent];
+    depth++;
+  }
+
+  return depth;
+}
+
+- (BOOL)isCached
+{
+  return cached;
+}
+
+- (void)setCached:(BOOL)value
+{
+  cached = value;
+}
+
+- (DBKBTreeNode *)cachePrev
+{
+  return cachePrev;
+}
+
+- (void)setCachePrev:(DBKBTreeNode *)anode
+{
+  cachePrev = anode;
+}
+
+- (DBKBTreeNode *)cacheNext
+{
+  return cacheNext;
+}
+
+- (void)setCacheNext:(DBKBTreeNode *)anode
+{
+  cacheNext = anode;
+}
+
 - (BOOL)isLeaf
 {
   return ([subnodes count] == 0);
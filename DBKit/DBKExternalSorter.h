@@ -0,0 +1,60 @@
+/* DBKExternalSorter.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_EXTERNAL_SORTER_H
+#define DBK_EXTERNAL_SORTER_H
+
+#include <Foundation/Foundation.h>
+
+@class DBKBTree;
+
+/*
+ * Sorts more keys than fit in memory, for DBKBTreeBuilder.
+ *
+ * Keys are collected in runs of runLength, each run is sorted with the
+ * ordering of the tree and spilled to a temporary file encoded with the
+ * tree delegate's -dataFromKeys:.  The sorted enumerator merges the runs,
+ * reading them sequentially.  The files are removed with the sorter.
+ */
+@interface DBKExternalSorter: NSObject 
+{
+  DBKBTree *tree;
+  NSUInteger runLength;
+  NSMutableArray *buffer;
+  NSMutableArray *runPaths;
+  BOOL merging;
+}
+
+- (id)initWithTree:(DBKBTree *)atree
+         runLength:(NSUInteger)len;
+
+- (void)addKey:(id)key;
+
+- (unsigned long)runsCount;
+
+/** The keys in ascending order, equal keys included.
+    No key can be added after this. */
+- (NSEnumerator *)sortedKeyEnumerator;
+
+@end
+
+#endif // DBK_EXTERNAL_SORTER_H
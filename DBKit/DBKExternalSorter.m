@@ -0,0 +1,386 @@
+/* DBKExternalSorter.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#import "DBKExternalSorter.h"
+#import "DBKBTree.h"
+
+#define RUN_BUFLEN (64 * 1024)
+
+static NSInteger compareKeys(id akey, id bkey, void *context)
+{
+  return [(DBKBTree *)context compareNodeKey: akey withKey: bkey];
+}
+
+
+/* One sorted run, read back from its file or kept in memory. */
+@interface DBKSortRun: NSObject
+{
+  DBKBTree *tree;
+  NSFileHandle *handle;
+  NSMutableData *buffer;
+  NSUInteger position;
+  NSArray *keys;
+  NSUInteger index;
+}
+
+- (id)initWithPath:(NSString *)path
+              tree:(DBKBTree *)atree;
+
+- (id)initWithKeys:(NSArray *)akeys;
+
+- (id)nextKey;
+
+@end
+
+@implementation	DBKSortRun
+
+- (void)dealloc
+{
+  [handle closeFile];
+  RELEASE (handle);
+  RELEASE (buffer);
+  RELEASE (keys);
+
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)path
+              tree:(DBKBTree *)atree
+{
+  self = [super init];
+
+  if (self) {
+    tree = atree;
+    handle = RETAIN ([NSFileHandle fileHandleForReadingAtPath: path]);
+
+    if (handle == nil) {
+      DESTROY (self);
+      [NSException raise: NSInternalInconsistencyException
+		              format: @"cannot open sort run at: %@", path];     
+      return self;
+    }
+
+    buffer = [[NSMutableData alloc] initWithCapacity: RUN_BUFLEN];
+    position = 0;
+  }
+
+  return self;
+}
+
+- (id)initWithKeys:(NSArray *)akeys
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (keys, akeys);
+    index = 0;
+  }
+
+  return self;
+}
+
+- (BOOL)readBytes:(void *)bytes
+           length:(NSUInteger)length
+{
+  while (([buffer length] - position) < length) {
+    NSData *data;
+
+    [buffer replaceBytesInRange: NSMakeRange(0, position)
+                      withBytes: NULL
+                         length: 0];
+    position = 0;
+
+    data = [handle readDataOfLength: RUN_BUFLEN];
+
+    if ([data length] == 0) {
+      return NO;
+    }
+
+    [buffer appendData: data];
+  }
+
+  [buffer getBytes: bytes range: NSMakeRange(position, length)];
+  position += length;
+
+  return YES;
+}
+
+- (id)nextKey
+{
+  NSMutableData *data;
+  unsigned length;
+  unsigned dlen;
+  NSArray *array;
+
+  if (handle == nil) {
+    return (index < [keys count]) ? [keys objectAtIndex: index++] : nil;
+  }
+
+  if ([self readBytes: &length length: sizeof(unsigned)] == NO) {
+    return nil;
+  }
+
+  data = [NSMutableData dataWithLength: length];
+
+  if ([self readBytes: [data mutableBytes] length: length] == NO) {
+    return nil;
+  }
+
+  array = [tree keysFromData: data withLength: &dlen];
+
+  return ([array count] ? [array objectAtIndex: 0] : nil);
+}
+
+@end
+
+
+/* Merges the runs, taking the lowest head each time. */
+@interface DBKSortMerger: NSEnumerator
+{
+  DBKBTree *tree;
+  id sorter;
+  NSMutableArray *runs;
+  NSMutableArray *heads;
+}
+
+- (id)initWithRuns:(NSArray *)aruns
+            sorter:(id)asorter
+              tree:(DBKBTree *)atree;
+
+@end
+
+@implementation	DBKSortMerger
+
+- (void)dealloc
+{
+  RELEASE (runs);
+  RELEASE (heads);
+  RELEASE (sorter);
+
+  [super dealloc];
+}
+
+- (id)initWithRuns:(NSArray *)aruns
+            sorter:(id)asorter
+              tree:(DBKBTree *)atree
+{
+  self = [super init];
+
+  if (self) {
+    NSUInteger i;
+
+    tree = atree;
+    /* the run files live as long as the sorter */
+    ASSIGN (sorter, asorter);
+    runs = [NSMutableArray new];
+    heads = [NSMutableArray new];
+
+    for (i = 0; i < [aruns count]; i++) {
+      DBKSortRun *run = [aruns objectAtIndex: i];
+      id key = [run nextKey];
+
+      if (key) {
+        [runs addObject: run];
+        [heads addObject: key];
+      }
+    }
+  }
+
+  return self;
+}
+
+- (id)nextObject
+{
+  NSUInteger count = [heads count];
+  NSUInteger lowest = 0;
+  NSUInteger i;
+  id key;
+  id next;
+
+  if (count == 0) {
+    return nil;
+  }
+
+  for (i = 1; i < count; i++) {
+    if ([tree compareNodeKey: [heads objectAtIndex: i]
+                     withKey: [heads objectAtIndex: lowest]] == NSOrderedAscending) {
+      lowest = i;
+    }
+  }
+
+  key = RETAIN ([heads objectAtIndex: lowest]);
+  next = [[runs objectAtIndex: lowest] nextKey];
+
+  if (next) {
+    [heads replaceObjectAtIndex: lowest withObject: next];
+  } else {
+    [heads removeObjectAtIndex: lowest];
+    [runs removeObjectAtIndex: lowest];
+  }
+
+  return AUTORELEASE (key);
+}
+
+@end
+
+
+@implementation	DBKExternalSorter
+
+- (void)dealloc
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSUInteger i;
+
+  for (i = 0; i < [runPaths count]; i++) {
+    [fm removeFileAtPath: [runPaths objectAtIndex: i] handler: nil];
+  }
+
+  RELEASE (runPaths);
+  RELEASE (buffer);
+  RELEASE (tree);
+
+  [super dealloc];
+}
+
+- (id)initWithTree:(DBKBTree *)atree
+         runLength:(NSUInteger)len
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (tree, atree);
+    runLength = (len > 0) ? len : 1;
+    buffer = [[NSMutableArray alloc] initWithCapacity: runLength];
+    runPaths = [NSMutableArray new];
+    merging = NO;
+  }
+
+  return self;
+}
+
+- (void)spillBuffer
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  NSString *path;
+  NSFileHandle *handle;
+  NSMutableData *data;
+  NSUInteger i;
+
+  path = [NSString stringWithFormat: @"dbksort_%@",
+                   [[NSProcessInfo processInfo] globallyUniqueString]];
+  path = [NSTemporaryDirectory() stringByAppendingPathComponent: path];
+
+  if ([[NSFileManager defaultManager] createFileAtPath: path
+                                              contents: nil
+                                            attributes: nil] == NO) {
+    RELEASE (arp);
+    [NSException raise: NSInternalInconsistencyException
+		            format: @"cannot create sort run at: %@", path];     
+  }
+
+  [runPaths addObject: path];
+  handle = [NSFileHandle fileHandleForWritingAtPath: path];
+
+  [buffer sortUsingFunction: compareKeys context: tree];
+
+  data = [NSMutableData dataWithCapacity: RUN_BUFLEN];
+
+  for (i = 0; i < [buffer count]; i++) {
+    CREATE_AUTORELEASE_POOL (pool);
+    NSArray *array = [NSArray arrayWithObject: [buffer objectAtIndex: i]];
+    NSData *kdata = [tree dataFromKeys: array];
+    unsigned length = [kdata length];
+
+    [data appendBytes: &length length: sizeof(unsigned)];
+    [data appendData: kdata];
+
+    if ([data length] >= RUN_BUFLEN) {
+      [handle writeData: data];
+      [data setLength: 0];
+    }
+
+    RELEASE (pool);
+  }
+
+  [handle writeData: data];
+  [handle closeFile];
+  [buffer removeAllObjects];
+
+  RELEASE (arp);
+}
+
+- (void)addKey:(id)key
+{
+  if (merging) {
+    [NSException raise: NSInternalInconsistencyException
+		            format: @"the keys are already sorted"];     
+  }
+
+  [buffer addObject: key];
+
+  if ([buffer count] >= runLength) {
+    [self spillBuffer];
+  }
+}
+
+- (unsigned long)runsCount
+{
+  return [runPaths count] + ([buffer count] ? 1 : 0);
+}
+
+- (NSEnumerator *)sortedKeyEnumerator
+{
+  NSMutableArray *runs;
+  NSUInteger i;
+
+  if (merging == NO) {
+    [buffer sortUsingFunction: compareKeys context: tree];
+    merging = YES;
+  }
+
+  if ([runPaths count] == 0) {
+    return [buffer objectEnumerator];
+  }
+
+  runs = [NSMutableArray array];
+
+  for (i = 0; i < [runPaths count]; i++) {
+    DBKSortRun *run = [[DBKSortRun alloc] initWithPath: [runPaths objectAtIndex: i]
+                                                  tree: tree];
+    [runs addObject: run];
+    RELEASE (run);
+  }
+
+  /* the last, partial run never leaves memory */
+  if ([buffer count]) {
+    DBKSortRun *run = [[DBKSortRun alloc] initWithKeys: buffer];
+
+    [runs addObject: run];
+    RELEASE (run);
+  }
+
+  return AUTORELEASE ([[DBKSortMerger alloc] initWithRuns: runs
+                                                   sorter: self
+                                                     tree: tree]);
+}
+
+@end
@@ -27,12 +27,17 @@
 
 #include <Foundation/Foundation.h>
 
+@class DBKMappedFile;
+@class DBKWriteAheadLog;
+
 @interface DBKFixLenRecordsFile: NSObject 
 {
   NSString *path;
   NSMutableDictionary *cacheDict;
   NSMutableArray *offsets;
   NSFileHandle *handle;
+  DBKMappedFile *mapping;
+  DBKWriteAheadLog *wal;
   unsigned long eof;
   unsigned maxlen;  
   BOOL autoflush;
@@ -54,6 +59,15 @@
 
 - (void)flush;
 
+/** With a log, each flush is logged and committed before it is
+    written in place.  The log is the file path plus ".wal". */
+- (void)setWriteAheadLog:(BOOL)value;
+
+- (BOOL)writeAheadLog;
+
+/** Syncs the file and empties the log. */
+- (void)checkpoint;
+
 - (NSData *)dataOfLength:(unsigned)length
                 atOffset:(NSNumber *)offset;
 
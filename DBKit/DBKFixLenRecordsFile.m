@@ -23,16 +23,25 @@
  */
 
 #include "DBKFixLenRecordsFile.h"
+#include "DBKMappedFile.h"
+#include "DBKWriteAheadLog.h"
 
 @implementation	DBKFixLenRecordsFile
 
 - (void)dealloc
 {
+  if (wal) {
+    [self checkpoint];
+    [wal close];
+    RELEASE (wal);
+  }
+
   if (handle) {
     [handle closeFile];
     RELEASE (handle);
   }
 
+  RELEASE (mapping);
   RELEASE (path);
   RELEASE (cacheDict);
   RELEASE (offsets);
@@ -77,6 +86,14 @@
       return self;
     }
 
+    /* a log left by a crash holds committed pages not yet in place */
+    [DBKWriteAheadLog replayLogAtPath: [path stringByAppendingString: @".wal"]
+                       intoFileHandle: handle];
+    [self open];
+
+    /* reads come from the map, falling back to the handle without it */
+    mapping = [[DBKMappedFile alloc] initWithPath: path];
+
     cacheDict = [NSMutableDictionary new];
     offsets = [NSMutableArray new];
     maxlen = len;
@@ -99,6 +116,10 @@
 
 - (void)close
 {
+  if (wal) {
+    [self checkpoint];
+  }
+
   if (handle) {
     [handle seekToEndOfFile];
     eof = [handle offsetInFile];
@@ -129,6 +150,17 @@
   CREATE_AUTORELEASE_POOL (arp);
   int i;
 
+  if (wal && [offsets count]) {
+    for (i = 0; i < [offsets count]; i++) {
+      NSNumber *offset = [offsets objectAtIndex: i];
+
+      [wal logData: [cacheDict objectForKey: offset]
+          atOffset: [offset unsignedLongValue]];
+    }
+
+    [wal commit];
+  }
+
   for (i = 0; i < [offsets count]; i++) {
     NSNumber *offset = [offsets objectAtIndex: i];
     NSData *data = [cacheDict objectForKey: offset];
@@ -146,18 +178,53 @@
   
   [cacheDict removeAllObjects];
   [offsets removeAllObjects];
+
+  if (wal && [wal needsCheckpoint]) {
+    [self checkpoint];
+  }
     
   RELEASE (arp);
 }
 
+- (void)setWriteAheadLog:(BOOL)value
+{
+  if (value && (wal == nil)) {
+    [self flush];
+    wal = [[DBKWriteAheadLog alloc] initWithPath: 
+                                [path stringByAppendingString: @".wal"]];
+  } else if ((value == NO) && wal) {
+    [self flush];
+    [self checkpoint];
+    [wal close];
+    DESTROY (wal);
+  }
+}
+
+- (BOOL)writeAheadLog
+{
+  return (wal != nil);
+}
+
+- (void)checkpoint
+{
+  if (wal && handle) {
+    [handle synchronizeFile];
+    [wal checkpoint];
+  }
+}
+
 - (NSData *)dataOfLength:(unsigned)length
                 atOffset:(NSNumber *)offset
 {
   NSData *data = [cacheDict objectForKey: offset];
   
   if (data == nil) {
-    [handle seekToFileOffset: [offset unsignedLongValue]];
-    data = [handle readDataOfLength: length];
+    if (mapping) {
+      data = [mapping dataOfLength: length atOffset: [offset unsignedLongValue]];
+    } else {
+      [handle seekToFileOffset: [offset unsignedLongValue]];
+      data = [handle readDataOfLength: length];
+    }
   } 
 
   return data;
@@ -0,0 +1,93 @@
+/* DBKKeyCodec.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_KEY_CODEC_H
+#define DBK_KEY_CODEC_H
+
+#include <Foundation/Foundation.h>
+
+/*
+ * Binary encodings for the keys of a DBKBTree node, for delegates to
+ * return from -keysFromData:withLength: and -dataFromKeys:.
+ *
+ * Every encoding starts with the keys count as an unsigned.  Decoding
+ * reads straight from the bytes of the node data and encoding writes
+ * straight into one buffer of the final size.  The codecs keep no
+ * state, so one instance can serve any number of trees.
+ */
+@interface DBKKeyCodec: NSObject
+{
+}
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen;
+
+- (NSData *)dataFromKeys:(NSArray *)keys;
+
+@end
+
+
+/* NSNumber keys stored as unsigned long. */
+@interface DBKOffsetKeyCodec: DBKKeyCodec
+{
+}
+
++ (DBKOffsetKeyCodec *)sharedCodec;
+
+@end
+
+
+@protocol DBKOffsetPairKey
+
+- (id)initWithFirstValue:(unsigned long)first
+             secondValue:(unsigned long)second;
+
+- (unsigned long)firstValue;
+
+- (unsigned long)secondValue;
+
+@end
+
+/* Keys made of two unsigned long, of a class adopting DBKOffsetPairKey. */
+@interface DBKOffsetPairKeyCodec: DBKKeyCodec
+{
+  Class keyClass;
+}
+
+- (id)initWithKeyClass:(Class)aclass;
+
+@end
+
+
+/* NSString keys stored as UTF-8.  Each key is written as the number of
+   bytes it shares with the previous key of the node, then the length
+   and bytes of the rest, so sorted paths mostly store their last
+   component.  The lengths are 7 bits per byte. */
+@interface DBKStringKeyCodec: DBKKeyCodec
+{
+}
+
++ (DBKStringKeyCodec *)sharedCodec;
+
+@end
+
+#endif // DBK_KEY_CODEC_H
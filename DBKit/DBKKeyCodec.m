@@ -0,0 +1,324 @@
+/* DBKKeyCodec.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#include <string.h>
+
+#import "DBKKeyCodec.h"
+
+#define ULEN (sizeof(unsigned))
+#define LLEN (sizeof(unsigned long))
+
+static unsigned readKeysCount(NSData *data)
+{
+  unsigned kcount = 0;
+
+  if ([data length] >= ULEN) {
+    memcpy(&kcount, [data bytes], ULEN);
+  }
+
+  return kcount;
+}
+
+static void checkLength(NSData *data, NSUInteger needed)
+{
+  if ([data length] < needed) {
+    [NSException raise: NSRangeException
+		            format: @"key data shorter than its keys count"];     
+  }
+}
+
+
+@implementation	DBKKeyCodec
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  [self subclassResponsibility: _cmd];
+  return nil;
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  [self subclassResponsibility: _cmd];
+  return nil;
+}
+
+@end
+
+
+@implementation	DBKOffsetKeyCodec
+
++ (DBKOffsetKeyCodec *)sharedCodec
+{
+  static DBKOffsetKeyCodec *codec = nil;
+
+  if (codec == nil) {
+    codec = [DBKOffsetKeyCodec new];
+  }
+
+  return codec;
+}
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  unsigned kcount = readKeysCount(data);
+  const unsigned char *bytes = [data bytes];
+  NSUInteger pos = ULEN;
+  NSMutableArray *keys;
+  unsigned i;
+
+  checkLength(data, ULEN + (NSUInteger)kcount * LLEN);
+  keys = [NSMutableArray arrayWithCapacity: kcount];
+
+  for (i = 0; i < kcount; i++) {
+    unsigned long key;
+
+    memcpy(&key, bytes + pos, LLEN);
+    [keys addObject: [NSNumber numberWithUnsignedLong: key]];
+    pos += LLEN;
+  }
+
+  *dlen = pos;
+
+  return keys;
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  unsigned kcount = [keys count];
+  NSMutableData *data = [NSMutableData dataWithLength: ULEN + kcount * LLEN];
+  unsigned char *bytes = [data mutableBytes];
+  NSUInteger pos = ULEN;
+  unsigned i;
+
+  memcpy(bytes, &kcount, ULEN);
+
+  for (i = 0; i < kcount; i++) {
+    unsigned long key = [[keys objectAtIndex: i] unsignedLongValue];
+
+    memcpy(bytes + pos, &key, LLEN);
+    pos += LLEN;
+  }
+
+  return data;
+}
+
+@end
+
+
+@implementation	DBKOffsetPairKeyCodec
+
+- (id)initWithKeyClass:(Class)aclass
+{
+  self = [super init];
+
+  if (self) {
+    keyClass = aclass;
+  }
+
+  return self;
+}
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  unsigned kcount = readKeysCount(data);
+  const unsigned char *bytes = [data bytes];
+  NSUInteger pos = ULEN;
+  NSMutableArray *keys;
+  unsigned i;
+
+  checkLength(data, ULEN + (NSUInteger)kcount * LLEN * 2);
+  keys = [NSMutableArray arrayWithCapacity: kcount];
+
+  for (i = 0; i < kcount; i++) {
+    unsigned long first;
+    unsigned long second;
+    id key;
+
+    memcpy(&first, bytes + pos, LLEN);
+    memcpy(&second, bytes + pos + LLEN, LLEN);
+    pos += LLEN * 2;
+
+    key = [[keyClass alloc] initWithFirstValue: first secondValue: second];
+    [keys addObject: key];
+    RELEASE (key);
+  }
+
+  *dlen = pos;
+
+  return keys;
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  unsigned kcount = [keys count];
+  NSMutableData *data = [NSMutableData dataWithLength: ULEN + kcount * LLEN * 2];
+  unsigned char *bytes = [data mutableBytes];
+  NSUInteger pos = ULEN;
+  unsigned i;
+
+  memcpy(bytes, &kcount, ULEN);
+
+  for (i = 0; i < kcount; i++) {
+    id key = [keys objectAtIndex: i];
+    unsigned long first = [key firstValue];
+    unsigned long second = [key secondValue];
+
+    memcpy(bytes + pos, &first, LLEN);
+    memcpy(bytes + pos + LLEN, &second, LLEN);
+    pos += LLEN * 2;
+  }
+
+  return data;
+}
+
+@end
+
+
+static void appendLength(NSMutableData *data, NSUInteger value)
+{
+  unsigned char byte;
+
+  do {
+    byte = value & 0x7f;
+    value >>= 7;
+    if (value) {
+      byte |= 0x80;
+    }
+    [data appendBytes: &byte length: 1];
+  } while (value);
+}
+
+static NSUInteger readLength(const unsigned char *bytes, 
+                             NSUInteger length,
+                             NSUInteger *pos)
+{
+  NSUInteger value = 0;
+  unsigned shift = 0;
+
+  while (1) {
+    unsigned char byte;
+
+    if ((*pos >= length) || (shift >= (sizeof(NSUInteger) * 8))) {
+      [NSException raise: NSRangeException
+		              format: @"truncated key length"];     
+    }
+
+    byte = bytes[(*pos)++];
+    value |= (NSUInteger)(byte & 0x7f) << shift;
+
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+    shift += 7;
+  }
+
+  return value;
+}
+
+@implementation	DBKStringKeyCodec
+
++ (DBKStringKeyCodec *)sharedCodec
+{
+  static DBKStringKeyCodec *codec = nil;
+
+  if (codec == nil) {
+    codec = [DBKStringKeyCodec new];
+  }
+
+  return codec;
+}
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  unsigned kcount = readKeysCount(data);
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  NSUInteger pos = ULEN;
+  NSMutableData *keydata;
+  NSMutableArray *keys;
+  unsigned i;
+
+  checkLength(data, ULEN + (NSUInteger)kcount * 2);
+  keys = [NSMutableArray arrayWithCapacity: kcount];
+  keydata = [NSMutableData dataWithCapacity: 256];
+
+  for (i = 0; i < kcount; i++) {
+    NSUInteger shared = readLength(bytes, length, &pos);
+    NSUInteger suffix = readLength(bytes, length, &pos);
+    NSString *key;
+
+    if ((shared > [keydata length]) || (suffix > (length - pos))) {
+      [NSException raise: NSRangeException
+		              format: @"truncated key data"];     
+    }
+
+    [keydata setLength: shared];
+    [keydata appendBytes: bytes + pos length: suffix];
+    pos += suffix;
+
+    key = [[NSString alloc] initWithBytes: [keydata bytes]
+                                   length: [keydata length]
+                                 encoding: NSUTF8StringEncoding];
+    [keys addObject: key];
+    RELEASE (key);
+  }
+
+  *dlen = pos;
+
+  return keys;
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  unsigned kcount = [keys count];
+  NSMutableData *data = [NSMutableData dataWithCapacity: ULEN + kcount * 16];
+  const char *prev = NULL;
+  NSUInteger prevlen = 0;
+  unsigned i;
+
+  [data appendBytes: &kcount length: ULEN];
+
+  for (i = 0; i < kcount; i++) {
+    const char *utf = [[keys objectAtIndex: i] UTF8String];
+    NSUInteger len = strlen(utf);
+    NSUInteger shared = 0;
+
+    while ((shared < len) && (shared < prevlen) && (utf[shared] == prev[shared])) {
+      shared++;
+    }
+
+    appendLength(data, shared);
+    appendLength(data, len - shared);
+    [data appendBytes: utf + shared length: len - shared];
+
+    prev = utf;
+    prevlen = len;
+  }
+
+  return data;
+}
+
+@end
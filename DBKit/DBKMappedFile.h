@@ -0,0 +1,62 @@
+/* DBKMappedFile.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_MAPPED_FILE_H
+#define DBK_MAPPED_FILE_H
+
+#include <Foundation/Foundation.h>
+
+@class DBKMappedRegion;
+
+/*
+ * Read-only memory map of a records file.
+ *
+ * Data is returned as NSData pointing into the mapping, with no copy.
+ * Each data retains the region it points into, so it stays valid after
+ * the file grows and is mapped again, or after -close.  Writes go
+ * through the owner's file handle as before.  The mapping is shared,
+ * so a data reflects later writes to the same offset: callers that keep
+ * one across a flush must copy it.
+ */
+@interface DBKMappedFile: NSObject 
+{
+  int fd;
+  DBKMappedRegion *region;
+}
+
+/** Returns nil if the file cannot be opened. */
+- (id)initWithPath:(NSString *)path;
+
+/** Up to length bytes at offset, less at the end of the file. */
+- (NSData *)dataOfLength:(NSUInteger)length
+                atOffset:(unsigned long)offset;
+
+/** Copies exactly length bytes at offset, or returns NO. */
+- (BOOL)getBytes:(void *)bytes
+          length:(NSUInteger)length
+        atOffset:(unsigned long)offset;
+
+- (void)close;
+
+@end
+
+#endif // DBK_MAPPED_FILE_H
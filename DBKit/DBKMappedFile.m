@@ -0,0 +1,223 @@
+/* DBKMappedFile.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#import "DBKMappedFile.h"
+
+@interface DBKMappedRegion: NSObject
+{
+@public
+  void *addr;
+  NSUInteger length;
+}
+
+- (id)initWithDescriptor:(int)fd
+                  length:(NSUInteger)len;
+
+@end
+
+@implementation	DBKMappedRegion
+
+- (void)dealloc
+{
+  if (addr) {
+    munmap(addr, length);
+  }
+
+  [super dealloc];
+}
+
+- (id)initWithDescriptor:(int)fd
+                  length:(NSUInteger)len
+{
+  self = [super init];
+
+  if (self) {
+    addr = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+
+    if (addr == MAP_FAILED) {
+      addr = NULL;
+      DESTROY (self);
+      return nil;
+    }
+
+    length = len;
+  }
+
+  return self;
+}
+
+@end
+
+
+/* NSData over a part of a region. */
+@interface DBKMappedData: NSData
+{
+  DBKMappedRegion *region;
+  const void *start;
+  NSUInteger size;
+}
+
+- (id)initWithRegion:(DBKMappedRegion *)reg
+               range:(NSRange)range;
+
+@end
+
+@implementation	DBKMappedData
+
+- (void)dealloc
+{
+  RELEASE (region);
+  [super dealloc];
+}
+
+- (id)initWithRegion:(DBKMappedRegion *)reg
+               range:(NSRange)range
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (region, reg);
+    start = (const char *)reg->addr + range.location;
+    size = range.length;
+  }
+
+  return self;
+}
+
+- (const void *)bytes
+{
+  return start;
+}
+
+- (NSUInteger)length
+{
+  return size;
+}
+
+@end
+
+
+@implementation	DBKMappedFile
+
+- (void)dealloc
+{
+  [self close];
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)path
+{
+  self = [super init];
+
+  if (self) {
+    fd = open([path fileSystemRepresentation], O_RDONLY);
+
+    if (fd < 0) {
+      DESTROY (self);
+      return nil;
+    }
+
+    region = nil;
+  }
+
+  return self;
+}
+
+- (void)close
+{
+  DESTROY (region);
+
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+/* Maps the file again if it grew past the end of the region. */
+- (BOOL)mapThrough:(unsigned long)end
+{
+  struct stat st;
+  DBKMappedRegion *reg;
+
+  if (region && (end <= region->length)) {
+    return YES;
+  }
+
+  if ((fd < 0) || (fstat(fd, &st) != 0) || (st.st_size == 0)) {
+    return NO;
+  }
+
+  if (region && ((unsigned long)st.st_size <= region->length)) {
+    return NO;
+  }
+
+  reg = [[DBKMappedRegion alloc] initWithDescriptor: fd 
+                                             length: (NSUInteger)st.st_size];
+
+  if (reg == nil) {
+    return NO;
+  }
+
+  ASSIGN (region, reg);
+  RELEASE (reg);
+
+  return (end <= region->length);
+}
+
+- (NSData *)dataOfLength:(NSUInteger)length
+                atOffset:(unsigned long)offset
+{
+  NSUInteger avail;
+
+  [self mapThrough: offset + length];
+
+  if ((region == nil) || (offset >= region->length)) {
+    return [NSData data];
+  }
+
+  avail = region->length - offset;
+
+  return AUTORELEASE ([[DBKMappedData alloc] initWithRegion: region
+                          range: NSMakeRange(offset, (length < avail) ? length : avail)]);
+}
+
+- (BOOL)getBytes:(void *)bytes
+          length:(NSUInteger)length
+        atOffset:(unsigned long)offset
+{
+  if ([self mapThrough: offset + length] == NO) {
+    return NO;
+  }
+
+  memcpy(bytes, (const char *)region->addr + offset, length);
+
+  return YES;
+}
+
+@end
@@ -0,0 +1,111 @@
+/* DBKRadixPathsTree.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_RADIX_PATHS_TREE_H
+#define DBK_RADIX_PATHS_TREE_H
+
+#include <Foundation/Foundation.h>
+
+/*
+ * The paths tree of DBKPathsTree.h as a radix trie.
+ *
+ * A path is the UTF-8 bytes of its components, each one ended by a
+ * zero byte, so a component ends where a zero byte does.  The edges
+ * hold byte strings and a node is only made where paths branch, end,
+ * or have been inserted a different number of times, so a chain of
+ * single subdirectories is one edge.  The nodes live in one array and
+ * refer to each other by index; the edge labels live in one buffer.
+ * The path is split on '/' directly, without -pathComponents: empty
+ * components and a trailing '/' are ignored.
+ */
+
+typedef struct _radixnode
+{
+  unsigned offset;        /* of the edge label in the labels buffer */
+  unsigned length;
+  unsigned child;         /* first child, 0 for none */
+  unsigned next;          /* next sibling, by first byte */
+  unsigned parent;
+  int ins_count;
+  unsigned last_path_comp;
+} radixnode;
+
+typedef struct _radixtree
+{
+  id identifier;
+  radixnode *nodes;       /* nodes[0] is the root */
+  unsigned count;
+  unsigned capacity;
+  unsigned free_nodes;    /* chained by next */
+  unsigned char *labels;
+  unsigned labels_length;
+  unsigned labels_capacity;
+  unsigned garbage;       /* label bytes no node refers to */
+} radixtree;
+
+
+@interface DBKRadixPathsTree: NSObject 
+{
+  radixtree *tree;
+  id identifier;
+}
+
+- (id)initWithIdentifier:(id)ident;
+
+- (id)identifier;
+
+- (void)insertComponentsOfPath:(NSString *)path;
+
+- (void)removeComponentsOfPath:(NSString *)path;
+
+- (void)emptyTree;
+
+- (BOOL)inTreeFullPath:(NSString *)path;
+
+- (BOOL)inTreeFirstPartOfPath:(NSString *)path;
+
+- (BOOL)containsElementsOfPath:(NSString *)path;
+
+- (NSArray *)paths;
+
+@end
+
+
+radixtree *newRadixTreeWithIdentifier(id identifier);
+
+void radixInsertComponentsOfPath(NSString *path, radixtree *tree);
+
+void radixRemoveComponentsOfPath(NSString *path, radixtree *tree);
+
+void radixEmptyTree(radixtree *tree);
+
+void radixFreeTree(radixtree *tree);
+
+BOOL radixFullPathInTree(NSString *path, radixtree *tree);
+
+BOOL radixInTreeFirstPartOfPath(NSString *path, radixtree *tree);
+
+BOOL radixContainsElementsOfPath(NSString *path, radixtree *tree);
+
+NSArray *radixPathsOfTree(radixtree *tree);
+
+#endif // DBK_RADIX_PATHS_TREE_H
@@ -0,0 +1,728 @@
+/* DBKRadixPathsTree.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#include <string.h>
+
+#import "DBKRadixPathsTree.h"
+
+#define NODES_CAPACITY 64
+#define LABELS_CAPACITY 1024
+#define KEY_BUFLEN 512
+#define MIN_GARBAGE 4096
+
+static unsigned char *keyOfPath(NSString *path, unsigned char *buf, unsigned *keylen);
+static unsigned walkKey(radixtree *tree, const unsigned char *key, unsigned len,
+                        unsigned *node, unsigned *inedge);
+static unsigned findChild(radixtree *tree, unsigned node, unsigned char byte, unsigned *prev);
+static unsigned newNode(radixtree *tree);
+static void releaseNode(radixtree *tree, unsigned node);
+static void ensureLabels(radixtree *tree, unsigned length);
+static void unlinkChild(radixtree *tree, unsigned node);
+static unsigned splitNode(radixtree *tree, unsigned node, unsigned length);
+static void compressNode(radixtree *tree, unsigned node);
+static void compactLabels(radixtree *tree);
+static void appendNodePaths(radixtree *tree, unsigned node, 
+                            NSMutableData *key, NSMutableArray *keys);
+
+@implementation DBKRadixPathsTree
+
+- (void)dealloc
+{
+  radixFreeTree(tree);
+  RELEASE (identifier);
+
+  [super dealloc];
+}
+
+- (id)initWithIdentifier:(id)ident
+{
+  self = [super init];
+  
+  if (self) {
+    ASSIGN (identifier, ident);
+    tree = newRadixTreeWithIdentifier(identifier);
+  }
+  
+  return self;
+}
+
+- (id)identifier
+{
+  return identifier;
+}
+
+- (NSUInteger)hash
+{
+  return [identifier hash];
+}
+
+- (BOOL)isEqual:(id)other
+{
+  if (other == self) {
+    return YES;
+  }
+  if ([other isKindOfClass: [DBKRadixPathsTree class]]) {
+    return [identifier isEqual: [other identifier]];
+  }
+  return NO;
+}
+
+- (void)insertComponentsOfPath:(NSString *)path
+{
+  radixInsertComponentsOfPath(path, tree);
+}
+
+- (void)removeComponentsOfPath:(NSString *)path
+{
+  radixRemoveComponentsOfPath(path, tree);
+}
+
+- (void)emptyTree
+{
+  radixEmptyTree(tree);
+}
+
+- (BOOL)inTreeFullPath:(NSString *)path
+{
+  return radixFullPathInTree(path, tree);
+}
+
+- (BOOL)inTreeFirstPartOfPath:(NSString *)path
+{
+  return radixInTreeFirstPartOfPath(path, tree);
+}
+
+- (BOOL)containsElementsOfPath:(NSString *)path
+{
+  return radixContainsElementsOfPath(path, tree);
+}
+
+- (NSArray *)paths
+{
+  return radixPathsOfTree(tree);
+}
+
+@end
+
+
+radixtree *newRadixTreeWithIdentifier(id identifier)
+{
+  if (identifier) {
+    radixtree *tree = NSZoneCalloc(NSDefaultMallocZone(), 1, sizeof(radixtree));
+
+    tree->identifier = [identifier retain];
+    tree->nodes = NSZoneCalloc(NSDefaultMallocZone(), NODES_CAPACITY, sizeof(radixnode));
+    tree->capacity = NODES_CAPACITY;
+    tree->count = 1;
+    tree->free_nodes = 0;
+    tree->labels = NSZoneMalloc(NSDefaultMallocZone(), LABELS_CAPACITY);
+    tree->labels_capacity = LABELS_CAPACITY;
+    tree->labels_length = 0;
+    tree->garbage = 0;
+
+    return tree;
+  }
+
+  return NULL;
+}
+
+void radixInsertComponentsOfPath(NSString *path, radixtree *tree)
+{
+  unsigned char buf[KEY_BUFLEN];
+  unsigned len;
+  unsigned char *key = keyOfPath(path, buf, &len);
+  unsigned node, inedge, pos;
+
+  pos = walkKey(tree, key, len, &node, &inedge);
+
+  if (inedge < tree->nodes[node].length) {
+    node = splitNode(tree, node, inedge);
+  }
+
+  if (pos < len) {
+    unsigned leaf = newNode(tree);
+    unsigned prev;
+
+    ensureLabels(tree, len - pos);
+    memcpy(tree->labels + tree->labels_length, key + pos, len - pos);
+
+    tree->nodes[leaf].offset = tree->labels_length;
+    tree->nodes[leaf].length = len - pos;
+    tree->nodes[leaf].parent = node;
+    tree->labels_length += len - pos;
+
+    findChild(tree, node, key[pos], &prev);
+
+    if (prev == 0) {
+      tree->nodes[leaf].next = tree->nodes[node].child;
+      tree->nodes[node].child = leaf;
+    } else {
+      tree->nodes[leaf].next = tree->nodes[prev].next;
+      tree->nodes[prev].next = leaf;
+    }
+
+    node = leaf;
+  }
+
+  tree->nodes[node].last_path_comp = 1;
+
+  while (node) {
+    tree->nodes[node].ins_count++;
+    node = tree->nodes[node].parent;
+  }
+
+  if (key != buf) {
+    NSZoneFree(NSDefaultMallocZone(), key);
+  }
+}
+
+void radixRemoveComponentsOfPath(NSString *path, radixtree *tree)
+{
+  unsigned char buf[KEY_BUFLEN];
+  unsigned len;
+  unsigned char *key = keyOfPath(path, buf, &len);
+  unsigned node, inedge, pos, end;
+
+  pos = walkKey(tree, key, len, &node, &inedge);
+
+  /* the components found, as for the components tree */
+  end = pos;
+  while ((end > 0) && (key[end - 1] != 0)) {
+    end--;
+  }
+
+  if (end > 0) {
+    if (end < pos) {
+      walkKey(tree, key, end, &node, &inedge);
+    }
+
+    if (inedge < tree->nodes[node].length) {
+      node = splitNode(tree, node, inedge);
+    }
+
+    if (end == len) {
+      tree->nodes[node].last_path_comp = 0;
+    }
+
+    pos = node;
+    while (pos) {
+      tree->nodes[pos].ins_count--;
+      pos = tree->nodes[pos].parent;
+    }
+
+    while (node && (tree->nodes[node].child == 0) 
+                        && (tree->nodes[node].ins_count <= 0)) {
+      unsigned parent = tree->nodes[node].parent;
+
+      unlinkChild(tree, node);
+      tree->garbage += tree->nodes[node].length;
+      releaseNode(tree, node);
+      node = parent;
+    }
+
+    while (node) {
+      compressNode(tree, node);
+      node = tree->nodes[node].parent;
+    }
+
+    if ((tree->garbage > MIN_GARBAGE) 
+                    && ((tree->garbage * 2) > tree->labels_length)) {
+      compactLabels(tree);
+    }
+  }
+
+  if (key != buf) {
+    NSZoneFree(NSDefaultMallocZone(), key);
+  }
+}
+
+void radixEmptyTree(radixtree *tree)
+{
+  memset(tree->nodes, 0, sizeof(radixnode));
+  tree->count = 1;
+  tree->free_nodes = 0;
+  tree->labels_length = 0;
+  tree->garbage = 0;
+}
+
+void radixFreeTree(radixtree *tree)
+{
+  if (tree) {
+    DESTROY (tree->identifier);
+    NSZoneFree(NSDefaultMallocZone(), tree->nodes);
+    NSZoneFree(NSDefaultMallocZone(), tree->labels);
+    NSZoneFree(NSDefaultMallocZone(), tree);
+  }
+}
+
+BOOL radixFullPathInTree(NSString *path, radixtree *tree)
+{
+  unsigned char buf[KEY_BUFLEN];
+  unsigned len;
+  unsigned char *key = keyOfPath(path, buf, &len);
+  unsigned node, inedge;
+  BOOL found;
+
+  found = ((len > 0) && (walkKey(tree, key, len, &node, &inedge) == len)
+                     && (inedge == tree->nodes[node].length)
+                     && tree->nodes[node].last_path_comp);
+
+  if (key != buf) {
+    NSZoneFree(NSDefaultMallocZone(), key);
+  }
+
+  return found;
+}
+
+/*
+  As inTreeFirstPartOfPath(): a leaf edge always ends with a component,
+  so the path is in if it goes through the end of a leaf.
+*/
+BOOL radixInTreeFirstPartOfPath(NSString *path, radixtree *tree)
+{
+  unsigned char buf[KEY_BUFLEN];
+  unsigned len;
+  unsigned char *key = keyOfPath(path, buf, &len);
+  radixnode *nodes = tree->nodes;
+  const unsigned char *labels = tree->labels;
+  unsigned node = 0;
+  unsigned pos = 0;
+  BOOL found = NO;
+
+  while (pos < len) {
+    unsigned child = findChild(tree, node, key[pos], NULL);
+    unsigned length, i;
+
+    if (child == 0) {
+      break;
+    }
+
+    node = child;
+    length = nodes[node].length;
+
+    if ((len - pos) < length) {
+      break;
+    }
+
+    for (i = 1; i < length; i++) {
+      if (labels[nodes[node].offset + i] != key[pos + i]) {
+        break;
+      }
+    }
+
+    if (i < length) {
+      break;
+    }
+
+    pos += length;
+
+    if (nodes[node].child == 0) {
+      found = YES;
+      break;
+    }
+  }
+
+  if (key != buf) {
+    NSZoneFree(NSDefaultMallocZone(), key);
+  }
+
+  return found;
+}
+
+BOOL radixContainsElementsOfPath(NSString *path, radixtree *tree)
+{
+  unsigned char buf[KEY_BUFLEN];
+  unsigned len;
+  unsigned char *key = keyOfPath(path, buf, &len);
+  unsigned node, inedge;
+  BOOL found = (walkKey(tree, key, len, &node, &inedge) == len);
+
+  if (key != buf) {
+    NSZoneFree(NSDefaultMallocZone(), key);
+  }
+
+  return found;
+}
+
+NSArray *radixPathsOfTree(radixtree *tree)
+{
+  NSMutableArray *keys = [NSMutableArray array];
+  NSMutableArray *paths = [NSMutableArray array];
+  NSMutableSet *firsts = [NSMutableSet set];
+  NSMutableArray *allcomps = [NSMutableArray array];
+  unsigned i;
+
+  appendNodePaths(tree, 0, [NSMutableData data], keys);
+
+  for (i = 0; i < [keys count]; i++) {
+    NSData *key = [keys objectAtIndex: i];
+    const char *bytes = [key bytes];
+    unsigned length = [key length];
+    NSMutableArray *comps = [NSMutableArray array];
+    unsigned start = 0;
+    unsigned j;
+
+    for (j = 0; j < length; j++) {
+      if (bytes[j] == 0) {
+        [comps addObject: [NSString stringWithUTF8String: bytes + start]];
+        start = j + 1;
+      }
+    }
+
+    if ([comps count]) {
+      [firsts addObject: [comps objectAtIndex: 0]];
+      [allcomps addObject: comps];
+    }
+  }
+
+  /* as pathsOfTreeWithBase(), the identifier leads when there
+     is more than one first component */
+  for (i = 0; i < [allcomps count]; i++) {
+    NSArray *comps = [allcomps objectAtIndex: i];
+    NSString *path;
+    unsigned j = 0;
+
+    if ([firsts count] == 1) {
+      path = [comps objectAtIndex: 0];
+      j = 1;
+    } else {
+      path = [NSString stringWithString: [tree->identifier description]];
+    }
+
+    for (; j < [comps count]; j++) {
+      path = [path stringByAppendingPathComponent: [comps objectAtIndex: j]];
+    }
+
+    [paths addObject: path];
+  }
+
+  return (([paths count] > 0) ? [paths makeImmutableCopyOnFail: NO] : nil);
+}
+
+/*
+  "/usr//local" gives "/" 0 "usr" 0 "local" 0, which is never longer
+  than the UTF-8 string plus two bytes.
+*/
+static unsigned char *keyOfPath(NSString *path, unsigned char *buf, unsigned *keylen)
+{
+  const char *str = [path UTF8String];
+  size_t slen = strlen(str);
+  unsigned char *key = buf;
+  unsigned k = 0;
+  size_t i = 0;
+
+  if ((slen + 2) > KEY_BUFLEN) {
+    key = NSZoneMalloc(NSDefaultMallocZone(), slen + 2);
+  }
+
+  if (str[0] == '/') {
+    key[k++] = '/';
+    key[k++] = 0;
+  }
+
+  while (i < slen) {
+    if (str[i] == '/') {
+      i++;
+    } else {
+      while ((i < slen) && (str[i] != '/')) {
+        key[k++] = str[i++];
+      }
+      key[k++] = 0;
+    }
+  }
+
+  *keylen = k;
+
+  return key;
+}
+
+/*
+  Follows the key as far as it goes.  Returns the bytes matched, with
+  the last node reached and the bytes matched of its edge.
+*/
+static unsigned walkKey(radixtree *tree, const unsigned char *key, unsigned len,
+                        unsigned *node, unsigned *inedge)
+{
+  radixnode *nodes = tree->nodes;
+  const unsigned char *labels = tree->labels;
+  unsigned n = 0;
+  unsigned in = 0;
+  unsigned pos = 0;
+
+  while (pos < len) {
+    if (in < nodes[n].length) {
+      if (labels[nodes[n].offset + in] != key[pos]) {
+        break;
+      }
+      in++;
+      pos++;
+    } else {
+      unsigned child = findChild(tree, n, key[pos], NULL);
+
+      if (child == 0) {
+        break;
+      }
+
+      n = child;
+      in = 0;
+    }
+  }
+
+  *node = n;
+  *inedge = in;
+
+  return pos;
+}
+
+/*
+  The children are ordered by their first byte.  prev gets the child
+  after which one starting with byte would go.
+*/
+static unsigned findChild(radixtree *tree, unsigned node, unsigned char byte, unsigned *prev)
+{
+  radixnode *nodes = tree->nodes;
+  unsigned child = nodes[node].child;
+  unsigned last = 0;
+
+  while (child) {
+    unsigned char first = tree->labels[nodes[child].offset];
+
+    if (first == byte) {
+      break;
+    } else if (first > byte) {
+      child = 0;
+      break;
+    }
+
+    last = child;
+    child = nodes[child].next;
+  }
+
+  if (prev) {
+    *prev = last;
+  }
+
+  return child;
+}
+
+static unsigned newNode(radixtree *tree)
+{
+  unsigned node;
+
+  if (tree->free_nodes) {
+    node = tree->free_nodes;
+    tree->free_nodes = tree->nodes[node].next;
+
+  } else {
+    if (tree->count == tree->capacity) {
+      radixnode *ptr;
+
+      ptr = NSZoneRealloc(NSDefaultMallocZone(), tree->nodes, 
+                                tree->capacity * 2 * sizeof(radixnode));
+
+      if (ptr == 0) {
+        [NSException raise: NSMallocException format: @"Unable to grow tree"];
+      } 
+
+      tree->nodes = ptr;
+      tree->capacity *= 2;
+    }
+
+    node = tree->count++;
+  }
+
+  memset(&tree->nodes[node], 0, sizeof(radixnode));
+
+  return node;
+}
+
+static void releaseNode(radixtree *tree, unsigned node)
+{
+  tree->nodes[node].next = tree->free_nodes;
+  tree->free_nodes = node;
+}
+
+static void ensureLabels(radixtree *tree, unsigned length)
+{
+  if ((tree->labels_length + length) > tree->labels_capacity) {
+    unsigned capacity = tree->labels_capacity * 2;
+    unsigned char *ptr;
+
+    while (capacity < (tree->labels_length + length)) {
+      capacity *= 2;
+    }
+
+    ptr = NSZoneRealloc(NSDefaultMallocZone(), tree->labels, capacity);
+
+    if (ptr == 0) {
+      [NSException raise: NSMallocException format: @"Unable to grow tree"];
+    } 
+
+    tree->labels = ptr;
+    tree->labels_capacity = capacity;
+  }
+}
+
+static void unlinkChild(radixtree *tree, unsigned node)
+{
+  radixnode *nodes = tree->nodes;
+  unsigned parent = nodes[node].parent;
+
+  if (nodes[parent].child == node) {
+    nodes[parent].child = nodes[node].next;
+  } else {
+    unsigned prev = nodes[parent].child;
+
+    while (nodes[prev].next != node) {
+      prev = nodes[prev].next;
+    }
+
+    nodes[prev].next = nodes[node].next;
+  }
+}
+
+/*
+  Puts a new node for the first length bytes of the edge of node
+  between it and its parent, and returns it.
+*/
+static unsigned splitNode(radixtree *tree, unsigned node, unsigned length)
+{
+  unsigned upper = newNode(tree);
+  radixnode *nodes = tree->nodes;
+  unsigned parent = nodes[node].parent;
+
+  nodes[upper].offset = nodes[node].offset;
+  nodes[upper].length = length;
+  nodes[upper].child = node;
+  nodes[upper].next = nodes[node].next;
+  nodes[upper].parent = parent;
+  nodes[upper].ins_count = nodes[node].ins_count;
+  nodes[upper].last_path_comp = 0;
+
+  if (nodes[parent].child == node) {
+    nodes[parent].child = upper;
+  } else {
+    unsigned prev = nodes[parent].child;
+
+    while (nodes[prev].next != node) {
+      prev = nodes[prev].next;
+    }
+
+    nodes[prev].next = upper;
+  }
+
+  nodes[node].offset += length;
+  nodes[node].length -= length;
+  nodes[node].parent = upper;
+  nodes[node].next = 0;
+
+  return upper;
+}
+
+/*
+  Joins the only child of node to it when nothing tells them apart.
+*/
+static void compressNode(radixtree *tree, unsigned node)
+{
+  radixnode *nodes = tree->nodes;
+  unsigned child = nodes[node].child;
+  unsigned sub;
+
+  if ((child == 0) || nodes[child].next || nodes[node].last_path_comp
+                   || (nodes[node].ins_count != nodes[child].ins_count)) {
+    return;
+  }
+
+  if ((nodes[node].offset + nodes[node].length) != nodes[child].offset) {
+    unsigned length = nodes[node].length + nodes[child].length;
+
+    ensureLabels(tree, length);
+    memcpy(tree->labels + tree->labels_length, 
+                    tree->labels + nodes[node].offset, nodes[node].length);
+    memcpy(tree->labels + tree->labels_length + nodes[node].length, 
+                    tree->labels + nodes[child].offset, nodes[child].length);
+
+    nodes[node].offset = tree->labels_length;
+    tree->labels_length += length;
+    tree->garbage += length;
+  }
+
+  nodes[node].length += nodes[child].length;
+  nodes[node].child = nodes[child].child;
+  nodes[node].last_path_comp = nodes[child].last_path_comp;
+
+  for (sub = nodes[node].child; sub; sub = nodes[sub].next) {
+    nodes[sub].parent = node;
+  }
+
+  releaseNode(tree, child);
+}
+
+static void compactLabels(radixtree *tree)
+{
+  radixnode *nodes = tree->nodes;
+  unsigned char *labels = NSZoneMalloc(NSDefaultMallocZone(), tree->labels_capacity);
+  unsigned length = 0;
+  unsigned node = nodes[0].child;
+
+  while (node) {
+    memcpy(labels + length, tree->labels + nodes[node].offset, nodes[node].length);
+    nodes[node].offset = length;
+    length += nodes[node].length;
+
+    if (nodes[node].child) {
+      node = nodes[node].child;
+    } else {
+      while (node && (nodes[node].next == 0)) {
+        node = nodes[node].parent;
+      }
+      if (node) {
+        node = nodes[node].next;
+      }
+    }
+  }
+
+  NSZoneFree(NSDefaultMallocZone(), tree->labels);
+  tree->labels = labels;
+  tree->labels_length = length;
+  tree->garbage = 0;
+}
+
+static void appendNodePaths(radixtree *tree, unsigned node, 
+                            NSMutableData *key, NSMutableArray *keys)
+{
+  unsigned length = [key length];
+  unsigned child;
+
+  [key appendBytes: tree->labels + tree->nodes[node].offset 
+            length: tree->nodes[node].length];
+
+  if (tree->nodes[node].last_path_comp && [key length]) {
+    [keys addObject: [NSData dataWithData: key]];
+  }
+
+  for (child = tree->nodes[node].child; child; child = tree->nodes[child].next) {
+    appendNodePaths(tree, child, key, keys);
+  }
+
+  [key setLength: length];
+}
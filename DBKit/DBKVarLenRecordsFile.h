@@ -27,6 +27,10 @@
 
 #include <Foundation/Foundation.h>
 #include "DBKBTree.h"
+#include "DBKKeyCodec.h"
+
+@class DBKMappedFile;
+@class DBKWriteAheadLog;
 
 @class DBKBFreeNodeEntry;
 
@@ -35,11 +39,17 @@
   NSMutableDictionary *cacheDict;
   NSMutableArray *offsets;
   NSFileHandle *handle;
+  DBKMappedFile *mapping;
+  NSString *logPath;
+  DBKWriteAheadLog *wal;
   unsigned long eof;
   unsigned maxlen;  
   BOOL autoflush;  
 
-  DBKBTree *freeOffsetsTree;
+  DBKBTree *freeOffsetsTree;   /* free extents by length */
+  DBKBTree *freeExtentsTree;   /* the same extents by offset */
+  id extentsDelegate;
+  DBKOffsetPairKeyCodec *keyCodec;
   
   unsigned ulen;
   unsigned llen;
@@ -56,6 +66,14 @@
 
 - (void)flush;
 
+/** Logs each flush before it is written in place, as does
+    DBKFixLenRecordsFile.  The free space trees get their own logs. */
+- (void)setWriteAheadLog:(BOOL)value;
+
+- (BOOL)writeAheadLog;
+
+- (void)checkpoint;
+
 - (NSData *)dataAtOffset:(NSNumber *)offset;
 
 - (NSNumber *)writeData:(NSData *)data;
@@ -71,10 +89,18 @@
 
 - (NSNumber *)freeOffsetForData:(NSData *)data;
 
+/** Frees the extent, merged with the free extents around it. */
+- (void)addFreeExtent:(DBKBFreeNodeEntry *)entry;
+
+/** extents, freeBytes, largestExtent, fileSize, fragmentation (the
+    share of free bytes outside the largest extent) and sizeClasses,
+    where item k counts the extents of 2^k to 2^(k+1) - 1 bytes. */
+- (NSDictionary *)fragmentationReport;
+
 @end
 
 
-@interface DBKBFreeNodeEntry: NSObject 
+@interface DBKBFreeNodeEntry: NSObject <DBKOffsetPairKey>
 {
   NSNumber *lengthNum;
   NSNumber *offsetNum;
@@ -94,6 +120,8 @@
 
 - (unsigned long)offset;
 
+- (NSComparisonResult)compareOffset:(DBKBFreeNodeEntry *)entry;
+
 @end
 
 #endif // DBK_VAR_LEN_RECORDS_FILE_H
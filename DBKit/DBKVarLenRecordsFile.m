@@ -24,18 +24,51 @@
 
 #import "DBKVarLenRecordsFile.h"
 #import "DBKBTreeNode.h"
+#import "DBKMappedFile.h"
+#import "DBKBTreeCursor.h"
+#import "DBKWriteAheadLog.h"
 
 #define FIRST_OFFSET 512
+#define MIN_EXTENT 32
+
+/* Orders the free extents tree by offset alone. */
+@interface DBKFreeExtentsDelegate: NSObject <DBKBTreeDelegate>
+{
+  DBKOffsetPairKeyCodec *keyCodec;
+}
+
+- (id)initWithCodec:(DBKOffsetPairKeyCodec *)codec;
+
+@end
+
+@interface DBKVarLenRecordsFile (FreeExtents)
+
+- (void)buildFreeExtentsTree;
+
+- (unsigned long)appendOffset;
+
+@end
 
 @implementation	DBKVarLenRecordsFile
 
 - (void)dealloc
 {
+  if (wal) {
+    [self checkpoint];
+    [wal close];
+    RELEASE (wal);
+  }
+  RELEASE (logPath);
+
   if (handle) {
     [handle closeFile];
     RELEASE (handle);
   }
+  RELEASE (mapping);
   RELEASE (freeOffsetsTree);
+  RELEASE (freeExtentsTree);
+  RELEASE (extentsDelegate);
+  RELEASE (keyCodec);
 
   RELEASE (cacheDict);
   RELEASE (offsets);
@@ -74,6 +107,7 @@
     } else {
       NSString *recordsPath = [path stringByAppendingPathComponent: @"records"];
       NSString *freePath = [path stringByAppendingPathComponent: @"free"];
+      NSString *extentsPath = [path stringByAppendingPathComponent: @"extents"];
 
       exists = [fm fileExistsAtPath: recordsPath isDirectory: &isdir];
 
@@ -101,6 +135,10 @@
 
       handle = [NSFileHandle fileHandleForUpdatingAtPath: recordsPath];
       RETAIN (handle);
+
+      ASSIGN (logPath, [recordsPath stringByAppendingString: @".wal"]);
+      [DBKWriteAheadLog replayLogAtPath: logPath intoFileHandle: handle];
+      [handle seekToFileOffset: 0];
       
       [data setLength: FIRST_OFFSET];
       [handle writeData: data];
@@ -108,9 +146,18 @@
       [handle seekToEndOfFile];
       eof = [handle offsetInFile];
 
+      mapping = [[DBKMappedFile alloc] initWithPath: recordsPath];
+
+      keyCodec = [[DBKOffsetPairKeyCodec alloc] initWithKeyClass: [DBKBFreeNodeEntry class]];
       freeOffsetsTree = [[DBKBTree alloc] initWithPath: freePath 
                                                  order: 16 
                                               delegate: self];
+
+      extentsDelegate = [[DBKFreeExtentsDelegate alloc] initWithCodec: keyCodec];
+      freeExtentsTree = [[DBKBTree alloc] initWithPath: extentsPath 
+                                                 order: 16 
+                                              delegate: extentsDelegate];
+      [self buildFreeExtentsTree];
     }
   }
   
@@ -138,6 +185,24 @@
 {
   int i;
 
+  if (wal && [offsets count]) {
+    for (i = 0; i < [offsets count]; i++) {
+      CREATE_AUTORELEASE_POOL (arp);
+      NSNumber *offset = [offsets objectAtIndex: i];
+      NSData *dictdata = [cacheDict objectForKey: offset];
+      unsigned datalen = [dictdata length];  
+      NSMutableData *data = [NSMutableData dataWithCapacity: 1];
+
+      [data appendBytes: &datalen length: ulen];
+      [data appendData: dictdata];
+      [wal logData: data atOffset: [offset unsignedLongValue]];
+
+      RELEASE (arp);
+    }
+
+    [wal commit];
+  }
+
   for (i = 0; i < [offsets count]; i++) {
     CREATE_AUTORELEASE_POOL (arp);
     NSNumber *offset = [offsets objectAtIndex: i];
@@ -163,6 +228,42 @@
   
   [cacheDict removeAllObjects];
   [offsets removeAllObjects];
+
+  if (wal && [wal needsCheckpoint]) {
+    [self checkpoint];
+  }
+}
+
+- (void)setWriteAheadLog:(BOOL)value
+{
+  if (value && (wal == nil)) {
+    [self flush];
+    wal = [[DBKWriteAheadLog alloc] initWithPath: logPath];
+  } else if ((value == NO) && wal) {
+    [self flush];
+    [self checkpoint];
+    [wal close];
+    DESTROY (wal);
+  }
+
+  [freeOffsetsTree setWriteAheadLog: value];
+  [freeExtentsTree setWriteAheadLog: value];
+}
+
+- (BOOL)writeAheadLog
+{
+  return (wal != nil);
+}
+
+- (void)checkpoint
+{
+  if (wal) {
+    [handle synchronizeFile];
+    [wal checkpoint];
+  }
+
+  [freeOffsetsTree checkpoint];
+  [freeExtentsTree checkpoint];
 }
 
 - (NSData *)dataAtOffset:(NSNumber *)offset
@@ -172,6 +273,10 @@
   if (data == nil) {
     unsigned long ofst = [offset unsignedLongValue];
     unsigned datalen;
+
+    if (mapping && [mapping getBytes: &datalen length: ulen atOffset: ofst]) {
+      return [mapping dataOfLength: datalen atOffset: ofst + ulen];
+    }
   
     [handle seekToFileOffset: ofst];
     data = [handle readDataOfLength: ulen];
@@ -222,15 +327,15 @@
     unsigned datalen;
     DBKBFreeNodeEntry *entry;    
     
-    [handle seekToFileOffset: ofst];
-    lndata = [handle readDataOfLength: ulen];
-    [lndata getBytes: &datalen range: NSMakeRange(0, ulen)];
+    if ((mapping == nil) 
+          || ([mapping getBytes: &datalen length: ulen atOffset: ofst] == NO)) {
+      [handle seekToFileOffset: ofst];
+      lndata = [handle readDataOfLength: ulen];
+      [lndata getBytes: &datalen range: NSMakeRange(0, ulen)];
+    }
             
     entry = [DBKBFreeNodeEntry entryWithLength: datalen atOffset: ofst];
-  
-    [freeOffsetsTree begin];
-    [freeOffsetsTree insertKey: entry];  
-    [freeOffsetsTree end];  
+    [self addFreeExtent: entry];
         
     RELEASE (arp);
   }
@@ -241,22 +346,27 @@
   NSNumber *offset = [self freeOffsetForData: data];
   
   if (offset == nil) {  
-    unsigned count = [offsets count];
-    unsigned long coffs = 0;
-  
-    if (count > 0) {
-      NSNumber *key = [offsets objectAtIndex: (count - 1)];
-      NSData *dictData = [cacheDict objectForKey: key];
-
-      coffs = [key unsignedLongValue] + ulen + [dictData length];
-    }
-    
-    offset = [NSNumber numberWithUnsignedLong: ((coffs > eof) ? coffs : eof)];
+    offset = [NSNumber numberWithUnsignedLong: [self appendOffset]];
   }
   
   return offset;
 }
 
+- (unsigned long)appendOffset
+{
+  unsigned count = [offsets count];
+  unsigned long coffs = 0;
+
+  if (count > 0) {
+    NSNumber *key = [offsets objectAtIndex: (count - 1)];
+    NSData *dictData = [cacheDict objectForKey: key];
+
+    coffs = [key unsignedLongValue] + ulen + [dictData length];
+  }
+
+  return ((coffs > eof) ? coffs : eof);
+}
+
 - (int)insertionIndexForOffset:(NSNumber *)offset
 {
   CREATE_AUTORELEASE_POOL(arp);
@@ -301,26 +411,39 @@
 - (NSNumber *)freeOffsetForData:(NSData *)data
 {
   CREATE_AUTORELEASE_POOL(arp);
-  DBKBFreeNodeEntry *entry = [DBKBFreeNodeEntry entryWithLength: [data length] atOffset: 0];
-  DBKBFreeNodeEntry *freeEntry = nil;
+  unsigned long datalen = [data length];
+  DBKBFreeNodeEntry *entry = [DBKBFreeNodeEntry entryWithLength: datalen atOffset: 0];
+  DBKBFreeNodeEntry *freeEntry;
+  DBKBTreeCursor *cursor;
   NSNumber *offset = nil;
-  DBKBTreeNode *node;
-  BOOL exists;
-  NSUInteger index;
   
   [freeOffsetsTree begin];
-    
-  node = [freeOffsetsTree nodeOfKey: entry getIndex: &index didExist: &exists];
-  
-  if (node && [[node keys] count]) {
-    freeEntry = [node successorKeyInNode: &node forKeyAtIndex: index];
-  } 
+  [freeExtentsTree begin];
+
+  /* best fit: the shortest extent that holds the data, lowest offset first */
+  cursor = [[DBKBTreeCursor alloc] initWithTree: freeOffsetsTree];
+  freeEntry = [cursor seekToKey: entry];
+  RELEASE (cursor);
 
   if (freeEntry) {
+    unsigned long rest = [freeEntry length] - datalen;
+
     offset = RETAIN ([freeEntry offsetNum]);
     [freeOffsetsTree deleteKey: freeEntry];
+    [freeExtentsTree deleteKey: freeEntry];
+
+    /* a tail too short for a record is left to the one written here */
+    if (rest >= (ulen + MIN_EXTENT)) {
+      DBKBFreeNodeEntry *tail;
+
+      tail = [DBKBFreeNodeEntry entryWithLength: rest - ulen
+                                       atOffset: [freeEntry offset] + ulen + datalen];
+      [freeOffsetsTree insertKey: tail];
+      [freeExtentsTree insertKey: tail];
+    }
   }
 
+  [freeExtentsTree end];
   [freeOffsetsTree end];
   
   RELEASE (arp);
@@ -328,6 +451,140 @@
   return AUTORELEASE (offset);
 }
 
+- (void)addFreeExtent:(DBKBFreeNodeEntry *)entry
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  unsigned long offset = [entry offset];
+  unsigned long length = [entry length];
+  unsigned long end = offset + ulen + length;
+  DBKBFreeNodeEntry *prev;
+  DBKBFreeNodeEntry *next;
+  DBKBTreeCursor *cursor;
+
+  [freeOffsetsTree begin];
+  [freeExtentsTree begin];
+
+  cursor = [[DBKBTreeCursor alloc] initWithTree: freeExtentsTree];
+  next = [cursor seekToKey: entry];
+  prev = next ? [cursor prevKey] : [cursor seekToLastKey];
+  RELEASE (cursor);
+
+  /* already free */
+  if (next && ([next offset] == offset)) {
+    [freeExtentsTree end];
+    [freeOffsetsTree end];
+    RELEASE (arp);
+    return;
+  }
+
+  if (prev && (([prev offset] + ulen + [prev length]) == offset)) {
+    [freeOffsetsTree deleteKey: prev];
+    [freeExtentsTree deleteKey: prev];
+    offset = [prev offset];
+    length += ulen + [prev length];
+  }
+
+  if (next && ([next offset] == end)) {
+    [freeOffsetsTree deleteKey: next];
+    [freeExtentsTree deleteKey: next];
+    length += ulen + [next length];
+  }
+
+  entry = [DBKBFreeNodeEntry entryWithLength: length atOffset: offset];
+  [freeOffsetsTree insertKey: entry];
+  [freeExtentsTree insertKey: entry];
+
+  [freeExtentsTree end];
+  [freeOffsetsTree end];
+
+  RELEASE (arp);
+}
+
+- (void)buildFreeExtentsTree
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSMutableArray *entries = [NSMutableArray array];
+  DBKBTreeCursor *cursor;
+  id entry;
+
+  [freeOffsetsTree begin];
+  [freeExtentsTree begin];
+
+  /* files from before the offsets index have only the lengths tree */
+  if ([freeExtentsTree isEmpty] && ([freeOffsetsTree isEmpty] == NO)) {
+    cursor = [[DBKBTreeCursor alloc] initWithTree: freeOffsetsTree];
+
+    for (entry = [cursor seekToFirstKey]; entry; entry = [cursor nextKey]) {
+      [entries addObject: entry];
+    }
+    RELEASE (cursor);
+
+    [entries sortUsingSelector: @selector(compareOffset:)];
+    [freeExtentsTree bulkLoadSortedKeys: entries];
+  }
+
+  [freeExtentsTree end];
+  [freeOffsetsTree end];
+
+  RELEASE (arp);
+}
+
+- (NSDictionary *)fragmentationReport
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSMutableArray *classes = [NSMutableArray array];
+  unsigned long counts[64];
+  unsigned long extents = 0;
+  unsigned long long freeBytes = 0;
+  unsigned long largest = 0;
+  unsigned maxclass = 0;
+  DBKBTreeCursor *cursor;
+  DBKBFreeNodeEntry *entry;
+  NSDictionary *report;
+  unsigned i;
+
+  memset(counts, 0, sizeof(counts));
+
+  [freeExtentsTree begin];
+  cursor = [[DBKBTreeCursor alloc] initWithTree: freeExtentsTree];
+
+  for (entry = [cursor seekToFirstKey]; entry; entry = [cursor nextKey]) {
+    unsigned long length = [entry length];
+    unsigned class = 0;
+
+    while ((class < 63) && ((length >> (class + 1)) != 0)) {
+      class++;
+    }
+
+    counts[class]++;
+    maxclass = (class > maxclass) ? class : maxclass;
+    freeBytes += ulen + length;
+    largest = (length > largest) ? length : largest;
+    extents++;
+  }
+
+  RELEASE (cursor);
+  [freeExtentsTree end];
+
+  for (i = 0; extents && (i <= maxclass); i++) {
+    [classes addObject: [NSNumber numberWithUnsignedLong: counts[i]]];
+  }
+
+  report = [NSDictionary dictionaryWithObjectsAndKeys:
+                [NSNumber numberWithUnsignedLong: extents], @"extents",
+                [NSNumber numberWithUnsignedLongLong: freeBytes], @"freeBytes",
+                [NSNumber numberWithUnsignedLong: largest], @"largestExtent",
+                [NSNumber numberWithUnsignedLong: [self appendOffset]], @"fileSize",
+                [NSNumber numberWithDouble: (freeBytes ? (1.0 - (double)(largest + ulen) / (double)freeBytes) : 0.0)], @"fragmentation",
+                classes, @"sizeClasses",
+                nil];
+
+  RETAIN (report);
+  RELEASE (arp);
+
+  return AUTORELEASE (report);
+}
+
 
 //
 // DBKBTreeDelegate methods
@@ -340,62 +597,12 @@
 - (NSArray *)keysFromData:(NSData *)data
                withLength:(unsigned *)dlen
 {
-  NSMutableArray *keys = [NSMutableArray array];
-  NSRange range;
-  unsigned kcount;
-  unsigned i;
-  
-  range = NSMakeRange(0, ulen);
-  [data getBytes: &kcount range: range];
-  range.location += ulen;
-  
-  range.length = llen;
-
-  for (i = 0; i < kcount; i++) {
-    CREATE_AUTORELEASE_POOL(arp);
-    DBKBFreeNodeEntry *entry;
-    unsigned long length;
-    unsigned long offset;
-  
-    [data getBytes: &length range: range];
-    range.location += llen;
-    [data getBytes: &offset range: range];
-    range.location += llen;
-    
-    entry = [[DBKBFreeNodeEntry alloc] initWithLength: length atOffset: offset];
-    [keys addObject: entry];
-    RELEASE (entry);
-    
-    RELEASE (arp);
-  }
-  
-  *dlen = range.location;
-  
-  return keys;
+  return [keyCodec keysFromData: data withLength: dlen];
 }
 
 - (NSData *)dataFromKeys:(NSArray *)keys
 {
-  CREATE_AUTORELEASE_POOL(arp);
-  NSMutableData *data = [NSMutableData dataWithCapacity: 1];
-  unsigned kcount = [keys count];
-  unsigned i;
-  
-  [data appendData: [NSData dataWithBytes: &kcount length: ulen]];
-    
-  for (i = 0; i < kcount; i++) {
-    DBKBFreeNodeEntry *entry = [keys objectAtIndex: i];
-    unsigned long length = [entry length];
-    unsigned long offset = [entry offset];
-  
-    [data appendData: [NSData dataWithBytes: &length length: llen]];
-    [data appendData: [NSData dataWithBytes: &offset length: llen]];
-  }
-  
-  RETAIN (data);
-  RELEASE (arp);
-    
-  return [data autorelease];  
+  return [keyCodec dataFromKeys: keys];
 }
 
 - (NSComparisonResult)compareNodeKey:(id)akey 
@@ -442,6 +649,22 @@
   return self;
 }
 
+- (id)initWithFirstValue:(unsigned long)first
+             secondValue:(unsigned long)second
+{
+  return [self initWithLength: first atOffset: second];
+}
+
+- (unsigned long)firstValue
+{
+  return [lengthNum unsignedLongValue];
+}
+
+- (unsigned long)secondValue
+{
+  return [offsetNum unsignedLongValue];
+}
+
 - (NSNumber *)lengthNum 
 {
   return lengthNum;
@@ -467,6 +690,11 @@
   return ([lengthNum hash] + [offsetNum hash]);
 }
 
+- (NSComparisonResult)compareOffset:(DBKBFreeNodeEntry *)entry
+{
+  return [offsetNum compare: [entry offsetNum]];
+}
+
 - (BOOL)isEqual:(id)other
 {
   if (other == self) {
@@ -482,26 +710,45 @@
 @end
 
 
+@implementation	DBKFreeExtentsDelegate
 
+- (void)dealloc
+{
+  RELEASE (keyCodec);
+  [super dealloc];
+}
 
+- (id)initWithCodec:(DBKOffsetPairKeyCodec *)codec
+{
+  self = [super init];
 
+  if (self) {
+    ASSIGN (keyCodec, codec);
+  }
 
+  return self;
+}
 
+- (unsigned long)nodesize
+{
+  return 512;
+}
 
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  return [keyCodec keysFromData: data withLength: dlen];
+}
 
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  return [keyCodec dataFromKeys: keys];
+}
 
+- (NSComparisonResult)compareNodeKey:(id)akey 
+                             withKey:(id)bkey
+{
+  return [[akey offsetNum] compare: [bkey offsetNum]];
+}
 
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+@end
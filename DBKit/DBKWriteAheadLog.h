@@ -0,0 +1,77 @@
+/* DBKWriteAheadLog.h
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#ifndef DBK_WRITE_AHEAD_LOG_H
+#define DBK_WRITE_AHEAD_LOG_H
+
+#include <Foundation/Foundation.h>
+
+/*
+ * Redo log for the records files.
+ *
+ * A flush logs the image of every record it is about to write, then a
+ * commit mark with the checksum of the batch, and syncs the log once
+ * before the records are written in place.  The file itself is only
+ * synced at a checkpoint, which then empties the log.  Opening a file
+ * replays the committed batches of a log left by a crash; a batch
+ * without its commit mark was never written in place and is dropped.
+ */
+@interface DBKWriteAheadLog: NSObject 
+{
+  NSString *path;
+  NSFileHandle *handle;
+  unsigned long long length;
+  unsigned long long checkpointLength;
+  unsigned long checksum;
+  unsigned pending;
+}
+
+/** Applies the committed batches of the log at lpath, if any, syncs
+    the file and empties the log.  Returns the batches applied. */
++ (unsigned)replayLogAtPath:(NSString *)lpath
+             intoFileHandle:(NSFileHandle *)fhandle;
+
+- (id)initWithPath:(NSString *)lpath;
+
+- (void)logData:(NSData *)data
+       atOffset:(unsigned long)offset;
+
+/** Closes the current batch and syncs the log. */
+- (void)commit;
+
+- (unsigned long long)length;
+
+/** The log length checkpoints are asked for at, 4 MB by default. */
+- (void)setCheckpointLength:(unsigned long long)len;
+
+- (unsigned long long)checkpointLength;
+
+- (BOOL)needsCheckpoint;
+
+/** Empties the log. The file must be synced before. */
+- (void)checkpoint;
+
+- (void)close;
+
+@end
+
+#endif // DBK_WRITE_AHEAD_LOG_H
@@ -0,0 +1,254 @@
+/* DBKWriteAheadLog.m
+ *  
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This file is part of the GNUstep Workspace application
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
+ */
+
+
+#include <limits.h>
+#include <string.h>
+
+#include "DBKWriteAheadLog.h"
+
+#define CHECKPOINT_LENGTH (4 * 1024 * 1024)
+#define COMMIT_MARK ULONG_MAX
+#define CHECKSUM_SEED 2166136261UL
+
+/*
+ * A log is a sequence of records, each an unsigned long offset and an
+ * unsigned length followed by the data.  A commit mark is a record
+ * with COMMIT_MARK as offset, the count of the records of the batch as
+ * length and the checksum of the batch as data.
+ */
+
+static unsigned long updateChecksum(unsigned long sum, 
+                                    const unsigned char *bytes,
+                                    unsigned long len)
+{
+  unsigned long i;
+
+  for (i = 0; i < len; i++) {
+    sum = (sum ^ bytes[i]) * 16777619UL;
+  }
+
+  return sum;
+}
+
+@implementation	DBKWriteAheadLog
+
++ (unsigned)replayLogAtPath:(NSString *)lpath
+             intoFileHandle:(NSFileHandle *)fhandle
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSData *log = [NSData dataWithContentsOfFile: lpath];
+  const unsigned char *bytes = [log bytes];
+  unsigned long loglen = [log length];
+  unsigned hlen = sizeof(unsigned long) + sizeof(unsigned);
+  NSMutableArray *batch = [NSMutableArray array];
+  unsigned long sum = CHECKSUM_SEED;
+  unsigned long pos = 0;
+  unsigned batches = 0;
+
+  while ((pos + hlen) <= loglen) {
+    unsigned long offset;
+    unsigned len;
+
+    memcpy(&offset, bytes + pos, sizeof(unsigned long));
+    memcpy(&len, bytes + pos + sizeof(unsigned long), sizeof(unsigned));
+
+    if (offset == COMMIT_MARK) {
+      unsigned long mark;
+      unsigned i;
+
+      if (((pos + hlen + sizeof(unsigned long)) > loglen)
+                                          || (len != [batch count])) {
+        break;
+      }
+
+      memcpy(&mark, bytes + pos + hlen, sizeof(unsigned long));
+
+      if (mark != sum) {
+        break;
+      }
+
+      for (i = 0; i < [batch count]; i++) {
+        unsigned long start = [[batch objectAtIndex: i] unsignedLongValue];
+        unsigned long recofs;
+        unsigned reclen;
+
+        memcpy(&recofs, bytes + start, sizeof(unsigned long));
+        memcpy(&reclen, bytes + start + sizeof(unsigned long), sizeof(unsigned));
+
+        [fhandle seekToFileOffset: recofs];
+        [fhandle writeData: [log subdataWithRange: NSMakeRange(start + hlen, reclen)]];
+      }
+
+      [batch removeAllObjects];
+      sum = CHECKSUM_SEED;
+      pos += hlen + sizeof(unsigned long);
+      batches++;
+
+    } else {
+      if ((pos + hlen + len) > loglen) {
+        break;
+      }
+
+      [batch addObject: [NSNumber numberWithUnsignedLong: pos]];
+      sum = updateChecksum(sum, bytes + pos, hlen + len);
+      pos += hlen + len;
+    }
+  }
+
+  if (batches) {
+    [fhandle synchronizeFile];
+  }
+
+  if (loglen) {
+    NSFileHandle *lhandle = [NSFileHandle fileHandleForUpdatingAtPath: lpath];
+
+    [lhandle truncateFileAtOffset: 0];
+    [lhandle synchronizeFile];
+    [lhandle closeFile];
+  }
+
+  RELEASE (arp);
+
+  return batches;
+}
+
+- (void)dealloc
+{
+  [self close];
+  RELEASE (path);
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)lpath
+{
+  self = [super init];
+
+  if (self) {
+    NSFileManager *fm = [NSFileManager defaultManager];
+
+    ASSIGN (path, lpath);
+
+    if ([fm fileExistsAtPath: path] == NO) {
+      if ([fm createFileAtPath: path contents: nil attributes: nil] == NO) {
+        DESTROY (self);
+        [NSException raise: NSInvalidArgumentException
+		                format: @"cannot create file at: %@", lpath];     
+        return self;
+      }
+    }
+
+    handle = [NSFileHandle fileHandleForUpdatingAtPath: path];
+
+    if (handle == nil) {
+      DESTROY (self);
+      [NSException raise: NSInvalidArgumentException
+		              format: @"cannot open file at: %@", lpath];     
+      return self;
+    }
+
+    RETAIN (handle);
+
+    /* anything left was replayed when the records file was opened */
+    [handle truncateFileAtOffset: 0];
+    length = 0;
+    checkpointLength = CHECKPOINT_LENGTH;
+    checksum = CHECKSUM_SEED;
+    pending = 0;
+  }
+
+  return self;
+}
+
+- (void)logData:(NSData *)data
+       atOffset:(unsigned long)offset
+{
+  NSMutableData *record = [NSMutableData dataWithCapacity: [data length] + 16];
+  unsigned len = [data length];
+
+  [record appendBytes: &offset length: sizeof(unsigned long)];
+  [record appendBytes: &len length: sizeof(unsigned)];
+  [record appendData: data];
+
+  checksum = updateChecksum(checksum, [record bytes], [record length]);
+  pending++;
+
+  [handle writeData: record];
+  length += [record length];
+}
+
+- (void)commit
+{
+  if (pending) {
+    NSMutableData *mark = [NSMutableData dataWithCapacity: 24];
+    unsigned long offset = COMMIT_MARK;
+
+    [mark appendBytes: &offset length: sizeof(unsigned long)];
+    [mark appendBytes: &pending length: sizeof(unsigned)];
+    [mark appendBytes: &checksum length: sizeof(unsigned long)];
+
+    [handle writeData: mark];
+    [handle synchronizeFile];
+    length += [mark length];
+
+    checksum = CHECKSUM_SEED;
+    pending = 0;
+  }
+}
+
+- (unsigned long long)length
+{
+  return length;
+}
+
+- (void)setCheckpointLength:(unsigned long long)len
+{
+  checkpointLength = len;
+}
+
+- (unsigned long long)checkpointLength
+{
+  return checkpointLength;
+}
+
+- (BOOL)needsCheckpoint
+{
+  return (length >= checkpointLength);
+}
+
+- (void)checkpoint
+{
+  if (length) {
+    [handle truncateFileAtOffset: 0];
+    [handle synchronizeFile];
+    length = 0;
+  }
+}
+
+- (void)close
+{
+  if (handle) {
+    [handle closeFile];
+    DESTROY (handle);
+  }
+}
+
+@end
@@ -0,0 +1,368 @@
+/* dbkit-bench: standard DBKit workloads
+ *
+ * Usage: dbkit-bench [-count N] [-path DIR]
+ *
+ * Each workload prints one line of space separated key=value pairs:
+ * the workload name, the operations run, ops/sec over the wall time,
+ * the 50th, 90th and 99th percentile latency of one operation in
+ * microseconds and the size of the files in bytes.
+ */
+
+#include <Foundation/Foundation.h>
+#include <DBKit/DBKBTree.h>
+#include <DBKit/DBKBTreeCursor.h>
+#include <DBKit/DBKKeyCodec.h>
+#include <DBKit/DBKVarLenRecordsFile.h>
+#include <time.h>
+
+#define BENCH_COUNT 100000
+#define BATCH 1000
+#define SCAN_LENGTH 100
+#define RECORD_LENGTH 100
+
+@interface BenchDelegate: NSObject <DBKBTreeDelegate>
+@end
+
+@implementation	BenchDelegate
+
+- (unsigned long)nodesize
+{
+  return 512;
+} 
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  return [[DBKOffsetKeyCodec sharedCodec] keysFromData: data withLength: dlen];
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  return [[DBKOffsetKeyCodec sharedCodec] dataFromKeys: keys];
+}
+
+- (NSComparisonResult)compareNodeKey:(id)akey 
+                             withKey:(id)bkey
+{
+  return [(NSNumber *)akey compare: (NSNumber *)bkey];
+}
+
+@end
+
+
+typedef struct {
+  const char *name;
+  unsigned count;
+  unsigned ops;
+  double *latencies;
+  double start;
+} benchrun;
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int compareLatencies(const void *a, const void *b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+
+  return (da < db) ? -1 : ((da > db) ? 1 : 0);
+}
+
+static void beginRun(benchrun *run, const char *name, unsigned count)
+{
+  run->name = name;
+  run->count = count;
+  run->ops = 0;
+  run->latencies = malloc(sizeof(double) * (count ? count : 1));
+  run->start = now();
+}
+
+static void addLatency(benchrun *run, double started)
+{
+  run->latencies[run->ops++] = now() - started;
+}
+
+static unsigned long long sizeOfPath(NSString *path)
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSDictionary *attributes = [fm fileAttributesAtPath: path traverseLink: NO];
+  unsigned long long size = [attributes fileSize];
+
+  if ([[attributes fileType] isEqual: NSFileTypeDirectory]) {
+    NSEnumerator *enumerator = [fm enumeratorAtPath: path];
+    NSString *sub;
+
+    while ((sub = [enumerator nextObject])) {
+      sub = [path stringByAppendingPathComponent: sub];
+      size += [[fm fileAttributesAtPath: sub traverseLink: NO] fileSize];
+    }
+  }
+
+  return size;
+}
+
+static double percentile(benchrun *run, double p)
+{
+  unsigned index;
+
+  if (run->ops == 0) {
+    return 0.0;
+  }
+
+  index = (unsigned)(p * (run->ops - 1) + 0.5);
+
+  return run->latencies[index] * 1e6;
+}
+
+static void endRun(benchrun *run, NSArray *paths)
+{
+  double secs = now() - run->start;
+  unsigned long long size = 0;
+  unsigned i;
+
+  qsort(run->latencies, run->ops, sizeof(double), compareLatencies);
+
+  for (i = 0; i < [paths count]; i++) {
+    size += sizeOfPath([paths objectAtIndex: i]);
+  }
+
+  printf("workload=%s ops=%u ops_per_sec=%.0f p50_us=%.2f p90_us=%.2f p99_us=%.2f file_bytes=%llu\n",
+         run->name, run->ops, (secs > 0) ? (run->ops / secs) : 0.0,
+         percentile(run, 0.5), percentile(run, 0.9), percentile(run, 0.99), size);
+  fflush(stdout);
+
+  free(run->latencies);
+}
+
+/* the same pseudo random permutation of 0..count-1 on every machine */
+static unsigned long *shuffledKeys(unsigned count, unsigned long long seed)
+{
+  unsigned long *keys = malloc(sizeof(unsigned long) * (count ? count : 1));
+  unsigned i;
+
+  for (i = 0; i < count; i++) {
+    keys[i] = i;
+  }
+
+  for (i = count; i > 1; i--) {
+    unsigned long j;
+    unsigned long swap;
+
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    j = (seed >> 33) % i;
+    swap = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = swap;
+  }
+
+  return keys;
+}
+
+static void insertKeys(DBKBTree *tree, benchrun *run, 
+                       unsigned long *keys, unsigned count)
+{
+  unsigned i;
+
+  [tree begin];
+
+  for (i = 0; i < count; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSNumber *key = [NSNumber numberWithUnsignedLong: keys[i] * 2];
+    double started = now();
+
+    [tree insertKey: key];
+    addLatency(run, started);
+    RELEASE (arp);
+
+    if (((i + 1) % BATCH) == 0) {
+      [tree end];
+      [tree begin];
+    }
+  }
+
+  [tree end];
+}
+
+int main(int argc, char** argv, char **env)
+{
+  CREATE_AUTORELEASE_POOL (pool);
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  BenchDelegate *delegate = [BenchDelegate new];
+  unsigned count = BENCH_COUNT;
+  NSString *base = NSTemporaryDirectory();
+  NSString *treepath, *randpath, *recpath;
+  unsigned long *keys;
+  unsigned long *shuffled;
+  DBKBTree *tree;
+  DBKBTree *randtree;
+  DBKVarLenRecordsFile *records;
+  NSMutableArray *offsets;
+  NSMutableData *record;
+  benchrun run;
+  unsigned i;
+
+  if ([defaults integerForKey: @"count"] > 0) {
+    count = [defaults integerForKey: @"count"];
+  }
+  if ([defaults stringForKey: @"path"]) {
+    base = [defaults stringForKey: @"path"];
+  }
+
+  treepath = [base stringByAppendingPathComponent: @"dbkit-bench-seq"];
+  randpath = [base stringByAppendingPathComponent: @"dbkit-bench-rand"];
+  recpath = [base stringByAppendingPathComponent: @"dbkit-bench-records"];
+  [fm removeFileAtPath: treepath handler: nil];
+  [fm removeFileAtPath: randpath handler: nil];
+  [fm removeFileAtPath: recpath handler: nil];
+
+  keys = malloc(sizeof(unsigned long) * (count ? count : 1));
+  for (i = 0; i < count; i++) {
+    keys[i] = i;
+  }
+  shuffled = shuffledKeys(count, 1);
+
+  printf("dbkit_bench count=%u batch=%u\n", count, BATCH);
+
+  tree = [[DBKBTree alloc] initWithPath: treepath order: 16 delegate: delegate];
+  beginRun(&run, "btree_seq_insert", count);
+  insertKeys(tree, &run, keys, count);
+  endRun(&run, [NSArray arrayWithObject: treepath]);
+
+  randtree = [[DBKBTree alloc] initWithPath: randpath order: 16 delegate: delegate];
+  beginRun(&run, "btree_random_insert", count);
+  insertKeys(randtree, &run, shuffled, count);
+  endRun(&run, [NSArray arrayWithObject: randpath]);
+  RELEASE (randtree);
+
+  beginRun(&run, "btree_point_lookup", count);
+  [tree begin];
+  for (i = 0; i < count; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSNumber *key = [NSNumber numberWithUnsignedLong: shuffled[i] * 2];
+    double started = now();
+
+    [tree nodeOfKey: key];
+    addLatency(&run, started);
+    RELEASE (arp);
+  }
+  [tree end];
+  endRun(&run, [NSArray arrayWithObject: treepath]);
+
+  beginRun(&run, "btree_range_scan", count / SCAN_LENGTH);
+  [tree begin];
+  for (i = 0; i < (count / SCAN_LENGTH); i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    DBKBTreeCursor *cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+    NSNumber *key = [NSNumber numberWithUnsignedLong: shuffled[i] * 2];
+    double started = now();
+    unsigned j = 0;
+    id k;
+
+    for (k = [cursor seekToKey: key]; k && (j < SCAN_LENGTH); k = [cursor nextKey]) {
+      j++;
+    }
+    addLatency(&run, started);
+    RELEASE (cursor);
+    RELEASE (arp);
+  }
+  [tree end];
+  endRun(&run, [NSArray arrayWithObject: treepath]);
+
+  /* delete a key and insert a new one, so the tree keeps its size */
+  beginRun(&run, "btree_delete_churn", count);
+  [tree begin];
+  for (i = 0; i < count; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSNumber *old = [NSNumber numberWithUnsignedLong: shuffled[i] * 2];
+    NSNumber *newkey = [NSNumber numberWithUnsignedLong: shuffled[i] * 2 + 1];
+    double started = now();
+
+    [tree deleteKey: old];
+    [tree insertKey: newkey];
+    addLatency(&run, started);
+    RELEASE (arp);
+
+    if (((i + 1) % BATCH) == 0) {
+      [tree end];
+      [tree begin];
+    }
+  }
+  [tree end];
+  endRun(&run, [NSArray arrayWithObject: treepath]);
+
+  RELEASE (tree);
+
+  beginRun(&run, "btree_reopen", 10);
+  for (i = 0; i < 10; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    double started = now();
+
+    tree = [[DBKBTree alloc] initWithPath: treepath order: 16 delegate: delegate];
+    [tree begin];
+    [tree nodeOfKey: [NSNumber numberWithUnsignedLong: shuffled[i % count] * 2 + 1]];
+    [tree end];
+    addLatency(&run, started);
+    RELEASE (tree);
+    RELEASE (arp);
+  }
+  endRun(&run, [NSArray arrayWithObject: treepath]);
+
+  records = [[DBKVarLenRecordsFile alloc] initWithPath: recpath cacheLength: BATCH];
+  offsets = [NSMutableArray arrayWithCapacity: count];
+  record = [NSMutableData dataWithLength: RECORD_LENGTH];
+
+  beginRun(&run, "records_write", count);
+  for (i = 0; i < count; i++) {
+    double started = now();
+
+    [offsets addObject: [records writeData: record]];
+    addLatency(&run, started);
+  }
+  [records flush];
+  endRun(&run, [NSArray arrayWithObject: recpath]);
+
+  beginRun(&run, "records_read", count);
+  for (i = 0; i < count; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    double started = now();
+
+    [records dataAtOffset: [offsets objectAtIndex: shuffled[i]]];
+    addLatency(&run, started);
+    RELEASE (arp);
+  }
+  endRun(&run, [NSArray arrayWithObject: recpath]);
+
+  beginRun(&run, "records_delete_churn", count);
+  for (i = 0; i < count; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    unsigned index = shuffled[i];
+    double started = now();
+
+    [records deleteDataAtOffset: [offsets objectAtIndex: index]];
+    [offsets replaceObjectAtIndex: index withObject: [records writeData: record]];
+    addLatency(&run, started);
+    RELEASE (arp);
+  }
+  [records flush];
+  endRun(&run, [NSArray arrayWithObject: recpath]);
+
+  RELEASE (records);
+
+  [fm removeFileAtPath: treepath handler: nil];
+  [fm removeFileAtPath: randpath handler: nil];
+  [fm removeFileAtPath: recpath handler: nil];
+
+  free(keys);
+  free(shuffled);
+  RELEASE (delegate);
+  RELEASE (pool);
+  exit(EXIT_SUCCESS);
+}
@@ -86,6 +86,8 @@ int main(int argc, char** argv)
   CREATE_AUTORELEASE_POOL (pool);
   TreeDelegate *delegate = [TreeDelegate new];
   DBKBTree *tree = [[DBKBTree alloc] initWithPath: dbpath order: 3 delegate: delegate];
+  NSString *bulkpath = [dbpath stringByAppendingString: @"_bulk"];
+  DBKBTree *bulktree;
   NSDate *date = [NSDate date];
   
   [tree begin];
@@ -111,6 +113,23 @@ int main(int argc, char** argv)
   [tree begin];
   test6(tree);
   [tree end];
+
+  [tree begin];
+  test7(tree);
+  [tree end];
+
+  [[NSFileManager defaultManager] removeFileAtPath: bulkpath handler: nil];
+  bulktree = [[DBKBTree alloc] initWithPath: bulkpath order: 3 delegate: delegate];
+  [bulktree begin];
+  test8(bulktree);
+  test9(bulktree);
+  test10(bulktree);
+  [bulktree end];
+  test13(bulktree);
+  RELEASE (bulktree);
+
+  test11([dbpath stringByAppendingString: @"_records"]);
+  test12([dbpath stringByAppendingString: @"_wal"]);
     
   NSDebugLLog(@"gwspace", @"%.2f", [[NSDate date] timeIntervalSinceDate: date]);
   NSDebugLLog(@"gwspace", @"done");
@@ -0,0 +1,117 @@
+/* Compare the DBKPathsTree backends */
+
+#include <Foundation/Foundation.h>
+#include <DBKit/DBKPathsTree.h>
+#include <DBKit/DBKRadixPathsTree.h>
+
+#define PATHS_COUNT 1000000
+
+static NSArray *makePaths(unsigned count, unsigned seed)
+{
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: count];
+  unsigned i;
+
+  srandom(seed);
+
+  for (i = 0; i < count; i++) {
+    [paths addObject: [NSString stringWithFormat: 
+                  @"/home/user%li/Documents/project%li/src/module%li/file%u.m",
+                  random() % 8, random() % 200, random() % 50, i]];
+  }
+
+  return paths;
+}
+
+static void report(NSString *what, NSDate *date, unsigned ops)
+{
+  NSTimeInterval secs = [[NSDate date] timeIntervalSinceDate: date];
+
+  printf("%-28s %8.3f s %12.0f ops/s\n", [what UTF8String], 
+                                secs, (secs > 0) ? (ops / secs) : 0.0);
+}
+
+int main(int argc, char** argv, char **env)
+{
+  CREATE_AUTORELEASE_POOL (pool);
+  NSArray *paths = makePaths(PATHS_COUNT, 1);
+  NSArray *queries = makePaths(PATHS_COUNT, 2);
+  pcomp *ctree = newTreeWithIdentifier(@"components");
+  radixtree *rtree = newRadixTreeWithIdentifier(@"radix");
+  unsigned mismatches = 0;
+  unsigned cfound = 0;
+  unsigned rfound = 0;
+  NSDate *date;
+  unsigned i;
+
+  printf("%i paths\n", PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    insertComponentsOfPath([paths objectAtIndex: i], ctree);
+  }
+  report(@"components insert", date, PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    radixInsertComponentsOfPath([paths objectAtIndex: i], rtree);
+  }
+  report(@"radix insert", date, PATHS_COUNT);
+
+  /* the queries share the directories but not the files */
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    cfound += inTreeFirstPartOfPath([queries objectAtIndex: i], ctree);
+  }
+  report(@"components first part", date, PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    rfound += radixInTreeFirstPartOfPath([queries objectAtIndex: i], rtree);
+  }
+  report(@"radix first part", date, PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    containsElementsOfPath([paths objectAtIndex: i], ctree);
+  }
+  report(@"components contains", date, PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    radixContainsElementsOfPath([paths objectAtIndex: i], rtree);
+  }
+  report(@"radix contains", date, PATHS_COUNT);
+
+  for (i = 0; i < PATHS_COUNT; i += 7) {
+    NSString *path = [queries objectAtIndex: i];
+
+    if (inTreeFirstPartOfPath(path, ctree) != radixInTreeFirstPartOfPath(path, rtree)
+          || (fullPathInTree([paths objectAtIndex: i], ctree) 
+                      != radixFullPathInTree([paths objectAtIndex: i], rtree))) {
+      mismatches++;
+    }
+  }
+
+  if ((cfound != rfound) || mismatches) {
+    printf("FAILED: the backends disagree (%u / %u found, %u mismatches)\n", 
+                                              cfound, rfound, mismatches);
+  }
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    removeComponentsOfPath([paths objectAtIndex: i], ctree);
+  }
+  report(@"components remove", date, PATHS_COUNT);
+
+  date = [NSDate date];
+  for (i = 0; i < PATHS_COUNT; i++) {
+    radixRemoveComponentsOfPath([paths objectAtIndex: i], rtree);
+  }
+  report(@"radix remove", date, PATHS_COUNT);
+
+  freeTree(ctree);
+  radixFreeTree(rtree);
+
+  RELEASE (pool);
+  exit(EXIT_SUCCESS);
+}
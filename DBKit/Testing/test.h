@@ -12,6 +12,12 @@ void test4(DBKBTree *tree);
 void test5(DBKBTree *tree);
 void test6(DBKBTree *tree);
 void test7(DBKBTree *tree);
+void test8(DBKBTree *tree);
+void test9(DBKBTree *tree);
+void test10(DBKBTree *tree);
+void test11(NSString *path);
+void test12(NSString *path);
+void test13(DBKBTree *tree);
 
 void printTree(DBKBTree *tree);
 void printTreeFromNode(DBKBTree *tree, DBKBTreeNode *node, int depth);
@@ -0,0 +1,46 @@
+#include <DBKit/DBKBTree.h>
+#include <DBKit/DBKKeyCodec.h>
+#include "test.h"
+
+void test10(DBKBTree *tree)
+{
+  DBKOffsetKeyCodec *offsets = [DBKOffsetKeyCodec sharedCodec];
+  DBKStringKeyCodec *strings = [DBKStringKeyCodec sharedCodec];
+  NSMutableArray *keys = [NSMutableArray array];
+  NSArray *decoded;
+  NSData *data;
+  unsigned dlen;
+  unsigned i;
+
+  NSDebugLLog(@"gwspace", @"test 10");
+
+  NSDebugLLog(@"gwspace", @"offset keys keep the node format of the tree delegates");
+  for (i = 0; i < 20; i++) {
+    [keys addObject: [NSNumber numberWithUnsignedLong: i * 1000003UL]];
+  }
+  data = [offsets dataFromKeys: keys];
+  if (![data isEqual: [tree dataFromKeys: keys]]) {
+    printf("FAILED: offset keys encoded differently\n");
+  }
+  decoded = [offsets keysFromData: data withLength: &dlen];
+  if (![decoded isEqual: keys] || dlen != [data length]) {
+    printf("FAILED: offset keys round trip\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"string keys share prefixes");
+  keys = [NSMutableArray arrayWithObjects: @"/home/user", 
+                         @"/home/user/Desktop", 
+                         @"/home/user/Documents", 
+                         [NSString stringWithUTF8String: "/home/user/Documents/r\xc3\xa9sum\xc3\xa9.txt"], 
+                         [NSString stringWithUTF8String: "/home/user/Documents/r\xc3\xa9sum\xc3\xa9s"], 
+                         @"/usr", @"", nil];
+  data = [strings dataFromKeys: keys];
+  decoded = [strings keysFromData: data withLength: &dlen];
+  if (![decoded isEqual: keys] || dlen != [data length]) {
+    printf("FAILED: string keys round trip\n");
+  }
+  printf("%lu paths in %lu bytes\n", 
+         (unsigned long)[keys count], (unsigned long)[data length]);
+
+  NSDebugLLog(@"gwspace", @"test 10 passed\n\n");
+}
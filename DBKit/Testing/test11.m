@@ -0,0 +1,58 @@
+
+#include <DBKit/DBKVarLenRecordsFile.h>
+#include "test.h"
+
+void test11(NSString *path)
+{
+  DBKVarLenRecordsFile *file;
+  NSMutableData *data = [NSMutableData dataWithLength: 100];
+  NSMutableArray *recs = [NSMutableArray array];
+  NSDictionary *report;
+  NSNumber *offset;
+  unsigned i;
+
+  NSDebugLLog(@"gwspace", @"test 11");
+
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+  file = [[DBKVarLenRecordsFile alloc] initWithPath: path cacheLength: 16];
+
+  for (i = 0; i < 4; i++) {
+    [recs addObject: [file writeData: data]];
+  }
+  [file flush];
+
+  NSDebugLLog(@"gwspace", @"adjacent free records merge");
+  [file deleteDataAtOffset: [recs objectAtIndex: 0]];
+  [file deleteDataAtOffset: [recs objectAtIndex: 2]];
+  [file deleteDataAtOffset: [recs objectAtIndex: 1]];
+  report = [file fragmentationReport];
+  if ([[report objectForKey: @"extents"] unsignedLongValue] != 1) {
+    printf("FAILED: free extents not merged\n");
+  }
+  if ([[report objectForKey: @"largestExtent"] unsignedLongValue] 
+                                        != (300 + 2 * sizeof(unsigned))) {
+    printf("FAILED: wrong merged extent length\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"double free is ignored");
+  [file deleteDataAtOffset: [recs objectAtIndex: 0]];
+  report = [file fragmentationReport];
+  if ([[report objectForKey: @"extents"] unsignedLongValue] != 1) {
+    printf("FAILED: double free added an extent\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"the rest of a reused extent stays free");
+  [data setLength: 50];
+  offset = [file writeData: data];
+  [file flush];
+  if ([offset isEqual: [recs objectAtIndex: 0]] == NO) {
+    printf("FAILED: free extent not reused\n");
+  }
+  report = [file fragmentationReport];
+  if ([[report objectForKey: @"freeBytes"] unsignedLongValue] 
+                                        != (300 - 50 + 2 * sizeof(unsigned))) {
+    printf("FAILED: extent remainder lost\n");
+  }
+
+  RELEASE (file);
+}
@@ -0,0 +1,53 @@
+
+#include <DBKit/DBKWriteAheadLog.h>
+#include "test.h"
+
+void test12(NSString *path)
+{
+  NSString *logpath = [path stringByAppendingString: @".wal"];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSData *page1 = [@"committed page" dataUsingEncoding: NSASCIIStringEncoding];
+  NSData *page2 = [@"half done page" dataUsingEncoding: NSASCIIStringEncoding];
+  NSMutableData *zeros = [NSMutableData dataWithLength: 64];
+  DBKWriteAheadLog *wal;
+  NSFileHandle *handle;
+  NSData *contents;
+  unsigned batches;
+
+  NSDebugLLog(@"gwspace", @"test 12");
+
+  [fm removeFileAtPath: path handler: nil];
+  [fm removeFileAtPath: logpath handler: nil];
+  [fm createFileAtPath: path contents: zeros attributes: nil];
+
+  NSDebugLLog(@"gwspace", @"a crash leaves one committed and one open batch");
+  wal = [[DBKWriteAheadLog alloc] initWithPath: logpath];
+  [wal logData: page1 atOffset: 8];
+  [wal commit];
+  [wal logData: page2 atOffset: 32];
+  [wal close];
+  RELEASE (wal);
+
+  handle = [NSFileHandle fileHandleForUpdatingAtPath: path];
+  batches = [DBKWriteAheadLog replayLogAtPath: logpath intoFileHandle: handle];
+  [handle closeFile];
+
+  if (batches != 1) {
+    printf("FAILED: replayed %i batches instead of 1\n", batches);
+  }
+
+  contents = [NSData dataWithContentsOfFile: path];
+  if ([[contents subdataWithRange: NSMakeRange(8, [page1 length])] isEqual: page1] == NO) {
+    printf("FAILED: committed page not replayed\n");
+  }
+  if ([[contents subdataWithRange: NSMakeRange(32, [page2 length])] 
+              isEqual: [zeros subdataWithRange: NSMakeRange(32, [page2 length])]] == NO) {
+    printf("FAILED: uncommitted page replayed\n");
+  }
+  if ([[[fm fileAttributesAtPath: logpath traverseLink: NO] objectForKey: NSFileSize] intValue] != 0) {
+    printf("FAILED: log not emptied after replay\n");
+  }
+
+  [fm removeFileAtPath: path handler: nil];
+  [fm removeFileAtPath: logpath handler: nil];
+}
@@ -0,0 +1,127 @@
+
+#include <DBKit/DBKBTree.h>
+#include <DBKit/DBKBTreeNode.h>
+#include <DBKit/DBKBTreeCursor.h>
+#include "test.h"
+
+#define READERS 4
+
+@interface Test13Reader: NSObject
+{
+  DBKBTree *tree;
+  NSArray *keys;
+  NSConditionLock *done;
+  unsigned missing;
+}
+
+- (id)initWithTree:(DBKBTree *)atree
+              keys:(NSArray *)akeys
+              done:(NSConditionLock *)lock;
+
+- (void)run:(id)sender;
+
+- (unsigned)missing;
+
+@end
+
+@implementation	Test13Reader
+
+- (id)initWithTree:(DBKBTree *)atree
+              keys:(NSArray *)akeys
+              done:(NSConditionLock *)lock
+{
+  self = [super init];
+
+  if (self) {
+    tree = atree;
+    keys = akeys;
+    done = lock;
+    missing = 0;
+  }
+
+  return self;
+}
+
+- (void)run:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  unsigned i;
+
+  [tree beginReading];
+
+  for (i = 0; i < [keys count]; i++) {
+    NSUInteger index;
+    BOOL exists;
+
+    [tree nodeOfKey: [keys objectAtIndex: i] getIndex: &index didExist: &exists];
+
+    if (exists == NO) {
+      missing++;
+    }
+  }
+
+  [tree endReading];
+
+  [done lock];
+  [done unlockWithCondition: [done condition] + 1];
+
+  RELEASE (arp);
+}
+
+- (unsigned)missing
+{
+  return missing;
+}
+
+@end
+
+void test13(DBKBTree *tree)
+{
+  NSMutableArray *keys = [NSMutableArray array];
+  NSMutableArray *readers = [NSMutableArray array];
+  NSConditionLock *done = [[NSConditionLock alloc] initWithCondition: 0];
+  unsigned long budget = [tree cacheBudget];
+  DBKBTreeCursor *cursor;
+  id key;
+  unsigned i;
+
+  NSDebugLLog(@"gwspace", @"test 13");
+
+  [tree beginReading];
+  cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+  for (key = [cursor seekToFirstKey]; key; key = [cursor nextKey]) {
+    [keys addObject: key];
+  }
+  RELEASE (cursor);
+  [tree endReading];
+
+  NSDebugLLog(@"gwspace", @"%i readers look up %i keys", READERS, [keys count]);
+  [tree setCacheBudget: [tree nodesize] * 4];
+
+  for (i = 0; i < READERS; i++) {
+    Test13Reader *reader = [[Test13Reader alloc] initWithTree: tree
+                                                         keys: keys
+                                                         done: done];
+    [readers addObject: reader];
+    RELEASE (reader);
+    [NSThread detachNewThreadSelector: @selector(run:)
+                             toTarget: reader
+                           withObject: nil];
+  }
+
+  [done lockWhenCondition: READERS];
+  [done unlock];
+
+  for (i = 0; i < READERS; i++) {
+    if ([[readers objectAtIndex: i] missing]) {
+      printf("FAILED: a reader missed %i keys\n", [[readers objectAtIndex: i] missing]);
+    }
+  }
+
+  if ([tree isReading]) {
+    printf("FAILED: the tree is still being read\n");
+  }
+
+  [tree setCacheBudget: budget];
+  RELEASE (done);
+}
@@ -0,0 +1,74 @@
+#include <DBKit/DBKBTree.h>
+#include "test.h"
+
+void test7(DBKBTree *tree)
+{
+  NSDictionary *stats;
+  unsigned long savedBudget = [tree cacheBudget];
+  unsigned savedLevels = [tree pinnedLevels];
+  unsigned long i;
+
+  NSDebugLLog(@"gwspace", @"test 7");
+
+  NSDebugLLog(@"gwspace", @"insert 1000 items");
+  for (i = 100000; i < 101000; i++) {
+    [tree insertKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+  [tree end];
+
+  NSDebugLLog(@"gwspace", @"look them up with the whole tree in the cache");
+  [tree setCacheBudget: 16 * 1024 * 1024];
+  [tree begin];
+  for (i = 100000; i < 101000; i++) {
+    [tree nodeOfKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+  [tree end];
+
+  [tree resetCacheStatistics];
+  [tree begin];
+  for (i = 100000; i < 101000; i++) {
+    [tree nodeOfKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+  [tree end];
+
+  stats = [tree cacheStatistics];
+  printf("cached lookups: %llu hits, %llu misses\n",
+         [[stats objectForKey: @"hits"] unsignedLongLongValue],
+         [[stats objectForKey: @"misses"] unsignedLongLongValue]);
+  if ([[stats objectForKey: @"misses"] unsignedLongLongValue] != 0) {
+    printf("FAILED: a warm cache must not read nodes\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"keep only the root");
+  [tree setCacheBudget: 0];
+  [tree setPinnedLevels: 1];
+  [tree begin];
+  [tree end];
+  if ([tree cachedBytes] != 512) {
+    printf("FAILED: %lu bytes cached, expected only the root\n",
+           [tree cachedBytes]);
+  }
+
+  [tree resetCacheStatistics];
+  [tree begin];
+  for (i = 100000; i < 101000; i++) {
+    [tree nodeOfKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+  [tree end];
+
+  stats = [tree cacheStatistics];
+  printf("uncached lookups: %llu hits, %llu misses, %llu evictions\n",
+         [[stats objectForKey: @"hits"] unsignedLongLongValue],
+         [[stats objectForKey: @"misses"] unsignedLongLongValue],
+         [[stats objectForKey: @"evictions"] unsignedLongLongValue]);
+
+  NSDebugLLog(@"gwspace", @"delete the 1000 items");
+  [tree setCacheBudget: savedBudget];
+  [tree setPinnedLevels: savedLevels];
+  [tree begin];
+  for (i = 100000; i < 101000; i++) {
+    [tree deleteKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+
+  NSDebugLLog(@"gwspace", @"test 7 passed\n\n");
+}
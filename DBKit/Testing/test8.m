@@ -0,0 +1,101 @@
+#include <DBKit/DBKBTree.h>
+#include <DBKit/DBKBTreeBuilder.h>
+#include <DBKit/DBKExternalSorter.h>
+#include "test.h"
+
+/* returns the depth of the leaves, or -1 if they differ or a node is
+   out of bounds */
+static int checkNode(DBKBTreeNode *node, unsigned order)
+{
+  NSUInteger kcount;
+  int depth = -1;
+  NSUInteger i;
+
+  if ([node isLoaded] == NO) {
+    [node loadNodeData];
+  }
+
+  kcount = [[node keys] count];
+
+  if ((kcount > (order * 2 - 1)) || ([node isRoot] == NO && kcount < (order - 1))) {
+    printf("FAILED: node with %lu keys\n", (unsigned long)kcount);
+    return -1;
+  }
+
+  if ([node isLeaf]) {
+    return 0;
+  }
+
+  if ([[node subnodes] count] != (kcount + 1)) {
+    printf("FAILED: node with %lu keys and %lu subnodes\n",
+           (unsigned long)kcount, (unsigned long)[[node subnodes] count]);
+    return -1;
+  }
+
+  for (i = 0; i <= kcount; i++) {
+    int d = checkNode([[node subnodes] objectAtIndex: i], order);
+
+    if ((d < 0) || ((depth >= 0) && (d != depth))) {
+      return -1;
+    }
+    depth = d;
+  }
+
+  return depth + 1;
+}
+
+void test8(DBKBTree *tree)
+{
+  DBKExternalSorter *sorter;
+  DBKBTreeBuilder *builder;
+  NSArray *keys;
+  unsigned long i;
+  unsigned long missing = 0;
+
+  NSDebugLLog(@"gwspace", @"test 8");
+
+  NSDebugLLog(@"gwspace", @"sort 10006 shuffled items in runs of 1000");
+  sorter = [[DBKExternalSorter alloc] initWithTree: tree runLength: 1000];
+  for (i = 1; i < 10007; i++) {
+    [sorter addKey: [NSNumber numberWithUnsignedLong: (i * 7919) % 10007]];
+  }
+  printf("%lu runs\n", [sorter runsCount]);
+
+  NSDebugLLog(@"gwspace", @"bulk load them at 70%% fill");
+  builder = [[DBKBTreeBuilder alloc] initWithTree: tree fillFactor: 0.7];
+  [builder addKeysFromEnumerator: [sorter sortedKeyEnumerator]];
+  [builder finish];
+  printf("%lu keys loaded\n", [builder keyscount]);
+  RELEASE (builder);
+  RELEASE (sorter);
+
+  if (checkNode([tree root], [tree order]) < 0) {
+    printf("FAILED: the tree is not balanced\n");
+  }
+
+  for (i = 1; i < 10007; i++) {
+    if ([tree nodeOfKey: [NSNumber numberWithUnsignedLong: i]] == nil) {
+      missing++;
+    }
+  }
+  if (missing) {
+    printf("FAILED: %lu keys not found\n", missing);
+  }
+
+  keys = [tree keysGreaterThenKey: [NSNumber numberWithUnsignedLong: 100]
+                 andLesserThenKey: [NSNumber numberWithUnsignedLong: 200]];
+  if ([keys count] != 99) {
+    printf("FAILED: %lu keys between 100 and 200\n", (unsigned long)[keys count]);
+  }
+
+  NSDebugLLog(@"gwspace", @"insert and delete after the bulk load");
+  [tree insertKey: [NSNumber numberWithUnsignedLong: 20000]];
+  for (i = 1; i < 5000; i++) {
+    [tree deleteKey: [NSNumber numberWithUnsignedLong: i]];
+  }
+  if (checkNode([tree root], [tree order]) < 0) {
+    printf("FAILED: the tree is not balanced after the updates\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"test 8 passed\n\n");
+}
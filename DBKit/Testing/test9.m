@@ -0,0 +1,73 @@
+#include <DBKit/DBKBTree.h>
+#include <DBKit/DBKBTreeCursor.h>
+#include "test.h"
+
+/* runs on the tree left by test8: 5000 to 10006 and 20000 */
+void test9(DBKBTree *tree)
+{
+  DBKBTreeCursor *cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+  NSNumber *key;
+  unsigned long prev;
+  unsigned long count;
+  BOOL ordered;
+
+  NSDebugLLog(@"gwspace", @"test 9");
+
+  NSDebugLLog(@"gwspace", @"seek, next and prev");
+  key = [cursor seekToKey: [NSNumber numberWithUnsignedLong: 6000]];
+  if ([key unsignedLongValue] != 6000) {
+    printf("FAILED: seek to an existing key\n");
+  }
+  if ([[cursor nextKey] unsignedLongValue] != 6001
+        || [[cursor prevKey] unsignedLongValue] != 6000
+        || [[cursor prevKey] unsignedLongValue] != 5999) {
+    printf("FAILED: next and prev around 6000\n");
+  }
+
+  key = [cursor seekToKey: [NSNumber numberWithUnsignedLong: 10007]];
+  if ([key unsignedLongValue] != 20000) {
+    printf("FAILED: seek to a missing key\n");
+  }
+  if ([[cursor prevKey] unsignedLongValue] != 10006) {
+    printf("FAILED: prev from the last key\n");
+  }
+  if ([cursor seekToKey: [NSNumber numberWithUnsignedLong: 30000]] != nil
+        || [cursor isValid]) {
+    printf("FAILED: seek past the end\n");
+  }
+
+  key = [cursor seekToFirstKey];
+  if ([key unsignedLongValue] != 5000 || [cursor prevKey] != nil) {
+    printf("FAILED: first key\n");
+  }
+
+  NSDebugLLog(@"gwspace", @"scan forward");
+  ordered = YES;
+  count = 0;
+  prev = 0;
+  for (key = [cursor seekToFirstKey]; key; key = [cursor nextKey]) {
+    ordered = ordered && ([key unsignedLongValue] > prev);
+    prev = [key unsignedLongValue];
+    count++;
+  }
+  if (count != 5008 || ordered == NO) {
+    printf("FAILED: %lu keys scanned forward\n", count);
+  }
+
+  NSDebugLLog(@"gwspace", @"scan backward");
+  ordered = YES;
+  count = 0;
+  prev = 30000;
+  for (key = [cursor seekToLastKey]; key; key = [cursor prevKey]) {
+    ordered = ordered && ([key unsignedLongValue] < prev);
+    prev = [key unsignedLongValue];
+    count++;
+  }
+  if (count != 5008 || ordered == NO) {
+    printf("FAILED: %lu keys scanned backward\n", count);
+  }
+
+  RELEASE (cursor);
+
+  NSDebugLLog(@"gwspace", @"test 9 passed\n\n");
+}
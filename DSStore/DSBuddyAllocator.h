@@ -15,9 +15,22 @@
     BOOL _dirty;
     NSMutableArray *_freeBlocks;
     NSMutableArray *_usedBlocks;
+    
+    // Mapped mode
+    BOOL _useMapping;
+    void *_map;
+    NSUInteger _mapLength;
 }
 
 - (id)initWithFile:(NSString *)filePath;
+
+// Maps the file instead of reading it (falling back to reading when it
+// cannot be mapped).  Blocks then decode straight from the mapping; writes
+// go to private copy-on-write pages and reach the file on -flush.  Growing
+// the file moves the allocator to an in-memory copy.  The file must not be
+// truncated while it is mapped, so DSStore maps only the files
+// gDSStoreMappingFilter accepts.
+- (id)initWithMappedFile:(NSString *)filePath;
 - (id)initWithData:(NSMutableData *)data;
 
 - (BOOL)open;
@@ -31,9 +44,24 @@
 - (DSBuddyBlock *)blockAtOffset:(NSUInteger)offset size:(NSUInteger)size;
 - (void)deallocateBlock:(DSBuddyBlock *)block;
 
+// Buddy free lists, for rewriting single blocks of an existing file.
+// Offsets are allocator addresses (the file offset less 4).  The lists are
+// rebuilt from the blocks in use rather than read from the file.
+- (BOOL)rebuildFreeListsWithUsedAddresses:(NSArray *)addresses;
+- (NSUInteger)allocateOffsetWithWidth:(NSUInteger)width;
+- (void)freeOffset:(NSUInteger)offset width:(NSUInteger)width;
+- (void)appendFreeListsToData:(NSMutableData *)data;
+
+// Writes each data at its file offset straight to the file, then syncs it
+- (BOOL)writeInPlace:(NSDictionary *)dataByOffset;
+
 - (NSUInteger)fileSize;
 - (BOOL)isDirty;
 
+- (BOOL)isMapped;
+// NULL unless the range lies in the mapping
+- (uint8_t *)mappedBytesAtOffset:(NSUInteger)offset length:(NSUInteger)length;
+
 @end
 
 @interface DSBuddyBlock : NSObject 
@@ -41,7 +69,8 @@
     DSBuddyAllocator *_allocator;
     NSUInteger _offset;
     NSUInteger _size;
-    NSMutableData *_data;
+    NSMutableData *_data;       // nil for a mapped block until it is written
+    const uint8_t *_mapped;
     NSUInteger _position;
     BOOL _dirty;
 }
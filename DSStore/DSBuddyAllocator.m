@@ -7,6 +7,10 @@
 #import "DSBuddyAllocator.h"
 #import "DSStore.h"
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
 
 // Constants from buddy.py
 #define BUDDY_MAGIC 0x00000001
@@ -49,6 +53,13 @@ static uint64_t swap64(uint64_t x) {
     return self;
 }
 
+- (id)initWithMappedFile:(NSString *)filePath {
+    if ((self = [self initWithFile:filePath])) {
+        _useMapping = YES;
+    }
+    return self;
+}
+
 - (id)initWithData:(NSMutableData *)data {
     if ((self = [super init])) {
         _filePath = nil;
@@ -66,11 +77,14 @@ static uint64_t swap64(uint64_t x) {
     [_data release];
     [_freeBlocks release];
     [_usedBlocks release];
+    if (_map) {
+        munmap(_map, _mapLength);
+    }
     [super dealloc];
 }
 
 - (BOOL)open {
-    if (_data) {
+    if (_data || _map) {
         if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DEBUG: Allocator already opened with data");
         return YES; // Already opened with data
     }
@@ -81,6 +95,11 @@ static uint64_t swap64(uint64_t x) {
     }
     
     if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DEBUG: Attempting to open file: %@", _filePath);
+    
+    if (_useMapping && [self mapFile]) {
+        return YES;
+    }
+    
     NSData *fileData = [NSData dataWithContentsOfFile:_filePath];
     if (!fileData) {
         if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DEBUG: Failed to read file data from: %@", _filePath);
@@ -102,10 +121,71 @@ static uint64_t swap64(uint64_t x) {
     if (_dirty && _filePath && _data) {
         [_data writeToFile:_filePath atomically:YES];
         _dirty = NO;
+    } else if (_dirty && _filePath && _map) {
+        // The mapping is private, so the changes only reach the file here
+        NSData *mapped = [NSData dataWithBytesNoCopy:_map length:_mapLength freeWhenDone:NO];
+        [mapped writeToFile:_filePath atomically:YES];
+        _dirty = NO;
     }
 }
 
+#pragma mark - Mapping
+
+// Maps the file privately: reads come straight from the page cache and
+// writes only touch private copies of the pages written.
+- (BOOL)mapFile {
+    int fd = open([_filePath fileSystemRepresentation], O_RDONLY);
+    struct stat st;
+    
+    if (fd < 0) {
+        return NO;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return NO;
+    }
+    
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    
+    if (map == MAP_FAILED) {
+        if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DEBUG: Cannot map %@, reading it instead", _filePath);
+        return NO;
+    }
+    
+    _map = map;
+    _mapLength = (NSUInteger)st.st_size;
+    if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DEBUG: Mapped %lu bytes of %@", (unsigned long)_mapLength, _filePath);
+    return YES;
+}
+
+// Moves to an in-memory copy, for when the file has to grow.  The mapping
+// stays until dealloc since blocks may still point into it.
+- (void)detachMapping {
+    if (_map && !_data) {
+        _data = [[NSMutableData alloc] initWithBytes:_map length:_mapLength];
+    }
+}
+
+- (BOOL)isMapped {
+    return _map != NULL && _data == nil;
+}
+
+- (uint8_t *)mappedBytesAtOffset:(NSUInteger)offset length:(NSUInteger)length {
+    if (![self isMapped] || offset + length > _mapLength) {
+        return NULL;
+    }
+    return (uint8_t *)_map + offset;
+}
+
 - (NSData *)readAtOffset:(NSUInteger)offset length:(NSUInteger)length {
+    if ([self isMapped]) {
+        if (offset + length > _mapLength) {
+            return nil;
+        }
+        return [NSData dataWithBytes:(uint8_t *)_map + offset length:length];
+    }
+    
     if (!_data || offset + length > [_data length]) {
         return nil;
     }
@@ -114,13 +194,22 @@ static uint64_t swap64(uint64_t x) {
 }
 
 - (void)writeAtOffset:(NSUInteger)offset data:(NSData *)data {
+    NSUInteger dataLength = [data length];
+    NSUInteger requiredSize = offset + dataLength;
+    
+    if ([self isMapped]) {
+        if (requiredSize <= _mapLength) {
+            memcpy((uint8_t *)_map + offset, [data bytes], dataLength);
+            _dirty = YES;
+            return;
+        }
+        [self detachMapping];
+    }
+    
     if (!_data) {
         return;
     }
     
-    NSUInteger dataLength = [data length];
-    NSUInteger requiredSize = offset + dataLength;
-    
     // Extend data if necessary
     if (requiredSize > [_data length]) {
         [_data setLength:requiredSize];
@@ -131,6 +220,8 @@ static uint64_t swap64(uint64_t x) {
 }
 
 - (DSBuddyBlock *)allocateBlockWithSize:(NSUInteger)size {
+    [self detachMapping];
+    
     // Simplified allocation - for full implementation, would need to track free blocks
     NSUInteger offset = [_data length];
     [_data setLength:offset + size];
@@ -141,7 +232,7 @@ static uint64_t swap64(uint64_t x) {
 }
 
 - (DSBuddyBlock *)blockAtOffset:(NSUInteger)offset size:(NSUInteger)size {
-    if (!_data || offset + size > [_data length]) {
+    if ((!_data && !_map) || offset + size > [self fileSize]) {
         return nil;
     }
     
@@ -154,8 +245,181 @@ static uint64_t swap64(uint64_t x) {
     // In full implementation, would add to free blocks list
 }
 
+#pragma mark - Free Lists
+
+// Adds a free block to the list for its width, keeping the list sorted
+- (void)addFreeOffset:(NSUInteger)offset width:(NSUInteger)width {
+    NSMutableArray *list = [_freeBlocks objectAtIndex:width];
+    NSUInteger i = 0;
+    
+    while (i < [list count] && [[list objectAtIndex:i] unsignedIntegerValue] < offset) {
+        i++;
+    }
+    [list insertObject:[NSNumber numberWithUnsignedInteger:offset] atIndex:i];
+}
+
+// Removes [offset, offset + 2^width) from the free lists, splitting the
+// free block that contains it.  Fails if any of it is already in use.
+- (BOOL)reserveOffset:(NSUInteger)offset width:(NSUInteger)width {
+    if (width < 5 || width > 31 || (offset & (((NSUInteger)1 << width) - 1)) != 0) {
+        return NO;
+    }
+    
+    for (NSUInteger w = width; w < 32; w++) {
+        NSUInteger base = offset & ~(((NSUInteger)1 << w) - 1);
+        NSMutableArray *list = [_freeBlocks objectAtIndex:w];
+        NSNumber *key = [NSNumber numberWithUnsignedInteger:base];
+        
+        if (![list containsObject:key]) {
+            continue;
+        }
+        [list removeObject:key];
+        
+        // Give back the halves that do not hold the reserved block
+        while (w > width) {
+            w--;
+            NSUInteger half = (NSUInteger)1 << w;
+            if (offset & half) {
+                [self addFreeOffset:base width:w];
+                base += half;
+            } else {
+                [self addFreeOffset:base + half width:w];
+            }
+        }
+        return YES;
+    }
+    return NO;
+}
+
+- (BOOL)rebuildFreeListsWithUsedAddresses:(NSArray *)addresses {
+    [_freeBlocks removeAllObjects];
+    for (NSUInteger i = 0; i < 32; i++) {
+        [_freeBlocks addObject:[NSMutableArray array]];
+    }
+    [self addFreeOffset:0 width:31];
+    
+    // The buddy header at offset 0 is never free
+    if (![self reserveOffset:0 width:5]) {
+        return NO;
+    }
+    
+    for (NSNumber *address in addresses) {
+        uint32_t addr = [address unsignedIntValue];
+        if (addr == 0) {
+            continue;
+        }
+        if (![self reserveOffset:(addr & ~0x1F) width:(addr & 0x1F)]) {
+            if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Block address 0x%08x overlaps another block", addr);
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (NSUInteger)allocateOffsetWithWidth:(NSUInteger)width {
+    if (width < 5 || width > 31 || [_freeBlocks count] != 32) {
+        return NSNotFound;
+    }
+    
+    for (NSUInteger w = width; w < 32; w++) {
+        NSMutableArray *list = [_freeBlocks objectAtIndex:w];
+        if ([list count] == 0) {
+            continue;
+        }
+        
+        NSUInteger offset = [[list objectAtIndex:0] unsignedIntegerValue];
+        [list removeObjectAtIndex:0];
+        
+        // Split down to the requested width, freeing the upper halves
+        while (w > width) {
+            w--;
+            [self addFreeOffset:offset + ((NSUInteger)1 << w) width:w];
+        }
+        return offset;
+    }
+    return NSNotFound;
+}
+
+- (void)freeOffset:(NSUInteger)offset width:(NSUInteger)width {
+    if (width < 5 || width > 31 || [_freeBlocks count] != 32) {
+        return;
+    }
+    
+    // Merge with the buddy for as long as it is free too
+    while (width < 31) {
+        NSUInteger buddy = offset ^ ((NSUInteger)1 << width);
+        NSMutableArray *list = [_freeBlocks objectAtIndex:width];
+        NSNumber *key = [NSNumber numberWithUnsignedInteger:buddy];
+        
+        if (![list containsObject:key]) {
+            break;
+        }
+        [list removeObject:key];
+        offset &= ~((NSUInteger)1 << width);
+        width++;
+    }
+    [self addFreeOffset:offset width:width];
+}
+
+- (void)appendFreeListsToData:(NSMutableData *)data {
+    for (NSUInteger i = 0; i < 32; i++) {
+        NSArray *list = (i < [_freeBlocks count]) ? [_freeBlocks objectAtIndex:i] : nil;
+        uint32_t count = swap32((uint32_t)[list count]);
+        
+        [data appendBytes:&count length:4];
+        for (NSNumber *offset in list) {
+            uint32_t value = swap32([offset unsignedIntValue]);
+            [data appendBytes:&value length:4];
+        }
+    }
+}
+
+- (BOOL)writeInPlace:(NSDictionary *)dataByOffset {
+    if (!_filePath || (!_data && !_map)) {
+        return NO;
+    }
+    
+    NSFileHandle *handle = [NSFileHandle fileHandleForUpdatingAtPath:_filePath];
+    if (!handle) {
+        return NO;
+    }
+    
+    BOOL success = YES;
+    @try {
+        for (NSNumber *offsetNum in dataByOffset) {
+            NSData *data = [dataByOffset objectForKey:offsetNum];
+            NSUInteger offset = [offsetNum unsignedIntegerValue];
+            
+            [handle seekToFileOffset:offset];
+            [handle writeData:data];
+            
+            // Keep the in-memory copy in step without scheduling a full flush
+            if ([self isMapped] && offset + [data length] <= _mapLength) {
+                memcpy((uint8_t *)_map + offset, [data bytes], [data length]);
+                continue;
+            }
+            [self detachMapping];
+            if (offset + [data length] > [_data length]) {
+                [_data setLength:offset + [data length]];
+            }
+            [_data replaceBytesInRange:NSMakeRange(offset, [data length]) withBytes:[data bytes]];
+        }
+        [handle synchronizeFile];
+    }
+    @catch (NSException *exception) {
+        NSDebugLLog(@"gwspace", @"Failed to write blocks in place: %@", [exception reason]);
+        success = NO;
+    }
+    [handle closeFile];
+    
+    return success;
+}
+
 - (NSUInteger)fileSize {
-    return _data ? [_data length] : 0;
+    if (_data) {
+        return [_data length];
+    }
+    return _map ? _mapLength : 0;
 }
 
 - (BOOL)isDirty {
@@ -176,16 +440,33 @@ static uint64_t swap64(uint64_t x) {
         _position = 0;
         _dirty = NO;
         
-        NSData *blockData = [allocator readAtOffset:offset length:size];
-        if (blockData) {
-            _data = [[NSMutableData dataWithData:blockData] retain];
+        // A mapped block reads in place and copies itself on first write
+        _mapped = [allocator mappedBytesAtOffset:offset length:size];
+        if (_mapped) {
+            _data = nil;
         } else {
-            _data = [[NSMutableData dataWithLength:size] retain];
+            NSData *blockData = [allocator readAtOffset:offset length:size];
+            if (blockData) {
+                _data = [[NSMutableData dataWithData:blockData] retain];
+            } else {
+                _data = [[NSMutableData dataWithLength:size] retain];
+            }
         }
     }
     return self;
 }
 
+- (const uint8_t *)bytes {
+    return _data ? (const uint8_t *)[_data bytes] : _mapped;
+}
+
+- (NSMutableData *)overlay {
+    if (!_data) {
+        _data = [[NSMutableData alloc] initWithBytes:_mapped length:_size];
+    }
+    return _data;
+}
+
 - (void)dealloc {
     [self close];
     [_allocator release];
@@ -241,7 +522,7 @@ static uint64_t swap64(uint64_t x) {
         length = _size - _position;
     }
     
-    NSData *result = [_data subdataWithRange:NSMakeRange(_position, length)];
+    NSData *result = [NSData dataWithBytes:[self bytes] + _position length:length];
     _position += length;
     return result;
 }
@@ -253,7 +534,7 @@ static uint64_t swap64(uint64_t x) {
         return;
     }
     
-    [_data replaceBytesInRange:NSMakeRange(_position, length) withBytes:[data bytes]];
+    [[self overlay] replaceBytesInRange:NSMakeRange(_position, length) withBytes:[data bytes]];
     _position += length;
     _dirty = YES;
 }
@@ -264,7 +545,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint8_t value;
-    [_data getBytes:&value range:NSMakeRange(_position, 1)];
+    memcpy(&value, [self bytes] + _position, 1);
     _position += 1;
     return value;
 }
@@ -275,7 +556,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint16_t value;
-    [_data getBytes:&value range:NSMakeRange(_position, 2)];
+    memcpy(&value, [self bytes] + _position, 2);
     _position += 2;
     return swap16(value); // Convert from big-endian
 }
@@ -286,7 +567,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint32_t value;
-    [_data getBytes:&value range:NSMakeRange(_position, 4)];
+    memcpy(&value, [self bytes] + _position, 4);
     _position += 4;
     return swap32(value); // Convert from big-endian
 }
@@ -297,7 +578,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint64_t value;
-    [_data getBytes:&value range:NSMakeRange(_position, 8)];
+    memcpy(&value, [self bytes] + _position, 8);
     _position += 8;
     return swap64(value); // Convert from big-endian
 }
@@ -307,7 +588,7 @@ static uint64_t swap64(uint64_t x) {
         return;
     }
     
-    [_data replaceBytesInRange:NSMakeRange(_position, 1) withBytes:&value];
+    [[self overlay] replaceBytesInRange:NSMakeRange(_position, 1) withBytes:&value];
     _position += 1;
     _dirty = YES;
 }
@@ -318,7 +599,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint16_t bigEndianValue = swap16(value);
-    [_data replaceBytesInRange:NSMakeRange(_position, 2) withBytes:&bigEndianValue];
+    [[self overlay] replaceBytesInRange:NSMakeRange(_position, 2) withBytes:&bigEndianValue];
     _position += 2;
     _dirty = YES;
 }
@@ -329,7 +610,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint32_t bigEndianValue = swap32(value);
-    [_data replaceBytesInRange:NSMakeRange(_position, 4) withBytes:&bigEndianValue];
+    [[self overlay] replaceBytesInRange:NSMakeRange(_position, 4) withBytes:&bigEndianValue];
     _position += 4;
     _dirty = YES;
 }
@@ -340,7 +621,7 @@ static uint64_t swap64(uint64_t x) {
     }
     
     uint64_t bigEndianValue = swap64(value);
-    [_data replaceBytesInRange:NSMakeRange(_position, 8) withBytes:&bigEndianValue];
+    [[self overlay] replaceBytesInRange:NSMakeRange(_position, 8) withBytes:&bigEndianValue];
     _position += 8;
     _dirty = YES;
 }
@@ -17,6 +17,14 @@ extern "C" {
 // Global verbose flag for debug output
 extern BOOL gDSStoreVerbose;
 
+// Whether the .DS_Store at a path may be mapped rather than read into
+// memory.  A file on a network share or on removable media can be
+// truncated under the mapping, and reading past its new end is a SIGBUS;
+// the application, which knows the volumes, sets this.  Unset, no file
+// is mapped.
+typedef BOOL (*DSStoreMappingFilter)(NSString *path);
+extern DSStoreMappingFilter gDSStoreMappingFilter;
+
 /**
  * DSStore - .DS_Store file interoperability library
  *
@@ -70,6 +78,17 @@ typedef NS_ENUM(NSInteger, DSStoreLabelColor) {
     DSStoreLabelColorGrey = 7
 };
 
+// One Iloc record, as packed by -iconLocationTable
+typedef struct {
+    uint64_t nameHash;              // DSStoreFilenameHash() of the filename
+    int32_t x;                      // raw .DS_Store coordinates
+    int32_t y;
+} DSStoreIconLocation;
+
+// 64-bit FNV-1a over the filename's UTF-16 code units, each fed high byte
+// first - i.e. over the big-endian bytes the filename has on disk
+uint64_t DSStoreFilenameHash(const unichar *characters, NSUInteger length);
+
 // Sort by options
 typedef NS_ENUM(NSInteger, DSStoreSortBy) {
     DSStoreSortByNone = 0,
@@ -104,6 +123,23 @@ extern "C" {
     uint32_t _records;
     uint32_t _nodes;
     uint32_t _pageSize;
+    uint32_t _dsdbOffset;
+    uint32_t _dsdbBlockNumber;
+    NSArray *_blockAddresses;
+    
+    // On-disk layout, for rewriting single blocks
+    uint32_t _rootBlockOffset;
+    uint32_t _rootBlockSize;
+    uint32_t _rootBlockUnknown;
+    NSData *_tocData;
+    NSDate *_fileModificationDate;
+    NSUInteger _fileSize;
+    NSMutableSet *_changedKeys;
+    
+    // Lazy lookups
+    BOOL _lazy;
+    NSMutableDictionary *_nodeCache;
+    NSMutableArray *_nodeCacheOrder;
 }
 
 // Factory methods
@@ -121,6 +157,13 @@ extern "C" {
 - (BOOL)load;
 - (BOOL)save;
 
+// Lazy loading - reads only the file header.  -entryForFilename:code: then
+// searches the on-disk B-tree and decodes just the matching record, keeping
+// a few decoded nodes cached.  Any other access, and any change, falls back
+// to a full -load.
+- (BOOL)loadLazily;
+- (BOOL)isLazy;
+
 // Entry access
 - (DSStoreEntry *)entryForFilename:(NSString *)filename code:(NSString *)code;
 - (void)setEntry:(DSStoreEntry *)entry;
@@ -133,6 +176,11 @@ extern "C" {
 - (NSPoint)iconLocationForFilename:(NSString *)filename;
 - (void)setIconLocationForFilename:(NSString *)filename x:(int)x y:(int)y;
 
+// Every Iloc record as DSStoreIconLocation structs sorted by nameHash.  A
+// store that is not loaded (or is lazy) scans the B-tree nodes in place,
+// creating no per-record objects.
+- (NSData *)iconLocationTable;
+
 // Background
 - (SimpleColor *)backgroundColorForDirectory;
 - (void)setBackgroundColorForDirectory:(SimpleColor *)color;
@@ -217,6 +265,7 @@ extern "C" {
 
 // Internal methods
 - (void)readBTreeNode:(DSBuddyBlock *)block address:(uint32_t)address isLeaf:(BOOL)isLeaf;
+- (DSStoreEntry *)readRecordFromBlock:(DSBuddyBlock *)block decodeValue:(BOOL)decodeValue;
 
 @end
 
@@ -10,6 +10,8 @@
 // Global verbose flag for debug output
 BOOL gDSStoreVerbose = NO;
 
+DSStoreMappingFilter gDSStoreMappingFilter = NULL;
+
 // Byte order conversion macros for GNUstep
 #define CFSwapInt32BigToHost(x) NSSwapBigIntToHost(x)
 #define CFSwapInt16BigToHost(x) NSSwapBigShortToHost(x)
@@ -23,6 +25,254 @@ static uint32_t swapBytes32(uint32_t x) {
            ((x & 0x0000FF00) << 8)  | ((x & 0x000000FF) << 24);
 }
 
+
+// Lazy lookups keep this many decoded B-tree nodes around
+#define DS_NODE_CACHE_SIZE 8
+
+// Deepest B-tree -iconLocationTable will descend; guards against cycles
+#define DS_MAX_TREE_DEPTH 16
+
+#define DS_FNV_OFFSET 0xcbf29ce484222325ULL
+#define DS_FNV_PRIME 0x100000001b3ULL
+
+uint64_t DSStoreFilenameHash(const unichar *characters, NSUInteger length) {
+    uint64_t hash = DS_FNV_OFFSET;
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        hash = (hash ^ (characters[i] >> 8)) * DS_FNV_PRIME;
+        hash = (hash ^ (characters[i] & 0xFF)) * DS_FNV_PRIME;
+    }
+    return hash;
+}
+
+// The same hash over a filename as stored on disk (UTF-16BE)
+static uint64_t hashUTF16BigEndian(const uint8_t *bytes, NSUInteger length) {
+    uint64_t hash = DS_FNV_OFFSET;
+    
+    for (NSUInteger i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * DS_FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint32_t readBigEndian32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static int compareIconLocations(const void *a, const void *b) {
+    const DSStoreIconLocation *la = a;
+    const DSStoreIconLocation *lb = b;
+    
+    if (la->nameHash != lb->nameHash) {
+        return la->nameHash < lb->nameHash ? -1 : 1;
+    }
+    return 0;
+}
+
+// Skips over a record value of the given type.  Must consume exactly what
+// -readRecordFromBlock:decodeValue: reads for the same type.
+static void skipRecordValue(DSBuddyBlock *block, NSString *type) {
+    if ([type isEqualToString:@"bool"]) {
+        [block seek:1 whence:1];
+    } else if ([type isEqualToString:@"long"] || [type isEqualToString:@"type"]) {
+        [block seek:4 whence:1];
+    } else if ([type isEqualToString:@"shor"]) {
+        [block seek:2 whence:1];
+    } else if ([type isEqualToString:@"comp"] || [type isEqualToString:@"dutc"]) {
+        [block seek:8 whence:1];
+    } else if ([type isEqualToString:@"ustr"]) {
+        [block seek:[block readUInt32] * 2 whence:1];
+    } else {
+        // blob, and unknown types read as blobs
+        [block seek:[block readUInt32] whence:1];
+    }
+}
+
+/**
+ * DSStoreNode - one on-disk B-tree node with its keys decoded
+ *
+ * A node starts with the block number of its rightmost child (0 for a
+ * leaf) and a record count.  In an internal node every record is preceded
+ * by the block number of the child holding the keys that sort before it.
+ * Only the (filename, code) keys and the record positions are kept; values
+ * are decoded on demand from the retained block.
+ */
+@interface DSStoreNode : NSObject
+{
+    DSBuddyBlock *_block;
+    uint32_t _rightChild;
+    NSMutableArray *_filenames;
+    NSMutableArray *_lowercaseFilenames;
+    NSMutableArray *_codes;
+    NSMutableArray *_positions;
+    NSMutableArray *_ends;
+    uint32_t _recordsCount;
+    NSMutableArray *_children;
+}
+
+- (id)initWithBlock:(DSBuddyBlock *)block store:(DSStore *)store;
+- (DSBuddyBlock *)block;
+- (BOOL)isLeaf;
+- (NSUInteger)indexOfFilename:(NSString *)filename code:(NSString *)code found:(BOOL *)found;
+- (NSUInteger)positionAtIndex:(NSUInteger)index;
+- (uint32_t)childAtIndex:(NSUInteger)index;
+- (NSUInteger)count;
+- (BOOL)isComplete;
+- (DSStoreEntry *)keyAtIndex:(NSUInteger)index;
+- (NSData *)recordDataAtIndex:(NSUInteger)index;
+
+@end
+
+@interface DSStore (LazyLookup)
+- (BOOL)readHeader;
+- (DSStoreNode *)nodeForBlockNumber:(uint32_t)blockNum;
+- (BOOL)lazyEntryForFilename:(NSString *)filename code:(NSString *)code entry:(DSStoreEntry **)entry;
+@end
+
+@interface DSStore (IconLocationTable)
+- (BOOL)scanIconLocationsInBlock:(uint32_t)blockNum depth:(NSUInteger)depth into:(NSMutableData *)table;
+@end
+
+@interface DSStore (IncrementalSave)
+- (void)noteChangedFilename:(NSString *)filename code:(NSString *)code;
+- (BOOL)isUnchangedOnDisk;
+- (BOOL)saveDirtyBlocks;
+@end
+
+static NSInteger compareRecordPairs(id pair1, id pair2, void *context) {
+    return [[pair1 objectAtIndex:0] compare:[pair2 objectAtIndex:0]];
+}
+
+@implementation DSStoreNode
+
+- (id)initWithBlock:(DSBuddyBlock *)block store:(DSStore *)store {
+    if ((self = [super init])) {
+        _block = [block retain];
+        _rightChild = [block readUInt32];
+        uint32_t recordsCount = [block readUInt32];
+        _recordsCount = recordsCount;
+        
+        _filenames = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        _lowercaseFilenames = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        _codes = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        _positions = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        _ends = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        _children = [[NSMutableArray alloc] initWithCapacity:recordsCount];
+        
+        for (uint32_t i = 0; i < recordsCount; i++) {
+            uint32_t child = (_rightChild != 0) ? [block readUInt32] : 0;
+            NSUInteger position = [block tell];
+            DSStoreEntry *key = [store readRecordFromBlock:block decodeValue:NO];
+            
+            if (!key) {
+                break;
+            }
+            [_filenames addObject:[key filename]];
+            [_lowercaseFilenames addObject:[[key filename] lowercaseString]];
+            [_codes addObject:[key code]];
+            [_positions addObject:[NSNumber numberWithUnsignedInteger:position]];
+            [_ends addObject:[NSNumber numberWithUnsignedInteger:[block tell]]];
+            [_children addObject:[NSNumber numberWithUnsignedInt:child]];
+        }
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_block release];
+    [_filenames release];
+    [_lowercaseFilenames release];
+    [_codes release];
+    [_positions release];
+    [_ends release];
+    [_children release];
+    [super dealloc];
+}
+
+- (DSBuddyBlock *)block {
+    return _block;
+}
+
+- (BOOL)isLeaf {
+    return _rightChild == 0;
+}
+
+// Binary search in DSStoreEntry -compare: order (case-insensitive filename,
+// then code).  Returns the matching record, or the first one sorting after
+// the key if there is none.
+- (NSUInteger)indexOfFilename:(NSString *)filename code:(NSString *)code found:(BOOL *)found {
+    NSString *lowercaseFilename = [filename lowercaseString];
+    NSUInteger lo = 0;
+    NSUInteger hi = [_codes count];
+    
+    *found = NO;
+    
+    while (lo < hi) {
+        NSUInteger mid = lo + (hi - lo) / 2;
+        NSComparisonResult result = [[_lowercaseFilenames objectAtIndex:mid] compare:lowercaseFilename];
+        
+        if (result == NSOrderedSame) {
+            result = [[_codes objectAtIndex:mid] compare:code];
+        }
+        if (result == NSOrderedAscending) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    
+    // Names differing only in case share a key; look for the exact one
+    for (NSUInteger i = lo; i < [_codes count]; i++) {
+        if (![[_lowercaseFilenames objectAtIndex:i] isEqualToString:lowercaseFilename] ||
+            ![[_codes objectAtIndex:i] isEqualToString:code]) {
+            break;
+        }
+        if ([[_filenames objectAtIndex:i] isEqualToString:filename]) {
+            *found = YES;
+            return i;
+        }
+    }
+    return lo;
+}
+
+- (NSUInteger)positionAtIndex:(NSUInteger)index {
+    return [[_positions objectAtIndex:index] unsignedIntegerValue];
+}
+
+- (uint32_t)childAtIndex:(NSUInteger)index {
+    if (index < [_children count]) {
+        return [[_children objectAtIndex:index] unsignedIntValue];
+    }
+    return _rightChild;
+}
+
+- (NSUInteger)count {
+    return [_codes count];
+}
+
+// NO if a record could not be parsed and the node was cut short
+- (BOOL)isComplete {
+    return [_codes count] == _recordsCount;
+}
+
+- (DSStoreEntry *)keyAtIndex:(NSUInteger)index {
+    return [[[DSStoreEntry alloc] initWithFilename:[_filenames objectAtIndex:index]
+                                              code:[_codes objectAtIndex:index]
+                                              type:nil
+                                             value:nil] autorelease];
+}
+
+// The record's bytes as they are on disk
+- (NSData *)recordDataAtIndex:(NSUInteger)index {
+    NSUInteger position = [self positionAtIndex:index];
+    NSUInteger end = [[_ends objectAtIndex:index] unsignedIntegerValue];
+    
+    [_block seek:position];
+    return [_block readBytes:end - position];
+}
+
+@end
+
 @implementation DSStore
 
 + (id)storeWithPath:(NSString *)path {
@@ -50,6 +300,10 @@ static uint32_t swapBytes32(uint32_t x) {
         _allocator = nil;
         _entries = [[NSMutableArray alloc] init];
         _isLoaded = NO;
+        _lazy = NO;
+        _nodeCache = [[NSMutableDictionary alloc] init];
+        _nodeCacheOrder = [[NSMutableArray alloc] init];
+        _changedKeys = [[NSMutableSet alloc] init];
     }
     return self;
 }
@@ -58,6 +312,12 @@ static uint32_t swapBytes32(uint32_t x) {
     [_filePath release];
     [_allocator release];
     [_entries release];
+    [_blockAddresses release];
+    [_tocData release];
+    [_fileModificationDate release];
+    [_changedKeys release];
+    [_nodeCache release];
+    [_nodeCacheOrder release];
     [super dealloc];
 }
 
@@ -72,9 +332,27 @@ static uint32_t swapBytes32(uint32_t x) {
     return [NSArray arrayWithArray:_entries];
 }
 
-- (BOOL)load {
-    // Initialize buddy allocator
-    _allocator = [[DSBuddyAllocator alloc] initWithFile:_filePath];
+// Reads the buddy allocator header, the block offsets table and the DSDB
+// superblock, without touching the B-tree itself.
+- (BOOL)readHeader {
+    // Start over from the file as it is on disk now
+    [_allocator release];
+    [_blockAddresses release];
+    _blockAddresses = nil;
+    [_tocData release];
+    _tocData = nil;
+    [_fileModificationDate release];
+    _fileModificationDate = nil;
+    [_nodeCache removeAllObjects];
+    [_nodeCacheOrder removeAllObjects];
+    
+    // Initialize buddy allocator, mapping the file rather than copying it
+    // where nobody else can truncate it
+    if (gDSStoreMappingFilter && gDSStoreMappingFilter(_filePath)) {
+        _allocator = [[DSBuddyAllocator alloc] initWithMappedFile:_filePath];
+    } else {
+        _allocator = [[DSBuddyAllocator alloc] initWithFile:_filePath];
+    }
     if (![_allocator open]) {
         return NO;
     }
@@ -136,6 +414,7 @@ static uint32_t swapBytes32(uint32_t x) {
     }
     
     // Read TOC count
+    NSUInteger tocStart = [rootBlock tell];
     uint32_t tocCount = [rootBlock readUInt32];
     if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"TOC count: %u", tocCount);
     
@@ -154,6 +433,11 @@ static uint32_t swapBytes32(uint32_t x) {
         [name release];
     }
     
+    // Keep the TOC as is for rewriting the root block
+    NSUInteger tocEnd = [rootBlock tell];
+    [rootBlock seek:tocStart];
+    NSData *tocData = [rootBlock readBytes:tocEnd - tocStart];
+    
     [rootBlock close];
     
     // Look for DSDB directory entry (robust approach)
@@ -190,20 +474,51 @@ static uint32_t swapBytes32(uint32_t x) {
     uint32_t nodesNumber = [dsdbBlock readUInt32];
     uint32_t pageSize = [dsdbBlock readUInt32];
     
+    [dsdbBlock close];
+    
     if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"DSDB: rootAddr=%u levels=%u records=%u nodes=%u pageSize=%u",
           rootAddress, levelsNumber, recordsNumber, nodesNumber, pageSize);
     
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_filePath error:NULL];
+    
+    _blockAddresses = [offsets retain];
+    _tocData = [tocData retain];
+    _fileModificationDate = [[attributes fileModificationDate] retain];
+    _fileSize = fileSize;
+    _rootBlockOffset = rootOffset;
+    _rootBlockSize = rootSize;
+    _rootBlockUnknown = unknown2;
+    _dsdbBlockNumber = dsdbBlockNum;
+    _dsdbOffset = dsdbOffset;
+    _rootNode = rootAddress;
+    _levels = levelsNumber;
+    _records = recordsNumber;
+    _nodes = nodesNumber;
+    _pageSize = pageSize;
+    return YES;
+}
+
+- (BOOL)load {
+    if (![self readHeader]) {
+        return NO;
+    }
+    
+    uint32_t rootAddress = _rootNode;
+    uint32_t levelsNumber = _levels;
+    uint32_t recordsNumber = _records;
+    uint32_t pageSize = _pageSize;
+    uint32_t dsdbOffset = _dsdbOffset;
+    NSArray *offsets = _blockAddresses;
+    
     [_entries removeAllObjects];
+    [_changedKeys removeAllObjects];
     
     if (recordsNumber == 0) {
         if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Empty B-tree");
-        [dsdbBlock close];
         _isLoaded = YES;
         return YES;
     }
     
-    [dsdbBlock close];
-    
     // The B-tree root address points to another block in the offset table
     // If rootAddress >= offsetCount, it's likely an offset relative to DSDB block
     if (rootAddress < [offsets count]) {
@@ -274,78 +589,11 @@ static uint32_t swapBytes32(uint32_t x) {
         for (uint32_t i = 0; i < recordsCount; i++) {
             if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Reading leaf record %u", i);
             
-            uint32_t filenameLength = [block readUInt32];
-            if (filenameLength == 0 || filenameLength > 1024) {
-                if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Invalid filename length: %u", filenameLength);
+            DSStoreEntry *entry = [self readRecordFromBlock:block decodeValue:YES];
+            if (!entry) {
                 break;
             }
-            
-            NSData *unicodeData = [block readBytes:filenameLength * 2];
-            NSString *filename = [[NSString alloc] initWithData:unicodeData encoding:NSUTF16BigEndianStringEncoding];
-            
-            // Read code (4 bytes ASCII)
-            NSData *codeData = [block readBytes:4];
-            NSString *code = [[NSString alloc] initWithData:codeData encoding:NSASCIIStringEncoding];
-            
-            // Read type (4 bytes ASCII)  
-            NSData *typeData = [block readBytes:4];
-            NSString *type = [[NSString alloc] initWithData:typeData encoding:NSASCIIStringEncoding];
-            
-            if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Entry: filename='%@', code='%@', type='%@'", filename, code, type);
-            
-            // Read value based on type
-            id value = nil;
-            if ([type isEqualToString:@"bool"]) {
-                uint8_t boolVal = [block readUInt8];
-                value = [NSNumber numberWithBool:(boolVal != 0)];
-            } else if ([type isEqualToString:@"long"]) {
-                uint32_t intVal = [block readUInt32];
-                value = [NSNumber numberWithUnsignedInt:intVal];
-            } else if ([type isEqualToString:@"shor"]) {
-                uint16_t shortVal = [block readUInt16];
-                value = [NSNumber numberWithUnsignedShort:shortVal];
-            } else if ([type isEqualToString:@"blob"]) {
-                uint32_t blobLen = [block readUInt32];
-                if (blobLen > 0 && blobLen < 65536) {
-                    value = [block readBytes:blobLen];
-                }
-            } else if ([type isEqualToString:@"ustr"]) {
-                uint32_t strLen = [block readUInt32];
-                if (strLen > 0 && strLen < 1024) {
-                    NSData *strData = [block readBytes:strLen * 2];
-                    value = [[NSString alloc] initWithData:strData encoding:NSUTF16BigEndianStringEncoding];
-                }
-            } else if ([type isEqualToString:@"type"]) {
-                NSData *typeValue = [block readBytes:4];
-                value = [[NSString alloc] initWithData:typeValue encoding:NSASCIIStringEncoding];
-            } else if ([type isEqualToString:@"comp"]) {
-                uint64_t longVal = [block readUInt64];
-                value = [NSNumber numberWithUnsignedLongLong:longVal];
-            } else if ([type isEqualToString:@"dutc"]) {
-                uint64_t longVal = [block readUInt64];
-                value = [NSNumber numberWithUnsignedLongLong:longVal];
-            } else {
-                // Unknown type - try to read as blob
-                uint32_t valueLen = [block readUInt32];
-                if (valueLen > 0 && valueLen < 65536) {
-                    value = [block readBytes:valueLen];
-                }
-            }
-            
-            DSStoreEntry *entry = [[DSStoreEntry alloc] initWithFilename:filename
-                                                                     code:code
-                                                                     type:type
-                                                                    value:value];
-            if (entry) {
-                [_entries addObject:entry];
-                [entry release];
-            }
-            [filename release];
-            [code release];
-            [type release];
-            if ([type isEqualToString:@"ustr"] || [type isEqualToString:@"type"]) {
-                [value release];
-            }
+            [_entries addObject:entry];
         }
     } else {
         // Read internal node pointers
@@ -378,12 +626,566 @@ static uint32_t swapBytes32(uint32_t x) {
     }
 }
 
+- (DSStoreEntry *)readRecordFromBlock:(DSBuddyBlock *)block decodeValue:(BOOL)decodeValue {
+    uint32_t filenameLength = [block readUInt32];
+    if (filenameLength == 0 || filenameLength > 1024) {
+        if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Invalid filename length: %u", filenameLength);
+        return nil;
+    }
+    
+    NSData *unicodeData = [block readBytes:filenameLength * 2];
+    NSString *filename = [[[NSString alloc] initWithData:unicodeData encoding:NSUTF16BigEndianStringEncoding] autorelease];
+    
+    // Read code (4 bytes ASCII)
+    NSData *codeData = [block readBytes:4];
+    NSString *code = [[[NSString alloc] initWithData:codeData encoding:NSASCIIStringEncoding] autorelease];
+    
+    // Read type (4 bytes ASCII)  
+    NSData *typeData = [block readBytes:4];
+    NSString *type = [[[NSString alloc] initWithData:typeData encoding:NSASCIIStringEncoding] autorelease];
+    
+    if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Entry: filename='%@', code='%@', type='%@'", filename, code, type);
+    
+    // Read value based on type
+    id value = nil;
+    if (!decodeValue) {
+        skipRecordValue(block, type);
+    } else if ([type isEqualToString:@"bool"]) {
+        uint8_t boolVal = [block readUInt8];
+        value = [NSNumber numberWithBool:(boolVal != 0)];
+    } else if ([type isEqualToString:@"long"]) {
+        uint32_t intVal = [block readUInt32];
+        value = [NSNumber numberWithUnsignedInt:intVal];
+    } else if ([type isEqualToString:@"shor"]) {
+        uint16_t shortVal = [block readUInt16];
+        value = [NSNumber numberWithUnsignedShort:shortVal];
+    } else if ([type isEqualToString:@"blob"]) {
+        uint32_t blobLen = [block readUInt32];
+        if (blobLen > 0 && blobLen < 65536) {
+            value = [block readBytes:blobLen];
+        } else {
+            [block seek:blobLen whence:1];
+        }
+    } else if ([type isEqualToString:@"ustr"]) {
+        uint32_t strLen = [block readUInt32];
+        if (strLen > 0 && strLen < 1024) {
+            NSData *strData = [block readBytes:strLen * 2];
+            value = [[[NSString alloc] initWithData:strData encoding:NSUTF16BigEndianStringEncoding] autorelease];
+        } else {
+            [block seek:strLen * 2 whence:1];
+        }
+    } else if ([type isEqualToString:@"type"]) {
+        NSData *typeValue = [block readBytes:4];
+        value = [[[NSString alloc] initWithData:typeValue encoding:NSASCIIStringEncoding] autorelease];
+    } else if ([type isEqualToString:@"comp"]) {
+        uint64_t longVal = [block readUInt64];
+        value = [NSNumber numberWithUnsignedLongLong:longVal];
+    } else if ([type isEqualToString:@"dutc"]) {
+        uint64_t longVal = [block readUInt64];
+        value = [NSNumber numberWithUnsignedLongLong:longVal];
+    } else {
+        // Unknown type - try to read as blob
+        uint32_t valueLen = [block readUInt32];
+        if (valueLen > 0 && valueLen < 65536) {
+            value = [block readBytes:valueLen];
+        } else {
+            [block seek:valueLen whence:1];
+        }
+    }
+    
+    return [[[DSStoreEntry alloc] initWithFilename:filename
+                                              code:code
+                                              type:type
+                                             value:value] autorelease];
+}
+
+#pragma mark - Lazy Lookups
+
+- (BOOL)loadLazily {
+    _lazy = YES;
+    [_entries removeAllObjects];
+    _isLoaded = NO;
+    return [self readHeader];
+}
+
+- (BOOL)isLazy {
+    return _lazy && !_isLoaded;
+}
+
+- (DSStoreNode *)nodeForBlockNumber:(uint32_t)blockNum {
+    NSNumber *key = [NSNumber numberWithUnsignedInt:blockNum];
+    DSStoreNode *node = [_nodeCache objectForKey:key];
+    
+    if (node) {
+        [_nodeCacheOrder removeObject:key];
+        [_nodeCacheOrder addObject:key];
+        return [[node retain] autorelease];
+    }
+    
+    if (blockNum >= [_blockAddresses count]) {
+        return nil;
+    }
+    
+    uint32_t addr = [[_blockAddresses objectAtIndex:blockNum] unsignedIntValue];
+    uint32_t offset = addr & ~0x1F;
+    uint32_t size = 1 << (addr & 0x1F);
+    
+    // +4 for file offset correction, as in -load
+    DSBuddyBlock *block = [_allocator blockAtOffset:offset + 4 size:size - 4];
+    if (!block) {
+        if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Failed to read B-tree node block %u", blockNum);
+        return nil;
+    }
+    
+    if ([_nodeCacheOrder count] >= DS_NODE_CACHE_SIZE) {
+        [_nodeCache removeObjectForKey:[_nodeCacheOrder objectAtIndex:0]];
+        [_nodeCacheOrder removeObjectAtIndex:0];
+    }
+    
+    node = [[DSStoreNode alloc] initWithBlock:block store:self];
+    [_nodeCache setObject:node forKey:key];
+    [_nodeCacheOrder addObject:key];
+    [node release];
+    
+    // Stays valid if a later lookup evicts it
+    return [[node retain] autorelease];
+}
+
+// Descends from the root to the record with the given key.  Returns NO if
+// the tree cannot be walked this way, so that the caller falls back to a
+// full load; otherwise *entry is the record, or nil if there is none.
+- (BOOL)lazyEntryForFilename:(NSString *)filename code:(NSString *)code entry:(DSStoreEntry **)entry {
+    *entry = nil;
+    
+    if (!_blockAddresses) {
+        return NO;
+    }
+    if (_records == 0) {
+        return YES;
+    }
+    // A root outside the offsets table is the relative form -load handles
+    if (_rootNode >= [_blockAddresses count]) {
+        return NO;
+    }
+    
+    uint32_t blockNum = _rootNode;
+    
+    // The bound only stops a corrupt tree from looping
+    for (uint32_t depth = 0; depth < 32; depth++) {
+        DSStoreNode *node = [self nodeForBlockNumber:blockNum];
+        BOOL found;
+        
+        if (!node) {
+            return NO;
+        }
+        
+        NSUInteger index = [node indexOfFilename:filename code:code found:&found];
+        if (found) {
+            DSBuddyBlock *block = [node block];
+            [block seek:[node positionAtIndex:index]];
+            *entry = [self readRecordFromBlock:block decodeValue:YES];
+            return YES;
+        }
+        if ([node isLeaf]) {
+            return YES;
+        }
+        blockNum = [node childAtIndex:index];
+    }
+    
+    return NO;
+}
+
+#pragma mark - Icon Location Table
+
+// Walks one node straight from the file bytes: for each record only the
+// filename length, code and type are looked at, Iloc values are decoded
+// and everything else is skipped in the same way -readRecordFromBlock:
+// reads it.  Returns NO on anything it cannot follow.
+- (BOOL)scanIconLocationsInBlock:(uint32_t)blockNum depth:(NSUInteger)depth into:(NSMutableData *)table {
+    if (depth > DS_MAX_TREE_DEPTH || blockNum >= [_blockAddresses count]) {
+        return NO;
+    }
+    
+    uint32_t addr = [[_blockAddresses objectAtIndex:blockNum] unsignedIntValue];
+    NSUInteger offset = (addr & ~0x1F) + 4;
+    NSUInteger size = (1 << (addr & 0x1F)) - 4;
+    NSData *copy = nil;
+    const uint8_t *bytes = [_allocator mappedBytesAtOffset:offset length:size];
+    
+    if (!bytes) {
+        copy = [_allocator readAtOffset:offset length:size];
+        bytes = [copy bytes];
+        if (!copy) {
+            return NO;
+        }
+    }
+    if (size < 8) {
+        return NO;
+    }
+    
+    uint32_t rightChild = readBigEndian32(bytes);
+    uint32_t count = readBigEndian32(bytes + 4);
+    NSUInteger pos = 8;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (rightChild != 0) {
+            if (pos + 4 > size
+                || ![self scanIconLocationsInBlock:readBigEndian32(bytes + pos) depth:depth + 1 into:table]) {
+                return NO;
+            }
+            pos += 4;
+        }
+        
+        if (pos + 4 > size) {
+            return NO;
+        }
+        uint32_t nameLength = readBigEndian32(bytes + pos);
+        if (nameLength == 0 || nameLength > 1024 || pos + 4 + nameLength * 2 + 8 > size) {
+            return NO;
+        }
+        const uint8_t *name = bytes + pos + 4;
+        const uint8_t *code = name + nameLength * 2;
+        const uint8_t *type = code + 4;
+        pos += 4 + nameLength * 2 + 8;
+        
+        NSUInteger valueLength;
+        if (memcmp(type, "bool", 4) == 0) {
+            valueLength = 1;
+        } else if (memcmp(type, "long", 4) == 0 || memcmp(type, "type", 4) == 0) {
+            valueLength = 4;
+        } else if (memcmp(type, "shor", 4) == 0) {
+            valueLength = 2;
+        } else if (memcmp(type, "comp", 4) == 0 || memcmp(type, "dutc", 4) == 0) {
+            valueLength = 8;
+        } else {
+            if (pos + 4 > size) {
+                return NO;
+            }
+            valueLength = readBigEndian32(bytes + pos);
+            if (memcmp(type, "ustr", 4) == 0) {
+                valueLength *= 2;
+            }
+            pos += 4;
+        }
+        if (valueLength > size - pos) {
+            return NO;
+        }
+        
+        if (memcmp(code, "Iloc", 4) == 0 && memcmp(type, "blob", 4) == 0 && valueLength >= 8) {
+            DSStoreIconLocation loc;
+            loc.nameHash = hashUTF16BigEndian(name, nameLength * 2);
+            loc.x = (int32_t)readBigEndian32(bytes + pos);
+            loc.y = (int32_t)readBigEndian32(bytes + pos + 4);
+            [table appendBytes:&loc length:sizeof(loc)];
+        }
+        pos += valueLength;
+    }
+    
+    if (rightChild != 0) {
+        return [self scanIconLocationsInBlock:rightChild depth:depth + 1 into:table];
+    }
+    return YES;
+}
+
+- (NSData *)iconLocationTable {
+    NSMutableData *table = [NSMutableData data];
+    BOOL scanned = NO;
+    
+    if (!_isLoaded) {
+        if (!_blockAddresses) {
+            [self readHeader];
+        }
+        if (_blockAddresses && _records == 0) {
+            return table;
+        }
+        // A root outside the offsets table is the relative form only -load reads
+        if (_blockAddresses && _rootNode < [_blockAddresses count]) {
+            scanned = [self scanIconLocationsInBlock:_rootNode depth:0 into:table];
+        }
+        if (!scanned) {
+            if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Iloc scan failed, loading %@", _filePath);
+            [table setLength:0];
+            if (![self load]) {
+                return nil;
+            }
+        }
+    }
+    
+    if (!scanned) {
+        unichar buffer[1024];
+        
+        for (DSStoreEntry *entry in _entries) {
+            NSString *filename = [entry filename];
+            NSUInteger length = [filename length];
+            
+            NSData *value = [entry value];
+            
+            if (![[entry code] isEqualToString:@"Iloc"] || ![value isKindOfClass:[NSData class]]
+                || [value length] < 8 || length > 1024) {
+                continue;
+            }
+            DSStoreIconLocation loc;
+            
+            [filename getCharacters:buffer range:NSMakeRange(0, length)];
+            loc.nameHash = DSStoreFilenameHash(buffer, length);
+            loc.x = (int32_t)readBigEndian32([value bytes]);
+            loc.y = (int32_t)readBigEndian32((const uint8_t *)[value bytes] + 4);
+            [table appendBytes:&loc length:sizeof(loc)];
+        }
+    }
+    
+    qsort([table mutableBytes], [table length] / sizeof(DSStoreIconLocation),
+          sizeof(DSStoreIconLocation), compareIconLocations);
+    return table;
+}
+
+#pragma mark - Incremental Save
+
+- (void)noteChangedFilename:(NSString *)filename code:(NSString *)code {
+    if (filename && code) {
+        [_changedKeys addObject:[NSArray arrayWithObjects:filename, code, nil]];
+    }
+}
+
+// Whether the file is still the one the offsets table was read from
+- (BOOL)isUnchangedOnDisk {
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_filePath error:NULL];
+    
+    return attributes != nil
+        && [[attributes fileModificationDate] isEqualToDate:_fileModificationDate]
+        && [attributes fileSize] == _fileSize;
+}
+
+// Rewrites only the B-tree nodes holding changed records.  Each one goes to
+// a newly allocated block of the same size, and the root block's offsets
+// table is then switched over in a single write.  Nodes refer to their
+// children by block number, so the parents of a moved node stay as they
+// are.  Returns NO when the change would alter the shape of the tree (a
+// node overflows or empties, or a separator record goes away) or the file
+// is not laid out as expected; the caller then rewrites the whole file.
+- (BOOL)saveDirtyBlocks {
+    if (!_blockAddresses || _records == 0 || _rootNode >= [_blockAddresses count] ||
+        [_blockAddresses count] > 256 || !_tocData) {
+        return NO;
+    }
+    if (![self isUnchangedOnDisk]) {
+        if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"%@ changed on disk, rewriting it", _filePath);
+        return NO;
+    }
+    if ([_changedKeys count] == 0) {
+        return YES;
+    }
+    
+    // Block number -> node, and -> its records as (key, bytes) pairs
+    NSMutableDictionary *dirtyNodes = [NSMutableDictionary dictionary];
+    NSMutableDictionary *dirtyRecords = [NSMutableDictionary dictionary];
+    NSInteger recordsDelta = 0;
+    
+    for (NSArray *key in _changedKeys) {
+        NSString *filename = [key objectAtIndex:0];
+        NSString *code = [key objectAtIndex:1];
+        DSStoreEntry *current = nil;
+        DSStoreNode *node = nil;
+        NSUInteger index = 0;
+        BOOL found = NO;
+        uint32_t blockNum = _rootNode;
+        uint32_t depth;
+        
+        for (DSStoreEntry *entry in _entries) {
+            if ([[entry filename] isEqualToString:filename] && [[entry code] isEqualToString:code]) {
+                current = entry;
+                break;
+            }
+        }
+        
+        for (depth = 0; depth < 32; depth++) {
+            node = [self nodeForBlockNumber:blockNum];
+            if (!node || ![node isComplete]) {
+                return NO;
+            }
+            index = [node indexOfFilename:filename code:code found:&found];
+            if (found || [node isLeaf]) {
+                break;
+            }
+            blockNum = [node childAtIndex:index];
+        }
+        if (depth == 32) {
+            return NO;
+        }
+        
+        if (!found && !current) {
+            continue; // Added and removed again since the last save
+        }
+        if (!current && ![node isLeaf]) {
+            return NO; // A separator record goes away
+        }
+        
+        NSNumber *blockKey = [NSNumber numberWithUnsignedInt:blockNum];
+        NSMutableArray *records = [dirtyRecords objectForKey:blockKey];
+        if (!records) {
+            records = [NSMutableArray arrayWithCapacity:[node count] + 1];
+            for (NSUInteger i = 0; i < [node count]; i++) {
+                [records addObject:[NSArray arrayWithObjects:[node keyAtIndex:i], [node recordDataAtIndex:i], nil]];
+            }
+            [dirtyRecords setObject:records forKey:blockKey];
+            [dirtyNodes setObject:node forKey:blockKey];
+        }
+        
+        NSData *encoded = [current encode];
+        if (current && !encoded) {
+            return NO;
+        }
+        
+        if (found && current) {
+            [records replaceObjectAtIndex:index withObject:[NSArray arrayWithObjects:current, encoded, nil]];
+        } else if (found) {
+            // Removed; dropped below so that the indexes stay valid
+            [records replaceObjectAtIndex:index withObject:[NSNull null]];
+            recordsDelta--;
+        } else {
+            [records addObject:[NSArray arrayWithObjects:current, encoded, nil]];
+            recordsDelta++;
+        }
+    }
+    
+    if (![_allocator rebuildFreeListsWithUsedAddresses:_blockAddresses]) {
+        return NO;
+    }
+    
+    NSMutableArray *addresses = [NSMutableArray arrayWithArray:_blockAddresses];
+    NSMutableArray *oldAddresses = [NSMutableArray array];
+    NSMutableDictionary *writes = [NSMutableDictionary dictionary];
+    
+    for (NSNumber *blockKey in dirtyRecords) {
+        DSStoreNode *node = [dirtyNodes objectForKey:blockKey];
+        NSMutableArray *records = [dirtyRecords objectForKey:blockKey];
+        uint32_t blockNum = [blockKey unsignedIntValue];
+        uint32_t addr = [[addresses objectAtIndex:blockNum] unsignedIntValue];
+        uint32_t width = addr & 0x1F;
+        
+        [records removeObject:[NSNull null]];
+        if ([records count] == 0) {
+            return NO; // An empty leaf changes the shape
+        }
+        if ([node isLeaf]) {
+            [records sortUsingFunction:compareRecordPairs context:NULL];
+        }
+        
+        NSMutableData *data = [NSMutableData data];
+        uint32_t rightChild = swapBytes32([node isLeaf] ? 0 : [node childAtIndex:[node count]]);
+        uint32_t count = swapBytes32((uint32_t)[records count]);
+        [data appendBytes:&rightChild length:4];
+        [data appendBytes:&count length:4];
+        
+        for (NSUInteger i = 0; i < [records count]; i++) {
+            if (![node isLeaf]) {
+                uint32_t child = swapBytes32([node childAtIndex:i]);
+                [data appendBytes:&child length:4];
+            }
+            [data appendData:[[records objectAtIndex:i] objectAtIndex:1]];
+        }
+        
+        // Leave the last 4 bytes alone, as -load does not read them
+        if ([data length] > ((NSUInteger)1 << width) - 4) {
+            if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Node %u overflows its block, rewriting the file", blockNum);
+            return NO;
+        }
+        
+        NSUInteger offset = [_allocator allocateOffsetWithWidth:width];
+        if (offset == NSNotFound) {
+            return NO;
+        }
+        [data setLength:((NSUInteger)1 << width) - 4];
+        [writes setObject:data forKey:[NSNumber numberWithUnsignedInteger:offset + 4]];
+        [addresses replaceObjectAtIndex:blockNum withObject:[NSNumber numberWithUnsignedInt:(uint32_t)offset | width]];
+        [oldAddresses addObject:[NSNumber numberWithUnsignedInt:addr]];
+    }
+    
+    // A new superblock when the record count changes
+    uint32_t dsdbOffset = _dsdbOffset;
+    if (recordsDelta != 0) {
+        uint32_t addr = [[addresses objectAtIndex:_dsdbBlockNumber] unsignedIntValue];
+        uint32_t width = addr & 0x1F;
+        NSData *old = [_allocator readAtOffset:_dsdbOffset + 4 length:20];
+        NSUInteger offset = [_allocator allocateOffsetWithWidth:width];
+        
+        if (!old || offset == NSNotFound) {
+            return NO;
+        }
+        
+        NSMutableData *data = [NSMutableData dataWithData:old];
+        uint32_t records = swapBytes32((uint32_t)((NSInteger)_records + recordsDelta));
+        [data replaceBytesInRange:NSMakeRange(8, 4) withBytes:&records];
+        [data setLength:((NSUInteger)1 << width) - 4];
+        
+        [writes setObject:data forKey:[NSNumber numberWithUnsignedInteger:offset + 4]];
+        [addresses replaceObjectAtIndex:_dsdbBlockNumber withObject:[NSNumber numberWithUnsignedInt:(uint32_t)offset | width]];
+        [oldAddresses addObject:[NSNumber numberWithUnsignedInt:addr]];
+        dsdbOffset = (uint32_t)offset;
+    }
+    
+    // The replaced blocks are free once the root block points elsewhere
+    for (NSNumber *address in oldAddresses) {
+        uint32_t addr = [address unsignedIntValue];
+        [_allocator freeOffset:(addr & ~0x1F) width:(addr & 0x1F)];
+    }
+    
+    NSMutableData *rootData = [NSMutableData data];
+    uint32_t value = swapBytes32((uint32_t)[addresses count]);
+    [rootData appendBytes:&value length:4];
+    value = swapBytes32(_rootBlockUnknown);
+    [rootData appendBytes:&value length:4];
+    for (NSUInteger i = 0; i < 256; i++) {
+        value = (i < [addresses count]) ? swapBytes32([[addresses objectAtIndex:i] unsignedIntValue]) : 0;
+        [rootData appendBytes:&value length:4];
+    }
+    [rootData appendData:_tocData];
+    [_allocator appendFreeListsToData:rootData];
+    
+    if ([rootData length] > _rootBlockSize - 4) {
+        return NO;
+    }
+    [rootData setLength:_rootBlockSize - 4];
+    
+    // New blocks first, then the root block that switches over to them
+    if (![_allocator writeInPlace:writes]) {
+        return NO;
+    }
+    if (![_allocator writeInPlace:[NSDictionary dictionaryWithObject:rootData
+                                                              forKey:[NSNumber numberWithUnsignedInteger:_rootBlockOffset + 4]]]) {
+        return NO;
+    }
+    
+    if (gDSStoreVerbose) NSDebugLLog(@"gwspace", @"Rewrote %lu B-tree node(s) of %@",
+                                     (unsigned long)[writes count], _filePath);
+    
+    NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:_filePath error:NULL];
+    
+    [_blockAddresses release];
+    _blockAddresses = [addresses copy];
+    [_fileModificationDate release];
+    _fileModificationDate = [[attributes fileModificationDate] retain];
+    _fileSize = (NSUInteger)[attributes fileSize];
+    _records = (uint32_t)((NSInteger)_records + recordsDelta);
+    _dsdbOffset = dsdbOffset;
+    [_nodeCache removeAllObjects];
+    [_nodeCacheOrder removeAllObjects];
+    [_changedKeys removeAllObjects];
+    
+    return YES;
+}
+
 - (BOOL)save {
     if (!_isLoaded) {
         NSDebugLLog(@"gwspace", @"Cannot save unloaded store");
         return NO;
     }
     
+    // Only the changed nodes, when the tree keeps its shape
+    if ([self saveDirtyBlocks]) {
+        return YES;
+    }
+    
     NSMutableData *fileData = [NSMutableData data];
     
     // Write the buddy allocator header
@@ -575,10 +1377,20 @@ static uint32_t swapBytes32(uint32_t x) {
     }
     
     NSDebugLLog(@"gwspace", @"Saved .DS_Store file: %@ (%lu bytes)", _filePath, (unsigned long)[fileData length]);
+    
+    // Later saves rewrite single blocks of the new layout
+    [self readHeader];
+    [_changedKeys removeAllObjects];
     return YES;
 }
 
 - (DSStoreEntry *)entryForFilename:(NSString *)filename code:(NSString *)code {
+    if (!_isLoaded && _lazy) {
+        DSStoreEntry *entry;
+        if ([self lazyEntryForFilename:filename code:code entry:&entry]) {
+            return entry;
+        }
+    }
     if (!_isLoaded) {
         [self load];
     }
@@ -604,6 +1416,7 @@ static uint32_t swapBytes32(uint32_t x) {
     }
     
     [_entries addObject:entry];
+    [self noteChangedFilename:[entry filename] code:[entry code]];
     _dirty = YES;  // Mark as modified
 }
 
@@ -615,6 +1428,7 @@ static uint32_t swapBytes32(uint32_t x) {
     DSStoreEntry *entry = [self entryForFilename:filename code:code];
     if (entry) {
         [_entries removeObject:entry];
+        [self noteChangedFilename:filename code:code];
         _dirty = YES;  // Mark as modified
     }
 }
@@ -1197,6 +2011,10 @@ static uint32_t swapBytes32(uint32_t x) {
 }
 
 - (void)removeAllEntriesForFilename:(NSString *)filename {
+    if (!_isLoaded && _lazy) {
+        [self load];
+    }
+    
     NSMutableArray *toRemove = [NSMutableArray array];
     
     for (DSStoreEntry *entry in _entries) {
@@ -1207,11 +2025,16 @@ static uint32_t swapBytes32(uint32_t x) {
     
     for (DSStoreEntry *entry in toRemove) {
         [_entries removeObject:entry];
+        [self noteChangedFilename:[entry filename] code:[entry code]];
         _dirty = YES;
     }
 }
 
 - (NSArray *)allFilenames {
+    if (!_isLoaded && _lazy) {
+        [self load];
+    }
+    
     NSMutableSet *filenames = [NSMutableSet set];
     
     for (DSStoreEntry *entry in _entries) {
@@ -1222,6 +2045,10 @@ static uint32_t swapBytes32(uint32_t x) {
 }
 
 - (NSArray *)allCodesForFilename:(NSString *)filename {
+    if (!_isLoaded && _lazy) {
+        [self load];
+    }
+    
     NSMutableArray *codes = [NSMutableArray array];
     
     for (DSStoreEntry *entry in _entries) {
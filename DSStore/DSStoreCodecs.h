@@ -20,6 +20,36 @@
 @interface DSPlistCodec : NSObject <DSStoreCodec>
 @end
 
+// Lazily decoded property list, as returned by DSPlistCodec.  Keeps the raw
+// bytes and parses them on first access; -scalarForKey: reads a top-level
+// number or string straight out of a binary plist without building the
+// dictionary, which is all most viewers need from icvp or lsvp.
+@interface DSPlistValue : NSObject
+{
+    NSData *_data;
+    id _plist;
+    BOOL _parsed;
+}
+
++ (DSPlistValue *)valueWithData:(NSData *)data;
+- (id)initWithData:(NSData *)data;
+
+- (NSData *)data;
+- (BOOL)isParsed;
+
+// The whole property list, parsed once
+- (id)propertyList;
+- (NSDictionary *)dictionary;
+
+// Top-level NSNumber or NSString for key, or nil when the key is missing or
+// its value is a container, data or date (use -objectForKey: for those)
+- (id)scalarForKey:(NSString *)key;
+
+// Any top-level value; scalars take the fast path, the rest parse the list
+- (id)objectForKey:(NSString *)key;
+
+@end
+
 // Boolean codec (bool)
 @interface DSBoolCodec : NSObject <DSStoreCodec>
 @end
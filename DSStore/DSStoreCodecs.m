@@ -77,10 +77,312 @@ static uint64_t swap64(uint64_t x) {
 
 @end
 
+#pragma mark - Binary plist scanning
+
+// Just enough of the bplist00 format to find one key of the top-level
+// dictionary: the trailer, the offset table and the object markers.
+typedef struct {
+    const uint8_t *bytes;
+    uint64_t end;           // start of the offset table; objects lie before it
+    unsigned offsetSize;
+    unsigned refSize;
+    uint64_t numObjects;
+    uint64_t topObject;
+} DSBPlist;
+
+typedef enum {
+    DSBPlistKeyMissing,
+    DSBPlistKeyScalar,
+    DSBPlistKeyOther,       // present, but not a number or string
+    DSBPlistUnreadable      // not a binary plist, or not a dictionary
+} DSBPlistLookup;
+
+static uint64_t readBigEndian(const uint8_t *p, unsigned n) {
+    uint64_t v = 0;
+
+    while (n--) {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+static BOOL bplistOpen(NSData *data, DSBPlist *bp) {
+    NSUInteger length = [data length];
+    const uint8_t *bytes = [data bytes];
+    const uint8_t *trailer;
+    uint64_t tableOffset;
+
+    if (length < 8 + 32 || memcmp(bytes, "bplist00", 8) != 0) {
+        return NO;
+    }
+
+    trailer = bytes + length - 32;
+    bp->bytes = bytes;
+    bp->offsetSize = trailer[6];
+    bp->refSize = trailer[7];
+    bp->numObjects = readBigEndian(trailer + 8, 8);
+    bp->topObject = readBigEndian(trailer + 16, 8);
+    tableOffset = readBigEndian(trailer + 24, 8);
+
+    if (bp->offsetSize < 1 || bp->offsetSize > 8 || bp->refSize < 1 || bp->refSize > 8
+        || bp->topObject >= bp->numObjects || tableOffset < 8
+        || tableOffset > length - 32
+        || bp->numObjects > (length - 32 - tableOffset) / bp->offsetSize) {
+        return NO;
+    }
+    bp->end = tableOffset;
+    return YES;
+}
+
+static BOOL bplistObjectOffset(DSBPlist *bp, uint64_t ref, uint64_t *offset) {
+    if (ref >= bp->numObjects) {
+        return NO;
+    }
+    *offset = readBigEndian(bp->bytes + bp->end + ref * bp->offsetSize, bp->offsetSize);
+    return *offset >= 8 && *offset < bp->end;
+}
+
+// Element count of the object at offset; *start is its first content byte
+static BOOL bplistCount(DSBPlist *bp, uint64_t offset, uint64_t *count, uint64_t *start) {
+    uint8_t info = bp->bytes[offset] & 0x0F;
+    uint64_t pos = offset + 1;
+    unsigned size;
+
+    if (info != 0x0F) {
+        *count = info;
+        *start = pos;
+        return YES;
+    }
+    if (pos >= bp->end || (bp->bytes[pos] & 0xF0) != 0x10) {
+        return NO;
+    }
+    size = 1 << (bp->bytes[pos] & 0x0F);
+    if (size > 8 || pos + 1 + size > bp->end) {
+        return NO;
+    }
+    *count = readBigEndian(bp->bytes + pos + 1, size);
+    *start = pos + 1 + size;
+    return YES;
+}
+
+static BOOL bplistKeyMatches(DSBPlist *bp, uint64_t offset, const char *key, NSUInteger keyLength,
+                             NSString *keyString) {
+    uint8_t type = bp->bytes[offset] & 0xF0;
+    uint64_t count, start;
+
+    if (!bplistCount(bp, offset, &count, &start)) {
+        return NO;
+    }
+    if (type == 0x50) {
+        return count == keyLength && count <= bp->end - start
+            && memcmp(bp->bytes + start, key, keyLength) == 0;
+    }
+    if (type == 0x60 && count <= (bp->end - start) / 2) {
+        NSString *s = [[NSString alloc] initWithBytes:bp->bytes + start
+                                               length:count * 2
+                                             encoding:NSUTF16BigEndianStringEncoding];
+        BOOL matches = [s isEqualToString:keyString];
+
+        [s release];
+        return matches;
+    }
+    return NO;
+}
+
+// Number or string at offset, or nil for any other kind of object
+static id bplistScalar(DSBPlist *bp, uint64_t offset) {
+    uint8_t marker = bp->bytes[offset];
+    unsigned size = 1 << (marker & 0x0F);
+    uint64_t count, start;
+
+    switch (marker & 0xF0) {
+    case 0x00:
+        if (marker == 0x08 || marker == 0x09) {
+            return [NSNumber numberWithBool:(marker == 0x09)];
+        }
+        return nil;
+    case 0x10:
+        if (size > 8 || offset + 1 + size > bp->end) {
+            return nil;
+        }
+        if (size == 8) {
+            return [NSNumber numberWithLongLong:(int64_t)readBigEndian(bp->bytes + offset + 1, 8)];
+        }
+        return [NSNumber numberWithUnsignedLongLong:readBigEndian(bp->bytes + offset + 1, size)];
+    case 0x20:
+        if (offset + 1 + size > bp->end) {
+            return nil;
+        }
+        if (size == 4) {
+            uint32_t bits = (uint32_t)readBigEndian(bp->bytes + offset + 1, 4);
+            float f;
+
+            memcpy(&f, &bits, 4);
+            return [NSNumber numberWithFloat:f];
+        }
+        if (size == 8) {
+            uint64_t bits = readBigEndian(bp->bytes + offset + 1, 8);
+            double d;
+
+            memcpy(&d, &bits, 8);
+            return [NSNumber numberWithDouble:d];
+        }
+        return nil;
+    case 0x50:
+        if (!bplistCount(bp, offset, &count, &start) || count > bp->end - start) {
+            return nil;
+        }
+        return [[[NSString alloc] initWithBytes:bp->bytes + start
+                                         length:count
+                                       encoding:NSASCIIStringEncoding] autorelease];
+    case 0x60:
+        if (!bplistCount(bp, offset, &count, &start) || count > (bp->end - start) / 2) {
+            return nil;
+        }
+        return [[[NSString alloc] initWithBytes:bp->bytes + start
+                                         length:count * 2
+                                       encoding:NSUTF16BigEndianStringEncoding] autorelease];
+    default:
+        return nil;
+    }
+}
+
+static DSBPlistLookup bplistLookup(NSData *data, NSString *key, id *value) {
+    DSBPlist bp;
+    uint64_t offset, count, start, i;
+    const char *keyBytes = [key UTF8String];
+    NSUInteger keyLength = strlen(keyBytes);
+
+    *value = nil;
+    if (!bplistOpen(data, &bp) || !bplistObjectOffset(&bp, bp.topObject, &offset)
+        || (bp.bytes[offset] & 0xF0) != 0xD0 || !bplistCount(&bp, offset, &count, &start)
+        || count > (bp.end - start) / (2 * bp.refSize)) {
+        return DSBPlistUnreadable;
+    }
+
+    // count key refs, then count value refs
+    for (i = 0; i < count; i++) {
+        uint64_t keyOffset, valueOffset;
+
+        if (!bplistObjectOffset(&bp, readBigEndian(bp.bytes + start + i * bp.refSize, bp.refSize),
+                                &keyOffset)) {
+            return DSBPlistUnreadable;
+        }
+        if (!bplistKeyMatches(&bp, keyOffset, keyBytes, keyLength, key)) {
+            continue;
+        }
+        if (!bplistObjectOffset(&bp, readBigEndian(bp.bytes + start + (count + i) * bp.refSize,
+                                                   bp.refSize), &valueOffset)) {
+            return DSBPlistUnreadable;
+        }
+        *value = bplistScalar(&bp, valueOffset);
+        return *value ? DSBPlistKeyScalar : DSBPlistKeyOther;
+    }
+    return DSBPlistKeyMissing;
+}
+
+#pragma mark - Lazy property list
+
+@implementation DSPlistValue
+
++ (DSPlistValue *)valueWithData:(NSData *)data {
+    return [[[self alloc] initWithData:data] autorelease];
+}
+
+- (id)initWithData:(NSData *)data {
+    if ((self = [super init])) {
+        _data = [data copy];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_data release];
+    [_plist release];
+    [super dealloc];
+}
+
+- (NSData *)data {
+    return _data;
+}
+
+- (BOOL)isParsed {
+    return _parsed;
+}
+
+- (id)propertyList {
+    if (!_parsed) {
+        NSError *error = nil;
+
+        _parsed = YES;
+        _plist = [[NSPropertyListSerialization propertyListWithData:_data
+                                                            options:NSPropertyListImmutable
+                                                             format:NULL
+                                                              error:&error] retain];
+        if (_plist == nil) {
+            NSDebugLLog(@"gwspace", @"Error decoding plist: %@", [error localizedDescription]);
+        }
+    }
+    return _plist;
+}
+
+- (NSDictionary *)dictionary {
+    id plist = [self propertyList];
+
+    return [plist isKindOfClass:[NSDictionary class]] ? plist : nil;
+}
+
+- (id)scalarForKey:(NSString *)key {
+    id value = nil;
+
+    if (key == nil) {
+        return nil;
+    }
+    if (_parsed) {
+        value = [[self dictionary] objectForKey:key];
+        return ([value isKindOfClass:[NSNumber class]] || [value isKindOfClass:[NSString class]])
+            ? value : nil;
+    }
+    if (bplistLookup(_data, key, &value) == DSBPlistUnreadable) {
+        // XML or otherwise unusual: parse it the normal way
+        [self propertyList];
+        return [self scalarForKey:key];
+    }
+    return value;
+}
+
+- (id)objectForKey:(NSString *)key {
+    id value = nil;
+
+    if (key == nil) {
+        return nil;
+    }
+    if (!_parsed) {
+        switch (bplistLookup(_data, key, &value)) {
+        case DSBPlistKeyScalar:
+            return value;
+        case DSBPlistKeyMissing:
+            return nil;
+        default:
+            break;
+        }
+    }
+    return [[self dictionary] objectForKey:key];
+}
+
+- (NSString *)description {
+    return [[self propertyList] description];
+}
+
+@end
+
 // Property list codec
 @implementation DSPlistCodec
 
 + (NSData *)encodeValue:(id)value {
+    if ([value isKindOfClass:[DSPlistValue class]]) {
+        return [(DSPlistValue *)value data];
+    }
     if (![value isKindOfClass:[NSDictionary class]] && ![value isKindOfClass:[NSArray class]]) {
         return nil;
     }
@@ -98,18 +400,12 @@ static uint64_t swap64(uint64_t x) {
     return plistData;
 }
 
+// Parsing is deferred until the value is used; see DSPlistValue
 + (id)decodeData:(NSData *)data {
-    NSError *error = nil;
-    id plist = [NSPropertyListSerialization propertyListWithData:data
-                                                         options:0
-                                                          format:NULL
-                                                           error:&error];
-    if (error) {
-        NSDebugLLog(@"gwspace", @"Error decoding plist: %@", [error localizedDescription]);
+    if ([data length] == 0) {
         return nil;
     }
-    
-    return plist;
+    return [DSPlistValue valueWithData:data];
 }
 
 @end
@@ -7,6 +7,8 @@
 #import <Foundation/Foundation.h>
 #import "SimpleColor.h"  // Simple color replacement for headless systems
 
+@class DSPlistValue;
+
 @interface DSStoreEntry : NSObject
 {
     NSString *_filename;
@@ -72,6 +74,9 @@
 - (BOOL)booleanValue;
 - (int32_t)longValue;
 
+// Lazily parsed property list of a blob record (bwsp, icvp, lsvp, ...)
+- (DSPlistValue *)plistValue;
+
 // Icon view options extraction
 - (int)gridSpacing;
 - (int)textSize;
@@ -5,6 +5,7 @@
  */
 
 #import "DSStoreEntry.h"
+#import "DSStoreCodecs.h"
 #include <arpa/inet.h>  // For htonl, ntohl, htons, ntohs
 
 // Byte swapping functions for portability
@@ -508,6 +509,14 @@ static uint64_t swapBytes64(uint64_t value) {
     return [(NSNumber *)_value intValue];
 }
 
+- (DSPlistValue *)plistValue {
+    if (![_type isEqualToString:@"blob"] || ![_value isKindOfClass:[NSData class]]) {
+        return nil;
+    }
+    
+    return [DSPlistCodec decodeData:(NSData *)_value];
+}
+
 // Icon view options extraction
 
 - (int)gridSpacing {
@@ -101,6 +101,10 @@
 - (void)loadColumnZero;
 - (FSNBrowserColumn *)createEmptyColumn;
 - (void)addAndLoadColumnForNode:(FSNode *)node;
+/* With `background`, a listing that is not cached is read off the main
+   thread and streamed into the column; see -loadContentsOfNode:. */
+- (void)addAndLoadColumnForNode:(FSNode *)node
+                   inBackground:(BOOL)background;
 - (void)addFillingColumn;
 - (void)unloadFromColumn:(NSInteger)column;
 - (void)reloadColumnWithNode:(FSNode *)anode;
@@ -41,6 +41,8 @@
 #import "FSNBrowserCell.h"
 #import "FSNIcon.h"
 #import "FSNFunctions.h"
+#import "FSNPrefetcher.h"
+#import "FSNTrace.h"
 
 
 #define DEFAULT_ISIZE 24
@@ -506,6 +508,12 @@
 }
 
 - (void)addAndLoadColumnForNode:(FSNode *)node
+{
+  [self addAndLoadColumnForNode: node inBackground: NO];
+}
+
+- (void)addAndLoadColumnForNode:(FSNode *)node
+                   inBackground:(BOOL)background
 {
   FSNBrowserColumn *bc;
   NSInteger i;
@@ -520,7 +528,11 @@
     }
 
   bc = [columns objectAtIndex: i];
-  [bc showContentsOfNode: node];
+
+  if (background)
+    [bc loadContentsOfNode: node];
+  else
+    [bc showContentsOfNode: node];
 
   updateViewsLock++;
   [self setLastColumn: i];
@@ -743,10 +755,10 @@
   if (column >= 0 && column < [columns count])
     {
       FSNBrowserColumn *bc = [columns objectAtIndex: column];
-      NSMatrix *matrix = [bc cmatrix];
-      if (row >= 0 && row < [matrix numberOfRows])
+
+      if (row >= 0 && row < [[bc nodes] count])
         {
-          [bc selectCell: [matrix cellAtRow: row column: 0] sendAction: YES];
+          [bc selectRow: row sendAction: YES];
         }
     }
 }
@@ -754,6 +766,7 @@
 
 - (void)tile
 {
+  FSN_TRACE_SCOPE ("FSNBrowser tile");
   updateViewsLock = (updateViewsLock < 0) ? 0 : updateViewsLock;
 
   if (updateViewsLock == 0) {
@@ -1281,7 +1294,8 @@
       
       if ([node isDirectory] && ([node isPackage] == NO))
         {
-          [self addAndLoadColumnForNode: node];
+          /* nothing selects in the new column, so it can fill in */
+          [self addAndLoadColumnForNode: node inBackground: YES];
           added = 1;
           
         }
@@ -1314,6 +1328,36 @@
   [self tile];
   
   [self notifySelectionChange: [col selectedNodes]];		  
+
+  if ([selection count] == 1)
+    [self prefetchAroundSelectionInColumn: col];
+}
+
+/* The column of the selected folder is already being read; arrowing up
+   or down lands on the neighbours next. */
+- (void)prefetchAroundSelectionInColumn:(FSNBrowserColumn *)col
+{
+  NSArray *colnodes = [col nodes];
+  NSInteger row = [col selectedRow];
+  NSInteger rows = [colnodes count];
+  NSMutableArray *nodes;
+  NSInteger i;
+
+  if (row < 0)
+    return;
+
+  nodes = [NSMutableArray arrayWithCapacity: 2];
+
+  for (i = row + 1; i >= row - 1; i -= 2)
+    {
+      if ((i >= 0) && (i < rows))
+        {
+          [nodes addObject: [colnodes objectAtIndex: i]];
+        }
+    }
+
+  [[FSNPrefetcher sharedPrefetcher] prefetchNodes: nodes
+                                         iconSize: (cellsIcon ? [cellPrototype iconSize] : 0)];
 }
 
 - (void)doubleClickInMatrixOfColumn:(FSNBrowserColumn *)col
@@ -1583,14 +1627,14 @@
 
 - (void)showContentsOfNode:(FSNode *)anode
 {
+  FSN_TRACE_SCOPE ("FSNBrowser showContentsOfNode");
   [self showSubnode: anode];
 }
 
 - (NSDictionary *)readNodeInfo
 {
-  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
   NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [baseNode path]];
-  NSDictionary *nodeDict = [defaults dictionaryForKey: prefsname];
+  NSDictionary *nodeDict = [fsnodeRep viewerPrefsForKey: prefsname];
 
   if (nodeDict) {
     id entry = [nodeDict objectForKey: @"fsn_info_type"];
@@ -1623,10 +1667,9 @@
   NSMutableDictionary *updatedInfo = nil;
 
   if ([baseNode isValid]) {
-    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
     NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [baseNode path]];
 
-    NSDictionary *prefs = [defaults dictionaryForKey: prefsname];
+    NSDictionary *prefs = [fsnodeRep viewerPrefsForKey: prefsname];
     if (prefs)
       updatedInfo = [prefs mutableCopy];
     else
@@ -1639,7 +1682,7 @@
       [updatedInfo setObject: extInfoType forKey: @"ext_info_type"];
 
     if (ondisk)
-      [defaults setObject: updatedInfo forKey: prefsname];
+      [fsnodeRep setViewerPrefs: updatedInfo forKey: prefsname];
   }
       
   RELEASE (arp);
@@ -1649,6 +1692,7 @@
 
 - (void)reloadContents
 {
+  FSN_TRACE_SCOPE ("FSNBrowser reloadContents");
   [self reloadFromColumnWithNode: baseNode];
 }
 
@@ -1747,7 +1791,7 @@
           NSString *newname = [files objectAtIndex: 0];
           NSString *newpath = [destination stringByAppendingPathComponent: newname];
           
-          selectCell = ([bc cellWithPath: newpath] != nil);
+          selectCell = ([bc rowOfNodeWithPath: newpath] != NSNotFound);
         }
         
         if (selectCell) {
@@ -1960,7 +2004,7 @@
         
       updateViewsLock++; 
     
-      [[col cmatrix] deselectAllCells];
+      [col unselectAllCells];
       [self setLastColumn: index];
       [self reloadFromColumn: col];
     
@@ -1983,7 +2027,7 @@
   FSNBrowserColumn *bc = [self lastLoadedColumn];
   
   if (bc) {
-    [[bc cmatrix] deselectAllCells];
+    [bc unselectAllCells];
     [self notifySelectionChange: [NSArray arrayWithObject: [bc shownNode]]];
   }
 }
@@ -44,6 +44,7 @@
 
   FSNInfoType showType;
   NSCell *infoCell;
+  int infoHeight;
   NSRect titleRect;
   NSRect infoRect;
 
@@ -59,6 +60,12 @@
 
   BOOL nameEdited;
 
+  /* the last label fitted by -drawInteriorWithFrame:inView: */
+  NSString *fitSource;
+  NSString *fitTitle;
+  NSFont *fitFont;
+  float fitWidth;
+
   FSNodeRep *fsnodeRep;
 }
 
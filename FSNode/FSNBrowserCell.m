@@ -30,6 +30,7 @@
 #import "FSNBrowserCell.h"
 #import "FSNode.h"
 #import "FSNFunctions.h"
+#import "FSNFontWidths.h"
 #import "FSNMetadataProvider.h"
 
 #define DEFAULT_ISIZE (16)
@@ -37,7 +38,6 @@
 
 static id <DesktopApplication> desktopApp = nil;
 
-static NSString *dots = @"...";
 
 @implementation FSNBrowserCell
 
@@ -51,6 +51,9 @@ static NSString *dots = @"...";
   RELEASE (icon); 
   RELEASE (selectedicon);
   RELEASE (tagColor);
+  RELEASE (fitSource);
+  RELEASE (fitTitle);
+  RELEASE (fitFont);
 
   [super dealloc];
 }
@@ -95,6 +98,11 @@ static NSString *dots = @"...";
       iconSelected = NO;
       isOpened = NO;
       nameEdited = NO;
+
+      fitSource = nil;
+      fitTitle = nil;
+      fitFont = nil;
+      fitWidth = 0;
       
       [self setAllowsMixedState: NO];
       
@@ -162,50 +170,8 @@ static NSString *dots = @"...";
 - (NSString *)cutTitle:(NSString *)title 
             toFitWidth:(float)width
 {
-  NSDictionary *fontAttr;
-
-  fontAttr = [NSDictionary dictionaryWithObject: [NSFont systemFontOfSize: 12]
-			   forKey: NSFontAttributeName];
-
-  if ([title sizeWithAttributes: fontAttr].width > width) {
-    int tl = [title length];
-  
-    if (tl <= 5) {
-      return dots;
-    } else {
-      int fpto = (tl / 2) - 2;
-      int spfr = fpto + 3;
-      NSString *fp = [title substringToIndex: fpto];
-      NSString *sp = [title substringFromIndex: spfr];
-      NSString *dotted = [NSString stringWithFormat: @"%@%@%@", fp, dots, sp];
-      int dl = [dotted length];
-      float dotl = [dotted sizeWithAttributes: fontAttr].width;
-      int p = 0;
-
-      while (dotl > width) {
-        if (dl <= 5) {
-          return dots;
-        }        
-
-        if (p) {
-          fpto--;
-        } else {
-          spfr++;
-        }
-        p = !p;
-
-        fp = [title substringToIndex: fpto];
-        sp = [title substringFromIndex: spfr];
-        dotted = [NSString stringWithFormat: @"%@%@%@", fp, dots, sp];
-        dotl = [dotted sizeWithAttributes: fontAttr].width;
-        dl = [dotted length];
-      }      
-      
-      return dotted;
-    }
-  }
-  
-  return title;
+  return [[FSNFontWidths widthsForFont: [self font]] titleForString: title
+                                                        fittingWidth: width];
 }
 
 - (void)drawInteriorWithFrame:(NSRect)cellFrame
@@ -241,7 +207,17 @@ static NSString *dots = @"...";
 
       textlenght -= MARGIN;
       ASSIGN (uncutTitle, [self stringValue]);
-      [self setStringValue: [self cutTitle:uncutTitle toFitWidth:textlenght]];
+
+      /* scrolling redraws the same labels at the same width */
+      if ((fitWidth != textlenght) || (fitFont != [self font])
+          || ([fitSource isEqualToString: uncutTitle] == NO))
+        {
+          ASSIGN (fitTitle, [self cutTitle: uncutTitle toFitWidth: textlenght]);
+          ASSIGN (fitSource, uncutTitle);
+          ASSIGN (fitFont, [self font]);
+          fitWidth = textlenght;
+        }
+      [self setStringValue: fitTitle];
 
       [self setShowsFirstResponder: NO];
 
@@ -251,7 +227,7 @@ static NSString *dots = @"...";
             {
               if (infoCell)
                 {
-                  infoheight = floor([[FSNodeRep sharedInstance] heightOfFont: [infoCell font]]);
+                  infoheight = infoHeight;
 
                   if (([self isHighlighted] || [self state]) && (nameEdited == NO))
                     {
@@ -583,6 +559,7 @@ static NSString *dots = @"...";
                                                     toHaveTrait: NSItalicFontMask];
       infoCell = [NSCell new];
       [infoCell setFont: infoFont];
+      infoHeight = floor([fsnodeRep heightOfFont: infoFont]);
     }
   
   switch(showType) {
@@ -28,18 +28,31 @@
 #include <Foundation/Foundation.h>
 #include <AppKit/NSView.h>
 #include "FSNodeRep.h"
+#include "FSNDirectoryLoader.h"
 
 @class FSNBrowser;
 @class FSNBrowserCell;
 @class FSNBrowserMatrix;
 @class FSNBrowserScroll;
+@class FSNSelectionSet;
 
-@interface FSNBrowserColumn : NSView 
+@interface FSNBrowserColumn : NSView <FSNDirectoryLoaderDelegate>
 {
   FSNBrowserScroll *scroll;
   FSNBrowserMatrix *matrix;
+  NSView *rowsView;
   FSNBrowserCell *cellPrototype;
 
+  /* The rows are the sorted subnodes of the shown node.  Only those in
+     boundRows have a cell in the matrix, which sits at their place in
+     rowsView; the selection and the locks are kept by row. */
+  NSMutableArray *nodes;
+  FSNSelectionSet *selection;
+  NSUInteger anchorRow;
+  NSRange boundRows;
+  NSMutableSet *lockedPaths;
+  BOOL allLocked;
+
   int cellsHeight;
   BOOL cellsIcon;
     
@@ -51,6 +64,9 @@
   BOOL isLoaded;
   BOOL isLeaf;
 
+  FSNDirectoryLoader *loader;
+  BOOL changedWhileLoading;
+
   BOOL isDragTarget;
   BOOL forceCopy;
   NSDragOperation negotiatedDragOp;
@@ -75,6 +91,14 @@
 
 - (void)showContentsOfNode:(FSNode *)anode;
 
+/* Like -showContentsOfNode:, but a listing that is not cached yet is
+ * read on a background thread: the column fills in as entries arrive
+ * and stays responsive meanwhile.  Showing anything else cancels it. */
+- (void)loadContentsOfNode:(FSNode *)anode;
+
+/* YES while a listing started by -loadContentsOfNode: is still arriving. */
+- (BOOL)isLoading;
+
 - (FSNode *)shownNode;
 
 - (void)createRowsInMatrix;
@@ -83,6 +107,38 @@
 
 - (void)removeCellsWithNames:(NSArray *)names;
 
+/* The sorted subnodes shown, one per row. */
+- (NSArray *)nodes;
+
+/* The first selected row, or -1. */
+- (NSInteger)selectedRow;
+
+/* The row matrix row `row` is bound to. */
+- (NSUInteger)rowOfMatrixRow:(NSInteger)row;
+
+/* The first row of the matrix, the rows before it have no cell. */
+- (NSUInteger)firstBoundRow;
+
+/* NSNotFound when no row shows it. */
+- (NSUInteger)rowOfNodeWithPath:(NSString *)path;
+
+/* Selecting a row with no cell, here or by node, path or name, scrolls
+ * it into view first. */
+- (void)selectRow:(NSUInteger)row
+       sendAction:(BOOL)act;
+
+/* Moves the selection up or down by `offset` rows; with `extend` the
+ * rows on the way are added to it. */
+- (void)moveSelectionBy:(NSInteger)offset
+                 extend:(BOOL)extend;
+
+/* Scrolls the row into view and binds it to a cell. */
+- (void)scrollRowToVisible:(NSUInteger)row;
+
+/* Binds the cells to the rows in view; done whenever the column scrolls. */
+- (void)bindVisibleRows;
+
+/* Only the selected rows that are bound to a cell have one. */
 - (NSArray *)selectedCells;
 
 - (NSArray *)selectedNodes;
@@ -143,6 +199,7 @@
 
 - (void)unlock;
      
+/* nil for the nodes of rows that are not bound to a cell. */
 - (FSNBrowserCell *)cellOfNode:(FSNode *)node;                
 
 - (FSNBrowserCell *)cellWithPath:(NSString *)path;                
@@ -32,9 +32,16 @@
 #import "FSNBrowserScroll.h"
 #import "FSNBrowser.h"
 #import "FSNFunctions.h"
+#import "FSNSelectionSet.h"
+#import "FSNRowWindow.h"
 
 #define ICON_CELL_HEIGHT 28
 
+/* A column with more rows than this has only this many cells, or three
+ * screens of them when that is more, bound to the rows around the visible
+ * ones; a shorter one has a cell for each row. */
+#define VIRTUAL_ROWS_POOL (400)
+
 #define CHECKRECT(rct) \
 if (rct.size.width < 0) rct.size.width = 0; \
 if (rct.size.height < 0) rct.size.height = 0
@@ -45,15 +52,62 @@ if (sz.height < 0) sz.height = 0
 
 static id <DesktopApplication> desktopApp = nil;
 
+
+/* The document view of a column, as tall as all of its rows; the matrix
+   is moved over the rows that are bound to its cells. */
+@interface FSNBrowserRowsView : NSView
+@end
+
+@implementation FSNBrowserRowsView
+
+- (BOOL)isFlipped
+{
+  return YES;
+}
+
+@end
+
+
+@interface FSNBrowserColumn (Private)
+- (void)clipViewBoundsDidChange:(NSNotification *)notif;
+- (NSUInteger)poolCapacity;
+- (NSRange)visibleRows;
+- (void)sizeRowsView;
+- (void)bindRows:(NSRange)rows;
+- (void)bindCell:(FSNBrowserCell *)cell
+           toRow:(NSUInteger)row;
+- (void)reloadRows;
+- (void)updateMatrixSelection;
+- (void)readMatrixSelection;
+- (void)sendSelectionAction;
+- (FSNBrowserCell *)cellOfRow:(NSUInteger)row;
+- (NSArray *)visibleNodesWithScrollTune:(float *)tune;
+- (void)scrollToNode:(FSNode *)node
+      withScrollTune:(float)tune;
+- (void)selectRowsWithValues:(NSArray *)values
+                    ofGetter:(SEL)getter
+                  sendAction:(BOOL)act;
+- (void)setLocked:(BOOL)locked
+         forPaths:(NSArray *)paths;
+- (NSArray *)pathsOfNames:(NSArray *)names;
+@end
+
+
 @implementation FSNBrowserColumn
 
 - (void)dealloc
 {
+  [[NSNotificationCenter defaultCenter] removeObserver: self];
+  [loader cancel];
+  RELEASE (loader);
   RELEASE (cellPrototype);
   RELEASE (shownNode);
   RELEASE (oldNode);
   RELEASE (extInfoType);
   RELEASE (backColor);
+  RELEASE (nodes);
+  RELEASE (selection);
+  RELEASE (lockedPaths);
 
   [super dealloc];
 }
@@ -113,6 +167,15 @@ static id <DesktopApplication> desktopApp = nil;
       scroll = nil;
       matrix = nil;
       isLoaded = NO;
+      loader = nil;
+      changedWhileLoading = NO;
+
+      nodes = [NSMutableArray new];
+      selection = [FSNSelectionSet new];
+      anchorRow = NSNotFound;
+      boundRows = NSMakeRange(0, 0);
+      lockedPaths = [NSMutableSet new];
+      allLocked = NO;
 
       [self setFrame: rect];
 
@@ -134,6 +197,8 @@ static id <DesktopApplication> desktopApp = nil;
 
       isDragTarget = NO;
 
+      rowsView = [[FSNBrowserRowsView alloc] initWithFrame: [self bounds]];
+
       matrix = [[FSNBrowserMatrix alloc] initInColumn: self
 					    withFrame: [self bounds]
 						 mode: NSListModeMatrix
@@ -151,8 +216,18 @@ static id <DesktopApplication> desktopApp = nil;
       [matrix setTarget: self];
       [matrix setAction: @selector(doClick:)];
       [matrix setDoubleAction: @selector(doDoubleClick:)];
-      [scroll setDocumentView: matrix];
+      [rowsView addSubview: matrix];
       RELEASE (matrix);
+      [scroll setDocumentView: rowsView];
+      RELEASE (rowsView);
+
+      /* Scrolling moves the clip view's bounds; the rows coming into
+       * view are bound to the cells. */
+      [[scroll contentView] setPostsBoundsChangedNotifications: YES];
+      [[NSNotificationCenter defaultCenter] addObserver: self
+                                               selector: @selector(clipViewBoundsDidChange:)
+                                                   name: NSViewBoundsDidChangeNotification
+                                                 object: [scroll contentView]];
     }
 
   return self;
@@ -220,9 +295,11 @@ static id <DesktopApplication> desktopApp = nil;
   NSMutableArray *visibleNodes = nil;
   float scrollTune = 0;
 
+  [self cancelLoading];
+
   if (oldNode && anode && [oldNode isEqualToNode: anode] && [anode isValid])
     {
-      NSArray *vnodes = nil;
+      NSArray *vnodes;
 
       savedSelection = [self selectedNodes];
 
@@ -230,17 +307,16 @@ static id <DesktopApplication> desktopApp = nil;
 	RETAIN (savedSelection);
       }
 
-      [matrix visibleCellsNodes: &vnodes scrollTuneSpace: &scrollTune];
+      vnodes = [self visibleNodesWithScrollTune: &scrollTune];
 
       if (vnodes) {
 	visibleNodes = [NSMutableArray new];
 	[visibleNodes addObjectsFromArray: vnodes];
       }
     }
-  if ([matrix numberOfColumns] > 0)
-    {
-      [matrix removeColumn: 0];
-    }
+
+  [nodes removeAllObjects];
+  [self reloadRows];
 
   DESTROY (shownNode);
   DESTROY (oldNode);
@@ -248,8 +324,6 @@ static id <DesktopApplication> desktopApp = nil;
 
   if (anode && [anode isValid])
     {
-      id cell = nil;
-
       ASSIGN (oldNode, anode);
       ASSIGN (shownNode, anode);
 
@@ -268,7 +342,7 @@ static id <DesktopApplication> desktopApp = nil;
 	    {
 	      FSNode *node = [visibleNodes objectAtIndex: i];
 
-	      if ([self cellOfNode: node] == nil)
+	      if ([self rowOfNodeWithPath: [node path]] == NSNotFound)
 		{
 		  [visibleNodes removeObjectAtIndex: i];
 		  count--;
@@ -278,18 +352,17 @@ static id <DesktopApplication> desktopApp = nil;
 
 	  if ([visibleNodes count])
 	    {
-	      cell = [self cellOfNode: [visibleNodes objectAtIndex: 0]];
-	      [matrix scrollToFirstPositionCell: cell withScrollTune: scrollTune];
-
+	      [self scrollToNode: [visibleNodes objectAtIndex: 0]
+		  withScrollTune: scrollTune];
 	    }
-	  else if ([[matrix cells] count])
+	  else if ([nodes count])
 	    {
-	      [matrix scrollCellToVisibleAtRow: 0 column: 0];
+	      [self scrollRowToVisible: 0];
 	    }
 	}
-      else if ([[matrix cells] count])
+      else if ([nodes count])
 	{
-	  [matrix scrollCellToVisibleAtRow: 0 column: 0];
+	  [self scrollRowToVisible: 0];
 	}
 
       isLoaded = YES;
@@ -299,81 +372,152 @@ static id <DesktopApplication> desktopApp = nil;
   RELEASE (visibleNodes);
 }
 
-- (FSNode *)shownNode
+- (void)loadContentsOfNode:(FSNode *)anode
 {
-  return shownNode;
+  SEL compSel;
+  FSNLoadTier tier;
+
+  if ((anode == nil) || ([anode isValid] == NO)
+      || [fsnodeRep hasCachedDirectoryListingAtPath: [anode path]])
+    {
+      [self showContentsOfNode: anode];
+      return;
+    }
+
+  [self showContentsOfNode: nil];
+
+  ASSIGN (oldNode, anode);
+  ASSIGN (shownNode, anode);
+  isLoaded = YES;
+
+  /* Sorting or showing anything but names reads attributes, which on a
+     Type tier listing would mean one stat per node on this thread. */
+  compSel = [fsnodeRep compareSelectorForDirectory: [anode path]];
+  tier = [fsnodeRep defaultLoadTier];
+
+  if ((infoType != FSNInfoNameType)
+      || (sel_isEqual(compSel, @selector(compareAccordingToName:)) == NO))
+    tier = FSNLoadTierStat;
+
+  loader = [[FSNDirectoryLoader alloc] initWithPath: [anode path]
+                                               tier: tier
+                                           delegate: self];
+  [loader start];
 }
 
-- (void)createRowsInMatrix
+- (BOOL)isLoading
 {
-  NSAutoreleasePool *pool;
-  NSArray *subNodes = [shownNode subNodes];
-  NSUInteger count = [subNodes count];
-  SEL compSel = [fsnodeRep compareSelectorForDirectory: [shownNode path]];
-  NSInteger i;
+  return (loader != nil);
+}
+
+- (void)cancelLoading
+{
+  if (loader)
+    {
+      [loader cancel];
+      DESTROY (loader);
+    }
+  changedWhileLoading = NO;
+}
 
-  if ([matrix numberOfColumns] > 0)
-    [matrix removeColumn: 0];
+- (void)directoryLoader:(FSNDirectoryLoader *)aloader
+         didReadEntries:(FSNDirectorySnapshot *)chunk
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSArray *subnodes;
 
+  [fsnodeRep removeHiddenEntriesFromSnapshot: chunk
+                                 hiddenNames: [aloader hiddenNames]];
+  subnodes = [shownNode subNodesFromSnapshot: chunk];
 
-  if (count == 0)
+  if ([subnodes count])
     {
+      NSArray *selnodes = [self selectedNodes];
+      float scrollTune = 0;
+      NSArray *vnodes = [self visibleNodesWithScrollTune: &scrollTune];
+      FSNode *first = ([vnodes count] ? [vnodes objectAtIndex: 0] : nil);
+      BOOL atTop = ((first == nil) || ([nodes indexOfObjectIdenticalTo: first] == 0));
+
+      [nodes addObjectsFromArray: subnodes];
+      [nodes sortUsingSelector: [fsnodeRep compareSelectorForDirectory: [shownNode path]]];
+      [self reloadRows];
+
+      if (selnodes)
+        [self selectCellsOfNodes: selnodes sendAction: NO];
+
+      /* entries sorted in above the visible ones must not move the list */
+      if (atTop)
+        [self scrollRowToVisible: 0];
+      else
+        [self scrollToNode: first withScrollTune: scrollTune];
+
       [matrix setNeedsDisplay: YES];
-      return;
     }
 
-  pool = [[NSAutoreleasePool alloc] init];
+  RELEASE (arp);
+}
+
+- (void)directoryLoader:(FSNDirectoryLoader *)aloader
+  didFinishWithSnapshot:(FSNDirectorySnapshot *)snapshot
+{
+  BOOL reload = changedWhileLoading;
 
-  [matrix addColumn];
+  [fsnodeRep cacheDirectorySnapshot: snapshot
+                        hiddenNames: [aloader hiddenNames]];
+  DESTROY (loader);
+  changedWhileLoading = NO;
 
-  for (i = 0; i < count; ++i)
+  /* Changes notified while reading may or may not be in the listing;
+     reloading keeps the selection and the scroll position. */
+  if (reload && [snapshot isValid])
     {
-      FSNode *subnode = [subNodes objectAtIndex: i];
-      id cell;
+      FSNode *node = AUTORELEASE (RETAIN (shownNode));
 
-      if (i != 0)
-	[matrix insertRow: i];
+      [self showContentsOfNode: node];
+    }
+}
 
-      cell = [matrix cellAtRow: i column: 0];
-      [cell setLoaded: YES];
-      [cell setEnabled: YES];
-      [cell setNode: subnode nodeInfoType: infoType extendedType: extInfoType];
+- (FSNode *)shownNode
+{
+  return shownNode;
+}
 
-      if ([subnode isDirectory])
-	{
-	  if ([subnode isPackage])
-	    [cell setLeaf: YES];
-	  else
-	    [cell setLeaf: NO];
-	}
-      else
-	{
-	  [cell setLeaf: YES];
-	}
+- (void)createRowsInMatrix
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  SEL compSel = [fsnodeRep compareSelectorForDirectory: [shownNode path]];
 
-      if (cellsIcon)
-	[cell setIcon];
+  /* the locks of the cells went with them */
+  [lockedPaths removeAllObjects];
+  allLocked = NO;
 
-      [cell checkLocked];
-    }
+  [nodes setArray: [shownNode subNodes]];
+  [nodes sortUsingSelector: compSel];
+  [self reloadRows];
 
-  [matrix sortUsingSelector: compSel];
-  RELEASE (pool);
+  RELEASE (arp);
 }
 
 - (void)addCellsWithNames:(NSArray *)names
 {
-  NSArray *subNodes = [shownNode subNodes];
+  NSArray *subNodes;
+
+  if (loader)
+    {
+      changedWhileLoading = YES;
+      return;
+    }
+
+  subNodes = [shownNode subNodes];
 
   if ([subNodes count])
     {
       CREATE_AUTORELEASE_POOL(arp);
       NSArray *selectedNodes = [self selectedNodes];
       SEL compSel = [fsnodeRep compareSelectorForDirectory: [shownNode path]];
+      NSMutableSet *shown = [NSMutableSet setWithArray: nodes];
       NSUInteger i;
 
-      [matrix setIntercellSpacing: NSMakeSize(0, 0)];
-
       for (i = 0; i < [names count]; i++)
 	{
 	  NSString *name = [names objectAtIndex: i];
@@ -381,43 +525,20 @@ static id <DesktopApplication> desktopApp = nil;
 
 	  if ([node isValid])
 	    {
-	      FSNBrowserCell *cell = [self cellOfNode: node];
-
-	      if (cell == nil)
+	      if ([shown containsObject: node] == NO)
 		{
-		  [matrix addRow];
-		  cell = [matrix cellAtRow: [[matrix cells] count] -1 column: 0];
-
-		  [cell setLoaded: YES];
-		  [cell setEnabled: YES];
-		  [cell setNode: node nodeInfoType: infoType extendedType: extInfoType];
-
-		  if ([node isDirectory])
-		    {
-		      if ([node isPackage])
-			[cell setLeaf: YES];
-		      else
-			[cell setLeaf: NO];
-		    }
-		  else
-		    {
-		      [cell setLeaf: YES];
-		    }
-
-		  if (cellsIcon)
-		    [cell setIcon];
-
-		  [cell checkLocked];
+		  [nodes addObject: node];
+		  [shown addObject: node];
 		}
 	      else
 		{
-		  [cell setEnabled: YES];
+		  [lockedPaths removeObject: [node path]];
 		}
 	    }
 	}
 
-      [matrix sortUsingSelector: compSel];
-      [self adjustMatrix];
+      [nodes sortUsingSelector: compSel];
+      [self reloadRows];
 
       if (selectedNodes)
 	[self selectCellsOfNodes: selectedNodes sendAction: NO];
@@ -430,65 +551,64 @@ static id <DesktopApplication> desktopApp = nil;
 - (void)removeCellsWithNames:(NSArray *)names
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSArray *selcells = nil;
-  NSMutableArray *selectedCells = nil;
-  NSArray *vnodes = nil;
-  NSMutableArray *visibleNodes = nil;
+  NSSet *removed = [NSSet setWithArray: names];
+  NSMutableArray *kept = [NSMutableArray arrayWithCapacity: [nodes count]];
+  NSMutableArray *selectedNodes = [NSMutableArray array];
+  NSMutableArray *visibleNodes = [NSMutableArray array];
+  NSArray *vnodes;
   FSNBrowserColumn *col = nil;
-  id cell = nil;
   float scrollTune = 0;
   BOOL updated = NO;
+  NSUInteger row;
   NSUInteger i;
 
-  selcells = [matrix selectedCells];
+  /* the names may still arrive with the listing being read */
+  if (loader)
+    changedWhileLoading = YES;
 
-  if (selcells && [selcells count])
+  for (row = [selection firstIndex]; row != NSNotFound;
+       row = [selection indexGreaterThanIndex: row])
     {
-      selectedCells = [selcells mutableCopy];
-    }
+      FSNode *node = [nodes objectAtIndex: row];
 
-  [matrix visibleCellsNodes: &vnodes scrollTuneSpace: &scrollTune];
+      if ([removed containsObject: [node name]] == NO)
+	[selectedNodes addObject: node];
+    }
 
-  if (vnodes && [vnodes count])
-    visibleNodes = [vnodes mutableCopy];
+  vnodes = [self visibleNodesWithScrollTune: &scrollTune];
 
-  for (i = 0; i < [names count]; i++)
+  for (i = 0; i < [vnodes count]; i++)
     {
-      NSString *cname = [names objectAtIndex: i];
+      FSNode *node = [vnodes objectAtIndex: i];
 
-      cell = [self cellWithName: cname];
-
-      if (cell)
-	{
-	  FSNode *node = [cell node];
-	  NSInteger row, col;
-
-	  if (visibleNodes && [visibleNodes containsObject: node])
-	    [visibleNodes removeObject: node];
+      if ([removed containsObject: [node name]] == NO)
+	[visibleNodes addObject: node];
+    }
 
-	  if (selectedCells && [selectedCells containsObject: cell])
-	    [selectedCells removeObject: cell];
+  for (i = 0; i < [nodes count]; i++)
+    {
+      FSNode *node = [nodes objectAtIndex: i];
 
-	  [matrix getRow: &row column: &col ofCell: cell];
-	  [matrix removeRow: row];
-	  updated = YES;
-	}
+      if ([removed containsObject: [node name]])
+	updated = YES;
+      else
+	[kept addObject: node];
     }
 
-  [matrix sizeToCells];
-  [matrix setNeedsDisplay: YES];
-
   if (updated)
     {
-      if ([selectedCells count] > 0)
+      [nodes setArray: kept];
+      [self reloadRows];
+
+      if ([selectedNodes count] > 0)
 	{
-	  [self selectCells: selectedCells sendAction: NO];
+	  [self selectCellsOfNodes: selectedNodes sendAction: NO];
 	  [matrix setNeedsDisplay: YES];
 
-	  if (visibleNodes && [visibleNodes count])
+	  if ([visibleNodes count])
 	    {
-	      cell = [self cellOfNode: [visibleNodes objectAtIndex: 0]];
-	      [matrix scrollToFirstPositionCell: cell withScrollTune: scrollTune];
+	      [self scrollToNode: [visibleNodes objectAtIndex: 0]
+		  withScrollTune: scrollTune];
 	    }
 	}
       else
@@ -498,8 +618,7 @@ static id <DesktopApplication> desktopApp = nil;
 	      if ((index - 1) >= [browser firstVisibleColumn])
 		{
 		  col = [browser columnBeforeColumn: self];
-		  cell = [col cellWithPath: [shownNode parentPath]];
-		  [col selectCell: cell sendAction: YES];
+		  [col selectCellWithPath: [shownNode parentPath] sendAction: YES];
 		}
 	    }
 	  else
@@ -510,167 +629,238 @@ static id <DesktopApplication> desktopApp = nil;
     }
   else if ([visibleNodes count])
     {
-      cell = [self cellOfNode: [visibleNodes objectAtIndex: 0]];
-      [matrix scrollToFirstPositionCell: cell withScrollTune: scrollTune];
+      [self scrollToNode: [visibleNodes objectAtIndex: 0]
+	  withScrollTune: scrollTune];
     }
 
-  RELEASE (selectedCells); 
-  RELEASE (visibleNodes);
+  [matrix setNeedsDisplay: YES];
   RELEASE (arp);
 }
 
-- (NSArray *)selectedCells
+- (NSArray *)nodes
+{
+  return nodes;
+}
+
+- (NSInteger)selectedRow
+{
+  NSUInteger row = [selection firstIndex];
+
+  return ((row == NSNotFound) ? -1 : (NSInteger)row);
+}
+
+- (NSUInteger)rowOfMatrixRow:(NSInteger)row
 {
-  NSArray *selected = [matrix selectedCells];
+  return boundRows.location + row;
+}
+
+- (NSUInteger)firstBoundRow
+{
+  return boundRows.location;
+}
 
-  if (selected)
+- (NSUInteger)rowOfNodeWithPath:(NSString *)path
+{
+  NSUInteger count = [nodes count];
+  NSUInteger i;
+
+  for (i = 0; i < count; i++)
     {
-      NSMutableArray *cells = [NSMutableArray array];
-      BOOL missing = NO;
-      NSUInteger i;
+      if ([[[nodes objectAtIndex: i] path] isEqual: path])
+	return i;
+    }
+
+  return NSNotFound;
+}
+
+- (NSArray *)selectedCells
+{
+  NSMutableArray *cells;
+  BOOL missing = NO;
+  NSUInteger i;
+
+  if ([selection selectedCount] == 0)
+    return nil;
 
-      for (i = 0; i < [selected count]; i++)
+  cells = [NSMutableArray array];
+
+  for (i = 0; i < boundRows.length; i++)
+    {
+      if ([selection containsIndex: boundRows.location + i])
 	{
-	  FSNBrowserCell *cell = [selected objectAtIndex: i];
+	  FSNBrowserCell *cell = [matrix cellAtRow: i column: 0];
 
 	  if ([[cell node] isValid])
 	    [cells addObject: cell];
 	  else
 	    missing = YES;
 	}
+    }
 
-      if (missing)
-	{
-	  [matrix deselectAllCells];
-	  if ([cells count])
-	    {
-	      [self selectCells: cells sendAction: YES];
-	    }
-	}
+  /* drops the invalid nodes of every row */
+  if (missing)
+    [self selectedNodes];
 
-      if ([cells count] > 0)
-	return [cells makeImmutableCopyOnFail: NO];
-    }
+  if ([cells count] > 0)
+    return [cells makeImmutableCopyOnFail: NO];
 
   return nil;
- }
+}
 
 - (NSArray *)selectedNodes
 {
-  NSArray *selected = [matrix selectedCells];
+  NSMutableArray *selnodes;
+  BOOL missing = NO;
+  NSUInteger row;
 
-  if (selected)
-    {
-      NSMutableArray *nodes = [NSMutableArray array];
-      BOOL missing = NO;
-      NSUInteger i;
+  if ([selection selectedCount] == 0)
+    return nil;
 
-      for (i = 0; i < [selected count]; i++)
-	{
-	  FSNode *node = [[selected objectAtIndex: i] node];
+  selnodes = [NSMutableArray arrayWithCapacity: [selection selectedCount]];
 
-	  if ([node isValid])
-	    [nodes addObject: node];
-	  else
-	    missing = YES;
-	}
+  for (row = [selection firstIndex]; row != NSNotFound;
+       row = [selection indexGreaterThanIndex: row])
+    {
+      FSNode *node = [nodes objectAtIndex: row];
 
-      if (missing)
-	{
-	  [matrix deselectAllCells];
-	  if ([nodes count])
-	    {
-	      [self selectCellsOfNodes: nodes sendAction: YES];
-	    }
-	}
+      if ([node isValid])
+	[selnodes addObject: node];
+      else
+	missing = YES;
+    }
 
-      if ([nodes count] > 0)
+  if (missing)
+    {
+      [self unselectAllCells];
+      if ([selnodes count])
 	{
-	  return [nodes makeImmutableCopyOnFail: NO];
+	  [self selectCellsOfNodes: selnodes sendAction: YES];
 	}
     }
 
+  if ([selnodes count] > 0)
+    {
+      return [selnodes makeImmutableCopyOnFail: NO];
+    }
+
   return nil;
- }
+}
 
 - (NSArray *)selectedPaths
 {
-  NSArray *selected = [matrix selectedCells];
+  NSArray *selnodes = [self selectedNodes];
 
-  if (selected)
+  if (selnodes)
     {
-      NSMutableArray *paths = [NSMutableArray array];
-      BOOL missing = NO;
+      NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [selnodes count]];
       NSUInteger i;
 
-      for (i = 0; i < [selected count]; i++)
-	{
-	  FSNode *node = [[selected objectAtIndex: i] node];
+      for (i = 0; i < [selnodes count]; i++)
+	[paths addObject: [[selnodes objectAtIndex: i] path]];
 
-	  if ([node isValid])
-	    [paths addObject: [node path]];
-	  else
-	    missing = YES;
-	}
+      return [paths makeImmutableCopyOnFail: NO];
+    }
+
+  return nil;
+}
+
+- (void)selectRow:(NSUInteger)row
+       sendAction:(BOOL)act
+{
+  if (row >= [nodes count])
+    return;
+
+  [selection removeAll];
+  [selection addIndex: row];
+  anchorRow = row;
+
+  if (NSLocationInRange(row, boundRows) == NO)
+    [self scrollRowToVisible: row];
+
+  [self updateMatrixSelection];
+
+  if (act)
+    [self sendSelectionAction];
+}
+
+- (void)moveSelectionBy:(NSInteger)offset
+                 extend:(BOOL)extend
+{
+  NSInteger count = [nodes count];
+  NSInteger row;
+
+  if (count == 0)
+    return;
+
+  if ([selection selectedCount] == 0)
+    {
+      row = (offset > 0) ? 0 : (count - 1);
+    }
+  else
+    {
+      NSUInteger from = [selection firstIndex];
 
-      if (missing)
+      if (offset > 0)
 	{
-	  [matrix deselectAllCells];
-	  if ([paths count])
-	    {
-	      [self selectCellsWithPaths: paths sendAction: YES];
-	    }
+	  NSUInteger next;
+
+	  while ((next = [selection indexGreaterThanIndex: from]) != NSNotFound)
+	    from = next;
 	}
 
-      if ([paths count] > 0)
-	return [paths makeImmutableCopyOnFail: NO];
+      row = (NSInteger)from + offset;
+      row = (row < 0) ? 0 : ((row >= count) ? (count - 1) : row);
+    }
 
+  if (extend)
+    {
+      [selection addIndex: row];
+      [self scrollRowToVisible: row];
+      [self updateMatrixSelection];
+      [self sendSelectionAction];
+    }
+  else
+    {
+      [self selectRow: row sendAction: NO];
+      [self scrollRowToVisible: row];
+      [self sendSelectionAction];
     }
+}
 
-  return nil;
- }
+- (void)scrollRowToVisible:(NSUInteger)row
+{
+  NSRect r = NSMakeRect(0, row * cellsHeight, [rowsView bounds].size.width, cellsHeight);
+
+  [rowsView scrollRectToVisible: r];
+  [self bindVisibleRows];
+}
 
 - (void)selectCell:(FSNBrowserCell *)cell
         sendAction:(BOOL)act
 {
-  [matrix selectCell: cell];
-  if (act)
+  NSInteger row, col;
+
+  if (cell && [matrix getRow: &row column: &col ofCell: cell])
     {
-      [matrix sendAction];
+      [self selectRow: [self rowOfMatrixRow: row] sendAction: act];
     }
 }
 
 - (FSNBrowserCell *)selectCellOfNode:(FSNode *)node
                           sendAction:(BOOL)act
 {
-  FSNBrowserCell *cell = [self cellOfNode: node];
-
-  if (cell)
-    {
-      [matrix selectCell: cell];
-      if (act)
-	{
-	  [matrix sendAction];
-	}
-      return cell;
-  }
-
-  return nil;
+  return [self selectCellWithPath: [node path] sendAction: act];
 }
 
 - (FSNBrowserCell *)selectCellWithPath:(NSString *)path
                             sendAction:(BOOL)act
 {
-  FSNBrowserCell *cell = [self cellWithPath: path];
+  NSUInteger row = [self rowOfNodeWithPath: path];
 
-  if (cell)
+  if (row != NSNotFound)
     {
-      [matrix selectCell: cell];
-      if (act)
-	{
-	  [matrix sendAction];
-	}
-      return cell;
+      [self selectRow: row sendAction: act];
+      return [self cellOfRow: row];
     }
 
   return nil;
@@ -679,19 +869,8 @@ static id <DesktopApplication> desktopApp = nil;
 - (FSNBrowserCell *)selectCellWithName:(NSString *)name
                             sendAction:(BOOL)act
 {
-  FSNBrowserCell *cell = [self cellWithName: name];
-
-  if (cell)
-    {
-      [matrix selectCell: cell];
-      if (act)
-	{
-	  [matrix sendAction];
-	}
-      return cell;
-    }
-
-  return nil;
+  return [self selectCellWithPath: [[shownNode path] stringByAppendingPathComponent: name]
+                       sendAction: act];
 }
 
 - (void)selectCells:(NSArray *)cells
@@ -701,95 +880,46 @@ static id <DesktopApplication> desktopApp = nil;
     {
       NSUInteger i;
 
-      [matrix deselectAllCells];
+      [selection removeAll];
 
       for (i = 0; i < [cells count]; i++)
 	{
-	  [matrix selectCell: [cells objectAtIndex: i]];
+	  NSInteger row, col;
+
+	  if ([matrix getRow: &row column: &col ofCell: [cells objectAtIndex: i]])
+	    [selection addIndex: [self rowOfMatrixRow: row]];
 	}
 
+      [self updateMatrixSelection];
+
       if (act)
-	[matrix sendAction];
+	[self sendSelectionAction];
     }
 }
 
-- (void)selectCellsOfNodes:(NSArray *)nodes
+- (void)selectCellsOfNodes:(NSArray *)selnodes
                 sendAction:(BOOL)act
 {
-  if (nodes && [nodes count])
-    {
-      NSArray *cells = [matrix cells];
-      NSUInteger i;
-
-      [matrix deselectAllCells];
-
-      for (i = 0; i < [cells count]; i++)
-	{
-	  FSNBrowserCell *cell = [cells objectAtIndex: i];
-
-	  if ([nodes containsObject: [cell node]])
-	    [matrix selectCell: cell];
-	}
-
-      if ([cells count] && act)
-	[matrix sendAction];
-    }
+  [self selectRowsWithValues: selnodes ofGetter: @selector(self) sendAction: act];
 }
 
 - (void)selectCellsWithPaths:(NSArray *)paths
                   sendAction:(BOOL)act
 {
-  if (paths && [paths count])
-    {
-      NSArray *cells = [matrix cells];
-      NSUInteger i;
-
-      [matrix deselectAllCells];
+  [self selectRowsWithValues: paths ofGetter: @selector(path) sendAction: act];
+}
 
-      for (i = 0; i < [cells count]; i++)
-	{
-	  FSNBrowserCell *cell = [cells objectAtIndex: i];
-
-	  if ([paths containsObject: [[cell node] path]])
-	    {
-	      [matrix selectCell: cell];
-	    }
-	}
-
-      if (act)
-	[matrix sendAction];
-    }
-}
-
-- (void)selectCellsWithNames:(NSArray *)names
-                  sendAction:(BOOL)act
-{
-  if (names && [names count])
-    {
-      NSArray *cells = [matrix cells];
-      NSUInteger i;
-
-      [matrix deselectAllCells];
-
-      for (i = 0; i < [cells count]; i++)
-	{
-	  FSNBrowserCell *cell = [cells objectAtIndex: i];
-
-	  if ([names containsObject: [[cell node] name]])
-	    [matrix selectCell: cell];
-	}
-
-      if (act)
-	[matrix sendAction];
-    }
-}
+- (void)selectCellsWithNames:(NSArray *)names
+                  sendAction:(BOOL)act
+{
+  [self selectRowsWithValues: names ofGetter: @selector(name) sendAction: act];
+}
 
 - (BOOL)selectFirstCell
 {
-  if ([[matrix cells] count])
+  if ([nodes count])
     {
-      [matrix selectCellAtRow: 0 column: 0];
-      [matrix sendAction];
+      [self selectRow: 0 sendAction: YES];
       return YES;
     }
 
@@ -798,43 +928,28 @@ static id <DesktopApplication> desktopApp = nil;
 
 - (BOOL)selectCellWithPrefix:(NSString *)prefix
 {
-  if ([[matrix cells] count])
+  NSUInteger n = [nodes count];
+
+  if (n)
     {
-      NSInteger n = [matrix numberOfRows];
-      NSInteger selRow = [matrix selectedRow];
-      NSString *cellStr = nil;
-      NSInteger i = 0;
+      NSInteger selRow = [self selectedRow];
+      NSUInteger i;
 
       // Nothing selected start from first
       if (selRow == -1)
 	selRow = 0;
 
-      // look at or after current selection
-      for (i = selRow; i < n; i++)
-	{
-	  cellStr = [[matrix cellAtRow: i column: 0] stringValue];
-
-	  if (([cellStr length] > 0) && ([cellStr rangeOfString: prefix options: NSCaseInsensitiveSearch].location == 0))
-	    {
-	      [matrix deselectAllCells];
-	      [matrix selectCellAtRow: i column: 0];
-	      [matrix scrollCellToVisibleAtRow: i column: 0];
-	      [matrix sendAction];
-	      return YES;
-	    }
-	}
-
-      // look before current selection
-      for (i = 0; i < selRow; i++)
+      // look at or after current selection, then before it
+      for (i = 0; i < n; i++)
 	{
-	  cellStr = [[matrix cellAtRow: i column: 0] stringValue];
+	  NSUInteger row = (selRow + i) % n;
+	  NSString *name = [[nodes objectAtIndex: row] name];
 
-	  if (([cellStr length] > 0) && ([cellStr rangeOfString: prefix options: NSCaseInsensitiveSearch].location == 0))
+	  if (([name length] > 0) && ([name rangeOfString: prefix options: NSCaseInsensitiveSearch].location == 0))
 	    {
-	      [matrix deselectAllCells];
-	      [matrix selectCellAtRow: i column: 0];
-	      [matrix scrollCellToVisibleAtRow: i column: 0];
-	      [matrix sendAction];
+	      [self selectRow: row sendAction: NO];
+	      [self scrollRowToVisible: row];
+	      [self sendSelectionAction];
 	      return YES;
 	    }
 	}
@@ -845,67 +960,22 @@ static id <DesktopApplication> desktopApp = nil;
 
 - (void)selectAll
 {
-  NSArray *cells = [matrix cells];
+  NSUInteger count = [nodes count];
 
-  if ([cells count])
+  if (count)
     {
-      NSUInteger count = [cells count];
-      FSNBrowserCell *cell;
-      NSInteger selStart = 0;
-      NSInteger selEnd = 0;
-      NSInteger i;
-
-      [matrix deselectAllCells];
-      while (selStart < count)
-	{
-	  cell = [cells objectAtIndex: selStart];
-
-	  if ([[cell node] isReserved] == NO)
-	    break;
-
-	  selStart++;
-	}
-
-      i = selStart;
-      while (i < count)
-	{
-	  cell = [cells objectAtIndex: i];
-
-	  if ([[cell node] isReserved] == NO)
-	    {
-	      selEnd = i;
-	    }
-	  else
-	    {
-	      [matrix setSelectionFrom: selStart
-				    to: selEnd
-				anchor: selStart
-			     highlight: YES];
-	      selStart = i + 1;
-
-	      while (selStart < count)
-		{
-		  cell = [cells objectAtIndex: selStart];
+      NSUInteger i;
 
-		  if ([[cell node] isReserved] == NO)
-		    break;
+      [selection addAll];
 
-		  selStart++;
-		  i++;
-		}
-	    }
-	  i++;
-	}
-
-      if (selStart < count)
+      for (i = 0; i < count; i++)
 	{
-	  [matrix setSelectionFrom: selStart
-				to: selEnd
-			    anchor: selStart
-			 highlight: YES];
+	  if ([[nodes objectAtIndex: i] isReserved])
+	    [selection removeIndex: i];
 	}
 
-      [matrix sendAction];
+      [self updateMatrixSelection];
+      [self sendSelectionAction];
     }
   else
     {
@@ -918,6 +988,7 @@ static id <DesktopApplication> desktopApp = nil;
 
 - (void)unselectAllCells
 {
+  [selection removeAll];
   [matrix deselectAllCells];
 }
 
@@ -944,118 +1015,46 @@ static id <DesktopApplication> desktopApp = nil;
   [matrix setNeedsDisplay: YES];
 }
 
-- (void)lockCellsOfNodes:(NSArray *)nodes
+- (void)lockCellsOfNodes:(NSArray *)lnodes
 {
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [lnodes count]];
   NSUInteger i;
-  BOOL found = NO;
 
-  for (i = 0; i < [nodes count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellOfNode: [nodes objectAtIndex: i]];
+  for (i = 0; i < [lnodes count]; i++)
+    [paths addObject: [[lnodes objectAtIndex: i] path]];
 
-      if (cell && [cell isEnabled])
-	{
-	  [cell setEnabled: NO];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: YES forPaths: paths];
 }
 
 - (void)lockCellsWithPaths:(NSArray *)paths
 {
-  NSUInteger i;
-  BOOL found = NO;
-
-  for (i = 0; i < [paths count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellWithPath: [paths objectAtIndex: i]];
-
-      if (cell && [cell isEnabled])
-	{
-	  [cell setEnabled: NO];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: YES forPaths: paths];
 }
 
 - (void)lockCellsWithNames:(NSArray *)names
 {
-  NSUInteger i;
-  BOOL found = NO;
-
-  for (i = 0; i < [names count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellWithName: [names objectAtIndex: i]];
-
-      if (cell && [cell isEnabled])
-	{
-	  [cell setEnabled: NO];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: YES forPaths: [self pathsOfNames: names]];
 }
 
-- (void)unLockCellsOfNodes:(NSArray *)nodes
+- (void)unLockCellsOfNodes:(NSArray *)lnodes
 {
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [lnodes count]];
   NSUInteger i;
-  BOOL found = NO;
 
-  for (i = 0; i < [nodes count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellOfNode: [nodes objectAtIndex: i]];
+  for (i = 0; i < [lnodes count]; i++)
+    [paths addObject: [[lnodes objectAtIndex: i] path]];
 
-      if (cell && ([cell isEnabled] == NO))
-	{
-	  [cell setEnabled: YES];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: NO forPaths: paths];
 }
 
 - (void)unLockCellsWithPaths:(NSArray *)paths
 {
-  NSUInteger i;
-  BOOL found = NO;
-
-  for (i = 0; i < [paths count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellWithPath: [paths objectAtIndex: i]];
-
-      if (cell && ([cell isEnabled] == NO))
-	{
-	  [cell setEnabled: YES];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: NO forPaths: paths];
 }
 
 - (void)unLockCellsWithNames:(NSArray *)names
 {
-  NSUInteger i;
-  BOOL found = NO;
-
-  for (i = 0; i < [names count]; i++)
-    {
-      FSNBrowserCell *cell = [self cellWithName: [names objectAtIndex: i]];
-
-      if (cell && ([cell isEnabled] == NO))
-	{
-	  [cell setEnabled: YES];
-	  found = YES;
-	}
-    }
-
-  [matrix setNeedsDisplay: found];
+  [self setLocked: NO forPaths: [self pathsOfNames: names]];
 }
 
 - (void)lock
@@ -1063,6 +1062,8 @@ static id <DesktopApplication> desktopApp = nil;
   NSArray *cells = [matrix cells];
   NSUInteger i;
 
+  allLocked = YES;
+
   for (i = 0; i < [cells count]; i++)
     {
       id cell = [cells objectAtIndex: i];
@@ -1079,6 +1080,9 @@ static id <DesktopApplication> desktopApp = nil;
   NSArray *cells = [matrix cells];
   NSUInteger i;
 
+  allLocked = NO;
+  [lockedPaths removeAllObjects];
+
   for (i = 0; i < [cells count]; i++)
     {
       id cell = [cells objectAtIndex: i];
@@ -1146,12 +1150,30 @@ static id <DesktopApplication> desktopApp = nil;
       return;
     }
 
-  [matrix setCellSize: NSMakeSize([scroll contentSize].width, cellsHeight)];
-  [matrix sizeToCells];
+  [self sizeRowsView];
+  [self bindVisibleRows];
+}
+
+- (void)bindVisibleRows
+{
+  NSRange rows = FSNRowWindowForVisibleRows([self visibleRows], boundRows,
+                                            [nodes count], [self poolCapacity]);
+
+  if (NSEqualRanges(rows, boundRows) && ([matrix numberOfRows] == rows.length))
+    {
+      /* the same rows, maybe of another height */
+      [matrix setFrameOrigin: NSMakePoint(0, rows.location * cellsHeight)];
+      [matrix sizeToCells];
+    }
+  else
+    {
+      [self bindRows: rows];
+    }
 }
 
 - (void)doClick:(id)sender
 {
+  [self readMatrixSelection];
   [browser clickInMatrixOfColumn: self];
 }
 
@@ -1179,7 +1201,7 @@ static id <DesktopApplication> desktopApp = nil;
 {
   if (isLoaded && matrix)
     {
-      return ([matrix selectedCell] ? YES : NO);
+      return ([selection selectedCount] > 0);
     }
 
   return NO;
@@ -1242,6 +1264,325 @@ static id <DesktopApplication> desktopApp = nil;
 @end
 
 
+@implementation FSNBrowserColumn (Private)
+
+- (void)clipViewBoundsDidChange:(NSNotification *)notif
+{
+  /* NSMatrix keeps tracking its cells while it autoscrolls; the
+     matrix asks for the rows in view when it is done. */
+  if ([matrix isTrackingMouse] == NO)
+    [self bindVisibleRows];
+}
+
+- (NSUInteger)poolCapacity
+{
+  NSUInteger screen = (NSUInteger)ceil([scroll contentSize].height / cellsHeight) + 1;
+
+  return MAX(VIRTUAL_ROWS_POOL, 3 * screen);
+}
+
+- (NSRange)visibleRows
+{
+  NSRect vr = [rowsView visibleRect];
+  NSUInteger first = (NSUInteger)floor(NSMinY(vr) / cellsHeight);
+  NSUInteger last = (NSUInteger)ceil(NSMaxY(vr) / cellsHeight);
+
+  return NSMakeRange(first, (last > first) ? (last - first) : 0);
+}
+
+- (void)sizeRowsView
+{
+  float width = [scroll contentSize].width;
+
+  [matrix setCellSize: NSMakeSize(width, cellsHeight)];
+  [rowsView setFrameSize: NSMakeSize(width, [nodes count] * cellsHeight)];
+}
+
+- (void)bindRows:(NSRange)rows
+{
+  NSUInteger i;
+
+  boundRows = rows;
+
+  if (rows.length == 0)
+    {
+      if ([matrix numberOfColumns] > 0)
+	[matrix removeColumn: 0];
+    }
+  else if (([matrix numberOfRows] != rows.length)
+	   || ([matrix numberOfColumns] != 1))
+    {
+      [matrix renewRows: rows.length columns: 1];
+    }
+
+  for (i = 0; i < rows.length; i++)
+    {
+      [self bindCell: [matrix cellAtRow: i column: 0]
+	       toRow: rows.location + i];
+    }
+
+  [matrix setFrameOrigin: NSMakePoint(0, rows.location * cellsHeight)];
+  [matrix sizeToCells];
+  [self updateMatrixSelection];
+  [matrix setNeedsDisplay: YES];
+}
+
+- (void)bindCell:(FSNBrowserCell *)cell
+           toRow:(NSUInteger)row
+{
+  FSNode *node = [nodes objectAtIndex: row];
+
+  /* the icon comes from the shared cache, for the bound rows only */
+  [cell setLoaded: YES];
+  [cell setNode: node nodeInfoType: infoType extendedType: extInfoType];
+
+  if ([node isDirectory])
+    [cell setLeaf: [node isPackage]];
+  else
+    [cell setLeaf: YES];
+
+  [cell setEnabled: ((allLocked || [lockedPaths containsObject: [node path]]) == NO)];
+}
+
+/* After `nodes` changed: the selection was of the old rows, and the
+   cells show them. */
+- (void)reloadRows
+{
+  [selection setCount: [nodes count]];
+  [selection removeAll];
+  anchorRow = NSNotFound;
+
+  [self sizeRowsView];
+  [self bindRows: FSNRowWindowForVisibleRows([self visibleRows], NSMakeRange(0, 0),
+                                             [nodes count], [self poolCapacity])];
+}
+
+- (void)updateMatrixSelection
+{
+  NSUInteger last = NSMaxRange(boundRows);
+  NSUInteger row;
+  NSUInteger start = NSNotFound;
+  NSUInteger end = 0;
+
+  [matrix deselectAllCells];
+
+  if (boundRows.length == 0)
+    return;
+
+  if (boundRows.location == 0)
+    row = [selection firstIndex];
+  else
+    row = [selection indexGreaterThanIndex: boundRows.location - 1];
+
+  /* one run of the matrix for each run of selected rows */
+  while (1)
+    {
+      if ((row != NSNotFound) && (row < last) && (start != NSNotFound) && (row == end + 1))
+	{
+	  end = row;
+	}
+      else
+	{
+	  if (start != NSNotFound)
+	    {
+	      [matrix setSelectionFrom: start - boundRows.location
+				    to: end - boundRows.location
+				anchor: start - boundRows.location
+			     highlight: YES];
+	    }
+
+	  if ((row == NSNotFound) || (row >= last))
+	    break;
+
+	  start = end = row;
+	}
+
+      row = [selection indexGreaterThanIndex: row];
+    }
+}
+
+/* A click made the matrix select its cells.  A plain one selects only
+   them; with a modifier the rows that are not bound stay selected too,
+   and shift selects those up to the row clicked last. */
+- (void)readMatrixSelection
+{
+  NSEvent *event = [NSApp currentEvent];
+  NSEventType type = [event type];
+  unsigned int flags = [event modifierFlags];
+  BOOL clicked = ((type == NSLeftMouseDown) || (type == NSLeftMouseUp)
+		  || (type == NSLeftMouseDragged));
+  BOOL extend = (flags & (NSShiftKeyMask | NSCommandKeyMask | NSAlternateKeyMask)) != 0;
+  NSArray *selcells = [matrix selectedCells];
+  NSInteger selRow = [matrix selectedRow];
+  NSUInteger i;
+
+  [selection setCount: [nodes count]];
+
+  if (clicked && (extend == NO))
+    {
+      [selection removeAll];
+    }
+  else
+    {
+      for (i = 0; i < boundRows.length; i++)
+	[selection removeIndex: boundRows.location + i];
+    }
+
+  for (i = 0; i < [selcells count]; i++)
+    {
+      NSInteger row, col;
+
+      if ([matrix getRow: &row column: &col ofCell: [selcells objectAtIndex: i]])
+	[selection addIndex: [self rowOfMatrixRow: row]];
+    }
+
+  if (clicked && (selRow >= 0))
+    {
+      NSUInteger row = [self rowOfMatrixRow: selRow];
+
+      if ((flags & NSShiftKeyMask) && (anchorRow != NSNotFound)
+	  && (anchorRow < [nodes count]))
+	{
+	  NSUInteger from = MIN(row, anchorRow);
+	  NSUInteger to = MAX(row, anchorRow);
+
+	  for (i = from; i <= to; i++)
+	    [selection addIndex: i];
+
+	  if ((NSLocationInRange(from, boundRows) == NO)
+	      || (NSLocationInRange(to, boundRows) == NO))
+	    [self updateMatrixSelection];
+	}
+      else if (extend == NO)
+	{
+	  anchorRow = row;
+	}
+    }
+}
+
+/* What the matrix sends for a click, for a selection made here. */
+- (void)sendSelectionAction
+{
+  [browser clickInMatrixOfColumn: self];
+}
+
+- (FSNBrowserCell *)cellOfRow:(NSUInteger)row
+{
+  if (NSLocationInRange(row, boundRows))
+    return [matrix cellAtRow: row - boundRows.location column: 0];
+
+  return nil;
+}
+
+/* The nodes of the rows entirely in view, and how far the first of
+   them is from the top. */
+- (NSArray *)visibleNodesWithScrollTune:(float *)tune
+{
+  NSRect vr = [rowsView visibleRect];
+  NSUInteger count = [nodes count];
+  NSUInteger row = (NSUInteger)ceil(NSMinY(vr) / cellsHeight);
+  float ylim = NSMaxY(vr) - cellsHeight;
+  NSMutableArray *vnodes = nil;
+
+  while ((row < count) && ((row * cellsHeight) <= ylim))
+    {
+      if (vnodes == nil)
+	{
+	  vnodes = [NSMutableArray array];
+	  *tune = (row * cellsHeight) - NSMinY(vr);
+	}
+      [vnodes addObject: [nodes objectAtIndex: row]];
+      row++;
+    }
+
+  return vnodes;
+}
+
+- (void)scrollToNode:(FSNode *)node
+      withScrollTune:(float)tune
+{
+  NSUInteger row = [nodes indexOfObject: node];
+
+  if (row != NSNotFound)
+    {
+      NSRect vr = [rowsView visibleRect];
+      NSRect r = NSMakeRect(0, row * cellsHeight,
+			    [rowsView bounds].size.width, vr.size.height - tune);
+
+      [rowsView scrollRectToVisible: r];
+      [self bindVisibleRows];
+    }
+}
+
+/* Selects the rows whose node answers `getter` with one of `values`. */
+- (void)selectRowsWithValues:(NSArray *)values
+                    ofGetter:(SEL)getter
+                  sendAction:(BOOL)act
+{
+  if (values && [values count])
+    {
+      NSSet *set = [NSSet setWithArray: values];
+      NSUInteger count = [nodes count];
+      NSUInteger i;
+
+      [selection removeAll];
+
+      for (i = 0; i < count; i++)
+	{
+	  FSNode *node = [nodes objectAtIndex: i];
+
+	  if ([set containsObject: [node performSelector: getter]])
+	    [selection addIndex: i];
+	}
+
+      [self updateMatrixSelection];
+
+      if (act)
+	[self sendSelectionAction];
+    }
+}
+
+- (void)setLocked:(BOOL)locked
+         forPaths:(NSArray *)paths
+{
+  NSUInteger i;
+  BOOL found = NO;
+
+  for (i = 0; i < [paths count]; i++)
+    {
+      NSString *path = [paths objectAtIndex: i];
+      FSNBrowserCell *cell = [self cellWithPath: path];
+
+      if (locked)
+	[lockedPaths addObject: path];
+      else
+	[lockedPaths removeObject: path];
+
+      if (cell && ([cell isEnabled] == locked))
+	{
+	  [cell setEnabled: (locked == NO)];
+	  found = YES;
+	}
+    }
+
+  [matrix setNeedsDisplay: found];
+}
+
+- (NSArray *)pathsOfNames:(NSArray *)names
+{
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [names count]];
+  NSUInteger i;
+
+  for (i = 0; i < [names count]; i++)
+    [paths addObject: [[shownNode path] stringByAppendingPathComponent:
+					  [names objectAtIndex: i]]];
+
+  return paths;
+}
+
+@end
+
+
 @implementation FSNBrowserColumn (DraggingDestination)
 
 - (NSDragOperation)draggingEntered:(id <NSDraggingInfo>)sender
@@ -42,6 +42,7 @@
   BOOL acceptDnd;
   FSNBrowserCell *dndTarget;
   unsigned int dragOperation;
+  BOOL trackingMouse;
 }
 
 - (id)initInColumn:(FSNBrowserColumn *)col
@@ -52,10 +53,9 @@
    numberOfColumns:(NSInteger)numColumns
          acceptDnd:(BOOL)dnd;
 
-- (void)visibleCellsNodes:(NSArray **)nodes
-          scrollTuneSpace:(float *)tspace;
-
-- (void)scrollToFirstPositionCell:(id)aCell withScrollTune:(float)vtune;
+/* YES while NSMatrix tracks a click on the cells, which stay bound to
+ * their rows meanwhile. */
+- (BOOL)isTrackingMouse;
 
 - (void)selectIconOfCell:(id)aCell;
 
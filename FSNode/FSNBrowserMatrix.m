@@ -89,57 +89,26 @@
 	}
       editstamp = 0.0;
       editIndex = -1;
+      trackingMouse = NO;
     }
 
   return self;
 }
 
-- (void)visibleCellsNodes:(NSArray **)nodes
-          scrollTuneSpace:(float *)tspace
+- (BOOL)isTrackingMouse
 {
-  NSArray *cells = [self cells];
-
-  if (cells && [cells count])
-    {
-      NSRect vr = [self visibleRect];
-      float ylim = vr.origin.y + vr.size.height - [self cellSize].height;
-      NSMutableArray *vnodes = [NSMutableArray array];
-      BOOL found = NO;
-      NSUInteger i;
-
-      for (i = 0; i < [cells count]; i++)
-	{
-	  NSRect cr = [self cellFrameAtRow: i column: 0];
-
-	  if ((cr.origin.y >= vr.origin.y) && (cr.origin.y <= ylim))
-	    {
-	      if (found == NO) {
-		*tspace = cr.origin.y - vr.origin.y;
-		found = YES;
-	      }
-	      [vnodes addObject: [[cells objectAtIndex: i] node]];
-	    }
-	}
-
-      if ([vnodes count])
-	{
-	  *nodes = vnodes;
-	}
-    }
+  return trackingMouse;
 }
 
-- (void)scrollToFirstPositionCell:(id)aCell withScrollTune:(float)vtune
+/* NSMatrix autoscrolls while it tracks the mouse; the column binds the
+   rows that came into view once it is done with the cells. */
+- (void)superMouseDown:(NSEvent *)theEvent
 {
-  NSRect vr, cr;
-  NSInteger row, col;
+  trackingMouse = YES;
+  [super mouseDown: theEvent];
+  trackingMouse = NO;
 
-  vr = [self visibleRect];
-
-  [self getRow: &row column: &col ofCell: aCell];
-  cr = [self cellFrameAtRow: row column: col];
-  cr.size.height = vr.size.height - vtune;
-
-  [self scrollRectToVisible: cr];
+  [column bindVisibleRows];
 }
 
 - (void)selectIconOfCell:(id)aCell
@@ -203,13 +172,13 @@
 
   if (acceptDnd == NO)
     {
-      [super mouseDown: theEvent];
+      [self superMouseDown: theEvent];
       return;
     }
 
   if (([self numberOfRows] == 0) || ([self numberOfColumns] == 0))
     {
-      [super mouseDown: theEvent];
+      [self superMouseDown: theEvent];
       return;
     }
 
@@ -232,6 +201,8 @@
     {
       FSNBrowserCell *cell = [[self cells] objectAtIndex: row];
       NSRect rect = [self cellFrameAtRow: row column: col];
+      /* the row of the column, the cell may be bound to another by the next click */
+      NSInteger crow = [column rowOfMatrixRow: row];
 
       if ([cell isEnabled])
 	{
@@ -250,9 +221,9 @@
 	      if (!([theEvent modifierFlags] & NSShiftKeyMask))
 		{
 		  [self deselectAllCells];
-		  if (editIndex != row)
+		  if (editIndex != crow)
 		    {
-		      editIndex = row;
+		      editIndex = crow;
 		    }
 		}
 
@@ -283,11 +254,11 @@
 	    }
 	  else
 	    {
-	      [super mouseDown: theEvent];
+	      [self superMouseDown: theEvent];
 
-	      if (editIndex != row)
+	      if (editIndex != crow)
 		{
-		  editIndex = row;
+		  editIndex = crow;
 		}
 	      else
 		{
@@ -310,6 +281,19 @@
   return YES;
 }
 
+/* The selection is of the rows of the column, not only of the cells. */
+- (void)moveUp:(id)sender
+{
+  [column moveSelectionBy: -1
+                   extend: (([[NSApp currentEvent] modifierFlags] & NSShiftKeyMask) != 0)];
+}
+
+- (void)moveDown:(id)sender
+{
+  [column moveSelectionBy: 1
+                   extend: (([[NSApp currentEvent] modifierFlags] & NSShiftKeyMask) != 0)];
+}
+
 - (void)drawRect:(NSRect)rect
 {
   NSInteger rows = [self numberOfRows];
@@ -319,7 +303,8 @@
       NSColor *evenColor = [NSColor colorWithCalibratedWhite: 0.92 alpha: 1.0];
       NSInteger i;
 
-      for (i = 0; i < rows; i += 2)
+      /* the even rows of the column, the first cell may be on an odd one */
+      for (i = ([column firstBoundRow] % 2); i < rows; i += 2)
         {
           NSRect cellFrame = [self cellFrameAtRow: i column: 0];
 
@@ -350,18 +335,7 @@
             {
               FSNBrowserCell *cell = [cells objectAtIndex: row];
               FSNode *clickedNode = [cell node];
-              NSArray *selcells = [self selectedCells];
-              NSMutableArray *selnodes = [NSMutableArray array];
-              NSUInteger i;
-
-              for (i = 0; i < [selcells count]; i++)
-                {
-                  FSNode *node = [[selcells objectAtIndex: i] node];
-                  if (node && [node isValid])
-                    {
-                      [selnodes addObject: node];
-                    }
-                }
+              NSArray *selnodes = [column selectedNodes];
 
               // If the clicked node is in the selection, use the full selection.
               // Otherwise, use just the clicked node.
@@ -425,8 +399,8 @@
 
 - (void)startExternalDragOnEvent:(NSEvent *)event
 {
-  NSArray *selectedCells = [self selectedCells];
-  unsigned count = [selectedCells count];
+  NSArray *selectedNodes = [column selectedNodes];
+  unsigned count = [selectedNodes count];
 
   if (count) {
     NSPoint dragPoint = [event locationInWindow];
@@ -442,8 +416,7 @@
       }
     else
       {
-	FSNBrowserCell *cell = [selectedCells objectAtIndex: 0];
-	FSNode *node = [cell node];
+	FSNode *node = [selectedNodes objectAtIndex: 0];
 
 	if (node && [node isValid])
 	  {
@@ -477,15 +450,13 @@
 
 - (void)declareAndSetShapeOnPasteboard:(NSPasteboard *)pb
 {
-  NSArray *selectedCells = [self selectedCells];
+  NSArray *selectedNodes = [column selectedNodes];
   NSMutableArray *selection = [NSMutableArray array];
-  NSArray *dndtypes;
   int i;
 
-  for (i = 0; i < [selectedCells count]; i++)
+  for (i = 0; i < [selectedNodes count]; i++)
     {
-      FSNBrowserCell *cell = [selectedCells objectAtIndex: i];
-      FSNode *node = [cell node];
+      FSNode *node = [selectedNodes objectAtIndex: i];
 
       if (node && [node isValid])
 	{
@@ -495,10 +466,7 @@
 
   if ([selection count])
     {
-      dndtypes = [NSArray arrayWithObject: NSFilenamesPboardType];
-      [pb declareTypes: dndtypes owner: nil];
-
-      if ([pb setPropertyList: selection forType: NSFilenamesPboardType] == NO)
+      if (FSNWritePathsToPasteboard(selection, pb) == NO)
 	{
 	  return;
 	}
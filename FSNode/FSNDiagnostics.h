@@ -0,0 +1,51 @@
+/* FSNDiagnostics.h
+ *
+ * Live object counters, for telling where the memory of a long running
+ * Workspace went.
+ *
+ * A counted class bumps its counter in +allocWithZone: and drops it in
+ * -dealloc, with a relaxed atomic add: a few cycles, cheap enough to
+ * stay on in every build.  FSNDiagnosticsReport() reads the counters
+ * with the state of the FSNode caches; Workspace adds its own and
+ * publishes the lot on D-Bus and in the log on SIGUSR1.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_DIAGNOSTICS_H
+#define FSN_DIAGNOSTICS_H
+
+#import <Foundation/Foundation.h>
+
+typedef enum
+{
+  FSNLiveNodes,
+  FSNLiveIcons,
+  FSNLiveIconContents,
+  FSNLiveCounterCount
+} FSNLiveCounter;
+
+extern long FSNLiveCounters[FSNLiveCounterCount];
+
+static inline void
+FSNLiveCounterAdd(FSNLiveCounter counter, long delta)
+{
+  __atomic_add_fetch(&FSNLiveCounters[counter], delta, __ATOMIC_RELAXED);
+}
+
+static inline long
+FSNLiveCounterValue(FSNLiveCounter counter)
+{
+  return __atomic_load_n(&FSNLiveCounters[counter], __ATOMIC_RELAXED);
+}
+
+/* Name -> NSNumber.  The live counts, with ".bytes" estimates from the
+ * instance sizes, and the entries and bytes of the icon cache, the
+ * thumbnail cache and store, and the directory listings cache.  Main
+ * thread only, as the caches of FSNodeRep are. */
+NSMutableDictionary *FSNDiagnosticsReport(void);
+
+/* The report as lines of "name value", sorted, for the log. */
+NSString *FSNDiagnosticsDescription(NSDictionary *report);
+
+#endif /* FSN_DIAGNOSTICS_H */
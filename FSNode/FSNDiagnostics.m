@@ -0,0 +1,95 @@
+/* FSNDiagnostics.m
+ *
+ * Live object counters.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#include <objc/runtime.h>
+
+#import "FSNDiagnostics.h"
+#import "FSNode.h"
+#import "FSNIcon.h"
+#import "FSNodeRep.h"
+
+long FSNLiveCounters[FSNLiveCounterCount];
+
+static void
+addCount(NSMutableDictionary *report, NSString *key, unsigned long long value)
+{
+  [report setObject: [NSNumber numberWithUnsignedLongLong: value] forKey: key];
+}
+
+/* `count` instances of `class`, their own memory only */
+static void
+addLiveCount(NSMutableDictionary *report, NSString *key,
+             FSNLiveCounter counter, Class class)
+{
+  long count = FSNLiveCounterValue(counter);
+
+  if (count < 0)
+    count = 0;
+
+  addCount(report, key, count);
+  addCount(report, [key stringByAppendingString: @".bytes"],
+           (unsigned long long)count * class_getInstanceSize(class));
+}
+
+static void
+addStatistics(NSMutableDictionary *report, NSString *prefix,
+              NSDictionary *stats, NSArray *keys)
+{
+  NSUInteger i;
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+      id value = [stats objectForKey: key];
+
+      if (value)
+        [report setObject: value
+                   forKey: [NSString stringWithFormat: @"%@.%@", prefix, key]];
+    }
+}
+
+
+NSMutableDictionary *
+FSNDiagnosticsReport(void)
+{
+  NSMutableDictionary *report = [NSMutableDictionary dictionary];
+  FSNodeRep *rep = [FSNodeRep sharedInstance];
+
+  addLiveCount(report, @"FSNode", FSNLiveNodes, [FSNode class]);
+  addLiveCount(report, @"FSNIcon", FSNLiveIcons, [FSNIcon class]);
+  /* icons holding their image and two label cells */
+  addCount(report, @"FSNIcon.loaded",
+           MAX(FSNLiveCounterValue(FSNLiveIconContents), 0));
+
+  addStatistics(report, @"iconsCache", [rep iconsCacheStatistics],
+                [NSArray arrayWithObjects: @"entries", @"bytes", @"evictions", nil]);
+  addStatistics(report, @"thumbnails", [rep thumbnailsStatistics],
+                [NSArray arrayWithObjects: @"entries", @"storeEntries", @"storeBytes", nil]);
+  addStatistics(report, @"listingCache", [rep listingCacheStatistics],
+                [NSArray arrayWithObjects: @"entries", @"names", nil]);
+
+  return report;
+}
+
+NSString *
+FSNDiagnosticsDescription(NSDictionary *report)
+{
+  NSArray *keys = [[report allKeys] sortedArrayUsingSelector: @selector(compare:)];
+  NSMutableString *desc = [NSMutableString string];
+  NSUInteger i;
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+
+      [desc appendFormat: @"%@ %@\n", key, [report objectForKey: key]];
+    }
+
+  return desc;
+}
@@ -0,0 +1,93 @@
+/* FSNDirectoryLoader.h
+ *
+ * Background read of a directory listing.
+ *
+ * The loader reads a directory on its own thread through an incremental
+ * FSNDirectorySnapshot and hands the entries to its delegate on the main
+ * thread as they come in: a small first batch, so a column can show
+ * something at once, then batches of growing size.  When the directory
+ * is exhausted the delegate gets the complete snapshot, ready to be
+ * cached by FSNodeRep.  A cancelled loader stops reading at the next
+ * batch and never calls its delegate again.
+ *
+ * FSNPrefetcher uses the same loader to read folders ahead of the user,
+ * with an entry limit, no batches and no network volumes.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_DIRECTORY_LOADER_H
+#define FSN_DIRECTORY_LOADER_H
+
+#import <Foundation/Foundation.h>
+#import "FSNDirectorySnapshot.h"
+
+@class FSNDirectoryLoader;
+
+@protocol FSNDirectoryLoaderDelegate
+
+/* `chunk` holds the entries read since the previous call, unfiltered. */
+- (void)directoryLoader:(FSNDirectoryLoader *)loader
+         didReadEntries:(FSNDirectorySnapshot *)chunk;
+
+/* `snapshot` holds every entry; it is not valid if the directory could
+ * not be read.  It is nil when the read was given up because of the
+ * entry limit or because the folder is on a network volume. */
+- (void)directoryLoader:(FSNDirectoryLoader *)loader
+  didFinishWithSnapshot:(FSNDirectorySnapshot *)snapshot;
+
+@end
+
+
+@interface FSNDirectoryLoader : NSObject
+{
+  NSString *path;
+  FSNLoadTier tier;
+  id <FSNDirectoryLoaderDelegate> delegate;   /* not retained */
+  NSSet *hiddenNames;
+  NSUInteger entryLimit;
+  BOOL deliversBatches;
+  BOOL localOnly;
+  id metadataProvider;
+  volatile BOOL cancelled;
+  BOOL started;
+}
+
+- (id)initWithPath:(NSString *)apath
+              tier:(FSNLoadTier)atier
+          delegate:(id <FSNDirectoryLoaderDelegate>)adelegate;
+
+/* Options; set them before -start. */
+
+/* Folders with more entries are not read through.  0, the default,
+ * means no limit. */
+- (void)setEntryLimit:(NSUInteger)limit;
+
+/* Whether -directoryLoader:didReadEntries: is sent.  Default YES. */
+- (void)setDeliversBatches:(BOOL)flag;
+
+/* Gives up on folders of network volumes.  Default NO. */
+- (void)setLocalOnly:(BOOL)flag;
+
+/* Also warms the metadata of the folder's files on the loader thread,
+ * through the FSNodeRep metadata provider.  Default NO. */
+- (void)setPrefetchesMetadata:(BOOL)flag;
+
+/* Starts reading on a new thread.  Call on the main thread, once. */
+- (void)start;
+
+/* Stops reading and detaches the delegate.  Call on the main thread;
+ * the delegate may be released right after. */
+- (void)cancel;
+
+- (BOOL)isCancelled;
+
+- (NSString *)path;
+
+/* Names from the directory's .hidden file, or nil.  Read before the
+ * first batch is delivered. */
+- (NSSet *)hiddenNames;
+
+@end
+
+#endif /* FSN_DIRECTORY_LOADER_H */
@@ -0,0 +1,191 @@
+/* FSNDirectoryLoader.m
+ *
+ * Background read of a directory listing.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNDirectoryLoader.h"
+#import "FSNodeRep.h"
+#import "FSNMetadataProvider.h"
+#import "FSNMountTable.h"
+
+/* The first batch is what a column can show before the folder is read
+ * through; later batches grow so that re-sorting after each one stays
+ * cheap compared to the read itself. */
+#define LOADER_FIRST_BATCH 64
+#define LOADER_MAX_BATCH 2048
+
+
+@implementation FSNDirectoryLoader
+
+- (void)dealloc
+{
+  RELEASE (path);
+  RELEASE (hiddenNames);
+  RELEASE (metadataProvider);
+
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)apath
+              tier:(FSNLoadTier)atier
+          delegate:(id <FSNDirectoryLoaderDelegate>)adelegate
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (path, apath);
+      tier = atier;
+      delegate = adelegate;
+      hiddenNames = nil;
+      entryLimit = 0;
+      deliversBatches = YES;
+      localOnly = NO;
+      metadataProvider = nil;
+      cancelled = NO;
+      started = NO;
+    }
+
+  return self;
+}
+
+- (void)setEntryLimit:(NSUInteger)limit
+{
+  entryLimit = limit;
+}
+
+- (void)setDeliversBatches:(BOOL)flag
+{
+  deliversBatches = flag;
+}
+
+- (void)setLocalOnly:(BOOL)flag
+{
+  localOnly = flag;
+}
+
+- (void)setPrefetchesMetadata:(BOOL)flag
+{
+  id provider = [[FSNodeRep sharedInstance] metadataProvider];
+
+  if (flag && [provider respondsToSelector: @selector(prefetchMetadataForDirectory:)])
+    ASSIGN (metadataProvider, provider);
+  else
+    DESTROY (metadataProvider);
+}
+
+- (void)start
+{
+  if (started == NO)
+    {
+      started = YES;
+      [NSThread detachNewThreadSelector: @selector(readDirectory:)
+                               toTarget: self
+                             withObject: nil];
+    }
+}
+
+- (void)cancel
+{
+  cancelled = YES;
+  delegate = nil;
+}
+
+- (BOOL)isCancelled
+{
+  return cancelled;
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (NSSet *)hiddenNames
+{
+  return hiddenNames;
+}
+
+/* Runs on the loader thread, which retains the loader until it returns. */
+- (void)readDirectory:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  FSNDirectorySnapshot *snap;
+  NSUInteger batch = LOADER_FIRST_BATCH;
+  NSUInteger delivered = 0;
+  BOOL givenUp = NO;
+
+  /* set before anything is sent to the main thread, which only reads it
+     from the delivery methods */
+  ASSIGN (hiddenNames, [FSNodeRep hiddenNamesAtPath: path]);
+
+  snap = [[FSNDirectorySnapshot alloc] initForReadingDirectoryAtPath: path
+                                                                tier: tier];
+
+  if (localOnly && ([snap isComplete] == NO))
+    {
+      dev_t dev = (dev_t)[snap directoryStatInfo]->device;
+
+      givenUp = [[[FSNMountTable sharedTable] entryForDevice: dev] isNetwork];
+    }
+
+  if (entryLimit > 0)
+    batch = MIN(batch, entryLimit + 1);
+
+  while ((cancelled == NO) && (givenUp == NO) && ([snap isComplete] == NO))
+    {
+      CREATE_AUTORELEASE_POOL(pool);
+
+      [snap readEntries: batch];
+
+      if ((entryLimit > 0) && ([snap count] > entryLimit))
+        {
+          givenUp = YES;
+        }
+      else if (deliversBatches && (cancelled == NO) && ([snap count] > delivered))
+        {
+          NSRange range = NSMakeRange(delivered, [snap count] - delivered);
+
+          [self performSelectorOnMainThread: @selector(deliverEntries:)
+                                 withObject: [snap snapshotOfEntriesInRange: range]
+                              waitUntilDone: NO];
+          delivered = [snap count];
+        }
+
+      batch = MIN(batch * 2, LOADER_MAX_BATCH);
+      RELEASE (pool);
+    }
+
+  if ((cancelled == NO) && (givenUp == NO) && [snap isValid] && metadataProvider)
+    {
+      [metadataProvider prefetchMetadataForDirectory: path];
+    }
+
+  if (cancelled == NO)
+    {
+      [self performSelectorOnMainThread: @selector(deliverSnapshot:)
+                             withObject: (givenUp ? nil : snap)
+                          waitUntilDone: NO];
+    }
+
+  RELEASE (snap);
+  RELEASE (arp);
+}
+
+/* Main thread.  -cancel runs on the main thread too, so a cancelled
+   loader can not reach a released delegate here. */
+- (void)deliverEntries:(FSNDirectorySnapshot *)chunk
+{
+  if (cancelled == NO)
+    [delegate directoryLoader: self didReadEntries: chunk];
+}
+
+- (void)deliverSnapshot:(FSNDirectorySnapshot *)snap
+{
+  if (cancelled == NO)
+    [delegate directoryLoader: self didFinishWithSnapshot: snap];
+}
+
+@end
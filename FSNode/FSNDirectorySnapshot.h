@@ -0,0 +1,154 @@
+/* FSNDirectorySnapshot.h
+ *
+ * One-pass directory listing for FSNode.
+ *
+ * A snapshot reads a directory once through its file descriptor
+ * (readdir + fstatat relative to dirfd()) and keeps the result as a
+ * compact C array of FSNStatInfo records next to the entry names.
+ * FSNode can then be initialised straight from a record, so listing a
+ * folder with N entries no longer costs N separate path lookups and N
+ * attribute dictionaries.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_DIRECTORY_SNAPSHOT_H
+#define FSN_DIRECTORY_SNAPSHOT_H
+
+#import <Foundation/Foundation.h>
+
+/* -----------------------------------------------------------------------
+ * FSNLoadTier — how much of a node's attributes is known.
+ *
+ *  Type   name and file type only, straight from the dirent (d_type).
+ *         Enough for first paint of browser columns and the desktop.
+ *  Stat   size, times, permissions and uid/gid from one stat call.
+ *  Owner  owner/group account names; FSNode resolves them only when
+ *         -owner/-group (or the Inspector) asks.
+ *
+ * A node never goes back to a lower tier; missing fields are loaded on
+ * first access.
+ * --------------------------------------------------------------------- */
+typedef enum FSNLoadTier {
+  FSNLoadTierType = 0,
+  FSNLoadTierStat = 1,
+  FSNLoadTierOwner = 2
+} FSNLoadTier;
+
+/* -----------------------------------------------------------------------
+ * FSNStatInfo — the subset of struct stat that FSNode actually uses.
+ *
+ * Times are seconds since 1970 so they convert to NSDate without any
+ * further system call.  `mode` carries the S_IFMT type bits as well as
+ * the permission bits.  At FSNLoadTierType only the type bits of `mode`
+ * are set and every other field is zero.
+ * --------------------------------------------------------------------- */
+typedef struct FSNStatInfo {
+  unsigned long long size;
+  unsigned long long inode;
+  unsigned long long device;
+  NSTimeInterval modificationTime;
+  NSTimeInterval changeTime;
+  unsigned long mode;
+  unsigned long uid;
+  unsigned long gid;
+  FSNLoadTier tier;
+} FSNStatInfo;
+
+/* Fills `info` from an lstat() of `path`.  Returns NO when the path does
+ * not exist (info is left untouched). */
+BOOL FSNStatInfoForPath(NSString *path, FSNStatInfo *info);
+
+/* Same as FSNStatInfoForPath() but follows a final symbolic link. */
+BOOL FSNStatInfoForPathTraversingLink(NSString *path, FSNStatInfo *info);
+
+/* NSFileType* constant for the type bits of `mode`. */
+NSString *FSNFileTypeForStatMode(unsigned long mode);
+
+/* Cached user/group name lookups (main thread only). */
+NSString *FSNUserNameForUID(unsigned long uid);
+NSString *FSNGroupNameForGID(unsigned long gid);
+
+
+@interface FSNDirectorySnapshot : NSObject
+{
+  NSString *path;
+  NSMutableArray *names;
+  FSNStatInfo *infos;
+  NSUInteger count;
+  NSUInteger capacity;
+  FSNStatInfo dirInfo;
+  FSNLoadTier tier;
+  NSTimeInterval timestamp;
+  BOOL valid;
+  void *dirStream;              /* open DIR while reading incrementally */
+  BOOL complete;
+}
+
++ (FSNDirectorySnapshot *)snapshotOfDirectoryAtPath:(NSString *)apath;
+
++ (FSNDirectorySnapshot *)snapshotOfDirectoryAtPath:(NSString *)apath
+                                               tier:(FSNLoadTier)atier;
+
+/* Reads the directory at `apath` with every entry at FSNLoadTierStat. */
+- (id)initWithDirectoryAtPath:(NSString *)apath;
+
+/* Reads the directory at `apath`.  With FSNLoadTierType no per-entry
+ * stat is done unless the filesystem does not report d_type.  On failure
+ * (not a directory, no permission) the snapshot is empty and -isValid
+ * returns NO. */
+- (id)initWithDirectoryAtPath:(NSString *)apath
+                         tier:(FSNLoadTier)atier;
+
+/* An empty snapshot that is not valid, made without touching the file
+ * system: what a directory that could not be read in time shows. */
+- (id)initUnreadDirectoryAtPath:(NSString *)apath
+                           tier:(FSNLoadTier)atier;
+
+/* Opens `apath` for an incremental read: entries are then added by
+ * -readEntries: until -isComplete.  This is how FSNDirectoryLoader
+ * streams a listing; the snapshot must stay on one thread meanwhile. */
+- (id)initForReadingDirectoryAtPath:(NSString *)apath
+                               tier:(FSNLoadTier)atier;
+
+/* Reads up to `maxCount` more entries and returns how many were added.
+ * Returns 0 once the directory is exhausted, which closes it. */
+- (NSUInteger)readEntries:(NSUInteger)maxCount;
+
+/* NO while an incremental read has entries left. */
+- (BOOL)isComplete;
+
+/* An independent, complete snapshot holding a copy of the entries in
+ * `range`, with the same path, tier and directory stat. */
+- (FSNDirectorySnapshot *)snapshotOfEntriesInRange:(NSRange)range;
+
+- (NSString *)path;
+
+- (FSNLoadTier)tier;
+
+/* When the directory was read (reference date seconds). */
+- (NSTimeInterval)timestamp;
+
+- (BOOL)isValid;
+
+/* stat of the directory itself, taken on the same descriptor. */
+- (const FSNStatInfo *)directoryStatInfo;
+
+- (NSUInteger)count;
+
+/* Entry names in readdir order ("." and ".." excluded). */
+- (NSArray *)names;
+
+- (NSString *)nameAtIndex:(NSUInteger)index;
+
+- (const FSNStatInfo *)statInfoAtIndex:(NSUInteger)index;
+
+- (const FSNStatInfo *)statInfoForName:(NSString *)aname;
+
+/* Compacts the snapshot in place to the entries at `indexes`; used by
+ * FSNodeRep to drop hidden entries without copying the records. */
+- (void)keepEntriesAtIndexes:(NSIndexSet *)indexes;
+
+@end
+
+#endif /* FSN_DIRECTORY_SNAPSHOT_H */
@@ -0,0 +1,465 @@
+/* FSNDirectorySnapshot.m
+ *
+ * One-pass directory listing for FSNode.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pwd.h>
+#include <grp.h>
+
+#import "FSNDirectorySnapshot.h"
+
+#if defined(__linux__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtim.tv_sec + (st)->st_mtim.tv_nsec / 1e9)
+  #define FSN_ST_CTIME(st) ((st)->st_ctim.tv_sec + (st)->st_ctim.tv_nsec / 1e9)
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtimespec.tv_sec + (st)->st_mtimespec.tv_nsec / 1e9)
+  #define FSN_ST_CTIME(st) ((st)->st_ctimespec.tv_sec + (st)->st_ctimespec.tv_nsec / 1e9)
+#else
+  #define FSN_ST_MTIME(st) ((NSTimeInterval)(st)->st_mtime)
+  #define FSN_ST_CTIME(st) ((NSTimeInterval)(st)->st_ctime)
+#endif
+
+#define SNAPSHOT_INITIAL_CAPACITY 64
+
+static inline void
+fillStatInfo(FSNStatInfo *info, const struct stat *st)
+{
+  info->size = (unsigned long long)st->st_size;
+  info->inode = (unsigned long long)st->st_ino;
+  info->device = (unsigned long long)st->st_dev;
+  info->modificationTime = FSN_ST_MTIME(st);
+  info->changeTime = FSN_ST_CTIME(st);
+  info->mode = (unsigned long)st->st_mode;
+  info->uid = (unsigned long)st->st_uid;
+  info->gid = (unsigned long)st->st_gid;
+  info->tier = FSNLoadTierStat;
+}
+
+#ifdef DT_UNKNOWN
+static inline BOOL
+fillTypeInfo(FSNStatInfo *info, unsigned char dtype)
+{
+  if (dtype == DT_UNKNOWN)
+    return NO;
+
+  memset(info, 0, sizeof(FSNStatInfo));
+  info->mode = (unsigned long)DTTOIF(dtype);
+  info->tier = FSNLoadTierType;
+  return YES;
+}
+#endif
+
+BOOL
+FSNStatInfoForPath(NSString *path, FSNStatInfo *info)
+{
+  struct stat st;
+
+  if (path == nil || lstat([path fileSystemRepresentation], &st) != 0)
+    return NO;
+
+  fillStatInfo(info, &st);
+  return YES;
+}
+
+BOOL
+FSNStatInfoForPathTraversingLink(NSString *path, FSNStatInfo *info)
+{
+  struct stat st;
+
+  if (path == nil || stat([path fileSystemRepresentation], &st) != 0)
+    return NO;
+
+  fillStatInfo(info, &st);
+  return YES;
+}
+
+NSString *
+FSNFileTypeForStatMode(unsigned long mode)
+{
+  switch (mode & S_IFMT)
+    {
+      case S_IFREG:  return NSFileTypeRegular;
+      case S_IFDIR:  return NSFileTypeDirectory;
+      case S_IFLNK:  return NSFileTypeSymbolicLink;
+      case S_IFSOCK: return NSFileTypeSocket;
+      case S_IFCHR:  return NSFileTypeCharacterSpecial;
+      case S_IFBLK:  return NSFileTypeBlockSpecial;
+      default:       return NSFileTypeUnknown;
+    }
+}
+
+/* uid/gid -> name.  A folder is almost always owned by one or two
+ * accounts, so a tiny map saves a getpwuid() per node. */
+static NSMapTable *userNames = nil;
+static NSMapTable *groupNames = nil;
+
+NSString *
+FSNUserNameForUID(unsigned long uid)
+{
+  NSString *uname;
+
+  if (userNames == nil)
+    {
+      userNames = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+                                   NSObjectMapValueCallBacks, 8);
+    }
+
+  uname = NSMapGet(userNames, (void *)(uintptr_t)uid);
+
+  if (uname == nil)
+    {
+      struct passwd *pw = getpwuid((uid_t)uid);
+
+      if (pw && pw->pw_name)
+        uname = [NSString stringWithUTF8String: pw->pw_name];
+      else
+        uname = [NSString stringWithFormat: @"%lu", uid];
+
+      NSMapInsert(userNames, (void *)(uintptr_t)uid, uname);
+    }
+
+  return uname;
+}
+
+NSString *
+FSNGroupNameForGID(unsigned long gid)
+{
+  NSString *gname;
+
+  if (groupNames == nil)
+    {
+      groupNames = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+                                    NSObjectMapValueCallBacks, 8);
+    }
+
+  gname = NSMapGet(groupNames, (void *)(uintptr_t)gid);
+
+  if (gname == nil)
+    {
+      struct group *gr = getgrgid((gid_t)gid);
+
+      if (gr && gr->gr_name)
+        gname = [NSString stringWithUTF8String: gr->gr_name];
+      else
+        gname = [NSString stringWithFormat: @"%lu", gid];
+
+      NSMapInsert(groupNames, (void *)(uintptr_t)gid, gname);
+    }
+
+  return gname;
+}
+
+
+@implementation FSNDirectorySnapshot
+
++ (FSNDirectorySnapshot *)snapshotOfDirectoryAtPath:(NSString *)apath
+{
+  return [[[self alloc] initWithDirectoryAtPath: apath] autorelease];
+}
+
++ (FSNDirectorySnapshot *)snapshotOfDirectoryAtPath:(NSString *)apath
+                                               tier:(FSNLoadTier)atier
+{
+  return [[[self alloc] initWithDirectoryAtPath: apath tier: atier] autorelease];
+}
+
+- (void)dealloc
+{
+  if (dirStream)
+    closedir((DIR *)dirStream);
+  RELEASE (path);
+  RELEASE (names);
+  if (infos)
+    free(infos);
+
+  [super dealloc];
+}
+
+- (id)initWithDirectoryAtPath:(NSString *)apath
+{
+  return [self initWithDirectoryAtPath: apath tier: FSNLoadTierStat];
+}
+
+- (id)initWithDirectoryAtPath:(NSString *)apath
+                         tier:(FSNLoadTier)atier
+{
+  self = [self initForReadingDirectoryAtPath: apath tier: atier];
+
+  if (self)
+    {
+      while ([self readEntries: NSUIntegerMax] > 0);
+    }
+
+  return self;
+}
+
+- (id)initUnreadDirectoryAtPath:(NSString *)apath
+                           tier:(FSNLoadTier)atier
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (path, apath);
+      names = [NSMutableArray new];
+      count = 0;
+      capacity = 0;
+      infos = NULL;
+      dirStream = NULL;
+      tier = (atier == FSNLoadTierType) ? FSNLoadTierType : FSNLoadTierStat;
+      valid = NO;
+      complete = YES;
+      timestamp = [NSDate timeIntervalSinceReferenceDate];
+      memset(&dirInfo, 0, sizeof(FSNStatInfo));
+    }
+
+  return self;
+}
+
+- (id)initForReadingDirectoryAtPath:(NSString *)apath
+                               tier:(FSNLoadTier)atier
+{
+  self = [self initUnreadDirectoryAtPath: apath tier: atier];
+
+  if (self)
+    {
+      DIR *dirp;
+
+      dirp = opendir([apath fileSystemRepresentation]);
+
+      if (dirp == NULL)
+        {
+          return self;
+        }
+
+      {
+        struct stat st;
+
+        if (fstat(dirfd(dirp), &st) == 0)
+          fillStatInfo(&dirInfo, &st);
+      }
+
+      capacity = SNAPSHOT_INITIAL_CAPACITY;
+      infos = malloc(capacity * sizeof(FSNStatInfo));
+
+      if (infos == NULL)
+        {
+          closedir(dirp);
+          capacity = 0;
+          return self;
+        }
+
+      dirStream = dirp;
+      complete = NO;
+    }
+
+  return self;
+}
+
+- (NSUInteger)readEntries:(NSUInteger)maxCount
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  DIR *dirp = (DIR *)dirStream;
+  NSUInteger added = 0;
+  int dfd;
+
+  if (dirp == NULL)
+    return 0;
+
+  dfd = dirfd(dirp);
+
+  while (added < maxCount)
+    {
+      struct dirent *de = readdir(dirp);
+      const char *dname;
+      struct stat st;
+      NSString *fname;
+
+      if (de == NULL)
+        {
+          closedir(dirp);
+          dirStream = NULL;
+          complete = YES;
+          valid = YES;
+          break;
+        }
+
+      dname = de->d_name;
+
+      if (dname[0] == '.'
+          && (dname[1] == '\0' || (dname[1] == '.' && dname[2] == '\0')))
+        continue;
+
+      if (count == capacity)
+        {
+          FSNStatInfo *grown = realloc(infos, capacity * 2 * sizeof(FSNStatInfo));
+
+          if (grown == NULL)
+            {
+              /* keep what was read; the listing ends here */
+              closedir(dirp);
+              dirStream = NULL;
+              complete = YES;
+              valid = YES;
+              break;
+            }
+
+          infos = grown;
+          capacity *= 2;
+        }
+
+#ifdef DT_UNKNOWN
+      if ((tier == FSNLoadTierType) && fillTypeInfo(&infos[count], de->d_type))
+        {
+          /* type is known from the dirent, no stat needed */
+        }
+      else
+#endif
+        {
+          /* The entry may vanish between readdir() and fstatat(); it
+           * is then simply not part of the snapshot. */
+          if (fstatat(dfd, dname, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+          fillStatInfo(&infos[count], &st);
+        }
+
+      fname = [fm stringWithFileSystemRepresentation: dname
+                                              length: strlen(dname)];
+      if (fname == nil)
+        continue;
+
+      [names addObject: fname];
+      count++;
+      added++;
+    }
+
+  return added;
+}
+
+- (BOOL)isComplete
+{
+  return complete;
+}
+
+- (FSNDirectorySnapshot *)snapshotOfEntriesInRange:(NSRange)range
+{
+  FSNDirectorySnapshot *snap = [[FSNDirectorySnapshot alloc] init];
+
+  if (NSMaxRange(range) > count)
+    {
+      RELEASE (snap);
+      [NSException raise: NSRangeException
+                  format: @"FSNDirectorySnapshot: range %@ out of range (%lu)",
+                   NSStringFromRange(range), (unsigned long)count];
+    }
+
+  ASSIGN (snap->path, path);
+  snap->names = [[names subarrayWithRange: range] mutableCopy];
+  snap->count = range.length;
+  snap->capacity = range.length;
+  snap->infos = malloc((range.length ? range.length : 1) * sizeof(FSNStatInfo));
+  if (snap->infos)
+    memcpy(snap->infos, infos + range.location, range.length * sizeof(FSNStatInfo));
+  else
+    snap->count = 0;
+  snap->dirInfo = dirInfo;
+  snap->tier = tier;
+  snap->timestamp = timestamp;
+  snap->valid = YES;
+  snap->complete = YES;
+
+  return AUTORELEASE (snap);
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (FSNLoadTier)tier
+{
+  return tier;
+}
+
+- (NSTimeInterval)timestamp
+{
+  return timestamp;
+}
+
+- (BOOL)isValid
+{
+  return valid;
+}
+
+- (const FSNStatInfo *)directoryStatInfo
+{
+  return &dirInfo;
+}
+
+- (NSUInteger)count
+{
+  return count;
+}
+
+- (NSArray *)names
+{
+  return names;
+}
+
+- (NSString *)nameAtIndex:(NSUInteger)index
+{
+  return [names objectAtIndex: index];
+}
+
+- (const FSNStatInfo *)statInfoAtIndex:(NSUInteger)index
+{
+  if (index >= count)
+    {
+      [NSException raise: NSRangeException
+                  format: @"FSNDirectorySnapshot: index %lu out of range (%lu)",
+                   (unsigned long)index, (unsigned long)count];
+    }
+  return &infos[index];
+}
+
+- (const FSNStatInfo *)statInfoForName:(NSString *)aname
+{
+  NSUInteger index = [names indexOfObject: aname];
+
+  if (index == NSNotFound)
+    return NULL;
+
+  return &infos[index];
+}
+
+- (void)keepEntriesAtIndexes:(NSIndexSet *)indexes
+{
+  NSMutableArray *kept = [NSMutableArray arrayWithCapacity: [indexes count]];
+  NSUInteger dst = 0;
+  NSUInteger src = [indexes firstIndex];
+
+  while (src != NSNotFound && src < count)
+    {
+      if (dst != src)
+        infos[dst] = infos[src];
+
+      [kept addObject: [names objectAtIndex: src]];
+      dst++;
+      src = [indexes indexGreaterThanIndex: src];
+    }
+
+  [names setArray: kept];
+  count = dst;
+}
+
+@end
@@ -0,0 +1,66 @@
+/* FSNFolderMetadata.h
+ *
+ * Finder metadata of all the files of one folder, as returned by
+ * -[FSNMetadataProvider folderMetadataAtPath:].  Views that show a whole
+ * folder read this table once instead of asking the provider per file for
+ * labels, invisibility, custom icons and positions.
+ *
+ * Only files that carry metadata have a record; -recordForName: returns
+ * NULL for the others, which means no label, visible, no custom icon and
+ * no stored position.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_FOLDER_METADATA_H
+#define FSN_FOLDER_METADATA_H
+
+#import <Foundation/Foundation.h>
+
+@class NSColor;
+
+typedef struct FSNMetadataRecord {
+  NSPoint iconPosition;     /* fdLocation top-left CENTER, (-1, -1) if none */
+  NSInteger labelNumber;    /* Finder label 1..7, 0 if none */
+  BOOL invisible;
+  BOOL hasCustomIcon;
+} FSNMetadataRecord;
+
+@interface FSNFolderMetadata : NSObject
+{
+  NSString *path;
+  NSMutableDictionary *indexes;
+  FSNMetadataRecord *records;
+  NSUInteger count;
+  NSUInteger capacity;
+  NSColor *labelColors[8];
+}
+
+- (id)initWithPath:(NSString *)apath;
+
+- (NSString *)path;
+
+/* Provider side */
+- (void)setRecord:(FSNMetadataRecord)record
+          forName:(NSString *)name;
+
+- (void)setColor:(NSColor *)color
+  forLabelNumber:(NSInteger)label;
+
+/* View side */
+- (NSUInteger)count;
+
+- (const FSNMetadataRecord *)recordForName:(NSString *)name;
+
+- (NSColor *)labelColorForName:(NSString *)name;
+
+- (BOOL)isInvisibleName:(NSString *)name;
+
+- (BOOL)hasCustomIconForName:(NSString *)name;
+
+/* (-1, -1) when no position is stored */
+- (NSPoint)iconPositionForName:(NSString *)name;
+
+@end
+
+#endif /* FSN_FOLDER_METADATA_H */
@@ -0,0 +1,125 @@
+/* FSNFolderMetadata.m
+ *
+ * Per-folder table of Finder metadata.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+
+#import <AppKit/AppKit.h>
+#import "FSNFolderMetadata.h"
+
+@implementation FSNFolderMetadata
+
+- (void)dealloc
+{
+  int i;
+
+  for (i = 0; i < 8; i++)
+    RELEASE (labelColors[i]);
+
+  free(records);
+  RELEASE (indexes);
+  RELEASE (path);
+
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)apath
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (path, apath);
+      indexes = [NSMutableDictionary new];
+    }
+
+  return self;
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (void)setRecord:(FSNMetadataRecord)record
+          forName:(NSString *)name
+{
+  NSNumber *index = [indexes objectForKey: name];
+
+  if (index != nil)
+    {
+      records[[index unsignedIntegerValue]] = record;
+      return;
+    }
+
+  if (count == capacity)
+    {
+      NSUInteger newcap = capacity ? capacity * 2 : 16;
+      FSNMetadataRecord *grown = realloc(records, newcap * sizeof(FSNMetadataRecord));
+
+      if (grown == NULL)
+        return;
+
+      records = grown;
+      capacity = newcap;
+    }
+
+  records[count] = record;
+  [indexes setObject: [NSNumber numberWithUnsignedInteger: count] forKey: name];
+  count++;
+}
+
+- (void)setColor:(NSColor *)color
+  forLabelNumber:(NSInteger)label
+{
+  if (label > 0 && label < 8)
+    ASSIGN (labelColors[label], color);
+}
+
+- (NSUInteger)count
+{
+  return count;
+}
+
+- (const FSNMetadataRecord *)recordForName:(NSString *)name
+{
+  NSNumber *index = [indexes objectForKey: name];
+
+  return index ? &records[[index unsignedIntegerValue]] : NULL;
+}
+
+- (NSColor *)labelColorForName:(NSString *)name
+{
+  const FSNMetadataRecord *rec = [self recordForName: name];
+
+  if (rec == NULL || rec->labelNumber <= 0 || rec->labelNumber > 7)
+    return nil;
+
+  return labelColors[rec->labelNumber];
+}
+
+- (BOOL)isInvisibleName:(NSString *)name
+{
+  const FSNMetadataRecord *rec = [self recordForName: name];
+
+  return rec ? rec->invisible : NO;
+}
+
+- (BOOL)hasCustomIconForName:(NSString *)name
+{
+  const FSNMetadataRecord *rec = [self recordForName: name];
+
+  return rec ? rec->hasCustomIcon : NO;
+}
+
+- (NSPoint)iconPositionForName:(NSString *)name
+{
+  const FSNMetadataRecord *rec = [self recordForName: name];
+
+  return rec ? rec->iconPosition : NSMakePoint(-1, -1);
+}
+
+@end
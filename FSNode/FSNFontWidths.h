@@ -0,0 +1,58 @@
+/* FSNFontWidths.h
+ *
+ * Shared character width table and label truncation for one font.
+ *
+ * Labels that do not fit are cut in the middle ("Long...name").  Finding
+ * the cut used to measure every candidate string with the font.  The
+ * table keeps the advance of each character once measured, so a
+ * candidate's width is a prefix-sum difference, and only the chosen cut
+ * is measured for real.  Results are also remembered per (string, width),
+ * which is what the shared data cell of a table view needs while it
+ * scrolls.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_FONT_WIDTHS_H
+#define FSN_FONT_WIDTHS_H
+
+#import <Foundation/Foundation.h>
+
+@class NSFont;
+
+@interface FSNFontWidths : NSObject
+{
+  NSFont *font;
+  NSDictionary *attributes;
+  float dotsWidth;
+  float lineHeight;
+  float *pages[256];            /* advance per unichar, < 0 until measured */
+  NSMutableDictionary *fitted;  /* title -> last (width, display title) */
+}
+
+/* The shared table of `font`.  Main thread only, like the drawing. */
++ (FSNFontWidths *)widthsForFont:(NSFont *)afont;
+
+- (NSFont *)font;
+
+/* NSFontAttributeName -> font, for -sizeWithAttributes: */
+- (NSDictionary *)attributes;
+
+/* The height -sizeWithAttributes: gives for a line of text. */
+- (float)lineHeight;
+
+/* The width -sizeWithAttributes: gives. */
+- (float)widthOfString:(NSString *)str;
+
+/* `title` if it fits in `width`, otherwise `title` cut in the middle
+ * with "..." until it fits, or just "..." for very short widths. */
+- (NSString *)titleForString:(NSString *)title
+                fittingWidth:(float)width;
+
+/* Same cut, without first checking whether `title` fits. */
+- (NSString *)cutString:(NSString *)title
+             toFitWidth:(float)width;
+
+@end
+
+#endif /* FSN_FONT_WIDTHS_H */
@@ -0,0 +1,296 @@
+/* FSNFontWidths.m
+ *
+ * Shared character width table and label truncation for one font.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+
+#import <AppKit/AppKit.h>
+#import "FSNFontWidths.h"
+
+/* remembered (string, width) fits per font, about a few large folders */
+#define FITTED_MAX 4096
+
+static NSString *dots = @"...";
+static NSMapTable *tables = nil;
+
+static inline NSString *
+cutCandidate(NSString *title, NSUInteger fpto, NSUInteger spfr)
+{
+  return [NSString stringWithFormat: @"%@%@%@",
+                   [title substringToIndex: fpto], dots,
+                   [title substringFromIndex: spfr]];
+}
+
+
+@implementation FSNFontWidths
+
++ (FSNFontWidths *)widthsForFont:(NSFont *)afont
+{
+  FSNFontWidths *widths;
+
+  if (afont == nil)
+    return nil;
+
+  if (tables == nil)
+    {
+      tables = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                NSObjectMapValueCallBacks, 4);
+    }
+
+  widths = NSMapGet(tables, afont);
+
+  if (widths == nil)
+    {
+      widths = [[self alloc] initWithFont: afont];
+      NSMapInsert(tables, afont, widths);
+      RELEASE (widths);
+    }
+
+  return widths;
+}
+
+- (void)dealloc
+{
+  NSUInteger i;
+
+  for (i = 0; i < 256; i++)
+    free(pages[i]);
+  RELEASE (font);
+  RELEASE (attributes);
+  RELEASE (fitted);
+
+  [super dealloc];
+}
+
+- (id)initWithFont:(NSFont *)afont
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (font, afont);
+      ASSIGN (attributes, [NSDictionary dictionaryWithObject: font
+                                                      forKey: NSFontAttributeName]);
+      memset(pages, 0, sizeof(pages));
+      fitted = [NSMutableDictionary new];
+      {
+        NSSize size = [dots sizeWithAttributes: attributes];
+
+        dotsWidth = size.width;
+        lineHeight = size.height;
+      }
+    }
+
+  return self;
+}
+
+- (NSFont *)font
+{
+  return font;
+}
+
+- (NSDictionary *)attributes
+{
+  return attributes;
+}
+
+- (float)lineHeight
+{
+  return lineHeight;
+}
+
+- (float)widthOfString:(NSString *)str
+{
+  return [str sizeWithAttributes: attributes].width;
+}
+
+/* < 0 for characters that have no advance of their own (surrogates) */
+- (float)widthOfCharacter:(unichar)c
+{
+  float *page;
+
+  if ((c >= 0xD800) && (c <= 0xDFFF))
+    return -1;
+
+  page = pages[c >> 8];
+
+  if (page == NULL)
+    {
+      NSUInteger i;
+
+      page = malloc(256 * sizeof(float));
+      if (page == NULL)
+        return -1;
+
+      for (i = 0; i < 256; i++)
+        page[i] = -1;
+      pages[c >> 8] = page;
+    }
+
+  if (page[c & 0xFF] < 0)
+    {
+      NSString *s = [NSString stringWithCharacters: &c length: 1];
+
+      page[c & 0xFF] = [self widthOfString: s];
+    }
+
+  return page[c & 0xFF];
+}
+
+/* prefix[i] is the estimated width of the first i characters.  Returns
+   NO when some character can not be estimated. */
+- (BOOL)getPrefixWidths:(float *)prefix
+              ofString:(NSString *)str
+                 length:(NSUInteger)len
+{
+  unichar *chars = malloc((len ? len : 1) * sizeof(unichar));
+  BOOL ok = (chars != NULL);
+  NSUInteger i;
+
+  if (ok)
+    {
+      [str getCharacters: chars range: NSMakeRange(0, len)];
+
+      prefix[0] = 0;
+      for (i = 0; i < len; i++)
+        {
+          float w = [self widthOfCharacter: chars[i]];
+
+          if (w < 0)
+            {
+              ok = NO;
+              break;
+            }
+          prefix[i + 1] = prefix[i] + w;
+        }
+
+      free(chars);
+    }
+
+  return ok;
+}
+
+- (NSString *)titleForString:(NSString *)title
+                fittingWidth:(float)width
+{
+  NSArray *last = [fitted objectForKey: title];
+  NSString *display;
+
+  if (last && ([[last objectAtIndex: 0] floatValue] == width))
+    return [last objectAtIndex: 1];
+
+  if ([self widthOfString: title] > width)
+    display = [self cutString: title toFitWidth: width];
+  else
+    display = title;
+
+  if ([fitted count] >= FITTED_MAX)
+    [fitted removeAllObjects];
+
+  [fitted setObject: [NSArray arrayWithObjects:
+                                [NSNumber numberWithFloat: width], display, nil]
+             forKey: title];
+
+  return display;
+}
+
+/* The cut keeps the first and the last part of the title and drops
+ * characters around the middle, alternately from the second and the
+ * first part, until the result fits.  Each step only makes the result
+ * narrower, so the first candidate that fits by estimate is measured
+ * and the neighbouring candidates settle any error of the estimate. */
+- (NSString *)cutString:(NSString *)title
+             toFitWidth:(float)width
+{
+  NSUInteger tl = [title length];
+  NSUInteger fpto, spfr;
+  NSUInteger steps = 0;
+  NSString *dotted;
+  float *prefix;
+  BOOL estimated;
+  int p = 0;
+
+  if (tl <= 5)
+    return dots;
+
+  fpto = (tl / 2) - 2;
+  spfr = fpto + 3;
+
+  prefix = malloc((tl + 1) * sizeof(float));
+  estimated = (prefix != NULL)
+                && [self getPrefixWidths: prefix ofString: title length: tl];
+
+  if (estimated)
+    {
+      while ((prefix[fpto] + dotsWidth + (prefix[tl] - prefix[spfr])) > width)
+        {
+          if ((fpto + 3 + (tl - spfr)) <= 5)
+            {
+              free(prefix);
+              return dots;
+            }
+
+          if (p)
+            fpto--;
+          else
+            spfr++;
+          p = !p;
+          steps++;
+        }
+    }
+
+  free(prefix);
+
+  dotted = cutCandidate(title, fpto, spfr);
+
+  if (estimated && ([self widthOfString: dotted] <= width))
+    {
+      /* the estimate may have been too wide: longer cuts can still fit */
+      while (steps > 0)
+        {
+          NSUInteger bfpto = fpto;
+          NSUInteger bspfr = spfr;
+          NSString *longer;
+
+          if (p)
+            bspfr--;
+          else
+            bfpto++;
+
+          longer = cutCandidate(title, bfpto, bspfr);
+
+          if ([self widthOfString: longer] > width)
+            break;
+
+          dotted = longer;
+          fpto = bfpto;
+          spfr = bspfr;
+          p = !p;
+          steps--;
+        }
+
+      return dotted;
+    }
+
+  /* measured candidates only, from here on */
+  while ([self widthOfString: dotted] > width)
+    {
+      if ((fpto + 3 + (tl - spfr)) <= 5)
+        return dots;
+
+      if (p)
+        fpto--;
+      else
+        spfr++;
+      p = !p;
+
+      dotted = cutCandidate(title, fpto, spfr);
+    }
+
+  return dotted;
+}
+
+@end
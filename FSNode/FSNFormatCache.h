@@ -0,0 +1,33 @@
+/* FSNFormatCache.h
+ *
+ * The date and size strings of the info columns and labels, formatted
+ * through caches shared by every node instead of once per node.
+ *
+ * A date is split into its local day and the time on that day.  The
+ * offset from GMT is looked up once per hour of dates and the day string
+ * ("Oct 14 2026") is made once per day, with the time zone and calendar
+ * setup of the first call, so formatting the dates of a large list is
+ * arithmetic and a string append per row.  Nodes keep the numeric times
+ * they were stat'ed with and ask for a string only when a row or label
+ * shows one.  The strings are those of -descriptionWithCalendarFormat:
+ * with "%b %d %Y" and "%b %d %Y %H:%M" in the local time zone; the caches
+ * are dropped when the default time zone changes.
+ *
+ * Sizes are the strings of sizeDescription(), of which the most used are
+ * kept.  Foundation only; safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_FORMAT_CACHE_H
+#define FSN_FORMAT_CACHE_H
+
+#import <Foundation/Foundation.h>
+
+/* The local date of `t`, seconds since 1970, with the time of day when
+ * `withTime` is YES. */
+NSString *FSNDateDescription(NSTimeInterval t, BOOL withTime);
+
+NSString *FSNSizeDescription(unsigned long long size);
+
+#endif /* FSN_FORMAT_CACHE_H */
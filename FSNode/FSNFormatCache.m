@@ -0,0 +1,180 @@
+/* FSNFormatCache.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+#import "FSNFormatCache.h"
+
+/* powers of two, the slots are picked by masking */
+#define OFFSET_SLOTS 256
+#define DAY_SLOTS 256
+#define SIZE_SLOTS 1024
+
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+
+typedef struct
+{
+  long long hour;           /* hours since 1970 */
+  long offset;              /* seconds east of GMT */
+  BOOL valid;
+} FSNOffsetSlot;
+
+typedef struct
+{
+  long long day;            /* local days since 1970 */
+  NSString *string;
+} FSNDaySlot;
+
+typedef struct
+{
+  unsigned long long size;
+  NSString *string;
+} FSNSizeSlot;
+
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static NSTimeZone *zone = nil;
+static FSNOffsetSlot offsets[OFFSET_SLOTS];
+static FSNDaySlot days[DAY_SLOTS];
+static FSNSizeSlot sizes[SIZE_SLOTS];
+
+#define ONE_KB 1024LLU
+#define ONE_MB (ONE_KB * ONE_KB)
+#define ONE_GB (ONE_KB * ONE_MB)
+#define ONE_TB (ONE_KB * ONE_GB)
+
+static NSString *
+formatSize(unsigned long long size)
+{
+  if (size == 1)
+    return @"1 byte";
+  if (size == 0)
+    return @"0 bytes";
+  if (size < (ONE_KB))
+    return [NSString stringWithFormat: @" %ld bytes", (long)size];
+  if (size < (ONE_MB))
+    return [NSString stringWithFormat: @" %3.2fKB", ((double)size / (double)(ONE_KB))];
+  if (size < (ONE_GB))
+    return [NSString stringWithFormat: @" %3.2fMB", ((double)size / (double)(ONE_MB))];
+  if (size < (ONE_TB))
+    return [NSString stringWithFormat: @" %3.2fGB", ((double)size / (double)(ONE_GB))];
+
+  return [NSString stringWithFormat: @" %3.2fTB", ((double)size / (double)(ONE_TB))];
+}
+
+/* With the lock held.  A new default time zone drops what was worked
+   out with the old one. */
+static void
+checkTimeZone(void)
+{
+  NSTimeZone *current = [NSTimeZone defaultTimeZone];
+  NSUInteger i;
+
+  if (current == zone)
+    return;
+
+  ASSIGN (zone, current);
+  memset(offsets, 0, sizeof(offsets));
+
+  for (i = 0; i < DAY_SLOTS; i++)
+    DESTROY (days[i].string);
+}
+
+static long
+offsetAt(long long t)
+{
+  return [zone secondsFromGMTForDate: [NSDate dateWithTimeIntervalSince1970: t]];
+}
+
+/* With the lock held. */
+static long
+offsetFromGMT(long long t)
+{
+  long long hour = (long long)floor((double)t / SECONDS_PER_HOUR);
+  FSNOffsetSlot *slot = &offsets[hour & (OFFSET_SLOTS - 1)];
+  long first;
+
+  if (slot->valid && (slot->hour == hour))
+    return slot->offset;
+
+  /* an hour with a transition in it is not cached */
+  first = offsetAt(hour * SECONDS_PER_HOUR);
+  if (first != offsetAt(hour * SECONDS_PER_HOUR + SECONDS_PER_HOUR - 1))
+    return offsetAt(t);
+
+  slot->hour = hour;
+  slot->offset = first;
+  slot->valid = YES;
+
+  return first;
+}
+
+NSString *
+FSNDateDescription(NSTimeInterval t, BOOL withTime)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  long long secs = (long long)floor(t);
+  long long local;
+  long long day;
+  long dayTime;
+  FSNDaySlot *slot;
+  NSString *dayString;
+  NSString *descr;
+
+  pthread_mutex_lock(&cacheLock);
+
+  checkTimeZone();
+
+  local = secs + offsetFromGMT(secs);
+  day = (long long)floor((double)local / SECONDS_PER_DAY);
+  dayTime = (long)(local - day * SECONDS_PER_DAY);
+
+  slot = &days[day & (DAY_SLOTS - 1)];
+  if ((slot->string == nil) || (slot->day != day))
+    {
+      ASSIGN (slot->string, [[NSDate dateWithTimeIntervalSince1970: secs]
+                              descriptionWithCalendarFormat: @"%b %d %Y"
+                                                   timeZone: zone
+                                                     locale: nil]);
+      slot->day = day;
+    }
+  dayString = RETAIN (slot->string);
+
+  pthread_mutex_unlock(&cacheLock);
+
+  if (withTime)
+    descr = [[NSString alloc] initWithFormat: @"%@ %02ld:%02ld", dayString,
+                              dayTime / SECONDS_PER_HOUR,
+                              (dayTime % SECONDS_PER_HOUR) / 60];
+  else
+    descr = RETAIN (dayString);
+
+  RELEASE (dayString);
+  RELEASE (arp);
+
+  return AUTORELEASE (descr);
+}
+
+NSString *
+FSNSizeDescription(unsigned long long size)
+{
+  FSNSizeSlot *slot = &sizes[(size ^ (size >> 13) ^ (size >> 29)) & (SIZE_SLOTS - 1)];
+  NSString *descr;
+
+  pthread_mutex_lock(&cacheLock);
+
+  if ((slot->string == nil) || (slot->size != size))
+    {
+      ASSIGN (slot->string, formatSize(size));
+      slot->size = size;
+    }
+  descr = RETAIN (slot->string);
+
+  pthread_mutex_unlock(&cacheLock);
+
+  return AUTORELEASE (descr);
+}
@@ -51,10 +51,31 @@ BOOL pathsAreOnSameVolume(NSString *path1, NSString *path2);
 
 NSDragOperation dragOperationForCurrentModifierFlags(void);
 
+@class NSPasteboard;
+@class FSNPasteboardPaths;
+
+/* Puts `paths` on `pb` for a drag or a copy: their compact form
+ * (FSNPasteboardPaths.h) now, and the NSFilenamesPboardType list when a
+ * reader first asks for it.  Paths in several folders are written as a
+ * list at once.  NO when nothing could be written. */
+BOOL FSNWritePathsToPasteboard(NSArray *paths, NSPasteboard *pb);
+
+/* The paths on `pb`, from the compact form when it is there; read once
+ * for each change of the pasteboard, as the drag targets ask at every
+ * movement.  nil when it holds no paths. */
+FSNPasteboardPaths *FSNPathsOnPasteboard(NSPasteboard *pb);
+
 NSString *subtractFirstPartFromPath(NSString *path, NSString *firstpart);
 
 NSComparisonResult compareWithExtType(id r1, id r2, void *context);
 
+/* Index at which `object` can be inserted into the already sorted `array`
+ * without breaking its order (after any equal elements).  The order is
+ * given by `func` when non-NULL, otherwise by the comparison selector
+ * `sel` sent to the elements, as for -sortUsingFunction:/-sortUsingSelector:. */
+NSUInteger FSNSortedInsertionIndex(NSArray *array, id object, SEL sel,
+                                   NSComparisonResult (*func)(id, id, void *));
+
 NSString *sizeDescription(unsigned long long size);
 
 NSArray *makePathsSelection(NSArray *selnodes);
@@ -31,6 +31,8 @@
 #import <GNUstepBase/GNUstep.h>
 #import "FSNFunctions.h"
 #import "FSNodeRep.h"
+#import "FSNPasteboardPaths.h"
+#import "FSNFormatCache.h"
 #import <dispatch/dispatch.h>
 static GSFilenameExtensionDisplayMode _displayModeCache = -1;
 
@@ -294,31 +296,39 @@ NSComparisonResult compareWithExtType(id r1, id r2, void *context)
   return NSOrderedSame;
 }
 
-#define ONE_KB 1024LLU
-#define ONE_MB (ONE_KB * ONE_KB)
-#define ONE_GB (ONE_KB * ONE_MB)
-#define ONE_TB (ONE_KB * ONE_GB)
+NSUInteger FSNSortedInsertionIndex(NSArray *array, id object, SEL sel,
+                                   NSComparisonResult (*func)(id, id, void *))
+{
+  NSComparisonResult (*cmp)(id, SEL, id) = NULL;
+  NSUInteger lo = 0;
+  NSUInteger hi = [array count];
+
+  if (func == NULL)
+    cmp = (NSComparisonResult (*)(id, SEL, id))[object methodForSelector: sel];
+
+  while (lo < hi)
+    {
+      NSUInteger mid = lo + (hi - lo) / 2;
+      id other = [array objectAtIndex: mid];
+      NSComparisonResult r;
+
+      if (func)
+        r = func(object, other, NULL);
+      else
+        r = cmp(object, sel, other);
+
+      if (r == NSOrderedAscending)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return lo;
+}
 
 NSString *sizeDescription(unsigned long long size)
 {
-  NSString *sizeStr;
-
-  if (size == 1)
-    sizeStr = @"1 byte";
-  else if (size == 0)
-    sizeStr = @"0 bytes";
-  else if (size < (ONE_KB))
-    sizeStr = [NSString stringWithFormat:@" %ld bytes", (long)size];
-  else if (size < (ONE_MB))
-    sizeStr = [NSString stringWithFormat:@" %3.2fKB", ((double)size / (double)(ONE_KB))];
-  else if (size < (ONE_GB))
-    sizeStr = [NSString stringWithFormat:@" %3.2fMB", ((double)size / (double)(ONE_MB))];
-  else if (size < (ONE_TB))
-    sizeStr = [NSString stringWithFormat:@" %3.2fGB", ((double)size / (double)(ONE_GB))];
-  else
-    sizeStr = [NSString stringWithFormat:@" %3.2fTB", ((double)size / (double)(ONE_TB))];
-
-  return sizeStr;
+  return FSNSizeDescription(size);
 }
 
 NSArray *makePathsSelection(NSArray *selnodes)
@@ -358,6 +368,125 @@ NSDragOperation dragOperationForCurrentModifierFlags(void)
   return NSDragOperationMove;
 }
 
+/* --- Pasteboard */
+
+/* Gives the full paths of a selection put on a pasteboard when a reader
+   asks for them.  Kept by pasteboard name until the pasteboard changes
+   owner, as the pasteboard does not keep its owner. */
+@interface FSNPasteboardPathsOwner : NSObject
+{
+@public
+  FSNPasteboardPaths *pbpaths;
+}
+@end
+
+static NSMutableDictionary *pasteboardOwners = nil;
+
+@implementation FSNPasteboardPathsOwner
+
+- (void)dealloc
+{
+  RELEASE (pbpaths);
+  [super dealloc];
+}
+
+- (void)pasteboard:(NSPasteboard *)sender
+provideDataForType:(NSString *)type
+{
+  if ([type isEqual: NSFilenamesPboardType])
+    {
+      [sender setPropertyList: [pbpaths paths] forType: NSFilenamesPboardType];
+    }
+}
+
+- (void)pasteboardChangedOwner:(NSPasteboard *)sender
+{
+  if ([pasteboardOwners objectForKey: [sender name]] == self)
+    {
+      [pasteboardOwners removeObjectForKey: [sender name]];
+    }
+}
+
+@end
+
+BOOL FSNWritePathsToPasteboard(NSArray *paths, NSPasteboard *pb)
+{
+  FSNPasteboardPaths *pbpaths = [FSNPasteboardPaths pasteboardPathsWithPaths: paths];
+  id plist = [pbpaths propertyList];
+  FSNPasteboardPathsOwner *owner;
+
+  if (pbpaths == nil)
+    {
+      return NO;
+    }
+
+  if (plist == nil)
+    {
+      [pb declareTypes: [NSArray arrayWithObject: NSFilenamesPboardType]
+                 owner: nil];
+      return [pb setPropertyList: paths forType: NSFilenamesPboardType];
+    }
+
+  if (pasteboardOwners == nil)
+    {
+      pasteboardOwners = [NSMutableDictionary new];
+    }
+
+  owner = AUTORELEASE ([FSNPasteboardPathsOwner new]);
+  ASSIGN (owner->pbpaths, pbpaths);
+  [pasteboardOwners setObject: owner forKey: [pb name]];
+
+  [pb declareTypes: [NSArray arrayWithObjects: FSNFileListPboardType,
+                                               NSFilenamesPboardType, nil]
+             owner: owner];
+
+  return [pb setPropertyList: plist forType: FSNFileListPboardType];
+}
+
+FSNPasteboardPaths *FSNPathsOnPasteboard(NSPasteboard *pb)
+{
+  static NSString *lastName = nil;
+  static NSInteger lastChangeCount = -1;
+  static FSNPasteboardPaths *lastPaths = nil;
+  NSInteger changeCount = [pb changeCount];
+  FSNPasteboardPaths *pbpaths = nil;
+  NSArray *types;
+
+  if (pb == nil)
+    {
+      return nil;
+    }
+
+  if ((changeCount == lastChangeCount) && [[pb name] isEqual: lastName])
+    {
+      return lastPaths;
+    }
+
+  types = [pb types];
+
+  if ([types containsObject: FSNFileListPboardType])
+    {
+      pbpaths = [FSNPasteboardPaths pasteboardPathsWithPropertyList:
+                                      [pb propertyListForType: FSNFileListPboardType]];
+    }
+
+  if ((pbpaths == nil) && [types containsObject: NSFilenamesPboardType])
+    {
+      id plist = [pb propertyListForType: NSFilenamesPboardType];
+
+      if ([plist isKindOfClass: [NSArray class]])
+        {
+          pbpaths = [FSNPasteboardPaths pasteboardPathsWithPaths: plist];
+        }
+    }
+
+  ASSIGN (lastName, [pb name]);
+  ASSIGN (lastPaths, pbpaths);
+  lastChangeCount = changeCount;
+
+  return pbpaths;
+}
+
 /* --- Text Field Editing Error Messages */
 
 void showAlertNoPermission(Class c, NSString *name)
@@ -0,0 +1,53 @@
+/* FSNGridOccupancy.h
+ *
+ * Occupancy bitmap of a placement grid.
+ *
+ * One bit per grid cell, stored in the traversal order of a placement
+ * enumerator, so "the next free cell for a new icon" is the first clear
+ * bit: a word-at-a-time scan from a low-water mark instead of a walk
+ * over the cells, and marking or testing a cell is a single bit
+ * operation.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_GRID_OCCUPANCY_H
+#define FSN_GRID_OCCUPANCY_H
+
+#import <Foundation/Foundation.h>
+#import "FSNIconPlacement.h"
+
+@class FSNPlacementEnumerator;
+
+@interface FSNGridOccupancy : NSObject
+{
+  FSNPlacementEnumerator *_enumerator;
+  unsigned long long *_words;
+  NSUInteger _cellCount;
+  NSUInteger _occupiedCount;
+  NSUInteger _firstFree;        /* no free cell has a lower index */
+}
+
+/* The grid shape and the order of free-cell queries are the
+ * enumerator's; its own iteration state is left alone. */
+- (instancetype)initWithEnumerator:(FSNPlacementEnumerator *)enumerator;
+
+/* Cells outside the grid are never occupied. */
+- (BOOL)isCellOccupied:(FSNGridCell)cell;
+
+/* Returns NO for cells outside the grid. */
+- (BOOL)occupyCell:(FSNGridCell)cell;
+
+- (void)vacateCell:(FSNGridCell)cell;
+
+/* Marks and returns the first free cell in traversal order; NO when the
+ * grid is full. */
+- (BOOL)takeFreeCell:(FSNGridCell *)cellOut;
+
+- (NSUInteger)occupiedCount;
+
+- (void)removeAllCells;
+
+@end
+
+#endif /* FSN_GRID_OCCUPANCY_H */
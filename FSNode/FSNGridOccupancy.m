@@ -0,0 +1,141 @@
+/* FSNGridOccupancy.m
+ *
+ * Occupancy bitmap of a placement grid.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FSNGridOccupancy.h"
+#import "FSNPlacementEnumerator.h"
+
+#define WORD_BITS (sizeof(unsigned long long) * 8)
+
+@implementation FSNGridOccupancy
+
+- (void)dealloc
+{
+  free(_words);
+  RELEASE (_enumerator);
+
+  [super dealloc];
+}
+
+- (instancetype)initWithEnumerator:(FSNPlacementEnumerator *)enumerator
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (_enumerator, enumerator);
+      _cellCount = [enumerator totalCells];
+      _words = calloc((_cellCount + WORD_BITS - 1) / WORD_BITS + 1,
+                      sizeof(unsigned long long));
+      if (_words == NULL)
+        {
+          RELEASE (self);
+          return nil;
+        }
+      _occupiedCount = 0;
+      _firstFree = 0;
+    }
+
+  return self;
+}
+
+- (BOOL)isCellOccupied:(FSNGridCell)cell
+{
+  NSUInteger index = [_enumerator indexOfCell: cell];
+
+  if (index == NSNotFound)
+    return NO;
+
+  return (_words[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+- (BOOL)occupyCell:(FSNGridCell)cell
+{
+  NSUInteger index = [_enumerator indexOfCell: cell];
+  unsigned long long bit;
+
+  if (index == NSNotFound)
+    return NO;
+
+  bit = 1ULL << (index % WORD_BITS);
+
+  if ((_words[index / WORD_BITS] & bit) == 0)
+    {
+      _words[index / WORD_BITS] |= bit;
+      _occupiedCount++;
+    }
+
+  return YES;
+}
+
+- (void)vacateCell:(FSNGridCell)cell
+{
+  NSUInteger index = [_enumerator indexOfCell: cell];
+  unsigned long long bit;
+
+  if (index == NSNotFound)
+    return;
+
+  bit = 1ULL << (index % WORD_BITS);
+
+  if (_words[index / WORD_BITS] & bit)
+    {
+      _words[index / WORD_BITS] &= ~bit;
+      _occupiedCount--;
+      if (index < _firstFree)
+        _firstFree = index;
+    }
+}
+
+- (BOOL)takeFreeCell:(FSNGridCell *)cellOut
+{
+  NSUInteger nwords = (_cellCount + WORD_BITS - 1) / WORD_BITS;
+  NSUInteger w = _firstFree / WORD_BITS;
+  unsigned long long mask = ~0ULL << (_firstFree % WORD_BITS);
+
+  if (cellOut == NULL)
+    return NO;
+
+  for (; w < nwords; w++, mask = ~0ULL)
+    {
+      unsigned long long freebits = ~_words[w] & mask;
+
+      if (freebits)
+        {
+          NSUInteger index = w * WORD_BITS + __builtin_ctzll(freebits);
+
+          if (index >= _cellCount)
+            break;
+
+          _words[w] |= 1ULL << (index % WORD_BITS);
+          _occupiedCount++;
+          _firstFree = index + 1;
+          *cellOut = [_enumerator cellAtIndex: index];
+          return YES;
+        }
+    }
+
+  _firstFree = _cellCount;
+  return NO;
+}
+
+- (NSUInteger)occupiedCount
+{
+  return _occupiedCount;
+}
+
+- (void)removeAllCells
+{
+  memset(_words, 0, ((_cellCount + WORD_BITS - 1) / WORD_BITS + 1)
+                    * sizeof(unsigned long long));
+  _occupiedCount = 0;
+  _firstFree = 0;
+}
+
+@end
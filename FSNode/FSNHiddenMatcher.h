@@ -0,0 +1,84 @@
+/* FSNHiddenMatcher.h
+ *
+ * Which files are kept out of listings, decided in one place for the
+ * viewers, the desktop, the indexer and the search tools.
+ *
+ * A name is hidden when it is one of the metadata files macOS and
+ * archives leave behind (.DS_Store, __MACOSX, the ._ AppleDouble
+ * sidecars), matches one of the user's patterns, or starts with a dot
+ * while dot files are hidden.  A path is hidden when one of its names
+ * is, or when it is or lies inside one of the user's hidden paths.
+ *
+ * The rules are compiled when set: plain names and the hidden paths go
+ * into hash sets, a pattern that is a literal with a single leading or
+ * trailing star becomes a prefix, suffix or infix test, and only the
+ * others are left to fnmatch().  Checking a path costs one set lookup
+ * per component, however many paths are hidden.
+ *
+ * Every change bumps -version, so a cache of filtered listings can tell
+ * it is stale without being told.  Safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_HIDDEN_MATCHER_H
+#define FSN_HIDDEN_MATCHER_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNHiddenMatcher : NSObject
+{
+  NSLock *lock;
+  NSSet *names;            /* exact names, built in and the user's */
+  NSArray *globs;          /* compiled patterns, built in and the user's */
+  NSArray *patterns;       /* the user's patterns, as set */
+  NSArray *paths;          /* the user's hidden paths, as set */
+  NSSet *pathsSet;
+  BOOL hidesDotFiles;
+  unsigned long version;
+}
+
+/* The matcher of this process.  GWorkspace sets its rules from its
+ * preferences; a tool reads them with -updateFromGWorkspaceDefaults. */
++ (FSNHiddenMatcher *)sharedMatcher;
+
+/* The built-in metadata rules only. */
+- (id)init;
+
+- (void)setHiddenPaths:(NSArray *)hpaths;
+- (NSArray *)hiddenPaths;
+
+/* Names or shell patterns ("*.bak", "Thumbs.db"), matched against the
+ * last component of a path. */
+- (void)setHiddenPatterns:(NSArray *)hpatterns;
+- (NSArray *)hiddenPatterns;
+
+- (void)setHidesDotFiles:(BOOL)value;
+- (BOOL)hidesDotFiles;
+
+/* Take the rules from GWorkspace's preferences: "hiddendirs",
+ * "hiddenpatterns" and "GSFileBrowserHideDotFiles".  The version only
+ * changes when they did. */
+- (void)updateFromGWorkspaceDefaults;
+
+/* YES for the metadata files that are never shown whatever the
+ * preferences. */
+- (BOOL)isMetadataName:(NSString *)name;
+
+/* The name rules alone. */
+- (BOOL)isHiddenName:(NSString *)name;
+
+/* An entry of a listing of `dir`: the name rules, and `dir`/`name`
+ * itself among the hidden paths.  The directory is taken as shown. */
+- (BOOL)isHiddenName:(NSString *)name
+         inDirectory:(NSString *)dir;
+
+/* A path found by a walk: hidden when any of its components is, or it
+ * or one of its ancestors is a hidden path. */
+- (BOOL)isHiddenPath:(NSString *)path;
+
+- (unsigned long)version;
+
+@end
+
+#endif /* FSN_HIDDEN_MATCHER_H */
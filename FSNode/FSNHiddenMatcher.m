@@ -0,0 +1,382 @@
+/* FSNHiddenMatcher.m
+ *
+ * Which files are kept out of listings.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <fnmatch.h>
+
+#import "FSNHiddenMatcher.h"
+
+/* left by macOS and by archivers, never shown */
+#define METADATA_NAMES  @".DS_Store", @"__MACOSX"
+#define METADATA_PREFIX @"._"
+
+#define GWORKSPACE_DOMAIN @"GWorkspace"
+
+static FSNHiddenMatcher *sharedMatcher = nil;
+static NSSet *metadataNames = nil;
+
+typedef enum
+{
+  FSNGlobPrefix,     /* "foo*"  */
+  FSNGlobSuffix,     /* "*foo"  */
+  FSNGlobInfix,      /* "*foo*" */
+  FSNGlobGeneral     /* anything else, by fnmatch() */
+} FSNGlobKind;
+
+/* A shell pattern, compiled.  The literal kinds cost a string compare. */
+@interface FSNHiddenGlob : NSObject
+{
+  FSNGlobKind kind;
+  NSString *literal;
+  NSString *pattern;
+}
+- (id)initWithPattern:(NSString *)pat;
+- (BOOL)matchesName:(NSString *)name;
+@end
+
+@implementation FSNHiddenGlob
+
+- (void)dealloc
+{
+  RELEASE (literal);
+  RELEASE (pattern);
+  [super dealloc];
+}
+
+- (id)initWithPattern:(NSString *)pat
+{
+  self = [super init];
+
+  if (self)
+    {
+      NSCharacterSet *meta = [NSCharacterSet characterSetWithCharactersInString: @"*?[\\"];
+      NSUInteger len = [pat length];
+      BOOL lead = (len > 1) && ([pat characterAtIndex: 0] == '*');
+      BOOL trail = (len > 1) && ([pat characterAtIndex: len - 1] == '*');
+      NSRange inner = NSMakeRange(lead ? 1 : 0, len - (lead ? 1 : 0) - (trail ? 1 : 0));
+      NSString *lit = ((NSInteger)inner.length > 0) ? [pat substringWithRange: inner] : nil;
+
+      ASSIGN (pattern, pat);
+
+      if (lit && (lead || trail)
+          && [lit rangeOfCharacterFromSet: meta].location == NSNotFound)
+        {
+          ASSIGN (literal, lit);
+          kind = (lead && trail) ? FSNGlobInfix : (lead ? FSNGlobSuffix : FSNGlobPrefix);
+        }
+      else
+        {
+          kind = FSNGlobGeneral;
+        }
+    }
+
+  return self;
+}
+
+- (BOOL)matchesName:(NSString *)name
+{
+  switch (kind)
+    {
+    case FSNGlobPrefix:
+      return [name hasPrefix: literal];
+    case FSNGlobSuffix:
+      return [name hasSuffix: literal];
+    case FSNGlobInfix:
+      return ([name rangeOfString: literal].location != NSNotFound);
+    default:
+      return (fnmatch([pattern UTF8String], [name UTF8String], 0) == 0);
+    }
+}
+
+@end
+
+
+static BOOL
+isPattern(NSString *str)
+{
+  NSCharacterSet *meta = [NSCharacterSet characterSetWithCharactersInString: @"*?[\\"];
+
+  return ([str rangeOfCharacterFromSet: meta].location != NSNotFound);
+}
+
+
+@implementation FSNHiddenMatcher
+
++ (void)initialize
+{
+  if (metadataNames == nil)
+    metadataNames = [[NSSet alloc] initWithObjects: METADATA_NAMES, nil];
+}
+
++ (FSNHiddenMatcher *)sharedMatcher
+{
+  if (sharedMatcher == nil)
+    sharedMatcher = [FSNHiddenMatcher new];
+
+  return sharedMatcher;
+}
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (names);
+  RELEASE (globs);
+  RELEASE (patterns);
+  RELEASE (paths);
+  RELEASE (pathsSet);
+  [super dealloc];
+}
+
+/* Must be called with the lock held, or before the matcher is shared. */
+- (void)compilePatterns
+{
+  NSMutableSet *nset = [NSMutableSet set];
+  NSMutableArray *garr = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [patterns count]; i++)
+    {
+      NSString *pat = [patterns objectAtIndex: i];
+
+      if ([pat length] == 0)
+        continue;
+
+      if (isPattern(pat))
+        {
+          FSNHiddenGlob *glob = [[FSNHiddenGlob alloc] initWithPattern: pat];
+          [garr addObject: glob];
+          RELEASE (glob);
+        }
+      else
+        {
+          [nset addObject: pat];
+        }
+    }
+
+  RELEASE (names);
+  names = [nset copy];
+  RELEASE (globs);
+  globs = [garr copy];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      patterns = [NSArray new];
+      paths = [NSArray new];
+      pathsSet = [NSSet new];
+      hidesDotFiles = NO;
+      version = 0;
+      [self compilePatterns];
+    }
+
+  return self;
+}
+
+- (void)setHiddenPaths:(NSArray *)hpaths
+{
+  hpaths = (hpaths ? [NSArray arrayWithArray: hpaths] : [NSArray array]);
+
+  [lock lock];
+
+  if ([paths isEqual: hpaths] == NO)
+    {
+      ASSIGN (paths, hpaths);
+      ASSIGN (pathsSet, [NSSet setWithArray: hpaths]);
+      version++;
+    }
+
+  [lock unlock];
+}
+
+- (NSArray *)hiddenPaths
+{
+  NSArray *hpaths;
+
+  [lock lock];
+  hpaths = RETAIN (paths);
+  [lock unlock];
+
+  return AUTORELEASE (hpaths);
+}
+
+- (void)setHiddenPatterns:(NSArray *)hpatterns
+{
+  hpatterns = (hpatterns ? [NSArray arrayWithArray: hpatterns] : [NSArray array]);
+
+  [lock lock];
+
+  if ([patterns isEqual: hpatterns] == NO)
+    {
+      ASSIGN (patterns, hpatterns);
+      [self compilePatterns];
+      version++;
+    }
+
+  [lock unlock];
+}
+
+- (NSArray *)hiddenPatterns
+{
+  NSArray *hpatterns;
+
+  [lock lock];
+  hpatterns = RETAIN (patterns);
+  [lock unlock];
+
+  return AUTORELEASE (hpatterns);
+}
+
+- (void)setHidesDotFiles:(BOOL)value
+{
+  [lock lock];
+
+  if (hidesDotFiles != value)
+    {
+      hidesDotFiles = value;
+      version++;
+    }
+
+  [lock unlock];
+}
+
+- (BOOL)hidesDotFiles
+{
+  BOOL value;
+
+  [lock lock];
+  value = hidesDotFiles;
+  [lock unlock];
+
+  return value;
+}
+
+- (void)updateFromGWorkspaceDefaults
+{
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSDictionary *domain;
+  id entry;
+
+  [defaults synchronize];
+  domain = [defaults persistentDomainForName: GWORKSPACE_DOMAIN];
+
+  entry = [domain objectForKey: @"hiddendirs"];
+  [self setHiddenPaths: [entry isKindOfClass: [NSArray class]] ? entry : nil];
+
+  entry = [domain objectForKey: @"hiddenpatterns"];
+  [self setHiddenPatterns: [entry isKindOfClass: [NSArray class]] ? entry : nil];
+
+  /* GWorkspace's own, or the GNUstep-wide one in the global domain */
+  entry = [domain objectForKey: @"GSFileBrowserHideDotFiles"];
+  if ([entry respondsToSelector: @selector(boolValue)])
+    [self setHidesDotFiles: [entry boolValue]];
+  else
+    [self setHidesDotFiles: [defaults boolForKey: @"GSFileBrowserHideDotFiles"]];
+}
+
+static BOOL
+isMetadataName(NSString *name)
+{
+  return ([metadataNames containsObject: name] || [name hasPrefix: METADATA_PREFIX]);
+}
+
+/* Must be called with the lock held. */
+static BOOL
+nameIsHidden(FSNHiddenMatcher *self, NSString *name)
+{
+  NSUInteger i;
+
+  if ([name length] == 0)
+    return NO;
+
+  if (isMetadataName(name) || [self->names containsObject: name])
+    return YES;
+
+  if (self->hidesDotFiles && [name characterAtIndex: 0] == '.')
+    return YES;
+
+  for (i = 0; i < [self->globs count]; i++)
+    {
+      if ([[self->globs objectAtIndex: i] matchesName: name])
+        return YES;
+    }
+
+  return NO;
+}
+
+- (BOOL)isMetadataName:(NSString *)name
+{
+  return isMetadataName(name);
+}
+
+- (BOOL)isHiddenName:(NSString *)name
+{
+  BOOL hidden;
+
+  [lock lock];
+  hidden = nameIsHidden(self, name);
+  [lock unlock];
+
+  return hidden;
+}
+
+- (BOOL)isHiddenName:(NSString *)name
+         inDirectory:(NSString *)dir
+{
+  BOOL hidden;
+
+  [lock lock];
+
+  hidden = nameIsHidden(self, name);
+
+  if ((hidden == NO) && [pathsSet count])
+    hidden = [pathsSet containsObject: [dir stringByAppendingPathComponent: name]];
+
+  [lock unlock];
+
+  return hidden;
+}
+
+- (BOOL)isHiddenPath:(NSString *)path
+{
+  NSString *p = path;
+  BOOL hidden = NO;
+
+  [lock lock];
+
+  while ((hidden == NO) && ([p length] > 1))
+    {
+      NSString *parent = [p stringByDeletingLastPathComponent];
+
+      hidden = (nameIsHidden(self, [p lastPathComponent])
+                || [pathsSet containsObject: p]);
+
+      if ([parent isEqual: p])
+        break;
+      p = parent;
+    }
+
+  [lock unlock];
+
+  return hidden;
+}
+
+- (unsigned long)version
+{
+  unsigned long v;
+
+  [lock lock];
+  v = version;
+  [lock unlock];
+
+  return v;
+}
+
+@end
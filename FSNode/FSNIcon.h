@@ -62,6 +62,8 @@
   NSTrackingRectTag trectTag;
   
   FSNTextCell *label;
+  NSFont *lblFont;
+  NSColor *lblColor;
   NSRect labelRect;
   BOOL drawLabelBackground;
   NSColor *labelFrameColor;
@@ -102,6 +104,13 @@
   BOOL labelChecked;        // YES once metadata has been probed for a label
   NSString *spotlightComment;  // Spotlight comment from DS_Store (cmmt)
 
+  // The composed appearance, and what it was drawn from (see -drawRect:)
+  NSImage *composedImage;
+  NSArray *composedObjects;
+  NSRect composedRects[3];
+  NSPoint composedPoint;
+  unsigned composedFlags;
+
   // Pixel placement data
   FSNIconItemData *_placementData;
 }
@@ -110,6 +119,12 @@
 
 + (NSImage *)branchImage;
 
+/* Whether icons keep a bitmap of how they look, drawn again only when
+   the image, size, selection, label, tag or state it shows changes.  On
+   unless the FSNIconDrawCache default is NO. */
++ (void)setUsesDrawCache:(BOOL)flag;
++ (BOOL)usesDrawCache;
+
 - (id)initForNode:(FSNode *)anode
      nodeInfoType:(FSNInfoType)type
      extendedType:(NSString *)exttype
@@ -122,17 +137,52 @@
         acceptDnd:(BOOL)dndaccept
         slideBack:(BOOL)slback;
 
+/* With `load` NO the icon is made without its image and text cells, for
+ * a container that places it by frame and placement data and shows only
+ * some of its icons; -loadContents makes them before it is shown. */
+- (id)initForNode:(FSNode *)anode
+     nodeInfoType:(FSNInfoType)type
+     extendedType:(NSString *)exttype
+         iconSize:(int)isize
+     iconPosition:(NSUInteger)ipos
+        labelFont:(NSFont *)lfont
+        textColor:(NSColor *)tcolor
+        gridIndex:(NSUInteger)gindex
+        dndSource:(BOOL)dndsrc
+        acceptDnd:(BOOL)dndaccept
+        slideBack:(BOOL)slback
+     loadContents:(BOOL)load;
+
+/* The image and the name and info cells.  A virtualized FSNIconsView
+ * loads them for the icons it attaches and unloads them from those it
+ * detaches, so a large folder holds them only for what is on screen. */
+- (void)loadContents;
+- (void)unloadContents;
+- (BOOL)hasContents;
+
 - (void)setSelectable:(BOOL)value;
 
+/* The container is normally the superview.  A virtualized FSNIconsView
+ * keeps off-screen icons out of its subviews and sets their container
+ * explicitly so selection still reaches it. */
+- (void)setContainer:(NSView <FSNodeRepContainer> *)acontainer;
+
 - (void)setSuppressSelectionDrawing:(BOOL)flag;
 
 - (NSRect)iconBounds;
 
 - (void)tile;
 
+/* Sets the selected state without telling the container or asking for
+   display, for a container that changes many icons at once. */
+- (void)setSelected:(BOOL)flag;
+
 // DS_Store tag/label color support
 - (void)setTagColor:(NSColor *)color;
 - (NSColor *)tagColor;
+// Label read by the container from a folder metadata table: nil means
+// the file has none, so the icon does not probe the provider itself.
+- (void)setMetadataLabelColor:(NSColor *)color;
 - (void)setSpotlightComment:(NSString *)comment;
 - (NSString *)spotlightComment;
 
@@ -36,10 +36,14 @@
 #import "FSNMetadataProvider.h"
 #import "FSNIconPlacement.h"
 #import "FSNIconsView.h"
+#import "FSNPasteboardPaths.h"
+#import "FSNDiagnostics.h"
 
 /* Private extension for FSNIcon */
 @interface FSNIcon (Private)
 - (void)loadLabelColorFromMetadata;
+- (void)drawContents;
+- (void)releaseComposedImage;
 @end
 
 /* Forward declaration for batch repositioning called on container (FSNIconsView) */
@@ -73,12 +77,25 @@ static id <DesktopApplication> desktopApp = nil;
 
 static NSImage *branchImage;
 
+/* the composed bitmaps of all the icons together stay under this */
+#define DRAW_CACHE_MAX_BYTES (48 * 1024 * 1024)
+
+static BOOL usesDrawCache = YES;
+static NSUInteger drawCacheBytes = 0;
+
 @implementation FSNIcon
 
 @synthesize placementData = _placementData;
 
++ (id)allocWithZone:(NSZone *)zone
+{
+  FSNLiveCounterAdd(FSNLiveIcons, 1);
+  return [super allocWithZone: zone];
+}
+
 - (void)dealloc
 {
+  FSNLiveCounterAdd(FSNLiveIcons, -1);
   if (trectTag != -1)
     {
       [self removeTrackingRect: trectTag];
@@ -91,12 +108,19 @@ static NSImage *branchImage;
   RELEASE (icon);
   RELEASE (selectedicon);
   RELEASE (highlightPath);
+  if (label != nil)
+    {
+      FSNLiveCounterAdd(FSNLiveIconContents, -1);
+    }
   RELEASE (label);
   RELEASE (infolabel);
+  RELEASE (lblFont);
+  RELEASE (lblColor);
   RELEASE (labelFrameColor);
   RELEASE (tagColor);
   RELEASE (spotlightComment);
   RELEASE (_placementData);
+  [self releaseComposedImage];
   [super dealloc];
 }
 
@@ -121,6 +145,10 @@ static NSImage *branchImage;
         }
 
       branchImage = [NSBrowserCell branchImage];
+
+      if ([[NSUserDefaults standardUserDefaults] objectForKey: @"FSNIconDrawCache"])
+        usesDrawCache = [[NSUserDefaults standardUserDefaults] boolForKey: @"FSNIconDrawCache"];
+
       initialized = YES;
     }
 }
@@ -130,6 +158,16 @@ static NSImage *branchImage;
   return branchImage;
 }
 
++ (void)setUsesDrawCache:(BOOL)flag
+{
+  usesDrawCache = flag;
+}
+
++ (BOOL)usesDrawCache
+{
+  return usesDrawCache;
+}
+
 /* we try to find a good host name.
  * We try to find something different from localhost, if possibile without dots,
  * else the first part of the qualified hostname gets taken */
@@ -204,13 +242,38 @@ static NSImage *branchImage;
         dndSource:(BOOL)dndsrc
         acceptDnd:(BOOL)dndaccept
         slideBack:(BOOL)slback
+{
+  return [self initForNode: anode
+              nodeInfoType: type
+              extendedType: exttype
+                  iconSize: isize
+              iconPosition: ipos
+                 labelFont: lfont
+                 textColor: tcolor
+                 gridIndex: gindex
+                 dndSource: dndsrc
+                 acceptDnd: dndaccept
+                 slideBack: slback
+              loadContents: YES];
+}
+
+- (id)initForNode:(FSNode *)anode
+     nodeInfoType:(FSNInfoType)type
+     extendedType:(NSString *)exttype
+         iconSize:(int)isize
+     iconPosition:(NSUInteger)ipos
+        labelFont:(NSFont *)lfont
+        textColor:(NSColor *)tcolor
+        gridIndex:(NSUInteger)gindex
+        dndSource:(BOOL)dndsrc
+        acceptDnd:(BOOL)dndaccept
+        slideBack:(BOOL)slback
+     loadContents:(BOOL)load
 {
   self = [super init];
 
   if (self)
     {
-      NSFontManager *fmanager = [NSFontManager sharedFontManager];
-      NSFont *infoFont;
       NSRect r = NSZeroRect;
       NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
 
@@ -225,18 +288,18 @@ static NSImage *branchImage;
       selection = nil;
       selectionTitle = nil;
 
-      ASSIGN (icon, [fsnodeRep iconOfSize: iconSize forNode: node]);
-      drawicon = icon;
+      icon = nil;
+      drawicon = nil;
       selectedicon = nil;
 
       /* Initialize placement data */
       _placementData = [[FSNIconItemData alloc] init];
       [_placementData setFilename: [anode name]];
 
-      /* Load Finder label color eagerly from the metadata provider */
-      ASSIGN (tagColor,
-              [[[FSNodeRep sharedInstance] metadataProvider]
-                labelColorForPath: [anode path]]);
+      /* The Finder label color is loaded on first draw (see
+         -loadLabelColorFromMetadata), so icons that are never shown
+         never query the metadata provider. */
+      tagColor = nil;
 
       dndSource = dndsrc;
       acceptDnd = dndaccept;
@@ -259,53 +322,37 @@ static NSImage *branchImage;
 	  ASSIGN (hostname, hname);
 	}
 
-      label = [FSNTextCell new];
-      [label setFont: lfont];
-      [label setTextColor: tcolor];
-
-      infoFont = [fmanager convertFont: lfont
-				toSize: ([lfont pointSize] - 2)];
-      infoFont = [fmanager convertFont: infoFont
-			   toHaveTrait: NSItalicFontMask];
-
-      infolabel = [FSNTextCell new];
-      [infolabel setFont: infoFont];
-      [infolabel setTextColor: tcolor];
+      ASSIGN (lblFont, lfont);
+      ASSIGN (lblColor, tcolor);
 
       if (exttype)
 	{
-	  [self setExtendedShowType: exttype];
+	  ASSIGN (extInfoType, exttype);
+	  showType = FSNInfoExtendedType;
 	}
       else
 	{
-	  [self setNodeInfoShowType: type];
+	  showType = type;
 	}
 
       labelRect = NSZeroRect;
-      labelRect.size.width = [label uncutTitleLenght] + [fsnodeRep labelMargin];
-      labelRect.size.height = [fsnodeRep heightOfFont: [label font]];
+      labelRect.size.height = [fsnodeRep heightOfFont: lfont];
       labelRect = NSIntegralRect(labelRect);
-
       infoRect = NSZeroRect;
-      if ((showType != FSNInfoNameType) && [[infolabel stringValue] length])
-	{
-	  infoRect.size.width = [infolabel uncutTitleLenght] + [fsnodeRep labelMargin];
-	}
-      else
-	{
-	  infoRect.size.width = labelRect.size.width;
-	}
-      infoRect.size.height = [fsnodeRep heightOfFont: [infolabel font]];
-      infoRect = NSIntegralRect(infoRect);
 
       icnPosition = ipos;
       gridIndex = gindex;
 
-      if (icnPosition == NSImageLeft)
+      isLocked = [node isLocked];
+      container = nil;
+
+      if (load)
 	{
-	  [label setAlignment: NSLeftTextAlignment];
-	  [infolabel setAlignment: NSLeftTextAlignment];
+	  [self loadContents];
+	}
 
+      if (icnPosition == NSImageLeft)
+	{
 	  r.size.width = hlightRect.size.width + labelRect.size.width;
 	  r.size.height = hlightRect.size.height;
 
@@ -322,9 +369,6 @@ static NSImage *branchImage;
 	}
       else if (icnPosition == NSImageAbove)
 	{
-	  [label setAlignment: NSCenterTextAlignment];
-	  [infolabel setAlignment: NSCenterTextAlignment];
-
 	  if (labelRect.size.width > hlightRect.size.width)
 	    {
 	      r.size.width = labelRect.size.width;
@@ -366,10 +410,6 @@ static NSImage *branchImage;
 	  [self registerForDraggedTypes: pbTypes];
 	}
 
-      isLocked = [node isLocked];
-
-      container = nil;
-
       isSelected = NO;
       isOpened = NO;
       nameEdited = NO;
@@ -393,6 +433,113 @@ static NSImage *branchImage;
   return self;
 }
 
+- (void)loadContents
+{
+  NSFontManager *fmanager;
+  NSFont *infoFont;
+  NSColor *tcolor;
+  int lblmargin;
+
+  if (label != nil)
+    {
+      return;
+    }
+
+  fmanager = [NSFontManager sharedFontManager];
+  lblmargin = [fsnodeRep labelMargin];
+
+  if (selection == nil)
+    {
+      ASSIGN (icon, [fsnodeRep iconOfSize: iconSize forNode: node]);
+    }
+  else
+    {
+      ASSIGN (icon, [fsnodeRep multipleSelectionIconOfSize: iconSize]);
+    }
+  drawicon = icon;
+  DESTROY (selectedicon);
+
+  tcolor = lblColor;
+  if (isLocked && container)
+    {
+      tcolor = [container disabledTextColor];
+    }
+
+  label = [FSNTextCell new];
+  [label setFont: lblFont];
+  [label setTextColor: tcolor];
+
+  infoFont = [fmanager convertFont: lblFont
+                            toSize: ([lblFont pointSize] - 2)];
+  infoFont = [fmanager convertFont: infoFont
+                       toHaveTrait: NSItalicFontMask];
+
+  infolabel = [FSNTextCell new];
+  [infolabel setFont: infoFont];
+  [infolabel setTextColor: tcolor];
+
+  FSNLiveCounterAdd(FSNLiveIconContents, 1);
+
+  if (icnPosition == NSImageLeft)
+    {
+      [label setAlignment: NSLeftTextAlignment];
+      [infolabel setAlignment: NSLeftTextAlignment];
+    }
+  else if (icnPosition == NSImageAbove)
+    {
+      [label setAlignment: NSCenterTextAlignment];
+      [infolabel setAlignment: NSCenterTextAlignment];
+    }
+
+  if (extInfoType)
+    {
+      [self setExtendedShowType: extInfoType];
+    }
+  else
+    {
+      [self setNodeInfoShowType: showType];
+    }
+
+  labelRect.size.width = [label uncutTitleLenght] + lblmargin;
+  labelRect.size.height = [fsnodeRep heightOfFont: lblFont];
+  labelRect = NSIntegralRect(labelRect);
+
+  if ((showType != FSNInfoNameType) && [[infolabel stringValue] length])
+    {
+      infoRect.size.width = [infolabel uncutTitleLenght] + lblmargin;
+    }
+  else
+    {
+      infoRect.size.width = labelRect.size.width;
+    }
+  infoRect.size.height = [fsnodeRep heightOfFont: infoFont];
+  infoRect = NSIntegralRect(infoRect);
+}
+
+/* Not while the name is edited or something is dragged over it: both
+   need the cells and the image. */
+- (void)unloadContents
+{
+  if ((label == nil) || nameEdited || isDragTarget)
+    {
+      return;
+    }
+
+  DESTROY (icon);
+  drawicon = nil;
+  DESTROY (selectedicon);
+  DESTROY (label);
+  DESTROY (infolabel);
+  [self releaseComposedImage];
+
+  FSNLiveCounterAdd(FSNLiveIconContents, -1);
+}
+
+- (BOOL)hasContents
+{
+  return (label != nil);
+}
+
 - (void)setSelectable:(BOOL)value
 {
   if ((icnPosition == NSImageOnly) && (selectable != value))
@@ -667,8 +814,17 @@ static NSImage *branchImage;
   [self setNeedsDisplay: YES];
 }
 
+- (void)setMetadataLabelColor:(NSColor *)color
+{
+  labelChecked = YES;
+  if (color != nil && tagColor == nil)
+    [self setTagColor: color];
+}
+
 - (NSColor *)tagColor
 {
+  if (tagColor == nil)
+    [self loadLabelColorFromMetadata];
   return tagColor;
 }
 
@@ -741,7 +897,16 @@ static NSImage *branchImage;
 - (void)viewDidMoveToSuperview
 {
   [super viewDidMoveToSuperview];
-  container = (NSView <FSNodeRepContainer> *)[self superview];
+
+  /* A virtualized FSNIconsView detaches off-screen icons but
+     remains their container (see -setContainer:). */
+  if ([self superview] != nil)
+    container = (NSView <FSNodeRepContainer> *)[self superview];
+}
+
+- (void)setContainer:(NSView <FSNodeRepContainer> *)acontainer
+{
+  container = acontainer;
 }
 
 - (void)mouseUp:(NSEvent *)theEvent
@@ -961,6 +1126,9 @@ static NSImage *branchImage;
 {
   [super setFrame: frameRect];
   [self tile];
+
+  if ([container respondsToSelector: @selector(invalidateSpatialIndex)])
+    [(FSNIconsView *)container invalidateSpatialIndex];
 }
 
 - (void)resizeWithOldSuperviewSize:(NSSize)oldBoundsSize
@@ -968,7 +1136,7 @@ static NSImage *branchImage;
   [self tile];
 }
 
-- (void)drawRect:(NSRect)rect
+- (void)drawContents
 {
   if (isSelected && !suppressSelectionDrawing)
     {
@@ -1026,10 +1194,6 @@ static NSImage *branchImage;
 
   // Draw tag color indicator (from DS_Store lclr or FinderInfo fdFlags)
   // Drawn last so it's always on top of everything, including the branch image.
-  // Lazily check the metadata provider if no colour has been set yet.
-  if (tagColor == nil)
-    [self loadLabelColorFromMetadata];
-
   if (tagColor)
     {
       // Draw a small colored dot in the bottom-right corner of the icon
@@ -1043,6 +1207,111 @@ static NSImage *branchImage;
 }
 
 
+- (void)releaseComposedImage
+{
+  if (composedImage)
+    {
+      NSSize size = [composedImage size];
+
+      drawCacheBytes -= (NSUInteger)(size.width * size.height * 4);
+      DESTROY (composedImage);
+    }
+  DESTROY (composedObjects);
+}
+
+/* What the icon is drawn from, to tell whether the composed bitmap
+   still shows it. */
+- (NSArray *)composedObjects
+{
+  id null = [NSNull null];
+  id bg = (isSelected && !suppressSelectionDrawing) ? [NSColor selectedControlColor]
+                                                    : [container backgroundColor];
+
+  return [NSArray arrayWithObjects:
+                    (drawicon ? (id)drawicon : null),
+                    ([label stringValue] ? (id)[label stringValue] : null),
+                    ([label textColor] ? (id)[label textColor] : null),
+                    ([label font] ? (id)[label font] : null),
+                    ([infolabel stringValue] ? (id)[infolabel stringValue] : null),
+                    (tagColor ? (id)tagColor : null),
+                    (labelFrameColor ? (id)labelFrameColor : null),
+                    (bg ? bg : null),
+                    nil];
+}
+
+- (unsigned)composedFlags
+{
+  return (isSelected ? 1 : 0) | (suppressSelectionDrawing ? 2 : 0)
+           | (isOpened ? 4 : 0) | (isLocked ? 8 : 0) | (isLeaf ? 16 : 0)
+           | (drawLabelBackground ? 32 : 0) | ((unsigned)icnPosition << 8)
+           | ((unsigned)showType << 16);
+}
+
+- (void)drawRect:(NSRect)rect
+{
+  NSRect bounds = [self bounds];
+  NSArray *objects;
+  unsigned flags;
+
+  if (label == nil)
+    [self loadContents];
+
+  // Lazily check the metadata provider if no colour has been set yet.
+  if (tagColor == nil)
+    [self loadLabelColorFromMetadata];
+
+  /* the field editor is over the label while it is edited */
+  if ((usesDrawCache == NO) || nameEdited
+      || (NSEqualPoints(bounds.origin, NSZeroPoint) == NO)
+      || ([[NSGraphicsContext currentContext] isDrawingToScreen] == NO))
+    {
+      [self releaseComposedImage];
+      [self drawContents];
+      return;
+    }
+
+  objects = [self composedObjects];
+  flags = [self composedFlags];
+
+  if ((composedImage == nil)
+      || (flags != composedFlags)
+      || (NSEqualSizes(bounds.size, [composedImage size]) == NO)
+      || (NSEqualRects(labelRect, composedRects[0]) == NO)
+      || (NSEqualRects(infoRect, composedRects[1]) == NO)
+      || (NSEqualRects(brImgBounds, composedRects[2]) == NO)
+      || (NSEqualPoints(icnPoint, composedPoint) == NO)
+      || ([objects isEqual: composedObjects] == NO))
+    {
+      NSUInteger bytes = (NSUInteger)(bounds.size.width * bounds.size.height * 4);
+
+      [self releaseComposedImage];
+
+      if ((bytes == 0) || ((drawCacheBytes + bytes) > DRAW_CACHE_MAX_BYTES))
+        {
+          [self drawContents];
+          return;
+        }
+
+      composedImage = [[NSImage alloc] initWithSize: bounds.size];
+      [composedImage lockFocus];
+      [self drawContents];
+      [composedImage unlockFocus];
+      drawCacheBytes += bytes;
+
+      ASSIGN (composedObjects, objects);
+      composedRects[0] = labelRect;
+      composedRects[1] = infoRect;
+      composedRects[2] = brImgBounds;
+      composedPoint = icnPoint;
+      composedFlags = flags;
+    }
+
+  [composedImage drawInRect: rect
+                    fromRect: rect
+                   operation: NSCompositeSourceOver
+                    fraction: 1.0];
+}
+
 //
 // FSNodeRep protocol
 //
@@ -1055,9 +1324,12 @@ static NSImage *branchImage;
   labelChecked = NO;    // New node — probe its label again on next draw
 
   ASSIGN (node, anode);
-  ASSIGN (icon, [fsnodeRep iconOfSize: iconSize forNode: node]);
-  drawicon = icon;
-  DESTROY (selectedicon);
+  if (label != nil)
+    {
+      ASSIGN (icon, [fsnodeRep iconOfSize: iconSize forNode: node]);
+      drawicon = icon;
+      DESTROY (selectedicon);
+    }
 
   if ([[node path] isEqual: path_separator()] && ([node isMountPoint] == NO))
     {
@@ -1109,9 +1381,12 @@ static NSImage *branchImage;
   ASSIGN (selection, selnodes);
   ASSIGN (selectionTitle, ([NSString stringWithFormat: @"%lu %@",
                                      (unsigned long)[selection count], NSLocalizedString(@"elements", @"")]));
-  ASSIGN (icon, [fsnodeRep multipleSelectionIconOfSize: iconSize]);
-  drawicon = icon;
-  DESTROY (selectedicon);
+  if (label != nil)
+    {
+      ASSIGN (icon, [fsnodeRep multipleSelectionIconOfSize: iconSize]);
+      drawicon = icon;
+      DESTROY (selectedicon);
+    }
 
   [label setStringValue: selectionTitle];
   [infolabel setStringValue: @""];
@@ -1163,6 +1438,7 @@ static NSImage *branchImage;
   int lblmargin = [fsnodeRep labelMargin];
   NSFont *infoFont;
 
+  ASSIGN (lblFont, fontObj);
   [label setFont: fontObj];
 
   infoFont = [fmanager convertFont: fontObj
@@ -1193,25 +1469,30 @@ static NSImage *branchImage;
 
 - (NSFont *)labelFont
 {
-  return [label font];
+  return lblFont;
 }
 
 - (void)setLabelTextColor:(NSColor *)acolor
 {
+  ASSIGN (lblColor, acolor);
   [label setTextColor: acolor];
   [infolabel setTextColor: acolor];
 }
 
 - (NSColor *)labelTextColor
 {
-  return [label textColor];
+  return (label != nil) ? [label textColor] : lblColor;
 }
 
 - (void)setIconSize:(int)isize
 {
   iconSize = isize;
   icnBounds = NSMakeRect(0, 0, iconSize, iconSize);
-  if (selection == nil)
+  if (label == nil)
+    {
+      /* made at the new size when loaded */
+    }
+  else if (selection == nil)
     {
       ASSIGN (icon, [fsnodeRep iconOfSize: iconSize forNode: node]);
     }
@@ -1228,7 +1509,7 @@ static NSImage *branchImage;
   ASSIGN (highlightPath, [fsnodeRep highlightPathOfSize: hlightRect.size]);
 
   labelRect.size.width = [label uncutTitleLenght] + [fsnodeRep labelMargin];
-  labelRect.size.height = [fsnodeRep heightOfFont: [label font]];
+  labelRect.size.height = [fsnodeRep heightOfFont: lblFont];
 
   [self tile];
 }
@@ -1271,6 +1552,11 @@ static NSImage *branchImage;
   showType = type;
   DESTROY (extInfoType);
 
+  if (label == nil)
+    {
+      return;
+    }
+
   if (selection)
     {
       [label setStringValue: selectionTitle];
@@ -1304,12 +1590,12 @@ static NSImage *branchImage;
 
 - (BOOL)setExtendedShowType:(NSString *)type
 {
+  /* -setNodeInfoShowType: drops extInfoType, which may be `type` */
+  type = AUTORELEASE (RETAIN (type));
+  [self setNodeInfoShowType: FSNInfoExtendedType];
   ASSIGN (extInfoType, type);
-  showType = FSNInfoExtendedType;
 
-  [self setNodeInfoShowType: showType];
-
-  if (selection == nil)
+  if ((selection == nil) && (infolabel != nil))
     {
       NSDictionary *info = [fsnodeRep extendedInfoOfType: type forNode: node];
 
@@ -1330,6 +1616,12 @@ static NSImage *branchImage;
 
 - (NSString *)shownInfo
 {
+  if (label == nil)
+    {
+      if (selection)
+        return selectionTitle;
+      return (hostname ? hostname : [node displayName]);
+    }
   return [label stringValue];
 }
 
@@ -1364,6 +1656,10 @@ static NSImage *branchImage;
     }
   isSelected = YES;
 
+  if ([container respondsToSelector: @selector(repDidChangeSelection:)])
+    {
+      [container repDidChangeSelection: self];
+    }
   if ([container respondsToSelector: @selector(unselectOtherReps:)])
     {
       [container unselectOtherReps: self];
@@ -1382,9 +1678,18 @@ static NSImage *branchImage;
     return;
   }
 	isSelected = NO;
+  if ([container respondsToSelector: @selector(repDidChangeSelection:)])
+    {
+      [container repDidChangeSelection: self];
+    }
   [self setNeedsDisplay: YES];
 }
 
+- (void)setSelected:(BOOL)flag
+{
+  isSelected = flag;
+}
+
 - (BOOL)isSelected
 {
   return isSelected;
@@ -1683,10 +1988,7 @@ static NSImage *branchImage;
       NSArray *selectedPaths = [container selectedPaths];
       NSPasteboard *pb = [NSPasteboard pasteboardWithName: NSDragPboard];
 
-      [pb declareTypes: [NSArray arrayWithObject: NSFilenamesPboardType]
-		 owner: nil];
-
-      if ([pb setPropertyList: selectedPaths forType: NSFilenamesPboardType])
+      if (FSNWritePathsToPasteboard(selectedPaths, pb))
 	{
 	  NSImage *dragIcon;
 
@@ -1779,9 +2081,9 @@ static NSImage *branchImage;
   NSPasteboard *pb;
   NSDragOperation sourceDragMask;
   NSArray *sourcePaths;
+  FSNPasteboardPaths *pbpaths = nil;
   NSString *fromPath;
   NSString *nodePath;
-  NSString *prePath;
   NSUInteger i, count;
 
   isDragTarget = NO;
@@ -1792,7 +2094,8 @@ static NSImage *branchImage;
 
   if ([[pb types] containsObject: NSFilenamesPboardType])
     {
-      sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
+      pbpaths = FSNPathsOnPasteboard(pb);
+      sourcePaths = [pbpaths paths];
     }
   
   /* Check for ISO drop onto mount point BEFORE general writability checks */
@@ -1863,7 +2166,8 @@ static NSImage *branchImage;
 
   if (sourcePaths == nil && [[pb types] containsObject: NSFilenamesPboardType])
     {
-      sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
+      pbpaths = FSNPathsOnPasteboard(pb);
+      sourcePaths = [pbpaths paths];
     }
   else if ([[pb types] containsObject: @"GWRemoteFilenamesPboardType"])
     {
@@ -1892,6 +2196,11 @@ static NSImage *branchImage;
     return NSDragOperationNone;
     }
 
+  if (pbpaths == nil)
+    {
+      pbpaths = [FSNPasteboardPaths pasteboardPathsWithPaths: sourcePaths];
+    }
+
   count = [sourcePaths count];
   if (count == 0)
     {
@@ -1930,44 +2239,19 @@ static NSImage *branchImage;
       return NSDragOperationNone;
     }
 
-  if ([sourcePaths containsObject: nodePath])
+  /* the node is one of the files dragged, or in a folder of them */
+  if ([pbpaths containsPathOrAncestorOfPath: nodePath])
     {
       NSDebugLLog(@"gwspace", @"FSNIcon: Drag rejected - would create circular reference [node=%@]", [node path]);
       return NSDragOperationNone;
     }
 
-  prePath = [NSString stringWithString: nodePath];
 
-  while (![prePath isEqual: path_separator()])
+  /* a sample only, the file operation checks each name */
+  if ([node isDirectory] && [node isParentOfPath: fromPath]
+      && [pbpaths sampleMeetsFolderInDirectory: nodePath])
     {
-      if ([sourcePaths containsObject: prePath])
-        return NSDragOperationNone;
-      prePath = [prePath stringByDeletingLastPathComponent];
-    }
-
-
-  if ([node isDirectory] && [node isParentOfPath: fromPath])
-    {
-      NSArray *subNodes = [node subNodes];
-
-      for (i = 0; i < [subNodes count]; i++)
-	{
-	  FSNode *nd = [subNodes objectAtIndex: i];
-
-	  if ([nd isDirectory])
-	    {
-	      NSUInteger j;
-
-	      for (j = 0; j < count; j++) {
-		NSString *fname = [[sourcePaths objectAtIndex: j] lastPathComponent];
-
-		if ([[nd name] isEqual: fname])
-		  {
-		    return NSDragOperationNone;
-		  }
-	      }
-	    }
-	}
+      return NSDragOperationNone;
     }
 
   if ([node isApplication])
@@ -1975,10 +2259,12 @@ static NSImage *branchImage;
       if (([container respondsToSelector: @selector(baseNode)] == NO)
 	  || ([node isEqual: [container baseNode]] == NO))
 	{
-	  for (i = 0; i < count; i++)
+	  NSArray *sample = [pbpaths samplePaths: FSN_PASTEBOARD_SAMPLE];
+
+	  for (i = 0; i < [sample count]; i++)
 	    {
 	      CREATE_AUTORELEASE_POOL(arp);
-	      FSNode *nd = [FSNode nodeWithPath: [sourcePaths objectAtIndex: i]];
+	      FSNode *nd = [FSNode nodeWithPath: [sample objectAtIndex: i]];
 
 	      if (([nd isPlain] == NO) && ([nd isPackage] == NO))
 		{
@@ -2146,6 +2432,7 @@ static NSImage *branchImage;
 - (void)concludeDragOperation:(id <NSDraggingInfo>)sender
 {
   NSPasteboard *pb;
+  FSNPasteboardPaths *pbpaths;
   NSArray *sourcePaths;
   NSString *operation;
   NSString *source;
@@ -2195,7 +2482,8 @@ static NSImage *branchImage;
 	}
     }
 
-  sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
+  pbpaths = FSNPathsOnPasteboard(pb);
+  sourcePaths = [pbpaths paths];
 
   /* Check for ISO file drop onto physical device mount point */
   if ([sourcePaths count] == 1 && [node isMountPoint])
@@ -2218,7 +2506,11 @@ static NSImage *branchImage;
 
   if (([node isApplication] == NO) || onApplication)
     {
-      source = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+      source = [pbpaths source];
+      if (source == nil)
+	{
+	  source = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+	}
       trashPath = [desktopApp trashPath];
 
       if ([source isEqual: trashPath])
@@ -2244,10 +2536,17 @@ static NSImage *branchImage;
 	    }
 	}
 
-      files = [NSMutableArray arrayWithCapacity: 1];
-      for(i = 0; i < [sourcePaths count]; i++)
+      if ([pbpaths names])
 	{
-	  [files addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+	  files = [NSMutableArray arrayWithArray: [pbpaths names]];
+	}
+      else
+	{
+	  files = [NSMutableArray arrayWithCapacity: [sourcePaths count]];
+	  for(i = 0; i < [sourcePaths count]; i++)
+	    {
+	      [files addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+	    }
 	}
 
       opDict = [NSMutableDictionary dictionaryWithCapacity: 4];
@@ -0,0 +1,51 @@
+/* FSNIconAtlas.h
+ *
+ * Persistent icon atlas for FSNodeRep.
+ *
+ * At quit FSNodeRep writes the resized icons of its cache, as raw RGBA
+ * bitmaps, to one file per theme in the user cache directory.  At the
+ * next start the file is memory-mapped and the bitmaps go straight back
+ * into the icon cache, so the desktop, Dock and viewers do not decode and
+ * rescale the same theme icons again.
+ *
+ * An atlas is only used for the theme it was written for.  Entries keyed
+ * by a path also record the path's modification time and are dropped when
+ * it has changed.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_ICON_ATLAS_H
+#define FSN_ICON_ATLAS_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNIconAtlas : NSObject
+{
+  NSString *path;
+  NSString *theme;
+  NSData *mapped;
+}
+
+/* <user cache dir>/Workspace/IconAtlas-<theme>.atlas */
++ (NSString *)atlasPathForTheme:(NSString *)atheme;
+
+/* Writes the { key -> { size -> NSImage } } dictionary `icons`.  Images
+ * without an 8 bit RGBA bitmap representation are skipped.  The file is
+ * replaced atomically, so a running process can keep reading the old one. */
++ (BOOL)writeIcons:(NSDictionary *)icons
+          forTheme:(NSString *)atheme
+            toFile:(NSString *)apath;
+
+/* Maps `apath`.  Returns nil when the file is missing, has another format
+ * version or was written for another theme. */
+- (id)initWithContentsOfFile:(NSString *)apath
+                       theme:(NSString *)atheme;
+
+/* The still valid entries as { key -> { size -> NSImage } }.  The pixels
+ * are copied out of the mapping, so the images outlive the atlas. */
+- (NSDictionary *)icons;
+
+@end
+
+#endif /* FSN_ICON_ATLAS_H */
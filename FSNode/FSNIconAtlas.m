@@ -0,0 +1,355 @@
+/* FSNIconAtlas.m
+ *
+ * Persistent icon atlas for FSNodeRep.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdint.h>
+
+#import <AppKit/AppKit.h>
+#import "FSNIconAtlas.h"
+#import "FSNDirectorySnapshot.h"
+
+#define ATLAS_MAGIC "FSNICNA1"
+#define ATLAS_VERSION (1)
+
+/* Header: magic[8], uint32 version, uint32 theme length, theme bytes.
+ * Then entries: FSNAtlasEntry, key bytes, RGBA pixels (width * height *
+ * 4, rows bottom to top as NSBitmapImageRep keeps them).  Every part
+ * starts on an 8 byte boundary.  Native byte order: the atlas is a
+ * per-user cache, never shared between machines. */
+typedef struct FSNAtlasEntry {
+  uint32_t keylen;
+  uint32_t size;
+  uint32_t width;
+  uint32_t height;
+  double mtime;
+} FSNAtlasEntry;
+
+#define PAD8(n) (((n) + 7) & ~((NSUInteger)7))
+
+static void
+appendPadded(NSMutableData *data, const void *bytes, NSUInteger len)
+{
+  static const char zeros[8] = { 0 };
+
+  [data appendBytes: bytes length: len];
+  if (PAD8(len) != len)
+    [data appendBytes: zeros length: PAD8(len) - len];
+}
+
+/* The file an entry's icon was made from, if its key names one.  Custom
+ * icons come from Finder metadata, which has no usable mtime; they are
+ * not persisted. */
+static NSString *
+sourcePathForKey(NSString *key)
+{
+  if ([key hasSuffix: @".customicon"])
+    return nil;
+  if ([key hasSuffix: @"_linked"])
+    key = [key substringToIndex: [key length] - [@"_linked" length]];
+
+  return [key isAbsolutePath] ? key : @"";
+}
+
+static double
+sourceMTime(NSString *spath)
+{
+  FSNStatInfo info;
+
+  if ([spath length] == 0)
+    return 0;
+  if (FSNStatInfoForPathTraversingLink(spath, &info) == NO)
+    return -1;
+  return info.modificationTime;
+}
+
+static NSBitmapImageRep *
+rgbaRepOfImage(NSImage *image)
+{
+  NSEnumerator *e = [[image representations] objectEnumerator];
+  NSImageRep *rep;
+
+  while ((rep = [e nextObject]) != nil)
+    {
+      if ([rep isKindOfClass: [NSBitmapImageRep class]])
+        {
+          NSBitmapImageRep *brep = (NSBitmapImageRep *)rep;
+
+          if ([brep bitsPerSample] == 8 && [brep samplesPerPixel] == 4
+              && [brep hasAlpha] && ([brep isPlanar] == NO)
+              && [brep bitsPerPixel] == 32)
+            return brep;
+        }
+    }
+
+  return nil;
+}
+
+
+@implementation FSNIconAtlas
+
++ (NSString *)atlasPathForTheme:(NSString *)atheme
+{
+  NSString *cacheDir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+                                                             NSUserDomainMask, YES) lastObject];
+  NSString *name = [NSString stringWithFormat: @"IconAtlas-%@.atlas",
+                             [atheme length] ? atheme : @"GNUstep"];
+
+  cacheDir = [cacheDir stringByAppendingPathComponent: @"Workspace"];
+
+  return [cacheDir stringByAppendingPathComponent: name];
+}
+
++ (BOOL)writeIcons:(NSDictionary *)icons
+          forTheme:(NSString *)atheme
+            toFile:(NSString *)apath
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSMutableData *data = [NSMutableData dataWithCapacity: 1024 * 1024];
+  NSData *themeData = [atheme dataUsingEncoding: NSUTF8StringEncoding];
+  NSEnumerator *ke = [icons keyEnumerator];
+  uint32_t u32;
+  NSString *key;
+  BOOL isdir;
+  BOOL done;
+
+  [data appendBytes: ATLAS_MAGIC length: 8];
+  u32 = ATLAS_VERSION;
+  [data appendBytes: &u32 length: sizeof(u32)];
+  u32 = (uint32_t)[themeData length];
+  [data appendBytes: &u32 length: sizeof(u32)];
+  appendPadded(data, [themeData bytes], [themeData length]);
+
+  while ((key = [ke nextObject]) != nil)
+    {
+      NSString *spath = sourcePathForKey(key);
+      NSDictionary *sizes = [icons objectForKey: key];
+      NSData *keyData = [key dataUsingEncoding: NSUTF8StringEncoding];
+      NSEnumerator *se;
+      NSNumber *size;
+      double mtime;
+
+      if (spath == nil)
+        continue;
+      mtime = sourceMTime(spath);
+      if (mtime < 0)
+        continue;
+
+      se = [sizes keyEnumerator];
+
+      while ((size = [se nextObject]) != nil)
+        {
+          NSBitmapImageRep *rep = rgbaRepOfImage([sizes objectForKey: size]);
+          FSNAtlasEntry entry;
+          unsigned char *pixels;
+          NSInteger bpr;
+          NSUInteger row;
+
+          if (rep == nil)
+            continue;
+
+          entry.keylen = (uint32_t)[keyData length];
+          entry.size = (uint32_t)[size intValue];
+          entry.width = (uint32_t)[rep pixelsWide];
+          entry.height = (uint32_t)[rep pixelsHigh];
+          entry.mtime = mtime;
+
+          pixels = [rep bitmapData];
+          bpr = [rep bytesPerRow];
+          if (pixels == NULL || entry.width == 0 || entry.height == 0)
+            continue;
+
+          appendPadded(data, &entry, sizeof(entry));
+          appendPadded(data, [keyData bytes], [keyData length]);
+
+          /* rows are stored tightly packed */
+          for (row = 0; row < entry.height; row++)
+            [data appendBytes: pixels + row * bpr length: entry.width * 4];
+          {
+            static const char zeros[8] = { 0 };
+            NSUInteger len = (NSUInteger)entry.width * 4 * entry.height;
+
+            if (PAD8(len) != len)
+              [data appendBytes: zeros length: PAD8(len) - len];
+          }
+        }
+    }
+
+  {
+    NSString *dir = [apath stringByDeletingLastPathComponent];
+
+    if (([fm fileExistsAtPath: dir isDirectory: &isdir] && isdir) == NO)
+      {
+        [fm createDirectoryAtPath: dir
+      withIntermediateDirectories: YES
+                       attributes: nil
+                            error: NULL];
+      }
+  }
+
+  done = [data writeToFile: apath atomically: YES];
+  RELEASE (arp);
+
+  return done;
+}
+
+- (void)dealloc
+{
+  RELEASE (path);
+  RELEASE (theme);
+  RELEASE (mapped);
+
+  [super dealloc];
+}
+
+- (id)initWithContentsOfFile:(NSString *)apath
+                       theme:(NSString *)atheme
+{
+  self = [super init];
+
+  if (self)
+    {
+      const char *bytes;
+      NSUInteger length;
+      uint32_t version;
+      uint32_t themelen;
+      NSString *atlasTheme;
+
+      ASSIGN (path, apath);
+      ASSIGN (theme, atheme);
+      mapped = [[NSData alloc] initWithContentsOfMappedFile: apath];
+
+      bytes = [mapped bytes];
+      length = [mapped length];
+
+      if (mapped == nil || length < 16 || memcmp(bytes, ATLAS_MAGIC, 8) != 0)
+        {
+          DESTROY (self);
+          return nil;
+        }
+
+      memcpy(&version, bytes + 8, sizeof(version));
+      memcpy(&themelen, bytes + 12, sizeof(themelen));
+
+      if (version != ATLAS_VERSION || 16 + (NSUInteger)themelen > length)
+        {
+          DESTROY (self);
+          return nil;
+        }
+
+      atlasTheme = AUTORELEASE ([[NSString alloc] initWithBytes: bytes + 16
+                                                         length: themelen
+                                                       encoding: NSUTF8StringEncoding]);
+      if ([atlasTheme isEqual: atheme] == NO)
+        {
+          DESTROY (self);
+          return nil;
+        }
+    }
+
+  return self;
+}
+
+- (NSDictionary *)icons
+{
+  NSMutableDictionary *icons = [NSMutableDictionary dictionary];
+  NSMutableDictionary *mtimes = [NSMutableDictionary dictionary];
+  const char *bytes = [mapped bytes];
+  NSUInteger length = [mapped length];
+  NSUInteger pos;
+  uint32_t themelen;
+
+  memcpy(&themelen, bytes + 12, sizeof(themelen));
+  pos = 16 + PAD8((NSUInteger)themelen);
+
+  while (pos + sizeof(FSNAtlasEntry) <= length)
+    {
+      FSNAtlasEntry entry;
+      NSUInteger keypos, pixpos, pixlen;
+      NSString *key;
+      NSNumber *current;
+      NSBitmapImageRep *rep;
+      NSImage *image;
+      NSMutableDictionary *sizes;
+
+      memcpy(&entry, bytes + pos, sizeof(entry));
+      keypos = pos + PAD8(sizeof(entry));
+      pixpos = keypos + PAD8((NSUInteger)entry.keylen);
+      pixlen = (NSUInteger)entry.width * entry.height * 4;
+
+      if (pixpos + pixlen > length || entry.width == 0 || entry.height == 0)
+        break;   /* truncated file: keep what was read */
+
+      pos = pixpos + PAD8(pixlen);
+
+      key = AUTORELEASE ([[NSString alloc] initWithBytes: bytes + keypos
+                                                  length: entry.keylen
+                                                encoding: NSUTF8StringEncoding]);
+      if (key == nil)
+        continue;
+
+      /* one stat per key, not per size */
+      current = [mtimes objectForKey: key];
+      if (current == nil)
+        {
+          current = [NSNumber numberWithDouble: sourceMTime(sourcePathForKey(key))];
+          [mtimes setObject: current forKey: key];
+        }
+      if ([current doubleValue] != entry.mtime)
+        continue;
+
+      rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                    pixelsWide: entry.width
+                                                    pixelsHigh: entry.height
+                                                 bitsPerSample: 8
+                                               samplesPerPixel: 4
+                                                      hasAlpha: YES
+                                                      isPlanar: NO
+                                                colorSpaceName: NSDeviceRGBColorSpace
+                                                   bytesPerRow: entry.width * 4
+                                                  bitsPerPixel: 32];
+      if (rep == nil)
+        continue;
+
+      memcpy([rep bitmapData], bytes + pixpos, pixlen);
+
+      image = [[NSImage alloc] initWithSize: NSMakeSize(entry.width, entry.height)];
+      [image addRepresentation: rep];
+      RELEASE (rep);
+
+      sizes = [icons objectForKey: key];
+      if (sizes == nil)
+        {
+          sizes = [NSMutableDictionary dictionary];
+          [icons setObject: sizes forKey: key];
+        }
+      [sizes setObject: image forKey: [NSNumber numberWithInt: entry.size]];
+      RELEASE (image);
+    }
+
+  /* FSNodeRep resizes other sizes from the 48 pixel base icon, so a key
+     is only usable with it */
+  {
+    NSArray *keys = [icons allKeys];
+    NSNumber *base = [NSNumber numberWithInt: 48];
+    NSUInteger i;
+
+    for (i = 0; i < [keys count]; i++)
+      {
+        NSString *key = [keys objectAtIndex: i];
+
+        if ([[icons objectForKey: key] objectForKey: base] == nil)
+          [icons removeObjectForKey: key];
+      }
+  }
+
+  return icons;
+}
+
+@end
@@ -17,6 +17,40 @@
 
 #import <Foundation/Foundation.h>
 
+/* One stored position in a location table: the name hash and the iloc
+ * (top-left CENTER) coordinates.  Same layout as DSStoreIconLocation. */
+typedef struct {
+  uint64_t nameHash;
+  int32_t x;
+  int32_t y;
+} FSNIconLocation;
+
+/* Name hash of a location table: 64-bit FNV-1a over the name's UTF-16 code
+ * units, high byte first (DSStoreFilenameHash). */
+static inline uint64_t
+FSNIconNameHash(NSString *name)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  unichar buf[256];
+  NSUInteger length = [name length];
+  NSUInteger pos = 0;
+
+  while (pos < length)
+    {
+      NSUInteger n = MIN(length - pos, 256);
+      NSUInteger i;
+
+      [name getCharacters: buf range: NSMakeRange(pos, n)];
+      for (i = 0; i < n; i++)
+        {
+          hash = (hash ^ (buf[i] >> 8)) * 0x100000001b3ULL;
+          hash = (hash ^ (buf[i] & 0xFF)) * 0x100000001b3ULL;
+        }
+      pos += n;
+    }
+  return hash;
+}
+
 @protocol FSNIconPositionStore <NSObject>
 
 /* Persist icon positions.  positionsByFolder maps a folder path to an
@@ -30,6 +64,13 @@
  * CENTER (iloc) coordinates, or an empty dictionary when none are stored. */
 - (NSDictionary *)storedIconPositionsForFolder:(NSString *)folder;
 
+@optional
+
+/* The same positions as a packed array of FSNIconLocation sorted by
+ * nameHash, so a view can merge-join it with its icons instead of looking
+ * each name up.  nil when the store cannot produce one. */
+- (NSData *)storedIconLocationTableForFolder:(NSString *)folder;
+
 @end
 
 #endif /* FSN_ICON_POSITION_STORE_H */
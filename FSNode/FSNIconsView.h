@@ -38,6 +38,9 @@
 @class FSNIcon;
 @class FSNIconNameEditor;
 @class FSNIconItemData;
+@class FSNSpatialIndex;
+@class FSNPrefixIndex;
+@class FSNSelectionSet;
 
 @interface FSNIconsView : NSView <NSTextFieldDelegate>
 {
@@ -100,6 +103,33 @@
   // Content extent (max right/top edge of laid-out icons) reported by
   // -layoutIcons and consumed by -tile to size the document view.
   NSSize _contentExtent;
+
+  // YES when the shown folder is large enough that only icons near the
+  // visible rect are kept as subviews (see -updateVisibleIcons).
+  BOOL _virtualized;
+
+  // Icon frames bucketed for rect queries; rebuilt on the first query
+  // after any icon frame changes (see -iconsIntersectingRect:).
+  FSNSpatialIndex *_spatialIndex;
+  BOOL _spatialIndexValid;
+
+  // Case-folded, sorted icon names for type-ahead selection; built on the
+  // first keystroke after the icons or their order change.
+  FSNPrefixIndex *_prefixIndex;
+
+  // The selected icons by their position in `icons`, read again from the
+  // icons after they change or one of them is selected on its own (see
+  // -selectionSet).  The selected reps, nodes and paths are built from it
+  // when first asked for and kept until the selection changes.
+  FSNSelectionSet *_selectionSet;
+  BOOL _selectionSetValid;
+  NSArray *_selectedReps;
+  NSArray *_selectedNodes;
+  NSArray *_selectedPaths;
+
+  // Visible rect origin of the last thumbnail hint, giving the scroll
+  // direction (see -updateThumbnailsPriority).
+  NSPoint _lastHintOrigin;
 }
 
 /* Layout policy: position every icon (setFrame:) and set _contentExtent to
@@ -110,6 +140,35 @@
  * and -gridOriginForLayout, not by overriding this method. */
 - (void)layoutIcons;
 
+/* For large folders inside a scroll view, attach the icons that lie within
+ * one screen of the visible rect (plus the edited one) as subviews and
+ * detach the rest; selected icons are never detached.  Detached icons keep their frame and
+ * selection state, so every lookup over `icons` works unchanged.  Called
+ * from -tile and whenever the clip view scrolls. */
+- (void)updateVisibleIcons;
+
+/* Tell the thumbnail scheduler which icons are visible and which lie one
+ * screen ahead in the direction of the last scroll, so their thumbnails
+ * are made first.  Called from -tile and whenever the clip view scrolls. */
+- (void)updateThumbnailsPriority;
+
+/* Icons whose frame intersects `rect`, from a spatial index over the
+ * icon frames, in no particular order.  Used for rubber-band selection
+ * and for virtualization so they only touch the icons nearby. */
+- (NSArray *)iconsIntersectingRect:(NSRect)rect;
+
+/* Called by FSNIcon when its frame changes and whenever icons are added
+ * or removed; the index is rebuilt on the next query. */
+- (void)invalidateSpatialIndex;
+
+/* Size the document view from the _contentExtent set by -layoutIcons. */
+- (void)sizeToContentExtent;
+
+/* Incremental -tile used after fswatcher/file-operation updates: lays out
+ * frames again but redoes the internal layout of `changed` icons only and
+ * leaves the scroll position alone. */
+- (void)tileChangedIcons:(NSArray *)changed;
+
 /* Whether this view honors saved (.DS_Store/fdLocation) icon positions.
  * YES for position-honoring views (desktop, spatial); NO for the browser
  * icon view, which always auto-grids and reflows to the current width. */
@@ -168,6 +227,15 @@
 
 - (NSString *)selectIconWithPrefix:(NSString *)prefix;
 
+/* Called whenever icons are added, removed or reordered. */
+- (void)invalidatePrefixIndex;
+
+/* The selection by icon position. */
+- (FSNSelectionSet *)selectionSet;
+
+/* Called by an icon selected or unselected on its own. */
+- (void)repDidChangeSelection:(id)arep;
+
 - (void)selectIconInPrevLine;
 
 - (void)selectIconInNextLine;
@@ -34,9 +34,20 @@
 #import "FSNIconsView.h"
 #import "FSNIcon.h"
 #import "FSNFunctions.h"
+#import "FSNSortKeys.h"
 #import "FSNMetadataProvider.h"
 #import "FSNIconPositionStore.h"
+#import "FSNThumbnailScheduler.h"
+#import "FSNFolderMetadata.h"
 #import "FSNPlacementEnumerator.h"
+#import "FSNGridOccupancy.h"
+#import "FSNSpatialIndex.h"
+#import "FSNPrefixIndex.h"
+#import "FSNSelectionSet.h"
+#import "FSNPasteboardPaths.h"
+#import "FSNHiddenMatcher.h"
+#import "FSNTrace.h"
+#import "FSNRepNames.h"
 
 #define DEF_ICN_SIZE 48
 #define DEF_TEXT_SIZE 12
@@ -56,6 +67,10 @@
 
 #define EDIT_MARGIN (4)
 
+/* Folders with more entries than this keep only the icons near the
+ * visible rect as subviews. */
+#define VIRTUAL_ICONS_THRESHOLD (400)
+
 #ifndef max
   #define max(a,b) ((a) >= (b) ? (a):(b))
 #endif
@@ -89,6 +104,71 @@ static void GWHighlightFrameRect(NSRect aRect)
   NSFrameRectWithWidthUsingOperation(aRect, 1.0, GSCompositeHighlight);
 }
 
+/* An icon's index keyed by the hash of its name, for the merge join with a
+ * stored location table. */
+typedef struct
+{
+  uint64_t hash;
+  NSUInteger index;
+} FSNIconNameKey;
+
+static int compareIconNameKeys(const void *a, const void *b)
+{
+  uint64_t ha = ((const FSNIconNameKey *)a)->hash;
+  uint64_t hb = ((const FSNIconNameKey *)b)->hash;
+
+  return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/* Gives each icon not yet MANUAL the position stored for its name.  The
+ * table is sorted by name hash; the icons are keyed and sorted the same
+ * way, so matching them is one linear pass with no objects created. */
+static void applyIconLocationTable(NSArray *icons, NSData *table)
+{
+  const FSNIconLocation *locs = [table bytes];
+  NSUInteger nlocs = [table length] / sizeof(FSNIconLocation);
+  NSUInteger count = [icons count];
+  FSNIconNameKey *keys;
+  NSUInteger i, n, l;
+
+  if (count == 0 || nlocs == 0)
+    return;
+
+  keys = NSZoneMalloc (NSDefaultMallocZone(), sizeof(FSNIconNameKey) * count);
+  for (i = 0, n = 0; i < count; i++)
+    {
+      FSNIcon *icon = [icons objectAtIndex: i];
+
+      if ([icon placementData].placementMode == FSNIconPlacementModeManual)
+        continue;
+      keys[n].hash = FSNIconNameHash([[icon node] name]);
+      keys[n].index = i;
+      n++;
+    }
+  qsort(keys, n, sizeof(FSNIconNameKey), compareIconNameKeys);
+
+  for (i = 0, l = 0; i < n && l < nlocs; )
+    {
+      if (keys[i].hash < locs[l].nameHash)
+        i++;
+      else if (keys[i].hash > locs[l].nameHash)
+        l++;
+      else
+        {
+          if (locs[l].x != 0 || locs[l].y != 0)
+            {
+              FSNIconItemData *data = [[icons objectAtIndex: keys[i].index] placementData];
+
+              data.ilocPosition = NSMakePoint(locs[l].x, locs[l].y);
+              data.placementMode = FSNIconPlacementModeManual;
+            }
+          i++;
+        }
+    }
+
+  NSZoneFree (NSDefaultMallocZone(), keys);
+}
+
 
 @implementation FSNIconsView
 
@@ -102,11 +182,23 @@ static void GWHighlightFrameRect(NSRect aRect)
       [[NSNotificationCenter defaultCenter] removeObserver: self
                                                       name: NSViewFrameDidChangeNotification
                                                     object: _observedClipView];
+      [[NSNotificationCenter defaultCenter] removeObserver: self
+                                                      name: NSViewBoundsDidChangeNotification
+                                                    object: _observedClipView];
       _observedClipView = nil;
     }
+  [[fsnodeRep thumbnailScheduler] prioritizeVisiblePaths: nil
+                                              aheadPaths: nil
+                                                 forView: self];
   RELEASE (node);
   RELEASE (extInfoType);
   RELEASE (icons);
+  RELEASE (_spatialIndex);
+  RELEASE (_prefixIndex);
+  RELEASE (_selectionSet);
+  RELEASE (_selectedReps);
+  RELEASE (_selectedNodes);
+  RELEASE (_selectedPaths);
   RELEASE (labelFont);
   RELEASE (nameEditor);
   RELEASE (horizontalImage);
@@ -199,6 +291,10 @@ static void GWHighlightFrameRect(NSRect aRect)
       editIcon = nil;
 
       icons = [NSMutableArray new];
+      _spatialIndex = [FSNSpatialIndex new];
+      _spatialIndexValid = NO;
+      _selectionSet = [FSNSelectionSet new];
+      _selectionSetValid = NO;
       isDragTarget = NO;
       lastKeyPressedTime = 0.0;
       charBuffer = nil;
@@ -244,6 +340,8 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)sortIcons
 {
+  [self invalidatePrefixIndex];
+
   if (infoType == FSNInfoExtendedType)
     {
       [icons sortUsingFunction: compareWithExtType
@@ -251,7 +349,10 @@ static void GWHighlightFrameRect(NSRect aRect)
     }
   else
     {
-      [icons sortUsingSelector: [fsnodeRep compareSelectorForDirectory: [node path]]];
+      SEL sel = [fsnodeRep compareSelectorForDirectory: [node path]];
+
+      if (FSNSortRepsUsingSelector(icons, sel) == NO)
+        [icons sortUsingSelector: sel];
     }
 }
 
@@ -306,11 +407,10 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)tile
 {
+  FSN_TRACE_SCOPE ("FSNIconsView tile");
   CREATE_AUTORELEASE_POOL (pool);
   NSUInteger count = [icons count];
   NSUInteger i;
-  /* Superview frame — used to fill the parent on the desktop (no scroll view). */
-  NSRect svr = [[self superview] frame];
 
   [self calculateGridSize];
 
@@ -332,37 +432,17 @@ static void GWHighlightFrameRect(NSRect aRect)
   /* Layout policy: set every icon's frame and fill _contentExtent. */
   [self layoutIcons];
 
-  /* Size the document view from the reported content extent. */
-  {
-    CGFloat visibleWidth = [self windowContentWidthForLayout];
-    CGFloat maxX = _contentExtent.width + X_MARGIN;
-    /* Snap trivial overflow so a few pixels of grid rounding don't add a
-     * horizontal scrollbar; keep the natural width for content genuinely
-     * outside the visible area (off-screen manual positions). */
-    if (maxX - X_MARGIN <= visibleWidth)
-      maxX = visibleWidth;
-
-    CGFloat fh = _contentExtent.height + Y_MARGIN;
-    /* Inside a scroll view the document owns its height (>= visible so icons
-     * start at the top and scrollbars are proportional); on the desktop the
-     * view must fill the parent. */
-    if ([[self superview] isKindOfClass: [NSClipView class]] == NO)
-      {
-        if (fh < svr.size.height)
-          fh = svr.size.height;
-      }
-    else
-      {
-        CGFloat visibleHeight = [self visibleContentHeightForLayout];
-        if (fh < visibleHeight)
-          fh = visibleHeight;
-      }
-    SETRECT (self, 0, 0, maxX, fh);
-  }
+  [self sizeToContentExtent];
 
-  /* Tile each icon's internal layout (highlight, label, icon image). */
-  for (i = 0; i < count; i++)
-    [[icons objectAtIndex: i] tile];
+  /* Tile each icon's internal layout (highlight, label, icon image).
+   * Detached icons of a virtualized view are tiled when they are attached. */
+  if (_virtualized)
+    [self updateVisibleIcons];
+  else
+    for (i = 0; i < count; i++)
+      [[icons objectAtIndex: i] tile];
+
+  [self updateThumbnailsPriority];
 
   {
     NSArray *selection = [self selectedReps];
@@ -384,6 +464,248 @@ static void GWHighlightFrameRect(NSRect aRect)
   RELEASE (pool);
 }
 
+- (void)updateVisibleIcons
+{
+  NSArray *wanted;
+  NSArray *attached;
+  NSUInteger i;
+  NSRect vr;
+
+  if (_virtualized == NO)
+    return;
+
+  /* Keep one screen above and below materialized so ordinary scrolling
+   * does not attach icons on every step. Only attached icons hold their
+   * image and label cells. */
+  vr = [self visibleRect];
+  vr = NSInsetRect(vr, 0, -vr.size.height);
+
+  wanted = [self iconsIntersectingRect: vr];
+
+  /* Only the attached icons can need detaching; walk those instead of
+   * the whole folder. */
+  attached = [NSArray arrayWithArray: [self subviews]];
+
+  for (i = 0; i < [attached count]; i++)
+    {
+      FSNIcon *icon = [attached objectAtIndex: i];
+
+      if ([icon isKindOfClass: [FSNIcon class]] == NO)
+        continue;
+
+      if (([icon isSelected] == NO) && (icon != editIcon)
+          && (NSIntersectsRect(vr, [icon frame]) == NO))
+        {
+          [icon removeFromSuperviewWithoutNeedingDisplay];
+          [icon setContainer: self];
+          [icon unloadContents];
+        }
+    }
+
+  if (editIcon && ([editIcon superview] != self))
+    wanted = [wanted arrayByAddingObject: editIcon];
+
+  for (i = 0; i < [wanted count]; i++)
+    {
+      FSNIcon *icon = [wanted objectAtIndex: i];
+
+      if ([icon superview] != self)
+        {
+          [icon loadContents];
+          [self addSubview: icon];
+          [icon tile];
+        }
+    }
+}
+
+- (void)updateThumbnailsPriority
+{
+  id scheduler = [fsnodeRep thumbnailScheduler];
+  NSMutableArray *visible;
+  NSMutableArray *ahead;
+  NSArray *found;
+  NSRect vr;
+  NSRect ar;
+  CGFloat dy;
+  NSUInteger i;
+
+  if ((scheduler == nil) || ([self enclosingScrollView] == nil))
+    return;
+
+  vr = [self visibleRect];
+  dy = vr.origin.y - _lastHintOrigin.y;
+  _lastHintOrigin = vr.origin;
+
+  /* Before any scroll, the next screen is the one below. */
+  if ((dy == 0) || isnan(dy))
+    dy = [self isFlipped] ? 1 : -1;
+  ar = NSOffsetRect(vr, 0, (dy > 0) ? vr.size.height : -vr.size.height);
+
+  found = [self iconsIntersectingRect: vr];
+  visible = [NSMutableArray arrayWithCapacity: [found count]];
+  for (i = 0; i < [found count]; i++)
+    [visible addObject: [[[found objectAtIndex: i] node] path]];
+
+  found = [self iconsIntersectingRect: ar];
+  ahead = [NSMutableArray arrayWithCapacity: [found count]];
+  for (i = 0; i < [found count]; i++)
+    {
+      FSNIcon *icon = [found objectAtIndex: i];
+
+      if (NSIntersectsRect(vr, [icon frame]) == NO)
+        [ahead addObject: [[icon node] path]];
+    }
+
+  [scheduler prioritizeVisiblePaths: visible
+                         aheadPaths: ahead
+                            forView: self];
+}
+
+- (NSArray *)iconsIntersectingRect:(NSRect)rect
+{
+  if (_spatialIndexValid == NO)
+    {
+      NSUInteger count = [icons count];
+      NSRect *frames = NSZoneMalloc (NSDefaultMallocZone(), sizeof(NSRect) * (count + 1));
+      NSUInteger i;
+
+      for (i = 0; i < count; i++)
+        frames[i] = [[icons objectAtIndex: i] frame];
+
+      [_spatialIndex setObjects: icons frames: frames];
+      NSZoneFree (NSDefaultMallocZone(), frames);
+      _spatialIndexValid = YES;
+    }
+
+  return [_spatialIndex objectsIntersectingRect: rect];
+}
+
+- (void)invalidateSpatialIndex
+{
+  if (_spatialIndexValid)
+    {
+      /* drop the references now, so removed icons are not kept alive */
+      [_spatialIndex removeAllObjects];
+      _spatialIndexValid = NO;
+    }
+}
+
+/* -iconBounds of `icon` in this view's coordinates; works for icons a
+ * virtualized view has detached. */
+- (NSRect)iconBoundsOfIcon:(FSNIcon *)icon
+{
+  NSRect ibounds = [icon iconBounds];
+  NSRect frame;
+
+  if ([icon superview] == self)
+    return [self convertRect: ibounds fromView: icon];
+
+  frame = [icon frame];
+  if ([icon isFlipped] != [self isFlipped])
+    ibounds.origin.y = frame.size.height - NSMaxY(ibounds);
+
+  ibounds.origin.x += frame.origin.x;
+  ibounds.origin.y += frame.origin.y;
+
+  return ibounds;
+}
+
+/* file name -> icon, for resolving a batch of fswatcher names without
+ * a linear scan per name. */
+- (NSDictionary *)iconsByName
+{
+  return FSNRepsByFileName(icons);
+}
+
+/* Moves each of `changed` (new or updated icons, the rest of `icons`
+ * being sorted) to its sorted position by binary search instead of
+ * re-sorting the whole folder. */
+- (void)insertIconsSorted:(NSArray *)changed
+{
+  SEL sel = [fsnodeRep compareSelectorForDirectory: [node path]];
+  NSComparisonResult (*func)(id, id, void *) = NULL;
+  NSUInteger i;
+
+  if (infoType == FSNInfoExtendedType)
+    func = compareWithExtType;
+
+  [icons removeObjectsInArray: changed];
+  [self invalidatePrefixIndex];
+
+  for (i = 0; i < [changed count]; i++)
+    {
+      FSNIcon *icon = [changed objectAtIndex: i];
+      NSUInteger index = FSNSortedInsertionIndex(icons, icon, sel, func);
+
+      [icons insertObject: icon atIndex: index];
+    }
+}
+
+/* Incremental counterpart of -tile after icons were inserted or removed:
+ * re-runs the (frame only) layout and document sizing, but redoes the
+ * internal layout of `changed` icons only and keeps the scroll position. */
+- (void)tileChangedIcons:(NSArray *)changed
+{
+  NSUInteger i;
+
+  if (_gridCached == NO)
+    {
+      [self tile];
+      return;
+    }
+
+  if (!customIconPositions)
+    customIconPositions = [[NSMutableDictionary alloc] init];
+
+  [self layoutIcons];
+  [self sizeToContentExtent];
+
+  for (i = 0; i < [changed count]; i++)
+    {
+      FSNIcon *icon = [changed objectAtIndex: i];
+
+      if ((_virtualized == NO) || ([icon superview] == self))
+        [icon tile];
+    }
+
+  [self updateVisibleIcons];
+
+  if ([[self subviews] containsObject: nameEditor])
+    [self updateNameEditor];
+}
+
+/* Size the document view from the _contentExtent reported by
+ * -layoutIcons. */
+- (void)sizeToContentExtent
+{
+  /* Superview frame — used to fill the parent on the desktop (no scroll view). */
+  NSRect svr = [[self superview] frame];
+  CGFloat visibleWidth = [self windowContentWidthForLayout];
+  CGFloat maxX = _contentExtent.width + X_MARGIN;
+  /* Snap trivial overflow so a few pixels of grid rounding don't add a
+   * horizontal scrollbar; keep the natural width for content genuinely
+   * outside the visible area (off-screen manual positions). */
+  if (maxX - X_MARGIN <= visibleWidth)
+    maxX = visibleWidth;
+
+  CGFloat fh = _contentExtent.height + Y_MARGIN;
+  /* Inside a scroll view the document owns its height (>= visible so icons
+   * start at the top and scrollbars are proportional); on the desktop the
+   * view must fill the parent. */
+  if ([[self superview] isKindOfClass: [NSClipView class]] == NO)
+    {
+      if (fh < svr.size.height)
+        fh = svr.size.height;
+    }
+  else
+    {
+      CGFloat visibleHeight = [self visibleContentHeightForLayout];
+      if (fh < visibleHeight)
+        fh = visibleHeight;
+    }
+  SETRECT (self, 0, 0, maxX, fh);
+}
+
 /* Layout policy for every view: honored icons (desktop, spatial) are placed
  * at their saved iloc mapped through -viewCenterForIlocCenter:; unhonored
  * icons (browser) and any unplaced icon flow into the next free grid cell and
@@ -415,7 +737,7 @@ static void GWHighlightFrameRect(NSRect aRect)
    * and respects _placementDirection so new icons appear at the correct
    * end of the grid (e.g., top-right for desktop's TopToBottomRightToLeft). */
   FSNPlacementEnumerator *autoEnumerator = nil;
-  NSMutableSet *occupiedCells = nil;
+  FSNGridOccupancy *occupancy = nil;
   NSPoint autoGOrigin = NSZeroPoint;
   CGFloat autoCellW = 0, autoCellH = 0, autoGapX = 0;
   BOOL autoInitDone = NO;
@@ -546,7 +868,7 @@ static void GWHighlightFrameRect(NSRect aRect)
                * position is honored, so no cell is occupied by one (stale
                * MANUAL flags or customIconPositions entries must not punch
                * phantom holes in the reflow grid). */
-              occupiedCells = [[NSMutableSet alloc] init];
+              occupancy = [[FSNGridOccupancy alloc] initWithEnumerator: autoEnumerator];
               if (honor)
                 {
               NSUInteger j;
@@ -577,36 +899,23 @@ static void GWHighlightFrameRect(NSRect aRect)
                                                          cellSize: NSMakeSize(autoCellW, autoCellH)
                                                              gapX: autoGapX
                                                            origin: autoGOrigin];
-                      if (!FSNGridCellsEqual(ocell, FSNGridCellNone)
-                          && ocell.col < nCols && ocell.row < nRows)
-                        {
-                          [occupiedCells addObject:
-                            [NSString stringWithFormat: @"%lu:%lu",
-                                       (unsigned long)ocell.col,
-                                       (unsigned long)ocell.row]];
-                        }
+                      /* cells outside the grid are ignored */
+                      if (!FSNGridCellsEqual(ocell, FSNGridCellNone))
+                        [occupancy occupyCell: ocell];
                     }
                 }
                 }
               autoInitDone = YES;
             }
 
-          /* Advance the direction-aware enumerator to the next free
-           * grid cell (skipping cells occupied by existing icons). */
+          /* Take the first free grid cell in the enumerator's
+           * direction-aware order (skipping cells occupied by existing
+           * icons) and mark it for subsequent AUTO-mode icons. */
           {
             FSNGridCell cell;
             BOOL found = NO;
-            while ([autoEnumerator nextCell: &cell])
+            if (occupancy && [occupancy takeFreeCell: &cell])
               {
-                NSString *cellKey = [NSString stringWithFormat: @"%lu:%lu",
-                                              (unsigned long)cell.col,
-                                              (unsigned long)cell.row];
-                if ([occupiedCells containsObject: cellKey])
-                  continue;
-
-                /* Mark this cell as taken for subsequent AUTO-mode icons. */
-                [occupiedCells addObject: cellKey];
-
                 NSPoint center = [self centerForGridCell: cell
                                                 cellSize: NSMakeSize(autoCellW, autoCellH)
                                                     gapX: autoGapX
@@ -625,7 +934,6 @@ static void GWHighlightFrameRect(NSRect aRect)
                       forKey: filename];
                   }
                 found = YES;
-                break;
               }
 
             if (!found)
@@ -670,7 +978,7 @@ static void GWHighlightFrameRect(NSRect aRect)
     }
 
   [autoEnumerator release];
-  [occupiedCells release];
+  [occupancy release];
 
   if (irects)
     NSZoneFree (NSDefaultMallocZone(), irects);
@@ -692,25 +1000,132 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (NSString *)selectIconWithPrefix:(NSString *)prefix
 {
-  NSUInteger i;
+  NSString *folded = [FSNPrefixIndex foldedString: prefix];
+  NSUInteger i = NSNotFound;
+  int pass;
 
-  for (i = 0; i < [icons count]; i++)
+  /* Names can change under the index (renames, info type), so a hit is
+   * checked against the icon and a stale index is rebuilt once. */
+  for (pass = 0; pass < 2; pass++)
+    {
+      if (_prefixIndex == nil)
+        {
+          NSMutableArray *names = [NSMutableArray arrayWithCapacity: [icons count]];
+          NSUInteger j;
+
+          for (j = 0; j < [icons count]; j++)
+            {
+              NSString *name = [[icons objectAtIndex: j] shownInfo];
+              [names addObject: (name ? name : @"")];
+            }
+
+          _prefixIndex = [[FSNPrefixIndex alloc] initWithNames: names];
+        }
+
+      i = [_prefixIndex firstIndexWithPrefix: prefix];
+
+      if ((i == NSNotFound) && ([_prefixIndex count] == [icons count]))
+        return nil;
+
+      if ((i != NSNotFound) && (i < [icons count])
+          && [[FSNPrefixIndex foldedString: [[icons objectAtIndex: i] shownInfo]] hasPrefix: folded])
+        break;
+
+      i = NSNotFound;
+      [self invalidatePrefixIndex];
+    }
+
+  if (i != NSNotFound)
     {
       FSNIcon *icon = [icons objectAtIndex: i];
-      NSString *name = [icon shownInfo];
 
-      if ([name rangeOfString: prefix options: NSCaseInsensitiveSearch].location == 0)
-	{
-	  [icon select];
-	  [self scrollIconToVisible: icon];
+      [icon select];
+      [self scrollIconToVisible: icon];
 
-	  return name;
-	}
+      return [icon shownInfo];
     }
 
   return nil;
 }
 
+- (void)invalidatePrefixIndex
+{
+  DESTROY (_prefixIndex);
+  /* the selection is kept by position too */
+  [self repDidChangeSelection: nil];
+}
+
+- (FSNSelectionSet *)selectionSet
+{
+  if ((_selectionSetValid == NO) || ([_selectionSet count] != [icons count]))
+    {
+      NSUInteger count = [icons count];
+      NSUInteger i;
+
+      [_selectionSet setCount: count];
+      [_selectionSet removeAll];
+
+      for (i = 0; i < count; i++)
+        {
+          if ([[icons objectAtIndex: i] isSelected])
+            [_selectionSet addIndex: i];
+        }
+
+      _selectionSetValid = YES;
+    }
+
+  return _selectionSet;
+}
+
+- (void)repDidChangeSelection:(id)arep
+{
+  _selectionSetValid = NO;
+  DESTROY (_selectedReps);
+  DESTROY (_selectedNodes);
+  DESTROY (_selectedPaths);
+}
+
+/* Makes the icons passing `test` the selection, in one pass that tells
+ * neither the icons' container nor the desktop of each one; the visible
+ * part of the view is drawn again once, which draws the icons in it. */
+- (void)selectIconsPassingTest:(BOOL (^)(FSNIcon *icon))test
+{
+  FSNSelectionSet *set = [self selectionSet];
+  NSUInteger count = [icons count];
+  BOOL changed = NO;
+  NSUInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      FSNIcon *icon = [icons objectAtIndex: i];
+      BOOL selected = test(icon);
+
+      if (selected != [set containsIndex: i])
+        {
+          [icon setSelected: selected];
+
+          if (selected)
+            [set addIndex: i];
+          else
+            [set removeIndex: i];
+
+          changed = YES;
+        }
+    }
+
+  if (changed)
+    {
+      DESTROY (_selectedReps);
+      DESTROY (_selectedNodes);
+      DESTROY (_selectedPaths);
+      [self setNeedsDisplayInRect: [self visibleRect]];
+    }
+
+  selectionMask = NSSingleSelectionMask;
+
+  [self selectionDidChange];
+}
+
 - (void)selectIconInPrevLine
 {
   FSNIcon *icon;
@@ -771,20 +1186,14 @@ static void GWHighlightFrameRect(NSRect aRect)
 {
   NSUInteger i;
 
-  for (i = 0; i < [icons count]; i++)
+  i = [[self selectionSet] firstIndex];
+
+  if ((i != NSNotFound) && (i > 0))
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
+      FSNIcon *icon = [icons objectAtIndex: i - 1];
 
-      if ([icon isSelected])
-	{
-	  if (i > 0)
-	    {
-	      icon = [icons objectAtIndex: i - 1];
-	      [icon select];
-	      [self scrollIconToVisible: icon];
-	    }
-	  break;
-	}
+      [icon select];
+      [self scrollIconToVisible: icon];
     }
 }
 
@@ -793,20 +1202,14 @@ static void GWHighlightFrameRect(NSRect aRect)
   NSUInteger count = [icons count];
   NSUInteger i;
 
-  for (i = 0; i < count; i++)
+  i = [[self selectionSet] firstIndex];
+
+  if ((i != NSNotFound) && (i < (count - 1)))
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
+      FSNIcon *icon = [icons objectAtIndex: i + 1];
 
-      if ([icon isSelected])
-	{
-	  if (i < (count - 1))
-	    {
-	      icon = [icons objectAtIndex: i + 1];
-	      [icon select];
-	      [self scrollIconToVisible: icon];
-	    }
-	  break;
-	}
+      [icon select];
+      [self scrollIconToVisible: icon];
     }
 }
 
@@ -1456,16 +1859,22 @@ static void GWHighlightFrameRect(NSRect aRect)
 
   selrect = NSMakeRect(x, y, w, h);
 
-  for (i = 0; i < [icons count]; i++)
+  /* the icon bounds lie within the frame, so the frames found are a
+     superset of the hits */
+  {
+    NSArray *candidates = [self iconsIntersectingRect: selrect];
+
+  for (i = 0; i < [candidates count]; i++)
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
-      NSRect iconBounds = [self convertRect: [icon iconBounds] fromView: icon];
+      FSNIcon *icon = [candidates objectAtIndex: i];
+      NSRect iconBounds = [self iconBoundsOfIcon: icon];
 
       if (NSIntersectsRect(selrect, iconBounds))
 	{
 	  [icon select];
 	}
     }
+  }
 
   selectionMask = NSSingleSelectionMask;
 
@@ -1706,6 +2115,9 @@ static void GWHighlightFrameRect(NSRect aRect)
       [[NSNotificationCenter defaultCenter] removeObserver: self
                                                       name: NSViewFrameDidChangeNotification
                                                     object: _observedClipView];
+      [[NSNotificationCenter defaultCenter] removeObserver: self
+                                                      name: NSViewBoundsDidChangeNotification
+                                                    object: _observedClipView];
       _observedClipView = nil;
     }
 
@@ -1721,6 +2133,14 @@ static void GWHighlightFrameRect(NSRect aRect)
                                                selector: @selector(clipViewFrameDidChange:)
                                                    name: NSViewFrameDidChangeNotification
                                                  object: _observedClipView];
+
+      /* Scrolling moves the clip view's bounds; a virtualized view
+       * attaches the icons coming into view. */
+      [_observedClipView setPostsBoundsChangedNotifications: YES];
+      [[NSNotificationCenter defaultCenter] addObserver: self
+                                               selector: @selector(clipViewBoundsDidChange:)
+                                                   name: NSViewBoundsDidChangeNotification
+                                                 object: _observedClipView];
     }
 
   if ([self superview])
@@ -1737,6 +2157,12 @@ static void GWHighlightFrameRect(NSRect aRect)
   [self tile];
 }
 
+- (void)clipViewBoundsDidChange:(NSNotification *)notif
+{
+  [self updateVisibleIcons];
+  [self updateThumbnailsPriority];
+}
+
 - (void)drawRect:(NSRect)rect
 {
   [super drawRect: rect];
@@ -1791,22 +2217,41 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)showContentsOfNode:(FSNode *)anode
 {
+  FSN_TRACE_SCOPE ("FSNIconsView showContentsOfNode");
   CREATE_AUTORELEASE_POOL(arp);
   NSArray *subNodes = [anode subNodes];
+  FSNFolderMetadata *folderMetadata = nil;
   NSUInteger i;
 
   for (i = 0; i < [icons count]; i++)
     {
-      [[icons objectAtIndex: i] removeFromSuperview];
+      FSNIcon *icon = [icons objectAtIndex: i];
+
+      [icon removeFromSuperview];
+      [icon setContainer: nil];
     }
   [icons removeAllObjects];
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
   editIcon = nil;
 
+  /* The desktop has no scroll view and always keeps every icon. */
+  _virtualized = (([subNodes count] > VIRTUAL_ICONS_THRESHOLD)
+                  && ([self enclosingScrollView] != nil));
+
   ASSIGN (node, anode);
   [self readNodeInfo];
   _gridCached = NO; /* icon properties may have changed */
+  _lastHintOrigin = NSMakePoint(NAN, NAN); /* no scroll direction yet */
   [self calculateGridSize];
 
+  /* Labels and positions are read from one folder table below instead
+     of per icon; without it, warm the provider's per-path cache. */
+  if ([[fsnodeRep metadataProvider] respondsToSelector: @selector(folderMetadataAtPath:)])
+    folderMetadata = [[fsnodeRep metadataProvider] folderMetadataAtPath: [anode path]];
+  else if ([[fsnodeRep metadataProvider] respondsToSelector: @selector(prefetchMetadataForDirectory:)])
+    [[fsnodeRep metadataProvider] prefetchMetadataForDirectory: [anode path]];
+
   for (i = 0; i < [subNodes count]; i++)
     {
       FSNode *subnode = [subNodes objectAtIndex: i];
@@ -1820,9 +2265,15 @@ static void GWHighlightFrameRect(NSRect aRect)
 					 gridIndex: -1
 					 dndSource: YES
 					 acceptDnd: YES
-					 slideBack: YES];
+					 slideBack: YES
+				      loadContents: (_virtualized == NO)];
+      if (folderMetadata)
+        [icon setMetadataLabelColor: [folderMetadata labelColorForName: [subnode name]]];
       [icons addObject: icon];
-      [self addSubview: icon];
+      if (_virtualized)
+        [icon setContainer: self];
+      else
+        [self addSubview: icon];
       RELEASE (icon);
     }
 
@@ -1844,7 +2295,9 @@ static void GWHighlightFrameRect(NSRect aRect)
         FSNIcon *icon = [icons objectAtIndex: i];
         FSNode *nd = [icon node];
         if (!nd) continue;
-        NSPoint floc = [[fsnodeRep metadataProvider] iconPositionForPath: [nd path]];
+        NSPoint floc = folderMetadata
+          ? [folderMetadata iconPositionForName: [nd name]]
+          : [[fsnodeRep metadataProvider] iconPositionForPath: [nd path]];
         if ((floc.x > 0 || floc.y > 0) && floc.x != -1 && floc.y != -1)
           {
             FSNIconItemData *data = [icon placementData];
@@ -1857,9 +2310,20 @@ static void GWHighlightFrameRect(NSRect aRect)
      * both provided by the injected position store (the app reads them via
      * the settings hierarchy).  Only fills icons not already positioned by
      * fdLocation.  Raw iloc (top-left) is stored; conversion to GNUstep
-     * bottom-left happens at tile time with the correct refH. */
-    NSDictionary *stored =
-      [[fsnodeRep iconPositionStore] storedIconPositionsForFolder: folderPath];
+     * bottom-left happens at tile time with the correct refH.  A store that
+     * can hand out a sorted location table is merge-joined with the icons;
+     * otherwise each icon looks its name up in the positions dictionary. */
+    id <FSNIconPositionStore> positionStore = [fsnodeRep iconPositionStore];
+    NSData *table = nil;
+    NSDictionary *stored = nil;
+
+    if ([positionStore respondsToSelector: @selector(storedIconLocationTableForFolder:)])
+      table = [positionStore storedIconLocationTableForFolder: folderPath];
+    if (table)
+      applyIconLocationTable(icons, table);
+    else
+      stored = [positionStore storedIconPositionsForFolder: folderPath];
+
     if ([stored count])
       {
         for (i = 0; i < [icons count]; i++)
@@ -1880,7 +2344,13 @@ static void GWHighlightFrameRect(NSRect aRect)
       }
   }
 
-  [icons sortUsingSelector: [fsnodeRep compareSelectorForDirectory: [node path]]];
+  [self invalidatePrefixIndex];
+  {
+    SEL sel = [fsnodeRep compareSelectorForDirectory: [node path]];
+
+    if (FSNSortRepsUsingSelector(icons, sel) == NO)
+      [icons sortUsingSelector: sel];
+  }
   [self tile];
 
   DESTROY (lastSelection);
@@ -1890,11 +2360,10 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (NSDictionary *)readNodeInfo
 {
-  /* Read per-folder view settings from user defaults only.
+  /* Read per-folder view settings from the viewer prefs store only.
    * Icon positions are restored separately from DS_Store / fdLocation. */
-  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
   NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [node path]];
-  NSDictionary *nodeDict = [defaults dictionaryForKey: prefsname];
+  NSDictionary *nodeDict = [fsnodeRep viewerPrefsForKey: prefsname];
 
   if (nodeDict)
     {
@@ -1936,17 +2405,16 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (NSMutableDictionary *)updateNodeInfo:(BOOL)ondisk
 {
-  /* Persist per-folder view settings to user defaults only.
+  /* Persist per-folder view settings to the viewer prefs store only.
    * Icon positions are stored via DS_Store / fdLocation, not here. */
   CREATE_AUTORELEASE_POOL(arp);
   NSMutableDictionary *updatedInfo = nil;
 
   if ([node isValid])
     {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
       NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [node path]];
 
-      NSDictionary *prefs = [defaults dictionaryForKey: prefsname];
+      NSDictionary *prefs = [fsnodeRep viewerPrefsForKey: prefsname];
       if (prefs)
         updatedInfo = [prefs mutableCopy];
       else
@@ -1965,7 +2433,7 @@ static void GWHighlightFrameRect(NSRect aRect)
         [updatedInfo setObject: extInfoType forKey: @"ext_info_type"];
 
       if (ondisk)
-        [defaults setObject: updatedInfo forKey: prefsname];
+        [fsnodeRep setViewerPrefs: updatedInfo forKey: prefsname];
     }
 
   RELEASE (arp);
@@ -1974,6 +2442,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)reloadContents
 {
+  FSN_TRACE_SCOPE ("FSNIconsView reloadContents");
   NSArray *selection = [self selectedNodes];
   NSMutableArray *opennodes = [NSMutableArray array];
   NSUInteger i;
@@ -1981,6 +2450,7 @@ static void GWHighlightFrameRect(NSRect aRect)
   /* A reload re-reads the directory from disk; drop cached file metadata
    * so labels/positions reflect any external change. */
   [[fsnodeRep metadataProvider] invalidateCaches];
+  [fsnodeRep invalidateDirectoryListingAtPath: [node path]];
 
   RETAIN (selection);
 
@@ -2122,6 +2592,8 @@ static void GWHighlightFrameRect(NSRect aRect)
   NSArray *files = [info objectForKey: @"files"];
   NSString *ndpath = [node path];
   NSMutableArray *newlyAdded = nil;
+  NSMutableArray *changed = [NSMutableArray array];
+  NSDictionary *reps;
   NSUInteger i;
 
   if ([operation isEqual: @"WorkspaceRenameOperation"])
@@ -2148,11 +2620,19 @@ static void GWHighlightFrameRect(NSRect aRect)
 	  files = [info objectForKey: @"origfiles"];
 	}
 
+	reps = [self iconsByName];
+
 	for (i = 0; i < [files count]; i++)
 	  {
 	    NSString *fname = [files objectAtIndex: i];
-	    FSNode *subnode = [FSNode nodeWithRelativePath: fname parent: node];
-	    [self removeRepOfSubnode: subnode];
+	    FSNIcon *icon = [reps objectForKey: fname];
+
+	    if (icon)
+	      {
+		/* See -removeRepOfSubnode:. */
+		[customIconPositions removeObjectForKey: fname];
+		[self removeRep: icon];
+	      }
 	  }
       }
     }
@@ -2179,29 +2659,33 @@ static void GWHighlightFrameRect(NSRect aRect)
 	  files = [info objectForKey: @"files"];
 	}
 
+      reps = [self iconsByName];
+
       for (i = 0; i < [files count]; i++)
 	{
 	  NSString *fname = [files objectAtIndex: i];
 	  FSNode *subnode = [FSNode nodeWithRelativePath: fname parent: node];
-	  FSNIcon *icon = [self repOfSubnode: subnode];
+	  FSNIcon *icon = [reps objectForKey: fname];
 
 	  if (icon){
 	    [icon setNode: subnode];
+	    [changed addObject: icon];
 	  } else {
 	    FSNIcon *added = [self addRepForSubnode: subnode];
 	    if (added)
 	      {
 		if (!newlyAdded) newlyAdded = [NSMutableArray array];
 		[newlyAdded addObject: added];
+		[changed addObject: added];
 	      }
 	  }
 	}
 
-      [self sortIcons];
+      [self insertIconsSorted: changed];
     }
 
   [self checkLockedReps];
-  [self tile];
+  [self tileChangedIcons: changed];
   /* Persist positions of any items added to this open window (honor views). */
   [self persistStoredPositionsForIcons: newlyAdded];
   [self setNeedsDisplay: YES];
@@ -2212,25 +2696,57 @@ static void GWHighlightFrameRect(NSRect aRect)
 {
   NSString *event = [info objectForKey: @"event"];
   NSArray *files = [info objectForKey: @"files"];
-  NSString *ndpath = [node path];
   NSMutableArray *newlyAdded = nil;
+  NSMutableArray *changed = [NSMutableArray array];
   NSUInteger i;
 
-  /* Files under the watched directory changed on disk — drop cached
-   * metadata so re-read reflects the new state. */
-  [[fsnodeRep metadataProvider] invalidateCaches];
+  /* Files under the watched directory changed on disk — drop their
+   * cached metadata so re-read reflects the new state. */
+  {
+    id provider = [fsnodeRep metadataProvider];
+    NSString *path = [info objectForKey: @"path"];
 
+    if (path && [provider respondsToSelector: @selector(invalidateCachesForPaths:)])
+      {
+        NSMutableArray *paths = [NSMutableArray arrayWithObject: path];
+
+        for (i = 0; i < [files count]; i++)
+          {
+            [paths addObject: [path stringByAppendingPathComponent:
+                                      [files objectAtIndex: i]]];
+          }
+        [provider invalidateCachesForPaths: paths];
+      }
+    else
+      {
+        [provider invalidateCaches];
+      }
+  }
+
+  /* Only the reps named by the event are touched: deletions keep the
+   * order, creations are inserted at their sorted position, and the
+   * grid is retiled without rebuilding the other icons. */
   if ([event isEqual: @"GWFileDeletedInWatchedDirectory"])
     {
+      NSDictionary *reps = [self iconsByName];
+
       for (i = 0; i < [files count]; i++)
 	{
 	  NSString *fname = [files objectAtIndex: i];
-	  NSString *fpath = [ndpath stringByAppendingPathComponent: fname];
-	  [self removeRepOfSubnodePath: fpath];
+	  FSNIcon *icon = [reps objectForKey: fname];
+
+	  if (icon)
+	    {
+	      /* See -removeRepOfSubnode:. */
+	      [customIconPositions removeObjectForKey: fname];
+	      [self removeRep: icon];
+	    }
 	}
     }
   else if ([event isEqual: @"GWFileCreatedInWatchedDirectory"])
     {
+      NSDictionary *reps = [self iconsByName];
+
       for (i = 0; i < [files count]; i++)
 	{
 	  NSString *fname = [files objectAtIndex: i];
@@ -2238,11 +2754,12 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 	  if (subnode && [subnode isValid])
 	    {
-	      FSNIcon *icon = [self repOfSubnode: subnode];
+	      FSNIcon *icon = [reps objectForKey: fname];
 
 	      if (icon)
 		{
 		  [icon setNode: subnode];
+		  [changed addObject: icon];
 		}
 	      else
 		{
@@ -2251,14 +2768,16 @@ static void GWHighlightFrameRect(NSRect aRect)
 		    {
 		      if (!newlyAdded) newlyAdded = [NSMutableArray array];
 		      [newlyAdded addObject: added];
+		      [changed addObject: added];
 		    }
 		}
 	    }
 	}
+
+      [self insertIconsSorted: changed];
     }
 
-  [self sortIcons];
-  [self tile];
+  [self tileChangedIcons: changed];
   /* Persist positions of any items created in this open window (honor views). */
   [self persistStoredPositionsForIcons: newlyAdded];
   [self setNeedsDisplay: YES];
@@ -2437,10 +2956,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 - (id)addRepForSubnode:(FSNode *)anode
 {
   /* Never display internal metadata files */
-  NSString *fname = [anode name];
-  if ([fname isEqualToString: @".DS_Store"]
-      || [fname hasPrefix: @"._"]
-      || [fname isEqualToString: @"__MACOSX"])
+  if ([[FSNHiddenMatcher sharedMatcher] isMetadataName: [anode name]])
     return nil;
 
   CREATE_AUTORELEASE_POOL(arp);
@@ -2454,9 +2970,15 @@ static void GWHighlightFrameRect(NSRect aRect)
                                      gridIndex: -1
                                      dndSource: YES
                                      acceptDnd: YES
-                                     slideBack: YES];
+                                     slideBack: YES
+                                  loadContents: (_virtualized == NO)];
   [icons addObject: icon];
-  [self addSubview: icon];
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
+  if (_virtualized)
+    [icon setContainer: self];
+  else
+    [self addSubview: icon];
   RELEASE (icon);
   RELEASE (arp);
 
@@ -2503,7 +3025,10 @@ static void GWHighlightFrameRect(NSRect aRect)
       editIcon = nil;
     }
   [arep removeFromSuperview];
+  [arep setContainer: nil];
   [icons removeObject: arep];
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
 }
 
 - (void)unloadFromNode:(FSNode *)anode
@@ -2518,6 +3043,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)unselectOtherReps:(id)arep
 {
+  FSNSelectionSet *set;
   NSUInteger i;
 
   if (selectionMask & FSNMultipleSelectionMask)
@@ -2525,115 +3051,81 @@ static void GWHighlightFrameRect(NSRect aRect)
       return;
     }
 
-  for (i = 0; i < [icons count]; i++)
+  /* only the selected icons are looked at */
+  set = [self selectionSet];
+  i = [set firstIndex];
+
+  while (i != NSNotFound)
     {
       FSNIcon *icon = [icons objectAtIndex: i];
+      NSUInteger next = [set indexGreaterThanIndex: i];
 
       if (icon != arep)
 	{
-	  [icon unselect];
+	  [icon setSelected: NO];
+	  [icon setNeedsDisplay: YES];
+	  [set removeIndex: i];
 	}
+
+      i = next;
     }
+
+  DESTROY (_selectedReps);
+  DESTROY (_selectedNodes);
+  DESTROY (_selectedPaths);
 }
 
 - (void)selectReps:(NSArray *)reps
 {
-  NSUInteger i;
-
-  selectionMask = NSSingleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
+  NSSet *wanted = [NSSet setWithArray: reps];
 
-  [self unselectOtherReps: nil];
-
-  selectionMask = FSNMultipleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  for (i = 0; i < [reps count]; i++)
-    {
-      [[reps objectAtIndex: i] select];
-    }
-
-  selectionMask = NSSingleSelectionMask;
-
-  [self selectionDidChange];
+  [self selectIconsPassingTest: ^BOOL (FSNIcon *icon) {
+    return [wanted containsObject: icon];
+  }];
 }
 
 - (void)selectRepsOfSubnodes:(NSArray *)nodes
 {
-  NSUInteger i;
-
-  selectionMask = NSSingleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  [self unselectOtherReps: nil];
-
-  selectionMask = FSNMultipleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  for (i = 0; i < [icons count]; i++)
-    {
-      FSNIcon *icon = [icons objectAtIndex: i];
-
-      if ([nodes containsObject: [icon node]])
-	{
-	  [icon select];
-	}
-    }
+  NSSet *wanted = [NSSet setWithArray: nodes];
 
-  selectionMask = NSSingleSelectionMask;
-
-  [self selectionDidChange];
+  [self selectIconsPassingTest: ^BOOL (FSNIcon *icon) {
+    return [wanted containsObject: [icon node]];
+  }];
 }
 
 - (void)selectRepsOfPaths:(NSArray *)paths
 {
-  NSUInteger i;
+  NSSet *wanted = [NSSet setWithArray: paths];
 
-  selectionMask = NSSingleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  [self unselectOtherReps: nil];
-
-  selectionMask = FSNMultipleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  for (i = 0; i < [icons count]; i++)
-    {
-      FSNIcon *icon = [icons objectAtIndex: i];
-
-      if ([paths containsObject: [[icon node] path]])
-	{
-	  [icon select];
-	}
-    }
-
-  selectionMask = NSSingleSelectionMask;
-
-  [self selectionDidChange];
+  [self selectIconsPassingTest: ^BOOL (FSNIcon *icon) {
+    return [wanted containsObject: [[icon node] path]];
+  }];
 }
 
 - (void)selectAll
 {
+  FSNSelectionSet *set = [self selectionSet];
+  NSUInteger count = [icons count];
   NSUInteger i;
 
-  selectionMask = NSSingleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
-
-  [self unselectOtherReps: nil];
-
-  selectionMask = FSNMultipleSelectionMask;
-  selectionMask |= FSNCreatingSelectionMask;
+  /* every position at once, then the reserved names taken away */
+  [set addAll];
 
-  for (i = 0; i < [icons count]; i++)
+  for (i = 0; i < count; i++)
     {
       FSNIcon *icon = [icons objectAtIndex: i];
-      FSNode *inode = [icon node];
 
-      if ([inode isReserved] == NO) {
-	[icon select];
-      }
+      if ([[icon node] isReserved])
+        [set removeIndex: i];
+
+      [icon setSelected: [set containsIndex: i]];
     }
 
+  DESTROY (_selectedReps);
+  DESTROY (_selectedNodes);
+  DESTROY (_selectedPaths);
+  [self setNeedsDisplayInRect: [self visibleRect]];
+
   selectionMask = NSSingleSelectionMask;
 
   [self selectionDidChange];
@@ -2666,32 +3158,34 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (NSArray *)selectedReps
 {
-  NSMutableArray *selectedReps = [NSMutableArray array];
-  NSUInteger i;
-
-  for (i = 0; i < [icons count]; i++)
+  if (_selectedReps == nil)
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
+      FSNSelectionSet *set = [self selectionSet];
+      NSMutableArray *selectedReps = [NSMutableArray arrayWithCapacity: [set selectedCount]];
+      NSUInteger i;
 
-      if ([icon isSelected])
+      for (i = [set firstIndex]; i != NSNotFound; i = [set indexGreaterThanIndex: i])
+	{
+	  [selectedReps addObject: [icons objectAtIndex: i]];
+	}
 
-	[selectedReps addObject: icon];
+      _selectedReps = [selectedReps copy];
     }
 
-  return [selectedReps makeImmutableCopyOnFail: NO];
+  return AUTORELEASE (RETAIN (_selectedReps));
 }
 
 - (NSArray *)selectedNodes
 {
-  NSMutableArray *selectedNodes = [NSMutableArray array];
-  NSUInteger i;
-
-  for (i = 0; i < [icons count]; i++)
+  if (_selectedNodes == nil)
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
+      NSArray *reps = [self selectedReps];
+      NSMutableArray *selectedNodes = [NSMutableArray arrayWithCapacity: [reps count]];
+      NSUInteger i;
 
-      if ([icon isSelected])
+      for (i = 0; i < [reps count]; i++)
 	{
+	  FSNIcon *icon = [reps objectAtIndex: i];
 	  NSArray *selection = [icon selection];
 
 	  if (selection)
@@ -2703,39 +3197,30 @@ static void GWHighlightFrameRect(NSRect aRect)
 	      [selectedNodes addObject: [icon node]];
 	    }
 	}
+
+      _selectedNodes = [selectedNodes copy];
     }
 
-  return [selectedNodes makeImmutableCopyOnFail: NO];
+  return AUTORELEASE (RETAIN (_selectedNodes));
 }
 
 - (NSArray *)selectedPaths
 {
-  NSMutableArray *selectedPaths = [NSMutableArray array];
-  NSUInteger i, j;
-
-  for (i = 0; i < [icons count]; i++)
+  if (_selectedPaths == nil)
     {
-      FSNIcon *icon = [icons objectAtIndex: i];
+      NSArray *nodes = [self selectedNodes];
+      NSMutableArray *selectedPaths = [NSMutableArray arrayWithCapacity: [nodes count]];
+      NSUInteger i;
 
-      if ([icon isSelected])
+      for (i = 0; i < [nodes count]; i++)
 	{
-	  NSArray *selection = [icon selection];
-
-	  if (selection)
-	    {
-	      for (j = 0; j < [selection count]; j++)
-		{
-		  [selectedPaths addObject: [[selection objectAtIndex: j] path]];
-		}
-	    }
-	  else
-	    {
-	      [selectedPaths addObject: [[icon node] path]];
-	    }
+	  [selectedPaths addObject: [[nodes objectAtIndex: i] path]];
 	}
+
+      _selectedPaths = [selectedPaths copy];
     }
 
-  return [selectedPaths makeImmutableCopyOnFail: NO];
+  return AUTORELEASE (RETAIN (_selectedPaths));
 }
 
 - (void)selectionDidChange
@@ -2904,41 +3389,36 @@ static void GWHighlightFrameRect(NSRect aRect)
 {
   NSPasteboard *pb;
   NSDragOperation sourceDragMask;
-  NSArray *sourcePaths;
+  FSNPasteboardPaths *pbpaths;
   NSString *basePath;
   NSString *nodePath;
-  NSString *prePath;
-  NSUInteger count;
 
   isDragTarget = NO;
 
   pb = [sender draggingPasteboard];
 
-  if (pb && [[pb types] containsObject: NSFilenamesPboardType])
-    {
-      sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
-    }
-  else if ([[pb types] containsObject: @"GWRemoteFilenamesPboardType"])
+  if ([[pb types] containsObject: @"GWRemoteFilenamesPboardType"]
+      && ([[pb types] containsObject: NSFilenamesPboardType] == NO))
     {
       NSData *pbData = [pb dataForType: @"GWRemoteFilenamesPboardType"];
       NSDictionary *pbDict = [NSUnarchiver unarchiveObjectWithData: pbData];
 
-      sourcePaths = [pbDict objectForKey: @"paths"];
+      pbpaths = [FSNPasteboardPaths pasteboardPathsWithPaths: [pbDict objectForKey: @"paths"]];
     }
-  else if ([[pb types] containsObject: @"GWLSFolderPboardType"])
+  else if ([[pb types] containsObject: @"GWLSFolderPboardType"]
+           && ([[pb types] containsObject: NSFilenamesPboardType] == NO))
     {
       NSData *pbData = [pb dataForType: @"GWLSFolderPboardType"];
       NSDictionary *pbDict = [NSUnarchiver unarchiveObjectWithData: pbData];
 
-      sourcePaths = [pbDict objectForKey: @"paths"];
+      pbpaths = [FSNPasteboardPaths pasteboardPathsWithPaths: [pbDict objectForKey: @"paths"]];
     }
   else
     {
-      return NSDragOperationNone;
+      pbpaths = FSNPathsOnPasteboard(pb);
     }
 
-  count = [sourcePaths count];
-  if (count == 0)
+  if ([pbpaths count] == 0)
     {
       return NSDragOperationNone;
     }
@@ -2950,55 +3430,27 @@ static void GWHighlightFrameRect(NSRect aRect)
 
   nodePath = [node path];
 
-  basePath = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
-  if ([basePath isEqual: nodePath])
+  basePath = [pbpaths source];
+  if (basePath == nil)
     {
-      return NSDragOperationNone;
+      basePath = [[[pbpaths paths] objectAtIndex: 0] stringByDeletingLastPathComponent];
     }
-
-  if ([sourcePaths containsObject: nodePath])
+  if ([basePath isEqual: nodePath])
     {
       return NSDragOperationNone;
     }
 
-  prePath = [NSString stringWithString: nodePath];
-
-  while (1)
+  /* dropping into one of the files dragged, or into a folder in one */
+  if ([pbpaths containsPathOrAncestorOfPath: nodePath])
     {
-      if ([sourcePaths containsObject: prePath])
-	{
-	  return NSDragOperationNone;
-	}
-      if ([prePath isEqual: path_separator()])
-	{
-	  break;
-	}
-      prePath = [prePath stringByDeletingLastPathComponent];
+      return NSDragOperationNone;
     }
 
-  if ([node isDirectory] && [node isParentOfPath: basePath])
+  /* a sample only, the file operation checks each name */
+  if ([node isDirectory] && [node isParentOfPath: basePath]
+      && [pbpaths sampleMeetsFolderInDirectory: nodePath])
     {
-      NSArray *subNodes = [node subNodes];
-      NSUInteger i;
-
-      for (i = 0; i < [subNodes count]; i++)
-	{
-	  FSNode *nd = [subNodes objectAtIndex: i];
-
-	  if ([nd isDirectory]) {
-	    NSUInteger j;
-
-	    for (j = 0; j < count; j++)
-	      {
-		NSString *fname = [[sourcePaths objectAtIndex: j] lastPathComponent];
-
-		if ([[nd name] isEqual: fname])
-		  {
-		    return NSDragOperationNone;
-		  }
-	      }
-	  }
-	}
+      return NSDragOperationNone;
     }
 
   isDragTarget = YES;
@@ -3138,13 +3590,12 @@ static void GWHighlightFrameRect(NSRect aRect)
 - (void)concludeDragOperation:(id <NSDraggingInfo>)sender
 {
   NSPasteboard *pb;
-  NSArray *sourcePaths;
+  FSNPasteboardPaths *pbpaths;
   NSString *operation;
   NSString *source;
-  NSMutableArray *files;
+  NSArray *files;
   NSMutableDictionary *opDict;
   NSString *trashPath;
-  NSUInteger i;
 
   isDragTarget = NO;
   operation = nil;
@@ -3168,14 +3619,18 @@ static void GWHighlightFrameRect(NSRect aRect)
       return;
     }
 
-  sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
+  pbpaths = FSNPathsOnPasteboard(pb);
 
-  if ([sourcePaths count] == 0)
+  if ([pbpaths count] == 0)
     {
       return;
     }
 
-  source = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+  source = [pbpaths source];
+  if (source == nil)
+    {
+      source = [[[pbpaths paths] objectAtIndex: 0] stringByDeletingLastPathComponent];
+    }
 
   trashPath = [desktopApp trashPath];
 
@@ -3202,10 +3657,18 @@ static void GWHighlightFrameRect(NSRect aRect)
 	}
     }
 
-  files = [NSMutableArray array];
-  for(i = 0; i < [sourcePaths count]; i++)
+  files = [pbpaths names];
+  if (files == nil)
     {
-      [files addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+      NSArray *sourcePaths = [pbpaths paths];
+      NSMutableArray *names = [NSMutableArray arrayWithCapacity: [sourcePaths count]];
+      NSUInteger i;
+
+      for (i = 0; i < [sourcePaths count]; i++)
+        {
+          [names addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+        }
+      files = names;
     }
 
   opDict = [NSMutableDictionary dictionary];
@@ -0,0 +1,51 @@
+/* FSNImageDecode.h
+ *
+ * Images decoded at the size they are shown at, for thumbnails and the
+ * Inspector.
+ *
+ * A JPEG is decoded by libjpeg scaled down by 1/2, 1/4 or 1/8 in the
+ * DCT, the smallest scale that still covers the size asked for, so a 40
+ * megapixel photo shown in a pane of a few hundred pixels costs well
+ * under a megapixel of memory and the time of that.  Other images, and
+ * JPEGs in CMYK or built without libjpeg, are decoded whole by NSImage;
+ * the box filter of FSNRaster then brings any of them to the size shown.
+ * Safe to use off the main thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_IMAGE_DECODE_H
+#define FSN_IMAGE_DECODE_H
+
+#import <Foundation/Foundation.h>
+
+@class NSBitmapImageRep;
+
+/* The JPEG at `path` decoded at the smallest DCT scale whose larger side
+ * is still `side` pixels or more; `fullSize`, when not NULL, gets the
+ * size of the whole image.  nil for a file that is not a JPEG, is in
+ * CMYK, or cannot be decoded this way.  `cancelled`, when not nil, is
+ * asked every few scanlines; when it answers YES the decode stops and
+ * this returns nil. */
+NSBitmapImageRep *FSNDecodeScaledJPEGAtPath(NSString *path,
+                                            NSUInteger side,
+                                            NSSize *fullSize,
+                                            BOOL (^cancelled)(void));
+
+/* The image at `path` as a bitmap covering `side` pixels where the
+ * decoder allows it (FSNDecodeScaledJPEGAtPath), whole otherwise. */
+NSBitmapImageRep *FSNDecodeImageAtPath(NSString *path,
+                                       NSUInteger side,
+                                       NSSize *fullSize,
+                                       BOOL (^cancelled)(void));
+
+/* The bitmap as 8 bit interleaved samples, as FSNRaster wants them:
+ * `rep` itself nearly always, a converted copy for 16 bit, planar or
+ * packed samples.  nil for more than 4 samples per pixel. */
+NSBitmapImageRep *FSNMeshedBitmap(NSBitmapImageRep *rep);
+
+/* `rep` scaled down with FSNRasterDownscale to fit `box`, keeping its
+ * aspect; `rep` itself when it fits already. */
+NSBitmapImageRep *FSNBitmapFittingSize(NSBitmapImageRep *rep, NSSize box);
+
+#endif /* FSN_IMAGE_DECODE_H */
@@ -0,0 +1,293 @@
+/* FSNImageDecode.m
+ *
+ * Images decoded at the size they are shown at.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#include <math.h>
+#include <stdio.h>
+#include <setjmp.h>
+#ifdef HAVE_LIBJPEG
+#include <jpeglib.h>
+#endif
+
+#import "FSNImageDecode.h"
+#import "FSNRaster.h"
+
+/* scanlines decoded between two questions to the cancel block */
+#define DECODE_CANCEL_LINES 64
+
+static BOOL
+isJPEGPath(NSString *path)
+{
+  NSString *ext = [[path pathExtension] lowercaseString];
+
+  return ([ext isEqual: @"jpg"] || [ext isEqual: @"jpeg"]
+          || [ext isEqual: @"jpe"] || [ext isEqual: @"jfif"]);
+}
+
+#ifdef HAVE_LIBJPEG
+typedef struct
+{
+  struct jpeg_error_mgr pub;
+  jmp_buf jump;
+} FSNJPEGError;
+
+static void
+jpegErrorExit(j_common_ptr cinfo)
+{
+  FSNJPEGError *err = (FSNJPEGError *)cinfo->err;
+  longjmp(err->jump, 1);
+}
+
+static void
+jpegOutputMessage(j_common_ptr cinfo)
+{
+}
+#endif
+
+
+NSBitmapImageRep *
+FSNDecodeScaledJPEGAtPath(NSString *path, NSUInteger side,
+                          NSSize *fullSize, BOOL (^cancelled)(void))
+{
+#ifdef HAVE_LIBJPEG
+  struct jpeg_decompress_struct cinfo;
+  FSNJPEGError jerr;
+  NSBitmapImageRep * volatile rep = nil;
+  FILE * volatile fp;
+  unsigned denom;
+  unsigned long longest;
+
+  if (isJPEGPath(path) == NO)
+    return nil;
+
+  fp = fopen([path fileSystemRepresentation], "rb");
+  if (fp == NULL)
+    return nil;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = jpegErrorExit;
+  jerr.pub.output_message = jpegOutputMessage;
+
+  if (setjmp(jerr.jump))
+    {
+      jpeg_destroy_decompress(&cinfo);
+      fclose(fp);
+      RELEASE (rep);
+      NSDebugLLog(@"gwspace", @"libjpeg failed on %@", path);
+      return nil;
+    }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, fp);
+
+  if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK
+      || cinfo.jpeg_color_space == JCS_CMYK
+      || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+      jpeg_destroy_decompress(&cinfo);
+      fclose(fp);
+      return nil;
+    }
+
+  if (fullSize)
+    *fullSize = NSMakeSize(cinfo.image_width, cinfo.image_height);
+
+  longest = MAX(cinfo.image_width, cinfo.image_height);
+  for (denom = 8; denom > 1; denom /= 2)
+    {
+      if ((longest + denom - 1) / denom >= side)
+        break;
+    }
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.out_color_space = (cinfo.num_components == 1) ? JCS_GRAYSCALE : JCS_RGB;
+  cinfo.dct_method = JDCT_IFAST;
+  cinfo.do_fancy_upsampling = FALSE;
+
+  jpeg_start_decompress(&cinfo);
+
+  rep = [[NSBitmapImageRep alloc]
+          initWithBitmapDataPlanes: NULL
+                        pixelsWide: cinfo.output_width
+                        pixelsHigh: cinfo.output_height
+                     bitsPerSample: 8
+                   samplesPerPixel: cinfo.output_components
+                          hasAlpha: NO
+                          isPlanar: NO
+                    colorSpaceName: ((cinfo.output_components == 1)
+                                     ? NSDeviceWhiteColorSpace
+                                     : NSDeviceRGBColorSpace)
+                       bytesPerRow: 0
+                      bitsPerPixel: 0];
+
+  while (cinfo.output_scanline < cinfo.output_height)
+    {
+      JSAMPROW row = [rep bitmapData] + cinfo.output_scanline * [rep bytesPerRow];
+
+      if (cancelled && ((cinfo.output_scanline % DECODE_CANCEL_LINES) == 0)
+          && cancelled())
+        {
+          jpeg_destroy_decompress(&cinfo);
+          fclose(fp);
+          RELEASE (rep);
+          return nil;
+        }
+
+      jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(fp);
+
+  return AUTORELEASE (rep);
+#else
+  return nil;
+#endif
+}
+
+NSBitmapImageRep *
+FSNDecodeImageAtPath(NSString *path, NSUInteger side,
+                     NSSize *fullSize, BOOL (^cancelled)(void))
+{
+  NSBitmapImageRep *rep = FSNDecodeScaledJPEGAtPath(path, side, fullSize, cancelled);
+  NSImage *image;
+
+  if (rep || (cancelled && cancelled()))
+    return rep;
+
+  image = [[NSImage alloc] initWithContentsOfFile: path];
+
+  if (image && [image isValid])
+    {
+      NSEnumerator *repEnum = [[image representations] objectEnumerator];
+      NSImageRep *imgRep;
+
+      while ((rep == nil) && (imgRep = [repEnum nextObject]))
+        {
+          if ([imgRep isKindOfClass: [NSBitmapImageRep class]])
+            rep = (NSBitmapImageRep *)imgRep;
+        }
+
+      if (rep && fullSize)
+        *fullSize = NSMakeSize([rep pixelsWide], [rep pixelsHigh]);
+    }
+
+  /* the rep outlives its image */
+  RETAIN (rep);
+  RELEASE (image);
+
+  return AUTORELEASE (rep);
+}
+
+NSBitmapImageRep *
+FSNMeshedBitmap(NSBitmapImageRep *srcRep)
+{
+  NSInteger spp = [srcRep samplesPerPixel];
+  NSInteger bps = [srcRep bitsPerSample];
+  NSInteger w = [srcRep pixelsWide];
+  NSInteger h = [srcRep pixelsHigh];
+  NSBitmapImageRep *rep;
+  NSUInteger maxval;
+  NSInteger x, y, i;
+
+  if (spp < 1 || spp > 4 || bps < 1 || bps > 16)
+    return nil;
+
+  if (bps == 8 && [srcRep isPlanar] == NO
+      && [srcRep bitsPerPixel] == 8 * spp)
+    return srcRep;
+
+  rep = [[NSBitmapImageRep alloc]
+          initWithBitmapDataPlanes: NULL
+                        pixelsWide: w
+                        pixelsHigh: h
+                     bitsPerSample: 8
+                   samplesPerPixel: spp
+                          hasAlpha: [srcRep hasAlpha]
+                          isPlanar: NO
+                    colorSpaceName: [srcRep colorSpaceName]
+                       bytesPerRow: 0
+                      bitsPerPixel: 0];
+  AUTORELEASE (rep);
+
+  maxval = (1 << bps) - 1;
+
+  for (y = 0; y < h; y++)
+    {
+      unsigned char *row = [rep bitmapData] + y * [rep bytesPerRow];
+
+      for (x = 0; x < w; x++)
+        {
+          NSUInteger pixel[5];
+
+          [srcRep getPixel: pixel atX: x y: y];
+          for (i = 0; i < spp; i++)
+            *row++ = (unsigned char)((pixel[i] * 255 + maxval / 2) / maxval);
+        }
+    }
+
+  return rep;
+}
+
+NSBitmapImageRep *
+FSNBitmapFittingSize(NSBitmapImageRep *srcRep, NSSize box)
+{
+  NSInteger srcSizeW = [srcRep pixelsWide];
+  NSInteger srcSizeH = [srcRep pixelsHigh];
+  NSInteger dstSizeW, dstSizeH;
+  NSBitmapImageRep *meshed;
+  NSBitmapImageRep *dstRep;
+
+  if ((srcSizeW <= 0) || (srcSizeH <= 0) || (box.width < 1) || (box.height < 1))
+    return nil;
+
+  if ((srcSizeW <= box.width) && (srcSizeH <= box.height))
+    return srcRep;
+
+  if ((box.width / srcSizeW) <= (box.height / srcSizeH))
+    {
+      dstSizeW = (NSInteger)floor(box.width + 0.5);
+      dstSizeH = (NSInteger)floor(dstSizeW * srcSizeH / (double)srcSizeW + 0.5);
+    }
+  else
+    {
+      dstSizeH = (NSInteger)floor(box.height + 0.5);
+      dstSizeW = (NSInteger)floor(dstSizeH * srcSizeW / (double)srcSizeH + 0.5);
+    }
+
+  dstSizeW = MAX(1, MIN(dstSizeW, srcSizeW));
+  dstSizeH = MAX(1, MIN(dstSizeH, srcSizeH));
+
+  meshed = FSNMeshedBitmap(srcRep);
+  if (meshed == nil)
+    return nil;
+
+  dstRep = [[NSBitmapImageRep alloc]
+             initWithBitmapDataPlanes: NULL
+                           pixelsWide: dstSizeW
+                           pixelsHigh: dstSizeH
+                        bitsPerSample: 8
+                      samplesPerPixel: [meshed samplesPerPixel]
+                             hasAlpha: [meshed hasAlpha]
+                             isPlanar: NO
+                       colorSpaceName: [meshed colorSpaceName]
+                          bytesPerRow: 0
+                         bitsPerPixel: 0];
+  AUTORELEASE (dstRep);
+
+  if (FSNRasterDownscale([meshed bitmapData], srcSizeW, srcSizeH,
+                         [meshed bytesPerRow],
+                         [dstRep bitmapData], dstSizeW, dstSizeH,
+                         [dstRep bytesPerRow],
+                         (unsigned)[meshed samplesPerPixel]) == NO)
+    return nil;
+
+  return dstRep;
+}
@@ -36,6 +36,7 @@
 @class FSNListView;
 @class FSNListViewNodeRep;
 @class FSNListViewNameEditor;
+@class FSNPrefixIndex;
 
 @interface FSNListViewDataSource : NSObject <NSTextFieldDelegate>
 {
@@ -43,11 +44,19 @@
 
   FSNode *node;
   NSMutableArray *nodeReps;
+  FSNPrefixIndex *prefixIndex;  /* type-ahead, dropped when nodeReps change */
   FSNInfoType hlighColId;
   NSString *extInfoType;
 
   NSArray *lastSelection;
 
+  /* the selected reps, nodes and paths, kept while the rows selected,
+     and the reps, stay the same */
+  NSIndexSet *selectedRows;
+  NSArray *selectedRepsCache;
+  NSArray *selectedNodesCache;
+  NSArray *selectedPathsCache;
+
   NSUInteger mouseFlags;
   BOOL isDragTarget;
   BOOL forceCopy;
@@ -61,6 +70,8 @@
   FSNodeRep *fsnodeRep;
 
   id <DesktopApplication> desktopApp;
+
+  NSInteger hintFirstRow;  /* first visible row of the last thumbnail hint */
 }
 
 - (id)initForListView:(FSNListView *)aview;
@@ -83,8 +94,14 @@
 
 - (NSDictionary *)columnsDescription;
 
+- (SEL)sortingSelector;
+
 - (void)sortNodeReps;
 
+- (NSDictionary *)nodeRepsByName;
+
+- (void)insertNodeRepsSorted:(NSArray *)changed;
+
 - (void)setMouseFlags:(NSUInteger)flags;
 
 - (void)doubleClickOnListView:(id)sender;
@@ -105,6 +122,10 @@
 
 - (void)redisplayRep:(id)aRep;
 
+/* Tell the thumbnail scheduler which rows are visible and which lie one
+   screen ahead in the direction of the last scroll. */
+- (void)updateThumbnailsPriority;
+
 - (id)desktopApp;
 
 @end
@@ -319,6 +340,8 @@
   NSTimeInterval lastKeyPressedTime;
 
   NSTimer *clickTimer;
+
+  NSView *observedClipView;  /* not retained, observed for scrolling */
 }
 
 - (id)initWithFrame:(NSRect)frameRect
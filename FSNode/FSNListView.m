@@ -31,7 +31,13 @@
 #import "FSNListView.h"
 #import "FSNTextCell.h"
 #import "FSNFunctions.h"
+#import "FSNSortKeys.h"
+#import "FSNPrefixIndex.h"
+#import "FSNPrefetcher.h"
+#import "FSNTrace.h"
+#import "FSNThumbnailScheduler.h"
 #import "FSNMetadataProvider.h"
+#import "FSNRepNames.h"
 
 #define ICNSIZE (24)
 #define CELLS_HEIGHT (28.0)
@@ -75,9 +81,17 @@ static NSString *defaultColumns = @"{ \
   [[NSNotificationCenter defaultCenter] removeObserver: self
                                                   name: NSUserDefaultsDidChangeNotification
                                                 object: nil];
+  [[fsnodeRep thumbnailScheduler] prioritizeVisiblePaths: nil
+                                              aheadPaths: nil
+                                                 forView: self];
   RELEASE (node);
   RELEASE (extInfoType);
   RELEASE (nodeReps);
+  RELEASE (prefixIndex);
+  RELEASE (selectedRows);
+  RELEASE (selectedRepsCache);
+  RELEASE (selectedNodesCache);
+  RELEASE (selectedPathsCache);
   RELEASE (nameEditor);
   RELEASE (lastSelection);
 
@@ -132,6 +146,7 @@ static NSString *defaultColumns = @"{ \
 
       mouseFlags = 0;
       isDragTarget = NO;
+      hintFirstRow = -1;
 
       [[NSNotificationCenter defaultCenter]
         addObserver: self
@@ -322,38 +337,38 @@ static NSString *defaultColumns = @"{ \
   return colsinfo;
 }
 
+- (SEL)sortingSelector
+{
+  switch(hlighColId)
+    {
+    case FSNInfoKindType:
+      return @selector(compareAccordingToKind:);
+    case FSNInfoDateType:
+      return @selector(compareAccordingToDate:);
+    case FSNInfoSizeType:
+      return @selector(compareAccordingToSize:);
+    case FSNInfoOwnerType:
+      return @selector(compareAccordingToOwner:);
+    case FSNInfoNameType:
+    default:
+      return @selector(compareAccordingToName:);
+    }
+}
+
 - (void)sortNodeReps
 {
   NSTableColumn *column;
 
-  if (hlighColId != FSNInfoExtendedType)
-    {
-      SEL sortingSel;
+  DESTROY (prefixIndex);
 
-      switch(hlighColId)
-	{
-	case FSNInfoNameType:
-	  sortingSel = @selector(compareAccordingToName:);
-	  break;
-	case FSNInfoKindType:
-	  sortingSel = @selector(compareAccordingToKind:);
-	  break;
-	case FSNInfoDateType:
-	  sortingSel = @selector(compareAccordingToDate:);
-	  break;
-	case FSNInfoSizeType:
-	  sortingSel = @selector(compareAccordingToSize:);
-	  break;
-	case FSNInfoOwnerType:
-	  sortingSel = @selector(compareAccordingToOwner:);
-	  break;
-	default:
-	  sortingSel = @selector(compareAccordingToName:);
-	  break;
-	}
+  DESTROY (selectedRows);
 
-      [nodeReps sortUsingSelector: sortingSel];
+  if (hlighColId != FSNInfoExtendedType)
+    {
+      SEL sel = [self sortingSelector];
 
+      if (FSNSortRepsUsingSelector(nodeReps, sel) == NO)
+        [nodeReps sortUsingSelector: sel];
     }
   else
     {
@@ -368,6 +383,37 @@ static NSString *defaultColumns = @"{ \
     }
 }
 
+/* file name -> rep, for resolving a batch of fswatcher names without
+ * a linear scan per name. */
+- (NSDictionary *)nodeRepsByName
+{
+  return FSNRepsByFileName(nodeReps);
+}
+
+/* Moves each of `changed` to its sorted position by binary search; the
+ * other reps are already sorted, so the folder is not re-sorted. */
+- (void)insertNodeRepsSorted:(NSArray *)changed
+{
+  SEL sel = [self sortingSelector];
+  NSComparisonResult (*func)(id, id, void *) = NULL;
+  NSUInteger i;
+
+  if (hlighColId == FSNInfoExtendedType)
+    func = compareWithExtType;
+
+  [nodeReps removeObjectsInArray: changed];
+  DESTROY (prefixIndex);
+  DESTROY (selectedRows);
+
+  for (i = 0; i < [changed count]; i++)
+    {
+      FSNListViewNodeRep *rep = [changed objectAtIndex: i];
+      NSUInteger index = FSNSortedInsertionIndex(nodeReps, rep, sel, func);
+
+      [nodeReps insertObject: rep atIndex: index];
+    }
+}
+
 - (void)setMouseFlags:(NSUInteger)flags
 {
   mouseFlags = flags;
@@ -439,21 +485,47 @@ static NSString *defaultColumns = @"{ \
 
 - (NSString *)selectRepWithPrefix:(NSString *)prefix
 {
-  NSUInteger i;
+  NSString *folded = [FSNPrefixIndex foldedString: prefix];
+  NSUInteger i = NSNotFound;
+  int pass;
 
-  for (i = 0; i < [nodeReps count]; i++)
+  /* a hit is checked against the rep, and a stale index rebuilt once */
+  for (pass = 0; pass < 2; pass++)
     {
-      FSNListViewNodeRep *rep = [nodeReps objectAtIndex: i];
-      NSString *name = [[rep node] name];
-
-      if ([name rangeOfString: prefix options: NSCaseInsensitiveSearch].location == 0)
+      if (prefixIndex == nil)
         {
-          [listView deselectAll: self];
-          [self selectReps: [NSArray arrayWithObject: rep]];
-          [listView scrollRowToVisible: i];
+          NSMutableArray *names = [NSMutableArray arrayWithCapacity: [nodeReps count]];
+          NSUInteger j;
+
+          for (j = 0; j < [nodeReps count]; j++)
+            [names addObject: [[[nodeReps objectAtIndex: j] node] name]];
 
-          return name;
+          prefixIndex = [[FSNPrefixIndex alloc] initWithNames: names];
         }
+
+      i = [prefixIndex firstIndexWithPrefix: prefix];
+
+      if ((i == NSNotFound) && ([prefixIndex count] == [nodeReps count]))
+        return nil;
+
+      if ((i != NSNotFound) && (i < [nodeReps count])
+          && [[FSNPrefixIndex foldedString: [[[nodeReps objectAtIndex: i] node] name]] hasPrefix: folded])
+        break;
+
+      i = NSNotFound;
+      DESTROY (prefixIndex);
+      DESTROY (selectedRows);
+    }
+
+  if (i != NSNotFound)
+    {
+      FSNListViewNodeRep *rep = [nodeReps objectAtIndex: i];
+
+      [listView deselectAll: self];
+      [self selectReps: [NSArray arrayWithObject: rep]];
+      [listView scrollRowToVisible: i];
+
+      return [[rep node] name];
     }
 
   return nil;
@@ -542,11 +614,7 @@ objectValueForTableColumn:(NSTableColumn *)aTableColumn
       [paths addObject: [[rep node] path]];
     }
 
-  [pboard declareTypes: [NSArray arrayWithObject: NSFilenamesPboardType]
-		 owner: nil];
-  [pboard setPropertyList: paths forType: NSFilenamesPboardType];
-
-  return YES;
+  return FSNWritePathsToPasteboard(paths, pboard);
 }
 
 - (NSDragOperation)tableView:(NSTableView *)tableView
@@ -690,6 +758,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 - (void)showContentsOfNode:(FSNode *)anode
 {
+  FSN_TRACE_SCOPE ("FSNListView showContentsOfNode");
   NSDictionary *info = nil;
   NSDictionary *colsInfo = nil;
   NSDictionary *colsDescr;
@@ -734,8 +803,11 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
   [listView deselectAll: self];
 
-  nodes = [anode subNodes];
+  /* the list shows sizes and dates, so load them in the listing pass */
+  nodes = [anode subNodesWithTier: FSNLoadTierStat];
   [nodeReps removeAllObjects];
+  DESTROY (prefixIndex);
+  DESTROY (selectedRows);
 
   for (i = 0; i < [nodes count]; i++)
     {
@@ -745,6 +817,9 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   [self sortNodeReps];
   [listView reloadData];
 
+  hintFirstRow = -1;
+  [self updateThumbnailsPriority];
+
   DESTROY (lastSelection);
   [self selectionDidChange];
 }
@@ -752,9 +827,8 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 - (NSDictionary *)readNodeInfo
 {
   FSNode *infoNode = [self infoNode];
-  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
   NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [infoNode path]];
-  NSDictionary *nodeDict = [defaults dictionaryForKey: prefsname];
+  NSDictionary *nodeDict = [fsnodeRep viewerPrefsForKey: prefsname];
 
   if (nodeDict)
     {
@@ -765,7 +839,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
       if (entry)
 	{
-	  NSArray *availableTypes = [[FSNodeRep sharedInstance] availableExtendedInfoNames];
+	  NSArray *availableTypes = [fsnodeRep availableExtendedInfoNames];
 
 	  if ([availableTypes containsObject: entry]) {
 	    ASSIGN (extInfoType, entry);
@@ -784,10 +858,9 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
   if ([infoNode isValid])
     {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
       NSString *prefsname = [NSString stringWithFormat: @"viewer_at_%@", [infoNode path]];
 
-      NSDictionary *prefs = [defaults dictionaryForKey: prefsname];
+      NSDictionary *prefs = [fsnodeRep viewerPrefsForKey: prefsname];
       if (prefs)
         updatedInfo = [prefs mutableCopy];
       else
@@ -805,7 +878,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 	}
 
       if (ondisk)
-        [defaults setObject: updatedInfo forKey: prefsname];
+        [fsnodeRep setViewerPrefs: updatedInfo forKey: prefsname];
     }
 
   RELEASE (arp);
@@ -815,6 +888,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 - (void)reloadContents
 {
+  FSN_TRACE_SCOPE ("FSNListView reloadContents");
   CREATE_AUTORELEASE_POOL (pool);
   NSMutableArray *selection = [[self selectedNodes] mutableCopy];
   NSMutableArray *opennodes = [NSMutableArray array];
@@ -943,6 +1017,8 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   NSString *destination = [info objectForKey: @"destination"];
   NSArray *files = [info objectForKey: @"files"];
   NSString *ndpath = [node path];
+  NSMutableArray *changed = [NSMutableArray array];
+  NSDictionary *reps;
   BOOL needsreload = NO;
   NSUInteger i;
 
@@ -972,11 +1048,18 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 	  files = [info objectForKey: @"origfiles"];
 	}
 
+	reps = [self nodeRepsByName];
+
 	for (i = 0; i < [files count]; i++)
 	  {
-	    NSString *fname = [files objectAtIndex: i];
-	    FSNode *subnode = [FSNode nodeWithRelativePath: fname parent: node];
-	    [self removeRepOfSubnode: subnode];
+	    FSNListViewNodeRep *rep = [reps objectForKey: [files objectAtIndex: i]];
+
+	    if (rep)
+	      {
+	        [nodeReps removeObjectIdenticalTo: rep];
+	        DESTROY (prefixIndex);
+	        DESTROY (selectedRows);
+	      }
 	  }
 	needsreload = YES;
       }
@@ -1005,11 +1088,13 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 	  files = [info objectForKey: @"files"];
 	}
 
+      reps = [self nodeRepsByName];
+
       for (i = 0; i < [files count]; i++)
 	{
 	  NSString *fname = [files objectAtIndex: i];
 	  FSNode *subnode = [FSNode nodeWithRelativePath: fname parent: node];
-	  FSNListViewNodeRep *rep = [self repOfSubnode: subnode];
+	  FSNListViewNodeRep *rep = [reps objectForKey: fname];
 
 	  if (rep)
 	    {
@@ -1017,9 +1102,11 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 	    }
 	  else
 	    {
-	      [self addRepForSubnode: subnode];
+	      rep = [self addRepForSubnode: subnode];
 	    }
+	  [changed addObject: rep];
 	}
+      [self insertNodeRepsSorted: changed];
       needsreload = YES;
     }
 
@@ -1027,7 +1114,6 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
   if (needsreload)
     {
-      [self sortNodeReps];
       [listView reloadData];
 
       if ([[listView window] isKeyWindow])
@@ -1059,23 +1145,34 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 {
   NSString *event = [info objectForKey: @"event"];
   NSArray *files = [info objectForKey: @"files"];
-  NSString *ndpath = [node path];
   BOOL needsreload = NO;
-  int i;
+  NSUInteger i;
 
+  /* Only the reps named by the event are touched; new ones are inserted
+   * at their sorted position instead of re-sorting the folder. */
   if ([event isEqual: @"GWFileDeletedInWatchedDirectory"])
     {
+      NSDictionary *reps = [self nodeRepsByName];
+
       for (i = 0; i < [files count]; i++)
 	{
-	  NSString *fname = [files objectAtIndex: i];
-	  NSString *fpath = [ndpath stringByAppendingPathComponent: fname];
-	  [self removeRepOfSubnodePath: fpath];
+	  FSNListViewNodeRep *rep = [reps objectForKey: [files objectAtIndex: i]];
+
+	  if (rep)
+	    {
+	      [nodeReps removeObjectIdenticalTo: rep];
+	      DESTROY (prefixIndex);
+	      DESTROY (selectedRows);
+	    }
 	}
       needsreload = YES;
 
     }
   else if ([event isEqual: @"GWFileCreatedInWatchedDirectory"])
     {
+      NSDictionary *reps = [self nodeRepsByName];
+      NSMutableArray *changed = [NSMutableArray array];
+
       for (i = 0; i < [files count]; i++)
 	{
 	  NSString *fname = [files objectAtIndex: i];
@@ -1083,7 +1180,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 	  if (subnode && [subnode isValid])
 	    {
-	      FSNListViewNodeRep *rep = [self repOfSubnode: subnode];
+	      FSNListViewNodeRep *rep = [reps objectForKey: fname];
 
 	      if (rep)
 		{
@@ -1091,15 +1188,16 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 		}
 	      else
 		{
-		  [self addRepForSubnode: subnode];
+		  rep = [self addRepForSubnode: subnode];
 		}
+	      [changed addObject: rep];
 	    }
 	}
 
+      [self insertNodeRepsSorted: changed];
       needsreload = YES;
     }
 
-  [self sortNodeReps];
   if (needsreload)
     {
       [listView deselectAll: self];
@@ -1250,6 +1348,8 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   FSNListViewNodeRep *rep = [[FSNListViewNodeRep alloc] initForNode: anode
                                                          dataSource: self];
   [nodeReps addObject: rep];
+  DESTROY (prefixIndex);
+  DESTROY (selectedRows);
   RELEASE (rep);
 
   return rep;
@@ -1262,6 +1362,8 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   if (rep)
     {
       [nodeReps removeObject: rep];
+      DESTROY (prefixIndex);
+      DESTROY (selectedRows);
     }
 }
 
@@ -1272,6 +1374,8 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   if (rep)
     {
       [nodeReps removeObject: rep];
+      DESTROY (prefixIndex);
+      DESTROY (selectedRows);
     }
 }
 
@@ -1292,17 +1396,16 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 - (void)selectReps:(NSArray *)reps
 {
+  NSSet *wanted = [NSSet setWithArray: reps];
   NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
   NSUInteger i;
 
-  for (i = 0; i < [reps count]; i++)
+  for (i = 0; i < [nodeReps count]; i++)
     {
-      FSNListViewNodeRep *rep = [reps objectAtIndex: i];
-      NSUInteger index = [nodeReps indexOfObjectIdenticalTo: rep];
-
-      if (index != NSNotFound) {
-	[set addIndex: index];
-      }
+      if ([wanted containsObject: [nodeReps objectAtIndex: i]])
+	{
+	  [set addIndex: i];
+	}
     }
 
   if ([set count])
@@ -1315,6 +1418,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 - (void)selectRepsOfSubnodes:(NSArray *)nodes
 {
+  NSSet *wanted = [NSSet setWithArray: nodes];
   NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
   NSUInteger i;
 
@@ -1322,7 +1426,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
     {
       FSNListViewNodeRep *rep = [nodeReps objectAtIndex: i];
 
-      if ([nodes containsObject: [rep node]])
+      if ([wanted containsObject: [rep node]])
         {
           [set addIndex: i];
         }
@@ -1338,6 +1442,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 
 - (void)selectRepsOfPaths:(NSArray *)paths
 {
+  NSSet *wanted = [NSSet setWithArray: paths];
   NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
   NSUInteger i;
 
@@ -1345,7 +1450,7 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
     {
       FSNListViewNodeRep *rep = [nodeReps objectAtIndex: i];
 
-      if ([paths containsObject: [[rep node] path]])
+      if ([wanted containsObject: [[rep node] path]])
 	{
 	  [set addIndex: i];
 	}
@@ -1364,13 +1469,16 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
   NSMutableIndexSet *set = [NSMutableIndexSet indexSet];
   NSUInteger i;
 
+  /* one range, less the reserved names */
+  [set addIndexesInRange: NSMakeRange(0, [nodeReps count])];
+
   for (i = 0; i < [nodeReps count]; i++)
     {
       FSNListViewNodeRep *rep = [nodeReps objectAtIndex: i];
 
-      if ([[rep node] isReserved] == NO)
+      if ([[rep node] isReserved])
 	{
-	  [set addIndex: i];
+	  [set removeIndex: i];
 	}
     }
 
@@ -1403,42 +1511,65 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
 - (NSArray *)selectedReps
 {
   NSIndexSet *set = [listView selectedRowIndexes];
-  NSMutableArray *selreps = [NSMutableArray array];
 
-  NSUInteger i;
-  for (i = [set firstIndex]; i != NSNotFound; i = [set indexGreaterThanIndex: i])
+  /* an index set compares by its ranges: a select all is one */
+  if ((selectedRows == nil) || ([selectedRows isEqual: set] == NO))
     {
-      [selreps addObject: [nodeReps objectAtIndex: i]];
+      NSMutableArray *selreps = [NSMutableArray arrayWithCapacity: [set count]];
+      NSUInteger i;
+
+      for (i = [set firstIndex]; i != NSNotFound; i = [set indexGreaterThanIndex: i])
+	{
+	  [selreps addObject: [nodeReps objectAtIndex: i]];
+	}
+
+      ASSIGN (selectedRows, AUTORELEASE ([set copy]));
+      ASSIGN (selectedRepsCache, AUTORELEASE ([selreps copy]));
+      DESTROY (selectedNodesCache);
+      DESTROY (selectedPathsCache);
     }
-  return [NSArray arrayWithArray: selreps];
+
+  return AUTORELEASE (RETAIN (selectedRepsCache));
 }
 
 - (NSArray *)selectedNodes
 {
-  NSMutableArray *selnodes = [NSMutableArray array];
+  NSArray *reps = [self selectedReps];
 
-  NSEnumerator *e = [[self selectedReps] objectEnumerator];
-  id rep;
-  while ((rep = [e nextObject]) != nil)
+  if (selectedNodesCache == nil)
     {
-      [selnodes addObject: [rep node]];
+      NSMutableArray *selnodes = [NSMutableArray arrayWithCapacity: [reps count]];
+      NSUInteger i;
+
+      for (i = 0; i < [reps count]; i++)
+	{
+	  [selnodes addObject: [[reps objectAtIndex: i] node]];
+	}
+
+      selectedNodesCache = [selnodes copy];
     }
 
-  return [NSArray arrayWithArray: selnodes];
+  return AUTORELEASE (RETAIN (selectedNodesCache));
 }
 
 - (NSArray *)selectedPaths
 {
-  NSMutableArray *selpaths = [NSMutableArray array];
+  NSArray *nodes = [self selectedNodes];
 
-  NSEnumerator *e = [[self selectedNodes] objectEnumerator];
-  id n;
-  while ((n = [e nextObject]) != nil)
+  if (selectedPathsCache == nil)
     {
-      [selpaths addObject: [n path]];
+      NSMutableArray *selpaths = [NSMutableArray arrayWithCapacity: [nodes count]];
+      NSUInteger i;
+
+      for (i = 0; i < [nodes count]; i++)
+	{
+	  [selpaths addObject: [[nodes objectAtIndex: i] path]];
+	}
+
+      selectedPathsCache = [selpaths copy];
     }
 
-  return [NSArray arrayWithArray: selpaths];
+  return AUTORELEASE (RETAIN (selectedPathsCache));
 }
 
 - (void)selectionDidChange
@@ -1454,9 +1585,76 @@ shouldEditTableColumn:(NSTableColumn *)aTableColumn
     {
       ASSIGN (lastSelection, selection);
       [desktopApp selectionChanged: selection];
+      [self prefetchAroundRow: [listView selectedRow]];
     }
 }
 
+/* The focused folder is what opens next, its neighbours are one arrow
+   key away. */
+- (void)prefetchAroundRow:(NSInteger)row
+{
+  NSMutableArray *nodes;
+  NSInteger count = [nodeReps count];
+
+  if ((row < 0) || (row >= count) || ([listView numberOfSelectedRows] != 1))
+    return;
+
+  nodes = [NSMutableArray arrayWithCapacity: 3];
+  [nodes addObject: [[nodeReps objectAtIndex: row] node]];
+  if (row + 1 < count)
+    [nodes addObject: [[nodeReps objectAtIndex: row + 1] node]];
+  if (row > 0)
+    [nodes addObject: [[nodeReps objectAtIndex: row - 1] node]];
+
+  [[FSNPrefetcher sharedPrefetcher] prefetchNodes: nodes iconSize: ICNSIZE];
+}
+
+- (void)updateThumbnailsPriority
+{
+  id scheduler = [fsnodeRep thumbnailScheduler];
+  NSInteger count = [nodeReps count];
+  NSMutableArray *visible;
+  NSMutableArray *ahead;
+  NSRange rows;
+  NSInteger first, last;
+  NSInteger i;
+
+  if ((scheduler == nil) || (count == 0))
+    return;
+
+  rows = [listView rowsInRect: [listView visibleRect]];
+  if (rows.length == 0)
+    return;
+
+  visible = [NSMutableArray arrayWithCapacity: rows.length];
+  for (i = rows.location; (i < NSMaxRange(rows)) && (i < count); i++)
+    [visible addObject: [[[nodeReps objectAtIndex: i] node] path]];
+
+  /* Before any scroll, the next screen is the one below. */
+  if ((hintFirstRow < 0) || ((NSInteger)rows.location >= hintFirstRow))
+    {
+      first = NSMaxRange(rows);
+      last = first + rows.length;
+    }
+  else
+    {
+      last = rows.location;
+      first = last - rows.length;
+    }
+  hintFirstRow = rows.location;
+
+  first = (first < 0) ? 0 : first;
+  last = (last > count) ? count : last;
+
+  ahead = [NSMutableArray arrayWithCapacity: rows.length];
+  for (i = first; i < last; i++)
+    [ahead addObject: [[[nodeReps objectAtIndex: i] node] path]];
+
+  [scheduler prioritizeVisiblePaths: visible
+                         aheadPaths: ahead
+                            forView: self];
+}
+
 - (void)checkLockedReps
 {
   NSUInteger i;
@@ -2709,6 +2907,12 @@ NSComparisonResult sortSubviews(id view1, id view2, void *context)
 
 - (void)dealloc
 {
+  if (observedClipView)
+    {
+      [[NSNotificationCenter defaultCenter] removeObserver: self
+                                                      name: NSViewBoundsDidChangeNotification
+                                                    object: observedClipView];
+    }
   RELEASE (charBuffer);
   RELEASE (dsource);
   [super dealloc];
@@ -2929,6 +3133,36 @@ NSComparisonResult sortSubviews(id view1, id view2, void *context)
   [self checkSize];
 }
 
+- (void)viewDidMoveToSuperview
+{
+  [super viewDidMoveToSuperview];
+
+  if (observedClipView)
+    {
+      [[NSNotificationCenter defaultCenter] removeObserver: self
+                                                      name: NSViewBoundsDidChangeNotification
+                                                    object: observedClipView];
+      observedClipView = nil;
+    }
+
+  /* scrolling moves the clip view's bounds: the rows coming into
+     view get their thumbnails first */
+  if ([[self superview] isKindOfClass: [NSClipView class]])
+    {
+      observedClipView = [self superview];
+      [observedClipView setPostsBoundsChangedNotifications: YES];
+      [[NSNotificationCenter defaultCenter] addObserver: self
+                                               selector: @selector(clipViewBoundsDidChange:)
+                                                   name: NSViewBoundsDidChangeNotification
+                                                 object: observedClipView];
+    }
+}
+
+- (void)clipViewBoundsDidChange:(NSNotification *)notif
+{
+  [dsource updateThumbnailsPriority];
+}
+
 - (NSImage *)dragImageForRows:(NSArray *)dragRows
 			event:(NSEvent *)dragEvent
 	      dragImageOffset:(NSPointPointer)dragImageOffset
@@ -19,6 +19,7 @@
 
 @class NSImage;
 @class NSColor;
+@class FSNFolderMetadata;
 
 @protocol FSNMetadataProvider <NSObject>
 
@@ -41,6 +42,22 @@
  * next read reflects external changes). */
 - (void)invalidateCaches;
 
+@optional
+
+/* Drop the cached metadata of just these paths (fswatcher events name the
+ * files that changed, so the rest of the cache stays warm). */
+- (void)invalidateCachesForPaths:(NSArray *)paths;
+
+/* Read the metadata of every file in the folder ahead of the per-path
+ * calls above, in one pass instead of one probe per file.  May be called
+ * off the main thread, by FSNDirectoryLoader. */
+- (void)prefetchMetadataForDirectory:(NSString *)path;
+
+/* Label, invisibility, custom icon flag and stored position of every file
+ * in the folder, read in one pass.  Views that show a whole folder use it
+ * instead of the per-path calls. */
+- (FSNFolderMetadata *)folderMetadataAtPath:(NSString *)path;
+
 @end
 
 #endif /* FSN_METADATA_PROVIDER_H */
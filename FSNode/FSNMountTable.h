@@ -0,0 +1,109 @@
+/* FSNMountTable.h
+ *
+ * Shared, cached view of the system mount table.
+ *
+ * On Linux the table is parsed from /proc/self/mountinfo once and parsed
+ * again only after poll() reports POLLPRI on the open file, which the
+ * kernel raises whenever something is mounted or unmounted.  Queries are
+ * dictionary lookups by mount point or by device, so callers can ask them
+ * per icon or per redraw.  On the BSDs the table comes from getmntinfo()
+ * and is re-read at most every MOUNT_TABLE_MIN_INTERVAL seconds.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_MOUNT_TABLE_H
+#define FSN_MOUNT_TABLE_H
+
+#import <Foundation/Foundation.h>
+#include <sys/types.h>
+
+@interface FSNMountEntry : NSObject
+{
+  NSString *mountPoint;
+  NSString *source;
+  NSString *fsType;
+  NSString *options;
+  dev_t device;
+  BOOL network;
+  BOOL diskImage;
+  BOOL removable;
+  BOOL readOnly;
+  NSString *volumeIconPath;
+  BOOL volumeIconChecked;
+}
+
+- (NSString *)mountPoint;
+
+/* the mounted device or remote, e.g. /dev/sda1 or user@host:/path */
+- (NSString *)source;
+
+/* as the kernel names it: ext4, nfs4, fuse.sshfs, iso9660... */
+- (NSString *)fileSystemType;
+
+- (NSString *)options;
+
+/* st_dev of the files on the volume; 0 where the platform has no way to
+   tell it without a stat() of the mount point */
+- (dev_t)device;
+
+/* NFS, SMB/CIFS, AFS, 9p and FUSE network filesystems */
+- (BOOL)isNetwork;
+
+/* ISO 9660, UDF, squashfs and loop-mounted images */
+- (BOOL)isDiskImage;
+
+/* on a device the kernel marks removable, or mounted where the media
+   automounters put them */
+- (BOOL)isRemovable;
+
+- (BOOL)isReadOnly;
+
+@end
+
+
+@interface FSNMountTable : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *byMountPoint;
+  NSMutableDictionary *byDevice;
+  NSArray *entries;
+  unsigned long generation;
+  int fd;
+  NSTimeInterval lastRead;
+  BOOL available;
+}
+
++ (FSNMountTable *)sharedTable;
+
+/* NO when no mount table could be read on this system; callers then
+   fall back to their own checks. */
+- (BOOL)isAvailable;
+
+/* Incremented every time the table is parsed again. */
+- (unsigned long)generation;
+
+/* All entries, in mount order.  Kernel pseudo filesystems, bind mounts
+   and the snap and container mounts are left out. */
+- (NSArray *)entries;
+
+- (FSNMountEntry *)entryForMountPoint:(NSString *)path;
+
+- (FSNMountEntry *)entryForDevice:(dev_t)dev;
+
+- (BOOL)isMountPointAtPath:(NSString *)path;
+
+/* nil if `path` is not a mount point */
+- (NSString *)fileSystemTypeAtMountPoint:(NSString *)path;
+
+- (BOOL)isNetworkVolumeAtPath:(NSString *)path;
+
+- (BOOL)isDiskImageVolumeAtPath:(NSString *)path;
+
+/* <mount point>/.VolumeIcon.icns if the volume has a readable one; the
+   answer is remembered for as long as the volume stays mounted. */
+- (NSString *)volumeIconPathForMountPoint:(NSString *)path;
+
+@end
+
+#endif /* FSN_MOUNT_TABLE_H */
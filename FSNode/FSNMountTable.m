@@ -0,0 +1,707 @@
+/* FSNMountTable.m
+ *
+ * Shared, cached view of the system mount table.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+
+#if defined(__linux__)
+  #include <poll.h>
+  #include <sys/sysmacros.h>
+#elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+  #include <sys/param.h>
+  #include <sys/mount.h>
+  #define HAVE_GETMNTINFO 1
+#endif
+
+#import "FSNMountTable.h"
+
+/* Only for platforms without a change notification */
+#define MOUNT_TABLE_MIN_INTERVAL (2.0)
+
+static FSNMountTable *sharedTable = nil;
+
+static BOOL
+isNetworkType(NSString *type)
+{
+  static NSSet *netTypes = nil;
+
+  if (netTypes == nil)
+    {
+      /* FUSE is listed by name: ntfs-3g, exfat, gvfsd-fuse, the AppImage
+         and archive mounters are local disks or files */
+      netTypes = [[NSSet alloc] initWithObjects:
+        @"nfs", @"nfs4", @"cifs", @"smb3", @"smbfs", @"ncpfs", @"afs",
+        @"9p", @"davfs", @"afpfs", @"ceph", @"glusterfs",
+        @"fuse.sshfs", @"fuse.rclone", @"fuse.s3fs", @"fuse.davfs2",
+        @"fuse.gcsfuse", @"fuse.goofys", @"fuse.blobfuse", @"fuse.blobfuse2",
+        @"fuse.curlftpfs", @"fuse.ftpfs", @"fuse.httpfs", @"fuse.smbnetfs",
+        @"fuse.afpfs", @"fuse.glusterfs", @"fuse.ceph-fuse", @"fuse.cephfs",
+        @"fuse.juicefs", @"fuse.mfs", @"fuse.lizardfs", @"fuse.onedriver",
+        @"fuse.google-drive-ocamlfuse", @"fuse.keybase", nil];
+    }
+
+  return [netTypes containsObject: type];
+}
+
+/* Kernel and runtime filesystems, never a volume for the user. The
+   same types NSWorkspace leaves out of -mountedLocalVolumePaths, and
+   the ones newer kernels added since. */
+static BOOL
+isPseudoType(NSString *type)
+{
+  static NSSet *pseudoTypes = nil;
+
+  if (pseudoTypes == nil)
+    {
+      pseudoTypes = [[NSSet alloc] initWithObjects:
+        @"proc", @"procfs", @"sysfs", @"devfs", @"devtmpfs", @"devpts",
+        @"kernfs", @"tmpfs", @"ramfs", @"shm", @"mfs", @"usbdevfs",
+        @"cgroup", @"cgroup2", @"securityfs", @"selinuxfs", @"debugfs",
+        @"tracefs", @"pstore", @"bpf", @"configfs", @"fusectl", @"mqueue",
+        @"hugetlbfs", @"autofs", @"binfmt_misc", @"efivarfs", @"rpc_pipefs",
+        @"nsfs", @"nfsd", @"fdescfs", @"linprocfs", @"linsysfs", nil];
+    }
+
+  return [pseudoTypes containsObject: type];
+}
+
+/* Snap packages and container layers are mounted by the hundred */
+static BOOL
+isSystemMountPoint(NSString *mpoint)
+{
+  return ([mpoint hasPrefix: @"/snap/"]
+          || [mpoint hasPrefix: @"/var/snap/"]
+          || [mpoint hasPrefix: @"/run/snapd/"]
+          || [mpoint hasPrefix: @"/var/lib/docker/"]
+          || [mpoint hasPrefix: @"/var/lib/containers/"]
+          || [mpoint hasPrefix: @"/run/docker/"]
+          || [mpoint hasPrefix: @"/run/containerd/"]
+          || [mpoint hasPrefix: @"/run/netns/"]);
+}
+
+static BOOL
+isDiskImageType(NSString *type, NSString *source)
+{
+  static NSSet *imageTypes = nil;
+
+  if (imageTypes == nil)
+    {
+      imageTypes = [[NSSet alloc] initWithObjects:
+        @"iso9660", @"isofs", @"cd9660", @"udf", @"squashfs",
+        @"fuse.squashfuse", @"fuse.fuseiso", nil];
+    }
+
+  return ([imageTypes containsObject: [type lowercaseString]]
+          || [source hasPrefix: @"/dev/loop"]);
+}
+
+static BOOL
+isRemovableVolume(NSString *source, NSString *mpoint)
+{
+#if defined(__linux__)
+  if ([source hasPrefix: @"/dev/"])
+    {
+      char dev[PATH_MAX];
+      char sys[PATH_MAX];
+      char attr[PATH_MAX];
+      char flag = '0';
+      const char *name;
+      int afd;
+
+      /* /dev/disk/by-uuid/... and the like link to the device */
+      if (realpath([source fileSystemRepresentation], dev) == NULL)
+        return NO;
+      name = strrchr(dev, '/') + 1;
+      snprintf(attr, sizeof(attr), "/sys/class/block/%s", name);
+      if (realpath(attr, sys) == NULL)
+        return NO;
+
+      /* a partition has the attribute on its disk, the directory above */
+      snprintf(attr, sizeof(attr), "%s/removable", sys);
+      afd = open(attr, O_RDONLY | O_CLOEXEC);
+      if (afd < 0)
+        {
+          snprintf(attr, sizeof(attr), "%s/../removable", sys);
+          afd = open(attr, O_RDONLY | O_CLOEXEC);
+        }
+      if (afd >= 0)
+        {
+          if (read(afd, &flag, 1) != 1)
+            flag = '0';
+          close(afd);
+        }
+      if (flag == '1')
+        return YES;
+    }
+#endif
+
+  /* udisks and the automounters put the media there, USB disks that
+     do not say they are removable included */
+  return ([mpoint hasPrefix: @"/media/"] || [mpoint hasPrefix: @"/run/media/"]);
+}
+
+static BOOL
+optionsAreReadOnly(const char *opts, size_t len)
+{
+  return ((len == 2 && memcmp(opts, "ro", 2) == 0)
+          || (len > 2 && memcmp(opts, "ro,", 3) == 0));
+}
+
+
+@interface FSNMountEntry (Private)
+
+- (id)initWithMountPoint:(NSString *)mpoint
+                  source:(NSString *)src
+                    type:(NSString *)type
+                 options:(NSString *)opts
+                  device:(dev_t)dev
+                readOnly:(BOOL)ro;
+
+- (NSString *)volumeIconPath;
+
+@end
+
+
+@implementation FSNMountEntry
+
+- (void)dealloc
+{
+  RELEASE (mountPoint);
+  RELEASE (source);
+  RELEASE (fsType);
+  RELEASE (options);
+  RELEASE (volumeIconPath);
+
+  [super dealloc];
+}
+
+- (id)initWithMountPoint:(NSString *)mpoint
+                  source:(NSString *)src
+                    type:(NSString *)type
+                 options:(NSString *)opts
+                  device:(dev_t)dev
+                readOnly:(BOOL)ro
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (mountPoint, mpoint);
+      ASSIGN (source, src);
+      ASSIGN (fsType, type);
+      ASSIGN (options, opts);
+      device = dev;
+      readOnly = ro;
+      network = isNetworkType(type);
+      diskImage = (network == NO) && isDiskImageType(type, src);
+      removable = (network == NO) && isRemovableVolume(src, mpoint);
+    }
+
+  return self;
+}
+
+- (NSString *)mountPoint
+{
+  return mountPoint;
+}
+
+- (NSString *)source
+{
+  return source;
+}
+
+- (NSString *)fileSystemType
+{
+  return fsType;
+}
+
+- (NSString *)options
+{
+  return options;
+}
+
+- (dev_t)device
+{
+  return device;
+}
+
+- (BOOL)isNetwork
+{
+  return network;
+}
+
+- (BOOL)isDiskImage
+{
+  return diskImage;
+}
+
+- (BOOL)isRemovable
+{
+  return removable;
+}
+
+- (BOOL)isReadOnly
+{
+  return readOnly;
+}
+
+/* Called with the table lock held. */
+- (NSString *)volumeIconPath
+{
+  if (volumeIconChecked == NO)
+    {
+      NSString *ipath = [mountPoint stringByAppendingPathComponent: @".VolumeIcon.icns"];
+
+      /* a network volume would be asked over the wire for every mount */
+      if (network == NO && access([ipath fileSystemRepresentation], R_OK) == 0)
+        ASSIGN (volumeIconPath, ipath);
+      volumeIconChecked = YES;
+    }
+
+  return volumeIconPath;
+}
+
+@end
+
+
+#if defined(__linux__)
+
+/* mountinfo escapes space, tab, newline and backslash as \ooo */
+static NSString *
+decodedField(const char *s, size_t len)
+{
+  char buf[PATH_MAX];
+  size_t i, j = 0;
+
+  if (len >= sizeof(buf))
+    len = sizeof(buf) - 1;
+
+  for (i = 0; i < len; i++)
+    {
+      if (s[i] == '\\' && i + 3 < len
+          && s[i + 1] >= '0' && s[i + 1] <= '3'
+          && s[i + 2] >= '0' && s[i + 2] <= '7'
+          && s[i + 3] >= '0' && s[i + 3] <= '7')
+        {
+          buf[j++] = (char)(((s[i + 1] - '0') << 6)
+                            | ((s[i + 2] - '0') << 3) | (s[i + 3] - '0'));
+          i += 3;
+        }
+      else
+        {
+          buf[j++] = s[i];
+        }
+    }
+
+  return AUTORELEASE ([[NSString alloc] initWithBytes: buf
+                                               length: j
+                                             encoding: NSUTF8StringEncoding]);
+}
+
+/* Whether `root` is the "subvol=" of the superblock options */
+static BOOL
+isSubvolumeRoot(const char *root, size_t rlen, const char *opts, size_t olen)
+{
+  size_t pos = 0;
+
+  while (pos < olen)
+    {
+      size_t end = pos;
+
+      while (end < olen && opts[end] != ',')
+        end++;
+
+      if (end - pos == rlen + 7 && memcmp(opts + pos, "subvol=", 7) == 0)
+        return (memcmp(opts + pos + 7, root, rlen) == 0);
+
+      pos = end + 1;
+    }
+
+  return NO;
+}
+
+/* One mountinfo line:
+   36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw */
+static FSNMountEntry *
+entryFromMountInfoLine(const char *line, size_t len)
+{
+  const char *fields[16];
+  size_t lens[16];
+  int nfields = 0;
+  int dash = -1;
+  size_t pos = 0;
+  unsigned int maj = 0, min = 0;
+  char devbuf[32];
+  NSString *mpoint;
+  NSString *type;
+
+  while (pos < len && nfields < 16)
+    {
+      size_t start;
+
+      while (pos < len && line[pos] == ' ')
+        pos++;
+      if (pos >= len)
+        break;
+
+      start = pos;
+      while (pos < len && line[pos] != ' ')
+        pos++;
+
+      fields[nfields] = line + start;
+      lens[nfields] = pos - start;
+
+      if (dash < 0 && nfields >= 6 && lens[nfields] == 1 && line[start] == '-')
+        dash = nfields;
+      nfields++;
+    }
+
+  if (dash < 0 || nfields < dash + 3 || lens[2] >= sizeof(devbuf))
+    return nil;
+
+  memcpy(devbuf, fields[2], lens[2]);
+  devbuf[lens[2]] = '\0';
+  if (sscanf(devbuf, "%u:%u", &maj, &min) != 2)
+    return nil;
+
+  /* a bind mount shows a subtree of a mount already in the table; a
+     btrfs subvolume has its own path there too, and is no bind */
+  if ((lens[3] != 1 || fields[3][0] != '/')
+      && (nfields < dash + 4
+          || isSubvolumeRoot(fields[3], lens[3],
+                             fields[dash + 3], lens[dash + 3]) == NO))
+    return nil;
+
+  mpoint = decodedField(fields[4], lens[4]);
+  type = decodedField(fields[dash + 1], lens[dash + 1]);
+  if (isPseudoType(type) || isSystemMountPoint(mpoint))
+    return nil;
+
+  return AUTORELEASE ([[FSNMountEntry alloc]
+     initWithMountPoint: mpoint
+                 source: decodedField(fields[dash + 2], lens[dash + 2])
+                   type: type
+                options: decodedField(fields[5], lens[5])
+                 device: makedev(maj, min)
+               readOnly: optionsAreReadOnly(fields[5], lens[5])]);
+}
+
+#endif /* __linux__ */
+
+
+@interface FSNMountTable (Private)
+- (void)refreshIfNeeded;
+- (NSArray *)readEntries;
+@end
+
+
+@implementation FSNMountTable
+
++ (FSNMountTable *)sharedTable
+{
+  @synchronized (self)
+    {
+      if (sharedTable == nil)
+        sharedTable = [FSNMountTable new];
+    }
+
+  return sharedTable;
+}
+
+- (void)dealloc
+{
+  if (fd >= 0)
+    close(fd);
+  RELEASE (entries);
+  RELEASE (byDevice);
+  RELEASE (byMountPoint);
+  RELEASE (lock);
+
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      byMountPoint = [NSMutableDictionary new];
+      byDevice = [NSMutableDictionary new];
+      entries = [NSArray new];
+      fd = -1;
+      lastRead = 0;
+      generation = 0;
+
+#if defined(__linux__)
+      fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+      available = (fd >= 0);
+#elif defined(HAVE_GETMNTINFO)
+      available = YES;
+#else
+      available = NO;
+#endif
+    }
+
+  return self;
+}
+
+- (NSArray *)readEntries
+{
+  NSMutableArray *list = [NSMutableArray array];
+
+#if defined(__linux__)
+  NSMutableData *data = [NSMutableData dataWithLength: 16384];
+  NSUInteger used = 0;
+  const char *bytes;
+  NSUInteger start = 0;
+  NSUInteger i;
+
+  if (lseek(fd, 0, SEEK_SET) < 0)
+    return nil;
+
+  while (1)
+    {
+      ssize_t n;
+
+      if (used == [data length])
+        [data setLength: used * 2];
+
+      n = read(fd, (char *)[data mutableBytes] + used, [data length] - used);
+      if (n < 0)
+        return nil;
+      if (n == 0)
+        break;
+      used += n;
+    }
+
+  bytes = [data bytes];
+
+  for (i = 0; i < used; i++)
+    {
+      if (bytes[i] == '\n')
+        {
+          FSNMountEntry *entry = entryFromMountInfoLine(bytes + start, i - start);
+
+          if (entry)
+            [list addObject: entry];
+          start = i + 1;
+        }
+    }
+
+#elif defined(HAVE_GETMNTINFO)
+  struct statfs *mnts = NULL;
+  int count = getmntinfo(&mnts, MNT_NOWAIT);
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      NSString *mpoint = [NSString stringWithUTF8String: mnts[i].f_mntonname];
+      NSString *type = [NSString stringWithUTF8String: mnts[i].f_fstypename];
+      FSNMountEntry *entry;
+
+      if (isPseudoType(type) || isSystemMountPoint(mpoint))
+        continue;
+
+      entry = [[FSNMountEntry alloc]
+          initWithMountPoint: mpoint
+                      source: [NSString stringWithUTF8String: mnts[i].f_mntfromname]
+                        type: type
+                     options: @""
+                      device: 0
+                    readOnly: ((mnts[i].f_flags & MNT_RDONLY) != 0)];
+      [list addObject: entry];
+      RELEASE (entry);
+    }
+#endif
+
+  return list;
+}
+
+/* Called with the lock held. */
+- (void)refreshIfNeeded
+{
+  BOOL changed = NO;
+
+  if (available == NO)
+    return;
+
+#if defined(__linux__)
+  {
+    struct pollfd pfd;
+
+    pfd.fd = fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+
+    /* the kernel flags POLLPRI (and POLLERR) once per table change */
+    changed = (generation == 0)
+      || (poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR)));
+  }
+#else
+  {
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+    changed = (generation == 0) || (now - lastRead >= MOUNT_TABLE_MIN_INTERVAL);
+    if (changed)
+      lastRead = now;
+  }
+#endif
+
+  if (changed)
+    {
+      CREATE_AUTORELEASE_POOL (arp);
+      NSArray *list = [self readEntries];
+      NSUInteger i;
+
+      if (list != nil)
+        {
+          NSMutableDictionary *oldByMountPoint = AUTORELEASE ([byMountPoint copy]);
+
+          [byMountPoint removeAllObjects];
+          [byDevice removeAllObjects];
+
+          for (i = 0; i < [list count]; i++)
+            {
+              FSNMountEntry *entry = [list objectAtIndex: i];
+              FSNMountEntry *old = [oldByMountPoint objectForKey: [entry mountPoint]];
+
+              /* an unchanged mount keeps its entry, and so its
+                 remembered volume icon */
+              if (old && [old device] == [entry device]
+                  && [[old fileSystemType] isEqual: [entry fileSystemType]]
+                  && [[old source] isEqual: [entry source]])
+                entry = old;
+
+              /* later lines are mounted on top of earlier ones */
+              [byMountPoint setObject: entry forKey: [entry mountPoint]];
+              if ([entry device] != 0)
+                {
+                  [byDevice setObject: entry
+                               forKey: [NSNumber numberWithUnsignedLongLong: [entry device]]];
+                }
+            }
+
+          {
+            NSMutableArray *ordered = [NSMutableArray arrayWithCapacity: [list count]];
+
+            for (i = 0; i < [list count]; i++)
+              {
+                FSNMountEntry *entry = [byMountPoint objectForKey:
+                                          [[list objectAtIndex: i] mountPoint]];
+
+                if ([ordered indexOfObjectIdenticalTo: entry] == NSNotFound)
+                  [ordered addObject: entry];
+              }
+            ASSIGN (entries, ordered);
+          }
+          generation++;
+        }
+
+      RELEASE (arp);
+    }
+}
+
+- (BOOL)isAvailable
+{
+  return available;
+}
+
+- (unsigned long)generation
+{
+  unsigned long gen;
+
+  [lock lock];
+  [self refreshIfNeeded];
+  gen = generation;
+  [lock unlock];
+
+  return gen;
+}
+
+- (NSArray *)entries
+{
+  NSArray *list;
+
+  [lock lock];
+  [self refreshIfNeeded];
+  list = RETAIN (entries);
+  [lock unlock];
+
+  return AUTORELEASE (list);
+}
+
+- (FSNMountEntry *)entryForMountPoint:(NSString *)path
+{
+  FSNMountEntry *entry;
+
+  if (path == nil)
+    return nil;
+
+  [lock lock];
+  [self refreshIfNeeded];
+  entry = RETAIN ([byMountPoint objectForKey: path]);
+  [lock unlock];
+
+  return AUTORELEASE (entry);
+}
+
+- (FSNMountEntry *)entryForDevice:(dev_t)dev
+{
+  FSNMountEntry *entry;
+
+  [lock lock];
+  [self refreshIfNeeded];
+  entry = RETAIN ([byDevice objectForKey: [NSNumber numberWithUnsignedLongLong: dev]]);
+  [lock unlock];
+
+  return AUTORELEASE (entry);
+}
+
+- (BOOL)isMountPointAtPath:(NSString *)path
+{
+  return ([self entryForMountPoint: path] != nil);
+}
+
+- (NSString *)fileSystemTypeAtMountPoint:(NSString *)path
+{
+  return [[self entryForMountPoint: path] fileSystemType];
+}
+
+- (BOOL)isNetworkVolumeAtPath:(NSString *)path
+{
+  return [[self entryForMountPoint: path] isNetwork];
+}
+
+- (BOOL)isDiskImageVolumeAtPath:(NSString *)path
+{
+  return [[self entryForMountPoint: path] isDiskImage];
+}
+
+- (NSString *)volumeIconPathForMountPoint:(NSString *)path
+{
+  NSString *ipath = nil;
+
+  if (path == nil)
+    return nil;
+
+  [lock lock];
+  [self refreshIfNeeded];
+  ipath = RETAIN ([[byMountPoint objectForKey: path] volumeIconPath]);
+  [lock unlock];
+
+  return AUTORELEASE (ipath);
+}
+
+@end
@@ -0,0 +1,62 @@
+/* FSNOperationPaths.h
+ *
+ * A file operation info dictionary (operation, source, destination,
+ * files) compiled into hashed tables of the full paths it touches.
+ *
+ * Every open viewer asks every node it shows whether an operation
+ * involves it; with the raw dictionary each answer walks the whole
+ * `files` array.  Here each answer walks the ancestors of the node path
+ * instead and looks them up, so it costs O(path depth) whatever the
+ * number of files.
+ *
+ * The last compiled dictionary is kept, so all the checks made for one
+ * notification share a single compilation.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_OPERATION_PATHS_H
+#define FSN_OPERATION_PATHS_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNOperationPaths : NSObject
+{
+  NSString *operation;
+  NSString *unmounted;
+
+  /* as -[FSNode involvedByFileOperation:] sees the operation */
+  NSString *source;
+  NSString *destination;
+  NSDictionary *sourcePaths;
+  NSDictionary *destinationPaths;
+
+  /* as -[FSNode willBeValidAfterFileOperation:] sees it */
+  NSString *validitySource;
+  NSString *validityDestination;
+  NSDictionary *removedPaths;
+  NSDictionary *replacedPaths;
+}
+
++ (FSNOperationPaths *)pathsForOperationInfo:(NSDictionary *)opinfo;
+
+- (id)initWithOperationInfo:(NSDictionary *)opinfo;
+
+- (NSString *)operation;
+
+/* The operation touches `path`, its parent folders or its contents. */
+- (BOOL)involvesPath:(NSString *)path;
+
+/* `path` is the unmounted volume or lies on it. */
+- (BOOL)isUnmountedPath:(NSString *)path;
+
+/* `path` or one of its ancestors is moved away, destroyed or recycled. */
+- (BOOL)isRemovedPath:(NSString *)path;
+
+/* If `path` or one of its ancestors gets replaced by a file landing in
+   the destination, its path before the operation, else nil. */
+- (NSString *)replacingSourceOfPath:(NSString *)path;
+
+@end
+
+#endif /* FSN_OPERATION_PATHS_H */
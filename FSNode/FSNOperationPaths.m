@@ -0,0 +1,227 @@
+/* FSNOperationPaths.m
+ *
+ * Compiled file operation info.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <AppKit/AppKit.h>
+#import "FSNOperationPaths.h"
+
+static NSDictionary *lastInfo = nil;
+static FSNOperationPaths *lastPaths = nil;
+
+/* Full paths of `files` in `dir`, each mapped to its file name. */
+static NSDictionary *
+pathsTable(NSString *dir, NSArray *files)
+{
+  NSUInteger count = [files count];
+  NSMutableDictionary *table;
+  NSUInteger i;
+
+  if (dir == nil || count == 0)
+    return nil;
+
+  table = [NSMutableDictionary dictionaryWithCapacity: count];
+
+  for (i = 0; i < count; i++)
+    {
+      NSString *fname = [files objectAtIndex: i];
+
+      [table setObject: fname
+                forKey: [dir stringByAppendingPathComponent: fname]];
+    }
+
+  return table;
+}
+
+/* `path` or its nearest ancestor strictly below `root` found in `table`. */
+static NSString *
+ancestorInTable(NSString *path, NSString *root, NSDictionary *table)
+{
+  NSUInteger rootlen = [root length];
+
+  if (table == nil || [path length] <= rootlen || [path hasPrefix: root] == NO)
+    return nil;
+
+  while ([path length] > rootlen)
+    {
+      NSString *parent;
+
+      if ([table objectForKey: path] != nil)
+        return path;
+
+      parent = [path stringByDeletingLastPathComponent];
+      if ([parent length] == [path length])
+        break;
+      path = parent;
+    }
+
+  return nil;
+}
+
+static BOOL
+isRemovingOperation(NSString *operation)
+{
+  return ([operation isEqual: NSWorkspaceMoveOperation]
+          || [operation isEqual: NSWorkspaceDestroyOperation]
+          || [operation isEqual: @"WorkspaceRenameOperation"]
+          || [operation isEqual: NSWorkspaceRecycleOperation]
+          || [operation isEqual: @"WorkspaceRecycleOutOperation"]
+          || [operation isEqual: @"WorkspaceemptyTrashOperation"]);
+}
+
+static BOOL
+isAddingOperation(NSString *operation)
+{
+  return ([operation isEqual: NSWorkspaceMoveOperation]
+          || [operation isEqual: NSWorkspaceCopyOperation]
+          || [operation isEqual: NSWorkspaceLinkOperation]
+          || [operation isEqual: NSWorkspaceRecycleOperation]
+          || [operation isEqual: @"WorkspaceRecycleOutOperation"]);
+}
+
+
+@implementation FSNOperationPaths
+
++ (FSNOperationPaths *)pathsForOperationInfo:(NSDictionary *)opinfo
+{
+  FSNOperationPaths *paths;
+
+  @synchronized (self)
+    {
+      /* the info dictionary is retained, so its address stays its own */
+      if (opinfo != lastInfo)
+        {
+          paths = [[FSNOperationPaths alloc] initWithOperationInfo: opinfo];
+          ASSIGN (lastInfo, opinfo);
+          ASSIGN (lastPaths, paths);
+          RELEASE (paths);
+        }
+      paths = RETAIN (lastPaths);
+    }
+
+  return AUTORELEASE (paths);
+}
+
+- (void)dealloc
+{
+  RELEASE (operation);
+  RELEASE (unmounted);
+  RELEASE (source);
+  RELEASE (destination);
+  RELEASE (sourcePaths);
+  RELEASE (destinationPaths);
+  RELEASE (validitySource);
+  RELEASE (validityDestination);
+  RELEASE (removedPaths);
+  RELEASE (replacedPaths);
+
+  [super dealloc];
+}
+
+- (id)initWithOperationInfo:(NSDictionary *)opinfo
+{
+  self = [super init];
+
+  if (self)
+    {
+      NSString *src = [opinfo objectForKey: @"source"];
+      NSString *dst = [opinfo objectForKey: @"destination"];
+      NSArray *files = [opinfo objectForKey: @"files"];
+
+      ASSIGN (operation, [opinfo objectForKey: @"operation"]);
+
+      if ([operation isEqual: @"UnmountOperation"])
+        ASSIGN (unmounted, [opinfo objectForKey: @"unmounted"]);
+
+      if ([operation isEqual: @"WorkspaceRenameOperation"])
+        {
+          NSArray *oldname = [NSArray arrayWithObject: [src lastPathComponent]];
+          NSArray *newname = [NSArray arrayWithObject: [dst lastPathComponent]];
+
+          ASSIGN (source, [src stringByDeletingLastPathComponent]);
+          ASSIGN (destination, [dst stringByDeletingLastPathComponent]);
+          ASSIGN (sourcePaths, pathsTable(source, oldname));
+          ASSIGN (destinationPaths, pathsTable(destination, newname));
+
+          /* a rename adds nothing a node could be replaced by */
+          ASSIGN (validitySource, source);
+          files = oldname;
+        }
+      else
+        {
+          ASSIGN (source, src);
+          ASSIGN (destination, dst);
+          ASSIGN (sourcePaths, pathsTable(source, files));
+          ASSIGN (destinationPaths, pathsTable(destination, files));
+          ASSIGN (validitySource, source);
+          ASSIGN (validityDestination, destination);
+        }
+
+      if (isRemovingOperation(operation))
+        ASSIGN (removedPaths, pathsTable(validitySource, files));
+
+      if (isAddingOperation(operation))
+        ASSIGN (replacedPaths, pathsTable(validityDestination, files));
+    }
+
+  return self;
+}
+
+- (NSString *)operation
+{
+  return operation;
+}
+
+- (BOOL)involvesPath:(NSString *)path
+{
+  if ([self isUnmountedPath: path])
+    return YES;
+
+  if ([path isEqual: source] || [path isEqual: destination])
+    return YES;
+
+  if (ancestorInTable(path, source, sourcePaths) != nil)
+    return YES;
+
+  return (ancestorInTable(path, destination, destinationPaths) != nil);
+}
+
+- (BOOL)isUnmountedPath:(NSString *)path
+{
+  if (unmounted == nil)
+    return NO;
+
+  if ([path isEqual: unmounted])
+    return YES;
+
+  return ([path hasPrefix: unmounted]
+          && ([unmounted isEqual: @"/"]
+              || [path characterAtIndex: [unmounted length]] == '/'));
+}
+
+- (BOOL)isRemovedPath:(NSString *)path
+{
+  return (ancestorInTable(path, validitySource, removedPaths) != nil);
+}
+
+- (NSString *)replacingSourceOfPath:(NSString *)path
+{
+  NSString *fpath = ancestorInTable(path, validityDestination, replacedPaths);
+  NSString *srcpath;
+
+  if (fpath == nil)
+    return nil;
+
+  srcpath = [validitySource stringByAppendingPathComponent:
+                                [replacedPaths objectForKey: fpath]];
+
+  if ([fpath length] < [path length])
+    srcpath = [srcpath stringByAppendingPathComponent:
+                           [path substringFromIndex: [fpath length] + 1]];
+
+  return srcpath;
+}
+
+@end
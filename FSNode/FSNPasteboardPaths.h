@@ -0,0 +1,70 @@
+/* FSNPasteboardPaths.h
+ *
+ * A selection of files as the pasteboard carries it: the folder they
+ * are in and their names, instead of a full path for each.
+ *
+ * The views put a selection on a pasteboard in this form, under
+ * FSNFileListPboardType, and give the NSFilenamesPboardType list of
+ * paths only to a reader that asks for it (see FSNWritePathsToPasteboard()
+ * in FSNFunctions.h).  A drop target checks the folder, whether it is
+ * dropping into a file of the selection, and a sample of the names; the
+ * file operation checks every file as it goes.
+ *
+ * Paths that are not all in one folder are kept as they are, and have
+ * no compact form.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_PASTEBOARD_PATHS_H
+#define FSN_PASTEBOARD_PATHS_H
+
+#import <Foundation/Foundation.h>
+
+/* { "source" = folder; "names" = (...); } */
+extern NSString * const FSNFileListPboardType;
+
+/* how many of the paths a drop target looks at */
+#define FSN_PASTEBOARD_SAMPLE 16
+
+@interface FSNPasteboardPaths : NSObject
+{
+  NSString *source;
+  NSArray *names;
+  NSArray *paths;
+  NSSet *lookup;      /* the names, or the paths without a source */
+}
+
+/* nil for no paths. */
++ (FSNPasteboardPaths *)pasteboardPathsWithPaths:(NSArray *)apaths;
+
+/* nil unless `plist` is the compact form of some paths. */
++ (FSNPasteboardPaths *)pasteboardPathsWithPropertyList:(id)plist;
+
+/* The compact form; nil when the paths are not all in one folder. */
+- (id)propertyList;
+
+/* The folder of the paths, or nil. */
+- (NSString *)source;
+
+/* The names in the source, or nil when there is none. */
+- (NSArray *)names;
+
+- (NSUInteger)count;
+
+/* Built from the source and the names when first asked for. */
+- (NSArray *)paths;
+
+/* The first and last paths and some between, at most `max` of them. */
+- (NSArray *)samplePaths:(NSUInteger)max;
+
+/* YES when `path`, or a folder it is in, is one of the paths. */
+- (BOOL)containsPathOrAncestorOfPath:(NSString *)path;
+
+/* YES when one of a sample of the paths has the name of a folder
+ * already in `dir`. */
+- (BOOL)sampleMeetsFolderInDirectory:(NSString *)dir;
+
+@end
+
+#endif /* FSN_PASTEBOARD_PATHS_H */
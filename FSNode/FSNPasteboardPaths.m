@@ -0,0 +1,222 @@
+/* FSNPasteboardPaths.m
+ *
+ * A selection of files as the pasteboard carries it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNPasteboardPaths.h"
+
+NSString * const FSNFileListPboardType = @"GWFileListPboardType";
+
+
+@implementation FSNPasteboardPaths
+
+- (void)dealloc
+{
+  RELEASE (source);
+  RELEASE (names);
+  RELEASE (paths);
+  RELEASE (lookup);
+  [super dealloc];
+}
+
++ (FSNPasteboardPaths *)pasteboardPathsWithPaths:(NSArray *)apaths
+{
+  FSNPasteboardPaths *pbpaths;
+  NSString *parent;
+  NSMutableArray *anames;
+  NSUInteger count = [apaths count];
+  NSUInteger i;
+
+  if (count == 0)
+    return nil;
+
+  pbpaths = AUTORELEASE ([FSNPasteboardPaths new]);
+  pbpaths->paths = [apaths copy];
+
+  parent = [[apaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+  anames = [NSMutableArray arrayWithCapacity: count];
+
+  for (i = 0; i < count; i++)
+    {
+      NSString *path = [apaths objectAtIndex: i];
+      NSString *name = [path lastPathComponent];
+
+      /* "/" is its own last component, and in no folder */
+      if (([name length] == 0) || [name isEqual: path]
+          || ([[path stringByDeletingLastPathComponent] isEqual: parent] == NO))
+        return pbpaths;
+
+      [anames addObject: name];
+    }
+
+  pbpaths->source = [parent copy];
+  pbpaths->names = [anames copy];
+
+  return pbpaths;
+}
+
++ (FSNPasteboardPaths *)pasteboardPathsWithPropertyList:(id)plist
+{
+  FSNPasteboardPaths *pbpaths;
+  id asource;
+  id anames;
+  NSUInteger i;
+
+  if ([plist isKindOfClass: [NSDictionary class]] == NO)
+    return nil;
+
+  asource = [plist objectForKey: @"source"];
+  anames = [plist objectForKey: @"names"];
+
+  if (([asource isKindOfClass: [NSString class]] == NO)
+      || ([asource isAbsolutePath] == NO)
+      || ([anames isKindOfClass: [NSArray class]] == NO)
+      || ([anames count] == 0))
+    return nil;
+
+  for (i = 0; i < [anames count]; i++)
+    {
+      id name = [anames objectAtIndex: i];
+
+      if (([name isKindOfClass: [NSString class]] == NO)
+          || ([name length] == 0)
+          || ([name rangeOfString: @"/"].location != NSNotFound))
+        return nil;
+    }
+
+  pbpaths = AUTORELEASE ([FSNPasteboardPaths new]);
+  pbpaths->source = [asource copy];
+  pbpaths->names = [anames copy];
+
+  return pbpaths;
+}
+
+- (id)propertyList
+{
+  if (source == nil)
+    return nil;
+
+  return [NSDictionary dictionaryWithObjectsAndKeys: source, @"source",
+                                                     names, @"names", nil];
+}
+
+- (NSString *)source
+{
+  return source;
+}
+
+- (NSArray *)names
+{
+  return names;
+}
+
+- (NSUInteger)count
+{
+  return paths ? [paths count] : [names count];
+}
+
+- (NSArray *)paths
+{
+  if (paths == nil)
+    {
+      NSMutableArray *apaths = [NSMutableArray arrayWithCapacity: [names count]];
+      NSUInteger i;
+
+      for (i = 0; i < [names count]; i++)
+        [apaths addObject: [source stringByAppendingPathComponent: [names objectAtIndex: i]]];
+
+      paths = [apaths copy];
+    }
+
+  return paths;
+}
+
+- (NSArray *)samplePaths:(NSUInteger)max
+{
+  NSUInteger count = [self count];
+  NSMutableArray *sample;
+  NSUInteger i;
+
+  if ((max == 0) || (count == 0))
+    return [NSArray array];
+
+  if (count <= max)
+    return [self paths];
+
+  sample = [NSMutableArray arrayWithCapacity: max];
+
+  /* evenly spread, the last one included */
+  for (i = 0; i < max; i++)
+    {
+      NSUInteger index = (max > 1) ? (i * (count - 1) / (max - 1)) : 0;
+
+      if (source)
+        [sample addObject: [source stringByAppendingPathComponent: [names objectAtIndex: index]]];
+      else
+        [sample addObject: [paths objectAtIndex: index]];
+    }
+
+  return sample;
+}
+
+- (BOOL)containsPathOrAncestorOfPath:(NSString *)path
+{
+  if (lookup == nil)
+    lookup = [[NSSet alloc] initWithArray: (source ? names : paths)];
+
+  if (source)
+    {
+      /* only the folder right under the source can be one of the names */
+      NSString *prefix = [source isEqual: @"/"] ? source
+                                                : [source stringByAppendingString: @"/"];
+      NSString *rest;
+      NSRange r;
+
+      if (([path hasPrefix: prefix] == NO) || ([path length] <= [prefix length]))
+        return NO;
+
+      rest = [path substringFromIndex: [prefix length]];
+      r = [rest rangeOfString: @"/"];
+
+      if (r.location != NSNotFound)
+        rest = [rest substringToIndex: r.location];
+
+      return [lookup containsObject: rest];
+    }
+
+  while (1)
+    {
+      if ([lookup containsObject: path])
+        return YES;
+
+      if (([path length] <= 1) || ([path isAbsolutePath] == NO))
+        break;
+
+      path = [path stringByDeletingLastPathComponent];
+    }
+
+  return NO;
+}
+
+- (BOOL)sampleMeetsFolderInDirectory:(NSString *)dir
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSArray *sample = [self samplePaths: FSN_PASTEBOARD_SAMPLE];
+  NSUInteger i;
+
+  for (i = 0; i < [sample count]; i++)
+    {
+      NSString *name = [[sample objectAtIndex: i] lastPathComponent];
+      BOOL isdir;
+
+      if ([fm fileExistsAtPath: [dir stringByAppendingPathComponent: name]
+                   isDirectory: &isdir] && isdir)
+        return YES;
+    }
+
+  return NO;
+}
+
+@end
@@ -64,6 +64,8 @@
   NSRect iconRect;
   NSTextFieldCell *label;
   NSDictionary *fontAttr;
+  float labelWidth;
+  float labelHeight;
   NSRect labelRect;
   NSRect brImgRect;
 
@@ -32,6 +32,7 @@
 #import "FSNPathComponentsViewer.h"
 #import "FSNode.h"
 #import "FSNFunctions.h"
+#import "FSNFontWidths.h"
 #import "FSNMetadataProvider.h"
 
 #define BORDER 8.0
@@ -78,17 +79,17 @@ static NSImage *branchImage;
   unsigned selcount;
   FSNode *node;
   FSNPathComponentView *component;
+  unsigned kept;
   unsigned i;
 
-  for (i = 0; i < [components count]; i++) {
-    [[components objectAtIndex: i] removeFromSuperview];
-  }
-
-  [components removeAllObjects];
   lastComponent = nil;
   openComponent = nil;  
   
   if ((selection == nil) || ([selection count] == 0)) {
+    for (i = 0; i < [components count]; i++) {
+      [[components objectAtIndex: i] removeFromSuperview];
+    }
+    [components removeAllObjects];
     [self tile];
     RELEASE (arp);
     return;
@@ -144,9 +145,31 @@ static NSImage *branchImage;
   newSelection = [commonPath pathComponents];
   
   selcount = [newSelection count]; 
+
+  /* the components of the folders still on the path are kept, with
+     their icon and label width: only the tail is made again */
+  for (kept = 0; kept < [components count] && kept < selcount; kept++) {
+    FSNode *kn = [[components objectAtIndex: kept] node];
+    NSString *kpath = (kept == 0) ? path_separator()
+                                  : [kn name];
+
+    if ([kpath isEqual: [newSelection objectAtIndex: kept]] == NO) {
+      break;
+    }
+  }
+
+  while ([components count] > kept) {
+    [[components lastObject] removeFromSuperview];
+    [components removeLastObject];
+  }
   
-  node = nil;
-  for (i = 0; i < selcount; i++) {   
+  node = kept ? [[components objectAtIndex: kept - 1] node] : nil;
+
+  for (i = 0; i < kept; i++) {
+    [[components objectAtIndex: i] setLeaf: NO];
+  }
+
+  for (i = kept; i < selcount; i++) {   
     FSNode *pn = nil;
     
     if (i != 0) {
@@ -161,14 +184,13 @@ static NSImage *branchImage;
 
     [self addSubview: component];
     [components addObject: component];
-    
-    if (i == (selcount -1)) {
-      lastComponent = component;
-      [lastComponent setLeaf: ([selection count] == 1)];
-    }
-    
     RELEASE (component);
   }
+
+  if (selcount) {
+    lastComponent = [components objectAtIndex: selcount - 1];
+    [lastComponent setLeaf: ([selection count] == 1)];
+  }
     
   [self tile];
   RELEASE (arp);
@@ -312,6 +334,9 @@ static NSImage *branchImage;
     [label setStringValue: (hostname ? hostname : [node name])];
     ASSIGN (fontAttr, [NSDictionary dictionaryWithObject: font
                                                   forKey: NSFontAttributeName]);    
+    labelWidth = [[FSNFontWidths widthsForFont: font]
+                   widthOfString: (hostname ? hostname : [node name])];
+    labelHeight = [fsnodeRep heightOfFont: font];
 
     brImgRect = NSMakeRect(0, 0, BRANCH_SIZE, BRANCH_SIZE);
   }
@@ -326,7 +351,10 @@ static NSImage *branchImage;
 
 - (void)setLeaf:(BOOL)value
 {
-  isLeaf = value;
+  if (isLeaf != value) {
+    isLeaf = value;
+    [self setNeedsDisplay: YES];
+  }
 }
 
 + (float)minWidthForIconSize:(int)isize
@@ -342,7 +370,7 @@ static NSImage *branchImage;
 
 - (float)uncuttedLabelLenght
 {
-  return [(hostname ? hostname : [node name]) sizeWithAttributes: fontAttr].width; 
+  return labelWidth; 
 }
 
 - (void)tile
@@ -353,7 +381,7 @@ static NSImage *branchImage;
       
   if (labelRect.size.width <= ([self bounds].size.width - minwidth)) {
     labelRect.origin.x = iconRect.size.width + ELEM_MARGIN;
-    labelRect.size.height = [fsnodeRep heightOfFont: [label font]];
+    labelRect.size.height = labelHeight;
     labelRect.origin.y = (iconRect.size.height - labelRect.size.height) / 2;  
     labelRect = NSIntegralRect(labelRect);  
   } else {
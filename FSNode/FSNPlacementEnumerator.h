@@ -35,6 +35,11 @@
 - (void)reset;
 - (NSUInteger)totalCells;
 
+/* Position of `cell` in this traversal order, NSNotFound outside the
+ * grid; -cellAtIndex: is the inverse. */
+- (NSUInteger)indexOfCell:(FSNGridCell)cell;
+- (FSNGridCell)cellAtIndex:(NSUInteger)index;
+
 @end
 
 /* -----------------------------------------------------------------------
@@ -55,6 +55,18 @@
   return _totalCells;
 }
 
+- (NSUInteger)indexOfCell:(FSNGridCell)cell
+{
+  [self doesNotRecognizeSelector: _cmd];
+  return NSNotFound;
+}
+
+- (FSNGridCell)cellAtIndex:(NSUInteger)index
+{
+  [self doesNotRecognizeSelector: _cmd];
+  return FSNGridCellNone;
+}
+
 @end
 
 
@@ -87,6 +99,20 @@
   return YES;
 }
 
+- (NSUInteger)indexOfCell:(FSNGridCell)cell
+{
+  if (cell.col >= _cols || cell.row >= _rows)
+    return NSNotFound;
+  return cell.row * _cols + cell.col;
+}
+
+- (FSNGridCell)cellAtIndex:(NSUInteger)index
+{
+  if (index >= _totalCells)
+    return FSNGridCellNone;
+  return FSNGridCellMake(index % _cols, index / _cols);
+}
+
 @end
 
 
@@ -129,4 +155,18 @@
   return YES;
 }
 
+- (NSUInteger)indexOfCell:(FSNGridCell)cell
+{
+  if (cell.col >= _cols || cell.row >= _rows)
+    return NSNotFound;
+  return (_cols - 1 - cell.col) * _rows + cell.row;
+}
+
+- (FSNGridCell)cellAtIndex:(NSUInteger)index
+{
+  if (index >= _totalCells)
+    return FSNGridCellNone;
+  return FSNGridCellMake(_cols - 1 - index / _rows, index % _rows);
+}
+
 @end
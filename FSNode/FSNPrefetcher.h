@@ -0,0 +1,49 @@
+/* FSNPrefetcher.h
+ *
+ * Reads the folders the user is likely to open next while they are not
+ * doing anything.
+ *
+ * A view hands over the directories next to its keyboard focus, most
+ * likely first.  After a short idle delay they are read one at a time
+ * by an FSNDirectoryLoader into the FSNodeRep listing cache, with the
+ * file metadata warmed on the loader thread and the icons of the first
+ * entries on the main thread.  The I/O budget is strict: a few folders
+ * per focus change, none with more than PREFETCH_MAX_ENTRIES entries,
+ * none on network volumes.  A new focus replaces the pending folders
+ * and cancels the one being read.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_PREFETCHER_H
+#define FSN_PREFETCHER_H
+
+#import <Foundation/Foundation.h>
+#import "FSNDirectoryLoader.h"
+
+@class FSNode;
+
+@interface FSNPrefetcher : NSObject <FSNDirectoryLoaderDelegate>
+{
+  NSMutableArray *pending;
+  FSNode *current;
+  FSNDirectoryLoader *loader;
+  NSTimer *idleTimer;
+  int iconSize;
+}
+
++ (FSNPrefetcher *)sharedPrefetcher;
+
+/* Replaces what is waiting to be read with the directories among
+ * `nodes`, in that order, and restarts the idle delay.  Icons of
+ * `size` are warmed for the first entries of each folder; 0 warms
+ * none.  Main thread only. */
+- (void)prefetchNodes:(NSArray *)nodes
+             iconSize:(int)size;
+
+/* Drops the pending folders and stops the current read. */
+- (void)cancel;
+
+@end
+
+#endif /* FSN_PREFETCHER_H */
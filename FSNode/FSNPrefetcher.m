@@ -0,0 +1,176 @@
+/* FSNPrefetcher.m
+ *
+ * Idle-time read-ahead of the next folders.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNPrefetcher.h"
+#import "FSNode.h"
+#import "FSNodeRep.h"
+
+/* how long the focus has to stay put before anything is read */
+#define PREFETCH_IDLE_DELAY 0.15
+/* folders read per focus change */
+#define PREFETCH_MAX_FOLDERS 3
+/* bigger folders are left to the view that opens them */
+#define PREFETCH_MAX_ENTRIES 1000
+/* icons warmed per folder, about one column or window */
+#define PREFETCH_ICONS 32
+
+static FSNPrefetcher *sharedPrefetcher = nil;
+
+
+@implementation FSNPrefetcher
+
++ (FSNPrefetcher *)sharedPrefetcher
+{
+  if (sharedPrefetcher == nil)
+    {
+      sharedPrefetcher = [FSNPrefetcher new];
+    }
+  return sharedPrefetcher;
+}
+
+- (void)dealloc
+{
+  [self cancel];
+  RELEASE (pending);
+
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      pending = [NSMutableArray new];
+      current = nil;
+      loader = nil;
+      idleTimer = nil;
+      iconSize = 0;
+    }
+
+  return self;
+}
+
+- (void)prefetchNodes:(NSArray *)nodes
+             iconSize:(int)size
+{
+  NSUInteger i;
+
+  [self cancel];
+  iconSize = size;
+
+  for (i = 0; (i < [nodes count]) && ([pending count] < PREFETCH_MAX_FOLDERS); i++)
+    {
+      FSNode *node = [nodes objectAtIndex: i];
+
+      if ([node isDirectory] && ([node isPackage] == NO)
+          && ([pending containsObject: node] == NO))
+        [pending addObject: node];
+    }
+
+  if ([pending count])
+    {
+      idleTimer = [NSTimer scheduledTimerWithTimeInterval: PREFETCH_IDLE_DELAY
+                                                   target: self
+                                                 selector: @selector(idleTimerFired:)
+                                                 userInfo: nil
+                                                  repeats: NO];
+    }
+}
+
+- (void)cancel
+{
+  [pending removeAllObjects];
+
+  if (idleTimer)
+    {
+      [idleTimer invalidate];
+      idleTimer = nil;
+    }
+
+  if (loader)
+    {
+      [loader cancel];
+      DESTROY (loader);
+    }
+
+  DESTROY (current);
+}
+
+- (void)idleTimerFired:(id)sender
+{
+  idleTimer = nil;
+  [self readNextFolder];
+}
+
+- (void)readNextFolder
+{
+  FSNodeRep *fsnodeRep = [FSNodeRep sharedInstance];
+
+  DESTROY (current);
+
+  while ([pending count])
+    {
+      FSNode *node = [pending objectAtIndex: 0];
+      NSString *path = [node path];
+
+      if ([fsnodeRep hasCachedDirectoryListingAtPath: path] == NO)
+        {
+          ASSIGN (current, node);
+          [pending removeObjectAtIndex: 0];
+
+          loader = [[FSNDirectoryLoader alloc] initWithPath: path
+                                                       tier: [fsnodeRep defaultLoadTier]
+                                                   delegate: self];
+          [loader setEntryLimit: PREFETCH_MAX_ENTRIES];
+          [loader setDeliversBatches: NO];
+          [loader setLocalOnly: YES];
+          [loader setPrefetchesMetadata: YES];
+          [loader start];
+          return;
+        }
+
+      [pending removeObjectAtIndex: 0];
+    }
+}
+
+- (void)directoryLoader:(FSNDirectoryLoader *)aloader
+         didReadEntries:(FSNDirectorySnapshot *)chunk
+{
+}
+
+- (void)directoryLoader:(FSNDirectoryLoader *)aloader
+  didFinishWithSnapshot:(FSNDirectorySnapshot *)snapshot
+{
+  FSNodeRep *fsnodeRep = [FSNodeRep sharedInstance];
+
+  if ([snapshot isValid])
+    {
+      [fsnodeRep cacheDirectorySnapshot: snapshot
+                            hiddenNames: [aloader hiddenNames]];
+
+      if (iconSize > 0)
+        {
+          CREATE_AUTORELEASE_POOL(arp);
+          NSRange range = NSMakeRange(0, MIN([snapshot count], PREFETCH_ICONS));
+          NSArray *nodes = [current subNodesFromSnapshot:
+                                      [snapshot snapshotOfEntriesInRange: range]];
+          NSUInteger i;
+
+          for (i = 0; i < [nodes count]; i++)
+            [fsnodeRep iconOfSize: iconSize forNode: [nodes objectAtIndex: i]];
+
+          RELEASE (arp);
+        }
+    }
+
+  DESTROY (loader);
+  [self readNextFolder];
+}
+
+@end
@@ -0,0 +1,46 @@
+/* FSNPrefixIndex.h
+ *
+ * Type-ahead lookup over the names shown by a view.
+ *
+ * The names are case folded and sorted once, so the names starting with
+ * a prefix are one contiguous range found by binary search.  Within that
+ * range a sparse table of minimum positions gives the match that comes
+ * first in the view's own order in constant time.  A prefix that extends
+ * the previous one is searched within the previous range only, which is
+ * what typing one more character does.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_PREFIX_INDEX_H
+#define FSN_PREFIX_INDEX_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNPrefixIndex : NSObject
+{
+  NSArray *keys;                /* folded names, sorted */
+  NSUInteger count;
+  NSUInteger *positions;        /* positions[i]: view index of keys[i] */
+  NSUInteger **mins;            /* mins[k][i]: min position in [i, i + 2^k) */
+  NSUInteger levels;
+
+  NSString *lastPrefix;
+  NSRange lastRange;
+}
+
+/* The case folding used for names and prefixes. */
++ (NSString *)foldedString:(NSString *)str;
+
+/* names[i] is the name shown at index i of the view. */
+- (id)initWithNames:(NSArray *)names;
+
+- (NSUInteger)count;
+
+/* Lowest view index whose name starts with `prefix`, ignoring case, or
+ * NSNotFound.  An empty prefix matches nothing, as with -rangeOfString:. */
+- (NSUInteger)firstIndexWithPrefix:(NSString *)prefix;
+
+@end
+
+#endif /* FSN_PREFIX_INDEX_H */
@@ -0,0 +1,208 @@
+/* FSNPrefixIndex.m
+ *
+ * Type-ahead lookup over the names shown by a view.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+
+#import "FSNPrefixIndex.h"
+
+typedef struct {
+  NSString *key;
+  NSUInteger position;
+} FSNPrefixEntry;
+
+static int
+compareEntries(const void *e1, const void *e2)
+{
+  const FSNPrefixEntry *a = e1;
+  const FSNPrefixEntry *b = e2;
+  NSComparisonResult r = [a->key compare: b->key options: NSLiteralSearch];
+
+  if (r == NSOrderedSame)
+    return (a->position < b->position) ? -1 : 1;
+  return (r == NSOrderedAscending) ? -1 : 1;
+}
+
+
+@implementation FSNPrefixIndex
+
++ (NSString *)foldedString:(NSString *)str
+{
+  return [[str decomposedStringWithCanonicalMapping] lowercaseString];
+}
+
+- (void)dealloc
+{
+  NSUInteger k;
+
+  for (k = 0; k < levels; k++)
+    free(mins[k]);
+  free(mins);
+  free(positions);
+  RELEASE (keys);
+  RELEASE (lastPrefix);
+
+  [super dealloc];
+}
+
+- (id)initWithNames:(NSArray *)names
+{
+  self = [super init];
+
+  if (self)
+    {
+      FSNPrefixEntry *entries;
+      NSMutableArray *sorted;
+      NSUInteger i, k;
+
+      count = [names count];
+      entries = malloc((count + 1) * sizeof(FSNPrefixEntry));
+      positions = malloc((count + 1) * sizeof(NSUInteger));
+
+      if (entries == NULL || positions == NULL)
+        {
+          free(entries);
+          RELEASE (self);
+          return nil;
+        }
+
+      /* the folded keys are kept alive by `sorted` below */
+      sorted = [NSMutableArray arrayWithCapacity: count];
+
+      for (i = 0; i < count; i++)
+        {
+          NSString *key = [FSNPrefixIndex foldedString: [names objectAtIndex: i]];
+
+          [sorted addObject: key];
+          entries[i].key = key;
+          entries[i].position = i;
+        }
+
+      qsort(entries, count, sizeof(FSNPrefixEntry), compareEntries);
+
+      [sorted removeAllObjects];
+      for (i = 0; i < count; i++)
+        {
+          [sorted addObject: entries[i].key];
+          positions[i] = entries[i].position;
+        }
+      free(entries);
+      keys = [sorted copy];
+
+      /* sparse table: level k holds the minimum of each run of 2^k */
+      levels = 1;
+      while (((NSUInteger)1 << levels) <= count)
+        levels++;
+
+      mins = calloc(levels, sizeof(NSUInteger *));
+      if (mins == NULL)
+        {
+          levels = 0;
+          RELEASE (self);
+          return nil;
+        }
+
+      for (k = 0; k < levels; k++)
+        {
+          NSUInteger len = count - ((NSUInteger)1 << k) + 1;
+
+          mins[k] = malloc((len ? len : 1) * sizeof(NSUInteger));
+          if (mins[k] == NULL)
+            {
+              RELEASE (self);
+              return nil;
+            }
+
+          for (i = 0; i < len; i++)
+            {
+              if (k == 0)
+                {
+                  mins[0][i] = positions[i];
+                }
+              else
+                {
+                  NSUInteger half = (NSUInteger)1 << (k - 1);
+                  NSUInteger a = mins[k - 1][i];
+                  NSUInteger b = mins[k - 1][i + half];
+
+                  mins[k][i] = (a < b) ? a : b;
+                }
+            }
+        }
+
+      lastRange = NSMakeRange(0, count);
+    }
+
+  return self;
+}
+
+- (NSUInteger)count
+{
+  return count;
+}
+
+- (NSUInteger)firstIndexWithPrefix:(NSString *)prefix
+{
+  NSString *folded = [FSNPrefixIndex foldedString: prefix];
+  NSUInteger lo = 0;
+  NSUInteger hi = count;
+  NSUInteger first, end, k;
+
+  if ([folded length] == 0)
+    return NSNotFound;
+
+  /* typing one more character only narrows the previous range */
+  if (lastPrefix && [folded hasPrefix: lastPrefix])
+    {
+      lo = lastRange.location;
+      hi = NSMaxRange(lastRange);
+    }
+
+  /* first key not ordered before the prefix */
+  while (lo < hi)
+    {
+      NSUInteger mid = lo + (hi - lo) / 2;
+
+      if ([[keys objectAtIndex: mid] compare: folded options: NSLiteralSearch] == NSOrderedAscending)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  first = lo;
+
+  /* first key after it that no longer starts with the prefix */
+  hi = (lastPrefix && [folded hasPrefix: lastPrefix]) ? NSMaxRange(lastRange) : count;
+  while (lo < hi)
+    {
+      NSUInteger mid = lo + (hi - lo) / 2;
+
+      if ([[keys objectAtIndex: mid] hasPrefix: folded])
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  end = lo;
+
+  ASSIGN (lastPrefix, folded);
+  lastRange = NSMakeRange(first, end - first);
+
+  if (end == first)
+    return NSNotFound;
+
+  /* minimum over [first, end) from two overlapping runs */
+  k = 0;
+  while (((NSUInteger)2 << k) <= (end - first))
+    k++;
+
+  {
+    NSUInteger a = mins[k][first];
+    NSUInteger b = mins[k][end - ((NSUInteger)1 << k)];
+
+    return (a < b) ? a : b;
+  }
+}
+
+@end
@@ -0,0 +1,46 @@
+/* FSNRaster.h
+ *
+ * Small raster kernels for icons and thumbnails.
+ *
+ * All buffers are 8 bit interleaved samples with rows `bpr` bytes apart.
+ * The hot loops have SSE2 and NEON versions, selected at compile time,
+ * with a portable C version for everything else.  The kernels have no
+ * AppKit dependency: callers hand in -bitmapData of an NSBitmapImageRep.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_RASTER_H
+#define FSN_RASTER_H
+
+#import <Foundation/Foundation.h>
+
+/* Area-averaging downscale of a `sw` x `sh` image with `spp` (1 to 4)
+ * samples per pixel into `dw` x `dh` (dw <= sw, dh <= sh).  The image is
+ * halved with a 2x2 box filter while it is at least twice the target,
+ * the rest is a box average over the source pixels each target pixel
+ * covers.  Returns NO if no scratch memory could be allocated. */
+BOOL FSNRasterDownscale(const unsigned char *src, NSUInteger sw, NSUInteger sh,
+                        NSUInteger sbpr,
+                        unsigned char *dst, NSUInteger dw, NSUInteger dh,
+                        NSUInteger dbpr,
+                        unsigned spp);
+
+/* Maps the colour samples of a `w` x `h` RGB (`sspp` 3) or RGBA (`sspp`
+ * 4) image through `lut` into the RGBA buffer `dst`; alpha is copied, or
+ * set opaque for RGB.  With `premultiplied` the table is applied to the
+ * unpremultiplied colour, so translucent edges keep colour <= alpha. */
+void FSNRasterApplyLUT(const unsigned char *src, NSUInteger sbpr, unsigned sspp,
+                       unsigned char *dst, NSUInteger dbpr,
+                       NSUInteger w, NSUInteger h,
+                       const unsigned char lut[256],
+                       BOOL premultiplied);
+
+/* Source-over of the premultiplied RGBA `src` onto the premultiplied RGBA
+ * `dst`, both `w` x `h`: used for badges (link arrow, labels) drawn at a
+ * fixed place of an icon. */
+void FSNRasterCompositeOver(const unsigned char *src, NSUInteger sbpr,
+                            unsigned char *dst, NSUInteger dbpr,
+                            NSUInteger w, NSUInteger h);
+
+#endif /* FSN_RASTER_H */
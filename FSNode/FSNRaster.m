@@ -0,0 +1,340 @@
+/* FSNRaster.m
+ *
+ * Small raster kernels for icons and thumbnails.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define FSN_RASTER_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define FSN_RASTER_NEON 1
+#endif
+
+#import "FSNRaster.h"
+
+/* x * y / 255, rounded, for x, y in 0..255 */
+static inline unsigned
+mul255(unsigned x, unsigned y)
+{
+  unsigned t = x * y + 128;
+
+  return (t + (t >> 8)) >> 8;
+}
+
+/* ----------------------------------------------------------------------
+ * 2x2 box halving
+ * -------------------------------------------------------------------- */
+
+static void
+halveRow(const unsigned char *r0, const unsigned char *r1,
+         unsigned char *out, NSUInteger ow, unsigned spp)
+{
+  NSUInteger x = 0;
+  unsigned c;
+
+  if (spp == 4)
+    {
+#if defined(FSN_RASTER_SSE2)
+      /* 8 source pixels (two rows) -> 4 output pixels per step */
+      for (; x + 4 <= ow; x += 4)
+        {
+          const unsigned char *p0 = r0 + x * 8;
+          const unsigned char *p1 = r1 + x * 8;
+          __m128i a = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)p0),
+                                   _mm_loadu_si128((const __m128i *)p1));
+          __m128i b = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(p0 + 16)),
+                                   _mm_loadu_si128((const __m128i *)(p1 + 16)));
+          __m128i even, odd;
+
+          /* [p0 p2 p1 p3] [p4 p6 p5 p7] -> evens and odds */
+          a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+          b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+          even = _mm_unpacklo_epi64(a, b);
+          odd = _mm_unpackhi_epi64(a, b);
+
+          _mm_storeu_si128((__m128i *)(out + x * 4), _mm_avg_epu8(even, odd));
+        }
+#elif defined(FSN_RASTER_NEON)
+      for (; x + 4 <= ow; x += 4)
+        {
+          uint32x4x2_t t0 = vld2q_u32((const uint32_t *)(r0 + x * 8));
+          uint32x4x2_t t1 = vld2q_u32((const uint32_t *)(r1 + x * 8));
+          uint8x16_t even = vrhaddq_u8(vreinterpretq_u8_u32(t0.val[0]),
+                                       vreinterpretq_u8_u32(t1.val[0]));
+          uint8x16_t odd = vrhaddq_u8(vreinterpretq_u8_u32(t0.val[1]),
+                                      vreinterpretq_u8_u32(t1.val[1]));
+
+          vst1q_u8(out + x * 4, vrhaddq_u8(even, odd));
+        }
+#endif
+    }
+
+  for (; x < ow; x++)
+    {
+      const unsigned char *p0 = r0 + x * 2 * spp;
+      const unsigned char *p1 = r1 + x * 2 * spp;
+
+      for (c = 0; c < spp; c++)
+        {
+          out[x * spp + c] = (unsigned char)((p0[c] + p0[spp + c]
+                                              + p1[c] + p1[spp + c] + 2) >> 2);
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * general box average (the last, non power of two, step)
+ * -------------------------------------------------------------------- */
+
+static BOOL
+boxScale(const unsigned char *src, NSUInteger sw, NSUInteger sh, NSUInteger sbpr,
+         unsigned char *dst, NSUInteger dw, NSUInteger dh, NSUInteger dbpr,
+         unsigned spp)
+{
+  NSUInteger *xs = malloc((dw + 1) * sizeof(NSUInteger));
+  NSUInteger x, y;
+
+  if (xs == NULL)
+    return NO;
+
+  for (x = 0; x <= dw; x++)
+    xs[x] = x * sw / dw;
+
+  for (y = 0; y < dh; y++)
+    {
+      NSUInteger y0 = y * sh / dh;
+      NSUInteger y1 = (y + 1) * sh / dh;
+      unsigned char *out = dst + y * dbpr;
+
+      if (y1 <= y0)
+        y1 = y0 + 1;
+
+      for (x = 0; x < dw; x++)
+        {
+          NSUInteger x0 = xs[x];
+          NSUInteger x1 = (xs[x + 1] > x0) ? xs[x + 1] : x0 + 1;
+          unsigned long sum[4] = { 0, 0, 0, 0 };
+          unsigned long n = (x1 - x0) * (y1 - y0);
+          NSUInteger sy, sx;
+          unsigned c;
+
+          for (sy = y0; sy < y1; sy++)
+            {
+              const unsigned char *p = src + sy * sbpr + x0 * spp;
+
+              for (sx = x0; sx < x1; sx++, p += spp)
+                for (c = 0; c < spp; c++)
+                  sum[c] += p[c];
+            }
+
+          for (c = 0; c < spp; c++)
+            out[x * spp + c] = (unsigned char)((sum[c] + n / 2) / n);
+        }
+    }
+
+  free(xs);
+  return YES;
+}
+
+BOOL
+FSNRasterDownscale(const unsigned char *src, NSUInteger sw, NSUInteger sh,
+                   NSUInteger sbpr,
+                   unsigned char *dst, NSUInteger dw, NSUInteger dh,
+                   NSUInteger dbpr,
+                   unsigned spp)
+{
+  unsigned char *bufs[2] = { NULL, NULL };
+  const unsigned char *cur = src;
+  NSUInteger cw = sw, ch = sh, cbpr = sbpr;
+  int which = 0;
+  BOOL done;
+
+  if (spp < 1 || spp > 4 || dw == 0 || dh == 0 || dw > sw || dh > sh)
+    return NO;
+
+  while (cw >= dw * 2 && ch >= dh * 2)
+    {
+      NSUInteger nw = cw / 2;
+      NSUInteger nh = ch / 2;
+      NSUInteger nbpr = nw * spp;
+      NSUInteger y;
+
+      if (bufs[which] == NULL)
+        {
+          /* the first halving is the largest, later ones reuse it */
+          bufs[which] = malloc(nbpr * nh);
+          if (bufs[which] == NULL)
+            {
+              free(bufs[0]);
+              free(bufs[1]);
+              return NO;
+            }
+        }
+
+      for (y = 0; y < nh; y++)
+        {
+          halveRow(cur + (y * 2) * cbpr, cur + (y * 2 + 1) * cbpr,
+                   bufs[which] + y * nbpr, nw, spp);
+        }
+
+      cur = bufs[which];
+      cw = nw;
+      ch = nh;
+      cbpr = nbpr;
+      which = !which;
+    }
+
+  if (cw == dw && ch == dh)
+    {
+      NSUInteger y;
+
+      for (y = 0; y < dh; y++)
+        memcpy(dst + y * dbpr, cur + y * cbpr, dw * spp);
+      done = YES;
+    }
+  else
+    {
+      done = boxScale(cur, cw, ch, cbpr, dst, dw, dh, dbpr, spp);
+    }
+
+  free(bufs[0]);
+  free(bufs[1]);
+
+  return done;
+}
+
+/* ----------------------------------------------------------------------
+ * tone curve
+ * -------------------------------------------------------------------- */
+
+void
+FSNRasterApplyLUT(const unsigned char *src, NSUInteger sbpr, unsigned sspp,
+                  unsigned char *dst, NSUInteger dbpr,
+                  NSUInteger w, NSUInteger h,
+                  const unsigned char lut[256],
+                  BOOL premultiplied)
+{
+  NSUInteger x, y;
+
+  /* A table lookup has no SSE2/NEON form (no byte gather); the loop is
+   * kept branch free for opaque pixels, which are nearly all of an icon. */
+  for (y = 0; y < h; y++)
+    {
+      const unsigned char *p = src + y * sbpr;
+      unsigned char *q = dst + y * dbpr;
+
+      for (x = 0; x < w; x++, p += sspp, q += 4)
+        {
+          unsigned a = (sspp == 4) ? p[3] : 255;
+
+          if (a == 255 || premultiplied == NO)
+            {
+              q[0] = lut[p[0]];
+              q[1] = lut[p[1]];
+              q[2] = lut[p[2]];
+            }
+          else if (a == 0)
+            {
+              q[0] = q[1] = q[2] = 0;
+            }
+          else
+            {
+              unsigned c;
+
+              for (c = 0; c < 3; c++)
+                {
+                  unsigned v = (p[c] * 255 + a / 2) / a;
+
+                  q[c] = (unsigned char)mul255(lut[(v > 255) ? 255 : v], a);
+                }
+            }
+          q[3] = (unsigned char)a;
+        }
+    }
+}
+
+/* ----------------------------------------------------------------------
+ * source over
+ * -------------------------------------------------------------------- */
+
+void
+FSNRasterCompositeOver(const unsigned char *src, NSUInteger sbpr,
+                       unsigned char *dst, NSUInteger dbpr,
+                       NSUInteger w, NSUInteger h)
+{
+  NSUInteger y;
+
+  for (y = 0; y < h; y++)
+    {
+      const unsigned char *s = src + y * sbpr;
+      unsigned char *d = dst + y * dbpr;
+      NSUInteger x = 0;
+
+#if defined(FSN_RASTER_SSE2)
+      {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i k255 = _mm_set1_epi16(255);
+        const __m128i k128 = _mm_set1_epi16(128);
+
+        for (; x + 4 <= w; x += 4)
+          {
+            __m128i sv = _mm_loadu_si128((const __m128i *)(s + x * 4));
+            __m128i dv = _mm_loadu_si128((const __m128i *)(d + x * 4));
+            __m128i r[2];
+            int half;
+
+            for (half = 0; half < 2; half++)
+              {
+                __m128i s16 = half ? _mm_unpackhi_epi8(sv, zero) : _mm_unpacklo_epi8(sv, zero);
+                __m128i d16 = half ? _mm_unpackhi_epi8(dv, zero) : _mm_unpacklo_epi8(dv, zero);
+                __m128i a16 = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                  _MM_SHUFFLE(3, 3, 3, 3));
+                __m128i t = _mm_add_epi16(_mm_mullo_epi16(d16, _mm_sub_epi16(k255, a16)), k128);
+
+                t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+                r[half] = _mm_add_epi16(s16, t);
+              }
+
+            _mm_storeu_si128((__m128i *)(d + x * 4), _mm_packus_epi16(r[0], r[1]));
+          }
+      }
+#elif defined(FSN_RASTER_NEON)
+      for (; x + 8 <= w; x += 8)
+        {
+          uint8x8x4_t sv = vld4_u8(s + x * 4);
+          uint8x8x4_t dv = vld4_u8(d + x * 4);
+          uint8x8_t inv = vmvn_u8(sv.val[3]);
+          int c;
+
+          for (c = 0; c < 4; c++)
+            {
+              uint16x8_t t = vmull_u8(dv.val[c], inv);
+
+              dv.val[c] = vqadd_u8(sv.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+            }
+          vst4_u8(d + x * 4, dv);
+        }
+#endif
+
+      for (; x < w; x++)
+        {
+          const unsigned char *sp = s + x * 4;
+          unsigned char *dp = d + x * 4;
+          unsigned inv = 255 - sp[3];
+          unsigned c;
+
+          for (c = 0; c < 4; c++)
+            {
+              unsigned v = sp[c] + mul255(dp[c], inv);
+
+              dp[c] = (unsigned char)((v > 255) ? 255 : v);
+            }
+        }
+    }
+}
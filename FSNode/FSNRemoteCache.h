@@ -0,0 +1,75 @@
+/* FSNRemoteCache.h
+ *
+ * What is known to be missing on network volumes.
+ *
+ * Over SFTP every lookup of a file that is not there is a round trip, and
+ * the views look up the same few on every folder they open: .DS_Store,
+ * .hidden and the ._ sidecar of each file, which most folders on a Linux
+ * server never have.  FSNodeRep records here the metadata names each
+ * complete listing of a remote directory holds, and the lookups that
+ * failed, so that asking again within the TTL costs nothing.
+ *
+ * Entries are kept per volume, by mount point, and expire after the
+ * negative TTL.  A change seen by fswatcher or an explicit refresh drops
+ * the entries at and beneath a path.  Safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_REMOTE_CACHE_H
+#define FSN_REMOTE_CACHE_H
+
+#import <Foundation/Foundation.h>
+
+typedef enum
+{
+  FSNRemoteProbeUnknown,
+  FSNRemoteProbePresent,
+  FSNRemoteProbeMissing
+} FSNRemoteProbe;
+
+@interface FSNRemoteCache : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *volumes;     /* mount point -> FSNRemoteVolume */
+  NSTimeInterval listingTTL;
+  NSTimeInterval negativeTTL;
+}
+
+/* Seconds a remote listing is reused without asking the server and
+ * seconds a miss is remembered. */
+- (id)initWithListingTTL:(NSTimeInterval)lttl
+             negativeTTL:(NSTimeInterval)nttl;
+
+- (NSTimeInterval)listingTTL;
+
+- (NSTimeInterval)negativeTTL;
+
+/* .DS_Store, .hidden and the ._ sidecars. */
++ (BOOL)isMetadataName:(NSString *)name;
+
+/* `names` is a complete listing of `dir`; only its metadata names are
+ * kept, which answers every metadata lookup in `dir` until they expire. */
+- (void)setListedNames:(NSArray *)names
+           ofDirectory:(NSString *)dir
+              onVolume:(NSString *)mpoint
+                atTime:(NSTimeInterval)now;
+
+- (void)setMissingPath:(NSString *)path
+              onVolume:(NSString *)mpoint
+                atTime:(NSTimeInterval)now;
+
+- (FSNRemoteProbe)probeForPath:(NSString *)path
+                      onVolume:(NSString *)mpoint
+                        atTime:(NSTimeInterval)now;
+
+/* Drops what is known at `path` and beneath it, on every volume. */
+- (void)invalidatePath:(NSString *)path;
+
+- (void)invalidateVolume:(NSString *)mpoint;
+
+- (void)invalidateAll;
+
+@end
+
+#endif /* FSN_REMOTE_CACHE_H */
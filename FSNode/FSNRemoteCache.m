@@ -0,0 +1,308 @@
+/* FSNRemoteCache.m
+ *
+ * What is known to be missing on network volumes.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNRemoteCache.h"
+
+/* per volume and kind; past it the expired entries go, then all of them */
+#define REMOTE_CACHE_MAX_ENTRIES 4096
+
+
+@interface FSNRemoteListing : NSObject
+{
+@public
+  NSSet *names;
+  NSTimeInterval time;
+}
+@end
+
+@implementation FSNRemoteListing
+
+- (void)dealloc
+{
+  RELEASE (names);
+  [super dealloc];
+}
+
+@end
+
+
+@interface FSNRemoteVolume : NSObject
+{
+@public
+  NSMutableDictionary *listings;    /* directory -> FSNRemoteListing */
+  NSMutableDictionary *missing;     /* path -> NSNumber, time of the miss */
+}
+@end
+
+@implementation FSNRemoteVolume
+
+- (void)dealloc
+{
+  RELEASE (listings);
+  RELEASE (missing);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      listings = [NSMutableDictionary new];
+      missing = [NSMutableDictionary new];
+    }
+
+  return self;
+}
+
+@end
+
+
+static BOOL
+isAtOrBeneath(NSString *path, NSString *base)
+{
+  NSUInteger blen = [base length];
+
+  if ([path hasPrefix: base] == NO)
+    return NO;
+  if (([path length] == blen) || [base isEqual: @"/"])
+    return YES;
+
+  return ([path characterAtIndex: blen] == '/');
+}
+
+static void
+removeKeysAtOrBeneath(NSMutableDictionary *dict, NSString *base)
+{
+  NSArray *keys = [dict allKeys];
+  NSUInteger i;
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+
+      if (isAtOrBeneath(key, base))
+        [dict removeObjectForKey: key];
+    }
+}
+
+
+@implementation FSNRemoteCache
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (volumes);
+  [super dealloc];
+}
+
+- (id)initWithListingTTL:(NSTimeInterval)lttl
+             negativeTTL:(NSTimeInterval)nttl
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      volumes = [NSMutableDictionary new];
+      listingTTL = lttl;
+      negativeTTL = nttl;
+    }
+
+  return self;
+}
+
+- (NSTimeInterval)listingTTL
+{
+  return listingTTL;
+}
+
+- (NSTimeInterval)negativeTTL
+{
+  return negativeTTL;
+}
+
++ (BOOL)isMetadataName:(NSString *)name
+{
+  return ([name isEqual: @".DS_Store"] || [name isEqual: @".hidden"]
+          || [name hasPrefix: @"._"]);
+}
+
+/* with the lock held */
+- (FSNRemoteVolume *)volumeForMountPoint:(NSString *)mpoint
+                                  create:(BOOL)create
+{
+  FSNRemoteVolume *vol = [volumes objectForKey: mpoint];
+
+  if ((vol == nil) && create)
+    {
+      vol = [FSNRemoteVolume new];
+      [volumes setObject: vol forKey: mpoint];
+      RELEASE (vol);
+    }
+
+  return vol;
+}
+
+/* with the lock held */
+- (void)makeRoomIn:(NSMutableDictionary *)dict
+            atTime:(NSTimeInterval)now
+{
+  NSArray *keys;
+  NSUInteger i;
+
+  if ([dict count] < REMOTE_CACHE_MAX_ENTRIES)
+    return;
+
+  keys = [dict allKeys];
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+      id entry = [dict objectForKey: key];
+      NSTimeInterval t = [entry isKindOfClass: [FSNRemoteListing class]]
+                           ? ((FSNRemoteListing *)entry)->time
+                           : [entry doubleValue];
+
+      if ((now - t) > negativeTTL)
+        [dict removeObjectForKey: key];
+    }
+
+  if ([dict count] >= REMOTE_CACHE_MAX_ENTRIES)
+    [dict removeAllObjects];
+}
+
+- (void)setListedNames:(NSArray *)names
+           ofDirectory:(NSString *)dir
+              onVolume:(NSString *)mpoint
+                atTime:(NSTimeInterval)now
+{
+  FSNRemoteListing *listing = [FSNRemoteListing new];
+  NSMutableSet *found = [NSMutableSet set];
+  FSNRemoteVolume *vol;
+  NSUInteger i;
+
+  for (i = 0; i < [names count]; i++)
+    {
+      NSString *name = [names objectAtIndex: i];
+
+      if ([FSNRemoteCache isMetadataName: name])
+        [found addObject: name];
+    }
+
+  listing->names = [found copy];
+  listing->time = now;
+
+  [lock lock];
+  vol = [self volumeForMountPoint: mpoint create: YES];
+  [self makeRoomIn: vol->listings atTime: now];
+  [vol->listings setObject: listing forKey: dir];
+  [lock unlock];
+
+  RELEASE (listing);
+}
+
+- (void)setMissingPath:(NSString *)path
+              onVolume:(NSString *)mpoint
+                atTime:(NSTimeInterval)now
+{
+  FSNRemoteVolume *vol;
+
+  [lock lock];
+  vol = [self volumeForMountPoint: mpoint create: YES];
+  [self makeRoomIn: vol->missing atTime: now];
+  [vol->missing setObject: [NSNumber numberWithDouble: now] forKey: path];
+  [lock unlock];
+}
+
+- (FSNRemoteProbe)probeForPath:(NSString *)path
+                      onVolume:(NSString *)mpoint
+                        atTime:(NSTimeInterval)now
+{
+  NSString *name = [path lastPathComponent];
+  NSString *dir = [path stringByDeletingLastPathComponent];
+  FSNRemoteProbe probe = FSNRemoteProbeUnknown;
+  FSNRemoteVolume *vol;
+  NSNumber *missed;
+
+  [lock lock];
+  vol = [self volumeForMountPoint: mpoint create: NO];
+
+  if (vol == nil)
+    {
+      [lock unlock];
+      return FSNRemoteProbeUnknown;
+    }
+
+  missed = [vol->missing objectForKey: path];
+
+  if (missed && ((now - [missed doubleValue]) > negativeTTL))
+    {
+      [vol->missing removeObjectForKey: path];
+      missed = nil;
+    }
+
+  if ([FSNRemoteCache isMetadataName: name])
+    {
+      FSNRemoteListing *listing = [vol->listings objectForKey: dir];
+
+      if (listing && ((now - listing->time) > negativeTTL))
+        {
+          [vol->listings removeObjectForKey: dir];
+          listing = nil;
+        }
+
+      /* the newer of the listing and the miss tells */
+      if (listing && ((missed == nil) || (listing->time > [missed doubleValue])))
+        probe = [listing->names containsObject: name] ? FSNRemoteProbePresent
+                                                      : FSNRemoteProbeMissing;
+    }
+
+  if ((probe == FSNRemoteProbeUnknown) && missed)
+    probe = FSNRemoteProbeMissing;
+
+  [lock unlock];
+
+  return probe;
+}
+
+- (void)invalidatePath:(NSString *)path
+{
+  NSString *parent = [path stringByDeletingLastPathComponent];
+  NSEnumerator *enumerator;
+  FSNRemoteVolume *vol;
+
+  [lock lock];
+  enumerator = [volumes objectEnumerator];
+
+  while ((vol = [enumerator nextObject]) != nil)
+    {
+      removeKeysAtOrBeneath(vol->listings, path);
+      removeKeysAtOrBeneath(vol->missing, path);
+      /* the listing holding it no longer tells the truth about it */
+      [vol->listings removeObjectForKey: parent];
+    }
+
+  [lock unlock];
+}
+
+- (void)invalidateVolume:(NSString *)mpoint
+{
+  [lock lock];
+  [volumes removeObjectForKey: mpoint];
+  [lock unlock];
+}
+
+- (void)invalidateAll
+{
+  [lock lock];
+  [volumes removeAllObjects];
+  [lock unlock];
+}
+
+@end
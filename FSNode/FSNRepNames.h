@@ -0,0 +1,21 @@
+/* FSNRepNames.h
+ *
+ * The reps of a view by the file name of their node.
+ *
+ * fswatcher and the file operations name the entries of a folder by
+ * their file name.  -[FSNode name] is not that: special folders show a
+ * localized name ("Scrivania" for Desktop), so the reps are keyed by
+ * -[FSNode lastPathComponent].
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_REP_NAMES_H
+#define FSN_REP_NAMES_H
+
+#import <Foundation/Foundation.h>
+
+/* file name -> rep, for each of `reps` answering -node. */
+NSMutableDictionary *FSNRepsByFileName(NSArray *reps);
+
+#endif /* FSN_REP_NAMES_H */
@@ -0,0 +1,27 @@
+/* FSNRepNames.m
+ *
+ * The reps of a view by the file name of their node.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNRepNames.h"
+
+NSMutableDictionary *
+FSNRepsByFileName(NSArray *reps)
+{
+  NSUInteger count = [reps count];
+  NSMutableDictionary *dict = [NSMutableDictionary dictionaryWithCapacity: count];
+  NSUInteger i;
+
+  for (i = 0; i < count; i++)
+    {
+      id rep = [reps objectAtIndex: i];
+      NSString *fname = [[rep node] lastPathComponent];
+
+      if (fname)
+        [dict setObject: rep forKey: fname];
+    }
+
+  return dict;
+}
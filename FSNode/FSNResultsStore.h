@@ -0,0 +1,86 @@
+/* FSNResultsStore.h
+ *
+ * The paths a live search folder found, kept in the folder.
+ *
+ * They live in two files: lsf.results, the sorted paths, memory-mapped
+ * and searched in place, and lsf.results.log, to which every path found
+ * or lost since is appended.  A change costs a record of the log; when
+ * the log is past a quarter of the sorted file, both are rewritten into
+ * a new sorted file and an empty log, which take the next generation.
+ * The folders of before the store, with their paths in the property
+ * list lsf.found, are read from it and moved into the store by the
+ * first writer.
+ *
+ * One process writes (lsfupdater), any number read.  A reader follows
+ * the log from where it read it last, and reads the whole store again
+ * when the sorted file was replaced.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_RESULTS_STORE_H
+#define FSN_RESULTS_STORE_H
+
+#import <Foundation/Foundation.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+@interface FSNResultsStore : NSObject
+{
+  NSString *basePath;
+  NSString *logPath;
+  NSString *legacyPath;
+  BOOL writable;
+
+  uint8_t *baseMap;
+  size_t baseMapLength;
+  const uint64_t *offsets;
+  const char *strings;
+  uint64_t baseCount;
+  uint64_t generation;
+  dev_t baseDevice;
+  ino_t baseInode;
+
+  NSMutableSet *added;     /* logged in, not in the sorted file */
+  NSMutableSet *removed;   /* in the sorted file, logged out */
+  uint64_t logOffset;      /* of the first record not read yet */
+  NSMutableData *pending;  /* writer: the records not written yet */
+}
+
+/* The store of the live search folder `dir`.  A writable one is created
+ * there when it does not exist. */
+- (id)initWithDirectory:(NSString *)dir
+               writable:(BOOL)flag;
+
+- (NSUInteger)count;
+
+- (BOOL)containsPath:(NSString *)path;
+
+/* All the paths, in the byte order of their UTF-8 strings. */
+- (NSArray *)allPaths;
+
+/* Writer only.  YES when the path was not there, or was. */
+- (BOOL)addPath:(NSString *)path;
+
+- (BOOL)removePath:(NSString *)path;
+
+/* Writer only.  Replaces all the paths, at once in a new sorted file. */
+- (BOOL)setPaths:(NSArray *)paths;
+
+/* Writer only.  Appends the changes to the log, and compacts the store
+ * when the log is too long. */
+- (BOOL)synchronize;
+
+- (BOOL)needsCompaction;
+
+- (BOOL)compact;
+
+/* Reader.  Reads what the writer changed since the last call, and
+ * returns YES when paths were added or removed, which are then in
+ * `addedp` and `removedp`. */
+- (BOOL)refreshAddedPaths:(NSArray **)addedp
+             removedPaths:(NSArray **)removedp;
+
+@end
+
+#endif /* FSN_RESULTS_STORE_H */
@@ -0,0 +1,711 @@
+/* FSNResultsStore.m
+ *
+ * The paths a live search folder found, kept in the folder.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#import "FSNResultsStore.h"
+
+#define BASE_MAGIC 0x5246534c   /* "LSFR" */
+#define LOG_MAGIC  0x4c46534c   /* "LSFL" */
+#define STORE_VERSION 1
+
+/* below this, a log is not worth folding into the sorted file */
+#define MIN_COMPACTION_LOG (64 * 1024)
+
+/* set in the length word of the record of a removal */
+#define REMOVAL_FLAG 0x80000000U
+
+/* followed by `count` offsets into the strings, in the order of the
+ * strings, and by the strings, UTF-8 and NUL terminated */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+  uint64_t count;
+  uint64_t stringsLength;
+} BaseHeader;
+
+/* followed by the records: a uint32_t with the length of the path, and
+ * REMOVAL_FLAG for a removal, then the path, UTF-8, no NUL.  A log whose
+ * generation is not the one of the sorted file was folded into it. */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+} LogHeader;
+
+static NSComparisonResult
+compareUTF8(id p1, id p2, void *context)
+{
+  int r = strcmp([p1 UTF8String], [p2 UTF8String]);
+
+  return (r < 0) ? NSOrderedAscending : ((r > 0) ? NSOrderedDescending : NSOrderedSame);
+}
+
+/* What is in `after` and not in `before`, and the reverse, both sorted. */
+static void
+diffSortedPaths(NSArray *before, NSArray *after,
+                NSMutableArray *plus, NSMutableArray *minus)
+{
+  NSUInteger b = 0;
+  NSUInteger a = 0;
+
+  while ((b < [before count]) || (a < [after count]))
+    {
+      NSComparisonResult r;
+
+      if (b == [before count])
+        r = NSOrderedDescending;
+      else if (a == [after count])
+        r = NSOrderedAscending;
+      else
+        r = compareUTF8([before objectAtIndex: b], [after objectAtIndex: a], NULL);
+
+      if (r == NSOrderedAscending)
+        [minus addObject: [before objectAtIndex: b++]];
+      else if (r == NSOrderedDescending)
+        [plus addObject: [after objectAtIndex: a++]];
+      else
+        {
+          b++;
+          a++;
+        }
+    }
+}
+
+static BOOL
+appendAll(int fd, const void *buf, size_t len)
+{
+  const uint8_t *p = buf;
+
+  while (len > 0)
+    {
+      ssize_t n = write(fd, p, len);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return NO;
+        }
+      p += n;
+      len -= n;
+    }
+
+  return YES;
+}
+
+static BOOL
+readAll(int fd, void *buf, size_t len, off_t offset)
+{
+  uint8_t *p = buf;
+
+  while (len > 0)
+    {
+      ssize_t n = pread(fd, p, len, offset);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return NO;
+        }
+      if (n == 0)
+        return NO;
+      p += n;
+      len -= n;
+      offset += n;
+    }
+
+  return YES;
+}
+
+
+@interface FSNResultsStore (Private)
+
+- (BOOL)mapBase;
+- (void)unmapBase;
+- (BOOL)baseContainsPath:(NSString *)path;
+- (BOOL)notePath:(NSString *)path;
+- (BOOL)forgetPath:(NSString *)path;
+- (void)logPath:(NSString *)path
+        removal:(BOOL)removal;
+- (BOOL)readLogNoting:(NSMutableDictionary *)initial;
+- (BOOL)replaceBaseWithSortedPaths:(NSArray *)paths;
+
+@end
+
+
+@implementation FSNResultsStore
+
+- (void)dealloc
+{
+  [self unmapBase];
+  RELEASE (basePath);
+  RELEASE (logPath);
+  RELEASE (legacyPath);
+  RELEASE (added);
+  RELEASE (removed);
+  RELEASE (pending);
+
+  [super dealloc];
+}
+
+- (id)initWithDirectory:(NSString *)dir
+               writable:(BOOL)flag
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (basePath, [dir stringByAppendingPathComponent: @"lsf.results"]);
+      ASSIGN (logPath, [dir stringByAppendingPathComponent: @"lsf.results.log"]);
+      ASSIGN (legacyPath, [dir stringByAppendingPathComponent: @"lsf.found"]);
+      writable = flag;
+
+      added = [NSMutableSet new];
+      removed = [NSMutableSet new];
+      pending = [NSMutableData new];
+      baseMap = NULL;
+      baseCount = 0;
+      generation = 0;
+      baseDevice = 0;
+      baseInode = 0;
+      logOffset = 0;
+
+      if ([self mapBase])
+        {
+          /* a log left of another generation is replaced, to be read */
+          if (([self readLogNoting: nil] == NO) && writable)
+            [self compact];
+        }
+      else
+        {
+          /* a folder of before the store, or a new one */
+          NSArray *legacy = [NSArray arrayWithContentsOfFile: legacyPath];
+
+          if (writable)
+            {
+              legacy = [legacy sortedArrayUsingFunction: compareUTF8 context: NULL];
+
+              if ([self replaceBaseWithSortedPaths: (legacy ? legacy : [NSArray array])] == NO)
+                {
+                  DESTROY (self);
+                  return nil;
+                }
+              if (legacy)
+                {
+                  [[NSFileManager defaultManager] removeFileAtPath: legacyPath
+                                                           handler: nil];
+                }
+            }
+          else if (legacy)
+            {
+              [added addObjectsFromArray: legacy];
+            }
+        }
+    }
+
+  return self;
+}
+
+- (NSUInteger)count
+{
+  return (NSUInteger)(baseCount - [removed count] + [added count]);
+}
+
+- (BOOL)containsPath:(NSString *)path
+{
+  if ([added containsObject: path])
+    return YES;
+  if ([removed containsObject: path])
+    return NO;
+  return [self baseContainsPath: path];
+}
+
+- (NSArray *)allPaths
+{
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [self count]];
+  NSArray *extra = [[added allObjects] sortedArrayUsingFunction: compareUTF8
+                                                        context: NULL];
+  NSUInteger extraCount = [extra count];
+  NSUInteger e = 0;
+  const char *next = extraCount ? [[extra objectAtIndex: 0] UTF8String] : NULL;
+  BOOL checkRemoved = ([removed count] > 0);
+  uint64_t i;
+
+  for (i = 0; i < baseCount; i++)
+    {
+      const char *s = strings + offsets[i];
+      NSString *path;
+
+      while (next && (strcmp(next, s) < 0))
+        {
+          [paths addObject: [extra objectAtIndex: e++]];
+          next = (e < extraCount) ? [[extra objectAtIndex: e] UTF8String] : NULL;
+        }
+
+      path = [[NSString alloc] initWithUTF8String: s];
+      if (path && ((checkRemoved == NO) || ([removed containsObject: path] == NO)))
+        [paths addObject: path];
+      RELEASE (path);
+    }
+
+  while (e < extraCount)
+    [paths addObject: [extra objectAtIndex: e++]];
+
+  return paths;
+}
+
+- (BOOL)addPath:(NSString *)path
+{
+  if ((writable == NO) || ([self notePath: path] == NO))
+    return NO;
+
+  [self logPath: path removal: NO];
+  return YES;
+}
+
+- (BOOL)removePath:(NSString *)path
+{
+  if ((writable == NO) || ([self forgetPath: path] == NO))
+    return NO;
+
+  [self logPath: path removal: YES];
+  return YES;
+}
+
+- (BOOL)setPaths:(NSArray *)paths
+{
+  if (writable == NO)
+    return NO;
+
+  return [self replaceBaseWithSortedPaths:
+                 [paths sortedArrayUsingFunction: compareUTF8 context: NULL]];
+}
+
+- (BOOL)synchronize
+{
+  if (writable == NO)
+    return NO;
+
+  if ([pending length])
+    {
+      int fd = open([logPath fileSystemRepresentation], O_WRONLY | O_APPEND);
+      struct stat st;
+      BOOL done;
+
+      if (fd < 0)
+        {
+          /* the log went away: the changes go in a new sorted file */
+          return [self compact];
+        }
+
+      done = appendAll(fd, [pending bytes], [pending length]);
+      if (done && (fstat(fd, &st) == 0))
+        logOffset = (uint64_t)st.st_size;
+      close(fd);
+
+      if (done == NO)
+        return NO;
+
+      [pending setLength: 0];
+    }
+
+  if ([self needsCompaction])
+    return [self compact];
+
+  return YES;
+}
+
+- (BOOL)needsCompaction
+{
+  return (logOffset > MIN_COMPACTION_LOG) && (logOffset > baseMapLength / 4);
+}
+
+- (BOOL)compact
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  BOOL done;
+
+  if (writable == NO)
+    {
+      RELEASE (arp);
+      return NO;
+    }
+
+  done = [self replaceBaseWithSortedPaths: [self allPaths]];
+  RELEASE (arp);
+
+  return done;
+}
+
+- (BOOL)refreshAddedPaths:(NSArray **)addedp
+             removedPaths:(NSArray **)removedp
+{
+  NSMutableArray *plus = [NSMutableArray array];
+  NSMutableArray *minus = [NSMutableArray array];
+  NSMutableDictionary *initial = [NSMutableDictionary dictionary];
+  struct stat st;
+  BOOL replaced;
+
+  replaced = ((stat([basePath fileSystemRepresentation], &st) == 0)
+              && ((st.st_ino != baseInode) || (st.st_dev != baseDevice)));
+
+  if ((replaced == NO) && [self readLogNoting: initial])
+    {
+      NSEnumerator *enumerator = [initial keyEnumerator];
+      NSString *path;
+
+      while ((path = [enumerator nextObject]) != nil)
+        {
+          BOOL was = [[initial objectForKey: path] boolValue];
+          BOOL is = [self containsPath: path];
+
+          if (is && (was == NO))
+            [plus addObject: path];
+          else if (was && (is == NO))
+            [minus addObject: path];
+        }
+    }
+  else
+    {
+      /* compacted, or written anew: what changed is found comparing */
+      CREATE_AUTORELEASE_POOL(arp);
+      NSArray *before = [self allPaths];
+
+      if ([self mapBase])
+        {
+          [added removeAllObjects];
+          [removed removeAllObjects];
+          logOffset = 0;
+          [self readLogNoting: nil];
+          diffSortedPaths(before, [self allPaths], plus, minus);
+        }
+      RELEASE (arp);
+    }
+
+  if (addedp)
+    *addedp = plus;
+  if (removedp)
+    *removedp = minus;
+
+  return ([plus count] || [minus count]);
+}
+
+@end
+
+
+@implementation FSNResultsStore (Private)
+
+/* Maps the sorted file, in place of the one mapped, if it is sound. */
+- (BOOL)mapBase
+{
+  const BaseHeader *header;
+  struct stat st;
+  uint8_t *map;
+  const uint64_t *offs;
+  uint64_t i;
+  int fd;
+
+  fd = open([basePath fileSystemRepresentation], O_RDONLY);
+  if (fd < 0)
+    return NO;
+
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(BaseHeader)))
+    {
+      close(fd);
+      return NO;
+    }
+
+  map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NO;
+
+  header = (const BaseHeader *)map;
+  offs = (const uint64_t *)(map + sizeof(BaseHeader));
+
+  if ((header->magic != BASE_MAGIC)
+      || (header->version != STORE_VERSION)
+      || (header->count > ((uint64_t)st.st_size - sizeof(BaseHeader)) / sizeof(uint64_t))
+      || (sizeof(BaseHeader) + header->count * sizeof(uint64_t) + header->stringsLength
+          != (uint64_t)st.st_size)
+      || ((header->stringsLength > 0) && (map[st.st_size - 1] != 0))
+      || ((header->count > 0) && (header->stringsLength == 0)))
+    {
+      munmap(map, (size_t)st.st_size);
+      return NO;
+    }
+
+  for (i = 0; i < header->count; i++)
+    {
+      if (offs[i] >= header->stringsLength)
+        {
+          munmap(map, (size_t)st.st_size);
+          return NO;
+        }
+    }
+
+  [self unmapBase];
+
+  baseMap = map;
+  baseMapLength = (size_t)st.st_size;
+  offsets = offs;
+  strings = (const char *)(offs + header->count);
+  baseCount = header->count;
+  generation = header->generation;
+  baseDevice = st.st_dev;
+  baseInode = st.st_ino;
+
+  return YES;
+}
+
+- (void)unmapBase
+{
+  if (baseMap)
+    munmap(baseMap, baseMapLength);
+
+  baseMap = NULL;
+  baseMapLength = 0;
+  offsets = NULL;
+  strings = NULL;
+  baseCount = 0;
+}
+
+- (BOOL)baseContainsPath:(NSString *)path
+{
+  const char *s = [path UTF8String];
+  uint64_t lo = 0;
+  uint64_t hi = baseCount;
+
+  while (lo < hi)
+    {
+      uint64_t mid = lo + (hi - lo) / 2;
+      int r = strcmp(strings + offsets[mid], s);
+
+      if (r == 0)
+        return YES;
+      if (r < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return NO;
+}
+
+/* YES when the path was not in the store and now is. */
+- (BOOL)notePath:(NSString *)path
+{
+  if ([removed containsObject: path])
+    {
+      [removed removeObject: path];
+      return YES;
+    }
+  if ([added containsObject: path] || [self baseContainsPath: path])
+    return NO;
+
+  [added addObject: path];
+  return YES;
+}
+
+/* YES when the path was in the store and now is not. */
+- (BOOL)forgetPath:(NSString *)path
+{
+  if ([added containsObject: path])
+    {
+      [added removeObject: path];
+      return YES;
+    }
+  if (([removed containsObject: path] == NO) && [self baseContainsPath: path])
+    {
+      [removed addObject: path];
+      return YES;
+    }
+
+  return NO;
+}
+
+- (void)logPath:(NSString *)path
+        removal:(BOOL)removal
+{
+  const char *s = [path UTF8String];
+  uint32_t word = (uint32_t)strlen(s);
+
+  if (removal)
+    word |= REMOVAL_FLAG;
+
+  [pending appendBytes: &word length: sizeof(word)];
+  [pending appendBytes: s length: strlen(s)];
+}
+
+/* Applies the records appended to the log since the last read.  With
+ * `initial`, what the paths they name were before goes in it.  NO when
+ * the log is not the one of the mapped sorted file. */
+- (BOOL)readLogNoting:(NSMutableDictionary *)initial
+{
+  LogHeader header;
+  struct stat st;
+  uint8_t *buf;
+  size_t length;
+  size_t p;
+  int fd;
+
+  fd = open([logPath fileSystemRepresentation], O_RDONLY);
+  if (fd < 0)
+    return YES;
+
+  if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(LogHeader))
+      || (readAll(fd, &header, sizeof(header), 0) == NO)
+      || (header.magic != LOG_MAGIC) || (header.version != STORE_VERSION))
+    {
+      close(fd);
+      return YES;
+    }
+
+  if (header.generation != generation)
+    {
+      close(fd);
+      return NO;
+    }
+
+  if (logOffset < sizeof(LogHeader))
+    logOffset = sizeof(LogHeader);
+
+  if ((uint64_t)st.st_size <= logOffset)
+    {
+      close(fd);
+      return YES;
+    }
+
+  length = (size_t)((uint64_t)st.st_size - logOffset);
+  buf = malloc(length);
+
+  if ((buf == NULL) || (readAll(fd, buf, length, (off_t)logOffset) == NO))
+    {
+      free(buf);
+      close(fd);
+      return YES;
+    }
+  close(fd);
+
+  /* a record still being written is read next time */
+  p = 0;
+  while (p + sizeof(uint32_t) <= length)
+    {
+      uint32_t word;
+      uint32_t len;
+      NSString *path;
+
+      memcpy(&word, buf + p, sizeof(word));
+      len = word & ~REMOVAL_FLAG;
+
+      if (p + sizeof(uint32_t) + len > length)
+        break;
+
+      path = [[NSString alloc] initWithBytes: buf + p + sizeof(uint32_t)
+                                      length: len
+                                    encoding: NSUTF8StringEncoding];
+      if (path)
+        {
+          if (initial && ([initial objectForKey: path] == nil))
+            {
+              [initial setObject: [NSNumber numberWithBool: [self containsPath: path]]
+                          forKey: path];
+            }
+          if (word & REMOVAL_FLAG)
+            [self forgetPath: path];
+          else
+            [self notePath: path];
+          RELEASE (path);
+        }
+
+      p += sizeof(uint32_t) + len;
+    }
+
+  logOffset += p;
+  free(buf);
+
+  return YES;
+}
+
+/* Writes `paths`, sorted, into a new sorted file, then a new log, both
+ * of the next generation, and maps the new file. */
+- (BOOL)replaceBaseWithSortedPaths:(NSArray *)paths
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSUInteger count = [paths count];
+  NSMutableData *offs = [NSMutableData dataWithCapacity: count * sizeof(uint64_t)];
+  NSMutableData *strs = [NSMutableData data];
+  NSMutableData *data;
+  BaseHeader header;
+  LogHeader logHeader;
+  const char *last = NULL;
+  NSUInteger i;
+  BOOL done;
+
+  header.magic = BASE_MAGIC;
+  header.version = STORE_VERSION;
+  header.generation = generation + 1;
+  header.count = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      const char *s = [[paths objectAtIndex: i] UTF8String];
+      uint64_t offset = [strs length];
+
+      if (last && (strcmp(last, s) == 0))
+        continue;
+
+      [offs appendBytes: &offset length: sizeof(offset)];
+      [strs appendBytes: s length: strlen(s) + 1];
+      header.count++;
+      last = s;
+    }
+
+  header.stringsLength = [strs length];
+
+  data = [NSMutableData dataWithCapacity: sizeof(header) + [offs length] + [strs length]];
+  [data appendBytes: &header length: sizeof(header)];
+  [data appendData: offs];
+  [data appendData: strs];
+
+  logHeader.magic = LOG_MAGIC;
+  logHeader.version = STORE_VERSION;
+  logHeader.generation = header.generation;
+
+  /* a crash between the two leaves the old log, of the old generation,
+     that the new sorted file already has */
+  done = ([data writeToFile: basePath atomically: YES]
+          && [[NSData dataWithBytes: &logHeader length: sizeof(logHeader)]
+               writeToFile: logPath atomically: YES]);
+
+  RELEASE (arp);
+
+  if (done && [self mapBase])
+    {
+      [added removeAllObjects];
+      [removed removeAllObjects];
+      [pending setLength: 0];
+      logOffset = sizeof(LogHeader);
+      return YES;
+    }
+
+  return NO;
+}
+
+@end
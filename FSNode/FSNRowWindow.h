@@ -0,0 +1,27 @@
+/* FSNRowWindow.h
+ *
+ * The rows of a long list that are bound to a fixed pool of cells.
+ *
+ * A browser column shows the sorted subnodes of its folder, but only
+ * the rows around the visible ones have a cell.  The window is moved
+ * when the visible rows leave it, and then centred on them, so that
+ * ordinary scrolling rebinds the pool about once a screen instead of
+ * on every step.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_ROW_WINDOW_H
+#define FSN_ROW_WINDOW_H
+
+#import <Foundation/Foundation.h>
+
+/* The rows of `rows` to bind to at most `capacity` cells, when `visible`
+ * are shown and `bound` are bound.  Returns `bound` itself while it still
+ * covers the visible rows and has the length it should have. */
+NSRange FSNRowWindowForVisibleRows(NSRange visible,
+                                   NSRange bound,
+                                   NSUInteger rows,
+                                   NSUInteger capacity);
+
+#endif /* FSN_ROW_WINDOW_H */
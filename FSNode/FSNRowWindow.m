@@ -0,0 +1,37 @@
+/* FSNRowWindow.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "FSNRowWindow.h"
+
+NSRange
+FSNRowWindowForVisibleRows(NSRange visible,
+                           NSRange bound,
+                           NSUInteger rows,
+                           NSUInteger capacity)
+{
+  NSUInteger length = MIN(rows, capacity);
+  NSUInteger slack;
+  NSUInteger first;
+
+  /* only the rows there are can be visible */
+  if (visible.location > rows)
+    visible.location = rows;
+  if (visible.length > rows - visible.location)
+    visible.length = rows - visible.location;
+
+  if ((bound.length == length)
+      && (NSMaxRange(bound) <= rows)
+      && (visible.location >= bound.location)
+      && (NSMaxRange(visible) <= NSMaxRange(bound)))
+    return bound;
+
+  slack = (length > visible.length) ? (length - visible.length) / 2 : 0;
+  first = (visible.location > slack) ? (visible.location - slack) : 0;
+
+  if (first > rows - length)
+    first = rows - length;
+
+  return NSMakeRange(first, length);
+}
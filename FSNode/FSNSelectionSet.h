@@ -0,0 +1,57 @@
+/* FSNSelectionSet.h
+ *
+ * The selection of a view, one bit per rep.
+ *
+ * A rep is selected when the bit at its position in the view's reps is
+ * set.  Selecting everything only sets a flag, which is written out to
+ * the words the first time a single rep is taken away again; the
+ * selected positions are found a word at a time, so a view of many
+ * reps with a few selected enumerates them without looking at the
+ * others, and the number selected is always known.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_SELECTION_SET_H
+#define FSN_SELECTION_SET_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNSelectionSet : NSObject
+{
+  unsigned long long *_words;
+  NSUInteger _wordCount;        /* allocated */
+  NSUInteger _count;            /* the reps */
+  NSUInteger _selectedCount;
+  BOOL _all;                    /* every rep, the words not written */
+}
+
+- (instancetype)initWithCount:(NSUInteger)count;
+
+/* The reps added past the old count are not selected. */
+- (void)setCount:(NSUInteger)count;
+
+- (NSUInteger)count;
+
+- (NSUInteger)selectedCount;
+
+/* NO for positions past the count. */
+- (BOOL)containsIndex:(NSUInteger)index;
+
+/* YES when the selection changed. */
+- (BOOL)addIndex:(NSUInteger)index;
+
+- (BOOL)removeIndex:(NSUInteger)index;
+
+- (void)addAll;
+
+- (void)removeAll;
+
+/* NSNotFound when there is none. */
+- (NSUInteger)firstIndex;
+
+- (NSUInteger)indexGreaterThanIndex:(NSUInteger)index;
+
+@end
+
+#endif /* FSN_SELECTION_SET_H */
@@ -0,0 +1,241 @@
+/* FSNSelectionSet.m
+ *
+ * The selection of a view, one bit per rep.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#import "FSNSelectionSet.h"
+
+#define WORD_BITS (sizeof(unsigned long long) * 8)
+#define WORDS_FOR(n) (((n) + WORD_BITS - 1) / WORD_BITS)
+
+
+@interface FSNSelectionSet (Private)
+- (void)writeAll;
+@end
+
+
+@implementation FSNSelectionSet
+
+- (void)dealloc
+{
+  free(_words);
+  [super dealloc];
+}
+
+- (instancetype)init
+{
+  return [self initWithCount: 0];
+}
+
+- (instancetype)initWithCount:(NSUInteger)count
+{
+  self = [super init];
+
+  if (self)
+    {
+      _wordCount = WORDS_FOR(count) + 1;
+      _words = calloc(_wordCount, sizeof(unsigned long long));
+      if (_words == NULL)
+        {
+          RELEASE (self);
+          return nil;
+        }
+      _count = count;
+      _selectedCount = 0;
+      _all = NO;
+    }
+
+  return self;
+}
+
+- (void)setCount:(NSUInteger)count
+{
+  NSUInteger i;
+
+  if (count == _count)
+    return;
+
+  if (_all)
+    [self writeAll];
+
+  if (WORDS_FOR(count) + 1 > _wordCount)
+    {
+      NSUInteger wcount = MAX(WORDS_FOR(count) + 1, _wordCount * 2);
+      unsigned long long *words = realloc(_words, wcount * sizeof(unsigned long long));
+
+      if (words == NULL)
+        [NSException raise: NSMallocException
+                    format: @"FSNSelectionSet: no memory for %lu reps",
+                            (unsigned long)count];
+
+      memset(words + _wordCount, 0, (wcount - _wordCount) * sizeof(unsigned long long));
+      _words = words;
+      _wordCount = wcount;
+    }
+
+  if (count < _count)
+    {
+      /* the positions dropped, and the bits past them in their word */
+      for (i = count; (i < _count) && (i % WORD_BITS); i++)
+        {
+          unsigned long long bit = 1ULL << (i % WORD_BITS);
+
+          if (_words[i / WORD_BITS] & bit)
+            {
+              _words[i / WORD_BITS] &= ~bit;
+              _selectedCount--;
+            }
+        }
+
+      for (; i < _count; i += WORD_BITS)
+        {
+          _selectedCount -= __builtin_popcountll(_words[i / WORD_BITS]);
+          _words[i / WORD_BITS] = 0;
+        }
+    }
+
+  _count = count;
+}
+
+- (NSUInteger)count
+{
+  return _count;
+}
+
+- (NSUInteger)selectedCount
+{
+  return _selectedCount;
+}
+
+- (BOOL)containsIndex:(NSUInteger)index
+{
+  if (index >= _count)
+    return NO;
+
+  if (_all)
+    return YES;
+
+  return (_words[index / WORD_BITS] >> (index % WORD_BITS)) & 1;
+}
+
+- (BOOL)addIndex:(NSUInteger)index
+{
+  unsigned long long bit;
+
+  if ((index >= _count) || _all)
+    return NO;
+
+  bit = 1ULL << (index % WORD_BITS);
+
+  if (_words[index / WORD_BITS] & bit)
+    return NO;
+
+  _words[index / WORD_BITS] |= bit;
+  _selectedCount++;
+
+  return YES;
+}
+
+- (BOOL)removeIndex:(NSUInteger)index
+{
+  unsigned long long bit;
+
+  if (index >= _count)
+    return NO;
+
+  if (_all)
+    [self writeAll];
+
+  bit = 1ULL << (index % WORD_BITS);
+
+  if ((_words[index / WORD_BITS] & bit) == 0)
+    return NO;
+
+  _words[index / WORD_BITS] &= ~bit;
+  _selectedCount--;
+
+  return YES;
+}
+
+- (void)addAll
+{
+  _all = YES;
+  _selectedCount = _count;
+}
+
+- (void)removeAll
+{
+  memset(_words, 0, _wordCount * sizeof(unsigned long long));
+  _all = NO;
+  _selectedCount = 0;
+}
+
+- (NSUInteger)firstIndex
+{
+  if (_count == 0)
+    return NSNotFound;
+
+  return [self containsIndex: 0] ? 0 : [self indexGreaterThanIndex: 0];
+}
+
+- (NSUInteger)indexGreaterThanIndex:(NSUInteger)index
+{
+  NSUInteger nwords = WORDS_FOR(_count);
+  NSUInteger w;
+  unsigned long long mask;
+
+  index++;
+
+  if ((index >= _count) || (index == 0))
+    return NSNotFound;
+
+  if (_all)
+    return index;
+
+  w = index / WORD_BITS;
+  mask = ~0ULL << (index % WORD_BITS);
+
+  for (; w < nwords; w++, mask = ~0ULL)
+    {
+      unsigned long long bits = _words[w] & mask;
+
+      if (bits)
+        {
+          NSUInteger found = w * WORD_BITS + __builtin_ctzll(bits);
+
+          return (found < _count) ? found : NSNotFound;
+        }
+    }
+
+  return NSNotFound;
+}
+
+@end
+
+
+@implementation FSNSelectionSet (Private)
+
+/* Sets the bit of every rep, for a change that takes one away. */
+- (void)writeAll
+{
+  NSUInteger nwords = WORDS_FOR(_count);
+
+  memset(_words, 0, _wordCount * sizeof(unsigned long long));
+
+  if (nwords)
+    {
+      memset(_words, 0xff, nwords * sizeof(unsigned long long));
+
+      if (_count % WORD_BITS)
+        _words[nwords - 1] = (1ULL << (_count % WORD_BITS)) - 1;
+    }
+
+  _all = NO;
+}
+
+@end
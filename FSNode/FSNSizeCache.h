@@ -0,0 +1,64 @@
+/* FSNSizeCache.h
+ *
+ * Folder sizes, walked on several threads and remembered per directory.
+ *
+ * A walk gives the Inspector the size of what is selected: the apparent
+ * size, what the files say they hold, and the allocated size, the blocks
+ * they take on disk (less for sparse files, more for many small ones).
+ * Directories are read by a few worker threads at once, with fstatat()
+ * on each entry, and the totals so far are handed to the caller as they
+ * grow.  The walk stays on the file system of each path it starts from.
+ *
+ * What each directory holds directly is remembered, by the directory's
+ * device, inode and modification time: walking the same tree again reads
+ * only the directories that changed, and stats the others.  A file
+ * rewritten in place does not change its directory; fswatcher events
+ * drop the directories they name.  Safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_SIZE_CACHE_H
+#define FSN_SIZE_CACHE_H
+
+#import <Foundation/Foundation.h>
+
+typedef struct
+{
+  unsigned long long apparent;    /* bytes, st_size */
+  unsigned long long allocated;   /* bytes, st_blocks */
+  unsigned long long items;       /* files, links and directories */
+} FSNSizeTotals;
+
+@interface FSNSizeCache : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *records;   /* directory -> FSNSizeRecord */
+}
+
++ (FSNSizeCache *)sharedCache;
+
+/* The totals of `paths` and everything beneath them.  `progress` is
+ * called on the calling thread with the totals so far, about every
+ * `interval` seconds; when it answers NO the walk stops and this returns
+ * NO, with partial totals. */
+- (BOOL)computeTotals:(FSNSizeTotals *)totals
+              ofPaths:(NSArray *)paths
+             interval:(NSTimeInterval)interval
+             progress:(BOOL (^)(FSNSizeTotals partial))progress;
+
+/* Forgets what `dir` holds directly, for a file in it that changed. */
+- (void)invalidateDirectory:(NSString *)dir;
+
+/* Forgets `path` and everything beneath it. */
+- (void)invalidatePath:(NSString *)path;
+
+- (void)invalidateAll;
+
+- (NSUInteger)recordCount;
+
+- (BOOL)hasRecordForDirectory:(NSString *)dir;
+
+@end
+
+#endif /* FSN_SIZE_CACHE_H */
@@ -0,0 +1,463 @@
+/* FSNSizeCache.m
+ *
+ * Folder sizes, walked on several threads and remembered per directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+#import "FSNSizeCache.h"
+
+#if defined(__linux__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtim.tv_sec + (st)->st_mtim.tv_nsec / 1e9)
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtimespec.tv_sec + (st)->st_mtimespec.tv_nsec / 1e9)
+#else
+  #define FSN_ST_MTIME(st) ((NSTimeInterval)(st)->st_mtime)
+#endif
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+/* the walk is bound by the disk and the stats, more threads than cores
+   keep a network volume or a slow disk busy */
+#define SIZE_WORKERS 8
+/* past it the records go, all of them */
+#define SIZE_CACHE_MAX_RECORDS 262144
+
+static FSNSizeCache *sharedCache = nil;
+
+
+/* What a directory holds directly: its entries, and the names of the
+   ones to walk into. */
+@interface FSNSizeRecord : NSObject
+{
+@public
+  unsigned long long device;
+  unsigned long long inode;
+  NSTimeInterval mtime;
+  FSNSizeTotals own;
+  NSArray *subdirs;
+}
+@end
+
+@implementation FSNSizeRecord
+
+- (void)dealloc
+{
+  RELEASE (subdirs);
+  [super dealloc];
+}
+
+@end
+
+
+@interface FSNSizeWalk : NSObject
+{
+@public
+  FSNSizeCache *cache;
+  NSCondition *lock;
+  NSMutableArray *queue;          /* directories left to read */
+  FSNSizeTotals totals;
+  NSUInteger active;
+  NSUInteger running;
+  BOOL stopped;
+}
+- (void)workerLoop:(id)sender;
+@end
+
+
+static void
+addTotals(FSNSizeTotals *to, const FSNSizeTotals *from)
+{
+  to->apparent += from->apparent;
+  to->allocated += from->allocated;
+  to->items += from->items;
+}
+
+static void
+addStat(FSNSizeTotals *to, const struct stat *st)
+{
+  to->apparent += (unsigned long long)st->st_size;
+  to->allocated += (unsigned long long)st->st_blocks * 512;
+  to->items++;
+}
+
+
+@interface FSNSizeCache (Private)
+- (FSNSizeRecord *)recordForDirectory:(NSString *)dir
+                                 stat:(const struct stat *)st;
+- (void)setRecord:(FSNSizeRecord *)rec
+     forDirectory:(NSString *)dir;
+@end
+
+
+@implementation FSNSizeWalk
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (queue);
+  [super dealloc];
+}
+
+- (id)initWithCache:(FSNSizeCache *)acache
+{
+  self = [super init];
+
+  if (self)
+    {
+      cache = acache;
+      lock = [NSCondition new];
+      queue = [NSMutableArray new];
+      memset(&totals, 0, sizeof(totals));
+    }
+
+  return self;
+}
+
+/* Adds what `dir` holds directly and queues its subdirectories. */
+- (void)readDirectory:(NSString *)dir
+{
+  const char *cdir = [dir fileSystemRepresentation];
+  FSNSizeRecord *rec;
+  struct stat st;
+
+  if (lstat(cdir, &st) != 0)
+    return;
+
+  rec = [cache recordForDirectory: dir stat: &st];
+
+  if (rec == nil)
+    {
+      NSFileManager *fm = [NSFileManager defaultManager];
+      NSMutableArray *subdirs = [NSMutableArray array];
+      FSNSizeTotals own;
+      NSUInteger n = 0;
+      struct dirent *de;
+      DIR *dirp;
+      int dfd;
+
+      memset(&own, 0, sizeof(own));
+      dfd = open(cdir, O_RDONLY | O_DIRECTORY);
+
+      if ((dfd < 0) || ((dirp = fdopendir(dfd)) == NULL))
+        {
+          if (dfd >= 0)
+            close(dfd);
+          return;
+        }
+
+      while ((de = readdir(dirp)) != NULL)
+        {
+          const char *dname = de->d_name;
+          struct stat est;
+
+          if ((dname[0] == '.')
+              && ((dname[1] == '\0') || ((dname[1] == '.') && (dname[2] == '\0'))))
+            continue;
+
+          if (((++n & 255) == 0) && stopped)
+            break;
+
+          if (fstatat(dfd, dname, &est, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+
+          addStat(&own, &est);
+
+          /* a mounted volume is counted, not entered */
+          if (S_ISDIR(est.st_mode) && (est.st_dev == st.st_dev))
+            {
+              NSString *name = [fm stringWithFileSystemRepresentation: dname
+                                                               length: strlen(dname)];
+              if (name)
+                [subdirs addObject: name];
+            }
+        }
+
+      closedir(dirp);
+
+      if (stopped)
+        return;
+
+      rec = AUTORELEASE ([FSNSizeRecord new]);
+      rec->device = (unsigned long long)st.st_dev;
+      rec->inode = (unsigned long long)st.st_ino;
+      rec->mtime = FSN_ST_MTIME(&st);
+      rec->own = own;
+      rec->subdirs = [subdirs copy];
+
+      [cache setRecord: rec forDirectory: dir];
+    }
+
+  [lock lock];
+  addTotals(&totals, &rec->own);
+
+  {
+    NSUInteger i;
+
+    for (i = 0; i < [rec->subdirs count]; i++)
+      [queue addObject: [dir stringByAppendingPathComponent:
+                               [rec->subdirs objectAtIndex: i]]];
+  }
+
+  [lock broadcast];
+  [lock unlock];
+}
+
+- (void)workerLoop:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(pool);
+
+  [lock lock];
+
+  while (1)
+    {
+      NSString *dir;
+
+      while (([queue count] == 0) && (active > 0) && (stopped == NO))
+        [lock wait];
+
+      if (stopped || ([queue count] == 0))
+        break;
+
+      /* depth first, as FileDeleteEngine: the queue stays short */
+      dir = RETAIN ([queue lastObject]);
+      [queue removeLastObject];
+      active++;
+      [lock unlock];
+
+      {
+        CREATE_AUTORELEASE_POOL(arp);
+        [self readDirectory: dir];
+        RELEASE (arp);
+      }
+      RELEASE (dir);
+
+      [lock lock];
+      active--;
+      [lock broadcast];
+    }
+
+  running--;
+  [lock broadcast];
+  [lock unlock];
+
+  RELEASE (pool);
+}
+
+@end
+
+
+@implementation FSNSizeCache
+
++ (FSNSizeCache *)sharedCache
+{
+  if (sharedCache == nil)
+    {
+      sharedCache = [FSNSizeCache new];
+    }
+  return sharedCache;
+}
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (records);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      records = [NSMutableDictionary new];
+    }
+
+  return self;
+}
+
+- (BOOL)computeTotals:(FSNSizeTotals *)totals
+              ofPaths:(NSArray *)paths
+             interval:(NSTimeInterval)interval
+             progress:(BOOL (^)(FSNSizeTotals partial))progress
+{
+  FSNSizeWalk *walk = [[FSNSizeWalk alloc] initWithCache: self];
+  NSTimeInterval last = [NSDate timeIntervalSinceReferenceDate];
+  BOOL done = NO;
+  BOOL completed;
+  NSUInteger i;
+
+  /* the paths themselves, then what is beneath the directories */
+  for (i = 0; i < [paths count]; i++)
+    {
+      NSString *path = [paths objectAtIndex: i];
+      struct stat st;
+
+      if (lstat([path fileSystemRepresentation], &st) != 0)
+        continue;
+
+      addStat(&walk->totals, &st);
+
+      if (S_ISDIR(st.st_mode))
+        [walk->queue addObject: path];
+    }
+
+  if ([walk->queue count])
+    {
+      walk->running = SIZE_WORKERS;
+
+      for (i = 0; i < SIZE_WORKERS; i++)
+        {
+          [NSThread detachNewThreadSelector: @selector(workerLoop:)
+                                   toTarget: walk
+                                 withObject: nil];
+        }
+    }
+
+  /* the progress block is only ever called from this thread */
+  while (done == NO)
+    {
+      FSNSizeTotals partial;
+
+      [walk->lock lock];
+      if (walk->running > 0)
+        [walk->lock waitUntilDate: [NSDate dateWithTimeIntervalSinceNow: interval]];
+      partial = walk->totals;
+      done = (walk->running == 0);
+      [walk->lock unlock];
+
+      /* the workers wake this thread for every directory */
+      if (done || (progress == nil)
+          || (([NSDate timeIntervalSinceReferenceDate] - last) < interval))
+        continue;
+
+      last = [NSDate timeIntervalSinceReferenceDate];
+
+      if (progress(partial) == NO)
+        {
+          [walk->lock lock];
+          walk->stopped = YES;
+          [walk->lock broadcast];
+          [walk->lock unlock];
+        }
+    }
+
+  if (totals)
+    *totals = walk->totals;
+
+  completed = (walk->stopped == NO);
+  RELEASE (walk);
+
+  return completed;
+}
+
+- (void)invalidateDirectory:(NSString *)dir
+{
+  [lock lock];
+  [records removeObjectForKey: dir];
+  [lock unlock];
+}
+
+- (void)invalidatePath:(NSString *)path
+{
+  NSString *prefix = [path hasSuffix: @"/"] ? path : [path stringByAppendingString: @"/"];
+  NSArray *keys;
+  NSUInteger i;
+
+  [lock lock];
+
+  [records removeObjectForKey: path];
+  keys = [records allKeys];
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+
+      if ([key hasPrefix: prefix])
+        [records removeObjectForKey: key];
+    }
+
+  [lock unlock];
+}
+
+- (void)invalidateAll
+{
+  [lock lock];
+  [records removeAllObjects];
+  [lock unlock];
+}
+
+- (NSUInteger)recordCount
+{
+  NSUInteger count;
+
+  [lock lock];
+  count = [records count];
+  [lock unlock];
+
+  return count;
+}
+
+- (BOOL)hasRecordForDirectory:(NSString *)dir
+{
+  BOOL found;
+
+  [lock lock];
+  found = ([records objectForKey: dir] != nil);
+  [lock unlock];
+
+  return found;
+}
+
+@end
+
+
+@implementation FSNSizeCache (Private)
+
+/* The record of `dir`, if it was taken of the directory `st` tells. */
+- (FSNSizeRecord *)recordForDirectory:(NSString *)dir
+                                 stat:(const struct stat *)st
+{
+  FSNSizeRecord *rec;
+
+  [lock lock];
+  rec = [records objectForKey: dir];
+
+  if (rec && ((rec->device != (unsigned long long)st->st_dev)
+              || (rec->inode != (unsigned long long)st->st_ino)
+              || (rec->mtime != FSN_ST_MTIME(st))))
+    {
+      [records removeObjectForKey: dir];
+      rec = nil;
+    }
+
+  RETAIN (rec);
+  [lock unlock];
+
+  return AUTORELEASE (rec);
+}
+
+- (void)setRecord:(FSNSizeRecord *)rec
+     forDirectory:(NSString *)dir
+{
+  [lock lock];
+
+  if ([records count] >= SIZE_CACHE_MAX_RECORDS)
+    [records removeAllObjects];
+
+  [records setObject: rec forKey: dir];
+  [lock unlock];
+}
+
+@end
@@ -0,0 +1,32 @@
+/* FSNSortKeys.h
+ *
+ * Flat-key sorting of node reps.
+ *
+ * Sorting a folder with -sortUsingSelector: sends one Objective-C message
+ * and one locale-aware string comparison per comparison.  Instead the
+ * functions here read each rep's keys once into a C array of records
+ * (a byte-comparable name key cached by FSNode, plus numeric keys for
+ * size, date and kind) and merge sort the records with plain C compares.
+ * Very large folders are split across a few threads; only the record
+ * sort runs off the main thread, the keys are always read on it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_SORT_KEYS_H
+#define FSN_SORT_KEYS_H
+
+#import <Foundation/Foundation.h>
+
+/* Compares two keys returned by -[FSNode nameSortKey] or
+ * -[FSNode extensionSortKey]. */
+NSComparisonResult FSNCompareSortKeys(NSData *key1, NSData *key2);
+
+/* Sorts `reps` (FSNode objects, or objects answering -node such as FSNIcon,
+ * FSNListViewNodeRep and FSNBrowserCell) in the order of the FSNode
+ * comparison named by `sel` (compareAccordingToName:, ...Kind:, ...Date:,
+ * ...Size:, ...Owner:, ...Group:).  Returns NO and leaves `reps` untouched
+ * for any other selector, so callers can fall back to -sortUsingSelector:. */
+BOOL FSNSortRepsUsingSelector(NSMutableArray *reps, SEL sel);
+
+#endif /* FSN_SORT_KEYS_H */
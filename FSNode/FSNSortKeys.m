@@ -0,0 +1,389 @@
+/* FSNSortKeys.m
+ *
+ * Flat-key sorting of node reps.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+
+#import "FSNSortKeys.h"
+#import "FSNode.h"
+#import "FSNTypeResolver.h"
+
+/* Below this many entries a single-threaded sort is faster than
+ * starting threads. */
+#define PARALLEL_SORT_MIN (20000)
+#define PARALLEL_SORT_CHUNKS (4)
+
+typedef enum FSNSortKeyType {
+  FSNSortByName,
+  FSNSortByKind,
+  FSNSortByDate,
+  FSNSortBySize,
+  FSNSortByOwner,
+  FSNSortByGroup
+} FSNSortKeyType;
+
+typedef struct FSNSortRecord {
+  id rep;
+  const unsigned char *name;
+  NSUInteger namelen;
+  const unsigned char *key;    /* extension, owner or group */
+  NSUInteger keylen;
+  double number;               /* date or size */
+  NSUInteger rank;             /* kind */
+} FSNSortRecord;
+
+typedef int (*FSNRecordCompare)(const FSNSortRecord *, const FSNSortRecord *);
+
+static inline int
+compareBytes(const unsigned char *b1, NSUInteger l1,
+             const unsigned char *b2, NSUInteger l2)
+{
+  int r = memcmp(b1, b2, (l1 < l2) ? l1 : l2);
+
+  if (r != 0)
+    return r;
+  return (l1 < l2) ? -1 : ((l1 > l2) ? 1 : 0);
+}
+
+NSComparisonResult
+FSNCompareSortKeys(NSData *key1, NSData *key2)
+{
+  int r = compareBytes([key1 bytes], [key1 length],
+                       [key2 bytes], [key2 length]);
+
+  if (r < 0)
+    return NSOrderedAscending;
+  return (r > 0) ? NSOrderedDescending : NSOrderedSame;
+}
+
+static int
+compareByName(const FSNSortRecord *r1, const FSNSortRecord *r2)
+{
+  return compareBytes(r1->name, r1->namelen, r2->name, r2->namelen);
+}
+
+static int
+compareByKey(const FSNSortRecord *r1, const FSNSortRecord *r2)
+{
+  int r = compareBytes(r1->key, r1->keylen, r2->key, r2->keylen);
+
+  return (r != 0) ? r : compareByName(r1, r2);
+}
+
+/* Kind ranks (see FSNTypeResolver.h) already order directories, then
+ * executables, then the rest, by extension within. */
+static int
+compareByKind(const FSNSortRecord *r1, const FSNSortRecord *r2)
+{
+  if (r1->rank != r2->rank)
+    return (r1->rank < r2->rank) ? -1 : 1;
+  return compareByName(r1, r2);
+}
+
+/* Newest / largest first. */
+static int
+compareByNumber(const FSNSortRecord *r1, const FSNSortRecord *r2)
+{
+  if (r1->number != r2->number)
+    return (r1->number > r2->number) ? -1 : 1;
+  return compareByName(r1, r2);
+}
+
+static void
+mergeRuns(FSNSortRecord *dst, const FSNSortRecord *a, NSUInteger na,
+          const FSNSortRecord *b, NSUInteger nb, FSNRecordCompare cmp)
+{
+  NSUInteger i = 0, j = 0, k = 0;
+
+  while (i < na && j < nb)
+    {
+      /* <= keeps the merge stable */
+      if (cmp(&a[i], &b[j]) <= 0)
+        dst[k++] = a[i++];
+      else
+        dst[k++] = b[j++];
+    }
+  while (i < na)
+    dst[k++] = a[i++];
+  while (j < nb)
+    dst[k++] = b[j++];
+}
+
+/* Bottom-up stable merge sort of recs[0..n) using tmp[0..n). */
+static void
+mergeSortRecords(FSNSortRecord *recs, FSNSortRecord *tmp, NSUInteger n,
+                 FSNRecordCompare cmp)
+{
+  FSNSortRecord *src = recs;
+  FSNSortRecord *dst = tmp;
+  NSUInteger width;
+  NSUInteger i;
+
+  /* insertion sort runs of 16 */
+  for (i = 0; i < n; i += 16)
+    {
+      NSUInteger end = (i + 16 < n) ? i + 16 : n;
+      NSUInteger j;
+
+      for (j = i + 1; j < end; j++)
+        {
+          FSNSortRecord r = recs[j];
+          NSUInteger k = j;
+
+          while (k > i && cmp(&recs[k - 1], &r) > 0)
+            {
+              recs[k] = recs[k - 1];
+              k--;
+            }
+          recs[k] = r;
+        }
+    }
+
+  for (width = 16; width < n; width *= 2)
+    {
+      for (i = 0; i < n; i += 2 * width)
+        {
+          NSUInteger mid = (i + width < n) ? i + width : n;
+          NSUInteger end = (i + 2 * width < n) ? i + 2 * width : n;
+
+          mergeRuns(&dst[i], &src[i], mid - i, &src[mid], end - mid, cmp);
+        }
+      {
+        FSNSortRecord *t = src;
+        src = dst;
+        dst = t;
+      }
+    }
+
+  if (src != recs)
+    memcpy(recs, src, n * sizeof(FSNSortRecord));
+}
+
+typedef struct FSNSortChunk {
+  FSNSortRecord *recs;
+  FSNSortRecord *tmp;
+  NSUInteger count;
+  FSNRecordCompare cmp;
+} FSNSortChunk;
+
+static void *
+sortChunk(void *arg)
+{
+  FSNSortChunk *chunk = arg;
+
+  mergeSortRecords(chunk->recs, chunk->tmp, chunk->count, chunk->cmp);
+  return NULL;
+}
+
+static void
+parallelSortRecords(FSNSortRecord *recs, FSNSortRecord *tmp, NSUInteger n,
+                    FSNRecordCompare cmp)
+{
+  FSNSortChunk chunks[PARALLEL_SORT_CHUNKS];
+  pthread_t threads[PARALLEL_SORT_CHUNKS];
+  BOOL started[PARALLEL_SORT_CHUNKS];
+  NSUInteger per = (n + PARALLEL_SORT_CHUNKS - 1) / PARALLEL_SORT_CHUNKS;
+  NSUInteger i;
+
+  for (i = 0; i < PARALLEL_SORT_CHUNKS; i++)
+    {
+      NSUInteger start = i * per;
+      NSUInteger end = (start + per < n) ? start + per : n;
+
+      chunks[i].recs = &recs[start];
+      chunks[i].tmp = &tmp[start];
+      chunks[i].count = (end > start) ? end - start : 0;
+      chunks[i].cmp = cmp;
+
+      /* the first chunk is sorted on this thread; a chunk whose thread
+         cannot be started is too */
+      started[i] = (i > 0)
+        && (pthread_create(&threads[i], NULL, sortChunk, &chunks[i]) == 0);
+    }
+
+  for (i = 0; i < PARALLEL_SORT_CHUNKS; i++)
+    {
+      if (started[i] == NO)
+        sortChunk(&chunks[i]);
+    }
+  for (i = 0; i < PARALLEL_SORT_CHUNKS; i++)
+    {
+      if (started[i])
+        pthread_join(threads[i], NULL);
+    }
+
+  /* (0+1) (2+3) into tmp, then both into recs */
+  mergeRuns(tmp, chunks[0].recs, chunks[0].count,
+            chunks[1].recs, chunks[1].count, cmp);
+  mergeRuns(&tmp[chunks[0].count + chunks[1].count],
+            chunks[2].recs, chunks[2].count,
+            chunks[3].recs, chunks[3].count, cmp);
+  mergeRuns(recs, tmp, chunks[0].count + chunks[1].count,
+            &tmp[chunks[0].count + chunks[1].count],
+            chunks[2].count + chunks[3].count, cmp);
+}
+
+static BOOL
+sortKeyTypeForSelector(SEL sel, FSNSortKeyType *type)
+{
+  if (sel_isEqual(sel, @selector(compareAccordingToName:)))
+    *type = FSNSortByName;
+  else if (sel_isEqual(sel, @selector(compareAccordingToKind:)))
+    *type = FSNSortByKind;
+  else if (sel_isEqual(sel, @selector(compareAccordingToDate:)))
+    *type = FSNSortByDate;
+  else if (sel_isEqual(sel, @selector(compareAccordingToSize:)))
+    *type = FSNSortBySize;
+  else if (sel_isEqual(sel, @selector(compareAccordingToOwner:)))
+    *type = FSNSortByOwner;
+  else if (sel_isEqual(sel, @selector(compareAccordingToGroup:)))
+    *type = FSNSortByGroup;
+  else
+    return NO;
+
+  return YES;
+}
+
+static inline void
+setKeyFromData(const unsigned char **bytes, NSUInteger *len, NSData *data)
+{
+  *bytes = [data bytes];
+  *len = [data length];
+}
+
+BOOL
+FSNSortRepsUsingSelector(NSMutableArray *reps, SEL sel)
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  NSUInteger count = [reps count];
+  FSNSortKeyType type;
+  FSNRecordCompare cmp;
+  FSNSortRecord *recs;
+  FSNSortRecord *tmp;
+  id *objs;
+  Class nodeClass = [FSNode class];
+  NSUInteger i;
+
+  if (sortKeyTypeForSelector(sel, &type) == NO)
+    {
+      RELEASE (arp);
+      return NO;
+    }
+
+  if (count < 2)
+    {
+      RELEASE (arp);
+      return YES;
+    }
+
+  recs = malloc(count * sizeof(FSNSortRecord));
+  tmp = malloc(count * sizeof(FSNSortRecord));
+  objs = malloc(count * sizeof(id));
+
+  if (recs == NULL || tmp == NULL || objs == NULL)
+    {
+      free(recs);
+      free(tmp);
+      free(objs);
+      RELEASE (arp);
+      return NO;
+    }
+
+  switch (type)
+    {
+    case FSNSortByKind:
+      cmp = compareByKind;
+      break;
+    case FSNSortByDate:
+    case FSNSortBySize:
+      cmp = compareByNumber;
+      break;
+    case FSNSortByOwner:
+    case FSNSortByGroup:
+      cmp = compareByKey;
+      break;
+    case FSNSortByName:
+    default:
+      cmp = compareByName;
+      break;
+    }
+
+  /* Keys are read here, on the calling thread; the NSData and name
+   * strings stay alive in the nodes (or in `arp`) until the sort ends. */
+  [reps getObjects: objs];
+
+  for (i = 0; i < count; i++)
+    {
+      id rep = objs[i];
+      FSNode *node = [rep isKindOfClass: nodeClass] ? rep : [rep node];
+      FSNSortRecord *rec = &recs[i];
+
+      memset(rec, 0, sizeof(FSNSortRecord));
+      rec->rep = rep;
+      setKeyFromData(&rec->name, &rec->namelen, [node nameSortKey]);
+
+      switch (type)
+        {
+        case FSNSortByKind:
+          rec->rank = [node kindIdentifier];
+          break;
+        case FSNSortByDate:
+          rec->number = [[node modificationDate] timeIntervalSinceReferenceDate];
+          break;
+        case FSNSortBySize:
+          rec->number = (double)[node fileSize];
+          break;
+        case FSNSortByOwner:
+        case FSNSortByGroup:
+          {
+            NSString *s = (type == FSNSortByOwner) ? [node owner] : [node group];
+            const char *utf8 = [s UTF8String];
+
+            rec->key = (const unsigned char *)(utf8 ? utf8 : "");
+            rec->keylen = utf8 ? strlen(utf8) : 0;
+          }
+          break;
+        case FSNSortByName:
+        default:
+          break;
+        }
+    }
+
+  /* ranks are taken once every kind in the folder is registered */
+  if (type == FSNSortByKind)
+    {
+      FSNTypeResolver *resolver = [FSNTypeResolver sharedResolver];
+
+      for (i = 0; i < count; i++)
+        recs[i].rank = [resolver rankOfKind: recs[i].rank];
+    }
+
+  if (count >= PARALLEL_SORT_MIN)
+    parallelSortRecords(recs, tmp, count, cmp);
+  else
+    mergeSortRecords(recs, tmp, count, cmp);
+
+  for (i = 0; i < count; i++)
+    objs[i] = recs[i].rep;
+
+  /* objs holds the same objects, so they stay retained by the
+     temporary array while `reps` is refilled */
+  {
+    NSArray *sorted = [[NSArray alloc] initWithObjects: objs count: count];
+
+    [reps setArray: sorted];
+    RELEASE (sorted);
+  }
+
+  free(recs);
+  free(tmp);
+  free(objs);
+  RELEASE (arp);
+
+  return YES;
+}
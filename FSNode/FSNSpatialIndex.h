@@ -0,0 +1,50 @@
+/* FSNSpatialIndex.h
+ *
+ * Uniform grid index over view frames.
+ *
+ * The frames are bucketed into a grid of cells about one frame in size,
+ * laid out as a single flat array (a counting sort by cell), so a rect
+ * query only looks at the objects of the cells the rect covers.  The
+ * index is rebuilt as a whole, which is one linear pass; it is meant to
+ * be rebuilt lazily after a layout and queried many times in between.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_SPATIAL_INDEX_H
+#define FSN_SPATIAL_INDEX_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNSpatialIndex : NSObject
+{
+  NSArray *objects;
+  NSRect *frames;
+  NSUInteger count;
+
+  NSPoint origin;
+  NSSize cellSize;
+  NSUInteger cols;
+  NSUInteger rows;
+  NSUInteger *cellStarts;       /* cols * rows + 1 offsets into `entries` */
+  NSUInteger *entries;          /* object indexes, grouped by cell */
+
+  unsigned *stamps;             /* per object, to report each one once */
+  unsigned stamp;
+}
+
+/* Replaces the contents with `objs`, frames[i] being the frame of the
+ * i-th object.  The array is copied. */
+- (void)setObjects:(NSArray *)objs
+            frames:(const NSRect *)objframes;
+
+- (void)removeAllObjects;
+
+- (NSUInteger)count;
+
+/* Objects whose frame intersects `rect`, in no particular order. */
+- (NSArray *)objectsIntersectingRect:(NSRect)rect;
+
+@end
+
+#endif /* FSN_SPATIAL_INDEX_H */
@@ -0,0 +1,220 @@
+/* FSNSpatialIndex.m
+ *
+ * Uniform grid index over view frames.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#import "FSNSpatialIndex.h"
+
+/* At most this many grid cells per indexed object; sparse layouts (a few
+   icons far apart) get coarser cells rather than a huge empty grid. */
+#define CELLS_PER_OBJECT (4)
+#define MIN_CELLS (64)
+
+typedef struct {
+  NSUInteger c0, r0, c1, r1;
+} FSNCellRange;
+
+/* Cells covered by `rect`, clamped to the grid. */
+static FSNCellRange
+cellRange(NSRect rect, NSPoint origin, NSSize cellSize,
+          NSUInteger cols, NSUInteger rows)
+{
+  double x0 = floor((NSMinX(rect) - origin.x) / cellSize.width);
+  double y0 = floor((NSMinY(rect) - origin.y) / cellSize.height);
+  double x1 = floor((NSMaxX(rect) - origin.x) / cellSize.width);
+  double y1 = floor((NSMaxY(rect) - origin.y) / cellSize.height);
+  FSNCellRange range;
+
+  range.c0 = (x0 < 0) ? 0 : MIN((NSUInteger)x0, cols - 1);
+  range.r0 = (y0 < 0) ? 0 : MIN((NSUInteger)y0, rows - 1);
+  range.c1 = (x1 < 0) ? 0 : MIN((NSUInteger)x1, cols - 1);
+  range.r1 = (y1 < 0) ? 0 : MIN((NSUInteger)y1, rows - 1);
+
+  return range;
+}
+
+
+@implementation FSNSpatialIndex
+
+- (void)dealloc
+{
+  [self removeAllObjects];
+  [super dealloc];
+}
+
+- (void)removeAllObjects
+{
+  DESTROY (objects);
+  free(frames);
+  free(cellStarts);
+  free(entries);
+  free(stamps);
+  frames = NULL;
+  cellStarts = NULL;
+  entries = NULL;
+  stamps = NULL;
+  count = 0;
+  cols = rows = 0;
+}
+
+- (void)setObjects:(NSArray *)objs
+            frames:(const NSRect *)objframes
+{
+  NSUInteger n = [objs count];
+  NSRect bounds = NSZeroRect;
+  CGFloat cw = 0, ch = 0;
+  NSUInteger *fill;
+  NSUInteger total;
+  NSUInteger i;
+
+  [self removeAllObjects];
+
+  if (n == 0)
+    return;
+
+  frames = malloc(n * sizeof(NSRect));
+  stamps = calloc(n, sizeof(unsigned));
+  if (frames == NULL || stamps == NULL)
+    {
+      [self removeAllObjects];
+      return;
+    }
+
+  memcpy(frames, objframes, n * sizeof(NSRect));
+  objects = [objs copy];
+  count = n;
+  stamp = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      NSRect r = frames[i];
+
+      bounds = (i == 0) ? r : NSUnionRect(bounds, r);
+      if (r.size.width > cw)
+        cw = r.size.width;
+      if (r.size.height > ch)
+        ch = r.size.height;
+    }
+
+  /* cells as large as the largest frame: every frame spans 4 cells at most */
+  cellSize = NSMakeSize(MAX(cw, 1), MAX(ch, 1));
+  origin = bounds.origin;
+  cols = (NSUInteger)ceil(bounds.size.width / cellSize.width) + 1;
+  rows = (NSUInteger)ceil(bounds.size.height / cellSize.height) + 1;
+
+  if (cols * rows > MAX(n * CELLS_PER_OBJECT, MIN_CELLS))
+    {
+      double scale = sqrt((double)(cols * rows) / MAX(n * CELLS_PER_OBJECT, MIN_CELLS));
+
+      cellSize.width *= scale;
+      cellSize.height *= scale;
+      cols = (NSUInteger)ceil(bounds.size.width / cellSize.width) + 1;
+      rows = (NSUInteger)ceil(bounds.size.height / cellSize.height) + 1;
+    }
+
+  cellStarts = calloc(cols * rows + 1, sizeof(NSUInteger));
+  fill = calloc(cols * rows, sizeof(NSUInteger));
+  if (cellStarts == NULL || fill == NULL)
+    {
+      free(fill);
+      [self removeAllObjects];
+      return;
+    }
+
+  /* count per cell, then prefix sums, then fill */
+  for (i = 0; i < n; i++)
+    {
+      FSNCellRange cr = cellRange(frames[i], origin, cellSize, cols, rows);
+      NSUInteger c, r;
+
+      for (r = cr.r0; r <= cr.r1; r++)
+        for (c = cr.c0; c <= cr.c1; c++)
+          cellStarts[r * cols + c + 1]++;
+    }
+
+  for (i = 0; i < cols * rows; i++)
+    cellStarts[i + 1] += cellStarts[i];
+
+  total = cellStarts[cols * rows];
+  entries = malloc((total ? total : 1) * sizeof(NSUInteger));
+  if (entries == NULL)
+    {
+      free(fill);
+      [self removeAllObjects];
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      FSNCellRange cr = cellRange(frames[i], origin, cellSize, cols, rows);
+      NSUInteger c, r;
+
+      for (r = cr.r0; r <= cr.r1; r++)
+        for (c = cr.c0; c <= cr.c1; c++)
+          {
+            NSUInteger cell = r * cols + c;
+            entries[cellStarts[cell] + fill[cell]++] = i;
+          }
+    }
+
+  free(fill);
+}
+
+- (NSUInteger)count
+{
+  return count;
+}
+
+- (NSArray *)objectsIntersectingRect:(NSRect)rect
+{
+  NSMutableArray *found = [NSMutableArray array];
+  FSNCellRange cr;
+  NSUInteger c, r;
+
+  if (count == 0 || cols == 0 || NSIsEmptyRect(rect))
+    return found;
+
+  if (NSIntersectsRect(rect, NSMakeRect(origin.x, origin.y,
+                                        cols * cellSize.width,
+                                        rows * cellSize.height)) == NO)
+    return found;
+
+  if (++stamp == 0)
+    {
+      memset(stamps, 0, count * sizeof(unsigned));
+      stamp = 1;
+    }
+
+  cr = cellRange(rect, origin, cellSize, cols, rows);
+
+  for (r = cr.r0; r <= cr.r1; r++)
+    {
+      for (c = cr.c0; c <= cr.c1; c++)
+        {
+          NSUInteger cell = r * cols + c;
+          NSUInteger e;
+
+          for (e = cellStarts[cell]; e < cellStarts[cell + 1]; e++)
+            {
+              NSUInteger i = entries[e];
+
+              if (stamps[i] == stamp)
+                continue;
+              stamps[i] = stamp;
+
+              if (NSIntersectsRect(rect, frames[i]))
+                [found addObject: [objects objectAtIndex: i]];
+            }
+        }
+    }
+
+  return found;
+}
+
+@end
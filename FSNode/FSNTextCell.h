@@ -31,6 +31,7 @@
 
 @class NSImage;
 @class NSColor;
+@class FSNFontWidths;
 
 @interface FSNTextCell : NSTextFieldCell
 {
@@ -43,6 +44,12 @@
   NSImage *displayIcon;   /* icon with tagColor badge composited on */
   NSColor *tagColor;
   NSString *nodePath;
+
+  /* the last title fitted by -drawInteriorWithFrame:inView: */
+  FSNFontWidths *widths;
+  NSString *fitSource;
+  NSString *fitTitle;
+  float fitWidth;
 }
 
 - (void)setIcon:(NSImage *)icn;
@@ -27,6 +27,7 @@
 #import <AppKit/AppKit.h>
 #import "FSNTextCell.h"
 #import "FSNFunctions.h"
+#import "FSNFontWidths.h"
 #import "FSNMetadataProvider.h"
 #import "FSNodeRep.h"
 
@@ -42,6 +43,9 @@
   RELEASE (displayIcon);
   RELEASE (tagColor);
   RELEASE (nodePath);
+  RELEASE (widths);
+  RELEASE (fitSource);
+  RELEASE (fitTitle);
   [super dealloc];
 }
 
@@ -89,6 +93,10 @@
       ASSIGN (fontAttr, [NSDictionary dictionaryWithObject: [self font]
 					      forKey: NSFontAttributeName]);
       ASSIGN (dots, @"...");
+      ASSIGN (widths, [FSNFontWidths widthsForFont: [self font]]);
+      fitSource = nil;
+      fitTitle = nil;
+      fitWidth = 0;
       titlesize = NSMakeSize(0, 0);
       icon = nil;
       displayIcon = nil;
@@ -117,6 +125,10 @@
   c->displayIcon = [displayIcon retain];
   c->tagColor = [tagColor retain];
   c->nodePath = [nodePath retain];
+  c->widths = [widths retain];
+  c->fitSource = [fitSource retain];
+  c->fitTitle = [fitTitle retain];
+  c->fitWidth = fitWidth;
 
   return c;
 }
@@ -130,8 +142,9 @@
 - (void)setFont:(NSFont *)fontObj
 {
   [super setFont: fontObj];
-  ASSIGN (fontAttr, [NSDictionary dictionaryWithObject: [self font]
-                                                forKey: NSFontAttributeName]);
+  ASSIGN (widths, [FSNFontWidths widthsForFont: [self font]]);
+  ASSIGN (fontAttr, [widths attributes]);
+  DESTROY (fitSource);
   titlesize = [[self stringValue] sizeWithAttributes: fontAttr];
 }
 
@@ -180,46 +193,7 @@
 - (NSString *)cutTitle:(NSString *)title
             toFitWidth:(float)width
 {
-  int tl = [title length];
-
-  if (tl <= 5)
-    {
-      return dots;
-    }
-  else
-    {
-      int fpto = (tl / 2) - 2;
-      int spfr = fpto + 3;
-      NSString *fp = [title substringToIndex: fpto];
-      NSString *sp = [title substringFromIndex: spfr];
-      NSString *dotted = [NSString stringWithFormat: @"%@%@%@", fp, dots, sp];
-      int dl = [dotted length];
-      float dotl = [dotted sizeWithAttributes: fontAttr].width;
-      int p = 0;
-
-      while (dotl > width) {
-        if (dl <= 5) {
-          return dots;
-        }
-
-        if (p) {
-          fpto--;
-        } else {
-          spfr++;
-        }
-        p = !p;
-
-        fp = [title substringToIndex: fpto];
-        sp = [title substringFromIndex: spfr];
-        dotted = [NSString stringWithFormat: @"%@%@%@", fp, dots, sp];
-        dotl = [dotted sizeWithAttributes: fontAttr].width;
-        dl = [dotted length];
-      }
-
-      return dotted;
-    }
-
-  return title;
+  return [widths cutString: title toFitWidth: width];
 }
 
 - (NSString *)cutDateTitle:(NSString *)title
@@ -276,21 +250,34 @@
 
   ASSIGN (uncutTitle, [self stringValue]);
   cutTitle = nil;
-  if ([uncutTitle sizeWithAttributes: fontAttr].width > textlength)
+
+  /* the list's data cell draws row after row: the fits are remembered
+     here for a redraw of the same row and by the font's table for the
+     others */
+  if ((fitWidth != textlength)
+      || ([fitSource isEqualToString: uncutTitle] == NO))
     {
-      if (dateCell)
-        cutTitle = [self cutDateTitle:uncutTitle toFitWidth:textlength];
+      if (dateCell == NO)
+        ASSIGN (fitTitle, [widths titleForString: uncutTitle fittingWidth: textlength]);
+      else if ([widths widthOfString: uncutTitle] > textlength)
+        ASSIGN (fitTitle, [self cutDateTitle: uncutTitle toFitWidth: textlength]);
       else
-        cutTitle = [self cutTitle:uncutTitle toFitWidth:textlength];
-      [self setStringValue: cutTitle];
+        ASSIGN (fitTitle, uncutTitle);
+
+      ASSIGN (fitSource, uncutTitle);
+      fitWidth = textlength;
     }
-  else
+
+  if ([fitTitle isEqualToString: uncutTitle] == NO)
     {
-      [self setStringValue: uncutTitle];
+      cutTitle = fitTitle;
+      [super setStringValue: cutTitle];
     }
 
-  title_rect.size.height = titlesize.height;
-  title_rect.origin.y += ((cellFrame.size.height - titlesize.height) / 2.0);
+  /* the title is not measured here: a table view sets it as the object
+     value, so titlesize can belong to another row */
+  title_rect.size.height = [widths lineHeight];
+  title_rect.origin.y += ((cellFrame.size.height - title_rect.size.height) / 2.0);
 
   if (icon == nil) {
     [super drawInteriorWithFrame: title_rect inView: controlView];
@@ -328,7 +315,7 @@
 
   /* we reset the title to the orginal string */
   if (cutTitle)
-    [self setStringValue: uncutTitle];
+    [super setStringValue: uncutTitle];
 }
 
 - (BOOL)startTrackingAt:(NSPoint)startPoint inView:(NSView *)controlView
@@ -0,0 +1,50 @@
+/* FSNTextPreview.h
+ *
+ * The first bytes of text files, read once and remembered for the
+ * Contents Inspector.
+ *
+ * A preview is the start of a regular file, at most the length asked
+ * for, when every byte of it is ASCII; anything else, a directory, a
+ * binary file or one that cannot be read, has no preview.  Only that
+ * window is read, with pread(), however large the file is.
+ *
+ * Previews are remembered, those found and those refused, by the file's
+ * device, inode, modification time and size, in an LRU of a few hundred
+ * files: selecting a file again costs a stat.  A file rewritten with a
+ * new modification time or size is read again.  Safe to use from any
+ * thread; the Inspector reads previews off the main thread, a file on a
+ * slow mount blocks only that reader.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_TEXT_PREVIEW_H
+#define FSN_TEXT_PREVIEW_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNTextPreview : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *previews;   /* file key -> NSData, or NSNull */
+  NSMutableArray *previewsOrder;   /* LRU, most recent last */
+  NSUInteger maxEntries;
+}
+
++ (FSNTextPreview *)sharedPreviews;
+
+/* An LRU of at most `max` files, 0 for no limit. */
+- (id)initWithMaxEntries:(NSUInteger)max;
+
+/* The first `length` bytes of the file at `path`, following a link,
+ * when they are all ASCII; nil when the file has no preview. */
+- (NSData *)textOfFileAtPath:(NSString *)path
+                      length:(NSUInteger)length;
+
+- (void)removeAllPreviews;
+
+- (NSUInteger)count;
+
+@end
+
+#endif /* FSN_TEXT_PREVIEW_H */
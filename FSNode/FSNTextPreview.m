@@ -0,0 +1,196 @@
+/* FSNTextPreview.m
+ *
+ * The first bytes of text files, read once and remembered.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#import "FSNTextPreview.h"
+
+#if defined(__linux__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtim.tv_sec + (st)->st_mtim.tv_nsec / 1e9)
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
+  #define FSN_ST_MTIME(st) ((st)->st_mtimespec.tv_sec + (st)->st_mtimespec.tv_nsec / 1e9)
+#else
+  #define FSN_ST_MTIME(st) ((NSTimeInterval)(st)->st_mtime)
+#endif
+
+#define TEXT_PREVIEW_MAX_ENTRIES 256
+
+static FSNTextPreview *sharedPreviews = nil;
+
+
+/* The start of the file at `cpath`, nil when it is not all ASCII or
+   cannot be read. */
+static NSData *
+readPreview(const char *cpath, unsigned long long size, NSUInteger length)
+{
+  NSUInteger nbytes = (size < length) ? (NSUInteger)size : length;
+  NSMutableData *data = [NSMutableData dataWithLength: nbytes];
+  unsigned char *bytes = [data mutableBytes];
+  NSUInteger got = 0;
+  NSUInteger i;
+  int fd = open(cpath, O_RDONLY);
+
+  if (fd < 0)
+    return nil;
+
+  while (got < nbytes)
+    {
+      ssize_t n = pread(fd, bytes + got, nbytes - got, (off_t)got);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          close(fd);
+          return nil;
+        }
+      if (n == 0)
+        break;
+
+      got += (NSUInteger)n;
+    }
+
+  close(fd);
+
+  /* a file that shrank since its stat */
+  [data setLength: got];
+
+  for (i = 0; i < got; i++)
+    {
+      if (bytes[i] & 0x80)
+        return nil;
+    }
+
+  return data;
+}
+
+
+@implementation FSNTextPreview
+
++ (FSNTextPreview *)sharedPreviews
+{
+  if (sharedPreviews == nil)
+    {
+      sharedPreviews = [[FSNTextPreview alloc]
+                         initWithMaxEntries: TEXT_PREVIEW_MAX_ENTRIES];
+    }
+  return sharedPreviews;
+}
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (previews);
+  RELEASE (previewsOrder);
+  [super dealloc];
+}
+
+- (id)init
+{
+  return [self initWithMaxEntries: TEXT_PREVIEW_MAX_ENTRIES];
+}
+
+- (id)initWithMaxEntries:(NSUInteger)max
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      previews = [NSMutableDictionary new];
+      previewsOrder = [NSMutableArray new];
+      maxEntries = max;
+    }
+
+  return self;
+}
+
+- (NSData *)textOfFileAtPath:(NSString *)path
+                      length:(NSUInteger)length
+{
+  const char *cpath = [path fileSystemRepresentation];
+  NSString *key;
+  id preview;
+  struct stat st;
+
+  if ((stat(cpath, &st) != 0) || (S_ISREG(st.st_mode) == 0))
+    return nil;
+
+  key = [NSString stringWithFormat: @"%llu:%llu:%.9f:%llu:%lu",
+                  (unsigned long long)st.st_dev,
+                  (unsigned long long)st.st_ino,
+                  FSN_ST_MTIME(&st),
+                  (unsigned long long)st.st_size,
+                  (unsigned long)length];
+
+  [lock lock];
+  preview = RETAIN ([previews objectForKey: key]);
+
+  if (preview)
+    {
+      [previewsOrder removeObject: key];
+      [previewsOrder addObject: key];
+    }
+
+  [lock unlock];
+
+  if (preview == nil)
+    {
+      /* read outside the lock, another file may be asked for meanwhile */
+      preview = readPreview(cpath, (unsigned long long)st.st_size, length);
+
+      if (preview == nil)
+        preview = [NSNull null];
+
+      RETAIN (preview);
+
+      [lock lock];
+
+      if ([previews objectForKey: key] == nil)
+        {
+          if (maxEntries && ([previewsOrder count] >= maxEntries))
+            {
+              [previews removeObjectForKey: [previewsOrder objectAtIndex: 0]];
+              [previewsOrder removeObjectAtIndex: 0];
+            }
+
+          [previews setObject: preview forKey: key];
+          [previewsOrder addObject: key];
+        }
+
+      [lock unlock];
+    }
+
+  AUTORELEASE (preview);
+
+  return (preview == [NSNull null]) ? nil : preview;
+}
+
+- (void)removeAllPreviews
+{
+  [lock lock];
+  [previews removeAllObjects];
+  [previewsOrder removeAllObjects];
+  [lock unlock];
+}
+
+- (NSUInteger)count
+{
+  NSUInteger count;
+
+  [lock lock];
+  count = [previews count];
+  [lock unlock];
+
+  return count;
+}
+
+@end
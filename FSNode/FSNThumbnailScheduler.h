@@ -0,0 +1,38 @@
+/* FSNThumbnailScheduler.h
+ *
+ * Protocol through which FSNode views tell the thumbnail maker what they
+ * show, without depending on it.  The Workspace application registers its
+ * thumbnailer on FSNodeRep at startup; when none is set, the views send no
+ * hints and thumbnails are made in listing order.
+ *
+ * Other background work on the files the views show, like reading the
+ * icons of AppImages, can be queued with the thumbnails and so follows
+ * the same hints and the same limits.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_THUMBNAIL_SCHEDULER_H
+#define FSN_THUMBNAIL_SCHEDULER_H
+
+#import <Foundation/Foundation.h>
+
+@protocol FSNThumbnailScheduler <NSObject>
+
+/* The paths a view shows now and the ones one screen ahead in the
+ * direction it scrolls.  Their thumbnails are made before the rest of the
+ * queue.  Each hint replaces the previous one of the view; nil paths
+ * withdraw it, as a view going away must do. */
+- (void)prioritizeVisiblePaths:(NSArray *)visible
+                    aheadPaths:(NSArray *)ahead
+                       forView:(id)view;
+
+/* Runs `work` on one of the thumbnail workers, ranked like the
+ * thumbnail of `path` by the hints and counted against the jobs limit
+ * of its disk. */
+- (void)scheduleWork:(void (^)(void))work
+             forPath:(NSString *)path;
+
+@end
+
+#endif /* FSN_THUMBNAIL_SCHEDULER_H */
@@ -0,0 +1,114 @@
+/* FSNThumbnailStore.h
+ *
+ * Packed thumbnail store shared by the thumbnail maker and the views.
+ *
+ * The thumbnails live in two files of the thumbnails directory:
+ * thumbnails.data, to which every thumbnail is appended as a record
+ * carrying its key and path, and thumbnails.index, an open-addressing
+ * hash table of the live records.  Both are memory-mapped.  A record is
+ * keyed by the device, inode, modification time and size of the file,
+ * so the thumbnail of a file that changed is no longer found.
+ *
+ * One process writes (the Workspace thumbnailer), any number read.  A
+ * reader checks each record against the key it looked up, so it can
+ * follow the writer without locking: the data file only grows, and when
+ * the index grows or the store is compacted the new files are renamed
+ * over the old ones, bumping the generation they share.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_THUMBNAIL_STORE_H
+#define FSN_THUMBNAIL_STORE_H
+
+#import <Foundation/Foundation.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+typedef struct
+{
+  uint64_t device;
+  uint64_t inode;
+  int64_t mtime;
+  int64_t size;
+} FSNThumbnailKey;
+
+@interface FSNThumbnailStore : NSObject
+{
+  NSString *dataPath;
+  NSString *indexPath;
+  BOOL writable;
+  NSLock *lock;
+
+  int dataFd;
+  uint8_t *dataMap;
+  size_t dataMapLength;
+  uint64_t dataSize;
+
+  int indexFd;
+  uint8_t *indexMap;
+  size_t indexMapLength;
+  ino_t indexInode;
+  uint64_t generation;
+}
+
+/* The store in `dir`, created there when `flag` is YES and it does not
+ * exist.  A store opened for reading only starts empty when the files
+ * are missing and finds them at -refresh. */
+- (id)initWithDirectory:(NSString *)dir
+               writable:(BOOL)flag;
+
+/* Key of the file at `path` (following links); NO when it cannot be
+ * stat()ed. */
++ (BOOL)getKey:(FSNThumbnailKey *)key
+       forPath:(NSString *)path;
+
+/* The thumbnail bytes of the file, without a copy: the data points into
+ * the mapped file and is valid until the next call to the store, so
+ * decode it at once.  nil when there is none for the current version of
+ * the file. */
+- (NSData *)thumbnailDataForPath:(NSString *)path;
+
+- (NSData *)thumbnailDataForKey:(FSNThumbnailKey)key;
+
+- (BOOL)hasThumbnailForPath:(NSString *)path;
+
+/* Writer only.  Replaces the thumbnail of any earlier version of the
+ * file. */
+- (BOOL)setThumbnailData:(NSData *)data
+                 forPath:(NSString *)path;
+
+- (BOOL)removeThumbnailForPath:(NSString *)path;
+
+/* Writer only.  Flushes the appended records and the index. */
+- (void)synchronize;
+
+/* Writer only.  YES when the records replaced or removed take more room
+ * than the live ones. */
+- (BOOL)needsCompaction;
+
+/* Writer only.  Rewrites the live records of files that still exist
+ * unchanged into new files.  Takes the store lock for its whole run, so
+ * call it from a background thread. */
+- (void)compact;
+
+/* Writer only.  Checks the next `count` live records from the slot at
+ * `*cursor` as -compact does, and removes those of the files gone or
+ * changed; the records of files right in one of the `skipped` folders
+ * are passed over.  Moves `*cursor` on, back to 0 past the last slot,
+ * and returns the records removed. */
+- (NSUInteger)removeStaleFromCursor:(unsigned long long *)cursor
+                              count:(NSUInteger)count
+                    skippingFolders:(NSSet *)skipped;
+
+/* Reader.  Maps the files again when the writer replaced them. */
+- (void)refresh;
+
+- (NSUInteger)count;
+
+/* Bytes of the record and index files, live records or not. */
+- (unsigned long long)fileSize;
+
+@end
+
+#endif /* FSN_THUMBNAIL_STORE_H */
@@ -0,0 +1,1148 @@
+/* FSNThumbnailStore.m
+ *
+ * Packed thumbnail store shared by the thumbnail maker and the views.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+
+#import "FSNThumbnailStore.h"
+
+#define DATA_MAGIC   0x44424d54   /* "TMBD" */
+#define INDEX_MAGIC  0x49424d54   /* "TMBI" */
+#define RECORD_MAGIC 0x52424d54   /* "TMBR" */
+#define STORE_VERSION 1
+
+#define INITIAL_SLOTS 4096
+/* the index grows past 7/10 of its slots, removed ones included */
+#define MAX_LOAD(n) (((n) * 7) / 10)
+
+/* the data file is mapped in steps, so most appends need no new map */
+#define DATA_MAP_STEP (16 * 1024 * 1024)
+
+/* below this, a store is not worth compacting whatever it wastes */
+#define MIN_COMPACTION_WASTE (4 * 1024 * 1024)
+
+#define ALIGN8(n) (((n) + 7) & ~((uint64_t)7))
+
+enum
+{
+  SLOT_EMPTY = 0,
+  SLOT_LIVE = 1,
+  SLOT_REMOVED = 2
+};
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+} DataHeader;
+
+/* followed by the path (UTF-8, no NUL), the image bytes and the padding
+ * to 8 bytes.  A record without image bytes records a removal. */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t pathLength;
+  uint32_t dataLength;
+  uint32_t reserved;
+  FSNThumbnailKey key;
+} RecordHeader;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+  uint64_t slotsCount;   /* a power of two */
+  uint64_t usedCount;    /* live and removed slots */
+  uint64_t liveCount;
+  uint64_t liveBytes;    /* about: the headers and images of the live records */
+} IndexHeader;
+
+typedef struct
+{
+  FSNThumbnailKey key;
+  uint64_t offset;       /* of the record in the data file */
+  uint32_t length;       /* of its image bytes */
+  uint32_t state;
+} IndexSlot;
+
+#define SLOTS(map) ((IndexSlot *)((map) + sizeof(IndexHeader)))
+
+static inline uint64_t
+keyHash(const FSNThumbnailKey *key)
+{
+  /* splitmix64 finalizer; the versions of a file share their slot chain */
+  uint64_t h = key->device * 0x9e3779b97f4a7c15ULL ^ key->inode;
+
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+static inline BOOL
+sameFile(const FSNThumbnailKey *a, const FSNThumbnailKey *b)
+{
+  return (a->device == b->device) && (a->inode == b->inode);
+}
+
+static inline BOOL
+sameKey(const FSNThumbnailKey *a, const FSNThumbnailKey *b)
+{
+  return (memcmp(a, b, sizeof(FSNThumbnailKey)) == 0);
+}
+
+/* The live slot of the file, whatever its version, or NULL. */
+static IndexSlot *
+findFileSlot(uint8_t *map, const FSNThumbnailKey *key)
+{
+  IndexHeader *header = (IndexHeader *)map;
+  IndexSlot *slots = SLOTS(map);
+  uint64_t mask = header->slotsCount - 1;
+  uint64_t i = keyHash(key) & mask;
+  uint64_t n;
+
+  for (n = 0; n < header->slotsCount; n++, i = (i + 1) & mask)
+    {
+      IndexSlot *slot = &slots[i];
+
+      if (slot->state == SLOT_EMPTY)
+        return NULL;
+      if ((slot->state == SLOT_LIVE) && sameFile(&slot->key, key))
+        return slot;
+    }
+
+  return NULL;
+}
+
+/* The slot to write the file in: its live one, else the first free one
+ * on its chain.  The index must have room. */
+static IndexSlot *
+slotForInsert(uint8_t *map, const FSNThumbnailKey *key)
+{
+  IndexHeader *header = (IndexHeader *)map;
+  IndexSlot *slots = SLOTS(map);
+  uint64_t mask = header->slotsCount - 1;
+  uint64_t i = keyHash(key) & mask;
+  IndexSlot *removed = NULL;
+  uint64_t n;
+
+  for (n = 0; n < header->slotsCount; n++, i = (i + 1) & mask)
+    {
+      IndexSlot *slot = &slots[i];
+
+      if (slot->state == SLOT_EMPTY)
+        return removed ? removed : slot;
+      if ((slot->state == SLOT_REMOVED) && (removed == NULL))
+        removed = slot;
+      else if ((slot->state == SLOT_LIVE) && sameFile(&slot->key, key))
+        return slot;
+    }
+
+  return removed;
+}
+
+/* Fills the slot so that a reader never takes a half-written one for
+ * live: the state goes last. */
+static void
+fillSlot(uint8_t *map, IndexSlot *slot, const FSNThumbnailKey *key,
+         uint64_t offset, uint32_t length)
+{
+  IndexHeader *header = (IndexHeader *)map;
+
+  if (slot->state == SLOT_LIVE)
+    {
+      header->liveBytes -= MIN(header->liveBytes, sizeof(RecordHeader) + slot->length);
+    }
+  else
+    {
+      if (slot->state == SLOT_EMPTY)
+        header->usedCount++;
+      header->liveCount++;
+    }
+
+  slot->key = *key;
+  slot->offset = offset;
+  slot->length = length;
+  __sync_synchronize();
+  slot->state = SLOT_LIVE;
+  header->liveBytes += sizeof(RecordHeader) + length;
+}
+
+static void
+removeSlot(uint8_t *map, IndexSlot *slot)
+{
+  IndexHeader *header = (IndexHeader *)map;
+
+  slot->state = SLOT_REMOVED;
+  header->liveCount--;
+  header->liveBytes -= MIN(header->liveBytes, sizeof(RecordHeader) + slot->length);
+}
+
+static uint64_t
+slotsCountFor(uint64_t entries)
+{
+  uint64_t n = INITIAL_SLOTS;
+
+  while (MAX_LOAD(n) <= entries * 2)
+    n <<= 1;
+  return n;
+}
+
+/* A new, empty index file mapped for writing. */
+static uint8_t *
+createIndexFile(const char *path, uint64_t slotsCount, uint64_t gen,
+                int *fdp, size_t *lengthp)
+{
+  size_t length = sizeof(IndexHeader) + slotsCount * sizeof(IndexSlot);
+  IndexHeader *header;
+  uint8_t *map;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate(fd, (off_t)length) != 0)
+    {
+      close(fd);
+      return NULL;
+    }
+
+  map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      close(fd);
+      return NULL;
+    }
+
+  header = (IndexHeader *)map;
+  header->magic = INDEX_MAGIC;
+  header->version = STORE_VERSION;
+  header->generation = gen;
+  header->slotsCount = slotsCount;
+  header->usedCount = 0;
+  header->liveCount = 0;
+  header->liveBytes = 0;
+
+  *fdp = fd;
+  *lengthp = length;
+  return map;
+}
+
+static BOOL
+writeAll(int fd, const void *buf, size_t len, off_t offset)
+{
+  const uint8_t *p = buf;
+
+  while (len > 0)
+    {
+      ssize_t n = pwrite(fd, p, len, offset);
+
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return NO;
+        }
+      p += n;
+      len -= n;
+      offset += n;
+    }
+
+  return YES;
+}
+
+
+@interface FSNThumbnailStore (Private)
+
+- (BOOL)openFiles;
+- (void)closeFiles;
+- (BOOL)mapDataUpTo:(uint64_t)end;
+- (BOOL)createIndex:(uint64_t)slotsCount;
+- (void)rebuildIndex;
+- (BOOL)growIndex;
+- (const RecordHeader *)recordOfSlot:(const IndexSlot *)slot;
+- (uint64_t)appendRecord:(const FSNThumbnailKey *)key
+                    path:(NSString *)path
+                   bytes:(const void *)bytes
+                  length:(uint32_t)length
+                    toFd:(int)fd
+                      at:(uint64_t)offset;
+
+@end
+
+
+@implementation FSNThumbnailStore
+
+- (void)dealloc
+{
+  [self closeFiles];
+  RELEASE (dataPath);
+  RELEASE (indexPath);
+  RELEASE (lock);
+
+  [super dealloc];
+}
+
+- (id)initWithDirectory:(NSString *)dir
+               writable:(BOOL)flag
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (dataPath, [dir stringByAppendingPathComponent: @"thumbnails.data"]);
+      ASSIGN (indexPath, [dir stringByAppendingPathComponent: @"thumbnails.index"]);
+      writable = flag;
+      lock = [NSLock new];
+      dataFd = -1;
+      indexFd = -1;
+
+      if ([self openFiles] == NO && writable)
+        {
+          NSDebugLLog(@"gwspace", @"unable to open the thumbnail store in %@", dir);
+          DESTROY (self);
+        }
+    }
+
+  return self;
+}
+
++ (BOOL)getKey:(FSNThumbnailKey *)key
+       forPath:(NSString *)path
+{
+  struct stat st;
+
+  if ((path == nil) || (stat([path fileSystemRepresentation], &st) != 0))
+    return NO;
+
+  memset(key, 0, sizeof(FSNThumbnailKey));
+  key->device = (uint64_t)st.st_dev;
+  key->inode = (uint64_t)st.st_ino;
+  key->mtime = (int64_t)st.st_mtime;
+  key->size = (int64_t)st.st_size;
+  return YES;
+}
+
+- (NSData *)thumbnailDataForPath:(NSString *)path
+{
+  FSNThumbnailKey key;
+
+  if ([FSNThumbnailStore getKey: &key forPath: path] == NO)
+    return nil;
+
+  return [self thumbnailDataForKey: key];
+}
+
+- (NSData *)thumbnailDataForKey:(FSNThumbnailKey)key
+{
+  NSData *data = nil;
+  IndexSlot *slot;
+
+  [lock lock];
+
+  slot = indexMap ? findFileSlot(indexMap, &key) : NULL;
+
+  if (slot && sameKey(&slot->key, &key))
+    {
+      const RecordHeader *record = [self recordOfSlot: slot];
+
+      if (record && record->dataLength)
+        {
+          const uint8_t *bytes = (const uint8_t *)(record + 1) + record->pathLength;
+
+          data = [NSData dataWithBytesNoCopy: (void *)bytes
+                                      length: record->dataLength
+                                freeWhenDone: NO];
+        }
+    }
+
+  [lock unlock];
+
+  return data;
+}
+
+- (BOOL)hasThumbnailForPath:(NSString *)path
+{
+  FSNThumbnailKey key;
+  IndexSlot *slot;
+  BOOL found;
+
+  if ([FSNThumbnailStore getKey: &key forPath: path] == NO)
+    return NO;
+
+  [lock lock];
+  slot = indexMap ? findFileSlot(indexMap, &key) : NULL;
+  found = (slot && sameKey(&slot->key, &key));
+  [lock unlock];
+
+  return found;
+}
+
+- (BOOL)setThumbnailData:(NSData *)data
+                 forPath:(NSString *)path
+{
+  FSNThumbnailKey key;
+  uint64_t offset;
+  uint64_t end;
+
+  if ((writable == NO) || ([data length] == 0) || ([data length] > UINT32_MAX)
+      || ([FSNThumbnailStore getKey: &key forPath: path] == NO))
+    return NO;
+
+  [lock lock];
+
+  /* the record is on disk before the slot points to it */
+  offset = dataSize;
+  end = [self appendRecord: &key
+                      path: path
+                     bytes: [data bytes]
+                    length: (uint32_t)[data length]
+                      toFd: dataFd
+                        at: offset];
+
+  if (end == UINT64_MAX)
+    {
+      [lock unlock];
+      return NO;
+    }
+
+  dataSize = end;
+
+  if ((findFileSlot(indexMap, &key) == NULL)
+      && (((IndexHeader *)indexMap)->usedCount + 1
+          > MAX_LOAD(((IndexHeader *)indexMap)->slotsCount))
+      && ([self growIndex] == NO))
+    {
+      [lock unlock];
+      return NO;
+    }
+
+  fillSlot(indexMap, slotForInsert(indexMap, &key), &key,
+           offset, (uint32_t)[data length]);
+
+  [lock unlock];
+
+  return YES;
+}
+
+- (BOOL)removeThumbnailForPath:(NSString *)path
+{
+  FSNThumbnailKey key;
+  IndexSlot *slot;
+  BOOL removed = NO;
+
+  if ((writable == NO) || ([FSNThumbnailStore getKey: &key forPath: path] == NO))
+    return NO;
+
+  [lock lock];
+
+  slot = findFileSlot(indexMap, &key);
+
+  if (slot)
+    {
+      uint64_t end;
+
+      removeSlot(indexMap, slot);
+
+      /* so that an index rebuilt from the data forgets it too */
+      end = [self appendRecord: &key path: path bytes: NULL length: 0
+                          toFd: dataFd at: dataSize];
+      if (end != UINT64_MAX)
+        dataSize = end;
+
+      removed = YES;
+    }
+
+  [lock unlock];
+
+  return removed;
+}
+
+- (void)synchronize
+{
+  if (writable == NO)
+    return;
+
+  [lock lock];
+  if (indexMap)
+    msync(indexMap, indexMapLength, MS_ASYNC);
+  [lock unlock];
+}
+
+- (BOOL)needsCompaction
+{
+  BOOL needs = NO;
+
+  [lock lock];
+
+  if (writable && indexMap)
+    {
+      uint64_t live = ((IndexHeader *)indexMap)->liveBytes;
+      uint64_t waste = (dataSize > live) ? (dataSize - live) : 0;
+
+      needs = ((waste > MIN_COMPACTION_WASTE) && (waste > live));
+    }
+
+  [lock unlock];
+
+  return needs;
+}
+
+- (void)compact
+{
+  NSString *tmpData;
+  NSString *tmpIndex;
+  IndexHeader *header;
+  IndexSlot *slots;
+  uint8_t *newMap;
+  size_t newMapLength;
+  int newDataFd;
+  int newIndexFd;
+  uint64_t newSize;
+  uint64_t newGeneration;
+  DataHeader dheader;
+  uint64_t i;
+
+  if (writable == NO)
+    return;
+
+  [lock lock];
+
+  tmpData = [dataPath stringByAppendingPathExtension: @"tmp"];
+  tmpIndex = [indexPath stringByAppendingPathExtension: @"tmp"];
+  header = (IndexHeader *)indexMap;
+  slots = SLOTS(indexMap);
+  newGeneration = generation + 1;
+
+  newDataFd = open([tmpData fileSystemRepresentation], O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (newDataFd < 0)
+    {
+      [lock unlock];
+      return;
+    }
+
+  dheader.magic = DATA_MAGIC;
+  dheader.version = STORE_VERSION;
+  dheader.generation = newGeneration;
+
+  newMap = createIndexFile([tmpIndex fileSystemRepresentation],
+                           slotsCountFor(header->liveCount), newGeneration,
+                           &newIndexFd, &newMapLength);
+
+  if ((newMap == NULL)
+      || (writeAll(newDataFd, &dheader, sizeof(DataHeader), 0) == NO))
+    {
+      if (newMap)
+        {
+          munmap(newMap, newMapLength);
+          close(newIndexFd);
+        }
+      close(newDataFd);
+      unlink([tmpData fileSystemRepresentation]);
+      unlink([tmpIndex fileSystemRepresentation]);
+      [lock unlock];
+      return;
+    }
+
+  newSize = ALIGN8(sizeof(DataHeader));
+
+  for (i = 0; i < header->slotsCount; i++)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      IndexSlot *slot = &slots[i];
+      const RecordHeader *record;
+      NSString *path;
+      FSNThumbnailKey key;
+      uint64_t end;
+
+      if (slot->state != SLOT_LIVE)
+        {
+          RELEASE (arp);
+          continue;
+        }
+
+      record = [self recordOfSlot: slot];
+      path = nil;
+
+      if (record && record->dataLength)
+        {
+          path = AUTORELEASE ([[NSString alloc] initWithBytes: (const void *)(record + 1)
+                                                       length: record->pathLength
+                                                     encoding: NSUTF8StringEncoding]);
+        }
+
+      /* a file that went away or changed has no use for it */
+      if (path && [FSNThumbnailStore getKey: &key forPath: path]
+          && sameKey(&key, &slot->key))
+        {
+          end = [self appendRecord: &key
+                              path: path
+                             bytes: (const uint8_t *)(record + 1) + record->pathLength
+                            length: record->dataLength
+                              toFd: newDataFd
+                                at: newSize];
+
+          if (end != UINT64_MAX)
+            {
+              fillSlot(newMap, slotForInsert(newMap, &key), &key,
+                       newSize, record->dataLength);
+              newSize = end;
+            }
+        }
+
+      RELEASE (arp);
+    }
+
+  msync(newMap, newMapLength, MS_SYNC);
+  fsync(newDataFd);
+
+  /* the data goes first: a reader between the two renames sees different
+     generations and waits for the next refresh */
+  if ((rename([tmpData fileSystemRepresentation], [dataPath fileSystemRepresentation]) == 0)
+      && (rename([tmpIndex fileSystemRepresentation], [indexPath fileSystemRepresentation]) == 0))
+    {
+      struct stat st;
+
+      [self closeFiles];
+
+      dataFd = newDataFd;
+      dataSize = newSize;
+      indexFd = newIndexFd;
+      indexMap = newMap;
+      indexMapLength = newMapLength;
+      generation = newGeneration;
+      if (fstat(indexFd, &st) == 0)
+        indexInode = st.st_ino;
+    }
+  else
+    {
+      munmap(newMap, newMapLength);
+      close(newIndexFd);
+      close(newDataFd);
+      unlink([tmpData fileSystemRepresentation]);
+      unlink([tmpIndex fileSystemRepresentation]);
+    }
+
+  [lock unlock];
+}
+
+- (NSUInteger)removeStaleFromCursor:(unsigned long long *)cursor
+                              count:(NSUInteger)count
+                    skippingFolders:(NSSet *)skipped
+{
+  IndexHeader *header;
+  uint64_t i;
+  NSUInteger checked = 0;
+  NSUInteger removed = 0;
+
+  if (writable == NO)
+    return 0;
+
+  [lock lock];
+
+  if (indexMap == NULL)
+    {
+      [lock unlock];
+      return 0;
+    }
+
+  header = (IndexHeader *)indexMap;
+
+  /* the index may have grown or shrunk since the last call */
+  for (i = (*cursor < header->slotsCount) ? *cursor : header->slotsCount;
+       (i < header->slotsCount) && (checked < count); i++)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      IndexSlot *slot = &SLOTS(indexMap)[i];
+      const RecordHeader *record;
+      NSString *path;
+      FSNThumbnailKey key;
+      uint64_t end;
+
+      if (slot->state != SLOT_LIVE)
+        {
+          RELEASE (arp);
+          continue;
+        }
+
+      record = [self recordOfSlot: slot];
+      path = nil;
+
+      if (record && record->dataLength)
+        {
+          path = AUTORELEASE ([[NSString alloc] initWithBytes: (const void *)(record + 1)
+                                                       length: record->pathLength
+                                                     encoding: NSUTF8StringEncoding]);
+        }
+
+      if (path && [skipped containsObject: [path stringByDeletingLastPathComponent]])
+        {
+          RELEASE (arp);
+          continue;
+        }
+
+      checked++;
+
+      if (path && [FSNThumbnailStore getKey: &key forPath: path]
+          && sameKey(&key, &slot->key))
+        {
+          RELEASE (arp);
+          continue;
+        }
+
+      key = slot->key;
+      removeSlot(indexMap, slot);
+
+      /* the record may be unreadable: the removal is logged without a path */
+      end = [self appendRecord: &key path: (path ? path : @"") bytes: NULL length: 0
+                          toFd: dataFd at: dataSize];
+      if (end != UINT64_MAX)
+        dataSize = end;
+
+      removed++;
+      RELEASE (arp);
+    }
+
+  *cursor = (i < header->slotsCount) ? i : 0;
+
+  [lock unlock];
+
+  return removed;
+}
+
+- (void)refresh
+{
+  struct stat st;
+
+  if (writable)
+    return;
+
+  [lock lock];
+
+  if ((stat([indexPath fileSystemRepresentation], &st) != 0)
+      || (indexMap == NULL) || (st.st_ino != indexInode))
+    {
+      [self closeFiles];
+      [self openFiles];
+    }
+  else
+    {
+      [self mapDataUpTo: 0];
+    }
+
+  [lock unlock];
+}
+
+- (NSUInteger)count
+{
+  NSUInteger count;
+
+  [lock lock];
+  count = indexMap ? (NSUInteger)((IndexHeader *)indexMap)->liveCount : 0;
+  [lock unlock];
+
+  return count;
+}
+
+- (unsigned long long)fileSize
+{
+  unsigned long long size;
+
+  [lock lock];
+  size = dataSize + indexMapLength;
+  [lock unlock];
+
+  return size;
+}
+
+@end
+
+
+@implementation FSNThumbnailStore (Private)
+
+/* Called with the lock held, or from the initializer. */
+- (BOOL)openFiles
+{
+  int flags = writable ? (O_RDWR | O_CREAT) : O_RDONLY;
+  DataHeader dheader;
+  struct stat st;
+
+  dataFd = open([dataPath fileSystemRepresentation], flags, 0644);
+  if (dataFd < 0)
+    return NO;
+
+  if ((pread(dataFd, &dheader, sizeof(DataHeader), 0) != sizeof(DataHeader))
+      || (dheader.magic != DATA_MAGIC) || (dheader.version != STORE_VERSION))
+    {
+      if (writable == NO)
+        {
+          [self closeFiles];
+          return NO;
+        }
+
+      /* a new or unreadable store starts over */
+      dheader.magic = DATA_MAGIC;
+      dheader.version = STORE_VERSION;
+      dheader.generation = (uint64_t)time(NULL);
+
+      if ((ftruncate(dataFd, 0) != 0)
+          || (writeAll(dataFd, &dheader, sizeof(DataHeader), 0) == NO))
+        {
+          [self closeFiles];
+          return NO;
+        }
+    }
+
+  generation = dheader.generation;
+
+  if (fstat(dataFd, &st) != 0)
+    {
+      [self closeFiles];
+      return NO;
+    }
+  dataSize = (uint64_t)st.st_size;
+
+  if (writable)
+    {
+      IndexHeader iheader;
+      int fd = open([indexPath fileSystemRepresentation], O_RDWR);
+      BOOL valid = NO;
+
+      if (fd >= 0)
+        {
+          valid = ((pread(fd, &iheader, sizeof(IndexHeader), 0) == sizeof(IndexHeader))
+                   && (iheader.magic == INDEX_MAGIC)
+                   && (iheader.version == STORE_VERSION)
+                   && (iheader.generation == generation)
+                   && (iheader.slotsCount >= INITIAL_SLOTS)
+                   && ((iheader.slotsCount & (iheader.slotsCount - 1)) == 0)
+                   && (fstat(fd, &st) == 0)
+                   && ((uint64_t)st.st_size == sizeof(IndexHeader)
+                                      + iheader.slotsCount * sizeof(IndexSlot)));
+        }
+
+      if (valid)
+        {
+          indexMapLength = (size_t)st.st_size;
+          indexMap = mmap(NULL, indexMapLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if (indexMap == MAP_FAILED)
+            {
+              indexMap = NULL;
+              valid = NO;
+            }
+        }
+
+      if (valid)
+        {
+          indexFd = fd;
+          indexInode = st.st_ino;
+          dataSize = ALIGN8(dataSize);
+        }
+      else
+        {
+          if (fd >= 0)
+            close(fd);
+          [self rebuildIndex];
+          if (indexMap == NULL)
+            {
+              [self closeFiles];
+              return NO;
+            }
+        }
+    }
+  else
+    {
+      const IndexHeader *iheader;
+
+      indexFd = open([indexPath fileSystemRepresentation], O_RDONLY);
+
+      if ((indexFd < 0) || (fstat(indexFd, &st) != 0)
+          || ((uint64_t)st.st_size < sizeof(IndexHeader)))
+        {
+          [self closeFiles];
+          return NO;
+        }
+
+      indexMapLength = (size_t)st.st_size;
+      indexMap = mmap(NULL, indexMapLength, PROT_READ, MAP_SHARED, indexFd, 0);
+
+      if (indexMap == MAP_FAILED)
+        {
+          indexMap = NULL;
+          [self closeFiles];
+          return NO;
+        }
+
+      iheader = (const IndexHeader *)indexMap;
+
+      if ((iheader->magic != INDEX_MAGIC) || (iheader->version != STORE_VERSION)
+          || (iheader->generation != generation)
+          || ((uint64_t)indexMapLength != sizeof(IndexHeader)
+                                  + iheader->slotsCount * sizeof(IndexSlot)))
+        {
+          [self closeFiles];
+          return NO;
+        }
+
+      indexInode = st.st_ino;
+    }
+
+  return [self mapDataUpTo: 0];
+}
+
+- (void)closeFiles
+{
+  if (dataMap)
+    munmap(dataMap, dataMapLength);
+  if (indexMap)
+    munmap(indexMap, indexMapLength);
+  if (dataFd >= 0)
+    close(dataFd);
+  if (indexFd >= 0)
+    close(indexFd);
+
+  dataMap = NULL;
+  dataMapLength = 0;
+  dataSize = 0;
+  indexMap = NULL;
+  indexMapLength = 0;
+  indexInode = 0;
+  dataFd = -1;
+  indexFd = -1;
+}
+
+/* Maps the data file again when it grew past `end` (0: whenever it
+ * grew past the map). */
+- (BOOL)mapDataUpTo:(uint64_t)end
+{
+  struct stat st;
+  size_t length;
+
+  if (dataFd < 0)
+    return NO;
+
+  if ((end != 0) && (dataMap != NULL) && (end <= dataMapLength))
+    return YES;
+
+  if (fstat(dataFd, &st) != 0)
+    return NO;
+
+  if (writable == NO)
+    dataSize = (uint64_t)st.st_size;
+
+  if ((dataMap != NULL) && ((uint64_t)st.st_size <= dataMapLength))
+    return YES;
+
+  length = (size_t)(((uint64_t)st.st_size / DATA_MAP_STEP + 1) * DATA_MAP_STEP);
+
+  if (dataMap)
+    munmap(dataMap, dataMapLength);
+
+  dataMap = mmap(NULL, length, PROT_READ, MAP_SHARED, dataFd, 0);
+
+  if (dataMap == MAP_FAILED)
+    {
+      dataMap = NULL;
+      dataMapLength = 0;
+      return NO;
+    }
+
+  dataMapLength = length;
+  return YES;
+}
+
+/* Called with the lock held. */
+- (BOOL)createIndex:(uint64_t)slotsCount
+{
+  NSString *tmpIndex = [indexPath stringByAppendingPathExtension: @"tmp"];
+  size_t length;
+  uint8_t *map;
+  int fd;
+
+  map = createIndexFile([tmpIndex fileSystemRepresentation], slotsCount,
+                        generation, &fd, &length);
+  if (map == NULL)
+    return NO;
+
+  if (indexMap)
+    {
+      IndexSlot *slots = SLOTS(indexMap);
+      uint64_t count = ((IndexHeader *)indexMap)->slotsCount;
+      uint64_t i;
+
+      for (i = 0; i < count; i++)
+        if (slots[i].state == SLOT_LIVE)
+          fillSlot(map, slotForInsert(map, &slots[i].key), &slots[i].key,
+                   slots[i].offset, slots[i].length);
+    }
+
+  msync(map, length, MS_SYNC);
+
+  if (rename([tmpIndex fileSystemRepresentation], [indexPath fileSystemRepresentation]) != 0)
+    {
+      munmap(map, length);
+      close(fd);
+      unlink([tmpIndex fileSystemRepresentation]);
+      return NO;
+    }
+
+  if (indexMap)
+    munmap(indexMap, indexMapLength);
+  if (indexFd >= 0)
+    close(indexFd);
+
+  indexMap = map;
+  indexMapLength = length;
+  indexFd = fd;
+
+  {
+    struct stat st;
+
+    if (fstat(fd, &st) == 0)
+      indexInode = st.st_ino;
+  }
+
+  return YES;
+}
+
+/* A lost or stale index is read back from the records in the order they
+ * were appended, so the last one of each file wins. */
+- (void)rebuildIndex
+{
+  uint64_t offset = ALIGN8(sizeof(DataHeader));
+
+  if ([self createIndex: INITIAL_SLOTS] == NO)
+    return;
+
+  [self mapDataUpTo: 0];
+
+  while (dataMap && (offset + sizeof(RecordHeader) <= dataSize))
+    {
+      const RecordHeader *record = (const RecordHeader *)(dataMap + offset);
+      uint64_t length = ALIGN8(sizeof(RecordHeader) + record->pathLength + record->dataLength);
+
+      if ((record->magic != RECORD_MAGIC) || (offset + length > dataSize))
+        break;
+
+      if (record->dataLength)
+        {
+          if ((((IndexHeader *)indexMap)->usedCount + 1
+               > MAX_LOAD(((IndexHeader *)indexMap)->slotsCount))
+              && ([self growIndex] == NO))
+            break;
+
+          fillSlot(indexMap, slotForInsert(indexMap, &record->key), &record->key,
+                   offset, record->dataLength);
+        }
+      else
+        {
+          IndexSlot *slot = findFileSlot(indexMap, &record->key);
+
+          if (slot)
+            removeSlot(indexMap, slot);
+        }
+
+      offset += length;
+    }
+
+  /* appends go after the last whole record */
+  dataSize = offset;
+}
+
+/* Called with the lock held. */
+- (BOOL)growIndex
+{
+  IndexHeader *header = (IndexHeader *)indexMap;
+  uint64_t count = header->slotsCount;
+
+  /* removed slots go away with the copy, so it may not need more */
+  if ((header->liveCount + 1) * 2 > MAX_LOAD(count))
+    count <<= 1;
+
+  return [self createIndex: count];
+}
+
+/* The record a slot points to, checked against it, or NULL. */
+- (const RecordHeader *)recordOfSlot:(const IndexSlot *)slot
+{
+  uint64_t offset = slot->offset;
+  const RecordHeader *record;
+  uint64_t end;
+
+  if (offset < sizeof(DataHeader))
+    return NULL;
+
+  /* a reader may not have seen the records appended since its map */
+  if ((offset + sizeof(RecordHeader) > dataSize) && (writable == NO))
+    [self mapDataUpTo: 0];
+
+  if ((offset + sizeof(RecordHeader) > dataSize)
+      || ([self mapDataUpTo: offset + sizeof(RecordHeader)] == NO))
+    return NULL;
+
+  record = (const RecordHeader *)(dataMap + offset);
+
+  if ((record->magic != RECORD_MAGIC) || (record->dataLength != slot->length)
+      || (sameKey(&record->key, &slot->key) == NO))
+    return NULL;
+
+  end = offset + sizeof(RecordHeader) + record->pathLength + record->dataLength;
+
+  if ((end > dataSize) && (writable == NO))
+    [self mapDataUpTo: 0];
+
+  if ((end > dataSize) || ([self mapDataUpTo: end] == NO))
+    return NULL;
+
+  record = (const RecordHeader *)(dataMap + offset);
+
+  return record;
+}
+
+/* Writes a record at `offset` and returns the offset after it, or
+ * UINT64_MAX. */
+- (uint64_t)appendRecord:(const FSNThumbnailKey *)key
+                    path:(NSString *)path
+                   bytes:(const void *)bytes
+                  length:(uint32_t)length
+                    toFd:(int)fd
+                      at:(uint64_t)offset
+{
+  const char *fspath = [path fileSystemRepresentation];
+  uint32_t pathLength = (uint32_t)strlen(fspath);
+  uint64_t total = ALIGN8(sizeof(RecordHeader) + pathLength + length);
+  static const uint8_t padding[8] = { 0 };
+  size_t padLength = (size_t)(total - (sizeof(RecordHeader) + pathLength + length));
+  RecordHeader header;
+
+  memset(&header, 0, sizeof(RecordHeader));
+  header.magic = RECORD_MAGIC;
+  header.pathLength = pathLength;
+  header.dataLength = length;
+  header.key = *key;
+
+  if ((writeAll(fd, &header, sizeof(RecordHeader), (off_t)offset) == NO)
+      || (writeAll(fd, fspath, pathLength, (off_t)(offset + sizeof(RecordHeader))) == NO)
+      || (length && (writeAll(fd, bytes, length,
+                              (off_t)(offset + sizeof(RecordHeader) + pathLength)) == NO))
+      || (padLength && (writeAll(fd, padding, padLength,
+                                 (off_t)(offset + total - padLength)) == NO)))
+    return UINT64_MAX;
+
+  return offset + total;
+}
+
+@end
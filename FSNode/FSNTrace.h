@@ -0,0 +1,128 @@
+/* FSNTrace.h
+ *
+ * Spans for finding out where a frozen window spent its time, in
+ * Workspace and the Operation framework and in the fswatcher and gmds
+ * daemons alike.
+ *
+ * Each thread records into its own ring of the last FSN_TRACE_RING_SIZE
+ * events, with no lock and no allocation after its first event: a span
+ * costs two clock readings and two stores.  While tracing is off a span
+ * costs one load and a branch; built with FSN_TRACE_DISABLED defined the
+ * macros are empty.  Tracing is turned on by the GW_TRACE environment
+ * variable or by FSNTraceSetEnabled().
+ *
+ * FSNTraceWrite() writes the rings as a Chrome trace-event JSON file
+ * (chrome://tracing, Perfetto).  Every process dumps its own file, on
+ * the signal given to FSNTraceInstallDumpSignal() (SIGUSR2 in all of
+ * them) or when asked; the timestamps are of the monotonic clock, so the
+ * files of several processes line up once loaded together, and a span
+ * recorded with an operation ID carries it as its "op" argument, the
+ * same on both sides: the batch sequence of an fswatcher delivery, the
+ * reference of a file operation, the number of a gmds query.
+ *
+ * Names must be string literals, or at least outlive the process: only
+ * the pointer is recorded.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_TRACE_H
+#define FSN_TRACE_H
+
+#import <Foundation/Foundation.h>
+#include <stdint.h>
+
+#define FSN_TRACE_RING_SIZE 8192
+
+extern volatile int FSNTraceOn;
+
+void FSNTraceRecord(char phase, const char *name, uint64_t op);
+
+typedef struct
+{
+  const char *name;
+  int recorded;
+} FSNTraceSpan;
+
+static inline FSNTraceSpan
+FSNTraceSpanBegin(const char *name, uint64_t op)
+{
+  FSNTraceSpan span = { name, FSNTraceOn };
+
+  if (span.recorded)
+    FSNTraceRecord('B', name, op);
+
+  return span;
+}
+
+static inline void
+FSNTraceSpanEnd(FSNTraceSpan *span)
+{
+  if (span->recorded)
+    FSNTraceRecord('E', span->name, 0);
+}
+
+#define FSN_TRACE_CONCAT_(a, b) a ## b
+#define FSN_TRACE_CONCAT(a, b) FSN_TRACE_CONCAT_(a, b)
+
+#ifndef FSN_TRACE_DISABLED
+
+/* A span from here to the end of the enclosing block, however it is
+   left. */
+#define FSN_TRACE_SCOPE(name) FSN_TRACE_SCOPE_OP(name, 0)
+
+#define FSN_TRACE_SCOPE_OP(name, op) \
+  FSNTraceSpan FSN_TRACE_CONCAT(fsnTraceSpan, __LINE__) \
+    __attribute__((cleanup(FSNTraceSpanEnd), unused)) \
+    = FSNTraceSpanBegin((name), (uint64_t)(op))
+
+/* For spans that do not end in the block they begin in. */
+#define FSN_TRACE_BEGIN(name, op) \
+  do { if (FSNTraceOn) FSNTraceRecord('B', (name), (uint64_t)(op)); } while (0)
+
+#define FSN_TRACE_END(name) \
+  do { if (FSNTraceOn) FSNTraceRecord('E', (name), 0); } while (0)
+
+#define FSN_TRACE_MARK(name, op) \
+  do { if (FSNTraceOn) FSNTraceRecord('i', (name), (uint64_t)(op)); } while (0)
+
+#else
+
+#define FSN_TRACE_SCOPE(name) do { } while (0)
+#define FSN_TRACE_SCOPE_OP(name, op) do { } while (0)
+#define FSN_TRACE_BEGIN(name, op) do { } while (0)
+#define FSN_TRACE_END(name) do { } while (0)
+#define FSN_TRACE_MARK(name, op) do { } while (0)
+
+#endif
+
+void FSNTraceSetEnabled(BOOL flag);
+
+BOOL FSNTraceIsEnabled(void);
+
+/* A thread's ring, for reading the spans open on the thread from
+   another one. */
+typedef struct FSNTraceRing *FSNTraceThread;
+
+/* The calling thread's; NULL if no ring could be had. */
+FSNTraceThread FSNTraceCurrentThread(void);
+
+/* The spans begun on `thread` and not ended yet, outermost first, as
+   "name [op]" joined by " > "; nil when there are none, or tracing was
+   off when they began.  Meant for a thread that is stuck: one that goes
+   on recording meanwhile may be read half way through a span. */
+NSString *FSNTraceOpenSpans(FSNTraceThread thread);
+
+/* Writes the events in the rings to `path`, or to
+   <temporary directory>/<process name>-trace-<pid>.json when `path` is
+   nil.  Returns the path written, nil on failure.  Threads may go on
+   recording meanwhile; the oldest events of a busy ring may then be
+   lost. */
+NSString *FSNTraceWrite(NSString *path);
+
+/* Writes the trace, to the default path, whenever the process gets
+   `sig`.  The dump is made on a thread of its own, so it works in a
+   process without a run loop. */
+void FSNTraceInstallDumpSignal(int sig);
+
+#endif /* FSN_TRACE_H */
@@ -0,0 +1,413 @@
+/* FSNTrace.m
+ *
+ * Per-thread trace rings and their Chrome trace-event dump.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#import "FSNTrace.h"
+
+typedef struct
+{
+  uint64_t ts;              /* nanoseconds of CLOCK_MONOTONIC */
+  const char *name;
+  uint64_t op;
+  uint32_t tid;
+  char phase;
+} FSNTraceEvent;
+
+/* Rings are never freed: the ring of a thread that ended is taken over
+   by the next new thread, events included, so a pool of short lived
+   threads costs as many rings as were ever alive at once. */
+typedef struct FSNTraceRing
+{
+  struct FSNTraceRing *next;
+  int inUse;
+  uint32_t tid;
+  uint64_t head;            /* events ever written; only its thread writes */
+  FSNTraceEvent events[FSN_TRACE_RING_SIZE];
+} FSNTraceRing;
+
+volatile int FSNTraceOn = 0;
+
+static FSNTraceRing *rings = NULL;
+static __thread FSNTraceRing *threadRing = NULL;
+static pthread_key_t ringKey;
+static pthread_once_t ringKeyOnce = PTHREAD_ONCE_INIT;
+
+static int dumpPipe[2] = { -1, -1 };
+
+@interface FSNTraceDumper : NSObject
++ (void)waitForSignals:(id)arg;
+@end
+
+
+__attribute__((constructor))
+static void
+traceReadEnvironment(void)
+{
+  const char *env = getenv("GW_TRACE");
+
+  if (env && *env && strcmp(env, "0") != 0)
+    FSNTraceOn = 1;
+}
+
+static uint64_t
+monotonicNanoseconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t
+currentThreadId(void)
+{
+#ifdef __linux__
+  return (uint32_t)syscall(SYS_gettid);
+#else
+  return (uint32_t)((uintptr_t)pthread_self() & 0xffffffff);
+#endif
+}
+
+static void
+releaseRing(void *ring)
+{
+  __atomic_store_n(&((FSNTraceRing *)ring)->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void
+makeRingKey(void)
+{
+  pthread_key_create(&ringKey, releaseRing);
+}
+
+static FSNTraceRing *
+ringForThread(void)
+{
+  FSNTraceRing *ring;
+
+  pthread_once(&ringKeyOnce, makeRingKey);
+
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+      int expected = 0;
+
+      if (__atomic_compare_exchange_n(&ring->inUse, &expected, 1, NO,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        break;
+    }
+
+  if (ring == NULL)
+    {
+      ring = calloc(1, sizeof(FSNTraceRing));
+      if (ring == NULL)
+        return NULL;
+
+      ring->inUse = 1;
+      ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+      while (__atomic_compare_exchange_n(&rings, &ring->next, ring, YES,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED) == NO)
+        ;
+    }
+
+  ring->tid = currentThreadId();
+  threadRing = ring;
+  pthread_setspecific(ringKey, ring);
+
+  return ring;
+}
+
+void
+FSNTraceRecord(char phase, const char *name, uint64_t op)
+{
+  FSNTraceRing *ring = threadRing ? threadRing : ringForThread();
+  FSNTraceEvent *event;
+  uint64_t head;
+
+  if (ring == NULL)
+    return;
+
+  head = ring->head;
+  event = &ring->events[head % FSN_TRACE_RING_SIZE];
+  event->ts = monotonicNanoseconds();
+  event->name = name;
+  event->op = op;
+  event->tid = ring->tid;
+  event->phase = phase;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void
+FSNTraceSetEnabled(BOOL flag)
+{
+  FSNTraceOn = (flag ? 1 : 0);
+}
+
+BOOL
+FSNTraceIsEnabled(void)
+{
+  return (FSNTraceOn != 0);
+}
+
+static void
+writeJSONString(FILE *fp, const char *str)
+{
+  fputc('"', fp);
+
+  for (; str && *str; str++)
+    {
+      unsigned char c = (unsigned char)*str;
+
+      if ((c == '"') || (c == '\\'))
+        fprintf(fp, "\\%c", c);
+      else if (c < 0x20)
+        fprintf(fp, "\\u%04x", c);
+      else
+        fputc(c, fp);
+    }
+
+  fputc('"', fp);
+}
+
+/* The events of `ring` still there once copied, oldest first. */
+static NSUInteger
+copyRing(FSNTraceRing *ring, FSNTraceEvent *buf)
+{
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t first = (head > FSN_TRACE_RING_SIZE) ? head - FSN_TRACE_RING_SIZE : 0;
+  uint64_t after;
+  uint64_t i;
+
+  for (i = first; i < head; i++)
+    buf[i - first] = ring->events[i % FSN_TRACE_RING_SIZE];
+
+  /* those overwritten while being copied are dropped */
+  after = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  if (after > FSN_TRACE_RING_SIZE && (after - FSN_TRACE_RING_SIZE) > first)
+    {
+      uint64_t lost = MIN(after - FSN_TRACE_RING_SIZE - first, head - first);
+
+      memmove(buf, buf + lost, (size_t)(head - first - lost) * sizeof(FSNTraceEvent));
+      first += lost;
+    }
+
+  return (NSUInteger)(head - first);
+}
+
+FSNTraceThread
+FSNTraceCurrentThread(void)
+{
+  return (threadRing ? threadRing : ringForThread());
+}
+
+#define MAX_OPEN_SPANS 64
+
+NSString *
+FSNTraceOpenSpans(FSNTraceThread thread)
+{
+  FSNTraceEvent *open[MAX_OPEN_SPANS];
+  NSMutableString *desc = nil;
+  NSUInteger depth = 0;
+  FSNTraceEvent *buf;
+  NSUInteger count;
+  NSUInteger i;
+  uint32_t tid;
+
+  if (thread == NULL)
+    return nil;
+
+  buf = malloc(FSN_TRACE_RING_SIZE * sizeof(FSNTraceEvent));
+  if (buf == NULL)
+    return nil;
+
+  tid = __atomic_load_n(&thread->tid, __ATOMIC_ACQUIRE);
+  count = copyRing(thread, buf);
+
+  for (i = 0; i < count; i++)
+    {
+      FSNTraceEvent *event = &buf[i];
+
+      /* left by a thread that had the ring before */
+      if (event->tid != tid)
+        continue;
+
+      if (event->phase == 'B')
+        {
+          if (depth < MAX_OPEN_SPANS)
+            open[depth] = event;
+          depth++;
+        }
+      else if (event->phase == 'E')
+        {
+          NSUInteger j = MIN(depth, MAX_OPEN_SPANS);
+
+          /* the span it ends, unless its begin was overwritten */
+          while (j > 0 && strcmp(open[j - 1]->name, event->name) != 0)
+            j--;
+
+          if (j > 0)
+            depth = j - 1;
+          else if (depth > MAX_OPEN_SPANS)
+            depth--;
+        }
+    }
+
+  for (i = 0; i < MIN(depth, MAX_OPEN_SPANS); i++)
+    {
+      if (desc == nil)
+        desc = [NSMutableString string];
+      else
+        [desc appendString: @" > "];
+
+      [desc appendFormat: @"%s", open[i]->name];
+      if (open[i]->op != 0)
+        [desc appendFormat: @" [%llu]", (unsigned long long)open[i]->op];
+    }
+
+  free(buf);
+
+  return desc;
+}
+
+NSString *
+FSNTraceWrite(NSString *path)
+{
+  NSString *pname = [[NSProcessInfo processInfo] processName];
+  int pid = (int)getpid();
+  FSNTraceEvent *buf;
+  FSNTraceRing *ring;
+  FILE *fp;
+
+  if (path == nil)
+    {
+      NSString *fname = [NSString stringWithFormat: @"%@-trace-%d.json", pname, pid];
+      path = [NSTemporaryDirectory() stringByAppendingPathComponent: fname];
+    }
+
+  buf = malloc(FSN_TRACE_RING_SIZE * sizeof(FSNTraceEvent));
+  if (buf == NULL)
+    return nil;
+
+  fp = fopen([path fileSystemRepresentation], "w");
+  if (fp == NULL)
+    {
+      free(buf);
+      return nil;
+    }
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":", pid);
+  writeJSONString(fp, [pname UTF8String]);
+  fprintf(fp, "}}");
+
+  for (ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+    {
+      NSUInteger count = copyRing(ring, buf);
+      NSUInteger i;
+
+      for (i = 0; i < count; i++)
+        {
+          FSNTraceEvent *event = &buf[i];
+
+          fprintf(fp, ",\n{\"name\":");
+          writeJSONString(fp, event->name);
+          fprintf(fp, ",\"cat\":\"gw\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                  event->phase, (double)event->ts / 1000.0, pid, (unsigned)event->tid);
+          if (event->phase == 'i')
+            fprintf(fp, ",\"s\":\"t\"");
+          if (event->op != 0)
+            fprintf(fp, ",\"args\":{\"op\":%llu}", (unsigned long long)event->op);
+          fputc('}', fp);
+        }
+    }
+
+  fprintf(fp, "\n]}\n");
+  free(buf);
+
+  if (fclose(fp) != 0)
+    return nil;
+
+  return path;
+}
+
+static void
+dumpSignalHandler(int sig)
+{
+  int saved = errno;
+  char c = 0;
+
+  if (write(dumpPipe[1], &c, 1) < 0)
+    {
+      /* a dump is pending already */
+    }
+  errno = saved;
+}
+
+@implementation FSNTraceDumper
+
++ (void)waitForSignals:(id)arg
+{
+  for (;;)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      char c;
+      ssize_t n = read(dumpPipe[0], &c, 1);
+
+      if (n > 0)
+        {
+          NSString *path = FSNTraceWrite(nil);
+
+          if (path)
+            NSLog(@"trace written to %@", path);
+          else
+            NSLog(@"could not write the trace");
+        }
+      RELEASE (arp);
+
+      if ((n == 0) || ((n < 0) && (errno != EINTR)))
+        break;
+    }
+}
+
+@end
+
+void
+FSNTraceInstallDumpSignal(int sig)
+{
+  struct sigaction sa;
+
+  if (dumpPipe[0] != -1)
+    return;
+
+  if (pipe(dumpPipe) != 0)
+    return;
+  /* the handler must never block */
+  fcntl(dumpPipe[1], F_SETFL, fcntl(dumpPipe[1], F_GETFL) | O_NONBLOCK);
+
+  [NSThread detachNewThreadSelector: @selector(waitForSignals:)
+                           toTarget: [FSNTraceDumper class]
+                         withObject: nil];
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = dumpSignalHandler;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(sig, &sa, NULL);
+}
@@ -0,0 +1,70 @@
+/* FSNTrash.h
+ *
+ * Where recycled files go.  What is in the home directory's file system
+ * goes to GWorkspace's own trash, ~/.Trash; what is on another volume
+ * goes to that volume's trash, as the freedesktop.org trash
+ * specification lays it out, so recycling is always a rename and never
+ * a copy:
+ *
+ *   $topdir/.Trash/$uid/files    when the administrator made $topdir/.Trash
+ *                                (a directory with the sticky bit, no link)
+ *   $topdir/.Trash-$uid/files    otherwise, made on first use
+ *
+ * Each item of a volume trash has a record in the "info" directory
+ * next to "files", <name>.trashinfo, with the path it came from
+ * (relative to $topdir) and when it was recycled, so other desktops see
+ * and restore it.  The record is written first, and its exclusive
+ * creation reserves the name in the trash.
+ *
+ * Foundation only; safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_TRASH_H
+#define FSN_TRASH_H
+
+#import <Foundation/Foundation.h>
+
+@interface FSNTrash : NSObject
+
++ (NSString *)homeTrashPath;
+
+/* The trash the items of `dir` are recycled to: the home trash when
+ * `dir` is on its file system, otherwise the trash of the volume `dir`
+ * is on, made if need be.  nil when that volume has none and none can
+ * be made, as on a read-only one: the caller falls back to the home
+ * trash, and to a copy. */
++ (NSString *)trashPathForDirectory:(NSString *)dir;
+
+/* The mount point of the file system `path` is on. */
++ (NSString *)topDirectoryOfPath:(NSString *)path;
+
+/* The "files" directory of the trash of the volume mounted at `topdir`.
+ * Unless `create` is YES, nil when it does not exist yet. */
++ (NSString *)trashPathOfVolume:(NSString *)topdir
+                         create:(BOOL)create;
+
+/* The home trash, then the trashes that exist on the volumes mounted at
+ * `mountPoints`, each once. */
++ (NSArray *)trashPathsOfVolumes:(NSArray *)mountPoints;
+
+/* YES for the "files" directory of a volume trash. */
++ (BOOL)isVolumeTrashPath:(NSString *)path;
+
+/* Writes the record for `name` in the volume trash `trash`, for the item
+ * now at `path`.  NO when the name has a record already. */
++ (BOOL)reserveName:(NSString *)name
+            inTrash:(NSString *)trash
+            forPath:(NSString *)path;
+
++ (void)removeInfoOfName:(NSString *)name
+                 inTrash:(NSString *)trash;
+
+/* Where the item was recycled from; nil without a record. */
++ (NSString *)originalPathOfName:(NSString *)name
+                         inTrash:(NSString *)trash;
+
+@end
+
+#endif /* FSN_TRASH_H */
@@ -0,0 +1,329 @@
+/* FSNTrash.m
+ *
+ * The home trash and the trashes of the volumes.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#import "FSNTrash.h"
+
+#define INFO_SUFFIX @".trashinfo"
+
+/* A directory of the user's, made if asked: never a link, nor one
+   somebody else could fill. */
+static BOOL
+ownDirectory(NSString *path, BOOL create)
+{
+  const char *cpath = [path fileSystemRepresentation];
+  struct stat st;
+
+  if (lstat(cpath, &st) != 0)
+    {
+      if ((create == NO) || (errno != ENOENT))
+        return NO;
+      if ((mkdir(cpath, 0700) != 0) && (errno != EEXIST))
+        return NO;
+      if (lstat(cpath, &st) != 0)
+        return NO;
+    }
+
+  return (S_ISDIR(st.st_mode) && (st.st_uid == getuid()));
+}
+
+/* The trash directory a "files" directory is in, laid out right. */
+static NSString *
+usableTrash(NSString *base, BOOL create)
+{
+  NSString *files = [base stringByAppendingPathComponent: @"files"];
+
+  if (ownDirectory(base, create)
+      && ownDirectory(files, create)
+      && ownDirectory([base stringByAppendingPathComponent: @"info"], create))
+    return files;
+
+  return nil;
+}
+
+/* The volume's top directory for a volume trash, nil for any other. */
+static NSString *
+topDirectoryOfTrash(NSString *trash)
+{
+  NSString *uid = [NSString stringWithFormat: @"%lu", (unsigned long)getuid()];
+  NSString *base = [trash stringByDeletingLastPathComponent];
+  NSString *name = [base lastPathComponent];
+  NSString *parent = [base stringByDeletingLastPathComponent];
+
+  if ([[trash lastPathComponent] isEqual: @"files"] == NO)
+    return nil;
+
+  if ([name isEqual: [@".Trash-" stringByAppendingString: uid]])
+    return parent;
+
+  if ([name isEqual: uid] && [[parent lastPathComponent] isEqual: @".Trash"])
+    return [parent stringByDeletingLastPathComponent];
+
+  return nil;
+}
+
+static NSString *
+infoPath(NSString *name, NSString *trash)
+{
+  NSString *info = [[trash stringByDeletingLastPathComponent]
+                     stringByAppendingPathComponent: @"info"];
+
+  return [info stringByAppendingPathComponent:
+                 [name stringByAppendingString: INFO_SUFFIX]];
+}
+
+/* RFC 2396 escaping, as the specification asks for the Path key. */
+static NSString *
+escapedPath(NSString *path)
+{
+  const unsigned char *s = (const unsigned char *)[path fileSystemRepresentation];
+  NSMutableString *escaped = [NSMutableString string];
+
+  for (; *s; s++)
+    {
+      if (((*s >= 'a') && (*s <= 'z')) || ((*s >= 'A') && (*s <= 'Z'))
+          || ((*s >= '0') && (*s <= '9')) || strchr("/-_.!~*'()", *s))
+        [escaped appendFormat: @"%c", *s];
+      else
+        [escaped appendFormat: @"%%%02X", *s];
+    }
+
+  return escaped;
+}
+
+static int
+hexValue(unsigned char c)
+{
+  if ((c >= '0') && (c <= '9'))
+    return c - '0';
+  if ((c >= 'a') && (c <= 'f'))
+    return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F'))
+    return c - 'A' + 10;
+  return -1;
+}
+
+static NSString *
+unescapedPath(NSString *escaped)
+{
+  NSData *data = [escaped dataUsingEncoding: NSUTF8StringEncoding];
+  const unsigned char *s = [data bytes];
+  NSUInteger len = [data length];
+  NSMutableData *raw = [NSMutableData dataWithCapacity: len];
+  NSUInteger i;
+
+  for (i = 0; i < len; i++)
+    {
+      unsigned char c = s[i];
+
+      if ((c == '%') && (i + 2 < len) && (hexValue(s[i + 1]) >= 0)
+          && (hexValue(s[i + 2]) >= 0))
+        {
+          c = (unsigned char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+          i += 2;
+        }
+      [raw appendBytes: &c length: 1];
+    }
+
+  return [[NSFileManager defaultManager]
+           stringWithFileSystemRepresentation: [raw bytes]
+                                       length: [raw length]];
+}
+
+
+@implementation FSNTrash
+
++ (NSString *)homeTrashPath
+{
+  static NSString *path = nil;
+
+  if (path == nil)
+    path = RETAIN ([NSHomeDirectory() stringByAppendingPathComponent: @".Trash"]);
+
+  return path;
+}
+
++ (NSString *)topDirectoryOfPath:(NSString *)path
+{
+  struct stat st;
+  dev_t dev;
+
+  if (stat([path fileSystemRepresentation], &st) != 0)
+    return nil;
+
+  dev = st.st_dev;
+
+  for (;;)
+    {
+      NSString *parent = [path stringByDeletingLastPathComponent];
+
+      if ([parent isEqual: path] || ([parent length] == 0))
+        return path;
+
+      if ((stat([parent fileSystemRepresentation], &st) != 0) || (st.st_dev != dev))
+        return path;
+
+      path = parent;
+    }
+}
+
++ (NSString *)trashPathOfVolume:(NSString *)topdir
+                         create:(BOOL)create
+{
+  NSString *uid = [NSString stringWithFormat: @"%lu", (unsigned long)getuid()];
+  NSString *shared = [topdir stringByAppendingPathComponent: @".Trash"];
+  NSString *trash = nil;
+  struct stat st;
+
+  if ((lstat([shared fileSystemRepresentation], &st) == 0)
+      && S_ISDIR(st.st_mode) && (st.st_mode & S_ISVTX))
+    {
+      trash = usableTrash([shared stringByAppendingPathComponent: uid], create);
+    }
+
+  if (trash == nil)
+    {
+      NSString *own = [@".Trash-" stringByAppendingString: uid];
+
+      trash = usableTrash([topdir stringByAppendingPathComponent: own], create);
+    }
+
+  return trash;
+}
+
++ (NSString *)trashPathForDirectory:(NSString *)dir
+{
+  NSString *home = [self homeTrashPath];
+  struct stat st;
+  struct stat hst;
+
+  if (stat([dir fileSystemRepresentation], &st) != 0)
+    return nil;
+
+  if ((stat([home fileSystemRepresentation], &hst) == 0
+       || stat([NSHomeDirectory() fileSystemRepresentation], &hst) == 0)
+      && (hst.st_dev == st.st_dev))
+    return home;
+
+  return [self trashPathOfVolume: [self topDirectoryOfPath: dir] create: YES];
+}
+
++ (NSArray *)trashPathsOfVolumes:(NSArray *)mountPoints
+{
+  NSMutableArray *trashes = [NSMutableArray arrayWithObject: [self homeTrashPath]];
+  NSUInteger i;
+
+  for (i = 0; i < [mountPoints count]; i++)
+    {
+      NSString *trash = [self trashPathOfVolume: [mountPoints objectAtIndex: i]
+                                         create: NO];
+
+      if (trash && ([trashes containsObject: trash] == NO))
+        [trashes addObject: trash];
+    }
+
+  return trashes;
+}
+
++ (BOOL)isVolumeTrashPath:(NSString *)path
+{
+  return (topDirectoryOfTrash(path) != nil);
+}
+
++ (BOOL)reserveName:(NSString *)name
+            inTrash:(NSString *)trash
+            forPath:(NSString *)path
+{
+  NSString *topdir = topDirectoryOfTrash(trash);
+  NSString *recorded = path;
+  NSData *data;
+  char date[32];
+  time_t now = time(NULL);
+  struct tm tm;
+  int fd;
+  BOOL written;
+
+  if (topdir == nil)
+    return NO;
+
+  /* relative to the volume, that may be mounted elsewhere next time */
+  if ([path hasPrefix: [topdir stringByAppendingString: @"/"]])
+    recorded = [path substringFromIndex: [topdir length] + 1];
+  else if ([topdir isEqual: @"/"] && [path hasPrefix: @"/"])
+    recorded = [path substringFromIndex: 1];
+
+  localtime_r(&now, &tm);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+
+  data = [[NSString stringWithFormat: @"[Trash Info]\nPath=%@\nDeletionDate=%s\n",
+                    escapedPath(recorded), date]
+           dataUsingEncoding: NSUTF8StringEncoding];
+
+  fd = open([infoPath(name, trash) fileSystemRepresentation],
+            O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    return NO;
+
+  written = (write(fd, [data bytes], [data length]) == (ssize_t)[data length]);
+
+  if ((close(fd) != 0) || (written == NO))
+    {
+      [self removeInfoOfName: name inTrash: trash];
+      return NO;
+    }
+
+  return YES;
+}
+
++ (void)removeInfoOfName:(NSString *)name
+                 inTrash:(NSString *)trash
+{
+  if (topDirectoryOfTrash(trash))
+    unlink([infoPath(name, trash) fileSystemRepresentation]);
+}
+
++ (NSString *)originalPathOfName:(NSString *)name
+                         inTrash:(NSString *)trash
+{
+  NSString *topdir = topDirectoryOfTrash(trash);
+  NSString *contents;
+  NSArray *lines;
+  NSUInteger i;
+
+  if (topdir == nil)
+    return nil;
+
+  contents = [NSString stringWithContentsOfFile: infoPath(name, trash)];
+  lines = [contents componentsSeparatedByString: @"\n"];
+
+  for (i = 0; i < [lines count]; i++)
+    {
+      NSString *line = [lines objectAtIndex: i];
+
+      if ([line hasPrefix: @"Path="])
+        {
+          NSString *path = unescapedPath([line substringFromIndex: 5]);
+
+          if ([path length] == 0)
+            return nil;
+          if ([path isAbsolutePath])
+            return path;
+          return [topdir stringByAppendingPathComponent: path];
+        }
+    }
+
+  return nil;
+}
+
+@end
@@ -0,0 +1,67 @@
+/* FSNTypeResolver.h
+ *
+ * Shared cache of what FSNode would otherwise ask NSWorkspace for every
+ * node: the default application of an extension, the workspace type of
+ * a directory, and the localized type descriptions.
+ *
+ * It also numbers kinds.  A kind is the node class (directory, executable,
+ * other) plus the lowercased extension; -rankOfKind: gives each kind its
+ * position in Kind sort order, so sorting by kind compares two integers.
+ *
+ * The application answers are dropped by -invalidateApplications, which
+ * the Workspace app calls when it rescans the application registry and
+ * FSNodeRep calls when an application bundle is created or removed.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_TYPE_RESOLVER_H
+#define FSN_TYPE_RESOLVER_H
+
+#import <Foundation/Foundation.h>
+
+typedef enum FSNKindClass {
+  FSNKindClassDirectory = 0,
+  FSNKindClassExecutable = 1,
+  FSNKindClassOther = 2
+} FSNKindClass;
+
+@interface FSNTypeResolver : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *appsByExtension;
+  NSMutableDictionary *descriptions;
+  NSMutableDictionary *kindsByKey;
+  NSMutableArray *kindKeys;
+  NSUInteger *ranks;
+  NSUInteger ranksCount;
+  BOOL ranksValid;
+}
+
++ (FSNTypeResolver *)sharedResolver;
+
+/* Default application for files with `ext`, or nil. */
+- (NSString *)applicationForExtension:(NSString *)ext;
+
+/* What -[NSWorkspace getInfoForFile:application:type:] answers for the
+   directory at `path`, from the extension and the mount table alone. */
+- (void)getInfoForDirectoryAtPath:(NSString *)path
+                      application:(NSString **)app
+                             type:(NSString **)type;
+
+/* Localized FSNode type description ("plain file", "directory"...). */
+- (NSString *)typeDescriptionForKey:(NSString *)key;
+
+/* A small, stable number for (`cls`, `extensionKey`), starting at 1. */
+- (NSUInteger)kindForClass:(FSNKindClass)cls
+              extensionKey:(NSData *)extensionKey;
+
+/* Sort position of `kind`: directories first, then executables, then
+   the rest, each by extension. */
+- (NSUInteger)rankOfKind:(NSUInteger)kind;
+
+- (void)invalidateApplications;
+
+@end
+
+#endif /* FSN_TYPE_RESOLVER_H */
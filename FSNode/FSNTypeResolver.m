@@ -0,0 +1,222 @@
+/* FSNTypeResolver.m
+ *
+ * Shared type and application resolution cache for FSNode.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#import <AppKit/AppKit.h>
+#import "FSNTypeResolver.h"
+#import "FSNMountTable.h"
+#import "FSNSortKeys.h"
+
+static FSNTypeResolver *sharedResolver = nil;
+
+static NSComparisonResult
+compareKindKeys(id k1, id k2, void *context)
+{
+  return FSNCompareSortKeys(k1, k2);
+}
+
+
+@interface FSNTypeResolver (Private)
+- (void)updateRanks;
+@end
+
+
+@implementation FSNTypeResolver
+
++ (FSNTypeResolver *)sharedResolver
+{
+  @synchronized (self)
+    {
+      if (sharedResolver == nil)
+        sharedResolver = [FSNTypeResolver new];
+    }
+
+  return sharedResolver;
+}
+
+- (void)dealloc
+{
+  free(ranks);
+  RELEASE (kindKeys);
+  RELEASE (kindsByKey);
+  RELEASE (descriptions);
+  RELEASE (appsByExtension);
+  RELEASE (lock);
+
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      lock = [NSLock new];
+      appsByExtension = [NSMutableDictionary new];
+      descriptions = [NSMutableDictionary new];
+      kindsByKey = [NSMutableDictionary new];
+      kindKeys = [NSMutableArray new];
+      ranks = NULL;
+      ranksCount = 0;
+      ranksValid = NO;
+    }
+
+  return self;
+}
+
+- (NSString *)applicationForExtension:(NSString *)ext
+{
+  id app;
+
+  if (ext == nil)
+    ext = @"";
+
+  [lock lock];
+  app = RETAIN ([appsByExtension objectForKey: ext]);
+  [lock unlock];
+
+  if (app == nil)
+    {
+      app = [[NSWorkspace sharedWorkspace] getBestAppInRole: nil
+                                               forExtension: ext];
+      if (app == nil)
+        app = [NSNull null];
+
+      [lock lock];
+      [appsByExtension setObject: app forKey: ext];
+      [lock unlock];
+      RETAIN (app);
+    }
+
+  AUTORELEASE (app);
+
+  return (app == [NSNull null]) ? nil : app;
+}
+
+- (void)getInfoForDirectoryAtPath:(NSString *)path
+                      application:(NSString **)app
+                             type:(NSString **)type
+{
+  NSString *ext = [path pathExtension];
+  NSString *defApp = [self applicationForExtension: ext];
+
+  /* the same rules as NSWorkspace, whose mount point test stats the
+     directory and its parent */
+  if ([ext isEqual: @"app"] || [ext isEqual: @"debug"] || [ext isEqual: @"profile"])
+    *type = NSApplicationFileType;
+  else if ([ext isEqual: @"bundle"])
+    *type = NSPlainFileType;
+  else if (defApp != nil && [ext length] > 0)
+    *type = NSPlainFileType;
+  else if ([[FSNMountTable sharedTable] isMountPointAtPath: path])
+    *type = NSFilesystemFileType;
+  else
+    *type = NSDirectoryFileType;
+
+  *app = defApp;
+}
+
+- (NSString *)typeDescriptionForKey:(NSString *)key
+{
+  NSString *descr;
+
+  [lock lock];
+  descr = RETAIN ([descriptions objectForKey: key]);
+  [lock unlock];
+
+  if (descr == nil)
+    {
+      descr = NSLocalizedStringFromTableInBundle(key, nil,
+                                                 [NSBundle bundleForClass: [self class]], @"");
+      [lock lock];
+      [descriptions setObject: descr forKey: key];
+      [lock unlock];
+      RETAIN (descr);
+    }
+
+  return AUTORELEASE (descr);
+}
+
+- (NSUInteger)kindForClass:(FSNKindClass)cls
+              extensionKey:(NSData *)extensionKey
+{
+  NSMutableData *key = [NSMutableData dataWithCapacity: [extensionKey length] + 1];
+  unsigned char c = (unsigned char)cls;
+  NSNumber *kind;
+  NSUInteger k;
+
+  /* class byte first, so byte order is Kind sort order */
+  [key appendBytes: &c length: 1];
+  [key appendData: extensionKey];
+
+  [lock lock];
+  kind = [kindsByKey objectForKey: key];
+  if (kind == nil)
+    {
+      [kindKeys addObject: key];
+      kind = [NSNumber numberWithUnsignedInteger: [kindKeys count]];
+      [kindsByKey setObject: kind forKey: key];
+      ranksValid = NO;
+    }
+  k = [kind unsignedIntegerValue];
+  [lock unlock];
+
+  return k;
+}
+
+/* Called with the lock held.  New kinds show up a handful of times per
+   folder at most, so the ranks are simply recomputed. */
+- (void)updateRanks
+{
+  NSArray *sorted = [kindKeys sortedArrayUsingFunction: compareKindKeys
+                                               context: NULL];
+  NSUInteger count = [sorted count];
+  NSUInteger *newranks = realloc(ranks, (count + 1) * sizeof(NSUInteger));
+  NSUInteger i;
+
+  if (newranks == NULL)
+    return;
+
+  ranks = newranks;
+  ranksCount = count + 1;
+  ranks[0] = 0;
+
+  for (i = 0; i < count; i++)
+    {
+      NSNumber *kind = [kindsByKey objectForKey: [sorted objectAtIndex: i]];
+
+      ranks[[kind unsignedIntegerValue]] = i + 1;
+    }
+
+  ranksValid = YES;
+}
+
+- (NSUInteger)rankOfKind:(NSUInteger)kind
+{
+  NSUInteger rank = 0;
+
+  [lock lock];
+  if (ranksValid == NO)
+    [self updateRanks];
+  if (kind < ranksCount)
+    rank = ranks[kind];
+  [lock unlock];
+
+  return rank;
+}
+
+- (void)invalidateApplications
+{
+  [lock lock];
+  [appsByExtension removeAllObjects];
+  [lock unlock];
+}
+
+@end
@@ -0,0 +1,33 @@
+/* FSNViewerPrefsStore.h
+ *
+ * Protocol through which FSNode views keep their per-folder settings
+ * (icon size, label size, icon position, info type) without knowing where
+ * they are kept.  The Workspace application registers an indexed store on
+ * FSNodeRep at startup, so the settings of the thousands of folders a user
+ * ever opened stay out of the user defaults domain every GNUstep app
+ * loads; when none is set, they are kept in the user defaults as before.
+ *
+ * The settings of a folder are one dictionary under its viewer key,
+ * "viewer_at_<path>", shared with the viewer the folder is shown in.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_VIEWER_PREFS_STORE_H
+#define FSN_VIEWER_PREFS_STORE_H
+
+#import <Foundation/Foundation.h>
+
+@protocol FSNViewerPrefsStore <NSObject>
+
+/* The dictionary stored under `key`, nil when there is none. */
+- (NSDictionary *)viewerPrefsForKey:(NSString *)key;
+
+/* Stores `prefs` under `key`, replacing what was there; nil removes it.
+ * Writes may be batched, a read sees them at once. */
+- (void)setViewerPrefs:(NSDictionary *)prefs
+                forKey:(NSString *)key;
+
+@end
+
+#endif /* FSN_VIEWER_PREFS_STORE_H */
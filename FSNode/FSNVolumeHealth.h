@@ -0,0 +1,71 @@
+/* FSNVolumeHealth.h
+ *
+ * File system calls with a time limit on network and FUSE volumes.
+ *
+ * A metadata call on an sshfs, NFS or SMB volume whose server went away
+ * blocks in the kernel, often for minutes.  On the main thread that is a
+ * frozen Workspace.  The calls FSNode and FSNodeRep make for a path on a
+ * volume that FSNMountTable reports as network go through
+ * -resultOfCall:forPath:timedOut:, which runs them on a worker thread and
+ * waits at most the call timeout; paths on local volumes are called
+ * directly, at the cost of one lookup among the network mount points.
+ *
+ * A call that times out keeps running on its worker until the kernel
+ * gives up and its result is dropped; so the call must only use what it
+ * retains or copies.  After FSN_VOLUME_MAX_TIMEOUTS timeouts in a row the
+ * volume is unresponsive: calls for it fail at once, and the mount point
+ * is probed in the background every FSN_VOLUME_PROBE_INTERVAL seconds
+ * until it answers.  Every change of state is posted on the main thread
+ * as FSNVolumeHealthDidChangeNotification, with the mount point as the
+ * object, so that the views can dim the volume.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSN_VOLUME_HEALTH_H
+#define FSN_VOLUME_HEALTH_H
+
+#import <Foundation/Foundation.h>
+#import "FSNDirectorySnapshot.h"
+
+#define FSN_VOLUME_MAX_TIMEOUTS 3
+#define FSN_VOLUME_PROBE_INTERVAL 10.0
+
+extern NSString *FSNVolumeHealthDidChangeNotification;
+
+@interface FSNVolumeHealth : NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *volumes;     /* mount point -> FSNVolumeState */
+  NSArray *remoteMountPoints;
+  unsigned long tableGeneration;
+  NSTimeInterval callTimeout;
+}
+
++ (FSNVolumeHealth *)sharedHealth;
+
+/* The mount point of the network volume holding `path`, or nil. */
+- (NSString *)remoteMountPointForPath:(NSString *)path;
+
+- (BOOL)isUnresponsiveVolumeAtPath:(NSString *)path;
+
+/* Seconds; from the "FSNVolumeCallTimeout" default, 2 without it. */
+- (NSTimeInterval)callTimeout;
+
+- (void)setCallTimeout:(NSTimeInterval)seconds;
+
+/* Returns what `call` returns.  `timedOut` is set when the call did not
+ * return in time or was not made because the volume is unresponsive;
+ * the result is then nil. */
+- (id)resultOfCall:(id (^)(void))call
+           forPath:(NSString *)path
+          timedOut:(BOOL *)timedOut;
+
+@end
+
+/* FSNStatInfoForPath() and FSNStatInfoForPathTraversingLink() through
+ * -resultOfCall:forPath:timedOut:.  `timedOut` may be NULL. */
+BOOL FSNVolumeStatInfoForPath(NSString *path, FSNStatInfo *info,
+                              BOOL traverseLink, BOOL *timedOut);
+
+#endif /* FSN_VOLUME_HEALTH_H */
@@ -0,0 +1,413 @@
+/* FSNVolumeHealth.m
+ *
+ * File system calls with a time limit on network and FUSE volumes.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <dispatch/dispatch.h>
+#import "FSNVolumeHealth.h"
+#import "FSNMountTable.h"
+#import "FSNFunctions.h"
+
+#define DEFAULT_CALL_TIMEOUT 2.0
+/* calls left blocked on one volume before the next ones fail at once,
+   so a dead server does not tie up every worker */
+#define MAX_PENDING_CALLS 4
+
+NSString *FSNVolumeHealthDidChangeNotification = @"FSNVolumeHealthDidChangeNotification";
+
+static FSNVolumeHealth *sharedHealth = nil;
+
+
+@interface FSNVolumeState : NSObject
+{
+@public
+  NSString *mountPoint;
+  NSUInteger timeouts;
+  NSUInteger pending;
+  BOOL unresponsive;
+  BOOL probing;
+  NSTimeInterval lastProbe;
+}
+@end
+
+@implementation FSNVolumeState
+
+- (void)dealloc
+{
+  RELEASE (mountPoint);
+  [super dealloc];
+}
+
+@end
+
+
+/* Shared between a call and its worker; whoever is last releases it. */
+@interface FSNVolumeCall : NSObject
+{
+@public
+  id result;
+  BOOL done;
+  BOOL abandoned;
+}
+@end
+
+@implementation FSNVolumeCall
+
+- (void)dealloc
+{
+  RELEASE (result);
+  [super dealloc];
+}
+
+@end
+
+
+@interface FSNVolumeHealth (Private)
+- (FSNVolumeState *)stateForMountPoint:(NSString *)mpoint;
+- (BOOL)mayCallVolume:(FSNVolumeState *)vol;
+- (void)probeVolume:(FSNVolumeState *)vol;
+- (void)volume:(FSNVolumeState *)vol didAnswer:(BOOL)answered;
+- (void)postChangeForMountPoint:(NSString *)mpoint;
+@end
+
+
+@implementation FSNVolumeHealth
+
++ (FSNVolumeHealth *)sharedHealth
+{
+  if (sharedHealth == nil)
+    {
+      sharedHealth = [FSNVolumeHealth new];
+    }
+  return sharedHealth;
+}
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (volumes);
+  RELEASE (remoteMountPoints);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+      id entry = [defaults objectForKey: @"FSNVolumeCallTimeout"];
+
+      lock = [NSLock new];
+      volumes = [NSMutableDictionary new];
+      remoteMountPoints = [NSArray new];
+      tableGeneration = 0;
+      callTimeout = entry ? [entry doubleValue] : DEFAULT_CALL_TIMEOUT;
+
+      if (callTimeout <= 0.0)
+        callTimeout = DEFAULT_CALL_TIMEOUT;
+    }
+
+  return self;
+}
+
+- (NSString *)remoteMountPointForPath:(NSString *)path
+{
+  FSNMountTable *table = [FSNMountTable sharedTable];
+  NSString *found = nil;
+  NSArray *mpoints;
+  NSUInteger i;
+
+  if ((path == nil) || ([table isAvailable] == NO))
+    return nil;
+
+  [lock lock];
+
+  if ([table generation] != tableGeneration)
+    {
+      NSArray *entries = [table entries];
+      NSMutableArray *remote = [NSMutableArray array];
+
+      for (i = 0; i < [entries count]; i++)
+        {
+          FSNMountEntry *entry = [entries objectAtIndex: i];
+
+          if ([entry isNetwork])
+            [remote addObject: [entry mountPoint]];
+        }
+
+      ASSIGN (remoteMountPoints, remote);
+      tableGeneration = [table generation];
+    }
+
+  mpoints = RETAIN (remoteMountPoints);
+  [lock unlock];
+
+  /* nested network mounts: the deepest one holds the path */
+  for (i = 0; i < [mpoints count]; i++)
+    {
+      NSString *mpoint = [mpoints objectAtIndex: i];
+
+      if (([path isEqual: mpoint] || isSubpathOfPath(mpoint, path))
+          && ((found == nil) || ([mpoint length] > [found length])))
+        found = mpoint;
+    }
+
+  RELEASE (mpoints);
+
+  return found;
+}
+
+- (BOOL)isUnresponsiveVolumeAtPath:(NSString *)path
+{
+  NSString *mpoint = [self remoteMountPointForPath: path];
+  BOOL unresponsive = NO;
+
+  if (mpoint)
+    {
+      [lock lock];
+      unresponsive = [self stateForMountPoint: mpoint]->unresponsive;
+      [lock unlock];
+    }
+
+  return unresponsive;
+}
+
+- (NSTimeInterval)callTimeout
+{
+  return callTimeout;
+}
+
+- (void)setCallTimeout:(NSTimeInterval)seconds
+{
+  if (seconds > 0.0)
+    callTimeout = seconds;
+}
+
+- (id)resultOfCall:(id (^)(void))call
+           forPath:(NSString *)path
+          timedOut:(BOOL *)timedOut
+{
+  NSString *mpoint = [self remoteMountPointForPath: path];
+  FSNVolumeState *vol;
+  FSNVolumeCall *vcall;
+  dispatch_semaphore_t sem;
+  id (^work)(void);
+  id result = nil;
+  BOOL expired;
+
+  if (timedOut)
+    *timedOut = NO;
+
+  if (mpoint == nil)
+    return call();
+
+  [lock lock];
+  vol = [self stateForMountPoint: mpoint];
+
+  if ([self mayCallVolume: vol] == NO)
+    {
+      [lock unlock];
+      if (timedOut)
+        *timedOut = YES;
+      return nil;
+    }
+
+  vol->pending++;
+  [lock unlock];
+
+  vcall = [FSNVolumeCall new];
+  sem = dispatch_semaphore_create(0);
+  /* one reference for the worker, released when it is done */
+  dispatch_retain(sem);
+  work = [call copy];
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    CREATE_AUTORELEASE_POOL(arp);
+    id r = work();
+
+    [lock lock];
+    vcall->done = YES;
+    vol->pending--;
+    if (vcall->abandoned == NO)
+      vcall->result = RETAIN (r);
+    [lock unlock];
+
+    RELEASE (arp);
+    dispatch_semaphore_signal(sem);
+    dispatch_release(sem);
+  });
+
+  expired = (dispatch_semaphore_wait(sem, dispatch_time(DISPATCH_TIME_NOW,
+                                     (int64_t)(callTimeout * NSEC_PER_SEC))) != 0);
+
+  [lock lock];
+  if (expired && (vcall->done == NO))
+    {
+      vcall->abandoned = YES;
+    }
+  else
+    {
+      expired = NO;
+      result = AUTORELEASE (vcall->result);
+      vcall->result = nil;
+    }
+  [lock unlock];
+
+  [self volume: vol didAnswer: (expired == NO)];
+
+  dispatch_release(sem);
+  RELEASE (work);
+  RELEASE (vcall);
+
+  if (timedOut)
+    *timedOut = expired;
+
+  return result;
+}
+
+@end
+
+
+@implementation FSNVolumeHealth (Private)
+
+/* with the lock held */
+- (FSNVolumeState *)stateForMountPoint:(NSString *)mpoint
+{
+  FSNVolumeState *vol = [volumes objectForKey: mpoint];
+
+  if (vol == nil)
+    {
+      vol = [FSNVolumeState new];
+      vol->mountPoint = [mpoint copy];
+      [volumes setObject: vol forKey: mpoint];
+      RELEASE (vol);
+    }
+
+  return vol;
+}
+
+/* with the lock held */
+- (BOOL)mayCallVolume:(FSNVolumeState *)vol
+{
+  if (vol->unresponsive)
+    {
+      [self probeVolume: vol];
+      return NO;
+    }
+
+  return (vol->pending < MAX_PENDING_CALLS);
+}
+
+/* with the lock held.  The probe waits on its worker for as long as the
+   kernel takes, so nobody waits for it. */
+- (void)probeVolume:(FSNVolumeState *)vol
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSString *mpoint;
+
+  if (vol->probing || ((now - vol->lastProbe) < FSN_VOLUME_PROBE_INTERVAL))
+    return;
+
+  vol->probing = YES;
+  vol->lastProbe = now;
+  mpoint = vol->mountPoint;
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+    CREATE_AUTORELEASE_POOL(arp);
+    FSNStatInfo info;
+    BOOL answered = FSNStatInfoForPathTraversingLink(mpoint, &info);
+
+    [lock lock];
+    vol->probing = NO;
+    vol->lastProbe = [NSDate timeIntervalSinceReferenceDate];
+    [lock unlock];
+
+    if (answered)
+      [self volume: vol didAnswer: YES];
+
+    RELEASE (arp);
+  });
+}
+
+- (void)volume:(FSNVolumeState *)vol didAnswer:(BOOL)answered
+{
+  BOOL changed = NO;
+
+  [lock lock];
+
+  if (answered)
+    {
+      vol->timeouts = 0;
+      changed = vol->unresponsive;
+      vol->unresponsive = NO;
+    }
+  else if (vol->unresponsive == NO)
+    {
+      vol->timeouts++;
+      if (vol->timeouts >= FSN_VOLUME_MAX_TIMEOUTS)
+        {
+          vol->unresponsive = YES;
+          vol->lastProbe = [NSDate timeIntervalSinceReferenceDate];
+          changed = YES;
+        }
+    }
+
+  [lock unlock];
+
+  if (changed)
+    {
+      NSLog(@"%@ is %@", vol->mountPoint,
+            answered ? @"responding again" : @"not responding");
+      [self performSelectorOnMainThread: @selector(postChangeForMountPoint:)
+                             withObject: vol->mountPoint
+                          waitUntilDone: NO];
+    }
+}
+
+- (void)postChangeForMountPoint:(NSString *)mpoint
+{
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName: FSNVolumeHealthDidChangeNotification
+                  object: mpoint];
+}
+
+@end
+
+
+BOOL
+FSNVolumeStatInfoForPath(NSString *path, FSNStatInfo *info,
+                         BOOL traverseLink, BOOL *timedOut)
+{
+  FSNVolumeHealth *health = [FSNVolumeHealth sharedHealth];
+  NSData *data;
+
+  if ([health remoteMountPointForPath: path] == nil)
+    {
+      if (timedOut)
+        *timedOut = NO;
+
+      return traverseLink ? FSNStatInfoForPathTraversingLink(path, info)
+                          : FSNStatInfoForPath(path, info);
+    }
+
+  /* the record is copied out: `info` may be gone when a late call ends */
+  data = [health resultOfCall: ^id (void) {
+      FSNStatInfo st;
+      BOOL found = traverseLink ? FSNStatInfoForPathTraversingLink(path, &st)
+                                : FSNStatInfoForPath(path, &st);
+
+      return found ? [NSData dataWithBytes: &st length: sizeof(st)] : nil;
+    }
+                      forPath: path
+                     timedOut: timedOut];
+
+  if (data == nil)
+    return NO;
+
+  [data getBytes: info length: sizeof(FSNStatInfo)];
+  return YES;
+}
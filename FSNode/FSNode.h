@@ -27,6 +27,7 @@
 #define FSNODE_H
 
 #import <Foundation/Foundation.h>
+#import "FSNDirectorySnapshot.h"
 
 @class NSImage;
 @class NSBezierPath;
@@ -35,25 +36,30 @@
 @interface FSNode : NSObject 
 {
   FSNode *parent;
-  NSString *path;
+  NSString *parentPath;     /* the parent's own string, shared by siblings */
+  NSString *path;           /* built from it on first use */
   NSString *relativePath;
   NSString *lastPathComponent;
   NSString *name;
-  NSDictionary *attributes;
+  FSNStatInfo statInfo;     /* tiered: see FSNLoadTier */
+  BOOL hasStatInfo;
+  BOOL placeholder;         /* its volume did not answer the stat in time */
   NSString *fileType;
   NSString *typeDescription;
   NSString *application;
     
   unsigned long long filesize;
   NSDate *crDate;
-  NSString *crDateDescription;
   NSDate *modDate;
-  NSString *modDateDescription;
   unsigned long permissions;
   NSString *owner;
   NSNumber *ownerId;
   NSString *group;
   NSNumber *groupId;
+  NSData *nameSortKey;
+  NSData *extensionSortKey;
+  NSUInteger kindIdentifier;
+  BOOL shared;              /* was entered in the table of shared nodes */
   
   struct nodeFlags {
     int readable;
@@ -83,13 +89,37 @@
 + (FSNode *)nodeWithRelativePath:(NSString *)rpath
                           parent:(FSNode *)aparent;
 
++ (FSNode *)nodeWithRelativePath:(NSString *)rpath
+                          parent:(FSNode *)aparent
+                        statInfo:(const FSNStatInfo *)info;
+
 - (id)initWithRelativePath:(NSString *)rpath
                     parent:(FSNode *)aparent;
 
+/* Designated initializer.  When `info` is not NULL (a record from an
+ * FSNDirectorySnapshot) the node takes its attributes from it instead of
+ * reading them from disk. */
+- (id)initWithRelativePath:(NSString *)rpath
+                    parent:(FSNode *)aparent
+                  statInfo:(const FSNStatInfo *)info;
+
 - (BOOL)isEqualToNode:(FSNode *)anode;
 
+/* How much of the node's attributes has been loaded so far. */
+- (FSNLoadTier)loadTier;
+
+/* Raises the node to FSNLoadTierStat.  Returns NO if the file is gone. */
+- (BOOL)loadStatTier;
+
 - (NSArray *)subNodes;
 
+/* Subnodes loaded only up to `tier`; -subNodes uses the FSNodeRep
+ * default tier.  Fields beyond the tier are fetched on first access. */
+- (NSArray *)subNodesWithTier:(FSNLoadTier)tier;
+
+/* Subnodes filled from an already taken snapshot of this node's path. */
+- (NSArray *)subNodesFromSnapshot:(FSNDirectorySnapshot *)snapshot;
+
 - (NSArray *)subNodeNames;
 
 - (NSArray *)subNodesOfParent;
@@ -218,6 +248,11 @@
 
 - (BOOL)hasValidPath;
 
+/* YES while the stat of a node on a network volume has not answered in
+ * time; the node is shown, without attributes, and stats again when it
+ * is asked whether it is valid or for its attributes. */
+- (BOOL)isPlaceholder;
+
 - (BOOL)isReserved;
 
 - (BOOL)willBeValidAfterFileOperation:(NSDictionary *)opinfo;
@@ -231,6 +266,17 @@
 
 @interface FSNode (Comparing)
 
+/* Byte-comparable keys (see FSNSortKeys.h), computed once per node:
+ * the name lowercased and canonically decomposed, with dot files after
+ * the others, and the lowercased path extension. */
+- (NSData *)nameSortKey;
+
+- (NSData *)extensionSortKey;
+
+/* Number of the node's kind in the shared FSNTypeResolver table; kinds
+ * are compared through -[FSNTypeResolver rankOfKind:]. */
+- (NSUInteger)kindIdentifier;
+
 - (NSComparisonResult)compareAccordingToPath:(FSNode *)aNode;
 
 - (NSComparisonResult)compareAccordingToName:(FSNode *)aNode;
@@ -29,28 +29,127 @@
 #import "FSNode.h"
 #import "FSNodeRep.h"
 #import "FSNFunctions.h"
+#import "FSNSortKeys.h"
 #import "FSNMetadataProvider.h"
+#import "FSNMountTable.h"
+#import "FSNVolumeHealth.h"
+#import "FSNTypeResolver.h"
+#import "FSNOperationPaths.h"
+#import "FSNDiagnostics.h"
+#import "FSNFormatCache.h"
+
+/* The nodes of the files on screen, by path, not retained.  Two views
+   listing the same folder, or the desktop and a search showing the same
+   file, get the same node, with its type, sort keys and icon worked out
+   once.  Only stat tier nodes are shared, so nobody gets a node whose
+   stat is older than the one just taken, and only between nodes with
+   the same parent object, which the child does not retain.  Filled and
+   looked up on the main thread; a shared node leaves the table in
+   -release, under the lock, before it can be deallocated. */
+static NSMapTable *sharedNodes = NULL;
+static NSLock *sharedNodesLock = nil;
+
+static BOOL
+sameStatInfo(const FSNStatInfo *a, const FSNStatInfo *b)
+{
+  return (a->device == b->device
+          && a->inode == b->inode
+          && a->size == b->size
+          && a->modificationTime == b->modificationTime
+          && a->changeTime == b->changeTime
+          && a->mode == b->mode
+          && a->uid == b->uid
+          && a->gid == b->gid);
+}
 
 
 @implementation FSNode
 
++ (void)initialize
+{
+  if (sharedNodes == NULL)
+    {
+      sharedNodes = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                     NSNonRetainedObjectMapValueCallBacks, 0);
+      sharedNodesLock = [NSLock new];
+    }
+}
+
+- (oneway void)release
+{
+  if (shared == NO)
+    {
+      [super release];
+      return;
+    }
+
+  [sharedNodesLock lock];
+
+  if (NSDecrementExtraRefCountWasZero(self))
+    {
+      if (NSMapGet(sharedNodes, path) == self)
+        NSMapRemove(sharedNodes, path);
+      [sharedNodesLock unlock];
+      [self dealloc];
+      return;
+    }
+
+  [sharedNodesLock unlock];
+}
+
+/* The node already standing for this file, retained, or self after
+   entering it in the table. */
+- (FSNode *)sharedNode
+{
+  FSNode *other;
+
+  [sharedNodesLock lock];
+
+  other = NSMapGet(sharedNodes, [self path]);
+
+  if (other && (other->parent == parent)
+      && other->hasStatInfo && (other->placeholder == NO)
+      && (other->statInfo.tier >= FSNLoadTierStat)
+      && sameStatInfo(&other->statInfo, &statInfo))
+    {
+      RETAIN (other);
+    }
+  else
+    {
+      NSMapInsert(sharedNodes, path, self);
+      shared = YES;
+      other = self;
+    }
+
+  [sharedNodesLock unlock];
+
+  return other;
+}
+
++ (id)allocWithZone:(NSZone *)zone
+{
+  FSNLiveCounterAdd(FSNLiveNodes, 1);
+  return [super allocWithZone: zone];
+}
+
 - (void)dealloc
 {
+  FSNLiveCounterAdd(FSNLiveNodes, -1);
+  RELEASE (parentPath);
   RELEASE (path);
   RELEASE (relativePath);
   RELEASE (lastPathComponent);
   RELEASE (name);  
-  RELEASE (attributes);  
   RELEASE (fileType);
   RELEASE (typeDescription);
   RELEASE (crDate);
-  RELEASE (crDateDescription);
   RELEASE (modDate);
-  RELEASE (modDateDescription);
   RELEASE (owner);
   RELEASE (ownerId);
   RELEASE (group);
   RELEASE (groupId);
+  RELEASE (nameSortKey);
+  RELEASE (extensionSortKey);
 
   [super dealloc];
 }
@@ -67,8 +166,24 @@
                                                     parent: aparent]);
 }
 
++ (FSNode *)nodeWithRelativePath:(NSString *)rpath
+                          parent:(FSNode *)aparent
+                        statInfo:(const FSNStatInfo *)info
+{
+  return AUTORELEASE ([[FSNode alloc] initWithRelativePath: rpath 
+                                                    parent: aparent
+                                                  statInfo: info]);
+}
+
+- (id)initWithRelativePath:(NSString *)rpath
+                    parent:(FSNode *)aparent
+{
+  return [self initWithRelativePath: rpath parent: aparent statInfo: NULL];
+}
+
 - (id)initWithRelativePath:(NSString *)rpath
                     parent:(FSNode *)aparent
+                  statInfo:(const FSNStatInfo *)info
 {    
   self = [super init];
     
@@ -80,24 +195,19 @@
 
       parent = aparent;
       ASSIGN (relativePath, rpath);
-      lastPathComponent = [[relativePath lastPathComponent] retain];
+
+      if ([rpath rangeOfString: path_separator()].location == NSNotFound)
+        lastPathComponent = [rpath retain];
+      else
+        lastPathComponent = [[rpath lastPathComponent] retain];
+
       name = nil;
-    
+      path = nil;
+
       if (parent)
-        {
-          NSString *parentPath = [parent path];
-      
-          if ([parentPath isEqual: path_separator()])
-            {
-              parentPath = @"";
-            }
-          ASSIGN (path, ([NSString stringWithFormat: @"%@%@%@",
-                                   parentPath, path_separator(), lastPathComponent]));
-        }
+        ASSIGN (parentPath, [parent path]);
       else
-        {
-          ASSIGN (path, relativePath);
-        }
+        ASSIGN (path, relativePath);
         
       flags.readable = -1;
       flags.writable = -1;
@@ -129,8 +239,30 @@
     
       application = nil;
                                       
-      attributes = [fm fileAttributesAtPath: path traverseLink: NO];
-      RETAIN (attributes);
+      placeholder = NO;
+
+      if (info)
+        {
+          statInfo = *info;
+          hasStatInfo = YES;
+        }
+      else
+        {
+          hasStatInfo = FSNVolumeStatInfoForPath([self path], &statInfo, NO, &placeholder);
+        }
+
+      if (hasStatInfo && (placeholder == NO)
+          && (statInfo.tier >= FSNLoadTierStat)
+          && ([self class] == [FSNode class]) && [NSThread isMainThread])
+        {
+          FSNode *other = [self sharedNode];
+
+          if (other != self)
+            {
+              RELEASE (self);
+              return other;
+            }
+        }
 
       /* we localize only directories which could be special */
       if ([self isDirectory])
@@ -142,9 +274,69 @@
   return self;
 }
 
+- (FSNLoadTier)loadTier
+{
+  if (hasStatInfo == NO)
+    return FSNLoadTierType;
+  if ((owner != nil) || (group != nil))
+    return FSNLoadTierOwner;
+  return statInfo.tier;
+}
+
+/* Stats a placeholder again; its type flags were computed without a
+   type, so they are dropped too. */
+- (void)resolvePlaceholder
+{
+  BOOL timedOut;
+
+  hasStatInfo = FSNVolumeStatInfoForPath([self path], &statInfo, NO, &timedOut);
+
+  if (timedOut == NO)
+    {
+      placeholder = NO;
+      DESTROY (fileType);
+      flags.plain = -1;
+      flags.directory = -1;
+      flags.link = -1;
+      flags.socket = -1;
+      flags.charspecial = -1;
+      flags.blockspecial = -1;
+      flags.mountpoint = -1;
+      flags.application = -1;
+      flags.package = -1;
+      flags.unknown = -1;
+    }
+}
+
+- (BOOL)isPlaceholder
+{
+  return placeholder;
+}
+
+- (BOOL)loadStatTier
+{
+  if (placeholder)
+    [self resolvePlaceholder];
+
+  if (hasStatInfo && (statInfo.tier < FSNLoadTierStat))
+    {
+      FSNStatInfo info;
+
+      /* Only the dirent type was known; fetch the rest now.  If the file
+       * vanished meanwhile, or its volume does not answer, the node keeps
+       * its type and stays valid until the next refresh, like a node
+       * whose attributes went stale. */
+      if (FSNVolumeStatInfoForPath([self path], &info, NO, NULL))
+        statInfo = info;
+      else
+        return NO;
+    }
+  return hasStatInfo;
+}
+
 - (NSUInteger)hash
 {
-  return [path hash];
+  return [[self path] hash];
 }
 
 - (BOOL)isEqual:(id)other
@@ -164,20 +356,32 @@
     {
       return YES;
     }
-  return [path isEqualToString: [anode path]];
+  return [[self path] isEqualToString: [anode path]];
 }
 
 - (NSArray *)subNodes 
+{
+  return [self subNodesFromSnapshot: [fsnodeRep directorySnapshotAtPath: [self path]]];
+}
+
+- (NSArray *)subNodesWithTier:(FSNLoadTier)tier
+{
+  return [self subNodesFromSnapshot: [fsnodeRep directorySnapshotAtPath: [self path]
+                                                                   tier: tier]];
+}
+
+- (NSArray *)subNodesFromSnapshot:(FSNDirectorySnapshot *)snapshot
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSMutableArray *nodes = [NSMutableArray array];
-  NSArray *fnames = [fsnodeRep directoryContentsAtPath: path];
+  NSUInteger count = [snapshot count];
+  NSMutableArray *nodes = [NSMutableArray arrayWithCapacity: count];
   NSUInteger i;
 
-  for (i = 0; i < [fnames count]; i++)
+  for (i = 0; i < count; i++)
     {
-      NSString *fname = [fnames objectAtIndex: i];
-      FSNode *node = [[FSNode alloc] initWithRelativePath: fname parent: self];
+      FSNode *node = [[FSNode alloc] initWithRelativePath: [snapshot nameAtIndex: i]
+                                                   parent: self
+                                                 statInfo: [snapshot statInfoAtIndex: i]];
 
       [nodes addObject: node];
       RELEASE (node);
@@ -191,14 +395,15 @@
 
 - (NSArray *)subNodeNames 
 {
-  return [fsnodeRep directoryContentsAtPath: path];
+  return [fsnodeRep directoryContentsAtPath: [self path]];
 }
 
 - (NSArray *)subNodesOfParent
 {
   CREATE_AUTORELEASE_POOL(arp);
   NSMutableArray *nodes = [NSMutableArray array];
-  NSArray *fnames = [fsnodeRep directoryContentsAtPath: [self parentPath]];
+  FSNDirectorySnapshot *snap = [fsnodeRep directorySnapshotAtPath: [self parentPath]];
+  NSUInteger count = [snap count];
   FSNode *pnd = nil;
   NSUInteger i;
   
@@ -206,9 +411,12 @@
     pnd = [parent parent];
   }
   
-  for (i = 0; i < [fnames count]; i++) {
-    NSString *fname = [fnames objectAtIndex: i];
-    FSNode *node = [[FSNode alloc] initWithRelativePath: fname parent: pnd];
+  for (i = 0; i < count; i++) {
+    NSString *fname = [snap nameAtIndex: i];
+    const FSNStatInfo *info = (pnd != nil) ? [snap statInfoAtIndex: i] : NULL;
+    FSNode *node = [[FSNode alloc] initWithRelativePath: fname 
+                                                 parent: pnd
+                                               statInfo: info];
 
     [nodes addObject: node];
     RELEASE (node);
@@ -423,7 +631,7 @@
 
 - (NSString *)parentPath
 {
-  return [path stringByDeletingLastPathComponent];
+  return [[self path] stringByDeletingLastPathComponent];
 }
 
 - (NSString *)parentName
@@ -433,26 +641,47 @@
 
 - (BOOL)isSubnodeOfNode:(FSNode *)anode
 {
-  return isSubpathOfPath([anode path], path);
+  return isSubpathOfPath([anode path], [self path]);
 }
 
 - (BOOL)isSubnodeOfPath:(NSString *)apath
 {
-  return isSubpathOfPath(apath, path);
+  return isSubpathOfPath(apath, [self path]);
 }
 
 - (BOOL)isParentOfNode:(FSNode *)anode
 {
-  return isSubpathOfPath(path, [anode path]);
+  return isSubpathOfPath([self path], [anode path]);
 }
 
 - (BOOL)isParentOfPath:(NSString *)apath
 {
-  return isSubpathOfPath(path, apath);
+  return isSubpathOfPath([self path], apath);
 }
 
 - (NSString *)path
 {
+  if (path == nil)
+    {
+      BOOL root = [parentPath isEqual: path_separator()];
+      NSMutableString *mpath;
+      NSString *built;
+      NSString *expected = nil;
+
+      mpath = [[NSMutableString alloc] initWithCapacity: [parentPath length] + [lastPathComponent length] + 1];
+      [mpath appendString: parentPath];
+      if (root == NO)
+        [mpath appendString: path_separator()];
+      [mpath appendString: lastPathComponent];
+      built = [mpath copy];
+      RELEASE (mpath);
+
+      /* a node can be asked from two threads at once */
+      if (__atomic_compare_exchange_n(&path, &expected, built, NO,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) == NO)
+        RELEASE (built);
+    }
+
   return path;
 }
 
@@ -486,8 +715,10 @@
 
 - (NSString *)fileType
 {
-  if (attributes && (fileType == nil)) {
-    ASSIGN (fileType, [attributes fileType]);
+  if (fileType == nil) {
+    if (hasStatInfo) {
+      ASSIGN (fileType, FSNFileTypeForStatMode(statInfo.mode));
+    }
   }
   return (fileType ? fileType : (NSString *)[NSString string]);
 }
@@ -524,7 +755,9 @@
     } else if (fileType == NSFileTypeDirectory) {
 	    NSString *defApp = nil, *type = nil;
 
-	    [ws getInfoForFile: path application: &defApp type: &type]; 
+	    [[FSNTypeResolver sharedResolver] getInfoForDirectoryAtPath: [self path]
+                                                      application: &defApp
+                                                             type: &type];
       
       if (defApp) {
         ASSIGN (application, defApp);
@@ -538,9 +771,9 @@
          * directories with a .app suffix as apps. Also reject
          * directories that contain a GNUmakefile at the root (likely
          * a source tree, not a built bundle). */
-        NSString *plistPath = [path stringByAppendingPathComponent: @"Resources/Info.plist"];
-        NSString *gnustepPlistPath = [path stringByAppendingPathComponent: @"Resources/Info-gnustep.plist"];
-        NSString *makefilePath = [path stringByAppendingPathComponent: @"GNUmakefile"];
+        NSString *plistPath = [[self path] stringByAppendingPathComponent: @"Resources/Info.plist"];
+        NSString *gnustepPlistPath = [[self path] stringByAppendingPathComponent: @"Resources/Info-gnustep.plist"];
+        NSString *makefilePath = [[self path] stringByAppendingPathComponent: @"GNUmakefile"];
         BOOL hasPlist = ([fm fileExistsAtPath: plistPath] || [fm fileExistsAtPath: gnustepPlistPath]);
         BOOL hasMakefile = [fm fileExistsAtPath: makefilePath];
         if (hasPlist && !hasMakefile) {
@@ -555,7 +788,7 @@
       }
 
     } else if (fileType == NSFileTypeSymbolicLink) {
-      NSDictionary *attrs = [fm fileAttributesAtPath: path traverseLink: YES];
+      NSDictionary *attrs = [fm fileAttributesAtPath: [self path] traverseLink: YES];
 
       if (attrs) {
         [self setFlagsForSymLink: attrs];
@@ -586,7 +819,9 @@
   } else if (ftype == NSFileTypeDirectory) {
 	  NSString *defApp = nil, *type = nil;
 
-	  [ws getInfoForFile: path application: &defApp type: &type]; 
+	  [[FSNTypeResolver sharedResolver] getInfoForDirectoryAtPath: [self path]
+                                                    application: &defApp
+                                                           type: &type];
       
     if (defApp) {
       ASSIGN (application, defApp);
@@ -600,9 +835,9 @@
          * directories with a .app suffix as apps. Also reject
          * directories that contain a GNUmakefile at the root (likely
          * a source tree, not a built bundle). */
-        NSString *plistPath = [path stringByAppendingPathComponent: @"Resources/Info.plist"];
-        NSString *gnustepPlistPath = [path stringByAppendingPathComponent: @"Resources/Info-gnustep.plist"];
-        NSString *makefilePath = [path stringByAppendingPathComponent: @"GNUmakefile"];
+        NSString *plistPath = [[self path] stringByAppendingPathComponent: @"Resources/Info.plist"];
+        NSString *gnustepPlistPath = [[self path] stringByAppendingPathComponent: @"Resources/Info-gnustep.plist"];
+        NSString *makefilePath = [[self path] stringByAppendingPathComponent: @"GNUmakefile"];
         BOOL hasPlist = ([fm fileExistsAtPath: plistPath] || [fm fileExistsAtPath: gnustepPlistPath]);
         BOOL hasMakefile = [fm fileExistsAtPath: makefilePath];
         if (hasPlist && !hasMakefile) {
@@ -619,7 +854,7 @@
       } 
 
     } else if (ftype == NSFileTypeSymbolicLink) {
-      attrs = [fm fileAttributesAtPath: path traverseLink: YES];
+      attrs = [fm fileAttributesAtPath: [self path] traverseLink: YES];
     if (attrs) {
       [self setFlagsForSymLink: attrs];
     }
@@ -633,34 +868,34 @@
     flags.unknown = 1;
   } 
 
-  ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"symbolic link", nil, [NSBundle bundleForClass:[self class]], @""));
+  ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"symbolic link"]);
 }
 
 - (NSString *)typeDescription
 {
   if (typeDescription == nil) {
     if ([self isPlain]) {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"plain file", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"plain file"]);
     } else if ([self isDirectory]) {
       if ([self isApplication]) {
-        ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"application", nil, [NSBundle bundleForClass:[self class]], @""));
+        ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"application"]);
       } else if ([self isPackage]) {
-        ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"package", nil, [NSBundle bundleForClass:[self class]], @""));
+        ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"package"]);
       } else if ([self isMountPoint]) {
-        ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"mount point", nil, [NSBundle bundleForClass:[self class]], @""));
+        ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"mount point"]);
       } else {
-        ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"directory", nil, [NSBundle bundleForClass:[self class]], @""));
+        ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"directory"]);
       }
     } else if ([self isLink]) {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"symbolic link", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"symbolic link"]);
     } else if ([self isSocket]) {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"socket", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"socket"]);
     } else if ([self isCharspecial]) {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"character special", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"character special"]);
     } else if ([self isBlockspecial]) {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"block special", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"block special"]);
     } else {
-      ASSIGN (typeDescription, NSLocalizedStringFromTableInBundle(@"unknown", nil, [NSBundle bundleForClass:[self class]], @""));
+      ASSIGN (typeDescription, [[FSNTypeResolver sharedResolver] typeDescriptionForKey: @"unknown"]);
     }
   }
 
@@ -669,58 +904,42 @@
 
 - (NSDate *)creationDate
 {
-  if (attributes && (crDate == nil)) {
-    ASSIGN (crDate, [attributes fileCreationDate]);
+  if (crDate == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (crDate, [NSDate dateWithTimeIntervalSince1970: statInfo.changeTime]);
+    }
   }
   return (crDate ? crDate : (NSDate *)[NSDate date]);
 }
 
+/* Formatted through the shared caches each time they are asked for, so
+   a listing keeps no strings for the rows it never shows. */
 - (NSString *)crDateDescription
 {
-  NSDate *date = [self creationDate];
-  
-  if (date) {
-    if (crDateDescription == nil) {
-      NSString *descr = [date descriptionWithCalendarFormat: @"%b %d %Y" 
-                            timeZone: [NSTimeZone localTimeZone] locale: nil];
-
-      ASSIGN (crDateDescription, descr);   
-    }
-
-    return crDateDescription;
-  }
-
-  return [NSString string];
+  return FSNDateDescription([[self creationDate] timeIntervalSince1970], NO);
 }
 
 - (NSDate *)modificationDate
 {
-  if (attributes && (modDate == nil)) {
-    ASSIGN (modDate, [attributes fileModificationDate]);
+  if (modDate == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (modDate, [NSDate dateWithTimeIntervalSince1970: statInfo.modificationTime]);
+    }
   }
   return (modDate ? modDate : (NSDate *)[NSDate date]);
 }
 
 - (NSString *)modDateDescription
 {
-  NSDate *date = [self modificationDate];
-
-  if (date) {
-    if (modDateDescription == nil) {
-      NSString *descr = [date descriptionWithCalendarFormat: @"%b %d %Y %H:%M" 
-                            timeZone: [NSTimeZone localTimeZone] locale: nil];
-      ASSIGN (modDateDescription, descr);   
-    }
-    return modDateDescription;
-  }
-
-  return [NSString string];
+  return FSNDateDescription([[self modificationDate] timeIntervalSince1970], YES);
 }
 
 - (unsigned long long)fileSize
 {
-  if ((filesize == 0) && attributes) {
-    filesize = [attributes fileSize];
+  if (filesize == 0) {
+    if ([self loadStatTier]) {
+      filesize = statInfo.size;
+    }
   }
   return filesize;
 }
@@ -728,50 +947,55 @@
 
 - (NSString *)sizeDescription
 {
-  unsigned long long fsize = [self fileSize];
-  NSString *sizeStr;
-
-  sizeStr = sizeDescription(fsize);
-    
-  return sizeStr;
+  return FSNSizeDescription([self fileSize]);
 }
 
 - (NSString *)owner
 {
-  if (attributes && (owner == nil)) {
-    ASSIGN (owner, [attributes fileOwnerAccountName]);
+  if (owner == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (owner, FSNUserNameForUID(statInfo.uid));
+    }
   }
   return (owner ? owner : (NSString *)[NSString string]);
 }
 
 - (NSNumber *)ownerId
 {
-  if (attributes && (ownerId == nil)) {
-    ASSIGN (ownerId, [attributes objectForKey: NSFileOwnerAccountID]);
+  if (ownerId == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (ownerId, [NSNumber numberWithUnsignedLong: statInfo.uid]);
+    }
   }
   return (ownerId ? ownerId : [NSNumber numberWithInt: 0]);
 }
 
 - (NSString *)group
 {
-  if (attributes && (group == nil)) {
-    ASSIGN (group, [attributes fileGroupOwnerAccountName]);
+  if (group == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (group, FSNGroupNameForGID(statInfo.gid));
+    }
   }
   return (group ? group : (NSString *)[NSString string]);
 }
 
 - (NSNumber *)groupId
 {
-  if (attributes && (groupId == nil)) {
-    ASSIGN (groupId, [attributes objectForKey: NSFileGroupOwnerAccountID]);
+  if (groupId == nil) {
+    if ([self loadStatTier]) {
+      ASSIGN (groupId, [NSNumber numberWithUnsignedLong: statInfo.gid]);
+    }
   }
   return (groupId ? groupId : [NSNumber numberWithInt: 0]);
 }
 
 - (unsigned long)permissions
 {
-  if ((permissions == 0) && attributes) {
-    permissions = [attributes filePosixPermissions];
+  if (permissions == 0) {
+    if ([self loadStatTier]) {
+      permissions = (statInfo.mode & 07777);
+    }
   }
   return permissions;
 }
@@ -834,9 +1058,14 @@
     return YES;
   }
 
+  /* FUSE and other mounts NSWorkspace does not report */
+  if ([[FSNMountTable sharedTable] isMountPointAtPath: [self path]]) {
+    return YES;
+  }
+
   /* Also consult FSNodeRep global volumes (for e.g. FUSE mounts tracked by NetworkVolumeManager) */
   NSSet *vols = [[FSNodeRep sharedInstance] volumes];
-  if (vols && [vols containsObject: path]) {
+  if (vols && [vols containsObject: [self path]]) {
     return YES;
   }
 
@@ -867,7 +1096,7 @@
 - (BOOL)isReadable 
 {
   if (flags.readable == -1) {
-    flags.readable = [fm isReadableFileAtPath: path];
+    flags.readable = [fm isReadableFileAtPath: [self path]];
   }
   return (flags.readable ? YES : NO);
 }
@@ -875,14 +1104,14 @@
 - (BOOL)isWritable 
 {
   if (flags.writable == -1) {
-    flags.writable = [fm isWritableFileAtPath: path];
+    flags.writable = [fm isWritableFileAtPath: [self path]];
   }
   return (flags.writable ? YES : NO);
 }
 
 - (void)checkWritable
 {
-  flags.writable = [fm isWritableFileAtPath: path];
+  flags.writable = [fm isWritableFileAtPath: [self path]];
 }
 
 - (BOOL)isParentWritable
@@ -893,7 +1122,7 @@
 - (BOOL)isExecutable
 {
   if (flags.executable == -1) {
-    flags.executable = [fm isExecutableFileAtPath: path];
+    flags.executable = [fm isExecutableFileAtPath: [self path]];
   }
   return (flags.executable ? YES : NO);
 }
@@ -901,7 +1130,7 @@
 - (BOOL)isDeletable
 {
   if (flags.deletable == -1) {
-    flags.deletable = [fm isDeletableFileAtPath: path];
+    flags.deletable = [fm isDeletableFileAtPath: [self path]];
   }
   return (flags.deletable ? YES : NO);
 }
@@ -914,19 +1143,42 @@
 - (BOOL)isFinderInvisible
 {
     if ([self isPlain] || [self isDirectory])
-        return [[fsnodeRep metadataProvider] isInvisibleAtPath: path];
+        return [[fsnodeRep metadataProvider] isInvisibleAtPath: [self path]];
     return NO;
 }
 
 - (BOOL)isValid
 {
-  BOOL valid = (attributes != nil);
+  BOOL valid;
+
+  if (placeholder) {
+    [self resolvePlaceholder];
+  }
+  /* kept until its volume answers */
+  if (placeholder) {
+    return YES;
+  }
+
+  valid = hasStatInfo;
+
+  if (valid && [[FSNVolumeHealth sharedHealth] remoteMountPointForPath: [self path]]) {
+    FSNStatInfo info;
+    BOOL timedOut;
+
+    valid = FSNVolumeStatInfoForPath([self path], &info, YES, &timedOut);
 
-  if (valid) {
-    valid = [fm fileExistsAtPath: path];
+    if ((valid == NO) && (timedOut == NO) && flags.link) {
+      valid = FSNVolumeStatInfoForPath([self path], &info, NO, &timedOut);
+    }
+    if (timedOut) {
+      valid = YES;
+    }
+
+  } else if (valid) {
+    valid = [fm fileExistsAtPath: [self path]];
 
     if ((valid == NO) && flags.link) {
-      valid = ([fm fileAttributesAtPath: path traverseLink: NO] != nil);
+      valid = ([fm fileAttributesAtPath: [self path] traverseLink: NO] != nil);
     }
   }
   
@@ -935,7 +1187,13 @@
 
 - (BOOL)hasValidPath
 {
-  return [fm fileExistsAtPath: path];
+  if ([[FSNVolumeHealth sharedHealth] remoteMountPointForPath: [self path]]) {
+    FSNStatInfo info;
+    BOOL timedOut;
+
+    return (FSNVolumeStatInfoForPath([self path], &info, YES, &timedOut) || timedOut);
+  }
+  return [fm fileExistsAtPath: [self path]];
 }
 
 - (BOOL)isReserved
@@ -945,181 +1203,79 @@
 
 - (BOOL)willBeValidAfterFileOperation:(NSDictionary *)opinfo
 {
-  NSString *operation = [opinfo objectForKey: @"operation"];
-  NSString *source = [opinfo objectForKey: @"source"];
-  NSString *destination = [opinfo objectForKey: @"destination"];
-  NSArray *files = [opinfo objectForKey: @"files"];
-  NSUInteger i;
-
-  if ([operation isEqual: @"WorkspaceRenameOperation"]) {      
-    files = [NSArray arrayWithObject: [source lastPathComponent]]; 
-    source = [source stringByDeletingLastPathComponent];            
-  } 
+  FSNOperationPaths *oppaths = [FSNOperationPaths pathsForOperationInfo: opinfo];
+  NSString *srcpath;
 
   /* Unmount operations: the node will not be valid after the volume is gone */
-  if ([operation isEqual: @"UnmountOperation"]) {
-    NSString *unmountedPath = [opinfo objectForKey: @"unmounted"];
-    if (unmountedPath) {
-      if ([path isEqual: unmountedPath] || isSubpathOfPath(unmountedPath, path)) {
-        return NO;
-      }
-    }
+  if ([oppaths isUnmountedPath: [self path]]) {
+    return NO;
   }
 
-  if ([self isSubnodeOfPath: source]) {
-    if ([operation isEqual: NSWorkspaceMoveOperation]
-        || [operation isEqual: NSWorkspaceDestroyOperation]
-        || [operation isEqual: @"WorkspaceRenameOperation"]
-			  || [operation isEqual: NSWorkspaceRecycleOperation]
-			  || [operation isEqual: @"WorkspaceRecycleOutOperation"]
-			  || [operation isEqual: @"WorkspaceemptyTrashOperation"]) { 
-      for (i = 0; i < [files count]; i++) {
-        NSString *fname = [files objectAtIndex: i];
-        NSString *fpath = [source stringByAppendingPathComponent: fname];
-
-        if ([path isEqual: fpath] || [self isSubnodeOfPath: fpath]) {  
-          return NO;      
-        }
-      }
-    } 
+  if ([oppaths isRemovedPath: [self path]]) {
+    return NO;
   }
 
-  if ([self isSubnodeOfPath: destination]) {
-    if ([operation isEqual: NSWorkspaceMoveOperation]
-          || [operation isEqual: NSWorkspaceCopyOperation]
-          || [operation isEqual: NSWorkspaceLinkOperation]
-	|| [operation isEqual: NSWorkspaceRecycleOperation]
-	|| [operation isEqual: @"WorkspaceRecycleOutOperation"]) { 
-      for (i = 0; i < [files count]; i++) {
-        NSString *fname = [files objectAtIndex: i];
-        NSString *fpath = [destination stringByAppendingPathComponent: fname];
-
-        if ([path isEqual: fpath]) {
-          NSString *srcpath = [source stringByAppendingPathComponent: fname];
-          NSDictionary *attrs = [fm fileAttributesAtPath: srcpath 
-                                            traverseLink: NO];
-          if ((attrs == nil) 
-                      || ([[attrs fileType] isEqual: [self fileType]] == NO)) {
-            return NO;
-          }
-
-        } else if ([self isSubnodeOfPath: fpath]) {  
-          NSString *ppart = subtractFirstPartFromPath(path, fpath);
-          NSString *srcpath = [source stringByAppendingPathComponent: fname];
-          
-          srcpath = [srcpath stringByAppendingPathComponent: ppart];
-
-          if ([fm fileExistsAtPath: srcpath]) {
-            NSDictionary *attrs = [fm fileAttributesAtPath: srcpath  
-                                              traverseLink: NO];
-            if ((attrs == nil) 
-                        || ([[attrs fileType] isEqual: [self fileType]] == NO)) {
-              return NO;
-            }
-          } else {
-            return NO;
-          }
-        }
-      }
+  /* a file landing on the node path keeps it valid only if it is of
+     the same type */
+  srcpath = [oppaths replacingSourceOfPath: [self path]];
+
+  if (srcpath) {
+    NSDictionary *attrs = [fm fileAttributesAtPath: srcpath traverseLink: NO];
+
+    if ((attrs == nil) || ([[attrs fileType] isEqual: [self fileType]] == NO)) {
+      return NO;
     }
   }
-  
+
   return YES;
 }
 
 - (BOOL)involvedByFileOperation:(NSDictionary *)opinfo
 {
-  NSString *operation = [opinfo objectForKey: @"operation"];
-  NSString *source = [opinfo objectForKey: @"source"];
-  NSString *destination = [opinfo objectForKey: @"destination"];	 
-  NSArray *files = [opinfo objectForKey: @"files"];    
-  NSUInteger i;  	 
-
-  /* Special handling for unmount operations */
-  if ([operation isEqual: @"UnmountOperation"]) {
-    NSString *unmountedPath = [opinfo objectForKey: @"unmounted"];
-    if (unmountedPath) {
-      /* Check if this node is the unmounted path or a subpath */
-      if ([path isEqual: unmountedPath] || isSubpathOfPath(unmountedPath, path)) {
-        return YES;
-      }
-    }
-  }
-
-  if ([operation isEqual: @"WorkspaceRenameOperation"])
-    {
-      files = [NSArray arrayWithObject: [source lastPathComponent]];
-      source = [source stringByDeletingLastPathComponent];
-      destination = [destination stringByDeletingLastPathComponent];
-    }
+  return [[FSNOperationPaths pathsForOperationInfo: opinfo] involvesPath: [self path]];
+}
 
-  if ([path isEqual: source] || [path isEqual: destination])
-    {
-      return YES;
-    }
+@end
 
-  if (isSubpathOfPath(source, path))
-    {
-      for (i = 0; i < [files count]; i++)
-        {
-          NSString *fname = [files objectAtIndex: i];
-          NSString *fpath = [source stringByAppendingPathComponent: fname];
 
-          if (([fpath isEqual: path]) || (isSubpathOfPath(fpath, path)))
-            {
-              return YES;
-            }
-        }
-    }
+@implementation FSNode (Comparing)
 
-  if ([operation isEqual: @"WorkspaceRenameOperation"])
-    {
-      destination = [opinfo objectForKey: @"destination"];
-      files = [NSArray arrayWithObject: [destination lastPathComponent]];
-      destination = [destination stringByDeletingLastPathComponent];
-    }
+- (NSComparisonResult)compareAccordingToPath:(FSNode *)aNode
+{
+  return [[self path] compare: [aNode path]];
+}
 
-  if (isSubpathOfPath(destination, path))
-    {
-      for (i = 0; i < [files count]; i++)
-        {
-          NSString *fname = [files objectAtIndex: i];
-          NSString *fpath = [destination stringByAppendingPathComponent: fname];
+- (NSData *)nameSortKey
+{
+  if (nameSortKey == nil) {
+    NSString *n = [[[self name] decomposedStringWithCanonicalMapping] lowercaseString];
+    NSData *utf8 = [n dataUsingEncoding: NSUTF8StringEncoding];
+    NSMutableData *key = [NSMutableData dataWithCapacity: [utf8 length] + 1];
+    /* dot files sort after all the others */
+    char group = [n hasPrefix: @"."] ? 1 : 0;
 
-          if (([fpath isEqual: path]) || (isSubpathOfPath(fpath, path)))
-            {
-              return YES;
-            }
-        }
-    }
+    [key appendBytes: &group length: 1];
+    [key appendData: utf8];
+    nameSortKey = [key copy];
+  }
 
-  return NO;
+  return nameSortKey;
 }
 
-@end
-
+- (NSData *)extensionSortKey
+{
+  if (extensionSortKey == nil) {
+    NSString *e = [[[self path] pathExtension] lowercaseString];
 
-@implementation FSNode (Comparing)
+    ASSIGN (extensionSortKey, [e dataUsingEncoding: NSUTF8StringEncoding]);
+  }
 
-- (NSComparisonResult)compareAccordingToPath:(FSNode *)aNode
-{
-  return [path compare: [aNode path]];
+  return extensionSortKey;
 }
 
 - (NSComparisonResult)compareAccordingToName:(FSNode *)aNode
 {
-  NSString *n1 = [self name];
-  NSString *n2 = [aNode name];
-
-  if ([n2 hasPrefix: @"."] || [n1 hasPrefix: @"."]) {
-    if ([n2 hasPrefix: @"."] && [n1 hasPrefix: @"."]) {
-      return [n1 caseInsensitiveCompare: n2];
-    } else {
-      return [n2 caseInsensitiveCompare: n1];
-    }
-  }
-  
-  return [n1 caseInsensitiveCompare: n2];
+  return FSNCompareSortKeys([self nameSortKey], [aNode nameSortKey]);
 }
 
 - (NSComparisonResult)compareAccordingToParent:(FSNode *)aNode
@@ -1132,43 +1288,53 @@
   return result;
 }
 
-- (NSComparisonResult)compareAccordingToKind:(FSNode *)aNode
+- (NSUInteger)kindIdentifier
 {
-  unsigned i1, i2;
+  if (kindIdentifier == 0) {
+    FSNKindClass cls;
 
-  if ([self isDirectory]) { 
-    i1 = 2; 
-  } else if ([self isExecutable]) { 
-    i1 = 1; 
-  } else { 
-    i1 = 0; 
-  } 
+    if ([self isDirectory]) {
+      cls = FSNKindClassDirectory;
+    } else if ([self isExecutable]) {
+      cls = FSNKindClassExecutable;
+    } else {
+      cls = FSNKindClassOther;
+    }
 
-  if ([aNode isDirectory]) { 
-    i2 = 2; 
-  } else if ([aNode isExecutable]) { 
-    i2 = 1; 
-  } else { 
-    i2 = 0; 
-  } 
+    kindIdentifier = [[FSNTypeResolver sharedResolver] kindForClass: cls
+                                                       extensionKey: [self extensionSortKey]];
+  }
 
-  if (i1 == i2) {	
-    return [self compareAccordingToExtension: aNode];
-  }   
+  return kindIdentifier;
+}
+
+- (NSComparisonResult)compareAccordingToKind:(FSNode *)aNode
+{
+  FSNTypeResolver *resolver = [FSNTypeResolver sharedResolver];
+  NSUInteger k1 = [self kindIdentifier];
+  NSUInteger k2 = [aNode kindIdentifier];
+  NSUInteger r1, r2;
 
-  return ((i1 > i2) ? NSOrderedAscending : NSOrderedDescending);
+  if (k1 == k2) {
+    return [self compareAccordingToName: aNode];
+  }
+
+  r1 = [resolver rankOfKind: k1];
+  r2 = [resolver rankOfKind: k2];
+
+  return ((r1 < r2) ? NSOrderedAscending : NSOrderedDescending);
 }
 
 - (NSComparisonResult)compareAccordingToExtension:(FSNode *)aNode
 {
-  NSString *e1 = [[self path] pathExtension];
-  NSString *e2 = [[aNode path] pathExtension];
-  
-  if ([e1 isEqual: e2]) {
+  NSComparisonResult r = FSNCompareSortKeys([self extensionSortKey],
+                                            [aNode extensionSortKey]);
+
+  if (r == NSOrderedSame) {
     return [self compareAccordingToName: aNode];
   }
   
-  return [e1 caseInsensitiveCompare: e2];
+  return r;
 }
 
 - (NSComparisonResult)compareAccordingToDate:(FSNode *)aNode
@@ -49,6 +49,9 @@ typedef enum FSNSelectionMask {
 @class NSColor;
 @class NSBezierPath;
 @class NSFont;
+@class FSNThumbnailStore;
+@class FSNRemoteCache;
+@class FSNHiddenMatcher;
 
 @protocol FSNodeRep
 
@@ -350,17 +353,33 @@ typedef enum FSNSelectionMask {
   NSArray *extInfoModules;
   
   FSNInfoType defSortOrder;
+  FSNLoadTier defLoadTier;
   BOOL hideSysFiles;
 
   NSMutableArray *lockedPaths;
-  NSArray *hiddenPaths;
+  FSNHiddenMatcher *hiddenMatcher;
+  unsigned long hiddenMatcherVersion;  /* of the listings in listingCache */
+  NSMutableDictionary *listingCache;   /* path -> filtered FSNDirectorySnapshot */
+  NSMutableArray *listingCacheOrder;   /* LRU, most recent last */
+  NSLock *listingLock;                 /* the two above; loaders and the
+                                          prefetcher share them */
+  FSNRemoteCache *remoteCache;         /* misses on network volumes */
   NSMutableSet *reservedNames;
   NSMutableSet *volumes;
   NSMutableSet *diskImageVolumes;  /* Tracks which volumes are disk images (DMG/ISO) */
   NSString *rootPath;
     
-  NSMutableDictionary *iconsCache;
-  NSMutableDictionary *tumbsCache;
+  NSMutableDictionary *iconsCache;       /* key -> { size -> NSImage } */
+  NSMutableArray *iconsCacheOrder;       /* LRU of keys, most recent last */
+  unsigned long long iconsCacheBytes;    /* estimated bitmap bytes held */
+  unsigned long long iconsCacheMaxBytes;
+  NSUInteger iconsCacheMaxEntries;
+  unsigned long iconsCacheHits;
+  unsigned long iconsCacheMisses;
+  unsigned long iconsCacheEvictions;
+  NSString *iconAtlasTheme;              /* theme the cache was filled for */
+  NSMutableDictionary *tumbsCache;      /* path -> NSImage decoded from the store */
+  FSNThumbnailStore *thumbnailStore;
   NSString *thumbnailDir;
   BOOL usesThumbnails;  
 
@@ -377,6 +396,8 @@ typedef enum FSNSelectionMask {
 
   id _metadataProvider;   /* id <FSNMetadataProvider>, set by the application */
   id _iconPositionStore;  /* id <FSNIconPositionStore>, set by the application */
+  id _thumbnailScheduler; /* id <FSNThumbnailScheduler>, set by the application */
+  id _viewerPrefsStore;   /* id <FSNViewerPrefsStore>, set by the application */
 }
 
 + (FSNodeRep *)sharedInstance;
@@ -391,8 +412,88 @@ typedef enum FSNSelectionMask {
 - (void)setIconPositionStore:(id)store;
 - (id)iconPositionStore;
 
+/* Thumbnail scheduler (takes the views' visible-first hints).  Injected by
+ * the application; nil in a plain FSNode client (no hints are sent). */
+- (void)setThumbnailScheduler:(id)scheduler;
+- (id)thumbnailScheduler;
+
+/* Per-folder settings store.  Injected by the application; a plain FSNode
+ * client keeps the settings in the user defaults. */
+- (void)setViewerPrefsStore:(id)store;
+- (id)viewerPrefsStore;
+
+/* The settings under `key`, from the store or else the user defaults. */
+- (NSDictionary *)viewerPrefsForKey:(NSString *)key;
+- (void)setViewerPrefs:(NSDictionary *)prefs
+                forKey:(NSString *)key;
+
 - (NSArray *)directoryContentsAtPath:(NSString *)path;
 
+/* Visible entries of `path` together with their stat records, read in a
+ * single pass over the directory.  -directoryContentsAtPath: returns the
+ * names of this snapshot. */
+- (FSNDirectorySnapshot *)directorySnapshotAtPath:(NSString *)path;
+
+- (FSNDirectorySnapshot *)directorySnapshotAtPath:(NSString *)path
+                                             tier:(FSNLoadTier)tier;
+
+/* Listings are cached per directory and reused while the directory's
+ * (device, inode, mtime) is unchanged; on network volumes they are reused
+ * without checking for "FSNRemoteListingTTL" seconds, 30 by default.
+ * fswatcher events invalidate them automatically; these are for callers
+ * that know better. */
+- (void)invalidateDirectoryListingAtPath:(NSString *)path;
+
+- (void)invalidateDirectoryListingsUnderPath:(NSString *)path;
+
+- (void)invalidateDirectoryListings;
+
+/* What an explicit refresh drops: the listings at and beneath `path`,
+ * what is known to be missing there and the Finder metadata of the
+ * files in it. */
+- (void)refreshCachesUnderPath:(NSString *)path;
+
+/* On network volumes the lookups of the .DS_Store, .hidden and ._ files
+ * most folders lack are answered from the last complete listing of the
+ * folder, or from a miss noted in the last "FSNRemoteNegativeTTL"
+ * seconds, 60 by default.  Callers that look such a file up ask first
+ * and note the misses; elsewhere these cost nothing and know nothing.
+ * Safe to call from any thread. */
+- (BOOL)isKnownMissingFileAtPath:(NSString *)path;
+
+- (void)noteMissingFileAtPath:(NSString *)path;
+
+/* for callers that wrote one of them */
+- (void)noteCreatedFileAtPath:(NSString *)path;
+
+/* YES when a listing of `path` is cached, without checking that it is
+ * still current. */
+- (BOOL)hasCachedDirectoryListingAtPath:(NSString *)path;
+
+/* entries (listings cached) and names (in all of them) */
+- (NSDictionary *)listingCacheStatistics;
+
+/* Names listed in the .hidden file of `path`, or nil.  Only reads the
+ * file, so it can be called from any thread. */
++ (NSSet *)hiddenNamesAtPath:(NSString *)path;
+
+/* Drops the entries the views never show: metadata files, dot files and
+ * invisible files when system files are hidden, `hiddenNames` and the
+ * hidden paths. */
+- (void)removeHiddenEntriesFromSnapshot:(FSNDirectorySnapshot *)snap
+                            hiddenNames:(NSSet *)hiddenNames;
+
+/* Filters a complete snapshot read elsewhere, e.g. by FSNDirectoryLoader,
+ * and caches it as the listing of its directory. */
+- (void)cacheDirectorySnapshot:(FSNDirectorySnapshot *)snap
+                   hiddenNames:(NSSet *)hiddenNames;
+
+/* Tier used by -subNodes and -directorySnapshotAtPath:.  Defaults to
+ * FSNLoadTierType: the names and types needed for first paint. */
+- (void)setDefaultLoadTier:(FSNLoadTier)tier;
+
+- (FSNLoadTier)defaultLoadTier;
+
 - (int)labelMargin;
 
 - (float)labelWFactor;
@@ -421,6 +522,9 @@ typedef enum FSNSelectionMask {
 
 - (NSArray *)hiddenPaths;
 
+/* The rules behind the two above, shared with the rest of the process. */
+- (FSNHiddenMatcher *)hiddenMatcher;
+
 - (void)lockNode:(FSNode *)node;
 
 - (void)lockPath:(NSString *)path;
@@ -488,8 +592,37 @@ typedef enum FSNSelectionMask {
                        forKey:(NSString *)key
                   addBaseIcon:(NSImage *)baseIcon;
 
+/* Explicit invalidation: drops every size cached for `key`. */
 - (void)removeCachedIconsForKey:(NSString *)key;
 
+/* The icon cache is an LRU over keys bounded both by an estimated bitmap
+ * size (width * height * 4 per image) and by a number of keys.  Defaults
+ * come from the "icons_cache_max_kbytes" and "icons_cache_max_entries"
+ * user defaults (16 MB, 1024 keys); 0 means no limit. */
+- (void)setIconsCacheMaxBytes:(unsigned long long)bytes
+                   maxEntries:(NSUInteger)entries;
+
+/* Looks up the sizes cached for `key` and marks it most recently used.
+ * Code outside this category must use this and -setCachedIcons:forKey:
+ * rather than touching iconsCache, so that sizes stay accounted for. */
+- (NSMutableDictionary *)cachedIconsForKey:(NSString *)key;
+
+- (void)setCachedIcons:(NSMutableDictionary *)dict
+                forKey:(NSString *)key;
+
+- (void)removeAllCachedIcons;
+
+/* hits, misses, evictions, bytes, maxBytes, entries, maxEntries */
+- (NSDictionary *)iconsCacheStatistics;
+
+/* Refills the icon cache from the on-disk atlas of the current theme
+ * (see FSNIconAtlas.h).  Called by -cacheIcons. */
+- (void)loadIconAtlas;
+
+/* Writes the cache to the atlas of the theme it was filled for.  Called
+ * when the application terminates and before a theme change. */
+- (void)saveIconAtlas;
+
 - (NSImage *)multipleSelectionIconOfSize:(int)size;
 
 - (NSImage *)openFolderIconOfSize:(int)size 
@@ -514,6 +647,10 @@ typedef enum FSNSelectionMask {
 
 - (NSImage *)thumbnailForPath:(NSString *)apath;
 
+/* entries (decoded thumbnails held), storeEntries and storeBytes (of
+ * the thumbnail store on disk) */
+- (NSDictionary *)thumbnailsStatistics;
+
 @end
 
 
@@ -34,6 +34,15 @@
 #import "ExtendedInfo.h"
 #import "config.h"
 #import "FSNMetadataProvider.h"
+#import "FSNFolderMetadata.h"
+#import "FSNMountTable.h"
+#import "FSNVolumeHealth.h"
+#import "FSNRemoteCache.h"
+#import "FSNHiddenMatcher.h"
+#import "FSNSizeCache.h"
+#import "FSNTypeResolver.h"
+#import "FSNThumbnailStore.h"
+#import "FSNViewerPrefsStore.h"
 
 
 #ifdef HAVE_GETMNTINFO
@@ -61,6 +70,22 @@
   #endif
 #endif
 
+/* Directory listings kept by -directorySnapshotAtPath:tier: */
+#define LISTING_CACHE_SIZE 64
+/* Stat records can go stale without the directory mtime changing (a file
+ * grows in place), so listings are reused only this long, whatever their
+ * tier, unless fswatcher tells us about the change first. */
+#define LISTING_STAT_TTL (5.0)
+/* Listings of network volumes are reused without asking the server this
+ * long, and missing metadata files are remembered this long; see the
+ * "FSNRemoteListingTTL" and "FSNRemoteNegativeTTL" defaults. */
+#define REMOTE_LISTING_TTL (30.0)
+#define REMOTE_NEGATIVE_TTL (60.0)
+
+/* Default icon cache limits, see -setIconsCacheMaxBytes:maxEntries: */
+#define ICONS_CACHE_KBYTES (16 * 1024)
+#define ICONS_CACHE_ENTRIES (1024)
+
 #define LABEL_W_FACT (8.0)
 #define FONT_H_FACT (1.5)
 
@@ -72,6 +97,8 @@ static FSNodeRep *shared = nil;
 
 - (void)loadExtendedInfoModules;
 
+- (NSArray *)extInfoModules;
+
 - (NSArray *)bundlesWithExtension:(NSString *)extension 
 			   inPath:(NSString *)path;
 
@@ -104,6 +131,9 @@ static FSNodeRep *shared = nil;
   trashIcon = [[NSImage imageNamed:NSImageNameTrashEmpty] retain];
   [trashFullIcon retain];
   trashFullIcon = [[NSImage imageNamed:NSImageNameTrashFull] retain];
+
+  /* icons resized in a previous session for this theme */
+  [self loadIconAtlas];
 }
 
 - (id)initSharedInstance
@@ -122,6 +152,27 @@ static FSNodeRep *shared = nil;
           
     labelWFactor = LABEL_W_FACT;
 
+    iconsCache = [NSMutableDictionary new];
+    iconsCacheOrder = [NSMutableArray new];
+    iconsCacheBytes = 0;
+    {
+      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+      id kbytes = [defaults objectForKey: @"icons_cache_max_kbytes"];
+      id entries = [defaults objectForKey: @"icons_cache_max_entries"];
+
+      [self setIconsCacheMaxBytes: (kbytes ? [kbytes intValue] : ICONS_CACHE_KBYTES) * 1024ULL
+                       maxEntries: (entries ? [entries intValue] : ICONS_CACHE_ENTRIES)];
+    }
+    {
+      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+      id lttl = [defaults objectForKey: @"FSNRemoteListingTTL"];
+      id nttl = [defaults objectForKey: @"FSNRemoteNegativeTTL"];
+
+      remoteCache = [[FSNRemoteCache alloc]
+                      initWithListingTTL: (lttl ? [lttl doubleValue] : REMOTE_LISTING_TTL)
+                             negativeTTL: (nttl ? [nttl doubleValue] : REMOTE_NEGATIVE_TTL)];
+    }
+
     /* images coming form GSTheme */
     [self cacheIcons];
 
@@ -133,7 +184,6 @@ static FSNodeRep *shared = nil;
     imagepath = [bundle pathForImageResource: @"HardDiskOpen"];
     openHardDiskIcon = [[NSImage alloc] initWithContentsOfFile: imagepath]; 
     
-    iconsCache = [NSMutableDictionary new];
     rootPath = path_separator();
     RETAIN (rootPath);
     
@@ -157,20 +207,38 @@ static FSNodeRep *shared = nil;
     }
     
     defSortOrder = FSNInfoNameType;
+    defLoadTier = FSNLoadTierType;
     hideSysFiles = NO;
     usesThumbnails = YES;
       
     lockedPaths = [NSMutableArray new];	
-    hiddenPaths = [NSArray new];
+    hiddenMatcher = RETAIN ([FSNHiddenMatcher sharedMatcher]);
+    hiddenMatcherVersion = [hiddenMatcher version];
+    listingCache = [NSMutableDictionary new];
+    listingCacheOrder = [NSMutableArray new];
+    listingLock = [NSLock new];
     volumes = [[NSMutableSet alloc] initWithCapacity: 1];
     [self setVolumes:[[NSWorkspace sharedWorkspace] mountedRemovableMedia]];
     diskImageVolumes = [[NSMutableSet alloc] initWithCapacity: 1];
     reservedNames = [[NSMutableSet alloc] initWithCapacity: 1];
     
-    [self loadExtendedInfoModules];
+    /* the extended info bundles are loaded when a view first asks */
+    extInfoModules = nil;
 
     /* we observe a theme change to re-cache icons */
     [nc addObserver:self selector:@selector(themeDidActivate:) name:GSThemeDidActivateNotification object:nil];
+
+    [nc addObserver: self
+           selector: @selector(applicationWillTerminate:)
+               name: NSApplicationWillTerminateNotification
+             object: nil];
+
+    /* fswatcher events, reposted by the application, keep the listing
+       cache honest before the directory mtime catches up */
+    [nc addObserver: self
+           selector: @selector(watcherNotification:)
+               name: @"GWFileWatcherFileDidChangeNotification"
+             object: nil];
   }
     
   return self;
@@ -232,6 +300,14 @@ static FSNodeRep *shared = nil;
   ASSIGN (extInfoModules, loaded);
 }
 
+- (NSArray *)extInfoModules
+{
+  if (extInfoModules == nil)
+    [self loadExtendedInfoModules];
+
+  return extInfoModules;
+}
+
 - (NSArray *)bundlesWithExtension:(NSString *)extension 
 			   inPath:(NSString *)path
 {
@@ -254,10 +330,17 @@ static FSNodeRep *shared = nil;
   return bundleList;
 }
 
+- (void)applicationWillTerminate:(NSNotification *)notif
+{
+  [self saveIconAtlas];
+}
+
 - (void)themeDidActivate:(id)sender
 {
-  /* we clean the cache of theme-derived images */
-  [iconsCache removeAllObjects];
+  /* keep what was resized for the old theme, then clean the cache of
+     theme-derived images */
+  [self saveIconAtlas];
+  [self removeAllCachedIcons];
   [self cacheIcons];
 }
 
@@ -274,9 +357,16 @@ static FSNodeRep *shared = nil;
   RELEASE (diskImageVolumes);
   RELEASE (reservedNames);
   RELEASE (rootPath);
-  RELEASE (hiddenPaths);
+  RELEASE (hiddenMatcher);
+  RELEASE (listingCache);
+  RELEASE (listingCacheOrder);
+  RELEASE (listingLock);
+  RELEASE (remoteCache);
   RELEASE (iconsCache);
+  RELEASE (iconsCacheOrder);
+  RELEASE (iconAtlasTheme);
   RELEASE (tumbsCache);
+  RELEASE (thumbnailStore);
   RELEASE (thumbnailDir);
   RELEASE (multipleSelIcon);
   RELEASE (openFolderIcon);
@@ -297,55 +387,424 @@ static FSNodeRep *shared = nil;
   return shared;
 }
 
-- (NSArray *)directoryContentsAtPath:(NSString *)path
+- (FSNDirectorySnapshot *)directorySnapshotAtPath:(NSString *)path
 {
-  NSArray *fnames = [fm directoryContentsAtPath: path];
-  NSString *hdnFilePath = [path stringByAppendingPathComponent: @".hidden"];
-  NSArray *hiddenNames = nil;
+  return [self directorySnapshotAtPath: path tier: defLoadTier];
+}
+
+/* Most recently used goes last. */
+- (void)touchListingAtPath:(NSString *)path
+{
+  [listingLock lock];
+  if ([listingCache objectForKey: path] != nil)
+    {
+      [listingCacheOrder removeObject: path];
+      [listingCacheOrder addObject: path];
+    }
+  [listingLock unlock];
+}
+
+/* The directory is stat'ed without the lock held: on a network volume
+   that can take until the health timeout. */
+- (FSNDirectorySnapshot *)cachedSnapshotAtPath:(NSString *)path
+                                          tier:(FSNLoadTier)tier
+{
+  FSNDirectorySnapshot *snap;
+  FSNStatInfo dinfo;
+  const FSNStatInfo *cinfo;
+  NSTimeInterval age;
+  BOOL remote;
+  BOOL timedOut;
+
+  [listingLock lock];
+  snap = AUTORELEASE (RETAIN ([listingCache objectForKey: path]));
+  [listingLock unlock];
+
+  if (snap == nil)
+    return nil;
+
+  age = [NSDate timeIntervalSinceReferenceDate] - [snap timestamp];
+  remote = ([[FSNVolumeHealth sharedHealth] remoteMountPointForPath: path] != nil);
+
+  /* too old whatever is asked for: a stat tier listing answering a type
+     request would otherwise be kept for good */
+  if (([snap tier] < tier)
+      || (age > (remote ? [remoteCache listingTTL] : LISTING_STAT_TTL)))
+    {
+      [self invalidateDirectoryListingAtPath: path];
+      return nil;
+    }
+
+  /* a revisit within the TTL costs no round trip; fswatcher still sees
+     the changes made from here, and a refresh drops the listing */
+  if (remote)
+    {
+      [self touchListingAtPath: path];
+      return snap;
+    }
+
+  if (FSNVolumeStatInfoForPath(path, &dinfo, YES, &timedOut) == NO)
+    {
+      /* an unreachable server: the last listing is better than none */
+      if (timedOut)
+        return snap;
+      [self invalidateDirectoryListingAtPath: path];
+      return nil;
+    }
+
+  cinfo = [snap directoryStatInfo];
+
+  if ((cinfo->device != dinfo.device)
+      || (cinfo->inode != dinfo.inode)
+      || (cinfo->modificationTime != dinfo.modificationTime))
+    {
+      [self invalidateDirectoryListingAtPath: path];
+      return nil;
+    }
+
+  [self touchListingAtPath: path];
+
+  return snap;
+}
+
+- (void)cacheSnapshot:(FSNDirectorySnapshot *)snap
+               atPath:(NSString *)path
+{
+  if ([snap isValid] == NO)
+    return;
+
+  [listingLock lock];
+
+  [listingCacheOrder removeObject: path];
+
+  while ([listingCacheOrder count] >= LISTING_CACHE_SIZE)
+    {
+      [listingCache removeObjectForKey: [listingCacheOrder objectAtIndex: 0]];
+      [listingCacheOrder removeObjectAtIndex: 0];
+    }
+
+  [listingCache setObject: snap forKey: path];
+  [listingCacheOrder addObject: path];
+
+  [listingLock unlock];
+}
 
-  if ([fm fileExistsAtPath: hdnFilePath])
-    hiddenNames = [[NSString stringWithContentsOfFile: hdnFilePath] componentsSeparatedByString: @"\n"];
+- (NSDictionary *)listingCacheStatistics
+{
+  NSEnumerator *enumerator;
+  FSNDirectorySnapshot *snap;
+  unsigned long long names = 0;
+  NSUInteger entries;
+
+  [listingLock lock];
+  enumerator = [listingCache objectEnumerator];
+  while ((snap = [enumerator nextObject]) != nil)
+    names += [snap count];
+  entries = [listingCache count];
+  [listingLock unlock];
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedInteger: entries], @"entries",
+    [NSNumber numberWithUnsignedLongLong: names], @"names",
+    nil];
+}
+
+- (void)invalidateDirectoryListingAtPath:(NSString *)path
+{
+  [listingLock lock];
+  if ([listingCache objectForKey: path] != nil)
+    {
+      [listingCache removeObjectForKey: path];
+      [listingCacheOrder removeObject: path];
+    }
+  [listingLock unlock];
+}
+
+- (void)invalidateDirectoryListingsUnderPath:(NSString *)path
+{
+  NSArray *cached;
+  NSUInteger i;
+
+  [listingLock lock];
+  cached = [NSArray arrayWithArray: listingCacheOrder];
+  [listingLock unlock];
+
+  for (i = 0; i < [cached count]; i++)
+    {
+      NSString *cpath = [cached objectAtIndex: i];
+
+      if ([cpath isEqual: path] || isSubpathOfPath(path, cpath))
+        [self invalidateDirectoryListingAtPath: cpath];
+    }
+}
+
+- (void)invalidateDirectoryListings
+{
+  [listingLock lock];
+  [listingCache removeAllObjects];
+  [listingCacheOrder removeAllObjects];
+  [listingLock unlock];
+  [remoteCache invalidateAll];
+}
+
+- (void)refreshCachesUnderPath:(NSString *)path
+{
+  [self invalidateDirectoryListingsUnderPath: path];
+  [remoteCache invalidatePath: path];
+
+  if ([_metadataProvider respondsToSelector: @selector(invalidateCachesForPaths:)])
+    {
+      NSArray *names = [fm directoryContentsAtPath: path];
+      NSMutableArray *paths = [NSMutableArray arrayWithObject: path];
+      NSUInteger i;
+
+      for (i = 0; i < [names count]; i++)
+        [paths addObject: [path stringByAppendingPathComponent: [names objectAtIndex: i]]];
+
+      [_metadataProvider invalidateCachesForPaths: paths];
+    }
+}
+
+- (BOOL)isKnownMissingFileAtPath:(NSString *)path
+{
+  NSString *mpoint = [[FSNVolumeHealth sharedHealth] remoteMountPointForPath: path];
+
+  if (mpoint == nil)
+    return NO;
+
+  return ([remoteCache probeForPath: path
+                           onVolume: mpoint
+                             atTime: [NSDate timeIntervalSinceReferenceDate]]
+          == FSNRemoteProbeMissing);
+}
+
+- (void)noteMissingFileAtPath:(NSString *)path
+{
+  NSString *mpoint = [[FSNVolumeHealth sharedHealth] remoteMountPointForPath: path];
+
+  if (mpoint)
+    [remoteCache setMissingPath: path
+                       onVolume: mpoint
+                         atTime: [NSDate timeIntervalSinceReferenceDate]];
+}
+
+- (void)noteCreatedFileAtPath:(NSString *)path
+{
+  [remoteCache invalidatePath: path];
+}
+
+- (void)watcherNotification:(NSNotification *)notif
+{
+  NSDictionary *info = (NSDictionary *)[notif object];
+  NSString *event = [info objectForKey: @"event"];
+  NSString *path = [info objectForKey: @"path"];
+
+  if (path == nil)
+    return;
 
+  [remoteCache invalidatePath: path];
 
+  /* a file written in place leaves its directory's mtime as it was */
   {
-    NSMutableArray *filteredNames = [NSMutableArray array];
+    FSNSizeCache *sizes = [FSNSizeCache sharedCache];
+    NSArray *files = [info objectForKey: @"files"];
     NSUInteger i;
 
-    for (i = 0; i < [fnames count]; i++)
-      {
-        NSString *fname = [fnames objectAtIndex: i];
-        NSString *fpath = [path stringByAppendingPathComponent: fname];
-        BOOL hidden = NO;
+    [sizes invalidateDirectory: path];
+    [sizes invalidateDirectory: [path stringByDeletingLastPathComponent]];
 
-        /* Always hide internal metadata files */
-        if ([fname hasPrefix: @"._"])
-          hidden = YES;
-        if ([fname isEqualToString: @"__MACOSX"])
-          hidden = YES;
-        if ([fname isEqualToString: @".DS_Store"])
-          hidden = YES;
+    for (i = 0; i < [files count]; i++)
+      [sizes invalidatePath: [path stringByAppendingPathComponent: [files objectAtIndex: i]]];
+  }
 
-        if (!hidden && [fname hasPrefix: @"."] && hideSysFiles)
-          hidden = YES;
+  if ([_metadataProvider respondsToSelector: @selector(invalidateCachesForPaths:)])
+    {
+      NSArray *files = [info objectForKey: @"files"];
+      NSMutableArray *paths = [NSMutableArray arrayWithObject: path];
+      NSUInteger i;
 
-        if (!hidden && hiddenNames && [hiddenNames containsObject: fname])
-          hidden = YES;
+      for (i = 0; i < [files count]; i++)
+        [paths addObject: [path stringByAppendingPathComponent: [files objectAtIndex: i]]];
 
-        if (!hidden && [hiddenPaths containsObject: fpath])
-          hidden = YES;
+      [_metadataProvider invalidateCachesForPaths: paths];
+    }
 
-        if (!hidden && hideSysFiles)
-          {
-            if ([self isFileInvisibleFromMetadataAtPath: fpath])
-              hidden = YES;
-          }
+  if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]
+      || [event isEqual: @"GWFileDeletedInWatchedDirectory"])
+    {
+      NSArray *files = [info objectForKey: @"files"];
+      NSUInteger i;
 
-        if (!hidden)
-          [filteredNames addObject: fname];
-      }
+      BOOL appsChanged = NO;
 
-    return filteredNames;
-  }
+      [self invalidateDirectoryListingAtPath: path];
+
+      /* a deleted or replaced subfolder takes its own listing with it */
+      for (i = 0; i < [files count]; i++)
+        {
+          NSString *fname = [files objectAtIndex: i];
+          NSString *fpath = [path stringByAppendingPathComponent: fname];
+
+          [self invalidateDirectoryListingsUnderPath: fpath];
+
+          if ([[fname pathExtension] isEqual: @"app"])
+            appsChanged = YES;
+        }
+
+      /* an installed or removed application can change the default
+         application of an extension */
+      if (appsChanged)
+        [[FSNTypeResolver sharedResolver] invalidateApplications];
+    }
+  else if ([event isEqual: @"GWWatchedFileModified"])
+    {
+      [self invalidateDirectoryListingAtPath: path];
+      [self invalidateDirectoryListingAtPath: [path stringByDeletingLastPathComponent]];
+    }
+  else if ([event isEqual: @"GWWatchedPathDeleted"]
+           || [event isEqual: @"GWWatchedPathRenamed"])
+    {
+      [self invalidateDirectoryListingsUnderPath: path];
+    }
+}
+
+- (FSNDirectorySnapshot *)directorySnapshotAtPath:(NSString *)path
+                                             tier:(FSNLoadTier)tier
+{
+  FSNDirectorySnapshot *snap;
+  NSSet *hiddenNames = nil;
+
+  /* the hidden-file rules changed, here or in another part of the
+     process, since the cached listings were filtered */
+  if ([hiddenMatcher version] != hiddenMatcherVersion)
+    {
+      hiddenMatcherVersion = [hiddenMatcher version];
+      [self invalidateDirectoryListings];
+    }
+
+  snap = [self cachedSnapshotAtPath: path tier: tier];
+
+  if (snap != nil)
+    return snap;
+
+  if ([[FSNVolumeHealth sharedHealth] remoteMountPointForPath: path])
+    {
+      BOOL timedOut;
+
+      snap = [[FSNVolumeHealth sharedHealth] resultOfCall: ^id (void) {
+          return [FSNDirectorySnapshot snapshotOfDirectoryAtPath: path tier: tier];
+        }
+                                                  forPath: path
+                                                 timedOut: &timedOut];
+      if (timedOut)
+        return AUTORELEASE ([[FSNDirectorySnapshot alloc]
+                              initUnreadDirectoryAtPath: path tier: tier]);
+    }
+  else
+    {
+      snap = [FSNDirectorySnapshot snapshotOfDirectoryAtPath: path tier: tier];
+    }
+
+  if ([snap statInfoForName: @".hidden"] != NULL)
+    hiddenNames = [FSNodeRep hiddenNamesAtPath: path];
+
+  [self cacheDirectorySnapshot: snap hiddenNames: hiddenNames];
+
+  return snap;
+}
+
++ (NSSet *)hiddenNamesAtPath:(NSString *)path
+{
+  NSString *hdnFilePath = [path stringByAppendingPathComponent: @".hidden"];
+  NSString *contents = [NSString stringWithContentsOfFile: hdnFilePath];
+
+  if (contents)
+    return [NSSet setWithArray: [contents componentsSeparatedByString: @"\n"]];
+
+  return nil;
+}
+
+- (BOOL)hasCachedDirectoryListingAtPath:(NSString *)path
+{
+  BOOL cached;
+
+  [listingLock lock];
+  cached = ([listingCache objectForKey: path] != nil);
+  [listingLock unlock];
+
+  return cached;
+}
+
+- (void)removeHiddenEntriesFromSnapshot:(FSNDirectorySnapshot *)snap
+                            hiddenNames:(NSSet *)hiddenNames
+{
+  NSString *path = [snap path];
+  FSNFolderMetadata *folderMetadata = nil;
+  NSMutableIndexSet *visible;
+  NSUInteger count;
+  NSUInteger i;
+
+  count = [snap count];
+  visible = [NSMutableIndexSet indexSet];
+
+  /* one folder read instead of one per entry */
+  if (hideSysFiles
+      && [_metadataProvider respondsToSelector: @selector(folderMetadataAtPath:)])
+    folderMetadata = [_metadataProvider folderMetadataAtPath: path];
+
+  for (i = 0; i < count; i++)
+    {
+      NSString *fname = [snap nameAtIndex: i];
+      BOOL hidden;
+
+      /* metadata files, dot files, the user's patterns and paths */
+      hidden = [hiddenMatcher isHiddenName: fname inDirectory: path];
+
+      if (!hidden && hiddenNames && [hiddenNames containsObject: fname])
+        hidden = YES;
+
+      if (!hidden && hideSysFiles)
+        {
+          if (folderMetadata != nil)
+            hidden = [folderMetadata isInvisibleName: fname];
+          else if ([self isFileInvisibleFromMetadataAtPath:
+                               [path stringByAppendingPathComponent: fname]])
+            hidden = YES;
+        }
+
+      if (!hidden)
+        [visible addIndex: i];
+    }
+
+  if ([visible count] != count)
+    [snap keepEntriesAtIndexes: visible];
+}
+
+- (void)cacheDirectorySnapshot:(FSNDirectorySnapshot *)snap
+                   hiddenNames:(NSSet *)hiddenNames
+{
+  NSString *mpoint;
+
+  if ([snap isValid] == NO)
+    return;
+
+  /* before the metadata files are filtered out: the complete listing
+     answers the .DS_Store, .hidden and ._ lookups to come */
+  mpoint = [[FSNVolumeHealth sharedHealth] remoteMountPointForPath: [snap path]];
+
+  if (mpoint)
+    [remoteCache setListedNames: [snap names]
+                    ofDirectory: [snap path]
+                       onVolume: mpoint
+                         atTime: [snap timestamp]];
+
+  [self removeHiddenEntriesFromSnapshot: snap hiddenNames: hiddenNames];
+  [self cacheSnapshot: snap atPath: [snap path]];
+}
+
+- (NSArray *)directoryContentsAtPath:(NSString *)path
+{
+  return [[self directorySnapshotAtPath: path] names];
 }
 
 - (int)labelMargin
@@ -458,9 +917,22 @@ static FSNodeRep *shared = nil;
   return compareSel;
 }
 
+- (void)setDefaultLoadTier:(FSNLoadTier)tier
+{
+  defLoadTier = tier;
+}
+
+- (FSNLoadTier)defaultLoadTier
+{
+  return defLoadTier;
+}
+
 - (void)setHideSysFiles:(BOOL)value
 {
+  if (hideSysFiles != value)
+    [self invalidateDirectoryListings];
   hideSysFiles = value;
+  [hiddenMatcher setHidesDotFiles: value];
 }
 
 - (BOOL)hideSysFiles
@@ -470,12 +942,18 @@ static FSNodeRep *shared = nil;
 
 - (void)setHiddenPaths:(NSArray *)paths
 {
-  ASSIGN (hiddenPaths, paths);
+  /* the listings go at the next read, when the version is seen */
+  [hiddenMatcher setHiddenPaths: paths];
 }
 
 - (NSArray *)hiddenPaths
 {
-  return hiddenPaths;
+  return [hiddenMatcher hiddenPaths];
+}
+
+- (FSNHiddenMatcher *)hiddenMatcher
+{
+  return hiddenMatcher;
 }
 
 - (void)lockNode:(FSNode *)node
@@ -661,62 +1139,22 @@ static FSNodeRep *shared = nil;
     }
   }
 
-  /* Check if this is an optical media filesystem (CD/DVD/Blu-ray)
-   * These should use the CD icon even if not mounted through VolumeManager */
-  NSWorkspace *ws = [NSWorkspace sharedWorkspace];
-  BOOL isRemovable = NO, isWritable = NO, isUnmountable = NO;
-  NSString *description = nil;
-  NSString *fsType = nil;
-  
-  if ([ws getFileSystemInfoForPath: path
-                       isRemovable: &isRemovable
-                        isWritable: &isWritable
-                     isUnmountable: &isUnmountable
-                       description: &description
-                              type: &fsType]) {
-    /* Optical media and disk image filesystem types that should show CD icon */
-    if ([fsType isEqualToString: @"ISO9660"] ||
-        [fsType isEqualToString: @"UDF"] ||
-        [fsType isEqualToString: @"CD9660"] ||
-        [fsType isEqualToString: @"ISOFS"] ||
-        [fsType isEqualToString: @"squashfs"] ||
-        [fsType isEqualToString: @"fuse.squashfuse"]) {
-      return YES;
-    }
-  }
+  /* Optical media and image filesystems (ISO 9660, UDF, squashfs, loop
+   * devices) use the CD icon even if not mounted through VolumeManager.
+   * Anything else under /Volumes is disk image or removable media too,
+   * except network filesystems (fuse.sshfs, ...) placed there. */
+  {
+    FSNMountTable *mtable = [FSNMountTable sharedTable];
+    FSNMountEntry *entry = [mtable entryForMountPoint: path];
 
-  /* Check if the path is under /Volumes — these are always disk image
-   * or removable media mounts and should use the CD icon.
-   * Exception: network filesystem mounts (fuse.sshfs, fuse.*) which
-   * are also placed under /Volumes but are not disk images. */
-  if ([path hasPrefix: @"/Volumes/"]) {
-    NSString *procMounts = @"/proc/mounts";
-    NSString *mountsContent;
-    mountsContent = [NSString stringWithContentsOfFile: procMounts
-                                             encoding: NSUTF8StringEncoding
-                                                error: NULL];
-    if (mountsContent) {
-      BOOL isNetworkMount = NO;
-      NSArray *lines = [mountsContent componentsSeparatedByString: @"\n"];
-      for (NSString *line in lines) {
-        if ([line length] == 0) continue;
-        NSArray *parts = [line componentsSeparatedByString: @" "];
-        if ([parts count] < 3) continue;
-        NSString *target = [parts objectAtIndex: 1];
-        if ([target isEqualToString: path]) {
-          NSString *fstype = [parts objectAtIndex: 2];
-          if ([fstype hasPrefix: @"fuse."]) {
-            isNetworkMount = YES;
-            break;
-          }
-        }
-      }
-      if (!isNetworkMount) {
-        return YES;
-      }
-    } else {
+    if (entry == nil && resolved)
+      entry = [mtable entryForMountPoint: resolved];
+
+    if ([entry isDiskImage])
       return YES;
-    }
+
+    if ([path hasPrefix: @"/Volumes/"])
+      return ([entry isNetwork] == NO);
   }
 
   return NO;
@@ -778,49 +1216,25 @@ static FSNodeRep *shared = nil;
     }
   }
   
-  if ([created count]) {
-    NSString *dictName = @"thumbnails.plist";
-    NSString *dictPath = [thumbnailDir stringByAppendingPathComponent: dictName];
-    
-    if ([fm fileExistsAtPath: dictPath]) {
-      NSDictionary *tdict = [NSDictionary dictionaryWithContentsOfFile: dictPath];
-
-      for (i = 0; i < [created count]; i++) {
-        NSString *key = [created objectAtIndex: i];
-        NSString *tumbname = [tdict objectForKey: key];
-        NSString *tumbpath = [thumbnailDir stringByAppendingPathComponent: tumbname]; 
+  /* decoded again from the store at the next lookup */
+  for (i = 0; i < [created count]; i++) {
+    [tumbsCache removeObjectForKey: [created objectAtIndex: i]];
+  }
 
-        if ([fm fileExistsAtPath: tumbpath]) {
-          NSImage *tumb = nil;
-        
-          NS_DURING
-            {
-          tumb = [[NSImage alloc] initWithContentsOfFile: tumbpath];
-          
-          if (tumb) {
-            [tumbsCache setObject: tumb forKey: key];
-            RELEASE (tumb);
-          }
-            }
-          NS_HANDLER
-            {
-          NSDebugLLog(@"gwspace", @"BAD IMAGE '%@'", tumbpath);
-            }
-          NS_ENDHANDLER
-        }
-      }    
-    }  
+  if ([created count]) {
+    [thumbnailStore refresh];
   }
 }
 
 - (NSArray *)availableExtendedInfoNames
 {
   NSMutableArray *names = [NSMutableArray array];
+  NSArray *modules = [self extInfoModules];
   NSUInteger i;
   
-  for (i = 0; i < [extInfoModules count]; i++)
+  for (i = 0; i < [modules count]; i++)
     {
-      id module = [extInfoModules objectAtIndex: i];
+      id module = [modules objectAtIndex: i];
       [names addObject: [module menuName]];
     }
   
@@ -830,11 +1244,12 @@ static FSNodeRep *shared = nil;
 - (NSDictionary *)extendedInfoOfType:(NSString *)type
                              forNode:(FSNode *)anode
 {
+  NSArray *modules = [self extInfoModules];
   NSUInteger i;
 
-  for (i = 0; i < [extInfoModules count]; i++)
+  for (i = 0; i < [modules count]; i++)
     {
-      id module = [extInfoModules objectAtIndex: i];
+      id module = [modules objectAtIndex: i];
       NSString *mname = [module menuName];
       
       if ([mname isEqual: type])
@@ -871,5 +1286,46 @@ static FSNodeRep *shared = nil;
   return _iconPositionStore;
 }
 
+- (void)setThumbnailScheduler:(id)scheduler
+{
+  _thumbnailScheduler = scheduler;   /* not retained: the app owns its lifetime */
+}
+
+- (id)thumbnailScheduler
+{
+  return _thumbnailScheduler;
+}
+
+- (void)setViewerPrefsStore:(id)store
+{
+  _viewerPrefsStore = store;   /* not retained: the app owns its lifetime */
+}
+
+- (id)viewerPrefsStore
+{
+  return _viewerPrefsStore;
+}
+
+- (NSDictionary *)viewerPrefsForKey:(NSString *)key
+{
+  if (_viewerPrefsStore)
+    return [_viewerPrefsStore viewerPrefsForKey: key];
+
+  return [[NSUserDefaults standardUserDefaults] dictionaryForKey: key];
+}
+
+- (void)setViewerPrefs:(NSDictionary *)prefs
+                forKey:(NSString *)key
+{
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+
+  if (_viewerPrefsStore)
+    [_viewerPrefsStore setViewerPrefs: prefs forKey: key];
+  else if (prefs)
+    [defaults setObject: prefs forKey: key];
+  else
+    [defaults removeObjectForKey: key];
+}
+
 @end
 
@@ -27,11 +27,20 @@
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import <GNUstepGUI/GSTheme.h>
 #import <fcntl.h>
 #import <unistd.h>
 #import "FSNodeRep.h"
 #import "FSNFunctions.h"
 #import "FSNMetadataProvider.h"
+#import "FSNIconAtlas.h"
+#import "FSNRaster.h"
+#import "FSNMountTable.h"
+#import "FSNThumbnailStore.h"
+#import "FSNTrace.h"
+
+/* the decoded thumbnails kept; the store holds the rest mapped */
+#define THUMBNAILS_CACHE_SIZE 512
 
 /*
  *****************************************************************************
@@ -122,6 +131,128 @@ static unsigned char darkerLUT[256] = {
   };
 
 
+/* Estimated bitmap footprint of a cached icon. */
+static inline unsigned long long
+iconCacheCost(NSImage *icon)
+{
+  NSSize s = [icon size];
+
+  return (unsigned long long)(s.width * s.height) * 4;
+}
+
+static unsigned long long
+iconsCacheEntryCost(NSDictionary *dict)
+{
+  NSEnumerator *e = [dict objectEnumerator];
+  unsigned long long cost = 0;
+  NSImage *icon;
+
+  while ((icon = [e nextObject]) != nil)
+    cost += iconCacheCost(icon);
+
+  return cost;
+}
+
+/* The largest 8 bit, interleaved RGBA (or, without `needsAlpha`, RGB)
+   bitmap representation of `icon`. */
+static NSBitmapImageRep *
+rgbBitmapOfIcon(NSImage *icon, BOOL needsAlpha)
+{
+  NSEnumerator *e = [[icon representations] objectEnumerator];
+  NSBitmapImageRep *best = nil;
+  NSImageRep *rep;
+
+  while ((rep = [e nextObject]) != nil)
+    {
+      NSBitmapImageRep *brep;
+      NSInteger spp;
+
+      if ([rep isKindOfClass: [NSBitmapImageRep class]] == NO)
+        continue;
+
+      brep = (NSBitmapImageRep *)rep;
+      spp = [brep samplesPerPixel];
+
+      if ([brep bitsPerSample] != 8 || [brep isPlanar]
+          || [brep bitmapData] == NULL
+          || (spp != 4 && (needsAlpha || spp != 3))
+          || [brep bitsPerPixel] != spp * 8)
+        continue;
+
+      if (best == nil || [brep pixelsWide] > [best pixelsWide])
+        best = brep;
+    }
+
+  return best;
+}
+
+static NSImage *
+tintedIcon(NSImage *icon, const unsigned char lut[256])
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSBitmapImageRep *rep = rgbBitmapOfIcon(icon, NO);
+  NSImage *newIcon;
+
+  if (rep == nil)
+    {
+      /* vector or odd format reps: go through a TIFF bitmap */
+      NSData *tiffdata = [icon TIFFRepresentation];
+      NSBitmapImageRep *trep = [NSBitmapImageRep imageRepWithData: tiffdata];
+
+      if (trep != nil)
+        {
+          NSImage *timage = AUTORELEASE ([[NSImage alloc] initWithSize: [icon size]]);
+
+          [timage addRepresentation: trep];
+          rep = rgbBitmapOfIcon(timage, NO);
+        }
+    }
+
+  if (rep != nil)
+    {
+      NSInteger pixelsWide = [rep pixelsWide];
+      NSInteger pixelsHigh = [rep pixelsHigh];
+      BOOL premultiplied = ([rep hasAlpha]
+                    && ([rep bitmapFormat] & NSAlphaNonpremultipliedBitmapFormat) == 0);
+      NSBitmapImageRep *newrep;
+
+      newIcon = [[NSImage alloc] initWithSize: NSMakeSize(pixelsWide, pixelsHigh)];
+
+      newrep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                  pixelsWide: pixelsWide
+                                  pixelsHigh: pixelsHigh
+                                  bitsPerSample: 8
+                                  samplesPerPixel: 4
+                                  hasAlpha: YES
+                                  isPlanar: NO
+                                  colorSpaceName: NSDeviceRGBColorSpace
+                                  bytesPerRow: 0
+                                  bitsPerPixel: 0];
+
+      [newIcon addRepresentation: newrep];
+      RELEASE (newrep);
+
+      FSNRasterApplyLUT([rep bitmapData], [rep bytesPerRow],
+                        (unsigned)[rep samplesPerPixel],
+                        [newrep bitmapData], [newrep bytesPerRow],
+                        pixelsWide, pixelsHigh, lut, premultiplied);
+    }
+  else
+    {
+      newIcon = [icon copy];
+    }
+
+  RELEASE (arp);
+
+  return AUTORELEASE (newIcon);
+}
+
+
+@interface FSNodeRep (IconsCache)
+- (void)trimIconsCache;
+@end
+
+
 @implementation FSNodeRep (Icons)
 
 static BOOL FSNodeRepHasAppImageMagic(NSString *path)
@@ -157,6 +288,7 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 - (NSImage *)iconOfSize:(int)size 
                 forNode:(FSNode *)node
 {
+  FSN_TRACE_SCOPE ("FSNodeRep iconOfSize");
   NSString *nodepath = [node path];
   NSImage *icon = nil;
   NSImage *baseIcon = nil;
@@ -179,6 +311,23 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
     }
   }
 
+  /* A node whose network volume did not answer: nothing is read for
+     its icon until it is resolved. */
+  if ([node isPlaceholder])
+    {
+      icon = [self cachedIconOfSize: size forKey: @"FSNPlaceholderIcon"];
+
+      if (icon == nil)
+        {
+          baseIcon = [[NSWorkspace sharedWorkspace] iconForFileType: @""];
+          if (baseIcon)
+            icon = [self cachedIconOfSize: size
+                                   forKey: @"FSNPlaceholderIcon"
+                              addBaseIcon: baseIcon];
+        }
+      return icon;
+    }
+
   if ([node isDirectory])
     {  
       if ([node isApplication])
@@ -187,9 +336,28 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 	}
       else if ([node isMountPoint] || [volumes containsObject: nodepath])
 	{
-	  /* Check if the mounted volume has a custom .VolumeIcon.icns */
-	  NSString *volumeIconPath = [nodepath stringByAppendingPathComponent: @".VolumeIcon.icns"];
-	  if ([fm isReadableFileAtPath: volumeIconPath])
+	  /* Check if the mounted volume has a custom .VolumeIcon.icns; the
+	     mount table remembers the answer while the volume is mounted */
+	  FSNMountTable *mtable = [FSNMountTable sharedTable];
+	  NSString *volumeIconPath = nil;
+
+	  if ([mtable isMountPointAtPath: nodepath])
+	    {
+	      volumeIconPath = [mtable volumeIconPathForMountPoint: nodepath];
+	    }
+	  else
+	    {
+	      volumeIconPath = [nodepath stringByAppendingPathComponent: @".VolumeIcon.icns"];
+	      if ([fm isReadableFileAtPath: volumeIconPath] == NO)
+		volumeIconPath = nil;
+	    }
+
+	  if (volumeIconPath && [self cachedIconsForKey: volumeIconPath])
+	    {
+	      key = volumeIconPath;
+	      icon = [self cachedIconOfSize: size forKey: key];
+	    }
+	  else if (volumeIconPath)
 	    {
 	      /* Use the custom volume icon from the mounted image */
 	      key = volumeIconPath;
@@ -206,7 +374,7 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 		  /* Cache the custom volume icon so cached lookups return it and we use it as base */
 		  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
 		  [dict setObject: icon forKey: [NSNumber numberWithInt: 48]];
-		  [iconsCache setObject: dict forKey: key];
+		  [self setCachedIcons: dict forKey: key];
 		  /* Use cached/resized icon with proper sizing for the requested size */
 		  baseIcon = icon;
 		  icon = [self cachedIconOfSize: size forKey: key addBaseIcon: baseIcon];
@@ -239,7 +407,7 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 			  /* Cache the base CD icon so cached lookups return it and we use it as base */
 			  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
 			  [dict setObject: icon forKey: [NSNumber numberWithInt: 48]];
-			  [iconsCache setObject: dict forKey: key];
+			  [self setCachedIcons: dict forKey: key];
 			  /* Use cached/resized icon immediately for the requested size */
 			  icon = [self cachedIconOfSize: size forKey: key];
 			}
@@ -474,7 +642,7 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 - (NSImage *)cachedIconOfSize:(int)size 
                        forKey:(NSString *)key
 {
-  NSMutableDictionary *dict = [iconsCache objectForKey: key];
+  NSMutableDictionary *dict = [self cachedIconsForKey: key];
   
   if (dict != nil) {
     NSNumber *num = [NSNumber numberWithInt: size];
@@ -484,12 +652,22 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
       NSImage *baseIcon = [dict objectForKey: [NSNumber numberWithInt: 48]];
     
       icon = [self resizedIcon: baseIcon ofSize: size];
+      if (icon == nil) {
+        return nil;
+      }
       [dict setObject: icon forKey: num];
+      iconsCacheBytes += iconCacheCost(icon);
+      iconsCacheMisses++;
+      [self trimIconsCache];
+    } else {
+      iconsCacheHits++;
     }
 
     return icon;
   }
 
+  iconsCacheMisses++;
+
   return nil;
 }
 
@@ -507,14 +685,132 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
   }  
 
   [dict setObject: baseIcon forKey: [NSNumber numberWithInt: basesize]];
-  [iconsCache setObject: dict forKey: key];
+  [self setCachedIcons: dict forKey: key];
   
   return [self cachedIconOfSize: size forKey: key];
 }
 
 - (void)removeCachedIconsForKey:(NSString *)key
 {
-  [iconsCache removeObjectForKey: key];
+  NSDictionary *dict = [iconsCache objectForKey: key];
+
+  if (dict != nil) {
+    unsigned long long cost = iconsCacheEntryCost(dict);
+
+    iconsCacheBytes = (cost < iconsCacheBytes) ? iconsCacheBytes - cost : 0;
+    [iconsCacheOrder removeObject: key];
+    [iconsCache removeObjectForKey: key];
+  }
+}
+
+- (void)removeAllCachedIcons
+{
+  [iconsCache removeAllObjects];
+  [iconsCacheOrder removeAllObjects];
+  iconsCacheBytes = 0;
+}
+
+- (NSMutableDictionary *)cachedIconsForKey:(NSString *)key
+{
+  NSMutableDictionary *dict = [iconsCache objectForKey: key];
+
+  if (dict != nil) {
+    [iconsCacheOrder removeObject: key];
+    [iconsCacheOrder addObject: key];
+  }
+
+  return dict;
+}
+
+- (void)setCachedIcons:(NSMutableDictionary *)dict
+                forKey:(NSString *)key
+{
+  [self removeCachedIconsForKey: key];
+
+  [iconsCache setObject: dict forKey: key];
+  [iconsCacheOrder addObject: key];
+  iconsCacheBytes += iconsCacheEntryCost(dict);
+
+  [self trimIconsCache];
+}
+
+/* Evicts least recently used keys until both limits hold.  The most
+ * recent key is always kept, so an entry just stored can be read back. */
+- (void)trimIconsCache
+{
+  while ([iconsCacheOrder count] > 1
+         && ((iconsCacheMaxBytes && (iconsCacheBytes > iconsCacheMaxBytes))
+             || (iconsCacheMaxEntries && ([iconsCacheOrder count] > iconsCacheMaxEntries)))) {
+    NSString *key = [iconsCacheOrder objectAtIndex: 0];
+
+    [self removeCachedIconsForKey: key];
+    iconsCacheEvictions++;
+  }
+}
+
+- (void)setIconsCacheMaxBytes:(unsigned long long)bytes
+                   maxEntries:(NSUInteger)entries
+{
+  iconsCacheMaxBytes = bytes;
+  iconsCacheMaxEntries = entries;
+  [self trimIconsCache];
+}
+
+- (void)loadIconAtlas
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  NSString *theme = [[GSTheme theme] name];
+  FSNIconAtlas *atlas;
+
+  if (theme == nil)
+    theme = @"";
+
+  ASSIGN (iconAtlasTheme, theme);
+
+  atlas = [[FSNIconAtlas alloc] initWithContentsOfFile: [FSNIconAtlas atlasPathForTheme: theme]
+                                                 theme: theme];
+  if (atlas) {
+    NSDictionary *icons = [atlas icons];
+    NSEnumerator *e = [icons keyEnumerator];
+    NSString *key;
+
+    while ((key = [e nextObject]) != nil) {
+      if ([iconsCache objectForKey: key] == nil) {
+        [self setCachedIcons: [icons objectForKey: key] forKey: key];
+      }
+    }
+
+    NSDebugLLog(@"gwspace", @"FSNodeRepIcons: %lu icon keys from the atlas of theme '%@'",
+                (unsigned long)[icons count], theme);
+    RELEASE (atlas);
+  }
+
+  RELEASE (arp);
+}
+
+- (void)saveIconAtlas
+{
+  if (iconAtlasTheme == nil || [iconsCache count] == 0)
+    return;
+
+  if ([FSNIconAtlas writeIcons: iconsCache
+                      forTheme: iconAtlasTheme
+                        toFile: [FSNIconAtlas atlasPathForTheme: iconAtlasTheme]] == NO) {
+    NSDebugLLog(@"gwspace", @"FSNodeRepIcons: unable to write the icon atlas");
+  }
+}
+
+- (NSDictionary *)iconsCacheStatistics
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLong: iconsCacheHits], @"hits",
+    [NSNumber numberWithUnsignedLong: iconsCacheMisses], @"misses",
+    [NSNumber numberWithUnsignedLong: iconsCacheEvictions], @"evictions",
+    [NSNumber numberWithUnsignedLongLong: iconsCacheBytes], @"bytes",
+    [NSNumber numberWithUnsignedLongLong: iconsCacheMaxBytes], @"maxBytes",
+    [NSNumber numberWithUnsignedInteger: [iconsCacheOrder count]], @"entries",
+    [NSNumber numberWithUnsignedInteger: iconsCacheMaxEntries], @"maxEntries",
+    nil];
 }
 
 - (NSImage *)multipleSelectionIconOfSize:(int)size
@@ -642,9 +938,45 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
   float fact = (icnsize.width >= icnsize.height) ? (icnsize.width / size) : (icnsize.height / size);
   NSSize newsize = NSMakeSize(floor(icnsize.width / fact + 0.5), floor(icnsize.height / fact + 0.5));	
   NSRect dstr = NSMakeRect(0, 0, newsize.width, newsize.height);
+  NSBitmapImageRep *srcrep = rgbBitmapOfIcon(icon, YES);
   NSImage *newIcon = [[NSImage alloc] initWithSize: newsize];
   NSBitmapImageRep *rep = nil;
-  
+
+  /* A pure downscale of an RGBA bitmap is averaged directly; anything
+     else (vector reps, upscaling, odd formats) is drawn as before. */
+  if (srcrep != nil
+      && [srcrep pixelsWide] >= newsize.width
+      && [srcrep pixelsHigh] >= newsize.height)
+    {
+      rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
+                                                    pixelsWide: (NSInteger)newsize.width
+                                                    pixelsHigh: (NSInteger)newsize.height
+                                                 bitsPerSample: 8
+                                               samplesPerPixel: 4
+                                                      hasAlpha: YES
+                                                      isPlanar: NO
+                                                colorSpaceName: [srcrep colorSpaceName]
+                                                   bytesPerRow: 0
+                                                  bitsPerPixel: 0];
+
+      if (rep != nil
+          && FSNRasterDownscale([srcrep bitmapData],
+                                [srcrep pixelsWide], [srcrep pixelsHigh],
+                                [srcrep bytesPerRow],
+                                [rep bitmapData],
+                                [rep pixelsWide], [rep pixelsHigh],
+                                [rep bytesPerRow], 4))
+        {
+          [newIcon addRepresentation: rep];
+          RELEASE (rep);
+          RELEASE (arp);
+
+          return AUTORELEASE (newIcon);
+        }
+
+      DESTROY (rep);
+    }
+
   [newIcon lockFocus];
 
   [icon drawInRect: dstr 
@@ -813,176 +1145,73 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 
 - (NSImage *)lighterIcon:(NSImage *)icon
 {
-  CREATE_AUTORELEASE_POOL(arp);
-  NSData *tiffdata = [icon TIFFRepresentation];
-  NSBitmapImageRep *rep = [NSBitmapImageRep imageRepWithData: tiffdata];
-  int samplesPerPixel = [rep samplesPerPixel];
-  int bitsPerPixel = [rep bitsPerPixel];
-  NSImage *newIcon;
-
-	if (((samplesPerPixel == 3) && (bitsPerPixel == 24)) 
-              || ((samplesPerPixel == 4) && (bitsPerPixel == 32))) {
-    int pixelsWide = [rep pixelsWide];
-    int pixelsHigh = [rep pixelsHigh];
-    int bytesPerRow = [rep bytesPerRow];
-    NSBitmapImageRep *newrep;
-    unsigned char *srcData;
-    unsigned char *dstData;
-    unsigned char *psrc;
-    unsigned char *pdst;
-    unsigned char *limit;
-
-    newIcon = [[NSImage alloc] initWithSize: NSMakeSize(pixelsWide, pixelsHigh)];
-
-    newrep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
-                                pixelsWide: pixelsWide
-                                pixelsHigh: pixelsHigh
-                                bitsPerSample: 8
-                                samplesPerPixel: 4
-                                hasAlpha: YES
-                                isPlanar: NO
-                                colorSpaceName: NSDeviceRGBColorSpace
-                                bytesPerRow: 0
-                                bitsPerPixel: 0];
-
-    [newIcon addRepresentation: newrep];
-    RELEASE (newrep); 
-
-    srcData = [rep bitmapData];
-    dstData = [newrep bitmapData];
-    psrc = srcData;
-    pdst = dstData;
-
-    limit = srcData + pixelsHigh * bytesPerRow;
-
-    while (psrc < limit) {
-      *pdst++ = lighterLUT[*(psrc+0)];  
-      *pdst++ = lighterLUT[*(psrc+1)];  
-      *pdst++ = lighterLUT[*(psrc+2)];  
-      *pdst++ = (bitsPerPixel == 32) ? *(psrc+3) : 255;
-      psrc += (bitsPerPixel == 32) ? 4 : 3;
-    }
-
-  } else {
-    newIcon = [icon copy];
-  }
-
-  RELEASE (arp);
-
-  return [newIcon autorelease];  
+  return tintedIcon(icon, lighterLUT);
 }
 
 - (NSImage *)darkerIcon:(NSImage *)icon
 {
-  CREATE_AUTORELEASE_POOL(arp);
-  NSData *tiffdata = [icon TIFFRepresentation];
-  NSBitmapImageRep *rep = [NSBitmapImageRep imageRepWithData: tiffdata];
-  int samplesPerPixel = [rep samplesPerPixel];
-  int bitsPerPixel = [rep bitsPerPixel];
-  NSImage *newIcon;
+  return tintedIcon(icon, darkerLUT);
+}
 
-	if (((samplesPerPixel == 3) && (bitsPerPixel == 24)) 
-              || ((samplesPerPixel == 4) && (bitsPerPixel == 32))) {
-    int pixelsWide = [rep pixelsWide];
-    int pixelsHigh = [rep pixelsHigh];
-    int bytesPerRow = [rep bytesPerRow];
-    NSBitmapImageRep *newrep;
-    unsigned char *srcData;
-    unsigned char *dstData;
-    unsigned char *psrc;
-    unsigned char *pdst;
-    unsigned char *limit;
+- (void)prepareThumbnailsCache
+{
+  DESTROY (tumbsCache);
+  tumbsCache = [NSMutableDictionary new];
 
-    newIcon = [[NSImage alloc] initWithSize: NSMakeSize(pixelsWide, pixelsHigh)];
+  if (thumbnailStore == nil)
+    thumbnailStore = [[FSNThumbnailStore alloc] initWithDirectory: thumbnailDir
+                                                         writable: NO];
+  else
+    [thumbnailStore refresh];
+}
 
-    newrep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes: NULL
-                                pixelsWide: pixelsWide
-                                pixelsHigh: pixelsHigh
-                                bitsPerSample: 8
-                                samplesPerPixel: 4
-                                hasAlpha: YES
-                                isPlanar: NO
-                                colorSpaceName: NSDeviceRGBColorSpace
-                                bytesPerRow: 0
-                                bitsPerPixel: 0];
+- (NSImage *)thumbnailForPath:(NSString *)apath
+{
+  NSImage *tumb;
+  NSData *data;
 
-    [newIcon addRepresentation: newrep];
-    RELEASE (newrep); 
+  if ((usesThumbnails == NO) || (tumbsCache == nil))
+    return nil;
 
-    srcData = [rep bitmapData];
-    dstData = [newrep bitmapData];
-    psrc = srcData;
-    pdst = dstData;
+  tumb = [tumbsCache objectForKey: apath];
+  if (tumb)
+    return tumb;
 
-    limit = srcData + pixelsHigh * bytesPerRow;
+  /* the bytes are in the mapped store, decode them before the next call */
+  data = [thumbnailStore thumbnailDataForPath: apath];
+  if (data == nil)
+    return nil;
 
-    while (psrc < limit) {
-      *pdst++ = darkerLUT[*(psrc+0)];  
-      *pdst++ = darkerLUT[*(psrc+1)];  
-      *pdst++ = darkerLUT[*(psrc+2)];  
-      *pdst++ = (bitsPerPixel == 32) ? *(psrc+3) : 255;
-      psrc += (bitsPerPixel == 32) ? 4 : 3;
+  NS_DURING
+    {
+      tumb = [[NSImage alloc] initWithData: data];
     }
+  NS_HANDLER
+    {
+      NSDebugLLog(@"gwspace", @"BAD THUMBNAIL '%@'", apath);
+      tumb = nil;
+    }
+  NS_ENDHANDLER
 
-  } else {
-    newIcon = [icon copy];
-  }
-
-  RELEASE (arp);
-
-  return [newIcon autorelease];  
-}
-
-- (void)prepareThumbnailsCache
-{
-  NSString *dictName = @"thumbnails.plist";
-  NSString *dictPath = [thumbnailDir stringByAppendingPathComponent: dictName];
-  NSDictionary *tdict;
-
-  DESTROY (tumbsCache);
-  tumbsCache = [NSMutableDictionary new];
-  
-  if ([fm fileExistsAtPath: dictPath]) {
-    tdict = [NSDictionary dictionaryWithContentsOfFile: dictPath];
+  if (tumb == nil)
+    return nil;
 
-    if (tdict) {
-      NSArray *keys = [tdict allKeys];
-      int i;
+  if ([tumbsCache count] >= THUMBNAILS_CACHE_SIZE)
+    [tumbsCache removeAllObjects];
 
-      for (i = 0; i < [keys count]; i++) {
-        NSString *key = [keys objectAtIndex: i];
-        NSString *tumbname = [tdict objectForKey: key];
-        NSString *tumbpath = [thumbnailDir stringByAppendingPathComponent: tumbname]; 
+  [tumbsCache setObject: tumb forKey: apath];
+  RELEASE (tumb);
 
-        if ([fm fileExistsAtPath: tumbpath]) {
-          NSImage *tumb = nil;
-        
-          NS_DURING
-            {
-          tumb = [[NSImage alloc] initWithContentsOfFile: tumbpath];
-          
-          if (tumb) {
-            [tumbsCache setObject: tumb forKey: key];
-            RELEASE (tumb);
-          }
-            }
-          NS_HANDLER
-            {
-          NSDebugLLog(@"gwspace", @"BAD IMAGE '%@'", tumbpath);
-            }
-          NS_ENDHANDLER
-        }
-      }
-    }   
-  }
+  return tumb;
 }
 
-- (NSImage *)thumbnailForPath:(NSString *)apath
+- (NSDictionary *)thumbnailsStatistics
 {
-  if (usesThumbnails && tumbsCache) {
-    return [tumbsCache objectForKey: apath];
-  }
-  return nil;
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedInteger: [tumbsCache count]], @"entries",
+    [NSNumber numberWithUnsignedInteger: [thumbnailStore count]], @"storeEntries",
+    [NSNumber numberWithUnsignedLongLong: [thumbnailStore fileSize]], @"storeBytes",
+    nil];
 }
 
 /**
@@ -993,33 +1222,15 @@ static BOOL FSNodeRepHasAppImageMagic(NSString *path)
 {
   if (path == nil) return nil;
 
-  NSString *procMounts = @"/proc/mounts";
-  NSString *mountsContent;
-  mountsContent = [NSString stringWithContentsOfFile: procMounts
-                                             encoding: NSUTF8StringEncoding
-                                                error: NULL];
-  if (mountsContent == nil) return nil;
-
-  NSArray *lines = [mountsContent componentsSeparatedByString: @"\n"];
-  for (NSString *line in lines) {
-    if ([line length] == 0) continue;
-    NSArray *parts = [line componentsSeparatedByString: @" "];
-    if ([parts count] < 3) continue;
-    NSString *target = [parts objectAtIndex: 1];
-    if ([target isEqualToString: path]) {
-      NSString *fstype = [parts objectAtIndex: 2];
-      if ([fstype hasPrefix: @"fuse."]) {
-        NSImage *ic = [NSImage imageNamed: @"Network"];
-        if (ic == nil) {
-          ic = [NSImage imageNamed: @"Computer"];
-        }
-        if (ic) {
-          [ic setScalesWhenResized: YES];
-          [ic setSize: NSMakeSize(48, 48)];
-          return ic;
-        }
-      }
-      break;
+  if ([[FSNMountTable sharedTable] isNetworkVolumeAtPath: path]) {
+    NSImage *ic = [NSImage imageNamed: @"Network"];
+    if (ic == nil) {
+      ic = [NSImage imageNamed: @"Computer"];
+    }
+    if (ic) {
+      [ic setScalesWhenResized: YES];
+      [ic setSize: NSMakeSize(48, 48)];
+      return ic;
     }
   }
 
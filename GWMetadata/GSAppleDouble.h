@@ -74,14 +74,28 @@ typedef NS_ENUM(uint32_t, GSAppleDoubleEntryID) {
 @interface GSAppleDouble : NSObject <NSCopying>
 {
   NSMutableDictionary *_entries;  // NSNumber(entryID) -> NSData
+  NSMutableDictionary *_ranges;   // NSNumber(entryID) -> NSValue(NSRange) in _data
+  NSData *_data;                  // the blob parsed, or nil
 }
 
 /**
  * Designated initializer: parse an existing AppleDouble blob.
  * Returns nil if the data is not valid AppleDouble V2.
+ *
+ * Only the header and the entry descriptors are read.  The blob is kept,
+ * and the data of an entry is a view into it made when first asked for,
+ * never a copy: a sidecar with a large resource fork costs nothing for
+ * the parts nobody reads.
  */
 - (instancetype)initWithData:(NSData *)data;
 
+/**
+ * Parse the AppleDouble file at path.  A large file is mapped rather
+ * than read, so only the pages of the entries used are touched; nil if
+ * the file cannot be read or is not valid AppleDouble V2.
+ */
+- (instancetype)initWithContentsOfFile:(NSString *)path;
+
 /**
  * Create an empty AppleDouble container (for generation).
  */
@@ -127,7 +141,8 @@ typedef NS_ENUM(uint32_t, GSAppleDoubleEntryID) {
 
 /**
  * Parse an AppleDouble blob and return the Finder Info bytes,
- * or nil if not present. Convenience for quick access.
+ * or nil if not present. Convenience for quick access: only the header
+ * and the descriptors are read, and the result is a view into data.
  */
 + (NSData *)finderInfoFromAppleDoubleData:(NSData *)data;
 
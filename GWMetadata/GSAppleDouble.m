@@ -8,10 +8,26 @@
 
 #import "GSAppleDouble.h"
 #import <GNUstepBase/GNUstep.h>
+#include <sys/stat.h>
 
 /* Private interface for internal access to the entries dictionary */
 @interface GSAppleDouble (Private)
 - (NSMutableDictionary *)mutableEntries;
+- (NSMutableDictionary *)mutableRanges;
+- (void)setParsedData:(NSData *)data;
+@end
+
+/*
+ * The bytes of one entry, inside the blob it was parsed from.  Keeps the
+ * blob alive and copies nothing.
+ */
+@interface GSAppleDoubleEntryData : NSData
+{
+  NSData *_parent;
+  const void *_bytes;
+  NSUInteger _length;
+}
+- (id)initWithData:(NSData *)parent range:(NSRange)range;
 @end
 
 
@@ -36,6 +52,12 @@
  */
 #define APPLEDOUBLE_ENTRY_SIZE   12
 
+/*
+ * Sidecars larger than this are mapped by -initWithContentsOfFile:, a
+ * smaller one is cheaper to read than to map and unmap.
+ */
+#define APPLEDOUBLE_MAP_THRESHOLD  (64 * 1024)
+
 static uint32_t
 readBE32(const uint8_t *bytes)
 {
@@ -61,6 +83,122 @@ writeBE16(uint8_t *bytes, uint16_t value)
   bytes[1] =  value       & 0xFF;
 }
 
+/*
+ * Validate the header of an AppleDouble blob.  Returns the number of
+ * entry descriptors and where they end, or NO if it is not AppleDouble V2.
+ */
+static BOOL
+readHeader(const uint8_t *bytes, NSUInteger length,
+           uint16_t *entryCount, NSUInteger *descriptorsEnd)
+{
+  /* Must be at least large enough for header + one entry descriptor */
+  if (length < APPLEDOUBLE_HEADER_SIZE + APPLEDOUBLE_ENTRY_SIZE)
+    return NO;
+
+  if (readBE32(bytes) != APPLEDOUBLE_MAGIC
+      || readBE32(bytes + 4) != APPLEDOUBLE_VERSION)
+    return NO;
+
+  *entryCount = (bytes[24] << 8) | bytes[25];
+
+  /* Check total size: header + entryCount descriptors */
+  *descriptorsEnd = APPLEDOUBLE_HEADER_SIZE
+                  + *entryCount * APPLEDOUBLE_ENTRY_SIZE;
+
+  return (*descriptorsEnd <= length);
+}
+
+/*
+ * The ID and the byte range of descriptor i, or NO for a malformed one.
+ */
+static BOOL
+readDescriptor(const uint8_t *bytes, NSUInteger length, uint16_t i,
+               NSUInteger descriptorsEnd, uint32_t *entryID, NSRange *range)
+{
+  const uint8_t *desc = bytes + APPLEDOUBLE_HEADER_SIZE
+                              + i * APPLEDOUBLE_ENTRY_SIZE;
+  uint32_t dataOff = readBE32(desc + 4);
+  uint32_t dataLen = readBE32(desc + 8);
+
+  /* Validate offset and length.  Compute the sum in 64-bit so a
+   * crafted (dataOff, dataLen) cannot wrap the 32-bit addition and
+   * slip past this bound check into an out-of-bounds read. */
+  if ((uint64_t)dataOff + (uint64_t)dataLen > length
+      || dataOff < descriptorsEnd)
+    return NO;
+
+  *entryID = readBE32(desc);
+  *range = NSMakeRange(dataOff, dataLen);
+  return YES;
+}
+
+/*
+ * Entry `wanted` of the blob, reading nothing but the header and the
+ * descriptors before it: a view into an immutable blob, a copy of the
+ * entry alone from a mutable one.
+ */
+static NSData *
+entryInData(NSData *data, uint32_t wanted)
+{
+  const uint8_t *bytes = [data bytes];
+  NSUInteger length = [data length];
+  NSUInteger descriptorsEnd;
+  uint16_t entryCount;
+  uint16_t i;
+
+  if (!readHeader(bytes, length, &entryCount, &descriptorsEnd))
+    return nil;
+
+  for (i = 0; i < entryCount; i++)
+    {
+      uint32_t entryID;
+      NSRange range;
+
+      if (readDescriptor(bytes, length, i, descriptorsEnd, &entryID, &range)
+          && entryID == wanted)
+        {
+          if ([data isKindOfClass: [NSMutableData class]])
+            return [data subdataWithRange: range];
+          return AUTORELEASE([[GSAppleDoubleEntryData alloc]
+                               initWithData: data range: range]);
+        }
+    }
+
+  return nil;
+}
+
+@implementation GSAppleDoubleEntryData
+
+- (id)initWithData:(NSData *)parent range:(NSRange)range
+{
+  self = [super init];
+  if (self)
+    {
+      _parent = RETAIN(parent);
+      _bytes = (const uint8_t *)[parent bytes] + range.location;
+      _length = range.length;
+    }
+  return self;
+}
+
+- (void)dealloc
+{
+  DESTROY(_parent);
+  [super dealloc];
+}
+
+- (const void *)bytes
+{
+  return _bytes;
+}
+
+- (NSUInteger)length
+{
+  return _length;
+}
+
+@end
+
 @implementation GSAppleDouble
 
 - (instancetype)init
@@ -69,89 +207,79 @@ writeBE16(uint8_t *bytes, uint16_t value)
   if (self)
     {
       _entries = [[NSMutableDictionary alloc] initWithCapacity: 4];
+      _ranges = [[NSMutableDictionary alloc] initWithCapacity: 4];
     }
   return self;
 }
 
 - (instancetype)initWithData:(NSData *)data
 {
-  self = [super init];
+  self = [self init];
   if (!self)
     return nil;
 
-  _entries = [[NSMutableDictionary alloc] initWithCapacity: 4];
-
   const uint8_t *bytes = [data bytes];
   NSUInteger length = [data length];
+  NSUInteger descriptorsEnd;
+  uint16_t entryCount;
 
-  /* Must be at least large enough for header + one entry descriptor */
-  if (length < APPLEDOUBLE_HEADER_SIZE + APPLEDOUBLE_ENTRY_SIZE)
-    {
-      DESTROY(self);
-      return nil;
-    }
-
-  /* Validate magic */
-  uint32_t magic = readBE32(bytes);
-  if (magic != APPLEDOUBLE_MAGIC)
-    {
-      DESTROY(self);
-      return nil;
-    }
-
-  /* Validate version */
-  uint32_t version = readBE32(bytes + 4);
-  if (version != APPLEDOUBLE_VERSION)
+  if (!readHeader(bytes, length, &entryCount, &descriptorsEnd))
     {
       DESTROY(self);
       return nil;
     }
 
-  /* Read entry count */
-  uint16_t entryCount = (bytes[24] << 8) | bytes[25];
-
-  /* Check total size: header + entryCount descriptors + data */
-  NSUInteger descriptorsEnd = APPLEDOUBLE_HEADER_SIZE
-                            + entryCount * APPLEDOUBLE_ENTRY_SIZE;
-  if (descriptorsEnd > length)
-    {
-      DESTROY(self);
-      return nil;
-    }
-
-  /* Parse each entry descriptor */
+  /* Note where each entry is; its data is only looked at when asked for */
   {
     uint16_t i;
     for (i = 0; i < entryCount; i++)
     {
-      NSUInteger descOffset = APPLEDOUBLE_HEADER_SIZE
-                            + i * APPLEDOUBLE_ENTRY_SIZE;
-      const uint8_t *desc = bytes + descOffset;
+      uint32_t entryID;
+      NSRange range;
 
-      uint32_t entryID  = readBE32(desc);
-      uint32_t dataOff  = readBE32(desc + 4);
-      uint32_t dataLen  = readBE32(desc + 8);
-
-      /* Validate offset and length.  Compute the sum in 64-bit so a
-       * crafted (dataOff, dataLen) cannot wrap the 32-bit addition and
-       * slip past this bound check into an out-of-bounds read below. */
-      if ((uint64_t)dataOff + (uint64_t)dataLen > length
-          || dataOff < descriptorsEnd)
+      if (!readDescriptor(bytes, length, i, descriptorsEnd, &entryID, &range))
         {
           /* Malformed entry; skip it rather than failing entirely */
           continue;
         }
 
-      NSData *entryData = [NSData dataWithBytes: bytes + dataOff
-                                         length: dataLen];
-      [_entries setObject: entryData
-                   forKey: [NSNumber numberWithUnsignedInt: entryID]];
+      [_ranges setObject: [NSValue valueWithRange: range]
+                  forKey: [NSNumber numberWithUnsignedInt: entryID]];
     }
   }
 
+  /* An immutable blob is kept as it is; a mutable one could change
+   * under the views. */
+  _data = [data copy];
+
   return self;
 }
 
+- (instancetype)initWithContentsOfFile:(NSString *)path
+{
+  struct stat st;
+  NSData *data;
+
+  if (stat([path fileSystemRepresentation], &st) != 0)
+    {
+      DESTROY(self);
+      return nil;
+    }
+
+  if (st.st_size > APPLEDOUBLE_MAP_THRESHOLD)
+    data = [NSData dataWithContentsOfMappedFile: path];
+  else
+    data = [NSData dataWithContentsOfFile: path];
+
+  if (data == nil)
+    {
+      DESTROY(self);
+      return nil;
+    }
+
+  return [self initWithData: data];
+}
+
 - (id)copyWithZone:(NSZone *)zone
 {
   GSAppleDouble *copy = [[GSAppleDouble allocWithZone: zone] init];
@@ -160,12 +288,16 @@ writeBE16(uint8_t *bytes, uint16_t value)
       id value = [_entries objectForKey: key];
       [[copy mutableEntries] setObject: value forKey: key];
     }
+  [[copy mutableRanges] addEntriesFromDictionary: _ranges];
+  [copy setParsedData: _data];
   return copy;
 }
 
 - (void)dealloc
 {
   DESTROY(_entries);
+  DESTROY(_ranges);
+  DESTROY(_data);
   [super dealloc];
 }
 
@@ -174,18 +306,56 @@ writeBE16(uint8_t *bytes, uint16_t value)
   return _entries;
 }
 
+- (NSMutableDictionary *)mutableRanges
+{
+  return _ranges;
+}
+
+- (void)setParsedData:(NSData *)data
+{
+  ASSIGN(_data, data);
+}
+
 - (void)setEntry:(GSAppleDoubleEntryID)entryID data:(NSData *)data
 {
+  NSNumber *key = [NSNumber numberWithUnsignedInt: entryID];
+
+  [_ranges removeObjectForKey: key];
   if (data)
-    [_entries setObject: data
-                 forKey: [NSNumber numberWithUnsignedInt: entryID]];
+    [_entries setObject: data forKey: key];
   else
-    [_entries removeObjectForKey: [NSNumber numberWithUnsignedInt: entryID]];
+    [_entries removeObjectForKey: key];
 }
 
 - (NSData *)dataForEntry:(GSAppleDoubleEntryID)entryID
 {
-  return [_entries objectForKey: [NSNumber numberWithUnsignedInt: entryID]];
+  NSNumber *key = [NSNumber numberWithUnsignedInt: entryID];
+  NSData *data = [_entries objectForKey: key];
+
+  if (data == nil)
+    {
+      NSValue *range = [_ranges objectForKey: key];
+
+      if (range)
+        {
+          data = [[GSAppleDoubleEntryData alloc] initWithData: _data
+                                                        range: [range rangeValue]];
+          [_entries setObject: data forKey: key];
+          [_ranges removeObjectForKey: key];
+          RELEASE(data);
+        }
+    }
+
+  return data;
+}
+
+/* Every entry ID present, read or not yet. */
+- (NSArray *)entryIDs
+{
+  NSMutableArray *ids = [NSMutableArray arrayWithArray: [_entries allKeys]];
+
+  [ids addObjectsFromArray: [_ranges allKeys]];
+  return ids;
 }
 
 - (NSData *)finderInfo
@@ -220,7 +390,7 @@ writeBE16(uint8_t *bytes, uint16_t value)
 
 - (NSData *)appleDoubleData
 {
-  NSArray *sortedIDs = [[_entries allKeys] sortedArrayUsingSelector:
+  NSArray *sortedIDs = [[self entryIDs] sortedArrayUsingSelector:
     @selector(compare:)];
   NSUInteger entryCount = [sortedIDs count];
 
@@ -235,7 +405,7 @@ writeBE16(uint8_t *bytes, uint16_t value)
   NSMutableArray *dataBlocks = [NSMutableArray arrayWithCapacity: entryCount];
   for (NSNumber *key in sortedIDs)
     {
-      NSData *entryData = [_entries objectForKey: key];
+      NSData *entryData = [self dataForEntry: [key unsignedIntValue]];
       [dataBlocks addObject: entryData];
       totalSize += [entryData length];
     }
@@ -283,33 +453,19 @@ writeBE16(uint8_t *bytes, uint16_t value)
 
 + (NSData *)finderInfoFromAppleDoubleData:(NSData *)data
 {
-  GSAppleDouble *ad = [[self alloc] initWithData: data];
-  NSData *fi = nil;
-  if (ad)
-    {
-      fi = [[ad finderInfo] retain];
-      DESTROY(ad);
-    }
-  return [fi autorelease];
+  return entryInData(data, GSAppleDoubleFinderInfo);
 }
 
 + (NSData *)resourceForkFromAppleDoubleData:(NSData *)data
 {
-  GSAppleDouble *ad = [[self alloc] initWithData: data];
-  NSData *rf = nil;
-  if (ad)
-    {
-      rf = [[ad resourceFork] retain];
-      DESTROY(ad);
-    }
-  return [rf autorelease];
+  return entryInData(data, GSAppleDoubleResourceFork);
 }
 
 - (NSString *)description
 {
   return [NSString stringWithFormat:
     @"<GSAppleDouble: entries=%@ finderInfo=%@ resourceFork=%lu bytes>",
-    [_entries allKeys],
+    [self entryIDs],
     ([self hasFinderInfo] ? @"YES" : @"NO"),
     (unsigned long)[[self resourceFork] length]];
 }
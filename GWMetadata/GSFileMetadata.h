@@ -73,6 +73,15 @@ typedef NS_ENUM(NSInteger, GSFileLabel) {
 #define GSXATTR_TEXTENCODING     @"user.com.apple.TextEncoding"
 #define GSXATTR_QUARANTINE       @"user.com.apple.quarantine"
 
+/**
+ * What +setFileProbe: takes.
+ */
+@protocol GSFileMetadataProbe <NSObject>
+- (BOOL)isKnownMissingFileAtPath:(NSString *)path;
+- (void)noteMissingFileAtPath:(NSString *)path;
+- (void)noteCreatedFileAtPath:(NSString *)path;
+@end
+
 /**
  * GSFileMetadata encapsulates all macOS file metadata and provides
  * read/write access via xattrs (primary) or AppleDouble sidecar files
@@ -181,13 +190,35 @@ typedef NS_ENUM(NSInteger, GSFileLabel) {
 
 /**
  * Cache control for +metadataForFileAtPath:.  The default read path caches
- * results (including "no metadata") keyed by path.  Callers that change a
- * file's metadata out of band should invalidate; the shared read caches are
- * also flushed wholesale on directory refresh.
+ * results (including "no metadata") keyed by path, in a bounded cache that
+ * is safe to use from any thread.  Callers that change a file's metadata
+ * out of band should invalidate; the shared read caches are also flushed
+ * wholesale on directory refresh and per path on fswatcher events.
  */
 + (void)invalidateAllCachedMetadata;
 + (void)invalidateCachedMetadataForPath:(NSString *)path;
 
+/** Number of paths held in the read cache, both generations. */
++ (NSUInteger)cachedMetadataCount;
+
+/**
+ * Asked before a ._ sidecar is opened, and told of the sidecars missing
+ * and written, so that a sidecar known to be missing, e.g. on a network
+ * volume, costs no round trip.  Not retained; nil, the default, opens
+ * every one.
+ */
++ (void)setFileProbe:(id <GSFileMetadataProbe>)probe;
+
+/**
+ * Fills the cache for every file in `dirPath` in one pass: the directory
+ * listing tells which files have a ._ sidecar, and a single listxattr per
+ * file tells which have Finder xattrs, so only those are actually read.
+ * Files already cached are not read again.  Returns the files that have
+ * metadata, as file name -> GSFileMetadata.  Safe to call off the main
+ * thread.
+ */
++ (NSDictionary *)prefetchMetadataForDirectory:(NSString *)dirPath;
+
 /**
  * Write metadata to a file path.
  * Tries xattrs first; falls back to creating/updating a ._ sidecar file.
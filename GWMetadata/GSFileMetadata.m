@@ -10,6 +10,7 @@
 #import "GWMetaXattr.h"
 #import <GNUstepBase/GNUstep.h>
 #import <string.h>
+#import <errno.h>
 
 /*
  * Marker used for "no position" in FinderInfo fdLocation.
@@ -399,26 +400,102 @@ host_to_be16(uint8_t *bytes, uint16_t value)
  * a cache.  A negative result is cached as NSNull so unlabeled files (the
  * majority) stop re-probing on every redraw.  Cleared by
  * +invalidateAllCachedMetadata (wired to the same refresh events that
- * clear FSNodeRep's icon cache) and per-path on write.  Main-thread only.
+ * clear FSNodeRep's icon cache) and per-path on write or fswatcher events.
+ *
+ * The cache is two generations of at most GS_METADATA_CACHE_GENERATION
+ * entries: new entries go into the young one, a hit in the old one moves
+ * the entry up, and when the young one is full the old one is dropped.
+ * That bounds it at twice the generation size with O(1) bookkeeping, so
+ * a 20k file folder cannot grow it forever.  All access is under
+ * _metadataCacheLock; the file reads themselves are done unlocked, so
+ * thumbnailers and indexers may call in from any thread.
  */
+#define GS_METADATA_CACHE_GENERATION (4096)
+
 static NSMutableDictionary *_metadataCache = nil;
+static NSMutableDictionary *_metadataCacheOld = nil;
+static NSLock *_metadataCacheLock = nil;
+static id <GSFileMetadataProbe> _fileProbe = nil;
+
++ (void)initialize
+{
+  if (self == [GSFileMetadata class] && _metadataCacheLock == nil)
+    {
+      _metadataCacheLock = [NSLock new];
+      _metadataCache = [NSMutableDictionary new];
+      _metadataCacheOld = [NSMutableDictionary new];
+    }
+}
+
+/* Must be called with _metadataCacheLock held. */
+static id
+cachedMetadataForPath(NSString *path)
+{
+  id cached = [_metadataCache objectForKey: path];
+
+  if (cached == nil)
+    {
+      cached = [_metadataCacheOld objectForKey: path];
+      if (cached != nil)
+        {
+          [_metadataCache setObject: cached forKey: path];
+          [_metadataCacheOld removeObjectForKey: path];
+        }
+    }
 
-+ (NSMutableDictionary *)_metadataCache
+  return cached;
+}
+
+/* Must be called with _metadataCacheLock held. */
+static void
+cacheMetadataForPath(id md, NSString *path)
 {
-  if (_metadataCache == nil)
-    _metadataCache = [[NSMutableDictionary alloc] init];
-  return _metadataCache;
+  if ([_metadataCache count] >= GS_METADATA_CACHE_GENERATION)
+    {
+      NSMutableDictionary *old = _metadataCacheOld;
+
+      _metadataCacheOld = _metadataCache;
+      _metadataCache = old;
+      [_metadataCache removeAllObjects];
+    }
+
+  [_metadataCacheOld removeObjectForKey: path];
+  [_metadataCache setObject: (md ? md : (id)[NSNull null]) forKey: path];
 }
 
 + (void)invalidateAllCachedMetadata
 {
+  [_metadataCacheLock lock];
   [_metadataCache removeAllObjects];
+  [_metadataCacheOld removeAllObjects];
+  [_metadataCacheLock unlock];
+}
+
++ (NSUInteger)cachedMetadataCount
+{
+  NSUInteger count;
+
+  [_metadataCacheLock lock];
+  count = [_metadataCache count] + [_metadataCacheOld count];
+  [_metadataCacheLock unlock];
+
+  return count;
 }
 
 + (void)invalidateCachedMetadataForPath:(NSString *)path
 {
-  if (path)
-    [_metadataCache removeObjectForKey: path];
+  if (path == nil)
+    return;
+
+  [_metadataCacheLock lock];
+  [_metadataCache removeObjectForKey: path];
+  [_metadataCacheOld removeObjectForKey: path];
+  [_metadataCacheLock unlock];
+}
+
++ (void)setFileProbe:(id <GSFileMetadataProbe>)probe
+{
+  _fileProbe = probe;
 }
 
 + (GSFileMetadata *)metadataForFileAtPath:(NSString *)path
@@ -426,16 +503,195 @@ static NSMutableDictionary *_metadataCache = nil;
   if (!path || [path length] == 0)
     return nil;
 
-  NSMutableDictionary *cache = [self _metadataCache];
-  id cached = [cache objectForKey: path];
+  [_metadataCacheLock lock];
+  id cached = RETAIN (cachedMetadataForPath(path));
+  [_metadataCacheLock unlock];
+
   if (cached != nil)
-    return (cached == [NSNull null]) ? nil : cached;
+    {
+      AUTORELEASE (cached);
+      return (cached == [NSNull null]) ? nil : cached;
+    }
 
   GSFileMetadata *md = [self metadataForFileAtPath: path forceSidecar: NO];
-  [cache setObject: (md ? (id)md : (id)[NSNull null]) forKey: path];
+
+  [_metadataCacheLock lock];
+  cacheMetadataForPath(md, path);
+  [_metadataCacheLock unlock];
+
   return md;
 }
 
+/*
+ * Fill md from the attributes read by gs_xattr_list_for_path().  YES if
+ * any of ours was there.
+ */
+static BOOL
+readMetadataFromXattrList(GSFileMetadata *md, const gs_xattr_list_t *list)
+{
+  const gs_xattr_entry_t *entry;
+  BOOL found = NO;
+
+  entry = gs_xattr_list_find(list, [GSXATTR_FINDERINFO UTF8String]);
+  if (entry && entry->size >= 32)
+    {
+      md.finderInfo = [NSData dataWithBytes: entry->value length: entry->size];
+      found = YES;
+    }
+
+  entry = gs_xattr_list_find(list, [GSXATTR_RESOURCEFORK UTF8String]);
+  if (entry && entry->size > 0)
+    {
+      md.resourceFork = [NSData dataWithBytes: entry->value length: entry->size];
+      found = YES;
+    }
+
+  entry = gs_xattr_list_find(list, [GSXATTR_FINDERCOMMENT UTF8String]);
+  if (entry && entry->size > 0)
+    {
+      NSString *comment = [[NSString alloc] initWithBytes: entry->value
+                                                   length: entry->size
+                                                 encoding: NSUTF8StringEncoding];
+      if (comment)
+        {
+          md.finderComment = comment;
+          RELEASE(comment);
+        }
+      found = YES;
+    }
+
+  return found;
+}
+
+typedef struct {
+  NSString *dirPath;
+  NSSet *sidecars;
+  NSSet *cached;
+  NSMutableArray *paths;
+  NSMutableArray *found;
+} GSPrefetchContext;
+
+static int
+prefetchFilter(const char *name, void *context)
+{
+  GSPrefetchContext *ctx = context;
+  NSString *str;
+
+  if (name[0] == '.' && name[1] == '_')
+    return 0;
+
+  str = [[NSFileManager defaultManager]
+          stringWithFileSystemRepresentation: name length: strlen(name)];
+
+  return ([ctx->cached containsObject: str] == NO);
+}
+
+static void
+prefetchCallback(const char *name, const gs_xattr_list_t *list,
+                 int err, void *context)
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  GSPrefetchContext *ctx = context;
+  NSString *str = [[NSFileManager defaultManager]
+                    stringWithFileSystemRepresentation: name length: strlen(name)];
+  NSString *path = [ctx->dirPath stringByAppendingPathComponent: str];
+  GSFileMetadata *md = nil;
+
+  if (list)
+    {
+      md = [[[GSFileMetadata alloc] init] autorelease];
+
+      if (readMetadataFromXattrList(md, list) == NO
+          && ([ctx->sidecars containsObject: str] == NO
+              || [md readSidecarForPath: path] == NO))
+        md = nil;
+    }
+  else if (err != ENOENT)
+    {
+      /* an attribute that vanished or grew past the cap mid-read */
+      md = [GSFileMetadata metadataForFileAtPath: path forceSidecar: NO];
+    }
+
+  [ctx->paths addObject: path];
+  [ctx->found addObject: (md ? (id)md : (id)[NSNull null])];
+
+  RELEASE (arp);
+}
+
++ (NSDictionary *)prefetchMetadataForDirectory:(NSString *)dirPath
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  NSMutableDictionary *result = [NSMutableDictionary new];
+  NSArray *names = [[NSFileManager defaultManager] directoryContentsAtPath: dirPath];
+  NSMutableSet *sidecars = [NSMutableSet set];
+  NSMutableSet *cached = [NSMutableSet set];
+  NSUInteger count = [names count];
+  GSPrefetchContext ctx;
+  NSUInteger i;
+
+  /* The listing says which files have a ._ sidecar, so no file needs
+   * an open() probe to find out it has none. */
+  for (i = 0; i < count; i++)
+    {
+      NSString *name = [names objectAtIndex: i];
+
+      if ([name hasPrefix: @"._"])
+        [sidecars addObject: [name substringFromIndex: 2]];
+    }
+
+  [_metadataCacheLock lock];
+  for (i = 0; i < count; i++)
+    {
+      NSString *name = [names objectAtIndex: i];
+
+      if ([name hasPrefix: @"._"] == NO)
+        {
+          id md = cachedMetadataForPath([dirPath stringByAppendingPathComponent: name]);
+
+          if (md != nil)
+            {
+              [cached addObject: name];
+              if (md != [NSNull null])
+                [result setObject: md forKey: name];
+            }
+        }
+    }
+  [_metadataCacheLock unlock];
+
+  /* One listxattr per file, and one getxattr per Finder attribute it
+   * does carry, in a single pass over the directory. */
+  ctx.dirPath = dirPath;
+  ctx.sidecars = sidecars;
+  ctx.cached = cached;
+  ctx.paths = [NSMutableArray arrayWithCapacity: count];
+  ctx.found = [NSMutableArray arrayWithCapacity: count];
+
+  gs_xattr_list_directory([dirPath fileSystemRepresentation], "user.com.apple.",
+                          prefetchFilter, prefetchCallback, &ctx);
+
+  [_metadataCacheLock lock];
+  for (i = 0; i < [ctx.paths count]; i++)
+    {
+      id md = [ctx.found objectAtIndex: i];
+      NSString *path = [ctx.paths objectAtIndex: i];
+
+      if (md == [NSNull null])
+        {
+          cacheMetadataForPath(nil, path);
+        }
+      else
+        {
+          cacheMetadataForPath(md, path);
+          [result setObject: md forKey: [path lastPathComponent]];
+        }
+    }
+  [_metadataCacheLock unlock];
+
+  RELEASE (arp);
+
+  return AUTORELEASE (result);
+}
+
 + (GSFileMetadata *)metadataForFileAtPath:(NSString *)path
                              forceSidecar:(BOOL)forceSidecar
 {
@@ -450,62 +706,16 @@ static NSMutableDictionary *_metadataCache = nil;
       return [md readSidecarForPath: path] ? md : nil;
     }
 
-  /* Try xattrs first */
+  /* Try xattrs first: one listxattr, and one getxattr for each of ours */
   BOOL found = NO;
+  gs_xattr_list_t *list = gs_xattr_list_for_path([path fileSystemRepresentation],
+                                                 "user.com.apple.");
 
-  /* Read FinderInfo via xattr */
-  {
-    const char *cpath = [path fileSystemRepresentation];
-    ssize_t size = gs_getxattr(cpath,
-                                [GSXATTR_FINDERINFO UTF8String],
-                                NULL, 0);
-    if (size >= 32)
-      {
-        NSMutableData *data = [NSMutableData dataWithLength: size];
-        gs_getxattr(cpath, [GSXATTR_FINDERINFO UTF8String],
-                    [data mutableBytes], size);
-        md.finderInfo = data;
-        found = YES;
-      }
-  }
-
-  /* Read ResourceFork via xattr */
-  {
-    const char *cpath = [path fileSystemRepresentation];
-    ssize_t size = gs_getxattr(cpath,
-                                [GSXATTR_RESOURCEFORK UTF8String],
-                                NULL, 0);
-    if (size > 0)
-      {
-        NSMutableData *data = [NSMutableData dataWithLength: size];
-        gs_getxattr(cpath, [GSXATTR_RESOURCEFORK UTF8String],
-                    [data mutableBytes], size);
-        md.resourceFork = data;
-        found = YES;
-      }
-  }
-
-  /* Read Finder comment via xattr */
-  {
-    const char *cpath = [path fileSystemRepresentation];
-    ssize_t size = gs_getxattr(cpath,
-                                [GSXATTR_FINDERCOMMENT UTF8String],
-                                NULL, 0);
-    if (size > 0)
-      {
-        NSMutableData *data = [NSMutableData dataWithLength: size];
-        gs_getxattr(cpath, [GSXATTR_FINDERCOMMENT UTF8String],
-                    [data mutableBytes], size);
-        NSString *comment = [[NSString alloc] initWithData: data
-                                                  encoding: NSUTF8StringEncoding];
-        if (comment)
-          {
-            md.finderComment = comment;
-            RELEASE(comment);
-          }
-        found = YES;
-      }
-  }
+  if (list)
+    {
+      found = readMetadataFromXattrList(md, list);
+      gs_xattr_list_free(list);
+    }
 
   /* If nothing found via xattrs, try sidecar */
   if (!found)
@@ -532,6 +742,8 @@ static NSMutableDictionary *_metadataCache = nil;
       return NO;
     }
 
+  [[self class] invalidateCachedMetadataForPath: path];
+
   if (_forceSidecar)
     return [self writeSidecarToFileAtPath: path error: error];
 
@@ -591,6 +803,8 @@ static NSMutableDictionary *_metadataCache = nil;
 {
   NSString *sidecarPath = [[self class] sidecarPathForFilePath: path];
 
+  [[self class] invalidateCachedMetadataForPath: path];
+
   /* Create AppleDouble blob */
   NSData *appleDoubleData = [self appleDoubleData];
   if (!appleDoubleData)
@@ -604,10 +818,10 @@ static NSMutableDictionary *_metadataCache = nil;
       return YES;
     }
 
-  /* Write the sidecar file */
-  BOOL written = [[NSFileManager defaultManager] createFileAtPath: sidecarPath
-                                                         contents: appleDoubleData
-                                                       attributes: nil];
+  /* Write the sidecar file.  Atomically: a sidecar read earlier may
+   * still be mapped, and truncating it in place would fault its views. */
+  BOOL written = [appleDoubleData writeToFile: sidecarPath atomically: YES];
+  [_fileProbe noteCreatedFileAtPath: sidecarPath];
   if (!written && error)
     {
       *error = [NSError errorWithDomain: NSCocoaErrorDomain
@@ -624,16 +838,23 @@ static NSMutableDictionary *_metadataCache = nil;
 - (BOOL)readSidecarForPath:(NSString *)path
 {
   NSString *sidecarPath = [[self class] sidecarPathForFilePath: path];
-  NSData *sidecarData = [NSData dataWithContentsOfFile: sidecarPath];
-  if (!sidecarData)
+  GSAppleDouble *ad;
+
+  if ([_fileProbe isKnownMissingFileAtPath: sidecarPath])
     return NO;
 
-  GSAppleDouble *ad = [[GSAppleDouble alloc] initWithData: sidecarData];
+  ad = [[GSAppleDouble alloc] initWithContentsOfFile: sidecarPath];
   if (!ad)
-    return NO;
+    {
+      if (![[NSFileManager defaultManager] fileExistsAtPath: sidecarPath])
+        [_fileProbe noteMissingFileAtPath: sidecarPath];
+      return NO;
+    }
 
+  /* The 32 bytes are copied out, so metadata kept in the cache does not
+   * hold on to the whole sidecar; the resource fork stays a view. */
   if ([ad hasFinderInfo])
-    self.finderInfo = [ad finderInfo];
+    self.finderInfo = [NSData dataWithData: [ad finderInfo]];
 
   if ([ad hasResourceFork])
     self.resourceFork = [ad resourceFork];
@@ -0,0 +1,119 @@
+/* GWArchiveIndex.h
+ *
+ * Browsing an archive without extracting it.
+ *
+ * The first time an archive is browsed its entries are read once, with
+ * libarchive, into an index kept under <Caches>/Workspace/Archives, keyed
+ * by the device, inode, size and modification time of the archive so that
+ * a changed archive is read again.  Next to the index a tree stands in for
+ * the archive: real directories, and for each file an empty sparse file of
+ * the entry's size and date, with no permissions until it is extracted.
+ * The viewers show this tree like any other; opening one of its files
+ * extracts just that entry into place.  The tree is read-only, as what
+ * is written in it would never reach the archive.
+ *
+ * Indexes whose archive is gone or has changed are removed, as are the
+ * ones unused for a month and, past 2 GB of extracted files, the least
+ * recently used.
+ *
+ * For uncompressed tar the index also records where each entry's header
+ * starts, so one entry is read without scanning the archive up to it.
+ * Other formats are read in order up to the entry, skipping the data of
+ * the ones before, which on uncompressed zip and tar is a seek.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GWARCHIVEINDEX_H
+#define GWARCHIVEINDEX_H
+
+#import <Foundation/Foundation.h>
+#import "GWMetaArchive.h"
+
+@interface GWArchiveIndex : NSObject
+{
+  NSString *archivePath;
+  NSString *cachePath;
+  NSDictionary *entries;        /* browsed name -> entry dictionary */
+  BOOL seekable;                /* the entries carry header offsets */
+}
+
+/**
+ * The directory the indexes and their trees are kept in.
+ */
++ (NSString *)cacheRoot;
+
+/**
+ * YES for the names of archives holding files: zip, tar and tar under a
+ * compressor, 7z, rar, cpio.  A compressed single file ("notes.txt.gz")
+ * holds no tree and is left to AVFS.
+ */
++ (BOOL)canBrowseArchiveAtPath:(NSString *)path;
+
+/**
+ * "<dev>-<inode>-<size>-<mtime>" in hex, nil if the archive cannot be
+ * stat'ed.
+ */
++ (NSString *)cacheKeyForArchiveAtPath:(NSString *)path;
+
+/**
+ * The relative path an entry is browsed at, absolute names made
+ * relative, or nil for the entries that are not shown (macOS metadata)
+ * or would land outside the tree ("..").
+ */
++ (NSString *)browsedNameForEntryName:(NSString *)ename;
+
+/**
+ * The index of the archive, read from the cache or built, reporting the
+ * bytes of the archive read with GWArchiveStageScanning.  nil with an
+ * error when libarchive cannot read it; a cancelled build fails with
+ * GWMetaArchiveCancelledError and leaves nothing behind.
+ */
++ (GWArchiveIndex *)indexForArchiveAtPath:(NSString *)path
+                                 progress:(GWArchiveProgressHandler)progress
+                                    error:(NSError **)error;
+
+/**
+ * The index of the archive if it is in the cache, without reading the
+ * archive.
+ */
++ (GWArchiveIndex *)cachedIndexForArchiveAtPath:(NSString *)path;
+
+/**
+ * The index whose tree holds `path`, or nil if `path` is not in one.
+ */
++ (GWArchiveIndex *)indexForBrowsedPath:(NSString *)path;
+
+/**
+ * Removes the indexes of archives that are gone or have changed, the
+ * unused ones and the least recently used ones over the size limit, but
+ * never the one of `key` nor one used in the last hour.  Reads every
+ * tree; not for the main thread.
+ */
++ (void)pruneCacheKeeping:(NSString *)key;
+
+- (NSString *)archivePath;
+
+/**
+ * The top of the tree standing in for the archive.
+ */
+- (NSString *)rootPath;
+
+- (NSUInteger)entryCount;
+
+/**
+ * YES when `path` is a file of the tree that has not been extracted yet.
+ */
+- (BOOL)isPendingEntryAtPath:(NSString *)path;
+
+/**
+ * Extracts the entry behind a file of the tree into place, reporting the
+ * bytes of the archive read with GWArchiveStageExtracting.
+ */
+- (BOOL)extractEntryAtPath:(NSString *)path
+                  progress:(GWArchiveProgressHandler)progress
+                     error:(NSError **)error;
+
+@end
+
+#endif /* GWARCHIVEINDEX_H */
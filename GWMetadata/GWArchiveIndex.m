@@ -0,0 +1,1012 @@
+/* GWArchiveIndex.m
+ *
+ * Browsing an archive without extracting it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "GWArchiveIndex.h"
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fts.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define INDEX_VERSION 1
+#define INDEX_FILE @"index.plist"
+#define ROOT_DIR @"root"
+#define READ_BLOCK_SIZE (1024 * 1024)
+
+/* unused this long, an index goes */
+#define CACHE_MAX_AGE (30 * 24 * 3600)
+/* above this, the least recently used go */
+#define CACHE_MAX_BYTES (2ULL * 1024 * 1024 * 1024)
+/* used this recently, an index may be browsed right now and stays */
+#define CACHE_IN_USE_AGE 3600
+
+/* cache key -> GWArchiveIndex, the ones read in this process */
+static NSMutableDictionary *loadedIndexes = nil;
+static NSLock *indexesLock = nil;
+/* held while a directory of a tree is writable */
+static NSLock *treeLock = nil;
+static NSLock *pruneLock = nil;
+
+
+static NSError *
+index_error(NSInteger code, NSString *desc)
+{
+  return [NSError errorWithDomain: @"GWArchiveIndex"
+                             code: code
+                         userInfo: @{NSLocalizedDescriptionKey: desc}];
+}
+
+static NSError *
+cancelled_error(void)
+{
+  return [NSError errorWithDomain: @"GWMetaArchive"
+                             code: GWMetaArchiveCancelledError
+                         userInfo: @{NSLocalizedDescriptionKey: @"Cancelled"}];
+}
+
+/* Every directory of the tree made unwritable, or writable again so that
+   the tree can be removed. */
+static void
+set_tree_writable(NSString *path, BOOL writable)
+{
+  char *paths[2] = { (char *)[path fileSystemRepresentation], NULL };
+  FTS *fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+  FTSENT *ent;
+
+  if (fts == NULL)
+    return;
+
+  /* up before entering a directory, down after leaving it */
+  while ((ent = fts_read(fts)) != NULL)
+    {
+      mode_t mode = ent->fts_statp->st_mode & 07777;
+
+      if (writable && (ent->fts_info == FTS_D))
+        chmod(ent->fts_accpath, mode | S_IRWXU);
+      else if ((writable == NO) && (ent->fts_info == FTS_DP))
+        chmod(ent->fts_accpath, mode & ~(S_IWUSR | S_IWGRP | S_IWOTH));
+    }
+
+  fts_close(fts);
+}
+
+static void
+remove_cache_dir(NSString *path)
+{
+  set_tree_writable(path, YES);
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+}
+
+/* The blocks in use, which stubs have none of. */
+static unsigned long long
+tree_bytes(NSString *path)
+{
+  char *paths[2] = { (char *)[path fileSystemRepresentation], NULL };
+  FTS *fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+  unsigned long long bytes = 0;
+  FTSENT *ent;
+
+  if (fts == NULL)
+    return 0;
+
+  while ((ent = fts_read(fts)) != NULL)
+    {
+      if ((ent->fts_info != FTS_DP) && (ent->fts_info != FTS_NS))
+        bytes += (unsigned long long)ent->fts_statp->st_blocks * 512;
+    }
+
+  fts_close(fts);
+
+  return bytes;
+}
+
+/* The last use of an index is the time of its directory. */
+static void
+mark_used(NSString *cpath)
+{
+  utimes([cpath fileSystemRepresentation], NULL);
+}
+
+/* `body` run with `dir` writable, one directory at a time. */
+static void
+in_writable_dir(NSString *dir, void (^body)(void))
+{
+  const char *cdir = [dir fileSystemRepresentation];
+  struct stat st;
+  BOOL restore;
+
+  [treeLock lock];
+  restore = ((stat(cdir, &st) == 0) && ((st.st_mode & S_IWUSR) == 0)
+             && (chmod(cdir, (st.st_mode & 07777) | S_IWUSR) == 0));
+  body();
+  if (restore)
+    chmod(cdir, st.st_mode & 07777);
+  [treeLock unlock];
+}
+
+static void
+set_file_time(int fd, time_t mtime)
+{
+  struct timeval tv[2];
+
+  tv[0].tv_sec = mtime;
+  tv[0].tv_usec = 0;
+  tv[1] = tv[0];
+  futimes(fd, tv);
+}
+
+/* Holes the archive records are seeked over, as in GWMetaArchive. */
+static int
+copy_entry_to_fd(struct archive *a, int fd, int64_t entrySize,
+                 GWArchiveProgressHandler progress,
+                 unsigned long long base, unsigned long long total,
+                 BOOL *cancelled)
+{
+  const void *buf;
+  size_t size;
+  int64_t offset;
+  int64_t position = 0;
+  int r;
+
+  for (;;)
+    {
+      r = archive_read_data_block(a, &buf, &size, &offset);
+      if (r == ARCHIVE_EOF) break;
+      if (r != ARCHIVE_OK)  return r;
+
+      if (offset > position)
+        {
+          if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+            return ARCHIVE_FATAL;
+          position = offset;
+        }
+
+      const char *p = buf;
+      size_t left = size;
+      while (left > 0)
+        {
+          ssize_t written = write(fd, p, left);
+          if (written < 0 && errno == EINTR)
+            continue;
+          if (written <= 0)
+            return ARCHIVE_FATAL;
+          p += written;
+          left -= (size_t)written;
+        }
+      position += (int64_t)size;
+
+      if (progress
+          && !progress(GWArchiveStageExtracting,
+                       base + (unsigned long long)archive_filter_bytes(a, -1),
+                       total))
+        {
+          *cancelled = YES;
+          return ARCHIVE_FATAL;
+        }
+    }
+
+  if (entrySize > position && ftruncate(fd, (off_t)entrySize) != 0)
+    return ARCHIVE_FATAL;
+
+  return ARCHIVE_OK;
+}
+
+
+@interface GWArchiveIndex (Private)
+- (id)initWithArchivePath:(NSString *)apath
+                cachePath:(NSString *)cpath
+                  entries:(NSDictionary *)dict
+                 seekable:(BOOL)seek;
++ (GWArchiveIndex *)loadIndexAtCachePath:(NSString *)cpath;
++ (BOOL)buildIndexForArchive:(NSString *)path
+                 atCachePath:(NSString *)cpath
+                    progress:(GWArchiveProgressHandler)progress
+                       error:(NSError **)error;
++ (NSString *)archivePathAtCachePath:(NSString *)cpath;
++ (void)removeIndexAtCachePath:(NSString *)cpath;
+- (NSString *)entryNameForPath:(NSString *)path;
+@end
+
+
+@implementation GWArchiveIndex
+
++ (void)initialize
+{
+  if (self == [GWArchiveIndex class])
+    {
+      loadedIndexes = [NSMutableDictionary new];
+      indexesLock = [NSLock new];
+      treeLock = [NSLock new];
+      pruneLock = [NSLock new];
+    }
+}
+
++ (NSString *)cacheRoot
+{
+  NSString *cacheDir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+                                                             NSUserDomainMask, YES) lastObject];
+
+  cacheDir = [cacheDir stringByAppendingPathComponent: @"Workspace"];
+
+  return [cacheDir stringByAppendingPathComponent: @"Archives"];
+}
+
++ (BOOL)canBrowseArchiveAtPath:(NSString *)path
+{
+  static NSSet *containers = nil;
+  static NSSet *compressors = nil;
+  NSString *ext = [[path pathExtension] lowercaseString];
+
+  if (containers == nil)
+    {
+      containers = [[NSSet alloc] initWithObjects:
+        @"zip", @"cbz", @"jar",
+        @"tar", @"tgz", @"tbz2", @"txz", @"tlz", @"tzst",
+        @"7z", @"rar", @"cbr", @"cpio", nil];
+      compressors = [[NSSet alloc] initWithObjects:
+        @"gz", @"bz2", @"xz", @"lzma", @"zst", nil];
+    }
+
+  if ([containers containsObject: ext])
+    return YES;
+
+  return ([compressors containsObject: ext]
+          && [[[[path stringByDeletingPathExtension] pathExtension]
+                lowercaseString] isEqual: @"tar"]);
+}
+
++ (NSString *)cacheKeyForArchiveAtPath:(NSString *)path
+{
+  struct stat st;
+
+  if ((path == nil) || (stat([path fileSystemRepresentation], &st) != 0))
+    return nil;
+
+  return [NSString stringWithFormat: @"%llx-%llx-%llx-%llx",
+                   (unsigned long long)st.st_dev,
+                   (unsigned long long)st.st_ino,
+                   (unsigned long long)st.st_size,
+                   (unsigned long long)st.st_mtime];
+}
+
++ (NSString *)browsedNameForEntryName:(NSString *)ename
+{
+  NSArray *parts = [ename componentsSeparatedByString: @"/"];
+  NSMutableArray *comps = [NSMutableArray arrayWithCapacity: [parts count]];
+  NSUInteger i;
+
+  for (i = 0; i < [parts count]; i++)
+    {
+      NSString *part = [parts objectAtIndex: i];
+
+      if (([part length] == 0) || [part isEqual: @"."])
+        continue;
+      if ([part isEqual: @".."])
+        return nil;
+
+      [comps addObject: part];
+    }
+
+  if ([comps count] == 0)
+    return nil;
+  if ([[comps objectAtIndex: 0] isEqual: @"__MACOSX"]
+      || [[comps lastObject] hasPrefix: @"._"])
+    return nil;
+
+  return [comps componentsJoinedByString: @"/"];
+}
+
++ (GWArchiveIndex *)cachedIndexForArchiveAtPath:(NSString *)path
+{
+  NSString *key = [self cacheKeyForArchiveAtPath: path];
+  GWArchiveIndex *index;
+
+  if (key == nil)
+    return nil;
+
+  [indexesLock lock];
+  index = RETAIN ([loadedIndexes objectForKey: key]);
+  [indexesLock unlock];
+
+  if (index)
+    {
+      mark_used(index->cachePath);
+      return AUTORELEASE (index);
+    }
+
+  index = [self loadIndexAtCachePath:
+                  [[self cacheRoot] stringByAppendingPathComponent: key]];
+
+  if (index)
+    {
+      mark_used(index->cachePath);
+      [indexesLock lock];
+      [loadedIndexes setObject: index forKey: key];
+      [indexesLock unlock];
+    }
+
+  return index;
+}
+
++ (GWArchiveIndex *)indexForArchiveAtPath:(NSString *)path
+                                 progress:(GWArchiveProgressHandler)progress
+                                    error:(NSError **)error
+{
+  NSString *key = [self cacheKeyForArchiveAtPath: path];
+  GWArchiveIndex *index;
+
+  if (key == nil)
+    {
+      if (error)
+        *error = index_error(1, [NSString stringWithFormat: @"Cannot read %@", path]);
+      return nil;
+    }
+
+  index = [self cachedIndexForArchiveAtPath: path];
+
+  if (index)
+    return index;
+
+  if ([self buildIndexForArchive: path
+                     atCachePath: [[self cacheRoot] stringByAppendingPathComponent: key]
+                        progress: progress
+                           error: error] == NO)
+    return nil;
+
+  [self pruneCacheKeeping: key];
+  index = [self cachedIndexForArchiveAtPath: path];
+
+  if ((index == nil) && error)
+    *error = index_error(2, @"Cannot read the archive index");
+
+  return index;
+}
+
++ (GWArchiveIndex *)indexForBrowsedPath:(NSString *)path
+{
+  NSString *root = [[self cacheRoot] stringByAppendingString: @"/"];
+  NSArray *comps;
+  NSString *key;
+  GWArchiveIndex *index;
+
+  if ([path hasPrefix: root] == NO)
+    return nil;
+
+  comps = [[path substringFromIndex: [root length]] pathComponents];
+
+  if (([comps count] < 2) || ([[comps objectAtIndex: 1] isEqual: ROOT_DIR] == NO))
+    return nil;
+
+  key = [comps objectAtIndex: 0];
+
+  [indexesLock lock];
+  index = RETAIN ([loadedIndexes objectForKey: key]);
+  [indexesLock unlock];
+
+  if (index == nil)
+    {
+      index = [self loadIndexAtCachePath: [root stringByAppendingPathComponent: key]];
+
+      if (index == nil)
+        return nil;
+
+      [indexesLock lock];
+      [loadedIndexes setObject: index forKey: key];
+      [indexesLock unlock];
+
+      return index;
+    }
+
+  return AUTORELEASE (index);
+}
+
++ (void)pruneCacheKeeping:(NSString *)key
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *croot = [self cacheRoot];
+  NSArray *names;
+  NSMutableArray *kept = [NSMutableArray array];
+  unsigned long long total = 0;
+  time_t now = time(NULL);
+  NSUInteger i;
+
+  [pruneLock lock];
+
+  names = [fm directoryContentsAtPath: croot];
+
+  for (i = 0; i < [names count]; i++)
+    {
+      CREATE_AUTORELEASE_POOL (arp);
+      NSString *name = [names objectAtIndex: i];
+      NSString *cpath = [croot stringByAppendingPathComponent: name];
+      NSString *apath;
+      struct stat st;
+      time_t age;
+
+      if (lstat([cpath fileSystemRepresentation], &st) != 0)
+        {
+          RELEASE (arp);
+          continue;
+        }
+
+      age = now - st.st_mtime;
+
+      if ([name isEqual: key])
+        {
+          total += tree_bytes(cpath);
+        }
+      else if ([name rangeOfString: @"."].location != NSNotFound)
+        {
+          /* a build that did not finish, or one still running */
+          if (age > CACHE_IN_USE_AGE)
+            remove_cache_dir(cpath);
+        }
+      else if (((apath = [self archivePathAtCachePath: cpath]) == nil)
+               || ([name isEqual: [self cacheKeyForArchiveAtPath: apath]] == NO)
+               || (age > CACHE_MAX_AGE))
+        {
+          /* the archive is gone or has changed, or is not browsed anymore */
+          [self removeIndexAtCachePath: cpath];
+        }
+      else
+        {
+          unsigned long long bytes = tree_bytes(cpath);
+
+          total += bytes;
+          [kept addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                                           cpath, @"path",
+                                           [NSNumber numberWithLongLong: age], @"age",
+                                           [NSNumber numberWithUnsignedLongLong: bytes], @"bytes",
+                                           nil]];
+        }
+
+      RELEASE (arp);
+    }
+
+  if (total > CACHE_MAX_BYTES)
+    {
+      NSSortDescriptor *oldest = [NSSortDescriptor sortDescriptorWithKey: @"age"
+                                                               ascending: NO];
+
+      [kept sortUsingDescriptors: [NSArray arrayWithObject: oldest]];
+
+      for (i = 0; (i < [kept count]) && (total > CACHE_MAX_BYTES); i++)
+        {
+          NSDictionary *info = [kept objectAtIndex: i];
+
+          if ([[info objectForKey: @"age"] longLongValue] <= CACHE_IN_USE_AGE)
+            break;
+
+          [self removeIndexAtCachePath: [info objectForKey: @"path"]];
+          total -= [[info objectForKey: @"bytes"] unsignedLongLongValue];
+        }
+    }
+
+  [pruneLock unlock];
+}
+
+- (void)dealloc
+{
+  RELEASE (archivePath);
+  RELEASE (cachePath);
+  RELEASE (entries);
+  [super dealloc];
+}
+
+- (NSString *)archivePath
+{
+  return archivePath;
+}
+
+- (NSString *)rootPath
+{
+  return [cachePath stringByAppendingPathComponent: ROOT_DIR];
+}
+
+- (NSUInteger)entryCount
+{
+  return [entries count];
+}
+
+- (BOOL)isPendingEntryAtPath:(NSString *)path
+{
+  NSString *ename = [self entryNameForPath: path];
+  struct stat st;
+
+  if ((ename == nil) || ([entries objectForKey: ename] == nil))
+    return NO;
+  if (lstat([path fileSystemRepresentation], &st) != 0)
+    return NO;
+
+  return (S_ISREG(st.st_mode) && ((st.st_mode & 07777) == 0));
+}
+
+- (BOOL)extractEntryAtPath:(NSString *)path
+                  progress:(GWArchiveProgressHandler)progress
+                     error:(NSError **)error
+{
+  NSString *ename = [self entryNameForPath: path];
+  NSDictionary *entry = ename ? [entries objectForKey: ename] : nil;
+  NSString *key = [[cachePath lastPathComponent] copy];
+  NSString *tmpPath;
+  struct archive *a;
+  struct archive_entry *ae;
+  unsigned long long base = 0;
+  unsigned long long total = 0;
+  BOOL cancelled = NO;
+  BOOL found = NO;
+  BOOL ok = NO;
+  struct stat st;
+  int afd = -1;
+
+  AUTORELEASE (key);
+
+  if (entry == nil)
+    {
+      if (error)
+        *error = index_error(3, [NSString stringWithFormat:
+                                  @"%@ is not in the archive", path]);
+      return NO;
+    }
+
+  if ([key isEqual: [GWArchiveIndex cacheKeyForArchiveAtPath: archivePath]] == NO)
+    {
+      if (error)
+        *error = index_error(4, [NSString stringWithFormat:
+                                  @"%@ has changed since it was read", archivePath]);
+      return NO;
+    }
+
+  if (stat([archivePath fileSystemRepresentation], &st) == 0)
+    total = (unsigned long long)st.st_size;
+
+  a = archive_read_new();
+
+  if (a == NULL)
+    {
+      if (error)
+        *error = index_error(5, @"archive_read_new failed");
+      return NO;
+    }
+
+  if (seekable && [entry objectForKey: @"offset"])
+    {
+      /* straight to the header, tar needs nothing before it */
+      base = [[entry objectForKey: @"offset"] unsignedLongLongValue];
+      archive_read_support_format_tar(a);
+      afd = open([archivePath fileSystemRepresentation], O_RDONLY);
+
+      if ((afd < 0) || (lseek(afd, (off_t)base, SEEK_SET) < 0)
+          || (archive_read_open_fd(a, afd, READ_BLOCK_SIZE) != ARCHIVE_OK))
+        {
+          if (afd >= 0)
+            close(afd);
+          archive_read_free(a);
+          if (error)
+            *error = index_error(6, [NSString stringWithFormat:
+                                      @"Cannot open %@", archivePath]);
+          return NO;
+        }
+    }
+  else
+    {
+      archive_read_support_format_all(a);
+      archive_read_support_filter_all(a);
+
+      if (archive_read_open_filename(a, [archivePath fileSystemRepresentation],
+                                     READ_BLOCK_SIZE) != ARCHIVE_OK)
+        {
+          if (error)
+            *error = index_error(6, [NSString stringWithFormat:
+                                      @"Cannot open %@: %s", archivePath,
+                                      archive_error_string(a)]);
+          archive_read_free(a);
+          return NO;
+        }
+    }
+
+  while (archive_read_next_header(a, &ae) == ARCHIVE_OK)
+    {
+      const char *name = archive_entry_pathname(ae);
+
+      if (name && [[GWArchiveIndex browsedNameForEntryName:
+                     [NSString stringWithUTF8String: name]] isEqual: ename]
+          && (archive_entry_filetype(ae) == AE_IFREG))
+        {
+          found = YES;
+          break;
+        }
+
+      archive_read_data_skip(a);
+
+      if (progress
+          && !progress(GWArchiveStageExtracting,
+                       base + (unsigned long long)archive_filter_bytes(a, -1),
+                       total))
+        {
+          cancelled = YES;
+          break;
+        }
+    }
+
+  /* written next to the stub and renamed over it, so that a failed or
+     cancelled extraction leaves the stub as it was */
+  tmpPath = [[path stringByDeletingLastPathComponent]
+              stringByAppendingPathComponent:
+                [NSString stringWithFormat: @".gwextract-%@",
+                          [[NSProcessInfo processInfo] globallyUniqueString]]];
+
+  if (found)
+    {
+      NSString *dir = [path stringByDeletingLastPathComponent];
+      __block int fd = -1;
+
+      /* the tree is read-only, but for the moment a file is added */
+      in_writable_dir(dir, ^{
+        fd = open([tmpPath fileSystemRepresentation],
+                  O_WRONLY | O_CREAT | O_EXCL, 0600);
+      });
+
+      if (fd >= 0)
+        {
+          /* readable by us, as a mode of 0 is what tells a stub, and
+             never writable: edits would not reach the archive */
+          mode_t mode = (archive_entry_perm(ae) & ACCESSPERMS & ~(S_IWUSR | S_IWGRP | S_IWOTH));
+          __block BOOL moved = NO;
+
+          ok = (copy_entry_to_fd(a, fd, archive_entry_size(ae), progress,
+                                 base, total, &cancelled) == ARCHIVE_OK);
+
+          if (ok)
+            {
+              fchmod(fd, mode | S_IRUSR);
+              set_file_time(fd, archive_entry_mtime(ae));
+            }
+
+          if (close(fd) != 0)
+            ok = NO;
+
+          in_writable_dir(dir, ^{
+            if (ok)
+              moved = (rename([tmpPath fileSystemRepresentation],
+                              [path fileSystemRepresentation]) == 0);
+            if (moved == NO)
+              unlink([tmpPath fileSystemRepresentation]);
+          });
+
+          ok = moved;
+          if (ok)
+            mark_used(cachePath);
+        }
+    }
+
+  archive_read_close(a);
+  archive_read_free(a);
+
+  if (afd >= 0)
+    close(afd);
+
+  if ((ok == NO) && error)
+    {
+      if (cancelled)
+        *error = cancelled_error();
+      else if (found == NO)
+        *error = index_error(3, [NSString stringWithFormat:
+                                  @"%@ is not in the archive", ename]);
+      else
+        *error = index_error(7, [NSString stringWithFormat:
+                                  @"Error extracting %@", ename]);
+    }
+
+  return ok;
+}
+
+@end
+
+
+@implementation GWArchiveIndex (Private)
+
+- (id)initWithArchivePath:(NSString *)apath
+                cachePath:(NSString *)cpath
+                  entries:(NSDictionary *)dict
+                 seekable:(BOOL)seek
+{
+  self = [super init];
+
+  if (self)
+    {
+      ASSIGN (archivePath, apath);
+      ASSIGN (cachePath, cpath);
+      ASSIGN (entries, dict);
+      seekable = seek;
+    }
+
+  return self;
+}
+
++ (GWArchiveIndex *)loadIndexAtCachePath:(NSString *)cpath
+{
+  NSString *ipath = [cpath stringByAppendingPathComponent: INDEX_FILE];
+  NSData *data = [NSData dataWithContentsOfFile: ipath];
+  NSDictionary *dict;
+  BOOL isdir;
+
+  if (data == nil)
+    return nil;
+
+  dict = [NSPropertyListSerialization propertyListWithData: data
+                                                   options: NSPropertyListImmutable
+                                                    format: NULL
+                                                     error: NULL];
+
+  if (([dict isKindOfClass: [NSDictionary class]] == NO)
+      || ([[dict objectForKey: @"version"] intValue] != INDEX_VERSION)
+      || ([[dict objectForKey: @"entries"] isKindOfClass: [NSDictionary class]] == NO)
+      || ([[NSFileManager defaultManager]
+            fileExistsAtPath: [cpath stringByAppendingPathComponent: ROOT_DIR]
+                 isDirectory: &isdir] == NO)
+      || (isdir == NO))
+    return nil;
+
+  return AUTORELEASE ([[self alloc] initWithArchivePath: [dict objectForKey: @"archive"]
+                                              cachePath: cpath
+                                                entries: [dict objectForKey: @"entries"]
+                                               seekable: [[dict objectForKey: @"seekable"] boolValue]]);
+}
+
+/* The tree and the index are made aside and renamed into place, so an
+   index that is there is complete. */
++ (BOOL)buildIndexForArchive:(NSString *)path
+                 atCachePath:(NSString *)cpath
+                    progress:(GWArchiveProgressHandler)progress
+                       error:(NSError **)error
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *tmpPath = [cpath stringByAppendingFormat: @".%@",
+                            [[NSProcessInfo processInfo] globallyUniqueString]];
+  NSString *root = [tmpPath stringByAppendingPathComponent: ROOT_DIR];
+  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+  unsigned long long total = 0;
+  struct archive *a;
+  struct archive_entry *ae;
+  struct stat st;
+  BOOL seek = NO;
+  BOOL cancelled = NO;
+  BOOL ok = YES;
+  int r;
+
+  if (stat([path fileSystemRepresentation], &st) == 0)
+    total = (unsigned long long)st.st_size;
+
+  if ([fm createDirectoryAtPath: root withIntermediateDirectories: YES
+                     attributes: nil error: NULL] == NO)
+    {
+      if (error)
+        *error = index_error(8, [NSString stringWithFormat:
+                                  @"Cannot create %@", root]);
+      return NO;
+    }
+
+  a = archive_read_new();
+
+  if (a == NULL)
+    {
+      remove_cache_dir(tmpPath);
+      if (error)
+        *error = index_error(5, @"archive_read_new failed");
+      return NO;
+    }
+
+  archive_read_support_format_all(a);
+  archive_read_support_filter_all(a);
+
+  if (archive_read_open_filename(a, [path fileSystemRepresentation],
+                                 READ_BLOCK_SIZE) != ARCHIVE_OK)
+    {
+      if (error)
+        *error = index_error(6, [NSString stringWithFormat:
+                                  @"Cannot open %@: %s", path,
+                                  archive_error_string(a)]);
+      archive_read_free(a);
+      remove_cache_dir(tmpPath);
+      return NO;
+    }
+
+  if (progress && !progress(GWArchiveStageScanning, 0, total))
+    cancelled = YES;
+  ok = !cancelled;
+
+  while (ok && ((r = archive_read_next_header(a, &ae)) != ARCHIVE_EOF))
+    {
+      CREATE_AUTORELEASE_POOL (arp);
+      const char *cname = archive_entry_pathname(ae);
+      int64_t offset = archive_read_header_position(a);
+      NSString *ename = nil;
+      NSString *dest;
+
+      if (r != ARCHIVE_OK)
+        {
+          if (error)
+            *error = index_error(9, [NSString stringWithFormat:
+                                      @"Error reading archive: %s",
+                                      archive_error_string(a)]);
+          RELEASE (arp);
+          ok = NO;
+          break;
+        }
+
+      if (cname)
+        ename = [self browsedNameForEntryName: [NSString stringWithUTF8String: cname]];
+
+      if (ename)
+        {
+          dest = [root stringByAppendingPathComponent: ename];
+
+          switch (archive_entry_filetype(ae))
+            {
+            case AE_IFDIR:
+              [fm createDirectoryAtPath: dest withIntermediateDirectories: YES
+                             attributes: nil error: NULL];
+              break;
+
+            case AE_IFREG:
+              {
+                int fd;
+
+                [fm createDirectoryAtPath: [dest stringByDeletingLastPathComponent]
+              withIntermediateDirectories: YES
+                               attributes: nil
+                                    error: NULL];
+
+                /* no permissions until extracted: nothing reads the zeros */
+                unlink([dest fileSystemRepresentation]);
+                fd = open([dest fileSystemRepresentation],
+                          O_WRONLY | O_CREAT | O_EXCL, 0);
+
+                if (fd >= 0)
+                  {
+                    if (archive_entry_size(ae) > 0)
+                      ftruncate(fd, (off_t)archive_entry_size(ae));
+                    set_file_time(fd, archive_entry_mtime(ae));
+                    close(fd);
+
+                    [dict setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                                        [NSNumber numberWithLongLong: archive_entry_size(ae)], @"size",
+                                        [NSNumber numberWithLongLong: offset], @"offset",
+                                        nil]
+                             forKey: ename];
+                  }
+              }
+              break;
+
+            case AE_IFLNK:
+              if (archive_entry_symlink(ae))
+                {
+                  [fm createDirectoryAtPath: [dest stringByDeletingLastPathComponent]
+                withIntermediateDirectories: YES
+                                 attributes: nil
+                                      error: NULL];
+                  unlink([dest fileSystemRepresentation]);
+                  symlink(archive_entry_symlink(ae), [dest fileSystemRepresentation]);
+                }
+              break;
+
+            default:
+              break;
+            }
+        }
+
+      archive_read_data_skip(a);
+
+      if (progress
+          && !progress(GWArchiveStageScanning,
+                       (unsigned long long)archive_filter_bytes(a, -1), total))
+        {
+          cancelled = YES;
+          ok = NO;
+        }
+
+      RELEASE (arp);
+    }
+
+  if (ok)
+    {
+      /* offsets of headers in the file itself, not in a decompressed stream */
+      seek = ((archive_filter_code(a, 0) == ARCHIVE_FILTER_NONE)
+              && ((archive_format(a) & ARCHIVE_FORMAT_BASE_MASK) == ARCHIVE_FORMAT_TAR));
+    }
+  else if (cancelled && error)
+    {
+      *error = cancelled_error();
+    }
+
+  archive_read_close(a);
+  archive_read_free(a);
+
+  if (ok)
+    {
+      /* a stand-in: what is written in it would never reach the archive */
+      set_tree_writable(root, NO);
+    }
+
+  if (ok)
+    {
+      NSDictionary *index = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            [NSNumber numberWithInt: INDEX_VERSION], @"version",
+                                            path, @"archive",
+                                            [NSNumber numberWithBool: seek], @"seekable",
+                                            dict, @"entries",
+                                            nil];
+      NSData *data = [NSPropertyListSerialization dataWithPropertyList: index
+                                                                format: NSPropertyListBinaryFormat_v1_0
+                                                               options: 0
+                                                                 error: NULL];
+
+      ok = (data && [data writeToFile: [tmpPath stringByAppendingPathComponent: INDEX_FILE]
+                           atomically: NO]);
+
+      if (ok)
+        {
+          remove_cache_dir(cpath);
+          ok = [fm movePath: tmpPath toPath: cpath handler: nil];
+        }
+
+      if ((ok == NO) && error)
+        *error = index_error(10, [NSString stringWithFormat:
+                                   @"Cannot write the index of %@", path]);
+    }
+
+  if (ok == NO)
+    remove_cache_dir(tmpPath);
+
+  return ok;
+}
+
+/* Only the archive of the index, which is the first thing written. */
++ (NSString *)archivePathAtCachePath:(NSString *)cpath
+{
+  NSData *data = [NSData dataWithContentsOfFile:
+                           [cpath stringByAppendingPathComponent: INDEX_FILE]];
+  id dict;
+
+  if (data == nil)
+    return nil;
+
+  dict = [NSPropertyListSerialization propertyListWithData: data
+                                                   options: NSPropertyListImmutable
+                                                    format: NULL
+                                                     error: NULL];
+
+  if ([dict isKindOfClass: [NSDictionary class]] == NO)
+    return nil;
+
+  return [dict objectForKey: @"archive"];
+}
+
++ (void)removeIndexAtCachePath:(NSString *)cpath
+{
+  [indexesLock lock];
+  [loadedIndexes removeObjectForKey: [cpath lastPathComponent]];
+  [indexesLock unlock];
+  remove_cache_dir(cpath);
+}
+
+- (NSString *)entryNameForPath:(NSString *)path
+{
+  NSString *root = [[self rootPath] stringByAppendingString: @"/"];
+
+  if ([path hasPrefix: root] == NO)
+    return nil;
+
+  return [path substringFromIndex: [root length]];
+}
+
+@end
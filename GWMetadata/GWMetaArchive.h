@@ -18,6 +18,33 @@
 
 #import <Foundation/Foundation.h>
 
+/* Zip is what every system opens; the tar formats compress on all cores
+ * (xz and zstd through libarchive's "threads" option). */
+typedef enum
+{
+  GWArchiveFormatZip = 0,
+  GWArchiveFormatTarGzip,
+  GWArchiveFormatTarXz,
+  GWArchiveFormatTarZstd
+} GWArchiveFormat;
+
+typedef enum
+{
+  GWArchiveStageCompressing,
+  GWArchiveStageScanning,     /* first pass of an extraction */
+  GWArchiveStageExtracting
+} GWArchiveStage;
+
+/* Called on the working thread as data goes through: `processed` of
+ * `total` bytes, the files read when compressing and the archive read
+ * when extracting.  Returning NO cancels the operation, which then fails
+ * with code GWMetaArchiveCancelledError. */
+typedef BOOL (^GWArchiveProgressHandler)(GWArchiveStage stage,
+                                         unsigned long long processed,
+                                         unsigned long long total);
+
+#define GWMetaArchiveCancelledError 20
+
 @interface GWMetaArchive : NSObject
 
 /**
@@ -34,6 +61,26 @@
           toArchiveAt:(NSString *)outputPath
                 error:(NSError **)error;
 
+/**
+ * Like +compressPaths:toArchiveAt:error:, in the given format and
+ * reporting progress.  Partial output is removed on failure.
+ */
++ (BOOL)compressPaths:(NSArray *)filePaths
+          toArchiveAt:(NSString *)outputPath
+               format:(GWArchiveFormat)format
+             progress:(GWArchiveProgressHandler)progress
+                error:(NSError **)error;
+
+/**
+ * "zip", "tar.gz", "tar.xz" or "tar.zst".
+ */
++ (NSString *)extensionForFormat:(GWArchiveFormat)format;
+
+/**
+ * The format named by an extension as above; zip for anything else.
+ */
++ (GWArchiveFormat)formatForExtension:(NSString *)ext;
+
 /**
  * Compress a single directory tree preserving relative structure
  * and macOS metadata.
@@ -56,6 +103,14 @@
                   toDir:(NSString *)destDir
                  error:(NSError **)error;
 
+/**
+ * Like +extractArchive:toDir:error:, reporting progress.
+ */
++ (BOOL)extractArchive:(NSString *)archivePath
+                  toDir:(NSString *)destDir
+              progress:(GWArchiveProgressHandler)progress
+                 error:(NSError **)error;
+
 /**
  * Returns YES if the given file extension corresponds to an archive
  * format that libarchive can read (zip, tar, 7z, rar, iso, ...).
@@ -23,8 +23,9 @@
 #include <errno.h>
 #include <sys/stat.h>
 
-#define READ_BLOCK_SIZE  10240
-#define WRITE_BLOCK_SIZE  16384
+/* Large blocks: fewer system calls and whole requests for the disks */
+#define READ_BLOCK_SIZE  (1024 * 1024)
+#define WRITE_BLOCK_SIZE  (1024 * 1024)
 
 /* Upper bound for a single __MACOSX/._ metadata entry buffered in pass 1.
  * AppleDouble headers are a few KB; anything larger is almost certainly a
@@ -36,6 +37,34 @@
  * Helpers
  * ------------------------------------------------------------------ */
 
+typedef struct
+{
+  GWArchiveProgressHandler handler;
+  GWArchiveStage stage;
+  unsigned long long processed;
+  unsigned long long total;
+  BOOL cancelled;
+  char *buffer;                 /* WRITE_BLOCK_SIZE, when compressing */
+} ArchiveProgress;
+
+/* NO when the handler asked to stop */
+static BOOL
+report_progress(ArchiveProgress *prog, unsigned long long processed)
+{
+  prog->processed = processed;
+  if (prog->handler && !prog->handler(prog->stage, processed, prog->total))
+    prog->cancelled = YES;
+  return !prog->cancelled;
+}
+
+static NSError *
+cancelled_error(void)
+{
+  return [NSError errorWithDomain: @"GWMetaArchive"
+                             code: GWMetaArchiveCancelledError
+                         userInfo: @{NSLocalizedDescriptionKey: @"Cancelled"}];
+}
+
 static void
 collect_tree(NSString *root, NSMutableArray *entries, NSFileManager *fm)
 {
@@ -58,18 +87,60 @@ collect_tree(NSString *root, NSMutableArray *entries, NSFileManager *fm)
 }
 
 static int
-copy_fd_to_archive(struct archive *a, int fd)
+copy_fd_to_archive(struct archive *a, int fd, ArchiveProgress *prog)
 {
-  char buf[WRITE_BLOCK_SIZE];
   ssize_t n;
-  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  while ((n = read(fd, prog->buffer, WRITE_BLOCK_SIZE)) > 0)
     {
-      if (archive_write_data(a, buf, (size_t)n) < 0)
+      if (archive_write_data(a, prog->buffer, (size_t)n) < 0)
+        return ARCHIVE_FATAL;
+      if (!report_progress(prog, prog->processed + (unsigned long long)n))
         return ARCHIVE_FATAL;
     }
   return (n == 0) ? ARCHIVE_OK : ARCHIVE_FATAL;
 }
 
+/* The compressors that can run on all cores are told how many there are;
+ * an older libarchive that lacks the option just compresses on one. */
+static int
+set_write_format(struct archive *a, GWArchiveFormat format)
+{
+  char threads[32];
+
+  snprintf(threads, sizeof(threads), "%lu",
+           (unsigned long)[[NSProcessInfo processInfo] activeProcessorCount]);
+
+  if (format == GWArchiveFormatZip)
+    {
+      archive_write_set_format_zip(a);
+      return archive_write_add_filter_none(a);
+    }
+
+  archive_write_set_format_pax_restricted(a);
+
+  switch (format)
+    {
+    case GWArchiveFormatTarXz:
+      if (archive_write_add_filter_xz(a) != ARCHIVE_OK)
+        return ARCHIVE_FATAL;
+      archive_write_set_filter_option(a, "xz", "threads", threads);
+      return ARCHIVE_OK;
+
+    case GWArchiveFormatTarZstd:
+#if ARCHIVE_VERSION_NUMBER >= 3003003
+      if (archive_write_add_filter_zstd(a) != ARCHIVE_OK)
+        return ARCHIVE_FATAL;
+      archive_write_set_filter_option(a, "zstd", "threads", threads);
+      return ARCHIVE_OK;
+#else
+      return ARCHIVE_FATAL;
+#endif
+
+    default:
+      return archive_write_add_filter_gzip(a);
+    }
+}
+
 /*
  * Write a __MACOSX/._ companion entry containing the AppleDouble blob.
  * This is the standard macOS zip format for file metadata.
@@ -104,7 +175,8 @@ write_macosx_entry(struct archive *a, NSString *arcname, NSData *appleDouble)
  * Add a single file + optional __MACOSX companion to the archive.
  */
 static int
-add_file_to_archive(struct archive *a, NSString *path, NSString *arcname)
+add_file_to_archive(struct archive *a, NSString *path, NSString *arcname,
+                    ArchiveProgress *prog)
 {
   struct stat st;
   const char *cpath = [path fileSystemRepresentation];
@@ -129,7 +201,7 @@ add_file_to_archive(struct archive *a, NSString *path, NSString *arcname)
       int fd = open(cpath, O_RDONLY);
       if (fd >= 0)
         {
-          r = copy_fd_to_archive(a, fd);
+          r = copy_fd_to_archive(a, fd, prog);
           close(fd);
         }
     }
@@ -184,23 +256,53 @@ add_dir_to_archive(struct archive *a, NSString *path, NSString *arcname)
  * Extraction helpers
  * ------------------------------------------------------------------ */
 
+/* Holes the archive records are seeked over, so sparse files (disk
+ * images, databases) stay sparse. */
 static int
-copy_archive_data_to_fd(struct archive *a, int fd)
+copy_archive_data_to_fd(struct archive *a, int fd, int64_t entrySize,
+                        ArchiveProgress *prog)
 {
   const void *buf;
   size_t size;
   int64_t offset;
+  int64_t position = 0;
   int r;
   for (;;)
     {
       r = archive_read_data_block(a, &buf, &size, &offset);
-      if (r == ARCHIVE_EOF) return ARCHIVE_OK;
+      if (r == ARCHIVE_EOF) break;
       if (r != ARCHIVE_OK)  return r;
 
-      ssize_t written = write(fd, buf, size);
-      if (written < 0 || (size_t)written != size)
+      if (offset > position)
+        {
+          if (lseek(fd, (off_t)offset, SEEK_SET) < 0)
+            return ARCHIVE_FATAL;
+          position = offset;
+        }
+
+      const char *p = buf;
+      size_t left = size;
+      while (left > 0)
+        {
+          ssize_t written = write(fd, p, left);
+          if (written < 0 && errno == EINTR)
+            continue;
+          if (written <= 0)
+            return ARCHIVE_FATAL;
+          p += written;
+          left -= (size_t)written;
+        }
+      position += (int64_t)size;
+
+      if (!report_progress(prog, (unsigned long long)archive_filter_bytes(a, -1)))
         return ARCHIVE_FATAL;
     }
+
+  /* a file ending in a hole */
+  if (entrySize > position && ftruncate(fd, (off_t)entrySize) != 0)
+    return ARCHIVE_FATAL;
+
+  return ARCHIVE_OK;
 }
 
 /*
@@ -260,6 +362,44 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
 + (BOOL)compressPaths:(NSArray *)filePaths
           toArchiveAt:(NSString *)outputPath
                 error:(NSError **)error
+{
+  return [self compressPaths: filePaths
+                 toArchiveAt: outputPath
+                      format: GWArchiveFormatZip
+                    progress: nil
+                       error: error];
+}
+
++ (NSString *)extensionForFormat:(GWArchiveFormat)format
+{
+  switch (format)
+    {
+    case GWArchiveFormatTarGzip: return @"tar.gz";
+    case GWArchiveFormatTarXz:   return @"tar.xz";
+    case GWArchiveFormatTarZstd: return @"tar.zst";
+    default:                     return @"zip";
+    }
+}
+
++ (GWArchiveFormat)formatForExtension:(NSString *)ext
+{
+  ext = [ext lowercaseString];
+
+  if ([ext isEqual: @"tar.gz"] || [ext isEqual: @"tgz"])
+    return GWArchiveFormatTarGzip;
+  if ([ext isEqual: @"tar.xz"] || [ext isEqual: @"txz"])
+    return GWArchiveFormatTarXz;
+  if ([ext isEqual: @"tar.zst"] || [ext isEqual: @"tzst"])
+    return GWArchiveFormatTarZstd;
+
+  return GWArchiveFormatZip;
+}
+
++ (BOOL)compressPaths:(NSArray *)filePaths
+          toArchiveAt:(NSString *)outputPath
+               format:(GWArchiveFormat)format
+             progress:(GWArchiveProgressHandler)progress
+                error:(NSError **)error
 {
   if (!filePaths || [filePaths count] == 0)
     {
@@ -319,8 +459,16 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
       return NO;
     }
 
-  archive_write_set_format_zip(a);
-  archive_write_add_filter_none(a);
+  if (set_write_format(a, format) != ARCHIVE_OK)
+    {
+      if (error)
+        *error = [NSError errorWithDomain: @"GWMetaArchive" code: 6
+          userInfo: @{NSLocalizedDescriptionKey:
+            [NSString stringWithFormat: @"This system cannot write %@ archives",
+              [self extensionForFormat: format]]}];
+      archive_write_free(a);
+      return NO;
+    }
 
   const char *outpath = [outputPath fileSystemRepresentation];
   if (archive_write_open_filename(a, outpath) != ARCHIVE_OK)
@@ -334,11 +482,35 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
       return NO;
     }
 
-  BOOL ok = YES;
+  /* bytes to read, for the progress */
+  ArchiveProgress prog;
+  memset(&prog, 0, sizeof(prog));
+  prog.handler = progress;
+  prog.stage = GWArchiveStageCompressing;
+  for (i = 0; i < [allFiles count]; i++)
+    {
+      struct stat st;
+      if (lstat([[allFiles objectAtIndex: i] fileSystemRepresentation], &st) == 0
+          && S_ISREG(st.st_mode))
+        prog.total += (unsigned long long)st.st_size;
+    }
+  prog.buffer = malloc(WRITE_BLOCK_SIZE);
+  if (prog.buffer == NULL)
+    {
+      if (error)
+        *error = [NSError errorWithDomain: @"GWMetaArchive" code: 7
+          userInfo: @{NSLocalizedDescriptionKey: @"Out of memory"}];
+      archive_write_free(a);
+      unlink(outpath);
+      return NO;
+    }
+  BOOL ok = report_progress(&prog, 0);
+  if (!ok && error)
+    *error = cancelled_error();
   NSUInteger prefixLen = [commonParent length];
   if (![commonParent hasSuffix: @"/"]) prefixLen++;
 
-  for (i = 0; i < [allFiles count]; i++)
+  for (i = 0; ok && i < [allFiles count]; i++)
     {
       NSString *fp = [allFiles objectAtIndex: i];
       NSString *arcname = [fp substringFromIndex: prefixLen];
@@ -346,7 +518,14 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
       [fm fileExistsAtPath: fp isDirectory: &isDir];
 
       int r = isDir ? add_dir_to_archive(a, fp, arcname)
-                     : add_file_to_archive(a, fp, arcname);
+                     : add_file_to_archive(a, fp, arcname, &prog);
+      if (prog.cancelled)
+        {
+          if (error)
+            *error = cancelled_error();
+          ok = NO;
+          break;
+        }
       if (r < ARCHIVE_WARN)
         {
           if (error)
@@ -359,8 +538,20 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
         }
     }
 
-  archive_write_close(a);
+  if (archive_write_close(a) != ARCHIVE_OK && ok)
+    {
+      if (error)
+        *error = [NSError errorWithDomain: @"GWMetaArchive" code: 5
+          userInfo: @{NSLocalizedDescriptionKey:
+            [NSString stringWithFormat: @"Error writing %@: %s",
+              outputPath, archive_error_string(a)]}];
+      ok = NO;
+    }
   archive_write_free(a);
+  free(prog.buffer);
+
+  if (!ok)
+    unlink(outpath);
   return ok;
 }
 
@@ -378,6 +569,17 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
 + (BOOL)extractArchive:(NSString *)archivePath
                   toDir:(NSString *)destDir
                  error:(NSError **)error
+{
+  return [self extractArchive: archivePath
+                        toDir: destDir
+                     progress: nil
+                        error: error];
+}
+
++ (BOOL)extractArchive:(NSString *)archivePath
+                  toDir:(NSString *)destDir
+              progress:(GWArchiveProgressHandler)progress
+                 error:(NSError **)error
 {
   NSFileManager *fm = [NSFileManager defaultManager];
 
@@ -417,6 +619,15 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
       return NO;
     }
 
+  /* both passes read the whole archive; progress is its compressed bytes */
+  ArchiveProgress prog;
+  struct stat ast;
+  memset(&prog, 0, sizeof(prog));
+  prog.handler = progress;
+  prog.stage = GWArchiveStageScanning;
+  if (stat(cpath, &ast) == 0)
+    prog.total = (unsigned long long)ast.st_size;
+
   /*
    * First pass:
    *   - Read __MACOSX entries, collecting AppleDouble metadata.
@@ -426,10 +637,10 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
    */
   NSMutableDictionary *metadataDict = [NSMutableDictionary dictionary];
   NSMutableArray *entryPaths = [NSMutableArray array];
-  BOOL ok = YES;
+  BOOL ok = report_progress(&prog, 0);
   struct archive_entry *entry;
 
-  for (;;)
+  while (ok)
     {
       int r = archive_read_next_header(a, &entry);
       if (r == ARCHIVE_EOF) break;
@@ -471,8 +682,13 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
           [entryPaths addObject: epath];
           archive_read_data_skip(a);
         }
+
+      ok = report_progress(&prog, (unsigned long long)archive_filter_bytes(a, -1));
     }
 
+  if (prog.cancelled && error)
+    *error = cancelled_error();
+
   if (!ok)
     {
       archive_read_close(a);
@@ -520,17 +736,32 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
       if (error)
         *error = [NSError errorWithDomain: @"GWMetaArchive" code: 14
           userInfo: @{NSLocalizedDescriptionKey: @"Cannot re-open archive"}];
+      archive_read_free(a);
       return NO;
     }
 
+  prog.stage = GWArchiveStageExtracting;
+  ok = report_progress(&prog, 0);
+  if (!ok && error)
+    *error = cancelled_error();
+
   /* Canonical destination used for the per-entry Zip-Slip check below. */
   NSString *canonicalDest = [destDir stringByStandardizingPath];
 
-  for (;;)
+  while (ok)
     {
       int r = archive_read_next_header(a, &entry);
       if (r == ARCHIVE_EOF) break;
-      if (r != ARCHIVE_OK) { ok = NO; break; }
+      if (r != ARCHIVE_OK)
+        {
+          if (error)
+            *error = [NSError errorWithDomain: @"GWMetaArchive" code: 13
+              userInfo: @{NSLocalizedDescriptionKey:
+                [NSString stringWithFormat: @"Error reading archive: %s",
+                  archive_error_string(a)]}];
+          ok = NO;
+          break;
+        }
 
       const char *ename = archive_entry_pathname(entry);
       if (!ename) { archive_read_data_skip(a); continue; }
@@ -587,10 +818,16 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
                         O_WRONLY | O_CREAT | O_TRUNC, openmode);
           if (fd >= 0)
             {
-              if (copy_archive_data_to_fd(a, fd) != ARCHIVE_OK)
+              if (copy_archive_data_to_fd(a, fd, archive_entry_size(entry),
+                                          &prog) != ARCHIVE_OK)
                 {
                   close(fd);
-                  if (error)
+                  if (prog.cancelled)
+                    {
+                      if (error)
+                        *error = cancelled_error();
+                    }
+                  else if (error)
                     *error = [NSError errorWithDomain: @"GWMetaArchive" code: 16
                       userInfo: @{NSLocalizedDescriptionKey:
                         [NSString stringWithFormat: @"Error extracting %@", epath]}];
@@ -623,6 +860,10 @@ path_is_within(NSString *canonicalDir, NSString *candidate)
                       destPath, we);
             }
         }
+
+      ok = report_progress(&prog, (unsigned long long)archive_filter_bytes(a, -1));
+      if (!ok && error)
+        *error = cancelled_error();
     }
 
   archive_read_close(a);
@@ -31,6 +31,13 @@ extern "C" {
  */
 #define GS_XATTR_MAX_SIZE  (256 * 1024 * 1024)
 
+/**
+ * Size of the stack buffers the batched readers (gs_xattr_list_for_*)
+ * use for the name list and for each value.  A value that fits is read
+ * with one call; a larger one costs one more, to size it.
+ */
+#define GS_XATTR_SCRATCH_SIZE  4096
+
 /**
  * Set an extended attribute on a file.
  *
@@ -69,6 +76,16 @@ ssize_t gs_getxattr(const char *path, const char *name,
  */
 ssize_t gs_listxattr(const char *path, char *list, size_t size);
 
+/**
+ * gs_getxattr() on an open file descriptor.
+ */
+ssize_t gs_fgetxattr(int fd, const char *name, void *value, size_t size);
+
+/**
+ * gs_listxattr() on an open file descriptor.
+ */
+ssize_t gs_flistxattr(int fd, char *list, size_t size);
+
 /**
  * Remove an extended attribute from a file.
  *
@@ -108,6 +125,12 @@ typedef struct {
  * Read all extended attributes matching a name prefix from a file.
  * If prefix is NULL, returns all attributes.
  *
+ * The names are listed with one call and each matching value is read
+ * with one more (see GS_XATTR_SCRATCH_SIZE): a file with no attributes
+ * costs one system call, a file with only its Finder info two.  A file
+ * with no attributes, or on a filesystem without them, gives an empty
+ * list.
+ *
  * @param path   Filesystem path
  * @param prefix Optional name prefix filter (e.g. "user.com.apple.")
  * @return A newly allocated list, or NULL on failure.
@@ -116,7 +139,49 @@ typedef struct {
 gs_xattr_list_t *gs_xattr_list_for_path(const char *path, const char *prefix);
 
 /**
- * Free a list returned by gs_xattr_list_for_path().
+ * gs_xattr_list_for_path() on an open file descriptor, for a caller that
+ * already holds the file open.
+ */
+gs_xattr_list_t *gs_xattr_list_for_fd(int fd, const char *prefix);
+
+/**
+ * The entry of `list` named `name`, or NULL.
+ */
+const gs_xattr_entry_t *gs_xattr_list_find(const gs_xattr_list_t *list,
+                                           const char *name);
+
+/**
+ * Which entries of a directory gs_xattr_list_directory() reads: nonzero
+ * to read `name`.
+ */
+typedef int (*gs_xattr_dir_filter_t)(const char *name, void *context);
+
+/**
+ * What gs_xattr_list_directory() found for one entry: its attributes,
+ * possibly none, or NULL and the errno of the failure in `error`.  The
+ * list is freed when the callback returns.
+ */
+typedef void (*gs_xattr_dir_callback_t)(const char *name,
+                                        const gs_xattr_list_t *list,
+                                        int error,
+                                        void *context);
+
+/**
+ * Read the attributes matching `prefix` of every entry of `dir`, but
+ * "." and "..", in one pass over the directory, and hand each to
+ * `callback`.  `filter`, if not NULL, skips the entries it answers 0
+ * for, without a system call for them.
+ *
+ * @return 0, or -1 if the directory cannot be read (errno is set)
+ */
+int gs_xattr_list_directory(const char *dir, const char *prefix,
+                            gs_xattr_dir_filter_t filter,
+                            gs_xattr_dir_callback_t callback,
+                            void *context);
+
+/**
+ * Free a list returned by gs_xattr_list_for_path() or
+ * gs_xattr_list_for_fd().  NULL is ignored.
  */
 void gs_xattr_list_free(gs_xattr_list_t *list);
 
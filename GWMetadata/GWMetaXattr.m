@@ -21,6 +21,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+
+#ifndef PATH_MAX
+# define PATH_MAX 4096
+#endif
 
 /* ===================================================================
  * Platform-specific includes and helpers
@@ -60,6 +66,18 @@ _gs_remove(const char *path, const char *name)
   return removexattr(path, name);
 }
 
+static ssize_t
+_gs_fget(int fd, const char *name, void *value, size_t size)
+{
+  return fgetxattr(fd, name, value, size);
+}
+
+static ssize_t
+_gs_flist(int fd, char *list, size_t size)
+{
+  return flistxattr(fd, list, size);
+}
+
 #elif defined(__FreeBSD__)
 # include <sys/extattr.h>
 
@@ -118,31 +136,15 @@ _gs_get(const char *path, const char *name, void *value, size_t size)
   return extattr_get_file(path, EXTATTR_NAMESPACE_USER, name, value, size);
 }
 
+/*
+ * FreeBSD extattr_list_file returns entries in a packed format:
+ *   [1-byte name-length][name bytes...]
+ * repeated for each attribute. We convert to the Linux convention:
+ *   "user.<name>\0user.<name2>\0..."
+ */
 static ssize_t
-_gs_list(const char *path, char *list, size_t size)
+_gs_convert_list(const char *raw, ssize_t raw_size, char *list, size_t size)
 {
-  /*
-   * FreeBSD extattr_list_file returns entries in a packed format:
-   *   [1-byte name-length][name bytes...]
-   * repeated for each attribute. We convert to the Linux convention:
-   *   "user.<name>\0user.<name2>\0..."
-   */
-  ssize_t raw_size = extattr_list_file(path, EXTATTR_NAMESPACE_USER,
-                                       NULL, 0);
-  if (raw_size <= 0)
-    return raw_size;
-
-  char *raw = malloc(raw_size);
-  if (!raw)
-    return -1;
-
-  raw_size = extattr_list_file(path, EXTATTR_NAMESPACE_USER, raw, raw_size);
-  if (raw_size <= 0)
-    {
-      free(raw);
-      return raw_size;
-    }
-
   /* Compute converted size */
   size_t conv_size = 0;
   size_t offset = 0;
@@ -160,14 +162,10 @@ _gs_list(const char *path, char *list, size_t size)
     }
 
   if (size == 0 || list == NULL)
-    {
-      free(raw);
-      return conv_size;
-    }
+    return conv_size;
 
   if (conv_size > size)
     {
-      free(raw);
       errno = ERANGE;
       return -1;
     }
@@ -191,10 +189,62 @@ _gs_list(const char *path, char *list, size_t size)
       offset += nlen;
     }
 
-  free(raw);
   return out_offset;
 }
 
+static ssize_t
+_gs_list(const char *path, char *list, size_t size)
+{
+  ssize_t raw_size = extattr_list_file(path, EXTATTR_NAMESPACE_USER,
+                                       NULL, 0);
+  if (raw_size <= 0)
+    return raw_size;
+
+  char *raw = malloc(raw_size);
+  if (!raw)
+    return -1;
+
+  raw_size = extattr_list_file(path, EXTATTR_NAMESPACE_USER, raw, raw_size);
+  if (raw_size <= 0)
+    {
+      free(raw);
+      return raw_size;
+    }
+
+  ssize_t ret = _gs_convert_list(raw, raw_size, list, size);
+  free(raw);
+  return ret;
+}
+
+static ssize_t
+_gs_fget(int fd, const char *name, void *value, size_t size)
+{
+  return extattr_get_fd(fd, EXTATTR_NAMESPACE_USER, name, value, size);
+}
+
+static ssize_t
+_gs_flist(int fd, char *list, size_t size)
+{
+  ssize_t raw_size = extattr_list_fd(fd, EXTATTR_NAMESPACE_USER, NULL, 0);
+  if (raw_size <= 0)
+    return raw_size;
+
+  char *raw = malloc(raw_size);
+  if (!raw)
+    return -1;
+
+  raw_size = extattr_list_fd(fd, EXTATTR_NAMESPACE_USER, raw, raw_size);
+  if (raw_size <= 0)
+    {
+      free(raw);
+      return raw_size;
+    }
+
+  ssize_t ret = _gs_convert_list(raw, raw_size, list, size);
+  free(raw);
+  return ret;
+}
+
 static int
 _gs_remove(const char *path, const char *name)
 {
@@ -245,6 +295,20 @@ _gs_remove(const char *path, const char *name)
   return -1;
 }
 
+static ssize_t
+_gs_fget(int fd, const char *name, void *value, size_t size)
+{
+  errno = ENOTSUP;
+  return -1;
+}
+
+static ssize_t
+_gs_flist(int fd, char *list, size_t size)
+{
+  errno = ENOTSUP;
+  return -1;
+}
+
 #else
 # error "Unsupported platform: only Linux, FreeBSD, and OpenBSD are supported."
 #endif /* platform */
@@ -305,6 +369,35 @@ gs_listxattr(const char *path, char *list, size_t size)
   return _gs_list(path, list, size);
 }
 
+ssize_t
+gs_fgetxattr(int fd, const char *name, void *value, size_t size)
+{
+  if (fd < 0 || !name)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+#if defined(__FreeBSD__)
+  const char *bare_name = STRIP_USER_PREFIX(name);
+  return _gs_fget(fd, bare_name, value, size);
+#else
+  return _gs_fget(fd, name, value, size);
+#endif
+}
+
+ssize_t
+gs_flistxattr(int fd, char *list, size_t size)
+{
+  if (fd < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  return _gs_flist(fd, list, size);
+}
+
 int
 gs_removexattr(const char *path, const char *name)
 {
@@ -346,42 +439,121 @@ gs_xattr_supported(const char *path)
   return -1;
 }
 
-gs_xattr_list_t *
-gs_xattr_list_for_path(const char *path, const char *prefix)
+/*
+ * The batched readers work on a path or on an open file descriptor,
+ * whichever the caller has.
+ */
+typedef struct {
+  const char *path;
+  int         fd;
+} gs_xattr_target_t;
+
+static ssize_t
+_gs_target_list(gs_xattr_target_t t, char *list, size_t size)
 {
-  if (!path)
+  return (t.fd >= 0) ? gs_flistxattr(t.fd, list, size)
+                     : gs_listxattr(t.path, list, size);
+}
+
+static ssize_t
+_gs_target_get(gs_xattr_target_t t, const char *name, void *value, size_t size)
+{
+  return (t.fd >= 0) ? gs_fgetxattr(t.fd, name, value, size)
+                     : gs_getxattr(t.path, name, value, size);
+}
+
+/*
+ * Reads a value with one call when it fits the stack buffer, which
+ * Finder info (32 bytes) and comments always do; only a larger one
+ * (a resource fork) is sized first.  A value that cannot be read is
+ * left NULL, with a size of 0.
+ */
+static void
+_gs_read_value(gs_xattr_target_t t, const char *name, gs_xattr_entry_t *e)
+{
+  char stackbuf[GS_XATTR_SCRATCH_SIZE];
+  ssize_t n = _gs_target_get(t, name, stackbuf, sizeof(stackbuf));
+  int tries;
+
+  if (n > 0)
     {
-      errno = EINVAL;
-      return NULL;
+      e->value = malloc(n);
+      if (e->value)
+        {
+          memcpy(e->value, stackbuf, n);
+          e->size = n;
+        }
+      return;
+    }
+
+  if (n == 0 || errno != ERANGE)
+    return;
+
+  /* the value may grow between the size query and the read */
+  for (tries = 0; tries < 3; tries++)
+    {
+      ssize_t vsize = _gs_target_get(t, name, NULL, 0);
+
+      if (vsize <= 0 || vsize > GS_XATTR_MAX_SIZE)
+        return;
+
+      e->value = malloc(vsize);
+      if (!e->value)
+        return;
+
+      n = _gs_target_get(t, name, e->value, vsize);
+      if (n >= 0)
+        {
+          e->size = n;
+          return;
+        }
+
+      free(e->value);
+      e->value = NULL;
+
+      if (errno != ERANGE)
+        return;
     }
+}
+
+static gs_xattr_list_t *
+_gs_list_for_target(gs_xattr_target_t t, const char *prefix)
+{
+  char stacklist[GS_XATTR_SCRATCH_SIZE];
+  char *buf = stacklist;
+  ssize_t ret;
 
   gs_xattr_list_t *list = calloc(1, sizeof(gs_xattr_list_t));
   if (!list)
     return NULL;
 
-  /* Get list size */
-  ssize_t bufsize = gs_listxattr(path, NULL, 0);
-  if (bufsize <= 0)
+  /* one call for the names, unless there are more than the stack holds */
+  ret = _gs_target_list(t, stacklist, sizeof(stacklist));
+  if (ret < 0 && errno == ERANGE)
     {
-      /* ENOTSUP / no attrs -> return empty list, not an error */
-      if (errno == ENOTSUP || errno == EOPNOTSUPP)
-        return list;
-      free(list);
-      return NULL;
-    }
+      ssize_t bufsize = _gs_target_list(t, NULL, 0);
 
-  char *buf = malloc(bufsize);
-  if (!buf)
-    {
-      free(list);
-      return NULL;
+      if (bufsize > 0 && (buf = malloc(bufsize)) != NULL)
+        ret = _gs_target_list(t, buf, bufsize);
+      else
+        {
+          buf = stacklist;
+          ret = -1;
+        }
     }
 
-  ssize_t ret = gs_listxattr(path, buf, bufsize);
   if (ret <= 0)
     {
-      free(buf);
+      int saved = errno;
+
+      if (buf != stacklist)
+        free(buf);
+
+      /* ENOTSUP / no attrs -> return empty list, not an error */
+      if (ret == 0 || saved == ENOTSUP || saved == EOPNOTSUPP)
+        return list;
       free(list);
+      errno = saved;
       return NULL;
     }
 
@@ -400,10 +572,18 @@ gs_xattr_list_for_path(const char *path, const char *prefix)
       ptr += len + 1;
     }
 
+  if (count == 0)
+    {
+      if (buf != stacklist)
+        free(buf);
+      return list;
+    }
+
   list->entries = calloc(count, sizeof(gs_xattr_entry_t));
-  if (!list->entries && count > 0)
+  if (!list->entries)
     {
-      free(buf);
+      if (buf != stacklist)
+        free(buf);
       free(list);
       return NULL;
     }
@@ -411,7 +591,7 @@ gs_xattr_list_for_path(const char *path, const char *prefix)
 
   /* Copy matching entries */
   ptr = buf;
-  while (ptr < buf + ret)
+  while (ptr < buf + ret && list->count < count)
     {
       size_t len = strlen(ptr);
       if (len > 0)
@@ -422,31 +602,137 @@ gs_xattr_list_for_path(const char *path, const char *prefix)
               e->name = strdup(ptr);
               if (!e->name)
                 {
-                  free(buf);
+                  if (buf != stacklist)
+                    free(buf);
                   gs_xattr_list_free(list);
                   return NULL;
                 }
 
-              ssize_t vsize = gs_getxattr(path, ptr, NULL, 0);
-              if (vsize > 0)
-                {
-                  e->value = malloc(vsize);
-                  if (e->value)
-                    {
-                      gs_getxattr(path, ptr, e->value, vsize);
-                      e->size = vsize;
-                    }
-                }
+              _gs_read_value(t, ptr, e);
               list->count++;
             }
         }
       ptr += len + 1;
     }
 
-  free(buf);
+  if (buf != stacklist)
+    free(buf);
   return list;
 }
 
+gs_xattr_list_t *
+gs_xattr_list_for_path(const char *path, const char *prefix)
+{
+  gs_xattr_target_t t;
+
+  if (!path)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  t.path = path;
+  t.fd = -1;
+  return _gs_list_for_target(t, prefix);
+}
+
+gs_xattr_list_t *
+gs_xattr_list_for_fd(int fd, const char *prefix)
+{
+  gs_xattr_target_t t;
+
+  if (fd < 0)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  t.path = NULL;
+  t.fd = fd;
+  return _gs_list_for_target(t, prefix);
+}
+
+const gs_xattr_entry_t *
+gs_xattr_list_find(const gs_xattr_list_t *list, const char *name)
+{
+  int i;
+
+  if (!list || !name)
+    return NULL;
+
+  for (i = 0; i < list->count; i++)
+    {
+      if (strcmp(list->entries[i].name, name) == 0)
+        return &list->entries[i];
+    }
+
+  return NULL;
+}
+
+int
+gs_xattr_list_directory(const char *dir, const char *prefix,
+                        gs_xattr_dir_filter_t filter,
+                        gs_xattr_dir_callback_t callback,
+                        void *context)
+{
+  char path[PATH_MAX];
+  size_t dirlen;
+  struct dirent *de;
+  DIR *dirp;
+
+  if (!dir || !callback)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+
+  dirlen = strlen(dir);
+  if (dirlen + 2 >= sizeof(path))
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+
+  dirp = opendir(dir);
+  if (!dirp)
+    return -1;
+
+  memcpy(path, dir, dirlen);
+  if (dirlen == 0 || path[dirlen - 1] != '/')
+    path[dirlen++] = '/';
+
+  while ((de = readdir(dirp)) != NULL)
+    {
+      const char *name = de->d_name;
+      size_t namelen = strlen(name);
+      gs_xattr_list_t *list;
+      int err = 0;
+
+      if (name[0] == '.'
+          && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+
+      if (filter && filter(name, context) == 0)
+        continue;
+
+      if (dirlen + namelen + 1 > sizeof(path))
+        continue;
+
+      /* the name list is read by path, one call for a file without
+         attributes; only the values of the names listed are read */
+      memcpy(path + dirlen, name, namelen + 1);
+      list = gs_xattr_list_for_path(path, prefix);
+      if (!list)
+        err = errno;
+
+      callback(name, list, err, context);
+      gs_xattr_list_free(list);
+    }
+
+  closedir(dirp);
+  return 0;
+}
+
 void
 gs_xattr_list_free(gs_xattr_list_t *list)
 {
@@ -94,6 +94,7 @@ typedef enum _MDKCompoundOperator
   NSNumber *queryNumber;
   NSMutableDictionary *sqlDescription;
   NSMutableDictionary *sqlUpdatesDescription;
+  NSTimeInterval updatesStamp;
   NSArray *categoryNames;  
   NSMutableDictionary *groupedResults;
   NSArray *fsfilters;
@@ -190,6 +191,13 @@ typedef enum _MDKCompoundOperator
 
 - (BOOL)isBuilt;
 
+- (NSString *)compileIntoStatements:(NSMutableArray *)statements
+                          fromTable:(NSString *)table;
+
+- (NSString *)compiledStatementFromTable:(NSString *)table;
+
+- (BOOL)usesTemporaryTables;
+
 - (void)setFSFilters:(NSArray *)filters;
 
 - (NSArray *)fsfilters;
@@ -220,11 +228,19 @@ typedef enum _MDKCompoundOperator
 - (void)stopQuery;
 - (BOOL)isStopped;
 
+- (void)setFetchesAllResults:(BOOL)value;
+- (BOOL)fetchesAllResults;
+- (void)fetchMoreResults;
+- (BOOL)isPaused;
+- (void)gatheringPaused;
+- (void)gatheringResumed;
+
 - (void)setUpdatesEnabled:(BOOL)enabled;
 - (BOOL)updatesEnabled;
 - (BOOL)isUpdating;
 - (void)updatingStarted;
 - (void)updatingDone;
+- (void)setUpdatesStamp:(NSTimeInterval)stamp;
 
 - (void)appendResults:(NSArray *)lines;
 
@@ -257,6 +273,8 @@ typedef enum _MDKCompoundOperator
 - (void)queryDidUpdateResults:(MDKQuery *)query
                 forCategories:(NSArray *)catnames;
 
+- (void)queryDidPauseGathering:(MDKQuery *)query;
+
 - (void)queryDidEndGathering:(MDKQuery *)query;
 
 - (void)queryDidStartUpdating:(MDKQuery *)query;
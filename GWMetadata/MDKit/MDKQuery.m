@@ -31,6 +31,9 @@ static NSArray *attrNames = nil;
 static NSDictionary *attrInfo = nil;
 
 static NSString *path_sep(void);
+static NSString *ftsMatchExpression(NSString *value);
+static NSString *searchPathsCondition(NSString *table, NSArray *paths);
+static NSString *appendStatement(NSMutableArray *statements, NSString *select);
 BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 static NSArray *basesetAttributes(void)
@@ -70,10 +73,16 @@ enum {
   GATHERING = 8,
   WAITSTART = 16,
   UPDATE_ENABLE = 32,
-  UPDATING = 64
+  UPDATING = 64,
+  FETCH_PAGES = 128,
+  PAUSED = 256
 };
 
 
+/* an update also asks for the paths stamped this long before the last
+   one started: a transaction may have committed them since */
+#define UPDATES_OVERLAP (10.0)
+
 #define CHECKDELEGATE(s) \
   ((delegate != nil) \
     && [delegate respondsToSelector: @selector(s)])
@@ -86,6 +95,10 @@ enum {
 
 - (void)setOperatorFromType;
 
+- (NSMutableString *)nameSubstring;
+
+- (NSString *)selectFromTable:(NSString *)table;
+
 @end
 
 
@@ -93,6 +106,8 @@ enum {
 {
 }
 
+- (NSString *)selectFromTable:(NSString *)table;
+
 @end
 
 
@@ -382,6 +397,8 @@ enum {
     [sqlDescription setObject: [NSMutableArray array] forKey: @"post"];
     [sqlDescription setObject: queryNumber forKey: @"qnumber"];
 
+    updatesStamp = 0.0;
+
     sqlUpdatesDescription = [NSMutableDictionary new]; 
     [sqlUpdatesDescription setObject: [NSMutableArray array] forKey: @"pre"];
     [sqlUpdatesDescription setObject: [NSString string] forKey: @"join"];
@@ -808,6 +825,119 @@ enum {
   return ((status & BUILT) == BUILT);
 }
 
+/*
+ * The subqueries, as the temporary tables join them: the ones joined
+ * by "||" are a single term, adding their scores, and the terms are
+ * joined by "&&", adding the scores of the paths found by all of them.
+ */
+- (NSString *)compileIntoStatements:(NSMutableArray *)statements
+                          fromTable:(NSString *)table
+{
+  NSMutableArray *terms = [NSMutableArray array];
+  NSMutableArray *names = [NSMutableArray array];
+  NSMutableString *sqlstr;
+  NSString *first;
+  NSUInteger i, j;
+
+  for (i = 0; i < [subqueries count]; i++) {
+    MDKQuery *query = [subqueries objectAtIndex: i];
+    NSString *name = [query compileIntoStatements: statements fromTable: table];
+
+    if (name == nil) {
+      return nil;
+    }
+
+    if (([terms count] == 0)
+            || ([query compoundOperator] != GMDOrCompoundOperator)) {
+      [terms addObject: [NSMutableArray array]];
+    }
+    [[terms lastObject] addObject: name];
+  }
+
+  for (i = 0; i < [terms count]; i++) {
+    NSArray *term = [terms objectAtIndex: i];
+
+    if ([term count] == 1) {
+      [names addObject: [term objectAtIndex: 0]];
+      continue;
+    }
+
+    sqlstr = [NSMutableString stringWithString:
+                           @"SELECT id, path, SUM(score) AS score FROM ("];
+
+    for (j = 0; j < [term count]; j++) {
+      if (j > 0) {
+        [sqlstr appendString: @" UNION ALL "];
+      }
+      [sqlstr appendFormat: @"SELECT id, path, score FROM %@",
+                                                [term objectAtIndex: j]];
+    }
+
+    [sqlstr appendString: @") GROUP BY id"];
+    [names addObject: appendStatement(statements, sqlstr)];
+  }
+
+  if ([names count] < 2) {
+    return [names lastObject];
+  }
+
+  first = [names objectAtIndex: 0];
+  sqlstr = [NSMutableString stringWithFormat: @"SELECT %@.id AS id, "
+                                    @"%@.path AS path, (%@.score",
+                                    first, first, first];
+
+  for (i = 1; i < [names count]; i++) {
+    [sqlstr appendFormat: @" + %@.score", [names objectAtIndex: i]];
+  }
+
+  [sqlstr appendFormat: @") AS score FROM %@", first];
+
+  for (i = 1; i < [names count]; i++) {
+    NSString *name = [names objectAtIndex: i];
+
+    [sqlstr appendFormat: @" JOIN %@ ON %@.id = %@.id", name, name, first];
+  }
+
+  return appendStatement(statements, sqlstr);
+}
+
+/*
+ * The whole query as a single statement on the paths of table, "paths"
+ * or "updated_paths", without the temporary tables of -buildQuery:
+ * every attribute is looked up through the indexes of the attributes
+ * and SQLite plans the joins. nil when a subquery can't be compiled.
+ */
+- (NSString *)compiledStatementFromTable:(NSString *)table
+{
+  NSMutableArray *statements = [NSMutableArray array];
+  NSString *name;
+
+  if ([table isEqual: @"updated_paths"]) {
+    /* the paths updated after :since, all of them when it isn't bound */
+    [statements addObject: @"updates AS (SELECT id, path, words_count "
+                           @"FROM updated_paths "
+                           @"WHERE timestamp > IFNULL(:since, 0))"];
+    table = @"updates";
+  }
+
+  name = [self compileIntoStatements: statements fromTable: table];
+
+  if (name == nil) {
+    return nil;
+  }
+
+  return [NSString stringWithFormat: @"WITH %@ "
+                                     @"SELECT %@.path, %@.score FROM %@ "
+                                     @"ORDER BY %@.score DESC, %@.path ASC;",
+                                     [statements componentsJoinedByString: @", "],
+                                     name, name, name, name, name];
+}
+
+- (BOOL)usesTemporaryTables
+{
+  return ([self compiledStatementFromTable: @"paths"] == nil);
+}
+
 - (void)setFSFilters:(NSArray *)filters
 {
   ASSIGN (fsfilters, filters);
@@ -1114,45 +1244,86 @@ enum {
 		          format: @"Cannot append to a MDKAttributeQuery instance."];     
 }
 
-- (BOOL)buildQuery
+/*
+ * The substring a "contains" query on the file name looks for, when it
+ * is long enough for the trigram index and holds no other wildcard.
+ */
+- (NSMutableString *)nameSubstring
 {
-  MDKQuery *root = [self rootQuery];
-  MDKQuery *leftSibling = [self leftSibling];
-  NSMutableString *sqlstr;
-  
-  sqlstr = [NSString stringWithFormat: @"CREATE TEMP TABLE %@ "
-                                   @"(id INTEGER UNIQUE ON CONFLICT IGNORE, "
-                                   @"path TEXT UNIQUE ON CONFLICT IGNORE, "
-                                   @"words_count INTEGER, "
-                                   @"score REAL); ", destTable];
-  
-  [root appendSQLToPreStatements: sqlstr checkExisting: YES];
+  NSCharacterSet *wildcards;
+  NSString *wc;
+  NSString *substr;
 
-  sqlstr = [NSString stringWithFormat: @"CREATE TEMP TRIGGER %@_trigger "
-               @"BEFORE INSERT ON %@ "
-               @"BEGIN "
-               @"UPDATE %@ "
-               @"SET score = (score + new.score) "
-               @"WHERE id = new.id; "
-               @"END;", destTable, destTable, destTable];
+  if ([attribute isEqual: @"GSMDItemFSName"] == NO
+        || attributeType != STRING
+        || operatorType != MDKEqualToOperatorType) {
+    return nil;
+  }
 
-  [root appendSQLToPreStatements: sqlstr checkExisting: YES];
+  wc = (caseSensitive ? @"*" : @"%");
 
-  sqlstr = [NSMutableString string];
-          
-  [sqlstr appendFormat: @"INSERT INTO %@ (id, path, words_count, score) "
-      @"SELECT "
-      @"%@.id, "
-      @"%@.path, "
-      @"%@.words_count, "
-      @"attributeScore('%@', '%@', attributes.attribute, %i, %i) "
-      @"FROM %@, attributes "
-      @"WHERE attributes.key = '%@' ", 
-      destTable, srcTable, srcTable, srcTable, 
-      attribute, searchValue, attributeType, operatorType, 
-      srcTable, attribute];
-
-  [sqlstr appendFormat: @"AND attributes.attribute %@ ", operator];
+  if ([searchValue length] < 5
+        || [searchValue hasPrefix: wc] == NO
+        || [searchValue hasSuffix: wc] == NO) {
+    return nil;
+  }
+
+  substr = [searchValue substringWithRange: 
+                          NSMakeRange(1, [searchValue length] - 2)];
+  wildcards = [NSCharacterSet characterSetWithCharactersInString: @"*%_?["];
+
+  if ([substr rangeOfCharacterFromSet: wildcards].location != NSNotFound) {
+    return nil;
+  }
+
+  return [[substr mutableCopy] autorelease];
+}
+
+/*
+ * The rows of the paths of table that match the query, with the
+ * columns of the temporary tables: id, path, words_count and score.
+ */
+- (NSString *)selectFromTable:(NSString *)table
+{
+  NSMutableString *sqlstr = [NSMutableString string];
+  NSMutableString *substr;
+
+  if (operator == nil) {
+    return nil;
+  }
+
+  [sqlstr appendFormat: @"SELECT "
+      @"%@.id AS id, "
+      @"%@.path AS path, "
+      @"%@.words_count AS words_count, "
+      @"attributeScore('%@', '%@', attributes.attribute, %i, %i) AS score ",
+      table, table, table, 
+      attribute, searchValue, attributeType, operatorType];
+
+  if ((substr = [self nameSubstring])) {
+    /* 
+     * Let the trigram index find the candidates, and check them against 
+     * the pattern by path id; the unary "+" keeps SQLite from scanning 
+     * the names through the attributes indexes instead. 
+     */  
+    [substr replaceOccurrencesOfString: @"\"" 
+                            withString: @"\"\"" 
+                               options: NSLiteralSearch
+                                 range: NSMakeRange(0, [substr length])];
+
+    [sqlstr appendFormat: @"FROM names CROSS JOIN %@ CROSS JOIN attributes "
+        @"WHERE names MATCH '\"%@\"' "
+        @"AND %@.id = names.rowid "
+        @"AND +attributes.key = '%@' "
+        @"AND +attributes.attribute %@ ",
+        table, substr, table, attribute, operator];
+
+  } else {
+    [sqlstr appendFormat: @"FROM %@, attributes "
+        @"WHERE attributes.key = '%@' "
+        @"AND attributes.attribute %@ ", 
+        table, attribute, operator];
+  }
       
   if ((attributeType == STRING) || (attributeType == DATA)) {
     [sqlstr appendString: @"'"];
@@ -1182,33 +1353,46 @@ enum {
     [sqlstr appendFormat: @"(cast (%@ as REAL)) ", searchValue];
   
   } else {
-    return NO;
+    return nil;
   }
         
-  [sqlstr appendFormat: @"AND attributes.path_id = %@.id ", srcTable];      
+  [sqlstr appendFormat: @"AND attributes.path_id = %@.id ", table];      
+  [sqlstr appendString: searchPathsCondition(table, searchPaths)];
 
-  if (searchPaths) {
-    NSUInteger count = [searchPaths count];
-    NSUInteger i;
-
-    [sqlstr appendString: @"AND ("];
+  return sqlstr;
+}
 
-    for (i = 0; i < count; i++) {
-      NSString *path = [searchPaths objectAtIndex: i];
-      NSString *minpath = [NSString stringWithFormat: @"%@%@*", path, path_sep()];
+- (BOOL)buildQuery
+{
+  MDKQuery *root = [self rootQuery];
+  MDKQuery *leftSibling = [self leftSibling];
+  NSString *select = [self selectFromTable: srcTable];
+  NSString *sqlstr;
 
-      [sqlstr appendFormat: @"(%@.path = '%@' OR %@.path GLOB '%@') ",
-                            srcTable, path, srcTable, minpath];    
+  if (select == nil) {
+    return NO;
+  }
+  
+  sqlstr = [NSString stringWithFormat: @"CREATE TEMP TABLE %@ "
+                                   @"(id INTEGER UNIQUE ON CONFLICT IGNORE, "
+                                   @"path TEXT UNIQUE ON CONFLICT IGNORE, "
+                                   @"words_count INTEGER, "
+                                   @"score REAL); ", destTable];
+  
+  [root appendSQLToPreStatements: sqlstr checkExisting: YES];
 
-      if (i != (count - 1)) {
-        [sqlstr appendString: @"OR "];
-      }
-    }
+  sqlstr = [NSString stringWithFormat: @"CREATE TEMP TRIGGER %@_trigger "
+               @"BEFORE INSERT ON %@ "
+               @"BEGIN "
+               @"UPDATE %@ "
+               @"SET score = (score + new.score) "
+               @"WHERE id = new.id; "
+               @"END;", destTable, destTable, destTable];
 
-    [sqlstr appendString: @")"];      
-  }
+  [root appendSQLToPreStatements: sqlstr checkExisting: YES];
 
-  [sqlstr appendString: @";"];    
+  sqlstr = [NSString stringWithFormat: @"INSERT INTO %@ (id, path, words_count, score) %@;",
+                                       destTable, select];
 
   [root appendSQLToPreStatements: sqlstr checkExisting: NO];
 
@@ -1243,6 +1427,21 @@ enum {
   return [self isBuilt];
 }
 
+/* an attribute may be stored more than once for a path */
+- (NSString *)compileIntoStatements:(NSMutableArray *)statements
+                          fromTable:(NSString *)table
+{
+  NSString *select = [self selectFromTable: table];
+
+  if (select == nil) {
+    return nil;
+  }
+
+  return appendStatement(statements, 
+              [NSString stringWithFormat: @"SELECT id, path, SUM(score) AS score "
+                                          @"FROM (%@) GROUP BY id", select]);
+}
+
 - (NSString *)description
 {
   NSMutableString *descr = [NSMutableString string];
@@ -1391,11 +1590,49 @@ enum {
 		          format: @"Cannot append to a MDKTextContentQuery instance."];     
 }
 
+/*
+ * The rows of the paths of table that match the query, with the
+ * columns of the temporary tables: id, path, words_count and score.
+ */
+- (NSString *)selectFromTable:(NSString *)table
+{
+  NSMutableString *sqlstr = [NSMutableString string];
+
+  if (operatorType == MDKEqualToOperatorType) {
+    [sqlstr appendFormat: @"SELECT "
+        @"%@.id AS id, "
+        @"%@.path AS path, "
+        @"%@.words_count AS words_count, "
+        @"-bm25(contents) AS score "
+        @"FROM contents, %@ "
+        @"WHERE contents MATCH %@ "
+        @"AND %@.id = contents.rowid ",
+        table, table, table, 
+        table, ftsMatchExpression(searchValue), table];
+
+  } else {  /* MDKNotEqualToOperatorType */
+    [sqlstr appendFormat: @"SELECT "
+        @"%@.id AS id, "
+        @"%@.path AS path, "
+        @"%@.words_count AS words_count, "
+        @"(1.0 / %@.words_count) AS score "        
+        @"FROM %@ "
+        @"WHERE %@.id NOT IN "
+        @"(SELECT rowid FROM contents WHERE contents MATCH %@) ",
+        table, table, table, table, 
+        table, table, ftsMatchExpression(searchValue)];
+  }
+
+  [sqlstr appendString: searchPathsCondition(table, searchPaths)];
+
+  return sqlstr;
+}
+
 - (BOOL)buildQuery
 {
   MDKQuery *root = [self rootQuery];
   MDKQuery *leftSibling = [self leftSibling];  
-  NSMutableString *sqlstr;
+  NSString *sqlstr;
 
   sqlstr = [NSString stringWithFormat: @"CREATE TEMP TABLE %@ "
                                    @"(id INTEGER UNIQUE ON CONFLICT IGNORE, "
@@ -1415,72 +1652,8 @@ enum {
 
   [root appendSQLToPreStatements: sqlstr checkExisting: YES];
 
-  sqlstr = [NSMutableString string];
-
-  if (operatorType == MDKEqualToOperatorType) {
-    [sqlstr appendFormat: @"INSERT INTO %@ (id, path, words_count, score) "
-        @"SELECT "
-        @"%@.id, "
-        @"%@.path, "
-        @"%@.words_count, "
-        @"wordScore('%@', words.word, postings.word_count, %@.words_count) "
-        @"FROM words, %@, postings ",        
-        destTable, srcTable, srcTable, srcTable, 
-        searchValue, srcTable, srcTable];
-
-    [sqlstr appendFormat: @"WHERE words.word %@ '", operator];
-    [sqlstr appendString: searchValue];
-    [sqlstr appendString: @"' "];
-
-    [sqlstr appendFormat: @"AND postings.word_id = words.id "
-                         @"AND %@.id = postings.path_id ", srcTable];
-
-  } else {  /* MDKNotEqualToOperatorType */
-    [sqlstr appendFormat: @"INSERT INTO %@ (id, path, words_count, score) "
-        @"SELECT "
-        @"%@.id AS tid, "
-        @"%@.path, "
-        @"%@.words_count, "
-        @"(1.0 / %@.words_count) "        
-        @"FROM %@ ",
-        destTable, srcTable, srcTable, srcTable, 
-        srcTable, srcTable];
-
-    [sqlstr appendString: @"WHERE "
-                         @"(SELECT words.word "
-                         @"FROM words, postings "
-                         @"WHERE postings.path_id = tid "
-                         @"AND words.id = postings.word_id "];
-
-    [sqlstr appendFormat: @"AND words.word %@ '", operator];
-
-    [sqlstr appendString: searchValue];
-
-    [sqlstr appendString: @"') ISNULL "];
-  }
-
-  if (searchPaths) {
-    unsigned count = [searchPaths count];
-    unsigned i;
-
-    [sqlstr appendString: @"AND ("];
-
-    for (i = 0; i < count; i++) {
-      NSString *path = [searchPaths objectAtIndex: i];
-      NSString *minpath = [NSString stringWithFormat: @"%@%@*", path, path_sep()];
-
-      [sqlstr appendFormat: @"(%@.path = '%@' OR %@.path GLOB '%@') ",
-                            srcTable, path, srcTable, minpath];    
-
-      if (i != (count - 1)) {
-        [sqlstr appendString: @"OR "];
-      }
-    }
-
-    [sqlstr appendString: @") "];      
-  }
-
-  [sqlstr appendString: @";"];    
+  sqlstr = [NSString stringWithFormat: @"INSERT INTO %@ (id, path, words_count, score) %@;",
+                                       destTable, [self selectFromTable: srcTable]];
 
   [root appendSQLToPreStatements: sqlstr checkExisting: NO];
 
@@ -1515,6 +1688,13 @@ enum {
   return [self isBuilt];
 }
 
+/* the full text index has a single row for each path */
+- (NSString *)compileIntoStatements:(NSMutableArray *)statements
+                          fromTable:(NSString *)table
+{
+  return appendStatement(statements, [self selectFromTable: table]);
+}
+
 - (NSString *)description
 {
   NSMutableString *descr = [NSMutableString string];
@@ -1561,8 +1741,23 @@ enum {
 - (NSDictionary *)sqlDescription
 {
   if ([self isRoot]) {
-    NSString *jtable = [self joinTable];
-    NSString *joinquery = [NSString stringWithFormat: @"SELECT %@.path, "
+    NSString *compiled = [self compiledStatementFromTable: @"paths"];
+    NSString *jtable;
+    NSString *joinquery;
+
+    if (compiled) {
+      NSString *updates = [self compiledStatementFromTable: @"updated_paths"];
+
+      return [NSDictionary dictionaryWithObjectsAndKeys:
+                         compiled, @"join",
+                         queryNumber, @"qnumber",
+                         [NSDictionary dictionaryWithObject: updates 
+                                                     forKey: @"join"], @"updates",
+                         nil];
+    }
+
+    jtable = [self joinTable];
+    joinquery = [NSString stringWithFormat: @"SELECT %@.path, "
                                           @"%@.score "
                                           @"FROM %@ "
                                           @"ORDER BY "
@@ -1572,6 +1767,13 @@ enum {
                                           jtable, jtable];
   
     [sqlDescription setObject: joinquery forKey: @"join"];
+
+    /* lets gmds bring cached results of the same query up to date */
+    [sqlDescription setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                         [sqlUpdatesDescription objectForKey: @"pre"], @"pre",
+                         [sqlUpdatesDescription objectForKey: @"post"], @"post",
+                         nil]
+                       forKey: @"updates"];
     
     return sqlDescription;
   
@@ -1586,6 +1788,23 @@ enum {
 - (NSDictionary *)sqlUpdatesDescription
 {
   if ([self isRoot]) {
+    NSString *compiled = [self compiledStatementFromTable: @"updated_paths"];
+
+    if (compiled) {
+      NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+
+      [dict setObject: compiled forKey: @"join"];
+      [dict setObject: queryNumber forKey: @"qnumber"];
+
+      /* only the paths updated since the results we have */
+      if (updatesStamp > 0.0) {
+        [dict setObject: [NSNumber numberWithDouble: updatesStamp - UPDATES_OVERLAP]
+                 forKey: @"since"];
+      }
+
+      return dict;
+    }
+
     [sqlUpdatesDescription setObject: [[self sqlDescription] objectForKey: @"join"]
                               forKey: @"join"];
 
@@ -1635,6 +1854,8 @@ enum {
 
 - (void)gatheringDone
 {
+  status &= ~PAUSED;
+
   if ([self isStopped]) {
     status &= ~(GATHERING | UPDATING);
   } else {
@@ -1655,6 +1876,7 @@ enum {
 {
   status |= STOPPED;
   status &= ~WAITSTART;
+  [qmanager stopQuery: self];
 }
 
 - (BOOL)isStopped
@@ -1662,6 +1884,49 @@ enum {
   return ((status & STOPPED) == STOPPED);
 }
 
+/*
+ * By default all the results are gathered as fast as gmds sends them.
+ * A client that shows only some of them can take them by pages: after
+ * each page the query pauses until -fetchMoreResults.
+ */
+- (void)setFetchesAllResults:(BOOL)value
+{
+  if (value) {
+    status &= ~FETCH_PAGES;
+  } else {
+    status |= FETCH_PAGES;
+  }
+}
+
+- (BOOL)fetchesAllResults
+{
+  return ((status & FETCH_PAGES) != FETCH_PAGES);
+}
+
+- (void)fetchMoreResults
+{
+  [qmanager fetchMoreResultsForQuery: self];
+}
+
+- (BOOL)isPaused
+{
+  return ((status & PAUSED) == PAUSED);
+}
+
+- (void)gatheringPaused
+{
+  status |= PAUSED;
+
+  if (CHECKDELEGATE (queryDidPauseGathering:)) {
+    [delegate queryDidPauseGathering: self];
+  }
+}
+
+- (void)gatheringResumed
+{
+  status &= ~PAUSED;
+}
+
 - (void)setUpdatesEnabled:(BOOL)enabled
 {
   if (enabled) {
@@ -1695,6 +1960,15 @@ enum {
   }  
 }
 
+/*
+ * The time gmds started the last query or update whose rows we have
+ * all: the next update only asks for the paths updated since.
+ */
+- (void)setUpdatesStamp:(NSTimeInterval)stamp
+{
+  updatesStamp = stamp;
+}
+
 - (void)appendResults:(NSArray *)lines
 {
   if (reportRawResults) {
@@ -1722,6 +1996,33 @@ enum {
         if (caninsert) {
           NSString *category = [qmanager categoryNameForNode: node];
 
+          /* an updated path may have moved to another category */
+          if (sort) {
+            NSUInteger j;
+
+            for (j = 0; j < [categoryNames count]; j++) {
+              NSString *catname = [categoryNames objectAtIndex: j];
+              NSDictionary *catdict = [groupedResults objectForKey: catname];
+              NSMutableArray *catnodes = [catdict objectForKey: @"nodes"];
+              NSUInteger index;
+
+              if ([catname isEqual: category]) {
+                continue;
+              }
+
+              index = [catnodes indexOfObject: node];
+
+              if (index != NSNotFound) {
+                [catnodes removeObjectAtIndex: index];
+                [[catdict objectForKey: @"scores"] removeObjectAtIndex: index];
+
+                if ([catnames containsObject: catname] == NO) {
+                  [catnames addObject: catname];
+                }
+              }
+            }
+          }
+
           [self insertNode: node 
                   andScore: score 
               inDictionary: [groupedResults objectForKey: category] 
@@ -1852,7 +2153,7 @@ enum {
     }
   }
   
-  if ((index != NSNotFound) && CHECKDELEGATE (queryDidUpdateResults:forCategories:)) {        
+  if ([catnames count] && CHECKDELEGATE (queryDidUpdateResults:forCategories:)) {        
     [delegate queryDidUpdateResults: self forCategories: catnames];
   }
   
@@ -2182,6 +2483,98 @@ enum {
 @end
 
 
+/*
+ * The FTS5 match expression, as an SQL term, for a word of a text
+ * content query.  The value is already escaped for an SQL literal and
+ * can hold the wildcards of both LIKE and GLOB: a trailing one is a
+ * prefix query, any other pattern is expanded to the indexed terms
+ * it matches, or to an empty phrase that matches nothing.
+ */
+static NSString *ftsMatchExpression(NSString *value)
+{
+  NSCharacterSet *wildcards = [NSCharacterSet characterSetWithCharactersInString: @"*%"];
+  NSMutableString *word = [[value mutableCopy] autorelease];
+  BOOL prefix = NO;
+
+  while ([word length] 
+            && [wildcards characterIsMember: [word characterAtIndex: [word length] - 1]]) {
+    [word deleteCharactersInRange: NSMakeRange([word length] - 1, 1)];
+    prefix = YES;
+  }
+
+  if ([word length] 
+        && [word rangeOfCharacterFromSet: wildcards].location == NSNotFound) {
+    [word replaceOccurrencesOfString: @"\"" 
+                          withString: @"\"\"" 
+                             options: NSLiteralSearch
+                               range: NSMakeRange(0, [word length])];
+                               
+    return [NSString stringWithFormat: @"'\"%@\"%@'", word, (prefix ? @"*" : @"")];
+  }
+
+  word = [[[value lowercaseString] mutableCopy] autorelease];
+  [word replaceOccurrencesOfString: @"%" 
+                        withString: @"*" 
+                           options: NSLiteralSearch
+                             range: NSMakeRange(0, [word length])];
+
+  return [NSString stringWithFormat: @"IFNULL((SELECT group_concat("
+                  @"'\"' || replace(term, '\"', '\"\"') || '\"', ' OR ') "
+                  @"FROM contents_terms WHERE term GLOB '%@'), '\"\"')", word];
+}
+
+/*
+ * The condition that keeps the paths of table under the search paths,
+ * or an empty string when the query has none.
+ */
+static NSString *searchPathsCondition(NSString *table, NSArray *paths)
+{
+  NSMutableString *sqlstr = [NSMutableString string];
+  NSUInteger count = [paths count];
+  NSUInteger i;
+
+  if (count == 0) {
+    return sqlstr;
+  }
+
+  [sqlstr appendString: @"AND ("];
+
+  for (i = 0; i < count; i++) {
+    NSString *path = stringForQuery([paths objectAtIndex: i]);
+    NSString *minpath = [NSString stringWithFormat: @"%@%@*", path, path_sep()];
+
+    [sqlstr appendFormat: @"(%@.path = '%@' OR %@.path GLOB '%@') ",
+                          table, path, table, minpath];    
+
+    if (i != (count - 1)) {
+      [sqlstr appendString: @"OR "];
+    }
+  }
+
+  [sqlstr appendString: @") "];
+
+  return sqlstr;
+}
+
+/*
+ * Appends a common table expression for select to the statements of a 
+ * compiled query, and returns its name.  The names only depend on the
+ * order of the subqueries, so the same query compiles to the same text.
+ */
+static NSString *appendStatement(NSMutableArray *statements, NSString *select)
+{
+  NSString *name;
+
+  if (select == nil) {
+    return nil;
+  }
+
+  name = [NSString stringWithFormat: @"q%lu", (unsigned long)[statements count]];
+  [statements addObject: [NSString stringWithFormat: @"%@ AS (%@)", name, select]];
+
+  return name;
+}
+
 static NSString *path_sep(void)
 {
   static NSString *separator = nil;
@@ -33,6 +33,7 @@
 @interface MDKQueryManager : NSObject
 {  
   NSMutableArray *queries;
+  NSMutableArray *activeQueries;
   NSMutableArray *liveQueries;
   unsigned long tableNumber;
   unsigned long queryNumber;
@@ -50,6 +51,14 @@
 
 - (oneway void)endOfQueryWithNumber:(NSNumber *)qnum;
 
+- (void)fetchMoreResultsForQuery:(MDKQuery *)query;
+
+- (void)stopQuery:(MDKQuery *)query;
+
+- (void)yieldPausedQuery;
+
+- (void)performQueuedQueries;
+
 - (MDKQuery *)queryWithNumber:(NSNumber *)qnum;
 
 - (MDKQuery *)nextQuery;
@@ -32,6 +32,9 @@
   do { if (GW_DEBUG_LOG) \
     NSDebugLLog(@"gwspace", format , ## args); } while (0)
 
+/* queries gmds steps side by side, a page each */
+#define MAX_ACTIVE_QUERIES 4
+
 static MDKQueryManager *queryManager = nil;
 
 
@@ -52,6 +55,10 @@ static MDKQueryManager *queryManager = nil;
 
 - (oneway void)performQuery:(NSDictionary *)queryInfo;
 
+- (oneway void)nextResultsForQueryWithNumber:(NSNumber *)qnum;
+
+- (oneway void)stopQueryWithNumber:(NSNumber *)qnum;
+
 @end
 
 
@@ -70,6 +77,7 @@ static MDKQueryManager *queryManager = nil;
   [dnc removeObserver: self];
   [nc removeObserver: self];
   RELEASE (queries);
+  RELEASE (activeQueries);
   RELEASE (liveQueries);
   
   [super dealloc];
@@ -81,6 +89,7 @@ static MDKQueryManager *queryManager = nil;
   
   if (self) {
     queries = [NSMutableArray new];
+    activeQueries = [NSMutableArray new];
     liveQueries = [NSMutableArray new];
   
     tableNumber = 0L;
@@ -119,7 +128,8 @@ static MDKQueryManager *queryManager = nil;
     for (i = 0; i < count; i++) {
       MDKQuery *q = [queries objectAtIndex: i];
       
-      if (([q isGathering] == NO) && [q isStopped]) {
+      if (([q isGathering] == NO) && [q isStopped]
+                    && ([activeQueries containsObject: q] == NO)) {
         [queries removeObjectAtIndex: i];
         i--;
         count--;
@@ -143,11 +153,8 @@ static MDKQueryManager *queryManager = nil;
     NS_ENDHANDLER
         
     [queries insertObject: query atIndex: 0];
-    
-    if ([queries count] == 1) {
-      [query setStarted];
-      [gmds performQuery: [query sqlDescription]];
-    }
+    [self yieldPausedQuery];
+    [self performQueuedQueries];
       
   } else {
     [NSException raise: NSInternalInconsistencyException
@@ -166,8 +173,28 @@ static MDKQueryManager *queryManager = nil;
   BOOL resok = NO;
   
   if (query && ([query isStopped] == NO)) {
+    NSNumber *stamp = [dict objectForKey: @"stamp"];
+    NSArray *removed = [dict objectForKey: @"removed"];
+
+    /* the paths of an update that no longer match */
+    if ([removed count]) {
+      [query removePaths: removed];
+    }
     [query appendResults: [dict objectForKey: @"lines"]];
     resok = YES;
+
+    /* on the last page: the next update starts from here */
+    if (stamp) {
+      [query setUpdatesStamp: [stamp doubleValue]];
+    }
+
+    /* the updates of a live query are few */
+    if ([query fetchesAllResults] || [query isUpdating]) {
+      [gmds nextResultsForQueryWithNumber: qnum];
+    } else {
+      [query gatheringPaused];
+      [self yieldPausedQuery];
+    }
   }
 
   RELEASE (arp);
@@ -190,25 +217,135 @@ static MDKQueryManager *queryManager = nil;
       [query updatingDone];
     }  
     [query gatheringDone];
+    [activeQueries removeObject: query];
     [queries removeObject: query];
   }
 
-  query = [self nextQuery];
+  [self performQueuedQueries];
+}
 
-  if (query && ([query isGathering] == NO)) {
-    if ([query isStopped] == NO) {
-      if ([query isUpdating] == NO) {    
-        [query setStarted];
-        [gmds performQuery: [query sqlDescription]];
-      } else {
-        [query updatingStarted];
-        
-        GWDebugLog(@"PERFORMING UPDATE (2) %lu", [queries count]);
-        
-        [gmds performQuery: [query sqlUpdatesDescription]];
-      }
+/*
+ * A query paged by its client asks gmds for the next page only when
+ * the client wants more.
+ */
+- (void)fetchMoreResultsForQuery:(MDKQuery *)query
+{
+  if (gmds && [query isPaused] && [queries containsObject: query]) {
+    [query gatheringResumed];
+    [gmds nextResultsForQueryWithNumber: [query queryNumber]];
+  }
+}
+
+/*
+ * Makes gmds drop the statement of a started query at once, instead
+ * of stepping on until the next page is refused.
+ */
+- (void)stopQuery:(MDKQuery *)query
+{
+  if (gmds && [activeQueries containsObject: query]) {
+    [gmds stopQueryWithNumber: [query queryNumber]];
+  }
+}
+
+/*
+ * A paused query would keep those queued after it waiting for no end
+ * when it holds the last free turn: it gets what it has and gives its
+ * turn up.
+ */
+- (void)yieldPausedQuery
+{
+  MDKQuery *waiting = nil;
+  NSUInteger i;
+
+  if (gmds == nil) {
+    return;
+  }
+
+  for (i = 0; i < [queries count]; i++) {
+    MDKQuery *query = [queries objectAtIndex: i];
+
+    if (([activeQueries containsObject: query] == NO) 
+                                    && ([query isStopped] == NO)) {
+      waiting = query;
+    }
+  }
+
+  if ((waiting == nil) 
+        || (([activeQueries count] < MAX_ACTIVE_QUERIES) 
+                          && ([waiting usesTemporaryTables] == NO))) {
+    return;
+  }
+
+  for (i = 0; i < [queries count]; i++) {
+    MDKQuery *query = [queries objectAtIndex: i];
+
+    if ([query isPaused]) {
+      GWDebugLog(@"YIELDING PAUSED QUERY %@", [query queryNumber]);
+      [gmds stopQueryWithNumber: [query queryNumber]];
+      break;
+    }
+  }
+}
+
+/*
+ * Starts the queued queries, the oldest first, as long as there are
+ * free turns.  gmds runs the queries of a client side by side, a page
+ * each, but the temporary tables of a query that can't be compiled 
+ * can't be created or dropped while other statements are running: 
+ * such a query runs alone.
+ */
+- (void)performQueuedQueries
+{
+  NSInteger i;
+
+  if (gmds == nil) {
+    return;
+  }
+
+  for (i = 0; i < [activeQueries count]; i++) {
+    if ([[activeQueries objectAtIndex: i] usesTemporaryTables]) {
+      return;
+    }
+  }
+
+  for (i = [queries count] - 1; i >= 0; i--) {
+    MDKQuery *query = [queries objectAtIndex: i];
+    BOOL exclusive;
+
+    if ([activeQueries containsObject: query]) {
+      continue;
+    }
+
+    if ([query isStopped]) {
+      [queries removeObjectAtIndex: i];
+      continue;
+    }
+
+    if ([activeQueries count] >= MAX_ACTIVE_QUERIES) {
+      break;
+    }
+
+    exclusive = [query usesTemporaryTables];
+
+    if (exclusive && [activeQueries count]) {
+      break;
+    }
+
+    [activeQueries addObject: query];
+
+    if ([query isUpdating] == NO) {    
+      [query setStarted];
+      [gmds performQuery: [query sqlDescription]];
     } else {
-      [queries removeObject: query];
+      [query updatingStarted];
+      
+      GWDebugLog(@"PERFORMING UPDATE %lu", [queries count]);
+      
+      [gmds performQuery: [query sqlUpdatesDescription]];
+    }
+
+    if (exclusive) {
+      break;
     }
   }
 }
@@ -337,14 +474,8 @@ static MDKQueryManager *queryManager = nil;
     }
   }
   
-  if (count && (count == [queries count])) {  
-    MDKQuery *query = [queries lastObject];
-    
-    GWDebugLog(@"PERFORMING UPDATE (1) %lu", [queries count]);
-    
-    [query updatingStarted];
-    [gmds performQuery: [query sqlUpdatesDescription]];
-  }
+  [self yieldPausedQuery];
+  [self performQueuedQueries];
 
   RELEASE (arp);
 }
@@ -47,6 +47,8 @@
 
 /* defines the maximum number of files to open before issuing a dialog */
 #define MAX_FILES_TO_OPEN_DIALOG 8
+/* the more results are asked for this many rows before the last */
+#define FETCH_AHEAD_ROWS 20
 
 
 BOOL isDotFile(NSString *path);
@@ -1182,6 +1184,7 @@ static NSString *nibName = @"MDKWindow";
   
   ASSIGN (currentQuery, [MDKQuery query]);
   [currentQuery setUpdatesEnabled: YES];
+  [currentQuery setFetchesAllResults: NO];
   [currentQuery setDelegate: self];
   
   casesens = ([caseSensButt state] == NSOnState);
@@ -1294,10 +1297,31 @@ static NSString *nibName = @"MDKWindow";
 - (void)queryDidUpdateResults:(MDKQuery *)query
                 forCategories:(NSArray *)catnames
 {
+  /* an empty page, or an update that changed nothing we show */
+  if ([catnames count] == 0) {
+    return;
+  }
+
   [self updateCategoryControls: YES removeSubviews: NO];
   [self updateElementsLabel: globalCount]; 
 }
 
+- (void)queryDidPauseGathering:(MDKQuery *)query
+{
+  if (query == currentQuery) {
+    NSRect vr = [resultsView visibleRect];
+    NSInteger visible = (NSInteger)(NSHeight(vr) / CELLS_HEIGHT);
+
+    /* go on until the rows fill the view, with some to scroll */
+    if (rowsCount < (visible + FETCH_AHEAD_ROWS)) {
+      [query fetchMoreResults];
+    } else {
+      [progView stop];
+      [self updateElementsLabel: globalCount];
+    }
+  }
+}
+
 - (void)queryDidEndGathering:(MDKQuery *)query
 {
   if (query == currentQuery) {
@@ -1452,6 +1476,11 @@ static NSString *nibName = @"MDKWindow";
               row:(NSInteger)rowIndex
 {
   id nd = [catlist resultAtIndex: rowIndex];
+
+  if ((rowIndex >= (rowsCount - FETCH_AHEAD_ROWS)) && [currentQuery isPaused]) {
+    [progView start];
+    [currentQuery fetchMoreResults];
+  }
   
   if ((*isMember)(nd, memberSel, FSNodeClass)) {
     [aCell setHeadCell: NO];
@@ -37,6 +37,8 @@
 {
   sqlite3 *db;
   NSMutableDictionary *preparedStatements;  
+  NSMutableDictionary *cachedStatements;
+  NSMutableArray *cachedQueries;
   NSFileManager *fm;   
 }
 
@@ -86,6 +88,10 @@
          withIdentifier:(id)identifier
                bindings:(int)firstTipe, ...;
 
+- (SQLitePreparedStatement *)cachedStatementForQuery:(NSString *)query;
+
+- (void)finalizeStatements;
+
 - (BOOL)executeQueryWithStatement:(SQLitePreparedStatement *)statement;
 
 - (NSArray *)resultsOfQueryWithStatement:(SQLitePreparedStatement *)statement;
@@ -37,15 +37,20 @@
     NSDebugLLog(@"gwspace", format , ## args); } while (0)
 
 #define MAX_RETRY 1000
+/* the plain queries kept prepared, the least recently used go first */
+#define STATEMENT_CACHE_SIZE 64
 
 @implementation SQLite
 
 - (void)dealloc
 {
+  [self finalizeStatements];
   if (db != NULL) {
     sqlite3_close(db);
   }
   RELEASE (preparedStatements);
+  RELEASE (cachedStatements);
+  RELEASE (cachedQueries);
   
   [super dealloc];
 }
@@ -63,6 +68,8 @@
   
   if (self) {
     preparedStatements = [NSMutableDictionary new];
+    cachedStatements = [NSMutableDictionary new];
+    cachedQueries = [NSMutableArray new];
     db = NULL;
     fm = [NSFileManager defaultManager];
 
@@ -81,6 +88,8 @@
   
   if (self) {
     preparedStatements = [NSMutableDictionary new];
+    cachedStatements = [NSMutableDictionary new];
+    cachedQueries = [NSMutableArray new];
     db = NULL;
     fm = [NSFileManager defaultManager];
   }
@@ -166,6 +175,8 @@
 
 - (void)closeDb
 {
+  [self finalizeStatements];
+
   if (db != NULL) {
     sqlite3_close(db);
     db = NULL;
@@ -195,135 +206,33 @@
   return YES;
 }
 
+/*
+ * The plain queries are run through cachedStatementForQuery: too: the
+ * same text is parsed once.  Values go in as bindings of a statement
+ * with an identifier, not in the text.
+ */
 - (BOOL)executeQuery:(NSString *)query
 {
-  const char *qbuff = [query UTF8String];
-  struct sqlite3_stmt *stmt;
-  int retry = 0;
-  int err;
-  
-  err = sqlite3_prepare(db, qbuff, strlen(qbuff), &stmt, NULL);
-  
-  if (err != SQLITE_OK) {
-    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
-    return NO;
-  }
-  
-  while (1) {
-    err = sqlite3_step(stmt);
-
-    if (err == SQLITE_DONE) {
-      break;
-      
-    } else if (err == SQLITE_BUSY) {
-      CREATE_AUTORELEASE_POOL(arp); 
-
-      usleep(100000); // 0.1 seconds
-      GWDebugLog(@"retry %i", retry);
-      RELEASE (arp);
-
-      if (retry++ >= MAX_RETRY) {
-        NSDebugLLog(@"gwspace", @"timeout for query: %@", query);
-        NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-		    return NO;
-      }
+  SQLitePreparedStatement *statement = [self cachedStatementForQuery: query];
 
-    } else {
-      NSDebugLLog(@"gwspace", @"error at: %@", query);
-      NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
-      sqlite3_finalize(stmt);
-      return NO;
-    }
+  if (statement == nil) {
+    NSDebugLLog(@"gwspace", @"error at: %@", query);
+    return NO;
   }
 
-  sqlite3_finalize(stmt);
-  
-  return YES;
+  return [self executeQueryWithStatement: statement];
 }
 
 - (NSArray *)resultsOfQuery:(NSString *)query
 {
-  const char *qbuff = [query UTF8String];
-  NSMutableArray *lines = [NSMutableArray array];
-  struct sqlite3_stmt *stmt;
-  int retry = 0;
-  int err;
-  int i;
-    
-  if (sqlite3_prepare(db, qbuff, strlen(qbuff), &stmt, NULL) == SQLITE_OK) {
-    while (1) {
-      err = sqlite3_step(stmt);
-
-      if (err == SQLITE_ROW) {
-        NSMutableDictionary *line = [NSMutableDictionary dictionary];
-        int count = sqlite3_data_count(stmt);
-
-        // we use "<= count" because sqlite sends also 
-        // the id of the entry with type = 0 
-        for (i = 0; i <= count; i++) { 
-          const char *name = sqlite3_column_name(stmt, i); 
-          
-          if (name != NULL) {
-            int type = sqlite3_column_type(stmt, i);
-
-            if (type == SQLITE_INTEGER) {
-              [line setObject: [NSNumber numberWithInt: sqlite3_column_int(stmt, i)]
-                       forKey: [NSString stringWithUTF8String: name]];    
-            
-            } else if (type == SQLITE_FLOAT) {
-              [line setObject: [NSNumber numberWithDouble: sqlite3_column_double(stmt, i)]
-                       forKey: [NSString stringWithUTF8String: name]];    
-            
-            } else if (type == SQLITE_TEXT) {
-              [line setObject: [NSString stringWithUTF8String: (const char *)sqlite3_column_text(stmt, i)]
-                       forKey: [NSString stringWithUTF8String: name]];    
+  SQLitePreparedStatement *statement = [self cachedStatementForQuery: query];
 
-            } else if (type == SQLITE_BLOB) {
-              const void *bytes = sqlite3_column_blob(stmt, i);
-              int length = sqlite3_column_bytes(stmt, i); 
-              
-              [line setObject: [NSData dataWithBytes: bytes length: length]
-                       forKey: [NSString stringWithUTF8String: name]];    
-            }
-          }
-        }
-
-        [lines addObject: line];
-
-      } else {
-        if (err == SQLITE_DONE) {
-          break;
-
-        } else if (err == SQLITE_BUSY) {
-          CREATE_AUTORELEASE_POOL(arp); 
-
-          usleep(100000); // 0.1 seconds
-          GWDebugLog(@"retry %i", retry);
-          RELEASE (arp);
-
-          if (retry++ >= MAX_RETRY) {
-            NSDebugLLog(@"gwspace", @"timeout for query: %@", query);
-            NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
-		        break;
-          }
-
-        } else {
-          NSDebugLLog(@"gwspace", @"error at: %@", query);
-          NSDebugLLog(@"gwspace", @"%i %s", err, sqlite3_errmsg(db));
-          break;
-        }
-      }
-    }
-  
-    sqlite3_finalize(stmt);
-    
-  } else {
+  if (statement == nil) {
     NSDebugLLog(@"gwspace", @"error at: %@", query);
-    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
+    return [NSArray array];
   }
-  
-  return lines;
+
+  return [self resultsOfQueryWithStatement: statement];
 }
 
 - (int)getIntEntry:(NSString *)query
@@ -462,6 +371,50 @@
   return statement;
 }
 
+- (SQLitePreparedStatement *)cachedStatementForQuery:(NSString *)query
+{
+  SQLitePreparedStatement *statement = [cachedStatements objectForKey: query];
+
+  if (statement) {
+    if ([cachedQueries lastObject] != query) {
+      RETAIN (query);
+      [cachedQueries removeObject: query];
+      [cachedQueries addObject: query];
+      RELEASE (query);
+    }
+    return statement;
+  }
+
+  statement = [SQLitePreparedStatement statementWithQuery: query onDb: db];
+
+  if (statement == nil) {
+    return nil;
+  }
+
+  if ([cachedQueries count] >= STATEMENT_CACHE_SIZE) {
+    NSString *oldest = [cachedQueries objectAtIndex: 0];
+
+    [[cachedStatements objectForKey: oldest] finalizeStatement];
+    [cachedStatements removeObjectForKey: oldest];
+    [cachedQueries removeObjectAtIndex: 0];
+  }
+
+  [cachedStatements setObject: statement forKey: query];
+  [cachedQueries addObject: query];
+
+  return statement;
+}
+
+/* Before the db is closed: it can't be while statements are left. */
+- (void)finalizeStatements
+{
+  [[preparedStatements allValues] makeObjectsPerformSelector: @selector(finalizeStatement)];
+  [preparedStatements removeAllObjects];
+  [[cachedStatements allValues] makeObjectsPerformSelector: @selector(finalizeStatement)];
+  [cachedStatements removeAllObjects];
+  [cachedQueries removeAllObjects];
+}
+
 - (BOOL)executeQueryWithStatement:(SQLitePreparedStatement *)statement
 {
   if (statement) {
@@ -655,11 +608,12 @@
   self = [super init];
 
   if (self) {
-    ASSIGN (query, stringForQuery(aquery));
+    ASSIGN (query, aquery);
     db = dbptr;
     handle = NULL;
     
-    if (sqlite3_prepare(db, [query UTF8String], -1, &handle, NULL) != SQLITE_OK) {
+    /* a _v2 statement prepares itself again when the schema changes */
+    if (sqlite3_prepare_v2(db, [query UTF8String], -1, &handle, NULL) != SQLITE_OK) {
       NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
       DESTROY (self);
     }
@@ -719,12 +673,17 @@
 
 - (BOOL)expired
 {
-  return (sqlite3_expired(handle) != 0);
+  return ((handle == NULL) || (sqlite3_expired(handle) != 0));
 }
 
 - (BOOL)prepare
 {
-  if (sqlite3_prepare(db, [query UTF8String], -1, &handle, NULL) != SQLITE_OK) {
+  if (handle != NULL) {
+    sqlite3_finalize(handle);
+    handle = NULL;
+  }
+
+  if (sqlite3_prepare_v2(db, [query UTF8String], -1, &handle, NULL) != SQLITE_OK) {
     NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
     return NO;
   }
@@ -739,14 +698,12 @@
 
 - (BOOL)finalizeStatement
 {
+  /* the handle is gone whatever the last step returned */
   int err = sqlite3_finalize(handle);
 
-  if (err == SQLITE_OK) {
-    handle = NULL;
-    return YES;
-  }
+  handle = NULL;
   
-  return NO;
+  return (err == SQLITE_OK);
 }
 
 - (NSString *)query
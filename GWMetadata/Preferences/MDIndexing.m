@@ -32,6 +32,31 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 BOOL isDotFile(NSString *path);
 
+/* no file done for this long, and the indexing looks stuck */
+#define STALLED_TIME (120.0)
+/* mdextractor rewrites metrics.plist every few seconds while it indexes */
+#define STALE_TIME (30.0)
+
+static NSString *sizeString(double bytes)
+{
+  if (bytes >= 1073741824.0) {
+    return [NSString stringWithFormat: @"%.1f GB", bytes / 1073741824.0];
+  } else if (bytes >= 1048576.0) {
+    return [NSString stringWithFormat: @"%.1f MB", bytes / 1048576.0];
+  }
+  return [NSString stringWithFormat: @"%.0f KB", bytes / 1024.0];
+}
+
+static NSString *durationString(double seconds)
+{
+  if (seconds < 60.0) {
+    return [NSString stringWithFormat: @"%.0f s", seconds];
+  } else if (seconds < 3600.0) {
+    return [NSString stringWithFormat: @"%.0f min", seconds / 60.0];
+  }
+  return [NSString stringWithFormat: @"%.1f h", seconds / 3600.0];
+}
+
 
 @implementation MDIndexing
 
@@ -971,7 +996,137 @@ return; \
         
         [str appendString: @"\n"];
       }
-  
+
+      {
+        NSString *metricsPath = [[indexedStatusPath stringByDeletingLastPathComponent]
+                                     stringByAppendingPathComponent: @"metrics.plist"];
+        NSDictionary *metrics = [NSDictionary dictionaryWithContentsOfFile: metricsPath];
+        NSArray *runs = [metrics objectForKey: @"paths"];
+        double age = -[[metrics objectForKey: @"date"] timeIntervalSinceNow];
+        NSUInteger j;
+
+        for (j = 0; j < [runs count]; j++) {
+          NSDictionary *run = [runs objectAtIndex: j];
+          NSString *state = [run objectForKey: @"state"];
+          NSDictionary *queue = [run objectForKey: @"queue"];
+          NSNumber *eta = [run objectForKey: @"eta"];
+          NSDate *progress = [run objectForKey: @"last_progress"];
+          unsigned long done = [[run objectForKey: @"files"] unsignedLongValue]
+                                 + [[run objectForKey: @"unchanged"] unsignedLongValue]
+                                 + [[run objectForKey: @"failed"] unsignedLongValue];
+
+          if (j == 0) {
+            [str appendString: @"indexing\n"];
+          }
+          [str appendFormat: @"  %@\n", [run objectForKey: @"path"]];
+          [str appendFormat: @"    state:   %@\n", state];
+          [str appendFormat: @"    rate:    %.1f files/s, %@/s\n",
+                       [[run objectForKey: @"files_per_second"] doubleValue],
+                       sizeString([[run objectForKey: @"bytes_per_second"] doubleValue])];
+          [str appendFormat: @"    files:   %@ indexed (%@), %@ unchanged, %@ failed\n",
+                       [run objectForKey: @"files"],
+                       sizeString([[run objectForKey: @"bytes"] doubleValue]),
+                       [run objectForKey: @"unchanged"], [run objectForKey: @"failed"]];
+          [str appendFormat: @"    skipped: %@ excluded, %@ too big, %@ timed out\n",
+                       [run objectForKey: @"skipped"], [run objectForKey: @"too_big"],
+                       [run objectForKey: @"timeouts"]];
+          [str appendFormat: @"    db:      %.1f s writing\n",
+                       [[run objectForKey: @"db_write_time"] doubleValue]];
+
+          if (queue) {
+            [str appendFormat: @"    queue:   %@ (%@ walked, %@ typed, %@ extracting, %@ to write)\n",
+                         [run objectForKey: @"queue_depth"],
+                         [queue objectForKey: @"walked"], [queue objectForKey: @"typed"],
+                         [queue objectForKey: @"extracting"], [queue objectForKey: @"extracted"]];
+          }
+
+          if ([state isEqual: @"indexing"]) {
+            if (eta) {
+              [str appendFormat: @"    eta:     %@ (%lu of %@%@ files)\n",
+                           durationString([eta doubleValue]), done,
+                           ([[run objectForKey: @"walk_done"] boolValue] ? @"" : @"about "),
+                           [run objectForKey: @"expected_files"]];
+            }
+            if (age > STALE_TIME) {
+              [str appendFormat: @"    stale:   not updated for %@, is mdextractor running?\n",
+                           durationString(age)];
+            } else if (progress && -[progress timeIntervalSinceNow] > STALLED_TIME) {
+              [str appendFormat: @"    stalled: no file done for %@\n",
+                           durationString(-[progress timeIntervalSinceNow])];
+            }
+          } else if ([run objectForKey: @"end"]) {
+            [str appendFormat: @"    end:     %@\n", [[run objectForKey: @"end"] description]];
+          }
+        }
+        if ([runs count]) {
+          [str appendString: @"\n"];
+        }
+      }
+
+      {
+        NSString *costsPath = [[indexedStatusPath stringByDeletingLastPathComponent]
+                                   stringByAppendingPathComponent: @"extractors.plist"];
+        NSDictionary *costs = [NSDictionary dictionaryWithContentsOfFile: costsPath];
+        NSArray *names = [[costs allKeys] sortedArrayUsingSelector: @selector(compare:)];
+        NSUInteger j;
+
+        if ([names count]) {
+          [str appendString: @"extractors\n"];
+        }
+        for (j = 0; j < [names count]; j++) {
+          NSString *name = [names objectAtIndex: j];
+          NSDictionary *info = [costs objectForKey: name];
+
+          [str appendFormat: @"  %@\n", name];
+          [str appendFormat: @"    files:   %@, %.1f s in all\n",
+                       [info objectForKey: @"count"],
+                       [[info objectForKey: @"time"] doubleValue]];
+          [str appendFormat: @"    time:    %.3f s mean, %.2f s longest\n",
+                       [[info objectForKey: @"mean_time"] doubleValue],
+                       [[info objectForKey: @"max_time"] doubleValue]];
+          if ([info objectForKey: @"max_time_exceeded"] || [info objectForKey: @"max_bytes_exceeded"]) {
+            [str appendFormat: @"    limits:  %lu timed out, %lu too big\n",
+                         [[info objectForKey: @"max_time_exceeded"] unsignedLongValue],
+                         [[info objectForKey: @"max_bytes_exceeded"] unsignedLongValue]];
+          }
+        }
+        if ([names count]) {
+          [str appendString: @"\n"];
+        }
+      }
+
+      {
+        NSString *schedPath = [[indexedStatusPath stringByDeletingLastPathComponent]
+                                   stringByAppendingPathComponent: @"scheduler.plist"];
+        NSDictionary *sched = [NSDictionary dictionaryWithContentsOfFile: schedPath];
+
+        if (sched) {
+          [str appendString: @"scheduled updates\n"];
+          [str appendFormat: @"  every:   %.2f s (%.0f directories a minute)\n",
+                       [[sched objectForKey: @"interval"] doubleValue],
+                       [[sched objectForKey: @"checks_per_minute"] doubleValue]];
+          [str appendFormat: @"  reason:  %@\n", [sched objectForKey: @"reason"]];
+        }
+      }
+
+      {
+        NSString *mntPath = [[indexedStatusPath stringByDeletingLastPathComponent]
+                                   stringByAppendingPathComponent: @"maintenance.plist"];
+        NSDictionary *mnt = [NSDictionary dictionaryWithContentsOfFile: mntPath];
+
+        if (mnt) {
+          [str appendString: @"\ndatabase\n"];
+          [str appendFormat: @"  size:    %.1f MB (wal %.1f MB)\n",
+                       [[mnt objectForKey: @"db_size"] doubleValue] / 1048576.0,
+                       [[mnt objectForKey: @"wal_size"] doubleValue] / 1048576.0];
+          [str appendFormat: @"  free:    %.1f%% of %@ pages\n",
+                       [[mnt objectForKey: @"fragmentation"] doubleValue],
+                       [mnt objectForKey: @"page_count"]];
+          [str appendFormat: @"  checked: %@\n",
+                       [[mnt objectForKey: @"maintenance_date"] description]];
+        }
+      }
+
       [statusView setString: str];
       [statusView sizeToFit];
     }
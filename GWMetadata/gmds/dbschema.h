@@ -1,5 +1,8 @@
 
-static NSString *db_version = @"v4";
+static NSString *db_version = @"v5";
+
+/* the db a v5 one is migrated from */
+static NSString *db_previous_version = @"v4";
 
 
 static NSString *db_schema = @"\
@@ -9,20 +12,12 @@ CREATE TABLE paths \
 path TEXT UNIQUE ON CONFLICT IGNORE, \
 words_count INTEGER, \
 moddate REAL, \
-is_directory INTEGER); \
-\
-CREATE TABLE words \
-(id INTEGER PRIMARY KEY AUTOINCREMENT, \
-word TEXT UNIQUE ON CONFLICT IGNORE); \
-\
-CREATE TABLE postings \
-(word_id INTEGER REFERENCES words(id), \
-path_id INTEGER REFERENCES paths(id), \
-word_count INTEGER); \
-\
-CREATE INDEX postings_wid_index ON postings(word_id); \
-CREATE INDEX postings_pid_index ON postings(path_id); \
+is_directory INTEGER, \
+fileid BLOB, \
+stamp BLOB, \
+ctime BLOB); \
 \
+CREATE INDEX paths_fileid_index ON paths(fileid); \
 \
 CREATE TABLE attributes \
 (path_id INTEGER REFERENCES paths(id), \
@@ -64,6 +59,71 @@ WHEN (checkUpdating() != 0) \
   END; \
 ";
 
+/*
+ * The trigrams of the GSMDItemFSName attribute, rowid = paths.id, for
+ * the substring name queries; the triggers keep them in step with the
+ * attribute.
+ */
+#define db_schema_names @"\
+CREATE TRIGGER names_insert_trigger AFTER INSERT ON attributes \
+WHEN new.key = 'GSMDItemFSName' \
+  BEGIN \
+    INSERT INTO names (rowid, name) VALUES (new.path_id, new.attribute); \
+  END; \
+\
+CREATE TRIGGER names_delete_trigger AFTER DELETE ON attributes \
+WHEN old.key = 'GSMDItemFSName' \
+  BEGIN \
+    DELETE FROM names WHERE rowid = old.path_id; \
+  END; \
+"
+
+/*
+ * The words of each path, one row per path with rowid = paths.id, every
+ * word repeated as many times as the extractor counted it so that bm25()
+ * ranks as the old postings did.  Only the index is kept; SQLite older
+ * than 3.43 cannot delete from a contentless table, and gets
+ * db_schema_fts_stored instead.  contents_terms lists the indexed
+ * words, for the patterns FTS5 cannot match by itself.
+ */
+static NSString *db_schema_fts = @"\
+CREATE VIRTUAL TABLE contents USING fts5 \
+(words, content = '', contentless_delete = 1, tokenize = 'unicode61'); \
+\
+CREATE VIRTUAL TABLE contents_terms USING fts5vocab(contents, 'row'); \
+\
+CREATE VIRTUAL TABLE names USING fts5 \
+(name, content = '', contentless_delete = 1, tokenize = 'trigram'); \
+" db_schema_names;
+
+static NSString *db_schema_fts_stored = @"\
+CREATE VIRTUAL TABLE contents USING fts5 \
+(words, tokenize = 'unicode61'); \
+\
+CREATE VIRTUAL TABLE contents_terms USING fts5vocab(contents, 'row'); \
+\
+CREATE VIRTUAL TABLE names USING fts5 \
+(name, tokenize = 'trigram'); \
+" db_schema_names;
+
+/*
+ * Run with the previous db attached as "previous", on a new, empty db.
+ */
+static NSString *db_migrate_previous = @"\
+INSERT INTO paths (id, path, words_count, moddate, is_directory) \
+SELECT id, path, words_count, moddate, is_directory FROM previous.paths; \
+\
+INSERT INTO attributes (path_id, key, attribute) \
+SELECT path_id, key, attribute FROM previous.attributes; \
+\
+INSERT INTO contents (rowid, words) \
+SELECT postings.path_id, \
+group_concat(replace(hex(zeroblob(postings.word_count)), '00', words.word || ' '), '') \
+FROM previous.postings AS postings, previous.words AS words \
+WHERE words.id = postings.word_id \
+GROUP BY postings.path_id; \
+";
+
 static NSString *db_schema_tmp = @"\
 CREATE TEMP TABLE removed_id \
 (id INTEGER PRIMARY KEY); \
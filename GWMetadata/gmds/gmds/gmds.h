@@ -45,9 +45,43 @@
 
 - (oneway void)performQuery:(NSDictionary *)queryInfo;
 
+- (oneway void)nextResultsForQueryWithNumber:(NSNumber *)qnum;
+
+- (oneway void)stopQueryWithNumber:(NSNumber *)qnum;
+
 @end
 
 
+/*
+ * A query between its pages: the statement stays prepared until the
+ * client asks for the next page, stops the query, or the last row has
+ * been sent.  A query answered from the cache has no statement and
+ * pages its cached lines instead.  The update of a live query since
+ * a time keeps the paths updated since then that it has not matched
+ * yet: those left at the end no longer match.  The cursors of a client take turns,
+ * a page each, so that its queries run side by side.
+ */
+typedef struct _gmds_cursor {
+  struct sqlite3_stmt *stmt;
+  NSNumber *qnumber;
+  NSArray *postqueries;
+  NSArray *cached;
+  NSUInteger cachedpos;
+  NSMutableArray *collected;
+  NSMutableDictionary *cacheEntry;
+  NSMutableSet *changed;
+  NSNumber *stamp;
+  NSUInteger pages;
+  int retry;
+  BOOL stepping;
+  BOOL wanted;
+  BOOL cancelled;
+  BOOL complete;
+} gmds_cursor;
+
+NSArray *lineOfStatement(struct sqlite3_stmt *stmt);
+
+
 @interface GMDS: NSObject <GMDSProtocol>
 {
   NSString *dbdir;
@@ -59,6 +93,11 @@
   NSConnection *conn;
   NSString *connectionName;
   NSMutableDictionary *clientInfo;
+  NSMapTable *cursors;
+  NSMutableArray *readyCursors;
+  BOOL runningCursors;
+  NSMutableDictionary *queryCache;
+  NSTimeInterval lastUpdateTime;
 
   NSFileManager *fm;
   NSNotificationCenter *nc; 
@@ -75,8 +114,21 @@
 
 - (void)performPostQueries:(NSArray *)queries;
           
+- (void)scheduleCursor:(gmds_cursor *)cursor;
+
+- (void)runReadyCursors;
+
+- (void)stepCursor:(gmds_cursor *)cursor;
+
+- (int)readCursor:(gmds_cursor *)cursor
+         maxLines:(NSUInteger)maxlines
+          inArray:(NSMutableArray *)lines;
+
+- (void)closeCursor:(gmds_cursor *)cursor;
+
 - (BOOL)sendResults:(NSArray *)lines
-           forQueryWithNumber:(NSNumber *)qnum;
+           withInfo:(NSDictionary *)info
+ forQueryWithNumber:(NSNumber *)qnum;
 
 - (void)endOfQueryWithNumber:(NSNumber *)qnum;
            
@@ -90,6 +142,22 @@
 
 @end
 
+
+@interface GMDS (query_cache)
+
+- (void)setupQueryCache;
+
+- (NSMutableDictionary *)cacheEntryForQuery:(NSDictionary *)queryInfo;
+
+- (NSArray *)cachedResultsForEntry:(NSMutableDictionary *)entry;
+
+- (void)cacheResults:(NSArray *)lines 
+           withEntry:(NSMutableDictionary *)entry;
+
+- (void)metadataDidUpdate:(NSNotification *)notif;
+
+@end
+
 #endif // GMDS_H
 
 
@@ -25,9 +25,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <signal.h>
 #include "gmds.h"
 #include "dbschema.h"
 #include "config.h"
+#include "../../../FSNode/FSNTrace.h"
 
 #define GWDebugLog(format, args...) \
   do { \
@@ -46,6 +48,12 @@
 
 #define MAX_RETRY 1000
 #define MAX_RES 100
+/* rows in the first page of a query, sent before stepping any further */
+#define FIRST_PAGE 20
+/* the longest the rows of a page are gathered */
+#define PAGE_TIME (0.2)
+/* results of more rows are not kept for the next same query */
+#define CACHE_MAX_LINES 20000
 #define TOUCH_INTERVAL (60.0)
 
 enum {
@@ -169,19 +177,119 @@ static void append_string(sqlite3_context *context, int argc, sqlite3_value **ar
   sqlite3_result_text(context, buff, strlen(buff), SQLITE_TRANSIENT);  
 }
 
-static void word_score(sqlite3_context *context, int argc, sqlite3_value **argv)
+NSArray *lineOfStatement(struct sqlite3_stmt *stmt)
 {
-  int searchlen = strlen((const char *)sqlite3_value_text(argv[0]));
-  int foundlen = strlen((const char *)sqlite3_value_text(argv[1]));
-  int posting_wcount = sqlite3_value_int(argv[2]);
-  int path_wcount = sqlite3_value_int(argv[3]);
-  float score = (1.0 * posting_wcount / path_wcount);
+  NSMutableArray *line = [NSMutableArray array];
+  int count = sqlite3_data_count(stmt);
+  int i;
 
-  if (searchlen != foundlen) {
-    score *= (1.0 * searchlen / foundlen);    
-  } 
+  // we use "<= count" because sqlite sends also 
+  // the id of the entry with type = 0 
+  for (i = 0; i <= count; i++) { 
+    int type = sqlite3_column_type(stmt, i);
+              
+    if (type == SQLITE_INTEGER) {
+      [line addObject: [NSNumber numberWithInt: sqlite3_column_int(stmt, i)]];
+    
+    } else if (type == SQLITE_FLOAT) {
+      [line addObject: [NSNumber numberWithDouble: sqlite3_column_double(stmt, i)]];
+    
+    } else if (type == SQLITE_TEXT) {
+      [line addObject: [NSString stringWithUTF8String: (const char *)sqlite3_column_text(stmt, i)]];
+    
+    } else if (type == SQLITE_BLOB) {
+      const char *bytes = sqlite3_column_blob(stmt, i);
+      int length = sqlite3_column_bytes(stmt, i); 
+
+      [line addObject: [NSData dataWithBytes: bytes length: length]];
+    }
+  }
+
+  return line;
+}
+
+static void free_cursor(gmds_cursor *cursor)
+{
+  if (cursor->stmt) {
+    sqlite3_finalize(cursor->stmt);
+  }
+  RELEASE (cursor->qnumber);
+  RELEASE (cursor->postqueries);
+  TEST_RELEASE (cursor->cached);
+  TEST_RELEASE (cursor->collected);
+  TEST_RELEASE (cursor->cacheEntry);
+  TEST_RELEASE (cursor->changed);
+  TEST_RELEASE (cursor->stamp);
+  free(cursor);
+}
+
+/* On exit: the post queries only drop temporary tables. */
+static void free_cursors(NSMapTable *cursors)
+{
+  NSMapEnumerator enumerator = NSEnumerateMapTable(cursors);
+  NSNumber *qnum;
+  gmds_cursor *cursor;
+
+  while (NSNextMapEnumeratorPair(&enumerator, (void **)&qnum, (void **)&cursor)) {
+    free_cursor(cursor);
+  }
+  NSEndMapTableEnumeration(&enumerator);
+  NSResetMapTable(cursors);
+}
+
+/* the paths of updated_paths stamped after since */
+static NSMutableSet *paths_updated_since(sqlite3 *db, double since)
+{
+  const char *query = "SELECT path FROM updated_paths WHERE timestamp > ?";
+  NSMutableSet *paths = [NSMutableSet set];
+  struct sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, query, strlen(query), &stmt, NULL) != SQLITE_OK) {
+    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
+    return paths;
+  }
+
+  sqlite3_bind_double(stmt, 1, since);
+
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const unsigned char *path = sqlite3_column_text(stmt, 0);
+
+    if (path) {
+      [paths addObject: [NSString stringWithUTF8String: (const char *)path]];
+    }
+  }
+
+  sqlite3_finalize(stmt);
+
+  return paths;
+}
+
+/*
+ * Logs how SQLite runs a query: which indexes it uses, and which
+ * subqueries it materializes.
+ */
+static void explain_query(sqlite3 *db, const char *query)
+{
+  NSString *explain = [NSString stringWithFormat: @"EXPLAIN QUERY PLAN %s", query];
+  const char *qbuff = [explain UTF8String];
+  struct sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, qbuff, strlen(qbuff), &stmt, NULL) != SQLITE_OK) {
+    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
+    return;
+  }
+
+  NSDebugLLog(@"gwspace", @"query plan of: %s", query);
 
-  sqlite3_result_double(context, score);
+  /* id, parent, unused, detail */
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    const unsigned char *detail = sqlite3_column_text(stmt, 3);
+
+    NSDebugLLog(@"gwspace", @"  %i/%i %s", sqlite3_column_int(stmt, 1),
+                sqlite3_column_int(stmt, 0), (detail ? (const char *)detail : ""));
+  }
+
+  sqlite3_finalize(stmt);
 }
 
 static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **argv)
@@ -203,6 +311,14 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
   }
 
   RELEASE (clientInfo);
+
+  if (cursors) {
+    free_cursors(cursors);
+    NSFreeMapTable(cursors);
+  }
+  TEST_RELEASE (readyCursors);
+  [[NSDistributedNotificationCenter defaultCenter] removeObserver: self];
+  TEST_RELEASE (queryCache);
   
   [nc removeObserver: self
 		            name: NSConnectionDidDieNotification
@@ -288,12 +404,17 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
 	           object: conn];
              
     clientInfo = [NSMutableDictionary new];
+    cursors = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                               NSNonOwnedPointerMapValueCallBacks, 0);
+    readyCursors = [NSMutableArray new];
+    runningCursors = NO;
+    [self setupQueryCache];
     
     touchQueries = [NSMutableArray new];
     touchind = 0;
     [touchQueries addObject: @"select count(is_directory) from paths;"];
-    [touchQueries addObject: @"select count(word) from words;"];
-    [touchQueries addObject: @"select count(word_count) from postings;"];
+    [touchQueries addObject: @"select count(rowid) from contents;"];
+    [touchQueries addObject: @"select count(rowid) from names;"];
     [touchQueries addObject: @"select count(attribute) from attributes;"];
     
     [NSTimer scheduledTimerWithTimeInterval: TOUCH_INTERVAL 
@@ -491,116 +612,340 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
   NSString *query = [queryInfo objectForKey: @"join"];
   NSArray *postqueries = [queryInfo objectForKey: @"post"];  
   NSNumber *queryNumber = [queryInfo objectForKey: @"qnumber"];  
+  NSNumber *since = [queryInfo objectForKey: @"since"];
+  /* what the client has seen once it has all the rows */
+  NSNumber *stamp = [NSNumber numberWithDouble: [NSDate timeIntervalSinceReferenceDate]];
   const char *qbuff = [query UTF8String];
-  NSMutableArray *reslines = [NSMutableArray array];
-  struct sqlite3_stmt *stmt;
-  int retry = 0;
-  int err;
-  int i;
+  NSMutableDictionary *cacheEntry = [self cacheEntryForQuery: queryInfo];
+  NSArray *cached = nil;
+  struct sqlite3_stmt *stmt = NULL;
+  gmds_cursor *cursor;
+  FSN_TRACE_SCOPE_OP ("gmds query", [queryNumber unsignedLongValue]);
+
+  if (cacheEntry) {
+    cached = [self cachedResultsForEntry: cacheEntry];
+  }
+
+  if (cached) {
+    GWDebugLog(@"CACHED %lu", (unsigned long)[cached count]);
+
+    cursor = calloc(1, sizeof(gmds_cursor));
+    cursor->qnumber = RETAIN (queryNumber);
+    cursor->cached = RETAIN (cached);
+    cursor->stamp = RETAIN (stamp);
+
+    NSMapInsert(cursors, queryNumber, cursor);
+    [self scheduleCursor: cursor];
+
+    RELEASE (pool);
+    return;
+  }
   
   if (prequeries) {
     prepared = [self performPreQueries: prequeries];
   }
   
-  if (prepared && (sqlite3_prepare(db, qbuff, strlen(qbuff), &stmt, NULL) == SQLITE_OK)) {
-    while (1) {
-      err = sqlite3_step(stmt);
+  if ((prepared == NO) 
+        || (sqlite3_prepare_v2(db, qbuff, strlen(qbuff), &stmt, NULL) != SQLITE_OK)) {
+    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
 
-      if (err == SQLITE_ROW) {
-        NSMutableArray *line = [NSMutableArray array];
-        int count = sqlite3_data_count(stmt);
-
-        // we use "<= count" because sqlite sends also 
-        // the id of the entry with type = 0 
-        for (i = 0; i <= count; i++) { 
-          int type = sqlite3_column_type(stmt, i);
-                    
-          if (type == SQLITE_INTEGER) {
-            [line addObject: [NSNumber numberWithInt: sqlite3_column_int(stmt, i)]];
-          
-          } else if (type == SQLITE_FLOAT) {
-            [line addObject: [NSNumber numberWithDouble: sqlite3_column_double(stmt, i)]];
-          
-          } else if (type == SQLITE_TEXT) {
-            [line addObject: [NSString stringWithUTF8String: (const char *)sqlite3_column_text(stmt, i)]];
-          
-          } else if (type == SQLITE_BLOB) {
-            const char *bytes = sqlite3_column_blob(stmt, i);
-            int length = sqlite3_column_bytes(stmt, i); 
-
-            [line addObject: [NSData dataWithBytes: bytes length: length]];
-          }
-        }
+    if (postqueries) {
+      [self performPostQueries: postqueries];
+    }
+    [self endOfQueryWithNumber: queryNumber];
 
-        [reslines addObject: line];
+    RELEASE (pool);
+    return;
+  }
 
-        if ([reslines count] == MAX_RES) {
-          GWDebugLog(@"SENDING");
+  if (GW_DEBUG_LOG) {
+    explain_query(db, qbuff);
+  }
 
-          if ([self sendResults: reslines forQueryWithNumber: queryNumber]) {
-            GWDebugLog(@"SENT");
-            [reslines removeAllObjects];
-          } else {
-            GWDebugLog(@"INVALID!");
-            break;
-          }
-        }
+  cursor = calloc(1, sizeof(gmds_cursor));
+  cursor->stmt = stmt;
+  cursor->qnumber = RETAIN (queryNumber);
+  cursor->postqueries = RETAIN (postqueries);
+  cursor->stamp = RETAIN (stamp);
 
-      } else {
-        if (err == SQLITE_DONE) {
-          GWDebugLog(@"SENDING (last)");
+  /* the update of a live query by the paths changed since its last one */
+  if (since) {
+    int index = sqlite3_bind_parameter_index(stmt, ":since");
 
-          if ([self sendResults: reslines forQueryWithNumber: queryNumber]) {
-            GWDebugLog(@"SENT");
-          } else {
-            GWDebugLog(@"INVALID!");
-          }
+    if (index) {
+      sqlite3_bind_double(stmt, index, [since doubleValue]);
+    }
+    cursor->changed = RETAIN (paths_updated_since(db, [since doubleValue]));
+  }
 
-          break;
+  if (cacheEntry) {
+    cursor->cacheEntry = RETAIN (cacheEntry);
+    cursor->collected = [NSMutableArray new];
+  }
+
+  NSMapInsert(cursors, queryNumber, cursor);
+  [self scheduleCursor: cursor];
+  
+  RELEASE (pool);
+}
+
+- (oneway void)nextResultsForQueryWithNumber:(NSNumber *)qnum
+{
+  gmds_cursor *cursor = NSMapGet(cursors, qnum);
 
-        } else if (err == SQLITE_BUSY) {
-          CREATE_AUTORELEASE_POOL(arp); 
-          usleep(100000); // 0.1 seconds
-          GWDebugLog(@"retry %i", retry);
-          RELEASE (arp);
+  if (cursor == NULL) {
+    return;
+  }
 
-          if (retry++ > MAX_RETRY) {
-            NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
-		        break;
-          }
+  /* asked while the client takes the page we are sending */
+  if (cursor->stepping) {
+    cursor->wanted = YES;
+    return;
+  }
+  
+  [self scheduleCursor: cursor];
+}
+
+- (oneway void)stopQueryWithNumber:(NSNumber *)qnum
+{
+  gmds_cursor *cursor = NSMapGet(cursors, qnum);
+
+  if (cursor == NULL) {
+    return;
+  }
+
+  GWDebugLog(@"STOPPED %@", qnum);
+
+  if (cursor->stepping) {
+    cursor->cancelled = YES;
+  } else {
+    [self closeCursor: cursor];
+  }
+}
 
+/*
+ * Queues the next page of a cursor after those of the other queries
+ * of the client.  A query started, or asked for more, while a page is 
+ * being sent waits for its turn in the loop of -runReadyCursors.
+ */
+- (void)scheduleCursor:(gmds_cursor *)cursor
+{
+  if ([readyCursors containsObject: cursor->qnumber] == NO) {
+    [readyCursors addObject: cursor->qnumber];
+  }
+
+  [self runReadyCursors];
+}
+
+/*
+ * Steps the queued cursors a page at a time, each page taking at most 
+ * PAGE_TIME, so that a slow query can't keep a fast one waiting for 
+ * longer.
+ */
+- (void)runReadyCursors
+{
+  if (runningCursors) {
+    return;
+  }
+
+  runningCursors = YES;
+
+  while ([readyCursors count]) {
+    NSNumber *qnum = AUTORELEASE (RETAIN ([readyCursors objectAtIndex: 0]));
+    gmds_cursor *cursor;
+
+    [readyCursors removeObjectAtIndex: 0];
+    cursor = NSMapGet(cursors, qnum);
+
+    /* stopped while it was waiting */
+    if (cursor) {
+      [self stepCursor: cursor];
+    }
+  }
+
+  runningCursors = NO;
+}
+
+/*
+ * Sends a page of at most MAX_RES rows, FIRST_PAGE for the first one,
+ * or PAGE_TIME of stepping.  The cursor is closed after the last row
+ * or when the client refuses the page, and queued again if the client 
+ * asked for more while it got this one.
+ */
+- (void)stepCursor:(gmds_cursor *)cursor
+{
+  CREATE_AUTORELEASE_POOL(pool); 
+  NSMutableArray *reslines = [NSMutableArray array];
+  /* a short first page, to show something at once */
+  NSUInteger maxlines = (cursor->pages ? MAX_RES : FIRST_PAGE);
+  NSDictionary *info = nil;
+  BOOL finished = NO;
+  int err;
+  FSN_TRACE_SCOPE_OP ("gmds results page", [cursor->qnumber unsignedLongValue]);
+
+  cursor->stepping = YES;
+  cursor->wanted = NO;
+
+  err = [self readCursor: cursor maxLines: maxlines inArray: reslines];
+  cursor->pages++;
+
+  if (cursor->cancelled == NO) {
+    if (err == SQLITE_DONE) {
+      GWDebugLog(@"SENDING (last)");
+      cursor->complete = YES;
+    } else {
+      GWDebugLog(@"SENDING");
+    }
+    
+    if (err == SQLITE_DONE) {
+      NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+
+      [dict setObject: cursor->stamp forKey: @"stamp"];
+
+      if ([cursor->changed count]) {
+        [dict setObject: [cursor->changed allObjects] forKey: @"removed"];
+      }
+      info = dict;
+    }
+    
+    if ([self sendResults: reslines withInfo: info forQueryWithNumber: cursor->qnumber]) {
+      GWDebugLog(@"SENT");
+      finished = (err != SQLITE_ROW);
+    } else {
+      GWDebugLog(@"INVALID!");
+      finished = YES;
+    }
+  }
+
+  cursor->stepping = NO;
+
+  if (finished || cursor->cancelled) {
+    [self closeCursor: cursor];
+  } else if (cursor->wanted) {
+    [self scheduleCursor: cursor];
+  }
+
+  RELEASE (pool);
+}
+
+/*
+ * SQLITE_ROW if the page is full or out of time and there may be more
+ * rows, SQLITE_DONE after the last, or the error that ended the query.
+ */
+- (int)readCursor:(gmds_cursor *)cursor
+         maxLines:(NSUInteger)maxlines
+          inArray:(NSMutableArray *)lines
+{
+  struct sqlite3_stmt *stmt = cursor->stmt;
+  NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+  int err;
+
+  if (stmt == NULL) {
+    NSUInteger count = [cursor->cached count];
+    NSUInteger last = MIN(cursor->cachedpos + maxlines, count);
+
+    [lines addObjectsFromArray: [cursor->cached subarrayWithRange: 
+                    NSMakeRange(cursor->cachedpos, last - cursor->cachedpos)]];
+    cursor->cachedpos = last;
+
+    return (last < count) ? SQLITE_ROW : SQLITE_DONE;
+  }
+
+  while (1) {
+    err = sqlite3_step(stmt);
+
+    if (err == SQLITE_ROW) {
+      NSArray *line = lineOfStatement(stmt);
+
+      [lines addObject: line];
+      [cursor->changed removeObject: [line objectAtIndex: 0]];
+
+      if (cursor->collected) {
+        if ([cursor->collected count] < CACHE_MAX_LINES) {
+          [cursor->collected addObject: line];
         } else {
-          NSDebugLLog(@"gwspace", @"%i %s", err, sqlite3_errmsg(db));
-          break;
+          DESTROY (cursor->collected);
         }
       }
+
+      if (([lines count] >= maxlines)
+            || (([NSDate timeIntervalSinceReferenceDate] - start) > PAGE_TIME)) {
+        return SQLITE_ROW;
+      }
+
+    } else if (err == SQLITE_DONE) {
+      return SQLITE_DONE;
+
+    } else if (err == SQLITE_BUSY) {
+      CREATE_AUTORELEASE_POOL(arp); 
+      usleep(100000); // 0.1 seconds
+      GWDebugLog(@"retry %i", cursor->retry);
+      RELEASE (arp);
+
+      if (cursor->retry++ > MAX_RETRY) {
+        NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
+        return err;
+      }
+
+    } else {
+      NSDebugLLog(@"gwspace", @"%i %s", err, sqlite3_errmsg(db));
+      return err;
+    }
+
+    /* the client gets a page, even an empty one, at least every PAGE_TIME, 
+       so that a query matching few rows of many can be stopped */
+    if (([NSDate timeIntervalSinceReferenceDate] - start) > PAGE_TIME) {
+      return SQLITE_ROW;
     }
-  
-    sqlite3_finalize(stmt);
-    
-  } else {
-    NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
   }
-  
-  if (postqueries) {
-    [self performPostQueries: postqueries];
+
+  return err;
+}
+
+- (void)closeCursor:(gmds_cursor *)cursor
+{
+  NSNumber *qnum = AUTORELEASE (RETAIN (cursor->qnumber));
+
+  NSMapRemove(cursors, qnum);
+
+  if (cursor->stmt) {
+    sqlite3_finalize(cursor->stmt);
+    cursor->stmt = NULL;
   }
+
+  if (cursor->postqueries) {
+    [self performPostQueries: cursor->postqueries];
+  }
+
+  /* all the rows have been read: the results can be used again */
+  if (cursor->complete && cursor->collected) {
+    [self cacheResults: cursor->collected withEntry: cursor->cacheEntry];
+  }
+
+  free_cursor(cursor);
   
-  [self endOfQueryWithNumber: queryNumber];
-  
-  RELEASE (pool);
+  [self endOfQueryWithNumber: qnum];
 }
 
+/*
+ * The last page of a query carries, in info, the time it was started
+ * and, for the update of a live query, the paths that no longer match.
+ */
 - (BOOL)sendResults:(NSArray *)lines
-           forQueryWithNumber:(NSNumber *)qnum
+           withInfo:(NSDictionary *)info
+ forQueryWithNumber:(NSNumber *)qnum
 {
   CREATE_AUTORELEASE_POOL(arp); 
   id client = [clientInfo objectForKey: @"client"];
-  NSDictionary *results;
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
   BOOL accepted;
   
-  results = [NSDictionary dictionaryWithObjectsAndKeys: qnum, @"qnumber",
-                                                        lines, @"lines", nil];  
+  if (info) {
+    [results addEntriesFromDictionary: info];
+  }
+  [results setObject: qnum forKey: @"qnumber"];
+  [results setObject: lines forKey: @"lines"];
+
   accepted = [client queryResults: [NSArchiver archivedDataWithRootObject: results]];    
   RELEASE (arp);
   
@@ -622,7 +967,13 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
         
     if (db != NULL) {
       if (newdb) {
-        if (sqlite3_exec(db, [db_schema UTF8String], NULL, 0, &err) != SQLITE_OK) {
+        /* as mdextractor does, if it is not the one creating the db */
+        sqlite3_exec(db, "PRAGMA auto_vacuum = INCREMENTAL", NULL, 0, NULL);
+
+        if (sqlite3_exec(db, [db_schema UTF8String], NULL, 0, &err) != SQLITE_OK
+              || (sqlite3_exec(db, [db_schema_fts UTF8String], NULL, 0, NULL) != SQLITE_OK
+                    && sqlite3_exec(db, [db_schema_fts_stored UTF8String], 
+                                                  NULL, 0, NULL) != SQLITE_OK)) {
           NSDebugLLog(@"gwspace", @"unable to create the database at %@", dbpath);
           sqlite3_free(err); 
           return NO;    
@@ -645,14 +996,17 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
                                 SQLITE_UTF8, 0, contains_substr, 0, 0);                                
     sqlite3_create_function(db, "appendString", 2, 
                                 SQLITE_UTF8, 0, append_string, 0, 0);
-    sqlite3_create_function(db, "wordScore", 4, 
-                                SQLITE_UTF8, 0, word_score, 0, 0);
     sqlite3_create_function(db, "attributeScore", 5, 
                                 SQLITE_UTF8, 0, attribute_score, 0, 0);
 
+    /* mdextractor keeps the db in WAL mode: our queries see the last
+       commit and never wait for the one being written */
+    if ([getStringEntry(db, @"PRAGMA journal_mode = WAL") isEqual: @"wal"] == NO) {
+      NSDebugLLog(@"gwspace", @"unable to switch %@ to WAL mode", dbpath);
+    }
     performWriteQuery(db, @"PRAGMA cache_size = 20000");
     performWriteQuery(db, @"PRAGMA count_changes = 0");
-    performWriteQuery(db, @"PRAGMA synchronous = OFF");
+    performWriteQuery(db, @"PRAGMA synchronous = NORMAL");
     performWriteQuery(db, @"PRAGMA temp_store = MEMORY");
   }
 
@@ -713,6 +1067,10 @@ static void attribute_score(sqlite3_context *context, int argc, sqlite3_value **
   }
 
   RELEASE (clientInfo);
+
+  if (cursors) {
+    free_cursors(cursors);
+  }
   
   if (db != NULL) {
     sqlite3_close(db);
@@ -763,6 +1121,8 @@ int main(int argc, char** argv)
     
   RELEASE(pool);
 
+  FSNTraceInstallDumpSignal(SIGUSR2);
+
   {
     CREATE_AUTORELEASE_POOL (pool);
     GMDS *gmds = [[GMDS alloc] init];
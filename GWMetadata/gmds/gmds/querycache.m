@@ -0,0 +1,306 @@
+/* querycache.m
+ *
+ * The results of the last queries, served again when a client sends
+ * the same query: the cached lines are brought up to date with the
+ * paths updated or removed since they were read, instead of running
+ * the whole query again.
+ *
+ * mdextractor empties removed_paths, and drops the updated_paths rows
+ * older than its previous notification, each time it posts
+ * GWMetadataDidUpdateNotification.  An entry is therefore brought up
+ * to date with the paths the notification says were removed, and
+ * forgotten once the rows it would need are gone.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <string.h>
+
+#include "gmds.h"
+#include "config.h"
+
+#define GWDebugLog(format, args...) \
+  do { \
+    if (GW_DEBUG_LOG) { \
+      NSDebugLLog(@"gwspace", format , ## args); \
+    } \
+  } while (0)
+
+#define CACHE_MAX_ENTRIES 16
+
+
+/*
+ * The statements of a query with the names of its temporary tables,
+ * unique to each MDKQuery ("tab_" followed by a number), replaced by
+ * their order of appearance: two queries with the same terms,
+ * operators and search paths get the same key.
+ */
+static NSString *normalized_query(NSArray *prequeries, NSString *join)
+{
+  NSMutableArray *tables = [NSMutableArray array];
+  NSMutableString *key = [NSMutableString string];
+  NSMutableArray *statements = [NSMutableArray arrayWithArray: prequeries];
+  NSUInteger i;
+
+  [statements addObject: join];
+
+  for (i = 0; i < [statements count]; i++) {
+    NSScanner *scanner = [NSScanner scannerWithString: [statements objectAtIndex: i]];
+
+    [scanner setCharactersToBeSkipped: nil];
+
+    while ([scanner isAtEnd] == NO) {
+      NSString *str;
+      unsigned long long num;
+
+      if ([scanner scanUpToString: @"tab_" intoString: &str]) {
+        [key appendString: str];
+      }
+
+      if ([scanner scanString: @"tab_" intoString: NULL]) {
+        if ([scanner scanUnsignedLongLong: &num]) {
+          NSNumber *table = [NSNumber numberWithUnsignedLongLong: num];
+          NSUInteger index = [tables indexOfObject: table];
+
+          if (index == NSNotFound) {
+            index = [tables count];
+            [tables addObject: table];
+          }
+          [key appendFormat: @"tab_#%lu", (unsigned long)index];
+        } else {
+          [key appendString: @"tab_"];
+        }
+      }
+    }
+
+    [key appendString: @";"];
+  }
+
+  return key;
+}
+
+static NSMutableSet *paths_of_query(sqlite3 *db, const char *query)
+{
+  NSMutableSet *paths = [NSMutableSet set];
+  struct sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare(db, query, strlen(query), &stmt, NULL) == SQLITE_OK) {
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      const unsigned char *path = sqlite3_column_text(stmt, 0);
+
+      if (path) {
+        [paths addObject: [NSString stringWithUTF8String: (const char *)path]];
+      }
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  return paths;
+}
+
+/* The order of the join query: score, then path. */
+static NSComparisonResult compare_lines(id line1, id line2, void *context)
+{
+  NSComparisonResult result = [[line2 objectAtIndex: 1] compare: [line1 objectAtIndex: 1]];
+
+  if (result == NSOrderedSame) {
+    result = [[line1 objectAtIndex: 0] compare: [line2 objectAtIndex: 0]];
+  }
+
+  return result;
+}
+
+
+@implementation GMDS (query_cache)
+
+- (void)setupQueryCache
+{
+  queryCache = [NSMutableDictionary new];
+  lastUpdateTime = [NSDate timeIntervalSinceReferenceDate];
+
+  [[NSDistributedNotificationCenter defaultCenter] addObserver: self
+                                selector: @selector(metadataDidUpdate:)
+                                    name: @"GWMetadataDidUpdateNotification"
+                                  object: nil];
+}
+
+/*
+ * An entry, cached or to be filled, for a query that can be cached:
+ * one that carries the statements of its updates, the ones filling
+ * its temporary tables from updated_paths or, for a compiled query,
+ * its own "join" on updated_paths.  The updates of a live query
+ * themselves are not cached.
+ */
+- (NSMutableDictionary *)cacheEntryForQuery:(NSDictionary *)queryInfo
+{
+  NSDictionary *updates = [queryInfo objectForKey: @"updates"];
+  NSString *join = [queryInfo objectForKey: @"join"];
+  NSString *key;
+  NSMutableDictionary *entry;
+
+  if ((updates == nil) || (join == nil)) {
+    return nil;
+  }
+
+  key = normalized_query([queryInfo objectForKey: @"pre"], join);
+  entry = [queryCache objectForKey: key];
+
+  if (entry == nil) {
+    entry = [NSMutableDictionary dictionary];
+    [entry setObject: key forKey: @"key"];
+    [entry setObject: join forKey: @"join"];
+    [entry setObject: updates forKey: @"updates"];
+    [entry setObject: [NSNumber numberWithDouble: [NSDate timeIntervalSinceReferenceDate]]
+              forKey: @"stamp"];
+  }
+
+  return entry;
+}
+
+/*
+ * The lines of a cached entry, with the paths updated since it was
+ * read evaluated again by the updates form of the query, and the
+ * removed ones left out.  nil if the entry has no lines yet.
+ */
+- (NSArray *)cachedResultsForEntry:(NSMutableDictionary *)entry
+{
+  NSMutableArray *lines = [entry objectForKey: @"lines"];
+  NSDictionary *updates = [entry objectForKey: @"updates"];
+  NSArray *prequeries = [updates objectForKey: @"pre"];
+  NSArray *postqueries = [updates objectForKey: @"post"];
+  NSString *joinquery = [updates objectForKey: @"join"];
+  const char *join;
+  NSTimeInterval stamp = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableSet *changed;
+  NSMutableArray *delta = nil;
+  struct sqlite3_stmt *stmt;
+  NSUInteger i;
+
+  if (lines == nil) {
+    return nil;
+  }
+
+  /* a compiled query has its own statement for the updated paths */
+  if (joinquery == nil) {
+    joinquery = [entry objectForKey: @"join"];
+  }
+  join = [joinquery UTF8String];
+
+  changed = paths_of_query(db, "SELECT path FROM updated_paths");
+  [changed unionSet: paths_of_query(db, "SELECT path FROM removed_paths")];
+
+  if ([changed count]) {
+    if (prequeries && ([self performPreQueries: prequeries] == NO)) {
+      [self performPostQueries: postqueries];
+      [queryCache removeObjectForKey: [entry objectForKey: @"key"]];
+      return nil;
+    }
+
+    delta = [NSMutableArray array];
+
+    if (sqlite3_prepare(db, join, strlen(join), &stmt, NULL) == SQLITE_OK) {
+      while (sqlite3_step(stmt) == SQLITE_ROW) {
+        [delta addObject: lineOfStatement(stmt)];
+      }
+      sqlite3_finalize(stmt);
+    } else {
+      delta = nil;
+    }
+
+    if (postqueries) {
+      [self performPostQueries: postqueries];
+    }
+
+    if (delta == nil) {
+      NSDebugLLog(@"gwspace", @"%s", sqlite3_errmsg(db));
+      [queryCache removeObjectForKey: [entry objectForKey: @"key"]];
+      return nil;
+    }
+
+    for (i = 0; i < [lines count]; i++) {
+      if ([changed containsObject: [[lines objectAtIndex: i] objectAtIndex: 0]]) {
+        [lines removeObjectAtIndex: i];
+        i--;
+      }
+    }
+
+    [lines addObjectsFromArray: delta];
+    [lines sortUsingFunction: compare_lines context: NULL];
+  }
+
+  GWDebugLog(@"cached query: %lu lines, %lu changed paths, %lu updated",
+             (unsigned long)[lines count], (unsigned long)[changed count],
+             (unsigned long)[delta count]);
+
+  [entry setObject: [NSNumber numberWithDouble: stamp] forKey: @"stamp"];
+
+  return [NSArray arrayWithArray: lines];
+}
+
+- (void)cacheResults:(NSArray *)lines
+           withEntry:(NSMutableDictionary *)entry
+{
+  NSString *key = [entry objectForKey: @"key"];
+
+  /* read before the last notification: the updates since may be gone */
+  if ([[entry objectForKey: @"stamp"] doubleValue] < lastUpdateTime) {
+    return;
+  }
+
+  if (([queryCache objectForKey: key] == nil)
+                    && ([queryCache count] >= CACHE_MAX_ENTRIES)) {
+    NSEnumerator *enumerator = [queryCache objectEnumerator];
+    NSDictionary *oldest = nil;
+    NSDictionary *dict;
+
+    while ((dict = [enumerator nextObject])) {
+      if ((oldest == nil) || ([[dict objectForKey: @"stamp"] doubleValue]
+                                < [[oldest objectForKey: @"stamp"] doubleValue])) {
+        oldest = dict;
+      }
+    }
+
+    [queryCache removeObjectForKey: [oldest objectForKey: @"key"]];
+  }
+
+  [entry setObject: [NSMutableArray arrayWithArray: lines] forKey: @"lines"];
+  [queryCache setObject: entry forKey: key];
+}
+
+/*
+ * mdextractor has just emptied removed_paths and dropped the
+ * updated_paths rows older than its previous notification.  The
+ * removed paths are taken out of every entry now; an entry read before
+ * the previous notification can no longer be brought up to date.
+ */
+- (void)metadataDidUpdate:(NSNotification *)notif
+{
+  NSSet *removed = [NSSet setWithArray: [[notif userInfo] objectForKey: @"removed"]];
+  NSTimeInterval limit = lastUpdateTime;
+  NSArray *keys = [queryCache allKeys];
+  NSUInteger i, j;
+
+  lastUpdateTime = [NSDate timeIntervalSinceReferenceDate];
+
+  for (i = 0; i < [keys count]; i++) {
+    NSString *key = [keys objectAtIndex: i];
+    NSMutableDictionary *entry = [queryCache objectForKey: key];
+
+    if ([[entry objectForKey: @"stamp"] doubleValue] < limit) {
+      GWDebugLog(@"cached query expired");
+      [queryCache removeObjectForKey: key];
+
+    } else if ([removed count]) {
+      NSMutableArray *lines = [entry objectForKey: @"lines"];
+
+      for (j = 0; j < [lines count]; j++) {
+        if ([removed containsObject: [[lines objectAtIndex: j] objectAtIndex: 0]]) {
+          [lines removeObjectAtIndex: j];
+          j--;
+        }
+      }
+    }
+  }
+}
+
+@end
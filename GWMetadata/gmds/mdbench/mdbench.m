@@ -0,0 +1,926 @@
+/* mdbench.m
+ *
+ * Measures the indexer on a synthetic corpus: writes a reproducible
+ * mix of text, HTML, RTF, JPEG and PDF files, indexes it with
+ * mdextractor into a scratch db, then times a fixed suite of queries
+ * through gmds.  Nothing outside the scratch directory is touched.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <Foundation/Foundation.h>
+#include "MDKQuery.h"
+
+/* files in each directory of the corpus */
+#define DIR_FILES 100
+/* polls of status.plist while indexing */
+#define POLL_TIME (0.25)
+/* what gmds gets to register its name */
+#define LAUNCH_TIME (10.0)
+
+static const char *words[] = {
+  "harbor", "lantern", "meadow", "copper", "violet", "engine", "orchard",
+  "signal", "timber", "canyon", "marble", "falcon", "glacier", "ember",
+  "quarry", "saddle", "thistle", "beacon", "cobalt", "drifter", "fennel",
+  "granite", "hollow", "juniper", "kestrel", "lagoon", "mantle", "nectar",
+  "oyster", "pepper", "quiver", "ribbon", "summit", "tundra", "umber",
+  "velvet", "willow", "yonder", "zephyr", "anchor", "bramble", "cinder",
+  "dune", "estuary", "feather", "gravel", "heron", "island", "jasper",
+  "kernel", "ledger", "mosaic", "nimbus", "outpost", "pillar", "quill",
+  "raven", "spindle", "tablet", "upland", "vessel", "wharf", "yarrow",
+  "zenith"
+};
+
+#define WORDS_COUNT (sizeof(words) / sizeof(words[0]))
+
+/* the suite: plain, prefix, AND, OR, name substring, EXIF and numeric */
+static NSString *suite[] = {
+  @"GSMDItemTextContent == \"harbor\"",
+  @"GSMDItemTextContent == \"gran*\"",
+  @"GSMDItemTextContent == \"lantern\" && GSMDItemTextContent == \"meadow\"",
+  @"GSMDItemTextContent == \"zephyr\" || GSMDItemTextContent == \"zenith\"",
+  @"GSMDItemFSName == \"*file-1*\"",
+  @"GSMDItemTitle == \"*copper*\"c",
+  @"GSMDItemAcquisitionMake == \"Bench*\"",
+  @"GSMDItemFSSize > 8192",
+  nil
+};
+
+enum {
+  TEXT_TYPE,
+  HTML_TYPE,
+  RTF_TYPE,
+  JPEG_TYPE,
+  PDF_TYPE,
+  TYPES_COUNT
+};
+
+static NSString *typeNames[] = {
+  @"text", @"html", @"rtf", @"jpeg", @"pdf"
+};
+
+static NSString *typeExtensions[] = {
+  @"txt", @"html", @"rtf", @"jpg", @"pdf"
+};
+
+
+@interface MDBench : NSObject
+{
+  NSString *scratch;
+  NSString *corpus;
+  NSString *home;
+  unsigned filescount;
+  unsigned long meansize;
+  unsigned weights[TYPES_COUNT];
+  uint32_t seed;
+  uint32_t state;
+  unsigned runs;
+  NSTimeInterval timeout;
+  BOOL keep;
+
+  unsigned long long corpusBytes;
+  unsigned typeCounts[TYPES_COUNT];
+
+  NSTask *extractor;
+  NSTask *gmds;
+
+  MDKQuery *query;
+  BOOL queryDone;
+  unsigned resultsCount;
+  NSTimeInterval queryStart;
+  NSTimeInterval firstResult;
+}
+
+- (id)initWithArguments:(NSArray *)args;
+
+- (BOOL)run;
+
+- (void)generateCorpus;
+
+- (NSData *)dataOfType:(int)type
+                  size:(unsigned long)size
+                 index:(unsigned)index;
+
+- (BOOL)indexCorpus;
+
+- (BOOL)runQuerySuite;
+
+- (NSDictionary *)scratchEnvironment;
+
+- (NSString *)dbFileNamed:(NSString *)name;
+
+- (void)cleanup;
+
+- (void)printHelp;
+
+@end
+
+
+/* xorshift: the same seed always gives the same corpus */
+static uint32_t next_random(uint32_t *state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+
+  return x;
+}
+
+/* a few words draw most of the text, as in real documents */
+static const char *random_word(uint32_t *state)
+{
+  unsigned a = next_random(state) % WORDS_COUNT;
+  unsigned b = next_random(state) % WORDS_COUNT;
+
+  return words[(a * b) / WORDS_COUNT];
+}
+
+static void append_words(NSMutableData *data, uint32_t *state,
+                         unsigned long size, unsigned linelen)
+{
+  unsigned long start = [data length];
+  unsigned col = 0;
+
+  while (([data length] - start) < size) {
+    const char *w = random_word(state);
+    unsigned len = strlen(w);
+
+    if (col && ((col + len) >= linelen)) {
+      [data appendBytes: "\n" length: 1];
+      col = 0;
+    } else if (col) {
+      [data appendBytes: " " length: 1];
+      col++;
+    }
+
+    [data appendBytes: w length: len];
+    col += len;
+  }
+}
+
+static void append_string(NSMutableData *data, NSString *str)
+{
+  const char *s = [str UTF8String];
+
+  [data appendBytes: s length: strlen(s)];
+}
+
+static void append_le16(NSMutableData *data, unsigned v)
+{
+  unsigned char b[2] = { v & 0xff, (v >> 8) & 0xff };
+
+  [data appendBytes: b length: 2];
+}
+
+static void append_le32(NSMutableData *data, unsigned long v)
+{
+  unsigned char b[4] = { v & 0xff, (v >> 8) & 0xff, (v >> 16) & 0xff, (v >> 24) & 0xff };
+
+  [data appendBytes: b length: 4];
+}
+
+static void append_be16(NSMutableData *data, unsigned v)
+{
+  unsigned char b[2] = { (v >> 8) & 0xff, v & 0xff };
+
+  [data appendBytes: b length: 2];
+}
+
+static double percentile(NSArray *sorted, double p)
+{
+  unsigned count = [sorted count];
+  unsigned i;
+
+  if (count == 0) {
+    return 0.0;
+  }
+
+  i = (unsigned)(p * count + 0.999999);
+  i = (i > 0) ? (i - 1) : 0;
+
+  return [[sorted objectAtIndex: MIN(i, count - 1)] doubleValue];
+}
+
+
+@implementation MDBench
+
+- (void)dealloc
+{
+  RELEASE (scratch);
+  RELEASE (corpus);
+  RELEASE (home);
+  TEST_RELEASE (extractor);
+  TEST_RELEASE (gmds);
+  TEST_RELEASE (query);
+
+  [super dealloc];
+}
+
+- (id)initWithArguments:(NSArray *)args
+{
+  self = [super init];
+
+  if (self) {
+    unsigned count = [args count];
+    NSString *dir = nil;
+    unsigned i;
+
+    filescount = 1000;
+    meansize = 8192;
+    seed = 1;
+    runs = 20;
+    timeout = 3600.0;
+    keep = NO;
+
+    weights[TEXT_TYPE] = 40;
+    weights[HTML_TYPE] = 20;
+    weights[RTF_TYPE] = 15;
+    weights[JPEG_TYPE] = 15;
+    weights[PDF_TYPE] = 10;
+
+    for (i = 1; i < count; i++) {
+      NSString *arg = [args objectAtIndex: i];
+      NSString *value = ((i + 1) < count) ? [args objectAtIndex: i + 1] : nil;
+
+      if ([arg isEqual: @"-h"]) {
+        [self printHelp];
+        DESTROY (self);
+        return self;
+
+      } else if ([arg isEqual: @"-keep"]) {
+        keep = YES;
+
+      } else if (value == nil) {
+        GSPrintf(stderr, @"mdbench: no value supplied for %@!\n", arg);
+        DESTROY (self);
+        return self;
+
+      } else if ([arg isEqual: @"-dir"]) {
+        dir = value;
+        i++;
+
+      } else if ([arg isEqual: @"-files"]) {
+        filescount = MAX(1, [value intValue]);
+        i++;
+
+      } else if ([arg isEqual: @"-size"]) {
+        meansize = MAX(64, [value intValue]);
+        i++;
+
+      } else if ([arg isEqual: @"-seed"]) {
+        seed = MAX(1, [value intValue]);
+        i++;
+
+      } else if ([arg isEqual: @"-runs"]) {
+        runs = MAX(1, [value intValue]);
+        i++;
+
+      } else if ([arg isEqual: @"-timeout"]) {
+        timeout = MAX(1.0, [value doubleValue]);
+        i++;
+
+      } else if ([arg isEqual: @"-mix"]) {
+        NSArray *parts = [value componentsSeparatedByString: @","];
+        unsigned j, t;
+
+        memset(weights, 0, sizeof(weights));
+
+        for (j = 0; j < [parts count]; j++) {
+          NSArray *pair = [[parts objectAtIndex: j] componentsSeparatedByString: @"="];
+
+          for (t = 0; t < TYPES_COUNT; t++) {
+            if ([pair count] == 2
+                  && [[pair objectAtIndex: 0] isEqual: typeNames[t]]) {
+              weights[t] = MAX(0, [[pair objectAtIndex: 1] intValue]);
+              break;
+            }
+          }
+
+          if (t == TYPES_COUNT) {
+            GSPrintf(stderr, @"mdbench: invalid mix entry %@!\n", [parts objectAtIndex: j]);
+            DESTROY (self);
+            return self;
+          }
+        }
+        i++;
+
+      } else {
+        GSPrintf(stderr, @"mdbench: unknown argument %@!\n", arg);
+        [self printHelp];
+        DESTROY (self);
+        return self;
+      }
+    }
+
+    if (dir == nil) {
+      dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"mdbench-%i", getpid()]];
+    }
+
+    ASSIGN (scratch, dir);
+    ASSIGN (corpus, [scratch stringByAppendingPathComponent: @"corpus"]);
+    ASSIGN (home, [scratch stringByAppendingPathComponent: @"home"]);
+    state = seed;
+  }
+
+  return self;
+}
+
+- (BOOL)run
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  BOOL done = NO;
+
+  /* the daemons of the user would get the requests meant for ours */
+  if ([NSConnection rootProxyForConnectionWithRegisteredName: @"gmds" host: @""]
+        || [NSConnection rootProxyForConnectionWithRegisteredName: @"mdextractor" host: @""]) {
+    GSPrintf(stderr, @"mdbench: stop gmds and mdextractor before running the benchmark!\n");
+    return NO;
+  }
+
+  if ([fm fileExistsAtPath: scratch]) {
+    GSPrintf(stderr, @"mdbench: %@ already exists!\n", scratch);
+    return NO;
+  }
+
+  if (([fm createDirectoryAtPath: corpus withIntermediateDirectories: YES
+                      attributes: nil error: NULL] == NO)
+        || ([fm createDirectoryAtPath: home withIntermediateDirectories: YES
+                           attributes: nil error: NULL] == NO)) {
+    GSPrintf(stderr, @"mdbench: unable to create %@!\n", scratch);
+    return NO;
+  }
+
+  GSPrintf(stdout, @"scratch: %@\n\n", scratch);
+
+  [self generateCorpus];
+
+  if ([self indexCorpus]) {
+    done = [self runQuerySuite];
+  }
+
+  [self cleanup];
+
+  return done;
+}
+
+- (void)generateCorpus
+{
+  NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+  unsigned total = 0;
+  NSString *dir = nil;
+  unsigned i, t;
+
+  for (t = 0; t < TYPES_COUNT; t++) {
+    total += weights[t];
+  }
+
+  if (total == 0) {
+    weights[TEXT_TYPE] = total = 1;
+  }
+
+  for (i = 0; i < filescount; i++) {
+    CREATE_AUTORELEASE_POOL (arp);
+    unsigned pick = next_random(&state) % total;
+    unsigned long size = meansize / 2 + next_random(&state) % (meansize + 1);
+    NSString *name;
+    NSData *data;
+
+    for (t = 0; t < TYPES_COUNT - 1; t++) {
+      if (pick < weights[t]) {
+        break;
+      }
+      pick -= weights[t];
+    }
+
+    if ((i % DIR_FILES) == 0) {
+      ASSIGN (dir, [corpus stringByAppendingPathComponent:
+                     [NSString stringWithFormat: @"dir-%04u", i / DIR_FILES]]);
+      [[NSFileManager defaultManager] createDirectoryAtPath: dir
+                                withIntermediateDirectories: YES
+                                                 attributes: nil
+                                                      error: NULL];
+    }
+
+    name = [NSString stringWithFormat: @"file-%u.%@", i, typeExtensions[t]];
+    data = [self dataOfType: t size: size index: i];
+    [data writeToFile: [dir stringByAppendingPathComponent: name] atomically: NO];
+
+    corpusBytes += [data length];
+    typeCounts[t]++;
+
+    RELEASE (arp);
+  }
+
+  TEST_RELEASE (dir);
+
+  GSPrintf(stdout, @"corpus: %u files, %llu bytes in %.2f s (seed %u)\n",
+           filescount, corpusBytes,
+           [NSDate timeIntervalSinceReferenceDate] - start, seed);
+
+  for (t = 0; t < TYPES_COUNT; t++) {
+    GSPrintf(stdout, @"  %-6s %u\n", [typeNames[t] UTF8String], typeCounts[t]);
+  }
+
+  GSPrintf(stdout, @"\n");
+}
+
+- (NSData *)dataOfType:(int)type
+                  size:(unsigned long)size
+                 index:(unsigned)index
+{
+  NSMutableData *data = [NSMutableData data];
+  NSString *title = [NSString stringWithFormat: @"%s %s %u",
+                          random_word(&state), random_word(&state), index];
+
+  switch (type) {
+    case HTML_TYPE:
+      append_string(data, [NSString stringWithFormat:
+            @"<html><head><title>%@</title>"
+            @"<meta name=\"keywords\" content=\"%s, %s\"></head>\n<body><p>\n",
+            title, random_word(&state), random_word(&state)]);
+      append_words(data, &state, size, 72);
+      append_string(data, @"\n</p></body></html>\n");
+      break;
+
+    case RTF_TYPE:
+      append_string(data, [NSString stringWithFormat:
+            @"{\\rtf1\\ansi{\\fonttbl\\f0\\fswiss Helvetica;}"
+            @"{\\info{\\title %@}{\\author Bench Author}}\n\\f0\\fs24\\pard\n", title]);
+      append_words(data, &state, size, 72);
+      append_string(data, @"\\par\n}\n");
+      break;
+
+    case JPEG_TYPE:
+      {
+        /* an 8x8 grey baseline image behind an EXIF header, padded
+           with comments up to the size */
+        static const unsigned char tables[] = {
+          0xFF, 0xDB, 0x00, 0x43, 0x00,
+          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+          1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+          0xFF, 0xC0, 0x00, 0x0B, 0x08, 0x00, 0x08, 0x00, 0x08, 0x01, 0x01, 0x11, 0x00,
+          0xFF, 0xC4, 0x00, 0x14, 0x00,
+          0x01, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00,
+          0xFF, 0xC4, 0x00, 0x14, 0x10,
+          0x01, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00,
+          0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00,
+          0x3F,
+          0xFF, 0xD9
+        };
+        const char *strings[4];
+        unsigned tags[4] = { 0x010F, 0x0110, 0x0132, 0x013B };
+        NSMutableData *tiff = [NSMutableData data];
+        NSMutableData *strdata = [NSMutableData data];
+        unsigned long stroffset = 8 + 2 + 4 * 12 + 4;
+        unsigned j;
+
+        strings[0] = "Bench Camera";
+        strings[1] = [[NSString stringWithFormat: @"Model %u", index % 7] UTF8String];
+        strings[2] = [[NSString stringWithFormat: @"20%02u:%02u:%02u 12:00:00",
+                        10 + index % 15, 1 + index % 12, 1 + index % 28] UTF8String];
+        strings[3] = [[NSString stringWithFormat: @"%s %s",
+                        random_word(&state), random_word(&state)] UTF8String];
+
+        [tiff appendBytes: "II*\0" length: 4];
+        append_le32(tiff, 8);
+        append_le16(tiff, 4);
+
+        for (j = 0; j < 4; j++) {
+          unsigned long len = strlen(strings[j]) + 1;
+
+          append_le16(tiff, tags[j]);
+          append_le16(tiff, 2);
+          append_le32(tiff, len);
+          append_le32(tiff, stroffset + [strdata length]);
+          [strdata appendBytes: strings[j] length: len];
+        }
+
+        append_le32(tiff, 0);
+        [tiff appendData: strdata];
+
+        [data appendBytes: "\xFF\xD8\xFF\xE1" length: 4];
+        append_be16(data, 2 + 6 + [tiff length]);
+        [data appendBytes: "Exif\0\0" length: 6];
+        [data appendData: tiff];
+
+        /* a comment is 4 bytes of marker and length, then the words */
+        while (([data length] + sizeof(tables) + 4 + 16) < size) {
+          NSMutableData *comment = [NSMutableData data];
+          unsigned long left = size - [data length] - sizeof(tables) - 4;
+
+          append_words(comment, &state, MIN(left, 60000), 72);
+
+          [data appendBytes: "\xFF\xFE" length: 2];
+          append_be16(data, 2 + [comment length]);
+          [data appendData: comment];
+        }
+
+        [data appendBytes: tables length: sizeof(tables)];
+      }
+      break;
+
+    case PDF_TYPE:
+      {
+        NSMutableData *stream = [NSMutableData data];
+        NSMutableData *text = [NSMutableData data];
+        NSMutableArray *offsets = [NSMutableArray array];
+        const char *p, *end;
+        unsigned long xref;
+        unsigned j;
+
+        append_words(text, &state, size, 80);
+        p = [text bytes];
+        end = p + [text length];
+
+        append_string(stream, @"BT /F1 10 Tf 72 760 Td 12 TL\n");
+        while (p < end) {
+          const char *nl = memchr(p, '\n', end - p);
+          unsigned long len = (nl ? nl : end) - p;
+
+          [stream appendBytes: "(" length: 1];
+          [stream appendBytes: p length: len];
+          [stream appendBytes: ") '\n" length: 4];
+          p += len + 1;
+        }
+        append_string(stream, @"ET\n");
+
+        append_string(data, @"%PDF-1.4\n");
+
+#define PDF_OBJECT(str) \
+  do { \
+    [offsets addObject: [NSNumber numberWithUnsignedLong: [data length]]]; \
+    append_string(data, str); \
+  } while (0)
+
+        PDF_OBJECT(@"1 0 obj << /Type /Catalog /Pages 2 0 R >> endobj\n");
+        PDF_OBJECT(@"2 0 obj << /Type /Pages /Kids [3 0 R] /Count 1 >> endobj\n");
+        PDF_OBJECT(@"3 0 obj << /Type /Page /Parent 2 0 R /MediaBox [0 0 612 792] "
+                   @"/Contents 4 0 R /Resources << /Font << /F1 5 0 R >> >> >> endobj\n");
+        PDF_OBJECT(([NSString stringWithFormat:
+                       @"4 0 obj << /Length %lu >>\nstream\n", [stream length]]));
+        [data appendData: stream];
+        append_string(data, @"endstream endobj\n");
+        PDF_OBJECT(@"5 0 obj << /Type /Font /Subtype /Type1 /BaseFont /Helvetica >> endobj\n");
+        PDF_OBJECT(([NSString stringWithFormat:
+                       @"6 0 obj << /Title (%@) /Author (Bench Author) >> endobj\n", title]));
+
+        xref = [data length];
+        append_string(data, [NSString stringWithFormat:
+                    @"xref\n0 %lu\n0000000000 65535 f \n", [offsets count] + 1]);
+
+        for (j = 0; j < [offsets count]; j++) {
+          append_string(data, [NSString stringWithFormat: @"%010lu 00000 n \n",
+                                [[offsets objectAtIndex: j] unsignedLongValue]]);
+        }
+
+        append_string(data, [NSString stringWithFormat:
+                  @"trailer << /Size %lu /Root 1 0 R /Info 6 0 R >>\n"
+                  @"startxref\n%lu\n%%%%EOF\n", [offsets count] + 1, xref]);
+      }
+      break;
+
+    default:
+      append_string(data, [NSString stringWithFormat: @"%@\n\n", title]);
+      append_words(data, &state, size, 72);
+      append_string(data, @"\n");
+      break;
+  }
+
+  return data;
+}
+
+/*
+ * Runs mdextractor on the corpus alone, with a home of its own, until
+ * status.plist says every indexable path is done.
+ */
+- (BOOL)indexCorpus
+{
+  NSString *paths = [NSString stringWithFormat: @"(\"%@\")", corpus];
+  NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+  NSTimeInterval elapsed = 0.0;
+  NSString *report;
+  NSDictionary *costs;
+  NSEnumerator *enumerator;
+  NSString *name;
+  BOOL indexed = NO;
+
+  ASSIGN (extractor, AUTORELEASE ([NSTask new]));
+  [extractor setLaunchPath: [NSTask launchPathForTool: @"mdextractor"]];
+  [extractor setArguments: [NSArray arrayWithObjects: @"--daemon",
+                                    @"-GSMetadataIndexablePaths", paths,
+                                    @"-GSMetadataIndexingEnabled", @"YES",
+                                    nil]];
+  [extractor setEnvironment: [self scratchEnvironment]];
+
+  NS_DURING
+    {
+  [extractor launch];
+    }
+  NS_HANDLER
+    {
+  GSPrintf(stderr, @"mdbench: unable to launch mdextractor: %@\n", localException);
+  return NO;
+    }
+  NS_ENDHANDLER
+
+  while ((indexed == NO) && [extractor isRunning]) {
+    CREATE_AUTORELEASE_POOL (arp);
+    NSString *statusPath = [self dbFileNamed: @"status.plist"];
+    NSArray *status = (statusPath ? [NSArray arrayWithContentsOfFile: statusPath] : nil);
+    unsigned i;
+
+    indexed = ([status count] > 0);
+
+    for (i = 0; i < [status count]; i++) {
+      if ([[[status objectAtIndex: i] objectForKey: @"indexed"] boolValue] == NO) {
+        indexed = NO;
+        break;
+      }
+    }
+
+    RELEASE (arp);
+
+    elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+    if (elapsed > timeout) {
+      break;
+    }
+    if (indexed == NO) {
+      usleep(POLL_TIME * 1000000);
+    }
+  }
+
+  if (indexed == NO) {
+    GSPrintf(stderr, @"mdbench: the corpus was not indexed in %.0f s!\n", elapsed);
+    return NO;
+  }
+
+  GSPrintf(stdout, @"indexing: %.2f s, %.1f files/s, %.1f KB/s\n", elapsed,
+           filescount / elapsed, (corpusBytes / 1024.0) / elapsed);
+
+  report = [self dbFileNamed: @"extractors.plist"];
+  costs = (report ? [NSDictionary dictionaryWithContentsOfFile: report] : nil);
+  enumerator = [[[costs allKeys] sortedArrayUsingSelector: @selector(compare:)]
+                                                              objectEnumerator];
+
+  if ([costs count]) {
+    GSPrintf(stdout, @"  %-24s %8s %10s %10s %10s\n",
+                     "extractor", "files", "total s", "mean ms", "max ms");
+  }
+
+  while ((name = [enumerator nextObject])) {
+    NSDictionary *stats = [costs objectForKey: name];
+
+    GSPrintf(stdout, @"  %-24s %8lu %10.3f %10.3f %10.3f\n", [name UTF8String],
+             [[stats objectForKey: @"count"] unsignedLongValue],
+             [[stats objectForKey: @"time"] doubleValue],
+             [[stats objectForKey: @"mean_time"] doubleValue] * 1000,
+             [[stats objectForKey: @"max_time"] doubleValue] * 1000);
+  }
+
+  [extractor terminate];
+  [extractor waitUntilExit];
+  DESTROY (extractor);
+
+  {
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *db = [self dbFileNamed: @"contents.db"];
+    NSString *wal = [db stringByAppendingString: @"-wal"];
+    unsigned long long dbsize = [[fm fileAttributesAtPath: db traverseLink: NO] fileSize];
+    unsigned long long walsize = [[fm fileAttributesAtPath: wal traverseLink: NO] fileSize];
+
+    GSPrintf(stdout, @"db size: %llu bytes (wal %llu), %.2f of the corpus\n\n",
+             dbsize, walsize, (corpusBytes ? (double)(dbsize + walsize) / corpusBytes : 0.0));
+  }
+
+  return YES;
+}
+
+/*
+ * Times each query of the suite from its start to its last page,
+ * through a gmds of our own on the scratch db.
+ */
+- (BOOL)runQuerySuite
+{
+  NSArray *dirs = [NSArray arrayWithObject: corpus];
+  NSTimeInterval start;
+  unsigned i, j;
+
+  ASSIGN (gmds, AUTORELEASE ([NSTask new]));
+  [gmds setLaunchPath: [NSTask launchPathForTool: @"gmds"]];
+  [gmds setArguments: [NSArray arrayWithObject: @"--daemon"]];
+  [gmds setEnvironment: [self scratchEnvironment]];
+
+  NS_DURING
+    {
+  [gmds launch];
+    }
+  NS_HANDLER
+    {
+  GSPrintf(stderr, @"mdbench: unable to launch gmds: %@\n", localException);
+  return NO;
+    }
+  NS_ENDHANDLER
+
+  start = [NSDate timeIntervalSinceReferenceDate];
+
+  while ([NSConnection rootProxyForConnectionWithRegisteredName: @"gmds" host: @""] == nil) {
+    if (([NSDate timeIntervalSinceReferenceDate] - start) > LAUNCH_TIME) {
+      GSPrintf(stderr, @"mdbench: gmds did not start!\n");
+      return NO;
+    }
+    usleep(POLL_TIME * 1000000);
+  }
+
+  GSPrintf(stdout, @"queries: %u runs each\n", runs);
+  GSPrintf(stdout, @"  %10s %10s %10s %8s  %s\n",
+                   "p50 ms", "p99 ms", "first ms", "results", "query");
+
+  for (i = 0; suite[i] != nil; i++) {
+    NSMutableArray *latencies = [NSMutableArray array];
+    NSMutableArray *firsts = [NSMutableArray array];
+    unsigned results = 0;
+
+    for (j = 0; j < runs; j++) {
+      CREATE_AUTORELEASE_POOL (arp);
+
+      NS_DURING
+        {
+      ASSIGN (query, [MDKQuery queryFromString: suite[i] inDirectories: dirs]);
+      [query setDelegate: self];
+      [query setReportRawResults: YES];
+
+      queryDone = NO;
+      resultsCount = 0;
+      firstResult = 0.0;
+      queryStart = [NSDate timeIntervalSinceReferenceDate];
+
+      [query startGathering];
+
+      while ((queryDone == NO)
+               && (([NSDate timeIntervalSinceReferenceDate] - queryStart) < timeout)) {
+        [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                                 beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+      }
+        }
+      NS_HANDLER
+        {
+      GSPrintf(stderr, @"mdbench: %@: %@\n", suite[i], localException);
+      queryDone = NO;
+        }
+      NS_ENDHANDLER
+
+      if (queryDone) {
+        [latencies addObject: [NSNumber numberWithDouble:
+                 ([NSDate timeIntervalSinceReferenceDate] - queryStart) * 1000]];
+        [firsts addObject: [NSNumber numberWithDouble:
+                 (firstResult > 0.0) ? (firstResult - queryStart) * 1000 : 0.0]];
+        results = resultsCount;
+      }
+
+      [query setDelegate: nil];
+      DESTROY (query);
+      RELEASE (arp);
+    }
+
+    [latencies sortUsingSelector: @selector(compare:)];
+    [firsts sortUsingSelector: @selector(compare:)];
+
+    GSPrintf(stdout, @"  %10.3f %10.3f %10.3f %8u  %@\n",
+             percentile(latencies, 0.5), percentile(latencies, 0.99),
+             percentile(firsts, 0.5), results, suite[i]);
+  }
+
+  return YES;
+}
+
+- (void)appendRawResults:(NSArray *)lines
+{
+  if ((firstResult == 0.0) && [lines count]) {
+    firstResult = [NSDate timeIntervalSinceReferenceDate];
+  }
+  resultsCount += [lines count];
+}
+
+- (void)queryDidEndGathering:(MDKQuery *)q
+{
+  queryDone = YES;
+}
+
+/* the Library of the daemons, and so their db, move under the scratch home */
+- (NSDictionary *)scratchEnvironment
+{
+  NSMutableDictionary *env = [[[NSProcessInfo processInfo] environment] mutableCopy];
+
+  [env setObject: home forKey: @"HOME"];
+  [env removeObjectForKey: @"GNUSTEP_USER_ROOT"];
+
+  return AUTORELEASE (env);
+}
+
+- (NSString *)dbFileNamed:(NSString *)name
+{
+  NSDirectoryEnumerator *enumerator = [[NSFileManager defaultManager] enumeratorAtPath: home];
+  NSString *path;
+
+  while ((path = [enumerator nextObject])) {
+    if ([[path lastPathComponent] isEqual: name]
+          && ([path rangeOfString: @"gmds/.db"].location != NSNotFound)) {
+      return [home stringByAppendingPathComponent: path];
+    }
+  }
+
+  return nil;
+}
+
+- (void)cleanup
+{
+  if (extractor && [extractor isRunning]) {
+    [extractor terminate];
+    [extractor waitUntilExit];
+  }
+  if (gmds && [gmds isRunning]) {
+    [gmds terminate];
+    [gmds waitUntilExit];
+  }
+
+  if (keep == NO) {
+    [[NSFileManager defaultManager] removeFileAtPath: scratch handler: nil];
+  }
+}
+
+- (void)printHelp
+{
+  GSPrintf(stderr,
+      @"\n"
+      @"The 'mdbench' tool measures the indexing throughput and the query\n"
+      @"latency on a synthetic corpus\n"
+      @"\n"
+      @"usage: mdbench [arguments]\n"
+      @"\n"
+      @"Arguments:\n"
+      @"  -dir 'directory'       the scratch directory, created by mdbench\n"
+      @"                         (default: a new one in the temporary dir).\n"
+      @"  -files 'n'             the files of the corpus (default 1000).\n"
+      @"  -size 'bytes'          the mean size of a file (default 8192).\n"
+      @"  -mix 'type=w,...'      the weight of each type among text, html, rtf,\n"
+      @"                         jpeg and pdf (default text=40,html=20,rtf=15,\n"
+      @"                         jpeg=15,pdf=10).\n"
+      @"  -seed 'n'              the same seed writes the same corpus (default 1).\n"
+      @"  -runs 'n'              the runs of each query (default 20).\n"
+      @"  -timeout 's'           gives up indexing after 's' seconds.\n"
+      @"  -keep                  keeps the scratch directory.\n"
+      @"  -h                     shows this help and exit.\n"
+      @"\n"
+      @"gmds and mdextractor must not be running: mdbench starts its own,\n"
+      @"with HOME set to the scratch directory.\n"
+      @"\n"
+  );
+}
+
+@end
+
+
+int main(int argc, char **argv, char **env)
+{
+  NSAutoreleasePool	*pool;
+  NSProcessInfo *proc;
+  MDBench *mdbench;
+  BOOL done;
+
+#ifdef GS_PASS_ARGUMENTS
+  [NSProcessInfo initializeWithArguments: argv count: argc environment: env];
+#endif
+
+  pool = [NSAutoreleasePool new];
+  proc = [NSProcessInfo processInfo];
+
+  if (proc == nil) {
+    GSPrintf(stderr, @"mdbench: unable to get process information!\n");
+    RELEASE (pool);
+    exit(EXIT_FAILURE);
+  }
+
+  mdbench = [[MDBench alloc] initWithArguments: [proc arguments]];
+
+  if (mdbench == nil) {
+    RELEASE (pool);
+    exit(EXIT_FAILURE);
+  }
+
+  done = [mdbench run];
+  RELEASE (mdbench);
+  RELEASE (pool);
+
+  exit(done ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -24,10 +24,10 @@
 
 #include <AppKit/AppKit.h>
 #include "HtmlExtractor.h"
+#include "tokenizer.h"
 
 #define MAXFSIZE 600000
 #define DLENGTH 256
-#define WORD_MAX 40
 
 void strip(const char *inbuf, NSMutableString *outstr, NSMutableDictionary *metadict);
 int escapeChar(char *buf, NSMutableString *str);
@@ -124,38 +124,15 @@ int escapeChar(char *buf, NSMutableString *str);
     strip(inbuf, stripped, attrsdict);
     
     if (stripped && [stripped length]) {
-      NSScanner *scanner = [NSScanner scannerWithString: stripped];
-      SEL scanSel = @selector(scanUpToCharactersFromSet:intoString:);
-      IMP scanImp = [scanner methodForSelector: scanSel];
-      NSMutableDictionary *wordsDict = [NSMutableDictionary dictionary];
-      NSCountedSet *wordset = [[NSCountedSet alloc] initWithCapacity: 1];
-      unsigned long wcount = 0;
-      NSString *word;
-    
-      [scanner setCharactersToBeSkipped: skipSet];
-
-      while ([scanner isAtEnd] == NO) {        
-        (*scanImp)(scanner, scanSel, skipSet, &word);
-
-        if (word) {
-          unsigned wl = [word length];
-
-          if ((wl > 3) && (wl < WORD_MAX)) { 
-            [wordset addObject: word];
-          }
-
-          wcount++;
-        }
-      }
+      GMDSTokenizer tk;
 
-      [wordsDict setObject: wordset forKey: @"wset"];
-      [wordsDict setObject: [NSNumber numberWithUnsignedLong: wcount] 
-                    forKey: @"wcount"];
+      GMDSTokenizerInit(&tk, skipSet);
+      GMDSTokenizerFeedString(&tk, stripped);
 
-      [mddict setObject: wordsDict forKey: @"words"];
+      [mddict setObject: GMDSTokenizerWords(&tk) forKey: @"words"];
       [mddict setObject: attrsdict forKey: @"attributes"];
 
-      RELEASE (wordset); 
+      GMDSTokenizerDestroy(&tk);
     }    
   }
 
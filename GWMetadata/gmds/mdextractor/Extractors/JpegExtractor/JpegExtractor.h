@@ -57,6 +57,7 @@
 {
   id extractor;
   NSArray *extensions;
+  NSLock *jheadLock;
 }
 
 @end
@@ -31,6 +31,7 @@
 - (void)dealloc
 {
   RELEASE (extensions);
+  RELEASE (jheadLock);
 	[super dealloc];
 }
 
@@ -40,6 +41,8 @@
   
   if (self) {
     ASSIGN (extensions, ([NSArray arrayWithObjects: @"jpeg", @"jpg", nil]));  
+    /* the jhead code keeps the file being read in globals */
+    jheadLock = [NSLock new];
     extractor = extr;
   }
 
@@ -67,13 +70,17 @@
   NSMutableDictionary *mddict = [NSMutableDictionary dictionary];
   NSMutableDictionary *imageInfo = [NSMutableDictionary dictionary];
   BOOL success = YES;
+  BOOL read;
   
+  [jheadLock lock];
   ResetJpgfile();
+  read = ReadJpegFile([path UTF8String], imageInfo);
+  DiscardData();
+  [jheadLock unlock];
 
-  if (ReadJpegFile([path UTF8String], imageInfo)) {
+  if (read) {
  //   [imageInfo setObject: @"public.jpeg" forKey: @"GSMDItemContentType"];
     [mddict setObject: imageInfo forKey: @"attributes"];
-    DiscardData();
 
     {
       /* mdextractor needs this empty "words" dictionary to let 
@@ -54,8 +54,23 @@ extern const int BytesPerFormat[];
 #define FMT_SINGLE    11
 #define FMT_DOUBLE    12
 
+//--------------------------------------------------------------------------
+// The headers are read with pread() a chunk at a time, from the start of
+// the file and no further than JPEG_HEADER_LIMIT; the scan stops at the
+// compressed data, so that is never read.
+#define JPEG_READ_CHUNK 65536
+#define JPEG_HEADER_LIMIT (4 * JPEG_READ_CHUNK)
+
+typedef struct {
+  int fd;
+  uchar Buf[JPEG_READ_CHUNK];
+  off_t BufStart;         // file offset of Buf[0]
+  int BufLen;
+  int Pos;                // next byte in Buf
+} JpegReader_t;
+
 // Prototypes from jpgfile.c
-BOOL ReadJpegSections (FILE *infile, NSMutableDictionary *imageInfo);
+BOOL ReadJpegSections (JpegReader_t *reader, NSMutableDictionary *imageInfo);
 void DiscardData(void);
 BOOL ReadJpegFile(const char *FileName, NSMutableDictionary *imageInfo);
 void ResetJpgfile(void);
@@ -6,6 +6,9 @@
 //
 // Matthias Wandel,  Dec 1999 - Dec 2002 
 //--------------------------------------------------------------------------
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "jhead.h"
 
 // Storage for simplified info extracted from file.
@@ -25,6 +28,68 @@ static int Get16m(const void * Short)
   return (((uchar *)Short)[0] << 8) | ((uchar *)Short)[1];
 }
 
+//--------------------------------------------------------------------------
+// The next chunk of the headers, if the limit allows.
+//--------------------------------------------------------------------------
+static BOOL ReaderFill(JpegReader_t *r)
+{
+  ssize_t got;
+
+  r->BufStart += r->BufLen;
+  r->BufLen = 0;
+  r->Pos = 0;
+
+  if (r->BufStart >= JPEG_HEADER_LIMIT) {
+    fprintf(stderr, "jpeg headers too long\n");
+    return NO;
+  }
+
+  do {
+    got = pread(r->fd, r->Buf, JPEG_READ_CHUNK, r->BufStart);
+  } while (got < 0 && errno == EINTR);
+
+  if (got <= 0) {
+    return NO;
+  }
+
+  r->BufLen = (int)got;
+
+  return YES;
+}
+
+static int ReaderGetc(JpegReader_t *r)
+{
+  if (r->Pos >= r->BufLen && ReaderFill(r) == NO) {
+    return EOF;
+  }
+
+  return r->Buf[r->Pos++];
+}
+
+static int ReaderRead(JpegReader_t *r, uchar *dest, int len)
+{
+  int got = 0;
+
+  while (got < len) {
+    int n;
+
+    if (r->Pos >= r->BufLen && ReaderFill(r) == NO) {
+      break;
+    }
+
+    n = r->BufLen - r->Pos;
+    if (n > len - got) {
+      n = len - got;
+    }
+
+    memcpy(dest + got, r->Buf + r->Pos, n);
+    r->Pos += n;
+    got += n;
+  }
+
+  return got;
+}
+
 //--------------------------------------------------------------------------
 // Process a COM marker.
 // We want to print out the marker contents as legible text;
@@ -93,14 +158,14 @@ static void process_SOFn (const uchar *Data, int marker,
 //--------------------------------------------------------------------------
 // Parse the marker stream until SOS or EOI is seen;
 //--------------------------------------------------------------------------
-BOOL ReadJpegSections(FILE *infile, NSMutableDictionary *imageInfo)
+BOOL ReadJpegSections(JpegReader_t *reader, NSMutableDictionary *imageInfo)
 {
   int a;
   BOOL HaveCom = NO;
 
-  a = fgetc(infile);
+  a = ReaderGetc(reader);
 
-  if (a != 0xff || fgetc(infile) != M_SOI){
+  if (a != 0xff || ReaderGetc(reader) != M_SOI){
     return NO;
   }
   
@@ -116,7 +181,7 @@ BOOL ReadJpegSections(FILE *infile, NSMutableDictionary *imageInfo)
     }
 
     for (a = 0; a < 7; a++) {
-      marker = fgetc(infile);
+      marker = ReaderGetc(reader);
       
       if (marker != 0xff) {
         break;
@@ -137,8 +202,13 @@ BOOL ReadJpegSections(FILE *infile, NSMutableDictionary *imageInfo)
     Sections[SectionsRead].Type = marker;
 
     // Read the length of the section.
-    lh = fgetc(infile);
-    ll = fgetc(infile);
+    lh = ReaderGetc(reader);
+    ll = ReaderGetc(reader);
+
+    if (lh == EOF || ll == EOF) {
+      fprintf(stderr, "Premature end of file?\n");
+      return NO;
+    }
 
     itemlen = (lh << 8) | ll;
 
@@ -160,7 +230,7 @@ BOOL ReadJpegSections(FILE *infile, NSMutableDictionary *imageInfo)
     Data[0] = (uchar)lh;
     Data[1] = (uchar)ll;
 
-    got = fread(Data + 2, 1, itemlen - 2, infile); // Read the whole section.
+    got = ReaderRead(reader, Data + 2, itemlen - 2); // Read the whole section.
     if (got != itemlen-2) {
       fprintf(stderr, "Premature end of file?\n");
       return NO;
@@ -251,24 +321,33 @@ void DiscardData(void)
 //--------------------------------------------------------------------------
 BOOL ReadJpegFile(const char * FileName, NSMutableDictionary *imageInfo)
 {
-  FILE *infile;
+  JpegReader_t *reader;
   BOOL ret;
 
-  infile = fopen(FileName, "rb"); // Unix ignores 'b', windows needs it.
+  reader = (JpegReader_t *)calloc(1, sizeof(JpegReader_t));
+
+  if (reader == NULL) {
+    fprintf(stderr, "Could not allocate memory\n");
+    return NO;
+  }
+
+  reader->fd = open(FileName, O_RDONLY);
 
-  if (infile == NULL) {
+  if (reader->fd < 0) {
     fprintf(stderr, "can't open '%s'\n", FileName);
+    free(reader);
     return NO;
   }
 
   // Scan the JPEG headers.
-  ret = ReadJpegSections(infile, imageInfo);
+  ret = ReadJpegSections(reader, imageInfo);
   
   if (ret == NO) {
     fprintf(stderr, "Not JPEG: '%s'\n", FileName);
   }
 
-  fclose(infile);
+  close(reader->fd);
+  free(reader);
 
   if (ret == NO) {
     DiscardData();
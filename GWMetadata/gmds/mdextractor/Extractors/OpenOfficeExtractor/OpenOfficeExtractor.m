@@ -137,6 +137,7 @@ static char *style = "<xsl:stylesheet "
     NSString *contents;
 
     if (doc == nil) {
+      [fm removeFileAtPath: [unzpaths objectForKey: @"dir"] handler: nil];
       RELEASE (arp);
       return NO;
     }
@@ -228,6 +229,8 @@ static char *style = "<xsl:stylesheet "
     }    
   }      
             
+  [fm removeFileAtPath: [unzpaths objectForKey: @"dir"] handler: nil];
+
   success = [extractor setMetadata: mddict forPath: path withID: path_id];  
   
   RELEASE (arp);
@@ -240,10 +243,16 @@ static char *style = "<xsl:stylesheet "
   NSMutableDictionary *paths = nil;
   NSTask *task = nil;
   NSFileHandle *nullHandle;
+  /* one directory per document, as documents are extracted in parallel */
+  NSString *unzdir = [tempdir stringByAppendingPathComponent:
+                        [[NSProcessInfo processInfo] globallyUniqueString]];
 
-  [fm removeFileAtPath: tempdir handler: nil]; 
- 
-  if ([fm createDirectoryAtPath: tempdir attributes: nil] == NO) {
+  if ([fm fileExistsAtPath: tempdir] == NO
+        && [fm createDirectoryAtPath: tempdir attributes: nil] == NO
+        && [fm fileExistsAtPath: tempdir] == NO) {
+    return nil;
+  }
+  if ([fm createDirectoryAtPath: unzdir attributes: nil] == NO) {
     return nil;
   }
   
@@ -251,7 +260,7 @@ static char *style = "<xsl:stylesheet "
     {
       task = [NSTask new];
       
-      [task setCurrentDirectoryPath: tempdir];
+      [task setCurrentDirectoryPath: unzdir];
       [task setLaunchPath: unzcomm]; 
       [task setArguments: [NSArray arrayWithObject: path]];
       nullHandle = [NSFileHandle fileHandleWithNullDevice];
@@ -270,8 +279,8 @@ static char *style = "<xsl:stylesheet "
     [task waitUntilExit];
     
     if ([task terminationStatus] == 0) { 
-      NSString *contspath = [tempdir stringByAppendingPathComponent: @"content.xml"];
-      NSString *metapath = [tempdir stringByAppendingPathComponent: @"meta.xml"];
+      NSString *contspath = [unzdir stringByAppendingPathComponent: @"content.xml"];
+      NSString *metapath = [unzdir stringByAppendingPathComponent: @"meta.xml"];
         
       paths = [NSMutableDictionary dictionary];  
       
@@ -287,8 +296,11 @@ static char *style = "<xsl:stylesheet "
   } 
   
   if (paths && [paths count]) {
+    [paths setObject: unzdir forKey: @"dir"];
     return paths;
   }
+
+  [fm removeFileAtPath: unzdir handler: nil];
   
   return nil;
 }
@@ -33,6 +33,8 @@
             forPath:(NSString *)path
              withID:(int)path_id;
 
+- (BOOL)extractionExpired;
+
 @end
 
 @protocol	ExtractorsProtocol
@@ -52,12 +54,19 @@
 
 @end
 
+@protocol	GMDSExtractorCosts
+
+- (NSDictionary *)costProfile;
+
+@end
+
 
-@interface PdfExtractor: NSObject <ExtractorsProtocol>
+@interface PdfExtractor: NSObject <ExtractorsProtocol, GMDSExtractorCosts>
 {
   id extractor;
   NSArray *extensions;
   NSMutableCharacterSet *skipSet;
+  NSLock *pdfLock;
 }
 
 @end
@@ -29,6 +29,8 @@
 #define MAXFSIZE 600000
 #define DLENGTH 256
 #define WORD_MAX 40
+/* words scanned between looks at the clock */
+#define WORD_CHECK 1024
 
 @implementation PdfExtractor
 
@@ -36,6 +38,7 @@
 {
   RELEASE (extensions);
   RELEASE (skipSet);
+  RELEASE (pdfLock);
 
 	[super dealloc];
 }
@@ -71,6 +74,9 @@
     [skipSet formUnionWithCharacterSet: set];  
   
     ASSIGN (extensions, ([NSArray arrayWithObject: @"pdf"]));  
+
+    /* xpdf shares its global parameters between documents */
+    pdfLock = [NSLock new];
     extractor = extr;
   }
 
@@ -82,6 +88,14 @@
   return extensions;
 }
 
+- (NSDictionary *)costProfile
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                 [NSNumber numberWithUnsignedLong: MAXFSIZE], @"max_bytes",
+                 [NSNumber numberWithDouble: 20.0], @"max_time",
+                 [NSNumber numberWithUnsignedLong: 100000], @"max_words", nil];
+}
+
 - (BOOL)canExtractFromFileType:(NSString *)type
                  withExtension:(NSString *)ext
                     attributes:(NSDictionary *)attributes
@@ -100,12 +114,22 @@
 {
   CREATE_AUTORELEASE_POOL(arp);
   NSMutableDictionary *mddict = [NSMutableDictionary dictionary];  
-  PDFDocument *doc = [PDFDocument documentFromFile: path];  
+  PDFDocument *doc;
+  NSString *contents = nil;
+  NSDictionary *info = nil;
   BOOL success = NO;
-  
+
+  [pdfLock lock];
+  doc = [PDFDocument documentFromFile: path];
   if (doc && [doc isOk] && ([doc errorCode] == 0)) {
-    NSString *contents = [doc getAllText];
-    NSDictionary *info = [doc getDocumentInfo];
+    contents = [doc getAllText];
+    info = [doc getDocumentInfo];
+  } else {
+    doc = nil;
+  }
+  [pdfLock unlock];
+  
+  if (doc) {
 
     if (contents && [contents length]) {
       NSScanner *scanner = [NSScanner scannerWithString: contents];
@@ -129,6 +153,11 @@
           }
 
           wcount++;
+
+          /* the words get dropped anyway */
+          if ((wcount % WORD_CHECK) == 0 && [extractor extractionExpired]) {
+            break;
+          }
         }
       }
 
@@ -33,6 +33,8 @@
             forPath:(NSString *)path
              withID:(int)path_id;
 
+- (BOOL)extractionExpired;
+
 @end
 
 @protocol	ExtractorsProtocol
@@ -52,8 +54,14 @@
 
 @end
 
+@protocol	GMDSExtractorCosts
+
+- (NSDictionary *)costProfile;
+
+@end
+
 
-@interface TextExtractor: NSObject <ExtractorsProtocol>
+@interface TextExtractor: NSObject <ExtractorsProtocol, GMDSExtractorCosts>
 {
   id extractor;
   NSArray *extensions;
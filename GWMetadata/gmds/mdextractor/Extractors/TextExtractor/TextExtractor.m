@@ -24,10 +24,12 @@
 
 #include <AppKit/AppKit.h>
 #include "TextExtractor.h"
+#include "tokenizer.h"
 
 #define MAXFSIZE 600000
 #define DLENGTH 256
-#define WORD_MAX 40
+/* bytes scanned between looks at the clock */
+#define SCAN_CHUNK 65536
 
 @implementation TextExtractor
 
@@ -81,6 +83,14 @@
   return extensions;
 }
 
+- (NSDictionary *)costProfile
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                 [NSNumber numberWithUnsignedLong: MAXFSIZE], @"max_bytes",
+                 [NSNumber numberWithDouble: 10.0], @"max_time",
+                 [NSNumber numberWithUnsignedLong: 100000], @"max_words", nil];
+}
+
 - (BOOL)canExtractFromFileType:(NSString *)type
                  withExtension:(NSString *)ext
                     attributes:(NSDictionary *)attributes
@@ -108,44 +118,43 @@
                    attributes:(NSDictionary *)attributes
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSString *contents = [NSString stringWithContentsOfFile: path];
+  size_t length = 0;
+  const char *bytes = GMDSMapFile(path, &length);
   BOOL success = YES;
   
-  if (contents && [contents length]) {
-    NSScanner *scanner = [NSScanner scannerWithString: contents];
-    SEL scanSel = @selector(scanUpToCharactersFromSet:intoString:);
-    IMP scanImp = [scanner methodForSelector: scanSel];
+  if (bytes) {
     NSMutableDictionary *mddict = [NSMutableDictionary dictionary];
-    NSMutableDictionary *wordsDict = [NSMutableDictionary dictionary];
-    NSCountedSet *wordset = [[NSCountedSet alloc] initWithCapacity: 1];
-    unsigned long wcount = 0;
-    NSString *word;
-    
-    [scanner setCharactersToBeSkipped: skipSet];
-        
-    while ([scanner isAtEnd] == NO) {        
-      (*scanImp)(scanner, scanSel, skipSet, &word);
+    GMDSTokenizer tk;
+
+    GMDSTokenizerInit(&tk, skipSet);
 
-      if (word) {
-        unsigned wl = [word length];
+    if (length >= 2 && ((bytes[0] == '\xFF' && bytes[1] == '\xFE')
+                          || (bytes[0] == '\xFE' && bytes[1] == '\xFF'))) {
+      /* UTF-16, which NSString reads from its byte order mark */
+      GMDSTokenizerFeedString(&tk, [NSString stringWithContentsOfFile: path]);
 
-        if ((wl > 3) && (wl < WORD_MAX)) { 
-          [wordset addObject: word];
-        }
+    } else {
+      size_t offset = 0;
 
-        wcount++;
+      if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) {
+        offset = 3;
+      }
+
+      /* the words get dropped anyway once the time is over */
+      while (offset < length && [extractor extractionExpired] == NO) {
+        size_t chunk = MIN(length - offset, SCAN_CHUNK);
+
+        offset += GMDSTokenizerFeed(&tk, bytes + offset, chunk,
+                                    (offset + chunk == length));
       }
     }
-    
-    [wordsDict setObject: wordset forKey: @"wset"];
-    [wordsDict setObject: [NSNumber numberWithUnsignedLong: wcount] 
-                  forKey: @"wcount"];
 
-    [mddict setObject: wordsDict forKey: @"words"];
+    GMDSUnmapFile(bytes, length);
+
+    [mddict setObject: GMDSTokenizerWords(&tk) forKey: @"words"];
+    GMDSTokenizerDestroy(&tk);
     
     success = [extractor setMetadata: mddict forPath: path withID: path_id];
-    
-    RELEASE (wordset);   
   }
 
   RELEASE (arp);
@@ -24,9 +24,9 @@
 
 #include <AppKit/AppKit.h>
 #include "XmlExtractor.h"
+#include "tokenizer.h"
 
 #define MAXFSIZE 600000
-#define WORD_MAX 40
 
 static char *style = "<xsl:stylesheet "
                       "xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\" "
@@ -110,42 +110,22 @@ static char *style = "<xsl:stylesheet "
     contents = [doc description];
 
     if (contents && [contents length]) {
-      NSScanner *scanner = [NSScanner scannerWithString: contents];
-      SEL scanSel = @selector(scanUpToCharactersFromSet:intoString:);
-      IMP scanImp = [scanner methodForSelector: scanSel];
-      NSMutableDictionary *wordsDict = [NSMutableDictionary dictionary];
-      NSCountedSet *wordset = [[NSCountedSet alloc] initWithCapacity: 1];
-      unsigned long wcount = 0;
-      NSString *word;
-
-      if ([scanner scanString: @"<?xml" intoString: NULL]) {
-        if ([scanner scanUpToString: @"?>" intoString: NULL]) {
-          [scanner scanString: @"?>" intoString: NULL];
-        }
-      }
-
-      [scanner setCharactersToBeSkipped: skipSet];
-
-      while ([scanner isAtEnd] == NO) {        
-        (*scanImp)(scanner, scanSel, skipSet, &word);
+      const char *text = [contents UTF8String];
+      const char *decl;
+      GMDSTokenizer tk;
 
-        if (word) {
-          unsigned wl = [word length];
+      text += strspn(text, " \t\r\n");
 
-          if ((wl > 3) && (wl < WORD_MAX)) { 
-            [wordset addObject: word];
-          }
-
-          wcount++;
-        }
+      if (strncmp(text, "<?xml", 5) == 0 && (decl = strstr(text, "?>"))) {
+        text = decl + 2;
       }
 
-      [wordsDict setObject: wordset forKey: @"wset"];
-      RELEASE (wordset);
-      [wordsDict setObject: [NSNumber numberWithUnsignedLong: wcount] 
-                    forKey: @"wcount"];
+      GMDSTokenizerInit(&tk, skipSet);
+      GMDSTokenizerFeed(&tk, text, strlen(text), YES);
+
+      [mddict setObject: GMDSTokenizerWords(&tk) forKey: @"words"];
 
-      [mddict setObject: wordsDict forKey: @"words"];
+      GMDSTokenizerDestroy(&tk);
     }
   }
             
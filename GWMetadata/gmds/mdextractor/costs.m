@@ -0,0 +1,289 @@
+/* costs.m
+ *
+ * The limits an extractor bundle runs under, and the per-extractor
+ * timings that show which formats are slow to index.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#import <Foundation/Foundation.h>
+
+#import "mdextractor.h"
+
+#define GWDebugLog(format, args...) \
+  do { if (GW_DEBUG_LOG) \
+    NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* What an extractor gets when its profile does not say. */
+#define DEFAULT_MAX_BYTES 16777216
+#define DEFAULT_MAX_TIME 30.0
+#define DEFAULT_MAX_WORDS 200000
+
+/* The key under which a thread keeps the extractor run it is in. */
+#define RUN_KEY @"GMDSExtractorRun"
+
+
+@interface GMDSExtractor (costs_private)
+
+- (NSMutableDictionary *)statsForExtractorNamed:(NSString *)name;
+
+- (void)extractorNamed:(NSString *)name
+         exceededLimit:(NSString *)limit
+                atPath:(NSString *)path;
+
+@end
+
+
+@implementation GMDSExtractor (costs)
+
+/*
+ * Called by -loadExtractors for each extractor: its own profile, if it
+ * has one, then whatever the GSMetadataExtractorLimits default sets
+ * for its class.
+ */
+- (void)registerCostProfileOfExtractor:(id)extractor
+{
+  NSString *name = NSStringFromClass([extractor class]);
+  NSDictionary *overrides = [[NSUserDefaults standardUserDefaults]
+                                  dictionaryForKey: @"GSMetadataExtractorLimits"];
+  NSMutableDictionary *limits = [NSMutableDictionary dictionary];
+
+  [limits setObject: [NSNumber numberWithUnsignedLongLong: DEFAULT_MAX_BYTES]
+             forKey: @"max_bytes"];
+  [limits setObject: [NSNumber numberWithDouble: DEFAULT_MAX_TIME]
+             forKey: @"max_time"];
+  [limits setObject: [NSNumber numberWithUnsignedLong: DEFAULT_MAX_WORDS]
+             forKey: @"max_words"];
+
+  if ([extractor respondsToSelector: @selector(costProfile)]) {
+    [limits addEntriesFromDictionary: [extractor costProfile]];
+  }
+  if ([[overrides objectForKey: name] isKindOfClass: [NSDictionary class]]) {
+    [limits addEntriesFromDictionary: [overrides objectForKey: name]];
+  }
+
+  if (extractorLimits == nil) {
+    extractorLimits = [NSMutableDictionary new];
+    extractorStats = [NSMutableDictionary new];
+    costLock = [NSLock new];
+  }
+
+  [extractorLimits setObject: limits forKey: name];
+
+  GWDebugLog(@"%@ limits: %@", name, limits);
+}
+
+/*
+ * Every extractor runs through here, on whatever thread.  A file
+ * bigger than the extractor takes is not given to it: the path keeps
+ * the attributes insertOrUpdatePath: sets and no content.
+ */
+- (BOOL)runExtractor:(id)extractor
+              atPath:(NSString *)path
+              withID:(int)path_id
+          attributes:(NSDictionary *)attributes
+{
+  NSString *name = NSStringFromClass([extractor class]);
+  NSDictionary *limits = [extractorLimits objectForKey: name];
+  NSMutableDictionary *tdict = [[NSThread currentThread] threadDictionary];
+  NSTimeInterval start;
+  NSTimeInterval elapsed;
+  BOOL success = NO;
+
+  if ([attributes fileSize] > [[limits objectForKey: @"max_bytes"] unsignedLongLongValue]) {
+    [self extractorNamed: name exceededLimit: @"max_bytes" atPath: path];
+    return YES;
+  }
+
+  start = [NSDate timeIntervalSinceReferenceDate];
+
+  [tdict setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                                    name, @"name",
+                                    [NSNumber numberWithDouble: start], @"start",
+                                    nil]
+            forKey: RUN_KEY];
+
+  NS_DURING
+    {
+      success = [extractor extractMetadataAtPath: path
+                                          withID: path_id
+                                      attributes: attributes];
+    }
+  NS_HANDLER
+    {
+      [tdict removeObjectForKey: RUN_KEY];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+
+  [tdict removeObjectForKey: RUN_KEY];
+
+  elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+  [costLock lock];
+  {
+    NSMutableDictionary *stats = [self statsForExtractorNamed: name];
+    unsigned long count = [[stats objectForKey: @"count"] unsignedLongValue];
+    double total = [[stats objectForKey: @"time"] doubleValue];
+
+    [stats setObject: [NSNumber numberWithUnsignedLong: count + 1] forKey: @"count"];
+    [stats setObject: [NSNumber numberWithDouble: total + elapsed] forKey: @"time"];
+    [stats setObject: [NSNumber numberWithDouble: (total + elapsed) / (count + 1)]
+              forKey: @"mean_time"];
+
+    if (elapsed > [[stats objectForKey: @"max_time"] doubleValue]) {
+      [stats setObject: [NSNumber numberWithDouble: elapsed] forKey: @"max_time"];
+      [stats setObject: path forKey: @"slowest"];
+    }
+    costsChanged = YES;
+  }
+  [costLock unlock];
+
+  return success;
+}
+
+/*
+ * Whether the extractor running on this thread is past its time, for
+ * the extractors to check in their long loops; they give up the
+ * content and set what they have.
+ */
+- (BOOL)extractionExpired
+{
+  NSDictionary *run = [[[NSThread currentThread] threadDictionary] objectForKey: RUN_KEY];
+  NSDictionary *limits;
+
+  if (run == nil) {
+    return NO;
+  }
+
+  limits = [extractorLimits objectForKey: [run objectForKey: @"name"]];
+
+  return (([NSDate timeIntervalSinceReferenceDate] - [[run objectForKey: @"start"] doubleValue])
+                        > [[limits objectForKey: @"max_time"] doubleValue]);
+}
+
+/*
+ * Called by -setMetadata:forPath:withID:.  The words of an extractor
+ * that ran out of time, or found more words than it may emit, are
+ * dropped; the attributes are kept.
+ */
+- (NSDictionary *)metadataWithinLimits:(NSDictionary *)mddict
+                               forPath:(NSString *)path
+{
+  NSDictionary *run = [[[NSThread currentThread] threadDictionary] objectForKey: RUN_KEY];
+  NSDictionary *wordsdict = [mddict objectForKey: @"words"];
+  NSString *name;
+  NSDictionary *limits;
+  NSString *exceeded = nil;
+
+  if (run == nil || wordsdict == nil) {
+    return mddict;
+  }
+
+  name = [run objectForKey: @"name"];
+  limits = [extractorLimits objectForKey: name];
+
+  if ([self extractionExpired]) {
+    exceeded = @"max_time";
+  } else if ([[wordsdict objectForKey: @"wcount"] unsignedLongValue]
+                      > [[limits objectForKey: @"max_words"] unsignedLongValue]) {
+    exceeded = @"max_words";
+  }
+
+  if (exceeded) {
+    NSMutableDictionary *dict = [NSMutableDictionary dictionaryWithDictionary: mddict];
+
+    [dict removeObjectForKey: @"words"];
+    [self extractorNamed: name exceededLimit: exceeded atPath: path];
+
+    return dict;
+  }
+
+  return mddict;
+}
+
+/*
+ * The timings so far, next to status.plist, one entry per extractor:
+ * the files it ran on, the total, mean and longest time, the slowest
+ * path and how often each limit was hit.
+ */
+- (void)writeCostsReport
+{
+  NSDictionary *report = nil;
+
+  if (costLock == nil) {
+    return;
+  }
+
+  [costLock lock];
+  if (costsChanged) {
+    NSMutableDictionary *copy = [NSMutableDictionary dictionary];
+    NSEnumerator *e = [extractorStats keyEnumerator];
+    NSString *name;
+
+    /* the workers go on changing the stats */
+    while ((name = [e nextObject])) {
+      [copy setObject: [NSDictionary dictionaryWithDictionary: 
+                                       [extractorStats objectForKey: name]]
+               forKey: name];
+    }
+    report = copy;
+    costsChanged = NO;
+  }
+  [costLock unlock];
+
+  if (report) {
+    NSString *path = [[indexedStatusPath stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: @"extractors.plist"];
+
+    [report writeToFile: path atomically: YES];
+  }
+}
+
+@end
+
+
+@implementation GMDSExtractor (costs_private)
+
+/* Under costLock. */
+- (NSMutableDictionary *)statsForExtractorNamed:(NSString *)name
+{
+  NSMutableDictionary *stats = [extractorStats objectForKey: name];
+
+  if (stats == nil) {
+    stats = [NSMutableDictionary dictionary];
+    [extractorStats setObject: stats forKey: name];
+  }
+
+  return stats;
+}
+
+- (void)extractorNamed:(NSString *)name
+         exceededLimit:(NSString *)limit
+                atPath:(NSString *)path
+{
+  NSString *key = [limit stringByAppendingString: @"_exceeded"];
+
+  [costLock lock];
+  {
+    NSMutableDictionary *stats = [self statsForExtractorNamed: name];
+
+    [stats setObject: [NSNumber numberWithUnsignedLong:
+                                  [[stats objectForKey: key] unsignedLongValue] + 1]
+              forKey: key];
+    costsChanged = YES;
+  }
+  [costLock unlock];
+
+  GWDebugLog(@"%@: %@ exceeded, no contents for %@", name, limit, path);
+
+  /* the error log is written by the main thread only */
+  [self performSelectorOnMainThread: @selector(logError:)
+                         withObject: [NSString stringWithFormat: @"LIMIT %@ %@ %@",
+                                                                name, limit, path]
+                      waitUntilDone: NO];
+}
+
+@end
@@ -0,0 +1,259 @@
+/* maintenance.m
+ *
+ * Keeps the db compact while the system is idle: gives back the pages
+ * freed by removed paths, drops the rows no path refers to any more,
+ * refreshes the statistics of the query planner, and tells what uses
+ * the space in maintenance.plist, next to status.plist.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#import <Foundation/Foundation.h>
+
+#import "mdextractor.h"
+
+#define GWDebugLog(format, args...) \
+  do { if (GW_DEBUG_LOG) \
+    NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* the pruning, ANALYZE and the report run at most this often */
+#define MAINTENANCE_TIME (21600.0)
+/* pages given back by each idle notification */
+#define VACUUM_PAGES 2048
+/* a db made without incremental vacuum is rebuilt past this share
+   of free pages */
+#define FRAGMENTATION_LIMIT (0.25)
+/* FTS5 segment pages merged by each maintenance */
+#define FTS_MERGE_PAGES 500
+
+#define AUTO_VACUUM_INCREMENTAL 2
+
+
+static long long int64_of_query(sqlite3 *db, const char *query)
+{
+  struct sqlite3_stmt *stmt;
+  long long value = -1;
+
+  if (sqlite3_prepare_v2(db, query, strlen(query), &stmt, NULL) == SQLITE_OK) {
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+      value = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  return value;
+}
+
+/* rows deleted by query, or -1 if it failed */
+static long long deleted_rows(sqlite3 *db, const char *query)
+{
+  if (sqlite3_exec(db, query, NULL, 0, NULL) != SQLITE_OK) {
+    NSDebugLLog(@"gwspace", @"%s: %s", query, sqlite3_errmsg(db));
+    return -1;
+  }
+
+  return sqlite3_changes(db);
+}
+
+
+@implementation GMDSExtractor (maintenance)
+
+/*
+ * Called after each update notification, when nothing is being
+ * extracted and the transactions are committed.
+ */
+- (void)maintainDbIfIdle
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSDictionary *pruned;
+
+  if (extracting || ([self systemIsIdle] == NO)) {
+    return;
+  }
+
+  [self vacuumFreePages];
+
+  /* the last maintenance of a previous run */
+  if (maintenanceTime == 0.0) {
+    NSString *path = [[indexedStatusPath stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: @"maintenance.plist"];
+    NSDictionary *report = [NSDictionary dictionaryWithContentsOfFile: path];
+    NSDate *date = [report objectForKey: @"maintenance_date"];
+
+    maintenanceTime = (date ? [date timeIntervalSinceReferenceDate] : 1.0);
+  }
+
+  if ((now - maintenanceTime) < MAINTENANCE_TIME) {
+    return;
+  }
+
+  maintenanceTime = now;
+
+  GWDebugLog(@"db maintenance");
+
+  pruned = [self pruneOrphanedRows];
+
+  [sqlite executeSimpleQuery: @"PRAGMA analysis_limit = 1000"];
+  [sqlite executeSimpleQuery: @"ANALYZE"];
+
+  [self writeMaintenanceReport: pruned];
+
+  GWDebugLog(@"db maintenance done in %.2f s",
+                  [NSDate timeIntervalSinceReferenceDate] - now);
+}
+
+/*
+ * Gives back a step of the free pages.  A db created before the
+ * incremental vacuum was turned on can only get it from a full
+ * VACUUM: it costs a copy of the db, and is done once the free pages
+ * are worth it.
+ */
+- (void)vacuumFreePages
+{
+  sqlite3 *db = [sqlite db];
+  long long freepages = int64_of_query(db, "PRAGMA freelist_count");
+  long long pages = int64_of_query(db, "PRAGMA page_count");
+
+  if (freepages <= 0) {
+    return;
+  }
+
+  if (int64_of_query(db, "PRAGMA auto_vacuum") == AUTO_VACUUM_INCREMENTAL) {
+    [sqlite executeSimpleQuery: [NSString stringWithFormat:
+                                    @"PRAGMA incremental_vacuum(%i)", VACUUM_PAGES]];
+    GWDebugLog(@"incremental vacuum: %lld free pages", MAX(0, freepages - VACUUM_PAGES));
+
+  } else if (freepages >= (pages * FRAGMENTATION_LIMIT)) {
+    NSDebugLLog(@"gwspace", @"rebuilding %@: %lld of %lld pages free",
+                                              dbpath, freepages, pages);
+
+    [sqlite executeSimpleQuery: @"PRAGMA auto_vacuum = INCREMENTAL"];
+
+    if ([sqlite executeSimpleQuery: @"VACUUM"] == NO) {
+      NSDebugLLog(@"gwspace", @"unable to vacuum %@", dbpath);
+    }
+  }
+}
+
+/*
+ * The attributes and the indexed words and names of the paths no
+ * longer in paths: left behind by an update cut short.
+ */
+- (NSDictionary *)pruneOrphanedRows
+{
+  NSMutableDictionary *pruned = [NSMutableDictionary dictionary];
+  sqlite3 *db = [sqlite db];
+  long long count;
+
+  if ([sqlite executeQuery: @"BEGIN"] == NO) {
+    return pruned;
+  }
+
+  count = deleted_rows(db, "DELETE FROM attributes "
+                           "WHERE path_id NOT IN (SELECT id FROM paths)");
+  [pruned setObject: [NSNumber numberWithLongLong: count] forKey: @"attributes"];
+
+  count = deleted_rows(db, "DELETE FROM contents "
+                           "WHERE rowid NOT IN (SELECT id FROM paths)");
+  [pruned setObject: [NSNumber numberWithLongLong: count] forKey: @"contents"];
+
+  count = deleted_rows(db, "DELETE FROM names "
+                           "WHERE rowid NOT IN (SELECT id FROM paths)");
+  [pruned setObject: [NSNumber numberWithLongLong: count] forKey: @"names"];
+
+  [sqlite executeQuery: @"COMMIT"];
+
+  /* the deleted words still take the space of their segments until
+     these are merged */
+  [sqlite executeSimpleQuery: [NSString stringWithFormat:
+        @"INSERT INTO contents (contents, rank) VALUES ('merge', %i)", FTS_MERGE_PAGES]];
+  [sqlite executeSimpleQuery: [NSString stringWithFormat:
+        @"INSERT INTO names (names, rank) VALUES ('merge', %i)", FTS_MERGE_PAGES]];
+
+  GWDebugLog(@"pruned %@", pruned);
+
+  return pruned;
+}
+
+/*
+ * The size of the db and of its WAL, the free pages, and the rows and
+ * bytes of each table; the bytes only with an SQLite built with the
+ * dbstat table.
+ */
+- (void)writeMaintenanceReport:(NSDictionary *)pruned
+{
+  static const char *counted[] = {
+    "paths", "attributes", "updated_paths", "removed_paths", "contents", "names", NULL
+  };
+  NSMutableDictionary *report = [NSMutableDictionary dictionary];
+  NSMutableDictionary *tables = [NSMutableDictionary dictionary];
+  NSString *path = [[indexedStatusPath stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: @"maintenance.plist"];
+  NSString *walpath = [dbpath stringByAppendingString: @"-wal"];
+  NSDictionary *attributes = [fm fileAttributesAtPath: walpath traverseLink: NO];
+  sqlite3 *db = [sqlite db];
+  long long pagesize = int64_of_query(db, "PRAGMA page_size");
+  long long pages = int64_of_query(db, "PRAGMA page_count");
+  long long freepages = int64_of_query(db, "PRAGMA freelist_count");
+  long long vacuum = int64_of_query(db, "PRAGMA auto_vacuum");
+  const char *query = "SELECT name, SUM(pgsize), SUM(unused) FROM dbstat GROUP BY name";
+  struct sqlite3_stmt *stmt;
+  int i;
+
+  for (i = 0; counted[i] != NULL; i++) {
+    NSString *name = [NSString stringWithUTF8String: counted[i]];
+    NSString *count = [NSString stringWithFormat: @"SELECT COUNT(*) FROM %@", name];
+    NSMutableDictionary *info = [NSMutableDictionary dictionary];
+
+    [info setObject: [NSNumber numberWithLongLong: int64_of_query(db, [count UTF8String])]
+             forKey: @"rows"];
+    [tables setObject: info forKey: name];
+  }
+
+  if (sqlite3_prepare_v2(db, query, strlen(query), &stmt, NULL) == SQLITE_OK) {
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+      NSString *name = [NSString stringWithUTF8String:
+                                  (const char *)sqlite3_column_text(stmt, 0)];
+      NSMutableDictionary *info = [tables objectForKey: name];
+
+      if (info == nil) {
+        info = [NSMutableDictionary dictionary];
+        [tables setObject: info forKey: name];
+      }
+
+      [info setObject: [NSNumber numberWithLongLong: sqlite3_column_int64(stmt, 1)]
+               forKey: @"size"];
+      [info setObject: [NSNumber numberWithLongLong: sqlite3_column_int64(stmt, 2)]
+               forKey: @"unused"];
+    }
+    sqlite3_finalize(stmt);
+  } else {
+    GWDebugLog(@"no dbstat: %s", sqlite3_errmsg(db));
+  }
+
+  [report setObject: [NSNumber numberWithLongLong: pagesize * pages] forKey: @"db_size"];
+  [report setObject: [NSNumber numberWithUnsignedLongLong:
+                                              (attributes ? [attributes fileSize] : 0)]
+             forKey: @"wal_size"];
+  [report setObject: [NSNumber numberWithLongLong: pagesize] forKey: @"page_size"];
+  [report setObject: [NSNumber numberWithLongLong: pages] forKey: @"page_count"];
+  [report setObject: [NSNumber numberWithLongLong: freepages] forKey: @"free_pages"];
+  [report setObject: [NSNumber numberWithDouble:
+                          (pages > 0) ? (100.0 * freepages / pages) : 0.0]
+             forKey: @"fragmentation"];
+  [report setObject: ((vacuum == AUTO_VACUUM_INCREMENTAL) ? @"incremental"
+                              : ((vacuum == 1) ? @"full" : @"none"))
+             forKey: @"auto_vacuum"];
+  [report setObject: tables forKey: @"tables"];
+  [report setObject: pruned forKey: @"pruned"];
+  [report setObject: [NSDate dateWithTimeIntervalSinceReferenceDate: maintenanceTime]
+             forKey: @"maintenance_date"];
+
+  [report writeToFile: path atomically: YES];
+}
+
+@end
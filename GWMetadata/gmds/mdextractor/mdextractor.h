@@ -25,13 +25,30 @@
 #ifndef MDEXTRACTOR_H
 #define MDEXTRACTOR_H
 
+#include <stdint.h>
+
 #include <Foundation/Foundation.h>
 #include "MDKQuery.h"
 #include "SQLite.h"
-#include "DBKPathsTree.h"
+#include "DBKRadixPathsTree.h"
 
 @class GMDSIndexablePath;
 
+/* What tells an indexed file is still the one we saw: the paths table
+   keeps dev and inode as "fileid", size and mtime as "stamp", and
+   ctime, each packed as a blob. */
+typedef struct {
+  uint64_t dev;
+  uint64_t ino;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  int64_t ctime_sec;
+  int64_t ctime_nsec;
+  uint32_t mode;
+  BOOL isdir;
+} GMDSFileStat;
+
 @protocol	FSWClientProtocol
 
 - (oneway void)watchedPathDidChange:(NSData *)info;
@@ -54,6 +71,9 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                           removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setFilter:(bycopy NSDictionary *)filter;
+
 @end
 
 
@@ -64,6 +84,9 @@
 @end
 
 
+/* Extractors run on the extraction worker threads, several files at
+   once, so -extractMetadataAtPath:withID:attributes: must not keep
+   per-file state in the instance. */
 @protocol	ExtractorsProtocol
 
 - (id)initForExtractor:(id)extr;
@@ -82,11 +105,20 @@
 @end
 
 
+/* What an extractor may cost, if it says: "max_bytes" of the files it
+   is given, "max_time" in seconds and "max_words" emitted per file. */
+@protocol	GMDSExtractorCosts
+
+- (NSDictionary *)costProfile;
+
+@end
+
+
 @interface GMDSExtractor: NSObject 
 {
   NSMutableArray *indexablePaths;
-  pcomp *includePathsTree;  
-  pcomp *excludedPathsTree;  
+  radixtree *includePathsTree;  
+  radixtree *excludedPathsTree;  
   NSMutableSet *excludedSuffixes;  
   BOOL indexingEnabled;
   BOOL extracting;
@@ -94,6 +126,14 @@
   NSString *dbdir;
   NSString *dbpath;
   SQLite *sqlite;
+
+  BOOL inUpdateGroup;
+  unsigned updateDepth;
+  unsigned groupedUpdates;
+  NSTimeInterval groupStart;
+  NSTimer *groupTimer;
+  NSCondition *checkpointLock;
+  BOOL checkpointDue;
   
 	NSMutableDictionary *extractors;
   id textExtractor;
@@ -110,12 +150,62 @@
   NSNotificationCenter *nc; 
   NSNotificationCenter *dnc;  
 
+  //
+  // pipeline
+  //
+  NSCondition *pipeLock;
+  NSMutableArray *walkedItems;
+  NSMutableArray *typedItems;
+  NSMutableArray *extractedItems;
+  NSSet *walkSuffixes;
+  radixtree *walkExcludedTree;
+  NSString *walkResumePath;
+  NSUInteger pipeRunning;
+  NSUInteger pipeActive;
+  BOOL walking;
+  BOOL feeding;
+  BOOL pipeCancelled;
+
+  //
+  // costs
+  //
+  NSMutableDictionary *extractorLimits;
+  NSMutableDictionary *extractorStats;
+  NSLock *costLock;
+  BOOL costsChanged;
+
+  //
+  // metrics
+  //
+  NSMutableDictionary *pathMetrics;
+  NSString *metricsPath;
+  NSTimeInterval metricsStart;
+  NSTimeInterval metricsSampleTime;
+  NSTimeInterval metricsProgressTime;
+  unsigned long metricsExpected;
+  unsigned long metricsFiles;
+  unsigned long long metricsBytes;
+  unsigned long metricsSampleFiles;
+  unsigned long long metricsSampleBytes;
+  unsigned long metricsUnchanged;
+  unsigned long metricsFailed;
+  unsigned long metricsTimeouts;
+  unsigned long metricsTooBig;
+  unsigned long metricsWalked;    /* under pipeLock, by the walker */
+  unsigned long metricsSkipped;
+  double metricsDbTime;
+  double metricsFileRate;
+  double metricsByteRate;
+
   //
   // fswatcher_update  
   //
   id fswatcher;
   NSMutableArray *fswupdatePaths;
+  NSMutableDictionary *fswupdateChanges;
   NSMutableDictionary *fswupdateSkipBuff;
+  NSMutableDictionary *priorityPaths;
+  BOOL fswupdateFlushing;
   NSMutableArray *lostPaths;
   NSTimer *fswupdateTimer;
   NSTimer *lostPathsTimer;
@@ -131,6 +221,17 @@
   NSMutableArray *directories;
   int dirpos;
   NSTimer *schedupdateTimer;
+  NSTimeInterval schedInterval;
+  NSTimeInterval schedSampleTime;
+  NSTimeInterval schedReportTime;
+  double schedIdleTime;
+  double schedPressure;
+  BOOL schedOnBattery;
+
+  //
+  // maintenance
+  //
+  NSTimeInterval maintenanceTime;
   
   //
   // update_notifications
@@ -172,18 +273,41 @@
                    ofType:(NSString *)type
            withAttributes:(NSDictionary *)attributes;
 
+- (int)insertOrUpdatePath:(NSString *)path
+                   ofType:(NSString *)type
+           withAttributes:(NSDictionary *)attributes
+                 fileStat:(const GMDSFileStat *)st;
+
+- (BOOL)skipsUnchangedPath:(NSString *)path
+                  fileStat:(const GMDSFileStat *)st;
+
 - (BOOL)setMetadata:(NSDictionary *)mddict
             forPath:(NSString *)path
              withID:(int)path_id;
 
+- (BOOL)beginUpdate;
+
+- (void)endUpdate:(BOOL)keep;
+
+- (void)commitUpdates:(id)sender;
+
 - (id)extractorForPath:(NSString *)path
                 ofType:(NSString *)type
         withAttributes:(NSDictionary *)attributes;
 
+- (NSString *)fileTypeOfPath:(NSString *)path
+                    fileStat:(const GMDSFileStat *)st;
+
 - (void)loadExtractors;
 
 - (BOOL)opendb;
 
+- (void)migratePreviousDb;
+
+- (void)walHasPages:(int)pages;
+
+- (void)checkpointLoop:(id)sender;
+
 - (void)logError:(NSString *)err;
 
 - (BOOL)connection:(NSConnection *)ancestor
@@ -210,8 +334,7 @@
 
 - (void)checkLostPaths:(id)sender;
 
-- (NSArray *)filteredDirectoryContentsAtPath:(NSString *)path
-                               escapeEntries:(BOOL)escape;
+- (NSArray *)filteredDirectoryContentsAtPath:(NSString *)path;
 
 @end
 
@@ -222,10 +345,22 @@
 
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)info;
 
+- (void)queueChange:(NSMutableDictionary *)change;
+
+- (void)markPriorityPath:(NSString *)path;
+
+- (BOOL)isPriorityPath:(NSString *)path;
+
+- (void)pathViewed:(NSNotification *)notif;
+
+- (NSArray *)orderedPendingChanges;
+
 - (void)processPendingChanges:(id)sender;
 
 - (void)connectFSWatcher:(id)sender;
 
+- (void)sendFSWatcherFilter;
+
 - (void)fswatcherConnectionDidDie:(NSNotification *)notif;
 
 @end
@@ -248,11 +383,90 @@
 
 - (void)setupScheduledUpdater;
 
+- (void)scheduleNextDirCheck;
+
 - (void)checkNextDir:(id)sender;
 
 @end
 
 
+@interface GMDSExtractor (throttle)
+
+- (NSTimeInterval)scheduledUpdateInterval;
+
+- (BOOL)systemIsIdle;
+
+@end
+
+
+@interface GMDSExtractor (maintenance)
+
+- (void)maintainDbIfIdle;
+
+- (void)vacuumFreePages;
+
+- (NSDictionary *)pruneOrphanedRows;
+
+- (void)writeMaintenanceReport:(NSDictionary *)pruned;
+
+@end
+
+
+@interface GMDSExtractor (pipeline)
+
+- (unsigned long)extractContentsOfPath:(GMDSIndexablePath *)indpath
+                            filesCount:(unsigned long)fcount;
+
+- (BOOL)capturesMetadata:(NSDictionary *)mddict;
+
+- (void)walkPath:(NSString *)path;
+
+- (BOOL)walkDirectory:(NSString *)dir
+           resumingAt:(NSArray *)components;
+
+- (void)extractionWorkerLoop:(id)sender;
+
+@end
+
+
+@interface GMDSExtractor (costs)
+
+- (void)registerCostProfileOfExtractor:(id)extractor;
+
+- (BOOL)runExtractor:(id)extractor
+              atPath:(NSString *)path
+              withID:(int)path_id
+          attributes:(NSDictionary *)attributes;
+
+- (BOOL)extractionExpired;
+
+- (NSDictionary *)metadataWithinLimits:(NSDictionary *)mddict
+                               forPath:(NSString *)path;
+
+- (void)writeCostsReport;
+
+@end
+
+
+@interface GMDSExtractor (metrics)
+
+- (void)metricsStartPath:(GMDSIndexablePath *)indpath
+           expectedFiles:(unsigned long)count;
+
+- (void)metricsCountFile:(unsigned long long)bytes
+                 changed:(BOOL)changed;
+
+- (void)metricsCountFailure;
+
+- (void)metricsAddDbTime:(NSTimeInterval)seconds;
+
+- (void)metricsEndPath:(GMDSIndexablePath *)indpath;
+
+- (void)writeMetricsReport;
+
+@end
+
+
 @interface GMDSExtractor (update_notifications)
 
 - (void)setupUpdateNotifications;
@@ -269,6 +483,7 @@
   BOOL indexed;
   NSDate *startTime;
   NSDate *endTime;
+  NSString *resumePath;
   NSMutableArray *subpaths;
   GMDSIndexablePath *ancestor;
 }
@@ -308,6 +523,12 @@
 
 - (void)setIndexed:(BOOL)value;
 
+/* The last entry, in the walker's order, whose metadata is committed
+   while the path is not indexed yet. */
+- (NSString *)resumePath;
+
+- (void)setResumePath:(NSString *)apath;
+
 - (void)checkIndexingDone;
 
 - (NSDictionary *)info;
@@ -319,6 +540,16 @@ void setUpdating(BOOL value);
 
 BOOL isDotFile(NSString *path);
 
+BOOL isHiddenFile(NSString *path);
+
+BOOL statPath(NSString *path, GMDSFileStat *st);
+
+NSData *fileIdOfStat(const GMDSFileStat *st);
+
+NSData *stampOfStat(const GMDSFileStat *st);
+
+NSData *ctimeOfStat(const GMDSFileStat *st);
+
 BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 NSString *path_separator(void);
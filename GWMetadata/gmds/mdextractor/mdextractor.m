@@ -24,20 +24,42 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <float.h>
+#include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 
 #import "mdextractor.h"
 #import "dbschema.h"
+#import "FSNHiddenMatcher.h"
 #include "config.h"
 
 #define DLENGTH 256
 #define MAX_RETRY 1000
-#define UPDATE_COUNT 100
+
+#if defined(__linux__) && defined(__GLIBC__) \
+  && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 28))
+#define HAVE_STATX 1
+#endif
+
+/* Path updates committed together, and the longest they wait. */
+#define GROUP_COUNT 500
+#define GROUP_INTERVAL 1.0
+
+/* Commits never checkpoint the WAL themselves: a thread with its own
+   connection does, once it holds this many pages or every interval. */
+#define CHECKPOINT_PAGES 4000
+#define CHECKPOINT_INTERVAL 30.0
+#define WAL_SIZE_LIMIT 67108864
 
 #define GWDebugLog(format, args...) \
   do { if (GW_DEBUG_LOG) \
@@ -131,6 +153,12 @@ static void path_moved(sqlite3_context *context, int argc, sqlite3_value **argv)
   free(newpath);
 }
 
+static int wal_committed(void *extractor, sqlite3 *db, const char *dbname, int pages)
+{
+  [(GMDSExtractor *)extractor walHasPages: pages];
+  return SQLITE_OK;
+}
+
 static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
 {
   NSTimeInterval interval = [[NSDate date] timeIntervalSinceReferenceDate];
@@ -138,6 +166,57 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
   sqlite3_result_double(context, interval);
 }
 
+/* Formats told by their first bytes, and the extension that picks
+   their extractor.  Text ones are matched after any blanks, in any
+   case. */
+static const struct {
+  unsigned offset;
+  const char *magic;
+  BOOL text;
+  const char *ext;
+} magic_numbers[] = {
+  { 0, "\xFF\xD8\xFF", NO, "jpg" },
+  { 0, "%PDF-", NO, "pdf" },
+  { 0, "{\\rtf", NO, "rtf" },
+  /* the stored "mimetype" entry that opens the zip */
+  { 30, "mimetypeapplication/vnd.oasis.opendocument.text", NO, "odt" },
+  { 30, "mimetypeapplication/vnd.oasis.opendocument.spreadsheet", NO, "ods" },
+  { 30, "mimetypeapplication/vnd.oasis.opendocument.presentation", NO, "odp" },
+  { 30, "mimetypeapplication/vnd.oasis.opendocument.graphics", NO, "odg" },
+  { 0, "<!doctype html", YES, "html" },
+  { 0, "<html", YES, "html" },
+  { 0, "<?xml", YES, "xml" }
+};
+
+static NSString *sniffed_extension(const char *bytes, size_t length)
+{
+  size_t start = 0;
+  unsigned i;
+
+  if (length >= 3 && memcmp(bytes, "\xEF\xBB\xBF", 3) == 0) {
+    start = 3;
+  }
+  while (start < length && bytes[start] && strchr(" \t\r\n", bytes[start])) {
+    start++;
+  }
+
+  for (i = 0; i < sizeof(magic_numbers) / sizeof(magic_numbers[0]); i++) {
+    const char *magic = magic_numbers[i].magic;
+    size_t mlen = strlen(magic);
+
+    if (magic_numbers[i].text) {
+      if (start + mlen <= length && strncasecmp(bytes + start, magic, mlen) == 0) {
+        return [NSString stringWithUTF8String: magic_numbers[i].ext];
+      }
+    } else if (magic_numbers[i].offset + mlen <= length
+                 && memcmp(bytes + magic_numbers[i].offset, magic, mlen) == 0) {
+      return [NSString stringWithUTF8String: magic_numbers[i].ext];
+    }
+  }
+
+  return nil;
+}
+
 
 @implementation	GMDSExtractor
 
@@ -147,13 +226,19 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
     [statusTimer invalidate];
   }
   TEST_RELEASE (statusTimer);
+
+  [self commitUpdates: nil];
+  if (groupTimer && [groupTimer isValid]) {
+    [groupTimer invalidate];
+  }
+  TEST_RELEASE (groupTimer);
   
   [dnc removeObserver: self];
   [nc removeObserver: self];
   
   RELEASE (indexablePaths);
-  freeTree(includePathsTree);
-  freeTree(excludedPathsTree);
+  radixFreeTree(includePathsTree);
+  radixFreeTree(excludedPathsTree);
   RELEASE (excludedSuffixes);
   RELEASE (dbpath);
   RELEASE (sqlite);
@@ -162,7 +247,25 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
   TEST_RELEASE (errHandle);
   RELEASE (extractors);  
   RELEASE (textExtractor);
+
+  //
+  // pipeline
+  //
+  TEST_RELEASE (pipeLock);
+  TEST_RELEASE (walkedItems);
+  TEST_RELEASE (typedItems);
+  TEST_RELEASE (extractedItems);
+
+  TEST_RELEASE (extractorLimits);
+  TEST_RELEASE (extractorStats);
+  TEST_RELEASE (costLock);
   
+  //
+  // metrics
+  //
+  TEST_RELEASE (pathMetrics);
+  TEST_RELEASE (metricsPath);
+
   //  
   // fswatcher_update  
   //
@@ -177,7 +280,9 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
   TEST_RELEASE (fswupdateTimer);
 
   RELEASE (fswupdatePaths);
+  RELEASE (fswupdateChanges);
   RELEASE (fswupdateSkipBuff);
+  RELEASE (priorityPaths);
   RELEASE (lostPaths);
   
   if (lostPathsTimer && [lostPathsTimer isValid]) {
@@ -229,6 +334,7 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
     dbdir = [dbdir stringByAppendingPathComponent: @".db"];
 
     ASSIGN (indexedStatusPath, [dbdir stringByAppendingPathComponent: @"status.plist"]);
+    maintenanceTime = 0.0;
     lockpath = [dbdir stringByAppendingPathComponent: @"extractors.lock"];    
 
     errpath = [dbdir stringByAppendingPathComponent: @"error.log"];
@@ -244,6 +350,21 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
       return self;    
     }
 
+    inUpdateGroup = NO;
+    updateDepth = 0;
+    groupTimer = [NSTimer scheduledTimerWithTimeInterval: GROUP_INTERVAL
+                                                  target: self
+                                                selector: @selector(commitUpdates:)
+                                                userInfo: nil
+                                                 repeats: YES];
+    RETAIN (groupTimer);
+
+    checkpointLock = [NSCondition new];
+    checkpointDue = NO;
+    [NSThread detachNewThreadSelector: @selector(checkpointLoop:)
+                             toTarget: self
+                           withObject: nil];
+
     indexedStatusLock = [[NSDistributedLock alloc] initWithPath: lockpath];
 
     if (indexedStatusLock == nil) {
@@ -289,11 +410,13 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
     
     defaults = [NSUserDefaults standardUserDefaults];
     [defaults synchronize];
+
+    [[FSNHiddenMatcher sharedMatcher] updateFromGWorkspaceDefaults];
     
     indexablePaths = [NSMutableArray new];
     
-    includePathsTree = newTreeWithIdentifier(@"included");
-    excludedPathsTree = newTreeWithIdentifier(@"excluded");
+    includePathsTree = newRadixTreeWithIdentifier(@"included");
+    excludedPathsTree = newRadixTreeWithIdentifier(@"excluded");
     excludedSuffixes = [[NSMutableSet alloc] initWithCapacity: 1];
     
     entry = [defaults arrayForKey: @"GSMetadataIndexablePaths"];
@@ -306,14 +429,14 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
         [indexablePaths addObject: indpath];
         RELEASE (indpath);
         
-        insertComponentsOfPath(path, includePathsTree);
+        radixInsertComponentsOfPath(path, includePathsTree);
       }
     }
 
     entry = [defaults arrayForKey: @"GSMetadataExcludedPaths"];
     if (entry) {
       for (i = 0; i < [entry count]; i++) {
-        insertComponentsOfPath([entry objectAtIndex: i], excludedPathsTree);
+        radixInsertComponentsOfPath([entry objectAtIndex: i], excludedPathsTree);
       }
     }
 
@@ -352,12 +475,14 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
   NSArray *indexable = [info objectForKey: @"GSMetadataIndexablePaths"];
   NSArray *excluded = [info objectForKey: @"GSMetadataExcludedPaths"];
   NSArray *suffixes = [info objectForKey: @"GSMetadataExcludedSuffixes"];
-  NSArray *excludedPaths = pathsOfTreeWithBase(excludedPathsTree);
+  NSArray *excludedPaths = radixPathsOfTree(excludedPathsTree);
   BOOL shouldExtract;
   unsigned count;
   unsigned i;
 
-  emptyTreeWithBase(includePathsTree);
+  [[FSNHiddenMatcher sharedMatcher] updateFromGWorkspaceDefaults];
+
+  radixEmptyTree(includePathsTree);
 
   for (i = 0; i < [indexable count]; i++) {
     NSString *path = [indexable objectAtIndex: i];
@@ -369,7 +494,7 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
       RELEASE (indpath);
     }
     
-    insertComponentsOfPath(path, includePathsTree);
+    radixInsertComponentsOfPath(path, includePathsTree);
   }
   
   count = [indexablePaths count];
@@ -389,12 +514,12 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
     }
   }  
 
-  emptyTreeWithBase(excludedPathsTree);
+  radixEmptyTree(excludedPathsTree);
 
   for (i = 0; i < [excluded count]; i++) {
     NSString *path = [excluded objectAtIndex: i];
     
-    insertComponentsOfPath(path, excludedPathsTree);
+    radixInsertComponentsOfPath(path, excludedPathsTree);
     
     if ([excludedPaths containsObject: path] == NO) {
       GMDSIndexablePath *ancestor = [self ancestorOfAddedPath: path];
@@ -425,6 +550,7 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
 
   [excludedSuffixes removeAllObjects];
   [excludedSuffixes addObjectsFromArray: suffixes];
+  [self sendFSWatcherFilter];
 
   indexingEnabled = [[info objectForKey: @"GSMetadataIndexingEnabled"] boolValue];
   
@@ -469,6 +595,16 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
             
             subentry = [subSaved objectForKey: @"indexed"];
             [subpath setIndexed: [subentry boolValue]];
+
+            subentry = [subSaved objectForKey: @"count"];
+            if (subentry) {
+              [subpath setFilesCount: [subentry unsignedLongValue]];
+            }
+
+            subentry = [subSaved objectForKey: @"resume"];
+            if (subentry) {
+              [subpath setResumePath: subentry];
+            }
             
             if ([subpath indexed] == NO) {
               shouldExtract = YES;
@@ -481,6 +617,12 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
         if (entry) {
           [indPath setFilesCount: [entry unsignedLongValue]];
         }
+
+        entry = [savedInfo objectForKey: @"resume"];
+        
+        if (entry) {
+          [indPath setResumePath: entry];
+        }
         
         entry = [savedInfo objectForKey: @"indexed"];
         
@@ -620,6 +762,9 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
 
     [status writeToFile: indexedStatusPath atomically: YES];
     [indexedStatusLock unlock];
+
+    [self writeCostsReport];
+    [self writeMetricsReport];
     
     GWDebugLog(@"paths status updated"); 
     
@@ -817,164 +962,74 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
 {
   NSString *path = [NSString stringWithString: [indpath path]];
   NSDictionary *attributes = [fm fileAttributesAtPath: path traverseLink: NO];
+  GMDSFileStat st;
   
-  if (attributes) {
-    NSString *app = nil;
+  if (attributes && statPath(path, &st)) {
     NSString *type = nil;
-    NSDirectoryEnumerator *enumerator;
     id extractor = nil;
-    unsigned long fcount = 0;  
+    /* a run cut short goes on from its checkpoint */
+    unsigned long fcount = ([indpath resumePath] ? [indpath filescount] : 0);  
     int path_id;
     
+    [self metricsStartPath: indpath
+             expectedFiles: ([indpath resumePath] ? 0 : [indpath filescount])];
+
     [self updateStatusOfPath: indpath
-                   startTime: [NSDate date]
+                   startTime: ([indpath resumePath] ? nil : [NSDate date])
                      endTime: nil
                   filesCount: fcount
                  indexedDone: NO];
     
-    EXECUTE_QUERY (@"BEGIN", NO);
+    if ([self skipsUnchangedPath: path fileStat: &st] == NO) {
+      if ([self beginUpdate] == NO) {
+        [self metricsEndPath: nil];
+        return NO;
+      }
     
-    [ws getInfoForFile: path application: &app type: &type];  
+      type = [self fileTypeOfPath: path fileStat: &st];
     
-    path_id = [self insertOrUpdatePath: path 
-                                ofType: type
-                        withAttributes: attributes];
+      path_id = [self insertOrUpdatePath: path 
+                                  ofType: type
+                          withAttributes: attributes
+                                fileStat: &st];
     
-    if (path_id == -1) {
-      [sqlite executeQuery: @"ROLLBACK"];
-      return NO;
-    }
-
-    extractor = [self extractorForPath: path 
-                                ofType: type
-                        withAttributes: attributes];
-
-    if (extractor) {
-      if ([extractor extractMetadataAtPath: path
-                                    withID: path_id
-                                attributes: attributes] == NO) {
-        [sqlite executeQuery: @"ROLLBACK"];
+      if (path_id == -1) {
+        [self endUpdate: NO];
+        [self metricsEndPath: nil];
         return NO;
       }
-    }
+
+      extractor = [self extractorForPath: path 
+                                  ofType: type
+                          withAttributes: attributes];
+
+      if (extractor) {
+        if ([self runExtractor: extractor
+                        atPath: path
+                        withID: path_id
+                    attributes: attributes] == NO) {
+          [self endUpdate: NO];
+          [self metricsEndPath: nil];
+          return NO;
+        }
+      }
     
-    [sqlite executeQuery: @"COMMIT"];
+      [self endUpdate: YES];
     
-    GWDebugLog(@"%@", path);
+      GWDebugLog(@"%@", path);
+    }
     
     fcount++;
 
-    enumerator = [fm enumeratorAtPath: path];
-
-    while (1) {
-      CREATE_AUTORELEASE_POOL(arp); 
-      NSString *entry = [enumerator nextObject];
-      NSDate *date = [NSDate dateWithTimeIntervalSinceNow: 0.001];
-      BOOL skip = NO;
-
-      [[NSRunLoop currentRunLoop] runUntilDate: date];
-
-      if (entry) {
-        NSString *subpath = [path stringByAppendingPathComponent: entry];
-        NSString *ext = [[subpath pathExtension] lowercaseString];
-
-        skip = ([excludedSuffixes containsObject: ext]
-                    || isDotFile(subpath) 
-                    || inTreeFirstPartOfPath(subpath, excludedPathsTree));
-
-        attributes = [fm fileAttributesAtPath: subpath traverseLink: NO];
-
-        if (attributes) {
-          BOOL failed = NO;
-          BOOL hasextractor = NO;
-        
-          if (skip == NO) {
-            NSString *app = nil;
-            NSString *type = nil;        
-                                
-            [sqlite executeQuery: @"BEGIN"];
-            
-            [ws getInfoForFile: subpath application: &app type: &type];
-            
-            path_id = [self insertOrUpdatePath: subpath 
-                                        ofType: type
-                                withAttributes: attributes];
-                    
-            if (path_id != -1) {
-              extractor = [self extractorForPath: subpath 
-                                          ofType: type
-                                  withAttributes: attributes];
-
-              if (extractor) {
-                hasextractor = YES;
-                
-                if ([extractor extractMetadataAtPath: subpath
-                                              withID: path_id
-                                          attributes: attributes] == NO) {
-                  failed = YES;                         
-                }
-              }
-          
-            } else {
-              failed = YES;
-            }
-                        
-            [sqlite executeQuery: (failed ? @"ROLLBACK" : @"COMMIT")];
-            
-            if ((failed == NO) && (skip == NO)) {
-              fcount++;
-            }
-            
-            if ((fcount % UPDATE_COUNT) == 0) {
-              [self updateStatusOfPath: indpath
-                             startTime: nil
-                               endTime: nil
-                            filesCount: fcount
-                           indexedDone: NO];
-                           
-              GWDebugLog(@"updating %lu", fcount);             
-            }
-          }
-          
-          if (skip) {
-            GWDebugLog(@"skipping %@", subpath);
-            
-            if ([attributes fileType] == NSFileTypeDirectory) {
-              [enumerator skipDescendents];
-            }
+    fcount = [self extractContentsOfPath: indpath filesCount: fcount];
 
-          } else {
-            if (failed) {
-              [self logError: [NSString stringWithFormat: @"EXTRACT %@", subpath]];
-              GWDebugLog(@"error extracting at: %@", subpath);
-            } else if (hasextractor == NO) {
-              GWDebugLog(@"no extractor for: %@", subpath);
-            } else {
-              GWDebugLog(@"extracted: %@", subpath);
-            }
-          }
-        }
-
-      } else {
-        RELEASE (arp);
-        break;
-      }
-
-      if (extracting == NO) {
-        GWDebugLog(@"stopped"); 
-        RELEASE (arp);
-        break;
-      }
-
-      TEST_RELEASE (arp); 
-    }
-    
     [self updateStatusOfPath: indpath
                    startTime: nil
                      endTime: [NSDate date]
                   filesCount: fcount
                  indexedDone: extracting];
-        
+
+    [self metricsEndPath: indpath];
     [self writePathsStatus: nil];
     
     GWDebugLog(@"done %@", path); 
@@ -986,12 +1041,32 @@ static void time_stamp(sqlite3_context *context, int argc, sqlite3_value **argv)
 - (int)insertOrUpdatePath:(NSString *)path
                    ofType:(NSString *)type
            withAttributes:(NSDictionary *)attributes
+{
+  GMDSFileStat st;
+
+  if (statPath(path, &st) == NO) {
+    memset(&st, 0, sizeof(st));
+  }
+
+  return [self insertOrUpdatePath: path 
+                           ofType: type 
+                   withAttributes: attributes 
+                         fileStat: &st];
+}
+
+/*
+ * st is what the file looked like before its metadata was read, and
+ * the same metadata will be judged by it on the next pass.
+ */
+- (int)insertOrUpdatePath:(NSString *)path
+                   ofType:(NSString *)type
+           withAttributes:(NSDictionary *)attributes
+                 fileStat:(const GMDSFileStat *)st
 {
   NSTimeInterval interval = [[attributes fileModificationDate] timeIntervalSinceReferenceDate];
   NSMutableArray *mdattributes = [NSMutableArray array];  
-  NSString *qpath = stringForQuery(path);
-  NSString *qname = stringForQuery([path lastPathComponent]);
-  NSString *qext = stringForQuery([[path pathExtension] lowercaseString]);  
+  NSString *name = [path lastPathComponent];
+  NSString *ext = [[path pathExtension] lowercaseString];
   SQLitePreparedStatement *statement;
   NSString *query;
   int path_id;
@@ -1011,7 +1086,7 @@ do { \
     
   statement = [sqlite statementForQuery: query 
                          withIdentifier: @"insert_or_update_1"
-                               bindings: SQLITE_TEXT, @":path", qpath, 0];
+                               bindings: SQLITE_TEXT, @":path", path, 0];
                              
   path_id = [sqlite getIntEntryWithStatement: statement];
   
@@ -1025,14 +1100,17 @@ do { \
     }
 
     query = @"INSERT INTO paths "
-            @"(path, words_count, moddate, is_directory) "
-            @"VALUES(:path, 0, :moddate, :isdir)";
+            @"(path, words_count, moddate, is_directory, fileid, stamp, ctime) "
+            @"VALUES(:path, 0, :moddate, :isdir, :fileid, :stamp, :ctime)";
 
     statement = [sqlite statementForQuery: query 
                            withIdentifier: @"insert_or_update_2"
-                                 bindings: SQLITE_TEXT, @":path", qpath, 
+                                 bindings: SQLITE_TEXT, @":path", path, 
                                            SQLITE_FLOAT, @":moddate", interval, 
-                                           SQLITE_INTEGER, @":isdir", isdir, 0];
+                                           SQLITE_INTEGER, @":isdir", isdir, 
+                                           SQLITE_BLOB, @":fileid", fileIdOfStat(st), 
+                                           SQLITE_BLOB, @":stamp", stampOfStat(st), 
+                                           SQLITE_BLOB, @":ctime", ctimeOfStat(st), 0];
 
     STATEMENT_EXECUTE_QUERY (statement, -1);
 
@@ -1040,12 +1118,16 @@ do { \
 
   } else {
     query = @"UPDATE paths "
-            @"SET words_count = 0, moddate = :moddate "
+            @"SET words_count = 0, moddate = :moddate, "
+            @"fileid = :fileid, stamp = :stamp, ctime = :ctime "
             @"WHERE id = :pathid";
   
     statement = [sqlite statementForQuery: query 
                            withIdentifier: @"insert_or_update_3"
                                  bindings: SQLITE_FLOAT, @":moddate", interval, 
+                                           SQLITE_BLOB, @":fileid", fileIdOfStat(st), 
+                                           SQLITE_BLOB, @":stamp", stampOfStat(st), 
+                                           SQLITE_BLOB, @":ctime", ctimeOfStat(st), 
                                            SQLITE_INTEGER, @":pathid", path_id, 0];
   
     STATEMENT_EXECUTE_QUERY (statement, -1);
@@ -1058,7 +1140,7 @@ do { \
 
     STATEMENT_EXECUTE_QUERY (statement, -1);
 
-    query = @"DELETE FROM postings WHERE path_id = :pathid";
+    query = @"DELETE FROM contents WHERE rowid = :pathid";
 
     statement = [sqlite statementForQuery: query 
                            withIdentifier: @"insert_or_update_5"
@@ -1067,8 +1149,8 @@ do { \
     STATEMENT_EXECUTE_QUERY (statement, -1);
   }
 
-  KEY_AND_ATTRIBUTE (@"GSMDItemFSName", qname);  
-  KEY_AND_ATTRIBUTE (@"GSMDItemFSExtension", qext);  
+  KEY_AND_ATTRIBUTE (@"GSMDItemFSName", name);  
+  KEY_AND_ATTRIBUTE (@"GSMDItemFSExtension", ext);  
   KEY_AND_ATTRIBUTE (@"GSMDItemFSType", type);  
   
   if (ddbd) {
@@ -1099,6 +1181,97 @@ do { \
   return path_id;
 }
 
+/*
+ * YES if the db already holds the file as it is: same path, inode and
+ * stamps.  A path the db does not know, whose inode it has under a
+ * path that is gone, was moved there while we were not looking; the
+ * entry, and the subtree of a directory, is renamed instead of being
+ * indexed anew, and skipped too if nothing but its ctime changed.
+ */
+- (BOOL)skipsUnchangedPath:(NSString *)path
+                  fileStat:(const GMDSFileStat *)st
+{
+  NSData *fileid = fileIdOfStat(st);
+  NSData *stamp = stampOfStat(st);
+  NSData *ctime = ctimeOfStat(st);
+  SQLitePreparedStatement *statement;
+  NSString *query;
+  NSString *oldpath;
+  GMDSFileStat oldst;
+
+  query = @"SELECT id FROM paths "
+          @"WHERE path = :path "
+          @"AND fileid = :fileid AND stamp = :stamp AND ctime = :ctime";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"skips_unchanged_1"
+                               bindings: SQLITE_TEXT, @":path", path, 
+                                         SQLITE_BLOB, @":fileid", fileid, 
+                                         SQLITE_BLOB, @":stamp", stamp, 
+                                         SQLITE_BLOB, @":ctime", ctime, 0];
+
+  if ([sqlite getIntEntryWithStatement: statement] != INT_MAX) {
+    return YES;
+  }
+
+  query = @"SELECT id FROM paths WHERE path = :path";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"skips_unchanged_2"
+                               bindings: SQLITE_TEXT, @":path", path, 0];
+
+  if ([sqlite getIntEntryWithStatement: statement] != INT_MAX) {
+    return NO;
+  }
+
+  query = @"SELECT path FROM paths WHERE fileid = :fileid";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"skips_unchanged_3"
+                               bindings: SQLITE_BLOB, @":fileid", fileid, 0];
+
+  oldpath = [sqlite getStringEntryWithStatement: statement];
+
+  if (oldpath == nil) {
+    return NO;
+  }
+
+  /* a hard link, not a rename */
+  if (statPath(oldpath, &oldst) && [fileIdOfStat(&oldst) isEqual: fileid]) {
+    return NO;
+  }
+
+  GWDebugLog(@"%@ moved to %@", oldpath, path);
+
+  if ([self updateRenamedPath: path oldPath: oldpath isDirectory: st->isdir] == NO) {
+    return NO;
+  }
+
+  if ([self beginUpdate] == NO) {
+    return NO;
+  }
+
+  query = @"UPDATE paths SET ctime = :ctime "
+          @"WHERE path = :path AND fileid = :fileid AND stamp = :stamp";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"skips_unchanged_4"
+                               bindings: SQLITE_BLOB, @":ctime", ctime, 
+                                         SQLITE_TEXT, @":path", path, 
+                                         SQLITE_BLOB, @":fileid", fileid, 
+                                         SQLITE_BLOB, @":stamp", stamp, 0];
+
+  if ([sqlite executeQueryWithStatement: statement] == NO) {
+    [self endUpdate: NO];
+    return NO;
+  }
+
+  [self endUpdate: YES];
+
+  /* the contents changed too, if it still does not match */
+  return [self skipsUnchangedPath: path fileStat: st];
+}
+
 - (BOOL)setMetadata:(NSDictionary *)mddict
             forPath:(NSString *)path
              withID:(int)path_id
@@ -1107,14 +1280,19 @@ do { \
   NSDictionary *attrsdict;
   SQLitePreparedStatement *statement;
   NSString *query;
+
+  mddict = [self metadataWithinLimits: mddict forPath: path];
+
+  if ([self capturesMetadata: mddict]) {
+    return YES;
+  }
         
   wordsdict = [mddict objectForKey: @"words"];
 
   if (wordsdict) {
     NSCountedSet *wordset = [wordsdict objectForKey: @"wset"];
-    NSEnumerator *enumerator = [wordset objectEnumerator];  
     unsigned wcount = [[wordsdict objectForKey: @"wcount"] unsignedLongValue];
-    NSString *word;
+    NSString *text = [wordsdict objectForKey: @"text"];
 
     query = @"UPDATE paths "
             @"SET words_count = :wcount "
@@ -1127,40 +1305,34 @@ do { \
 
     STATEMENT_EXECUTE_QUERY (statement, NO);
 
-    while ((word = [enumerator nextObject])) {
-      NSString *qword = stringForQuery(word);
-      unsigned word_count = [wordset countForObject: word];
-      int word_id;
-      
-      query = @"SELECT id FROM words WHERE word = :word";
+    /* the extractors using tokenizer.h give the text as it goes in;
+       bm25() takes the term frequencies from the text itself */
+    if (text == nil) {
+      NSEnumerator *enumerator = [wordset objectEnumerator];  
+      NSMutableString *mtext = [NSMutableString string];
+      NSString *word;
 
-      statement = [sqlite statementForQuery: query 
-                             withIdentifier: @"set_metadata_2"
-                                   bindings: SQLITE_TEXT, @":word", qword, 0];
-      
-      word_id = [sqlite getIntEntryWithStatement: statement];
-      
-      if (word_id == INT_MAX) {
-        query = @"INSERT INTO words (word) VALUES(:word)";
+      while ((word = [enumerator nextObject])) {
+        unsigned word_count = [wordset countForObject: word];
+        unsigned j;
 
-        statement = [sqlite statementForQuery: query 
-                               withIdentifier: @"set_metadata_3"
-                                     bindings: SQLITE_TEXT, @":word", qword, 0];
-      
-        STATEMENT_EXECUTE_QUERY (statement, NO);
-      
-        word_id = [sqlite lastInsertRowId];
+        for (j = 0; j < word_count; j++) {
+          [mtext appendString: word];
+          [mtext appendString: @" "];
+        }
       }
-      
-      query = @"INSERT INTO postings (word_id, path_id, word_count) "
-              @"VALUES(:wordid, :pathid, :wordcount)";
-              
+      text = mtext;
+    }
+
+    if ([text length]) {
+      query = @"INSERT INTO contents (rowid, words) "
+              @"VALUES(:pathid, :words)";
+
       statement = [sqlite statementForQuery: query 
-                             withIdentifier: @"set_metadata_4"
-                                   bindings: SQLITE_INTEGER, @":wordid", word_id,
-                                             SQLITE_INTEGER, @":pathid", path_id, 
-                                             SQLITE_INTEGER, @":wordcount", word_count, 0];
-              
+                             withIdentifier: @"set_metadata_2"
+                                   bindings: SQLITE_INTEGER, @":pathid", path_id, 
+                                             SQLITE_TEXT, @":words", text, 0];
+
       STATEMENT_EXECUTE_QUERY (statement, NO);
     }
   }
@@ -1217,29 +1389,98 @@ do { \
   return YES;
 }
 
+/*
+ * Every change to the db happens between -beginUpdate and -endUpdate:,
+ * which nest a savepoint in a transaction shared with the changes
+ * before it; the transaction is committed every GROUP_COUNT changes
+ * or GROUP_INTERVAL seconds, by -commitUpdates:.  Anything wanting the
+ * changes visible to gmds at once calls -commitUpdates: itself.
+ */
+- (BOOL)beginUpdate
+{
+  if (inUpdateGroup == NO) {
+    EXECUTE_QUERY (@"BEGIN", NO);
+    inUpdateGroup = YES;
+    groupedUpdates = 0;
+    groupStart = [NSDate timeIntervalSinceReferenceDate];
+  }
+
+  EXECUTE_QUERY (@"SAVEPOINT path_update", NO);
+  updateDepth++;
+
+  return YES;
+}
+
+- (void)endUpdate:(BOOL)keep
+{
+  if (updateDepth == 0) {
+    return;
+  }
+
+  if (keep == NO) {
+    [sqlite executeQuery: @"ROLLBACK TO path_update"];
+  }
+  [sqlite executeQuery: @"RELEASE path_update"];
+  updateDepth--;
+  groupedUpdates++;
+
+  if (groupedUpdates >= GROUP_COUNT) {
+    [self commitUpdates: nil];
+  }
+}
+
+- (void)commitUpdates:(id)sender
+{
+  NSTimeInterval start;
+
+  if (inUpdateGroup == NO || updateDepth > 0) {
+    /* an extractor running the run loop, with its change still open */
+    return;
+  }
+
+  if (sender == groupTimer
+        && ([NSDate timeIntervalSinceReferenceDate] - groupStart) < GROUP_INTERVAL) {
+    return;
+  }
+
+  start = [NSDate timeIntervalSinceReferenceDate];
+  if ([sqlite executeQuery: @"COMMIT"] == NO) {
+    [sqlite executeQuery: @"ROLLBACK"];
+  }
+  [self metricsAddDbTime: [NSDate timeIntervalSinceReferenceDate] - start];
+  inUpdateGroup = NO;
+}
+
+/*
+ * Only the first DLENGTH bytes are read, for the extractors to test
+ * and for the magic numbers when the extension is unknown or wrong.
+ */
 - (id)extractorForPath:(NSString *)path
                 ofType:(NSString *)type
         withAttributes:(NSDictionary *)attributes
 {
   NSString *ext = [[path pathExtension] lowercaseString];
+  NSString *sniffed = nil;
   NSData *data = nil;
   id extractor = nil;  
   
   if ([attributes fileType] == NSFileTypeRegular) {
-    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath: path];
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
 
-    if (handle) {
-      NS_DURING
-        {
-          data = [handle readDataOfLength: DLENGTH];
-        }
-      NS_HANDLER
-        {
-          data = nil;
-        }
-      NS_ENDHANDLER
+    if (fd >= 0) {
+      char buf[DLENGTH];
+      ssize_t got;
+
+      do {
+        got = pread(fd, buf, DLENGTH, 0);
+      } while (got < 0 && errno == EINTR);
 
-      [handle closeFile];
+      close(fd);
+
+      if (got >= 0) {
+        data = [NSData dataWithBytes: buf length: got];
+        sniffed = sniffed_extension(buf, got);
+      }
     }
   }
 
@@ -1253,6 +1494,17 @@ do { \
       return extractor;
     }
   }
+
+  if (sniffed && [sniffed isEqual: ext] == NO) {
+    extractor = [extractors objectForKey: sniffed];
+
+    if (extractor && [extractor canExtractFromFileType: type
+                                         withExtension: sniffed
+                                            attributes: attributes
+                                              testData: data]) {
+      return extractor;
+    }
+  }
   
   if ([textExtractor canExtractFromFileType: type 
                               withExtension: ext
@@ -1264,6 +1516,25 @@ do { \
   return nil;
 }
 
+/*
+ * What NSWorkspace would say of the path; for a regular file, which
+ * most are, from what statPath() found, without asking it.
+ */
+- (NSString *)fileTypeOfPath:(NSString *)path
+                    fileStat:(const GMDSFileStat *)st
+{
+  NSString *app = nil;
+  NSString *type = nil;
+
+  if (S_ISREG(st->mode)) {
+    return ((st->mode & 0111) ? NSShellCommandFileType : NSPlainFileType);
+  }
+
+  [ws getInfoForFile: path application: &app type: &type];
+
+  return type;
+}
+
 - (void)loadExtractors
 {
   NSString *bundlesDir;
@@ -1304,6 +1575,8 @@ do { \
         if (extractor) {
           NSArray *extensions = [extractor pathExtensions];
 
+          [self registerCostProfileOfExtractor: extractor];
+
           if ([extensions containsObject: @"txt"]) {
             ASSIGN (textExtractor, extractor);
 
@@ -1329,7 +1602,12 @@ do { \
 
   if ([sqlite opendbAtPath: dbpath isNew: &newdb]) {    
     if (newdb) {
-      if ([sqlite executeSimpleQuery: db_schema] == NO) {
+      /* lets the maintenance give the pages of removed paths back */
+      [sqlite executeSimpleQuery: @"PRAGMA auto_vacuum = INCREMENTAL"];
+
+      if ([sqlite executeSimpleQuery: db_schema] == NO
+            || ([sqlite executeSimpleQuery: db_schema_fts] == NO
+                  && [sqlite executeSimpleQuery: db_schema_fts_stored] == NO)) {
         NSDebugLLog(@"gwspace", @"unable to create the database at %@", dbpath);
         return NO;
       } else {
@@ -1357,10 +1635,19 @@ do { \
                   argumentsCount: 0
                     userFunction: time_stamp];
 
+  /* in WAL mode the gmds readers never wait for us, and NORMAL
+     is safe there: a crash can lose the last commits, not the db */
+  if ([[sqlite getStringEntry: @"PRAGMA journal_mode = WAL"] isEqual: @"wal"] == NO) {
+    NSDebugLLog(@"gwspace", @"unable to switch %@ to WAL mode", dbpath);
+  }
   [sqlite executeQuery: @"PRAGMA cache_size = 20000"];
   [sqlite executeQuery: @"PRAGMA count_changes = 0"];
-  [sqlite executeQuery: @"PRAGMA synchronous = OFF"];
+  [sqlite executeQuery: @"PRAGMA synchronous = NORMAL"];
   [sqlite executeQuery: @"PRAGMA temp_store = MEMORY"];
+  [sqlite getIntEntry: @"PRAGMA wal_autocheckpoint = 0"];
+  [sqlite getIntEntry: [NSString stringWithFormat: @"PRAGMA journal_size_limit = %i",
+                                 WAL_SIZE_LIMIT]];
+  sqlite3_wal_hook([sqlite db], wal_committed, self);
 
   if ([sqlite executeSimpleQuery: db_schema_tmp] == NO) {
     NSDebugLLog(@"gwspace", @"unable to create temp tables");
@@ -1368,6 +1655,8 @@ do { \
     return NO;    
   }
 
+  [self migratePreviousDb];
+
   /* only to avoid a compiler warning */
   if (0) {
     NSDebugLLog(@"gwspace", @"%@", user_db_schema);
@@ -1377,6 +1666,103 @@ do { \
   return YES;
 }
 
+/*
+ * Fills an empty db with the contents of the one of the previous
+ * version, if there is one, which is removed afterwards.  gmds may
+ * well have created the db before we got here.
+ */
+- (void)migratePreviousDb
+{
+  NSString *prevdir = [[dbdir stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: db_previous_version];
+  NSString *prevpath = [prevdir stringByAppendingPathComponent: @"contents.db"];
+  BOOL isnew;
+
+  if ([fm fileExistsAtPath: prevpath] == NO
+        || [sqlite getIntEntry: @"SELECT COUNT(id) FROM paths"] != 0) {
+    return;
+  }
+
+  NSDebugLLog(@"gwspace", @"migrating the %@ database", db_previous_version);
+
+  if ([sqlite attachDbAtPath: prevpath withName: @"previous" isNew: &isnew] == NO) {
+    return;
+  }
+
+  if ([sqlite executeQuery: @"BEGIN"]
+        && [sqlite executeSimpleQuery: db_migrate_previous]
+        && [sqlite executeQuery: @"COMMIT"]) {
+    [sqlite executeSimpleQuery: @"DETACH DATABASE previous"];
+    [fm removeFileAtPath: prevdir handler: nil];
+    GWDebugLog(@"%@ database migrated", db_previous_version);
+
+  } else {
+    [sqlite executeQuery: @"ROLLBACK"];
+    [sqlite executeSimpleQuery: @"DETACH DATABASE previous"];
+    NSDebugLLog(@"gwspace", @"unable to migrate %@", prevpath);
+  }
+}
+
+/* Called by SQLite after each commit, on this thread. */
+- (void)walHasPages:(int)pages
+{
+  if (pages >= CHECKPOINT_PAGES) {
+    [checkpointLock lock];
+    if (checkpointDue == NO) {
+      checkpointDue = YES;
+      [checkpointLock signal];
+    }
+    [checkpointLock unlock];
+  }
+}
+
+/*
+ * Passive checkpoints, on a connection of their own: they copy what no
+ * gmds reader still needs back into the db and never block a writer.
+ */
+- (void)checkpointLoop:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  sqlite3 *cdb = NULL;
+
+  if (sqlite3_open([dbpath fileSystemRepresentation], &cdb) != SQLITE_OK) {
+    NSDebugLLog(@"gwspace", @"no checkpoints for %@: %s", dbpath, sqlite3_errmsg(cdb));
+    sqlite3_close(cdb);
+    RELEASE (pool);
+    return;
+  }
+  sqlite3_busy_timeout(cdb, 1000);
+
+  while (1) {
+    CREATE_AUTORELEASE_POOL(arp);
+    int logged = 0;
+    int copied = 0;
+    int err;
+
+    [checkpointLock lock];
+    if (checkpointDue == NO) {
+      [checkpointLock waitUntilDate:
+        [NSDate dateWithTimeIntervalSinceNow: CHECKPOINT_INTERVAL]];
+    }
+    checkpointDue = NO;
+    [checkpointLock unlock];
+
+    err = sqlite3_wal_checkpoint_v2(cdb, NULL, SQLITE_CHECKPOINT_PASSIVE,
+                                    &logged, &copied);
+
+    if (err != SQLITE_OK && err != SQLITE_BUSY) {
+      NSDebugLLog(@"gwspace", @"checkpoint: %s", sqlite3_errmsg(cdb));
+    } else {
+      GWDebugLog(@"checkpoint: %i of %i pages", copied, logged);
+    }
+
+    RELEASE (arp);
+  }
+
+  sqlite3_close(cdb);
+  RELEASE (pool);
+}
+
 - (void)logError:(NSString *)err
 {
   NSString *errbuf = [NSString stringWithFormat: @"%@\n", err];
@@ -1432,6 +1818,7 @@ do { \
   RELEASE (path);
   TEST_RELEASE (startTime);
   TEST_RELEASE (endTime);
+  TEST_RELEASE (resumePath);
   RELEASE (subpaths);
   TEST_RELEASE (ancestor);
   
@@ -1452,6 +1839,7 @@ do { \
     }
     startTime = nil;
     endTime = nil;
+    resumePath = nil;
     filescount = 0L;
     indexed = NO;
   }
@@ -1564,6 +1952,20 @@ do { \
 - (void)setIndexed:(BOOL)value
 {
   indexed = value;
+
+  if (indexed) {
+    DESTROY (resumePath);
+  }
+}
+
+- (NSString *)resumePath
+{
+  return resumePath;
+}
+
+- (void)setResumePath:(NSString *)apath
+{
+  ASSIGN (resumePath, apath);
 }
 
 - (void)checkIndexingDone
@@ -1604,6 +2006,10 @@ do { \
   [info setObject: [NSNumber numberWithBool: indexed] forKey: @"indexed"];
   
   [info setObject: [NSNumber numberWithUnsignedLong: filescount] forKey: @"count"];
+
+  if (resumePath) {
+    [info setObject: resumePath forKey: @"resume"];
+  }
   
   for (i = 0; i < [subpaths count]; i++) {
     [subinfo addObject: [[subpaths objectAtIndex: i] info]];
@@ -1699,6 +2105,98 @@ BOOL isDotFile(NSString *path)
   return found;  
 }
 
+BOOL isHiddenFile(NSString *path)
+{
+  /* dot files are never indexed; the rest is what the viewers hide */
+  return (isDotFile(path)
+            || ((path != nil)
+                  && [[FSNHiddenMatcher sharedMatcher] isHiddenPath: path]));
+}
+
+
+/* lstat(), or the part of statx() we need, which does not make a
+   network file system sync to answer. */
+BOOL statPath(NSString *path, GMDSFileStat *st)
+{
+  const char *cpath = [path fileSystemRepresentation];
+  struct stat sb;
+
+#ifdef HAVE_STATX
+  struct statx sx;
+
+  if (statx(AT_FDCWD, cpath, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+            STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME | STATX_CTIME,
+            &sx) == 0) {
+    st->dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+    st->ino = sx.stx_ino;
+    st->size = sx.stx_size;
+    st->mtime_sec = sx.stx_mtime.tv_sec;
+    st->mtime_nsec = sx.stx_mtime.tv_nsec;
+    st->ctime_sec = sx.stx_ctime.tv_sec;
+    st->ctime_nsec = sx.stx_ctime.tv_nsec;
+    st->mode = sx.stx_mode;
+    st->isdir = S_ISDIR(sx.stx_mode);
+    return YES;
+
+  } else if (errno != ENOSYS) {
+    return NO;
+  }
+#endif
+
+  if (lstat(cpath, &sb) != 0) {
+    return NO;
+  }
+
+  st->dev = sb.st_dev;
+  st->ino = sb.st_ino;
+  st->size = sb.st_size;
+#ifdef __APPLE__
+  st->mtime_sec = sb.st_mtimespec.tv_sec;
+  st->mtime_nsec = sb.st_mtimespec.tv_nsec;
+  st->ctime_sec = sb.st_ctimespec.tv_sec;
+  st->ctime_nsec = sb.st_ctimespec.tv_nsec;
+#else
+  st->mtime_sec = sb.st_mtim.tv_sec;
+  st->mtime_nsec = sb.st_mtim.tv_nsec;
+  st->ctime_sec = sb.st_ctim.tv_sec;
+  st->ctime_nsec = sb.st_ctim.tv_nsec;
+#endif
+  st->mode = sb.st_mode;
+  st->isdir = S_ISDIR(sb.st_mode);
+
+  return YES;
+}
+
+NSData *fileIdOfStat(const GMDSFileStat *st)
+{
+  uint64_t fields[2];
+
+  fields[0] = st->dev;
+  fields[1] = st->ino;
+
+  return [NSData dataWithBytes: fields length: sizeof(fields)];
+}
+
+NSData *stampOfStat(const GMDSFileStat *st)
+{
+  int64_t fields[3];
+
+  fields[0] = st->size;
+  fields[1] = st->mtime_sec;
+  fields[2] = st->mtime_nsec;
+
+  return [NSData dataWithBytes: fields length: sizeof(fields)];
+}
+
+NSData *ctimeOfStat(const GMDSFileStat *st)
+{
+  int64_t fields[2];
+
+  fields[0] = st->ctime_sec;
+  fields[1] = st->ctime_nsec;
+
+  return [NSData dataWithBytes: fields length: sizeof(fields)];
+}
 
 BOOL subPathOfPath(NSString *p1, NSString *p2)
 {
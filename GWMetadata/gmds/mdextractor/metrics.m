@@ -0,0 +1,315 @@
+/* metrics.m
+ *
+ * How fast the indexing of each path goes and where its time goes,
+ * in metrics.plist next to status.plist, for the preferences to show
+ * while it runs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#import <Foundation/Foundation.h>
+
+#import "mdextractor.h"
+
+#define GWDebugLog(format, args...) \
+  do { if (GW_DEBUG_LOG) \
+    NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* the weight of the last sample in the rates */
+#define RATE_WEIGHT (0.5)
+
+
+@interface GMDSExtractor (metrics_private)
+
+- (unsigned long)exceededLimits:(NSString *)limit;
+
+- (NSDictionary *)metricsOfRunAt:(NSTimeInterval)now;
+
+@end
+
+
+@implementation GMDSExtractor (metrics)
+
+/*
+ * Called by -extractFromPath: as it starts on a path.  count is the
+ * files the path had the last time it was indexed from the start, 0
+ * when that is not known: the estimate for the ETA until the walker
+ * has seen the whole tree.
+ */
+- (void)metricsStartPath:(GMDSIndexablePath *)indpath
+           expectedFiles:(unsigned long)count
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  if (pathMetrics == nil) {
+    pathMetrics = [NSMutableDictionary new];
+  }
+  if (metricsPath) {
+    [self metricsEndPath: nil];
+  }
+
+  ASSIGN (metricsPath, [indpath path]);
+  metricsStart = now;
+  metricsSampleTime = now;
+  metricsProgressTime = now;
+  metricsExpected = count;
+  metricsFiles = 0;
+  metricsBytes = 0;
+  metricsSampleFiles = 0;
+  metricsSampleBytes = 0;
+  metricsUnchanged = 0;
+  metricsFailed = 0;
+  metricsDbTime = 0;
+  metricsFileRate = 0;
+  metricsByteRate = 0;
+  metricsTimeouts = [self exceededLimits: @"max_time"];
+  metricsTooBig = [self exceededLimits: @"max_bytes"];
+
+  [pipeLock lock];
+  metricsWalked = 0;
+  metricsSkipped = 0;
+  [pipeLock unlock];
+
+  GWDebugLog(@"metrics: %@, %lu files expected", metricsPath, count);
+}
+
+/* Main thread.  A file written to the db, or found as the db has it. */
+- (void)metricsCountFile:(unsigned long long)bytes
+                 changed:(BOOL)changed
+{
+  if (metricsPath == nil) {
+    return;
+  }
+  if (changed) {
+    metricsFiles++;
+    metricsBytes += bytes;
+  } else {
+    metricsUnchanged++;
+  }
+  metricsProgressTime = [NSDate timeIntervalSinceReferenceDate];
+}
+
+- (void)metricsCountFailure
+{
+  if (metricsPath == nil) {
+    return;
+  }
+  metricsFailed++;
+  metricsProgressTime = [NSDate timeIntervalSinceReferenceDate];
+}
+
+- (void)metricsAddDbTime:(NSTimeInterval)seconds
+{
+  metricsDbTime += seconds;
+}
+
+/*
+ * The run of the path is over; its figures stay in the report, as of
+ * when it ended, next to those of the run going on.  nil when the run
+ * gave up before its end.
+ */
+- (void)metricsEndPath:(GMDSIndexablePath *)indpath
+{
+  NSMutableDictionary *last;
+  NSString *state;
+
+  if (metricsPath == nil) {
+    return;
+  }
+
+  if (indpath == nil) {
+    state = @"failed";
+  } else if ([indpath indexed]) {
+    state = @"done";
+  } else {
+    state = @"stopped";
+  }
+
+  last = [NSMutableDictionary dictionaryWithDictionary:
+                      [self metricsOfRunAt: [NSDate timeIntervalSinceReferenceDate]]];
+  [last setObject: state forKey: @"state"];
+  [last setObject: [NSDate date] forKey: @"end"];
+  [last removeObjectForKey: @"eta"];
+  [last removeObjectForKey: @"queue"];
+  [last removeObjectForKey: @"queue_depth"];
+  /* the rates of a run over are its averages */
+  [last setObject: [last objectForKey: @"average_files_per_second"]
+           forKey: @"files_per_second"];
+  [last setObject: [last objectForKey: @"average_bytes_per_second"]
+           forKey: @"bytes_per_second"];
+
+  [pathMetrics setObject: last forKey: metricsPath];
+  DESTROY (metricsPath);
+}
+
+/*
+ * Called with the status report, every few seconds while the paths
+ * are indexed: one entry per path, the one being indexed with its
+ * rates of the last seconds, queue depth and ETA.
+ */
+- (void)writeMetricsReport
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableDictionary *paths;
+  NSMutableDictionary *report;
+  NSString *path;
+
+  if (indexedStatusPath == nil || (pathMetrics == nil && metricsPath == nil)) {
+    return;
+  }
+
+  /* the paths no longer indexed go */
+  {
+    NSArray *keys = [pathMetrics allKeys];
+    NSUInteger i, j;
+
+    for (i = 0; i < [keys count]; i++) {
+      NSString *key = [keys objectAtIndex: i];
+      BOOL indexed = ([self indexablePathWithPath: key] != nil);
+
+      for (j = 0; j < [indexablePaths count] && indexed == NO; j++) {
+        indexed = ([[indexablePaths objectAtIndex: j] subpathWithPath: key] != nil);
+      }
+      if (indexed == NO) {
+        [pathMetrics removeObjectForKey: key];
+      }
+    }
+  }
+
+  paths = [NSMutableDictionary dictionaryWithDictionary: pathMetrics];
+
+  if (metricsPath) {
+    NSTimeInterval elapsed = now - metricsSampleTime;
+
+    if (elapsed > 0) {
+      double files = (metricsFiles + metricsUnchanged + metricsFailed
+                        - metricsSampleFiles) / elapsed;
+      double bytes = (metricsBytes - metricsSampleBytes) / elapsed;
+
+      if (metricsSampleTime == metricsStart) {
+        metricsFileRate = files;
+        metricsByteRate = bytes;
+      } else {
+        metricsFileRate = RATE_WEIGHT * files + (1 - RATE_WEIGHT) * metricsFileRate;
+        metricsByteRate = RATE_WEIGHT * bytes + (1 - RATE_WEIGHT) * metricsByteRate;
+      }
+      metricsSampleTime = now;
+      metricsSampleFiles = metricsFiles + metricsUnchanged + metricsFailed;
+      metricsSampleBytes = metricsBytes;
+    }
+
+    [paths setObject: [self metricsOfRunAt: now] forKey: metricsPath];
+  }
+
+  report = [NSMutableDictionary dictionary];
+  [report setObject: [paths allValues] forKey: @"paths"];
+  [report setObject: [NSDate date] forKey: @"date"];
+
+  path = [[indexedStatusPath stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: @"metrics.plist"];
+  [report writeToFile: path atomically: YES];
+}
+
+@end
+
+
+@implementation GMDSExtractor (metrics_private)
+
+/* How often the extractors hit the limit, since mdextractor started. */
+- (unsigned long)exceededLimits:(NSString *)limit
+{
+  NSString *key = [limit stringByAppendingString: @"_exceeded"];
+  unsigned long count = 0;
+  NSEnumerator *e;
+  NSDictionary *stats;
+
+  if (costLock == nil) {
+    return 0;
+  }
+
+  [costLock lock];
+  e = [extractorStats objectEnumerator];
+  while ((stats = [e nextObject])) {
+    count += [[stats objectForKey: key] unsignedLongValue];
+  }
+  [costLock unlock];
+
+  return count;
+}
+
+- (NSDictionary *)metricsOfRunAt:(NSTimeInterval)now
+{
+  NSMutableDictionary *run = [NSMutableDictionary dictionary];
+  NSTimeInterval elapsed = now - metricsStart;
+  unsigned long done = metricsFiles + metricsUnchanged + metricsFailed;
+  unsigned long walked;
+  unsigned long skipped;
+  unsigned long total;
+  NSUInteger queued[3] = { 0, 0, 0 };
+  NSUInteger active = 0;
+  BOOL walkDone;
+
+  [pipeLock lock];
+  walked = metricsWalked;
+  skipped = metricsSkipped;
+  walkDone = (walking == NO);
+  if (pipeRunning > 0) {
+    queued[0] = [walkedItems count];
+    queued[1] = [typedItems count];
+    queued[2] = [extractedItems count];
+    active = pipeActive;
+  }
+  [pipeLock unlock];
+
+  [run setObject: metricsPath forKey: @"path"];
+  [run setObject: @"indexing" forKey: @"state"];
+  [run setObject: [NSDate dateWithTimeIntervalSinceReferenceDate: metricsStart]
+          forKey: @"start"];
+  [run setObject: [NSDate dateWithTimeIntervalSinceReferenceDate: metricsProgressTime]
+          forKey: @"last_progress"];
+  [run setObject: [NSNumber numberWithUnsignedLong: metricsFiles] forKey: @"files"];
+  [run setObject: [NSNumber numberWithUnsignedLongLong: metricsBytes] forKey: @"bytes"];
+  [run setObject: [NSNumber numberWithUnsignedLong: metricsUnchanged] forKey: @"unchanged"];
+  [run setObject: [NSNumber numberWithUnsignedLong: metricsFailed] forKey: @"failed"];
+  [run setObject: [NSNumber numberWithUnsignedLong: skipped] forKey: @"skipped"];
+  [run setObject: [NSNumber numberWithUnsignedLong:
+                              [self exceededLimits: @"max_time"] - metricsTimeouts]
+          forKey: @"timeouts"];
+  [run setObject: [NSNumber numberWithUnsignedLong:
+                              [self exceededLimits: @"max_bytes"] - metricsTooBig]
+          forKey: @"too_big"];
+  [run setObject: [NSNumber numberWithDouble: metricsDbTime] forKey: @"db_write_time"];
+  [run setObject: [NSNumber numberWithDouble: metricsFileRate] forKey: @"files_per_second"];
+  [run setObject: [NSNumber numberWithDouble: metricsByteRate] forKey: @"bytes_per_second"];
+  [run setObject: [NSNumber numberWithDouble: (elapsed > 0 ? done / elapsed : 0)]
+          forKey: @"average_files_per_second"];
+  [run setObject: [NSNumber numberWithDouble: (elapsed > 0 ? metricsBytes / elapsed : 0)]
+          forKey: @"average_bytes_per_second"];
+
+  [run setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                    [NSNumber numberWithUnsignedInteger: queued[0]], @"walked",
+                    [NSNumber numberWithUnsignedInteger: queued[1]], @"typed",
+                    [NSNumber numberWithUnsignedInteger: active], @"extracting",
+                    [NSNumber numberWithUnsignedInteger: queued[2]], @"extracted",
+                    nil]
+          forKey: @"queue"];
+  [run setObject: [NSNumber numberWithUnsignedInteger:
+                              queued[0] + queued[1] + queued[2] + active]
+          forKey: @"queue_depth"];
+
+  /* all the walker saw once it is done, else the last count if more */
+  total = walkDone ? walked : MAX(walked, metricsExpected);
+  [run setObject: [NSNumber numberWithUnsignedLong: total] forKey: @"expected_files"];
+  [run setObject: [NSNumber numberWithBool: walkDone] forKey: @"walk_done"];
+
+  if (total > done && metricsFileRate > 0) {
+    [run setObject: [NSNumber numberWithDouble: (total - done) / metricsFileRate]
+            forKey: @"eta"];
+  }
+
+  return run;
+}
+
+@end
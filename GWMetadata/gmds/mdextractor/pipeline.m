@@ -0,0 +1,598 @@
+/* pipeline.m
+ *
+ * The staged indexing of a directory tree: a walker thread, a pool of
+ * extraction workers and the thread owning the db, which does all the
+ * writing.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+
+#import "mdextractor.h"
+
+#define GWDebugLog(format, args...) \
+  do { if (GW_DEBUG_LOG) \
+    NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* Entries the walker may get ahead of the workers, and entries typed
+ * and waiting for a worker. */
+#define WALK_QUEUE 512
+#define EXTRACT_QUEUE 256
+
+#define MAX_WORKERS 8
+#define UPDATE_COUNT 100
+
+/* The key under which a worker thread keeps the entry it is extracting. */
+#define ITEM_KEY @"GMDSExtractionItem"
+
+
+@interface GMDSExtractionItem : NSObject
+{
+@public
+  NSString *path;
+  GMDSFileStat st;
+  NSDictionary *attributes;
+  NSString *type;
+  NSDictionary *mddict;
+  BOOL hasextractor;
+  BOOL failed;
+  BOOL done;
+}
+
+- (id)initWithPath:(NSString *)apath
+          fileStat:(const GMDSFileStat *)stat;
+
+@end
+
+@implementation GMDSExtractionItem
+
+- (void)dealloc
+{
+  RELEASE (path);
+  TEST_RELEASE (attributes);
+  TEST_RELEASE (type);
+  TEST_RELEASE (mddict);
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)apath
+          fileStat:(const GMDSFileStat *)stat
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (path, apath);
+    st = *stat;
+    attributes = nil;
+    type = nil;
+    mddict = nil;
+    hasextractor = NO;
+    failed = NO;
+    done = NO;
+  }
+
+  return self;
+}
+
+@end
+
+
+@interface GMDSExtractor (pipeline_private)
+
+- (BOOL)writeExtractedItem:(GMDSExtractionItem *)item;
+
+- (void)checkpointPath:(GMDSIndexablePath *)indpath
+             withOrder:(NSMutableArray *)order;
+
+- (void)stopPipeline;
+
+@end
+
+
+@implementation GMDSExtractor (pipeline)
+
+/*
+ * Indexes everything below the path.  Reading the tree and the file
+ * contents happens on other threads; this one resolves the file types,
+ * since NSWorkspace is not thread safe, and does all the db writing,
+ * in the grouped transactions of -beginUpdate.  It also keeps its run
+ * loop going, for the status timer and the DO connections.
+ */
+- (unsigned long)extractContentsOfPath:(GMDSIndexablePath *)indpath
+                            filesCount:(unsigned long)fcount
+{
+  NSString *path = [indpath path];
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSInteger workers = [defaults integerForKey: @"GSMetadataExtractionThreads"];
+  NSArray *excluded = radixPathsOfTree(excludedPathsTree);
+  NSMutableArray *order = [NSMutableArray array];
+  NSUInteger i;
+
+  if (workers <= 0) {
+    workers = [[NSProcessInfo processInfo] processorCount];
+  }
+  workers = (workers < 1) ? 1 : ((workers > MAX_WORKERS) ? MAX_WORKERS : workers);
+
+  /* the walker gets its own copy of the exclusions, which can change
+     under it while this thread runs its loop */
+  ASSIGN (walkSuffixes, [NSSet setWithSet: excludedSuffixes]);
+  walkExcludedTree = newRadixTreeWithIdentifier(@"walkexcluded");
+  for (i = 0; i < [excluded count]; i++) {
+    radixInsertComponentsOfPath([excluded objectAtIndex: i], walkExcludedTree);
+  }
+  ASSIGN (walkResumePath, [indpath resumePath]);
+
+  if (pipeLock == nil) {
+    pipeLock = [NSCondition new];
+    walkedItems = [NSMutableArray new];
+    typedItems = [NSMutableArray new];
+    extractedItems = [NSMutableArray new];
+  }
+
+  walking = YES;
+  feeding = YES;
+  pipeCancelled = NO;
+  pipeActive = 0;
+  pipeRunning = workers + 1;
+
+  [NSThread detachNewThreadSelector: @selector(walkPath:)
+                           toTarget: self
+                         withObject: path];
+
+  for (i = 0; i < (NSUInteger)workers; i++) {
+    [NSThread detachNewThreadSelector: @selector(extractionWorkerLoop:)
+                             toTarget: self
+                           withObject: nil];
+  }
+
+  while (1) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSMutableArray *walked = [NSMutableArray array];
+    NSArray *extracted;
+    NSUInteger room;
+    BOOL done;
+
+    [pipeLock lock];
+
+    if ([extractedItems count] == 0
+          && ([walkedItems count] == 0 || [typedItems count] >= EXTRACT_QUEUE)) {
+      [pipeLock waitUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+
+    room = ([typedItems count] < EXTRACT_QUEUE) ? (EXTRACT_QUEUE - [typedItems count]) : 0;
+    room = (room < [walkedItems count]) ? room : [walkedItems count];
+
+    if (room > 0) {
+      [walked addObjectsFromArray: [walkedItems subarrayWithRange: NSMakeRange(0, room)]];
+      [walkedItems removeObjectsInRange: NSMakeRange(0, room)];
+      [pipeLock broadcast];
+    }
+
+    extracted = [NSArray arrayWithArray: extractedItems];
+    [extractedItems removeAllObjects];
+
+    /* a worker hands its entry over before it stops counting as active */
+    done = (feeding == NO && [typedItems count] == 0 && pipeActive == 0);
+
+    [pipeLock unlock];
+
+    [order addObjectsFromArray: walked];
+
+    /* what the db has as it is goes no further */
+    for (i = 0; i < [walked count]; i++) {
+      GMDSExtractionItem *item = [walked objectAtIndex: i];
+
+      if ([self skipsUnchangedPath: item->path fileStat: &item->st]) {
+        GWDebugLog(@"unchanged: %@", item->path);
+        item->done = YES;
+        [walked removeObjectAtIndex: i];
+        i--;
+        fcount++;
+        [self metricsCountFile: 0 changed: NO];
+        continue;
+      }
+
+      ASSIGN (item->type, [self fileTypeOfPath: item->path fileStat: &item->st]);
+    }
+
+    if (feeding) {
+      [pipeLock lock];
+      [typedItems addObjectsFromArray: walked];
+      if (walking == NO && [walkedItems count] == 0) {
+        feeding = NO;
+      }
+      [pipeLock broadcast];
+      [pipeLock unlock];
+    }
+
+    for (i = 0; i < [extracted count]; i++) {
+      GMDSExtractionItem *item = [extracted objectAtIndex: i];
+
+      item->done = YES;
+
+      if ([self writeExtractedItem: item]) {
+        fcount++;
+        [self metricsCountFile: (item->st.isdir ? 0 : (unsigned long long)item->st.size)
+                       changed: YES];
+
+        if ((fcount % UPDATE_COUNT) == 0) {
+          [self updateStatusOfPath: indpath
+                         startTime: nil
+                           endTime: nil
+                        filesCount: fcount
+                       indexedDone: NO];
+
+          GWDebugLog(@"updating %lu", fcount);
+        }
+
+        if (item->hasextractor == NO) {
+          GWDebugLog(@"no extractor for: %@", item->path);
+        } else {
+          GWDebugLog(@"extracted: %@", item->path);
+        }
+
+      } else {
+        [self metricsCountFailure];
+        [self logError: [NSString stringWithFormat: @"EXTRACT %@", item->path]];
+        GWDebugLog(@"error extracting at: %@", item->path);
+      }
+
+      [self checkpointPath: indpath withOrder: order];
+    }
+
+    [[NSRunLoop currentRunLoop]
+          runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.001]];
+
+    [self checkpointPath: indpath withOrder: order];
+
+    RELEASE (arp);
+
+    if (done) {
+      break;
+    }
+
+    if (extracting == NO) {
+      GWDebugLog(@"stopped");
+      [self stopPipeline];
+      break;
+    }
+  }
+
+  [self commitUpdates: nil];
+  [self checkpointPath: indpath withOrder: order];
+
+  /* the threads must be gone before the next run reuses the queues */
+  [pipeLock lock];
+  while (pipeRunning > 0) {
+    [pipeLock wait];
+  }
+  [walkedItems removeAllObjects];
+  [typedItems removeAllObjects];
+  [extractedItems removeAllObjects];
+  [pipeLock unlock];
+
+  radixFreeTree(walkExcludedTree);
+  walkExcludedTree = NULL;
+  DESTROY (walkSuffixes);
+  DESTROY (walkResumePath);
+
+  return fcount;
+}
+
+/*
+ * Called by -setMetadata:forPath:withID: on a worker thread: the
+ * metadata goes with the entry to the writing thread.
+ */
+- (BOOL)capturesMetadata:(NSDictionary *)mddict
+{
+  GMDSExtractionItem *item;
+
+  if ([NSThread isMainThread]) {
+    return NO;
+  }
+
+  item = [[[NSThread currentThread] threadDictionary] objectForKey: ITEM_KEY];
+
+  if (item == nil) {
+    return NO;
+  }
+
+  ASSIGN (item->mddict, mddict);
+
+  return YES;
+}
+
+/*
+ * The walk goes depth first with the entries of each directory in
+ * sorted order, so that the last entry committed tells where a run
+ * stopped: entries up to walkResumePath are not walked again.
+ */
+- (void)walkPath:(NSString *)path
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSArray *components = nil;
+
+  if (walkResumePath && subPathOfPath(path, walkResumePath)) {
+    NSString *relative = [walkResumePath substringFromIndex: [path length]];
+
+    components = [relative pathComponents];
+    if ([components count] && [[components objectAtIndex: 0] isEqual: path_separator()]) {
+      components = [components subarrayWithRange: NSMakeRange(1, [components count] - 1)];
+    }
+    GWDebugLog(@"resuming %@ after %@", path, walkResumePath);
+  }
+
+  [self walkDirectory: path resumingAt: components];
+
+  [pipeLock lock];
+  walking = NO;
+  pipeRunning--;
+  [pipeLock broadcast];
+  [pipeLock unlock];
+
+  RELEASE (pool);
+}
+
+/*
+ * components is the rest of the path of the resume entry below dir;
+ * that entry, and whatever comes before it, was done.  NO once the
+ * pipeline is cancelled.
+ */
+- (BOOL)walkDirectory:(NSString *)dir
+           resumingAt:(NSArray *)components
+{
+  NSFileManager *wfm = [NSFileManager defaultManager];
+  NSArray *names = [[wfm directoryContentsAtPath: dir] 
+                          sortedArrayUsingSelector: @selector(compare:)];
+  NSString *first = ([components count] ? [components objectAtIndex: 0] : nil);
+  NSUInteger i;
+
+  for (i = 0; i < [names count]; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSString *name = [names objectAtIndex: i];
+    NSString *subpath;
+    NSString *ext;
+    GMDSFileStat st;
+    BOOL resumed = NO;
+    BOOL skipped = NO;
+    BOOL cancelled;
+    BOOL skip;
+
+    if (first) {
+      NSComparisonResult order = [name compare: first];
+
+      if (order == NSOrderedAscending) {
+        RELEASE (arp);
+        continue;
+      }
+      resumed = (order == NSOrderedSame);
+    }
+
+    subpath = [dir stringByAppendingPathComponent: name];
+    ext = [[subpath pathExtension] lowercaseString];
+
+    skip = ([walkSuffixes containsObject: ext]
+              || isHiddenFile(subpath)
+              || radixInTreeFirstPartOfPath(subpath, walkExcludedTree));
+
+    if (statPath(subpath, &st)) {
+      if (skip) {
+        GWDebugLog(@"skipping %@", subpath);
+        skipped = YES;
+
+      } else {
+        if (resumed == NO) {
+          GMDSExtractionItem *item = [[GMDSExtractionItem alloc] initWithPath: subpath
+                                                                     fileStat: &st];
+          [pipeLock lock];
+
+          while ([walkedItems count] >= WALK_QUEUE && pipeCancelled == NO) {
+            [pipeLock wait];
+          }
+          [walkedItems addObject: item];
+          metricsWalked++;
+          [pipeLock broadcast];
+          [pipeLock unlock];
+
+          RELEASE (item);
+        }
+
+        if (st.isdir) {
+          NSArray *rest = nil;
+
+          if (resumed) {
+            rest = [components subarrayWithRange: NSMakeRange(1, [components count] - 1)];
+          }
+          if ([self walkDirectory: subpath resumingAt: rest] == NO) {
+            RELEASE (arp);
+            return NO;
+          }
+        }
+      }
+    }
+
+    RELEASE (arp);
+
+    [pipeLock lock];
+    if (skipped) {
+      metricsSkipped++;
+    }
+    cancelled = pipeCancelled;
+    [pipeLock unlock];
+
+    if (cancelled) {
+      return NO;
+    }
+  }
+
+  return YES;
+}
+
+/*
+ * Each worker finds the extractor for an entry and runs it.  The
+ * extractors are shared by the workers and keep no per-file state in
+ * their instances; the metadata they set is captured, see
+ * -capturesMetadata:.
+ */
+- (void)extractionWorkerLoop:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSMutableDictionary *tdict = [[NSThread currentThread] threadDictionary];
+
+  [pipeLock lock];
+
+  while (1) {
+    GMDSExtractionItem *item;
+
+    while ([typedItems count] == 0 && feeding && pipeCancelled == NO) {
+      [pipeLock wait];
+    }
+    if (pipeCancelled || [typedItems count] == 0) {
+      break;
+    }
+
+    item = RETAIN ([typedItems objectAtIndex: 0]);
+    [typedItems removeObjectAtIndex: 0];
+    pipeActive++;
+    [pipeLock unlock];
+
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      id extractor;
+
+      [tdict setObject: item forKey: ITEM_KEY];
+
+      /* the walker only had it stat'ed */
+      ASSIGN (item->attributes, [[NSFileManager defaultManager] 
+                                    fileAttributesAtPath: item->path traverseLink: NO]);
+
+      NS_DURING
+        {
+          extractor = nil;
+
+          if (item->attributes == nil) {
+            item->failed = YES;
+          } else {
+            extractor = [self extractorForPath: item->path
+                                        ofType: item->type
+                                withAttributes: item->attributes];
+          }
+
+          if (extractor) {
+            item->hasextractor = YES;
+
+            if ([self runExtractor: extractor
+                            atPath: item->path
+                            withID: 0
+                        attributes: item->attributes] == NO) {
+              item->failed = YES;
+            }
+          }
+        }
+      NS_HANDLER
+        {
+          NSDebugLLog(@"gwspace", @"extracting %@: %@", item->path, localException);
+          item->failed = YES;
+        }
+      NS_ENDHANDLER
+
+      [tdict removeObjectForKey: ITEM_KEY];
+      RELEASE (arp);
+    }
+
+    [pipeLock lock];
+    [extractedItems addObject: item];
+    RELEASE (item);
+    pipeActive--;
+    [pipeLock broadcast];
+  }
+
+  pipeRunning--;
+  [pipeLock broadcast];
+  [pipeLock unlock];
+
+  RELEASE (pool);
+}
+
+@end
+
+
+@implementation GMDSExtractor (pipeline_private)
+
+- (BOOL)writeExtractedItem:(GMDSExtractionItem *)item
+{
+  NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+  int path_id;
+
+  if (item->failed) {
+    return NO;
+  }
+
+  if ([self beginUpdate] == NO) {
+    return NO;
+  }
+
+  path_id = [self insertOrUpdatePath: item->path
+                              ofType: item->type
+                      withAttributes: item->attributes
+                            fileStat: &item->st];
+
+  if (path_id == -1
+        || (item->mddict && [self setMetadata: item->mddict
+                                      forPath: item->path
+                                       withID: path_id] == NO)) {
+    [self endUpdate: NO];
+    [self metricsAddDbTime: [NSDate timeIntervalSinceReferenceDate] - start];
+    return NO;
+  }
+
+  [self endUpdate: YES];
+  [self metricsAddDbTime: [NSDate timeIntervalSinceReferenceDate] - start];
+
+  return YES;
+}
+
+/*
+ * Moves the checkpoint past the entries done, in the walker's order,
+ * once their changes are committed.  An entry still with a worker
+ * holds it back.
+ */
+- (void)checkpointPath:(GMDSIndexablePath *)indpath
+             withOrder:(NSMutableArray *)order
+{
+  NSString *resume = nil;
+
+  if (inUpdateGroup) {
+    return;
+  }
+
+  while ([order count]) {
+    GMDSExtractionItem *item = [order objectAtIndex: 0];
+
+    if (item->done == NO) {
+      break;
+    }
+    resume = AUTORELEASE (RETAIN (item->path));
+    [order removeObjectAtIndex: 0];
+  }
+
+  if (resume) {
+    [indpath setResumePath: resume];
+  }
+}
+
+/* The walker and the workers give up; whatever they were holding is
+   dropped. */
+- (void)stopPipeline
+{
+  [pipeLock lock];
+  pipeCancelled = YES;
+  [pipeLock broadcast];
+  [pipeLock unlock];
+}
+
+@end
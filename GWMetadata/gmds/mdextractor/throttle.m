@@ -0,0 +1,269 @@
+/* throttle.m
+ *
+ * How often the scheduled updater checks the next directory: more
+ * often while the user is away, less often when the system is short
+ * of cpu or i/o and when it runs on battery.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+
+#ifdef HAVE_XSS
+  #include <X11/Xlib.h>
+  #include <X11/extensions/scrnsaver.h>
+#endif
+
+#import <Foundation/Foundation.h>
+
+#import "mdextractor.h"
+
+#define GWDebugLog(format, args...) \
+  do { if (GW_DEBUG_LOG) \
+    NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* the interval when nothing says otherwise */
+#define SCHED_TIME (1.0)
+#define SCHED_MIN_TIME (0.25)
+#define SCHED_MAX_TIME (60.0)
+
+/* how long the load is taken as it was last read */
+#define LOAD_SAMPLE_TIME (5.0)
+/* how often scheduler.plist is rewritten when the interval stays */
+#define SCHED_REPORT_TIME (30.0)
+
+/* the user is away after this many seconds without input */
+#define IDLE_TIME (300.0)
+/* share of time, over the last 10 seconds, some task waited */
+#define PRESSURE_LOW (10.0)
+#define PRESSURE_HIGH (40.0)
+
+#define POWER_SUPPLY_DIR "/sys/class/power_supply"
+
+
+/*
+ * The "some avg10" of a pressure stall file, or -1 on kernels
+ * without PSI.
+ */
+static double stall_pressure(const char *path)
+{
+  FILE *fp = fopen(path, "r");
+  double avg10 = -1.0;
+
+  if (fp) {
+    if (fscanf(fp, "some avg10=%lf", &avg10) != 1) {
+      avg10 = -1.0;
+    }
+    fclose(fp);
+  }
+
+  return avg10;
+}
+
+static BOOL read_supply_value(const char *supply, const char *name,
+                              char *buf, size_t size)
+{
+  char path[512];
+  FILE *fp;
+  BOOL done = NO;
+
+  snprintf(path, sizeof(path), "%s/%s/%s", POWER_SUPPLY_DIR, supply, name);
+
+  fp = fopen(path, "r");
+  if (fp) {
+    if (fgets(buf, size, fp)) {
+      buf[strcspn(buf, "\n")] = '\0';
+      done = YES;
+    }
+    fclose(fp);
+  }
+
+  return done;
+}
+
+/*
+ * 1 on battery, 0 on mains or on a machine without batteries, -1 when
+ * the power supplies can't be read.
+ */
+static int on_battery(void)
+{
+  DIR *dir = opendir(POWER_SUPPLY_DIR);
+  struct dirent *entry;
+  BOOL battery = NO;
+  BOOL mains = NO;
+
+  if (dir == NULL) {
+    return -1;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    char type[64];
+    char value[64];
+
+    if (entry->d_name[0] == '.'
+          || read_supply_value(entry->d_name, "type", type, sizeof(type)) == NO) {
+      continue;
+    }
+
+    if (strcmp(type, "Battery") == 0) {
+      /* the batteries of a mouse or a keyboard say "device" */
+      if (read_supply_value(entry->d_name, "scope", value, sizeof(value)) == NO
+                                        || strcmp(value, "Device") != 0) {
+        battery = YES;
+      }
+    } else if (read_supply_value(entry->d_name, "online", value, sizeof(value))
+                                                  && strcmp(value, "1") == 0) {
+      mains = YES;
+    }
+  }
+
+  closedir(dir);
+
+  return (battery && (mains == NO)) ? 1 : 0;
+}
+
+/*
+ * Seconds since the last keyboard or mouse input, or -1 without an
+ * X display to ask.
+ */
+static double user_idle_time(void)
+{
+#ifdef HAVE_XSS
+  static Display *display = NULL;
+  static BOOL triedDisplay = NO;
+  static int event_base, error_base;
+  XScreenSaverInfo *info;
+  double idle = -1.0;
+
+  if (triedDisplay == NO) {
+    triedDisplay = YES;
+    display = XOpenDisplay(NULL);
+
+    if (display && (XScreenSaverQueryExtension(display, &event_base, &error_base) == 0)) {
+      XCloseDisplay(display);
+      display = NULL;
+    }
+  }
+
+  if (display == NULL) {
+    return -1.0;
+  }
+
+  info = XScreenSaverAllocInfo();
+
+  if (info) {
+    if (XScreenSaverQueryInfo(display, DefaultRootWindow(display), info)) {
+      idle = info->idle / 1000.0;
+    }
+    XFree(info);
+  }
+
+  return idle;
+#else
+  return -1.0;
+#endif
+}
+
+
+@implementation GMDSExtractor (throttle)
+
+/*
+ * The interval until the next -checkNextDir:.  The load is read again
+ * when the last reading is older than LOAD_SAMPLE_TIME, so this is
+ * cheap to call after every directory.
+ */
+- (NSTimeInterval)scheduledUpdateInterval
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableArray *reasons;
+  NSTimeInterval interval;
+  double cpu, io, pressure, idle;
+  int battery;
+
+  if ((schedInterval > 0) && ((now - schedSampleTime) < LOAD_SAMPLE_TIME)) {
+    return schedInterval;
+  }
+
+  schedSampleTime = now;
+
+  cpu = stall_pressure("/proc/pressure/cpu");
+  io = stall_pressure("/proc/pressure/io");
+  pressure = MAX(cpu, io);
+  idle = user_idle_time();
+  battery = on_battery();
+
+  schedIdleTime = idle;
+  schedPressure = pressure;
+  schedOnBattery = (battery == 1);
+
+  interval = SCHED_TIME;
+  reasons = [NSMutableArray array];
+
+  if (idle >= IDLE_TIME) {
+    interval /= 4;
+    [reasons addObject: @"idle"];
+  }
+
+  if (pressure >= PRESSURE_HIGH) {
+    interval *= 16;
+    [reasons addObject: (cpu >= io) ? @"high cpu pressure" : @"high io pressure"];
+  } else if (pressure >= PRESSURE_LOW) {
+    interval *= 4;
+    [reasons addObject: (cpu >= io) ? @"cpu pressure" : @"io pressure"];
+  }
+
+  if (battery == 1) {
+    interval *= 4;
+    [reasons addObject: @"on battery"];
+  }
+
+  interval = MIN(MAX(interval, SCHED_MIN_TIME), SCHED_MAX_TIME);
+
+  if ((interval != schedInterval) || ((now - schedReportTime) >= SCHED_REPORT_TIME)) {
+    NSMutableDictionary *report = [NSMutableDictionary dictionary];
+    NSString *path = [[indexedStatusPath stringByDeletingLastPathComponent]
+                          stringByAppendingPathComponent: @"scheduler.plist"];
+
+    if (interval != schedInterval) {
+      GWDebugLog(@"scheduled update interval %.2f (%@)", interval, reasons);
+    }
+
+    [report setObject: [NSNumber numberWithDouble: interval] forKey: @"interval"];
+    [report setObject: [NSNumber numberWithDouble: 60.0 / interval]
+               forKey: @"checks_per_minute"];
+    [report setObject: ([reasons count] ? [reasons componentsJoinedByString: @", "]
+                                        : @"normal")
+               forKey: @"reason"];
+    [report setObject: [NSNumber numberWithDouble: cpu] forKey: @"cpu_pressure"];
+    [report setObject: [NSNumber numberWithDouble: io] forKey: @"io_pressure"];
+    [report setObject: [NSNumber numberWithDouble: idle] forKey: @"idle_time"];
+    [report setObject: [NSNumber numberWithBool: (battery == 1)] forKey: @"on_battery"];
+    [report setObject: [NSDate date] forKey: @"date"];
+
+    [report writeToFile: path atomically: YES];
+    schedReportTime = now;
+  }
+
+  schedInterval = interval;
+
+  return schedInterval;
+}
+
+/*
+ * Whether the system has cpu, i/o and power to spare and the user is
+ * away, or there is no X display to tell: the time for the work that
+ * can wait.
+ */
+- (BOOL)systemIsIdle
+{
+  [self scheduledUpdateInterval];
+
+  return ((schedOnBattery == NO) && (schedPressure < PRESSURE_LOW)
+            && ((schedIdleTime >= IDLE_TIME) || (schedIdleTime < 0)));
+}
+
+@end
@@ -0,0 +1,454 @@
+/* tokenizer.h
+ *
+ * The word scanner the text extractors share.  It runs over the bytes
+ * of a file, mapped or in memory, as UTF-8, splits them into words,
+ * folds ASCII case in the copy it counts (the contents index folds the
+ * rest) and gives -setMetadata: the text it puts into the index as it
+ * is, without a word set to walk.
+ *
+ * ASCII goes sixteen bytes at a time (SSE2 where the compiler has it,
+ * eight otherwise): only its letters make words.  Other characters are
+ * decoded and looked up in the extractor's skip set, as the NSScanner
+ * this replaces did.  Bytes that are not UTF-8 are read as Latin-1.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GMDS_TOKENIZER_H
+#define GMDS_TOKENIZER_H
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#import <Foundation/Foundation.h>
+
+/* A word is kept if it is longer than GMDS_WORD_MIN and shorter than
+ * GMDS_WORD_MAX characters (UTF-16 units, as NSString counts them). */
+#define GMDS_WORD_MIN 3
+#define GMDS_WORD_MAX 40
+#define GMDS_WORD_BYTES (GMDS_WORD_MAX * 4)
+
+#define GMDS_TABLE_SIZE 1024
+
+typedef struct {
+  uint32_t hash;
+  uint32_t offset;         /* in keys */
+  uint32_t length;
+  uint32_t count;          /* 0 for a free slot */
+} GMDSWordEntry;
+
+typedef struct {
+  id skipSet;
+  BOOL (*isSkipped)(id, SEL, UTF32Char);
+
+  GMDSWordEntry *entries;  /* open addressing, linear probing */
+  uint32_t capacity;       /* a power of two */
+  uint32_t used;
+  char *keys;
+  size_t keysLength;
+  size_t keysCapacity;
+  size_t textLength;
+
+  unsigned long wcount;    /* every word found, kept or not */
+
+  uint8_t word[GMDS_WORD_BYTES];
+  unsigned wordBytes;
+  unsigned wordUnits;
+  BOOL inWord;
+} GMDSTokenizer;
+
+
+static inline void GMDSTokenizerInit(GMDSTokenizer *tk, NSCharacterSet *skipSet)
+{
+  SEL sel = @selector(longCharacterIsMember:);
+
+  memset(tk, 0, sizeof(GMDSTokenizer));
+
+  tk->skipSet = skipSet;
+  tk->isSkipped = (BOOL (*)(id, SEL, UTF32Char))[skipSet methodForSelector: sel];
+  tk->capacity = GMDS_TABLE_SIZE;
+  tk->entries = NSZoneCalloc(NSDefaultMallocZone(), tk->capacity, sizeof(GMDSWordEntry));
+  tk->keysCapacity = GMDS_TABLE_SIZE * 8;
+  tk->keys = NSZoneMalloc(NSDefaultMallocZone(), tk->keysCapacity);
+}
+
+static inline void GMDSTokenizerDestroy(GMDSTokenizer *tk)
+{
+  NSZoneFree(NSDefaultMallocZone(), tk->entries);
+  NSZoneFree(NSDefaultMallocZone(), tk->keys);
+  tk->entries = NULL;
+  tk->keys = NULL;
+}
+
+/* FNV-1a */
+static inline uint32_t GMDSWordHash(const uint8_t *s, unsigned len)
+{
+  uint32_t h = 2166136261u;
+  unsigned i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ s[i]) * 16777619u;
+  }
+
+  return h;
+}
+
+static inline void GMDSTokenizerGrow(GMDSTokenizer *tk)
+{
+  uint32_t capacity = tk->capacity * 2;
+  uint32_t mask = capacity - 1;
+  GMDSWordEntry *entries = NSZoneCalloc(NSDefaultMallocZone(), capacity, sizeof(GMDSWordEntry));
+  uint32_t i;
+
+  for (i = 0; i < tk->capacity; i++) {
+    GMDSWordEntry *e = &tk->entries[i];
+
+    if (e->count) {
+      uint32_t j = e->hash & mask;
+
+      while (entries[j].count) {
+        j = (j + 1) & mask;
+      }
+      entries[j] = *e;
+    }
+  }
+
+  NSZoneFree(NSDefaultMallocZone(), tk->entries);
+  tk->entries = entries;
+  tk->capacity = capacity;
+}
+
+/* The end of a word: counted, and kept if its length is right. */
+static inline void GMDSTokenizerEndWord(GMDSTokenizer *tk)
+{
+  tk->wcount++;
+
+  if (tk->wordUnits > GMDS_WORD_MIN && tk->wordUnits < GMDS_WORD_MAX) {
+    uint32_t hash = GMDSWordHash(tk->word, tk->wordBytes);
+    uint32_t mask = tk->capacity - 1;
+    uint32_t i = hash & mask;
+    GMDSWordEntry *e;
+
+    while ((e = &tk->entries[i])->count) {
+      if (e->hash == hash && e->length == tk->wordBytes
+              && memcmp(tk->keys + e->offset, tk->word, e->length) == 0) {
+        break;
+      }
+      i = (i + 1) & mask;
+    }
+
+    if (e->count == 0) {
+      if (tk->keysLength + tk->wordBytes > tk->keysCapacity) {
+        tk->keysCapacity *= 2;
+        tk->keys = NSZoneRealloc(NSDefaultMallocZone(), tk->keys, tk->keysCapacity);
+      }
+      memcpy(tk->keys + tk->keysLength, tk->word, tk->wordBytes);
+      e->hash = hash;
+      e->offset = (uint32_t)tk->keysLength;
+      e->length = tk->wordBytes;
+      tk->keysLength += tk->wordBytes;
+      tk->used++;
+    }
+
+    e->count++;
+    tk->textLength += tk->wordBytes + 1;
+
+    if (tk->used * 4 > tk->capacity * 3) {
+      GMDSTokenizerGrow(tk);
+    }
+  }
+
+  tk->wordBytes = 0;
+  tk->wordUnits = 0;
+  tk->inWord = NO;
+}
+
+/* ASCII letters, folded to lower case as they are copied. */
+static inline void GMDSTokenizerAppendASCII(GMDSTokenizer *tk, const uint8_t *p, unsigned n)
+{
+  unsigned i;
+
+  for (i = 0; i < n && tk->wordBytes < GMDS_WORD_BYTES; i++) {
+    tk->word[tk->wordBytes++] = p[i] | 0x20;
+  }
+  tk->wordUnits += n;
+}
+
+/*
+ * n bytes of ASCII; bit i of letters is set if p[i] is a letter.  Runs
+ * of letters and of anything else are stepped over whole.
+ */
+static inline void GMDSTokenizerASCIIBlock(GMDSTokenizer *tk, const uint8_t *p,
+                                           uint32_t letters, unsigned n)
+{
+  unsigned i = 0;
+
+  while (i < n) {
+    uint32_t rest = letters >> i;
+
+    if (tk->inWord) {
+      /* the bits past n are clear, so this stops at n at most */
+      unsigned run = __builtin_ctz(~rest);
+
+      GMDSTokenizerAppendASCII(tk, p + i, run);
+      i += run;
+
+      if (i < n) {
+        GMDSTokenizerEndWord(tk);
+      }
+    } else if (rest == 0) {
+      break;
+    } else {
+      i += __builtin_ctz(rest);
+      tk->inWord = YES;
+    }
+  }
+}
+
+static inline void GMDSTokenizerCharacter(GMDSTokenizer *tk, UTF32Char c)
+{
+  if (c < 0x80) {
+    if ((unsigned)((c | 0x20) - 'a') < 26) {
+      uint8_t b = (uint8_t)c;
+
+      tk->inWord = YES;
+      GMDSTokenizerAppendASCII(tk, &b, 1);
+
+    } else if (tk->inWord) {
+      GMDSTokenizerEndWord(tk);
+    }
+
+  } else if (tk->isSkipped(tk->skipSet, @selector(longCharacterIsMember:), c) == NO) {
+    uint8_t *w = tk->word + tk->wordBytes;
+
+    tk->inWord = YES;
+
+    if (tk->wordBytes + 4 <= GMDS_WORD_BYTES) {
+      if (c < 0x800) {
+        w[0] = 0xC0 | (c >> 6);
+        w[1] = 0x80 | (c & 0x3F);
+        tk->wordBytes += 2;
+      } else if (c < 0x10000) {
+        w[0] = 0xE0 | (c >> 12);
+        w[1] = 0x80 | ((c >> 6) & 0x3F);
+        w[2] = 0x80 | (c & 0x3F);
+        tk->wordBytes += 3;
+      } else {
+        w[0] = 0xF0 | (c >> 18);
+        w[1] = 0x80 | ((c >> 12) & 0x3F);
+        w[2] = 0x80 | ((c >> 6) & 0x3F);
+        w[3] = 0x80 | (c & 0x3F);
+        tk->wordBytes += 4;
+      }
+    }
+    tk->wordUnits += (c > 0xFFFF) ? 2 : 1;
+
+  } else if (tk->inWord) {
+    GMDSTokenizerEndWord(tk);
+  }
+}
+
+/*
+ * The character at p, which is not ASCII, and its length in bytes; 0
+ * if it may go on past end.  Anything that is not UTF-8 is one Latin-1
+ * byte.
+ */
+static inline unsigned GMDSDecodeUTF8(const uint8_t *p, const uint8_t *end,
+                                      BOOL last, UTF32Char *c)
+{
+  uint8_t b = p[0];
+  unsigned n;
+  UTF32Char min;
+  unsigned i;
+
+  if (b >= 0xC2 && b <= 0xDF) {
+    n = 2; min = 0x80; *c = b & 0x1F;
+  } else if (b >= 0xE0 && b <= 0xEF) {
+    n = 3; min = 0x800; *c = b & 0x0F;
+  } else if (b >= 0xF0 && b <= 0xF4) {
+    n = 4; min = 0x10000; *c = b & 0x07;
+  } else {
+    *c = b;
+    return 1;
+  }
+
+  for (i = 1; i < n; i++) {
+    if (p + i >= end) {
+      if (last == NO) {
+        return 0;
+      }
+      break;
+    }
+    if ((p[i] & 0xC0) != 0x80) {
+      break;
+    }
+    *c = (*c << 6) | (p[i] & 0x3F);
+  }
+
+  if (i < n || *c < min || *c > 0x10FFFF || (*c >= 0xD800 && *c <= 0xDFFF)) {
+    *c = b;
+    return 1;
+  }
+
+  return n;
+}
+
+/*
+ * Scans len bytes and returns how many it used: all of them, unless a
+ * character is cut at the end of a chunk that is not the last one; the
+ * rest go at the head of the next chunk.
+ */
+static inline size_t GMDSTokenizerFeed(GMDSTokenizer *tk, const char *bytes,
+                                       size_t len, BOOL last)
+{
+  const uint8_t *start = (const uint8_t *)bytes;
+  const uint8_t *p = start;
+  const uint8_t *end = p + len;
+
+  while (p < end) {
+    UTF32Char c;
+    unsigned n;
+
+#if defined(__SSE2__)
+    if (end - p >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)p);
+
+      if (_mm_movemask_epi8(v) == 0) {
+        __m128i l = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i m = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1)));
+
+        GMDSTokenizerASCIIBlock(tk, p, (uint32_t)_mm_movemask_epi8(m), 16);
+        p += 16;
+        continue;
+      }
+    }
+#else
+    if (end - p >= 8) {
+      uint64_t w;
+
+      memcpy(&w, p, 8);
+
+      if ((w & 0x8080808080808080ULL) == 0) {
+        uint32_t letters = 0;
+        unsigned i;
+
+        for (i = 0; i < 8; i++) {
+          if ((unsigned)((p[i] | 0x20) - 'a') < 26) {
+            letters |= (1u << i);
+          }
+        }
+
+        GMDSTokenizerASCIIBlock(tk, p, letters, 8);
+        p += 8;
+        continue;
+      }
+    }
+#endif
+
+    if (*p < 0x80) {
+      GMDSTokenizerCharacter(tk, *p);
+      p++;
+      continue;
+    }
+
+    n = GMDSDecodeUTF8(p, end, last, &c);
+
+    if (n == 0) {
+      break;
+    }
+
+    GMDSTokenizerCharacter(tk, c);
+    p += n;
+  }
+
+  if (last && tk->inWord) {
+    GMDSTokenizerEndWord(tk);
+  }
+
+  return p - start;
+}
+
+static inline void GMDSTokenizerFeedString(GMDSTokenizer *tk, NSString *str)
+{
+  const char *s = [str UTF8String];
+
+  if (s) {
+    GMDSTokenizerFeed(tk, s, strlen(s), YES);
+  }
+}
+
+/*
+ * The "words" entry of the metadata dictionary: "text" has each word
+ * as many times as it was found, for bm25() to take the frequencies
+ * from, and "wcount" the number of words.
+ */
+static inline NSMutableDictionary *GMDSTokenizerWords(GMDSTokenizer *tk)
+{
+  NSMutableData *data = [NSMutableData dataWithLength: tk->textLength];
+  char *t = [data mutableBytes];
+  NSString *text;
+  uint32_t i;
+
+  for (i = 0; i < tk->capacity; i++) {
+    GMDSWordEntry *e = &tk->entries[i];
+    uint32_t j;
+
+    for (j = 0; j < e->count; j++) {
+      memcpy(t, tk->keys + e->offset, e->length);
+      t += e->length;
+      *t++ = ' ';
+    }
+  }
+
+  text = [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding];
+
+  return [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                AUTORELEASE (text), @"text",
+                                [NSNumber numberWithUnsignedLong: tk->wcount], @"wcount",
+                                nil];
+}
+
+/* The file mapped for reading, or NULL, for an empty one as well. */
+static inline const char *GMDSMapFile(NSString *path, size_t *length)
+{
+  int fd = open([path fileSystemRepresentation], O_RDONLY);
+  struct stat st;
+  void *map;
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) != 0 || S_ISREG(st.st_mode) == 0 || st.st_size == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+  *length = st.st_size;
+
+  return map;
+}
+
+static inline void GMDSUnmapFile(const char *map, size_t length)
+{
+  munmap((void *)map, length);
+}
+
+#endif /* GMDS_TOKENIZER_H */
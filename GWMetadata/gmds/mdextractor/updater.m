@@ -50,7 +50,7 @@ do { \
 #define EXECUTE_OR_ROLLBACK(q, r) \
 do { \
   if ([sqlite executeQuery: q] == NO) { \
-    [sqlite executeQuery: @"ROLLBACK"]; \
+    [self endUpdate: NO]; \
     NSDebugLLog(@"gwspace", @"error at: %@", q); \
     return r; \
   } \
@@ -70,7 +70,7 @@ do { \
     if (u) { \
       setUpdating(NO); \
     } \
-    [sqlite executeQuery: @"ROLLBACK"]; \
+    [self endUpdate: NO]; \
     NSDebugLLog(@"gwspace", @"error at: %@", [s query]); \
     return r; \
   } \
@@ -78,9 +78,10 @@ do { \
 
 
 #define SKIP_EXPIRE (1.0)
+/* how long a path the user opened or edited goes first */
+#define PRIORITY_EXPIRE (600.0)
 #define LOST_PATHS_EXPIRE (60.0)
 #define LOST_PATHS_CHECK (30.0)
-#define SCHED_TIME (1.0)
 #define NOTIF_TIME (60.0)
 
 
@@ -106,7 +107,9 @@ do { \
     BOOL hasextractor = NO;
     int path_id;
     
-    EXECUTE_QUERY (@"BEGIN", NO); 
+    if ([self beginUpdate] == NO) {
+      return NO;
+    }
     setUpdating(YES);
      
     [ws getInfoForFile: path application: &app type: &type];  
@@ -123,9 +126,10 @@ do { \
       if (extractor) {
         hasextractor = YES;
       
-        if ([extractor extractMetadataAtPath: path
-                                      withID: path_id
-                                  attributes: attributes] == NO) {
+        if ([self runExtractor: extractor
+                        atPath: path
+                        withID: path_id
+                    attributes: attributes] == NO) {
           failed = YES;                         
         }
       }
@@ -136,7 +140,7 @@ do { \
     
     if (failed == NO) {
       setUpdating(NO);
-      [sqlite executeQuery: @"COMMIT"];
+      [self endUpdate: YES];
       
       if (hasextractor) {
         GWDebugLog(@"updated: %@", path);
@@ -146,7 +150,7 @@ do { \
       
     } else {
       setUpdating(NO);
-      [sqlite executeQuery: @"ROLLBACK"];
+      [self endUpdate: NO];
       [self logError: [NSString stringWithFormat: @"UPDATE %@", path]];
       GWDebugLog(@"error updating at: %@", path);
       
@@ -169,8 +173,8 @@ do { \
           NSString *ext = [[subpath pathExtension] lowercaseString];
           
           skip = ([excludedSuffixes containsObject: ext]
-                    || isDotFile(subpath) 
-                    || inTreeFirstPartOfPath(subpath, excludedPathsTree));
+                    || isHiddenFile(subpath) 
+                    || radixInTreeFirstPartOfPath(subpath, excludedPathsTree));
         
           attributes = [fm fileAttributesAtPath: subpath traverseLink: NO];
         
@@ -182,7 +186,7 @@ do { \
               NSString *app = nil;
               NSString *type = nil;
               
-              [sqlite executeQuery: @"BEGIN"];
+              [self beginUpdate];
               setUpdating(YES);
               
               [ws getInfoForFile: subpath application: &app type: &type];
@@ -199,9 +203,10 @@ do { \
                 if (extractor) {
                   hasextractor = YES;
 
-                  if ([extractor extractMetadataAtPath: subpath
-                                                withID: path_id
-                                            attributes: attributes] == NO) {
+                  if ([self runExtractor: extractor
+                                  atPath: subpath
+                                  withID: path_id
+                              attributes: attributes] == NO) {
                     failed = YES;                         
                   }
                 }
@@ -211,7 +216,7 @@ do { \
               }
               
               setUpdating(NO);
-              [sqlite executeQuery: @"COMMIT"];
+              [self endUpdate: (failed == NO)];
             }
             
             if (skip) { 
@@ -256,7 +261,9 @@ do { \
     id extractor;
     int path_id;
     
-    EXECUTE_QUERY (@"BEGIN", NO);
+    if ([self beginUpdate] == NO) {
+      return NO;
+    }
     setUpdating(YES);
     
     [ws getInfoForFile: path application: &app type: &type];  
@@ -267,7 +274,7 @@ do { \
     
     if (path_id == -1) {
       setUpdating(NO);
-      [sqlite executeQuery: @"COMMIT"];
+      [self endUpdate: YES];
       return NO;
     }
 
@@ -276,17 +283,18 @@ do { \
                         withAttributes: attributes];
 
     if (extractor) {
-      if ([extractor extractMetadataAtPath: path
-                                    withID: path_id
-                                attributes: attributes] == NO) {
+      if ([self runExtractor: extractor
+                      atPath: path
+                      withID: path_id
+                  attributes: attributes] == NO) {
         setUpdating(NO);                         
-        [sqlite executeQuery: @"COMMIT"];
+        [self endUpdate: YES];
         return NO;
       }
     }
     
     setUpdating(NO);
-    [sqlite executeQuery: @"COMMIT"];
+    [self endUpdate: YES];
   }
   
   return YES;
@@ -296,12 +304,12 @@ do { \
                   oldPath:(NSString *)oldpath
               isDirectory:(BOOL)isdir
 {
-  NSString *qpath = stringForQuery(path);
-  NSString *qoldpath = stringForQuery(oldpath);
   SQLitePreparedStatement *statement;
   NSString *query;
         
-  EXECUTE_QUERY (@"BEGIN", NO);
+  if ([self beginUpdate] == NO) {
+    return NO;
+  }
   setUpdating(YES);
 
   statement = [sqlite statementForQuery: @"DELETE FROM renamed_paths" 
@@ -322,8 +330,8 @@ do { \
 
   statement = [sqlite statementForQuery: query 
                          withIdentifier: @"update_renamed_3"
-                               bindings: SQLITE_TEXT, @":path", qpath, 
-                                         SQLITE_TEXT, @":oldpath", qoldpath, 0];
+                               bindings: SQLITE_TEXT, @":path", path, 
+                                         SQLITE_TEXT, @":oldpath", oldpath, 0];
 
   STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
   
@@ -338,9 +346,9 @@ do { \
 
     statement = [sqlite statementForQuery: query 
                            withIdentifier: @"update_renamed_4"
-                                 bindings: SQLITE_TEXT, @":oldpath", qoldpath,
+                                 bindings: SQLITE_TEXT, @":oldpath", oldpath,
                                            SQLITE_TEXT, @":minpath", 
-          [NSString stringWithFormat: @"%@%@*", qoldpath, path_separator()], 0];
+          [NSString stringWithFormat: @"%@%@*", oldpath, path_separator()], 0];
   } else {
     query = @"INSERT INTO renamed_paths "
             @"(id, path, base, oldbase) "
@@ -351,24 +359,47 @@ do { \
 
     statement = [sqlite statementForQuery: query 
                            withIdentifier: @"update_renamed_5"
-                                 bindings: SQLITE_TEXT, @":oldpath", qoldpath, 0];
+                                 bindings: SQLITE_TEXT, @":oldpath", oldpath, 0];
   }
   
   STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
 
+  /* the entry itself has a new name; the trigram index follows it */
+  query = @"DELETE FROM attributes "
+          @"WHERE key = 'GSMDItemFSName' "
+          @"AND path_id = (SELECT id FROM paths WHERE path = :path)";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"update_renamed_6"
+                               bindings: SQLITE_TEXT, @":path", path, 0];
+
+  STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
+
+  query = @"INSERT INTO attributes (path_id, key, attribute) "
+          @"SELECT id, 'GSMDItemFSName', :name FROM paths WHERE path = :path";
+
+  statement = [sqlite statementForQuery: query 
+                         withIdentifier: @"update_renamed_7"
+                               bindings: SQLITE_TEXT, @":name", 
+                                         [path lastPathComponent], 
+                                         SQLITE_TEXT, @":path", path, 0];
+
+  STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
+
   setUpdating(NO);
-  EXECUTE_QUERY (@"COMMIT", NO);
+  [self endUpdate: YES];
   
   return YES;
 }
 
 - (BOOL)removePath:(NSString *)path
 {
-  NSString *qpath = stringForQuery(path);
   SQLitePreparedStatement *statement;
   NSString *query;
       
-  EXECUTE_QUERY (@"BEGIN", NO);
+  if ([self beginUpdate] == NO) {
+    return NO;
+  }
   setUpdating(YES);
 
   statement = [sqlite statementForQuery: @"DELETE FROM removed_id" 
@@ -384,9 +415,9 @@ do { \
           
   statement = [sqlite statementForQuery: query 
                          withIdentifier: @"remove_path_2"
-                               bindings: SQLITE_TEXT, @":path", qpath,
+                               bindings: SQLITE_TEXT, @":path", path,
                                          SQLITE_TEXT, @":minpath", 
-          [NSString stringWithFormat: @"%@%@*", qpath, path_separator()], 0];
+          [NSString stringWithFormat: @"%@%@*", path, path_separator()], 0];
       
   STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
 
@@ -398,7 +429,7 @@ do { \
 
   STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
 
-  query = @"DELETE FROM postings WHERE path_id IN (SELECT id FROM removed_id)";
+  query = @"DELETE FROM contents WHERE rowid IN (SELECT id FROM removed_id)";
 
   statement = [sqlite statementForQuery: query 
                          withIdentifier: @"remove_path_4"
@@ -415,7 +446,7 @@ do { \
   STATEMENT_EXECUTE_OR_ROLLBACK (statement, YES, NO);
 
   setUpdating(NO);
-  EXECUTE_QUERY (@"COMMIT", NO);
+  [self endUpdate: YES];
 
   return YES;
 }
@@ -440,7 +471,6 @@ do { \
 }
 
 - (NSArray *)filteredDirectoryContentsAtPath:(NSString *)path
-                               escapeEntries:(BOOL)escape
 {
   NSMutableArray *contents = [NSMutableArray array];
   NSEnumerator *enumerator = [[fm directoryContentsAtPath: path] objectEnumerator];
@@ -451,9 +481,9 @@ do { \
     NSString *ext = [[subpath pathExtension] lowercaseString];
     
     if (([excludedSuffixes containsObject: ext] == NO)
-            && (isDotFile(subpath) == NO)
-            && (inTreeFirstPartOfPath(subpath, excludedPathsTree) == NO)) {
-      [contents addObject: (escape ? stringForQuery(subpath) : subpath)];
+            && (isHiddenFile(subpath) == NO)
+            && (radixInTreeFirstPartOfPath(subpath, excludedPathsTree) == NO)) {
+      [contents addObject: subpath];
     }
   }
 
@@ -468,8 +498,16 @@ do { \
 - (void)setupFswatcherUpdater
 {
   fswupdatePaths = [NSMutableArray new];
+  fswupdateChanges = [NSMutableDictionary new];
   fswupdateSkipBuff = [NSMutableDictionary new];
+  priorityPaths = [NSMutableDictionary new];
   lostPaths = [NSMutableArray new];
+  fswupdateFlushing = NO;
+
+  [dnc addObserver: self
+          selector: @selector(pathViewed:)
+	            name: @"GSMetadataPathViewedNotification"
+	          object: nil];
      
   fswupdateTimer = [NSTimer scheduledTimerWithTimeInterval: 1.0 
 						                         target: self 
@@ -519,7 +557,7 @@ do { \
     [dict setObject: event forKey: @"event"];
     [dict setObject: exists forKey: @"exists"];
 
-    if ([fswupdatePaths containsObject: dict] == NO) {
+    {
       NSDictionary *skipInfo = [fswupdateSkipBuff objectForKey: path];
       BOOL caninsert = YES;
 
@@ -545,7 +583,7 @@ do { \
       }
 
       if (caninsert) {
-        [fswupdatePaths insertObject: dict atIndex: 0];
+        [self queueChange: dict];
         GWDebugLog(@"queueing: %@ - %@", path, event);
       }
     }
@@ -554,19 +592,144 @@ do { \
   }                  
 }
 
+/*
+ * What happens to a path between two flushes is folded into one
+ * change: a path created and deleted again is not looked at, one
+ * modified many times is read once, and one deleted and created again
+ * is removed and added in the same flush.  A rename is queued as it
+ * came, and nothing after it folds into a change before it.
+ */
+- (void)queueChange:(NSMutableDictionary *)change
+{
+  NSString *path = [change objectForKey: @"path"];
+  NSString *event = [change objectForKey: @"event"];
+  NSMutableDictionary *pending;
+  NSString *pendingEvent;
+
+  if ([event isEqual: @"GWWatchedPathRenamed"]) {
+    [fswupdatePaths addObject: change];
+    [fswupdateChanges removeAllObjects];
+    return;
+  }
+
+  pending = [fswupdateChanges objectForKey: path];
+
+  if (pending == nil) {
+    [fswupdatePaths addObject: change];
+    [fswupdateChanges setObject: change forKey: path];
+    return;
+  }
+
+  pendingEvent = [pending objectForKey: @"event"];
+
+  if ([event isEqual: @"GWWatchedPathDeleted"]) {
+    if ([pendingEvent isEqual: @"GWFileCreatedInWatchedDirectory"]
+          && [[pending objectForKey: @"removed"] boolValue] == NO) {
+      GWDebugLog(@"dropping: %@", path);
+      [fswupdatePaths removeObjectIdenticalTo: pending];
+      [fswupdateChanges removeObjectForKey: path];
+    } else {
+      [pending setObject: event forKey: @"event"];
+      [pending setObject: [NSNumber numberWithBool: NO] forKey: @"exists"];
+      [pending removeObjectForKey: @"removed"];
+    }
+
+  } else if ([pendingEvent isEqual: @"GWWatchedPathDeleted"]) {
+    [pending setObject: @"GWFileCreatedInWatchedDirectory" forKey: @"event"];
+    [pending setObject: [NSNumber numberWithBool: YES] forKey: @"exists"];
+    [pending setObject: [NSNumber numberWithBool: YES] forKey: @"removed"];
+
+  } else if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]) {
+    /* adding it reads it as well */
+    [pending setObject: event forKey: @"event"];
+  }
+}
+
+/* Paths the user opened, or set attributes of, and the entries of such
+   a directory, are flushed before the others for a while. */
+- (void)markPriorityPath:(NSString *)path
+{
+  [priorityPaths setObject: [NSDate date] forKey: path];
+}
+
+- (BOOL)isPriorityPath:(NSString *)path
+{
+  return ([priorityPaths objectForKey: path] != nil
+            || [priorityPaths objectForKey: [path stringByDeletingLastPathComponent]] != nil);
+}
+
+- (void)pathViewed:(NSNotification *)notif
+{
+  NSString *path = [notif object];
+
+  if ([path isKindOfClass: [NSString class]] && [path isAbsolutePath]) {
+    [self markPriorityPath: path];
+  }
+}
+
+/* The pending changes with those of priority paths first, each run
+   between two renames on its own. */
+- (NSArray *)orderedPendingChanges
+{
+  NSMutableArray *ordered = [NSMutableArray arrayWithCapacity: [fswupdatePaths count]];
+  NSMutableArray *later = [NSMutableArray array];
+  unsigned i;
+
+  for (i = 0; i < [fswupdatePaths count]; i++) {
+    NSDictionary *change = [fswupdatePaths objectAtIndex: i];
+
+    if ([[change objectForKey: @"event"] isEqual: @"GWWatchedPathRenamed"]) {
+      [ordered addObjectsFromArray: later];
+      [later removeAllObjects];
+      [ordered addObject: change];
+
+    } else if ([self isPriorityPath: [change objectForKey: @"path"]]) {
+      [ordered addObject: change];
+
+    } else {
+      [later addObject: change];
+    }
+  }
+
+  [ordered addObjectsFromArray: later];
+
+  return ordered;
+}
+
+/*
+ * A flush is one transaction, committed at its end, so that what a
+ * bulk operation changed shows up at once.  Changes coming in while it
+ * runs wait for the next one.
+ */
 - (void)processPendingChanges:(id)sender
 {
-  if (extracting == NO) {
+  if (extracting == NO && fswupdateFlushing == NO) {
     CREATE_AUTORELEASE_POOL(arp);
+    NSArray *changes = [self orderedPendingChanges];
+    BOOL grouped = NO;
+    unsigned c;
 
-    while ([fswupdatePaths count] > 0) {
-      NSDictionary *dict = [fswupdatePaths lastObject];
+    fswupdateFlushing = YES;
+    [fswupdatePaths removeAllObjects];
+    [fswupdateChanges removeAllObjects];
+
+    if ([changes count]) {
+      grouped = [self beginUpdate];
+    }
+
+    for (c = 0; c < [changes count]; c++) {
+      NSDictionary *dict = [changes objectAtIndex: c];
       NSString *path = [dict objectForKey: @"path"];    
       NSString *event = [dict objectForKey: @"event"];
       NSDate *date = [NSDate dateWithTimeIntervalSinceNow: 0.001];
 
       [[NSRunLoop currentRunLoop] runUntilDate: date]; 
 
+      if ([[dict objectForKey: @"removed"] boolValue]) {
+        GWDebugLog(@"db remove: %@", path);
+        [self removePath: path];
+      }
+
       if ([event isEqual: @"GWWatchedFileModified"]
             || [event isEqual: @"GWFileCreatedInWatchedDirectory"]) {
         if ([fm fileExistsAtPath: path]) {
@@ -662,9 +825,13 @@ do { \
           GWDebugLog(@"add lost path: %@", path);
         }
       }
+    }
 
-      [fswupdatePaths removeLastObject];    
+    if (grouped) {
+      [self endUpdate: YES];
+      [self commitUpdates: nil];
     }
+    fswupdateFlushing = NO;
 
     {
       NSArray *skipPaths = [fswupdateSkipBuff allKeys];
@@ -686,6 +853,20 @@ do { \
       RELEASE (skipPaths);
     }  
 
+    {
+      NSArray *prioPaths = [priorityPaths allKeys];
+      NSDate *now = [NSDate date];
+      unsigned i;
+
+      for (i = 0; i < [prioPaths count]; i++) {
+        NSString *path = [prioPaths objectAtIndex: i];
+
+        if ([now timeIntervalSinceDate: [priorityPaths objectForKey: path]] > PRIORITY_EXPIRE) {
+          [priorityPaths removeObjectForKey: path];
+        }
+      }
+    }  
+
     RELEASE (arp);  
   }
 }
@@ -733,6 +914,7 @@ do { \
                        
 	    [fswatcher registerClient: (id <FSWClientProtocol>)self 
                 isGlobalWatcher: YES];
+      [self sendFSWatcherFilter];
 
       NSDebugLLog(@"gwspace", @"fswatcher connected!");                
     } else {
@@ -741,6 +923,23 @@ do { \
   }
 }
 
+/* What -extractFromPath: would skip anyway never needs sending. */
+- (void)sendFSWatcherFilter
+{
+  NSDictionary *filter;
+
+  if (fswatcher == nil) {
+    return;
+  }
+
+  filter = [NSDictionary dictionaryWithObjectsAndKeys:
+                           radixPathsOfTree(excludedPathsTree), @"excludePaths",
+                         [excludedSuffixes allObjects], @"excludedSuffixes",
+                         [NSNumber numberWithBool: YES], @"skipDotFiles", nil];
+
+  [fswatcher client: (id <FSWClientProtocol>)self setFilter: filter];
+}
+
 - (void)fswatcherConnectionDidDie:(NSNotification *)notif
 {
   id connection = [notif object];
@@ -846,11 +1045,16 @@ do { \
     NSString *ext = [[path pathExtension] lowercaseString];
 
     if (([excludedSuffixes containsObject: ext] == NO)
-              && (isDotFile(path) == NO)
-              && inTreeFirstPartOfPath(path, includePathsTree)
-              && (inTreeFirstPartOfPath(path, excludedPathsTree) == NO)) {
+              && (isHiddenFile(path) == NO)
+              && radixInTreeFirstPartOfPath(path, includePathsTree)
+              && (radixInTreeFirstPartOfPath(path, excludedPathsTree) == NO)) {
       GWDebugLog(@"ddbd_update: %@", path);        
-      [self updatePath: path];
+      [self markPriorityPath: path];
+      [self queueChange: [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                                path, @"path",
+                                                @"GWWatchedFileModified", @"event",
+                                                [NSNumber numberWithBool: YES], @"exists",
+                                                nil]];
     }
   }
 }
@@ -878,18 +1082,35 @@ do { \
   
   dirpos = 0;
 
-  schedupdateTimer = [NSTimer scheduledTimerWithTimeInterval: SCHED_TIME
+  [self scheduleNextDirCheck];
+  
+  RELEASE (arp);
+}
+
+/*
+ * The timer doesn't repeat: each check sets the next one, at the
+ * interval -scheduledUpdateInterval gives for the current load.
+ */
+- (void)scheduleNextDirCheck
+{
+  if (schedupdateTimer && [schedupdateTimer isValid]) {
+    [schedupdateTimer invalidate];
+  }
+  /* it may be the timer that is firing */
+  TEST_AUTORELEASE (schedupdateTimer);
+
+  schedupdateTimer = [NSTimer scheduledTimerWithTimeInterval: [self scheduledUpdateInterval]
 						                                 target: self 
                                            selector: @selector(checkNextDir:) 
 																           userInfo: nil 
-                                            repeats: YES];
+                                            repeats: NO];
   RETAIN (schedupdateTimer);     
-  
-  RELEASE (arp);
 }
 
 - (void)checkNextDir:(id)sender
 {
+  [self scheduleNextDirCheck];
+
   if (extracting == NO) {
     CREATE_AUTORELEASE_POOL(arp);
     NSUInteger count = [directories count];
@@ -912,10 +1133,9 @@ do { \
     dirok = (attributes && ([attributes fileType] == NSFileTypeDirectory));
   
     if (dirok) {
-      NSArray *contents = [self filteredDirectoryContentsAtPath: dir escapeEntries: YES];
+      NSArray *contents = [self filteredDirectoryContentsAtPath: dir];
       NSMutableDictionary *dbcontents = [NSMutableDictionary dictionary];
       NSArray *dbpaths = nil;
-      NSString *qdir = stringForQuery(dir);
       NSString *sep = path_separator();
       NSString *query;
       SQLitePreparedStatement *statement;
@@ -930,13 +1150,13 @@ do { \
                              withIdentifier: @"check_next_dir"
                                    bindings: SQLITE_TEXT,
                                              @":minpath",
-                      [NSString stringWithFormat: @"%@%@", qdir, sep],                   
+                      [NSString stringWithFormat: @"%@%@", dir, sep],                   
                                              SQLITE_TEXT,
                                              @":maxpath",                             
-                      [NSString stringWithFormat: @"%@0", qdir],
+                      [NSString stringWithFormat: @"%@0", dir],
                                              SQLITE_TEXT,
                                              @":limit",                             
-                [NSString stringWithFormat: @"%@%@*%@*", qdir, sep, sep], 0];
+                [NSString stringWithFormat: @"%@%@*%@*", dir, sep, sep], 0];
       
       results = [sqlite resultsOfQueryWithStatement: statement];
 
@@ -1044,6 +1264,7 @@ do { \
     NSDictionary *info;
     unsigned i;
 
+    [self commitUpdates: nil];
     [sqlite executeQuery: @"BEGIN"];
 
     query = @"SELECT path FROM removed_paths;";
@@ -1072,6 +1293,8 @@ do { \
                        object: nil 
                      userInfo: info];
 
+    [self maintainDbIfIdle];
+
     RELEASE (arp);
   }
 }
@@ -24,6 +24,7 @@
 
 #include <Foundation/Foundation.h>
 #include "MDKQuery.h"
+#include "FSNode.h"
 
 @interface MDFind : NSObject
 { 
@@ -32,6 +33,14 @@
   NSString *searchdir;
   BOOL repscore;
   BOOL onlycount;
+  BOOL json;
+  NSArray *jsonattrs;
+  unsigned limit;
+  BOOL timing;
+  NSTimeInterval startTime;
+  NSTimeInterval parseTime;
+  NSTimeInterval planTime;
+  NSTimeInterval firstTime;
 }
 
 - (id)initWithArguments:(NSArray *)args;
@@ -42,15 +51,110 @@
 
 - (void)queryDidEndGathering:(MDKQuery *)query;
 
+- (void)printJSONLine:(NSArray *)line;
+
+- (void)printTiming;
+
+- (void)done;
+
 - (void)printAttributesList;
 
 - (void)printAttributeDescription:(NSString *)attribute;
 
+- (void)printDbStats;
+
 - (void)printHelp;
 
 @end
 
 
+static NSArray *json_attribute_names(void)
+{
+  static NSArray *names = nil;
+
+  if (names == nil) {
+    names = [[NSArray alloc] initWithObjects: @"GSMDItemFSName",
+                                              @"GSMDItemFSExtension",
+                                              @"GSMDItemFSType",
+                                              @"GSMDItemFSSize",
+                                              @"GSMDItemFSModificationDate",
+                                              @"GSMDItemFSCreationDate",
+                                              @"GSMDItemFSOwnerUser",
+                                              @"GSMDItemFSOwnerUserID",
+                                              @"GSMDItemFSOwnerGroup",
+                                              @"GSMDItemFSOwnerGroupID",
+                                              nil];
+  }
+
+  return names;
+}
+
+static NSString *json_string(NSString *str)
+{
+  NSMutableString *escaped = [NSMutableString stringWithString: @"\""];
+  unsigned len = [str length];
+  unsigned i;
+
+  for (i = 0; i < len; i++) {
+    unichar c = [str characterAtIndex: i];
+
+    if (c == '"') {
+      [escaped appendString: @"\\\""];
+    } else if (c == '\\') {
+      [escaped appendString: @"\\\\"];
+    } else if (c == '\n') {
+      [escaped appendString: @"\\n"];
+    } else if (c == '\t') {
+      [escaped appendString: @"\\t"];
+    } else if (c < 0x20) {
+      [escaped appendFormat: @"\\u%04x", c];
+    } else {
+      [escaped appendFormat: @"%C", c];
+    }
+  }
+
+  [escaped appendString: @"\""];
+
+  return escaped;
+}
+
+/* the value of attr read from the file system, as JSON */
+static NSString *json_attribute_value(FSNode *node, NSString *attr)
+{
+  id value = nil;
+
+  if ([node isValid] == NO) {
+    return @"null";
+  }
+
+  if ([attr isEqual: @"GSMDItemFSName"]) {
+    value = [node name];
+  } else if ([attr isEqual: @"GSMDItemFSExtension"]) {
+    value = [[node name] pathExtension];
+  } else if ([attr isEqual: @"GSMDItemFSType"]) {
+    value = [node fileType];
+  } else if ([attr isEqual: @"GSMDItemFSSize"]) {
+    return [NSString stringWithFormat: @"%llu", [node fileSize]];
+  } else if ([attr isEqual: @"GSMDItemFSModificationDate"]) {
+    return [NSString stringWithFormat: @"%.0f", 
+                               [[node modificationDate] timeIntervalSince1970]];
+  } else if ([attr isEqual: @"GSMDItemFSCreationDate"]) {
+    return [NSString stringWithFormat: @"%.0f", 
+                               [[node creationDate] timeIntervalSince1970]];
+  } else if ([attr isEqual: @"GSMDItemFSOwnerUser"]) {
+    value = [node owner];
+  } else if ([attr isEqual: @"GSMDItemFSOwnerUserID"]) {
+    return [[node ownerId] description];
+  } else if ([attr isEqual: @"GSMDItemFSOwnerGroup"]) {
+    value = [node group];
+  } else if ([attr isEqual: @"GSMDItemFSOwnerGroupID"]) {
+    return [[node groupId] description];
+  }
+
+  return (value ? json_string(value) : @"null");
+}
+
+
 @implementation MDFind
 
 - (id)initWithArguments:(NSArray *)args
@@ -72,6 +176,10 @@
     searchdir = nil;
     repscore = NO;
     onlycount = NO;
+    json = NO;
+    jsonattrs = nil;
+    limit = 0;
+    timing = NO;
     rescount = 0;
     
     for (i = 1; i < count; i++) {
@@ -89,14 +197,62 @@
         }
         runquery = NO;
 
+      } else if ([arg isEqual: @"-stats"]) {
+        [self printDbStats];
+        runquery = NO;
+
       } else if ([arg isEqual: @"-s"]) {
         repscore = YES; 
         pos++;
 
-      } else if ([arg isEqual: @"-c"]) {
+      } else if ([arg isEqual: @"-c"] || [arg isEqual: @"--count"]) {
         onlycount = YES; 
         pos++;
 
+      } else if ([arg isEqual: @"--json"]) {
+        json = YES; 
+        pos++;
+
+      } else if ([arg isEqual: @"--attr"]) {
+        NSArray *names = nil;
+        unsigned j;
+
+        if (++i < count) {
+          names = [[args objectAtIndex: i] componentsSeparatedByString: @","];
+        }
+
+        for (j = 0; j < [names count]; j++) {
+          if ([json_attribute_names() containsObject: [names objectAtIndex: j]] == NO) {
+            GSPrintf(stderr, @"mdfind: %@: not a file system attribute!\n",
+                                                     [names objectAtIndex: j]);
+            runquery = NO;
+          }
+        }
+
+        if ([names count] == 0) {
+          GSPrintf(stderr, @"mdfind: no attributes supplied!\n");
+          runquery = NO;
+        }
+
+        ASSIGN (jsonattrs, names);
+        json = YES; 
+        pos += 2;
+
+      } else if ([arg isEqual: @"--limit"]) {
+        if (++i < count) {
+          limit = MAX(0, [[args objectAtIndex: i] intValue]);
+        }
+
+        if (limit == 0) {
+          GSPrintf(stderr, @"mdfind: invalid limit supplied!\n");
+          runquery = NO;
+        }
+        pos += 2;
+
+      } else if ([arg isEqual: @"--timing"]) {
+        timing = YES; 
+        pos++;
+
       } else if ([arg isEqual: @"-onlyin"]) {
         BOOL pathok = YES;
 
@@ -128,7 +284,15 @@
 	      {
       NSArray *dirs = (searchdir ? [NSArray arrayWithObject: searchdir] : nil);  
       
+      startTime = [NSDate timeIntervalSinceReferenceDate];
       ASSIGN (query, [MDKQuery queryFromString: qstr inDirectories: dirs]);            
+      parseTime = [NSDate timeIntervalSinceReferenceDate];
+      /* the statement gmds runs, compiled here only to time it */
+      if (timing) {
+        [query sqlDescription];
+      }
+      planTime = [NSDate timeIntervalSinceReferenceDate];
+
       [query setDelegate: self];
       [query setReportRawResults: YES];
       [query startGathering];
@@ -152,13 +316,28 @@
 
 - (void)appendRawResults:(NSArray *)lines
 {
+  unsigned count = [lines count];
+
+  if ((firstTime == 0.0) && count) {
+    firstTime = [NSDate timeIntervalSinceReferenceDate];
+  }
+
+  if (limit && ((rescount + count) > limit)) {
+    count = limit - rescount;
+  }
+
   if (onlycount == NO) {
     unsigned i;
 
-    for (i = 0; i < [lines count]; i++) {
+    for (i = 0; i < count; i++) {
       NSArray *line = [lines objectAtIndex: i];
       NSString *path = [line objectAtIndex: 0];
 
+      if (json) {
+        [self printJSONLine: line];
+        continue;
+      }
+
       GSPrintf(stdout, @"%@", path);
       
       if (repscore) {
@@ -168,15 +347,78 @@
       GSPrintf(stdout, @"\n");
     }
 
-  } else {
-    rescount += [lines count];
+    /* each page as soon as it comes, for who reads from a pipe */
+    fflush(stdout);
+  }
+
+  rescount += count;
+
+  if (limit && (rescount >= limit)) {
+    [query stopQuery];
+    [self done];
   }
 }
 
 - (void)queryDidEndGathering:(MDKQuery *)query
+{
+  [self done];
+}
+
+- (void)printJSONLine:(NSArray *)line
+{
+  NSString *path = [line objectAtIndex: 0];
+  NSMutableString *str = [NSMutableString string];
+  unsigned i;
+
+  [str appendFormat: @"{\"path\": %@", json_string(path)];
+  [str appendFormat: @", \"score\": %@", [[line objectAtIndex: 1] description]];
+
+  if (jsonattrs) {
+    FSNode *node = [FSNode nodeWithPath: path];
+
+    for (i = 0; i < [jsonattrs count]; i++) {
+      NSString *attr = [jsonattrs objectAtIndex: i];
+
+      [str appendFormat: @", %@: %@", json_string(attr), 
+                                      json_attribute_value(node, attr)];
+    }
+  }
+
+  [str appendString: @"}"];
+
+  GSPrintf(stdout, @"%@\n", str);
+}
+
+- (void)printTiming
+{
+  NSTimeInterval endTime = [NSDate timeIntervalSinceReferenceDate];
+
+  GSPrintf(stderr, @"parse:        %.3f ms\n", (parseTime - startTime) * 1000);
+  GSPrintf(stderr, @"plan:         %.3f ms\n", (planTime - parseTime) * 1000);
+  GSPrintf(stderr, @"execution:    %.3f ms\n", (endTime - planTime) * 1000);
+
+  if (firstTime > 0.0) {
+    GSPrintf(stderr, @"first result: %.3f ms\n", (firstTime - startTime) * 1000);
+  } else {
+    GSPrintf(stderr, @"first result: -\n");
+  }
+
+  GSPrintf(stderr, @"total:        %.3f ms, %u results\n", 
+                               (endTime - startTime) * 1000, rescount);
+}
+
+- (void)done
 {
   if (onlycount) {
-    GSPrintf(stdout, @"%i\n", rescount);
+    if (json) {
+      GSPrintf(stdout, @"{\"count\": %u}\n", rescount);
+    } else {
+      GSPrintf(stdout, @"%u\n", rescount);
+    }
+  }
+
+  if (timing) {
+    [self printTiming];
   }
     
   exit(EXIT_SUCCESS);
@@ -203,6 +445,63 @@
   }
 }
 
+- (void)printDbStats
+{
+  NSString *path = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, 
+                                        NSUserDomainMask, YES) lastObject];
+  NSDictionary *report;
+  NSDictionary *tables;
+  NSEnumerator *enumerator;
+  NSString *name;
+
+  path = [path stringByAppendingPathComponent: @"gmds"];
+  path = [path stringByAppendingPathComponent: @".db"];
+  path = [path stringByAppendingPathComponent: @"maintenance.plist"];
+  report = [NSDictionary dictionaryWithContentsOfFile: path];
+
+  if (report == nil) {
+    GSPrintf(stderr, @"mdfind: no db maintenance report yet!\n");
+    return;
+  }
+
+  GSPrintf(stdout, @"checked:      %@\n", [report objectForKey: @"maintenance_date"]);
+  GSPrintf(stdout, @"db size:      %@ bytes\n", [report objectForKey: @"db_size"]);
+  GSPrintf(stdout, @"wal size:     %@ bytes\n", [report objectForKey: @"wal_size"]);
+  GSPrintf(stdout, @"pages:        %@ of %@ bytes, %@ free (%.1f%%)\n",
+                   [report objectForKey: @"page_count"],
+                   [report objectForKey: @"page_size"],
+                   [report objectForKey: @"free_pages"],
+                   [[report objectForKey: @"fragmentation"] doubleValue]);
+  GSPrintf(stdout, @"auto vacuum:  %@\n", [report objectForKey: @"auto_vacuum"]);
+
+  tables = [report objectForKey: @"tables"];
+  enumerator = [[[tables allKeys] sortedArrayUsingSelector: @selector(compare:)]
+                                                              objectEnumerator];
+
+  GSPrintf(stdout, @"\n%-32s %12s %14s %14s\n", "table", "rows", "bytes", "unused");
+
+  while ((name = [enumerator nextObject])) {
+    NSDictionary *info = [tables objectForKey: name];
+    id rows = [info objectForKey: @"rows"];
+    id size = [info objectForKey: @"size"];
+    id unused = [info objectForKey: @"unused"];
+
+    GSPrintf(stdout, @"%-32s %12s %14s %14s\n", [name UTF8String],
+             (rows ? [[rows description] UTF8String] : "-"),
+             (size ? [[size description] UTF8String] : "-"),
+             (unused ? [[unused description] UTF8String] : "-"));
+  }
+
+  tables = [report objectForKey: @"pruned"];
+
+  if ([tables count]) {
+    GSPrintf(stdout, @"\npruned orphans: attributes %@, contents %@, names %@\n",
+                     [tables objectForKey: @"attributes"],
+                     [tables objectForKey: @"contents"],
+                     [tables objectForKey: @"names"]);
+  }
+}
+
 - (void)printHelp
 {
   GSPrintf(stderr,
@@ -214,9 +513,17 @@
       @"Arguments:\n"
       @"  -onlyin 'directory'    limits the the search to 'directory'.\n"
       @"  -s                     reports also the score for each found path.\n"
-      @"  -c                     reports only the count of the found paths.\n"
+      @"  -c, --count            reports only the count of the found paths.\n"
+      @"  --limit 'n'            stops after the first 'n' paths.\n"
+      @"  --json                 prints each path as a JSON object on a line.\n"
+      @"  --attr 'a1,a2...'      adds these file system attributes to the JSON\n"
+      @"                         objects (implies --json).\n"
+      @"  --timing               prints on stderr the parse, plan and execution\n"
+      @"                         time and the time to the first result.\n"
       @"  -a [attribute]         if 'attribute' is supplied, prints the attribute\n"
       @"                         description, else prints the attributes list.\n"
+      @"  -stats                 prints the size of the db and of its tables\n"
+      @"                         from the last db maintenance.\n"
       @"  -h                     shows this help and exit.\n"
       @"\n"
       @"The query have the format: attribute  operator  value\n"
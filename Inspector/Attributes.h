@@ -39,6 +39,9 @@
 
 - (oneway void)computeSizeOfPaths:(NSArray *)paths;
 
+- (oneway void)computeSizeOfPaths:(NSArray *)paths
+                          request:(unsigned long)request;
+
 - (oneway void)stopComputeSize;
 
 @end
@@ -141,6 +144,8 @@
 
 - (IBAction)calculateSizes:(id)sender;
 
+- (void)requestSizes;
+
 - (void)startSizer;
 
 - (void)sizerConnDidDie:(NSNotification *)notification;
@@ -166,5 +171,10 @@
 
 - (void)computeSizeOfPaths:(NSArray *)paths;
 
+- (void)computeSizeOfPaths:(NSArray *)paths
+                   request:(unsigned long)request;
+
+- (void)stopComputeSize;
+
 @end
 
@@ -41,6 +41,7 @@
 #import "TimeDateView.h"
 #import "Functions.h"
 #import "FSNodeRep.h"
+#import "FSNSizeCache.h"
 
 #define SINGLE 0
 #define MULTIPLE 1
@@ -55,7 +56,12 @@
 
 static NSString *nibName = @"Attributes";
 
-static BOOL sizeStop = NO;
+/* Bumped for every size asked of the sizer and every new selection: a
+   walk goes on only while it is the last one asked for. */
+static unsigned long sizeRequests = 0;
+
+/* the partial totals of a walk are shown this often */
+#define SIZE_REPORT_INTERVAL 0.25
 
 /* Helper function to get volume information using statvfs */
 static BOOL getVolumeInfo(const char *path, unsigned long long *total, 
@@ -226,7 +232,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 
   // NSLog(@"Attributes: activateForPaths called with %lu paths", (unsigned long)[paths count]);
 
-  sizeStop = YES;
+  __atomic_add_fetch(&sizeRequests, 1, __ATOMIC_RELEASE);
 
   if (paths == nil) {
     DESTROY (insppaths);
@@ -324,7 +330,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
               if (sizer == nil)
                 [self startSizer];
               else
-                [sizer computeSizeOfPaths: insppaths];
+                [self requestSizes];
             }
           
           [insideButt	setEnabled: YES];
@@ -415,7 +421,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
           if (sizer == nil)
             [self startSizer];
           else
-            [sizer computeSizeOfPaths: insppaths];
+            [self requestSizes];
         }
     
       usr = [attributes objectForKey: NSFileOwnerAccountName];
@@ -810,11 +816,18 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
   else
     {
       [sizeField setStringValue: @"--"]; 
-      [sizer computeSizeOfPaths: insppaths];
+      [self requestSizes];
     }
   [calculateButt setEnabled: NO];
 }
 
+- (void)requestSizes
+{
+  unsigned long request = __atomic_add_fetch(&sizeRequests, 1, __ATOMIC_RELEASE);
+
+  [sizer computeSizeOfPaths: insppaths request: request];
+}
+
 - (void)startSizer
 {
   NSPort *port[2];  
@@ -872,9 +885,8 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
       RETAIN (sizer);
       if (insppaths)
         {
-          sizeStop = YES;
           [sizeField setStringValue: @"--"];
-          [sizer computeSizeOfPaths: insppaths];
+          [self requestSizes];
         }
     }
 }
@@ -904,6 +916,17 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 @end
 
 
+/* "12.4 MB (12.9 MB on disk)" */
+static NSString *
+sizeDescriptionOfTotals(FSNSizeTotals totals)
+{
+  return [NSString stringWithFormat: @"%@ (%@ %@)",
+                   sizeDescription(totals.apparent),
+                   sizeDescription(totals.allocated),
+                   NSLocalizedString(@"on disk", @"")];
+}
+
+
 @implementation Sizer
 
 - (void)dealloc
@@ -950,81 +973,48 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 
 - (void)computeSizeOfPaths:(NSArray *)paths
 {
-  unsigned long long dirsize = 0;
-  unsigned long long fsize = 0;
-  NSUInteger i;
-	
-  sizeStop = NO;
-  
-  for (i = 0; i < [paths count]; i++)
-    {
-      CREATE_AUTORELEASE_POOL (arp1);
-      NSString *path, *filePath;
-      NSDictionary *fileAttrs;
-      BOOL isdir;
-
-      if (sizeStop)
-	{
-	  RELEASE (arp1);
-	  return;
-	}
-
-      path = [paths objectAtIndex: i];
+  [self computeSizeOfPaths: paths
+                   request: __atomic_load_n(&sizeRequests, __ATOMIC_ACQUIRE)];
+}
 
-      fileAttrs = [fm fileAttributesAtPath: path traverseLink: NO];
-      if (fileAttrs)
-        {
-          fsize = [[fileAttrs objectForKey: NSFileSize] unsignedLongLongValue];
-          dirsize += fsize;
-        }
-     
-      [fm fileExistsAtPath: path isDirectory: &isdir];
-          
-      if (isdir)
-        {
-          NSDirectoryEnumerator *enumerator = [fm enumeratorAtPath: path];
+/* Walks on the threads of FSNSizeCache, which remembers what each
+   directory holds, and shows the totals as they grow. */
+- (void)computeSizeOfPaths:(NSArray *)paths
+                   request:(unsigned long)request
+{
+  CREATE_AUTORELEASE_POOL (arp);
+  FSNSizeTotals totals;
+  BOOL done;
 
-          while (1)
-            {
-              CREATE_AUTORELEASE_POOL (arp2);
+  if (request != __atomic_load_n(&sizeRequests, __ATOMIC_ACQUIRE))
+    {
+      RELEASE (arp);
+      return;
+    }
 
-              filePath = [enumerator nextObject];
+  done = [[FSNSizeCache sharedCache] computeTotals: &totals
+                                           ofPaths: paths
+                                          interval: SIZE_REPORT_INTERVAL
+                                          progress: ^BOOL (FSNSizeTotals partial) {
+      if (request != __atomic_load_n(&sizeRequests, __ATOMIC_ACQUIRE))
+        return NO;
 
-              if (filePath)
-                {
-                  if (sizeStop)
-                    {
-                      RELEASE (arp2);
-                      RELEASE (arp1);
-                      return;
-                    }
-
-                  filePath = [path stringByAppendingPathComponent: filePath];
-                  fileAttrs = [fm fileAttributesAtPath: filePath traverseLink: NO];
-                  if (fileAttrs)
-                    {
-                      fsize = [[fileAttrs objectForKey: NSFileSize] unsignedLongLongValue];
-                      dirsize += fsize;
-                    }
-      
-                }
-              else
-                {
-                  RELEASE (arp2);
-                  break;   
-                }
-      
-              RELEASE (arp2);
-            }
-        }
-    
-      RELEASE (arp1);
-    }	
+      [attributes sizeReady: [NSString stringWithFormat: @"%@...",
+                                       sizeDescriptionOfTotals(partial)]];
+      return YES;
+    }];
 
-  if (sizeStop == NO)
+  if (done && (request == __atomic_load_n(&sizeRequests, __ATOMIC_ACQUIRE)))
     {
-      [attributes sizeReady: sizeDescription(dirsize)];
+      [attributes sizeReady: sizeDescriptionOfTotals(totals)];
     }
+
+  RELEASE (arp);
+}
+
+- (void)stopComputeSize
+{
+  __atomic_add_fetch(&sizeRequests, 1, __ATOMIC_RELEASE);
 }
 
 @end
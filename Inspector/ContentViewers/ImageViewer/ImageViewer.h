@@ -47,7 +47,8 @@
 @protocol ImageResizerProtocol
 
 - (oneway void)readImageAtPath:(NSString *)path
-                       setSize:(NSSize)imsize;
+                       setSize:(NSSize)imsize
+                       request:(unsigned long)request;
 
 - (oneway void)terminate;
 
@@ -81,6 +82,8 @@
 
 - (oneway void)imageReady:(NSDictionary *)imginfo;
 
+- (void)showThumbnailOfPath:(NSString *)path;
+
 - (void)editFile:(id)sender;
 
 - (void)setContextHelp;
@@ -29,6 +29,7 @@
 #include <math.h>
 
 #import "Resizer.h"
+#import "FSNodeRep.h"
 
 @implementation ImageViewer
 
@@ -140,12 +141,17 @@
 
 - (void)displayPath:(NSString *)path
 {
+  /* the decode of the image shown before, if any, stops */
+  __atomic_add_fetch(&imageResizerRequests, 1, __ATOMIC_RELEASE);
+
   DESTROY (editPath);
   [editButt setEnabled: NO];		
   [widthLabel setStringValue: @""];
   [heightLabel setStringValue: @""];
   
   ASSIGN (imagePath, path);
+  [self showThumbnailOfPath: path];
+
   if (conn == nil)
     {
       NSPort *p1;
@@ -171,7 +177,32 @@
       imsize.height -= 4;
       [self addSubview: progView]; 
       [progView start];
-      [resizer readImageAtPath: imagePath setSize: imsize];
+      [resizer readImageAtPath: imagePath
+                       setSize: imsize
+                       request: __atomic_load_n(&imageResizerRequests, __ATOMIC_ACQUIRE)];
+    }
+}
+
+/* The thumbnail the store already holds, shown scaled while the image is
+   decoded at the size of the pane. */
+- (void)showThumbnailOfPath:(NSString *)path
+{
+  NSImage *thumb = [[FSNodeRep sharedInstance] thumbnailForPath: path];
+
+  if (thumb)
+    {
+      if (valid == NO)
+        {
+          valid = YES;
+          [errLabel removeFromSuperview];
+          [self addSubview: imview];
+        }
+      [imview setImageScaling: NSImageScaleProportionallyUpOrDown];
+      [imview setImage: thumb];
+    }
+  else
+    {
+      [imview setImage: nil];
     }
 }
 
@@ -188,7 +219,9 @@
     [resizer setProxy: self];
     [self addSubview: progView]; 
     [progView start];    
-    [resizer readImageAtPath: imagePath setSize: imsize];
+    [resizer readImageAtPath: imagePath
+                     setSize: imsize
+                     request: __atomic_load_n(&imageResizerRequests, __ATOMIC_ACQUIRE)];
 }
 
 
@@ -241,6 +274,7 @@
               [self addSubview: imview];
             }
 
+          [imview setImageScaling: NSScaleNone];
           [imview setImage: image];
 
           str = NSLocalizedString(@"Width:", @"");
@@ -288,6 +322,9 @@
 
 - (void)stopTasks
 {
+  __atomic_add_fetch(&imageResizerRequests, 1, __ATOMIC_RELEASE);
+  [progView stop];
+  [progView removeFromSuperview];
   [imview setImage: nil];
 }
 
@@ -26,6 +26,10 @@ h
 
 #import "ContentViewersProtocol.h"
 
+/* Bumped by the viewer for each image it asks for, and when it stops:
+   a decode of an older request stops and is not answered. */
+extern unsigned long imageResizerRequests;
+
 @interface ImageResizer : NSObject
 {
   id <ImageViewerProtocol> imageViewerProxy;
@@ -36,6 +40,7 @@ h
 - (void)setProxy:(id <ImageViewerProtocol>)ivp;
 
 - (void)readImageAtPath:(NSString *)path
-                setSize:(NSSize)imsize;
+                setSize:(NSSize)imsize
+                request:(unsigned long)request;
 
 @end
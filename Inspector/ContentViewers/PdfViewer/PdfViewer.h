@@ -62,6 +62,12 @@
   NSString *pdfPath;
   PDFDocument *pdfDoc;
   PDFImageRep *imageRep;
+
+  NSMutableDictionary *pageCache;    /* page number -> rendered NSImage */
+  NSMutableArray *pageCacheOrder;    /* LRU of page numbers, most recent last */
+  unsigned long long pageCacheBytes;
+  NSSize pageCacheBox;               /* the view size the pages fit */
+  NSMutableArray *renderQueue;       /* neighbouring pages left to render */
   
   id <ContentInspectorProtocol>inspector;
   NSFileManager *fm;
@@ -71,6 +77,12 @@
 
 - (void)goToPage:(id)sender;
 
+- (NSImage *)imageOfPage:(NSInteger)index;
+
+- (void)renderNextPage:(id)sender;
+
+- (void)dropPageCache;
+
 - (void)nextPage:(id)sender;
 
 - (void)previousPage:(id)sender;
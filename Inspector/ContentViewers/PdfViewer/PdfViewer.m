@@ -30,6 +30,10 @@
 #import "PdfViewer.h"
 
 #define MAXPAGES 9999
+/* pages rendered ahead of the one shown, and behind it */
+#define PAGE_PREFETCH 2
+/* past it the least recently shown pages go */
+#define PAGE_CACHE_MAX_BYTES (24 * 1024 * 1024)
 
 const double PDFResolution = 72.0;
 
@@ -37,6 +41,10 @@ const double PDFResolution = 72.0;
 
 - (void)dealloc
 {
+  [NSObject cancelPreviousPerformRequestsWithTarget: self];
+  RELEASE (pageCache);
+  RELEASE (pageCacheOrder);
+  RELEASE (renderQueue);
   TEST_RELEASE (pdfPath);	
   TEST_RELEASE (pdfDoc);
   TEST_RELEASE (imageRep);
@@ -151,6 +159,12 @@ const double PDFResolution = 72.0;
       valid = YES;
       pdfPath = nil;
 
+      pageCache = [NSMutableDictionary new];
+      pageCacheOrder = [NSMutableArray new];
+      pageCacheBytes = 0;
+      pageCacheBox = NSZeroSize;
+      renderQueue = [NSMutableArray new];
+
       [self setContextHelp];
     }
 
@@ -162,6 +176,7 @@ const double PDFResolution = 72.0;
   PDFDocument *doc;
   
   ASSIGN (pdfPath, path);
+  [self dropPageCache];
 
   if ([self superview]) {      
     [inspector contentsReadyAt: pdfPath];
@@ -273,17 +288,65 @@ const double PDFResolution = 72.0;
 
 - (void)goToPage:(id)sender
 {
-  NSImage *image = nil;
+  NSInteger npages = [pdfDoc countPages];
   NSInteger index;
-  NSSize imsize;
-  NSSize unscaledSize;
-                                              
+  NSInteger i;
 
   index = [matrix selectedColumn] + 1;
   if (index <= 0)
     return;
 
-  imsize = [imageView bounds].size;
+  /* the pages were rendered to fit the view as it was */
+  if (NSEqualSizes(pageCacheBox, [imageView bounds].size) == NO)
+    {
+      [self dropPageCache];
+      pageCacheBox = [imageView bounds].size;
+    }
+
+  [imageView setImage: [self imageOfPage: index]];
+
+  /* the neighbours, nearest first, are rendered when the run loop is
+     idle; those of the page shown before are no longer needed */
+  [NSObject cancelPreviousPerformRequestsWithTarget: self
+                                           selector: @selector(renderNextPage:)
+                                             object: nil];
+  [renderQueue removeAllObjects];
+
+  for (i = 1; i <= PAGE_PREFETCH; i++)
+    {
+      if (index + i <= npages)
+	[renderQueue addObject: [NSNumber numberWithInteger: index + i]];
+      if (index - i >= 1)
+	[renderQueue addObject: [NSNumber numberWithInteger: index - i]];
+    }
+
+  if ([renderQueue count])
+    {
+      [self performSelector: @selector(renderNextPage:)
+                 withObject: nil
+                 afterDelay: 0.0];
+    }
+}
+
+/* The page rendered once at the resolution that fits it in the view, and
+   kept while the view keeps its size. */
+- (NSImage *)imageOfPage:(NSInteger)index
+{
+  NSNumber *key = [NSNumber numberWithInteger: index];
+  NSImage *image = [pageCache objectForKey: key];
+  NSSize imsize;
+  NSSize unscaledSize;
+  float resolution = PDFResolution;
+  unsigned long long bytes;
+
+  if (image)
+    {
+      [pageCacheOrder removeObject: key];
+      [pageCacheOrder addObject: key];
+      return image;
+    }
+
+  imsize = pageCacheBox;
   unscaledSize = NSMakeSize([pdfDoc pageWidth: index], [pdfDoc pageHeight: index]);
 
   if ((imsize.width < unscaledSize.width) || (imsize.height < unscaledSize.height))
@@ -308,18 +371,76 @@ const double PDFResolution = 72.0;
 
       xfactor = scaledSize.width / unscaledSize.width * PDFResolution;
       yfactor = scaledSize.height / unscaledSize.height * PDFResolution;
-
-      [imageRep setResolution: (xfactor < yfactor ? xfactor : yfactor)];
+      resolution = (xfactor < yfactor ? xfactor : yfactor);
     }
 
+  [imageRep setResolution: resolution];
   [imageRep setPageNum: index];
-  
-  image = [[NSImage alloc] initWithSize: [imageRep size]];
-  [image setBackgroundColor: [NSColor whiteColor]];
-  [image setScalesWhenResized: YES];
-  [image addRepresentation: imageRep];
-  [imageView setImage: image];
-  RELEASE (image);
+
+  /* drawn once into a bitmap: showing the page again does not render it */
+  image = AUTORELEASE ([[NSImage alloc] initWithSize: [imageRep size]]);
+  [image lockFocus];
+  [[NSColor whiteColor] set];
+  NSRectFill(NSMakeRect(0, 0, [imageRep size].width, [imageRep size].height));
+  [imageRep drawInRect: NSMakeRect(0, 0, [imageRep size].width, [imageRep size].height)];
+  [image unlockFocus];
+
+  bytes = (unsigned long long)([image size].width * [image size].height * 4);
+
+  while ([pageCacheOrder count]
+	 && ((pageCacheBytes + bytes) > PAGE_CACHE_MAX_BYTES))
+    {
+      NSNumber *old = [pageCacheOrder objectAtIndex: 0];
+      NSImage *oldImage = [pageCache objectForKey: old];
+
+      pageCacheBytes -= (unsigned long long)([oldImage size].width * [oldImage size].height * 4);
+      [pageCache removeObjectForKey: old];
+      [pageCacheOrder removeObjectAtIndex: 0];
+    }
+
+  [pageCache setObject: image forKey: key];
+  [pageCacheOrder addObject: key];
+  pageCacheBytes += bytes;
+
+  return image;
+}
+
+- (void)renderNextPage:(id)sender
+{
+  if ([renderQueue count] && pdfDoc && imageRep)
+    {
+      NSNumber *key = RETAIN ([renderQueue objectAtIndex: 0]);
+
+      [renderQueue removeObjectAtIndex: 0];
+
+      if ([pageCache objectForKey: key] == nil)
+	{
+	  CREATE_AUTORELEASE_POOL (pool);
+	  [self imageOfPage: [key integerValue]];
+	  RELEASE (pool);
+	}
+
+      RELEASE (key);
+    }
+
+  if ([renderQueue count])
+    {
+      [self performSelector: @selector(renderNextPage:)
+                 withObject: nil
+                 afterDelay: 0.0];
+    }
+}
+
+- (void)dropPageCache
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget: self
+                                           selector: @selector(renderNextPage:)
+                                             object: nil];
+  [renderQueue removeAllObjects];
+  [pageCache removeAllObjects];
+  [pageCacheOrder removeAllObjects];
+  pageCacheBytes = 0;
+  pageCacheBox = NSZeroSize;
 }
 
 - (void)displayData:(NSData *)data 
@@ -334,7 +455,10 @@ const double PDFResolution = 72.0;
 
 - (void)stopTasks
 {
-
+  [NSObject cancelPreviousPerformRequestsWithTarget: self
+                                           selector: @selector(renderNextPage:)
+                                             object: nil];
+  [renderQueue removeAllObjects];
 }
 
 - (BOOL)canDisplayPath:(NSString *)path
@@ -48,11 +48,13 @@
   GenericView *genericView;
 
   NSMutableArray *viewers;
+  BOOL viewersLoaded;
   id currentViewer;
   
   TextViewer *textViewer;
   
   NSString *currentPath;
+  unsigned long previewRequests;  /* bumped for each path asked for */
   
   NSImage *pboardImage;
   
@@ -111,6 +113,9 @@
 
 - (BOOL)tryToDisplayPath:(NSString *)path;
 
+- (void)displayText:(NSData *)data
+             ofPath:(NSString *)path;
+
 - (NSData *)textContentsAtPath:(NSString *)path 
                 withAttributes:(NSDictionary *)attributes;
 
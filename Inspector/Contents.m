@@ -25,16 +25,19 @@
  */
 
 #include <math.h>
+#include <sys/stat.h>
 #include "config.h"
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import <dispatch/dispatch.h>
 #import "Contents.h"
 #import "ContentViewersProtocol.h"
 #import "Inspector.h"
 #import "IconView.h"
 #import "Functions.h"
 #import "FSNodeRep.h"
+#import "FSNTextPreview.h"
 
 #define ICNSIZE 48
 #define MAXDATA 1000
@@ -46,6 +49,22 @@
 
 static NSString *nibName = @"Contents";
 
+@interface Contents (PrivateMethods)
+
+- (void)loadViewers;
+
+- (id)firstViewerForPath:(NSString *)path;
+
+- (void)cancelPreview;
+
+- (void)loadContentsAt:(NSString *)path;
+
+- (void)showContentsAt:(NSString *)path
+                exists:(BOOL)exists
+                  text:(NSData *)text;
+
+@end
+
 @implementation Contents
 
 - (void)dealloc
@@ -68,12 +87,8 @@ static NSString *nibName = @"Contents";
   if (self)
     {
       NSBundle *bundle;
-      NSEnumerator *enumerator;
       NSString *imagepath;
-      NSString *bundlesDir;
-      NSArray *bnames;
       id label;
-      unsigned i;
       NSRect r;
 
       if ([NSBundle loadNibNamed: nibName owner: self] == NO)
@@ -89,6 +104,9 @@ static NSString *nibName = @"Contents";
       [iconView setInspector: inspector];
       viewers = [NSMutableArray new];
       currentPath = nil;
+      previewRequests = 0;
+      /* made here, before a reader thread asks for it */
+      [FSNTextPreview sharedPreviews];
 
       fm = [NSFileManager defaultManager];
       ws = [NSWorkspace sharedWorkspace];
@@ -99,55 +117,8 @@ static NSString *nibName = @"Contents";
 
       r = [[viewersBox contentView] bounds];
 
-      enumerator = [NSSearchPathForDirectoriesInDomains
-                     (NSLibraryDirectory, NSAllDomainsMask, YES) objectEnumerator];
-      while ((bundlesDir = [enumerator nextObject]) != nil)
-        {
-          bundlesDir = [bundlesDir stringByAppendingPathComponent: @"Bundles"];
-          bnames = [fm directoryContentsAtPath: bundlesDir];
-
-          for (i = 0; i < [bnames count]; i++)
-            {
-              NSString *bname = [bnames objectAtIndex: i];
-	
-              if ([[bname pathExtension] isEqual: @"inspector"])
-                {
-                  NSString *bpath = [bundlesDir stringByAppendingPathComponent: bname];
-
-                  bundle = [NSBundle bundleWithPath: bpath];
-
-                  if (bundle)
-                    {
-                      Class principalClass = [bundle principalClass];
-
-                      if ([principalClass conformsToProtocol: @protocol(ContentViewersProtocol)])
-                        {
-                          CREATE_AUTORELEASE_POOL (pool);
-                          id vwr = [[principalClass alloc] initWithFrame: r inspector: self];
-
-                          [viewers addObject: vwr];
-                          [vwr release];
-                          RELEASE (pool);
-                        }
-                    }
-                }
-            }
-        }
-
-    // We reorter viewers and put the ImageViewer at the end, so that specialized viewers,
-    // e.g. PDF Viewer, can take precedence
-    // String comparison, so no class import is needed
-    for (i = 0; i < [viewers count]; i++)
-      {
-        id vwr = [viewers objectAtIndex: i];
-
-        if ([NSStringFromClass([vwr class]) isEqualToString:@"ImageViewer"])
-          {
-            [viewers removeObjectAtIndex: i];
-            [viewers addObject: vwr];
-            break;
-          }
-      }
+      /* the viewer bundles are loaded by the first path shown */
+      viewersLoaded = NO;
 
     textViewer = [[TextViewer alloc] initWithFrame: r forInspector: self];					
     genericView = [[GenericView alloc] initWithFrame: r];					
@@ -192,6 +163,7 @@ static NSString *nibName = @"Contents";
     
       [viewersBox setContentView: noContsView];
       currentViewer = noContsView;
+      [self cancelPreview];
     
       if (currentPath) {
         [inspector removeWatcherForPath: currentPath];
@@ -202,30 +174,85 @@ static NSString *nibName = @"Contents";
     }
 }
 
-- (id)viewerForPath:(NSString *)path
+- (void)loadViewers
 {
-  NSInteger i;
-  
-  if ((path == nil) || ([fm fileExistsAtPath: path] == NO))
+  NSEnumerator *enumerator;
+  NSString *bundlesDir;
+  NSArray *bnames;
+  NSUInteger i;
+  NSRect r;
+
+  viewersLoaded = YES;
+  r = [[viewersBox contentView] bounds];
+
+  enumerator = [NSSearchPathForDirectoriesInDomains
+                 (NSLibraryDirectory, NSAllDomainsMask, YES) objectEnumerator];
+  while ((bundlesDir = [enumerator nextObject]) != nil)
     {
-      return nil;
+      bundlesDir = [bundlesDir stringByAppendingPathComponent: @"Bundles"];
+      bnames = [fm directoryContentsAtPath: bundlesDir];
+
+      for (i = 0; i < [bnames count]; i++)
+        {
+          NSString *bname = [bnames objectAtIndex: i];
+	
+          if ([[bname pathExtension] isEqual: @"inspector"])
+            {
+              NSString *bpath = [bundlesDir stringByAppendingPathComponent: bname];
+              NSBundle *bundle = [NSBundle bundleWithPath: bpath];
+
+              if (bundle)
+                {
+                  Class principalClass = [bundle principalClass];
+
+                  if ([principalClass conformsToProtocol: @protocol(ContentViewersProtocol)])
+                    {
+                      CREATE_AUTORELEASE_POOL (pool);
+                      id vwr = [[principalClass alloc] initWithFrame: r inspector: self];
+
+                      [viewers addObject: vwr];
+                      [vwr release];
+                      RELEASE (pool);
+                    }
+                }
+            }
+        }
     }
-    
+
+  // We reorter viewers and put the ImageViewer at the end, so that specialized viewers,
+  // e.g. PDF Viewer, can take precedence
+  // String comparison, so no class import is needed
   for (i = 0; i < [viewers count]; i++)
     {
-      id vwr = [viewers objectAtIndex: i];		
-      if ([vwr canDisplayPath: path])
+      id vwr = [viewers objectAtIndex: i];
+
+      if ([NSStringFromClass([vwr class]) isEqualToString:@"ImageViewer"])
         {
-          return vwr;
-        }				
+          [viewers removeObjectAtIndex: i];
+          [viewers addObject: vwr];
+          break;
+        }
     }
-  
-  return nil;
+}
+
+- (id)viewerForPath:(NSString *)path
+{
+  if ((path == nil) || ([fm fileExistsAtPath: path] == NO))
+    {
+      return nil;
+    }
+
+  return [self firstViewerForPath: path];
 }
 
 - (id)viewerForDataOfType:(NSString *)type
 {
   NSUInteger i;
+
+  if (viewersLoaded == NO)
+    {
+      [self loadViewers];
+    }
   
   for (i = 0; i < [viewers count]; i++)
     {
@@ -245,8 +272,6 @@ static NSString *nibName = @"Contents";
 
 - (void)showContentsAt:(NSString *)path
 {
-  NSString *winName;
-
   // No change in selection? leave current path
   if (currentPath && [currentPath isEqual:path])
     {
@@ -254,6 +279,44 @@ static NSString *nibName = @"Contents";
       return;
     }
 
+  [self loadContentsAt: path];
+}
+
+- (id)firstViewerForPath:(NSString *)path
+{
+  NSUInteger i;
+
+  if (viewersLoaded == NO)
+    {
+      [self loadViewers];
+    }
+    
+  for (i = 0; i < [viewers count]; i++)
+    {
+      id vwr = [viewers objectAtIndex: i];		
+      if ([vwr canDisplayPath: path])
+        {
+          return vwr;
+        }				
+    }
+  
+  return nil;
+}
+
+- (void)cancelPreview
+{
+  __atomic_add_fetch(&previewRequests, 1, __ATOMIC_RELEASE);
+}
+
+/* The stat of the path and the read of its start go to a background
+   thread, so that a slow mount or a large file does not hold the main
+   thread; a later request, or data shown meanwhile, drops the answer. */
+- (void)loadContentsAt:(NSString *)path
+{
+  unsigned long request = __atomic_add_fetch(&previewRequests, 1, __ATOMIC_RELEASE);
+
+  path = AUTORELEASE ([path copy]);
+
   // we change content to new path or to nil
   // stop current work (e.g. resizing)
   if (currentViewer && [currentViewer respondsToSelector: @selector(stopTasks)])
@@ -265,12 +328,58 @@ static NSString *nibName = @"Contents";
   [inspector removeWatcherForPath: currentPath];
   DESTROY (currentPath);
 
+  if (path == nil)
+    {
+      [self showContentsAt: nil exists: NO text: nil];
+      return;
+    }
+
+  [titleField setStringValue: [path lastPathComponent]];
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    NSData *text = nil;
+    BOOL exists = NO;
+
+    /* a selection already changed again is not read */
+    if (__atomic_load_n(&previewRequests, __ATOMIC_ACQUIRE) == request)
+      {
+        CREATE_AUTORELEASE_POOL (pool);
+        struct stat st;
+
+        exists = (stat([path fileSystemRepresentation], &st) == 0);
+
+        if (exists && S_ISREG(st.st_mode))
+          {
+            text = [[FSNTextPreview sharedPreviews] textOfFileAtPath: path
+                                                              length: MAXDATA];
+            RETAIN (text);
+          }
+
+        RELEASE (pool);
+      }
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+      if (__atomic_load_n(&previewRequests, __ATOMIC_ACQUIRE) == request)
+        {
+          [self showContentsAt: path exists: exists text: text];
+        }
+      RELEASE (text);
+    });
+  });
+}
+
+- (void)showContentsAt:(NSString *)path
+                exists:(BOOL)exists
+                  text:(NSData *)text
+{
+  NSString *winName;
+
   // Are we going to display the new path?
-  if (path && [fm fileExistsAtPath: path])
+  if (path && exists)
     {
       id viewer;
 
-      viewer = [self viewerForPath: path];
+      viewer = [self firstViewerForPath: path];
       if (viewer)
 	{
 	  currentViewer = viewer;
@@ -287,8 +396,9 @@ static NSString *nibName = @"Contents";
 	  [iconView setImage: icon];
 	  [titleField setStringValue: [node name]];
 
-	  if ([textViewer tryToDisplayPath: path])
+	  if (text)
 	    {
+	      [textViewer displayText: text ofPath: path];
 	      [viewersBox setContentView: textViewer];
 	      currentViewer = textViewer;
 	      winName = NSLocalizedString(@"Text Inspector", @"");
@@ -300,6 +410,7 @@ static NSString *nibName = @"Contents";
 	    }
 	  else
 	    {
+	      [textViewer displayText: nil ofPath: nil];
 	      [viewersBox setContentView: genericView];
 	      currentViewer = genericView;
 	      [genericView showInfoOfPath: path];
@@ -363,6 +474,7 @@ static NSString *nibName = @"Contents";
     [inspector removeWatcherForPath: currentPath];
     DESTROY (currentPath);
   }
+  [self cancelPreview];
   
   viewer = [self viewerForDataOfType: type];
   
@@ -410,7 +522,7 @@ static NSString *nibName = @"Contents";
         if ([currentViewer respondsToSelector: @selector(displayPath:)]) {
           [currentViewer displayPath: currentPath];
         } else if (currentViewer == textViewer) {
-          [currentViewer tryToDisplayPath: currentPath];
+          [self loadContentsAt: currentPath];
         }
       }
     }
@@ -496,83 +608,45 @@ static NSString *nibName = @"Contents";
 
 - (BOOL)tryToDisplayPath:(NSString *)path
 {
-  NSFileManager *fm = [NSFileManager defaultManager];
-  NSDictionary *attributes = [fm fileAttributesAtPath: path traverseLink: YES];
+  NSData *data = [self textContentsAtPath: path withAttributes: nil];
+
+  [self displayText: data ofPath: (data ? path : nil)];
 
+  return (data != nil);
+}
+
+- (void)displayText:(NSData *)data
+             ofPath:(NSString *)path
+{
   DESTROY (editPath);
   [editButt setEnabled: NO];	
 
-  if (attributes && ([attributes fileType] != NSFileTypeDirectory))
+  if (data)
     {
-      NSString *app = nil, *type = nil;
-
-      [ws getInfoForFile: path application: &app type: &type];
-
-      if (type && ((type == NSPlainFileType) || (type == NSShellCommandFileType)))
-	{
-	  NSData *data = [self textContentsAtPath: path withAttributes: attributes];
-
-	  if (data)
-	    {
-	      CREATE_AUTORELEASE_POOL (pool);
-	      NSString *str = [[NSString alloc] initWithData: data
-						    encoding: [NSString defaultCStringEncoding]];
-	      NSAttributedString *attrstr = [[NSAttributedString alloc] initWithString: str];
-
-	      [[textView textStorage] setAttributedString: attrstr];
-	      [[textView textStorage] addAttribute: NSFontAttributeName
-					     value: [NSFont systemFontOfSize: 8.0]
-					     range: NSMakeRange(0, [attrstr length])];
-	      RELEASE (str);
-	      RELEASE (attrstr);
-	      [editButt setEnabled: YES];
-	      ASSIGN (editPath, path);
-	      RELEASE (pool);
-
-	      return YES;
-	    }
-	}
+      CREATE_AUTORELEASE_POOL (pool);
+      NSString *str = [[NSString alloc] initWithData: data
+					    encoding: [NSString defaultCStringEncoding]];
+      NSAttributedString *attrstr = [[NSAttributedString alloc] initWithString: str];
+
+      [[textView textStorage] setAttributedString: attrstr];
+      [[textView textStorage] addAttribute: NSFontAttributeName
+				     value: [NSFont systemFontOfSize: 8.0]
+				     range: NSMakeRange(0, [attrstr length])];
+      RELEASE (str);
+      RELEASE (attrstr);
+      [editButt setEnabled: YES];
+      ASSIGN (editPath, path);
+      RELEASE (pool);
     }
-
-  return NO;
 }
 
+/* Regular files only, as NSPlainFileType and NSShellCommandFileType were;
+   at most MAXDATA bytes are read, and remembered by FSNTextPreview. */
 - (NSData *)textContentsAtPath:(NSString *)path 
                 withAttributes:(NSDictionary *)attributes
 {
-  unsigned long long nbytes = [attributes fileSize];
-  NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath: path];
-  NSData *data;
-    
-  nbytes = ((nbytes > MAXDATA) ? MAXDATA : nbytes);
-  
-  NS_DURING
-    {
-      data = [handle readDataOfLength: nbytes];
-    }
-  NS_HANDLER
-    {
-      [handle closeFile];
-	    return nil;
-    }
-  NS_ENDHANDLER
-  
-  [handle closeFile];
-  
-  if (data) {
-    const char *bytes = [data bytes];
-    int i;
-    
-    for (i = 0; i < nbytes; i++) {
-      if (!isascii(bytes[i])) {
-        return nil;
-      }
-    }
-    
-    return data;
-  }
-
-  return nil;
+  return [[FSNTextPreview sharedPreviews] textOfFileAtPath: path
+                                                    length: MAXDATA];
 }
 
 - (void)editFile:(id)sender
@@ -0,0 +1,31 @@
+/* FileChecksum.h
+ *
+ * Streaming XXH64, for checking a copy against the data written to it.
+ * Not a cryptographic hash: it catches corruption, not tampering.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FILE_CHECKSUM_H
+#define FILE_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  uint64_t total;
+  uint64_t v[4];
+  unsigned char mem[32];
+  size_t memsize;
+} file_checksum_t;
+
+void file_checksum_init(file_checksum_t *sum);
+
+void file_checksum_update(file_checksum_t *sum, const void *data, size_t len);
+
+/* As many zero bytes as a hole of that length reads back. */
+void file_checksum_update_zeros(file_checksum_t *sum, uint64_t len);
+
+uint64_t file_checksum_digest(const file_checksum_t *sum);
+
+#endif /* FILE_CHECKSUM_H */
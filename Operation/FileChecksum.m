@@ -0,0 +1,194 @@
+/* FileChecksum.m
+ *
+ * Streaming XXH64.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <string.h>
+
+#include "FileChecksum.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+/* XXH64 reads its input little-endian. */
+static inline uint64_t
+read64(const unsigned char *p)
+{
+  uint64_t v;
+
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline uint32_t
+read32(const unsigned char *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline uint64_t
+xxh_round(uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t
+xxh_merge(uint64_t acc, uint64_t val)
+{
+  acc ^= xxh_round(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+/* The four lanes are independent, so the loop keeps the ALUs busy. */
+static const unsigned char *
+consume_stripes(uint64_t *v, const unsigned char *p, const unsigned char *limit)
+{
+  uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+  while (p + 32 <= limit)
+    {
+      v1 = xxh_round(v1, read64(p));
+      v2 = xxh_round(v2, read64(p + 8));
+      v3 = xxh_round(v3, read64(p + 16));
+      v4 = xxh_round(v4, read64(p + 24));
+      p += 32;
+    }
+
+  v[0] = v1;
+  v[1] = v2;
+  v[2] = v3;
+  v[3] = v4;
+
+  return p;
+}
+
+void
+file_checksum_init(file_checksum_t *sum)
+{
+  memset(sum, 0, sizeof(*sum));
+  sum->v[0] = PRIME64_1 + PRIME64_2;
+  sum->v[1] = PRIME64_2;
+  sum->v[2] = 0;
+  sum->v[3] = 0 - PRIME64_1;
+}
+
+void
+file_checksum_update(file_checksum_t *sum, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  const unsigned char *end = p + len;
+
+  sum->total += len;
+
+  if (sum->memsize + len < 32)
+    {
+      memcpy(sum->mem + sum->memsize, p, len);
+      sum->memsize += len;
+      return;
+    }
+
+  if (sum->memsize > 0)
+    {
+      size_t fill = 32 - sum->memsize;
+
+      memcpy(sum->mem + sum->memsize, p, fill);
+      consume_stripes(sum->v, sum->mem, sum->mem + 32);
+      p += fill;
+      sum->memsize = 0;
+    }
+
+  p = consume_stripes(sum->v, p, end);
+
+  if (p < end)
+    {
+      memcpy(sum->mem, p, end - p);
+      sum->memsize = end - p;
+    }
+}
+
+void
+file_checksum_update_zeros(file_checksum_t *sum, uint64_t len)
+{
+  static const unsigned char zeros[64 * 1024];
+
+  while (len > 0)
+    {
+      size_t n = (len > sizeof(zeros)) ? sizeof(zeros) : (size_t)len;
+
+      file_checksum_update(sum, zeros, n);
+      len -= n;
+    }
+}
+
+uint64_t
+file_checksum_digest(const file_checksum_t *sum)
+{
+  const unsigned char *p = sum->mem;
+  const unsigned char *end = p + sum->memsize;
+  uint64_t h;
+
+  if (sum->total >= 32)
+    {
+      h = rotl64(sum->v[0], 1) + rotl64(sum->v[1], 7)
+        + rotl64(sum->v[2], 12) + rotl64(sum->v[3], 18);
+      h = xxh_merge(h, sum->v[0]);
+      h = xxh_merge(h, sum->v[1]);
+      h = xxh_merge(h, sum->v[2]);
+      h = xxh_merge(h, sum->v[3]);
+    }
+  else
+    {
+      h = PRIME64_5;
+    }
+
+  h += sum->total;
+
+  while (p + 8 <= end)
+    {
+      h ^= xxh_round(0, read64(p));
+      h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+      p += 8;
+    }
+  if (p + 4 <= end)
+    {
+      h ^= (uint64_t)read32(p) * PRIME64_1;
+      h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+      p += 4;
+    }
+  while (p < end)
+    {
+      h ^= (*p) * PRIME64_5;
+      h = rotl64(h, 11) * PRIME64_1;
+      p++;
+    }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
@@ -0,0 +1,94 @@
+/* FileCopyEngine.h
+ *
+ * Copies files and directory trees for the file operations, moving the
+ * data inside the kernel where it can (a reflink clone, copy_file_range()
+ * or sendfile()) and through one large aligned buffer where it cannot.
+ *
+ * Sparse files keep their holes: only the data extents are copied.
+ *
+ * Errors and progress go to an NSFileManager-style handler, so the
+ * executor keeps its -fileManager:willProcessPath: progress accounting
+ * and its -fileManager:shouldProceedAfterError: dialog.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FILE_COPY_ENGINE_H
+#define FILE_COPY_ENGINE_H
+
+#import <Foundation/Foundation.h>
+
+@class FileOpJournal;
+
+@interface FileCopyEngine : NSObject
+{
+  id handler;
+  NSFileManager *fm;
+  char *buffer;
+  unsigned long long bytesCopied;
+  unsigned long long *counter;
+  unsigned long long bytesSkipped;
+  unsigned long long *skipped;
+  NSTimeInterval lastReport;
+  FileOpJournal *journal;
+  BOOL resuming;
+  BOOL verifies;
+  FileCopyEngine *owner;
+  NSMutableArray *mismatches;
+  NSMutableArray *failures;
+  NSLock *pathsLock;
+}
+
+/* The handler is not retained. */
+- (id)initWithHandler:(id)aHandler;
+
+/* Like -[NSFileManager copyPath:toPath:handler:]: fails without
+ * calling the handler if dst exists, and asks the handler after each
+ * error whether to go on; an item that failed is skipped and the rest
+ * copied.  Returns YES only if every item was copied.  Mode, owner,
+ * times and extended attributes are carried over.  A directory is
+ * copied by a pool of worker threads sized for the source and
+ * destination devices; the handler is still only called from the
+ * calling thread.  */
+- (BOOL)copyPath:(NSString *)src toPath:(NSString *)dst;
+
+/* Copies one regular file; no handler calls other than the byte
+ * count.  Returns 0 or an errno. */
+- (int)copyFileAtPath:(NSString *)src toPath:(NSString *)dst;
+
+/* Completed files and the progress of large ones go to the journal,
+ * which is not retained.  When resuming, copies merge into what an
+ * earlier run left at the destination: files the journal has as done
+ * are skipped, partly copied ones continue from their last recorded
+ * offset and any others are copied again. */
+- (void)setJournal:(FileOpJournal *)aJournal resuming:(BOOL)flag;
+
+/* File data copied so far, all threads included; holes count too. */
+- (unsigned long long)bytesCopied;
+
+/* Of those, the bytes in holes, which were not written. */
+- (unsigned long long)bytesSkipped;
+
+/* Hashes each file as it is written, then reads the copy back from the
+ * device and compares.  A copy that does not match is removed and its
+ * path added to -mismatchedPaths; the rest of the copy goes on. */
+- (void)setVerifies:(BOOL)flag;
+
+- (NSArray *)mismatchedPaths;
+
+/* Source paths that could not be copied, since the engine was made. */
+- (NSArray *)failedPaths;
+
+@end
+
+
+@interface NSObject (FileCopyEngineHandler)
+
+/* Sent from the calling thread a few times a second while data moves,
+ * including in the middle of a large file. */
+- (void)copyEngine:(FileCopyEngine *)engine
+      didCopyBytes:(unsigned long long)bytes;
+
+@end
+
+#endif /* FILE_COPY_ENGINE_H */
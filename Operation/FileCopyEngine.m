@@ -0,0 +1,1401 @@
+/* FileCopyEngine.m
+ *
+ * Kernel-side file copies for the file operations.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#include <sys/xattr.h>
+#endif
+
+#import <GNUstepBase/GNUstep.h>
+#import "FileCopyEngine.h"
+#import "FileChecksum.h"
+#import "FileOpJournal.h"
+#import "Functions.h"
+
+#if defined(__linux__) && defined(__GLIBC__) \
+  && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+
+/* read()/write() buffer, aligned so O_DIRECT-friendly file systems and
+ * the page cache see whole pages. */
+#define BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGN 4096
+
+/* Upper bound for one copy_file_range()/sendfile() call, so a huge
+ * file does not pin a single syscall for seconds. */
+#define KERNEL_CHUNK (64 * 1024 * 1024)
+
+/* Bytes between the offsets a large file records in the journal; the
+ * data is synced first, so a recorded offset is never ahead of it. */
+#define CHECKPOINT_BYTES (256 * 1024 * 1024)
+
+/* Seconds between -copyEngine:didCopyBytes: messages. */
+#define REPORT_INTERVAL 0.25
+
+#ifdef __linux__
+/*
+ * A kernel copy that fails with one of these did not copy anything and
+ * left both offsets alone: the next method can carry on from there.
+ */
+static BOOL
+can_fall_back(int err)
+{
+  return (err == ENOSYS || err == EXDEV || err == EINVAL
+          || err == EOPNOTSUPP || err == EBADF
+#if defined(ENOTSUP) && ENOTSUP != EOPNOTSUPP
+          || err == ENOTSUP
+#endif
+          );
+}
+#endif
+
+@interface FileCopyEngine (Progress)
+
+- (void)reportBytes;
+
+@end
+
+static void
+count_bytes(unsigned long long *counter, off_t n, FileCopyEngine *reporter)
+{
+  __atomic_add_fetch(counter, (unsigned long long)n, __ATOMIC_RELAXED);
+  if (reporter)
+    [reporter reportBytes];
+}
+
+static size_t
+chunk_size(off_t left)
+{
+  return (left > KERNEL_CHUNK) ? KERNEL_CHUNK : (size_t)left;
+}
+
+/* Where a file being copied records its progress; no journal, none. */
+typedef struct {
+  FileOpJournal *journal;
+  NSString *dst;
+  const struct stat *st;
+  off_t next;
+} checkpoint_t;
+
+static void
+checkpoint(checkpoint_t *cp, int out, off_t done)
+{
+  if (cp->journal == nil || done < cp->next)
+    return;
+  cp->next = done + CHECKPOINT_BYTES;
+  if (fdatasync(out) == 0)
+    [cp->journal file: cp->dst
+             copiedTo: done
+           sourceSize: cp->st->st_size
+           sourceTime: cp->st->st_mtime];
+}
+
+/* Hashes what a resumed copy keeps from the earlier run. */
+static int
+hash_prefix(int in, off_t len, char *buf, file_checksum_t *sum)
+{
+  off_t pos = 0;
+
+  while (pos < len)
+    {
+      size_t want = (len - pos > BUFFER_SIZE) ? BUFFER_SIZE : (size_t)(len - pos);
+      ssize_t n = pread(in, buf, want, pos);
+
+      if (n == 0)
+        break;
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return errno;
+        }
+      file_checksum_update(sum, buf, n);
+      pos += n;
+    }
+
+  return 0;
+}
+
+/*
+ * Reads the copy back and compares it with the hash of what was
+ * written.  The data is synced and dropped from the page cache first,
+ * so the read comes from the device and not from our own writes.
+ */
+static int
+verify_copy(int out, const char *dpath, char *buf,
+            const file_checksum_t *expected, BOOL *match)
+{
+  file_checksum_t sum;
+  ssize_t n;
+  int fd;
+
+  if (fdatasync(out) != 0)
+    return errno;
+#ifdef POSIX_FADV_DONTNEED
+  posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+  fd = open(dpath, O_RDONLY);
+  if (fd < 0)
+    return errno;
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  file_checksum_init(&sum);
+  while ((n = read(fd, buf, BUFFER_SIZE)) != 0)
+    {
+      if (n < 0)
+        {
+          int err = errno;
+
+          if (err == EINTR)
+            continue;
+          close(fd);
+          return err;
+        }
+      file_checksum_update(&sum, buf, n);
+    }
+  close(fd);
+
+  *match = (sum.total == expected->total
+            && file_checksum_digest(&sum) == file_checksum_digest(expected));
+
+  return 0;
+}
+
+/* Fewer blocks than the size needs: the file has holes. */
+static BOOL
+is_sparse(const struct stat *st)
+{
+  return (st->st_size > 0
+          && (off_t)st->st_blocks * 512 < st->st_size - (off_t)st->st_blksize);
+}
+
+#ifdef SEEK_HOLE
+/*
+ * Copies bytes [from, to) at explicit offsets, through the kernel where
+ * it can; the file offsets are left alone.
+ */
+static int
+copy_range(int in, int out, off_t from, off_t to, char *buf,
+           unsigned long long *counter, FileCopyEngine *reporter,
+           checkpoint_t *cp, file_checksum_t *sum)
+{
+  ssize_t n;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  while (sum == NULL && from < to)
+    {
+      off_t inoff = from;
+      off_t outoff = from;
+
+      n = copy_file_range(in, &inoff, out, &outoff, chunk_size(to - from), 0);
+      if (n > 0)
+        {
+          from += n;
+          count_bytes(counter, n, reporter);
+          checkpoint(cp, out, from);
+        }
+      else if (n == 0)
+        return 0;
+      else if (errno == EINTR)
+        continue;
+      else if (can_fall_back(errno))
+        break;
+      else
+        return errno;
+    }
+#endif
+
+  while (from < to)
+    {
+      size_t len = (to - from > BUFFER_SIZE) ? BUFFER_SIZE : (size_t)(to - from);
+      char *p = buf;
+
+      n = pread(in, buf, len, from);
+      if (n == 0)
+        break;
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return errno;
+        }
+      if (sum)
+        file_checksum_update(sum, buf, n);
+
+      while (n > 0)
+        {
+          ssize_t w = pwrite(out, p, n, from);
+
+          if (w < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              return errno;
+            }
+          p += w;
+          n -= w;
+          from += w;
+          count_bytes(counter, w, reporter);
+        }
+      checkpoint(cp, out, from);
+    }
+
+  return 0;
+}
+
+/*
+ * Copies only the data extents of a sparse file: holes are skipped in
+ * `out` too, and the last one is made by ftruncate().  Hole bytes are
+ * counted as copied, for the progress, and added to `skipped`.
+ * Returns -1 when the file system does not report holes at all, so
+ * that the plain copy runs instead.
+ */
+static int
+copy_sparse(int in, int out, off_t start, off_t size, char *buf,
+            unsigned long long *counter, unsigned long long *skipped,
+            FileCopyEngine *reporter, checkpoint_t *cp, file_checksum_t *sum)
+{
+  off_t pos = start;
+  int err;
+
+  while (pos < size)
+    {
+      off_t data = lseek(in, pos, SEEK_DATA);
+      off_t hole;
+
+      if (data < 0 && errno == ENXIO)
+        data = size;
+      else if (data < 0)
+        return (pos == start && (errno == EINVAL || errno == ENOTSUP
+                                 || errno == EOPNOTSUPP)) ? -1 : errno;
+      if (data > size)
+        data = size;
+
+      if (data > pos)
+        {
+          if (sum)
+            file_checksum_update_zeros(sum, data - pos);
+          __atomic_add_fetch(skipped, (unsigned long long)(data - pos), __ATOMIC_RELAXED);
+          count_bytes(counter, data - pos, reporter);
+        }
+      if (data >= size)
+        break;
+
+      hole = lseek(in, data, SEEK_HOLE);
+      if (hole < 0)
+        return errno;
+      if (hole > size)
+        hole = size;
+
+      err = copy_range(in, out, data, hole, buf, counter, reporter, cp, sum);
+      if (err != 0)
+        return err;
+      pos = hole;
+    }
+
+  if (ftruncate(out, size) != 0)
+    return errno;
+
+  return 0;
+}
+#endif
+
+/*
+ * Copies the contents of `in` to `out` from offset `start`, which is 0
+ * unless an interrupted copy is being resumed; `out` holds exactly
+ * `start` bytes.  A sparse file keeps its holes.  Otherwise each
+ * method advances the file offsets, so when one gives up halfway the
+ * next continues where it stopped; the final read()/write() loop runs
+ * to EOF, which also catches files that grew or report size 0.  Every
+ * chunk is added to `counter`; a non-nil `reporter` is also told.
+ *
+ * With a `sum`, every byte written is hashed into it, the part an
+ * earlier run wrote included; the kernel paths, which never show the
+ * data to us, are skipped.
+ */
+static int
+copy_contents(int in, int out, off_t start, const struct stat *st, char *buf,
+              unsigned long long *counter, unsigned long long *skipped,
+              FileCopyEngine *reporter, checkpoint_t *cp, file_checksum_t *sum)
+{
+  off_t size = st->st_size;
+  off_t done = start;
+  ssize_t n;
+
+  if (start > 0 && sum)
+    {
+      int err = hash_prefix(in, start, buf, sum);
+
+      if (err != 0)
+        return err;
+    }
+
+  if (start > 0
+      && (lseek(in, start, SEEK_SET) < 0 || lseek(out, start, SEEK_SET) < 0))
+    return errno;
+
+#ifdef FICLONE
+  if (sum == NULL && start == 0 && size > 0 && ioctl(out, FICLONE, in) == 0)
+    {
+      count_bytes(counter, size, reporter);
+      return 0;
+    }
+#endif
+
+#ifdef SEEK_HOLE
+  if (is_sparse(st))
+    {
+      int err = copy_sparse(in, out, start, size, buf,
+                            counter, skipped, reporter, cp, sum);
+
+      if (err >= 0)
+        return err;
+    }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+  while (sum == NULL && done < size)
+    {
+      n = copy_file_range(in, NULL, out, NULL, chunk_size(size - done), 0);
+
+      if (n > 0)
+        {
+          done += n;
+          count_bytes(counter, n, reporter);
+          checkpoint(cp, out, done);
+        }
+      else if (n == 0)
+        break;
+      else if (errno == EINTR)
+        continue;
+      else if (can_fall_back(errno))
+        break;
+      else
+        return errno;
+    }
+#endif
+
+#ifdef __linux__
+  while (sum == NULL && done < size)
+    {
+      n = sendfile(out, in, NULL, chunk_size(size - done));
+
+      if (n > 0)
+        {
+          done += n;
+          count_bytes(counter, n, reporter);
+          checkpoint(cp, out, done);
+        }
+      else if (n == 0)
+        break;
+      else if (errno == EINTR)
+        continue;
+      else if (can_fall_back(errno))
+        break;
+      else
+        return errno;
+    }
+#endif
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(in, done, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  while (1)
+    {
+      char *p = buf;
+
+      n = read(in, buf, BUFFER_SIZE);
+      if (n == 0)
+        break;
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          return errno;
+        }
+      if (sum)
+        file_checksum_update(sum, buf, n);
+
+      while (n > 0)
+        {
+          ssize_t w = write(out, p, n);
+
+          if (w < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              return errno;
+            }
+          p += w;
+          n -= w;
+          done += w;
+          count_bytes(counter, w, reporter);
+        }
+      checkpoint(cp, out, done);
+    }
+
+  return 0;
+}
+
+#ifdef __linux__
+/* Copies what xattrs it can; the target may lack support or privileges
+ * (security.*, trusted.*), which is not an error for a copy. */
+static void
+copy_xattrs(int in, int out)
+{
+  ssize_t len = flistxattr(in, NULL, 0);
+  char *names;
+  char *name;
+
+  if (len <= 0)
+    return;
+
+  names = malloc(len);
+  if (names == NULL)
+    return;
+  len = flistxattr(in, names, len);
+
+  for (name = names; len > 0 && name < names + len; name += strlen(name) + 1)
+    {
+      ssize_t vlen = fgetxattr(in, name, NULL, 0);
+      char *value;
+
+      if (vlen < 0)
+        continue;
+      value = malloc(vlen ? vlen : 1);
+      if (value == NULL)
+        break;
+      vlen = fgetxattr(in, name, value, vlen);
+      if (vlen >= 0 && fsetxattr(out, name, value, vlen, 0) != 0
+          && (errno == ENOTSUP || errno == EOPNOTSUPP))
+        {
+          free(value);
+          break;
+        }
+      free(value);
+    }
+
+  free(names);
+}
+#endif
+
+/* Owner, xattrs, mode and times, in that order: chown clears setuid
+ * bits, and anything that writes would bump the mtime. */
+static void
+copy_metadata(int in, int out, const struct stat *st)
+{
+  struct timespec times[2];
+
+  if (fchown(out, st->st_uid, st->st_gid) != 0)
+    {
+      /* not the owner: keep ours, as NSFileManager does */
+    }
+#ifdef __linux__
+  copy_xattrs(in, out);
+#endif
+  fchmod(out, st->st_mode & 07777);
+
+  times[0] = st->st_atim;
+  times[1] = st->st_mtim;
+  futimens(out, times);
+}
+
+
+/* Recreates a symlink; returns 0 or an errno. */
+static int
+copy_link(const char *src, const char *dst, const struct stat *st)
+{
+  char target[PATH_MAX];
+  ssize_t len = readlink(src, target, sizeof(target) - 1);
+  struct timespec times[2];
+
+  if (len < 0)
+    return errno;
+  target[len] = '\0';
+
+  if (symlink(target, dst) != 0)
+    return errno;
+
+  if (lchown(dst, st->st_uid, st->st_gid) != 0)
+    {
+      /* not the owner: keep ours */
+    }
+  times[0] = st->st_atim;
+  times[1] = st->st_mtim;
+  utimensat(AT_FDCWD, dst, times, AT_SYMLINK_NOFOLLOW);
+
+  return 0;
+}
+
+/* mkdir(), writable by us until the contents are in; with `merge` a
+ * directory left there by an interrupted run will do as well. */
+static int
+make_directory(const char *path, BOOL merge)
+{
+  struct stat st;
+  int err;
+
+  if (mkdir(path, S_IRWXU) == 0)
+    return 0;
+  err = errno;
+  if (err == EEXIST && merge && stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      chmod(path, st.st_mode | S_IRWXU);
+      return 0;
+    }
+  return err;
+}
+
+/* Called once a directory's contents are in place. */
+static void
+copy_directory_metadata(const char *src, const char *dst, const struct stat *st)
+{
+  int in = open(src, O_RDONLY | O_DIRECTORY);
+  int out = open(dst, O_RDONLY | O_DIRECTORY);
+
+  if (in >= 0 && out >= 0)
+    copy_metadata(in, out, st);
+  if (in >= 0)
+    close(in);
+  if (out >= 0)
+    close(out);
+}
+
+/*
+ * Concurrent copies a device takes before it starts to seek more than
+ * it transfers: a spinning disk gets two, anything else (SSDs, network
+ * and virtual file systems) eight.
+ */
+#define ROTATIONAL_SLOTS 2
+#define DEFAULT_SLOTS 8
+
+/* Workers for copying the tree at src to dst, capped by both devices;
+ * a single spinning disk on both ends gets no parallelism at all. */
+static NSUInteger
+pipeline_workers(NSString *src, NSString *dst)
+{
+  struct stat sst, dst_st;
+  BOOL srot, drot;
+
+  if (stat([src fileSystemRepresentation], &sst) != 0
+      || stat([[dst stringByDeletingLastPathComponent] fileSystemRepresentation],
+              &dst_st) != 0)
+    return 1;
+
+  srot = isRotationalDevice(sst.st_dev);
+  drot = isRotationalDevice(dst_st.st_dev);
+
+  if (srot && drot && sst.st_dev == dst_st.st_dev)
+    return 1;
+
+  return (srot || drot) ? ROTATIONAL_SLOTS : DEFAULT_SLOTS;
+}
+
+
+/* One item of a tree copy; directories count their unfinished children. */
+@interface FileCopyNode : NSObject
+{
+@public
+  NSString *src;
+  NSString *dst;
+  FileCopyNode *parent;
+  struct stat st;
+  NSUInteger pending;
+}
+
+- (id)initWithPath:(NSString *)spath
+            toPath:(NSString *)dpath
+            parent:(FileCopyNode *)pnode;
+
+@end
+
+
+/*
+ * Copies a directory tree with a pool of worker threads.  Workers take
+ * items off a shared stack; a directory item creates the directory and
+ * pushes its children, so the walk runs inside the pool.  An item that
+ * fails is skipped, and its directory still finishes.  The calling
+ * thread only reports progress and the errors to the engine's handler,
+ * which is not thread safe.
+ */
+@interface FileCopyPipeline : NSObject
+{
+  FileCopyEngine *engine;
+  NSCondition *lock;
+  NSMutableArray *queue;
+  NSUInteger active;
+  NSUInteger running;
+  NSUInteger processed;
+  NSMutableArray *errors;
+  NSUInteger errorCount;
+  BOOL stopped;
+}
+
+- (id)initWithEngine:(FileCopyEngine *)anEngine;
+
+- (BOOL)copyTreeAtPath:(NSString *)src
+                toPath:(NSString *)dst
+               workers:(NSUInteger)workers;
+
+@end
+
+
+@interface FileCopyEngine (Private)
+
+- (BOOL)proceedAfterError:(NSString *)error
+                   atPath:(NSString *)path
+                   toPath:(NSString *)topath;
+
+- (void)willProcessPath:(NSString *)path;
+
+- (BOOL)copyLinkAtPath:(NSString *)src
+                toPath:(NSString *)dst
+            attributes:(const struct stat *)st;
+
+- (BOOL)copyDirectoryAtPath:(NSString *)src
+                     toPath:(NSString *)dst
+                 attributes:(const struct stat *)st;
+
+- (BOOL)copyItemAtPath:(NSString *)src toPath:(NSString *)dst;
+
+- (void)shareCounterOf:(FileCopyEngine *)engine;
+
+- (void)addMismatchAtPath:(NSString *)dst;
+
+- (void)addFailureAtPath:(NSString *)src;
+
+- (BOOL)isResuming;
+
+- (BOOL)isDoneAtPath:(NSString *)dst attributes:(const struct stat *)st;
+
+- (void)clearPath:(NSString *)dst;
+
+- (void)didFinishPath:(NSString *)dst;
+
+@end
+
+
+@implementation FileCopyEngine
+
+- (void)dealloc
+{
+  free(buffer);
+  RELEASE (mismatches);
+  RELEASE (failures);
+  RELEASE (pathsLock);
+  [super dealloc];
+}
+
+- (id)initWithHandler:(id)aHandler
+{
+  self = [super init];
+
+  if (self) {
+    handler = aHandler;
+    fm = [NSFileManager defaultManager];
+    buffer = NULL;
+    bytesCopied = 0;
+    counter = &bytesCopied;
+    bytesSkipped = 0;
+    skipped = &bytesSkipped;
+    lastReport = 0.0;
+    journal = nil;
+    resuming = NO;
+    verifies = NO;
+    owner = self;
+    mismatches = [NSMutableArray new];
+    failures = [NSMutableArray new];
+    pathsLock = [NSLock new];
+  }
+
+  return self;
+}
+
+- (BOOL)proceedAfterError:(NSString *)error
+                   atPath:(NSString *)path
+                   toPath:(NSString *)topath
+{
+  NSDictionary *errorDict;
+
+  [owner addFailureAtPath: path];
+
+  if ([handler respondsToSelector:
+                 @selector(fileManager:shouldProceedAfterError:)] == NO) {
+    return NO;
+  }
+
+  errorDict = [NSDictionary dictionaryWithObjectsAndKeys:
+                              path, @"NSFilePath",
+                            topath, @"NSFileToPath",
+                             error, @"Error", nil];
+
+  return [handler fileManager: fm shouldProceedAfterError: errorDict];
+}
+
+- (void)shareCounterOf:(FileCopyEngine *)engine
+{
+  counter = engine->counter;
+  skipped = engine->skipped;
+  journal = engine->journal;
+  resuming = engine->resuming;
+  verifies = engine->verifies;
+  owner = engine->owner;
+}
+
+- (void)setVerifies:(BOOL)flag
+{
+  verifies = flag;
+}
+
+- (NSArray *)mismatchedPaths
+{
+  NSArray *paths;
+
+  [pathsLock lock];
+  paths = [NSArray arrayWithArray: mismatches];
+  [pathsLock unlock];
+
+  return paths;
+}
+
+- (NSArray *)failedPaths
+{
+  NSArray *paths;
+
+  [pathsLock lock];
+  paths = [NSArray arrayWithArray: failures];
+  [pathsLock unlock];
+
+  return paths;
+}
+
+- (void)addMismatchAtPath:(NSString *)dst
+{
+  NSDebugLLog(@"gwspace", @"%@ does not match its source", dst);
+  [pathsLock lock];
+  [mismatches addObject: dst];
+  [pathsLock unlock];
+}
+
+- (void)addFailureAtPath:(NSString *)src
+{
+  [pathsLock lock];
+  [failures addObject: src];
+  [pathsLock unlock];
+}
+
+- (void)setJournal:(FileOpJournal *)aJournal resuming:(BOOL)flag
+{
+  journal = aJournal;
+  resuming = (aJournal != nil && flag);
+}
+
+- (BOOL)isResuming
+{
+  return resuming;
+}
+
+/* A file an earlier run finished still counts towards the progress. */
+- (BOOL)isDoneAtPath:(NSString *)dst attributes:(const struct stat *)st
+{
+  if (resuming == NO || [journal isFileDone: dst] == NO) {
+    return NO;
+  }
+  count_bytes(counter, S_ISREG(st->st_mode) ? st->st_size : 0, nil);
+  return YES;
+}
+
+/* Makes room for a copy an earlier run may have left unfinished. */
+- (void)clearPath:(NSString *)dst
+{
+  if (resuming) {
+    unlink([dst fileSystemRepresentation]);
+  }
+}
+
+- (void)didFinishPath:(NSString *)dst
+{
+  [journal fileDone: dst];
+}
+
+- (unsigned long long)bytesCopied
+{
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+- (unsigned long long)bytesSkipped
+{
+  return __atomic_load_n(skipped, __ATOMIC_RELAXED);
+}
+
+- (void)reportBytes
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  if (now - lastReport < REPORT_INTERVAL) {
+    return;
+  }
+  lastReport = now;
+
+  if ([handler respondsToSelector: @selector(copyEngine:didCopyBytes:)]) {
+    [handler copyEngine: self didCopyBytes: [self bytesCopied]];
+  }
+}
+
+- (void)willProcessPath:(NSString *)path
+{
+  if ([handler respondsToSelector: @selector(fileManager:willProcessPath:)]) {
+    [handler fileManager: fm willProcessPath: path];
+  }
+}
+
+- (int)copyFileAtPath:(NSString *)src toPath:(NSString *)dst
+{
+  const char *dpath = [dst fileSystemRepresentation];
+  file_checksum_t sum;
+  BOOL match = YES;
+  checkpoint_t cp;
+  struct stat st;
+  struct stat dst_st;
+  off_t start = 0;
+  int in, out;
+  int err;
+
+  if (buffer == NULL && posix_memalign((void **)&buffer, BUFFER_ALIGN,
+                                       BUFFER_SIZE) != 0) {
+    buffer = NULL;
+    return ENOMEM;
+  }
+
+  in = open([src fileSystemRepresentation], O_RDONLY);
+  if (in < 0) {
+    return errno;
+  }
+  if (fstat(in, &st) != 0) {
+    err = errno;
+    close(in);
+    return err;
+  }
+
+  out = -1;
+  if (resuming) {
+    start = [journal offsetForFile: dst
+                        sourceSize: st.st_size
+                        sourceTime: st.st_mtime];
+    if (start > 0) {
+      out = open(dpath, O_WRONLY);
+      if (out >= 0 && (fstat(out, &dst_st) != 0 || dst_st.st_size < start
+                       || ftruncate(out, start) != 0)) {
+        close(out);
+        out = -1;
+      }
+    }
+    if (out < 0) {
+      start = 0;
+      unlink(dpath);
+    }
+  }
+
+  if (out < 0) {
+    out = open(dpath, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  }
+  if (out < 0) {
+    err = errno;
+    close(in);
+    return err;
+  }
+
+  /* what an earlier run copied is progress too */
+  if (start > 0) {
+    count_bytes(counter, start, nil);
+  }
+
+  cp.journal = (st.st_size > CHECKPOINT_BYTES) ? journal : nil;
+  cp.dst = dst;
+  cp.st = &st;
+  cp.next = start + CHECKPOINT_BYTES;
+
+  if (verifies) {
+    file_checksum_init(&sum);
+  }
+
+  err = copy_contents(in, out, start, &st, buffer, counter, skipped,
+                      (handler != nil) ? self : nil, &cp,
+                      verifies ? &sum : NULL);
+  if (err == 0) {
+    copy_metadata(in, out, &st);
+  }
+  if (err == 0 && verifies) {
+    err = verify_copy(out, dpath, buffer, &sum, &match);
+  }
+
+  close(in);
+  if (close(out) != 0 && err == 0) {
+    err = errno;
+  }
+  if (err != 0 || match == NO) {
+    unlink(dpath);
+  } else {
+    [self didFinishPath: dst];
+  }
+  /* not an error: the copy goes on, and the mismatch is reported */
+  if (err == 0 && match == NO) {
+    [owner addMismatchAtPath: dst];
+  }
+
+  return err;
+}
+
+- (BOOL)copyLinkAtPath:(NSString *)src
+                toPath:(NSString *)dst
+            attributes:(const struct stat *)st
+{
+  int err;
+
+  [self clearPath: dst];
+  err = copy_link([src fileSystemRepresentation],
+                  [dst fileSystemRepresentation], st);
+
+  if (err != 0) {
+    return [self proceedAfterError: [NSString stringWithFormat:
+                                       @"cannot copy link: %s", strerror(err)]
+                            atPath: src
+                            toPath: dst];
+  }
+  [self didFinishPath: dst];
+
+  return YES;
+}
+
+- (BOOL)copyDirectoryAtPath:(NSString *)src
+                     toPath:(NSString *)dst
+                 attributes:(const struct stat *)st
+{
+  NSArray *contents;
+  NSUInteger i;
+
+  int err;
+
+  /* Writable by us until the contents are in; the real mode comes last. */
+  err = make_directory([dst fileSystemRepresentation], resuming);
+  if (err != 0) {
+    return [self proceedAfterError: [NSString stringWithFormat:
+                                       @"cannot create directory: %s", strerror(err)]
+                            atPath: src
+                            toPath: dst];
+  }
+
+  contents = [fm directoryContentsAtPath: src];
+
+  for (i = 0; i < [contents count]; i++) {
+    NSString *name = [contents objectAtIndex: i];
+    CREATE_AUTORELEASE_POOL(arp);
+    BOOL ok = [self copyItemAtPath: [src stringByAppendingPathComponent: name]
+                            toPath: [dst stringByAppendingPathComponent: name]];
+    RELEASE (arp);
+
+    if (ok == NO) {
+      return NO;
+    }
+  }
+
+  copy_directory_metadata([src fileSystemRepresentation],
+                          [dst fileSystemRepresentation], st);
+
+  return YES;
+}
+
+- (BOOL)copyItemAtPath:(NSString *)src toPath:(NSString *)dst
+{
+  struct stat st;
+  int err;
+
+  [self willProcessPath: src];
+
+  if (lstat([src fileSystemRepresentation], &st) != 0) {
+    return [self proceedAfterError: [NSString stringWithFormat:
+                                       @"cannot stat file: %s", strerror(errno)]
+                            atPath: src
+                            toPath: dst];
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    return [self copyDirectoryAtPath: src toPath: dst attributes: &st];
+  } else if ([self isDoneAtPath: dst attributes: &st]) {
+    return YES;
+  } else if (S_ISLNK(st.st_mode)) {
+    return [self copyLinkAtPath: src toPath: dst attributes: &st];
+  } else if (S_ISREG(st.st_mode) == NO) {
+    /* devices, fifos and sockets */
+    [self clearPath: dst];
+    if ([fm copyPath: src toPath: dst handler: handler] == NO) {
+      [owner addFailureAtPath: src];
+      return NO;
+    }
+    [self didFinishPath: dst];
+    return YES;
+  }
+
+  err = [self copyFileAtPath: src toPath: dst];
+  if (err != 0) {
+    return [self proceedAfterError: [NSString stringWithFormat:
+                                       @"cannot copy file: %s", strerror(err)]
+                            atPath: src
+                            toPath: dst];
+  }
+
+  return YES;
+}
+
+- (BOOL)copyPath:(NSString *)src toPath:(NSString *)dst
+{
+  struct stat st;
+  NSUInteger workers;
+  NSUInteger nfailed;
+  BOOL ok;
+
+  if (resuming == NO && lstat([dst fileSystemRepresentation], &st) == 0) {
+    return NO;
+  }
+
+  nfailed = [[self failedPaths] count];
+
+  if (lstat([src fileSystemRepresentation], &st) == 0 && S_ISDIR(st.st_mode)
+      && (workers = pipeline_workers(src, dst)) > 1) {
+    FileCopyPipeline *pipeline = [[FileCopyPipeline alloc] initWithEngine: self];
+
+    ok = [pipeline copyTreeAtPath: src toPath: dst workers: workers];
+    RELEASE (pipeline);
+  } else {
+    ok = [self copyItemAtPath: src toPath: dst];
+  }
+
+  /* the handler may have said to go on past a file left behind */
+  return (ok && [[self failedPaths] count] == nfailed);
+}
+
+@end
+
+
+@implementation FileCopyNode
+
+- (void)dealloc
+{
+  RELEASE (src);
+  RELEASE (dst);
+  RELEASE (parent);
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)spath
+            toPath:(NSString *)dpath
+            parent:(FileCopyNode *)pnode
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (src, spath);
+    ASSIGN (dst, dpath);
+    ASSIGN (parent, pnode);
+    pending = 0;
+  }
+
+  return self;
+}
+
+@end
+
+
+@implementation FileCopyPipeline
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (queue);
+  RELEASE (errors);
+  [super dealloc];
+}
+
+- (id)initWithEngine:(FileCopyEngine *)anEngine
+{
+  self = [super init];
+
+  if (self) {
+    engine = anEngine;
+    lock = [NSCondition new];
+    queue = [NSMutableArray new];
+    active = 0;
+    running = 0;
+    processed = 0;
+    errors = [NSMutableArray new];
+    errorCount = 0;
+    stopped = NO;
+  }
+
+  return self;
+}
+
+- (BOOL)copyTreeAtPath:(NSString *)src
+                toPath:(NSString *)dst
+               workers:(NSUInteger)workers
+{
+  FileCopyNode *root = [[FileCopyNode alloc] initWithPath: src
+                                                   toPath: dst
+                                                   parent: nil];
+  NSUInteger i;
+  BOOL done = NO;
+
+  [queue addObject: root];
+  RELEASE (root);
+
+  running = workers;
+  for (i = 0; i < workers; i++) {
+    [NSThread detachNewThreadSelector: @selector(workerLoop:)
+                             toTarget: self
+                           withObject: nil];
+  }
+
+  /* The handler is only ever called from this thread. */
+  while (done == NO) {
+    NSUInteger count;
+    NSArray *reported;
+
+    [lock lock];
+    [lock waitUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+    count = processed;
+    processed = 0;
+    reported = [errors copy];
+    [errors removeAllObjects];
+    done = (running == 0);
+    [lock unlock];
+
+    while (count--) {
+      [engine willProcessPath: src];
+    }
+    [engine reportBytes];
+
+    for (i = 0; i < [reported count]; i++) {
+      NSDictionary *error = [reported objectAtIndex: i];
+      NSString *path = [error objectForKey: @"NSFilePath"];
+
+      if (stopped) {
+        [engine addFailureAtPath: path];
+      } else if ([engine proceedAfterError: [error objectForKey: @"Error"]
+                                    atPath: path
+                                    toPath: [error objectForKey: @"NSFileToPath"]] == NO) {
+        [lock lock];
+        stopped = YES;
+        [lock broadcast];
+        [lock unlock];
+      }
+    }
+    RELEASE (reported);
+  }
+
+  /* What a stop left queued does not keep its directories writable. */
+  while ([queue count] > 0) {
+    FileCopyNode *node = RETAIN ([queue lastObject]);
+
+    [queue removeLastObject];
+    [self finishNode: node];
+    RELEASE (node);
+  }
+
+  return (stopped == NO && errorCount == 0);
+}
+
+/* The node is skipped; the directory it is in still finishes. */
+- (void)fail:(NSString *)message
+        node:(FileCopyNode *)node
+       error:(int)err
+{
+  NSString *error = [NSString stringWithFormat: @"%@: %s",
+                              message, strerror(err)];
+
+  [lock lock];
+  [errors addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+                                     node->src, @"NSFilePath",
+                                   node->dst, @"NSFileToPath",
+                                   error, @"Error", nil]];
+  errorCount++;
+  [lock broadcast];
+  [lock unlock];
+
+  [self finishNode: node];
+}
+
+/* The last child of a directory to finish applies the directory's mode
+ * and times, then counts itself done in the directory above. */
+- (void)finishNode:(FileCopyNode *)node
+{
+  while (node != nil && node->parent != nil) {
+    FileCopyNode *dir = node->parent;
+    BOOL last;
+
+    [lock lock];
+    last = (--dir->pending == 0);
+    [lock unlock];
+
+    if (last == NO) {
+      break;
+    }
+    copy_directory_metadata([dir->src fileSystemRepresentation],
+                            [dir->dst fileSystemRepresentation], &dir->st);
+    node = dir;
+  }
+}
+
+- (void)expandDirectory:(FileCopyNode *)node
+            fileManager:(NSFileManager *)manager
+                  merge:(BOOL)merge
+{
+  NSArray *contents;
+  NSUInteger count;
+  NSUInteger i;
+  int err;
+
+  err = make_directory([node->dst fileSystemRepresentation], merge);
+  if (err != 0) {
+    [self fail: @"cannot create directory" node: node error: err];
+    return;
+  }
+
+  contents = [manager directoryContentsAtPath: node->src];
+  count = [contents count];
+
+  if (count == 0) {
+    copy_directory_metadata([node->src fileSystemRepresentation],
+                            [node->dst fileSystemRepresentation], &node->st);
+    [self finishNode: node];
+    return;
+  }
+
+  [lock lock];
+  node->pending = count;
+  for (i = 0; i < count; i++) {
+    NSString *name = [contents objectAtIndex: i];
+    FileCopyNode *child;
+
+    child = [[FileCopyNode alloc] initWithPath: [node->src stringByAppendingPathComponent: name]
+                                        toPath: [node->dst stringByAppendingPathComponent: name]
+                                        parent: node];
+    [queue addObject: child];
+    RELEASE (child);
+  }
+  [lock broadcast];
+  [lock unlock];
+}
+
+- (void)processNode:(FileCopyNode *)node
+             engine:(FileCopyEngine *)copier
+        fileManager:(NSFileManager *)manager
+{
+  const char *spath = [node->src fileSystemRepresentation];
+  int err;
+
+  if (lstat(spath, &node->st) != 0) {
+    [self fail: @"cannot stat file" node: node error: errno];
+    return;
+  }
+
+  if (S_ISDIR(node->st.st_mode)) {
+    [self expandDirectory: node fileManager: manager merge: [copier isResuming]];
+    return;
+  } else if ([copier isDoneAtPath: node->dst attributes: &node->st]) {
+    /* finished by an earlier run */
+  } else if (S_ISLNK(node->st.st_mode)) {
+    [copier clearPath: node->dst];
+    err = copy_link(spath, [node->dst fileSystemRepresentation], &node->st);
+    if (err != 0) {
+      [self fail: @"cannot copy link" node: node error: err];
+      return;
+    }
+    [copier didFinishPath: node->dst];
+  } else if (S_ISREG(node->st.st_mode)) {
+    err = [copier copyFileAtPath: node->src toPath: node->dst];
+    if (err != 0) {
+      [self fail: @"cannot copy file" node: node error: err];
+      return;
+    }
+  } else {
+    [copier clearPath: node->dst];
+    if ([manager copyPath: node->src toPath: node->dst handler: nil] == NO) {
+      [self fail: @"cannot copy file" node: node error: EIO];
+      return;
+    }
+    [copier didFinishPath: node->dst];
+  }
+
+  [self finishNode: node];
+}
+
+- (void)workerLoop:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  /* Own buffer, own file manager: nothing here is shared but the queue. */
+  FileCopyEngine *copier = [[FileCopyEngine alloc] initWithHandler: nil];
+  NSFileManager *manager = [NSFileManager new];
+
+  [copier shareCounterOf: engine];
+
+  [lock lock];
+
+  while (1) {
+    FileCopyNode *node;
+
+    while ([queue count] == 0 && active > 0 && stopped == NO) {
+      [lock wait];
+    }
+    if (stopped || [queue count] == 0) {
+      break;
+    }
+
+    /* Last in, first out: the walk stays depth first, so directories
+     * finish, and get their metadata, early. */
+    node = RETAIN ([queue lastObject]);
+    [queue removeLastObject];
+    active++;
+    [lock unlock];
+
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      [self processNode: node engine: copier fileManager: manager];
+      RELEASE (arp);
+    }
+    RELEASE (node);
+
+    [lock lock];
+    active--;
+    processed++;
+    [lock broadcast];
+  }
+
+  running--;
+  [lock broadcast];
+  [lock unlock];
+
+  RELEASE (manager);
+  RELEASE (copier);
+  RELEASE (pool);
+}
+
+@end
@@ -0,0 +1,52 @@
+/* FileDeleteEngine.h
+ *
+ * Removes directory trees for Destroy and Empty Trash with a pool of
+ * worker threads, working relative to open directory descriptors
+ * (openat()/unlinkat()) so no path is resolved twice.
+ *
+ * Removals are counted by the workers and passed to the handler in
+ * batches from the calling thread, instead of one callback per file.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FILE_DELETE_ENGINE_H
+#define FILE_DELETE_ENGINE_H
+
+#import <Foundation/Foundation.h>
+
+@interface FileDeleteEngine : NSObject
+{
+  id handler;
+  NSCondition *lock;
+  NSMutableArray *queue;
+  NSUInteger active;
+  NSUInteger running;
+  NSUInteger removed;
+  NSMutableArray *errors;
+  BOOL rootRemoved;
+  BOOL cancelled;
+}
+
+/* The handler is not retained. */
+- (id)initWithHandler:(id)aHandler;
+
+/* Like -[NSFileManager removeFileAtPath:handler:], but an entry that
+ * cannot be removed is skipped, with the directories it is in, and the
+ * rest of the tree still goes.  The handler is asked after each error
+ * whether to go on.  Returns YES only if the path itself is gone.  */
+- (BOOL)removePath:(NSString *)path;
+
+@end
+
+
+@interface NSObject (FileDeleteEngineHandler)
+
+/* Sent from the calling thread a few times a second with the number of
+ * items removed since the last message; NO stops the removal. */
+- (BOOL)deleteEngine:(FileDeleteEngine *)engine
+      didRemoveItems:(NSUInteger)count;
+
+@end
+
+#endif /* FILE_DELETE_ENGINE_H */
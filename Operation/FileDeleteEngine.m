@@ -0,0 +1,449 @@
+/* FileDeleteEngine.m
+ *
+ * Parallel, descriptor-relative tree removal.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#import <GNUstepBase/GNUstep.h>
+#import "FileDeleteEngine.h"
+#import "Functions.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Removal is all metadata: a spinning disk gets two workers, to keep
+ * its journal writes close, anything else eight. */
+#define ROTATIONAL_WORKERS 2
+#define DEFAULT_WORKERS 8
+
+/* Seconds between -deleteEngine:didRemoveItems: messages. */
+#define REPORT_INTERVAL 0.1
+
+
+/* A directory being emptied.  Its descriptor stays open while any
+ * subdirectory still needs it for openat() and unlinkat().  A directory
+ * that keeps an entry it could not remove is kept too. */
+@interface FileDeleteNode : NSObject
+{
+@public
+  FileDeleteNode *parent;
+  char *name;
+  int fd;
+  NSUInteger pending;
+  BOOL keep;
+}
+
+- (id)initWithName:(const char *)aName
+            parent:(FileDeleteNode *)pnode;
+
+@end
+
+@implementation FileDeleteNode
+
+- (void)dealloc
+{
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(name);
+  RELEASE (parent);
+  [super dealloc];
+}
+
+- (id)initWithName:(const char *)aName
+            parent:(FileDeleteNode *)pnode
+{
+  self = [super init];
+
+  if (self) {
+    name = strdup(aName);
+    ASSIGN (parent, pnode);
+    fd = -1;
+    pending = 0;
+    keep = NO;
+  }
+
+  return self;
+}
+
+@end
+
+
+@interface FileDeleteEngine (Private)
+
+- (void)fail:(int)err
+        node:(FileDeleteNode *)node
+       child:(const char *)child;
+
+- (void)reportErrors;
+
+- (BOOL)proceedAfterError:(int)err
+                   atPath:(NSString *)path;
+
+- (void)finishDirectory:(FileDeleteNode *)node;
+
+- (void)emptyDirectory:(FileDeleteNode *)node;
+
+- (void)workerLoop:(id)sender;
+
+@end
+
+
+@implementation FileDeleteEngine
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (queue);
+  RELEASE (errors);
+  [super dealloc];
+}
+
+- (id)initWithHandler:(id)aHandler
+{
+  self = [super init];
+
+  if (self) {
+    handler = aHandler;
+    lock = [NSCondition new];
+    queue = [NSMutableArray new];
+    errors = [NSMutableArray new];
+  }
+
+  return self;
+}
+
+- (BOOL)removePath:(NSString *)path
+{
+  const char *fspath = [path fileSystemRepresentation];
+  FileDeleteNode *root;
+  NSUInteger workers;
+  NSUInteger i;
+  struct stat st;
+  BOOL done = NO;
+
+  if (lstat(fspath, &st) != 0) {
+    [self proceedAfterError: errno atPath: path];
+    return NO;
+  }
+
+  if (S_ISDIR(st.st_mode) == NO) {
+    if (unlink(fspath) != 0) {
+      [self proceedAfterError: errno atPath: path];
+      return NO;
+    }
+    if ([handler respondsToSelector: @selector(deleteEngine:didRemoveItems:)]) {
+      [handler deleteEngine: self didRemoveItems: 1];
+    }
+    return YES;
+  }
+
+  workers = isRotationalDevice(st.st_dev) ? ROTATIONAL_WORKERS : DEFAULT_WORKERS;
+
+  active = 0;
+  removed = 0;
+  rootRemoved = NO;
+  cancelled = NO;
+  [errors removeAllObjects];
+
+  root = [[FileDeleteNode alloc] initWithName: fspath parent: nil];
+  [queue addObject: root];
+  RELEASE (root);
+
+  running = workers;
+  for (i = 0; i < workers; i++) {
+    [NSThread detachNewThreadSelector: @selector(workerLoop:)
+                             toTarget: self
+                           withObject: nil];
+  }
+
+  /* The handler is only ever called from this thread. */
+  while (done == NO) {
+    NSUInteger count;
+
+    [lock lock];
+    [lock waitUntilDate: [NSDate dateWithTimeIntervalSinceNow: REPORT_INTERVAL]];
+    count = removed;
+    removed = 0;
+    done = (running == 0);
+    [lock unlock];
+
+    if (count > 0
+        && [handler respondsToSelector: @selector(deleteEngine:didRemoveItems:)]
+        && [handler deleteEngine: self didRemoveItems: count] == NO) {
+      [lock lock];
+      cancelled = YES;
+      [lock broadcast];
+      [lock unlock];
+    }
+
+    [self reportErrors];
+  }
+
+  [queue removeAllObjects];
+
+  return (cancelled == NO && rootRemoved);
+}
+
+@end
+
+
+@implementation FileDeleteEngine (Private)
+
+/* Queues the error for the handler; its path is rebuilt from the node
+ * chain.  The caller keeps the node. */
+- (void)fail:(int)err
+        node:(FileDeleteNode *)node
+       child:(const char *)child
+{
+  NSMutableData *bytes = [NSMutableData data];
+  NSMutableArray *names = [NSMutableArray array];
+  NSString *path;
+  FileDeleteNode *n;
+  NSUInteger i;
+
+  for (n = node; n != nil; n = n->parent) {
+    [names insertObject: [NSValue valueWithPointer: n->name] atIndex: 0];
+  }
+  for (i = 0; i < [names count]; i++) {
+    const char *part = [[names objectAtIndex: i] pointerValue];
+
+    if (i > 0) {
+      [bytes appendBytes: "/" length: 1];
+    }
+    [bytes appendBytes: part length: strlen(part)];
+  }
+  if (child) {
+    [bytes appendBytes: "/" length: 1];
+    [bytes appendBytes: child length: strlen(child)];
+  }
+
+  path = [[NSFileManager defaultManager]
+           stringWithFileSystemRepresentation: [bytes bytes]
+                                       length: [bytes length]];
+
+  [lock lock];
+  [errors addObject: [NSArray arrayWithObjects:
+                                [NSNumber numberWithInt: err], path, nil]];
+  [lock broadcast];
+  [lock unlock];
+}
+
+/* Called from the calling thread only; NO from the handler stops the
+ * removal. */
+- (void)reportErrors
+{
+  NSArray *reported;
+  NSUInteger i;
+
+  [lock lock];
+  reported = [errors copy];
+  [errors removeAllObjects];
+  [lock unlock];
+
+  for (i = 0; i < [reported count] && cancelled == NO; i++) {
+    NSArray *error = [reported objectAtIndex: i];
+
+    if ([self proceedAfterError: [[error objectAtIndex: 0] intValue]
+                         atPath: [error objectAtIndex: 1]] == NO) {
+      [lock lock];
+      cancelled = YES;
+      [lock broadcast];
+      [lock unlock];
+    }
+  }
+  RELEASE (reported);
+}
+
+- (BOOL)proceedAfterError:(int)err
+                   atPath:(NSString *)path
+{
+  NSDictionary *errorDict;
+
+  if ([handler respondsToSelector:
+                 @selector(fileManager:shouldProceedAfterError:)] == NO) {
+    return NO;
+  }
+
+  errorDict = [NSDictionary dictionaryWithObjectsAndKeys:
+                              path, @"NSFilePath",
+                            [NSString stringWithFormat: @"cannot remove: %s",
+                                      strerror(err)], @"Error", nil];
+
+  return [handler fileManager: [NSFileManager defaultManager]
+      shouldProceedAfterError: errorDict];
+}
+
+/* Removes an emptied directory, unless it keeps something; the last
+ * subdirectory of its parent to finish then finishes the parent, up to
+ * the root. */
+- (void)finishDirectory:(FileDeleteNode *)node
+{
+  while (node != nil) {
+    FileDeleteNode *dir = node->parent;
+    int pfd = (dir != nil) ? dir->fd : AT_FDCWD;
+    BOOL gone = NO;
+    BOOL last;
+
+    if (node->fd >= 0) {
+      close(node->fd);
+      node->fd = -1;
+    }
+
+    if (node->keep == NO) {
+      gone = (unlinkat(pfd, node->name, AT_REMOVEDIR) == 0);
+      if (gone == NO) {
+        [self fail: errno node: node child: NULL];
+      }
+    }
+
+    [lock lock];
+    if (gone) {
+      removed++;
+    } else if (dir != nil) {
+      dir->keep = YES;
+    }
+    if (dir == nil) {
+      rootRemoved = gone;
+    }
+    last = (dir != nil && --dir->pending == 0);
+    [lock unlock];
+
+    if (last == NO) {
+      break;
+    }
+    node = dir;
+  }
+}
+
+/* Unlinks everything in the directory but its subdirectories, which
+ * go on the queue for whichever worker is free. */
+- (void)emptyDirectory:(FileDeleteNode *)node
+{
+  int pfd = (node->parent != nil) ? node->parent->fd : AT_FDCWD;
+  NSMutableArray *subdirs = [NSMutableArray array];
+  NSUInteger count = 0;
+  struct dirent *ent;
+  DIR *dir;
+  int dfd;
+
+  node->fd = openat(pfd, node->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if (node->fd < 0) {
+    [self fail: errno node: node child: NULL];
+    node->keep = YES;
+    [self finishDirectory: node];
+    return;
+  }
+
+  dfd = dup(node->fd);
+  dir = (dfd >= 0) ? fdopendir(dfd) : NULL;
+  if (dir == NULL) {
+    [self fail: errno node: node child: NULL];
+    if (dfd >= 0) {
+      close(dfd);
+    }
+    node->keep = YES;
+    [self finishDirectory: node];
+    return;
+  }
+
+  while ((ent = readdir(dir)) != NULL) {
+    const char *dname = ent->d_name;
+    BOOL isdir;
+
+    if (dname[0] == '.'
+        && (dname[1] == '\0' || (dname[1] == '.' && dname[2] == '\0'))) {
+      continue;
+    }
+
+#ifdef DT_DIR
+    if (ent->d_type != DT_UNKNOWN) {
+      isdir = (ent->d_type == DT_DIR);
+    } else
+#endif
+    {
+      struct stat st;
+
+      isdir = (fstatat(node->fd, dname, &st, AT_SYMLINK_NOFOLLOW) == 0
+               && S_ISDIR(st.st_mode));
+    }
+
+    if (isdir) {
+      FileDeleteNode *child = [[FileDeleteNode alloc] initWithName: dname
+                                                            parent: node];
+      [subdirs addObject: child];
+      RELEASE (child);
+    } else if (unlinkat(node->fd, dname, 0) == 0) {
+      count++;
+    } else {
+      [self fail: errno node: node child: dname];
+      node->keep = YES;
+    }
+  }
+  closedir(dir);
+
+  [lock lock];
+  removed += count;
+  node->pending = [subdirs count];
+  [queue addObjectsFromArray: subdirs];
+  [lock broadcast];
+  [lock unlock];
+
+  if ([subdirs count] == 0) {
+    [self finishDirectory: node];
+  }
+}
+
+- (void)workerLoop:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(pool);
+
+  [lock lock];
+
+  while (1) {
+    FileDeleteNode *node;
+
+    while ([queue count] == 0 && active > 0 && cancelled == NO) {
+      [lock wait];
+    }
+    if (cancelled || [queue count] == 0) {
+      break;
+    }
+
+    /* depth first: subtrees finish, and close their descriptors, early */
+    node = RETAIN ([queue lastObject]);
+    [queue removeLastObject];
+    active++;
+    [lock unlock];
+
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      [self emptyDirectory: node];
+      RELEASE (arp);
+    }
+    RELEASE (node);
+
+    [lock lock];
+    active--;
+    [lock broadcast];
+  }
+
+  running--;
+  [lock broadcast];
+  [lock unlock];
+
+  RELEASE (pool);
+}
+
+@end
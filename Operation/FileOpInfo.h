@@ -26,6 +26,9 @@
 #import <Foundation/Foundation.h>
 
 @class FileOpExecutor;
+@class FileCopyEngine;
+@class FileDeleteEngine;
+@class FileOpJournal;
 
 @class NSWindow;
 @class NSTextField;
@@ -41,9 +44,16 @@
 
 - (NSInteger)showErrorAlertWithMessage:(NSString *)message;
 
-- (void)setNumFiles:(int)n;
+- (void)setNumFiles:(int)n
+         totalBytes:(unsigned long long)bytes
+           complete:(BOOL)complete;
 
-- (void)setProgIndicatorValue:(int)n;
+- (void)setProgIndicatorValue:(int)n
+                    bytesDone:(unsigned long long)bytes;
+
+- (void)setBytesSkipped:(unsigned long long)bytes;
+
+- (void)setMismatchedPaths:(bycopy NSArray *)paths;
 
 - (void)sendDidChangeNotification;
 
@@ -119,6 +129,29 @@
   IBOutlet NSProgressIndicator *progInd;
   IBOutlet NSButton *pauseButt;
   IBOutlet NSButton *stopButt;  
+
+  NSString *winTitle;
+  int totalFiles;
+  int filesDone;
+  unsigned long long totalBytes;
+  BOOL totalsComplete;
+  unsigned long long bytesDone;
+  unsigned long long bytesBase;
+  NSTimeInterval rateTime;
+  unsigned long long rateBytes;
+  double throughput;
+  unsigned long long bytesSkipped;
+  NSArray *mismatchedPaths;
+
+  NSArray *devices;
+  BOOL queued;
+
+  FileOpJournal *journal;
+
+  BOOL inProcess;
+  NSTimer *progressTimer;
+  int sampledFiles;
+  unsigned long long sampledBytes;
 }
 
 + (id)operationOfType:(NSString *)tp
@@ -141,8 +174,24 @@
                     winrect:(NSRect)wrect
                  controller:(id)cntrl;
 
+- (void)setPriority:(NSString *)priority;
+
+- (BOOL)isBackground;
+
+- (void)setVerifies:(BOOL)flag;
+
+- (NSArray *)devices;
+
+- (BOOL)runsInProcess;
+
+- (void)setJournalPath:(NSString *)path;
+
 - (void)startOperation;
 
+- (BOOL)isQueued;
+
+- (void)startQueuedOperation;
+
 - (void)detachOperationThread;
 
 - (NSInteger)requestUserConfirmationWithMessage:(NSString *)message 
@@ -156,9 +205,27 @@
 
 - (void)showProgressWin;
 
-- (void)setNumFiles:(int)n;
+- (void)setNumFiles:(int)n
+         totalBytes:(unsigned long long)bytes
+           complete:(BOOL)complete;
+
+- (void)setProgIndicatorValue:(int)n
+                    bytesDone:(unsigned long long)bytes;
+
+- (void)storeProgress:(int)n
+            bytesDone:(unsigned long long)bytes;
 
-- (void)setProgIndicatorValue:(int)n;
+- (void)sampleProgress:(NSTimer *)timer;
+
+- (double)throughput;
+
+- (NSTimeInterval)estimatedTimeRemaining;
+
+- (NSDictionary *)progressInfo;
+
+- (void)setBytesSkipped:(unsigned long long)bytes;
+
+- (void)setMismatchedPaths:(NSArray *)paths;
 
 - (void)removeProcessedFiles;
 
@@ -200,6 +267,7 @@
 @interface FileOpExecutor: NSObject
 {
   NSString *operation;
+  int ref;
   NSString *source;
   NSString *destination;
   NSMutableArray *files;
@@ -210,22 +278,50 @@
   float progstep;
   int stepcount;
   BOOL canupdate;
+  int scanFiles;
+  unsigned long long scanBytes;
+  BOOL scanDone;
+  BOOL scanned;
+  int shownFiles;
+  NSTimeInterval shownTime;
   BOOL samename;
   BOOL onlyolder;
   NSFileManager *fm;
+  FileCopyEngine *copier;
+  FileDeleteEngine *remover;
+  FileOpJournal *journal;
+  FileOpInfo *info;
+  NSSet *sidecars;
+  BOOL sidecarsToXattrs;
+  BOOL verify;
   id <FileOpInfoProtocol> fileOp;
 }
 
 + (void)setPorts:(NSArray *)thePorts;
 
++ (void)setBackgroundPorts:(NSArray *)thePorts;
+
 - (void)setFileop:(NSArray *)thePorts;
 
+- (void)setFileOpInfo:(FileOpInfo *)anInfo;
+
+- (void)showProgress:(int)n
+           bytesDone:(unsigned long long)bytes;
+
 - (BOOL)setOperation:(NSData *)opinfo;
 
 - (BOOL)checkSameName;
 
 - (oneway void)calculateNumFiles:(NSUInteger)continueFrom;
 
+- (void)scanSidecars;
+
+- (BOOL)hasSidecar:(NSString *)name;
+
+- (void)transferSidecarOf:(NSString *)src
+                   toPath:(NSString *)dst
+                     move:(BOOL)move;
+
 - (oneway void)performOperation;
 
 - (NSData *)processedFiles;
@@ -23,6 +23,17 @@
  * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <fts.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import <GNUstepBase/GNUstep.h>
@@ -31,6 +42,11 @@
 #import "FileOpInfo.h"
 #import "Operation.h"
 #import "Functions.h"
+#import "FileCopyEngine.h"
+#import "FileDeleteEngine.h"
+#import "FileOpJournal.h"
+#import "FSNTrace.h"
+#import "FSNTrash.h"
 
 
 /*
@@ -48,11 +64,211 @@ sidecar_path(NSString *filePath)
 
 
 #define PROGR_STEPS (100.0)
+
+/* Seconds between the samples averaged into the throughput. */
+#define RATE_INTERVAL (1.0)
+
+/* Seconds between refined totals while the pre-scan still runs. */
+#define SCAN_REFINE_INTERVAL (0.5)
+
+/* Seconds between samples of an in-process executor's progress. */
+#define PROGRESS_SAMPLE_INTERVAL (0.1)
+
+static NSString *
+bytes_description(double bytes)
+{
+  if (bytes < 1024.0)
+    return [NSString stringWithFormat: @"%.0f bytes", bytes];
+  if (bytes < 1024.0 * 1024.0)
+    return [NSString stringWithFormat: @"%.1f KB", bytes / 1024.0];
+  if (bytes < 1024.0 * 1024.0 * 1024.0)
+    return [NSString stringWithFormat: @"%.1f MB", bytes / (1024.0 * 1024.0)];
+  return [NSString stringWithFormat: @"%.2f GB", bytes / (1024.0 * 1024.0 * 1024.0)];
+}
+
+static NSString *
+time_description(NSTimeInterval secs)
+{
+  if (secs < 60.0)
+    return [NSString stringWithFormat: @"%.0f %@", secs,
+                     NSLocalizedString(@"sec left", @"")];
+  if (secs < 3600.0)
+    return [NSString stringWithFormat: @"%.0f %@", secs / 60.0,
+                     NSLocalizedString(@"min left", @"")];
+  return [NSString stringWithFormat: @"%.1f %@", secs / 3600.0,
+                   NSLocalizedString(@"hours left", @"")];
+}
+
+/* st_dev of the path, or of its nearest existing ancestor; nil if none. */
+static NSNumber *
+device_of_path(NSString *path)
+{
+  struct stat st;
+
+  while ([path length] > 0)
+    {
+      if (stat([path fileSystemRepresentation], &st) == 0)
+        return [NSNumber numberWithUnsignedLongLong: (unsigned long long)st.st_dev];
+      if ([path isEqual: @"/"])
+        break;
+      path = [path stringByDeletingLastPathComponent];
+    }
+  return nil;
+}
+
+#if defined(__linux__) && !defined(RENAME_NOREPLACE)
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+/* Renames `name` from the directory open as `srcfd` to the one open as
+ * `dstfd`, never over an entry there: 0, or the errno.  ENOSYS where
+ * the system cannot refuse to replace. */
+static int
+rename_noreplace(int srcfd, int dstfd, NSString *name)
+{
+#if defined(__linux__) && defined(SYS_renameat2)
+  const char *fsname = [name fileSystemRepresentation];
+
+  if (syscall(SYS_renameat2, srcfd, fsname, dstfd, fsname, RENAME_NOREPLACE) == 0)
+    return 0;
+  return errno;
+#else
+  return ENOSYS;
+#endif
+}
+
 static BOOL stopped = NO;
 static BOOL paused = NO;
 
+/* Nice value of a background operation's thread. */
+#define BACKGROUND_NICE 10
+
+#ifdef __linux__
+#ifndef IOPRIO_CLASS_IDLE
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_PRIO_VALUE(class, data) (((class) << IOPRIO_CLASS_SHIFT) | (data))
+#endif
+#endif
+
+/*
+ * Puts the calling thread in the idle I/O class, which only gets the
+ * disk when nobody else wants it, and lowers its CPU priority.  Both
+ * are per thread on Linux and inherited by the threads it starts, so
+ * the copy and delete workers follow.
+ */
+static void
+lower_thread_priority(void)
+{
+#ifdef __linux__
+  pid_t tid = (pid_t)syscall(SYS_gettid);
+
+  syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+          IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+  setpriority(PRIO_PROCESS, tid, BACKGROUND_NICE);
+#endif
+}
+
+/*
+ * Counts what an operation on `paths` will process, the way the
+ * executor's progress sees it: everything inside a directory, but not
+ * the directory itself; and, if `bytes` is given, the regular files'
+ * sizes.  The counts are published as they grow, for a reader on
+ * another thread.  Gives up, with a partial count, when the operation
+ * stops.
+ */
+static void
+count_paths(NSArray *paths, int *files, unsigned long long *bytes)
+{
+  NSUInteger count = [paths count];
+  char **argv = malloc((count + 1) * sizeof(char *));
+  unsigned long long total = 0;
+  int n = 0;
+  FTS *fts;
+  FTSENT *ent;
+  NSUInteger i;
+
+  if (argv == NULL)
+    return;
+
+  for (i = 0; i < count; i++)
+    argv[i] = (char *)[[paths objectAtIndex: i] fileSystemRepresentation];
+  argv[count] = NULL;
+
+  fts = fts_open(argv, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+
+  while (fts && stopped == NO && (ent = fts_read(fts)) != NULL)
+    {
+      if (ent->fts_info == FTS_DP)
+        continue;
+      if (ent->fts_info == FTS_D && ent->fts_level == FTS_ROOTLEVEL)
+        continue;
+
+      n++;
+      if (ent->fts_info == FTS_F)
+        total += ent->fts_statp->st_size;
+
+      if ((n & 255) == 0)
+        {
+          if (bytes)
+            __atomic_store_n(bytes, total, __ATOMIC_RELAXED);
+          __atomic_store_n(files, n, __ATOMIC_RELAXED);
+        }
+    }
+
+  if (fts)
+    fts_close(fts);
+  free(argv);
+
+  if (bytes)
+    __atomic_store_n(bytes, total, __ATOMIC_RELAXED);
+  __atomic_store_n(files, n, __ATOMIC_RELAXED);
+}
+
 static NSString *nibName = @"FileOperationWin";
 
+
+/* The FileOpInfoProtocol side of an in-process executor: messages
+ * are run on the main thread, where the window lives, and waited for. */
+@interface FileOpMainThreadProxy : NSProxy
+{
+  id target;
+}
+
+- (id)initWithTarget:(id)anObject;
+
+@end
+
+@implementation FileOpMainThreadProxy
+
+- (void)dealloc
+{
+  RELEASE (target);
+  [super dealloc];
+}
+
+- (id)initWithTarget:(id)anObject
+{
+  ASSIGN (target, anObject);
+  return self;
+}
+
+- (NSMethodSignature *)methodSignatureForSelector:(SEL)aSelector
+{
+  return [target methodSignatureForSelector: aSelector];
+}
+
+- (void)forwardInvocation:(NSInvocation *)anInvocation
+{
+  [anInvocation performSelectorOnMainThread: @selector(invokeWithTarget:)
+                                 withObject: target
+                              waitUntilDone: YES];
+}
+
+@end
+
+
 @implementation FileOpInfo
 
 - (NSString *)description
@@ -74,6 +290,11 @@ static NSString *nibName = @"FileOperationWin";
   RELEASE (dupfiles);
   RELEASE (notifNames);
   RELEASE (win);
+  RELEASE (winTitle);
+  RELEASE (devices);
+  RELEASE (journal);
+  RELEASE (progressTimer);
+  RELEASE (mismatchedPaths);
   
   DESTROY (executor);
   DESTROY (execconn);
@@ -210,6 +431,7 @@ static NSString *nibName = @"FileOperationWin";
       if (destination != nil)
 	[operationDict setObject: destination forKey: @"destination"];
       [operationDict setObject: files forKey: @"files"];
+      [operationDict setObject: @"interactive" forKey: @"priority"];
 
       confirm = conf;
       executor = nil;
@@ -312,9 +534,122 @@ static NSString *nibName = @"FileOperationWin";
         return;
       }
     }
+
+  /* copies can be resumed after a crash or a logout */
+  if (journal == nil && [type isEqual: NSWorkspaceCopyOperation])
+    {
+      journal = [[FileOpJournal alloc] initWithOperation: operationDict];
+    }
+  if (journal)
+    {
+      [journal claim];
+      [operationDict setObject: [journal path] forKey: @"journal"];
+    }
+
+  /* the controller starts it once its devices are free */
+  if ([controller shouldDeferOperation: self])
+    {
+      queued = YES;
+      if (showwin)
+        {
+          [self showProgressWin];
+          [progInd stopAnimation: self];
+          [win setTitle: [NSString stringWithFormat: @"%@ - %@", winTitle,
+                                   NSLocalizedString(@"waiting", @"")]];
+          [pauseButt setTitle: NSLocalizedString(@"Run Next", @"")];
+        }
+      return;
+    }
+
   [self detachOperationThread];
 }
 
+- (BOOL)isQueued
+{
+  return queued;
+}
+
+- (void)startQueuedOperation
+{
+  queued = NO;
+  if (showwin)
+    {
+      [win setTitle: winTitle];
+      [pauseButt setTitle: NSLocalizedString(@"Pause", @"")];
+      [progInd startAnimation: self];
+    }
+  [self detachOperationThread];
+}
+
+/* @"interactive" (the default) or @"background" */
+- (void)setPriority:(NSString *)priority
+{
+  [operationDict setObject: priority forKey: @"priority"];
+}
+
+- (BOOL)isBackground
+{
+  return [[operationDict objectForKey: @"priority"] isEqual: @"background"];
+}
+
+/* Copy and Move read every file back after writing it. */
+- (void)setVerifies:(BOOL)flag
+{
+  [operationDict setObject: [NSNumber numberWithBool: flag] forKey: @"verify"];
+}
+
+/* Resumes the operation recorded in an interrupted journal. */
+- (void)setJournalPath:(NSString *)path
+{
+  ASSIGN (journal, AUTORELEASE ([[FileOpJournal alloc] initWithContentsOfPath: path]));
+}
+
+/* The devices the operation reads and writes, as NSNumbers; empty for
+ * the ones that only touch directory entries (links, renames, new files
+ * and folders, moves within a device), which never wait for a device. */
+- (NSArray *)devices
+{
+  if (devices == nil)
+    {
+      NSMutableArray *devs = [NSMutableArray array];
+      NSNumber *srcdev = device_of_path(source);
+      NSNumber *dstdev = device_of_path(destination);
+
+      if (([type isEqual: NSWorkspaceLinkOperation]
+           || [type isEqual: @"WorkspaceRenameOperation"]
+           || [type isEqual: @"WorkspaceCreateDirOperation"]
+           || [type isEqual: @"WorkspaceCreateFileOperation"]) == NO)
+        {
+          if (srcdev)
+            [devs addObject: srcdev];
+          if (dstdev && [dstdev isEqual: srcdev] == NO)
+            [devs addObject: dstdev];
+
+          if (([type isEqual: NSWorkspaceMoveOperation]
+               || [type isEqual: NSWorkspaceRecycleOperation]
+               || [type isEqual: @"WorkspaceRecycleOutOperation"])
+              && [devs count] == 1 && srcdev && dstdev)
+            [devs removeAllObjects];
+        }
+
+      ASSIGN (devices, devs);
+    }
+
+  return devices;
+}
+
+/*
+ * The operations that only touch directory entries are done before a
+ * DO connection to an executor thread would even be set up: they run
+ * on a dispatch queue, calling back through a main thread proxy, and
+ * their progress is sampled from counters instead of being sent.
+ * Background ones keep their own, lowered, thread.
+ */
+- (BOOL)runsInProcess
+{
+  return ([[self devices] count] == 0 && [self isBackground] == NO);
+}
+
 - (void) threadWillExit: (NSNotification *)notification
 {
   [nc removeObserver: self
@@ -329,6 +664,17 @@ static NSString *nibName = @"FileOperationWin";
   NSPort *port[2];
   NSArray *ports;
 
+  inProcess = [self runsInProcess];
+  if (inProcess)
+    {
+      FileOpExecutor *exec = [FileOpExecutor new];
+
+      [exec setFileOpInfo: self];
+      [self registerExecutor: exec];
+      RELEASE (exec);
+      return;
+    }
+
   port[0] = (NSPort *)[NSPort port];
   port[1] = (NSPort *)[NSPort port];
   
@@ -346,9 +692,18 @@ static NSString *nibName = @"FileOperationWin";
 
   NS_DURING
     {
-      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        [FileOpExecutor setPorts:ports];
-      });
+      if ([self isBackground])
+        {
+          [NSThread detachNewThreadSelector: @selector(setBackgroundPorts:)
+                                   toTarget: [FileOpExecutor class]
+                                 withObject: ports];
+        }
+      else
+        {
+          dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [FileOpExecutor setPorts:ports];
+          });
+        }
     }
   NS_HANDLER
     {
@@ -383,6 +738,12 @@ static NSString *nibName = @"FileOperationWin";
 
 - (IBAction)pause:(id)sender
 {
+  if (queued)
+    {
+      [controller moveOperationToFront: self];
+      return;
+    }
+
   if (paused == NO)
     {
       [pauseButt setTitle: NSLocalizedString(@"Continue", @"")];	
@@ -398,6 +759,14 @@ static NSString *nibName = @"FileOperationWin";
 
 - (IBAction)stop:(id)sender
 {
+  /* nothing runs yet, and the flag is shared with the running ones */
+  if (queued)
+    {
+      queued = NO;
+      [self endOperation];
+      return;
+    }
+
   if (paused)
     {
       [self endOperation];
@@ -517,6 +886,7 @@ static NSString *nibName = @"FileOperationWin";
 	[toField setStringValue: @""];
       }
 
+    ASSIGN (winTitle, [win title]);
     [progInd setIndeterminate: YES];
     [progInd startAnimation: self];
   }
@@ -525,22 +895,139 @@ static NSString *nibName = @"FileOperationWin";
   showwin = YES;
 }
 
+/* With a byte total the bar counts bytes, otherwise files.  Sent again
+ * with growing totals while the pre-scan runs, the last time complete. */
 - (void)setNumFiles:(int)n
+         totalBytes:(unsigned long long)bytes
+           complete:(BOOL)complete
 {
+  totalFiles = n;
+  totalBytes = bytes;
+  totalsComplete = complete;
+
   [progInd stopAnimation: self];
   [progInd setIndeterminate: NO];
   [progInd setMinValue: 0.0];
-  [progInd setMaxValue: n];
-  [progInd setDoubleValue: 0.0];
+  [progInd setMaxValue: (totalBytes > 0) ? (double)totalBytes : n];
+  [progInd setDoubleValue: (totalBytes > 0) ? (double)bytesDone : filesDone];
 }
 
 - (void)setProgIndicatorValue:(int)n
+                    bytesDone:(unsigned long long)bytes
 {
-  [progInd setDoubleValue: n];
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  filesDone = n;
+  bytesDone = bytesBase + bytes;
+
+  if (rateTime == 0.0 || bytesDone < rateBytes)
+    {
+      rateTime = now;
+      rateBytes = bytesDone;
+    }
+  else if (now - rateTime >= RATE_INTERVAL)
+    {
+      double rate = (bytesDone - rateBytes) / (now - rateTime);
+
+      throughput = (throughput > 0.0) ? (throughput * 0.7 + rate * 0.3) : rate;
+      rateTime = now;
+      rateBytes = bytesDone;
+    }
+
+  if ([progInd isIndeterminate] == NO)
+    [progInd setDoubleValue: (totalBytes > 0) ? (double)bytesDone : n];
+
+  if (showwin && winTitle && totalBytes > 0 && throughput > 0.0
+      && totalsComplete == NO)
+    {
+      [win setTitle: [NSString stringWithFormat: @"%@ - %@ %@ %@, %@/s",
+                               winTitle,
+                               bytes_description(bytesDone),
+                               NSLocalizedString(@"of at least", @""),
+                               bytes_description(totalBytes),
+                               bytes_description(throughput)]];
+    }
+  else if (showwin && winTitle && totalBytes > 0 && throughput > 0.0)
+    {
+      [win setTitle: [NSString stringWithFormat: @"%@ - %@ %@ %@, %@/s, %@",
+                               winTitle,
+                               bytes_description(bytesDone),
+                               NSLocalizedString(@"of", @""),
+                               bytes_description(totalBytes),
+                               bytes_description(throughput),
+                               time_description([self estimatedTimeRemaining])]];
+    }
+}
+
+/* From an in-process executor's thread. */
+- (void)storeProgress:(int)n
+            bytesDone:(unsigned long long)bytes
+{
+  __atomic_store_n(&sampledBytes, bytes, __ATOMIC_RELAXED);
+  __atomic_store_n(&sampledFiles, n, __ATOMIC_RELAXED);
+}
+
+- (void)sampleProgress:(NSTimer *)timer
+{
+  int n = __atomic_load_n(&sampledFiles, __ATOMIC_RELAXED);
+  unsigned long long bytes = __atomic_load_n(&sampledBytes, __ATOMIC_RELAXED);
+
+  if (n != filesDone || bytesBase + bytes != bytesDone)
+    [self setProgIndicatorValue: n bytesDone: bytes];
+}
+
+/* Bytes per second, averaged; 0 until there are two samples. */
+- (double)throughput
+{
+  return throughput;
+}
+
+/* Seconds, or -1 while there is no final byte total or no throughput yet. */
+- (NSTimeInterval)estimatedTimeRemaining
+{
+  if (totalBytes == 0 || totalsComplete == NO || throughput <= 0.0)
+    return -1.0;
+  if (bytesDone >= totalBytes)
+    return 0.0;
+  return (totalBytes - bytesDone) / throughput;
+}
+
+- (NSDictionary *)progressInfo
+{
+  NSMutableDictionary *info = [NSMutableDictionary dictionary];
+
+  [info setObject: [NSNumber numberWithInt: ref] forKey: @"ref"];
+  [info setObject: type forKey: @"operation"];
+  [info setObject: source forKey: @"source"];
+  if (destination != nil)
+    [info setObject: destination forKey: @"destination"];
+  [info setObject: [NSNumber numberWithInt: filesDone] forKey: @"filesDone"];
+  [info setObject: [NSNumber numberWithInt: totalFiles] forKey: @"totalFiles"];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: bytesDone]
+           forKey: @"bytesDone"];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: totalBytes]
+           forKey: @"totalBytes"];
+  [info setObject: [NSNumber numberWithDouble: throughput]
+           forKey: @"throughput"];
+  [info setObject: [NSNumber numberWithDouble: [self estimatedTimeRemaining]]
+           forKey: @"secondsRemaining"];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: bytesSkipped]
+           forKey: @"bytesSkipped"];
+  [info setObject: [NSNumber numberWithUnsignedInteger: [mismatchedPaths count]]
+           forKey: @"mismatches"];
+  [info setObject: [NSNumber numberWithBool: queued] forKey: @"queued"];
+
+  return info;
 }
 
 - (void)cleanUpExecutor
 {
+  if (progressTimer)
+    {
+      [progressTimer invalidate];
+      DESTROY (progressTimer);
+    }
+
   if (executor)
     {
       [nc removeObserver: self
@@ -562,7 +1049,8 @@ static NSString *nibName = @"FileOperationWin";
       [win saveFrameUsingName: @"fopinfo"];
       [win close];
     }
-  
+
+  [journal remove];
   [controller endOfFileOperation: self];
   [execconn setRootObject:nil];
 }
@@ -594,6 +1082,38 @@ static NSString *nibName = @"FileOperationWin";
   RELEASE (arp);
 }
 
+/* Hole bytes of sparse files the copy did not write, for the summary. */
+- (void)setBytesSkipped:(unsigned long long)bytes
+{
+  bytesSkipped = bytes;
+  if (bytes > 0)
+    NSDebugLLog(@"gwspace", @"%@: %@ of holes not written",
+                type, bytes_description(bytes));
+}
+
+/* Copies that did not read back as written; they were removed. */
+- (void)setMismatchedPaths:(NSArray *)paths
+{
+  NSUInteger count = [paths count];
+  NSMutableString *msg;
+  NSUInteger i;
+
+  ASSIGN (mismatchedPaths, paths);
+  if (count == 0)
+    return;
+
+  msg = [NSMutableString stringWithFormat: @"%@\n",
+                         NSLocalizedString(@"These copies did not match the originals and were removed:", @"")];
+  for (i = 0; i < count && i < 10; i++)
+    [msg appendFormat: @"\n%@", [paths objectAtIndex: i]];
+  if (count > i)
+    [msg appendFormat: @"\n%@", [NSString stringWithFormat:
+                                            NSLocalizedString(@"and %lu more", @""),
+                                          (unsigned long)(count - i)]];
+
+  NSRunAlertPanel(nil, @"%@", NSLocalizedString(@"OK", @""), nil, nil, msg);
+}
+
 - (void)sendDidChangeNotification
 {
   CREATE_AUTORELEASE_POOL(arp);
@@ -614,6 +1134,12 @@ static NSString *nibName = @"FileOperationWin";
     [notifObj setObject: notifNames forKey: @"files"];
     [notifObj setObject: notifNames forKey: @"origfiles"];	
   }
+
+  if (bytesSkipped > 0)
+    [notifObj setObject: [NSNumber numberWithUnsignedLongLong: bytesSkipped]
+                 forKey: @"bytesSkipped"];
+  if ([mismatchedPaths count] > 0)
+    [notifObj setObject: mismatchedPaths forKey: @"mismatches"];
   
   opdone = YES;			
 
@@ -628,7 +1154,8 @@ static NSString *nibName = @"FileOperationWin";
   NSData *opinfo = [NSArchiver archivedDataWithRootObject: operationDict];
   BOOL samename;
 
-  [anObject setProtocolForProxy: @protocol(FileOpExecutorProtocol)];
+  if ([anObject isProxy])
+    [anObject setProtocolForProxy: @protocol(FileOpExecutorProtocol)];
   executor = (id <FileOpExecutorProtocol>)[anObject retain];
   
   [executor setOperation: opinfo];
@@ -677,6 +1204,7 @@ static NSString *nibName = @"FileOperationWin";
       
           if (result == NSAlertAlternateReturn)
             {
+              [journal remove];
               [controller endOfFileOperation: self];
               return;   
             }
@@ -696,7 +1224,33 @@ static NSString *nibName = @"FileOperationWin";
   
   stopped = NO;
   paused = NO;   
-  [executor calculateNumFiles:[procFiles count]];
+  /* a resumed executor counts its bytes from zero again */
+  bytesBase = bytesDone;
+
+  if (inProcess)
+    {
+      id exec = executor;
+      NSUInteger continueFrom = [procFiles count];
+
+      sampledFiles = filesDone;
+      sampledBytes = 0;
+      if (showwin)
+        {
+          ASSIGN (progressTimer,
+                  [NSTimer scheduledTimerWithTimeInterval: PROGRESS_SAMPLE_INTERVAL
+                                                   target: self
+                                                 selector: @selector(sampleProgress:)
+                                                 userInfo: nil
+                                                  repeats: YES]);
+        }
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        [exec calculateNumFiles: continueFrom];
+      });
+    }
+  else
+    {
+      [executor calculateNumFiles:[procFiles count]];
+    }
 }
 
 - (BOOL)connection:(NSConnection*)ancestor 
@@ -808,6 +1362,18 @@ shouldMakeNewConnection:(NSConnection*)newConn
   RELEASE (pool);
 }
 
+/*
+ * Background operations run on a thread of their own rather than on a
+ * shared dispatch queue thread: an unprivileged thread cannot raise
+ * its priorities back once lowered, so the thread has to die with the
+ * operation.
+ */
++ (void)setBackgroundPorts:(NSArray *)thePorts
+{
+  lower_thread_priority();
+  [self setPorts: thePorts];
+}
+
 - (void)dealloc
 {
   RELEASE (operation);
@@ -815,6 +1381,12 @@ shouldMakeNewConnection:(NSConnection*)newConn
   RELEASE (destination);
   RELEASE (files);
   RELEASE (procfiles);
+  RELEASE (copier);
+  RELEASE (remover);
+  RELEASE (journal);
+  RELEASE (sidecars);
+  if (info)
+    RELEASE ((id)fileOp);
   [super dealloc];
 }
 
@@ -824,6 +1396,8 @@ shouldMakeNewConnection:(NSConnection*)newConn
   
   if (self) {
     fm = [NSFileManager defaultManager];
+    copier = [[FileCopyEngine alloc] initWithHandler: self];
+    remover = [[FileDeleteEngine alloc] initWithHandler: self];
 		samename = NO;
     onlyolder = NO;
   }
@@ -848,6 +1422,25 @@ shouldMakeNewConnection:(NSConnection*)newConn
   fileOp = (id <FileOpInfoProtocol>)anObject;
 }
 
+/* In process, the proxy keeps the FileOpInfo alive until the
+ * executor is done with it. */
+- (void)setFileOpInfo:(FileOpInfo *)anInfo
+{
+  info = anInfo;
+  fileOp = (id <FileOpInfoProtocol>)[[FileOpMainThreadProxy alloc] initWithTarget: anInfo];
+}
+
+/* In process the counters are sampled on the main thread; over DO
+ * they are sent. */
+- (void)showProgress:(int)n
+           bytesDone:(unsigned long long)bytes
+{
+  if (info)
+    [info storeProgress: n bytesDone: bytes];
+  else
+    [fileOp setProgIndicatorValue: n bytesDone: bytes];
+}
+
 - (BOOL)setOperation:(NSData *)opinfo
 {
   NSDictionary *opDict = [NSUnarchiver unarchiveObjectWithData: opinfo];
@@ -858,6 +1451,8 @@ shouldMakeNewConnection:(NSConnection*)newConn
     ASSIGN (operation, dictEntry);   
   } 
 
+  ref = [[opDict objectForKey: @"ref"] intValue];
+
   dictEntry = [opDict objectForKey: @"source"];
   if (dictEntry) {
     ASSIGN (source, dictEntry);
@@ -875,6 +1470,26 @@ shouldMakeNewConnection:(NSConnection*)newConn
   }		
   
   procfiles = [NSMutableArray new];
+
+  verify = [[opDict objectForKey: @"verify"] boolValue];
+  [copier setVerifies: verify];
+
+  /* a resumed operation skips what an earlier run finished */
+  dictEntry = [opDict objectForKey: @"journal"];
+  if (dictEntry) {
+    NSUInteger i;
+
+    journal = [[FileOpJournal alloc] initWithContentsOfPath: dictEntry];
+
+    for (i = [files count]; i > 0; i--) {
+      NSString *name = [[files objectAtIndex: i - 1] objectForKey: @"name"];
+
+      if ([journal isEntryDone: name]) {
+        [files removeObjectAtIndex: i - 1];
+      }
+    }
+    [copier setJournal: journal resuming: NO];
+  }
   
   return YES;
 }
@@ -901,6 +1516,10 @@ shouldMakeNewConnection:(NSConnection*)newConn
           NSDictionary *dict = [files objectAtIndex: i];
           NSString *name = [dict objectForKey: @"name"]; 
     
+          /* left there by an interrupted run of this operation */
+          if ([journal wasEntryStarted: name])
+            continue;
+
           if ([dirContents containsObject: name])
             {
               samename = YES;
@@ -935,91 +1554,161 @@ shouldMakeNewConnection:(NSConnection*)newConn
   onlyolder = flag;
 }
 
+/*
+ * Starts the operation right away and counts what it will process on
+ * a background queue; the executor picks the running totals up in its
+ * handler callbacks (-takeScanResult), so the progress total grows
+ * while the scan goes on and is final once it is done.
+ */
 - (oneway void)calculateNumFiles:(NSUInteger)continueFrom
 {
-  NSUInteger i;
-  NSUInteger fnum = 0;
-
   if (continueFrom == 0)
     {
+      NSMutableArray *paths = [NSMutableArray array];
+      BOOL countBytes = ([operation isEqual: NSWorkspaceCopyOperation]
+                         || [operation isEqual: NSWorkspaceDuplicateOperation]);
+      NSUInteger i;
+
       for (i = 0; i < [files count]; i++)
         {
-          CREATE_AUTORELEASE_POOL (arp);
           NSDictionary *dict = [files objectAtIndex: i];
           NSString *name = [dict objectForKey: @"name"]; 
-          NSString *path = [source stringByAppendingPathComponent: name];       
-          BOOL isDir = NO;
-          
-          [fm fileExistsAtPath: path isDirectory: &isDir];
-          
-          if (isDir)
-            {
-              NSDirectoryEnumerator *enumerator = [fm enumeratorAtPath: path];
-              
-              while (1)
-                {
-                  CREATE_AUTORELEASE_POOL (arp2);
-                  NSString *dirEntry = [enumerator nextObject];
-                  
-                  if (dirEntry)
-                    {
-                      if (stopped)
-                        {
-                          RELEASE (arp2);
-                          break;
-                        }
-                      fnum++;
-                    }
-                  else
-                    {
-                      RELEASE (arp2);
-                      break;
-                    }
-                  RELEASE (arp2);
-                }
-            }
-          else
-            {
-              fnum++;
-            }
-          
-          if (stopped)
-            {
-              RELEASE (arp);
-              break;
-            }
-          RELEASE (arp);
-        }
-      
-      if (stopped)
-        {
-          [fileOp endOperation];
-          [fileOp cleanUpExecutor];
+
+          [paths addObject: [source stringByAppendingPathComponent: name]];
         }
-      
+
       fcount = 0;
       stepcount = 0;
-      
-      if (fnum < PROGR_STEPS)
-        {
-          progstep = 1.0;
-        }
-      else
-        {
-          progstep = fnum / PROGR_STEPS;
-        }
-      [fileOp setNumFiles: fnum];
+      scanned = NO;
+      scanDone = NO;
+      scanFiles = 0;
+      scanBytes = 0;
+      shownFiles = 0;
+      shownTime = 0.0;
+
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        CREATE_AUTORELEASE_POOL (arp);
+
+        count_paths(paths, &scanFiles, countBytes ? &scanBytes : NULL);
+        __atomic_store_n(&scanDone, YES, __ATOMIC_RELEASE);
+        RELEASE (arp);
+      });
     }
   else
     {
       fcount = continueFrom;
       stepcount = continueFrom;
+      /* the totals from the first run are still shown */
+      scanned = YES;
+      shownTime = [NSDate timeIntervalSinceReferenceDate];
     }
+  [self scanSidecars];
   [self performOperation];
 }
 
+/*
+ * The ._ sidecars of the entries, from one listing of the directory
+ * they are in, instead of a stat per entry while they are processed.
+ * A sidecar that is an entry itself is processed on its own.
+ */
+- (void)scanSidecars
+{
+  NSString *dir = [operation isEqual: NSWorkspaceDuplicateOperation] ? destination : source;
+  NSArray *contents = [fm directoryContentsAtPath: dir];
+  NSMutableSet *entries = [NSMutableSet set];
+  NSMutableSet *found = [NSMutableSet set];
+  NSUInteger i;
+
+  for (i = 0; i < [files count]; i++)
+    {
+      [entries addObject: [[files objectAtIndex: i] objectForKey: @"name"]];
+    }
+
+  for (i = 0; i < [contents count]; i++)
+    {
+      NSString *name = [contents objectAtIndex: i];
+
+      if ([name hasPrefix: @"._"] && [name length] > 2
+          && [entries containsObject: name] == NO
+          && [entries containsObject: [name substringFromIndex: 2]])
+        {
+          [found addObject: name];
+        }
+    }
+
+  ASSIGN (sidecars, found);
+  sidecarsToXattrs = [[NSUserDefaults standardUserDefaults]
+                       boolForKey: @"GSConvertSidecarsToXattrs"];
+}
+
+- (BOOL)hasSidecar:(NSString *)name
+{
+  return [sidecars containsObject: [@"._" stringByAppendingString: name]];
+}
+
+/* Right after its primary; with GSConvertSidecarsToXattrs set, a
+ * destination that takes xattrs gets them instead of the ._ file. */
+- (void)transferSidecarOf:(NSString *)src
+                   toPath:(NSString *)dst
+                     move:(BOOL)move
+{
+  NSString *scsrc = sidecar_path(src);
+
+  if (sidecarsToXattrs && convertSidecarToXattrs(scsrc, dst))
+    {
+      if (move)
+        [fm removeFileAtPath: scsrc handler: nil];
+    }
+  else if (move)
+    {
+      [fm movePath: scsrc toPath: sidecar_path(dst) handler: self];
+    }
+  else
+    {
+      [copier copyPath: scsrc toPath: sidecar_path(dst)];
+    }
+}
+
+/* Called on the executor thread only, which owns fileOp.  Partial
+ * totals go out at most every SCAN_REFINE_INTERVAL seconds. */
+- (void)takeScanResult
+{
+  BOOL done;
+  int nfiles;
+  NSTimeInterval now;
+
+  if (scanned)
+    return;
+
+  done = __atomic_load_n(&scanDone, __ATOMIC_ACQUIRE);
+  nfiles = __atomic_load_n(&scanFiles, __ATOMIC_RELAXED);
+  now = [NSDate timeIntervalSinceReferenceDate];
+
+  if (done == NO
+      && (nfiles == shownFiles || now - shownTime < SCAN_REFINE_INTERVAL))
+    return;
+
+  scanned = done;
+  shownFiles = nfiles;
+  shownTime = now;
+
+  if (nfiles < PROGR_STEPS)
+    {
+      progstep = 1.0;
+    }
+  else
+    {
+      progstep = nfiles / PROGR_STEPS;
+    }
+  [fileOp setNumFiles: nfiles
+           totalBytes: __atomic_load_n(&scanBytes, __ATOMIC_RELAXED)
+             complete: done];
+}
+
 - (oneway void)performOperation
 {
+  FSN_TRACE_SCOPE_OP ("file operation", ref);
+
   canupdate = YES; 
 
   if ([operation isEqual: NSWorkspaceMoveOperation]
@@ -1075,28 +1764,94 @@ fileinfo = [files objectAtIndex: 0]; \
 RETAIN (fileinfo); \
 filename = [fileinfo objectForKey: @"name"];
 
+/*
+ * Within a volume the items are renamed in place, with no stat of each:
+ * a name taken shows as EEXIST, and only then is the existing entry
+ * looked at.  An item that cannot be renamed so, like a mount point,
+ * goes the way of a move across volumes.
+ */
 - (void)doMove
 {
+  int srcfd = -1;
+  int dstfd = -1;
+
+  if ([device_of_path(source) isEqual: device_of_path(destination)])
+    {
+      srcfd = open([source fileSystemRepresentation], O_RDONLY | O_DIRECTORY);
+      dstfd = open([destination fileSystemRepresentation], O_RDONLY | O_DIRECTORY);
+    }
+
   while (1)
     {
+      BOOL handled = NO;
+
       CHECK_DONE;	
       GET_FILENAME;    
 
-      if ((samename == NO) || (samename && [self removeExisting: fileinfo]))
+      if ((srcfd >= 0) && (dstfd >= 0))
+        {
+          int err = rename_noreplace(srcfd, dstfd, filename);
+
+          if ((err == EEXIST) && samename)
+            {
+              if ([self removeExisting: fileinfo])
+                err = rename_noreplace(srcfd, dstfd, filename);
+              else
+                handled = YES;
+            }
+
+          if (err == 0)
+            {
+              [procfiles addObject: filename];
+              if ([self hasSidecar: filename])
+                [self transferSidecarOf: [source stringByAppendingPathComponent: filename]
+                                 toPath: [destination stringByAppendingPathComponent: filename]
+                                   move: YES];
+              fcount++;
+              stepcount++;
+              [self takeScanResult];
+              if (shownTime > 0.0 && stepcount >= progstep)
+                {
+                  stepcount = 0;
+                  [self showProgress: fcount bytesDone: [copier bytesCopied]];
+                }
+              handled = YES;
+            }
+          else if (err == ENOSYS)
+            {
+              close(srcfd);
+              srcfd = -1;
+            }
+        }
+
+      if (handled == NO
+          && ((samename == NO) || (samename && [self removeExisting: fileinfo])))
 	{
 	  NSString *src = [source stringByAppendingPathComponent: filename];
 	  NSString *dst = [destination stringByAppendingPathComponent: filename];
 	  
-	  if ([fm movePath: src toPath: dst handler: self])
+	  if (verify && [device_of_path(src) isEqual: device_of_path(destination)] == NO)
+	    {
+	      /* the source goes only once all of it was copied and read
+		 back right; the handler may have gone on past an error */
+	      NSUInteger bad = [[copier mismatchedPaths] count];
+	      NSUInteger failed = [[copier failedPaths] count];
+
+	      if ([copier copyPath: src toPath: dst]
+		  && [[copier failedPaths] count] == failed
+		  && [[copier mismatchedPaths] count] == bad
+		  && [fm removeFileAtPath: src handler: self])
+		{
+		  [procfiles addObject: filename];
+		  if ([self hasSidecar: filename])
+		    [self transferSidecarOf: src toPath: dst move: YES];
+		}
+	    }
+	  else if ([fm movePath: src toPath: dst handler: self])
 	    {    
 	      [procfiles addObject: filename];	
-          /* Move AppleDouble sidecar if present */
-          {
-            NSString *sc_src = sidecar_path(src);
-            NSString *sc_dst = sidecar_path(dst);
-            if ([fm fileExistsAtPath: sc_src])
-              [fm movePath: sc_src toPath: sc_dst handler: self];
-          }
+	      if ([self hasSidecar: filename])
+		[self transferSidecarOf: src toPath: dst move: YES];
 	    }
 	  else
 	    {
@@ -1117,6 +1872,22 @@ filename = [fileinfo objectForKey: @"name"];
       RELEASE (fileinfo);
     }
 
+  /* what is moved out of a volume trash leaves no record there */
+  if ([FSNTrash isVolumeTrashPath: source])
+    {
+      NSUInteger i;
+
+      for (i = 0; i < [procfiles count]; i++)
+        [FSNTrash removeInfoOfName: [procfiles objectAtIndex: i] inTrash: source];
+    }
+
+  if (srcfd >= 0)
+    close(srcfd);
+  if (dstfd >= 0)
+    close(dstfd);
+
+  if (verify)
+    [fileOp setMismatchedPaths: [copier mismatchedPaths]];
   [fileOp cacheProcessedFiles: [self processedFiles]];
   [fileOp sendDidChangeNotification];
   if (([files count] == 0) || stopped)
@@ -1134,27 +1905,37 @@ filename = [fileinfo objectForKey: @"name"];
 {
   while (1)
     {
+      BOOL resume;
+
       CHECK_DONE;	
       GET_FILENAME;
+
+      resume = [journal wasEntryStarted: filename];
+      if (resume == NO)
+        [journal entryStarted: filename];
+      [copier setJournal: journal resuming: resume];
       
-      if ((samename == NO) || (samename && [self removeExisting: fileinfo]))
+      if (resume || (samename == NO) || (samename && [self removeExisting: fileinfo]))
         {
-          if ([fm copyPath: [source stringByAppendingPathComponent: filename]
-                    toPath: [destination stringByAppendingPathComponent: filename]
-                   handler: self])
+          if ([copier copyPath: [source stringByAppendingPathComponent: filename]
+                        toPath: [destination stringByAppendingPathComponent: filename]])
             {
               [procfiles addObject: filename];
-              /* Copy AppleDouble sidecar if present */
-              NSString *sc_src = sidecar_path([source stringByAppendingPathComponent: filename]);
-              NSString *sc_dst = sidecar_path([destination stringByAppendingPathComponent: filename]);
-              if ([fm fileExistsAtPath: sc_src])
-                [fm copyPath: sc_src toPath: sc_dst handler: self];	
+              if ([self hasSidecar: filename])
+                [self transferSidecarOf: [source stringByAppendingPathComponent: filename]
+                                 toPath: [destination stringByAppendingPathComponent: filename]
+                                   move: NO];
             }
         }
+      [journal entryDone: filename];
       [files removeObject: fileinfo];
       RELEASE (fileinfo); 
     }
   
+  [journal flush];
+  [fileOp setBytesSkipped: [copier bytesSkipped]];
+  if (verify)
+    [fileOp setMismatchedPaths: [copier mismatchedPaths]];
   [fileOp cacheProcessedFiles: [self processedFiles]];
   [fileOp sendDidChangeNotification];
   if (([files count] == 0) || stopped)
@@ -1204,6 +1985,9 @@ filename = [fileinfo objectForKey: @"name"];
 
 - (void)doRemove
 {
+  BOOL records = [operation isEqual: @"WorkspaceemptyTrashOperation"]
+                   && [FSNTrash isVolumeTrashPath: source];
+
   while (1)
     {
       CHECK_DONE;
@@ -1211,12 +1995,12 @@ filename = [fileinfo objectForKey: @"name"];
 
       NSString *srcpath = [source stringByAppendingPathComponent: filename];
 
-      if ([fm removeFileAtPath: srcpath handler: self])
+      if ([remover removePath: srcpath])
         {
-          /* Remove AppleDouble sidecar (._filename) if present */
-          NSString *scpath = sidecar_path(srcpath);
-          if ([fm fileExistsAtPath: scpath])
-            [fm removeFileAtPath: scpath handler: self];
+          if ([self hasSidecar: filename])
+            [remover removePath: sidecar_path(srcpath)];
+          if (records)
+            [FSNTrash removeInfoOfName: filename inTrash: source];
 
           [procfiles addObject: filename];
         }
@@ -1279,15 +2063,19 @@ filename = [fileinfo objectForKey: @"name"];
       }
 	  }
 
-	  if ([fm copyPath: [destination stringByAppendingPathComponent: filename]
-				      toPath: destpath 
-			       handler: self]) {
+	  if ([copier copyPath: [destination stringByAppendingPathComponent: filename]
+				          toPath: destpath]) {
       [procfiles addObject: newname];	
+      if ([self hasSidecar: filename])
+        [self transferSidecarOf: [destination stringByAppendingPathComponent: filename]
+                         toPath: destpath
+                           move: NO];
     }
 	  [files removeObject: fileinfo];
     RELEASE (fileinfo);	       
   }
 
+  [fileOp setBytesSkipped: [copier bytesSkipped]];
   [fileOp cacheProcessedFiles: [self processedFiles]];
   [fileOp sendDidChangeNotification];
   if (([files count] == 0) || stopped)
@@ -1371,10 +2159,13 @@ filename = [fileinfo objectForKey: @"name"];
 - (void)doTrash
 {
   NSString *copystr = NSLocalizedString(@"_copy", @"");
+  /* a volume trash keeps a record of each item, which reserves its name */
+  BOOL records = [FSNTrash isVolumeTrashPath: destination];
   NSString *srcpath;
   NSString *destpath;
   NSString *newname;
   NSString *ntmp;
+  BOOL done;
 
   while (1)
     {
@@ -1385,7 +2176,9 @@ filename = [fileinfo objectForKey: @"name"];
     srcpath = [source stringByAppendingPathComponent: filename];
     destpath = [destination stringByAppendingPathComponent: newname];
     
-    if ([fm fileExistsAtPath: destpath]) {
+    if ([fm fileExistsAtPath: destpath]
+        || (records && ([FSNTrash reserveName: newname inTrash: destination
+                                      forPath: srcpath] == NO))) {
       NSString *ext = [filename pathExtension]; 
       NSString *base = [filename stringByDeletingPathExtension]; 
       NSUInteger count = 1;
@@ -1405,7 +2198,9 @@ filename = [fileinfo objectForKey: @"name"];
 
 		    destpath = [destination stringByAppendingPathComponent: ntmp];
 
-		    if ([fm fileExistsAtPath: destpath] == NO) {
+		    if ([fm fileExistsAtPath: destpath] == NO
+            && ((records == NO) || [FSNTrash reserveName: ntmp inTrash: destination
+                                                 forPath: srcpath])) {
           newname = ntmp;
 			    break;
         } else {
@@ -1414,14 +2209,13 @@ filename = [fileinfo objectForKey: @"name"];
 	    }
     }
 
+    done = NO;
+
 	  if ([fm movePath: srcpath toPath: destpath handler: self]) {
-      [procfiles addObject: newname];
-        /* Move AppleDouble sidecar if present */
-        NSString *sc_src2 = sidecar_path(srcpath);
-        NSString *sc_dst2 = sidecar_path(destpath);
-        if ([fm fileExistsAtPath: sc_src2])
-          [fm movePath: sc_src2 toPath: sc_dst2 handler: self];	
-      
+      done = YES;
+      /* the Recycler keeps the ._ file, to put back as it was */
+      if ([self hasSidecar: filename])
+        [fm movePath: sidecar_path(srcpath) toPath: sidecar_path(destpath) handler: self];
     } else {
       /* check for broken symlink */
       NSDictionary *attributes = [fm fileAttributesAtPath: srcpath traverseLink: NO];
@@ -1430,10 +2224,16 @@ filename = [fileinfo objectForKey: @"name"];
                                   && ([fm fileExistsAtPath: srcpath] == NO)) {
         if ([fm copyPath: srcpath toPath: destpath handler: self]
                           && [fm removeFileAtPath: srcpath handler: self]) {
-          [procfiles addObject: newname];
+          done = YES;
         }
       }
     }
+
+    if (done) {
+      [procfiles addObject: newname];
+    } else if (records) {
+      [FSNTrash removeInfoOfName: newname inTrash: destination];
+    }
     
 	  [files removeObject: fileinfo];	 
     RELEASE (fileinfo);  
@@ -1590,10 +2390,11 @@ filename = [fileinfo objectForKey: @"name"];
   if (canupdate) {
     fcount++;
     stepcount++;
+    [self takeScanResult];
     
-    if (stepcount >= progstep) {
+    if (shownTime > 0.0 && stepcount >= progstep) {
       stepcount = 0;
-      [fileOp setProgIndicatorValue: fcount];
+      [self showProgress: fcount bytesDone: [copier bytesCopied]];
     }
   }
   
@@ -1604,5 +2405,32 @@ filename = [fileinfo objectForKey: @"name"];
     }                                             
 }
 
+- (BOOL)deleteEngine:(FileDeleteEngine *)engine
+      didRemoveItems:(NSUInteger)count
+{
+  if (canupdate) {
+    fcount += count;
+    stepcount += count;
+    [self takeScanResult];
+    
+    if (shownTime > 0.0 && stepcount >= progstep) {
+      stepcount = 0;
+      [self showProgress: fcount bytesDone: 0];
+    }
+  }
+
+  /* doRemove sees the stop and ends the operation */
+  return (stopped == NO);
+}
+
+- (void)copyEngine:(FileCopyEngine *)engine
+      didCopyBytes:(unsigned long long)bytes
+{
+  if (canupdate) {
+    [self takeScanResult];
+    [self showProgress: fcount bytesDone: bytes];
+  }
+}
+
 @end
 
@@ -0,0 +1,93 @@
+/* FileOpJournal.h
+ *
+ * An append-only, on-disk record of a file operation's progress, so an
+ * operation cut short by a crash, a logout or a sleeping device can be
+ * resumed where it stopped at the next launch.
+ *
+ * The first record holds the operation itself; the ones after it say
+ * which top-level entries were started and finished, which files
+ * inside them are complete, and how far large files had been copied.
+ * Records are buffered and written, then synced, in batches.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FILE_OP_JOURNAL_H
+#define FILE_OP_JOURNAL_H
+
+#include <sys/types.h>
+
+#import <Foundation/Foundation.h>
+
+@interface FileOpJournal : NSObject
+{
+  NSString *path;
+  int fd;
+  NSLock *lock;
+  NSMutableData *batch;
+  NSUInteger batched;
+  NSTimeInterval lastFlush;
+
+  NSDictionary *operation;
+  NSMutableSet *startedEntries;
+  NSMutableSet *doneEntries;
+  NSMutableSet *doneFiles;
+  NSMutableDictionary *partials;
+}
+
+/* ~/Library/Workspace/FileOperations */
++ (NSString *)journalDirectory;
+
+/* Journals that no running operation has claimed. */
++ (NSArray *)interruptedJournalPaths;
+
+/* A new journal for the operation dictionary (operation, source,
+ * destination, files, priority, verify); nil if it cannot be created. */
+- (id)initWithOperation:(NSDictionary *)opdict;
+
+/* Reads back an existing journal and appends to it from then on. */
+- (id)initWithContentsOfPath:(NSString *)aPath;
+
+- (NSString *)path;
+
+/* The operation as recorded, with "files" as an array of names. */
+- (NSDictionary *)operation;
+
+/* Marks the journal as owned by a live operation, for as long as this
+ * object is around; NO if someone else holds it. */
+- (BOOL)claim;
+
+/* Recording; safe to call from any thread.  -entryStarted: is written
+ * out at once, the rest in batches. */
+- (void)entryStarted:(NSString *)name;
+
+- (void)entryDone:(NSString *)name;
+
+- (void)fileDone:(NSString *)dst;
+
+- (void)file:(NSString *)dst
+    copiedTo:(off_t)offset
+  sourceSize:(off_t)size
+  sourceTime:(time_t)mtime;
+
+- (void)flush;
+
+/* Deletes the journal: the operation is over. */
+- (void)remove;
+
+/* What the journal held when it was read back. */
+- (BOOL)wasEntryStarted:(NSString *)name;
+
+- (BOOL)isEntryDone:(NSString *)name;
+
+- (BOOL)isFileDone:(NSString *)dst;
+
+/* 0 unless the file was partly copied from a source of that size and
+ * modification time. */
+- (off_t)offsetForFile:(NSString *)dst
+            sourceSize:(off_t)size
+            sourceTime:(time_t)mtime;
+
+@end
+
+#endif /* FILE_OP_JOURNAL_H */
@@ -0,0 +1,469 @@
+/* FileOpJournal.m
+ *
+ * On-disk progress journal for resumable file operations.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#import <GNUstepBase/GNUstep.h>
+#import "FileOpJournal.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* Records buffered before a write, and the longest they wait for one. */
+#define JOURNAL_BATCH 64
+#define JOURNAL_FLUSH_INTERVAL 1.0
+
+#define JOURNAL_EXTENSION @"journal"
+
+/* One record per line: a tag, then the fields; strings are last on the
+ * line with backslash and newline escaped. */
+static void
+append_string(NSMutableData *data, NSString *str)
+{
+  const char *s = [str UTF8String];
+
+  for (; *s; s++)
+    {
+      if (*s == '\\')
+        [data appendBytes: "\\\\" length: 2];
+      else if (*s == '\n')
+        [data appendBytes: "\\n" length: 2];
+      else
+        [data appendBytes: s length: 1];
+    }
+}
+
+static NSString *
+unescaped_string(const char *s, const char *end)
+{
+  NSMutableData *data = [NSMutableData dataWithCapacity: end - s];
+
+  for (; s < end; s++)
+    {
+      if (*s == '\\' && s + 1 < end)
+        {
+          s++;
+          [data appendBytes: (*s == 'n') ? "\n" : s length: 1];
+        }
+      else
+        [data appendBytes: s length: 1];
+    }
+
+  return AUTORELEASE ([[NSString alloc] initWithData: data
+                                            encoding: NSUTF8StringEncoding]);
+}
+
+
+@interface FileOpJournal (Private)
+
+- (void)appendRecord:(NSData *)record force:(BOOL)force;
+
+- (void)appendTag:(char)tag string:(NSString *)str force:(BOOL)force;
+
+- (void)replayRecord:(const char *)line end:(const char *)end;
+
+@end
+
+
+@implementation FileOpJournal
+
++ (NSString *)journalDirectory
+{
+  NSString *lib = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory,
+                                                       NSUserDomainMask, YES) lastObject];
+
+  return [[lib stringByAppendingPathComponent: @"Workspace"]
+            stringByAppendingPathComponent: @"FileOperations"];
+}
+
++ (NSArray *)interruptedJournalPaths
+{
+  NSString *dir = [self journalDirectory];
+  NSArray *contents = [[NSFileManager defaultManager] directoryContentsAtPath: dir];
+  NSMutableArray *paths = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [contents count]; i++)
+    {
+      NSString *name = [contents objectAtIndex: i];
+      NSString *jpath = [dir stringByAppendingPathComponent: name];
+      int jfd;
+
+      if ([[name pathExtension] isEqual: JOURNAL_EXTENSION] == NO)
+        continue;
+
+      jfd = open([jpath fileSystemRepresentation], O_RDONLY | O_CLOEXEC);
+      if (jfd < 0)
+        continue;
+      if (flock(jfd, LOCK_EX | LOCK_NB) == 0)
+        {
+          [paths addObject: jpath];
+          flock(jfd, LOCK_UN);
+        }
+      close(jfd);
+    }
+
+  return paths;
+}
+
+- (void)dealloc
+{
+  [self flush];
+  if (fd >= 0)
+    close(fd);
+  RELEASE (path);
+  RELEASE (lock);
+  RELEASE (batch);
+  RELEASE (operation);
+  RELEASE (startedEntries);
+  RELEASE (doneEntries);
+  RELEASE (doneFiles);
+  RELEASE (partials);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self)
+    {
+      fd = -1;
+      lock = [NSLock new];
+      batch = [NSMutableData new];
+      batched = 0;
+      lastFlush = [NSDate timeIntervalSinceReferenceDate];
+      startedEntries = [NSMutableSet new];
+      doneEntries = [NSMutableSet new];
+      doneFiles = [NSMutableSet new];
+      partials = [NSMutableDictionary new];
+    }
+
+  return self;
+}
+
+- (id)initWithOperation:(NSDictionary *)opdict
+{
+  self = [self init];
+
+  if (self)
+    {
+      NSString *dir = [[self class] journalDirectory];
+      NSMutableDictionary *op = [NSMutableDictionary dictionary];
+      NSArray *files = [opdict objectForKey: @"files"];
+      NSMutableArray *names = [NSMutableArray array];
+      NSArray *keys = [NSArray arrayWithObjects: @"operation", @"source",
+                                @"destination", @"priority",
+                                @"verify", nil];
+      NSUInteger i;
+
+      for (i = 0; i < [keys count]; i++)
+        {
+          id value = [opdict objectForKey: [keys objectAtIndex: i]];
+
+          if (value)
+            [op setObject: value forKey: [keys objectAtIndex: i]];
+        }
+      for (i = 0; i < [files count]; i++)
+        {
+          id entry = [files objectAtIndex: i];
+
+          [names addObject: [entry isKindOfClass: [NSDictionary class]]
+                   ? [entry objectForKey: @"name"] : entry];
+        }
+      [op setObject: names forKey: @"files"];
+      ASSIGN (operation, op);
+
+      [[NSFileManager defaultManager] createDirectoryAtPath: dir
+                                withIntermediateDirectories: YES
+                                                 attributes: nil
+                                                      error: NULL];
+      ASSIGN (path, ([dir stringByAppendingPathComponent:
+                            [[[NSProcessInfo processInfo] globallyUniqueString]
+                              stringByAppendingPathExtension: JOURNAL_EXTENSION]]));
+
+      fd = open([path fileSystemRepresentation],
+                O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC,
+                S_IRUSR | S_IWUSR);
+      if (fd < 0)
+        {
+          NSDebugLLog(@"gwspace", @"cannot create journal %@: %s",
+                      path, strerror(errno));
+          DESTROY (self);
+          return nil;
+        }
+
+      [self appendTag: 'O' string: [operation description] force: YES];
+    }
+
+  return self;
+}
+
+- (id)initWithContentsOfPath:(NSString *)aPath
+{
+  self = [self init];
+
+  if (self)
+    {
+      NSData *data = [NSData dataWithContentsOfFile: aPath];
+      const char *bytes = [data bytes];
+      const char *end = bytes + [data length];
+      const char *line = bytes;
+      const char *nl;
+
+      ASSIGN (path, aPath);
+
+      /* a torn last record, from a crash mid-write, is dropped */
+      while (line < end && (nl = memchr(line, '\n', end - line)) != NULL)
+        {
+          [self replayRecord: line end: nl];
+          line = nl + 1;
+        }
+
+      fd = open([path fileSystemRepresentation], O_WRONLY | O_APPEND | O_CLOEXEC);
+      if (fd < 0 || operation == nil)
+        {
+          DESTROY (self);
+          return nil;
+        }
+      if (line < end)
+        ftruncate(fd, line - bytes);
+    }
+
+  return self;
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (NSDictionary *)operation
+{
+  return operation;
+}
+
+- (BOOL)claim
+{
+  return (flock(fd, LOCK_EX | LOCK_NB) == 0);
+}
+
+- (void)entryStarted:(NSString *)name
+{
+  [self appendTag: 'S' string: name force: YES];
+}
+
+- (void)entryDone:(NSString *)name
+{
+  [self appendTag: 'E' string: name force: NO];
+}
+
+- (void)fileDone:(NSString *)dst
+{
+  [self appendTag: 'F' string: dst force: NO];
+}
+
+- (void)file:(NSString *)dst
+    copiedTo:(off_t)offset
+  sourceSize:(off_t)size
+  sourceTime:(time_t)mtime
+{
+  NSMutableData *record = [NSMutableData data];
+  char fields[80];
+
+  snprintf(fields, sizeof(fields), "P %lld %lld %lld ",
+           (long long)offset, (long long)size, (long long)mtime);
+  [record appendBytes: fields length: strlen(fields)];
+  append_string(record, dst);
+  [record appendBytes: "\n" length: 1];
+  [self appendRecord: record force: NO];
+}
+
+- (void)flush
+{
+  [lock lock];
+  if ([batch length] > 0 && fd >= 0)
+    {
+      const char *p = [batch bytes];
+      size_t left = [batch length];
+
+      while (left > 0)
+        {
+          ssize_t n = write(fd, p, left);
+
+          if (n < 0)
+            {
+              if (errno == EINTR)
+                continue;
+              NSDebugLLog(@"gwspace", @"cannot write journal %@: %s",
+                          path, strerror(errno));
+              break;
+            }
+          p += n;
+          left -= n;
+        }
+      fdatasync(fd);
+    }
+  [batch setLength: 0];
+  batched = 0;
+  lastFlush = [NSDate timeIntervalSinceReferenceDate];
+  [lock unlock];
+}
+
+- (void)remove
+{
+  [lock lock];
+  [batch setLength: 0];
+  batched = 0;
+  if (fd >= 0)
+    {
+      unlink([path fileSystemRepresentation]);
+      close(fd);
+      fd = -1;
+    }
+  [lock unlock];
+}
+
+- (BOOL)wasEntryStarted:(NSString *)name
+{
+  return [startedEntries containsObject: name];
+}
+
+- (BOOL)isEntryDone:(NSString *)name
+{
+  return [doneEntries containsObject: name];
+}
+
+- (BOOL)isFileDone:(NSString *)dst
+{
+  return [doneFiles containsObject: dst];
+}
+
+- (off_t)offsetForFile:(NSString *)dst
+            sourceSize:(off_t)size
+            sourceTime:(time_t)mtime
+{
+  NSArray *partial = [partials objectForKey: dst];
+
+  if (partial == nil
+      || [[partial objectAtIndex: 1] longLongValue] != size
+      || [[partial objectAtIndex: 2] longLongValue] != mtime)
+    return 0;
+
+  return (off_t)[[partial objectAtIndex: 0] longLongValue];
+}
+
+@end
+
+
+@implementation FileOpJournal (Private)
+
+- (void)appendRecord:(NSData *)record force:(BOOL)force
+{
+  BOOL full;
+
+  [lock lock];
+  [batch appendData: record];
+  batched++;
+  full = (batched >= JOURNAL_BATCH
+          || [NSDate timeIntervalSinceReferenceDate] - lastFlush >= JOURNAL_FLUSH_INTERVAL);
+  [lock unlock];
+
+  if (force || full)
+    [self flush];
+}
+
+- (void)appendTag:(char)tag string:(NSString *)str force:(BOOL)force
+{
+  NSMutableData *record = [NSMutableData data];
+  char head[2];
+
+  head[0] = tag;
+  head[1] = ' ';
+  [record appendBytes: head length: 2];
+  append_string(record, str);
+  [record appendBytes: "\n" length: 1];
+  [self appendRecord: record force: force];
+}
+
+- (void)replayRecord:(const char *)line end:(const char *)end
+{
+  const char *arg = line + 2;
+
+  if (end - line < 2 || line[1] != ' ')
+    return;
+
+  switch (line[0])
+    {
+    case 'O':
+      NS_DURING
+        {
+          id plist = [unescaped_string(arg, end) propertyList];
+
+          if ([plist isKindOfClass: [NSDictionary class]])
+            ASSIGN (operation, plist);
+        }
+      NS_HANDLER
+        {
+          NSDebugLLog(@"gwspace", @"unreadable journal %@", path);
+        }
+      NS_ENDHANDLER
+      break;
+
+    case 'S':
+      [startedEntries addObject: unescaped_string(arg, end)];
+      break;
+
+    case 'E':
+      [doneEntries addObject: unescaped_string(arg, end)];
+      break;
+
+    case 'F':
+      {
+        NSString *dst = unescaped_string(arg, end);
+
+        [doneFiles addObject: dst];
+        [partials removeObjectForKey: dst];
+      }
+      break;
+
+    case 'P':
+      {
+        long long offset, size, mtime;
+        char fields[80];
+        size_t len = (end - arg < (long)sizeof(fields)) ? end - arg : sizeof(fields) - 1;
+        int used = 0;
+
+        /* the line is not NUL-terminated */
+        memcpy(fields, arg, len);
+        fields[len] = '\0';
+        if (sscanf(fields, "%lld %lld %lld%n", &offset, &size, &mtime, &used) == 3
+            && fields[used] == ' ')
+          {
+            [partials setObject: [NSArray arrayWithObjects:
+                                            [NSNumber numberWithLongLong: offset],
+                                          [NSNumber numberWithLongLong: size],
+                                          [NSNumber numberWithLongLong: mtime], nil]
+                         forKey: unescaped_string(arg + used + 1, end)];
+          }
+      }
+      break;
+
+    default:
+      break;
+    }
+}
+
+@end
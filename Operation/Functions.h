@@ -23,8 +23,19 @@
  */
 
  
+#include <sys/types.h>
+
 #import <Foundation/Foundation.h>
 
 BOOL isSubpath(NSString *p1, NSString *p2);
 
 NSString *relativePathFittingInField(id field, NSString *fullPath);
+
+/* YES for a spinning disk, which wants few concurrent requests. */
+BOOL isRotationalDevice(dev_t dev);
+
+/* Stores the Finder info and resource fork of the AppleDouble file at
+ * sidecar as user.com.apple.* xattrs of path.  NO if path takes no
+ * xattrs, or if the sidecar holds anything else, which only the
+ * sidecar itself would keep. */
+BOOL convertSidecarToXattrs(NSString *sidecar, NSString *path);
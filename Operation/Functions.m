@@ -22,7 +22,15 @@
  * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
  */
 
+#include <sys/types.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#endif
 
 #import <AppKit/AppKit.h>
 #import <GNUstepBase/GNUstep.h>
@@ -106,3 +114,102 @@ NSString *relativePathFittingInField(id field, NSString *fullPath)
 	return relpath;
 }
 
+BOOL isRotationalDevice(dev_t dev)
+{
+#ifdef __linux__
+  /* a partition keeps its queue/ in the parent disk's directory */
+  static const char *formats[] = {
+    "/sys/dev/block/%u:%u/queue/rotational",
+    "/sys/dev/block/%u:%u/../queue/rotational"
+  };
+  unsigned i;
+
+  for (i = 0; i < 2; i++) {
+    char path[64];
+    char c = '0';
+    int fd;
+
+    snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+      if (read(fd, &c, 1) != 1) {
+        c = '0';
+      }
+      close(fd);
+      return (c == '1');
+    }
+  }
+#endif
+  return NO;
+}
+
+
+#define APPLEDOUBLE_MAGIC 0x00051607
+#define APPLEDOUBLE_RESOURCE_FORK 2
+#define APPLEDOUBLE_FINDER_INFO 9
+#define FINDER_INFO_LENGTH 32
+
+#ifdef __linux__
+/* the entry table starts at byte 26: not aligned */
+static uint32_t be32(const unsigned char *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+#endif
+
+BOOL convertSidecarToXattrs(NSString *sidecar, NSString *path)
+{
+#ifdef __linux__
+  NSData *data = [NSData dataWithContentsOfFile: sidecar];
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+  const char *fspath = [path fileSystemRepresentation];
+  unsigned count;
+  unsigned i;
+
+  if (length < 26 || be32(bytes) != APPLEDOUBLE_MAGIC) {
+    return NO;
+  }
+  count = (bytes[24] << 8) | bytes[25];
+  if (26 + count * 12 > length) {
+    return NO;
+  }
+
+  /* everything has to fit in an xattr, or nothing is converted */
+  for (i = 0; i < count; i++) {
+    const unsigned char *ent = bytes + 26 + i * 12;
+    uint32_t eid = be32(ent);
+    uint32_t off = be32(ent + 4);
+    uint32_t len = be32(ent + 8);
+
+    if ((unsigned long long)off + len > length) {
+      return NO;
+    }
+    if (eid == APPLEDOUBLE_FINDER_INFO && len != FINDER_INFO_LENGTH) {
+      /* macOS keeps its other xattrs past the Finder info */
+      return NO;
+    }
+    if (eid != APPLEDOUBLE_FINDER_INFO && eid != APPLEDOUBLE_RESOURCE_FORK) {
+      return NO;
+    }
+  }
+
+  for (i = 0; i < count; i++) {
+    const unsigned char *ent = bytes + 26 + i * 12;
+    uint32_t eid = be32(ent);
+    uint32_t off = be32(ent + 4);
+    uint32_t len = be32(ent + 8);
+    const char *name = (eid == APPLEDOUBLE_FINDER_INFO)
+                         ? "user.com.apple.FinderInfo"
+                         : "user.com.apple.ResourceFork";
+
+    if (len > 0 && setxattr(fspath, name, bytes + off, len, 0) != 0) {
+      return NO;
+    }
+  }
+
+  return YES;
+#else
+  return NO;
+#endif
+}
@@ -37,6 +37,7 @@ enum {
 @interface Operation : NSObject 
 {
   NSMutableArray *fileOperations;
+  NSMutableArray *queuedOperations;
   NSUInteger fopRef;
   
   BOOL filenamesCut;
@@ -51,6 +52,8 @@ enum {
 
 - (void)performOperation:(NSDictionary *)opdict;
 
+- (void)resumeInterruptedOperations;
+
 - (BOOL)isLockedAction:(int)action
                 onPath:(NSString *)path;
 
@@ -60,10 +63,20 @@ enum {
                      
 - (void)endOfFileOperation:(FileOpInfo *)op;
 
+- (BOOL)canStartOperation:(FileOpInfo *)op;
+
+- (BOOL)shouldDeferOperation:(FileOpInfo *)op;
+
+- (void)startQueuedOperations;
+
+- (void)moveOperationToFront:(FileOpInfo *)op;
+
 - (NSUInteger)fileOpRef;
 
 - (FileOpInfo *)fileOpWithRef:(NSUInteger)ref;
 
+- (NSArray *)operationsProgress;
+
 - (NSRect)rectForFileOpWindow;
 
 - (BOOL)verifyFileAtPath:(NSString *)path
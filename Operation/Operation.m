@@ -28,7 +28,9 @@
 
 #import "Operation.h"
 #import "FileOpInfo.h"
+#import "FileOpJournal.h"
 #import "Functions.h"
+#import "FSNTrash.h"
 
 
 @implementation Operation
@@ -36,6 +38,7 @@
 - (void)dealloc
 {
   RELEASE (fileOperations);
+  RELEASE (queuedOperations);
     
   [super dealloc];
 }
@@ -46,6 +49,7 @@
   
   if (self) {  
     fileOperations = [NSMutableArray new];
+    queuedOperations = [NSMutableArray new];
     fopRef = 0;
     fm = [NSFileManager defaultManager];
     nc = [NSNotificationCenter defaultCenter];
@@ -74,6 +78,9 @@
   NSString *confirmString = [operation stringByAppendingString: @"Confirm"];
   BOOL confirm = !([defaults boolForKey: confirmString]);
   BOOL usewin = ![defaults boolForKey: @"fopstatusnotshown"];
+  NSString *priority = [opdict objectForKey: @"priority"];
+  NSString *journal = [opdict objectForKey: @"journal"];
+  NSNumber *verify = [opdict objectForKey: @"verify"];
   NSString *opbase;
   NSArray *opfiles;
   NSMutableArray *oppaths;
@@ -87,6 +94,51 @@
       files = [NSArray arrayWithObject: @""];
     }
 
+  /* "<operation>Background" runs an operation type in the background,
+     behind interactive ones; Empty Trash does by default. */
+  if (priority == nil)
+    {
+      NSString *bgString = [operation stringByAppendingString: @"Background"];
+      BOOL background;
+
+      if ([defaults objectForKey: bgString])
+        background = [defaults boolForKey: bgString];
+      else
+        background = [operation isEqual: @"WorkspaceemptyTrashOperation"];
+
+      priority = background ? @"background" : @"interactive";
+    }
+
+  /* "<operation>Verify" reads copies back after writing them, for
+     Copy and Move; the caller can also ask for it with "verify". */
+  if (verify == nil
+      && ([operation isEqual: NSWorkspaceCopyOperation]
+          || [operation isEqual: NSWorkspaceMoveOperation]))
+    {
+      NSString *verifyString = [operation stringByAppendingString: @"Verify"];
+
+      verify = [NSNumber numberWithBool: [defaults boolForKey: verifyString]];
+    }
+
+  /* what is recycled goes to the trash of its own volume, by a rename */
+  if ([operation isEqual: NSWorkspaceRecycleOperation]
+      && ((destination == nil) || [destination isEqual: [FSNTrash homeTrashPath]]))
+    {
+      destination = [FSNTrash trashPathForDirectory: source];
+
+      if (destination == nil)
+        {
+          destination = [FSNTrash homeTrashPath];
+        }
+    }
+
+  /* a resumed operation was confirmed the first time, and the caller
+     may have asked already */
+  if (journal || [[opdict objectForKey: @"confirmed"] boolValue])
+    {
+      confirm = NO;
+    }
+
   opfiles = files;
 
   if ([operation isEqual: @"WorkspaceRenameOperation"]
@@ -194,10 +246,81 @@
                              winrect: [self rectForFileOpWindow]
                           controller: self];
   
+  [info setPriority: priority];
+  if ([verify boolValue])
+    {
+      [info setVerifies: YES];
+    }
+  if (journal)
+    {
+      [info setJournalPath: journal];
+    }
   [fileOperations insertObject: info atIndex: [fileOperations count]];
   [info startOperation];
 }
 
+/* Offers to resume the operations a crash or a logout cut short, as
+ * found in their journals; what is declined is forgotten. */
+- (void)resumeInterruptedOperations
+{
+  NSArray *paths = [FileOpJournal interruptedJournalPaths];
+  BOOL resume;
+  NSUInteger i;
+
+  if ([paths count] == 0)
+    {
+      return;
+    }
+
+  resume = (NSRunAlertPanel(nil,
+                            NSLocalizedString(@"Some file operations were interrupted.\nDo you want to resume them?", @""),
+                            NSLocalizedString(@"Resume", @""),
+                            NSLocalizedString(@"Discard", @""),
+                            nil) == NSAlertDefaultReturn);
+
+  for (i = 0; i < [paths count]; i++)
+    {
+      NSString *path = [paths objectAtIndex: i];
+      FileOpJournal *journal = [[FileOpJournal alloc] initWithContentsOfPath: path];
+      NSMutableDictionary *opdict = [NSMutableDictionary dictionaryWithDictionary: [journal operation]];
+      NSMutableArray *names = [NSMutableArray array];
+      NSArray *files = [opdict objectForKey: @"files"];
+      NSUInteger count = [fileOperations count];
+      NSUInteger j;
+
+      for (j = 0; j < [files count]; j++)
+        {
+          NSString *name = [files objectAtIndex: j];
+
+          if ([journal isEntryDone: name] == NO)
+            {
+              [names addObject: name];
+            }
+        }
+
+      if (resume && journal && [names count])
+        {
+          [opdict setObject: names forKey: @"files"];
+          [opdict setObject: path forKey: @"journal"];
+          [self performOperation: opdict];
+        }
+
+      /* not started again: the sources may be gone */
+      if ([fileOperations count] == count)
+        {
+          if (journal)
+            {
+              [journal remove];
+            }
+          else
+            {
+              [fm removeFileAtPath: path handler: nil];
+            }
+        }
+      RELEASE (journal);
+    }
+}
+
 - (BOOL)isLockedAction:(int)action
                 onPath:(NSString *)path 
 {
@@ -335,6 +458,85 @@
 - (void)endOfFileOperation:(FileOpInfo *)op
 {
   [fileOperations removeObject: op];
+  [queuedOperations removeObject: op];
+  [self startQueuedOperations];
+}
+
+/* Operations on independent devices run side by side; one that shares
+ * a source or destination device with a running operation, or with one
+ * queued ahead of it, waits its turn.  A background operation also
+ * waits while an interactive one is using any device. */
+- (BOOL)canStartOperation:(FileOpInfo *)op
+{
+  NSArray *devs = [op devices];
+  NSUInteger qpos = [queuedOperations indexOfObjectIdenticalTo: op];
+  NSUInteger i;
+
+  for (i = 0; i < [fileOperations count]; i++) {
+    FileOpInfo *other = [fileOperations objectAtIndex: i];
+    NSArray *odevs = [other devices];
+    NSUInteger opos = [queuedOperations indexOfObjectIdenticalTo: other];
+    NSUInteger j;
+
+    if (other == op) {
+      continue;
+    }
+    if (opos != NSNotFound && qpos != NSNotFound && opos > qpos) {
+      continue;
+    }
+    if (opos == NSNotFound && [odevs count] && [op isBackground]
+        && [other isBackground] == NO) {
+      return NO;
+    }
+    for (j = 0; j < [devs count]; j++) {
+      if ([odevs containsObject: [devs objectAtIndex: j]]) {
+        return NO;
+      }
+    }
+  }
+
+  return YES;
+}
+
+- (BOOL)shouldDeferOperation:(FileOpInfo *)op
+{
+  if ([self canStartOperation: op]) {
+    return NO;
+  }
+  [queuedOperations addObject: op];
+  return YES;
+}
+
+/* Starts, in queue order, every waiting operation whose devices are free. */
+- (void)startQueuedOperations
+{
+  NSUInteger i = 0;
+
+  while (i < [queuedOperations count]) {
+    FileOpInfo *op = [queuedOperations objectAtIndex: i];
+
+    if ([self canStartOperation: op]) {
+      RETAIN (op);
+      [queuedOperations removeObjectAtIndex: i];
+      [op startQueuedOperation];
+      RELEASE (op);
+    } else {
+      i++;
+    }
+  }
+}
+
+/* From the progress window: the operation goes ahead of the others that
+ * wait for its devices, and starts as soon as they are free. */
+- (void)moveOperationToFront:(FileOpInfo *)op
+{
+  if ([queuedOperations indexOfObjectIdenticalTo: op] != NSNotFound) {
+    RETAIN (op);
+    [queuedOperations removeObjectIdenticalTo: op];
+    [queuedOperations insertObject: op atIndex: 0];
+    RELEASE (op);
+    [self startQueuedOperations];
+  }
 }
 
 - (FileOpInfo *)fileOpWithRef:(NSUInteger)ref
@@ -352,6 +554,19 @@
   return nil;
 }
 
+/* One -[FileOpInfo progressInfo] dictionary per running operation. */
+- (NSArray *)operationsProgress
+{
+  NSMutableArray *progress = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [fileOperations count]; i++) {
+    [progress addObject: [[fileOperations objectAtIndex: i] progressInfo]];
+  }
+
+  return progress;
+}
+
 - (NSUInteger)fileOpRef
 {
   return fopRef++;
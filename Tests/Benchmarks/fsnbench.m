@@ -0,0 +1,505 @@
+/* fsnbench.m — timings of the large-directory hot paths, without a display.
+ *
+ * Generates fixture folders of 1k, 10k and 100k entries (files of many
+ * types and sizes, folders, symlinks, hidden files, Finder xattrs, ._
+ * sidecars and a .DS_Store with icon positions) and times, on each:
+ *
+ *   listing-cold/-warm   -[FSNodeRep directoryContentsAtPath:]
+ *   subnodes-cold/-warm  -[FSNode subNodes]
+ *   sort-<key>           -sortedArrayUsingSelector: with each FSNode
+ *                        compareAccordingTo...: selector
+ *   sortkeys-<key>       FSNSortRepsUsingSelector(), the views' fast path
+ *   dsstore-load         a DSStoreInfo read from the .DS_Store
+ *   dsstore-cached       +infoForDirectoryPath:loadImmediately: once parsed
+ *   metadata-lookup      +[GSFileMetadata metadataForFileAtPath:], cold
+ *   metadata-prefetch    +[GSFileMetadata prefetchMetadataForDirectory:]
+ *   icons                -[FSNodeRep iconOfSize:forNode:] for every entry
+ *
+ * The icons need a gui backend; where none can be loaded they are
+ * reported as skipped (the headless backend, -GSBackend
+ * libgnustep-headless, runs them without a display where installed).
+ *
+ * The results are a JSON document on stdout.  Given a previous one with
+ * --baseline, the steps whose median got slower by more than --tolerance
+ * are listed under "regressions" and the tool exits 1.
+ *
+ *   fsnbench [--sizes 1000,10000,100000] [--runs 5] [--fixtures DIR]
+ *            [--baseline FILE] [--tolerance 0.25]
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#import "FSNode.h"
+#import "FSNodeRep.h"
+#import "FSNSortKeys.h"
+#import "DSStoreInfo.h"
+#import "GSFileMetadata.h"
+
+/* bumped when the fixtures change, so that old ones are made again */
+#define FIXTURE_VERSION 1
+#define FIXTURE_STAMP @".fsnbench-fixture"
+
+/* below this, a slower median is noise rather than a regression */
+#define REGRESSION_FLOOR_MS 1.0
+
+static const char *extensions[] = {
+  "txt", "png", "pdf", "m", "h", "tar.gz", "", "jpg", "html", "md", "app", "c"
+};
+#define EXTENSIONS_COUNT (sizeof(extensions) / sizeof(extensions[0]))
+
+static double
+nowMilliseconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static NSString *
+entryName(NSUInteger i)
+{
+  switch (i % 20)
+    {
+      case 0:
+        return [NSString stringWithFormat: @"Folder %06lu", (unsigned long)i];
+      case 1:
+        return [NSString stringWithFormat: @"link-%06lu", (unsigned long)i];
+      case 2:
+        return [NSString stringWithFormat: @".hidden-%06lu", (unsigned long)i];
+      default:
+        {
+          const char *ext = extensions[(i * 7) % EXTENSIONS_COUNT];
+
+          /* mixed case, so that the name sort has work to do */
+          return [NSString stringWithFormat: @"%@-%06lu%s%s",
+                           ((i % 3) ? @"file" : @"File"), (unsigned long)i,
+                           (*ext ? "." : ""), ext];
+        }
+    }
+}
+
+/* Makes `dir` with `count` entries, unless a fixture of this version is
+ * there already.  Not timed. */
+static BOOL
+makeFixture(NSString *dir, NSUInteger count)
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *stamp = [dir stringByAppendingPathComponent: FIXTURE_STAMP];
+  NSString *version = [NSString stringWithFormat: @"%d %lu",
+                                FIXTURE_VERSION, (unsigned long)count];
+  DSStoreInfo *dsinfo;
+  time_t base = time(NULL) - 3 * 365 * 24 * 3600;
+  NSUInteger i;
+
+  if ([[NSString stringWithContentsOfFile: stamp] isEqual: version])
+    return YES;
+
+  fprintf(stderr, "fsnbench: making %lu entries in %s\n",
+          (unsigned long)count, [dir fileSystemRepresentation]);
+
+  [fm removeFileAtPath: dir handler: nil];
+  if ([fm createDirectoryAtPath: dir attributes: nil] == NO)
+    return NO;
+
+  dsinfo = [[DSStoreInfo alloc] initWithDirectoryPath: dir];
+
+  for (i = 0; i < count; i++)
+    {
+      NSAutoreleasePool *arp = [NSAutoreleasePool new];
+      NSString *name = entryName(i);
+      NSString *path = [dir stringByAppendingPathComponent: name];
+      const char *cpath = [path fileSystemRepresentation];
+      struct timeval times[2];
+
+      if (i % 20 == 0)
+        {
+          [fm createDirectoryAtPath: path attributes: nil];
+        }
+      else if (i % 20 == 1)
+        {
+          [fm createSymbolicLinkAtPath: path pathContent: entryName(i + 2)];
+        }
+      else
+        {
+          FILE *fp = fopen(cpath, "w");
+
+          if (fp == NULL)
+            {
+              [arp release];
+              [dsinfo release];
+              return NO;
+            }
+          /* sparse, so sizes up to a megabyte cost no disk */
+          ftruncate(fileno(fp), (off_t)((i * 7919) % (1024 * 1024)));
+          fclose(fp);
+
+          if (i % 8 == 3)
+            {
+              GSFileMetadata *md = [[GSFileMetadata new] autorelease];
+
+              [md setLabelNumber: 1 + (i % 7)];
+              [md writeToFileAtPath: path error: NULL];
+            }
+          else if (i % 8 == 7)
+            {
+              GSFileMetadata *md = [[GSFileMetadata new] autorelease];
+
+              [md setLabelNumber: 1 + (i % 7)];
+              [md writeSidecarToFileAtPath: path error: NULL];
+            }
+        }
+
+      if (i % 20 != 1)
+        {
+          times[0].tv_sec = times[1].tv_sec = base + (time_t)((i * 104729) % (3 * 365 * 24 * 3600));
+          times[0].tv_usec = times[1].tv_usec = 0;
+          utimes(cpath, times);
+        }
+
+      if (i % 4 == 0)
+        {
+          DSStoreIconInfo *icon = [DSStoreIconInfo infoForFilename: name];
+
+          [icon setPosition: NSMakePoint(64 + (i % 50) * 90, 64 + (i / 50) * 90)];
+          [icon setHasPosition: YES];
+          [dsinfo setIconInfo: icon forFilename: name];
+        }
+
+      [arp release];
+    }
+
+  [dsinfo setIconSize: 48];
+  [dsinfo setHasIconSize: YES];
+  [dsinfo saveToPath: [dir stringByAppendingPathComponent: @".DS_Store"]];
+  [dsinfo release];
+
+  return [version writeToFile: stamp atomically: YES];
+}
+
+static double
+median(NSArray *sorted)
+{
+  NSUInteger n = [sorted count];
+
+  if (n == 0)
+    return 0;
+  if (n % 2)
+    return [[sorted objectAtIndex: n / 2] doubleValue];
+  return ([[sorted objectAtIndex: n / 2 - 1] doubleValue]
+          + [[sorted objectAtIndex: n / 2] doubleValue]) / 2;
+}
+
+/* Runs `body` once untimed and `runs` times timed, each time after
+ * `prepare` (untimed) when given, and adds the statistics to `results`. */
+static void
+measure(NSMutableArray *results, NSString *step, NSUInteger size,
+        NSUInteger items, NSUInteger runs,
+        void (^prepare)(void), void (^body)(void))
+{
+  NSMutableArray *times = [NSMutableArray arrayWithCapacity: runs];
+  NSArray *sorted;
+  double total = 0;
+  double med;
+  NSUInteger i;
+
+  for (i = 0; i <= runs; i++)
+    {
+      NSAutoreleasePool *arp = [NSAutoreleasePool new];
+      double start;
+      double elapsed;
+
+      if (prepare)
+        prepare();
+      start = nowMilliseconds();
+      body();
+      elapsed = nowMilliseconds() - start;
+      [arp release];
+
+      if (i > 0)
+        {
+          [times addObject: [NSNumber numberWithDouble: elapsed]];
+          total += elapsed;
+        }
+    }
+
+  sorted = [times sortedArrayUsingSelector: @selector(compare:)];
+  med = median(sorted);
+
+  [results addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+    step, @"step",
+    [NSNumber numberWithUnsignedInteger: size], @"size",
+    [NSNumber numberWithUnsignedInteger: items], @"items",
+    [NSNumber numberWithUnsignedInteger: runs], @"runs",
+    [sorted objectAtIndex: 0], @"min_ms",
+    [NSNumber numberWithDouble: med], @"median_ms",
+    [NSNumber numberWithDouble: total / runs], @"mean_ms",
+    [sorted lastObject], @"max_ms",
+    [NSNumber numberWithDouble: (items ? med * 1000.0 / items : 0)], @"median_us_per_item",
+    nil]];
+
+  fprintf(stderr, "fsnbench: %7lu %-22s %10.3f ms\n",
+          (unsigned long)size, [step UTF8String], med);
+}
+
+static void
+skip(NSMutableArray *results, NSString *step, NSUInteger size, NSString *reason)
+{
+  [results addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+    step, @"step",
+    [NSNumber numberWithUnsignedInteger: size], @"size",
+    reason, @"skipped",
+    nil]];
+}
+
+static void
+benchmarkFolder(NSMutableArray *results, NSString *dir, NSUInteger size,
+                NSUInteger runs, BOOL withIcons)
+{
+  FSNodeRep *rep = [FSNodeRep sharedInstance];
+  FSNode *folder = [FSNode nodeWithPath: dir];
+  NSArray *nodes;
+  NSUInteger items;
+  const char *keys[] = {
+    "Name", "Kind", "Extension", "Date", "CrDate", "Size",
+    "Owner", "Group", "Parent", "Path"
+  };
+  NSUInteger k;
+
+  measure(results, @"listing-cold", size, size, runs,
+          ^{ [rep invalidateDirectoryListingAtPath: dir]; },
+          ^{ [rep directoryContentsAtPath: dir]; });
+
+  measure(results, @"listing-warm", size, size, runs, nil,
+          ^{ [rep directoryContentsAtPath: dir]; });
+
+  measure(results, @"subnodes-cold", size, size, runs,
+          ^{ [rep invalidateDirectoryListingAtPath: dir]; },
+          ^{ [folder subNodes]; });
+
+  measure(results, @"subnodes-warm", size, size, runs, nil,
+          ^{ [folder subNodes]; });
+
+  nodes = [[folder subNodes] retain];
+  items = [nodes count];
+
+  for (k = 0; k < sizeof(keys) / sizeof(keys[0]); k++)
+    {
+      NSString *key = [NSString stringWithUTF8String: keys[k]];
+      SEL sel = NSSelectorFromString([NSString stringWithFormat:
+                                                 @"compareAccordingTo%@:", key]);
+      NSMutableArray *reps = [NSMutableArray array];
+
+      measure(results, [@"sort-" stringByAppendingString: [key lowercaseString]],
+              size, items, runs, nil,
+              ^{ [nodes sortedArrayUsingSelector: sel]; });
+
+      /* the selectors without flat keys are left to the one above */
+      [reps setArray: nodes];
+      if (FSNSortRepsUsingSelector(reps, sel))
+        {
+          measure(results, [@"sortkeys-" stringByAppendingString: [key lowercaseString]],
+                  size, items, runs,
+                  ^{ [reps setArray: nodes]; },
+                  ^{ FSNSortRepsUsingSelector(reps, sel); });
+        }
+    }
+
+  measure(results, @"dsstore-load", size, size / 4, runs, nil,
+          ^{
+            DSStoreInfo *info = [[DSStoreInfo alloc] initWithDirectoryPath: dir];
+
+            [info load];
+            [info release];
+          });
+
+  measure(results, @"dsstore-cached", size, size / 4, runs, nil,
+          ^{ [DSStoreInfo infoForDirectoryPath: dir loadImmediately: YES]; });
+
+  measure(results, @"metadata-lookup", size, items, runs,
+          ^{ [GSFileMetadata invalidateAllCachedMetadata]; },
+          ^{
+            NSUInteger i;
+
+            for (i = 0; i < items; i++)
+              {
+                NSAutoreleasePool *arp = [NSAutoreleasePool new];
+
+                [GSFileMetadata metadataForFileAtPath: [[nodes objectAtIndex: i] path]];
+                [arp release];
+              }
+          });
+
+  measure(results, @"metadata-prefetch", size, items, runs,
+          ^{ [GSFileMetadata invalidateAllCachedMetadata]; },
+          ^{ [GSFileMetadata prefetchMetadataForDirectory: dir]; });
+
+  if (withIcons)
+    {
+      measure(results, @"icons", size, items, runs, nil,
+              ^{
+                NSUInteger i;
+
+                for (i = 0; i < items; i++)
+                  {
+                    NSAutoreleasePool *arp = [NSAutoreleasePool new];
+
+                    [rep iconOfSize: 48 forNode: [nodes objectAtIndex: i]];
+                    [arp release];
+                  }
+              });
+    }
+  else
+    {
+      skip(results, @"icons", size, @"no gui backend");
+    }
+
+  [nodes release];
+}
+
+/* The steps of `results` slower than in `baseline` by more than `tolerance`. */
+static NSArray *
+regressions(NSArray *results, NSDictionary *baseline, double tolerance)
+{
+  NSMutableDictionary *before = [NSMutableDictionary dictionary];
+  NSMutableArray *slower = [NSMutableArray array];
+  NSEnumerator *enumerator = [[baseline objectForKey: @"results"] objectEnumerator];
+  NSDictionary *entry;
+
+  while ((entry = [enumerator nextObject]) != nil)
+    {
+      if ([entry objectForKey: @"median_ms"])
+        [before setObject: entry forKey: [NSString stringWithFormat: @"%@ %@",
+                                                   [entry objectForKey: @"size"],
+                                                   [entry objectForKey: @"step"]]];
+    }
+
+  enumerator = [results objectEnumerator];
+  while ((entry = [enumerator nextObject]) != nil)
+    {
+      NSDictionary *old = [before objectForKey: [NSString stringWithFormat: @"%@ %@",
+                                                          [entry objectForKey: @"size"],
+                                                          [entry objectForKey: @"step"]]];
+      double was = [[old objectForKey: @"median_ms"] doubleValue];
+      double is = [[entry objectForKey: @"median_ms"] doubleValue];
+
+      if (old && [entry objectForKey: @"median_ms"]
+          && (is > was * (1.0 + tolerance)) && (is - was > REGRESSION_FLOOR_MS))
+        {
+          [slower addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+            [entry objectForKey: @"step"], @"step",
+            [entry objectForKey: @"size"], @"size",
+            [NSNumber numberWithDouble: was], @"baseline_median_ms",
+            [NSNumber numberWithDouble: is], @"median_ms",
+            nil]];
+        }
+    }
+
+  return slower;
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSUserDefaults *defs = [NSUserDefaults standardUserDefaults];
+  NSString *sizesArg = [defs stringForKey: @"-sizes"];
+  NSString *fixtures = [defs stringForKey: @"-fixtures"];
+  NSString *baselinePath = [defs stringForKey: @"-baseline"];
+  NSInteger runs = [defs objectForKey: @"-runs"] ? [defs integerForKey: @"-runs"] : 5;
+  double tolerance = [defs objectForKey: @"-tolerance"] ? [defs doubleForKey: @"-tolerance"] : 0.25;
+  NSMutableArray *results = [NSMutableArray array];
+  NSMutableDictionary *report = [NSMutableDictionary dictionary];
+  NSArray *sizes;
+  NSArray *slower = nil;
+  NSData *json;
+  BOOL withIcons = YES;
+  int status = 0;
+  NSUInteger i;
+
+  if ([[[NSProcessInfo processInfo] arguments] containsObject: @"--help"])
+    {
+      fprintf(stderr, "Usage: %s [--sizes 1000,10000,100000] [--runs 5] [--fixtures DIR]\n"
+                      "       [--baseline FILE] [--tolerance 0.25]\n", argv[0]);
+      [arp release];
+      return 0;
+    }
+
+  sizes = [(sizesArg ? sizesArg : @"1000,10000,100000") componentsSeparatedByString: @","];
+  if (fixtures == nil)
+    fixtures = [NSTemporaryDirectory() stringByAppendingPathComponent: @"fsnbench-fixtures"];
+  if (runs < 1)
+    runs = 1;
+
+  /* the icons are made with the gui; without a backend they are skipped */
+  NS_DURING
+    {
+      [NSApplication sharedApplication];
+    }
+  NS_HANDLER
+    {
+      withIcons = NO;
+    }
+  NS_ENDHANDLER
+
+  [[NSFileManager defaultManager] createDirectoryAtPath: fixtures attributes: nil];
+
+  for (i = 0; i < [sizes count]; i++)
+    {
+      NSUInteger size = (NSUInteger)[[sizes objectAtIndex: i] integerValue];
+      NSString *dir = [fixtures stringByAppendingPathComponent:
+                                  [NSString stringWithFormat: @"dir-%lu", (unsigned long)size]];
+
+      if (size == 0)
+        continue;
+      if (makeFixture(dir, size) == NO)
+        {
+          fprintf(stderr, "fsnbench: cannot make the fixture %s\n", [dir fileSystemRepresentation]);
+          [arp release];
+          return 2;
+        }
+      benchmarkFolder(results, dir, size, (NSUInteger)runs, withIcons);
+    }
+
+  [report setObject: @"fsnbench" forKey: @"benchmark"];
+  [report setObject: [NSNumber numberWithInt: FIXTURE_VERSION] forKey: @"fixture_version"];
+  [report setObject: [[NSDate date] description] forKey: @"date"];
+  [report setObject: [[NSProcessInfo processInfo] hostName] forKey: @"host"];
+  [report setObject: [NSNumber numberWithInteger: runs] forKey: @"runs"];
+  [report setObject: results forKey: @"results"];
+
+  if (baselinePath)
+    {
+      NSData *data = [NSData dataWithContentsOfFile: baselinePath];
+      id baseline = data ? [NSJSONSerialization JSONObjectWithData: data options: 0 error: NULL] : nil;
+
+      if ([baseline isKindOfClass: [NSDictionary class]] == NO)
+        {
+          fprintf(stderr, "fsnbench: cannot read the baseline %s\n", [baselinePath fileSystemRepresentation]);
+          [arp release];
+          return 2;
+        }
+      slower = regressions(results, baseline, tolerance);
+      [report setObject: [NSNumber numberWithDouble: tolerance] forKey: @"tolerance"];
+      [report setObject: slower forKey: @"regressions"];
+      if ([slower count])
+        status = 1;
+    }
+
+  json = [NSJSONSerialization dataWithJSONObject: report
+                                         options: NSJSONWritingPrettyPrinted
+                                           error: NULL];
+  fwrite([json bytes], 1, [json length], stdout);
+  fputc('\n', stdout);
+
+  [arp release];
+  return status;
+}
@@ -0,0 +1,61 @@
+/* t_DSBuddyAllocator.m — headless coverage for the mapped allocator mode.
+ *
+ * A mapped allocator hands out blocks that read from the mapping.  Writes
+ * stay private until -flush, and a write past the end of the file moves
+ * the allocator to an in-memory copy.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../DSStore/DSBuddyAllocator.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+    [NSString stringWithFormat: @"t_DSBuddyAllocator-%d", getpid()]];
+  NSMutableData *contents = [NSMutableData dataWithLength: 4096];
+  DSBuddyAllocator *alloc;
+  DSBuddyBlock *block;
+  const uint8_t *bytes;
+
+  ((uint8_t *)[contents mutableBytes])[64] = 0x12;
+  ((uint8_t *)[contents mutableBytes])[65] = 0x34;
+  [contents writeToFile: path atomically: NO];
+
+  alloc = [[DSBuddyAllocator alloc] initWithMappedFile: path];
+  PASS([alloc open] && [alloc isMapped], "the file is mapped");
+  PASS([alloc fileSize] == 4096, "the mapping covers the file");
+
+  block = [alloc blockAtOffset: 64 size: 32];
+  PASS([block readUInt16] == 0x1234, "a block reads from the mapping");
+
+  [block seek: 0];
+  [block writeUInt16: 0xbeef];
+  [block flush];
+  bytes = [[NSData dataWithContentsOfFile: path] bytes];
+  PASS(bytes[64] == 0x12, "a written block stays private until -flush");
+  PASS([[alloc readAtOffset: 64 length: 2] isEqual:
+          [NSData dataWithBytes: "\xbe\xef" length: 2]],
+       "the allocator sees its own writes");
+
+  [alloc flush];
+  bytes = [[NSData dataWithContentsOfFile: path] bytes];
+  PASS(bytes[64] == 0xbe && bytes[65] == 0xef, "-flush writes the changes out");
+
+  [alloc writeAtOffset: 4096 data: [NSData dataWithBytes: "tail" length: 4]];
+  PASS(![alloc isMapped] && [alloc fileSize] == 4100,
+       "growing the file moves to an in-memory copy");
+  PASS([[alloc readAtOffset: 64 length: 2] isEqual:
+          [NSData dataWithBytes: "\xbe\xef" length: 2]],
+       "the copy keeps the earlier writes");
+
+  [alloc release];
+  [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,83 @@
+/* t_DSPlistValue.m — headless coverage for lazily decoded plist records.
+ *
+ * DSPlistCodec hands out DSPlistValue proxies for bwsp/icvp/lsvp.  Scalar
+ * keys are read straight from the binary plist; the whole list is parsed
+ * only when a container is asked for, or when the bytes are not bplist00.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../DSStore/DSStoreCodecs.m"
+
+static NSData *
+encode(id plist, NSPropertyListFormat format)
+{
+  return [NSPropertyListSerialization dataWithPropertyList: plist
+                                                    format: format
+                                                   options: 0
+                                                     error: NULL];
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSDictionary *icvp = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithInt: 64], @"iconSize",
+    [NSNumber numberWithDouble: 54.5], @"gridSpacing",
+    [NSNumber numberWithBool: YES], @"labelOnBottom",
+    [NSNumber numberWithLongLong: -3], @"offset",
+    @"grid", @"arrangeBy",
+    @"Größe", @"sortColumn",
+    [NSArray arrayWithObjects: @"name", @"size", nil], @"columns",
+    nil];
+  NSData *binary = encode(icvp, NSPropertyListBinaryFormat_v1_0);
+  DSPlistValue *value;
+  NSData *truncated;
+
+  value = [[DSStoreCodecRegistry sharedRegistry] decodeData: binary forType: @"icvp"];
+  PASS([value isKindOfClass: [DSPlistValue class]] && ![value isParsed],
+       "the codec returns an unparsed proxy");
+
+  PASS([[value scalarForKey: @"iconSize"] intValue] == 64, "integers are read");
+  PASS([[value scalarForKey: @"gridSpacing"] doubleValue] == 54.5, "reals are read");
+  PASS([[value scalarForKey: @"labelOnBottom"] boolValue], "booleans are read");
+  PASS([[value scalarForKey: @"offset"] longLongValue] == -3, "8-byte integers are signed");
+  PASS([[value scalarForKey: @"arrangeBy"] isEqual: @"grid"], "ASCII strings are read");
+  PASS([[value scalarForKey: @"sortColumn"] isEqual: @"Größe"],
+       "UTF-16 strings are read");
+  PASS([value scalarForKey: @"columns"] == nil, "containers are not scalars");
+  PASS([value scalarForKey: @"missing"] == nil, "a missing key is nil");
+  PASS(![value isParsed], "scalar lookups do not parse the plist");
+
+  PASS([[value objectForKey: @"iconSize"] intValue] == 64 && ![value isParsed],
+       "-objectForKey: takes the fast path for scalars");
+  PASS([[value objectForKey: @"columns"] isEqual: [icvp objectForKey: @"columns"]]
+       && [value isParsed],
+       "a container parses the whole plist");
+  PASS([[value dictionary] isEqual: icvp], "the parsed plist is complete");
+  PASS([[DSPlistCodec encodeValue: value] isEqual: binary],
+       "a proxy encodes back to its bytes");
+
+  value = [DSPlistValue valueWithData: encode(icvp, NSPropertyListXMLFormat_v1_0)];
+  PASS([[value scalarForKey: @"iconSize"] intValue] == 64 && [value isParsed],
+       "an XML plist falls back to a full parse");
+
+  truncated = [binary subdataWithRange: NSMakeRange(0, [binary length] - 8)];
+  value = [DSPlistValue valueWithData: truncated];
+  PASS([value scalarForKey: @"iconSize"] == nil && [value dictionary] == nil,
+       "a truncated plist yields nothing");
+
+  value = [DSPlistValue valueWithData:
+    encode([NSArray arrayWithObject: @"x"], NSPropertyListBinaryFormat_v1_0)];
+  PASS([value objectForKey: @"iconSize"] == nil && [value dictionary] == nil,
+       "a plist that is not a dictionary has no keys");
+
+  PASS([DSPlistCodec decodeData: [NSData data]] == nil, "an empty blob has no plist");
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,220 @@
+/* t_DSStoreLazy.m — headless coverage for lazy DSStore lookups.
+ *
+ * -loadLazily reads only the header and -entryForFilename:code: descends
+ * the on-disk B-tree; -iconLocationTable scans all of it in place.  A two-level tree is written by hand, since -save
+ * only produces a single leaf, so the internal-node path is exercised too.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../DSStore/DSStore.m"
+
+static void
+put32(NSMutableData *data, NSUInteger pos, uint32_t value)
+{
+  uint32_t big = NSSwapHostIntToBig(value);
+
+  [data replaceBytesInRange: NSMakeRange(pos, 4) withBytes: &big];
+}
+
+/* Writes a node at file offset `pos` (the reader adds 4); children is nil
+ * for a leaf, rightChild 0. */
+static void
+putNode(NSMutableData *data, NSUInteger pos, uint32_t rightChild,
+        NSArray *records, NSArray *children)
+{
+  NSUInteger i;
+
+  pos += 4;
+  put32(data, pos, rightChild);
+  put32(data, pos + 4, [records count]);
+  pos += 8;
+
+  for (i = 0; i < [records count]; i++)
+    {
+      NSData *enc = [[records objectAtIndex: i] encode];
+
+      if (children)
+        {
+          put32(data, pos, [[children objectAtIndex: i] unsignedIntValue]);
+          pos += 4;
+        }
+      [data replaceBytesInRange: NSMakeRange(pos, [enc length])
+                      withBytes: [enc bytes]];
+      pos += [enc length];
+    }
+}
+
+static NSData *
+twoLevelStore(NSArray *sorted)
+{
+  NSMutableData *data = [NSMutableData dataWithLength: 0x4000];
+  NSUInteger half = [sorted count] / 2;
+  NSRange left = NSMakeRange(0, half);
+  NSRange right = NSMakeRange(half + 1, [sorted count] - half - 1);
+
+  /* buddy header, root block, offsets and the DSDB entry */
+  put32(data, 0, 1);
+  put32(data, 4, 0x42756431);
+  put32(data, 8, 0x800);
+  put32(data, 12, 0x800);
+  put32(data, 16, 0x800);
+
+  put32(data, 0x804, 5);
+  put32(data, 0x80c, 0x800 | 11);
+  put32(data, 0x810, 0x20 | 5);
+  put32(data, 0x814, 0x1000 | 12);
+  put32(data, 0x818, 0x2000 | 12);
+  put32(data, 0x81c, 0x3000 | 12);
+  put32(data, 0x80c + 256 * 4, 1);
+  [data replaceBytesInRange: NSMakeRange(0x80c + 256 * 4 + 4, 5)
+                  withBytes: "\004DSDB"];
+  put32(data, 0x80c + 256 * 4 + 9, 1);
+
+  /* DSDB superblock: root node 2, two levels, three nodes */
+  put32(data, 0x24, 2);
+  put32(data, 0x28, 2);
+  put32(data, 0x2c, [sorted count]);
+  put32(data, 0x30, 3);
+  put32(data, 0x34, 4096);
+
+  putNode(data, 0x1000, 4,
+          [NSArray arrayWithObject: [sorted objectAtIndex: half]],
+          [NSArray arrayWithObject: [NSNumber numberWithUnsignedInt: 3]]);
+  putNode(data, 0x2000, 0, [sorted subarrayWithRange: left], nil);
+  putNode(data, 0x3000, 0, [sorted subarrayWithRange: right], nil);
+
+  return data;
+}
+
+/* The table holds exactly the Iloc records of `sorted`, in hash order. */
+static BOOL
+tableMatches(NSData *table, NSArray *sorted)
+{
+  const DSStoreIconLocation *locs = [table bytes];
+  NSUInteger n = [table length] / sizeof(DSStoreIconLocation);
+  NSUInteger i, matched = 0;
+
+  for (i = 1; i < n; i++)
+    if (locs[i - 1].nameHash > locs[i].nameHash)
+      return NO;
+
+  for (i = 0; i < [sorted count]; i++)
+    {
+      DSStoreEntry *e = [sorted objectAtIndex: i];
+      NSString *name = [e filename];
+      unichar chars[64];
+      uint64_t hash;
+      NSPoint p;
+      NSUInteger j;
+
+      if (![[e code] isEqualToString: @"Iloc"])
+        continue;
+      [name getCharacters: chars range: NSMakeRange(0, [name length])];
+      hash = DSStoreFilenameHash(chars, [name length]);
+      p = [e iconLocation];
+      for (j = 0; j < n; j++)
+        if (locs[j].nameHash == hash && locs[j].x == p.x && locs[j].y == p.y)
+          break;
+      if (j == n)
+        return NO;
+      matched++;
+    }
+  return matched == n;
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *dir = NSTemporaryDirectory();
+  NSString *flatPath = [dir stringByAppendingPathComponent:
+    [NSString stringWithFormat: @"t_DSStoreLazy-%d-flat", getpid()]];
+  NSString *treePath = [dir stringByAppendingPathComponent:
+    [NSString stringWithFormat: @"t_DSStoreLazy-%d-tree", getpid()]];
+  NSMutableArray *entries = [NSMutableArray array];
+  NSArray *sorted;
+  DSStore *store;
+  NSUInteger i;
+  BOOL ok;
+
+  for (i = 0; i < 60; i++)
+    {
+      NSString *name = [NSString stringWithFormat: @"file%02lu.txt", (unsigned long)i];
+
+      [entries addObject: [DSStoreEntry iconLocationEntryForFile: name
+                                                               x: (int)i * 10
+                                                               y: (int)i * 20]];
+    }
+  [entries addObject: [DSStoreEntry viewStyleEntryForFile: @"." style: @"icnv"]];
+  [entries addObject: [DSStoreEntry booleanEntryForFile: @"Docs" code: @"dilc" value: YES]];
+  sorted = [entries sortedArrayUsingSelector: @selector(compare:)];
+
+  /* --- single leaf, as written by -save --- */
+  store = [DSStore createStoreAtPath: flatPath withEntries: entries];
+  PASS([store save], "a flat store is saved");
+
+  store = [DSStore storeWithPath: flatPath];
+  PASS([store loadLazily] && [store isLazy], "-loadLazily reads the header");
+
+  ok = YES;
+  for (i = 0; i < [sorted count]; i++)
+    {
+      DSStoreEntry *e = [sorted objectAtIndex: i];
+      DSStoreEntry *found = [store entryForFilename: [e filename] code: [e code]];
+
+      if (!found || ![[found value] isEqual: [e value]]
+          || ![[found type] isEqualToString: [e type]])
+        ok = NO;
+    }
+  PASS(ok, "every record of a flat store is found lazily");
+  PASS([store isLazy], "lookups do not load the whole store");
+  PASS(tableMatches([store iconLocationTable], sorted) && [store isLazy],
+       "the Iloc table is scanned without loading the store");
+
+  store = [DSStore storeWithPath: flatPath];
+  [store load];
+  PASS(tableMatches([store iconLocationTable], sorted),
+       "a loaded store builds the same Iloc table");
+
+  /* --- root, two leaves --- */
+  PASS([twoLevelStore(sorted) writeToFile: treePath atomically: NO],
+       "a two-level store is written");
+
+  store = [DSStore storeWithPath: treePath];
+  PASS([store loadLazily], "-loadLazily reads a two-level header");
+
+  ok = YES;
+  for (i = 0; i < [sorted count]; i++)
+    {
+      DSStoreEntry *e = [sorted objectAtIndex: i];
+      DSStoreEntry *found = [store entryForFilename: [e filename] code: [e code]];
+
+      if (!found || ![[found value] isEqual: [e value]])
+        ok = NO;
+    }
+  PASS(ok, "records in both leaves and in the root are found");
+  PASS(tableMatches([store iconLocationTable], sorted),
+       "the Iloc table covers both leaves and the root");
+
+  PASS([store entryForFilename: @"file05.txt" code: @"bwsp"] == nil,
+       "a missing code is not found");
+  PASS([store entryForFilename: @"file99.txt" code: @"Iloc"] == nil,
+       "a key past the last leaf is not found");
+  PASS([store entryForFilename: @"" code: @"Iloc"] == nil,
+       "a key before the first leaf is not found");
+  PASS([store entryForFilename: @"FILE05.txt" code: @"Iloc"] == nil,
+       "filenames still match exactly");
+  PASS([store isLazy], "the store is still lazy after the lookups");
+
+  [store setEntry: [DSStoreEntry viewStyleEntryForFile: @"." style: @"Nlsv"]];
+  PASS(![store isLazy], "a change falls back to a full load");
+
+  [[NSFileManager defaultManager] removeItemAtPath: flatPath error: NULL];
+  [[NSFileManager defaultManager] removeItemAtPath: treePath error: NULL];
+  [arp release];
+  return 0;
+}
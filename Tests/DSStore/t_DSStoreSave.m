@@ -0,0 +1,120 @@
+/* t_DSStoreSave.m — headless coverage for incremental DSStore saves.
+ *
+ * After the first full write, -save rewrites only the changed B-tree nodes
+ * in place and switches the offsets table over to them, so the file keeps
+ * its inode.  A change that no longer fits the leaf falls back to a full,
+ * atomic rewrite, which replaces the file.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../DSStore/DSStore.m"
+
+static unsigned long
+fileNumber(NSString *path)
+{
+  NSDictionary *attrs = [[NSFileManager defaultManager]
+                          attributesOfItemAtPath: path error: NULL];
+
+  return [attrs fileSystemFileNumber];
+}
+
+static BOOL
+hasLocation(DSStore *store, NSString *name, int x, int y)
+{
+  NSPoint p = [store iconLocationForFilename: name];
+
+  return p.x == x && p.y == y;
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+    [NSString stringWithFormat: @"t_DSStoreSave-%d", getpid()]];
+  NSMutableArray *entries = [NSMutableArray array];
+  unsigned long inode;
+  DSStore *store;
+  NSUInteger i;
+  BOOL ok;
+
+  for (i = 0; i < 40; i++)
+    {
+      NSString *name = [NSString stringWithFormat: @"file%02lu.txt", (unsigned long)i];
+
+      [entries addObject: [DSStoreEntry iconLocationEntryForFile: name
+                                                               x: (int)i
+                                                               y: (int)i]];
+    }
+
+  store = [DSStore createStoreAtPath: path withEntries: entries];
+  PASS([store save], "the first save writes the whole file");
+  inode = fileNumber(path);
+
+  /* --- one moved icon --- */
+  [store setIconLocationForFilename: @"file07.txt" x: 300 y: 400];
+  PASS([store save], "a moved icon is saved");
+  PASS(fileNumber(path) == inode, "the save rewrote blocks in place");
+
+  store = [DSStore storeWithPath: path];
+  PASS([store load], "the store still loads");
+  PASS(hasLocation(store, @"file07.txt", 300, 400), "the new position is read back");
+  PASS([[store entries] count] == 40, "no record was lost");
+
+  /* --- an added and a removed record, from a fresh load --- */
+  [store setIconLocationForFilename: @"new.txt" x: 5 y: 6];
+  [store removeEntryForFilename: @"file03.txt" code: @"Iloc"];
+  PASS([store save], "an insertion and a removal are saved");
+  PASS(fileNumber(path) == inode, "still in place");
+
+  store = [DSStore storeWithPath: path];
+  [store load];
+  PASS(hasLocation(store, @"new.txt", 5, 6)
+       && [store entryForFilename: @"file03.txt" code: @"Iloc"] == nil
+       && [[store entries] count] == 40,
+       "the record count and the records are updated");
+
+  ok = YES;
+  for (i = 0; i < 40; i++)
+    {
+      NSString *name = [NSString stringWithFormat: @"file%02lu.txt", (unsigned long)i];
+
+      if (i != 3 && i != 7 && !hasLocation(store, name, (int)i, (int)i))
+        ok = NO;
+    }
+  PASS(ok, "untouched records are copied as they were");
+
+  /* --- repeated saves reuse the freed blocks --- */
+  for (i = 0; i < 10; i++)
+    {
+      [store setIconLocationForFilename: @"file10.txt" x: (int)i y: 0];
+      [store save];
+    }
+  PASS([[[NSFileManager defaultManager] attributesOfItemAtPath: path error: NULL]
+         fileSize] < 0x10000,
+       "the file does not grow with every save");
+
+  store = [DSStore storeWithPath: path];
+  PASS([store loadLazily] && hasLocation(store, @"file10.txt", 9, 0),
+       "a lazy lookup sees the last save");
+
+  /* --- a leaf that overflows --- */
+  store = [DSStore storeWithPath: path];
+  [store load];
+  for (i = 0; i < 200; i++)
+    {
+      NSString *name = [NSString stringWithFormat: @"extra%03lu.txt", (unsigned long)i];
+
+      [store setIconLocationForFilename: name x: 1 y: 2];
+    }
+  PASS([store save], "an overflowing leaf is saved");
+  PASS(fileNumber(path) != inode, "it fell back to a full rewrite");
+
+  [[NSFileManager defaultManager] removeItemAtPath: path error: NULL];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,82 @@
+/* t_FSNDirectorySnapshot.m — headless coverage for incremental listings.
+ *
+ * FSNDirectoryLoader streams a folder into a browser column by reading an
+ * FSNDirectorySnapshot a batch at a time.  The snapshot is Foundation-only,
+ * so it is compiled in-process and run with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include <unistd.h>
+
+#include "../../FSNode/FSNDirectorySnapshot.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                    [NSString stringWithFormat: @"t_fsnsnap_%d", (int)getpid()]];
+  FSNDirectorySnapshot *whole;
+  FSNDirectorySnapshot *snap;
+  FSNDirectorySnapshot *chunk;
+  NSMutableSet *read;
+  NSUInteger i;
+
+  [fm removeFileAtPath: dir handler: nil];
+  [fm createDirectoryAtPath: dir attributes: nil];
+  for (i = 0; i < 5; i++)
+    {
+      NSString *fname = [NSString stringWithFormat: @"file%lu", (unsigned long)i];
+
+      [fm createFileAtPath: [dir stringByAppendingPathComponent: fname]
+                  contents: [NSData data]
+                attributes: nil];
+    }
+
+  whole = [[FSNDirectorySnapshot alloc] initWithDirectoryAtPath: dir];
+  PASS([whole isValid] && [whole isComplete] && [whole count] == 5,
+       "a one-pass read lists every entry");
+
+  snap = [[FSNDirectorySnapshot alloc] initForReadingDirectoryAtPath: dir
+                                                                tier: FSNLoadTierStat];
+  PASS([snap isComplete] == NO && [snap isValid] == NO,
+       "an incremental read starts open and not yet valid");
+
+  PASS([snap readEntries: 2] == 2 && [snap count] == 2, "first batch");
+  chunk = [snap snapshotOfEntriesInRange: NSMakeRange(0, 2)];
+  PASS([chunk isValid] && [chunk isComplete] && [chunk count] == 2
+       && [[chunk nameAtIndex: 1] isEqual: [snap nameAtIndex: 1]]
+       && [chunk statInfoAtIndex: 1]->inode == [snap statInfoAtIndex: 1]->inode,
+       "a chunk copies names and stat records");
+  PASS([[chunk path] isEqual: dir] && [chunk tier] == FSNLoadTierStat,
+       "a chunk keeps path and tier");
+
+  PASS([snap readEntries: 2] == 2, "second batch");
+  PASS([snap readEntries: 2] == 1 && [snap isComplete] == NO,
+       "the last entries can come before the end is seen");
+  PASS([snap readEntries: 2] == 0 && [snap isComplete] && [snap isValid],
+       "the read ends valid and complete");
+  PASS([snap readEntries: 2] == 0, "a complete snapshot reads nothing more");
+
+  read = [NSMutableSet setWithArray: [snap names]];
+  PASS([read count] == 5 && [read isEqual: [NSSet setWithArray: [whole names]]],
+       "batches add up to the one-pass listing");
+
+  [snap release];
+  snap = [[FSNDirectorySnapshot alloc] initForReadingDirectoryAtPath:
+                                   [dir stringByAppendingPathComponent: @"missing"]
+                                                                tier: FSNLoadTierType];
+  PASS([snap isComplete] && [snap isValid] == NO && [snap readEntries: 10] == 0,
+       "a missing directory is complete and invalid");
+
+  [snap release];
+  [whole release];
+  [fm removeFileAtPath: dir handler: nil];
+  [arp release];
+  return 0;
+}
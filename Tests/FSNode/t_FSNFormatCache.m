@@ -0,0 +1,86 @@
+/* t_FSNFormatCache.m — headless coverage for the shared date and size
+ * string caches.
+ *
+ * FSNFormatCache is Foundation-only, so it is compiled in-process.  The
+ * dates are checked against -descriptionWithCalendarFormat: in a zone with
+ * daylight saving time, around its transitions, and in the zone set after.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNFormatCache.m"
+
+static BOOL
+matchesCalendarFormat(NSTimeInterval t)
+{
+  NSDate *date = [NSDate dateWithTimeIntervalSince1970: t];
+  NSTimeZone *tz = [NSTimeZone defaultTimeZone];
+  NSString *day = [date descriptionWithCalendarFormat: @"%b %d %Y"
+                                             timeZone: tz locale: nil];
+  NSString *full = [date descriptionWithCalendarFormat: @"%b %d %Y %H:%M"
+                                              timeZone: tz locale: nil];
+
+  return ([FSNDateDescription(t, NO) isEqual: day]
+          && [FSNDateDescription(t, YES) isEqual: full]);
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSTimeZone *rome = [NSTimeZone timeZoneWithName: @"Europe/Rome"];
+  NSTimeZone *adelaide = [NSTimeZone timeZoneWithName: @"Australia/Adelaide"];
+  NSTimeInterval t;
+  BOOL all;
+
+  [NSTimeZone setDefaultTimeZone: [NSTimeZone timeZoneForSecondsFromGMT: 0]];
+  PASS_EQUAL(FSNDateDescription(0, YES), @"Jan 01 1970 00:00", "the epoch");
+  PASS_EQUAL(FSNDateDescription(86399.9, YES), @"Jan 01 1970 23:59",
+             "the last second of a day is on that day");
+  PASS_EQUAL(FSNDateDescription(-1, NO), @"Dec 31 1969", "and before the epoch");
+
+  if (rome)
+    {
+      [NSTimeZone setDefaultTimeZone: rome];
+      all = YES;
+      /* 2024-03-31 and 2024-10-27, a minute at a time around 01:00 GMT */
+      for (t = 1711846800 - 7200; t < 1711846800 + 7200; t += 60)
+        all = all && matchesCalendarFormat(t);
+      for (t = 1729990800 - 7200; t < 1729990800 + 7200; t += 60)
+        all = all && matchesCalendarFormat(t);
+      PASS(all, "the local time is right across daylight saving transitions");
+
+      all = YES;
+      for (t = 1700000000; t < 1700000000 + 400 * 86400; t += 86400 / 3 + 17)
+        all = all && matchesCalendarFormat(t);
+      PASS(all, "and on the days of a year, more than the cache holds");
+    }
+
+  if (adelaide)
+    {
+      [NSTimeZone setDefaultTimeZone: adelaide];
+      all = YES;
+      /* 2024-04-06 at 16:30 GMT, inside an hour */
+      for (t = 1712421000 - 5400; t < 1712421000 + 5400; t += 60)
+        all = all && matchesCalendarFormat(t);
+      PASS(all, "a new default time zone is used, half hour transitions too");
+    }
+
+  PASS_EQUAL(FSNSizeDescription(0), @"0 bytes", "no bytes");
+  PASS_EQUAL(FSNSizeDescription(1), @"1 byte", "one byte");
+  PASS_EQUAL(FSNSizeDescription(512), @" 512 bytes", "bytes");
+  PASS_EQUAL(FSNSizeDescription(1536), @" 1.50KB", "kilobytes");
+  PASS_EQUAL(FSNSizeDescription(3 * 1024 * 1024), @" 3.00MB", "megabytes");
+  PASS(FSNSizeDescription(4096) == FSNSizeDescription(4096),
+       "the string of a size is shared");
+  /* in the slot of 4096 */
+  PASS_EQUAL(FSNSizeDescription(1073758208ULL), @" 1.00GB",
+             "a size in the same slot gets its own string");
+  PASS_EQUAL(FSNSizeDescription(4096), @" 4.00KB", "and takes it over");
+
+  [arp release];
+  return 0;
+}
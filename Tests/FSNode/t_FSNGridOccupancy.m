@@ -0,0 +1,87 @@
+/* t_FSNGridOccupancy.m — headless coverage for the placement grid bitmap.
+ *
+ * FSNGridOccupancy is what AUTO icon placement asks for the next free cell.
+ * It and the placement enumerators are Foundation-only, so both are compiled
+ * in-process and run with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNPlacementEnumerator.m"
+#include "../../FSNode/FSNGridOccupancy.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  FSNPlacementEnumerator *e;
+  FSNGridOccupancy *occ;
+  FSNGridCell cell;
+  NSUInteger i;
+  BOOL ok;
+
+  /* Index <-> cell mapping must follow -nextCell: in both directions. */
+  e = [[FSNTopToBottomRightToLeftEnumerator alloc] initWithColumns: 5 rows: 3];
+  ok = YES;
+  for (i = 0; [e nextCell: &cell]; i++)
+    {
+      if ([e indexOfCell: cell] != i
+          || !FSNGridCellsEqual([e cellAtIndex: i], cell))
+        ok = NO;
+    }
+  PASS(ok && i == 15, "desktop order: indexOfCell/cellAtIndex follow nextCell");
+  PASS([e indexOfCell: FSNGridCellMake(5, 0)] == NSNotFound,
+       "cells outside the grid have no index");
+  [e release];
+
+  e = [[FSNLeftToRightTopToBottomEnumerator alloc] initWithColumns: 4 rows: 40];
+  ok = YES;
+  for (i = 0; [e nextCell: &cell]; i++)
+    {
+      if ([e indexOfCell: cell] != i
+          || !FSNGridCellsEqual([e cellAtIndex: i], cell))
+        ok = NO;
+    }
+  PASS(ok && i == 160, "viewer order: indexOfCell/cellAtIndex follow nextCell");
+
+  /* Free cells come out in traversal order, skipping occupied ones,
+   * across word boundaries. */
+  occ = [[FSNGridOccupancy alloc] initWithEnumerator: e];
+  [occ occupyCell: FSNGridCellMake(0, 0)];
+  [occ occupyCell: FSNGridCellMake(2, 0)];
+  PASS([occ isCellOccupied: FSNGridCellMake(2, 0)]
+       && ![occ isCellOccupied: FSNGridCellMake(1, 0)],
+       "occupied cells are reported");
+  PASS(![occ occupyCell: FSNGridCellMake(4, 0)], "out-of-grid cells are refused");
+
+  [occ takeFreeCell: &cell];
+  PASS(FSNGridCellsEqual(cell, FSNGridCellMake(1, 0)), "first free cell is (1,0)");
+  [occ takeFreeCell: &cell];
+  PASS(FSNGridCellsEqual(cell, FSNGridCellMake(3, 0)), "occupied (2,0) is skipped");
+
+  for (i = 4; i < 64; i++)
+    [occ occupyCell: [e cellAtIndex: i]];
+  [occ takeFreeCell: &cell];
+  PASS([e indexOfCell: cell] == 64, "search crosses a full bitmap word");
+
+  [occ vacateCell: FSNGridCellMake(2, 0)];
+  [occ takeFreeCell: &cell];
+  PASS(FSNGridCellsEqual(cell, FSNGridCellMake(2, 0)), "a vacated cell is reused first");
+
+  while ([occ takeFreeCell: &cell]);
+  PASS([occ occupiedCount] == 160 && ![occ takeFreeCell: &cell],
+       "a full grid has no free cell");
+
+  [occ removeAllCells];
+  PASS([occ occupiedCount] == 0 && [occ takeFreeCell: &cell]
+       && FSNGridCellsEqual(cell, FSNGridCellMake(0, 0)),
+       "removeAllCells empties the grid");
+
+  [occ release];
+  [e release];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,71 @@
+/* t_FSNHiddenMatcher.m — headless coverage for the hidden-file rules the
+ * viewers, the indexer and the search tools share.
+ *
+ * FSNHiddenMatcher is Foundation-only, so it is compiled in-process; its
+ * rules are set by hand, the GWorkspace defaults are not read.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNHiddenMatcher.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  FSNHiddenMatcher *matcher = [FSNHiddenMatcher new];
+  unsigned long version = [matcher version];
+
+  PASS([matcher isHiddenName: @".DS_Store"]
+       && [matcher isHiddenName: @"__MACOSX"]
+       && [matcher isHiddenName: @"._photo.jpg"],
+       "the metadata files are always hidden");
+  PASS([matcher isHiddenName: @"photo.jpg"] == NO
+       && [matcher isHiddenName: @".profile"] == NO,
+       "nothing else is by default");
+  PASS([matcher isMetadataName: @"._x"] && ([matcher isMetadataName: @".profile"] == NO),
+       "isMetadataName: knows only the metadata files");
+
+  [matcher setHidesDotFiles: YES];
+  PASS([matcher isHiddenName: @".profile"], "dot files can be hidden");
+  PASS([matcher version] != version, "and that is a new version");
+  version = [matcher version];
+  [matcher setHidesDotFiles: YES];
+  PASS([matcher version] == version, "setting the same rule again is not");
+  [matcher setHidesDotFiles: NO];
+
+  [matcher setHiddenPatterns: [NSArray arrayWithObjects:
+                                         @"*.bak", @"tmp*", @"*cache*",
+                                         @"core.[0-9]*", @"Thumbs.db", nil]];
+  PASS([matcher isHiddenName: @"notes.bak"], "a suffix pattern");
+  PASS([matcher isHiddenName: @"tmpfile"], "a prefix pattern");
+  PASS([matcher isHiddenName: @"my-cache-dir"], "an infix pattern");
+  PASS([matcher isHiddenName: @"core.1234"]
+       && ([matcher isHiddenName: @"core.dump"] == NO),
+       "a general pattern");
+  PASS([matcher isHiddenName: @"Thumbs.db"]
+       && ([matcher isHiddenName: @"thumbs.db"] == NO),
+       "a plain name");
+  PASS([matcher isHiddenName: @"notes.txt"] == NO, "and leaves the rest");
+
+  [matcher setHiddenPaths: [NSArray arrayWithObject: @"/home/u/Private"]];
+  PASS([matcher isHiddenName: @"Private" inDirectory: @"/home/u"],
+       "a hidden path in its folder's listing");
+  PASS([matcher isHiddenName: @"letter" inDirectory: @"/home/u/Private"] == NO,
+       "a listing of the hidden folder itself shows its contents");
+  PASS([matcher isHiddenPath: @"/home/u/Private/letter"],
+       "but a walk does not go in");
+  PASS([matcher isHiddenPath: @"/home/u/Private"]
+       && [matcher isHiddenPath: @"/home/u/Public/__MACOSX/a"]
+       && ([matcher isHiddenPath: @"/home/u/Public/a"] == NO),
+       "a path is hidden by any of its components");
+  PASS_EQUAL([matcher hiddenPaths], [NSArray arrayWithObject: @"/home/u/Private"],
+             "the hidden paths are kept as set");
+
+  [matcher release];
+  [arp release];
+  return 0;
+}
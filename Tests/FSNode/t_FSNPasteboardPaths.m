@@ -0,0 +1,94 @@
+/* t_FSNPasteboardPaths.m — headless coverage for the compact pasteboard
+ * form of a selection.
+ *
+ * FSNPasteboardPaths is what the views put on a drag or copy pasteboard
+ * and what the drop targets check.  It is Foundation-only, so it is
+ * compiled in-process with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNPasteboardPaths.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *root = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_FSNPasteboardPaths-%d",
+                                [[NSProcessInfo processInfo] processIdentifier]]];
+  NSMutableArray *many = [NSMutableArray array];
+  FSNPasteboardPaths *pbp;
+  id plist;
+  NSUInteger i;
+
+  PASS([FSNPasteboardPaths pasteboardPathsWithPaths: [NSArray array]] == nil,
+       "no paths, nothing to carry");
+
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPaths:
+           [NSArray arrayWithObjects: @"/home/u/a.txt", @"/home/u/Docs", nil]];
+  PASS([[pbp source] isEqual: @"/home/u"]
+         && [[pbp names] isEqual: [NSArray arrayWithObjects: @"a.txt", @"Docs", nil]],
+       "paths in one folder become the folder and the names");
+
+  plist = [pbp propertyList];
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPropertyList: plist];
+  PASS([[pbp paths] isEqual: [NSArray arrayWithObjects: @"/home/u/a.txt", @"/home/u/Docs", nil]],
+       "the compact form gives the paths back");
+
+  PASS([pbp containsPathOrAncestorOfPath: @"/home/u/Docs"]
+         && [pbp containsPathOrAncestorOfPath: @"/home/u/Docs/x/y"]
+         && ([pbp containsPathOrAncestorOfPath: @"/home/u/Doc"] == NO)
+         && ([pbp containsPathOrAncestorOfPath: @"/home/u"] == NO)
+         && ([pbp containsPathOrAncestorOfPath: @"/home/v/Docs"] == NO),
+       "a drop into a dragged folder, or a folder in one, is found");
+
+  PASS([FSNPasteboardPaths pasteboardPathsWithPropertyList:
+          [NSDictionary dictionaryWithObjectsAndKeys: @"/home", @"source",
+                          [NSArray arrayWithObject: @"a/b"], @"names", nil]] == nil
+         && [FSNPasteboardPaths pasteboardPathsWithPropertyList:
+               [NSDictionary dictionaryWithObjectsAndKeys: @"home", @"source",
+                               [NSArray arrayWithObject: @"a"], @"names", nil]] == nil
+         && [FSNPasteboardPaths pasteboardPathsWithPropertyList: @"x"] == nil,
+       "a malformed compact form is refused");
+
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPaths:
+           [NSArray arrayWithObjects: @"/a/x", @"/b/y", nil]];
+  PASS([pbp source] == nil && [pbp propertyList] == nil && [pbp count] == 2,
+       "paths in several folders have no compact form");
+  PASS([pbp containsPathOrAncestorOfPath: @"/b/y/z"]
+         && ([pbp containsPathOrAncestorOfPath: @"/b"] == NO),
+       "and are still looked up");
+
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPaths: [NSArray arrayWithObject: @"/"]];
+  PASS([pbp source] == nil, "the root is in no folder");
+
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPaths: [NSArray arrayWithObject: @"/etc"]];
+  PASS([[pbp source] isEqual: @"/"] && [pbp containsPathOrAncestorOfPath: @"/etc/fstab"],
+       "files right under the root");
+
+  for (i = 0; i < 1000; i++)
+    [many addObject: [NSString stringWithFormat: @"/data/f%lu", (unsigned long)i]];
+  pbp = [FSNPasteboardPaths pasteboardPathsWithPropertyList:
+           [[FSNPasteboardPaths pasteboardPathsWithPaths: many] propertyList]];
+  PASS([[pbp samplePaths: 5] isEqual: [NSArray arrayWithObjects: @"/data/f0", @"/data/f249",
+                                               @"/data/f499", @"/data/f749", @"/data/f999", nil]],
+       "a sample is spread over the paths, the first and last included");
+  PASS([[pbp samplePaths: 2000] count] == 1000, "a sample of few paths is all of them");
+
+  [fm removeFileAtPath: root handler: nil];
+  [fm createDirectoryAtPath: [root stringByAppendingPathComponent: @"dst/f999"]
+      withIntermediateDirectories: YES attributes: nil error: NULL];
+  PASS([pbp sampleMeetsFolderInDirectory: [root stringByAppendingPathComponent: @"dst"]],
+       "a sampled name that is a folder in the destination is found");
+  PASS([pbp sampleMeetsFolderInDirectory: root] == NO,
+       "and none elsewhere");
+  [fm removeFileAtPath: root handler: nil];
+
+  [arp release];
+  return 0;
+}
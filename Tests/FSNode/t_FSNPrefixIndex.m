@@ -0,0 +1,47 @@
+/* t_FSNPrefixIndex.m — headless coverage for type-ahead lookup.
+ *
+ * FSNPrefixIndex answers -selectIconWithPrefix: and -selectRepWithPrefix:.
+ * It is Foundation-only, so it is compiled in-process with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNPrefixIndex.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  /* view order, e.g. sorted by date: not alphabetical */
+  NSArray *names = [NSArray arrayWithObjects:
+                              @"Zeta", @"beta", @"Alpha", @"alphabet",
+                              @"Beta two", @"gamma", @"ALPS", nil];
+  FSNPrefixIndex *index = [[FSNPrefixIndex alloc] initWithNames: names];
+  FSNPrefixIndex *empty = [[FSNPrefixIndex alloc] initWithNames: [NSArray array]];
+
+  PASS([index count] == 7, "all names are indexed");
+
+  PASS([index firstIndexWithPrefix: @"a"] == 2,
+       "first match in view order, not in name order");
+  PASS([index firstIndexWithPrefix: @"al"] == 2, "refined prefix");
+  PASS([index firstIndexWithPrefix: @"alps"] == 6, "refined to a later name");
+  PASS([index firstIndexWithPrefix: @"alpsx"] == NSNotFound,
+       "refined past every name");
+
+  PASS([index firstIndexWithPrefix: @"BETA"] == 1, "case is ignored");
+  PASS([index firstIndexWithPrefix: @"beta t"] == 4, "spaces are literal");
+  PASS([index firstIndexWithPrefix: @"z"] == 0, "last key in name order");
+  PASS([index firstIndexWithPrefix: @"q"] == NSNotFound, "no match");
+  PASS([index firstIndexWithPrefix: @""] == NSNotFound,
+       "an empty prefix matches nothing");
+
+  PASS([empty firstIndexWithPrefix: @"a"] == NSNotFound, "empty index");
+
+  [empty release];
+  [index release];
+  [arp release];
+  return 0;
+}
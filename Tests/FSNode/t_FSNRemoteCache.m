@@ -0,0 +1,99 @@
+/* t_FSNRemoteCache.m — headless coverage for the misses remembered on
+ * network volumes.
+ *
+ * FSNRemoteCache is Foundation-only and takes the time from its callers,
+ * so it is compiled in-process and driven with made-up clocks.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNRemoteCache.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  FSNRemoteCache *cache = [[FSNRemoteCache alloc] initWithListingTTL: 30
+                                                        negativeTTL: 60];
+  NSString *vol = @"/media/sftp";
+  NSArray *names = [NSArray arrayWithObjects:
+                              @"a.txt", @"._a.txt", @"b.txt", @".hidden", nil];
+
+  PASS([FSNRemoteCache isMetadataName: @".DS_Store"]
+       && [FSNRemoteCache isMetadataName: @"._b.txt"]
+       && [FSNRemoteCache isMetadataName: @".hidden"]
+       && ([FSNRemoteCache isMetadataName: @".profile"] == NO),
+       "the metadata names");
+
+  PASS([cache probeForPath: @"/media/sftp/d/.DS_Store" onVolume: vol atTime: 0]
+         == FSNRemoteProbeUnknown,
+       "nothing is known of a volume never seen");
+
+  [cache setListedNames: names ofDirectory: @"/media/sftp/d"
+               onVolume: vol atTime: 100];
+  PASS([cache probeForPath: @"/media/sftp/d/.DS_Store" onVolume: vol atTime: 110]
+         == FSNRemoteProbeMissing,
+       "a listing tells a .DS_Store is missing");
+  PASS([cache probeForPath: @"/media/sftp/d/._b.txt" onVolume: vol atTime: 110]
+         == FSNRemoteProbeMissing,
+       "and a ._ sidecar");
+  PASS([cache probeForPath: @"/media/sftp/d/._a.txt" onVolume: vol atTime: 110]
+         == FSNRemoteProbePresent,
+       "or that it is there");
+  PASS([cache probeForPath: @"/media/sftp/d/c.txt" onVolume: vol atTime: 110]
+         == FSNRemoteProbeUnknown,
+       "but nothing of the other names");
+  PASS([cache probeForPath: @"/media/sftp/d/.DS_Store" onVolume: vol atTime: 161]
+         == FSNRemoteProbeUnknown,
+       "a listing expires after the negative TTL");
+
+  [cache setMissingPath: @"/media/sftp/e/.DS_Store" onVolume: vol atTime: 200];
+  PASS([cache probeForPath: @"/media/sftp/e/.DS_Store" onVolume: vol atTime: 250]
+         == FSNRemoteProbeMissing,
+       "a miss is remembered");
+  PASS([cache probeForPath: @"/media/sftp/e/.DS_Store" onVolume: vol atTime: 261]
+         == FSNRemoteProbeUnknown,
+       "for the negative TTL only");
+
+  [cache setMissingPath: @"/media/sftp/d/._a.txt" onVolume: vol atTime: 300];
+  [cache setListedNames: names ofDirectory: @"/media/sftp/d"
+               onVolume: vol atTime: 310];
+  PASS([cache probeForPath: @"/media/sftp/d/._a.txt" onVolume: vol atTime: 320]
+         == FSNRemoteProbePresent,
+       "a newer listing wins over a miss");
+  [cache setMissingPath: @"/media/sftp/d/._a.txt" onVolume: vol atTime: 330];
+  PASS([cache probeForPath: @"/media/sftp/d/._a.txt" onVolume: vol atTime: 340]
+         == FSNRemoteProbeMissing,
+       "and a newer miss over a listing");
+
+  [cache setMissingPath: @"/media/sftp/d/sub/.DS_Store" onVolume: vol atTime: 340];
+  [cache setMissingPath: @"/media/sftp/dx/.DS_Store" onVolume: vol atTime: 340];
+  [cache invalidatePath: @"/media/sftp/d"];
+  PASS([cache probeForPath: @"/media/sftp/d/.hidden" onVolume: vol atTime: 341]
+         == FSNRemoteProbeUnknown
+       && [cache probeForPath: @"/media/sftp/d/sub/.DS_Store" onVolume: vol atTime: 341]
+         == FSNRemoteProbeUnknown,
+       "invalidating a path drops what is known at and beneath it");
+  PASS([cache probeForPath: @"/media/sftp/dx/.DS_Store" onVolume: vol atTime: 341]
+         == FSNRemoteProbeMissing,
+       "but not of a sibling sharing the prefix");
+
+  [cache setListedNames: names ofDirectory: @"/media/sftp/d"
+               onVolume: vol atTime: 400];
+  [cache invalidatePath: @"/media/sftp/d/.DS_Store"];
+  PASS([cache probeForPath: @"/media/sftp/d/.DS_Store" onVolume: vol atTime: 401]
+         == FSNRemoteProbeUnknown,
+       "a file written drops the listing of its directory");
+
+  [cache invalidateVolume: vol];
+  PASS([cache probeForPath: @"/media/sftp/dx/.DS_Store" onVolume: vol atTime: 401]
+         == FSNRemoteProbeUnknown,
+       "invalidating a volume drops all of it");
+
+  [cache release];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,75 @@
+/* t_FSNRepNames.m — headless coverage for the file name -> rep maps.
+ *
+ * FSNIconsView and FSNListView resolve the names of fswatcher and file
+ * operation events through FSNRepsByFileName().  A special folder shows
+ * a localized name, so the map must be keyed by the file name.  It is
+ * Foundation-only, so it is compiled in-process with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNRepNames.m"
+
+/* an FSNode and a rep, as far as the map sees them */
+@interface TestNode : NSObject
+{
+@public
+  NSString *name;
+  NSString *lastPathComponent;
+}
+@end
+
+@implementation TestNode
+- (NSString *)name { return name; }
+- (NSString *)lastPathComponent { return lastPathComponent; }
+@end
+
+@interface TestRep : NSObject
+{
+@public
+  TestNode *node;
+}
+@end
+
+@implementation TestRep
+- (id)node { return node; }
+@end
+
+static TestRep *
+makeRep(NSString *name, NSString *fname)
+{
+  TestRep *rep = [[TestRep new] autorelease];
+
+  rep->node = [[TestNode new] autorelease];
+  rep->node->name = name;
+  rep->node->lastPathComponent = fname;
+
+  return rep;
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  TestRep *desktop = makeRep(@"Scrivania", @"Desktop");
+  TestRep *notes = makeRep(@"notes.txt", @"notes.txt");
+  NSDictionary *reps;
+
+  reps = FSNRepsByFileName([NSArray arrayWithObjects: desktop, notes, nil]);
+
+  PASS([reps count] == 2, "every rep is mapped");
+  PASS([reps objectForKey: @"Desktop"] == desktop,
+       "a localized folder is found by its file name");
+  PASS([reps objectForKey: @"Scrivania"] == nil,
+       "and not by the name it shows");
+  PASS([reps objectForKey: @"notes.txt"] == notes,
+       "a file is found by its name");
+  PASS([FSNRepsByFileName([NSArray array]) count] == 0,
+       "no reps, an empty map");
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,109 @@
+/* t_FSNResultsStore.m — headless coverage for the stored results of live
+ * search folders.
+ *
+ * FSNResultsStore is Foundation-only, so it is compiled in-process.  A
+ * writer and a reader are opened on a temporary folder, as lsfupdater and
+ * the folder window open the .lsf folder.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include <unistd.h>
+
+#include "../../FSNode/FSNResultsStore.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                    [NSString stringWithFormat: @"t_fsnresults_%d", (int)getpid()]];
+  NSString *legacy = [dir stringByAppendingPathComponent: @"lsf.found"];
+  NSArray *expected;
+  NSArray *plus;
+  NSArray *minus;
+  FSNResultsStore *writer;
+  FSNResultsStore *reader;
+  NSUInteger i;
+
+  [fm removeFileAtPath: dir handler: nil];
+  [fm createDirectoryAtPath: dir attributes: nil];
+
+  /* a folder of before the store */
+  [[NSArray arrayWithObjects: @"/home/b", @"/home/a", nil] writeToFile: legacy
+                                                            atomically: YES];
+  reader = [[FSNResultsStore alloc] initWithDirectory: dir writable: NO];
+  PASS([reader count] == 2 && [reader containsPath: @"/home/a"],
+       "a reader reads the paths of an old folder");
+  PASS([fm fileExistsAtPath: legacy], "and leaves them where they are");
+
+  writer = [[FSNResultsStore alloc] initWithDirectory: dir writable: YES];
+  expected = [NSArray arrayWithObjects: @"/home/a", @"/home/b", nil];
+  PASS_EQUAL([writer allPaths], expected, "the writer moves them into the store");
+  PASS([fm fileExistsAtPath: legacy] == NO, "and removes the old file");
+
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus] == NO,
+       "the same paths moved are no change for the reader");
+
+  PASS([writer addPath: @"/home/c"], "a path is added");
+  PASS([writer addPath: @"/home/c"] == NO, "but once");
+  PASS([writer removePath: @"/home/a"], "a path is removed");
+  PASS([writer removePath: @"/home/z"] == NO, "one that is not there is not");
+  PASS([writer containsPath: @"/home/c"] && ([writer containsPath: @"/home/a"] == NO)
+       && [writer count] == 2, "the writer sees its changes at once");
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus] == NO,
+       "the reader does not, before they are written");
+
+  PASS([writer synchronize], "the changes are written");
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus], "the reader sees changes");
+  PASS_EQUAL(plus, [NSArray arrayWithObject: @"/home/c"], "the path added");
+  PASS_EQUAL(minus, [NSArray arrayWithObject: @"/home/a"], "the path removed");
+
+  [writer addPath: @"/home/a"];
+  [writer removePath: @"/home/a"];
+  [writer synchronize];
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus] == NO,
+       "a path added and removed again is no change");
+  [reader release];
+
+  [writer release];
+  writer = [[FSNResultsStore alloc] initWithDirectory: dir writable: YES];
+  expected = [NSArray arrayWithObjects: @"/home/b", @"/home/c", nil];
+  PASS_EQUAL([writer allPaths], expected, "the store is read back with its log");
+
+  reader = [[FSNResultsStore alloc] initWithDirectory: dir writable: NO];
+  PASS_EQUAL([reader allPaths], expected, "by a new reader too");
+
+  for (i = 0; i < 5000; i++)
+    {
+      [writer addPath: [NSString stringWithFormat: @"/data/file-%04lu", (unsigned long)i]];
+    }
+  PASS([writer synchronize] && [writer needsCompaction] == NO,
+       "a long log is folded into a new sorted file");
+  PASS([writer count] == 5002 && [writer containsPath: @"/data/file-4999"],
+       "which has them all");
+
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus]
+       && [plus count] == 5000 && [minus count] == 0,
+       "a reader finds what changed when the sorted file was replaced");
+  PASS([reader count] == 5002 && [reader containsPath: @"/data/file-0000"],
+       "and reads it");
+
+  PASS([writer setPaths: [NSArray arrayWithObjects: @"/x", @"/b", @"/x", nil]]
+       && [writer count] == 2, "paths set at once are sorted, and once");
+  PASS([reader refreshAddedPaths: &plus removedPaths: &minus]
+       && [plus count] == 2 && [minus count] == 5002,
+       "the reader sees them replaced");
+  PASS_EQUAL([reader allPaths], ([NSArray arrayWithObjects: @"/b", @"/x", nil]),
+             "and in order");
+
+  [reader release];
+  [writer release];
+  [fm removeFileAtPath: dir handler: nil];
+  [arp release];
+  return 0;
+}
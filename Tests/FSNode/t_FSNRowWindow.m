@@ -0,0 +1,68 @@
+/* t_FSNRowWindow.m — headless coverage for the rows bound to a cell pool.
+ *
+ * FSNRowWindowForVisibleRows() is what FSNBrowserColumn binds its matrix
+ * with.  It is Foundation-only, so it is compiled in-process.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNRowWindow.m"
+
+static BOOL
+rangeIs(NSRange r, NSUInteger location, NSUInteger length)
+{
+  return (r.location == location) && (r.length == length);
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSRange none = NSMakeRange(0, 0);
+  NSRange bound;
+  NSUInteger top;
+  BOOL all;
+
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(0, 20), none, 100, 400), 0, 100),
+       "a short list is bound whole");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(0, 20), none, 0, 400), 0, 0),
+       "an empty list binds nothing");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(0, 20), none, 100000, 400), 0, 400),
+       "the top of a long list binds the pool from the first row");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(50000, 20), none, 100000, 400),
+               49810, 400),
+       "rows in the middle are centred in the pool");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(99990, 20), none, 100000, 400),
+               99600, 400),
+       "the rows past the end are not bound, the pool ends with the last row");
+
+  bound = NSMakeRange(49810, 400);
+  PASS(NSEqualRanges(FSNRowWindowForVisibleRows(NSMakeRange(50150, 20), bound,
+                                                100000, 400), bound),
+       "scrolling inside the pool keeps it where it is");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(50200, 20), bound, 100000, 400),
+               50010, 400),
+       "scrolling out of it moves it");
+  PASS(rangeIs(FSNRowWindowForVisibleRows(NSMakeRange(0, 20), NSMakeRange(0, 400),
+                                          300, 400), 0, 300),
+       "a list that got shorter is bound again");
+
+  all = YES;
+  bound = none;
+  for (top = 0; top + 30 <= 100000; top += 7)
+    {
+      NSRange visible = NSMakeRange(top, 30);
+
+      bound = FSNRowWindowForVisibleRows(visible, bound, 100000, 400);
+      if ((bound.length != 400) || (NSMaxRange(bound) > 100000)
+          || (NSIntersectionRange(bound, visible).length != 30))
+        all = NO;
+    }
+  PASS(all, "the visible rows are always bound while scrolling down the list");
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,81 @@
+/* t_FSNSelectionSet.m — headless coverage for the selection bitset.
+ *
+ * FSNSelectionSet is what FSNIconsView keeps its selection in.  It is
+ * Foundation-only, so it is compiled in-process with no gnustep-gui.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNSelectionSet.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  FSNSelectionSet *set = [[FSNSelectionSet alloc] initWithCount: 200];
+  NSUInteger i, n;
+
+  PASS([set selectedCount] == 0 && [set firstIndex] == NSNotFound,
+       "a new set selects nothing");
+
+  PASS([set addIndex: 3] && [set addIndex: 64] && [set addIndex: 199]
+         && ([set addIndex: 3] == NO) && ([set addIndex: 200] == NO),
+       "adding answers whether the selection changed");
+  PASS([set selectedCount] == 3 && [set containsIndex: 64]
+         && ([set containsIndex: 65] == NO),
+       "the added positions are selected");
+  PASS([set firstIndex] == 3 && [set indexGreaterThanIndex: 3] == 64
+         && [set indexGreaterThanIndex: 64] == 199
+         && [set indexGreaterThanIndex: 199] == NSNotFound,
+       "the selected positions are enumerated in order");
+
+  PASS([set removeIndex: 64] && ([set removeIndex: 64] == NO)
+         && [set selectedCount] == 2,
+       "removing a position");
+
+  [set addAll];
+  PASS([set selectedCount] == 200 && [set containsIndex: 150]
+         && [set firstIndex] == 0 && [set indexGreaterThanIndex: 198] == 199,
+       "select all");
+  PASS([set removeIndex: 100] && [set selectedCount] == 199
+         && ([set containsIndex: 100] == NO) && [set containsIndex: 99]
+         && [set indexGreaterThanIndex: 99] == 101,
+       "taking one away after select all keeps the others");
+
+  for (i = [set firstIndex], n = 0; i != NSNotFound; i = [set indexGreaterThanIndex: i])
+    n++;
+  PASS(n == 199, "every selected position is enumerated");
+
+  [set setCount: 130];
+  PASS([set selectedCount] == 129 && ([set containsIndex: 130] == NO),
+       "the positions past a smaller count go");
+  [set setCount: 300];
+  PASS([set selectedCount] == 129 && ([set containsIndex: 250] == NO)
+         && [set indexGreaterThanIndex: 129] == NSNotFound,
+       "the positions of a larger count are not selected");
+
+  [set addAll];
+  [set setCount: 310];
+  PASS([set selectedCount] == 300 && [set containsIndex: 299]
+         && ([set containsIndex: 305] == NO),
+       "growing after select all adds unselected positions");
+
+  [set removeAll];
+  PASS([set selectedCount] == 0 && [set firstIndex] == NSNotFound
+         && ([set containsIndex: 0] == NO),
+       "remove all");
+
+  [set release];
+
+  set = [[FSNSelectionSet alloc] initWithCount: 0];
+  [set addAll];
+  PASS([set selectedCount] == 0 && [set firstIndex] == NSNotFound,
+       "an empty set has nothing to select");
+  [set release];
+
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,136 @@
+/* t_FSNSizeCache.m — headless coverage for the folder sizes the
+ * Inspector shows.
+ *
+ * FSNSizeCache is Foundation-only, so it is compiled in-process and run
+ * over a small tree in the temporary directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNSizeCache.m"
+
+static void
+writeFile(NSString *path, NSUInteger length)
+{
+  [[NSMutableData dataWithLength: length] writeToFile: path atomically: NO];
+}
+
+/* what the walk should find, by lstat of each path */
+static FSNSizeTotals
+expectedTotals(NSArray *paths)
+{
+  FSNSizeTotals t;
+  NSUInteger i;
+
+  memset(&t, 0, sizeof(t));
+
+  for (i = 0; i < [paths count]; i++)
+    {
+      struct stat st;
+
+      if (lstat([[paths objectAtIndex: i] fileSystemRepresentation], &st) == 0)
+        addStat(&t, &st);
+    }
+
+  return t;
+}
+
+static BOOL
+sameTotals(FSNSizeTotals a, FSNSizeTotals b)
+{
+  return (a.apparent == b.apparent) && (a.allocated == b.allocated)
+           && (a.items == b.items);
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *root = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_FSNSizeCache-%d", getpid()]];
+  NSString *sub = [root stringByAppendingPathComponent: @"sub"];
+  NSString *deeper = [sub stringByAppendingPathComponent: @"deeper"];
+  NSString *a = [root stringByAppendingPathComponent: @"a"];
+  NSString *b = [sub stringByAppendingPathComponent: @"b"];
+  NSString *c = [deeper stringByAppendingPathComponent: @"c"];
+  NSString *d = [sub stringByAppendingPathComponent: @"d"];
+  FSNSizeCache *cache = [FSNSizeCache new];
+  FSNSizeTotals totals;
+  BOOL done;
+  int fd;
+
+  [fm createDirectoryAtPath: deeper withIntermediateDirectories: YES
+                 attributes: nil error: NULL];
+  writeFile(a, 100);
+  writeFile(b, 5000);
+  writeFile(c, 10);
+
+  done = [cache computeTotals: &totals
+                      ofPaths: [NSArray arrayWithObject: root]
+                     interval: 0.0
+                     progress: ^BOOL (FSNSizeTotals partial) {
+      return YES;
+    }];
+  PASS(done && sameTotals(totals, expectedTotals([NSArray arrayWithObjects:
+                                                    root, a, sub, b, deeper, c, nil])),
+       "a walk counts every entry, apparent and allocated");
+  PASS(totals.items == 6, "the path itself included");
+  PASS([cache recordCount] == 3
+       && [cache hasRecordForDirectory: root]
+       && [cache hasRecordForDirectory: deeper],
+       "each directory is remembered");
+
+  done = [cache computeTotals: &totals
+                      ofPaths: [NSArray arrayWithObjects: a, deeper, nil]
+                     interval: 1.0
+                     progress: nil];
+  PASS(done && sameTotals(totals, expectedTotals([NSArray arrayWithObjects:
+                                                    a, deeper, c, nil])),
+       "a selection of a file and a folder");
+
+  /* the directories' times must move on for the change to be seen */
+  usleep(50000);
+  fd = open([a fileSystemRepresentation], O_WRONLY);
+  ftruncate(fd, 300);
+  close(fd);
+  done = [cache computeTotals: &totals
+                      ofPaths: [NSArray arrayWithObject: root]
+                     interval: 1.0
+                     progress: nil];
+  PASS(totals.apparent == expectedTotals([NSArray arrayWithObjects:
+                                            root, sub, b, deeper, c, nil]).apparent + 100,
+       "a file rewritten in place is not seen from the record");
+  [cache invalidateDirectory: root];
+  done = [cache computeTotals: &totals
+                      ofPaths: [NSArray arrayWithObject: root]
+                     interval: 1.0
+                     progress: nil];
+  PASS(done && sameTotals(totals, expectedTotals([NSArray arrayWithObjects:
+                                                    root, a, sub, b, deeper, c, nil])),
+       "until its directory is invalidated");
+
+  writeFile(d, 42);
+  done = [cache computeTotals: &totals
+                      ofPaths: [NSArray arrayWithObject: root]
+                     interval: 1.0
+                     progress: nil];
+  PASS(done && (totals.items == 7)
+       && sameTotals(totals, expectedTotals([NSArray arrayWithObjects:
+                                               root, a, sub, b, d, deeper, c, nil])),
+       "a new file changes its directory, which is read again");
+
+  [cache invalidatePath: sub];
+  PASS([cache hasRecordForDirectory: root]
+       && ([cache hasRecordForDirectory: sub] == NO)
+       && ([cache hasRecordForDirectory: deeper] == NO),
+       "invalidating a path drops it and what is beneath");
+
+  [cache release];
+  [fm removeFileAtPath: root handler: nil];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,93 @@
+/* t_FSNTextPreview.m — headless coverage for the text previews of the
+ * Contents Inspector.
+ *
+ * FSNTextPreview is Foundation-only, so it is compiled in-process and run
+ * over a few files in the temporary directory.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNTextPreview.m"
+
+static void
+writeString(NSString *path, NSString *str)
+{
+  [[str dataUsingEncoding: NSASCIIStringEncoding] writeToFile: path atomically: NO];
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *root = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_FSNTextPreview-%d",
+                                [[NSProcessInfo processInfo] processIdentifier]]];
+  NSString *text = [root stringByAppendingPathComponent: @"notes.txt"];
+  NSString *other = [root stringByAppendingPathComponent: @"other.txt"];
+  NSString *third = [root stringByAppendingPathComponent: @"third.txt"];
+  NSString *binary = [root stringByAppendingPathComponent: @"blob"];
+  NSString *link = [root stringByAppendingPathComponent: @"link"];
+  FSNTextPreview *previews;
+  unsigned char bytes[4] = { 'a', 0xC3, 0xA9, 'b' };
+  NSData *data;
+
+  [fm removeFileAtPath: root handler: nil];
+  [fm createDirectoryAtPath: root withIntermediateDirectories: YES
+                 attributes: nil error: NULL];
+
+  writeString(text, @"hello, world\n");
+  writeString(other, @"other");
+  writeString(third, @"third");
+  [[NSData dataWithBytes: bytes length: 4] writeToFile: binary atomically: NO];
+  [fm createSymbolicLinkAtPath: link pathContent: text];
+
+  previews = [[FSNTextPreview alloc] initWithMaxEntries: 2];
+
+  data = [previews textOfFileAtPath: text length: 1000];
+  PASS([data isEqual: [@"hello, world\n" dataUsingEncoding: NSASCIIStringEncoding]],
+       "a short text file is read whole");
+  PASS([[previews textOfFileAtPath: text length: 5] isEqual:
+          [@"hello" dataUsingEncoding: NSASCIIStringEncoding]],
+       "only the window asked for is read");
+  PASS([previews count] == 2, "each window is remembered");
+
+  PASS([previews textOfFileAtPath: binary length: 1000] == nil,
+       "a file with bytes past ASCII has no preview");
+  PASS([previews textOfFileAtPath: binary length: 1] != nil,
+       "unless they fall past the window");
+  PASS([previews textOfFileAtPath: root length: 1000] == nil,
+       "a directory has none");
+  PASS([previews textOfFileAtPath: [root stringByAppendingPathComponent: @"none"]
+                           length: 1000] == nil,
+       "a missing file has none");
+  PASS([[previews textOfFileAtPath: link length: 1000] isEqual: data],
+       "a link is followed");
+
+  [previews removeAllPreviews];
+  [previews textOfFileAtPath: text length: 1000];
+  [previews textOfFileAtPath: other length: 1000];
+  [previews textOfFileAtPath: text length: 1000];
+  [previews textOfFileAtPath: third length: 1000];
+  PASS([previews count] == 2, "the LRU keeps its bound");
+  PASS([[previews textOfFileAtPath: text length: 1000] isEqual: data]
+         && [previews count] == 2,
+       "the file used last stays");
+
+  writeString(text, @"rewritten, and longer\n");
+  PASS([[previews textOfFileAtPath: text length: 1000] isEqual:
+          [@"rewritten, and longer\n" dataUsingEncoding: NSASCIIStringEncoding]],
+       "a rewritten file is read again");
+
+  [[NSData dataWithBytes: bytes + 1 length: 2] writeToFile: text atomically: NO];
+  PASS([previews textOfFileAtPath: text length: 1000] == nil,
+       "and may lose its preview");
+
+  [previews release];
+  [fm removeFileAtPath: root handler: nil];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* t_FSNTrace.m — headless coverage for the trace rings and their Chrome
+ * trace-event dump.
+ *
+ * FSNTrace is Foundation-only, so it is compiled in-process; the file is
+ * written to the temporary directory and read back as JSON.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNTrace.m"
+
+static void
+spanWithReturn(int early)
+{
+  FSN_TRACE_SCOPE_OP ("scoped", 42);
+
+  if (early)
+    return;
+
+  FSN_TRACE_MARK ("late", 0);
+}
+
+@interface TraceWorker : NSObject
++ (void)run:(NSConditionLock *)done;
+@end
+
+@implementation TraceWorker
++ (void)run:(NSConditionLock *)done
+{
+  FSN_TRACE_MARK ("worker", 7);
+  [done lock];
+  [done unlockWithCondition: 1];
+}
+@end
+
+static NSArray *
+eventsNamed(NSArray *events, NSString *name)
+{
+  NSMutableArray *found = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [events count]; i++)
+    {
+      NSDictionary *event = [events objectAtIndex: i];
+
+      if ([[event objectForKey: @"name"] isEqual: name])
+        [found addObject: event];
+    }
+
+  return found;
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_FSNTrace-%d.json", (int)getpid()]];
+  NSConditionLock *done = [[NSConditionLock alloc] initWithCondition: 0];
+  NSArray *events;
+  NSArray *found;
+  NSDictionary *trace;
+  NSUInteger i;
+
+  FSNTraceSetEnabled(NO);
+  FSN_TRACE_MARK ("unseen", 0);
+  spanWithReturn(1);
+
+  FSNTraceSetEnabled(YES);
+  PASS(FSNTraceIsEnabled(), "tracing can be turned on");
+  spanWithReturn(1);
+  spanWithReturn(0);
+
+  PASS(FSNTraceOpenSpans(FSNTraceCurrentThread()) == nil, "no span is open");
+  {
+    FSN_TRACE_SCOPE_OP ("outer", 3);
+
+    spanWithReturn(0);
+    {
+      FSN_TRACE_SCOPE ("inner");
+
+      PASS_EQUAL(FSNTraceOpenSpans(FSNTraceCurrentThread()), @"outer [3] > inner",
+                 "the open spans are read outermost first");
+    }
+  }
+  PASS(FSNTraceOpenSpans(FSNTraceCurrentThread()) == nil, "and none once they end");
+
+  [NSThread detachNewThreadSelector: @selector(run:)
+                           toTarget: [TraceWorker class]
+                         withObject: done];
+  [done lockWhenCondition: 1];
+  [done unlock];
+
+  PASS_EQUAL(FSNTraceWrite(path), path, "the trace is written where asked");
+
+  trace = [NSJSONSerialization JSONObjectWithData: [NSData dataWithContentsOfFile: path]
+                                          options: 0
+                                            error: NULL];
+  PASS([trace isKindOfClass: [NSDictionary class]], "the file is JSON");
+  events = [trace objectForKey: @"traceEvents"];
+
+  PASS([[[events objectAtIndex: 0] objectForKey: @"ph"] isEqual: @"M"],
+       "it starts with the process name");
+  PASS([eventsNamed(events, @"unseen") count] == 0,
+       "nothing is recorded while tracing is off");
+
+  found = eventsNamed(events, @"scoped");
+  PASS([found count] == 6, "a scope records its begin and its end");
+  for (i = 0; i + 1 < [found count]; i += 2)
+    {
+      NSDictionary *b = [found objectAtIndex: i];
+      NSDictionary *e = [found objectAtIndex: i + 1];
+
+      PASS([[b objectForKey: @"ph"] isEqual: @"B"] && [[e objectForKey: @"ph"] isEqual: @"E"]
+           && [[e objectForKey: @"ts"] doubleValue] >= [[b objectForKey: @"ts"] doubleValue],
+           "however the block is left");
+      PASS([[[b objectForKey: @"args"] objectForKey: @"op"] intValue] == 42,
+           "the begin carries the operation ID");
+    }
+  PASS([eventsNamed(events, @"late") count] == 2, "marks are recorded");
+
+  found = eventsNamed(events, @"worker");
+  PASS([found count] == 1
+       && ([[[found lastObject] objectForKey: @"tid"]
+             isEqual: [[eventsNamed(events, @"late") lastObject] objectForKey: @"tid"]] == NO),
+       "another thread records into a ring of its own");
+  PASS([[[[found lastObject] objectForKey: @"args"] objectForKey: @"op"] intValue] == 7,
+       "whose events are still there after it ended");
+
+  for (i = 0; i < 2 * FSN_TRACE_RING_SIZE; i++)
+    FSN_TRACE_MARK ("flood", i);
+  FSNTraceWrite(path);
+  trace = [NSJSONSerialization JSONObjectWithData: [NSData dataWithContentsOfFile: path]
+                                          options: 0
+                                            error: NULL];
+  found = eventsNamed([trace objectForKey: @"traceEvents"], @"flood");
+  PASS([found count] == FSN_TRACE_RING_SIZE, "a full ring keeps its last events");
+  PASS([[[[found lastObject] objectForKey: @"args"] objectForKey: @"op"] unsignedLongValue]
+         == 2 * FSN_TRACE_RING_SIZE - 1,
+       "down to the newest");
+
+  [[NSFileManager defaultManager] removeFileAtPath: path handler: nil];
+  [done release];
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,93 @@
+/* t_FSNTrash.m — headless coverage for the volume trashes and their
+ * .trashinfo records.
+ *
+ * FSNTrash is Foundation-only, so it is compiled in-process; a directory
+ * in the temporary directory stands for the top of a volume.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../FSNode/FSNTrash.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *topdir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                        [NSString stringWithFormat: @"t_FSNTrash-%d", (int)getpid()]];
+  NSString *uid = [NSString stringWithFormat: @"%lu", (unsigned long)getuid()];
+  NSString *own = [[topdir stringByAppendingPathComponent:
+                             [@".Trash-" stringByAppendingString: uid]]
+                    stringByAppendingPathComponent: @"files"];
+  NSString *shared = [topdir stringByAppendingPathComponent: @".Trash"];
+  NSString *item = [topdir stringByAppendingPathComponent: @"Some dir/a b%.txt"];
+  NSString *trash;
+  NSString *info;
+  NSArray *trashes;
+
+  [fm createDirectoryAtPath: topdir attributes: nil];
+
+  PASS([FSNTrash trashPathOfVolume: topdir create: NO] == nil,
+       "a volume has no trash until one is made");
+  trash = [FSNTrash trashPathOfVolume: topdir create: YES];
+  PASS_EQUAL(trash, own, "the user's own trash is made at the top of the volume");
+  PASS([fm fileExistsAtPath: [[own stringByDeletingLastPathComponent]
+                               stringByAppendingPathComponent: @"info"]],
+       "with its info directory");
+  PASS_EQUAL([FSNTrash trashPathOfVolume: topdir create: NO], own, "and is found again");
+  PASS([FSNTrash isVolumeTrashPath: own], "it is a volume trash");
+  PASS([FSNTrash isVolumeTrashPath: [FSNTrash homeTrashPath]] == NO
+       && [FSNTrash isVolumeTrashPath: topdir] == NO,
+       "the home trash and other folders are not");
+
+  trashes = [FSNTrash trashPathsOfVolumes: [NSArray arrayWithObjects: topdir, topdir, nil]];
+  PASS([trashes count] == 2
+       && [[trashes objectAtIndex: 0] isEqual: [FSNTrash homeTrashPath]]
+       && [[trashes objectAtIndex: 1] isEqual: own],
+       "the trashes are the home one, then each volume's once");
+
+  PASS([FSNTrash reserveName: @"a b%.txt" inTrash: own forPath: item],
+       "a name is reserved by its record");
+  PASS([FSNTrash reserveName: @"a b%.txt" inTrash: own forPath: item] == NO,
+       "only once");
+  info = [NSString stringWithContentsOfFile:
+                     [[[own stringByDeletingLastPathComponent]
+                         stringByAppendingPathComponent: @"info"]
+                       stringByAppendingPathComponent: @"a b%.txt.trashinfo"]];
+  PASS([info hasPrefix: @"[Trash Info]\nPath=Some%20dir/a%20b%25.txt\nDeletionDate="],
+       "the record has the escaped path, relative to the volume");
+  PASS_EQUAL([FSNTrash originalPathOfName: @"a b%.txt" inTrash: own], item,
+             "and gives the original path back");
+  [FSNTrash removeInfoOfName: @"a b%.txt" inTrash: own];
+  PASS([FSNTrash originalPathOfName: @"a b%.txt" inTrash: own] == nil,
+       "until it is removed");
+  PASS([FSNTrash reserveName: @"x" inTrash: [FSNTrash homeTrashPath] forPath: item] == NO,
+       "the home trash keeps no records");
+
+  [fm createDirectoryAtPath: shared attributes: nil];
+  PASS_EQUAL([FSNTrash trashPathOfVolume: topdir create: YES], own,
+             "a shared .Trash without the sticky bit is not used");
+  chmod([shared fileSystemRepresentation], 01777);
+  trash = [FSNTrash trashPathOfVolume: topdir create: YES];
+  PASS_EQUAL(trash, [[shared stringByAppendingPathComponent: uid]
+                      stringByAppendingPathComponent: @"files"],
+             "a sticky one is");
+  PASS([FSNTrash isVolumeTrashPath: trash], "and that is a volume trash too");
+  PASS([FSNTrash reserveName: @"y" inTrash: trash forPath: item]
+       && [[FSNTrash originalPathOfName: @"y" inTrash: trash] isEqual: item],
+       "whose records are relative to the same volume top");
+
+  PASS([[topdir stringByAppendingPathComponent: @"sub"]
+         hasPrefix: [FSNTrash topDirectoryOfPath: topdir]],
+       "a path is under the top of its volume");
+  PASS_EQUAL([FSNTrash trashPathForDirectory: NSHomeDirectory()], [FSNTrash homeTrashPath],
+             "the home directory recycles to the home trash");
+
+  [fm removeFileAtPath: topdir handler: nil];
+  [arp release];
+  return 0;
+}
@@ -101,6 +101,25 @@ main(void)
          && NSEqualPoints([ri position], NSMakePoint(80, 160)),
          "per-icon Iloc position survives the on-disk round-trip");
 
+    /* the shared cache hands out copies, and sees the next save */
+    DSStoreInfo *r2 = [DSStoreInfo infoForDirectoryPath: dir];
+    PASS(r2 != r && r2.loaded
+         && NSEqualPoints([[r2 iconInfoForFilename: @"doc.txt"] position],
+                          NSMakePoint(80, 160)),
+         "a cached info is a loaded copy");
+    [[r2 iconInfoForFilename: @"doc.txt"] setPosition: NSMakePoint(1, 1)];
+    PASS(NSEqualPoints([[[DSStoreInfo infoForDirectoryPath: dir]
+                          iconInfoForFilename: @"doc.txt"] position],
+                       NSMakePoint(80, 160)),
+         "changing a copy leaves the cached info alone");
+
+    icon.position = NSMakePoint(200, 240);
+    [w saveToPath: dsPath];
+    PASS(NSEqualPoints([[[DSStoreInfo infoForDirectoryPath: dir]
+                          iconInfoForFilename: @"doc.txt"] position],
+                       NSMakePoint(200, 240)),
+         "saving invalidates the cached info");
+
     [fm removeFileAtPath: dir handler: nil];
   }
 
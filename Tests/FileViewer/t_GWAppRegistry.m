@@ -0,0 +1,122 @@
+/* t_GWAppRegistry.m — headless coverage for the Open With application index.
+ *
+ * GWAppRegistry is Foundation-only, so it is compiled in-process with no
+ * gnustep-gui.  Fake .app bundles are written under a temporary root.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../Workspace/GWAppRegistry.m"
+
+static void makeApp(NSString *dir, NSString *name, NSArray *exts, NSArray *mimes)
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *res = [[dir stringByAppendingPathComponent: name]
+                        stringByAppendingPathComponent: @"Resources"];
+  NSMutableDictionary *type = [NSMutableDictionary dictionary];
+  NSDictionary *info;
+
+  [fm createDirectoryAtPath: res withIntermediateDirectories: YES
+                 attributes: nil error: NULL];
+  if (exts)
+    [type setObject: exts forKey: @"NSUnixExtensions"];
+  if (mimes)
+    [type setObject: mimes forKey: @"NSMIMETypes"];
+  info = [NSDictionary dictionaryWithObject: [NSArray arrayWithObject: type]
+                                     forKey: @"NSTypes"];
+  [info writeToFile: [res stringByAppendingPathComponent: @"Info-gnustep.plist"]
+         atomically: YES];
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *root = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_GWAppRegistry-%d",
+                                [[NSProcessInfo processInfo] processIdentifier]]];
+  NSString *utils = [root stringByAppendingPathComponent: @"Utilities"];
+  GWAppRegistry *reg;
+  NSDictionary *types;
+  NSArray *apps;
+  unsigned long gen;
+
+  /* the info dictionaries, both layouts */
+  types = [GWAppRegistry typesOfApplicationWithInfo:
+    [NSDictionary dictionaryWithObjectsAndKeys:
+      [NSArray arrayWithObject:
+        [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSArray arrayWithObjects: @"TXT", @"*", nil], @"NSUnixExtensions",
+          @"text/plain", @"NSMIMETypes", nil]], @"NSTypes",
+      [NSArray arrayWithObject:
+        [NSDictionary dictionaryWithObject: [NSArray arrayWithObject: @"rtf"]
+                                    forKey: @"CFBundleTypeExtensions"]],
+      @"CFBundleDocumentTypes", nil]];
+  PASS([[types objectForKey: @"extensions"] isEqual:
+          [NSArray arrayWithObjects: @"rtf", @"txt", nil]],
+       "extensions come from NSTypes and CFBundleDocumentTypes, lowercased, no \"*\"");
+  PASS([[types objectForKey: @"mimetypes"] isEqual: [NSArray arrayWithObject: @"text/plain"]],
+       "a single MIME type string is taken");
+
+  PASS([[GWAppRegistry typeOfFileAtPath: @"/a/Notes.TXT"] isEqual: @"txt"],
+       "a file is matched by its extension");
+  PASS([[GWAppRegistry typeOfFileAtPath: @"/a/Makefile"] isEqual: @"makefile"],
+       "or by its name when it has none");
+
+  [fm removeFileAtPath: root handler: nil];
+  makeApp(root, @"TextEdit.app", [NSArray arrayWithObjects: @"txt", @"rtf", nil], nil);
+  makeApp(root, @"Ink.app", [NSArray arrayWithObject: @"txt"],
+          [NSArray arrayWithObject: @"text/plain"]);
+  makeApp(utils, @"Viewer.app", [NSArray arrayWithObject: @"png"], nil);
+
+  reg = [[GWAppRegistry alloc] initWithDirectories: [NSArray arrayWithObject: root]];
+
+  apps = [reg applicationsForTypes: [NSSet setWithObject: @"txt"]];
+  PASS([apps isEqual: [NSArray arrayWithObjects: @"Ink.app", @"TextEdit.app", nil]],
+       "the applications for an extension, sorted");
+  PASS([apps isEqual: [reg applicationsForTypes: [NSSet setWithObject: @"txt"]]],
+       "the same answer twice");
+
+  apps = [reg applicationsForFiles: [NSArray arrayWithObjects: @"/x/a.txt", @"/x/b.rtf", nil]];
+  PASS([apps isEqual: [NSArray arrayWithObject: @"TextEdit.app"]],
+       "a mixed selection gets the applications common to its types");
+  PASS([[reg applicationsForTypes: [NSSet setWithObject: @"text/plain"]]
+          isEqual: [NSArray arrayWithObject: @"Ink.app"]],
+       "MIME types are indexed");
+  PASS([[reg applicationsForTypes: [NSSet setWithObject: @"png"]]
+          isEqual: [NSArray arrayWithObject: @"Viewer.app"]],
+       "the folders in a root are read");
+  PASS([[reg applicationsForTypes: [NSSet setWithObject: @"zzz"]] count] == 0,
+       "nothing for an unknown type");
+
+  PASS([[reg watchedDirectories] isEqual: [NSArray arrayWithObjects: root, utils, nil]],
+       "the root and its folders are to be watched");
+
+  gen = [reg generation];
+  PASS([reg applicationDirectoryDidChange: root] == NO && [reg generation] == gen,
+       "an event that changes nothing keeps the index");
+
+  makeApp(root, @"Notes.app", [NSArray arrayWithObject: @"txt"], nil);
+  PASS([reg applicationDirectoryDidChange: root] && [reg generation] > gen,
+       "a new bundle is seen");
+  PASS([[reg applicationsForTypes: [NSSet setWithObject: @"txt"]] count] == 3,
+       "and the answers are worked out again");
+
+  [fm removeFileAtPath: utils handler: nil];
+  PASS([reg applicationDirectoryDidChange: root]
+         && [[reg applicationsForTypes: [NSSet setWithObject: @"png"]] count] == 0
+         && [[reg watchedDirectories] count] == 1,
+       "a folder that went away is dropped");
+
+  PASS([reg applicationDirectoryDidChange: @"/nowhere"] == NO,
+       "a directory that was not read is ignored");
+
+  [reg release];
+  [fm removeFileAtPath: root handler: nil];
+  [arp release];
+  return 0;
+}
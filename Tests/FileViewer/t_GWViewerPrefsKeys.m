@@ -1,8 +1,8 @@
 /* t_GWViewerPrefsKeys.m — ObjectTesting coverage for the viewer prefs-key
  * derivation.
  *
- * GWViewerPrefsKey is the single source for the NSUserDefaults key a viewer
- * persists its per-folder remainder under.  Browser and spatial windows get
+ * GWViewerPrefsKey is the single source for the key a viewer persists its
+ * per-folder remainder under.  Browser and spatial windows get
  * distinct keys (they store different state shapes); previously both used
  * "viewer_at_<path>" and the last closer clobbered the other.  Pinning the
  * shapes here makes the naming half of viewer identity testable.
@@ -55,6 +55,21 @@ main(void)
              GWViewerPrefsKey(path, NO, nil, NO),
              "legacy spatial key == browser key (documents the old collision)");
 
+  /* --- the keys moved out of the user defaults --- */
+  PASS(GWViewerPrefsIsFolderKey(GWViewerPrefsKey(@"/", NO, nil, YES))
+       && GWViewerPrefsIsFolderKey(GWViewerPrefsKey(@"/", NO, rk, NO))
+       && GWViewerPrefsIsFolderKey(GWViewerPrefsKey(path, NO, nil, NO))
+       && GWViewerPrefsIsFolderKey(GWViewerPrefsKey(path, YES, nil, NO))
+       && GWViewerPrefsIsFolderKey(GWViewerPrefsKey(@"/", YES, rk, NO))
+       && GWViewerPrefsIsFolderKey(GWViewerLegacySharedPrefsKey(@"/", rk)),
+       "every key shape is a folder key");
+  PASS(GWViewerPrefsIsFolderKey(@"viewersinfo") == NO
+       && GWViewerPrefsIsFolderKey(@"browserColsWidth") == NO
+       && GWViewerPrefsIsFolderKey(@"NSWindow Frame viewer_at_/") == NO
+       && GWViewerPrefsIsFolderKey(@"_viewer_at_/") == NO
+       && GWViewerPrefsIsFolderKey(@"x1_viewer_at_/") == NO,
+       "the other defaults keys are not");
+
   [arp release];
   return 0;
 }
@@ -0,0 +1,108 @@
+/* t_GWViewerPrefsStore.m — ObjectTesting coverage for the viewer prefs store.
+ *
+ * The store and DBKit are Foundation-only, so the store is compiled
+ * in-process against libDBKit and runs headless, on a directory in the
+ * temporary directory.  The migration reads a persistent domain of its own
+ * that is removed at the end.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../Workspace/FileViewer/GWViewerPrefsStore.m"
+
+#define MANY_KEYS 500
+
+static NSDictionary *
+prefsOfSize(int size)
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithInt: size], @"iconsize",
+                       @"{{10, 20}, {300, 200}}", @"geometry", nil];
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat: @"t_GWViewerPrefsStore-%d", (int)getpid()]];
+  NSString *domain = [dir lastPathComponent];
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSMutableDictionary *legacy = [NSMutableDictionary dictionary];
+  GWViewerPrefsStore *store;
+  BOOL all;
+  int i;
+
+  store = [[GWViewerPrefsStore alloc] initWithDirectory: dir];
+  PASS(store != nil, "a store is made in a new directory");
+  PASS([store viewerPrefsForKey: @"viewer_at_/tmp"] == nil, "an empty store has no prefs");
+
+  [store setViewerPrefs: prefsOfSize(48) forKey: @"viewer_at_/tmp"];
+  PASS_EQUAL([store viewerPrefsForKey: @"viewer_at_/tmp"], prefsOfSize(48),
+             "pending prefs are read back before they are written");
+  [store flushPendingWrites];
+  [store release];
+
+  store = [[GWViewerPrefsStore alloc] initWithDirectory: dir];
+  PASS_EQUAL([store viewerPrefsForKey: @"viewer_at_/tmp"], prefsOfSize(48),
+             "written prefs are there when the store is opened again");
+
+  for (i = 0; i < MANY_KEYS; i++)
+    [store setViewerPrefs: prefsOfSize(i)
+                   forKey: [NSString stringWithFormat: @"viewer_at_/home/user/dir%d", i]];
+  [store setViewerPrefs: prefsOfSize(64) forKey: @"viewer_at_/tmp"];
+  [store setViewerPrefs: prefsOfSize(1) forKey: @"spatial_at_/tmp"];
+  [store flushPendingWrites];
+  [store setViewerPrefs: nil forKey: @"spatial_at_/tmp"];
+  [store flushPendingWrites];
+  [store release];
+
+  store = [[GWViewerPrefsStore alloc] initWithDirectory: dir];
+  all = YES;
+  for (i = MANY_KEYS - 1; i >= 0; i--)
+    {
+      NSString *key = [NSString stringWithFormat: @"viewer_at_/home/user/dir%d", i];
+
+      if ([[store viewerPrefsForKey: key] isEqual: prefsOfSize(i)] == NO)
+        all = NO;
+    }
+  PASS(all, "each of many keys finds its own prefs");
+  PASS_EQUAL([store viewerPrefsForKey: @"viewer_at_/tmp"], prefsOfSize(64),
+             "prefs written again replace the old ones");
+  PASS([store viewerPrefsForKey: @"spatial_at_/tmp"] == nil, "removed prefs are gone");
+  PASS([store viewerPrefsForKey: @"viewer_at_/home/user"] == nil,
+       "a key that is a prefix of others is not found");
+
+  [legacy setObject: prefsOfSize(32) forKey: @"viewer_at_/home/user/legacy"];
+  [legacy setObject: prefsOfSize(16) forKey: @"42_viewer_at_/"];
+  [legacy setObject: @"stray" forKey: @"spatial_at_/home/user/legacy"];
+  [legacy setObject: @"yes" forKey: @"use_thumbnails"];
+  [defaults setPersistentDomain: legacy forName: domain];
+
+  PASS([store migrateDomain: domain ofUserDefaults: defaults] == 2,
+       "the folder prefs of the domain are migrated");
+  PASS_EQUAL([store viewerPrefsForKey: @"viewer_at_/home/user/legacy"], prefsOfSize(32),
+             "and are found in the store");
+  PASS_EQUAL([store viewerPrefsForKey: @"42_viewer_at_/"], prefsOfSize(16),
+             "those of extra root viewers too");
+  PASS_EQUAL([defaults persistentDomainForName: domain],
+             [NSDictionary dictionaryWithObject: @"yes" forKey: @"use_thumbnails"],
+             "the folder keys leave the domain, the others stay");
+  PASS([store migrateDomain: domain ofUserDefaults: defaults] == 0,
+       "a second migration has nothing to do");
+  [store release];
+
+  store = [[GWViewerPrefsStore alloc] initWithDirectory: dir];
+  PASS_EQUAL([store viewerPrefsForKey: @"viewer_at_/home/user/legacy"], prefsOfSize(32),
+             "migrated prefs are on disk");
+  [store release];
+
+  [defaults removePersistentDomainForName: domain];
+  [fm removeFileAtPath: dir handler: nil];
+  [arp release];
+  return 0;
+}
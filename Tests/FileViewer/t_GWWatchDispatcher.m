@@ -0,0 +1,120 @@
+/* t_GWWatchDispatcher.m — headless coverage for the fswatcher event routing.
+ *
+ * GWWatchDispatcher is Foundation-only, so it is compiled in-process with
+ * no gnustep-gui.  Each recorder counts the events it is sent.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../Workspace/FileViewer/GWWatchDispatcher.m"
+
+@interface Recorder : NSObject
+{
+@public
+  NSUInteger count;
+  GWWatchDispatcher *dispatcher;
+  id victim;
+}
+- (void)event:(NSDictionary *)info;
+@end
+
+@implementation Recorder
+- (void)event:(NSDictionary *)info
+{
+  count++;
+  if (victim)
+    [dispatcher removeObserver: victim];
+}
+@end
+
+static NSDictionary *event(NSString *path, NSString *name)
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         path, @"path", name, @"event", nil];
+}
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  GWWatchDispatcher *d = [GWWatchDispatcher new];
+  Recorder *exact = [Recorder new];
+  Recorder *shelf = [Recorder new];
+  Recorder *tree = [Recorder new];
+  Recorder *other = [Recorder new];
+  NSDictionary *modified = event(@"/home/u/docs", @"GWWatchedFileModified");
+
+  [d addObserver: exact selector: @selector(event:)
+         forPath: @"/home/u/docs" scope: GWWatchPath];
+  [d addObserver: shelf selector: @selector(event:)
+         forPath: @"/home/u/docs/a" scope: GWWatchPathAndAncestors];
+  [d addObserver: tree selector: @selector(event:)
+         forPath: @"/media/" scope: GWWatchSubtree];
+  [d addObserver: other selector: @selector(event:)
+         forPath: @"/tmp" scope: GWWatchPath];
+
+  [d dispatchWatcherInfo: modified];
+  PASS(exact->count == 1, "an event reaches the path registered");
+  PASS(shelf->count == 1, "and the registrations beneath for their ancestors");
+  PASS(tree->count == 0 && other->count == 0, "and nobody else");
+
+  [d dispatchWatcherInfo: event(@"/home/u/docs/b", @"GWWatchedFileModified")];
+  PASS(exact->count == 1 && shelf->count == 1,
+       "an unregistered path beneath reaches no path registration");
+
+  [d dispatchWatcherInfo: event(@"/media/usb/x", @"GWWatchedFileModified")];
+  [d dispatchWatcherInfo: event(@"/media", @"GWFileCreatedInWatchedDirectory")];
+  PASS(tree->count == 2, "a subtree gets the events at its root and beneath");
+  [d dispatchWatcherInfo: event(@"/mediaX", @"GWWatchedFileModified")];
+  PASS(tree->count == 2, "a sibling sharing the prefix is not beneath");
+
+  [d dispatchWatcherInfo: event(@"/home/u", @"GWFileDeletedInWatchedDirectory")];
+  PASS(exact->count == 1 && shelf->count == 2,
+       "only ancestor registrations see other events above them");
+  [d dispatchWatcherInfo: event(@"/home", @"GWWatchedPathDeleted")];
+  PASS(exact->count == 2 && shelf->count == 3,
+       "a deleted directory reaches the paths beneath it");
+
+  /* counted registrations */
+  [d addObserver: exact selector: @selector(event:)
+         forPath: @"/home/u/docs" scope: GWWatchPath];
+  [d removeObserver: exact forPath: @"/home/u/docs" scope: GWWatchPath];
+  [d dispatchWatcherInfo: modified];
+  PASS(exact->count == 3, "a path added twice is kept after one removal");
+  [d removeObserver: exact forPath: @"/home/u/docs" scope: GWWatchPath];
+  [d dispatchWatcherInfo: modified];
+  PASS(exact->count == 3, "and dropped after the second");
+
+  /* one delivery per observer and selector */
+  [d addObserver: tree selector: @selector(event:)
+         forPath: @"/media/u" scope: GWWatchSubtree];
+  [d dispatchWatcherInfo: event(@"/media/u/disk", @"GWWatchedFileModified")];
+  PASS(tree->count == 3, "overlapping registrations deliver once");
+
+  /* removal while dispatching */
+  [d addObserver: other selector: @selector(event:)
+         forPath: @"/media/u/disk" scope: GWWatchPath];
+  tree->dispatcher = d;
+  tree->victim = other;
+  [d dispatchWatcherInfo: event(@"/media/u/disk", @"GWWatchedFileModified")];
+  PASS(other->count == 0, "an observer removed meanwhile gets nothing");
+  tree->victim = nil;
+
+  [d removeObserver: tree];
+  [d removeObserver: shelf];
+  [d dispatchWatcherInfo: event(@"/media/u/disk", @"GWWatchedFileModified")];
+  [d dispatchWatcherInfo: modified];
+  PASS(tree->count == 4 && shelf->count == 5,
+       "removing an observer drops all its registrations");
+
+  [exact release];
+  [shelf release];
+  [tree release];
+  [other release];
+  [d release];
+  [arp release];
+  return 0;
+}
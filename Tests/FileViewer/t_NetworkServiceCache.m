@@ -0,0 +1,94 @@
+/* t_NetworkServiceCache.m — headless coverage for the cache of resolved
+ * mDNS service records.
+ *
+ * NetworkServiceCache is Foundation-only, so it is compiled in-process.
+ * The cache is written to a temporary file and read back.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "../../Workspace/Network/NetworkServiceCache.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *file = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_NetworkServiceCache-%d.plist",
+                                [[NSProcessInfo processInfo] processIdentifier]]];
+  NSDate *now = [NSDate date];
+  NSData *addr = [NSData dataWithBytes: "\x02\x00\x00\x16\xc0\xa8\x01\x02" length: 8];
+  NSData *txt = [NSData dataWithBytes: "\x06u=user" length: 7];
+  NSDictionary *record;
+  NSDictionary *old;
+  NetworkServiceCache *cache;
+
+  [[NSFileManager defaultManager] removeItemAtPath: file error: NULL];
+
+  record = [NetworkServiceCache recordWithHostName: @"nas.local."
+                                              port: 22
+                                         addresses: [NSArray arrayWithObject: addr]
+                                     TXTRecordData: txt
+                                              date: now
+                                               ttl: NETWORK_SERVICE_RECORD_TTL];
+  PASS([NetworkServiceCache isRecordFresh: record atDate: now],
+       "a record is fresh when it is resolved");
+  PASS([NetworkServiceCache isRecordFresh: record
+                                   atDate: [now dateByAddingTimeInterval: 119]],
+       "and within its TTL");
+  PASS(![NetworkServiceCache isRecordFresh: record
+                                    atDate: [now dateByAddingTimeInterval: 120]],
+       "not after it");
+  PASS(![NetworkServiceCache isRecordFresh: record
+                                    atDate: [now dateByAddingTimeInterval: -60]],
+       "nor before it was resolved");
+  PASS(![NetworkServiceCache isRecordFresh: nil atDate: now],
+       "no record is not fresh");
+
+  old = [NetworkServiceCache recordWithHostName: @"old.local."
+                                           port: 80
+                                      addresses: nil
+                                  TXTRecordData: nil
+                                           date: [now dateByAddingTimeInterval:
+                                                        -NETWORK_SERVICE_RECORD_KEEP - 60]
+                                            ttl: NETWORK_SERVICE_RECORD_TTL];
+
+  cache = [[NetworkServiceCache alloc] initWithPath: file];
+  PASS([cache recordForIdentifier: @"nas._sftp-ssh._tcp.local."] == nil,
+       "a new cache is empty");
+  [cache setRecord: record forIdentifier: @"nas._sftp-ssh._tcp.local."];
+  [cache setRecord: old forIdentifier: @"old._webdav._tcp.local."];
+  PASS([cache synchronize], "the records are written");
+  [cache release];
+
+  cache = [[NetworkServiceCache alloc] initWithPath: file];
+  record = [cache recordForIdentifier: @"nas._sftp-ssh._tcp.local."];
+  PASS_EQUAL([record objectForKey: NetworkServiceRecordHostName], @"nas.local.",
+             "the host name is read back");
+  PASS([[record objectForKey: NetworkServiceRecordPort] intValue] == 22,
+       "the port");
+  PASS_EQUAL([record objectForKey: NetworkServiceRecordAddresses],
+             [NSArray arrayWithObject: addr], "the addresses");
+  PASS_EQUAL([record objectForKey: NetworkServiceRecordTXTData], txt,
+             "the TXT record");
+  PASS([NetworkServiceCache isRecordFresh: record atDate: now],
+       "and the record is as fresh as it was");
+  PASS([cache recordForIdentifier: @"old._webdav._tcp.local."] == nil,
+       "a record resolved more than a week ago is dropped");
+
+  [cache removeRecordForIdentifier: @"nas._sftp-ssh._tcp.local."];
+  PASS([cache synchronize], "a removal is written");
+  [cache release];
+
+  cache = [[NetworkServiceCache alloc] initWithPath: file];
+  PASS([cache recordForIdentifier: @"nas._sftp-ssh._tcp.local."] == nil,
+       "and stays removed");
+  [cache release];
+
+  [[NSFileManager defaultManager] removeItemAtPath: file error: NULL];
+  [arp release];
+  return 0;
+}
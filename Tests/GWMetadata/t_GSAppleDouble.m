@@ -82,6 +82,60 @@ main(void)
          "overflow descriptor is skipped, not read out of bounds");
   }
 
+  /* --- Entries are views into the blob, made when asked for --- */
+  {
+    uint8_t fi[32] = {0};
+    NSMutableData *rsrc = [NSMutableData dataWithLength: 100000];
+    fi[0] = 'A'; fi[1] = 'P'; fi[2] = 'P'; fi[3] = 'L';
+    ((uint8_t *)[rsrc mutableBytes])[99999] = 0x7f;
+
+    GSAppleDouble *ad = [[[GSAppleDouble alloc] init] autorelease];
+    [ad setFinderInfo: [NSData dataWithBytes: fi length: 32]];
+    [ad setResourceFork: rsrc];
+    NSData *blob = [NSData dataWithData: [ad appleDoubleData]];
+    const uint8_t *start = [blob bytes];
+    const uint8_t *end = start + [blob length];
+
+    NSData *quick = [GSAppleDouble finderInfoFromAppleDoubleData: blob];
+    PASS_EQUAL(quick, [NSData dataWithBytes: fi length: 32],
+               "finderInfoFromAppleDoubleData: finds the FinderInfo");
+    PASS((const uint8_t *)[quick bytes] >= start
+         && (const uint8_t *)[quick bytes] < end,
+         "finderInfoFromAppleDoubleData: does not copy it");
+
+    NSData *fork;
+    GSAppleDouble *copy;
+    {
+      NSAutoreleasePool *pool = [NSAutoreleasePool new];
+      GSAppleDouble *rd = [[GSAppleDouble alloc] initWithData: blob];
+      fork = [[rd resourceFork] retain];
+      copy = [rd copy];
+      [rd release];
+      [pool release];
+    }
+    PASS((const uint8_t *)[fork bytes] >= start
+         && (const uint8_t *)[fork bytes] < end,
+         "the resource fork is a view into the blob");
+    PASS_EQUAL(fork, rsrc, "and outlives the parser");
+    PASS_EQUAL([copy finderInfo], [NSData dataWithBytes: fi length: 32],
+               "a copy reads the entries its original had not");
+    PASS_EQUAL([copy appleDoubleData], blob, "and serializes them again");
+    [fork release];
+    [copy release];
+
+    NSString *file = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                       [NSString stringWithFormat: @"t_gsappledouble_%d",
+                                 [[NSProcessInfo processInfo] processIdentifier]]];
+    [blob writeToFile: file atomically: NO];
+    GSAppleDouble *mapped = [[[GSAppleDouble alloc] initWithContentsOfFile: file]
+                              autorelease];
+    PASS_EQUAL([mapped resourceFork], rsrc,
+               "initWithContentsOfFile: reads a mapped sidecar");
+    [[NSFileManager defaultManager] removeFileAtPath: file handler: nil];
+    PASS([[GSAppleDouble alloc] initWithContentsOfFile: file] == nil,
+         "initWithContentsOfFile: -> nil for a missing file");
+  }
+
   [arp release];
   return 0;
 }
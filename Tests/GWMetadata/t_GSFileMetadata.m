@@ -116,6 +116,41 @@ main(void)
     [fm removeFileAtPath: path handler: nil];
   }
 
+  /* --- folder prefetch fills the cache, positive and negative --- */
+  {
+    NSString *dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                      [NSString stringWithFormat: @"t_gsfm_dir_%d", (int)getpid()]];
+    NSString *tagged = [dir stringByAppendingPathComponent: @"tagged.txt"];
+    NSString *plain = [dir stringByAppendingPathComponent: @"plain.txt"];
+
+    [fm removeFileAtPath: dir handler: nil];
+    [fm createDirectoryAtPath: dir attributes: nil];
+    [fm createFileAtPath: tagged contents: [NSData data] attributes: nil];
+    [fm createFileAtPath: plain contents: [NSData data] attributes: nil];
+
+    GSFileMetadata *md = [[[GSFileMetadata alloc] init] autorelease];
+    [md setLabelNumber: 2];
+    [md setForceSidecar: YES];
+    [md writeToFileAtPath: tagged error: NULL];
+
+    [GSFileMetadata invalidateAllCachedMetadata];
+    [GSFileMetadata prefetchMetadataForDirectory: dir];
+
+    GSFileMetadata *rd = [GSFileMetadata metadataForFileAtPath: tagged];
+    PASS(rd != nil && [rd labelNumber] == 2,
+         "prefetch reads a file's ._ sidecar metadata");
+    PASS([GSFileMetadata metadataForFileAtPath: plain] == nil,
+         "prefetch caches files without metadata as none");
+
+    [md setLabelNumber: 5];
+    [md writeToFileAtPath: tagged error: NULL];
+    rd = [GSFileMetadata metadataForFileAtPath: tagged];
+    PASS(rd != nil && [rd labelNumber] == 5,
+         "writing metadata invalidates the cached entry");
+
+    [fm removeFileAtPath: dir handler: nil];
+  }
+
   /* --- AppleDouble encode/decode preserves fdLocation --- */
   {
     GSFileMetadata *md = [[[GSFileMetadata alloc] init] autorelease];
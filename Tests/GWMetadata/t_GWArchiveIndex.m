@@ -0,0 +1,87 @@
+/* t_GWArchiveIndex.m — headless coverage for the naming rules of browsed
+ * archives.
+ *
+ * The tree standing in for an archive must never hold a name outside it,
+ * must not take edits, and its cache key must change when the archive
+ * does.  Foundation and
+ * libarchive only, compiled in-process.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "Testing.h"
+
+#include "GWArchiveIndex.m"
+
+int
+main(void)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *tmp = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                     [NSString stringWithFormat: @"t_GWArchiveIndex-%d", getpid()]];
+  NSString *key;
+
+  PASS_EQUAL([GWArchiveIndex browsedNameForEntryName: @"dir/file.txt"],
+             @"dir/file.txt", "a plain name is kept");
+  PASS_EQUAL([GWArchiveIndex browsedNameForEntryName: @"./dir//file.txt"],
+             @"dir/file.txt", "empty and . components are dropped");
+  PASS_EQUAL([GWArchiveIndex browsedNameForEntryName: @"/etc/passwd"],
+             @"etc/passwd", "an absolute name is made relative");
+  PASS([GWArchiveIndex browsedNameForEntryName: @"../x"] == nil
+       && [GWArchiveIndex browsedNameForEntryName: @"a/../../x"] == nil,
+       "a name climbing out of the tree is not shown");
+  PASS([GWArchiveIndex browsedNameForEntryName: @"__MACOSX/._a"] == nil
+       && [GWArchiveIndex browsedNameForEntryName: @"d/._a"] == nil
+       && [GWArchiveIndex browsedNameForEntryName: @"./"] == nil,
+       "nor metadata, nor an empty name");
+
+  PASS([GWArchiveIndex canBrowseArchiveAtPath: @"/a/b.zip"]
+       && [GWArchiveIndex canBrowseArchiveAtPath: @"/a/b.tar.gz"]
+       && [GWArchiveIndex canBrowseArchiveAtPath: @"/a/b.TGZ"]
+       && [GWArchiveIndex canBrowseArchiveAtPath: @"/a/b.tar.zst"],
+       "archives holding files are browsed");
+  PASS([GWArchiveIndex canBrowseArchiveAtPath: @"/a/notes.txt.gz"] == NO
+       && [GWArchiveIndex canBrowseArchiveAtPath: @"/a/b.iso"] == NO,
+       "a compressed single file is not");
+
+  PASS([GWArchiveIndex cacheKeyForArchiveAtPath: @"/nonexistent/x.zip"] == nil,
+       "a missing archive has no key");
+
+  [[NSFileManager defaultManager] createDirectoryAtPath: tmp
+                            withIntermediateDirectories: YES
+                                             attributes: nil
+                                                  error: NULL];
+  tmp = [tmp stringByAppendingPathComponent: @"a.tar"];
+  [[NSData dataWithBytes: "abc" length: 3] writeToFile: tmp atomically: NO];
+  key = [GWArchiveIndex cacheKeyForArchiveAtPath: tmp];
+  PASS(key != nil && [[key componentsSeparatedByString: @"-"] count] == 4,
+       "the key has device, inode, size and time");
+  [[NSData dataWithBytes: "abcd" length: 4] writeToFile: tmp atomically: NO];
+  PASS([key isEqual: [GWArchiveIndex cacheKeyForArchiveAtPath: tmp]] == NO,
+       "and changes with the archive");
+
+  {
+    NSString *tree = [[tmp stringByDeletingLastPathComponent]
+                       stringByAppendingPathComponent: @"tree"];
+    NSString *sub = [tree stringByAppendingPathComponent: @"sub"];
+    struct stat st;
+
+    [[NSFileManager defaultManager] createDirectoryAtPath: sub
+                              withIntermediateDirectories: YES
+                                               attributes: nil
+                                                    error: NULL];
+    set_tree_writable(tree, NO);
+    PASS(stat([sub fileSystemRepresentation], &st) == 0
+         && (st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) == 0,
+         "the stand-in tree is made read-only");
+    remove_cache_dir(tree);
+    PASS(lstat([tree fileSystemRepresentation], &st) != 0,
+         "and can still be removed");
+  }
+
+  [[NSFileManager defaultManager] removeFileAtPath:
+    [tmp stringByDeletingLastPathComponent] handler: nil];
+  [arp release];
+  return 0;
+}
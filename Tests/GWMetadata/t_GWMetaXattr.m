@@ -15,10 +15,30 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 /* Bring the implementation in directly — it depends only on libc. */
 #include "GWMetaXattr.m"
 
+static int
+skipSecond(const char *name, void *context)
+{
+  return strcmp(name, "second") != 0;
+}
+
+static void
+countEntries(const char *name, const gs_xattr_list_t *list, int err, void *context)
+{
+  int *seen = context;
+
+  if (strcmp(name, "first") == 0 && list && list->count == 1)
+    seen[0]++;
+  else if (strcmp(name, "second") == 0)
+    seen[1]++;
+  else if (strcmp(name, "third") == 0 && list && list->count == 0)
+    seen[2]++;
+}
+
 int
 main(void)
 {
@@ -78,6 +98,56 @@ main(void)
       free(list);
       PASS(found, "gs_listxattr() includes the attribute name");
 
+      gs_setxattr(cpath, "user.other", "x", 1, 0);
+      gs_xattr_list_t *xl = gs_xattr_list_for_path(cpath, "user.com.apple.");
+      const gs_xattr_entry_t *entry = gs_xattr_list_find(xl, name);
+      PASS(xl && xl->count == 1 && entry && entry->size == sizeof(value)
+           && memcmp(entry->value, value, sizeof(value)) == 0,
+           "gs_xattr_list_for_path() reads the attributes under a prefix");
+      PASS(gs_xattr_list_find(xl, "user.other") == NULL,
+           "gs_xattr_list_find() misses a name outside the list");
+      gs_xattr_list_free(xl);
+
+      int fd = open(cpath, O_RDONLY);
+      xl = gs_xattr_list_for_fd(fd, NULL);
+      PASS(xl && gs_xattr_list_find(xl, name) && gs_xattr_list_find(xl, "user.other"),
+           "gs_xattr_list_for_fd() reads them from a descriptor");
+      gs_xattr_list_free(xl);
+      close(fd);
+      gs_removexattr(cpath, "user.other");
+
+      /* past the stack buffer, where the filesystem allows it */
+      unsigned char big[GS_XATTR_SCRATCH_SIZE * 2];
+      memset(big, 0x5a, sizeof(big));
+      if (gs_setxattr(cpath, "user.com.apple.Big", big, sizeof(big), 0) == 0)
+        {
+          xl = gs_xattr_list_for_path(cpath, "user.com.apple.");
+          entry = gs_xattr_list_find(xl, "user.com.apple.Big");
+          PASS(entry && entry->size == sizeof(big)
+               && memcmp(entry->value, big, sizeof(big)) == 0,
+               "a value larger than the stack buffer is read whole");
+          gs_xattr_list_free(xl);
+          gs_removexattr(cpath, "user.com.apple.Big");
+        }
+
+      NSString *dir = [path stringByAppendingString: @".d"];
+      int seen[3] = { 0, 0, 0 };
+      [fm createDirectoryAtPath: dir withIntermediateDirectories: YES
+                     attributes: nil error: NULL];
+      [fm createFileAtPath: [dir stringByAppendingPathComponent: @"first"]
+                  contents: [NSData data] attributes: nil];
+      [fm createFileAtPath: [dir stringByAppendingPathComponent: @"second"]
+                  contents: [NSData data] attributes: nil];
+      [fm createFileAtPath: [dir stringByAppendingPathComponent: @"third"]
+                  contents: [NSData data] attributes: nil];
+      gs_setxattr([[dir stringByAppendingPathComponent: @"first"] fileSystemRepresentation],
+                  name, value, sizeof(value), 0);
+      PASS(gs_xattr_list_directory([dir fileSystemRepresentation], "user.com.apple.",
+                                   skipSecond, countEntries, seen) == 0
+           && seen[0] == 1 && seen[1] == 0 && seen[2] == 1,
+           "gs_xattr_list_directory() reads each entry the filter lets through");
+      [fm removeFileAtPath: dir handler: nil];
+
       PASS(gs_removexattr(cpath, name) == 0, "gs_removexattr() succeeds");
 
       errno = 0;
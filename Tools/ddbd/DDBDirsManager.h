@@ -55,6 +55,10 @@
 - (void)removeDirsFromPaths:(NSArray *)paths;
 
 - (NSArray *)dirsFromPath:(NSString *)path;
+
+- (NSArray *)dirsFromPath:(NSString *)path
+                    after:(NSString *)last
+                 maxCount:(NSUInteger)max;
                                                                
 @end
 
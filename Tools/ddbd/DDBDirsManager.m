@@ -23,6 +23,8 @@
  */
 
 #include "DBKBTreeNode.h"
+#include "DBKBTreeCursor.h"
+#include "DBKKeyCodec.h"
 #include "DBKVarLenRecordsFile.h"
 #include "DDBDirsManager.h"
 #include "ddbd.h"
@@ -57,6 +59,11 @@
     path = [bpath stringByAppendingPathComponent: @"directories.index"];
     tree = [[DBKBTree alloc] initWithPath: path order: 16 delegate: self];
 
+    /* updates are logged and reach the disk at -synchronize */
+    [vlfile setWriteAheadLog: YES];
+    [vlfile setAutoflush: NO];
+    [tree setWriteAheadLog: YES];
+
     ASSIGN (dummyOffsets[0], [NSNumber numberWithUnsignedLong: 1L]);
     ASSIGN (dummyOffsets[1], [NSNumber numberWithUnsignedLong: 2L]);
   
@@ -184,11 +191,24 @@
 }
 
 - (NSArray *)dirsFromPath:(NSString *)path
+{
+  return [self dirsFromPath: path after: nil maxCount: 0];
+}
+
+/*
+ * The directories under path that sort after last, at most max of them
+ * when max is not 0.  The cursor is sought again at each call, so the
+ * tree can change between two of them.
+ */
+- (NSArray *)dirsFromPath:(NSString *)path
+                    after:(NSString *)last
+                 maxCount:(NSUInteger)max
 {
   CREATE_AUTORELEASE_POOL(pool);
   NSMutableArray *paths = [NSMutableArray array];
   NSMutableArray *toremove = [NSMutableArray array];
-  NSArray *keys = nil;
+  DBKBTreeCursor *cursor;
+  NSNumber *offset;
   NSUInteger i;
 
   [tree begin];
@@ -201,29 +221,47 @@
     ASSIGN (dummyPaths[1], @"0");
   }
 
-  keys = [tree keysGreaterThenKey: dummyOffsets[0] 
-                 andLesserThenKey: dummyOffsets[1]];
+  if (last) {
+    ASSIGN (dummyPaths[0], last);
+  }
 
-  [tree end];
-  
-  if (keys) {
-    for (i = 0; i < [keys count]; i++) {
-      CREATE_AUTORELEASE_POOL(arp);
-      NSData *data = [vlfile dataAtOffset: [keys objectAtIndex: i]];
-      NSString *path = [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding];
-      BOOL isdir;
-
-      if ([fm fileExistsAtPath: path isDirectory: &isdir] &&isdir) {
-        [paths addObject: path];
-      } else {
-        [toremove addObject: path];
-      }
+  /* each directory is read as the cursor reaches it */
+  cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+  offset = [cursor seekToKey: dummyOffsets[0]];
+
+  if (offset && ([self compareNodeKey: offset withKey: dummyOffsets[0]] == NSOrderedSame)) {
+    offset = [cursor nextKey];
+  }
 
-      RELEASE (path);
+  while (offset && ((max == 0) || ([paths count] < max))) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSData *data;
+    NSString *dir;
+    BOOL isdir;
+
+    if ([self compareNodeKey: offset withKey: dummyOffsets[1]] != NSOrderedAscending) {
       RELEASE(arp);
-    }  
+      break;
+    }
+
+    data = [vlfile dataAtOffset: offset];
+    dir = [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding];
+
+    if ([fm fileExistsAtPath: dir isDirectory: &isdir] &&isdir) {
+      [paths addObject: dir];
+    } else {
+      [toremove addObject: dir];
+    }
+
+    RELEASE (dir);
+    offset = RETAIN ([cursor nextKey]);
+    RELEASE(arp);
+    AUTORELEASE (offset);
   }
 
+  RELEASE (cursor);
+  [tree end];
+
   for (i = 0; i < [toremove count]; i++) {
     [self removeDirectory: [toremove objectAtIndex: i]];
   }
@@ -247,43 +285,12 @@
 - (NSArray *)keysFromData:(NSData *)data
                withLength:(unsigned *)dlen
 {
-  NSMutableArray *keys = [NSMutableArray array];
-  NSRange range;
-  unsigned kcount;
-  unsigned long key;
-  unsigned i;
-  
-  range = NSMakeRange(0, sizeof(unsigned));
-  [data getBytes: &kcount range: range];
-  range.location += sizeof(unsigned);
-  
-  range.length = sizeof(unsigned long);
-
-  for (i = 0; i < kcount; i++) {
-    [data getBytes: &key range: range];
-    [keys addObject: [NSNumber numberWithUnsignedLong: key]];
-    range.location += sizeof(unsigned long);
-  }
-  
-  *dlen = range.location;
-  
-  return keys;
+  return [[DBKOffsetKeyCodec sharedCodec] keysFromData: data withLength: dlen];
 }
 
 - (NSData *)dataFromKeys:(NSArray *)keys
 {
-  NSMutableData *data = [NSMutableData dataWithCapacity: 1];
-  NSUInteger kcount = [keys count];
-  NSUInteger i;
-  
-  [data appendData: [NSData dataWithBytes: &kcount length: sizeof(unsigned)]];
-    
-  for (i = 0; i < kcount; i++) {
-    unsigned long kl = [[keys objectAtIndex: i] unsignedLongValue];
-    [data appendData: [NSData dataWithBytes: &kl length: sizeof(unsigned long)]];
-  }
-  
-  return data;  
+  return [[DBKOffsetKeyCodec sharedCodec] dataFromKeys: keys];
 }
 
 - (NSComparisonResult)compareNodeKey:(id)akey 
@@ -36,11 +36,16 @@
   DDBMDStorage *mdstorage;
   DBKBTree *tree;
   DBKVarLenRecordsFile *vlfile;
+  DBKVarLenRecordsFile *mdfile;
+  BOOL needsSync;
    
   DDBPath *dummyPaths[2];
   NSNumber *dummyOffsets[2];
   
   NSMutableDictionary *mdmodules;
+
+  NSMutableDictionary *annotationsCache;
+  NSMutableArray *annotationsCacheOrder;   /* LRU, most recent last */
      
   unsigned ulen;
   unsigned llen;
@@ -52,6 +57,10 @@
 
 - (void)synchronize;
 
+- (void)setNeedsSynchronize;
+
+- (void)synchronizeIfNeeded;
+
 - (DDBPath *)ddbpathForPath:(NSString *)path;
                 
 - (DDBPath *)addPath:(NSString *)path;
@@ -67,10 +76,21 @@
 
 - (NSArray *)metadataForPath:(NSString *)apath;
 
+- (NSString *)annotationsForPath:(NSString *)path;
+
+- (NSDictionary *)annotationsForPaths:(NSArray *)paths;
+
 - (NSTimeInterval)timestampOfPath:(NSString *)path;
 
 - (void)metadataDidChangeForPath:(DDBPath *)ddbpath;
 
+- (NSDictionary *)metadataRecordOfPath:(DDBPath *)ddbpath;
+
+- (void)setMetadataRecord:(NSDictionary *)record
+                  forPath:(DDBPath *)ddbpath;
+
+- (void)migrateLegacyMetadataAtPath:(NSString *)path;
+
 - (void)duplicateDataOfPath:(NSString *)srcpath
                     forPath:(NSString *)dstpath;
 
@@ -88,6 +108,7 @@
 {
   NSString *path;
   NSString *mdpath;
+  NSNumber *mdoffset;
   NSTimeInterval timestamp;
 }
 
@@ -105,6 +126,10 @@
 
 - (NSString *)mdpath;
 
+- (void)setMDOffset:(NSNumber *)offset;
+
+- (NSNumber *)mdoffset;
+
 - (void)setTimestamp:(NSTimeInterval)stamp;
 
 - (NSTimeInterval)timestamp;
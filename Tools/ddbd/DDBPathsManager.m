@@ -23,24 +23,41 @@
  */
 
 #import "DBKBTreeNode.h"
+#import "DBKBTreeCursor.h"
+#import "DBKKeyCodec.h"
 #import "DBKVarLenRecordsFile.h"
 #import "DDBPathsManager.h"
 #import "DDBMDStorage.h"
 #import "MDModulesProtocol.h"
 #import "ddbd.h"
 
+/* paths whose annotations are kept in memory */
+#define ANNOTATIONS_CACHE_SIZE 1024
+
+@interface DDBPathsManager (Private)
+
+- (void)writePath:(DDBPath *)ddbpath;
+
+- (void)forgetAnnotationsOfPath:(NSString *)path;
+
+@end
+
+
 @implementation	DDBPathsManager
 
 - (void)dealloc
 {
-  RELEASE (mdstorage);
+  TEST_RELEASE (mdstorage);
   RELEASE (vlfile);
+  RELEASE (mdfile);
   RELEASE (tree);
   RELEASE (dummyPaths[0]);
   RELEASE (dummyPaths[1]);
   RELEASE (dummyOffsets[0]);
   RELEASE (dummyOffsets[1]);
   RELEASE (mdmodules);
+  RELEASE (annotationsCache);
+  RELEASE (annotationsCacheOrder);
       
   [super dealloc];
 }
@@ -66,10 +83,19 @@
     path = [bpath stringByAppendingPathComponent: @"paths.index"];
     tree = [[DBKBTree alloc] initWithPath: path order: 16 delegate: self];
 
-    path = [bpath stringByAppendingPathComponent: @"docs"];
-    mdstorage = [[DDBMDStorage alloc] initWithPath: path 
-                                        levelCount: 100 
-                                         dirsDepth: 3];
+    /* updates are logged and reach the disk at -synchronize */
+    [vlfile setWriteAheadLog: YES];
+    [vlfile setAutoflush: NO];
+    [tree setWriteAheadLog: YES];
+
+    /* the metadata of all the paths, a record each */
+    path = [bpath stringByAppendingPathComponent: @"metadata"];
+    mdfile = [[DBKVarLenRecordsFile alloc] initWithPath: path cacheLength: 10];
+    [mdfile setWriteAheadLog: YES];
+    [mdfile setAutoflush: NO];
+
+    mdstorage = nil;
+    needsSync = NO;
 
     ASSIGN (dummyOffsets[0], [NSNumber numberWithUnsignedLong: 1L]);
     ASSIGN (dummyOffsets[1], [NSNumber numberWithUnsignedLong: 2L]);
@@ -77,6 +103,9 @@
     fm = [NSFileManager defaultManager];
     
     mdmodules = [NSMutableDictionary new];
+
+    annotationsCache = [NSMutableDictionary new];
+    annotationsCacheOrder = [NSMutableArray new];
     
     enumerator = [NSSearchPathForDirectoriesInDomains
       (NSLibraryDirectory, NSAllDomainsMask, YES) objectEnumerator];
@@ -114,6 +143,13 @@
     
     [self addPath: pathsep()];
     [self synchronize];
+
+    /* the file per path of the older versions */
+    path = [bpath stringByAppendingPathComponent: @"docs"];
+
+    if ([fm fileExistsAtPath: path]) {
+      [self migrateLegacyMetadataAtPath: path];
+    }
   }
 
   return self;
@@ -121,8 +157,27 @@
 
 - (void)synchronize
 {
+  /* a path never refers to a record that is not on disk */
+  [mdfile flush];
   [vlfile flush];
   [tree synchronize];
+  needsSync = NO;
+}
+
+/*
+ * The changes reach the disk together at the next -synchronizeIfNeeded,
+ * instead of one flush each.
+ */
+- (void)setNeedsSynchronize
+{
+  needsSync = YES;
+}
+
+- (void)synchronizeIfNeeded
+{
+  if (needsSync) {
+    [self synchronize];
+  }
 }
 
 - (DDBPath *)ddbpathForPath:(NSString *)path
@@ -170,19 +225,17 @@
   node = [tree insertKey: dummyOffsets[0]];
 
   if (node) {
-    NSString *mdpath = [mdstorage nextEntry];
     NSTimeInterval stamp = [[NSDate date] timeIntervalSinceReferenceDate];
     NSData *data;
     NSNumber *offset;
 
-    [dummyPaths[0] setMDPath: mdpath];
     [dummyPaths[0] setTimestamp: stamp];
 
     data = [NSArchiver archivedDataWithRootObject: dummyPaths[0]];
     offset = [vlfile writeData: data];
 
     [node replaceKey: dummyOffsets[0] withKey: offset];
-    [self synchronize];
+    [self setNeedsSynchronize];
     
     ddbpath = dummyPaths[0];
     RETAIN (ddbpath);
@@ -219,7 +272,13 @@
     RETAIN (offset);
     [tree deleteKey: offset];
     [vlfile deleteDataAtOffset: offset]; 
-    [mdstorage removeEntry: mdpath]; 
+
+    if ([ddbpath mdoffset]) {
+      [mdfile deleteDataAtOffset: [ddbpath mdoffset]];
+    }
+    if (mdpath && mdstorage) {
+      [mdstorage removeEntry: mdpath]; 
+    }
     RELEASE (offset);
   }
   
@@ -229,7 +288,7 @@
   
   RELEASE (arp);  
   
-  [self synchronize];
+  [self setNeedsSynchronize];
 }
 
 - (void)setMetadata:(id)mdata
@@ -238,17 +297,21 @@
 {
   CREATE_AUTORELEASE_POOL(arp);
   DDBPath *ddbpath = [self ddbpathForPath: apath];
-  NSString *path = [mdstorage basePath];
-  id module = [self mdmoduleForMDType: mdtype];
+  NSMutableDictionary *record = [NSMutableDictionary dictionary];
   
   if (ddbpath == nil) {
     ddbpath = [self addPath: apath];
   } 
 
-  path = [path stringByAppendingPathComponent: [ddbpath mdpath]];
-  
-  [module saveData: mdata withBasePath: path];
+  [record addEntriesFromDictionary: [self metadataRecordOfPath: ddbpath]];
+
+  if (mdata) {
+    [record setObject: mdata forKey: mdtype];
+  } else {
+    [record removeObjectForKey: mdtype];
+  }
   
+  [self setMetadataRecord: record forPath: ddbpath];
   [self metadataDidChangeForPath: ddbpath];
 
   if ([apath isEqual: pathsep()] == NO) {
@@ -274,17 +337,12 @@
              forPath:(NSString *)apath
 {
   DDBPath *ddbpath = [self ddbpathForPath: apath];
-  id mddata = nil;
   
   if (ddbpath) {
-    id module = [self mdmoduleForMDType: mdtype];
-    NSString *path = [mdstorage basePath];
-    
-    path = [path stringByAppendingPathComponent: [ddbpath mdpath]];
-    mddata = [module dataWithBasePath: path];
+    return [[self metadataRecordOfPath: ddbpath] objectForKey: mdtype];
   }
   
-  return mddata;
+  return nil;
 }
 
 - (NSArray *)metadataForPath:(NSString *)apath
@@ -292,11 +350,13 @@
   CREATE_AUTORELEASE_POOL(arp);
   NSMutableArray *alldata = [NSMutableArray array];
   NSArray *types = [mdmodules allKeys];
+  DDBPath *ddbpath = [self ddbpathForPath: apath];
+  NSDictionary *record = (ddbpath ? [self metadataRecordOfPath: ddbpath] : nil);
   NSUInteger i;
 
   for (i = 0; i < [types count]; i++) {
     NSString *type = [types objectAtIndex: i];
-    id data = [self metadataOfType: type forPath: apath];
+    id data = [record objectForKey: type];
 
     if (data) {
       NSDictionary *dict;
@@ -312,6 +372,77 @@
   return [alldata autorelease];
 }
 
+/*
+ * The annotations of a recently asked path are taken from the cache
+ * while the timestamp of the path is the one they were read with:
+ * any change of its metadata, and its removal, give it a new one.
+ */
+- (NSString *)annotationsForPath:(NSString *)path
+{
+  DDBPath *ddbpath = [self ddbpathForPath: path];
+  NSDictionary *entry = [annotationsCache objectForKey: path];
+  NSTimeInterval stamp;
+  id annotations;
+
+  if (ddbpath == nil) {
+    [self forgetAnnotationsOfPath: path];
+    return nil;
+  }
+
+  stamp = [ddbpath timestamp];
+
+  if (entry && ([[entry objectForKey: @"stamp"] doubleValue] == stamp)) {
+    annotations = [entry objectForKey: @"annotations"];
+
+    [annotationsCacheOrder removeObject: path];
+    [annotationsCacheOrder addObject: path];
+
+    return ((annotations == [NSNull null]) ? nil : annotations);
+  }
+
+  annotations = [[self metadataRecordOfPath: ddbpath] 
+                              objectForKey: @"GSMDItemFinderComment"];
+
+  [annotationsCacheOrder removeObject: path];
+
+  while ([annotationsCacheOrder count] >= ANNOTATIONS_CACHE_SIZE) {
+    [annotationsCache removeObjectForKey: [annotationsCacheOrder objectAtIndex: 0]];
+    [annotationsCacheOrder removeObjectAtIndex: 0];
+  }
+
+  entry = [NSDictionary dictionaryWithObjectsAndKeys: 
+                                (annotations ? annotations : [NSNull null]), @"annotations",
+                                [NSNumber numberWithDouble: stamp], @"stamp",
+                                nil];
+  [annotationsCache setObject: entry forKey: path];
+  [annotationsCacheOrder addObject: path];
+
+  return annotations;
+}
+
+/*
+ * The annotations of the paths that have some, by path.
+ */
+- (NSDictionary *)annotationsForPaths:(NSArray *)paths
+{
+  NSMutableDictionary *annotations = [NSMutableDictionary dictionary];
+  NSUInteger i;
+
+  for (i = 0; i < [paths count]; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSString *path = [paths objectAtIndex: i];
+    NSString *str = [self annotationsForPath: path];
+
+    if (str) {
+      [annotations setObject: str forKey: path];
+    }
+
+    RELEASE (arp);
+  }
+
+  return annotations;
+}
+
 - (NSTimeInterval)timestampOfPath:(NSString *)path
 {
   DDBPath *ddbpath = [self ddbpathForPath: path];
@@ -324,6 +455,12 @@
 }
 
 - (void)metadataDidChangeForPath:(DDBPath *)ddbpath
+{
+  [ddbpath setTimestamp: [[NSDate date] timeIntervalSinceReferenceDate]];
+  [self writePath: ddbpath];
+}
+
+- (void)writePath:(DDBPath *)ddbpath
 {
   CREATE_AUTORELEASE_POOL(arp);
   DBKBTreeNode *node; 
@@ -337,20 +474,165 @@
 
   if (exists) {
     NSNumber *offset = [node keyAtIndex: index];
-    NSTimeInterval stamp = [[NSDate date] timeIntervalSinceReferenceDate];
-    NSData *data;
+    NSData *data = [NSArchiver archivedDataWithRootObject: ddbpath];
 
-    [ddbpath setTimestamp: stamp];
-    data = [NSArchiver archivedDataWithRootObject: ddbpath];
-    [vlfile writeData: data atOffset: offset];
-    [self synchronize];
+    if ([data length] == [[vlfile dataAtOffset: offset] length]) {
+      [vlfile writeData: data atOffset: offset];
+    } else {
+      /* a record that got longer or shorter moves, and its key with it */
+      RETAIN (offset);
+      [vlfile deleteDataAtOffset: offset];
+      [node replaceKeyAtIndex: index withKey: [vlfile writeData: data]];
+      RELEASE (offset);
+    }
+
+    [self setNeedsSynchronize];
   }
   
   [tree end];
+  DESTROY (dummyPaths[0]);
   
   RELEASE (arp);  
 }
 
+- (void)forgetAnnotationsOfPath:(NSString *)path
+{
+  if ([annotationsCache objectForKey: path] != nil) {
+    [annotationsCache removeObjectForKey: path];
+    [annotationsCacheOrder removeObject: path];
+  }
+}
+
+/*
+ * The metadata of ddbpath by type: its record in the metadata file or,
+ * for a path not yet migrated, what the modules read from its files.
+ */
+- (NSDictionary *)metadataRecordOfPath:(DDBPath *)ddbpath
+{
+  if ([ddbpath mdoffset]) {
+    NSData *data = [mdfile dataAtOffset: [ddbpath mdoffset]];
+
+    return (data ? [NSUnarchiver unarchiveObjectWithData: data] : nil);
+
+  } else if ([ddbpath mdpath] && mdstorage) {
+    NSMutableDictionary *record = [NSMutableDictionary dictionary];
+    NSString *path = [[mdstorage basePath] stringByAppendingPathComponent: 
+                                                             [ddbpath mdpath]];
+    NSEnumerator *enumerator = [mdmodules keyEnumerator];
+    NSString *type;
+
+    while ((type = [enumerator nextObject])) {
+      id mddata = [[mdmodules objectForKey: type] dataWithBasePath: path];
+
+      if (mddata) {
+        [record setObject: mddata forKey: type];
+      }
+    }
+
+    return record;
+  }
+
+  return nil;
+}
+
+/*
+ * Replaces the record of ddbpath, which the caller writes back.
+ */
+- (void)setMetadataRecord:(NSDictionary *)record
+                  forPath:(DDBPath *)ddbpath
+{
+  [self forgetAnnotationsOfPath: [ddbpath path]];
+
+  if ([ddbpath mdoffset]) {
+    [mdfile deleteDataAtOffset: [ddbpath mdoffset]];
+  }
+
+  if ([record count]) {
+    NSData *data = [NSArchiver archivedDataWithRootObject: record];
+
+    [ddbpath setMDOffset: [mdfile writeData: data]];
+  } else {
+    [ddbpath setMDOffset: nil];
+  }
+
+  if ([ddbpath mdpath]) {
+    if (mdstorage) {
+      [mdstorage removeEntry: [ddbpath mdpath]];
+    }
+    [ddbpath setMDPath: nil];
+  }
+
+  [self setNeedsSynchronize];
+}
+
+/*
+ * Moves the files of the older versions, one directory entry per path,
+ * into the metadata file, keeping the timestamps.  The old directory is
+ * renamed when every path is done, and read in the meantime.
+ */
+- (void)migrateLegacyMetadataAtPath:(NSString *)path
+{
+  NSMutableArray *offsets = [NSMutableArray array];
+  NSUInteger migrated = 0;
+  DBKBTreeCursor *cursor;
+  NSNumber *offset;
+  NSUInteger i;
+
+  mdstorage = [[DDBMDStorage alloc] initWithPath: path 
+                                      levelCount: 100 
+                                       dirsDepth: 3];
+
+  [tree begin];
+  cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+  offset = [cursor seekToFirstKey];
+
+  while (offset) {
+    [offsets addObject: offset];
+    offset = [cursor nextKey];
+  }
+
+  RELEASE (cursor);
+  [tree end];
+
+  NS_DURING
+    {
+  for (i = 0; i < [offsets count]; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSData *data = [vlfile dataAtOffset: [offsets objectAtIndex: i]];
+    DDBPath *ddbpath = [NSUnarchiver unarchiveObjectWithData: data];
+
+    if ([ddbpath mdpath] && ([ddbpath mdoffset] == nil)) {
+      NSDictionary *record = [self metadataRecordOfPath: ddbpath];
+
+      /* the files go with the directory, not one by one */
+      [ddbpath setMDPath: nil];
+      [self setMetadataRecord: record forPath: ddbpath];
+      [self writePath: ddbpath];
+      migrated++;
+    }
+
+    RELEASE (arp);
+  }
+
+  [self synchronize];
+  DESTROY (mdstorage);
+
+  [fm movePath: path 
+        toPath: [path stringByAppendingPathExtension: @"migrated"]
+       handler: nil];
+
+  NSDebugLLog(@"gwspace", @"migrated the metadata of %lu paths from %@",
+                                              (unsigned long)migrated, path);
+    }
+  NS_HANDLER
+    {
+  NSDebugLLog(@"gwspace", @"metadata migration from %@ stopped: %@", 
+                                                       path, localException);
+  [self synchronize];
+    }
+  NS_ENDHANDLER
+}
+
 - (void)duplicateDataOfPath:(NSString *)srcpath
                     forPath:(NSString *)dstpath
 {
@@ -411,7 +693,8 @@
   CREATE_AUTORELEASE_POOL(pool);
   NSMutableArray *paths = [NSMutableArray array];
   NSMutableArray *toremove = [NSMutableArray array];
-  NSArray *keys = nil;
+  DBKBTreeCursor *cursor;
+  NSNumber *offset;
   NSString *dmstr[2];
   NSUInteger i;
 
@@ -428,26 +711,40 @@
   dummyPaths[0] = [[DDBPath alloc] initForPath: dmstr[0]];
   dummyPaths[1] = [[DDBPath alloc] initForPath: dmstr[1]];
 
-  keys = [tree keysGreaterThenKey: dummyOffsets[0] 
-                 andLesserThenKey: dummyOffsets[1]];
+  /* each subpath is read as the cursor reaches it */
+  cursor = [[DBKBTreeCursor alloc] initWithTree: tree];
+  offset = [cursor seekToKey: dummyOffsets[0]];
 
-  [tree end];
-  
-  if (keys) {
-    for (i = 0; i < [keys count]; i++) {
-      CREATE_AUTORELEASE_POOL(arp);
-      NSData *data = [vlfile dataAtOffset: [keys objectAtIndex: i]];
-      DDBPath *ddbpath = [NSUnarchiver unarchiveObjectWithData: data];
+  if (offset && ([self compareNodeKey: offset withKey: dummyOffsets[0]] == NSOrderedSame)) {
+    offset = [cursor nextKey];
+  }
 
-      if ([fm fileExistsAtPath: [ddbpath path]]) {
-        [paths addObject: ddbpath];
-      } else {
-        [toremove addObject: [ddbpath path]];
-      }
+  while (offset) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSData *data;
+    DDBPath *ddbpath;
 
+    if ([self compareNodeKey: offset withKey: dummyOffsets[1]] != NSOrderedAscending) {
       RELEASE(arp);
-    }  
+      break;
+    }
+
+    data = [vlfile dataAtOffset: offset];
+    ddbpath = [NSUnarchiver unarchiveObjectWithData: data];
+
+    if ([fm fileExistsAtPath: [ddbpath path]]) {
+      [paths addObject: ddbpath];
+    } else {
+      [toremove addObject: [ddbpath path]];
+    }
+
+    offset = RETAIN ([cursor nextKey]);
+    RELEASE(arp);
+    AUTORELEASE (offset);
   }
+
+  RELEASE (cursor);
+  [tree end];
   
   for (i = 0; i < [toremove count]; i++) {
     [self removePath: [toremove objectAtIndex: i]];
@@ -477,43 +774,12 @@
 - (NSArray *)keysFromData:(NSData *)data
                withLength:(unsigned *)dlen
 {
-  NSMutableArray *keys = [NSMutableArray array];
-  NSRange range;
-  unsigned kcount;
-  unsigned long key;
-  NSUInteger i;
-  
-  range = NSMakeRange(0, sizeof(unsigned));
-  [data getBytes: &kcount range: range];
-  range.location += sizeof(unsigned);
-  
-  range.length = sizeof(unsigned long);
-
-  for (i = 0; i < kcount; i++) {
-    [data getBytes: &key range: range];
-    [keys addObject: [NSNumber numberWithUnsignedLong: key]];
-    range.location += sizeof(unsigned long);
-  }
-  
-  *dlen = range.location;
-  
-  return keys;
+  return [[DBKOffsetKeyCodec sharedCodec] keysFromData: data withLength: dlen];
 }
 
 - (NSData *)dataFromKeys:(NSArray *)keys
 {
-  NSMutableData *data = [NSMutableData dataWithCapacity: 1];
-  unsigned kcount = [keys count];
-  NSUInteger i;
-  
-  [data appendData: [NSData dataWithBytes: &kcount length: sizeof(unsigned)]];
-    
-  for (i = 0; i < kcount; i++) {
-    unsigned long kl = [[keys objectAtIndex: i] unsignedLongValue];
-    [data appendData: [NSData dataWithBytes: &kl length: sizeof(unsigned long)]];
-  }
-  
-  return data;  
+  return [[DBKOffsetKeyCodec sharedCodec] dataFromKeys: keys];
 }
 
 - (NSComparisonResult)compareNodeKey:(id)akey 
@@ -555,11 +821,20 @@
 - (void)dealloc
 {
   RELEASE (path);
-  RELEASE (mdpath);
+  TEST_RELEASE (mdpath);
+  TEST_RELEASE (mdoffset);
       
   [super dealloc];
 }
 
++ (void)initialize
+{
+  if (self == [DDBPath class]) {
+    /* 1: the offset of the record in the metadata file */
+    [self setVersion: 1];
+  }
+}
+
 - (id)initForPath:(NSString *)apath
 {
   self = [super init];
@@ -567,6 +842,7 @@
   if (self) {
     ASSIGN (path, apath);
     mdpath = nil;
+    mdoffset = nil;
     timestamp = 0.0;
   }
   
@@ -581,11 +857,16 @@
     if ([decoder allowsKeyedCoding]) {
       ASSIGN (path, [decoder decodeObjectForKey: @"path"]);
       ASSIGN (mdpath, [decoder decodeObjectForKey: @"mdpath"]);
+      ASSIGN (mdoffset, [decoder decodeObjectForKey: @"mdoffset"]);
       timestamp = [decoder decodeDoubleForKey: @"timestamp"];
     } else {
       ASSIGN (path, [decoder decodeObject]);
       ASSIGN (mdpath, [decoder decodeObject]);    
       [decoder decodeValueOfObjCType: @encode(double) at: &timestamp];
+
+      if ([decoder versionForClassName: @"DDBPath"] >= 1) {
+        ASSIGN (mdoffset, [decoder decodeObject]);
+      }
     }
   }
   
@@ -597,11 +878,13 @@
   if ([encoder allowsKeyedCoding]) {
     [encoder encodeObject: path forKey: @"path"];
     [encoder encodeObject: mdpath forKey: @"mdpath"];
+    [encoder encodeObject: mdoffset forKey: @"mdoffset"];
     [encoder encodeDouble: timestamp forKey: @"timestamp"];
   } else {
     [encoder encodeObject: path];
     [encoder encodeObject: mdpath];  
     [encoder encodeValueOfObjCType: @encode(double) at: &timestamp]; 
+    [encoder encodeObject: mdoffset];
   }
 }
 
@@ -643,6 +926,16 @@
   return mdpath;
 }
 
+- (void)setMDOffset:(NSNumber *)offset
+{
+  ASSIGN (mdoffset, offset);
+}
+
+- (NSNumber *)mdoffset
+{
+  return mdoffset;
+}
+
 - (void)setTimestamp:(NSTimeInterval)stamp
 {
   timestamp = stamp;
@@ -41,10 +41,18 @@
 
 - (NSData *)directoryTreeFromPath:(NSString *)apath;
 
+- (NSNumber *)openDirectoryTreeCursorFromPath:(NSString *)apath;
+
+- (NSData *)nextChunk:(NSNumber *)cursor;
+
+- (oneway void)closeDirectoryTreeCursor:(NSNumber *)cursor;
+
 - (NSArray *)userMetadataForPath:(NSString *)apath;
 
 - (NSString *)annotationsForPath:(NSString *)path;
 
+- (NSData *)annotationsForPaths:(NSData *)info;
+
 - (oneway void)setAnnotations:(NSString *)annotations
                       forPath:(NSString *)path;
 
@@ -62,8 +70,12 @@
   NSString *dbdir;
   NSConnection *conn;
   NSNotificationCenter *nc; 
+  NSMutableDictionary *treeCursors;
+  unsigned long cursorsCount;
 }
                                                      
+- (void)synchronizePaths:(id)sender;
+
 - (void)connectionBecameInvalid:(NSNotification *)notification;
 
 - (void)threadWillExit:(NSNotification *)notification;
@@ -76,6 +88,10 @@
   NSDictionary *updinfo;
 }
 
++ (void)scheduleTask:(NSDictionary *)info;
+
++ (void)runPendingTasks;
+
 + (void)updaterForTask:(NSDictionary *)info;
 
 - (void)setUpdaterTask:(NSDictionary *)info;
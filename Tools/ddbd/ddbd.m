@@ -35,6 +35,14 @@
 #define GWDebugLog(format, args...) \
   do { if (GW_DEBUG_LOG) \
     NSDebugLLog(@"gwspace", format , ## args); } while (0)
+
+/* how long the changes to the paths wait to be written together */
+#define SYNC_TIME (2.0)
+
+/* directories sent by each -nextChunk: */
+#define TREE_CHUNK 256
+/* a directory tree cursor left unread this long is dropped */
+#define CURSOR_TIMEOUT (120.0)
     
 enum {   
   DDBdInsertTreeUpdate,
@@ -49,6 +57,12 @@ static NSRecursiveLock *dirslock = nil;
 
 static NSFileManager *fm = nil;
 
+/* the updates run one at a time, the queries don't wait for a crowd */
+static dispatch_queue_t updaterQueue = NULL;
+static NSMutableArray *pendingTasks = nil;
+static NSLock *taskslock = nil;
+static BOOL updaterScheduled = NO;
+
 static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
 
 
@@ -64,6 +78,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
     }
 
   RELEASE (dbdir);
+  RELEASE (treeCursors);
             
   [super dealloc];
 }
@@ -90,6 +105,9 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
     }
 
     nc = [NSNotificationCenter defaultCenter];
+
+    treeCursors = [NSMutableDictionary new];
+    cursorsCount = 0;
                
     conn = [NSConnection defaultConnection];
     [conn setRootObject: self];
@@ -110,6 +128,16 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
     pathslock = [NSRecursiveLock new];
     dirsManager = [[DDBDirsManager alloc] initWithBasePath: dbdir];
     dirslock = [NSRecursiveLock new];
+
+    pendingTasks = [NSMutableArray new];
+    taskslock = [NSLock new];
+    updaterQueue = dispatch_queue_create("ddbd.updates", DISPATCH_QUEUE_SERIAL);
+
+    [NSTimer scheduledTimerWithTimeInterval: SYNC_TIME
+                                     target: self
+                                   selector: @selector(synchronizePaths:)
+                                   userInfo: nil
+                                    repeats: YES];
         
     NSDebugLLog(@"gwspace", @"ddbd started");    
   }
@@ -161,17 +189,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
                   forKey: @"type"];
   [updaterInfo setObject: dict forKey: @"taskdict"];
 
-  NS_DURING
-    {
-      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        [DBUpdater updaterForTask:updaterInfo];
-      });
-    }
-  NS_HANDLER
-    {
-      NSDebugLLog(@"gwspace", @"A fatal error occurred while dispatching the task!");
-    }
-  NS_ENDHANDLER
+  [DBUpdater scheduleTask: updaterInfo];
 }
 
 - (void)removeTreesFromPaths:(NSData *)info
@@ -185,17 +203,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
                   forKey: @"type"];
   [updaterInfo setObject: dict forKey: @"taskdict"];
 
-  NS_DURING
-    {
-      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        [DBUpdater updaterForTask:updaterInfo];
-      });
-    }
-  NS_HANDLER
-    {
-      NSDebugLLog(@"gwspace", @"A fatal error occurred while dispatching the task!");
-    }
-  NS_ENDHANDLER
+  [DBUpdater scheduleTask: updaterInfo];
 }
 
 - (NSData *)directoryTreeFromPath:(NSString *)apath
@@ -214,6 +222,94 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   return data;
 }
 
+/*
+ * The directory tree of apath a chunk at a time, so that the client
+ * can start on the first directories and ddbd is locked for a chunk
+ * only.  Returns nil if the db has no directory under apath.
+ */
+- (NSNumber *)openDirectoryTreeCursorFromPath:(NSString *)apath
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSArray *keys = [treeCursors allKeys];
+  NSMutableDictionary *cursor;
+  NSNumber *cnumber;
+  NSArray *chunk;
+  NSUInteger i;
+
+  for (i = 0; i < [keys count]; i++) {
+    NSDictionary *info = [treeCursors objectForKey: [keys objectAtIndex: i]];
+
+    if ((now - [[info objectForKey: @"stamp"] doubleValue]) > CURSOR_TIMEOUT) {
+      [treeCursors removeObjectForKey: [keys objectAtIndex: i]];
+    }
+  }
+
+  [dirslock lock];
+  chunk = [dirsManager dirsFromPath: apath after: nil maxCount: TREE_CHUNK];
+  [dirslock unlock];
+
+  if ([chunk count] == 0) {
+    return nil;
+  }
+
+  cursor = [NSMutableDictionary dictionary];
+  [cursor setObject: apath forKey: @"path"];
+  [cursor setObject: chunk forKey: @"chunk"];
+  [cursor setObject: [NSNumber numberWithDouble: now] forKey: @"stamp"];
+
+  cnumber = [NSNumber numberWithUnsignedLong: ++cursorsCount];
+  [treeCursors setObject: cursor forKey: cnumber];
+
+  return cnumber;
+}
+
+/*
+ * The next directories of the cursor, or nil when they are over and
+ * the cursor is closed.
+ */
+- (NSData *)nextChunk:(NSNumber *)cursor
+{
+  NSMutableDictionary *info = [treeCursors objectForKey: cursor];
+  NSArray *chunk;
+
+  if (info == nil) {
+    return nil;
+  }
+
+  chunk = [info objectForKey: @"chunk"];
+
+  if (chunk) {
+    RETAIN (chunk);
+    [info removeObjectForKey: @"chunk"];
+    AUTORELEASE (chunk);
+
+  } else {
+    NSString *last = [info objectForKey: @"last"];
+
+    [dirslock lock];
+    chunk = [dirsManager dirsFromPath: [info objectForKey: @"path"]
+                                after: last
+                             maxCount: TREE_CHUNK];
+    [dirslock unlock];
+  }
+
+  if ([chunk count] == 0) {
+    [treeCursors removeObjectForKey: cursor];
+    return nil;
+  }
+
+  [info setObject: [chunk lastObject] forKey: @"last"];
+  [info setObject: [NSNumber numberWithDouble: [NSDate timeIntervalSinceReferenceDate]]
+           forKey: @"stamp"];
+
+  return [NSArchiver archivedDataWithRootObject: chunk];
+}
+
+- (oneway void)closeDirectoryTreeCursor:(NSNumber *)cursor
+{
+  [treeCursors removeObjectForKey: cursor];
+}
+
 - (NSArray *)userMetadataForPath:(NSString *)apath
 {
   NSArray *usrdata = nil;
@@ -230,13 +326,34 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   NSString *annotations = nil;
   
   [pathslock lock];
-  annotations = [pathsManager metadataOfType: @"GSMDItemFinderComment" 
-                                     forPath: path];
+  annotations = [pathsManager annotationsForPath: path];
   [pathslock unlock];
 
   return annotations;
 }
 
+/*
+ * The annotations of an archived array of paths, in one round trip:
+ * an archived dictionary with the paths that have some.
+ */
+- (NSData *)annotationsForPaths:(NSData *)info
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSArray *paths = [NSUnarchiver unarchiveObjectWithData: info];
+  NSDictionary *annotations;
+  NSData *data;
+
+  [pathslock lock];
+  annotations = [pathsManager annotationsForPaths: paths];
+  [pathslock unlock];
+
+  data = [NSArchiver archivedDataWithRootObject: annotations];
+  RETAIN (data);
+  RELEASE (arp);
+
+  return AUTORELEASE (data);
+}
+
 - (oneway void)setAnnotations:(NSString *)annotations
                       forPath:(NSString *)path
 {
@@ -267,17 +384,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
                   forKey: @"type"];
   [updaterInfo setObject: dict forKey: @"taskdict"];
 
-  NS_DURING
-    {
-      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        [DBUpdater updaterForTask:updaterInfo];
-      });
-    }
-  NS_HANDLER
-    {
-      NSDebugLLog(@"gwspace", @"A fatal error occurred while dispatching the task!");
-    }
-  NS_ENDHANDLER
+  [DBUpdater scheduleTask: updaterInfo];
 }
 
 - (oneway void)synchronize
@@ -291,6 +398,13 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   [dirslock unlock];
 }
 
+- (void)synchronizePaths:(id)sender
+{
+  [pathslock lock];
+  [pathsManager synchronizeIfNeeded];
+  [pathslock unlock];
+}
+
 - (void)connectionBecameInvalid:(NSNotification *)notification
 {
   id connection = [notification object];
@@ -307,6 +421,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   else if (auto_stop == YES)
     {
       NSDebugLLog(@"gwspace", @"ddbd: connection became invalid, shutting down");
+      [self synchronizePaths: nil];
       exit(EXIT_SUCCESS);
     }
 }
@@ -340,6 +455,115 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   [super dealloc];
 }
 
+/*
+ * Queues a task for the serial updater.  A path that a tree task still
+ * waiting has too is left to the newer one, and a task follows the
+ * last waiting one of its type when nothing else came in between.
+ */
++ (void)scheduleTask:(NSDictionary *)info
+{
+  int type = [[info objectForKey: @"type"] intValue];
+  NSDictionary *taskdict = [info objectForKey: @"taskdict"];
+  BOOL mustdispatch = NO;
+
+  [taskslock lock];
+
+  if (type == DDBdFileOperationUpdate) {
+    if ([pendingTasks containsObject: info] == NO) {
+      [pendingTasks addObject: info];
+    }
+
+  } else {
+    NSArray *paths = [taskdict objectForKey: @"paths"];
+    NSMutableDictionary *last = nil;
+    NSUInteger i;
+
+    for (i = 0; i < [pendingTasks count]; i++) {
+      NSDictionary *task = [pendingTasks objectAtIndex: i];
+      NSMutableArray *tpaths;
+
+      if ([[task objectForKey: @"type"] intValue] == DDBdFileOperationUpdate) {
+        continue;
+      }
+
+      tpaths = [[task objectForKey: @"taskdict"] objectForKey: @"paths"];
+      [tpaths removeObjectsInArray: paths];
+
+      if ([tpaths count] == 0) {
+        [pendingTasks removeObjectAtIndex: i];
+        i--;
+      }
+    }
+
+    last = [pendingTasks lastObject];
+
+    if (last && ([[last objectForKey: @"type"] intValue] == type)) {
+      [[[last objectForKey: @"taskdict"] objectForKey: @"paths"] 
+                                            addObjectsFromArray: paths];
+    } else {
+      NSMutableDictionary *task = [NSMutableDictionary dictionary];
+      NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+
+      [dict setObject: [NSMutableArray arrayWithArray: paths] forKey: @"paths"];
+      [task setObject: [info objectForKey: @"type"] forKey: @"type"];
+      [task setObject: dict forKey: @"taskdict"];
+      [pendingTasks addObject: task];
+    }
+  }
+
+  if (updaterScheduled == NO) {
+    updaterScheduled = YES;
+    mustdispatch = YES;
+  }
+
+  [taskslock unlock];
+
+  if (mustdispatch) {
+    dispatch_async(updaterQueue, ^{
+      [DBUpdater runPendingTasks];
+    });
+  }
+}
+
+/*
+ * Runs on the updater queue until no task is waiting.
+ */
++ (void)runPendingTasks
+{
+  while (1) {
+    NSDictionary *task = nil;
+
+    [taskslock lock];
+
+    if ([pendingTasks count]) {
+      task = RETAIN ([pendingTasks objectAtIndex: 0]);
+      [pendingTasks removeObjectAtIndex: 0];
+    } else {
+      updaterScheduled = NO;
+    }
+
+    [taskslock unlock];
+
+    if (task == nil) {
+      break;
+    }
+
+    NS_DURING
+      {
+        [DBUpdater updaterForTask: task];
+      }
+    NS_HANDLER
+      {
+        NSDebugLLog(@"gwspace", @"db update failed: %@", localException);
+      }
+    NS_ENDHANDLER
+
+    RELEASE (task);
+  }
+
+  GWDebugLog(@"db update done");
+}
+
 + (void)updaterForTask:(NSDictionary *)info
 {
   CREATE_AUTORELEASE_POOL(arp);
@@ -7,6 +7,10 @@
 #import <Foundation/Foundation.h>
 #import "DSStore.h"
 #import "DSStoreEntry.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 void printUsage(void) {
     printf("dsutil - .DS_Store file manipulation tool\n\n");
@@ -24,7 +28,9 @@ void printUsage(void) {
     printf("  info <path>                  Show file information and statistics\n");
     printf("  validate <path>              Validate .DS_Store file structure\n");
     printf("  files <path>                 List all files with metadata entries\n");
-    printf("  summary <directory>          Show comprehensive summary with conversions\n\n");
+    printf("  summary <directory>          Show comprehensive summary with conversions\n");
+    printf("  scan <directory> [-j n] [--save]  Load every .DS_Store below directory on n threads,\n");
+    printf("                               print statistics and timing (--save also times saving a copy)\n\n");
     
     printf("ICON POSITION COMMANDS:\n");
     printf("  get-pos <file> <filename>    Get icon position coordinates\n");
@@ -1577,6 +1583,361 @@ int showSummary(NSString *directoryPath) {
     return 0;
 }
 
+#pragma mark - Recursive scan
+
+// Totals for the scan command.  Each worker keeps its own and adds them to
+// the scanner's when it finishes, so the hot path takes no lock.
+typedef struct {
+    unsigned long directories;
+    unsigned long stores;
+    unsigned long failed;
+    unsigned long saved;
+    unsigned long long records;
+    unsigned long long bytes;
+    double loadSeconds;
+    double saveSeconds;
+} DSScanTotals;
+
+static double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Walks a tree on a pool of threads.  Pending directories sit on one shared
+// stack; a worker pops one, reads it, pushes its subdirectories and processes
+// the .DS_Store it holds, if any.  The walk is over when the stack is empty
+// and no worker is still reading a directory.
+@interface DSScanner : NSObject {
+    NSCondition *_condition;
+    NSMutableArray *_pending;
+    NSUInteger _busy;
+    NSUInteger _running;
+    BOOL _saveCopies;
+    NSString *_scratchPath;
+    DSScanTotals _totals;
+    NSCountedSet *_codes;
+    NSCountedSet *_viewStyles;
+    NSMutableArray *_failures;
+}
+- (id)initWithRoot:(NSString *)root saveCopies:(BOOL)saveCopies;
+- (void)runWithThreads:(NSUInteger)threads;
+- (DSScanTotals)totals;
+- (NSCountedSet *)codes;
+- (NSCountedSet *)viewStyles;
+- (NSArray *)failures;
+@end
+
+@implementation DSScanner
+
+- (id)initWithRoot:(NSString *)root saveCopies:(BOOL)saveCopies {
+    if ((self = [super init])) {
+        _condition = [[NSCondition alloc] init];
+        _pending = [[NSMutableArray alloc] initWithObjects:root, nil];
+        _saveCopies = saveCopies;
+        _scratchPath = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+                         [NSString stringWithFormat:@"dsutil-scan-%d", getpid()]] retain];
+        _codes = [[NSCountedSet alloc] init];
+        _viewStyles = [[NSCountedSet alloc] init];
+        _failures = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_condition release];
+    [_pending release];
+    [_scratchPath release];
+    [_codes release];
+    [_viewStyles release];
+    [_failures release];
+    [super dealloc];
+}
+
+- (DSScanTotals)totals {
+    return _totals;
+}
+
+- (NSCountedSet *)codes {
+    return _codes;
+}
+
+- (NSCountedSet *)viewStyles {
+    return _viewStyles;
+}
+
+- (NSArray *)failures {
+    return _failures;
+}
+
+- (void)processStoreAtPath:(NSString *)path size:(off_t)size worker:(int)worker
+                    totals:(DSScanTotals *)totals codes:(NSCountedSet *)codes
+                    styles:(NSCountedSet *)styles failures:(NSMutableArray *)failures {
+    DSStore *store = [[DSStore alloc] initWithPath:path];
+    double start = monotonicSeconds();
+    BOOL loaded = [store load];
+
+    totals->loadSeconds += monotonicSeconds() - start;
+    totals->stores++;
+    totals->bytes += size;
+
+    if (!loaded) {
+        totals->failed++;
+        [failures addObject:path];
+        [store release];
+        return;
+    }
+
+    NSArray *entries = [store entries];
+    totals->records += [entries count];
+    for (DSStoreEntry *entry in entries) {
+        [codes addObject:[entry code]];
+    }
+    NSString *style = [store viewStyleForDirectory];
+    if (style) {
+        [styles addObject:style];
+    }
+
+    if (_saveCopies) {
+        // Written next to nothing the user owns: a scratch file per worker
+        NSString *copyPath = [_scratchPath stringByAppendingFormat:@"-%d", worker];
+        DSStore *copy = [DSStore createStoreAtPath:copyPath withEntries:entries];
+
+        start = monotonicSeconds();
+        if ([copy save]) {
+            totals->saved++;
+        }
+        totals->saveSeconds += monotonicSeconds() - start;
+        unlink([copyPath fileSystemRepresentation]);
+    }
+    [store release];
+}
+
+// Reads one directory: returns its subdirectories, processes its store
+- (NSArray *)scanDirectory:(NSString *)dirPath worker:(int)worker
+                    totals:(DSScanTotals *)totals codes:(NSCountedSet *)codes
+                    styles:(NSCountedSet *)styles failures:(NSMutableArray *)failures {
+    NSMutableArray *subdirs = [NSMutableArray array];
+    DIR *dir = opendir([dirPath fileSystemRepresentation]);
+    struct dirent *de;
+    off_t storeSize = -1;
+
+    if (dir == NULL) {
+        return subdirs;
+    }
+    totals->directories++;
+
+    while ((de = readdir(dir)) != NULL) {
+        const char *name = de->d_name;
+        unsigned char type = de->d_type;
+        struct stat st;
+
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        BOOL isStore = (strcmp(name, ".DS_Store") == 0);
+        if (!isStore && type != DT_DIR && type != DT_UNKNOWN) {
+            continue;
+        }
+
+        NSString *path = [dirPath stringByAppendingPathComponent:
+                          [[NSFileManager defaultManager] stringWithFileSystemRepresentation:name
+                                                                                     length:strlen(name)]];
+        if (type == DT_UNKNOWN || isStore) {
+            // Symbolic links are never followed
+            if (lstat([path fileSystemRepresentation], &st) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+
+        if (type == DT_DIR) {
+            [subdirs addObject:path];
+        } else if (isStore && type == DT_REG) {
+            storeSize = st.st_size;
+        }
+    }
+    closedir(dir);
+
+    if (storeSize >= 0) {
+        [self processStoreAtPath:[dirPath stringByAppendingPathComponent:@".DS_Store"]
+                            size:storeSize worker:worker totals:totals codes:codes
+                          styles:styles failures:failures];
+    }
+    return subdirs;
+}
+
+- (void)worker:(NSNumber *)index {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int worker = [index intValue];
+    DSScanTotals totals;
+    NSCountedSet *codes = [NSCountedSet set];
+    NSCountedSet *styles = [NSCountedSet set];
+    NSMutableArray *failures = [NSMutableArray array];
+
+    memset(&totals, 0, sizeof(totals));
+
+    for (;;) {
+        NSAutoreleasePool *arp;
+        NSString *dirPath;
+        NSArray *subdirs;
+
+        [_condition lock];
+        while ([_pending count] == 0 && _busy > 0) {
+            [_condition wait];
+        }
+        if ([_pending count] == 0) {
+            [_condition broadcast];
+            [_condition unlock];
+            break;
+        }
+        dirPath = [[_pending lastObject] retain];
+        [_pending removeLastObject];
+        _busy++;
+        [_condition unlock];
+
+        arp = [[NSAutoreleasePool alloc] init];
+        subdirs = [[self scanDirectory:dirPath worker:worker totals:&totals codes:codes
+                                styles:styles failures:failures] retain];
+        [arp drain];
+        [dirPath release];
+
+        [_condition lock];
+        [_pending addObjectsFromArray:subdirs];
+        _busy--;
+        if ([subdirs count] > 0 || _busy == 0) {
+            [_condition broadcast];
+        }
+        [_condition unlock];
+        [subdirs release];
+    }
+
+    [_condition lock];
+    _totals.directories += totals.directories;
+    _totals.stores += totals.stores;
+    _totals.failed += totals.failed;
+    _totals.saved += totals.saved;
+    _totals.records += totals.records;
+    _totals.bytes += totals.bytes;
+    _totals.loadSeconds += totals.loadSeconds;
+    _totals.saveSeconds += totals.saveSeconds;
+    for (id code in codes) {
+        NSUInteger n = [codes countForObject:code];
+        while (n--) {
+            [_codes addObject:code];
+        }
+    }
+    for (id style in styles) {
+        NSUInteger n = [styles countForObject:style];
+        while (n--) {
+            [_viewStyles addObject:style];
+        }
+    }
+    [_failures addObjectsFromArray:failures];
+    _running--;
+    [_condition broadcast];
+    [_condition unlock];
+
+    [pool drain];
+}
+
+- (void)runWithThreads:(NSUInteger)threads {
+    NSUInteger i;
+
+    _running = threads;
+    for (i = 0; i < threads; i++) {
+        [NSThread detachNewThreadSelector:@selector(worker:)
+                                 toTarget:self
+                               withObject:[NSNumber numberWithUnsignedInteger:i]];
+    }
+
+    [_condition lock];
+    while (_running > 0) {
+        [_condition wait];
+    }
+    [_condition unlock];
+}
+
+@end
+
+static NSComparisonResult compareByCount(id a, id b, void *context) {
+    NSCountedSet *set = (NSCountedSet *)context;
+    NSUInteger ca = [set countForObject:a];
+    NSUInteger cb = [set countForObject:b];
+
+    if (ca != cb) {
+        return ca > cb ? NSOrderedAscending : NSOrderedDescending;
+    }
+    return [a compare:b];
+}
+
+static void printCounts(const char *title, NSCountedSet *set, NSUInteger limit) {
+    NSArray *keys = [[set allObjects] sortedArrayUsingFunction:compareByCount context:set];
+    NSUInteger i;
+
+    if ([keys count] == 0) {
+        return;
+    }
+    printf("\n%s:\n", title);
+    for (i = 0; i < [keys count] && i < limit; i++) {
+        id key = [keys objectAtIndex:i];
+        printf("  %-6s %lu\n", [[key description] UTF8String],
+               (unsigned long)[set countForObject:key]);
+    }
+    if ([keys count] > limit) {
+        printf("  ... %lu more\n", (unsigned long)([keys count] - limit));
+    }
+}
+
+int scanTree(NSString *root, NSUInteger threads, BOOL saveCopies) {
+    BOOL isDir = NO;
+    if (![[NSFileManager defaultManager] fileExistsAtPath:root isDirectory:&isDir] || !isDir) {
+        printf("Error: Not a directory: %s\n", [root UTF8String]);
+        return 1;
+    }
+
+    DSScanner *scanner = [[[DSScanner alloc] initWithRoot:root saveCopies:saveCopies] autorelease];
+    double start = monotonicSeconds();
+    [scanner runWithThreads:threads];
+    double wall = monotonicSeconds() - start;
+    DSScanTotals t = [scanner totals];
+    double mb = t.bytes / (1024.0 * 1024.0);
+
+    printf("=== Scan of %s ===\n", [root UTF8String]);
+    printf("Threads:      %lu\n", (unsigned long)threads);
+    printf("Directories:  %lu\n", t.directories);
+    printf("Stores:       %lu (%lu failed to load)\n", t.stores, t.failed);
+    printf("Records:      %llu (%.1f per store)\n", t.records,
+           t.stores ? (double)t.records / t.stores : 0.0);
+    printf("Store bytes:  %llu (%.2f MB)\n", t.bytes, mb);
+    printf("Wall time:    %.3f s (%.0f directories/s, %.0f stores/s)\n", wall,
+           wall > 0 ? t.directories / wall : 0.0, wall > 0 ? t.stores / wall : 0.0);
+    printf("Load time:    %.3f s summed over threads (%.1f us per store, %.2f MB/s per thread)\n",
+           t.loadSeconds, t.stores ? t.loadSeconds * 1e6 / t.stores : 0.0,
+           t.loadSeconds > 0 ? mb / t.loadSeconds : 0.0);
+    if (saveCopies) {
+        printf("Save time:    %.3f s summed over threads (%lu saved, %.1f us per store)\n",
+               t.saveSeconds, t.saved, t.saved ? t.saveSeconds * 1e6 / t.saved : 0.0);
+    }
+
+    printCounts("Record codes", [scanner codes], 20);
+    printCounts("View styles", [scanner viewStyles], 10);
+
+    NSArray *failures = [scanner failures];
+    if ([failures count] > 0) {
+        NSUInteger i;
+        printf("\nFailed to load:\n");
+        for (i = 0; i < [failures count] && i < 20; i++) {
+            printf("  %s\n", [[failures objectAtIndex:i] UTF8String]);
+        }
+        if ([failures count] > 20) {
+            printf("  ... %lu more\n", (unsigned long)([failures count] - 20));
+        }
+    }
+    return t.failed > 0 ? 1 : 0;
+}
+
 int main(int argc, const char * argv[]) {
     NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
     
@@ -2096,6 +2457,25 @@ int main(int argc, const char * argv[]) {
             NSString *path = [NSString stringWithUTF8String:ARG(2)];
             result = showInfo(path);
         }
+    } else if (strcmp(command, "scan") == 0) {
+        NSString *root = nil;
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        BOOL saveCopies = NO;
+        for (int i = 2; i < ARGC_EFFECTIVE; i++) {
+            if (strcmp(ARG(i), "-j") == 0 && i + 1 < ARGC_EFFECTIVE) {
+                threads = atol(ARG(++i));
+            } else if (strcmp(ARG(i), "--save") == 0) {
+                saveCopies = YES;
+            } else if (root == nil) {
+                root = [NSString stringWithUTF8String:ARG(i)];
+            }
+        }
+        if (root == nil) {
+            printf("Error: scan requires <directory> [-j threads] [--save]\n");
+            result = 1;
+        } else {
+            result = scanTree(root, threads > 0 ? (NSUInteger)threads : 1, saveCopies);
+        }
     } else if (strcmp(command, "summary") == 0) {
         if (ARGC_EFFECTIVE < 3) {
             printf("Error: summary command requires directory path\n");
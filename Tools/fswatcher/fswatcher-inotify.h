@@ -28,16 +28,41 @@
 #include <sys/types.h>
 #include <sys/inotify.h>
 #import <Foundation/Foundation.h>
-#include "DBKPathsTree.h"
+#include "DBKRadixPathsTree.h"
 
 @class Watcher;
 
+/* An event waiting in the coalescing queue.  Paths are IDs into the
+ * queue's interned strings, 0 for none; the event is one of the
+ * constant GW... strings, compared by pointer. */
+typedef struct {
+  NSString *event;
+  uint32_t path;
+  uint32_t file;
+  uint32_t oldpath;
+  BOOL global;
+  BOOL live;
+} fsw_event;
+
+/* A filesystem with a fanotify mark.  Its events name their directory
+ * by a handle, which is opened relative to a descriptor on the same
+ * filesystem. */
+typedef struct {
+  uint64_t fsid;
+  dev_t dev;
+  int fd;
+} fsw_fan_mount;
+
 @protocol	FSWClientProtocol <NSObject>
 
 - (oneway void)watchedPathDidChange:(NSData *)dirinfo;
 
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo;
 
+/* Batched delivery, see FSWEventBatch.h; the client acknowledges each
+ * batch with -client:didProcessBatch:. */
+- (oneway void)watchedPathsDidChange:(NSData *)batch;
+
 @end
 
 
@@ -54,6 +79,29 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                           removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          didProcessBatch:(unsigned long long)sequence;
+
+/* Events the client wants, checked before anything is sent to it:
+ * "includePaths" and "excludePaths", arrays of path prefixes;
+ * "excludedSuffixes", lowercase extensions; "events", the event names;
+ * "skipDotFiles".  Keys left out do not filter, nil drops the filter. */
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setFilter:(bycopy NSDictionary *)filter;
+
+/* How long, at least, a batched client's events gather before they
+ * are sent; adaptive windows stretch while the client's events pour
+ * in.  The default, 0, sends every flush. */
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setCoalescingWindow:(double)seconds
+                          adaptive:(BOOL)flag;
+
+/* Counters, for seeing whether fswatcher keeps up. */
+- (bycopy NSDictionary *)statistics;
+
 - (oneway void)logDataReady:(NSData *)data;
 
 @end
@@ -64,6 +112,23 @@
   id <FSWClientProtocol> client;
   NSCountedSet *wpaths;
   BOOL global;
+  BOOL batched;
+  NSMutableData *batch;
+  NSString *batchRoot;
+  NSString *rescanPath;
+  unsigned long long sentBatches;
+  unsigned long long ackedBatches;
+  BOOL filtered;
+  radixtree *includeTree;
+  radixtree *excludeTree;
+  NSSet *excludedSuffixes;
+  uint32_t eventMask;
+  BOOL skipDotFiles;
+  unsigned long long deliveredEvents;
+  double window;
+  BOOL adaptiveWindow;
+  double lastSent;
+  double recordRate;
 }
 
 - (void)setConnection:(NSConnection *)connection;
@@ -86,6 +151,36 @@
 
 - (BOOL)isGlobal;
 
+- (void)setBatched:(BOOL)value;
+
+- (BOOL)isBatched;
+
+- (void)queueRecord:(uint8_t)type
+               path:(NSString *)path
+              extra:(NSString *)extra;
+
+- (void)setCoalescingWindow:(double)seconds
+                   adaptive:(BOOL)flag;
+
+- (double)currentWindow;
+
+/* Sends the batch if the client's window is over; otherwise returns
+ * when it will be. */
+- (double)sendBatchAt:(double)now;
+
+- (void)sendBatch;
+
+- (void)batchProcessed:(unsigned long long)sequence;
+
+- (void)setFilter:(NSDictionary *)filter;
+
+- (BOOL)acceptsEvent:(uint8_t)type
+              atPath:(NSString *)path;
+
+- (void)countDeliveredEvent;
+
+- (unsigned long long)deliveredEvents;
+
 @end
 
 
@@ -93,18 +188,56 @@
 {
   NSConnection *conn;
   NSMutableArray *clientsInfo;  
+  NSMapTable *clientsByConnection;
+  NSMapTable *listenersByPath;
+  NSMutableSet *globalClients;
   NSMapTable *watchers;
   NSMapTable *watchDescrMap;
   
   NSFileHandle *inotifyHandle;
   NSMutableData *inotifyPendingData;
+  size_t inotifyReadSize;
+  double lastEventsRead;
   uint32_t filemask;
   uint32_t dirmask;
   NSString *lastMovedPath;
   uint32_t moveCookie;
+
+  NSFileHandle *fanotifyHandle;
+  fsw_fan_mount *fanotifyMounts;
+  NSUInteger fanotifyMountsCount;
+  NSMutableDictionary *fanotifyDirs;
+
+  NSMutableArray *rescanRoots;
+  NSDirectoryEnumerator *rescanEnum;
+  NSString *rescanRoot;
+  double rescanSince;
+  NSUInteger rescanVisited;
+  NSTimer *rescanTimer;
+
+  fsw_event *events;
+  NSUInteger eventsCount;
+  NSUInteger eventsCapacity;
+  uint32_t *eventSlots;
+  NSUInteger slotsCount;
+  NSMapTable *pathIds;
+  NSMutableArray *internedPaths;
+  NSTimer *flushTimer;
+  double lastFlush;
+  double eventRate;
+  unsigned long long queuedEvents;
+  unsigned long long flushedEvents;
+  unsigned long long coalescedEvents;
+  unsigned long long overflows;
+  unsigned long long flushes;
+  double flushTime;
+  double maxFlushTime;
+  NSTimer *statsTimer;
+  NSTimer *batchTimer;
   
-  pcomp *includePathsTree;
-  pcomp *excludePathsTree;  
+  NSArray *globalRoots;
+  radixtree *includePathsTree;
+  radixtree *excludePathsTree;  
   NSMutableSet *excludedSuffixes;
      
   NSFileManager *fm;
@@ -130,11 +263,36 @@
 
 - (FSWClientInfo *)clientInfoWithRemote:(id)remote;
 
+- (void)removeClientInfo:(FSWClientInfo *)info;
+
+- (void)clientInfo:(FSWClientInfo *)info
+    addWatchedPath:(NSString *)path;
+
+- (void)clientInfo:(FSWClientInfo *)info
+ removeWatchedPath:(NSString *)path;
+
 - (oneway void)client:(id <FSWClientProtocol>)client
                                 addWatcherForPath:(NSString *)path;
 
 - (oneway void)client:(id <FSWClientProtocol>)client
                                 removeWatcherForPath:(NSString *)path;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                didProcessBatch:(unsigned long long)sequence;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setFilter:(bycopy NSDictionary *)filter;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setCoalescingWindow:(double)seconds
+                                adaptive:(BOOL)flag;
+
+- (bycopy NSDictionary *)statistics;
+
+- (void)logStatistics:(id)sender;
                                 
 - (Watcher *)watcherForPath:(NSString *)path;
 
@@ -148,8 +306,60 @@
 
 - (void)checkLastMovedPath:(id)sender;
 
+- (uint32_t)internPath:(NSString *)path;
+
+- (NSString *)internedPath:(uint32_t)pid;
+
+- (fsw_event *)pendingEventForPath:(uint32_t)path
+                              file:(uint32_t)file
+                            global:(BOOL)global
+                              slot:(NSUInteger *)slot;
+
+- (void)growEventQueue;
+
+- (double)flushInterval;
+
+- (void)enqueueEvent:(NSString *)event
+                path:(uint32_t)path
+                file:(uint32_t)file
+             oldPath:(uint32_t)oldpath
+              global:(BOOL)global;
+
+- (void)queueEvent:(NSString *)event
+            atPath:(NSString *)path
+           forFile:(NSString *)fname;
+
+- (void)queueGlobalEvent:(NSString *)event
+                 forPath:(NSString *)path
+                 oldPath:(NSString *)oldpath;
+
+- (void)processPendingEvents:(id)sender;
+
+- (void)sendDueBatches:(id)sender;
+
 - (void)inotifyDataReady:(NSNotification *)notif;
 
+- (void)inotifyQueueOverflowed;
+
+- (void)notifyGlobalRescanOfPath:(NSString *)path;
+
+- (void)scheduleGlobalRescanSince:(double)since;
+
+- (void)globalRescanStep:(id)sender;
+
+- (BOOL)isGlobalWatchedPath:(NSString *)path;
+
+- (BOOL)startFanotify;
+
+- (void)stopFanotify;
+
+- (void)fanotifyMarkPaths:(NSArray *)paths;
+
+- (NSString *)fanotifyDirectoryForHandle:(void *)handle
+                                    fsid:(uint64_t)fsid;
+
+- (void)fanotifyDataReady:(NSNotification *)notif;
+
 @end
 
 
@@ -22,10 +22,29 @@
  * Foundation, Inc., 31 Milk Street #960789 Boston, MA 02196 USA.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE   /* open_by_handle_at() */
+#endif
+
 #import "fswatcher-inotify.h"
+#import "FSWEventBatch.h"
+#import "../../FSNode/FSNTrace.h"
 #include "config.h"
 #include <unistd.h>
+#include <signal.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_FANOTIFY_H
+#include <sys/fanotify.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
+#include <limits.h>
+#endif
 
 #define GWDebugLog(format, args...) \
   do { if (GW_DEBUG_LOG) \
@@ -37,8 +56,73 @@ static NSString *GWWatchedPathDeleted = @"GWWatchedPathDeleted";
 static NSString *GWFileDeletedInWatchedDirectory = @"GWFileDeletedInWatchedDirectory";
 static NSString *GWFileCreatedInWatchedDirectory = @"GWFileCreatedInWatchedDirectory";
 static NSString *GWWatchedFileModified = @"GWWatchedFileModified";
+static NSString *GWFileModifiedInWatchedDirectory = @"GWFileModifiedInWatchedDirectory";
 static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 
+/* Records in one batch, and batches a client may leave unacknowledged,
+ * past which it is told to rescan instead. */
+#define FSW_BATCH_MAX_RECORDS 2048
+#define FSW_MAX_UNACKED_BATCHES 4
+
+/* An adaptive client window grows with the client's record rate, to
+ * this many times its base window (and at least CLIENT_MIN_STRETCHED
+ * seconds) at CLIENT_BUSY_RATE records per second. */
+#define CLIENT_WINDOW_STRETCH 8.0
+#define CLIENT_MIN_STRETCHED 1.0
+#define CLIENT_BUSY_RATE 1000.0
+
+/* The inotify read buffer grows, up to the maximum, while reads keep
+ * filling it and when the kernel queue overflows. */
+#define INOTIFY_READ_MIN (16 * 1024)
+#define INOTIFY_READ_MAX (1024 * 1024)
+
+/* The mtime rescan after lost global events: entries looked at per
+ * run loop pass, entries in all before what is left goes to the
+ * clients as rescan records, and seconds of mtime slack. */
+#define RESCAN_STEP 500
+#define RESCAN_LIMIT 100000
+#define RESCAN_SLACK 2.0
+
+static inline BOOL isDotFile(NSString *path);
+
+/* The deepest directory containing both paths; p1 may be nil. */
+static NSString *commonAncestor(NSString *p1, NSString *p2)
+{
+  NSArray *c1, *c2;
+  NSUInteger i, n;
+
+  if (p1 == nil || [p1 isEqual: p2]) {
+    return p2;
+  }
+  if ([p2 hasPrefix: p1] 
+        && ([p1 isEqual: @"/"] || [p2 characterAtIndex: [p1 length]] == '/')) {
+    return p1;
+  }
+
+  c1 = [p1 pathComponents];
+  c2 = [p2 pathComponents];
+  n = MIN ([c1 count], [c2 count]);
+
+  for (i = 0; i < n; i++) {
+    if ([[c1 objectAtIndex: i] isEqual: [c2 objectAtIndex: i]] == NO) {
+      break;
+    }
+  }
+
+  if (i == 0) {
+    return @"/";
+  }
+  return [NSString pathWithComponents: [c1 subarrayWithRange: NSMakeRange(0, i)]];
+}
+
+static inline double monotonicTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
 
 @implementation	FSWClientInfo
 
@@ -47,6 +131,10 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   RELEASE (conn);
   RELEASE (client);
   RELEASE (wpaths);
+  RELEASE (batch);
+  RELEASE (batchRoot);
+  RELEASE (rescanPath);
+  [self setFilter: nil];
   [super dealloc];
 }
 
@@ -60,6 +148,23 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
       conn = nil;
       wpaths = [[NSCountedSet alloc] initWithCapacity: 1];
       global = NO;
+      batched = NO;
+      batch = nil;
+      batchRoot = nil;
+      rescanPath = nil;
+      sentBatches = 0;
+      ackedBatches = 0;
+      filtered = NO;
+      includeTree = NULL;
+      excludeTree = NULL;
+      excludedSuffixes = nil;
+      eventMask = 0;
+      skipDotFiles = NO;
+      deliveredEvents = 0;
+      window = 0;
+      adaptiveWindow = NO;
+      lastSent = 0;
+      recordRate = 0;
     }
   
   return self;
@@ -115,6 +220,244 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   return global;
 }
 
+- (void)setBatched:(BOOL)value
+{
+  batched = value;
+}
+
+- (BOOL)isBatched
+{
+  return batched;
+}
+
+- (void)queueRecord:(uint8_t)type
+               path:(NSString *)path
+              extra:(NSString *)extra
+{
+  deliveredEvents++;
+
+  /* a client with a long window can gather more than it should read */
+  if (rescanPath != nil && batch == nil) {
+    ASSIGN (rescanPath, commonAncestor(rescanPath, path));
+    return;
+  }
+  if (batch != nil && FSWBatchCount(batch) >= FSW_BATCH_MAX_RECORDS) {
+    ASSIGN (rescanPath, commonAncestor(commonAncestor(rescanPath, batchRoot), path));
+    DESTROY (batch);
+    DESTROY (batchRoot);
+    return;
+  }
+
+  if (batch == nil) {
+    ASSIGN (batch, FSWBatchCreate());
+  }
+  FSWBatchAppend(batch, type, path, extra);
+  ASSIGN (batchRoot, commonAncestor(batchRoot, path));
+}
+
+- (void)setCoalescingWindow:(double)seconds
+                   adaptive:(BOOL)flag
+{
+  window = (seconds > 0) ? seconds : 0;
+  adaptiveWindow = flag;
+}
+
+- (double)currentWindow
+{
+  double stretched, load;
+
+  if (adaptiveWindow == NO) {
+    return window;
+  }
+
+  stretched = MAX (window * CLIENT_WINDOW_STRETCH, CLIENT_MIN_STRETCHED);
+  load = MIN (recordRate / CLIENT_BUSY_RATE, 1.0);
+
+  return window + (stretched - window) * load;
+}
+
+- (double)sendBatchAt:(double)now
+{
+  double due;
+
+  if (batch == nil && rescanPath == nil) {
+    return 0;
+  }
+
+  due = lastSent + [self currentWindow];
+  if (now < due) {
+    return due;
+  }
+
+  /* whatever is left waits for an acknowledgement */
+  [self sendBatch];
+  return 0;
+}
+
+/*
+ * Sends what the last flush queued.  A client that has not caught up
+ * with its earlier batches, or a batch too large to be worth reading
+ * event by event, is folded into one rescan record for the directory
+ * holding all the paths; the client gets it once it acknowledges.  A
+ * rescan covers both directory and global events.
+ */
+- (void)sendBatch
+{
+  BOOL behind = (sentBatches - ackedBatches >= FSW_MAX_UNACKED_BATCHES);
+
+  if (batch && (behind || FSWBatchCount(batch) > FSW_BATCH_MAX_RECORDS)) {
+    ASSIGN (rescanPath, commonAncestor(rescanPath, batchRoot));
+    DESTROY (batch);
+    DESTROY (batchRoot);
+  }
+
+  if (behind || (batch == nil && rescanPath == nil)) {
+    return;
+  }
+
+  if (rescanPath) {
+    /* anything newer is somewhere under the same root by now */
+    if (batchRoot) {
+      ASSIGN (rescanPath, commonAncestor(rescanPath, batchRoot));
+    }
+    ASSIGN (batch, FSWBatchCreate());
+    FSWBatchAppend(batch, FSWBatchRescan, rescanPath, nil);
+    GWDebugLog(@"client fell behind; rescan of %@", rescanPath);
+    DESTROY (rescanPath);
+  }
+
+  {
+    double now = monotonicTime();
+    double elapsed = MAX (now - lastSent, 0.02);
+
+    recordRate = (recordRate + FSWBatchCount(batch) / elapsed) / 2;
+    lastSent = now;
+  }
+
+  sentBatches++;
+  FSWBatchSetSequence(batch, sentBatches);
+  {
+    /* the client's dispatch of the batch has the same op */
+    FSN_TRACE_SCOPE_OP ("fswatcher send batch", sentBatches);
+    [client watchedPathsDidChange: batch];
+  }
+
+  DESTROY (batch);
+  DESTROY (batchRoot);
+}
+
+- (void)setFilter:(NSDictionary *)filter
+{
+  NSArray *paths;
+  NSArray *names;
+  NSUInteger i;
+
+  if (includeTree) {
+    radixFreeTree(includeTree);
+    includeTree = NULL;
+  }
+  if (excludeTree) {
+    radixFreeTree(excludeTree);
+    excludeTree = NULL;
+  }
+  DESTROY (excludedSuffixes);
+  eventMask = 0;
+  skipDotFiles = NO;
+  filtered = (filter != nil);
+
+  if (filter == nil) {
+    return;
+  }
+
+  paths = [filter objectForKey: @"includePaths"];
+  if ([paths count]) {
+    includeTree = newRadixTreeWithIdentifier(@"client_incl");
+    for (i = 0; i < [paths count]; i++) {
+      radixInsertComponentsOfPath([paths objectAtIndex: i], includeTree);
+    }
+  }
+
+  paths = [filter objectForKey: @"excludePaths"];
+  if ([paths count]) {
+    excludeTree = newRadixTreeWithIdentifier(@"client_excl");
+    for (i = 0; i < [paths count]; i++) {
+      radixInsertComponentsOfPath([paths objectAtIndex: i], excludeTree);
+    }
+  }
+
+  if ([[filter objectForKey: @"excludedSuffixes"] count]) {
+    excludedSuffixes = [[NSSet alloc] initWithArray: 
+                                        [filter objectForKey: @"excludedSuffixes"]];
+  }
+
+  names = [filter objectForKey: @"events"];
+  for (i = 0; i < [names count]; i++) {
+    uint8_t type = FSWBatchEventType([names objectAtIndex: i]);
+
+    if (type) {
+      eventMask |= (1 << type);
+    }
+  }
+  /* whatever else it asked for, a client cannot opt out of rescans */
+  if (eventMask) {
+    eventMask |= (1 << FSWBatchRescan);
+  }
+
+  skipDotFiles = [[filter objectForKey: @"skipDotFiles"] boolValue];
+}
+
+/* path is the changed file, not its directory, for directory events. */
+- (BOOL)acceptsEvent:(uint8_t)type
+              atPath:(NSString *)path
+{
+  if (filtered == NO) {
+    return YES;
+  }
+  type &= ~FSWBatchGlobal;
+
+  if (eventMask && (eventMask & (1 << type)) == 0) {
+    return NO;
+  }
+  if (type == FSWBatchRescan) {
+    return YES;
+  }
+  if (excludedSuffixes 
+        && [excludedSuffixes containsObject: [[path pathExtension] lowercaseString]]) {
+    return NO;
+  }
+  if (skipDotFiles && isDotFile(path)) {
+    return NO;
+  }
+  if (includeTree && radixInTreeFirstPartOfPath(path, includeTree) == NO) {
+    return NO;
+  }
+  if (excludeTree && radixInTreeFirstPartOfPath(path, excludeTree)) {
+    return NO;
+  }
+
+  return YES;
+}
+
+- (void)countDeliveredEvent
+{
+  deliveredEvents++;
+}
+
+- (unsigned long long)deliveredEvents
+{
+  return deliveredEvents;
+}
+
+- (void)batchProcessed:(unsigned long long)sequence
+{
+  if (sequence > ackedBatches && sequence <= sentBatches) {
+    ackedBatches = sequence;
+  }
+  if (rescanPath) {
+    [self sendBatch];
+  }
+}
+
 @end
 
 
@@ -145,14 +488,30 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   [dnc removeObserver: self];
   
   RELEASE (clientsInfo);
+  NSFreeMapTable (clientsByConnection);
+  NSFreeMapTable (listenersByPath);
+  RELEASE (globalClients);
   NSZoneFree (NSDefaultMallocZone(), (void *)watchers);
   NSZoneFree (NSDefaultMallocZone(), (void *)watchDescrMap);
-  freeTree(includePathsTree);
-  freeTree(excludePathsTree);
+  RELEASE (globalRoots);
+  radixFreeTree(includePathsTree);
+  radixFreeTree(excludePathsTree);
   RELEASE (excludedSuffixes);
   RELEASE (inotifyHandle);  
   RELEASE (inotifyPendingData);
+  [self stopFanotify];
+  [rescanTimer invalidate];
+  RELEASE (rescanRoots);
+  RELEASE (rescanEnum);
+  RELEASE (rescanRoot);
   RELEASE (lastMovedPath);
+  [flushTimer invalidate];
+  [statsTimer invalidate];
+  [batchTimer invalidate];
+  free(events);
+  free(eventSlots);
+  NSFreeMapTable (pathIds);
+  RELEASE (internedPaths);
   
   [super dealloc];
 }
@@ -200,23 +559,72 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
     }
 
     dirmask = (IN_CREATE | IN_DELETE | IN_DELETE_SELF 
-                | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_MODIFY);    
+                | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_MODIFY
+                | IN_CLOSE_WRITE);    
     filemask = (IN_CLOSE_WRITE | IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF);    
     lastMovedPath = nil;
     moveCookie = 0;
 
-    inotifyPendingData = [[NSMutableData alloc] initWithCapacity: 4096];
+    inotifyPendingData = [[NSMutableData alloc] initWithCapacity: INOTIFY_READ_MIN];
+    inotifyReadSize = INOTIFY_READ_MIN;
+    lastEventsRead = [NSDate timeIntervalSinceReferenceDate];
+
+    rescanRoots = [NSMutableArray new];
+    rescanEnum = nil;
+    rescanRoot = nil;
+    rescanSince = 0.0;
+    rescanVisited = 0;
+    rescanTimer = nil;
+
+    events = NULL;
+    eventsCount = 0;
+    eventsCapacity = 0;
+    eventSlots = NULL;
+    slotsCount = 0;
+    pathIds = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                               NSIntegerMapValueCallBacks, 0);
+    internedPaths = [NSMutableArray new];
+    flushTimer = nil;
+    lastFlush = monotonicTime();
+    eventRate = 0.0;
+    queuedEvents = 0;
+    flushedEvents = 0;
+    coalescedEvents = 0;
+    overflows = 0;
+    flushes = 0;
+    flushTime = 0.0;
+    maxFlushTime = 0.0;
+    statsTimer = nil;
+    batchTimer = nil;
   
     clientsInfo = [NSMutableArray new];    
+    /* the infos are owned by clientsInfo; these only index them, so
+       that neither a request nor an event walks every client */
+    clientsByConnection = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+                                           NSNonOwnedPointerMapValueCallBacks, 0);
+    listenersByPath = NSCreateMapTable(NSObjectMapKeyCallBacks,
+                                       NSObjectMapValueCallBacks, 0);
+    globalClients = [NSMutableSet new];
     watchers = NSCreateMapTable(NSObjectMapKeyCallBacks,
 	                                        NSObjectMapValueCallBacks, 0);
                                           
     watchDescrMap = NSCreateMapTable(NSIntMapKeyCallBacks,
 	                                     NSNonOwnedPointerMapValueCallBacks, 0);
                                           
-    includePathsTree = newTreeWithIdentifier(@"incl_paths");
-    excludePathsTree = newTreeWithIdentifier(@"excl_paths");
+    includePathsTree = newRadixTreeWithIdentifier(@"incl_paths");
+    excludePathsTree = newRadixTreeWithIdentifier(@"excl_paths");
     excludedSuffixes = [[NSMutableSet alloc] initWithCapacity: 1];
+    globalRoots = nil;
+
+    fanotifyHandle = nil;
+    fanotifyMounts = NULL;
+    fanotifyMountsCount = 0;
+    fanotifyDirs = nil;
+
+    if ([[NSUserDefaults standardUserDefaults] objectForKey: @"FSWatcherUsesFanotify"] == nil
+          || [[NSUserDefaults standardUserDefaults] boolForKey: @"FSWatcherUsesFanotify"]) {
+      [self startFanotify];
+    }
     
     [self setDefaultGlobalPaths];
 
@@ -232,10 +640,23 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 
     [nc addObserver: self
 	         selector: @selector(inotifyDataReady:)
-		           name: NSFileHandleReadCompletionNotification
+		           name: NSFileHandleDataAvailableNotification
 		         object: inotifyHandle];
   
-    [inotifyHandle readInBackgroundAndNotify];
+    [inotifyHandle waitForDataInBackgroundAndNotify];
+
+    {
+      double interval = [[NSUserDefaults standardUserDefaults] 
+                                  doubleForKey: @"FSWatcherStatisticsInterval"];
+
+      if (interval > 0) {
+        statsTimer = [NSTimer scheduledTimerWithTimeInterval: interval
+                                                      target: self
+                                                    selector: @selector(logStatistics:)
+                                                    userInfo: nil
+                                                     repeats: YES];
+      }
+    }
   }
   
   return self;    
@@ -248,6 +669,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 	      
   [info setConnection: newConn];
   [clientsInfo addObject: info];
+  NSMapInsert (clientsByConnection, (void *)newConn, (void *)info);
   RELEASE (info);
 
   [nc addObserver: self
@@ -291,7 +713,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 		[watcher removeListener];
 	    }
 	  
-	  [clientsInfo removeObject: info];
+	  [self removeClientInfo: info];
 	}
       
       if (auto_stop == YES && [clientsInfo count] <= 1)
@@ -308,6 +730,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 - (void)setDefaultGlobalPaths
 {
   NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSMutableArray *included = [NSMutableArray array];
   id entry;
   NSUInteger i;
   
@@ -317,16 +740,16 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   
   if (entry) {
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
+      [included addObject: [entry objectAtIndex: i]];
     }
   
   } else {
-    insertComponentsOfPath(NSHomeDirectory(), includePathsTree);
+    [included addObject: NSHomeDirectory()];
 
     entry = NSSearchPathForDirectoriesInDomains(NSAllApplicationsDirectory, 
                                                         NSAllDomainsMask, YES);
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
+      [included addObject: [entry objectAtIndex: i]];
     }
     
     entry = NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, 
@@ -336,22 +759,28 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
       NSString *path = [dir stringByAppendingPathComponent: @"Headers"];
 
       if ([fm fileExistsAtPath: path]) {
-        insertComponentsOfPath(path, includePathsTree);
+        [included addObject: path];
       }
       
       path = [dir stringByAppendingPathComponent: @"Documentation"];
       
       if ([fm fileExistsAtPath: path]) {
-        insertComponentsOfPath(path, includePathsTree);
+        [included addObject: path];
       }
     }  
   }
 
+  for (i = 0; i < [included count]; i++) {
+    radixInsertComponentsOfPath([included objectAtIndex: i], includePathsTree);
+  }
+  ASSIGN (globalRoots, included);
+  [self fanotifyMarkPaths: included];
+
   entry = [defaults arrayForKey: @"GSMetadataExcludedPaths"];
 
   if (entry) {
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], excludePathsTree);
+      radixInsertComponentsOfPath([entry objectAtIndex: i], excludePathsTree);
     }
   }
   
@@ -378,16 +807,18 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   
   NSUInteger i;
 
-  emptyTreeWithBase(includePathsTree);
+  radixEmptyTree(includePathsTree);
   
   for (i = 0; i < [indexable count]; i++) {
-    insertComponentsOfPath([indexable objectAtIndex: i], includePathsTree);
+    radixInsertComponentsOfPath([indexable objectAtIndex: i], includePathsTree);
   }
+  ASSIGN (globalRoots, (indexable ? indexable : [NSArray array]));
+  [self fanotifyMarkPaths: indexable];
 
-  emptyTreeWithBase(excludePathsTree);
+  radixEmptyTree(excludePathsTree);
   
   for (i = 0; i < [excluded count]; i++) {
-    insertComponentsOfPath([excluded objectAtIndex: i], excludePathsTree);
+    radixInsertComponentsOfPath([excluded objectAtIndex: i], excludePathsTree);
   }
   
   [excludedSuffixes removeAllObjects];
@@ -416,6 +847,9 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
     [(id)client setProtocolForProxy: @protocol(FSWClientProtocol)];
     [info setClient: client];  
     [info setGlobal: global];
+    if (global) {
+      [globalClients addObject: info];
+    }
   }
 }
 
@@ -452,7 +886,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 	              name: NSConnectionDidDieNotification
 	            object: connection];
 
-  [clientsInfo removeObject: info];
+  [self removeClientInfo: info];
   
   if (auto_stop == YES && [clientsInfo count] <= 1)
     {
@@ -465,17 +899,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 
 - (FSWClientInfo *)clientInfoWithConnection:(NSConnection *)connection
 {
-  NSUInteger i;
-
-  for (i = 0; i < [clientsInfo count]; i++) {
-    FSWClientInfo *info = [clientsInfo objectAtIndex: i];
-  
-		if ([info connection] == connection) {
-			return info;
-		}  
-  }
-
-	return nil;
+  return (FSWClientInfo *)NSMapGet(clientsByConnection, (void *)connection);
 }
 
 - (FSWClientInfo *)clientInfoWithRemote:(id)remote
@@ -493,6 +917,55 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   return nil;
 }
 
+- (void)removeClientInfo:(FSWClientInfo *)info
+{
+  NSEnumerator *enumerator = [[info watchedPaths] objectEnumerator];
+  NSString *wpath;
+
+  while ((wpath = [enumerator nextObject])) {
+    NSMutableSet *listeners = NSMapGet(listenersByPath, wpath);
+
+    [listeners removeObject: info];
+    if ([listeners count] == 0) {
+      NSMapRemove(listenersByPath, wpath);
+    }
+  }
+
+  [globalClients removeObject: info];
+  NSMapRemove(clientsByConnection, (void *)[info connection]);
+  [clientsInfo removeObject: info];
+}
+
+- (void)clientInfo:(FSWClientInfo *)info
+    addWatchedPath:(NSString *)path
+{
+  NSMutableSet *listeners = NSMapGet(listenersByPath, path);
+
+  if (listeners == nil) {
+    listeners = [NSMutableSet new];
+    NSMapInsert(listenersByPath, path, listeners);
+    RELEASE (listeners);
+  }
+  [listeners addObject: info];
+  [info addWatchedPath: path];
+}
+
+- (void)clientInfo:(FSWClientInfo *)info
+ removeWatchedPath:(NSString *)path
+{
+  [info removeWatchedPath: path];
+
+  /* a client can watch a path more than once */
+  if ([info isWathchingPath: path] == NO) {
+    NSMutableSet *listeners = NSMapGet(listenersByPath, path);
+
+    [listeners removeObject: info];
+    if ([listeners count] == 0) {
+      NSMapRemove(listenersByPath, path);
+    }
+  }
+}
+
 - (oneway void)client:(id <FSWClientProtocol>)client
                               addWatcherForPath:(NSString *)path
 {
@@ -512,7 +985,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   
   if (watcher) {
     GWDebugLog(@"watcher found; adding listener for: %@", path);
-    [info addWatchedPath: path];
+    [self clientInfo: info addWatchedPath: path];
     [watcher addListener]; 
         
   } else {
@@ -525,7 +998,7 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
       
       if (wd != -1) { 
         GWDebugLog(@"add watcher for: %@", path);      
-        [info addWatchedPath: path];
+        [self clientInfo: info addWatchedPath: path];
   	    watcher = [[Watcher alloc] initWithWatchedPath: path 
                                        watchDescriptor: wd
                                              fswatcher: self];      
@@ -562,13 +1035,125 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
   
   if (watcher) {
     GWDebugLog(@"remove listener for: %@", path);
-    [info removeWatchedPath: path];    
+    [self clientInfo: info removeWatchedPath: path];    
   	[watcher removeListener];  
   }
   
   GWDebugLog(@"watchers: %lu", (unsigned long)NSCountMapTable(watchers));
 }
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setBatchedDelivery:(BOOL)flag
+{
+  NSConnection *connection = [(NSDistantObject *)client connectionForProxy];
+  FSWClientInfo *info = [self clientInfoWithConnection: connection];
+
+  if (info == nil || [info client] == nil) {
+    [NSException raise: NSInternalInconsistencyException
+                format: @"batched delivery for unregistered client"];
+  }
+
+  [info setBatched: flag];
+}
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                didProcessBatch:(unsigned long long)sequence
+{
+  NSConnection *connection = [(NSDistantObject *)client connectionForProxy];
+
+  [[self clientInfoWithConnection: connection] batchProcessed: sequence];
+}
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setFilter:(bycopy NSDictionary *)filter
+{
+  NSConnection *connection = [(NSDistantObject *)client connectionForProxy];
+  FSWClientInfo *info = [self clientInfoWithConnection: connection];
+
+  if (info == nil || [info client] == nil) {
+    [NSException raise: NSInternalInconsistencyException
+                format: @"filter for unregistered client"];
+  }
+
+  [info setFilter: filter];
+}
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setCoalescingWindow:(double)seconds
+                                adaptive:(BOOL)flag
+{
+  NSConnection *connection = [(NSDistantObject *)client connectionForProxy];
+  FSWClientInfo *info = [self clientInfoWithConnection: connection];
+
+  if (info == nil || [info client] == nil) {
+    [NSException raise: NSInternalInconsistencyException
+                format: @"coalescing window for unregistered client"];
+  }
+
+  [info setCoalescingWindow: seconds adaptive: flag];
+}
+
+- (bycopy NSDictionary *)statistics
+{
+  NSMutableDictionary *stats = [NSMutableDictionary dictionary];
+  NSMutableArray *perClient = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [clientsInfo count]; i++) {
+    FSWClientInfo *info = [clientsInfo objectAtIndex: i];
+
+    [perClient addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+              [NSNumber numberWithBool: [info isGlobal]], @"global",
+              [NSNumber numberWithBool: [info isBatched]], @"batched",
+              [NSNumber numberWithUnsignedInteger: [[info watchedPaths] count]], @"watchedPaths",
+              [NSNumber numberWithUnsignedLongLong: [info deliveredEvents]], @"delivered",
+              nil]];
+  }
+
+  [stats setObject: [NSNumber numberWithUnsignedInteger: NSCountMapTable(watchers)]
+            forKey: @"watches"];
+  [stats setObject: [NSNumber numberWithUnsignedLongLong: queuedEvents]
+            forKey: @"eventsReceived"];
+  [stats setObject: [NSNumber numberWithDouble: eventRate]
+            forKey: @"eventsPerSecond"];
+  [stats setObject: [NSNumber numberWithUnsignedLongLong: coalescedEvents]
+            forKey: @"eventsCoalesced"];
+  [stats setObject: [NSNumber numberWithUnsignedInteger: eventsCount]
+            forKey: @"queueDepth"];
+  [stats setObject: [NSNumber numberWithUnsignedLongLong: flushes]
+            forKey: @"flushes"];
+  [stats setObject: [NSNumber numberWithDouble: flushTime]
+            forKey: @"flushTime"];
+  [stats setObject: [NSNumber numberWithDouble: maxFlushTime]
+            forKey: @"maxFlushTime"];
+  [stats setObject: [NSNumber numberWithUnsignedLongLong: overflows]
+            forKey: @"overflows"];
+  [stats setObject: [NSNumber numberWithBool: (fanotifyHandle != nil)]
+            forKey: @"fanotify"];
+  [stats setObject: perClient forKey: @"clients"];
+
+  return stats;
+}
+
+/* One line per FSWatcherStatisticsInterval seconds, when set. */
+- (void)logStatistics:(id)sender
+{
+  NSMutableString *delivered = [NSMutableString string];
+  NSUInteger i;
+
+  for (i = 0; i < [clientsInfo count]; i++) {
+    [delivered appendFormat: @"%s%llu", (i ? "," : ""),
+               [[clientsInfo objectAtIndex: i] deliveredEvents]];
+  }
+
+  NSLog(@"fswatcher: %lu watches, %.0f events/s, %llu received, %llu coalesced, "
+        @"queue %lu, flush %.2f ms avg %.2f ms max, %llu overflows, delivered [%@]",
+        (unsigned long)NSCountMapTable(watchers), eventRate, queuedEvents,
+        coalescedEvents, (unsigned long)eventsCount,
+        flushes ? flushTime * 1000.0 / flushes : 0.0, maxFlushTime * 1000.0,
+        overflows, delivered);
+}
+
 - (Watcher *)watcherForPath:(NSString *)path
 {
   return (Watcher *)NSMapGet(watchers, path);
@@ -602,15 +1187,32 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 {
   CREATE_AUTORELEASE_POOL(pool);
   NSString *path = [info objectForKey: @"path"];
-  NSData *data = [NSArchiver archivedDataWithRootObject: info];
+  NSArray *listeners = [(NSSet *)NSMapGet(listenersByPath, path) allObjects];
+  NSString *file = [[info objectForKey: @"files"] lastObject];
+  NSString *evpath = nil;
+  uint8_t type = FSWBatchEventType([info objectForKey: @"event"]);
+  NSData *data = nil;
   NSUInteger i;
 
-  for (i = 0; i < [clientsInfo count]; i++) {
-    FSWClientInfo *clinfo = [clientsInfo objectAtIndex: i];
-  
-		if ([clinfo isWathchingPath: path]) {
-			[[clinfo client] watchedPathDidChange: data];
-		}
+  for (i = 0; i < [listeners count]; i++) {
+    FSWClientInfo *clinfo = [listeners objectAtIndex: i];
+
+    if (evpath == nil) {
+      evpath = file ? [path stringByAppendingPathComponent: file] : path;
+    }
+    if ([clinfo acceptsEvent: type atPath: evpath] == NO) {
+      continue;
+    }
+
+    if ([clinfo isBatched]) {
+      [clinfo queueRecord: type path: path extra: file];
+    } else {
+      if (data == nil) {
+        data = [NSArchiver archivedDataWithRootObject: info];
+      }
+      [[clinfo client] watchedPathDidChange: data];
+      [clinfo countDeliveredEvent];
+    }
   }
 
   RELEASE (pool);  
@@ -618,13 +1220,25 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 
 - (void)notifyGlobalWatchingClients:(NSDictionary *)info
 {
+  NSArray *globals = [globalClients allObjects];
+  NSString *path = [info objectForKey: @"path"];
+  uint8_t type = FSWBatchEventType([info objectForKey: @"event"]) | FSWBatchGlobal;
   NSUInteger i;
 
-  for (i = 0; i < [clientsInfo count]; i++) {
-    FSWClientInfo *clinfo = [clientsInfo objectAtIndex: i];
+  for (i = 0; i < [globals count]; i++) {
+    FSWClientInfo *clinfo = [globals objectAtIndex: i];
+
+    if ([clinfo acceptsEvent: type atPath: path] == NO) {
+      continue;
+    }
 
-    if ([clinfo isGlobal]) {
+    if ([clinfo isBatched]) {
+      [clinfo queueRecord: type
+                     path: path
+                    extra: [info objectForKey: @"oldpath"]];
+    } else {
       [[clinfo client] globalWatchedPathDidChange: info];
+      [clinfo countDeliveredEvent];
     }
   }
 }
@@ -632,12 +1246,9 @@ static NSString *GWWatchedPathRenamed = @"GWWatchedPathRenamed";
 - (void)checkLastMovedPath:(id)sender
 {
   if (lastMovedPath != nil) {  
-    NSMutableDictionary *notifdict = [NSMutableDictionary dictionary];
-    
-    [notifdict setObject: lastMovedPath forKey: @"path"];        
-    [notifdict setObject: GWWatchedPathDeleted forKey: @"event"];
-    
-    [self notifyGlobalWatchingClients: notifdict];   
+    [self queueGlobalEvent: GWWatchedPathDeleted 
+                   forPath: lastMovedPath 
+                   oldPath: nil];   
     
     GWDebugLog(@"%@ MOVED to not indexable path", lastMovedPath);         
   }
@@ -697,178 +1308,345 @@ static inline BOOL isDotFile(NSString *path)
 }
 
 
-/*
-#define EV_GRAIN (0.2)
-#define EV_TIMEOUT (0.5)
+/* Events wait in the queue until the next flush, so that a burst on
+ * one path (a build, a checkout) reaches the clients once.  The wait
+ * grows with the event rate: a lone event goes out almost at once. */
+#define EV_MIN_GRAIN (0.02)
+#define EV_MAX_GRAIN (0.5)
+#define EV_BUSY_RATE (2000.0)   /* events per second with the longest wait */
+#define EV_QUEUE_LIMIT (16384)  /* pending events that force a flush */
 
-- (void)queueEvent:(NSString *)event
-            atPath:(NSString *)path
-           forFile:(NSString *)fname
+static inline NSUInteger eventHash(uint32_t path, uint32_t file, BOOL global)
 {
-  NSMutableDictionary *dict = nil;
-  NSString *fullpath = path;
-  NSDate *now = [NSDate date];
-  BOOL exists = (event == GWFileCreatedInWatchedDirectory
-                            || event == GWWatchedFileModified 
-                              || event == GWWatchedPathRenamed);
-  
-  if (event == GWFileCreatedInWatchedDirectory
-          || event == GWFileDeletedInWatchedDirectory) {
-    fullpath = [path stringByAppendingPathComponent: fname];
-  }
-  
-  dict = [eventsQueue objectForKey: fullpath];
-  
-  if (dict) {
-    NSDate *stamp = [dict objectForKey: @"stamp"];
-    NSTimeInterval interval = [now timeIntervalSinceDate: stamp];
-    NSString *lastevent = [dict objectForKey: @"event"];
-    BOOL didexist = (lastevent == GWFileCreatedInWatchedDirectory
-                              || lastevent == GWWatchedFileModified 
-                                  || lastevent == GWWatchedPathRenamed);
-    
-    if (exists == didexist) {
-      [dict setObject: event forKey: @"event"];
-    } else {
-      if (interval < EV_GRAIN) {
-        [eventsQueue removeObjectForKey: fullpath];
-      } else {
-        [dict setObject: event forKey: @"event"];
-        [dict setObject: now forKey: @"stamp"];
-      }
-    }  
-      
-  } else {
-    dict = [NSMutableDictionary dictionary];
-    
-    [dict setObject: event forKey: @"event"];
-    [dict setObject: now forKey: @"stamp"];
-    
-    [eventsQueue setObject: dict forKey: fullpath];
-  }
+  uint64_t h = ((uint64_t)path << 32) ^ ((uint64_t)file << 1) ^ (global ? 1 : 0);
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+
+  return (NSUInteger)h;
 }
 
-- (void)queueGlobalEvent:(NSString *)event
-                 forPath:(NSString *)path
-                 oldPath:(NSString *)oldpath
+static inline BOOL isRemovalEvent(NSString *event)
 {
-  NSMutableDictionary *dict = [globalEventsQueue objectForKey: path];
-  NSDate *now = [NSDate date];
-  BOOL exists = (event == GWFileCreatedInWatchedDirectory
-                            || event == GWWatchedFileModified 
-                              || event == GWWatchedPathRenamed);
-  
-  if (dict) {
-    NSDate *stamp = [dict objectForKey: @"stamp"];
-    NSTimeInterval interval = [now timeIntervalSinceDate: stamp];
-    NSString *lastevent = [dict objectForKey: @"event"];
-    BOOL didexist = (lastevent == GWFileCreatedInWatchedDirectory
-                              || lastevent == GWWatchedFileModified 
-                                  || lastevent == GWWatchedPathRenamed);
-  
-    if (exists == didexist) {
-      [dict setObject: event forKey: @"event"];
-    } else {
-      if (interval < EV_GRAIN) {
-        [eventsQueue removeObjectForKey: fullpath];
-      } else {
-        [dict setObject: event forKey: @"event"];
-        [dict setObject: now forKey: @"stamp"];
-      }
-    }  
-  
-  } else {
-    dict = [NSMutableDictionary dictionary];
-    
-    [dict setObject: event forKey: @"event"];
-    [dict setObject: now forKey: @"stamp"];    
-    if (event == GWWatchedPathRenamed) {
-      [dict setObject: oldpath forKey: @"oldpath"]; 
+  return (event == GWFileDeletedInWatchedDirectory 
+            || event == GWWatchedPathDeleted);
+}
+
+- (uint32_t)internPath:(NSString *)path
+{
+  uintptr_t pid;
+
+  if (path == nil) {
+    return 0;
+  }
+
+  pid = (uintptr_t)NSMapGet(pathIds, path);
+
+  if (pid == 0) {
+    [internedPaths addObject: path];
+    pid = [internedPaths count];
+    NSMapInsert(pathIds, path, (void *)pid);
+  }
+
+  return (uint32_t)pid;
+}
+
+- (NSString *)internedPath:(uint32_t)pid
+{
+  return (pid != 0) ? [internedPaths objectAtIndex: pid - 1] : nil;
+}
+
+/* The last queued event for the key, dead or live; *slot is where the
+ * key's entry is, or goes. */
+- (fsw_event *)pendingEventForPath:(uint32_t)path
+                              file:(uint32_t)file
+                            global:(BOOL)global
+                              slot:(NSUInteger *)slot
+{
+  NSUInteger mask = slotsCount - 1;
+  NSUInteger i = eventHash(path, file, global) & mask;
+
+  while (eventSlots[i] != 0) {
+    fsw_event *ev = &events[eventSlots[i] - 1];
+
+    if (ev->path == path && ev->file == file && ev->global == global) {
+      *slot = i;
+      return ev;
     }
-    
-    [globalEventsQueue setObject: dict forKey: fullpath];
+    i = (i + 1) & mask;
   }
+
+  *slot = i;
+  return NULL;
+}
+
+- (void)growEventQueue
+{
+  NSUInteger i;
+
+  eventsCapacity = (eventsCapacity > 0) ? (eventsCapacity * 2) : 256;
+  events = realloc(events, eventsCapacity * sizeof(fsw_event));
+
+  /* at most half full, so probes stay short */
+  slotsCount = eventsCapacity * 2;
+  free(eventSlots);
+  eventSlots = calloc(slotsCount, sizeof(uint32_t));
+
+  if (events == NULL || eventSlots == NULL) {
+    NSDebugLLog(@"gwspace", @"out of memory for the event queue");
+    exit(EXIT_FAILURE);
+  }
+
+  for (i = 0; i < eventsCount; i++) {
+    fsw_event *ev = &events[i];
+    NSUInteger slot;
+
+    [self pendingEventForPath: ev->path file: ev->file 
+                       global: ev->global slot: &slot];
+    eventSlots[slot] = i + 1;
+  }
+}
+
+- (double)flushInterval
+{
+  double busy = eventRate / EV_BUSY_RATE;
+
+  if (busy > 1.0) {
+    busy = 1.0;
+  }
+
+  return EV_MIN_GRAIN + (EV_MAX_GRAIN - EV_MIN_GRAIN) * busy;
+}
+
+/*
+ * A new event for a path with one pending is folded into it when the
+ * clients would see the same end state: a repeat, a change to what was
+ * just created or renamed, a removal after a change.  Something created
+ * and removed again before the flush is never seen at all.  Anything
+ * else is queued behind the pending event.
+ */
+- (void)enqueueEvent:(NSString *)event
+                path:(uint32_t)path
+                file:(uint32_t)file
+             oldPath:(uint32_t)oldpath
+              global:(BOOL)global
+{
+  NSUInteger slot;
+  fsw_event *ev;
+
+  queuedEvents++;
+
+  if (eventsCount == eventsCapacity) {
+    [self growEventQueue];
+  }
+
+  ev = [self pendingEventForPath: path file: file global: global slot: &slot];
+
+  if (ev && ev->live) {
+    NSString *last = ev->event;
+
+    if ((last == event && event != GWWatchedPathRenamed)
+          || ((last == GWFileCreatedInWatchedDirectory 
+                || last == GWWatchedPathRenamed) 
+                  && (event == GWWatchedFileModified
+                        || event == GWFileModifiedInWatchedDirectory))) {
+      return;
+    }
+    if (last == GWFileCreatedInWatchedDirectory && isRemovalEvent(event)) {
+      ev->live = NO;
+      return;
+    }
+    if (last == GWWatchedFileModified && isRemovalEvent(event)) {
+      ev->event = event;
+      return;
+    }
+  }
+
+  ev = &events[eventsCount];
+  ev->event = event;
+  ev->path = path;
+  ev->file = file;
+  ev->oldpath = oldpath;
+  ev->global = global;
+  ev->live = YES;
+  eventSlots[slot] = ++eventsCount;
+
+  if (eventsCount >= EV_QUEUE_LIMIT) {
+    [self processPendingEvents: nil];
+  } else if (flushTimer == nil) {
+    flushTimer = [NSTimer scheduledTimerWithTimeInterval: [self flushInterval]
+                                                  target: self 
+                                                selector: @selector(processPendingEvents:) 
+                                                userInfo: nil 
+                                                 repeats: NO];
+  }
+}
+
+- (void)queueEvent:(NSString *)event
+            atPath:(NSString *)path
+           forFile:(NSString *)fname
+{
+  [self enqueueEvent: event
+                path: [self internPath: path]
+                file: [self internPath: fname]
+             oldPath: 0
+              global: NO];
+}
+
+- (void)queueGlobalEvent:(NSString *)event
+                 forPath:(NSString *)path
+                 oldPath:(NSString *)oldpath
+{
+  [self enqueueEvent: event
+                path: [self internPath: path]
+                file: 0
+             oldPath: [self internPath: oldpath]
+              global: YES];
 }
 
 - (void)processPendingEvents:(id)sender
 {
-  NSArray *paths = [eventsQueue allKeys];
-  NSDate *now = [NSDate date];
-  int i;
-  
-  RETAIN (paths);
-  
-  for (i = 0; i < [paths count]; i++) {
-    NSString *path = [paths objectAtIndex: i];
-    NSDictionary *dict = [eventsQueue objectForKey: path];
-    NSDate *stamp = [dict objectForKey: @"stamp"];
+  CREATE_AUTORELEASE_POOL(pool);
+  unsigned long long received = queuedEvents - flushedEvents;
+  NSUInteger delivered = 0;
+  double now = monotonicTime();
+  double elapsed = now - lastFlush;
+  NSUInteger i;
 
-    if ([now timeIntervalSinceDate: stamp] >= EV_TIMEOUT) {
-      NSMutableDictionary *notifdict = [NSMutableDictionary dictionary];
-      NSString *event = [dict objectForKey: @"event"];
-      NSString *basepath = path;
-      
-      [notifdict setObject: event forKey: @"event"];
-      
-      if (event == GWFileCreatedInWatchedDirectory
-          || event == GWFileDeletedInWatchedDirectory) {
-        NSString *fname = [path lastPathComponent];    
-        
-        [notifdict setObject: [NSArray arrayWithObject: fname] 
+  [flushTimer invalidate];
+  flushTimer = nil;
+
+  for (i = 0; i < eventsCount; i++) {
+    fsw_event *ev = &events[i];
+    NSMutableDictionary *notifdict;
+
+    if (ev->live == NO) {
+      continue;
+    }
+
+    notifdict = [NSMutableDictionary dictionary];
+    [notifdict setObject: ev->event forKey: @"event"];
+    [notifdict setObject: [self internedPath: ev->path] forKey: @"path"];
+
+    if (ev->global) {
+      if (ev->oldpath != 0) {
+        [notifdict setObject: [self internedPath: ev->oldpath] 
+                      forKey: @"oldpath"]; 
+      }
+      [self notifyGlobalWatchingClients: notifdict];
+
+    } else {
+      if (ev->file != 0) {
+        [notifdict setObject: [NSArray arrayWithObject: [self internedPath: ev->file]] 
                       forKey: @"files"];
-        
-        basepath = [path stringByDeletingLastPathComponent];          
       }
-      
-      [notifdict setObject: basepath forKey: @"path"];
-      
       [self notifyClients: notifdict];
-      
-      [eventsQueue removeObjectForKey: path];
     }
+
+    delivered++;
   }
 
-  RELEASE (paths);
+  /* at most one message per batched client and coalescing window */
+  [self sendDueBatches: nil];
 
-  paths = [globalEventsQueue allKeys];
-  
-  for (i = 0; i < [paths count]; i++) {
-    NSString *path = [paths objectAtIndex: i];
-    NSDictionary *dict = [eventsQueue objectForKey: path];
-    NSDate *stamp = [dict objectForKey: @"stamp"];
+  if (received > delivered) {
+    coalescedEvents += received - delivered;
+    NSDebugLLog(@"gwspace", @"%llu events delivered as %lu (%llu coalesced in all)",
+                received, (unsigned long)delivered, coalescedEvents);
+  }
 
-    if ([now timeIntervalSinceDate: stamp] >= EV_TIMEOUT) {
-      NSMutableDictionary *notifdict = [NSMutableDictionary dictionary];
-      NSString *event = [dict objectForKey: @"event"];
-      
-      [notifdict setObject: event forKey: @"event"];
-      [notifdict setObject: path forKey: @"path"];
-  
-      if (event == GWWatchedPathRenamed) {
-        [notifdict setObject: [dict objectForKey: @"oldpath"] 
-                      forKey: @"oldpath"]; 
-      }
-    
-      [self notifyGlobalWatchingClients: notifdict];
-      
-      [globalEventsQueue removeObjectForKey: path];
+  eventsCount = 0;
+  if (eventSlots) {
+    memset(eventSlots, 0, slotsCount * sizeof(uint32_t));
+  }
+  NSResetMapTable(pathIds);
+  [internedPaths removeAllObjects];
+
+  if (elapsed < EV_MIN_GRAIN) {
+    elapsed = EV_MIN_GRAIN;
+  }
+  eventRate = (eventRate + received / elapsed) / 2;
+  lastFlush = now;
+  flushedEvents = queuedEvents;
+
+  {
+    double spent = monotonicTime() - now;
+
+    flushes++;
+    flushTime += spent;
+    if (spent > maxFlushTime) {
+      maxFlushTime = spent;
     }
   }
-  
-  RELEASE (paths);
+
+  RELEASE (pool);
 }
 
-*/
 
 
+- (BOOL)isGlobalWatchedPath:(NSString *)path
+{
+  NSString *ext = [[path pathExtension] lowercaseString];
+
+  return (([excludedSuffixes containsObject: ext] == NO)
+            && (isDotFile(path) == NO) 
+            && radixInTreeFirstPartOfPath(path, includePathsTree)
+            && (radixInTreeFirstPartOfPath(path, excludePathsTree) == NO));
+}
+
+- (void)sendDueBatches:(id)sender
+{
+  double now = monotonicTime();
+  double next = 0;
+  NSUInteger i;
+
+  [batchTimer invalidate];
+  batchTimer = nil;
+
+  for (i = 0; i < [clientsInfo count]; i++) {
+    FSWClientInfo *clinfo = [clientsInfo objectAtIndex: i];
+
+    if ([clinfo isBatched]) {
+      double due = [clinfo sendBatchAt: now];
+
+      if (due > 0 && (next == 0 || due < next)) {
+        next = due;
+      }
+    }
+  }
+
+  if (next > 0) {
+    batchTimer = [NSTimer scheduledTimerWithTimeInterval: next - now
+                                                  target: self
+                                                selector: @selector(sendDueBatches:)
+                                                userInfo: nil
+                                                 repeats: NO];
+  }
+}
+
 - (void)inotifyDataReady:(NSNotification *)notif
 {
-  NSDictionary *info = [notif userInfo];
-  NSData *data = [info objectForKey: NSFileHandleNotificationDataItem];
+  FSN_TRACE_SCOPE ("fswatcher read events");
   unsigned evsize = sizeof(struct inotify_event);
+  NSUInteger pending = [inotifyPendingData length];
+  BOOL overflowed = NO;
+  ssize_t n;
+
+  [inotifyPendingData setLength: pending + inotifyReadSize];
+  n = read([inotifyHandle fileDescriptor], 
+           (char *)[inotifyPendingData mutableBytes] + pending, inotifyReadSize);
 
-  if (data && [data length] > 0) {
-    [inotifyPendingData appendData: data];
+  if (n < 0) {
+    if (errno != EINTR && errno != EAGAIN) {
+      NSDebugLLog(@"gwspace", @"inotify read failed: %s", strerror(errno));
+    }
+    n = 0;
+  }
+  [inotifyPendingData setLength: pending + n];
+
+  if ((size_t)n == inotifyReadSize && inotifyReadSize < INOTIFY_READ_MAX) {
+    inotifyReadSize *= 2;
   }
 
   const uint8_t *bytes = (const uint8_t *)[inotifyPendingData bytes];
@@ -890,99 +1668,99 @@ static inline BOOL isDotFile(NSString *path)
     }
 
     uint32_t type = eventType(eventp->mask);
+
+    if (eventp->mask & IN_Q_OVERFLOW) {
+      overflowed = YES;
+    }
     
     if (type != IN_IGNORED && eventp->len) {
       Watcher *watcher = [self watcherWithWatchDescriptor: eventp->wd];
       
       if (watcher) {
         CREATE_AUTORELEASE_POOL(arp);
-        NSMutableDictionary *notifdict = [NSMutableDictionary dictionary];
         NSString *basepath = [watcher watchedPath];
         NSString *fullpath = basepath;
         NSString *fname = [NSString stringWithUTF8String: eventp->name];         
-        NSString *ext = [[fname pathExtension] lowercaseString];
+        NSString *event = nil;
+        NSString *evpath = basepath;
+        NSString *evfile = nil;
+        NSString *oldpath = nil;
         BOOL dirwatch = [watcher isDirWatcher];
-        BOOL notify = YES;
-        
-        [notifdict setObject: basepath forKey: @"path"];
+        BOOL notify;
             
         if (dirwatch) {    
           if (type == IN_DELETE_SELF) {     
-            [notifdict setObject: GWWatchedPathDeleted forKey: @"event"];
+            event = GWWatchedPathDeleted;
             
           } else if (type == IN_DELETE || type == IN_MOVED_FROM) {
-            [notifdict setObject: [NSArray arrayWithObject: fname] 
-                          forKey: @"files"];            
-            [notifdict setObject: GWFileDeletedInWatchedDirectory 
-                          forKey: @"event"];
+            event = GWFileDeletedInWatchedDirectory;
+            evfile = fname;
             fullpath = [basepath stringByAppendingPathComponent: fname];
                            
           } else if (type == IN_CREATE || type == IN_MOVED_TO) {
-            [notifdict setObject: [NSArray arrayWithObject: fname] 
-                          forKey: @"files"];            
-            [notifdict setObject: GWFileCreatedInWatchedDirectory 
-                          forKey: @"event"];
+            event = GWFileCreatedInWatchedDirectory;
+            evfile = fname;
             fullpath = [basepath stringByAppendingPathComponent: fname];
               
           } else if (type == IN_MODIFY) {
-            [notifdict setObject: GWWatchedFileModified forKey: @"event"];
             fullpath = [basepath stringByAppendingPathComponent: fname];
             
             if ([self watcherForPath: fullpath] != nil) { 
-              [notifdict setObject: fullpath forKey: @"path"];
+              event = GWWatchedFileModified;
+              evpath = fullpath;
             } else {
               fullpath = basepath;
-              notify = NO;               
             }
-            
-          } else {
-            notify = NO;
+
+          } else if (type == IN_CLOSE_WRITE) {
+            /* a file of the directory was written and closed: its
+               own watcher, if any, reports it */
+            if ([self watcherForPath: 
+                        [basepath stringByAppendingPathComponent: fname]] == nil) {
+              event = GWFileModifiedInWatchedDirectory;
+              evfile = fname;
+            }
           }
           
         } else {
           if (type == IN_MODIFY || type == IN_CLOSE_WRITE) {
-            [notifdict setObject: GWWatchedFileModified forKey: @"event"];
+            event = GWWatchedFileModified;
           } else if (type == IN_DELETE_SELF) {
-            [notifdict setObject: GWWatchedPathDeleted forKey: @"event"];          
+            event = GWWatchedPathDeleted;
           } else if (type == IN_MOVE_SELF) {
-            [notifdict setObject: GWWatchedPathRenamed forKey: @"event"];          
-          } else {
-            notify = NO;
+            event = GWWatchedPathRenamed;
           }
         }   
         
+        notify = (event != nil);
+
         if (notify) {
-          [self notifyClients: notifdict];
+          [self queueEvent: event atPath: evpath forFile: evfile];
         }         
                 
-        notify = (notify && ([excludedSuffixes containsObject: ext] == NO)
-                   && (isDotFile(fullpath) == NO) 
-                   && inTreeFirstPartOfPath(fullpath, includePathsTree)
-                   && (inTreeFirstPartOfPath(fullpath, excludePathsTree) == NO));
+        /* with fanotify the global events come from its marks */
+        notify = (notify && (fanotifyHandle == nil)
+                   && [self isGlobalWatchedPath: fullpath]);
         
         if (notify) {
-          [notifdict removeAllObjects]; 
-          
-          [notifdict setObject: fullpath forKey: @"path"];
+          event = nil;
           
           if (type == IN_DELETE || type == IN_DELETE_SELF) {       
-            [notifdict setObject: GWWatchedPathDeleted forKey: @"event"];
+            event = GWWatchedPathDeleted;
             GWDebugLog(@"DELETE %@", fullpath); 
             
           } else if (type == IN_CREATE) {
-            [notifdict setObject: GWFileCreatedInWatchedDirectory 
-                          forKey: @"event"];        
+            event = GWFileCreatedInWatchedDirectory;
             GWDebugLog(@"CREATED %@", fullpath); 
                      
           } else if (type == IN_MODIFY 
                         || ((dirwatch == NO) && type == IN_CLOSE_WRITE)) {
-            [notifdict setObject: GWWatchedFileModified forKey: @"event"];        
+            event = GWWatchedFileModified;
             GWDebugLog(@"MODIFIED %@", fullpath); 
                  
           } else if (type == IN_MOVED_FROM || type == IN_MOVE_SELF) {  
             ASSIGN (lastMovedPath, fullpath);
             moveCookie = eventp->cookie;          
-            notify = NO;
             GWDebugLog(@"MOVE from indexable path: %@", fullpath);
             
             [NSTimer scheduledTimerWithTimeInterval: 0.1 
@@ -993,25 +1771,21 @@ static inline BOOL isDotFile(NSString *path)
             
           } else if (type == IN_MOVED_TO) {              
             if ((eventp->cookie == moveCookie) && (lastMovedPath != nil)) {
-              [notifdict setObject: lastMovedPath forKey: @"oldpath"];
-              [notifdict setObject: GWWatchedPathRenamed forKey: @"event"];
+              oldpath = AUTORELEASE (RETAIN (lastMovedPath));
+              event = GWWatchedPathRenamed;
               GWDebugLog(@"MOVED from: %@ to: %@", lastMovedPath, fullpath);
             
             } else {
-              [notifdict setObject: GWFileCreatedInWatchedDirectory 
-                            forKey: @"event"];             
+              event = GWFileCreatedInWatchedDirectory;
               GWDebugLog(@"MOVED from not indexable path: %@", fullpath); 
             }
             
             DESTROY (lastMovedPath);
             moveCookie = 0;
-          
-          } else {
-            notify = NO;
           }
           
-          if (notify) {
-            [self notifyGlobalWatchingClients: notifdict];
+          if (event != nil) {
+            [self queueGlobalEvent: event forPath: fullpath oldPath: oldpath];
           }                   
         } 
         
@@ -1029,10 +1803,524 @@ static inline BOOL isDotFile(NSString *path)
       [inotifyPendingData replaceBytesInRange: NSMakeRange(0, processed) withBytes: NULL length: 0];
     }
   }
+
+  if (overflowed) {
+    [self inotifyQueueOverflowed];
+  }
+  lastEventsRead = [NSDate timeIntervalSinceReferenceDate];
       
-  [inotifyHandle readInBackgroundAndNotify];
+  [inotifyHandle waitForDataInBackgroundAndNotify];
+}
+
+/*
+ * The kernel dropped events.  Nothing says which, so every watched
+ * directory may be stale: each client gets a rescan record for each of
+ * its watched paths, and global clients, when their events come from
+ * inotify, an mtime rescan of the global paths.
+ */
+- (void)inotifyQueueOverflowed
+{
+  NSUInteger i;
+
+  overflows++;
+  NSDebugLLog(@"gwspace", @"inotify queue overflow; read buffer now %lu bytes",
+              (unsigned long)INOTIFY_READ_MAX);
+  inotifyReadSize = INOTIFY_READ_MAX;
+
+  for (i = 0; i < [clientsInfo count]; i++) {
+    FSWClientInfo *clinfo = [clientsInfo objectAtIndex: i];
+    NSEnumerator *enumerator = [[clinfo watchedPaths] objectEnumerator];
+    NSString *wpath;
+
+    while ((wpath = [enumerator nextObject])) {
+      if ([clinfo isBatched]) {
+        [clinfo queueRecord: FSWBatchRescan path: wpath extra: nil];
+      } else {
+        NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+                                             FSWRescanEvent, @"event",
+                                           wpath, @"path", nil];
+        [[clinfo client] watchedPathDidChange: 
+                           [NSArchiver archivedDataWithRootObject: info]];
+      }
+    }
+  }
+
+  if (fanotifyHandle == nil) {
+    [self scheduleGlobalRescanSince: lastEventsRead - RESCAN_SLACK];
+  }
+
+  [self processPendingEvents: nil];
+}
+
+- (void)notifyGlobalRescanOfPath:(NSString *)path
+{
+  NSArray *globals = [globalClients allObjects];
+  NSDictionary *info = nil;
+  NSUInteger i;
+
+  for (i = 0; i < [globals count]; i++) {
+    FSWClientInfo *clinfo = [globals objectAtIndex: i];
+
+    if ([clinfo isBatched]) {
+      [clinfo queueRecord: FSWBatchRescan | FSWBatchGlobal path: path extra: nil];
+    } else {
+      if (info == nil) {
+        info = [NSDictionary dictionaryWithObjectsAndKeys:
+                               FSWRescanEvent, @"event", path, @"path", nil];
+      }
+      [[clinfo client] globalWatchedPathDidChange: info];
+    }
+  }
+}
+
+/*
+ * Walks the global paths a few hundred entries at a time, reporting
+ * files modified since the events were lost and, as rescan records,
+ * directories whose contents changed, which covers removals.  Past
+ * RESCAN_LIMIT entries the roots not walked yet are handed to the
+ * clients as rescans.  A new overflow during a walk starts it over
+ * from the earlier time.
+ */
+- (void)scheduleGlobalRescanSince:(double)since
+{
+  if ([globalClients count] == 0) {
+    return;
+  }
+
+  if (rescanTimer != nil && rescanSince < since) {
+    since = rescanSince;
+  }
+  rescanSince = since;
+  rescanVisited = 0;
+  DESTROY (rescanEnum);
+  DESTROY (rescanRoot);
+  [rescanRoots removeAllObjects];
+
+  [rescanRoots addObjectsFromArray: globalRoots];
+
+  if (rescanTimer == nil) {
+    rescanTimer = [NSTimer scheduledTimerWithTimeInterval: 0.05
+                                                   target: self
+                                                 selector: @selector(globalRescanStep:)
+                                                 userInfo: nil
+                                                  repeats: YES];
+  }
 }
 
+- (void)globalRescanStep:(id)sender
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSUInteger count = 0;
+
+  while (count < RESCAN_STEP) {
+    NSString *name;
+
+    if (rescanEnum == nil) {
+      if ([rescanRoots count] == 0) {
+        break;
+      }
+      ASSIGN (rescanRoot, [rescanRoots objectAtIndex: 0]);
+      [rescanRoots removeObjectAtIndex: 0];
+
+      if (rescanVisited >= RESCAN_LIMIT) {
+        [self notifyGlobalRescanOfPath: rescanRoot];
+        DESTROY (rescanRoot);
+        continue;
+      }
+      ASSIGN (rescanEnum, [fm enumeratorAtPath: rescanRoot]);
+      continue;
+    }
+
+    name = [rescanEnum nextObject];
+
+    if (name == nil || rescanVisited >= RESCAN_LIMIT) {
+      if (name != nil) {
+        /* the rest of this root as well */
+        [self notifyGlobalRescanOfPath: rescanRoot];
+      }
+      DESTROY (rescanEnum);
+      DESTROY (rescanRoot);
+      continue;
+    }
+
+    count++;
+    rescanVisited++;
+
+    {
+      NSString *path = [rescanRoot stringByAppendingPathComponent: name];
+      NSDictionary *attrs = [rescanEnum fileAttributes];
+      NSString *type = [attrs fileType];
+      double mtime = [[attrs fileModificationDate] timeIntervalSinceReferenceDate];
+
+      if ([type isEqual: NSFileTypeDirectory]) {
+        if ([self isGlobalWatchedPath: path] == NO) {
+          [rescanEnum skipDescendents];
+        } else if (mtime >= rescanSince) {
+          [self notifyGlobalRescanOfPath: path];
+        }
+      } else if (mtime >= rescanSince && [self isGlobalWatchedPath: path]) {
+        [self queueGlobalEvent: GWWatchedFileModified forPath: path oldPath: nil];
+      }
+    }
+  }
+
+  if (rescanEnum == nil && [rescanRoots count] == 0) {
+    NSDebugLLog(@"gwspace", @"global rescan done, %lu entries looked at",
+                (unsigned long)rescanVisited);
+    [rescanTimer invalidate];
+    rescanTimer = nil;
+  }
+
+  /* rescan records only go out with a flush */
+  if (count > 0) {
+    [self processPendingEvents: nil];
+  }
+  RELEASE (arp);
+}
+
+
+#ifdef HAVE_SYS_FANOTIFY_H
+
+/*
+ * Global watching through fanotify: one mark per filesystem that holds
+ * a global path, and so every change under it, rather than only the
+ * directories some viewer happens to watch with inotify.  The marks
+ * need CAP_SYS_ADMIN, and turning the reported directory handles back
+ * into paths CAP_DAC_READ_SEARCH; without them, or on a kernel older
+ * than 5.9, fswatcher stays with inotify.
+ */
+
+#define FAN_GLOBAL_MASK (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO \
+                           | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ONDIR)
+
+/* Resolved directory handles kept before the cache is emptied. */
+#define FAN_DIRS_LIMIT 4096
+
+static inline uint64_t fsidValue(const void *fsid)
+{
+  uint64_t value;
+
+  memcpy(&value, fsid, sizeof(value));
+  return value;
+}
+
+- (BOOL)startFanotify
+{
+  int fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC,
+                         O_RDONLY);
+
+  if (fd == -1) {
+    NSDebugLLog(@"gwspace", @"fanotify not available (%s), global watching uses inotify",
+                strerror(errno));
+    return NO;
+  }
+
+  fanotifyHandle = [[NSFileHandle alloc] initWithFileDescriptor: fd 
+                                                 closeOnDealloc: YES];
+  fanotifyDirs = [NSMutableDictionary new];
+
+  [nc addObserver: self
+	       selector: @selector(fanotifyDataReady:)
+		         name: NSFileHandleReadCompletionNotification
+		       object: fanotifyHandle];
+
+  [fanotifyHandle readInBackgroundAndNotify];
+
+  return YES;
+}
+
+- (void)stopFanotify
+{
+  NSUInteger i;
+
+  if (fanotifyHandle) {
+    [nc removeObserver: self
+		              name: NSFileHandleReadCompletionNotification
+		            object: fanotifyHandle];
+    DESTROY (fanotifyHandle);
+    NSDebugLLog(@"gwspace", @"global watching falls back to inotify");
+  }
+
+  for (i = 0; i < fanotifyMountsCount; i++) {
+    close(fanotifyMounts[i].fd);
+  }
+  free(fanotifyMounts);
+  fanotifyMounts = NULL;
+  fanotifyMountsCount = 0;
+  DESTROY (fanotifyDirs);
+}
+
+/* Marks the filesystems of the paths not marked yet.  Any failure
+ * gives up fanotify altogether: half the global paths unwatched would
+ * be worse than inotify. */
+- (void)fanotifyMarkPaths:(NSArray *)paths
+{
+  NSUInteger i;
+
+  for (i = 0; i < [paths count] && fanotifyHandle != nil; i++) {
+    NSString *path = [paths objectAtIndex: i];
+    const char *fspath = [path fileSystemRepresentation];
+    struct {
+      struct file_handle fh;
+      unsigned char bytes[MAX_HANDLE_SZ];
+    } handle;
+    struct statfs sfs;
+    struct stat st;
+    int mountid;
+    int mfd, tfd;
+    NSUInteger j;
+
+    if (stat(fspath, &st) != 0 || S_ISDIR(st.st_mode) == NO) {
+      continue;
+    }
+    for (j = 0; j < fanotifyMountsCount; j++) {
+      if (fanotifyMounts[j].dev == st.st_dev) {
+        break;
+      }
+    }
+    if (j < fanotifyMountsCount) {
+      continue;
+    }
+
+    if (fanotify_mark([fanotifyHandle fileDescriptor], 
+                      FAN_MARK_ADD | FAN_MARK_FILESYSTEM,
+                      FAN_GLOBAL_MASK, AT_FDCWD, fspath) != 0) {
+      NSDebugLLog(@"gwspace", @"cannot mark %@ for fanotify: %s", path, strerror(errno));
+      [self stopFanotify];
+      return;
+    }
+
+    mfd = -1;
+    tfd = -1;
+    handle.fh.handle_bytes = MAX_HANDLE_SZ;
+
+    if (statfs(fspath, &sfs) == 0
+          && (mfd = open(fspath, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0
+          && name_to_handle_at(AT_FDCWD, fspath, &handle.fh, &mountid, 0) == 0) {
+      tfd = open_by_handle_at(mfd, &handle.fh, O_PATH | O_CLOEXEC);
+    }
+
+    if (tfd < 0) {
+      NSDebugLLog(@"gwspace", @"cannot resolve fanotify handles under %@: %s", 
+                  path, strerror(errno));
+      if (mfd >= 0) {
+        close(mfd);
+      }
+      [self stopFanotify];
+      return;
+    }
+    close(tfd);
+
+    fanotifyMounts = realloc(fanotifyMounts, 
+                             (fanotifyMountsCount + 1) * sizeof(fsw_fan_mount));
+    fanotifyMounts[fanotifyMountsCount].fsid = fsidValue(&sfs.f_fsid);
+    fanotifyMounts[fanotifyMountsCount].dev = st.st_dev;
+    fanotifyMounts[fanotifyMountsCount].fd = mfd;
+    fanotifyMountsCount++;
+
+    GWDebugLog(@"fanotify mark for the filesystem of %@", path);
+  }
+}
+
+- (NSString *)fanotifyDirectoryForHandle:(void *)handle
+                                    fsid:(uint64_t)fsid
+{
+  struct file_handle *fh = (struct file_handle *)handle;
+  NSData *key = [NSData dataWithBytes: fh 
+                               length: sizeof(struct file_handle) + fh->handle_bytes];
+  NSString *dir = [fanotifyDirs objectForKey: key];
+  char procpath[64];
+  char buf[PATH_MAX];
+  ssize_t len;
+  NSUInteger i;
+  int dfd;
+
+  if (dir != nil) {
+    return dir;
+  }
+
+  for (i = 0; i < fanotifyMountsCount; i++) {
+    if (fanotifyMounts[i].fsid == fsid) {
+      break;
+    }
+  }
+  if (i == fanotifyMountsCount) {
+    return nil;
+  }
+
+  /* fails if the directory is already gone */
+  dfd = open_by_handle_at(fanotifyMounts[i].fd, fh, O_PATH | O_CLOEXEC);
+  if (dfd < 0) {
+    return nil;
+  }
+  snprintf(procpath, sizeof(procpath), "/proc/self/fd/%d", dfd);
+  len = readlink(procpath, buf, sizeof(buf));
+  close(dfd);
+
+  if (len <= 0 || len >= (ssize_t)sizeof(buf) || buf[0] != '/') {
+    return nil;
+  }
+
+  dir = [fm stringWithFileSystemRepresentation: buf length: len];
+
+  if ([fanotifyDirs count] >= FAN_DIRS_LIMIT) {
+    [fanotifyDirs removeAllObjects];
+  }
+  [fanotifyDirs setObject: dir forKey: key];
+
+  return dir;
+}
+
+- (void)fanotifyDataReady:(NSNotification *)notif
+{
+  NSDictionary *info = [notif userInfo];
+  NSData *data = [info objectForKey: NSFileHandleNotificationDataItem];
+  const struct fanotify_event_metadata *meta = [data bytes];
+  ssize_t len = [data length];
+
+  if (len == 0) {
+    [self stopFanotify];
+    return;
+  }
+
+  /* the kernel only hands out whole events */
+  for (; FAN_EVENT_OK(meta, len); meta = FAN_EVENT_NEXT(meta, len)) {
+    CREATE_AUTORELEASE_POOL(arp);
+    const struct fanotify_event_info_fid *fid;
+    struct file_handle *fh;
+    NSString *dir;
+    NSString *fullpath;
+    NSString *event = nil;
+    NSString *oldpath = nil;
+    const char *name;
+    uint64_t mask = meta->mask;
+
+    if (meta->vers != FANOTIFY_METADATA_VERSION) {
+      NSDebugLLog(@"gwspace", @"unknown fanotify event version %d", meta->vers);
+      RELEASE (arp);
+      [self stopFanotify];
+      return;
+    }
+
+    if (meta->fd >= 0) {
+      close(meta->fd);
+    }
+
+    if (mask & FAN_Q_OVERFLOW) {
+      overflows++;
+      NSDebugLLog(@"gwspace", @"fanotify queue overflow, global events lost");
+      [self scheduleGlobalRescanSince: 
+              [NSDate timeIntervalSinceReferenceDate] - RESCAN_SLACK];
+      RELEASE (arp);
+      continue;
+    }
+
+    fid = (const struct fanotify_event_info_fid *)((const char *)meta + meta->metadata_len);
+
+    if (meta->event_len <= meta->metadata_len
+          || fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME) {
+      RELEASE (arp);
+      continue;
+    }
+
+    fh = (struct file_handle *)fid->handle;
+    name = (const char *)(fh->f_handle + fh->handle_bytes);
+    dir = [self fanotifyDirectoryForHandle: fh fsid: fsidValue(&fid->fsid)];
+
+    if (dir == nil) {
+      RELEASE (arp);
+      continue;
+    }
+
+    fullpath = dir;
+    if (strcmp(name, ".") != 0) {
+      fullpath = [dir stringByAppendingPathComponent: 
+                        [fm stringWithFileSystemRepresentation: name 
+                                                        length: strlen(name)]];
+    }
+
+    /* cached paths under a moved or removed directory are wrong now */
+    if ((mask & FAN_ONDIR) && (mask & (FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO))) {
+      [fanotifyDirs removeAllObjects];
+    }
+
+    if ([self isGlobalWatchedPath: fullpath] == NO) {
+      RELEASE (arp);
+      continue;
+    }
+
+    /* no move cookie here: a MOVED_TO pairs with the MOVED_FROM just before it */
+    if (mask & FAN_MOVED_FROM) {
+      ASSIGN (lastMovedPath, fullpath);
+      GWDebugLog(@"MOVE from indexable path: %@", fullpath);
+
+      [NSTimer scheduledTimerWithTimeInterval: 0.1 
+                                       target: self 
+                                     selector: @selector(checkLastMovedPath:) 
+                                     userInfo: nil 
+                                      repeats: NO];
+
+    } else if (mask & FAN_MOVED_TO) {
+      if (lastMovedPath != nil) {
+        oldpath = AUTORELEASE (RETAIN (lastMovedPath));
+        event = GWWatchedPathRenamed;
+        GWDebugLog(@"MOVED from: %@ to: %@", lastMovedPath, fullpath);
+      } else {
+        event = GWFileCreatedInWatchedDirectory;
+        GWDebugLog(@"MOVED from not indexable path: %@", fullpath); 
+      }
+      DESTROY (lastMovedPath);
+
+    } else if (mask & FAN_DELETE) {
+      event = GWWatchedPathDeleted;
+      GWDebugLog(@"DELETE %@", fullpath); 
+
+    } else if (mask & FAN_CREATE) {
+      event = GWFileCreatedInWatchedDirectory;
+      GWDebugLog(@"CREATED %@", fullpath); 
+
+    } else if (mask & (FAN_MODIFY | FAN_CLOSE_WRITE)) {
+      event = GWWatchedFileModified;
+      GWDebugLog(@"MODIFIED %@", fullpath); 
+    }
+
+    if (event != nil) {
+      [self queueGlobalEvent: event forPath: fullpath oldPath: oldpath];
+    }
+
+    RELEASE (arp);
+  }
+
+  [fanotifyHandle readInBackgroundAndNotify];
+}
+
+#else /* HAVE_SYS_FANOTIFY_H */
+
+- (BOOL)startFanotify
+{
+  return NO;
+}
+
+- (void)stopFanotify
+{
+}
+
+- (void)fanotifyMarkPaths:(NSArray *)paths
+{
+}
+
+- (NSString *)fanotifyDirectoryForHandle:(void *)handle
+                                    fsid:(uint64_t)fsid
+{
+  return nil;
+}
+
+- (void)fanotifyDataReady:(NSNotification *)notif
+{
+}
+
+#endif /* HAVE_SYS_FANOTIFY_H */
+
 @end
 
 
@@ -1142,6 +2430,8 @@ int main(int argc, char** argv)
   
   RELEASE(pool);
 
+  FSNTraceInstallDumpSignal(SIGUSR2);
+
   {
     CREATE_AUTORELEASE_POOL (pool);
     FSWatcher *fsw = [[FSWatcher alloc] init];
@@ -1,15 +1,37 @@
 /* fswatcher-test-client.m
  * 
  * Simple test client to verify fswatcher is working
- * without needing to run full Workspace
+ * without needing to run full Workspace.
+ *
+ * With --load it generates load instead: it connects many clients at
+ * once, has them watch many directories, creates, modifies and renames
+ * files in them at a given rate, and measures how long each change took
+ * to be reported, and how many never were.  The numbers are printed as
+ * JSON, e.g. to compare coalescing windows, batched delivery or the
+ * inotify and fanotify backends:
+ *
+ *   fswatcher-test-client --load --clients 8 --dirs 64 --rate 2000 \
+ *                         --duration 20 --batched --window 0.05
  */
 
 #import <Foundation/Foundation.h>
+#import "FSWEventBatch.h"
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 @protocol FSWClientProtocol
 
 - (oneway void)watchedPathDidChange:(NSData *)dirinfo;
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo;
+- (oneway void)watchedPathsDidChange:(NSData *)batch;
 
 @end
 
@@ -26,6 +48,18 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                                 removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                didProcessBatch:(unsigned long long)sequence;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setCoalescingWindow:(double)seconds
+                                adaptive:(BOOL)flag;
+
+- (bycopy NSDictionary *)statistics;
+
 @end
 
 
@@ -133,6 +167,15 @@
   NSDebugLLog(@"gwspace", @"Global watcher notification: %@", dirinfo);
 }
 
+- (oneway void)watchedPathsDidChange:(NSData *)batch
+{
+  unsigned long long sequence = 0;
+  NSArray *records = FSWBatchDecode(batch, &sequence);
+
+  NSDebugLLog(@"gwspace", @"Batch %llu: %@", sequence, records);
+  [fswatcher client: (id <FSWClientProtocol>)self didProcessBatch: sequence];
+}
+
 - (void)run
 {
   NSDebugLLog(@"gwspace", @"");
@@ -152,9 +195,1075 @@
 @end
 
 
+/*
+ * The load generator.
+ */
+
+enum {
+  FSWLoadCreate = 0,
+  FSWLoadModify = 1,
+  FSWLoadRename = 2,
+  /* the old name of a rename */
+  FSWLoadRemove = 3
+};
+
+typedef struct {
+  NSUInteger dirs;
+  NSUInteger clients;
+  NSUInteger dirsPerClient;   /* 0: every client watches every directory */
+  NSUInteger files;           /* made in each directory before the watches */
+  double rate;                /* operations per second, in all */
+  double duration;
+  double settle;              /* how long to wait for late events */
+  unsigned mix[3];            /* weights of creations, modifications, renames */
+  BOOL batched;
+  double window;              /* negative: fswatcher's default */
+  BOOL adaptive;
+  unsigned seed;
+  NSString *root;
+  BOOL keep;
+  double maxLoss;             /* negative: no limit */
+  double maxP99;
+} fsw_load_options;
+
+static double monotonicTime(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x < y) ? -1 : ((x > y) ? 1 : 0);
+}
+
+/* Nearest-rank percentile of `count` sorted values. */
+static double percentile(const double *sorted, NSUInteger count, double p)
+{
+  NSUInteger rank;
+
+  if (count == 0) {
+    return 0;
+  }
+  rank = (NSUInteger)ceil(p / 100.0 * count);
+  if (rank < 1) {
+    rank = 1;
+  }
+  return sorted[MIN(rank, count) - 1];
+}
+
+
+/* What the generator changed and what each client was told about it.
+ * The generator thread records every change before it makes it, the
+ * main thread matches the events as they arrive; a change is keyed by
+ * the path changed, as fswatcher coalesces them.  Whatever is still
+ * pending when the run has settled was lost. */
+@interface FSWLoadLedger : NSObject
+{
+  NSLock *lock;
+  NSUInteger clientsCount;
+  NSMutableArray *pending;   /* per client: path -> dates of its changes not reported */
+  NSMutableArray *created;   /* per client: the pending paths that were created */
+  unsigned long long *counters;
+  NSMutableData *latencies;  /* seconds, as doubles */
+}
+
+- (id)initWithClientsCount:(NSUInteger)count;
+
+- (void)expectChange:(int)kind
+              ofPath:(NSString *)path
+          forClients:(NSArray *)clients
+              atTime:(double)t;
+
+- (void)noteRecords:(NSArray *)records
+          undecoded:(NSUInteger)undecoded
+          forClient:(NSUInteger)client
+             atTime:(double)t;
+
+- (NSUInteger)pendingCount;
+
+- (NSDictionary *)report;
+
+@end
+
+enum {
+  FSWLoadExpected,
+  FSWLoadDelivered,
+  FSWLoadCoalesced,
+  FSWLoadCancelled,
+  FSWLoadRescanned,
+  FSWLoadUnexpected,
+  FSWLoadMessages,
+  FSWLoadRecords,
+  FSWLoadUndecoded,
+  FSWLoadCountersCount
+};
+
+static NSString *counterNames[FSWLoadCountersCount] = {
+  @"expected", @"delivered", @"coalesced", @"cancelled", @"rescanned",
+  @"unexpected", @"messages", @"records", @"undecoded"
+};
+
+#define COUNTER(c, n) counters[(c) * FSWLoadCountersCount + (n)]
+
+@implementation FSWLoadLedger
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (pending);
+  RELEASE (created);
+  RELEASE (latencies);
+  free(counters);
+  [super dealloc];
+}
+
+- (id)initWithClientsCount:(NSUInteger)count
+{
+  self = [super init];
+
+  if (self) {
+    NSUInteger i;
+
+    lock = [NSLock new];
+    clientsCount = count;
+    pending = [[NSMutableArray alloc] initWithCapacity: count];
+    created = [[NSMutableArray alloc] initWithCapacity: count];
+    for (i = 0; i < count; i++) {
+      [pending addObject: [NSMutableDictionary dictionary]];
+      [created addObject: [NSMutableSet set]];
+    }
+    counters = calloc(count * FSWLoadCountersCount, sizeof(unsigned long long));
+    latencies = [NSMutableData new];
+  }
+
+  return self;
+}
+
+- (void)expectChange:(int)kind
+              ofPath:(NSString *)path
+          forClients:(NSArray *)clients
+              atTime:(double)t
+{
+  NSNumber *date = [NSNumber numberWithDouble: t];
+  NSUInteger i;
+
+  [lock lock];
+
+  for (i = 0; i < [clients count]; i++) {
+    NSUInteger c = [[clients objectAtIndex: i] unsignedIntegerValue];
+    NSMutableDictionary *dates = [pending objectAtIndex: c];
+    NSMutableSet *fresh = [created objectAtIndex: c];
+    NSMutableArray *times = [dates objectForKey: path];
+
+    COUNTER(c, FSWLoadExpected)++;
+
+    if (kind == FSWLoadRemove && [fresh containsObject: path]) {
+      /* created and gone before it was reported: fswatcher drops both */
+      COUNTER(c, FSWLoadCancelled) += [times count] + 1;
+      [dates removeObjectForKey: path];
+      [fresh removeObject: path];
+      continue;
+    }
+
+    if (times == nil) {
+      times = [NSMutableArray array];
+      [dates setObject: times forKey: path];
+      if (kind == FSWLoadCreate) {
+        [fresh addObject: path];
+      }
+    }
+    [times addObject: date];
+  }
+
+  [lock unlock];
+}
+
+- (void)noteRecords:(NSArray *)records
+          undecoded:(NSUInteger)undecoded
+          forClient:(NSUInteger)c
+             atTime:(double)t
+{
+  NSMutableDictionary *dates = [pending objectAtIndex: c];
+  NSMutableSet *fresh = [created objectAtIndex: c];
+  NSUInteger i;
+
+  [lock lock];
+
+  COUNTER(c, FSWLoadMessages)++;
+  COUNTER(c, FSWLoadRecords) += [records count];
+  COUNTER(c, FSWLoadUndecoded) += undecoded;
+
+  for (i = 0; i < [records count]; i++) {
+    NSDictionary *info = [records objectAtIndex: i];
+    NSString *path = [info objectForKey: @"path"];
+    NSString *file = [[info objectForKey: @"files"] lastObject];
+    NSArray *times;
+    NSUInteger j;
+
+    if ([[info objectForKey: @"event"] isEqual: FSWRescanEvent]) {
+      /* the client was told to read everything under the path again */
+      NSString *prefix = [path stringByAppendingString: @"/"];
+      NSArray *keys = [dates allKeys];
+
+      for (j = 0; j < [keys count]; j++) {
+        NSString *key = [keys objectAtIndex: j];
+
+        if ([key isEqual: path] || [key hasPrefix: prefix]) {
+          COUNTER(c, FSWLoadRescanned) += [[dates objectForKey: key] count];
+          [dates removeObjectForKey: key];
+          [fresh removeObject: key];
+        }
+      }
+      continue;
+    }
+
+    if (file) {
+      path = [path stringByAppendingPathComponent: file];
+    }
+    times = [dates objectForKey: path];
+    if (times == nil) {
+      COUNTER(c, FSWLoadUnexpected)++;
+      continue;
+    }
+
+    for (j = 0; j < [times count]; j++) {
+      double latency = t - [[times objectAtIndex: j] doubleValue];
+
+      [latencies appendBytes: &latency length: sizeof(latency)];
+    }
+    COUNTER(c, FSWLoadDelivered) += [times count];
+    COUNTER(c, FSWLoadCoalesced) += [times count] - 1;
+    [dates removeObjectForKey: path];
+    [fresh removeObject: path];
+  }
+
+  [lock unlock];
+}
+
+- (NSUInteger)pendingCount
+{
+  NSUInteger count = 0;
+  NSUInteger c;
+
+  [lock lock];
+  for (c = 0; c < clientsCount; c++) {
+    NSEnumerator *enumerator = [[pending objectAtIndex: c] objectEnumerator];
+    NSArray *times;
+
+    while ((times = [enumerator nextObject]) != nil) {
+      count += [times count];
+    }
+  }
+  [lock unlock];
+
+  return count;
+}
+
+- (NSDictionary *)report
+{
+  NSMutableDictionary *report = [NSMutableDictionary dictionary];
+  NSMutableDictionary *events = [NSMutableDictionary dictionary];
+  NSMutableDictionary *latency = [NSMutableDictionary dictionary];
+  NSMutableArray *perClient = [NSMutableArray array];
+  unsigned long long totals[FSWLoadCountersCount];
+  unsigned long long lost = 0;
+  NSUInteger count;
+  double *sorted;
+  double sum = 0;
+  NSUInteger c, n, i;
+
+  [lock lock];
+
+  memset(totals, 0, sizeof(totals));
+
+  for (c = 0; c < clientsCount; c++) {
+    NSMutableDictionary *client = [NSMutableDictionary dictionary];
+    NSEnumerator *enumerator = [[pending objectAtIndex: c] objectEnumerator];
+    unsigned long long clientLost = 0;
+    NSArray *times;
+
+    while ((times = [enumerator nextObject]) != nil) {
+      clientLost += [times count];
+    }
+    for (n = 0; n < FSWLoadCountersCount; n++) {
+      totals[n] += COUNTER(c, n);
+      [client setObject: [NSNumber numberWithUnsignedLongLong: COUNTER(c, n)]
+                 forKey: counterNames[n]];
+    }
+    [client setObject: [NSNumber numberWithUnsignedLongLong: clientLost]
+               forKey: @"lost"];
+    [perClient addObject: client];
+    lost += clientLost;
+  }
+
+  for (n = 0; n < FSWLoadCountersCount; n++) {
+    [events setObject: [NSNumber numberWithUnsignedLongLong: totals[n]]
+               forKey: counterNames[n]];
+  }
+  [events setObject: [NSNumber numberWithUnsignedLongLong: lost] forKey: @"lost"];
+  [events setObject: [NSNumber numberWithDouble: (totals[FSWLoadExpected]
+                              ? (double)lost / totals[FSWLoadExpected] : 0)]
+             forKey: @"loss"];
+
+  count = [latencies length] / sizeof(double);
+  sorted = malloc((count ? count : 1) * sizeof(double));
+  memcpy(sorted, [latencies bytes], count * sizeof(double));
+  qsort(sorted, count, sizeof(double), compareDoubles);
+  for (i = 0; i < count; i++) {
+    sorted[i] *= 1000.0;
+    sum += sorted[i];
+  }
+
+  [lock unlock];
+
+  [latency setObject: [NSNumber numberWithUnsignedInteger: count] forKey: @"count"];
+  [latency setObject: [NSNumber numberWithDouble: (count ? sorted[0] : 0)] forKey: @"min"];
+  [latency setObject: [NSNumber numberWithDouble: (count ? sum / count : 0)] forKey: @"mean"];
+  [latency setObject: [NSNumber numberWithDouble: percentile(sorted, count, 50)] forKey: @"p50"];
+  [latency setObject: [NSNumber numberWithDouble: percentile(sorted, count, 90)] forKey: @"p90"];
+  [latency setObject: [NSNumber numberWithDouble: percentile(sorted, count, 99)] forKey: @"p99"];
+  [latency setObject: [NSNumber numberWithDouble: percentile(sorted, count, 99.9)] forKey: @"p999"];
+  [latency setObject: [NSNumber numberWithDouble: (count ? sorted[count - 1] : 0)] forKey: @"max"];
+  free(sorted);
+
+  [report setObject: events forKey: @"events"];
+  [report setObject: latency forKey: @"latency_ms"];
+  [report setObject: perClient forKey: @"clients"];
+
+  return report;
+}
+
+@end
+
+
+/* One of the generator's clients, on a connection of its own. */
+@interface FSWLoadClient : NSObject <FSWClientProtocol>
+{
+  NSUInteger index;
+  FSWLoadLedger *ledger;
+  NSConnection *connection;
+  id <FSWatcherProtocol> fswatcher;
+  BOOL batched;
+}
+
+- (id)initWithIndex:(NSUInteger)idx
+             ledger:(FSWLoadLedger *)aledger;
+
+- (BOOL)connectBatched:(BOOL)flag;
+
+- (id <FSWatcherProtocol>)fswatcher;
+
+- (void)disconnect;
+
+@end
+
+@implementation FSWLoadClient
+
+- (void)dealloc
+{
+  [self disconnect];
+  RELEASE (ledger);
+  [super dealloc];
+}
+
+- (id)initWithIndex:(NSUInteger)idx
+             ledger:(FSWLoadLedger *)aledger
+{
+  self = [super init];
+
+  if (self) {
+    index = idx;
+    ASSIGN (ledger, aledger);
+  }
+
+  return self;
+}
+
+- (BOOL)connectBatched:(BOOL)flag
+{
+  NSPort *sendPort = [[NSPortNameServer systemDefaultPortNameServer]
+                                    portForName: @"fswatcher" onHost: @""];
+
+  if (sendPort == nil) {
+    return NO;
+  }
+
+  /* fswatcher tells its clients apart by their connections: each gets
+     a receive port, and so a connection, of its own */
+  connection = [[NSConnection alloc] initWithReceivePort: [[sendPort class] port]
+                                                sendPort: sendPort];
+  fswatcher = (id <FSWatcherProtocol>)[connection rootProxy];
+
+  if (fswatcher == nil) {
+    DESTROY (connection);
+    return NO;
+  }
+
+  RETAIN (fswatcher);
+  [(id)fswatcher setProtocolForProxy: @protocol(FSWatcherProtocol)];
+
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(connectionDidDie:)
+                                               name: NSConnectionDidDieNotification
+                                             object: connection];
+
+  [fswatcher registerClient: (id <FSWClientProtocol>)self isGlobalWatcher: NO];
+  batched = flag;
+  if (batched) {
+    [fswatcher client: (id <FSWClientProtocol>)self setBatchedDelivery: YES];
+  }
+
+  return YES;
+}
+
+- (id <FSWatcherProtocol>)fswatcher
+{
+  return fswatcher;
+}
+
+- (void)disconnect
+{
+  if (fswatcher) {
+    [[NSNotificationCenter defaultCenter] removeObserver: self];
+    NS_DURING
+      {
+        [fswatcher unregisterClient: (id <FSWClientProtocol>)self];
+      }
+    NS_HANDLER
+      {
+      }
+    NS_ENDHANDLER
+    DESTROY (fswatcher);
+  }
+  if (connection) {
+    [connection invalidate];
+    DESTROY (connection);
+  }
+}
+
+- (void)connectionDidDie:(NSNotification *)notif
+{
+  fprintf(stderr, "fswatcher-test-client: client %lu lost its connection to fswatcher\n",
+          (unsigned long)index);
+  exit(2);
+}
+
+- (oneway void)watchedPathDidChange:(NSData *)dirinfo
+{
+  double now = monotonicTime();
+  NSDictionary *info = [NSUnarchiver unarchiveObjectWithData: dirinfo];
+
+  [ledger noteRecords: (info ? [NSArray arrayWithObject: info] : [NSArray array])
+            undecoded: (info ? 0 : 1)
+            forClient: index
+               atTime: now];
+}
+
+- (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo
+{
+}
+
+- (oneway void)watchedPathsDidChange:(NSData *)batch
+{
+  double now = monotonicTime();
+  unsigned long long sequence = 0;
+  NSArray *records = FSWBatchDecode(batch, &sequence);
+  NSUInteger count = records ? FSWBatchCount(batch) : 0;
+
+  [ledger noteRecords: (records ? records : [NSArray array])
+            undecoded: ((count > [records count]) ? count - [records count] : 0)
+            forClient: index
+               atTime: now];
+
+  if (records) {
+    [fswatcher client: (id <FSWClientProtocol>)self didProcessBatch: sequence];
+  }
+}
+
+@end
+
+
+/* Changes the files of the directories, on a thread of its own. */
+@interface FSWLoadGenerator : NSObject
+{
+  fsw_load_options opts;
+  NSArray *dirs;
+  NSArray *watchersOfDirs;   /* per directory: the clients watching it */
+  NSMutableArray *filesOfDirs;
+  FSWLoadLedger *ledger;
+  unsigned long long nameCount;
+  unsigned long long done[3];
+  unsigned long long errors;
+  double elapsed;
+  double maxLag;
+}
+
+- (id)initWithOptions:(fsw_load_options *)options
+          directories:(NSArray *)directories
+             watchers:(NSArray *)watchers
+               ledger:(FSWLoadLedger *)aledger;
+
+- (BOOL)populate;
+
+- (void)generate:(id)observer;
+
+- (NSDictionary *)report;
+
+@end
+
+@implementation FSWLoadGenerator
+
+- (void)dealloc
+{
+  RELEASE (dirs);
+  RELEASE (watchersOfDirs);
+  RELEASE (filesOfDirs);
+  RELEASE (ledger);
+  [super dealloc];
+}
+
+- (id)initWithOptions:(fsw_load_options *)options
+          directories:(NSArray *)directories
+             watchers:(NSArray *)watchers
+               ledger:(FSWLoadLedger *)aledger
+{
+  self = [super init];
+
+  if (self) {
+    NSUInteger i;
+
+    opts = *options;
+    ASSIGN (dirs, directories);
+    ASSIGN (watchersOfDirs, watchers);
+    ASSIGN (ledger, aledger);
+    filesOfDirs = [[NSMutableArray alloc] initWithCapacity: [dirs count]];
+    for (i = 0; i < [dirs count]; i++) {
+      [filesOfDirs addObject: [NSMutableArray array]];
+    }
+  }
+
+  return self;
+}
+
+- (NSString *)nextName
+{
+  return [NSString stringWithFormat: @"f%08llu", nameCount++];
+}
+
+static BOOL writeSome(NSString *path, int flags)
+{
+  int fd = open([path fileSystemRepresentation], O_WRONLY | flags, 0644);
+  BOOL ok;
+
+  if (fd < 0) {
+    return NO;
+  }
+  ok = (write(fd, "fswatcher load\n", 15) == 15);
+  return (close(fd) == 0) && ok;
+}
+
+- (BOOL)populate
+{
+  NSUInteger d, i;
+
+  for (d = 0; d < [dirs count]; d++) {
+    NSString *dir = [dirs objectAtIndex: d];
+    NSMutableArray *files = [filesOfDirs objectAtIndex: d];
+
+    for (i = 0; i < opts.files; i++) {
+      NSString *name = [self nextName];
+
+      if (writeSome([dir stringByAppendingPathComponent: name], O_CREAT | O_EXCL) == NO) {
+        return NO;
+      }
+      [files addObject: name];
+    }
+  }
+
+  return YES;
+}
+
+- (void)generate:(id)observer
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  unsigned weights = opts.mix[0] + opts.mix[1] + opts.mix[2];
+  double interval = 1.0 / opts.rate;
+  double start = monotonicTime();
+  unsigned long long n;
+
+  for (n = 0; ; n++) {
+    CREATE_AUTORELEASE_POOL(pool);
+    double due = start + n * interval;
+    double now = monotonicTime();
+    NSUInteger d = (NSUInteger)(random() % [dirs count]);
+    NSString *dir = [dirs objectAtIndex: d];
+    NSArray *watchers = [watchersOfDirs objectAtIndex: d];
+    NSMutableArray *files = [filesOfDirs objectAtIndex: d];
+    unsigned pick = (unsigned)(random() % weights);
+    int op;
+
+    if (due - start >= opts.duration) {
+      RELEASE (pool);
+      break;
+    }
+    if (due > now) {
+      struct timespec ts;
+
+      ts.tv_sec = (time_t)(due - now);
+      ts.tv_nsec = (long)(((due - now) - ts.tv_sec) * 1e9);
+      nanosleep(&ts, NULL);
+    } else if (now - due > maxLag) {
+      maxLag = now - due;
+    }
+
+    if (pick < opts.mix[0] || [files count] == 0) {
+      op = FSWLoadCreate;
+    } else if (pick < opts.mix[0] + opts.mix[1]) {
+      op = FSWLoadModify;
+    } else {
+      op = FSWLoadRename;
+    }
+
+    /* every change is recorded before it is made, so that its event
+       cannot come before it */
+    if (op == FSWLoadCreate) {
+      NSString *name = [self nextName];
+      NSString *path = [dir stringByAppendingPathComponent: name];
+
+      [ledger expectChange: FSWLoadCreate ofPath: path
+                forClients: watchers atTime: monotonicTime()];
+      if (writeSome(path, O_CREAT | O_EXCL)) {
+        [files addObject: name];
+      } else {
+        errors++;
+      }
+
+    } else if (op == FSWLoadModify) {
+      NSString *name = [files objectAtIndex: random() % [files count]];
+      NSString *path = [dir stringByAppendingPathComponent: name];
+
+      [ledger expectChange: FSWLoadModify ofPath: path
+                forClients: watchers atTime: monotonicTime()];
+      if (writeSome(path, O_APPEND) == NO) {
+        errors++;
+      }
+
+    } else {
+      NSUInteger i = random() % [files count];
+      NSString *oldname = [files objectAtIndex: i];
+      NSString *name = [self nextName];
+      NSString *oldpath = [dir stringByAppendingPathComponent: oldname];
+      NSString *path = [dir stringByAppendingPathComponent: name];
+      double t = monotonicTime();
+
+      [ledger expectChange: FSWLoadRemove ofPath: oldpath forClients: watchers atTime: t];
+      [ledger expectChange: FSWLoadCreate ofPath: path forClients: watchers atTime: t];
+      if (rename([oldpath fileSystemRepresentation], [path fileSystemRepresentation]) == 0) {
+        [files replaceObjectAtIndex: i withObject: name];
+      } else {
+        errors++;
+      }
+    }
+
+    done[op]++;
+    RELEASE (pool);
+  }
+
+  elapsed = monotonicTime() - start;
+
+  [observer performSelectorOnMainThread: @selector(generatorDidFinish:)
+                             withObject: self
+                          waitUntilDone: NO];
+  RELEASE (arp);
+}
+
+- (NSDictionary *)report
+{
+  unsigned long long total = done[0] + done[1] + done[2];
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLongLong: done[FSWLoadCreate]], @"created",
+    [NSNumber numberWithUnsignedLongLong: done[FSWLoadModify]], @"modified",
+    [NSNumber numberWithUnsignedLongLong: done[FSWLoadRename]], @"renamed",
+    [NSNumber numberWithUnsignedLongLong: errors], @"errors",
+    [NSNumber numberWithDouble: elapsed], @"seconds",
+    [NSNumber numberWithDouble: (elapsed > 0 ? total / elapsed : 0)], @"rate",
+    [NSNumber numberWithDouble: maxLag * 1000.0], @"max_lag_ms",
+    nil];
+}
+
+@end
+
+
+/* Runs the load and prints its report. */
+@interface FSWLoadRun : NSObject
+{
+  fsw_load_options opts;
+  BOOL generated;
+}
+
+- (id)initWithOptions:(fsw_load_options *)options;
+
+- (int)run;
+
+- (void)generatorDidFinish:(id)generator;
+
+@end
+
+@implementation FSWLoadRun
+
+- (id)initWithOptions:(fsw_load_options *)options
+{
+  self = [super init];
+
+  if (self) {
+    opts = *options;
+  }
+
+  return self;
+}
+
+- (void)generatorDidFinish:(id)generator
+{
+  generated = YES;
+}
+
+static void runFor(double seconds)
+{
+  [[NSRunLoop currentRunLoop] runUntilDate:
+                          [NSDate dateWithTimeIntervalSinceNow: seconds]];
+}
+
+static NSDictionary *statisticsOf(id <FSWatcherProtocol> fswatcher)
+{
+  NSDictionary *stats = nil;
+
+  NS_DURING
+    {
+      stats = [fswatcher statistics];
+    }
+  NS_HANDLER
+    {
+      /* the fswatcher without inotify keeps no counters */
+      stats = nil;
+    }
+  NS_ENDHANDLER
+
+  return stats;
+}
+
+/* What the counters of fswatcher did during the run. */
+static NSDictionary *statisticsDelta(NSDictionary *before, NSDictionary *after)
+{
+  NSArray *keys = [NSArray arrayWithObjects: @"eventsReceived", @"eventsCoalesced",
+                                             @"overflows", @"flushes", @"flushTime", nil];
+  NSMutableDictionary *delta = [NSMutableDictionary dictionary];
+  NSUInteger i;
+
+  if (after == nil) {
+    return delta;
+  }
+  for (i = 0; i < [keys count]; i++) {
+    NSString *key = [keys objectAtIndex: i];
+
+    [delta setObject: [NSNumber numberWithDouble:
+                           [[after objectForKey: key] doubleValue]
+                         - [[before objectForKey: key] doubleValue]]
+              forKey: key];
+  }
+  if ([after objectForKey: @"maxFlushTime"]) {
+    [delta setObject: [after objectForKey: @"maxFlushTime"] forKey: @"maxFlushTime"];
+  }
+  if ([after objectForKey: @"fanotify"]) {
+    [delta setObject: [after objectForKey: @"fanotify"] forKey: @"fanotify"];
+  }
+
+  return delta;
+}
+
+- (int)run
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSMutableArray *dirs = [NSMutableArray array];
+  NSMutableArray *watchers = [NSMutableArray array];
+  NSMutableArray *clients = [NSMutableArray array];
+  FSWLoadLedger *ledger;
+  FSWLoadGenerator *generator;
+  NSMutableDictionary *report;
+  NSMutableDictionary *config;
+  NSMutableArray *failures = [NSMutableArray array];
+  NSDictionary *statsBefore;
+  NSDictionary *statsAfter;
+  NSDictionary *events;
+  NSData *json;
+  double settleStart;
+  NSUInteger perClient = opts.dirsPerClient ? MIN(opts.dirsPerClient, opts.dirs) : opts.dirs;
+  NSUInteger c, d;
+
+  [fm removeFileAtPath: opts.root handler: nil];
+  if ([fm createDirectoryAtPath: opts.root attributes: nil] == NO) {
+    fprintf(stderr, "fswatcher-test-client: cannot create %s\n", [opts.root fileSystemRepresentation]);
+    return 2;
+  }
+
+  for (d = 0; d < opts.dirs; d++) {
+    NSString *dir = [opts.root stringByAppendingPathComponent:
+                                 [NSString stringWithFormat: @"d%04lu", (unsigned long)d]];
+
+    [fm createDirectoryAtPath: dir attributes: nil];
+    [dirs addObject: dir];
+    [watchers addObject: [NSMutableArray array]];
+  }
+
+  /* client c watches perClient directories from c * perClient on */
+  for (c = 0; c < opts.clients; c++) {
+    for (d = 0; d < perClient; d++) {
+      [[watchers objectAtIndex: (c * perClient + d) % opts.dirs]
+                    addObject: [NSNumber numberWithUnsignedInteger: c]];
+    }
+  }
+
+  ledger = AUTORELEASE ([[FSWLoadLedger alloc] initWithClientsCount: opts.clients]);
+  generator = AUTORELEASE ([[FSWLoadGenerator alloc] initWithOptions: &opts
+                                                          directories: dirs
+                                                             watchers: watchers
+                                                               ledger: ledger]);
+  if ([generator populate] == NO) {
+    fprintf(stderr, "fswatcher-test-client: cannot populate %s\n", [opts.root fileSystemRepresentation]);
+    return 2;
+  }
+
+  for (c = 0; c < opts.clients; c++) {
+    FSWLoadClient *client = AUTORELEASE ([[FSWLoadClient alloc] initWithIndex: c ledger: ledger]);
+    id <FSWatcherProtocol> fsw;
+
+    if ([client connectBatched: opts.batched] == NO) {
+      fprintf(stderr, "fswatcher-test-client: cannot connect to fswatcher\n");
+      return 2;
+    }
+    fsw = [client fswatcher];
+    if (opts.window >= 0) {
+      [fsw client: (id <FSWClientProtocol>)client
+                    setCoalescingWindow: opts.window adaptive: opts.adaptive];
+    }
+    for (d = 0; d < perClient; d++) {
+      [fsw client: (id <FSWClientProtocol>)client
+                addWatcherForPath: [dirs objectAtIndex: (c * perClient + d) % opts.dirs]];
+    }
+    [clients addObject: client];
+  }
+
+  /* a call that waits for its answer follows the one-way messages of its
+     connection: once every client has one, all the watches are set */
+  for (c = 0; c < [clients count]; c++) {
+    statisticsOf([[clients objectAtIndex: c] fswatcher]);
+  }
+  runFor(0.2);
+  statsBefore = statisticsOf([[clients objectAtIndex: 0] fswatcher]);
+
+  fprintf(stderr, "fswatcher-test-client: %lu clients, %lu directories, %.0f changes/s for %.1f s\n",
+          (unsigned long)opts.clients, (unsigned long)opts.dirs, opts.rate, opts.duration);
+
+  srandom(opts.seed);
+  [NSThread detachNewThreadSelector: @selector(generate:)
+                           toTarget: generator
+                         withObject: self];
+
+  while (generated == NO) {
+    runFor(0.05);
+  }
+
+  settleStart = monotonicTime();
+  while ([ledger pendingCount] > 0 && monotonicTime() - settleStart < opts.settle) {
+    runFor(0.05);
+  }
+  /* for the messages already on their way */
+  runFor(0.1);
+
+  statsAfter = statisticsOf([[clients objectAtIndex: 0] fswatcher]);
+
+  report = [NSMutableDictionary dictionaryWithDictionary: [ledger report]];
+  config = [NSMutableDictionary dictionary];
+  [config setObject: [NSNumber numberWithUnsignedInteger: opts.clients] forKey: @"clients"];
+  [config setObject: [NSNumber numberWithUnsignedInteger: opts.dirs] forKey: @"dirs"];
+  [config setObject: [NSNumber numberWithUnsignedInteger: perClient] forKey: @"dirsPerClient"];
+  [config setObject: [NSNumber numberWithUnsignedInteger: opts.files] forKey: @"files"];
+  [config setObject: [NSNumber numberWithDouble: opts.rate] forKey: @"rate"];
+  [config setObject: [NSNumber numberWithDouble: opts.duration] forKey: @"duration"];
+  [config setObject: [NSString stringWithFormat: @"%u,%u,%u",
+                               opts.mix[0], opts.mix[1], opts.mix[2]] forKey: @"mix"];
+  [config setObject: [NSNumber numberWithBool: opts.batched] forKey: @"batched"];
+  if (opts.window >= 0) {
+    [config setObject: [NSNumber numberWithDouble: opts.window] forKey: @"window"];
+    [config setObject: [NSNumber numberWithBool: opts.adaptive] forKey: @"adaptive"];
+  }
+  [config setObject: [NSNumber numberWithUnsignedInt: opts.seed] forKey: @"seed"];
+  [report setObject: config forKey: @"config"];
+  [report setObject: [generator report] forKey: @"operations"];
+  [report setObject: statisticsDelta(statsBefore, statsAfter) forKey: @"fswatcher"];
+
+  events = [report objectForKey: @"events"];
+  if (opts.maxLoss >= 0 && [[events objectForKey: @"loss"] doubleValue] > opts.maxLoss) {
+    [failures addObject: [NSString stringWithFormat: @"loss %g > %g",
+                             [[events objectForKey: @"loss"] doubleValue], opts.maxLoss]];
+  }
+  if (opts.maxP99 >= 0) {
+    double p99 = [[[report objectForKey: @"latency_ms"] objectForKey: @"p99"] doubleValue];
+
+    if (p99 > opts.maxP99) {
+      [failures addObject: [NSString stringWithFormat: @"p99 %g ms > %g ms", p99, opts.maxP99]];
+    }
+  }
+  [report setObject: failures forKey: @"failures"];
+
+  json = [NSJSONSerialization dataWithJSONObject: report
+                                         options: NSJSONWritingPrettyPrinted
+                                           error: NULL];
+  fwrite([json bytes], 1, [json length], stdout);
+  fputc('\n', stdout);
+
+  for (c = 0; c < [clients count]; c++) {
+    [[clients objectAtIndex: c] disconnect];
+  }
+  if (opts.keep == NO) {
+    [fm removeFileAtPath: opts.root handler: nil];
+  }
+
+  return [failures count] ? 1 : 0;
+}
+
+@end
+
+
+static void loadUsage(const char *name)
+{
+  fprintf(stderr, "Usage: %s --load [options]\n", name);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "  --clients N          clients connected at once (4)\n");
+  fprintf(stderr, "  --dirs N             directories changed (16)\n");
+  fprintf(stderr, "  --dirs-per-client N  directories each client watches (all)\n");
+  fprintf(stderr, "  --files N            files in each directory before the run (20)\n");
+  fprintf(stderr, "  --rate N             changes per second, in all (200)\n");
+  fprintf(stderr, "  --duration S         seconds of changes (10)\n");
+  fprintf(stderr, "  --mix C,M,R          weights of creations, modifications, renames (1,2,1)\n");
+  fprintf(stderr, "  --batched            batched delivery\n");
+  fprintf(stderr, "  --window S           coalescing window of the clients\n");
+  fprintf(stderr, "  --adaptive           adaptive coalescing windows\n");
+  fprintf(stderr, "  --settle S           seconds to wait for late events (5)\n");
+  fprintf(stderr, "  --seed N             seed of the changes (1)\n");
+  fprintf(stderr, "  --root DIR           where the directories are made\n");
+  fprintf(stderr, "  --keep               leave the directories\n");
+  fprintf(stderr, "  --max-loss F         fail when more than this fraction is lost\n");
+  fprintf(stderr, "  --max-p99 MS         fail when the 99th percentile is slower\n");
+}
+
+static int runLoad(int argc, const char *argv[])
+{
+  fsw_load_options opts;
+  int i;
+
+  memset(&opts, 0, sizeof(opts));
+  opts.clients = 4;
+  opts.dirs = 16;
+  opts.files = 20;
+  opts.rate = 200;
+  opts.duration = 10;
+  opts.settle = 5;
+  opts.mix[0] = 1;
+  opts.mix[1] = 2;
+  opts.mix[2] = 1;
+  opts.window = -1;
+  opts.seed = 1;
+  opts.maxLoss = -1;
+  opts.maxP99 = -1;
+  opts.root = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                 [NSString stringWithFormat: @"fswatcher-load-%d", (int)getpid()]];
+
+  for (i = 2; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+    if (strcmp(arg, "--batched") == 0) {
+      opts.batched = YES;
+      continue;
+    } else if (strcmp(arg, "--adaptive") == 0) {
+      opts.adaptive = YES;
+      continue;
+    } else if (strcmp(arg, "--keep") == 0) {
+      opts.keep = YES;
+      continue;
+    } else if (strcmp(arg, "--help") == 0) {
+      loadUsage(argv[0]);
+      return 0;
+    }
+
+    if (val == NULL) {
+      loadUsage(argv[0]);
+      return 2;
+    }
+    i++;
+
+    if (strcmp(arg, "--clients") == 0) {
+      opts.clients = strtoul(val, NULL, 10);
+    } else if (strcmp(arg, "--dirs") == 0) {
+      opts.dirs = strtoul(val, NULL, 10);
+    } else if (strcmp(arg, "--dirs-per-client") == 0) {
+      opts.dirsPerClient = strtoul(val, NULL, 10);
+    } else if (strcmp(arg, "--files") == 0) {
+      opts.files = strtoul(val, NULL, 10);
+    } else if (strcmp(arg, "--rate") == 0) {
+      opts.rate = strtod(val, NULL);
+    } else if (strcmp(arg, "--duration") == 0) {
+      opts.duration = strtod(val, NULL);
+    } else if (strcmp(arg, "--settle") == 0) {
+      opts.settle = strtod(val, NULL);
+    } else if (strcmp(arg, "--window") == 0) {
+      opts.window = strtod(val, NULL);
+    } else if (strcmp(arg, "--seed") == 0) {
+      opts.seed = (unsigned)strtoul(val, NULL, 10);
+    } else if (strcmp(arg, "--root") == 0) {
+      opts.root = [[NSString stringWithUTF8String: val] stringByExpandingTildeInPath];
+    } else if (strcmp(arg, "--max-loss") == 0) {
+      opts.maxLoss = strtod(val, NULL);
+    } else if (strcmp(arg, "--max-p99") == 0) {
+      opts.maxP99 = strtod(val, NULL);
+    } else if (strcmp(arg, "--mix") == 0) {
+      if (sscanf(val, "%u,%u,%u", &opts.mix[0], &opts.mix[1], &opts.mix[2]) != 3) {
+        loadUsage(argv[0]);
+        return 2;
+      }
+    } else {
+      loadUsage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (opts.clients == 0 || opts.dirs == 0 || opts.rate <= 0 || opts.duration <= 0
+        || opts.mix[0] + opts.mix[1] + opts.mix[2] == 0) {
+    loadUsage(argv[0]);
+    return 2;
+  }
+
+  return [AUTORELEASE ([[FSWLoadRun alloc] initWithOptions: &opts]) run];
+}
+
+
 int main(int argc, const char *argv[])
 {
   CREATE_AUTORELEASE_POOL(pool);
+
+  if (argc > 1 && strcmp(argv[1], "--load") == 0) {
+    int status = runLoad(argc, argv);
+
+    RELEASE(pool);
+    return status;
+  }
   
   NSDebugLLog(@"gwspace", @"");
   NSDebugLLog(@"gwspace", @"╔════════════════════════════════════════════╗");
@@ -164,9 +1273,11 @@ int main(int argc, const char *argv[])
   
   if (argc < 2) {
     fprintf(stderr, "Usage: %s <path1> [path2] [path3] ...\n", argv[0]);
+    fprintf(stderr, "       %s --load [options]\n", argv[0]);
     fprintf(stderr, "\nExample:\n");
     fprintf(stderr, "  %s /tmp/test\n", argv[0]);
     fprintf(stderr, "  %s $HOME/Desktop /tmp/test\n", argv[0]);
+    fprintf(stderr, "  %s --load --clients 8 --dirs 64 --rate 2000 --batched\n", argv[0]);
     fprintf(stderr, "\n");
     RELEASE(pool);
     return 1;
@@ -26,7 +26,7 @@
 #define FSWATCHER_H
 
 #import <Foundation/Foundation.h>
-#import "DBKPathsTree.h"
+#import "DBKRadixPathsTree.h"
 
 @class Watcher;
 
@@ -36,6 +36,8 @@
 
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo;
 
+- (oneway void)watchedPathsDidChange:(NSData *)batch;
+
 @end
 
 
@@ -52,6 +54,21 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                           removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          didProcessBatch:(unsigned long long)sequence;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setFilter:(bycopy NSDictionary *)filter;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setCoalescingWindow:(double)seconds
+                          adaptive:(BOOL)flag;
+
+- (bycopy NSDictionary *)statistics;
+
 @end
 
 
@@ -92,8 +109,8 @@
   NSMutableArray *clientsInfo;
   NSMapTable *watchers;
 
-  pcomp *includePathsTree;
-  pcomp *excludePathsTree;  
+  radixtree *includePathsTree;
+  radixtree *excludePathsTree;  
   NSMutableSet *excludedSuffixes;
   
   NSFileManager *fm;
@@ -125,15 +142,30 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                                 removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                didProcessBatch:(unsigned long long)sequence;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setFilter:(bycopy NSDictionary *)filter;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setCoalescingWindow:(double)seconds
+                                adaptive:(BOOL)flag;
+
+- (bycopy NSDictionary *)statistics;
+
 - (Watcher *)watcherForPath:(NSString *)path;
 
 - (void)watcherTimeOut:(NSTimer *)sender;
 
 - (void)removeWatcher:(Watcher *)awatcher;
 
-- (pcomp *)includePathsTree;
+- (radixtree *)includePathsTree;
 
-- (pcomp *)excludePathsTree;  
+- (radixtree *)excludePathsTree;  
 
 - (NSSet *)excludedSuffixes;
 
@@ -139,8 +139,8 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   
   RELEASE (clientsInfo);
   NSZoneFree (NSDefaultMallocZone(), (void *)watchers);
-  freeTree(includePathsTree);
-  freeTree(excludePathsTree);
+  radixFreeTree(includePathsTree);
+  radixFreeTree(excludePathsTree);
   RELEASE (excludedSuffixes);
 
   [super dealloc];
@@ -172,8 +172,8 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
     watchers = NSCreateMapTable(NSObjectMapKeyCallBacks,
 	                                        NSObjectMapValueCallBacks, 0);
       
-    includePathsTree = newTreeWithIdentifier(@"incl_paths");
-    excludePathsTree = newTreeWithIdentifier(@"excl_paths");
+    includePathsTree = newRadixTreeWithIdentifier(@"incl_paths");
+    excludePathsTree = newRadixTreeWithIdentifier(@"excl_paths");
     excludedSuffixes = [[NSMutableSet alloc] initWithCapacity: 1];
     [self setDefaultGlobalPaths];  
 
@@ -268,16 +268,16 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   
   if (entry) {
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
+      radixInsertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
     }
   
   } else {
-    insertComponentsOfPath(NSHomeDirectory(), includePathsTree);
+    radixInsertComponentsOfPath(NSHomeDirectory(), includePathsTree);
 
     entry = NSSearchPathForDirectoriesInDomains(NSAllApplicationsDirectory, 
                                                         NSAllDomainsMask, YES);
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
+      radixInsertComponentsOfPath([entry objectAtIndex: i], includePathsTree);
     }
     
     entry = NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, 
@@ -287,13 +287,13 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
       NSString *path = [dir stringByAppendingPathComponent: @"Headers"];
 
       if ([fm fileExistsAtPath: path]) {
-        insertComponentsOfPath(path, includePathsTree);
+        radixInsertComponentsOfPath(path, includePathsTree);
       }
       
       path = [dir stringByAppendingPathComponent: @"Documentation"];
       
       if ([fm fileExistsAtPath: path]) {
-        insertComponentsOfPath(path, includePathsTree);
+        radixInsertComponentsOfPath(path, includePathsTree);
       }
     }  
   }
@@ -302,7 +302,7 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
 
   if (entry) {
     for (i = 0; i < [entry count]; i++) {
-      insertComponentsOfPath([entry objectAtIndex: i], excludePathsTree);
+      radixInsertComponentsOfPath([entry objectAtIndex: i], excludePathsTree);
     }
   }
   
@@ -329,16 +329,16 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   
   NSUInteger i;
 
-  emptyTreeWithBase(includePathsTree);
+  radixEmptyTree(includePathsTree);
   
   for (i = 0; i < [indexable count]; i++) {
-    insertComponentsOfPath([indexable objectAtIndex: i], includePathsTree);
+    radixInsertComponentsOfPath([indexable objectAtIndex: i], includePathsTree);
   }
 
-  emptyTreeWithBase(excludePathsTree);
+  radixEmptyTree(excludePathsTree);
   
   for (i = 0; i < [excluded count]; i++) {
-    insertComponentsOfPath([excluded objectAtIndex: i], excludePathsTree);
+    radixInsertComponentsOfPath([excluded objectAtIndex: i], excludePathsTree);
   }
   
   [excludedSuffixes removeAllObjects];
@@ -504,6 +504,39 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   }
 }
 
+/* Batches are only built by the inotify backend; here every client
+ * keeps getting one message per event. */
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setBatchedDelivery:(BOOL)flag
+{
+}
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                didProcessBatch:(unsigned long long)sequence
+{
+}
+
+/* Nor filters: clients of this backend still see every event. */
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setFilter:(bycopy NSDictionary *)filter
+{
+}
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                                setCoalescingWindow:(double)seconds
+                                adaptive:(BOOL)flag
+{
+}
+
+- (bycopy NSDictionary *)statistics
+{
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithUnsignedInteger: NSCountMapTable(watchers)], 
+                       @"watches",
+                       [NSNumber numberWithUnsignedInteger: [clientsInfo count]], 
+                       @"clientsCount", nil];
+}
+
 - (Watcher *)watcherForPath:(NSString *)path
 {
   return (Watcher *)NSMapGet(watchers, path);
@@ -536,12 +569,12 @@ static BOOL	auto_stop = NO;		/* Should we shut down when unused? */
   RELEASE (path);
 }
 
-- (pcomp *)includePathsTree
+- (radixtree *)includePathsTree
 {
   return includePathsTree;
 }
 
-- (pcomp *)excludePathsTree
+- (radixtree *)excludePathsTree
 {
   return excludePathsTree;
 }
@@ -579,8 +612,8 @@ static inline BOOL isDotFile(NSString *path)
 
   return (([excludedSuffixes containsObject: ext] == NO)
                    && (isDotFile(path) == NO) 
-                   && inTreeFirstPartOfPath(path, includePathsTree)
-                   && (inTreeFirstPartOfPath(path, excludePathsTree) == NO));
+                   && radixInTreeFirstPartOfPath(path, includePathsTree)
+                   && (radixInTreeFirstPartOfPath(path, excludePathsTree) == NO));
 }
 
 - (void)notifyClients:(NSDictionary *)info
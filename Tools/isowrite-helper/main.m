@@ -16,12 +16,35 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <pthread.h>
+
+#include "ISOImageDigest.h"
 
 #ifndef O_DIRECT
 #define O_DIRECT 0
 #endif
 
-#define BUFFER_SIZE (1024 * 1024)  /* 1MB buffer */
+/* While one buffer is written, the next ones are read and hashed; USB
+   sticks want large requests to reach their bandwidth. */
+#define BUFFER_SIZE (4 * 1024 * 1024)
+#define BUFFER_COUNT 4
+/* O_DIRECT lengths must be multiples of the logical block size */
+#define DIRECT_ALIGNMENT 4096
+
+typedef struct {
+  void *data[BUFFER_COUNT];
+  ssize_t length[BUFFER_COUNT];
+  int head;               /* next buffer the writer takes */
+  int count;              /* buffers read and not yet written */
+  int done;               /* reader reached the end or failed */
+  int readError;          /* errno of a failed read */
+  int stop;               /* writer failed, reader gives up */
+  int isoFd;
+  ISOImageDigest digest;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;
+  pthread_cond_t emptied;
+} Pipeline;
 
 static void print_usage(const char *progname) {
   fprintf(stderr, "Usage: %s <iso-file> <device-path>\n", progname);
@@ -35,6 +58,87 @@ static void print_error(const char *message) {
   exit(1);
 }
 
+/* Fills the buffers in turn, hashing each before handing it over. */
+static void *reader_thread(void *arg) {
+  Pipeline *pl = (Pipeline *)arg;
+  int slot = 0;
+
+  for (;;) {
+    ssize_t got = 0;
+    ssize_t n = 0;
+
+    pthread_mutex_lock(&pl->lock);
+    while (pl->count == BUFFER_COUNT && !pl->stop) {
+      pthread_cond_wait(&pl->emptied, &pl->lock);
+    }
+    if (pl->stop) {
+      pthread_mutex_unlock(&pl->lock);
+      return NULL;
+    }
+    pthread_mutex_unlock(&pl->lock);
+
+    /* full buffers but the last, so every write but the last is aligned */
+    while (got < BUFFER_SIZE) {
+      n = read(pl->isoFd, (char *)pl->data[slot] + got, BUFFER_SIZE - got);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        break;
+      }
+      got += n;
+    }
+
+    if (n < 0) {
+      pthread_mutex_lock(&pl->lock);
+      pl->readError = errno;
+      pl->done = 1;
+      pthread_cond_signal(&pl->filled);
+      pthread_mutex_unlock(&pl->lock);
+      return NULL;
+    }
+
+    if (got > 0) {
+      ISOImageDigestUpdate(&pl->digest, pl->data[slot], (size_t)got);
+    }
+
+    pthread_mutex_lock(&pl->lock);
+    if (got > 0) {
+      pl->length[slot] = got;
+      pl->count++;
+      slot = (slot + 1) % BUFFER_COUNT;
+    }
+    if (got < BUFFER_SIZE) {
+      pl->done = 1;
+    }
+    pthread_cond_signal(&pl->filled);
+    pthread_mutex_unlock(&pl->lock);
+
+    if (got < BUFFER_SIZE) {
+      return NULL;
+    }
+  }
+}
+
+static int write_fully(int fd, const char *buf, ssize_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      if (n == 0) {
+        errno = EIO;
+      }
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
 int main(int argc, const char *argv[]) {
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
   
@@ -80,10 +184,15 @@ int main(int argc, const char *argv[]) {
     exit(1);
   }
   
-  /* Open device for writing with O_SYNC */
-  int device_fd = open(device_path, O_WRONLY | O_SYNC | O_DIRECT);
+  posix_fadvise(iso_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  /* Open the device unbuffered: O_DIRECT writes reach the device as they
+     are made, so the progress is true without O_SYNC flushing each one */
+  int direct = 1;
+  int device_fd = open(device_path, O_WRONLY | O_DIRECT);
   if (device_fd < 0) {
     /* Try without O_DIRECT */
+    direct = 0;
     device_fd = open(device_path, O_WRONLY | O_SYNC);
   }
   
@@ -93,69 +202,120 @@ int main(int argc, const char *argv[]) {
     exit(1);
   }
   
-  /* Allocate aligned buffer */
-  void *buffer = NULL;
-  if (posix_memalign(&buffer, 4096, BUFFER_SIZE) != 0) {
-    buffer = malloc(BUFFER_SIZE);
-  }
-  
-  if (!buffer) {
-    print_error("Cannot allocate buffer");
+  /* Allocate aligned buffers */
+  Pipeline pl;
+  int i;
+
+  memset(&pl, 0, sizeof(pl));
+  pl.isoFd = iso_fd;
+  ISOImageDigestInit(&pl.digest);
+  pthread_mutex_init(&pl.lock, NULL);
+  pthread_cond_init(&pl.filled, NULL);
+  pthread_cond_init(&pl.emptied, NULL);
+
+  for (i = 0; i < BUFFER_COUNT; i++) {
+    if (posix_memalign(&pl.data[i], DIRECT_ALIGNMENT, BUFFER_SIZE) != 0) {
+      print_error("Cannot allocate buffer");
+    }
   }
   
   /* Copy data */
   unsigned long long total_written = 0;
   unsigned long long last_report = 0;
-  ssize_t bytes_read;
+  pthread_t reader;
+  int write_errno = 0;
   
   fprintf(stderr, "INFO: Writing image to device...\n");
   fprintf(stderr, "INFO: ISO size: %lld bytes\n", (long long)iso_stat.st_size);
+
+  if (pthread_create(&reader, NULL, reader_thread, &pl) != 0) {
+    print_error("Cannot start the reader thread");
+  }
   
-  while ((bytes_read = read(iso_fd, buffer, BUFFER_SIZE)) > 0) {
-    ssize_t bytes_written = write(device_fd, buffer, bytes_read);
-    
-    if (bytes_written < 0) {
-      fprintf(stderr, "ERROR: Write failed: %s\n", strerror(errno));
-      free(buffer);
-      close(device_fd);
-      close(iso_fd);
-      exit(1);
+  for (;;) {
+    ssize_t length;
+    void *data;
+
+    pthread_mutex_lock(&pl.lock);
+    while (pl.count == 0 && !pl.done) {
+      pthread_cond_wait(&pl.filled, &pl.lock);
     }
-    
-    if (bytes_written != bytes_read) {
-      fprintf(stderr, "ERROR: Incomplete write (%zd of %zd bytes)\n", 
-              bytes_written, bytes_read);
-      free(buffer);
-      close(device_fd);
-      close(iso_fd);
-      exit(1);
+    if (pl.count == 0) {
+      pthread_mutex_unlock(&pl.lock);
+      break;
+    }
+    data = pl.data[pl.head];
+    length = pl.length[pl.head];
+    pthread_mutex_unlock(&pl.lock);
+
+    /* the tail of the image may not be a whole number of blocks */
+    if (direct && (length % DIRECT_ALIGNMENT) != 0) {
+      fcntl(device_fd, F_SETFL, fcntl(device_fd, F_GETFL) & ~O_DIRECT);
+      direct = 0;
+    }
+
+    if (write_fully(device_fd, data, length) < 0) {
+      write_errno = errno;
+      break;
     }
+
+    pthread_mutex_lock(&pl.lock);
+    pl.head = (pl.head + 1) % BUFFER_COUNT;
+    pl.count--;
+    pthread_cond_signal(&pl.emptied);
+    pthread_mutex_unlock(&pl.lock);
     
-    total_written += bytes_written;
+    total_written += length;
     
     /* Report progress every 5MB for responsive UI updates */
-    if (total_written - last_report >= 5 * 1024 * 1024 || bytes_read == 0) {
+    if (total_written - last_report >= 5 * 1024 * 1024) {
       double percent = (double)total_written / (double)iso_stat.st_size * 100.0;
       fprintf(stderr, "PROGRESS: %.1f%% (%llu / %lld bytes)\n", 
               percent, total_written, (long long)iso_stat.st_size);
       last_report = total_written;
     }
   }
+
+  pthread_mutex_lock(&pl.lock);
+  pl.stop = 1;
+  pthread_cond_signal(&pl.emptied);
+  pthread_mutex_unlock(&pl.lock);
+  pthread_join(reader, NULL);
   
-  if (bytes_read < 0) {
-    fprintf(stderr, "ERROR: Read failed: %s\n", strerror(errno));
-    free(buffer);
+  if (write_errno) {
+    fprintf(stderr, "ERROR: Write failed: %s\n", strerror(write_errno));
+    close(device_fd);
+    close(iso_fd);
+    exit(1);
+  }
+
+  if (pl.readError) {
+    fprintf(stderr, "ERROR: Read failed: %s\n", strerror(pl.readError));
     close(device_fd);
     close(iso_fd);
     exit(1);
   }
   
+  fprintf(stderr, "PROGRESS: 100.0%% (%llu / %lld bytes)\n",
+          total_written, (long long)iso_stat.st_size);
+
   /* Sync to ensure all data is written */
   fprintf(stderr, "INFO: Syncing device...\n");
-  fsync(device_fd);
+  if (fsync(device_fd) != 0) {
+    fprintf(stderr, "ERROR: Sync failed: %s\n", strerror(errno));
+    close(device_fd);
+    close(iso_fd);
+    exit(1);
+  }
+
+  /* What ISOWriteOperation compares the device read-back with */
+  fprintf(stderr, "DIGEST: %016llx %llu\n",
+          (unsigned long long)ISOImageDigestFinal(&pl.digest), total_written);
   
   /* Clean up */
-  free(buffer);
+  for (i = 0; i < BUFFER_COUNT; i++) {
+    free(pl.data[i]);
+  }
   close(device_fd);
   close(iso_fd);
   
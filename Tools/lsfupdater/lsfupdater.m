@@ -25,6 +25,8 @@
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import "FinderModulesProtocol.h"
+#import "FSNHiddenMatcher.h"
+#import "FSNResultsStore.h"
 #include "config.h"
 
 #ifndef GW_DEBUG_LOG
@@ -35,8 +37,33 @@
   do { if (GW_DEBUG_LOG) \
     NSDebugLLog(@"gwspace", format , ## args); } while (0)
 
+/* with fswatcher telling the changes, the timer only makes sure */
+#define SWEEP_FACTOR 10
+#define SAVE_DELAY (2.0)
+
 BOOL subPathOfPath(NSString *p1, NSString *p2);
 
+/*
+ * The cheapest module first, in the order of the Finder between the
+ * ones of the same cost.  A module that doesn't tell is taken as one
+ * that reads the files.
+ */
+static NSInteger compareModulesCost(id m1, id m2, void *context)
+{
+  NSInteger c1 = [m1 respondsToSelector: @selector(evaluationCost)] 
+                              ? [m1 evaluationCost] : FModuleCostContents;
+  NSInteger c2 = [m2 respondsToSelector: @selector(evaluationCost)] 
+                              ? [m2 evaluationCost] : FModuleCostContents;
+
+  if (c1 < c2) {
+    return NSOrderedAscending;
+  } else if (c1 > c2) {
+    return NSOrderedDescending;
+  }
+
+  return [m1 compareModule: m2];
+}
+
 @protocol LSFolderProtocol
 
 - (oneway void)setUpdater:(id)anObject;
@@ -58,12 +85,32 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 - (oneway void)insertDirectoryTreesFromPaths:(NSData *)info;
 - (oneway void)removeTreesFromPaths:(NSData *)info;
 - (NSData *)directoryTreeFromPath:(NSString *)path;
+- (NSNumber *)openDirectoryTreeCursorFromPath:(NSString *)path;
+- (NSData *)nextChunk:(NSNumber *)cursor;
+- (oneway void)closeDirectoryTreeCursor:(NSNumber *)cursor;
 - (NSString *)annotationsForPath:(NSString *)path;
+- (NSData *)annotationsForPaths:(NSData *)info;
 - (NSTimeInterval)timestampOfPath:(NSString *)path;
 
 @end
 
 
+@protocol	FSWatcher
+
+- (oneway void)registerClient:(id)client
+              isGlobalWatcher:(BOOL)global;
+
+- (oneway void)unregisterClient:(id)client;
+
+- (oneway void)client:(id)client
+                          addWatcherForPath:(NSString *)path;
+
+- (oneway void)client:(id)client
+                          removeWatcherForPath:(NSString *)path;
+
+@end
+
+
 @interface LSFUpdater: NSObject
 {
   NSMutableArray *searchPaths;
@@ -81,6 +128,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   BOOL norecursion;
   
   NSMutableArray *foundPaths;
+  FSNResultsStore *results;
   int fpathindex;
   
   NSDate *lastUpdate;
@@ -88,9 +136,11 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   unsigned autoupdate;
   NSTimeInterval updateInterval;
   NSTimer *autoupdateTmr;
+  NSTimer *saveTmr;
   
   id lsfolder;
   id ddbd;
+  id fswatcher;
   NSFileManager *fm;
   NSNotificationCenter *nc;
 }
@@ -105,12 +155,18 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 - (void)setAutoupdate:(unsigned)value;
 - (void)resetTimer;
+- (NSTimeInterval)cycleTime;
 - (void)notifyEndAction:(id)sender;
 - (void)terminate;
 - (void)fastUpdate;
 - (void)getFoundPaths;
+- (void)recordFoundPath:(NSString *)path;
+- (void)forgetFoundPath:(NSString *)path;
 - (void)checkFoundPaths;
 - (void)updateSearchPath:(NSString *)srcpath;
+- (void)updateDirectory:(NSString *)dbpath
+       knownDirectories:(NSSet *)known
+     unknownDirectories:(NSMutableSet *)unknown;
 - (BOOL)saveResults;
 - (NSArray *)fullSearchInDirectory:(NSString *)dirpath;
 - (BOOL)checkPath:(NSString *)path;
@@ -132,13 +188,32 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 - (void)ddbdInsertTrees;
 - (void)ddbdInsertDirectoryTreesFromPaths:(NSArray *)paths;
 - (NSArray *)ddbdGetDirectoryTreeFromPath:(NSString *)path;
+- (NSNumber *)ddbdOpenDirectoryTreeCursorFromPath:(NSString *)path;
+- (NSArray *)ddbdNextChunk:(NSNumber *)cursor;
 - (void)ddbdRemoveTreesFromPaths:(NSArray *)paths;
 - (NSString *)ddbdGetAnnotationsForPath:(NSString *)path;
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths;
 - (NSTimeInterval)ddbdGetTimestampOfPath:(NSString *)path;
 
 @end
 
 
+@interface LSFUpdater (fswatcher)
+
+- (void)connectFSWatcher;
+- (void)disconnectFSWatcher;
+- (void)fswatcherConnectionDidDie:(NSNotification *)notif;
+- (oneway void)watchedPathDidChange:(NSData *)info;
+- (oneway void)globalWatchedPathDidChange:(NSDictionary *)info;
+- (void)pathDidChange:(NSString *)path
+              created:(BOOL)created;
+- (BOOL)isSearchedPath:(NSString *)path;
+- (void)scheduleSave;
+- (void)saveChanges:(id)sender;
+
+@end
+
+
 @interface LSFUpdater (scheduled)
 
 - (void)searchInNextDirectory:(id)sender;
@@ -157,9 +232,15 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     [autoupdateTmr invalidate];
     DESTROY (autoupdateTmr);
   }
+
+  if (saveTmr && [saveTmr isValid]) {
+    [saveTmr invalidate];
+    DESTROY (saveTmr);
+  }
   
   DESTROY (lsfolder);
   DESTROY (ddbd);
+  DESTROY (fswatcher);
 
   RELEASE (modules);
   RELEASE (searchPaths);
@@ -167,6 +248,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   RELEASE (lastUpdate);
   RELEASE (startSearch);
   RELEASE (foundPaths);
+  RELEASE (results);
   RELEASE (directories);
   
   [super dealloc];
@@ -184,6 +266,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     nc = [NSNotificationCenter defaultCenter];
     lsfolder = nil;
     ddbd = nil;
+    fswatcher = nil;
 
     modules = [NSMutableArray new];
     searchPaths = nil;
@@ -191,9 +274,11 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     lastUpdate = nil;
     startSearch = nil;
     foundPaths = [NSMutableArray new];
+    results = nil;
     directories = nil;
 
     autoupdateTmr = nil;
+    saveTmr = nil;
     autoupdate = 0;
     updateInterval = 0.0;
     fpathindex = 0;
@@ -244,6 +329,10 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   searchPaths = [[lsfinfo objectForKey: @"searchpaths"] mutableCopy];
   ASSIGN (searchCriteria, [lsfinfo objectForKey: @"criteria"]);
   ASSIGN (lastUpdate, [NSDate dateWithString: [lsfinfo objectForKey: @"lastupdate"]]);
+  DESTROY (results);
+  results = [[FSNResultsStore alloc] initWithDirectory:
+                 [[lsfolder infoPath] stringByDeletingLastPathComponent]
+                                              writable: YES];
   [self loadModules];
 }
 
@@ -320,6 +409,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     }
   }
 
+  [modules sortUsingFunction: compareModulesCost context: NULL];
+
   RELEASE (arp);
 }
 
@@ -391,11 +482,13 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
       [self getFoundPaths];
     }
 
+    [self connectFSWatcher];
+
     if (dircount > 0) {
       unsigned fcount = [foundPaths count];
       unsigned count = (fcount > dircount) ? fcount : dircount;
       count = (count == 0) ? 1 : count;
-      updateInterval = (autoupdate * 1.0) / count;
+      updateInterval = [self cycleTime] / count;
     }
 
     interval = (updateInterval == 0) ? 0.1 : updateInterval;
@@ -406,7 +499,9 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
                              userInfo: nil 
                               repeats: YES];
     RETAIN (autoupdateTmr);
-  } 
+  } else {
+    [self disconnectFSWatcher];
+  }
 }
 
 - (void)resetTimer
@@ -422,7 +517,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     NSTimeInterval interval;
     
     count = (count == 0) ? 1 : count;
-    updateInterval = (autoupdate * 1.0) / count;
+    updateInterval = [self cycleTime] / count;
     interval = (updateInterval == 0) ? 0.1 : updateInterval;
 
     GWDebugLog(@"\nresetTimer");
@@ -439,6 +534,12 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   }
 }
 
+/* the time the timer takes to go through all the search paths */
+- (NSTimeInterval)cycleTime
+{
+  return (autoupdate * 1.0) * (fswatcher ? SWEEP_FACTOR : 1);
+}
+
 - (void)notifyEndAction:(id)sender
 {
   if (lsfolder) {
@@ -452,7 +553,13 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     [autoupdateTmr invalidate];
     DESTROY (autoupdateTmr);
   }
+
+  if (saveTmr && [saveTmr isValid]) {
+    [saveTmr invalidate];
+    [self saveChanges: nil];
+  }
   
+  [self disconnectFSWatcher];
   [nc removeObserver: self];
   DESTROY (ddbd);
   exit(0);
@@ -466,8 +573,9 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 
   GWDebugLog(@"starting fast update");
 
-  [lsfolder clearFoundPaths];
-  
+  [[FSNHiddenMatcher sharedMatcher] updateFromGWorkspaceDefaults];
+
+  /* the folder reads the paths from the store: only the changes are sent */
   [self getFoundPaths];
 
   GWDebugLog(@"got %lu found paths. checking...", (unsigned long)[foundPaths count]);
@@ -482,9 +590,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
       if (isdir) {
         [self updateSearchPath: spath];
       } else if ([self checkPath: spath]
-                      && ([foundPaths containsObject: spath] == NO)) {
-        [foundPaths addObject: spath];
-        [lsfolder addFoundPath: spath];
+                      && ([results containsPath: spath] == NO)) {
+        [self recordFoundPath: spath];
       }
     } else {
       [searchPaths removeObjectAtIndex: i];
@@ -513,19 +620,25 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 - (void)getFoundPaths
 {
-  NSString *fpath = [lsfolder foundPath];
-
-  [foundPaths removeAllObjects];
-
-  if ([fm fileExistsAtPath: fpath]) {
-    NSArray *founds = [NSArray arrayWithContentsOfFile: fpath];
+  [foundPaths setArray: [results allPaths]];
+}
 
-    if (founds) {
-      [foundPaths addObjectsFromArray: founds];
-    } 
+/* A path found, unless it was already, into the store and the folder. */
+- (void)recordFoundPath:(NSString *)path
+{
+  if ([results addPath: path]) {
+    [foundPaths addObject: path];
+    [lsfolder addFoundPath: path];
   }
 }
 
+- (void)forgetFoundPath:(NSString *)path
+{
+  [results removePath: path];
+  [foundPaths removeObject: path];
+  [lsfolder removeFoundPath: path];
+}
+
 - (void)checkFoundPaths
 {
   int count = [foundPaths count];
@@ -561,12 +674,11 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     }
     
     if (remove) {
+      [results removePath: path];
       [lsfolder removeFoundPath: path];
       [foundPaths removeObjectAtIndex: i];
       count--;
       i--;
-    } else {
-      [lsfolder addFoundPath: path];
     }
   }
 }
@@ -574,93 +686,61 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 - (void)updateSearchPath:(NSString *)srcpath
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSArray *paths;
+  NSNumber *cursor = nil;
   
   GWDebugLog(@"getting directories from the db...");
   
-  if (norecursion) {
-    paths = [NSArray array];
-  } else {
-    paths = [self ddbdGetDirectoryTreeFromPath: srcpath];
+  if (norecursion == NO) {
+    cursor = [self ddbdOpenDirectoryTreeCursorFromPath: srcpath];
   }
   
-  if (paths) {
+  if (cursor || norecursion) {
     NSMutableArray *toinsert = [NSMutableArray array];
-    unsigned count = [paths count];
-    unsigned i;
-        
-    paths = [paths arrayByAddingObject: srcpath];
+    NSMutableSet *known = [NSMutableSet setWithObject: srcpath];
+    NSMutableSet *unknown = [NSMutableSet set];
+    NSEnumerator *enumerator;
+    NSString *fpath;
+    NSArray *chunk;
+    unsigned i, m;
 
-    GWDebugLog(@"%lu directories", (unsigned long)[paths count]);
     GWDebugLog(@"updating in %@", srcpath);    
-    
-    for (i = 0; i <= count; i++) {
-      CREATE_AUTORELEASE_POOL(arp1);
-      NSString *dbpath = [paths objectAtIndex: i];
-      NSDictionary *attributes = [fm fileAttributesAtPath: dbpath traverseLink: NO];
-      NSDate *moddate = [attributes fileModificationDate];
-      BOOL mustcheck;
-      
-      mustcheck = (([moddate laterDate: lastUpdate] == moddate) || newcriteria);
-      
-      if ((mustcheck == NO) && metadataModule) {
-        NSTimeInterval interval = [lastUpdate timeIntervalSinceReferenceDate];
-        mustcheck = ([self ddbdGetTimestampOfPath: dbpath] > interval);      
-        if (mustcheck) {
-          GWDebugLog(@"metadata modification date changed at %@", dbpath);
-        }
+
+    /* the directories are checked chunk by chunk, as ddbd reads them */
+    while (cursor && (chunk = [self ddbdNextChunk: cursor])) {
+      for (i = 0; i < [chunk count]; i++) {
+        NSString *dbpath = [chunk objectAtIndex: i];
+
+        [known addObject: dbpath];
+        [unknown removeObject: dbpath];
+        [self updateDirectory: dbpath 
+             knownDirectories: known 
+           unknownDirectories: unknown];
       }
-      
-      if (mustcheck) {
-        NSArray *contents;
-        unsigned j, m;
-
-        if ([self checkPath: dbpath attributes: attributes]
-                      && ([foundPaths containsObject: dbpath] == NO)) {
-          [foundPaths addObject: dbpath];
-          [lsfolder addFoundPath: dbpath];
-          GWDebugLog(@"adding %@", dbpath);
-        }
-        
-        contents = [fm directoryContentsAtPath: dbpath];
-        
-        for (j = 0; j < [contents count]; j++) {
-          CREATE_AUTORELEASE_POOL(arp2);
-          NSString *fname = [contents objectAtIndex: j];
-          NSString *fpath = [dbpath stringByAppendingPathComponent: fname];
-          NSDictionary *attr = [fm fileAttributesAtPath: fpath traverseLink: NO];
+    }
 
-          if ([self checkPath: fpath attributes: attr]
-                              && ([foundPaths containsObject: fpath] == NO)) {
-            [foundPaths addObject: fpath];
-            [lsfolder addFoundPath: fpath];
-            GWDebugLog(@"adding %@", fpath);
-          }
+    [self updateDirectory: srcpath 
+         knownDirectories: known 
+       unknownDirectories: unknown];
 
-          if (([attr fileType] == NSFileTypeDirectory) 
-                        && ([paths containsObject: fpath] == NO) 
-                                                && (norecursion == NO)) { 
-            NSArray *founds = [self fullSearchInDirectory: fpath];
+    GWDebugLog(@"%lu directories", (unsigned long)[known count]);
 
-            if (founds && [founds count]) {
-              for (m = 0; m < [founds count]; m++) {
-                NSString *found = [founds objectAtIndex: m];
+    /* the new directories, that no chunk of the tree had */
+    enumerator = [unknown objectEnumerator];
 
-                if ([foundPaths containsObject: found] == NO) {
-                  [foundPaths addObject: found];
-                  [lsfolder addFoundPath: found];
-                  GWDebugLog(@"adding %@", found);
-                }
-              }
-            }
+    while ((fpath = [enumerator nextObject])) {
+      CREATE_AUTORELEASE_POOL(arp1);
+      NSArray *founds = [self fullSearchInDirectory: fpath];
 
-            [self insertShorterPath: fpath inArray: toinsert];
-          }
+      for (m = 0; m < [founds count]; m++) {
+        NSString *found = [founds objectAtIndex: m];
 
-          RELEASE (arp2);
+        if ([results containsPath: found] == NO) {
+          [self recordFoundPath: found];
+          GWDebugLog(@"adding %@", found);
         }
       }
-      
+
+      [self insertShorterPath: fpath inArray: toinsert];
       RELEASE (arp1);
     }
      
@@ -680,9 +760,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     for (i = 0; i < [founds count]; i++) {
       NSString *found = [founds objectAtIndex: i];
       
-      if ([foundPaths containsObject: found] == NO) {
-        [foundPaths addObject: found];
-        [lsfolder addFoundPath: found];
+      if ([results containsPath: found] == NO) {
+        [self recordFoundPath: found];
       }
     }
     
@@ -696,6 +775,67 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   RELEASE (arp);
 }
 
+/*
+ * Checks dbpath and its contents if they changed since the last
+ * update.  The subdirectories that are not in known go in unknown:
+ * they are searched in full if the rest of the tree doesn't have them.
+ */
+- (void)updateDirectory:(NSString *)dbpath
+       knownDirectories:(NSSet *)known
+     unknownDirectories:(NSMutableSet *)unknown
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSDictionary *attributes = [fm fileAttributesAtPath: dbpath traverseLink: NO];
+  NSDate *moddate = [attributes fileModificationDate];
+  BOOL mustcheck;
+      
+  mustcheck = (([moddate laterDate: lastUpdate] == moddate) || newcriteria);
+      
+  if ((mustcheck == NO) && metadataModule) {
+    NSTimeInterval interval = [lastUpdate timeIntervalSinceReferenceDate];
+    mustcheck = ([self ddbdGetTimestampOfPath: dbpath] > interval);      
+    if (mustcheck) {
+      GWDebugLog(@"metadata modification date changed at %@", dbpath);
+    }
+  }
+      
+  if (mustcheck) {
+    NSArray *contents;
+    unsigned j;
+
+    if ([self checkPath: dbpath attributes: attributes]
+                  && ([results containsPath: dbpath] == NO)) {
+      [self recordFoundPath: dbpath];
+      GWDebugLog(@"adding %@", dbpath);
+    }
+        
+    contents = [fm directoryContentsAtPath: dbpath];
+        
+    for (j = 0; j < [contents count]; j++) {
+      CREATE_AUTORELEASE_POOL(arp1);
+      NSString *fname = [contents objectAtIndex: j];
+      NSString *fpath = [dbpath stringByAppendingPathComponent: fname];
+      NSDictionary *attr = [fm fileAttributesAtPath: fpath traverseLink: NO];
+
+      if ([self checkPath: fpath attributes: attr]
+                          && ([results containsPath: fpath] == NO)) {
+        [self recordFoundPath: fpath];
+        GWDebugLog(@"adding %@", fpath);
+      }
+
+      if (([attr fileType] == NSFileTypeDirectory) 
+                    && ([known containsObject: fpath] == NO) 
+                                            && (norecursion == NO)) { 
+        [unknown addObject: fpath];
+      }
+
+      RELEASE (arp1);
+    }
+  }
+
+  RELEASE (arp);
+}
+
 - (BOOL)saveResults
 {
   NSMutableDictionary *dict = [NSMutableDictionary dictionary];
@@ -715,7 +855,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   if ([dict writeToFile: [lsfolder infoPath] atomically: YES] == NO) {
     return NO;
   }
-  if ([foundPaths writeToFile: [lsfolder foundPath] atomically: YES] == NO) {
+  if ([results synchronize] == NO) {
     return NO;
   }
 
@@ -736,12 +876,15 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     if (path) {
       NSString *fullPath = [dirpath stringByAppendingPathComponent: path];
       NSDictionary *attrs = [enumerator fileAttributes];
+      BOOL hidden = [[FSNHiddenMatcher sharedMatcher] 
+                        isHiddenName: [fullPath lastPathComponent]
+                         inDirectory: [fullPath stringByDeletingLastPathComponent]];
 
-      if ([self checkPath: fullPath attributes: attrs]) {    
+      if ((hidden == NO) && [self checkPath: fullPath attributes: attrs]) {    
         [founds addObject: fullPath];
       }
 
-      if (([attrs fileType] == NSFileTypeDirectory) && norecursion) {
+      if (([attrs fileType] == NSFileTypeDirectory) && (norecursion || hidden)) {
         [enumerator skipDescendents];
       }
 
@@ -761,7 +904,13 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 
 - (BOOL)checkPath:(NSString *)path
 {
-  NSDictionary *attrs = [fm fileAttributesAtPath: path traverseLink: NO];
+  NSDictionary *attrs;
+
+  if ([[FSNHiddenMatcher sharedMatcher] isHiddenPath: path]) {
+    return NO;
+  }
+
+  attrs = [fm fileAttributesAtPath: path traverseLink: NO];
   return (attrs && [self checkPath: path attributes: attrs]);
 }
 
@@ -794,7 +943,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     if ([lastmod laterDate: lastUpdate] == lastmod) {
       return [module checkPath: path withAttributes: attrs];
     } else {
-      return [foundPaths containsObject: path];
+      return [results containsPath: path];
     }
 
   } else {
@@ -917,16 +1066,45 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 }
 
 - (NSArray *)ddbdGetDirectoryTreeFromPath:(NSString *)path
+{
+  NSNumber *cursor = [self ddbdOpenDirectoryTreeCursorFromPath: path];
+
+  if (cursor) {
+    NSMutableArray *paths = [NSMutableArray array];
+    NSArray *chunk;
+
+    while ((chunk = [self ddbdNextChunk: cursor])) {
+      [paths addObjectsFromArray: chunk];
+    }
+
+    return paths;
+  }
+  
+  return nil;
+}
+
+- (NSNumber *)ddbdOpenDirectoryTreeCursorFromPath:(NSString *)path
+{
+  [self connectDDBd];
+  if (ddbd != nil) {
+    return [ddbd openDirectoryTreeCursorFromPath: path];
+  }
+
+  return nil;
+}
+
+/* the next directories of cursor, nil at its end */
+- (NSArray *)ddbdNextChunk:(NSNumber *)cursor
 {
   [self connectDDBd];
   if (ddbd != nil) {
-    NSData *data = [ddbd directoryTreeFromPath: path];  
+    NSData *data = [ddbd nextChunk: cursor];
 
     if (data) {
       return [NSUnarchiver unarchiveObjectWithData: data];
     }
   }
-  
+
   return nil;
 }
 
@@ -947,6 +1125,20 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
   return nil;
 }
 
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths
+{
+  [self connectDDBd];
+  if (ddbd != nil) {
+    NSData *data = [ddbd annotationsForPaths: 
+                      [NSArchiver archivedDataWithRootObject: paths]];
+
+    if (data) {
+      return [NSUnarchiver unarchiveObjectWithData: data];
+    }
+  }
+  return nil;
+}
+
 - (NSTimeInterval)ddbdGetTimestampOfPath:(NSString *)path
 {
   [self connectDDBd];
@@ -959,6 +1151,231 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
 @end
 
 
+@implementation	LSFUpdater (fswatcher)
+
+/*
+ * fswatcher tells the changes under the indexable paths to its global
+ * clients, and the ones in the search paths themselves to the client
+ * watching them, so the changes outside of both are left to the timer.
+ */
+- (void)connectFSWatcher
+{
+  if (fswatcher == nil) {
+    fswatcher = [NSConnection rootProxyForConnectionWithRegisteredName: @"fswatcher" 
+                                                                  host: @""];
+    if (fswatcher) {
+      NSUInteger i;
+
+      RETAIN (fswatcher);
+      [fswatcher setProtocolForProxy: @protocol(FSWatcher)];
+
+      [nc addObserver: self
+             selector: @selector(fswatcherConnectionDidDie:)
+                 name: NSConnectionDidDieNotification
+               object: [fswatcher connectionForProxy]];
+
+      [fswatcher registerClient: self isGlobalWatcher: YES];
+
+      for (i = 0; i < [searchPaths count]; i++) {
+        NSString *spath = [searchPaths objectAtIndex: i];
+        BOOL isdir;
+
+        if ([fm fileExistsAtPath: spath isDirectory: &isdir] && isdir) {
+          [fswatcher client: self addWatcherForPath: spath];
+        }
+      }
+
+      GWDebugLog(@"fswatcher connected!");
+    } else {
+      GWDebugLog(@"no fswatcher, updating on the timer only.");
+    }
+  }
+}
+
+- (void)disconnectFSWatcher
+{
+  if (fswatcher) {
+    NSUInteger i;
+
+    [nc removeObserver: self
+                  name: NSConnectionDidDieNotification
+                object: [fswatcher connectionForProxy]];
+
+    for (i = 0; i < [searchPaths count]; i++) {
+      [fswatcher client: self 
+           removeWatcherForPath: [searchPaths objectAtIndex: i]];
+    }
+
+    [fswatcher unregisterClient: self];
+    DESTROY (fswatcher);
+  }
+}
+
+- (void)fswatcherConnectionDidDie:(NSNotification *)notif
+{
+  [nc removeObserver: self
+	              name: NSConnectionDidDieNotification
+	            object: [notif object]];
+
+  // Don't access [fswatcher connectionForProxy] here - the connection is already dead
+  RELEASE (fswatcher);
+  fswatcher = nil;
+
+  NSDebugLLog(@"gwspace", @"the fswatcher connection died!");
+  [self resetTimer];
+}
+
+- (oneway void)watchedPathDidChange:(NSData *)info
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSDictionary *dict = [NSUnarchiver unarchiveObjectWithData: info];
+  NSString *path = [dict objectForKey: @"path"];
+  NSString *event = [dict objectForKey: @"event"];
+
+  if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]
+        || [event isEqual: @"GWFileDeletedInWatchedDirectory"]) {
+    NSArray *files = [dict objectForKey: @"files"];
+    BOOL created = [event isEqual: @"GWFileCreatedInWatchedDirectory"];
+    NSUInteger i;
+
+    for (i = 0; i < [files count]; i++) {
+      [self pathDidChange: [path stringByAppendingPathComponent: 
+                                                  [files objectAtIndex: i]]
+                  created: created];
+    }
+
+  } else if ([event isEqual: @"GWWatchedFileModified"]
+                || [event isEqual: @"GWWatchedPathDeleted"]) {
+    [self pathDidChange: path created: NO];
+  }
+
+  RELEASE (arp);
+}
+
+- (oneway void)globalWatchedPathDidChange:(NSDictionary *)info
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSString *event = [info objectForKey: @"event"];
+
+  [self pathDidChange: [info objectForKey: @"path"]
+              created: [event isEqual: @"GWFileCreatedInWatchedDirectory"]];
+
+  RELEASE (arp);
+}
+
+/*
+ * The path is checked again, and so is a directory that has just come
+ * into a recursive search with its contents.  A path that is gone
+ * takes away what was found under it.
+ */
+- (void)pathDidChange:(NSString *)path
+              created:(BOOL)created
+{
+  NSDictionary *attrs;
+  BOOL changed = NO;
+
+  if ((autoupdate == 0) || ([self isSearchedPath: path] == NO)) {
+    return;
+  }
+
+  attrs = [fm fileAttributesAtPath: path traverseLink: NO];
+
+  if (attrs == nil) {
+    NSUInteger i = [foundPaths count];
+
+    while (i > 0) {
+      NSString *fpath = [foundPaths objectAtIndex: --i];
+
+      if ([fpath isEqual: path] || subPathOfPath(path, fpath)) {
+        [results removePath: fpath];
+        [lsfolder removeFoundPath: fpath];
+        [foundPaths removeObjectAtIndex: i];
+        changed = YES;
+      }
+    }
+
+  } else {
+    BOOL wasfound = [results containsPath: path];
+
+    if ([self checkPath: path attributes: attrs]) {
+      if (wasfound == NO) {
+        [self recordFoundPath: path];
+        changed = YES;
+      }
+    } else if (wasfound) {
+      [self forgetFoundPath: path];
+      changed = YES;
+    }
+
+    if (created && (norecursion == NO) 
+                && ([attrs fileType] == NSFileTypeDirectory)) {
+      NSArray *founds = [self fullSearchInDirectory: path];
+      NSUInteger i;
+
+      for (i = 0; i < [founds count]; i++) {
+        NSString *fpath = [founds objectAtIndex: i];
+
+        if ([results containsPath: fpath] == NO) {
+          [self recordFoundPath: fpath];
+          changed = YES;
+        }
+      }
+
+      [self ddbdInsertDirectoryTreesFromPaths: [NSArray arrayWithObject: path]];
+    }
+  }
+
+  if (changed) {
+    [self scheduleSave];
+  }
+}
+
+- (BOOL)isSearchedPath:(NSString *)path
+{
+  NSUInteger i;
+
+  for (i = 0; i < [searchPaths count]; i++) {
+    NSString *spath = [searchPaths objectAtIndex: i];
+
+    if ([path isEqual: spath]) {
+      return YES;
+    } else if (norecursion) {
+      if ([[path stringByDeletingLastPathComponent] isEqual: spath]) {
+        return YES;
+      }
+    } else if (subPathOfPath(spath, path)) {
+      return YES;
+    }
+  }
+
+  return NO;
+}
+
+/* a burst of changes is written once */
+- (void)scheduleSave
+{
+  if (saveTmr == nil) {
+    saveTmr = [NSTimer scheduledTimerWithTimeInterval: SAVE_DELAY
+                                               target: self 
+                                             selector: @selector(saveChanges:) 
+                                             userInfo: nil 
+                                              repeats: NO];
+    RETAIN (saveTmr);
+  }
+}
+
+- (void)saveChanges:(id)sender
+{
+  DESTROY (saveTmr);
+
+  if ([self saveResults] == NO) {
+    NSDebugLLog(@"gwspace", @"unable to save the found paths.");
+  }
+}
+
+@end
+
+
 @implementation	LSFUpdater (scheduled)
 
 - (void)searchInNextDirectory:(id)sender
@@ -992,9 +1409,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
         }
       } else {
         if ([self checkPath: spath]
-                      && ([foundPaths containsObject: spath] == NO)) {
-          [foundPaths addObject: spath];
-          [lsfolder addFoundPath: spath];
+                      && ([results containsPath: spath] == NO)) {
+          [self recordFoundPath: spath];
         }
 
         return;
@@ -1040,9 +1456,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
           }
         } else {
           if ([self checkPath: spath]
-                        && ([foundPaths containsObject: spath] == NO)) {
-            [foundPaths addObject: spath];
-            [lsfolder addFoundPath: spath];
+                        && ([results containsPath: spath] == NO)) {
+            [self recordFoundPath: spath];
           } 
       
           return;
@@ -1088,9 +1503,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
       int j, m;
       
       if ([self checkPath: directory attributes: attributes]
-                    && ([foundPaths containsObject: directory] == NO)) {
-        [foundPaths addObject: directory];
-        [lsfolder addFoundPath: directory];
+                    && ([results containsPath: directory] == NO)) {
+        [self recordFoundPath: directory];
       }
       
       contents = [fm directoryContentsAtPath: directory];
@@ -1103,9 +1517,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
           NSDictionary *attr = [fm fileAttributesAtPath: fpath traverseLink: NO];
 
           if ([self checkPath: fpath attributes: attr]
-                              && ([foundPaths containsObject: fpath] == NO)) {
-            [foundPaths addObject: fpath];
-            [lsfolder addFoundPath: fpath];
+                              && ([results containsPath: fpath] == NO)) {
+            [self recordFoundPath: fpath];
           }
 
           if (([attr fileType] == NSFileTypeDirectory) 
@@ -1117,9 +1530,8 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
               for (m = 0; m < [founds count]; m++) {
                 NSString *found = [founds objectAtIndex: m];
 
-                if ([foundPaths containsObject: found] == NO) {
-                  [foundPaths addObject: found];
-                  [lsfolder addFoundPath: found];
+                if ([results containsPath: found] == NO) {
+                  [self recordFoundPath: found];
                 }
               }
             }
@@ -1191,8 +1603,7 @@ BOOL subPathOfPath(NSString *p1, NSString *p2);
     }
     
     if (remove) {
-      [lsfolder removeFoundPath: path];
-      [foundPaths removeObject: path];
+      [self forgetFoundPath: path];
     } 
 
     fpathindex++;
@@ -25,8 +25,84 @@
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import "FinderModulesProtocol.h"
+#import "FSNHiddenMatcher.h"
 #import "config.h"
 
+/* the most threads a search walks with: a network share keeps more
+   of them than the cpus busy */
+#define MAX_WORKERS 16
+/* how often the results found in the meantime go to the Finder */
+#define RESULTS_TIME (0.1)
+/* and the most of them in one message */
+#define RESULTS_COUNT 1024
+
+/*
+ * The cheapest module first, in the order of the Finder between the
+ * ones of the same cost.  A module that doesn't tell is taken as one
+ * that reads the files.
+ */
+static NSInteger compareModulesCost(id m1, id m2, void *context)
+{
+  NSInteger c1 = [m1 respondsToSelector: @selector(evaluationCost)] 
+                              ? [m1 evaluationCost] : FModuleCostContents;
+  NSInteger c2 = [m2 respondsToSelector: @selector(evaluationCost)] 
+                              ? [m2 evaluationCost] : FModuleCostContents;
+
+  if (c1 < c2) {
+    return NSOrderedAscending;
+  } else if (c1 > c2) {
+    return NSOrderedDescending;
+  }
+
+  return [m1 compareModule: m2];
+}
+
+static BOOL isPathInPath(NSString *path, NSString *dir)
+{
+  if ([path isEqual: dir]) {
+    return YES;
+  }
+  if ([dir isEqual: @"/"]) {
+    return [path hasPrefix: dir];
+  }
+  return [path hasPrefix: [dir stringByAppendingString: @"/"]];
+}
+
+/*
+ * MDKit builds after the tools and is optional, so the query class
+ * comes from the framework at the first search that can use it.
+ */
+static Class mdkQueryClass(void)
+{
+  static Class queryClass = Nil;
+  static BOOL loaded = NO;
+
+  if (loaded == NO) {
+    NSEnumerator *enumerator;
+    NSString *dir;
+
+    loaded = YES;
+    queryClass = NSClassFromString(@"MDKQuery");
+
+    enumerator = [NSSearchPathForDirectoriesInDomains
+      (NSLibraryDirectory, NSAllDomainsMask, YES) objectEnumerator];
+
+    while ((queryClass == Nil) && ((dir = [enumerator nextObject]) != nil)) {
+      NSBundle *bundle;
+
+      dir = [dir stringByAppendingPathComponent: @"Frameworks"];
+      dir = [dir stringByAppendingPathComponent: @"MDKit.framework"];
+      bundle = [NSBundle bundleWithPath: dir];
+
+      if (bundle && [bundle load]) {
+        queryClass = NSClassFromString(@"MDKQuery");
+      }
+    }
+  }
+
+  return queryClass;
+}
+
 
 
 @protocol	Finder
@@ -35,14 +111,64 @@
 
 - (oneway void)nextResult:(NSString *)path;
 
+- (oneway void)nextResults:(NSData *)info;
+
 - (oneway void)endOfSearch;
 
 @end
 
 
+/* what the search asks of an MDKQuery */
+@protocol	IndexQuery
+
++ (id)queryFromString:(NSString *)qstr
+        inDirectories:(NSArray *)searchdirs;
+
+- (void)setDelegate:(id)adelegate;
+
+- (void)setReportRawResults:(BOOL)value;
+
+- (void)startGathering;
+
+- (void)stopQuery;
+
+@end
+
+
 @protocol	DDBd
 
 - (NSString *)annotationsForPath:(NSString *)path;
+- (NSData *)annotationsForPaths:(NSData *)info;
+
+@end
+
+
+/*
+ * The directories a walking thread has still to search, and its own
+ * modules.  The thread takes the newest directory, the idle ones the
+ * oldest, which is the top of a larger subtree.
+ */
+@interface SearchWorker: NSObject
+{
+  NSMutableArray *deque;
+  NSLock *dequeLock;
+  NSArray *modules;
+  NSFileManager *fm;
+}
+
+- (id)initWithModules:(NSArray *)mods;
+
+- (NSArray *)modules;
+
+- (NSFileManager *)fileManager;
+
+- (void)pushDirectory:(NSString *)path;
+
+- (NSString *)popDirectory;
+
+- (NSString *)stealDirectory;
+
+- (BOOL)hasDirectories;
 
 @end
 
@@ -51,10 +177,24 @@
 {
   BOOL stopped;  
   BOOL done;
+  BOOL recursion;
   id finder;
   id ddbd;
+  NSLock *ddbdLock;
   NSFileManager *fm;
   NSNotificationCenter *nc; 
+
+  NSArray *workers;
+  NSCondition *workCondition;
+  NSUInteger idleWorkers;
+  NSUInteger runningWorkers;
+  BOOL walkDone;
+
+  NSMutableArray *results;
+  NSLock *resultsLock;
+
+  id indexQuery;
+  NSArray *indexModules;
 }
 
 - (id)initWithConnectionName:(NSString *)cname;
@@ -63,6 +203,34 @@
 
 - (void)searchWithInfo:(NSData *)srcinfo;
 
+- (void)walkWithWorker:(SearchWorker *)worker;
+
+- (void)searchInDirectory:(NSString *)dir
+               withWorker:(SearchWorker *)worker;
+
+- (BOOL)checkPath:(NSString *)path
+       attributes:(NSDictionary *)attributes
+          modules:(NSArray *)modules;
+
+- (BOOL)workersHaveDirectories;
+
+- (NSArray *)indexedPathsInPaths:(NSArray *)paths;
+
+- (NSArray *)indexingStatus;
+
+- (NSString *)indexQueryOfModules:(NSArray *)modules;
+
+- (BOOL)startIndexQuery:(NSString *)qstr
+          inDirectories:(NSArray *)dirs;
+
+- (void)appendRawResults:(NSArray *)lines;
+
+- (void)queryDidEndGathering:(id)query;
+
+- (void)addResult:(NSString *)path;
+
+- (void)flushResults;
+
 - (void)stop;
 
 - (void)done;
@@ -80,6 +248,91 @@
 - (void)connectDDBd;
 - (void)ddbdConnectionDidDie:(NSNotification *)notif;
 - (NSString *)ddbdGetAnnotationsForPath:(NSString *)path;
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths;
+
+@end
+
+
+@implementation	SearchWorker
+
+- (void)dealloc
+{
+  RELEASE (deque);
+  RELEASE (dequeLock);
+  RELEASE (modules);
+  RELEASE (fm);
+  [super dealloc];
+}
+
+- (id)initWithModules:(NSArray *)mods
+{
+  self = [super init];
+
+  if (self) {
+    deque = [NSMutableArray new];
+    dequeLock = [NSLock new];
+    ASSIGN (modules, mods);
+    fm = [NSFileManager new];
+  }
+
+  return self;
+}
+
+- (NSArray *)modules
+{
+  return modules;
+}
+
+- (NSFileManager *)fileManager
+{
+  return fm;
+}
+
+- (void)pushDirectory:(NSString *)path
+{
+  [dequeLock lock];
+  [deque addObject: path];
+  [dequeLock unlock];
+}
+
+- (NSString *)popDirectory
+{
+  NSString *path = nil;
+
+  [dequeLock lock];
+  if ([deque count]) {
+    path = RETAIN ([deque lastObject]);
+    [deque removeLastObject];
+  }
+  [dequeLock unlock];
+
+  return AUTORELEASE (path);
+}
+
+- (NSString *)stealDirectory
+{
+  NSString *path = nil;
+
+  [dequeLock lock];
+  if ([deque count]) {
+    path = RETAIN ([deque objectAtIndex: 0]);
+    [deque removeObjectAtIndex: 0];
+  }
+  [dequeLock unlock];
+
+  return AUTORELEASE (path);
+}
+
+- (BOOL)hasDirectories
+{
+  BOOL has;
+
+  [dequeLock lock];
+  has = ([deque count] > 0);
+  [dequeLock unlock];
+
+  return has;
+}
 
 @end
 
@@ -91,6 +344,12 @@
   [nc removeObserver: self];
   DESTROY (finder);
   DESTROY (ddbd);
+  RELEASE (ddbdLock);
+  RELEASE (workCondition);
+  RELEASE (results);
+  RELEASE (resultsLock);
+  TEST_RELEASE (indexQuery);
+  TEST_RELEASE (indexModules);
   [super dealloc];
 }
 
@@ -104,6 +363,11 @@
 
     fm = [NSFileManager defaultManager];    
     nc = [NSNotificationCenter defaultCenter];
+
+    ddbdLock = [NSLock new];
+    workCondition = [NSCondition new];
+    results = [NSMutableArray new];
+    resultsLock = [NSLock new];
             
     conn = [NSConnection connectionWithRegisteredName: cname host: nil];
     
@@ -151,20 +415,24 @@
   NSDictionary *srcdict = [NSUnarchiver unarchiveObjectWithData: srcinfo];
   NSArray *paths = [srcdict objectForKey: @"paths"];
   id recursionObj = [srcdict objectForKey: @"recursion"];
-  BOOL recursion;
   NSDictionary *criteria = [srcdict objectForKey: @"criteria"];
   NSArray *classNames = [criteria allKeys];
-  NSMutableArray *modules = [NSMutableArray array];
+  NSMutableArray *classes = [NSMutableArray array];
+  NSMutableArray *wrks = [NSMutableArray array];
+  NSArray *indexedPaths;
   NSString *bundlesDir;
   BOOL isdir;
   NSMutableArray *bundlesPaths;
   NSEnumerator *enumerator;
-  NSUInteger i;
+  NSUInteger count;
+  NSUInteger i, j;
 
   recursion = NO;
   if (recursionObj)
       recursion = [recursionObj boolValue];
 
+  [[FSNHiddenMatcher sharedMatcher] updateFromGWorkspaceDefaults];
+
   bundlesPaths = [NSMutableArray array];
   enumerator = [NSSearchPathForDirectoriesInDomains
     (NSLibraryDirectory, NSAllDomainsMask, YES) objectEnumerator];
@@ -192,101 +460,475 @@
       NSString *className = NSStringFromClass(principalClass);
 
       if ([classNames containsObject: className]) {
-        NSDictionary *moduleCriteria = [criteria objectForKey: className];
-        id module = [[principalClass alloc] initWithSearchCriteria: moduleCriteria
-                                                        searchTool: self];
-        [modules addObject: module];
-        RELEASE (module);  
+        [classes addObject: principalClass];
       }
     }
   }
 
+  /* the modules keep state while they check, so each thread has its own */
+  count = [[NSProcessInfo processInfo] processorCount] * 2;
+  count = (count < 2) ? 2 : ((count > MAX_WORKERS) ? MAX_WORKERS : count);
+
+  /* one more set checks the paths the index gives, on this thread */
+  for (i = 0; i <= count; i++) {
+    NSMutableArray *modules = [NSMutableArray array];
+    SearchWorker *worker;
+
+    for (j = 0; j < [classes count]; j++) {
+      Class principalClass = [classes objectAtIndex: j];
+      NSDictionary *moduleCriteria = [criteria objectForKey: 
+                                          NSStringFromClass(principalClass)];
+      id module = [[principalClass alloc] initWithSearchCriteria: moduleCriteria
+                                                      searchTool: self];
+      [modules addObject: module];
+      RELEASE (module);  
+    }
+
+    [modules sortUsingFunction: compareModulesCost context: NULL];
+
+    if (i == count) {
+      ASSIGN (indexModules, modules);
+      break;
+    }
+
+    worker = [[SearchWorker alloc] initWithModules: modules];
+    [wrks addObject: worker];
+    RELEASE (worker);
+  }
+
+  ASSIGN (workers, wrks);
+
+  /* the indexed directories are asked to gmds, the others walked */
+  indexedPaths = [self indexedPathsInPaths: paths];
+
+  if ([indexedPaths count]) {
+    NSString *qstr = [self indexQueryOfModules: indexModules];
+
+    if ((qstr == nil) 
+          || ([self startIndexQuery: qstr inDirectories: indexedPaths] == NO)) {
+      indexedPaths = nil;
+    }
+  }
+
   for (i = 0; i < [paths count]; i++) {
     NSString *path = [paths objectAtIndex: i];
     NSDictionary *attributes = [fm fileAttributesAtPath: path traverseLink: YES];
-    NSString *type = [attributes fileType];
-    NSUInteger j;
     
-    if (type == NSFileTypeDirectory) {
-      CREATE_AUTORELEASE_POOL(arp1);
-      NSDirectoryEnumerator *enumerator = [fm enumeratorAtPath: path];
-      
-      while (!stopped) {
-        CREATE_AUTORELEASE_POOL(arp2);
-        NSString *currentPath = [enumerator nextObject];
-      
-        if (currentPath) {
-          NSString *fullPath = [path stringByAppendingPathComponent: currentPath];
-          NSDictionary *attrs = [enumerator fileAttributes];
-          BOOL found = YES;
-        
-          for (j = 0; j < [modules count]; j++) {
-            id module = [modules objectAtIndex: j];
-
-            found = [module checkPath: fullPath withAttributes: attrs];
-
-            if (found == NO) {
-              break;
-            }
-
-            if (stopped) {
-              break;
-            }
-          }
-
-          if (found) {
-            [finder nextResult: fullPath];
-          }
-
-          if (stopped) {
-            RELEASE (arp2);
-            break;
-          }
-
-          if (([attrs fileType] == NSFileTypeDirectory) && !recursion) {
-            [enumerator skipDescendents];
-          }
-        
-        } else {
-          RELEASE (arp2);
-          break;
-        }
-        
-        RELEASE (arp2);  
-      }
-      
-      RELEASE (arp1);
+    if ([indexedPaths containsObject: path]) {
+      continue;
+
+    } else if ([attributes fileType] == NSFileTypeDirectory) {
+      [[workers objectAtIndex: (i % count)] pushDirectory: path];
+
+    } else if ([self checkPath: path 
+                    attributes: attributes 
+                       modules: [[workers objectAtIndex: 0] modules]]) {
+      [self addResult: path];
+    }
+  }
+
+  idleWorkers = 0;
+  runningWorkers = count;
+  walkDone = NO;
+
+  for (i = 0; i < count; i++) {
+    [NSThread detachNewThreadSelector: @selector(walkWithWorker:)
+                             toTarget: self
+                           withObject: [workers objectAtIndex: i]];
+  }
+
+  /* the run loop keeps going for -stop */
+  while (1) {
+    BOOL over;
+
+    [[NSRunLoop currentRunLoop] runUntilDate:
+                [NSDate dateWithTimeIntervalSinceNow: RESULTS_TIME]];
+
+    [self flushResults];
+
+    [workCondition lock];
+    over = (runningWorkers == 0);
+    [workCondition unlock];
+
+    if (over && ((indexQuery == nil) || stopped)) {
+      break;
+    }
+  }
+
+  if (indexQuery) {
+    [indexQuery setDelegate: nil];
+    [indexQuery stopQuery];
+    DESTROY (indexQuery);
+  }
+
+  [self flushResults];
+  DESTROY (workers);
+  DESTROY (indexModules);
+
+  RELEASE (arp);
+
+  [self done];
+}
+
+/*
+ * A walking thread: it searches its own directories, then the ones of
+ * the other threads, and stops when all of them are idle with nothing
+ * left to search.
+ */
+- (void)walkWithWorker:(SearchWorker *)worker
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSUInteger count = [workers count];
+  NSUInteger index = [workers indexOfObjectIdenticalTo: worker];
+
+  while (stopped == NO) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSString *dir = [worker popDirectory];
+    NSUInteger i;
+
+    for (i = 1; (dir == nil) && (i < count); i++) {
+      dir = [[workers objectAtIndex: ((index + i) % count)] stealDirectory];
+    }
+
+    if (dir) {
+      [self searchInDirectory: dir withWorker: worker];
 
     } else {
-      BOOL found = YES;
-      
-      for (j = 0; j < [modules count]; j++) {
-        id module = [modules objectAtIndex: j];
-        
-        found = [module checkPath: path withAttributes: attributes];
+      BOOL over;
 
-        if (found == NO) {
-          break;
-        }
-        
-        if (stopped) {
-          break;
-        }
+      [workCondition lock];
+      idleWorkers++;
+
+      if ((idleWorkers == count) && ([self workersHaveDirectories] == NO)) {
+        walkDone = YES;
+        [workCondition broadcast];
+      } else if (walkDone == NO) {
+        [workCondition waitUntilDate: 
+                  [NSDate dateWithTimeIntervalSinceNow: RESULTS_TIME]];
       }
-      
-      if (found) {
-        [finder nextResult: path];
+
+      over = walkDone;
+      idleWorkers--;
+      [workCondition unlock];
+
+      if (over) {
+        RELEASE (arp);
+        break;
       }
     }
-    
+
+    RELEASE (arp);
+  }
+
+  [workCondition lock];
+  runningWorkers--;
+  [workCondition broadcast];
+  [workCondition unlock];
+
+  RELEASE (pool);
+}
+
+- (void)searchInDirectory:(NSString *)dir
+               withWorker:(SearchWorker *)worker
+{
+  NSFileManager *wfm = [worker fileManager];
+  NSArray *modules = [worker modules];
+  NSArray *contents = [wfm directoryContentsAtPath: dir];
+  FSNHiddenMatcher *matcher = [FSNHiddenMatcher sharedMatcher];
+  BOOL pushed = NO;
+  NSUInteger i;
+
+  for (i = 0; i < [contents count]; i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSString *fname = [contents objectAtIndex: i];
+    NSString *fullPath;
+    NSDictionary *attrs;
+
+    /* what the viewers don't show, it doesn't find, nor stats */
+    if ([matcher isHiddenName: fname inDirectory: dir]) {
+      RELEASE (arp);
+      continue;
+    }
+
+    fullPath = [dir stringByAppendingPathComponent: fname];
+    attrs = [wfm fileAttributesAtPath: fullPath traverseLink: NO];
+
+    if ([self checkPath: fullPath attributes: attrs modules: modules]) {
+      [self addResult: fullPath];
+    }
+
+    if (recursion && ([attrs fileType] == NSFileTypeDirectory)) {
+      [worker pushDirectory: fullPath];
+      pushed = YES;
+    }
+
+    RELEASE (arp);
+
     if (stopped) {
       break;
     }
   }
 
-  RELEASE (arp);
+  if (pushed) {
+    [workCondition lock];
+    if (idleWorkers) {
+      [workCondition broadcast];
+    }
+    [workCondition unlock];
+  }
+}
 
-  [self done];
+- (BOOL)checkPath:(NSString *)path
+       attributes:(NSDictionary *)attributes
+          modules:(NSArray *)modules
+{
+  BOOL found = YES;
+  NSUInteger i;
+
+  for (i = 0; i < [modules count]; i++) {
+    id module = [modules objectAtIndex: i];
+
+    found = [module checkPath: path withAttributes: attributes];
+
+    if ((found == NO) || stopped) {
+      break;
+    }
+  }
+
+  return (found && (stopped == NO));
+}
+
+/* called with workCondition locked */
+- (BOOL)workersHaveDirectories
+{
+  NSUInteger i;
+
+  for (i = 0; i < [workers count]; i++) {
+    if ([[workers objectAtIndex: i] hasDirectories]) {
+      return YES;
+    }
+  }
+
+  return NO;
+}
+
+/*
+ * The paths of a recursive search that gmds indexes whole, if the
+ * user doesn't want all of them walked.  Not indexed yet, or with a
+ * part left out, a path is walked.
+ */
+- (NSArray *)indexedPathsInPaths:(NSArray *)paths
+{
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSMutableArray *indexed = [NSMutableArray array];
+  NSDictionary *domain;
+  NSArray *excluded;
+  NSArray *status;
+  id entry;
+  NSUInteger i, j;
+
+  entry = [defaults objectForKey: @"FinderSearchUsesIndex"];
+
+  if ((recursion == NO) || (entry && ([entry boolValue] == NO))
+                        || (mdkQueryClass() == Nil)) {
+    return indexed;
+  }
+
+  [defaults synchronize];
+  domain = [defaults persistentDomainForName: NSGlobalDomain];
+  entry = [domain objectForKey: @"GSMetadataIndexingEnabled"];
+
+  if ((entry == nil) || ([entry boolValue] == NO)) {
+    return indexed;
+  }
+
+  excluded = [domain objectForKey: @"GSMetadataExcludedPaths"];
+  status = [self indexingStatus];
+
+  for (i = 0; i < [paths count]; i++) {
+    NSString *path = [paths objectAtIndex: i];
+    NSDictionary *attributes = [fm fileAttributesAtPath: path traverseLink: NO];
+    BOOL covered = NO;
+
+    if ([attributes fileType] != NSFileTypeDirectory) {
+      continue;
+    }
+
+    for (j = 0; j < [status count]; j++) {
+      NSDictionary *info = [status objectAtIndex: j];
+
+      if ([[info objectForKey: @"indexed"] boolValue]
+            && isPathInPath(path, [info objectForKey: @"path"])) {
+        covered = YES;
+        break;
+      }
+    }
+
+    for (j = 0; covered && (j < [excluded count]); j++) {
+      NSString *expath = [excluded objectAtIndex: j];
+
+      if (isPathInPath(path, expath) || isPathInPath(expath, path)) {
+        covered = NO;
+      }
+    }
+
+    if (covered) {
+      [indexed addObject: path];
+    }
+  }
+
+  return indexed;
+}
+
+/* the status of the newest database of gmds */
+- (NSArray *)indexingStatus
+{
+  NSString *dbdir;
+  NSArray *contents;
+  NSString *statusPath = nil;
+  NSDate *statusDate = nil;
+  NSUInteger i;
+
+  dbdir = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, 
+                                        NSUserDomainMask, YES) lastObject];
+  dbdir = [dbdir stringByAppendingPathComponent: @"gmds"];
+  dbdir = [dbdir stringByAppendingPathComponent: @".db"];
+  contents = [fm directoryContentsAtPath: dbdir];
+
+  for (i = 0; i < [contents count]; i++) {
+    NSString *path = [dbdir stringByAppendingPathComponent: 
+                                               [contents objectAtIndex: i]];
+    NSDictionary *attributes;
+
+    path = [path stringByAppendingPathComponent: @"status.plist"];
+    attributes = [fm fileAttributesAtPath: path traverseLink: NO];
+
+    if (attributes && ((statusDate == nil) 
+          || ([[attributes fileModificationDate] laterDate: statusDate] 
+                                                        != statusDate))) {
+      statusPath = path;
+      statusDate = [attributes fileModificationDate];
+    }
+  }
+
+  if (statusPath) {
+    return [NSArray arrayWithContentsOfFile: statusPath];
+  }
+
+  return nil;
+}
+
+/*
+ * The query of the modules that can give one.  Every path is still
+ * checked by all the modules, so the query needs only to hold at
+ * least the results.
+ */
+- (NSString *)indexQueryOfModules:(NSArray *)modules
+{
+  NSMutableArray *fragments = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [modules count]; i++) {
+    id module = [modules objectAtIndex: i];
+
+    if ([module respondsToSelector: @selector(indexQuery)]) {
+      NSString *fragment = [module indexQuery];
+
+      if (fragment) {
+        [fragments addObject: fragment];
+      }
+    }
+  }
+
+  if ([fragments count]) {
+    return [fragments componentsJoinedByString: @" && "];
+  }
+
+  return nil;
+}
+
+- (BOOL)startIndexQuery:(NSString *)qstr
+          inDirectories:(NSArray *)dirs
+{
+  Class queryClass = mdkQueryClass();
+
+  /* a gmds that isn't running would never end the query */
+  if ([NSConnection rootProxyForConnectionWithRegisteredName: @"gmds" 
+                                                        host: @""] == nil) {
+    return NO;
+  }
+
+  NS_DURING
+    {
+      ASSIGN (indexQuery, [queryClass queryFromString: qstr 
+                                        inDirectories: dirs]);
+      [indexQuery setDelegate: self];
+      [indexQuery setReportRawResults: YES];
+      [indexQuery startGathering];
+    }
+  NS_HANDLER
+    {
+      NSDebugLLog(@"gwspace", @"index query failed: %@", localException);
+      DESTROY (indexQuery);
+    }
+  NS_ENDHANDLER
+
+  return (indexQuery != nil);
+}
+
+- (void)appendRawResults:(NSArray *)lines
+{
+  NSUInteger i;
+
+  for (i = 0; (i < [lines count]) && (stopped == NO); i++) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSString *path = [[lines objectAtIndex: i] objectAtIndex: 0];
+    NSDictionary *attrs = [fm fileAttributesAtPath: path traverseLink: NO];
+
+    if (attrs && [self checkPath: path attributes: attrs 
+                                          modules: indexModules]) {
+      [self addResult: path];
+    }
+
+    RELEASE (arp);
+  }
+}
+
+- (void)queryDidEndGathering:(id)query
+{
+  if (query == indexQuery) {
+    /* it is still the one calling */
+    [indexQuery setDelegate: nil];
+    AUTORELEASE (indexQuery);
+    indexQuery = nil;
+  }
+}
+
+- (void)addResult:(NSString *)path
+{
+  [resultsLock lock];
+  [results addObject: path];
+  [resultsLock unlock];
+}
+
+- (void)flushResults
+{
+  NSArray *batch;
+  NSUInteger i;
+
+  [resultsLock lock];
+  batch = [NSArray arrayWithArray: results];
+  [results removeAllObjects];
+  [resultsLock unlock];
+
+  for (i = 0; i < [batch count]; i += RESULTS_COUNT) {
+    NSUInteger count = [batch count] - i;
+    NSArray *chunk;
+
+    count = (count > RESULTS_COUNT) ? RESULTS_COUNT : count;
+    chunk = [batch subarrayWithRange: NSMakeRange(i, count)];
+    [finder nextResults: [NSArchiver archivedDataWithRootObject: chunk]];
+  }
 }
 
 - (void)stop
@@ -360,6 +1002,8 @@
     if (ddbd) {
       RETAIN (ddbd);
       [ddbd setProtocolForProxy: @protocol(DDBd)];
+      /* the modules ask from the walking threads */
+      [[ddbd connectionForProxy] enableMultipleThreads];
     
       [[NSNotificationCenter defaultCenter] addObserver: self
 					       selector: @selector(ddbdConnectionDidDie:)
@@ -388,9 +1032,33 @@
 
 - (NSString *)ddbdGetAnnotationsForPath:(NSString *)path
 {
+  NSString *annotations = nil;
+
+  [ddbdLock lock];
   [self connectDDBd];
   if (ddbd != nil) {
-    return [ddbd annotationsForPath: path];
+    annotations = [ddbd annotationsForPath: path];
+  }
+  [ddbdLock unlock];
+
+  return annotations;
+}
+
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths
+{
+  NSData *data = nil;
+
+  [ddbdLock lock];
+  [self connectDDBd];
+  if (ddbd != nil) {
+    data = RETAIN ([ddbd annotationsForPaths: 
+                      [NSArchiver archivedDataWithRootObject: paths]]);
+  }
+  [ddbdLock unlock];
+
+  if (data) {
+    AUTORELEASE (data);
+    return [NSUnarchiver unarchiveObjectWithData: data];
   }
   return nil;
 }
@@ -115,6 +115,19 @@
  */
 - (oneway void)clearFailureHighlights;
 
+/**
+ * Measure one run of a scenario: the milliseconds from injecting it until
+ * the windows are drawn and the run loop is idle again.
+ *
+ * @param scenario "open", "scroll", "select-all" or "rename"
+ * @param argument The folder to open, or the file to rename
+ * @param timeout Seconds the scenario may take (0 = 10 seconds)
+ * @return NSDictionary with success, scenario and latency (milliseconds)
+ */
+- (NSDictionary *)measureScenario:(NSString *)scenario
+                         argument:(NSString *)argument
+                          timeout:(CGFloat)timeout;
+
 @end
 
 #endif /* WORKSPACE_UI_TESTING_H */
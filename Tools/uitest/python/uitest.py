@@ -130,9 +130,9 @@ class WorkspaceTestClient:
         except FileNotFoundError:
             raise UITestException(f"uitest not found at {self.uitest_path}")
     
-    def _run_command(self, *args: str) -> Tuple[str, str, int]:
+    def _run_command(self, *args: str, timeout: float = 10) -> Tuple[str, str, int]:
         """
-        Run a uitest command.
+        Run a uitest command, for at most `timeout` seconds.
         
         Returns:
             Tuple of (stdout, stderr, returncode)
@@ -148,7 +148,7 @@ class WorkspaceTestClient:
                 cmd,
                 capture_output=True,
                 text=True,
-                timeout=10
+                timeout=timeout
             )
             
             # Check for Workspace not running
@@ -366,6 +366,42 @@ class WorkspaceTestClient:
         )
         return self._extract_json(stdout)
     
+    def measure(self, scenario: str, argument: Optional[str] = None,
+                repeat: int = 20, warmup: int = 2, timeout: float = 10.0,
+                max_p95: Optional[float] = None,
+                max_p99: Optional[float] = None) -> Dict[str, Any]:
+        """
+        Measure the latency of a scenario, from injecting it until Workspace
+        has redrawn and its run loop is idle.
+        
+        Args:
+            scenario: "open", "scroll", "select-all" or "rename"
+            argument: Folder to open, or file to rename
+            repeat: Runs counted (default 20)
+            warmup: Runs made first and not counted (default 2)
+            timeout: Seconds a run may take (default 10)
+            max_p95: Fail when the p95 latency is over this, in milliseconds
+            max_p99: Fail when the p99 latency is over this, in milliseconds
+            
+        Returns:
+            Dictionary with result: {"success": true/false, "runs": n,
+            "min", "mean", "p50", "p95", "p99", "max": milliseconds,
+            "latencies": [milliseconds]}
+        """
+        args = ["measure", scenario]
+        if argument:
+            args.append(argument)
+        args += ["--repeat", str(repeat), "--warmup", str(warmup),
+                 "--timeout", str(timeout)]
+        if max_p95 is not None:
+            args += ["--max-p95", str(max_p95)]
+        if max_p99 is not None:
+            args += ["--max-p99", str(max_p99)]
+        stdout, stderr, code = self._run_command(
+            *args, timeout=(repeat + warmup) * timeout + 10
+        )
+        return self._extract_json(stdout)
+    
     def close_window(self, window_title: str) -> Dict[str, Any]:
         """
         Close a window by title.
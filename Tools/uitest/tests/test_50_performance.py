@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+"""
+Test 50: Performance Mode
+
+Verifies the latency measurement of scenarios:
+- A scenario is measured and reported in percentiles
+- A limit that cannot be met fails
+- An unknown scenario fails
+"""
+
+import sys, os
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'python'))
+
+from uitest import WorkspaceTestClient, run_tests
+
+client = WorkspaceTestClient()
+
+def test_measure_open():
+    """Test that opening the home folder is measured."""
+    result = client.measure("open", os.path.expanduser("~"), repeat=5, warmup=1)
+    return (result.get('success', False)
+            and result.get('runs') == 5
+            and 0 <= result['p50'] <= result['p95'] <= result['p99'] <= result['max'])
+
+def test_measure_limit_fails():
+    """Test that a p95 limit no run can meet fails the measurement."""
+    result = client.measure("open", os.path.expanduser("~"), repeat=3, warmup=0,
+                            max_p95=0.000001)
+    return result.get('success', True) == False and 'p95' in result
+
+def test_measure_unknown_scenario():
+    """Test that an unknown scenario is an error."""
+    result = client.measure("no-such-scenario", repeat=1, warmup=0)
+    return result.get('success', True) == False
+
+tests = [
+    # A scenario measured
+    ("measure open reports ordered percentiles",
+     test_measure_open),
+    
+    # Gating
+    ("measure fails over the p95 limit",
+     test_measure_limit_fails),
+    
+    # Errors
+    ("measure rejects an unknown scenario",
+     test_measure_unknown_scenario),
+]
+
+if __name__ == "__main__":
+    exit(run_tests(*tests))
@@ -26,6 +26,8 @@
 #import <X11/Xlib.h>
 #import <X11/cursorfont.h>
 #import <X11/Xutil.h>
+#include <math.h>
+#include <string.h>
 
 /* Protocol for UI testing support - can be implemented by Workspace */
 @protocol WorkspaceUITesting
@@ -41,6 +43,7 @@
 - (NSDictionary *)waitForWindow:(NSString *)title timeout:(NSTimeInterval)timeout;
 - (NSDictionary *)closeWindow:(NSString *)title;
 - (NSDictionary *)findElementInWindow:(NSString *)window withText:(NSString *)elementText;
+- (NSDictionary *)measureScenario:(NSString *)scenario argument:(NSString *)argument timeout:(CGFloat)timeout;
 @end
 
 typedef enum {
@@ -60,7 +63,8 @@ typedef enum {
   TestActionWaitWindow,
   TestActionCloseWindow,
   TestActionFindElement,
-  TestActionListMenus
+  TestActionListMenus,
+  TestActionMeasure
 } TestAction;
 
 /* Forward declarations */
@@ -95,6 +99,12 @@ void printUsage(const char *programName) {
   fprintf(stderr, "  highlight \"Window\" \"Text\" [duration]  Highlight element with red overlay\n");
   fprintf(stderr, "  clear-highlights     Remove all red failure highlights\n");
   fprintf(stderr, "\n");
+  fprintf(stderr, "Performance:\n");
+  fprintf(stderr, "  measure SCENARIO [ARG] [options]  Latency percentiles of a scenario\n");
+  fprintf(stderr, "                       open [FOLDER] | scroll | select-all | rename FILE\n");
+  fprintf(stderr, "                       --repeat N (default 20) | --warmup N (default 2)\n");
+  fprintf(stderr, "                       --timeout S (default 10) | --max-p95 MS | --max-p99 MS\n");
+  fprintf(stderr, "\n");
   fprintf(stderr, "  help                 Show this help message\n\n");
   fprintf(stderr, "This tool communicates with a running Workspace instance\n");
   fprintf(stderr, "via distributed objects (requires Workspace started with -d flag).\n");
@@ -1099,6 +1109,98 @@ int doFindElement(const char *windowTitle, const char *text) {
   return result;
 }
 
+/* Nearest-rank percentile of latencies sorted in ascending order */
+double latencyPercentile(NSArray *sorted, double percent) {
+  NSUInteger count = [sorted count];
+  NSUInteger rank;
+
+  if (count == 0) {
+    return 0;
+  }
+  rank = (NSUInteger)ceil(percent / 100.0 * count);
+  rank = (rank < 1) ? 1 : ((rank > count) ? count : rank);
+  return [[sorted objectAtIndex:rank - 1] doubleValue];
+}
+
+int doMeasure(const char *scenarioName, const char *argument,
+              int repeat, int warmup, CGFloat timeout,
+              double maxP95, double maxP99) {
+  NSAutoreleasePool *pool = [NSAutoreleasePool new];
+  NSMutableArray *latencies = [NSMutableArray array];
+  NSString *scenario = [NSString stringWithUTF8String:scenarioName];
+  NSString *arg = argument ? [NSString stringWithUTF8String:argument] : @"";
+  int result = 0;
+  int i;
+
+  @try {
+    id proxy = getWorkspaceProxy();
+    if (!proxy) {
+      [pool release];
+      return 1;
+    }
+
+    if (![proxy respondsToSelector:@selector(measureScenario:argument:timeout:)]) {
+      fprintf(stderr, "Error: Workspace doesn't support measure command.\n");
+      [pool release];
+      return 1;
+    }
+
+    /* the first runs fill the caches, and are not counted */
+    for (i = 0; i < warmup + repeat; i++) {
+      NSDictionary *response = [proxy measureScenario:scenario argument:arg timeout:timeout];
+
+      if (![[response objectForKey:@"success"] boolValue]) {
+        printResultAsJSON(response);
+        [pool release];
+        return 1;
+      }
+      if (i >= warmup) {
+        [latencies addObject:[response objectForKey:@"latency"]];
+      }
+    }
+  } @catch (NSException *e) {
+    fprintf(stderr, "Error: %s\n", [[e reason] UTF8String]);
+    [pool release];
+    return 1;
+  }
+
+  {
+    NSArray *sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+    double sum = 0;
+    double p50, p95, p99;
+    NSMutableDictionary *report = [NSMutableDictionary dictionary];
+
+    for (NSNumber *latency in sorted) {
+      sum += [latency doubleValue];
+    }
+    p50 = latencyPercentile(sorted, 50);
+    p95 = latencyPercentile(sorted, 95);
+    p99 = latencyPercentile(sorted, 99);
+
+    [report setObject:scenario forKey:@"scenario"];
+    [report setObject:[NSNumber numberWithUnsignedInteger:[sorted count]] forKey:@"runs"];
+    [report setObject:[sorted objectAtIndex:0] forKey:@"min"];
+    [report setObject:[NSNumber numberWithDouble:sum / [sorted count]] forKey:@"mean"];
+    [report setObject:[NSNumber numberWithDouble:p50] forKey:@"p50"];
+    [report setObject:[NSNumber numberWithDouble:p95] forKey:@"p95"];
+    [report setObject:[NSNumber numberWithDouble:p99] forKey:@"p99"];
+    [report setObject:[sorted lastObject] forKey:@"max"];
+    [report setObject:latencies forKey:@"latencies"];
+
+    if ((maxP95 > 0 && p95 > maxP95) || (maxP99 > 0 && p99 > maxP99)) {
+      [report setObject:@NO forKey:@"success"];
+      [report setObject:@"Latency over the limit" forKey:@"error"];
+      result = 1;
+    } else {
+      [report setObject:@YES forKey:@"success"];
+    }
+    printResultAsJSON(report);
+  }
+
+  [pool release];
+  return result;
+}
+
 /* Interactive point selection using X11 */
 int selectPointInteractive(CGFloat *x, CGFloat *y) {
   Display *display = XOpenDisplay(NULL);
@@ -1199,6 +1301,8 @@ int main(int argc, char** argv) {
       action = TestActionFindElement;
     } else if ([command isEqualToString:@"list-menus"]) {
       action = TestActionListMenus;
+    } else if ([command isEqualToString:@"measure"]) {
+      action = TestActionMeasure;
     } else if ([command isEqualToString:@"help"] || 
                [command isEqualToString:@"--help"] ||
                [command isEqualToString:@"-h"]) {
@@ -1346,6 +1450,50 @@ int main(int argc, char** argv) {
       result = doListMenus();
       break;
       
+    case TestActionMeasure:
+      if (argc < 3) {
+        fprintf(stderr, "Error: measure requires a scenario.\n");
+        fprintf(stderr, "Usage: %s measure open|scroll|select-all|rename [ARG] [--repeat N]\n", argv[0]);
+        result = 1;
+      } else {
+        const char *argument = NULL;
+        int repeat = 20;
+        int warmup = 2;
+        CGFloat timeout = 10.0;
+        double maxP95 = 0;
+        double maxP99 = 0;
+        int i;
+
+        for (i = 3; i < argc; i++) {
+          if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+          } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+          } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            timeout = atof(argv[++i]);
+          } else if (strcmp(argv[i], "--max-p95") == 0 && i + 1 < argc) {
+            maxP95 = atof(argv[++i]);
+          } else if (strcmp(argv[i], "--max-p99") == 0 && i + 1 < argc) {
+            maxP99 = atof(argv[++i]);
+          } else if (argv[i][0] != '-' && argument == NULL) {
+            argument = argv[i];
+          } else {
+            fprintf(stderr, "Error: unknown measure option: %s\n", argv[i]);
+            result = 1;
+          }
+        }
+
+        if (result == 0) {
+          if (repeat < 1 || warmup < 0) {
+            fprintf(stderr, "Error: --repeat must be at least 1 and --warmup not negative.\n");
+            result = 1;
+          } else {
+            result = doMeasure(argv[2], argument, repeat, warmup, timeout, maxP95, maxP99);
+          }
+        }
+      }
+      break;
+      
     case TestActionShowHelp:
       printUsage(argv[0]);
       result = 0;
@@ -17,6 +17,7 @@
 #import <string.h>
 #import <stdlib.h>
 #import <errno.h>
+#import <math.h>
 
 #import <sqfs/predef.h>
 #import <sqfs/error.h>
@@ -31,6 +32,9 @@
 
 #import "FSNodeRep.h"
 #import "FSNIcon.h"
+#import "FSNThumbnailStore.h"
+#import "FSNThumbnailScheduler.h"
+#import "FSNRaster.h"
 
 #define APPIMAGE_ICON_LOG_PREFIX @"AppImageIconProvider"
 
@@ -53,6 +57,13 @@ typedef struct {
 
 static NSMutableDictionary *appImageLoadingState = nil;
 
+static FSNThumbnailStore *appImageIconStore = nil;
+static NSLock *appImageIconStoreLock = nil;
+
+// Without a thumbnail scheduler (outside Workspace) the icons are read
+// one at a time
+static dispatch_queue_t appImageIconQueue = NULL;
+
 static AppImageSqfsFile *AppImageSqfsFileCreate(int fd,
                                                 off_t base_offset,
                                                 sqfs_u64 size);
@@ -194,6 +205,51 @@ static BOOL AppImageHasType2Magic(const char *path)
   return NO;
 }
 
+// Icons ask at every draw, and at every icon lookup, whether their file
+// is an AppImage, so the answer is kept by path, with the modification
+// date it was read at
+#define APPIMAGE_NODE_PATHS_MAX 4096
+
+static NSMutableDictionary *appImageNodePaths = nil;
+static NSLock *appImageNodePathsLock = nil;
+
+// The AppImage a node is, its symlinks resolved, or nil
+static NSString *AppImageRealPathOfNode(FSNode *node)
+{
+  NSString *nodepath = [node path];
+  NSDate *date = [node modificationDate];
+  NSArray *entry;
+  NSString *realPath;
+
+  [appImageNodePathsLock lock];
+  entry = AUTORELEASE (RETAIN ([appImageNodePaths objectForKey: nodepath]));
+  [appImageNodePathsLock unlock];
+
+  if (entry && [[entry objectAtIndex: 0] isEqual: date]) {
+    realPath = [entry objectAtIndex: 1];
+    return ((id)realPath == [NSNull null]) ? nil : realPath;
+  }
+
+  realPath = [nodepath stringByResolvingSymlinksInPath];
+
+  if (AppImageHasType2Magic([realPath fileSystemRepresentation]) == NO) {
+    realPath = nil;
+  }
+
+  entry = [NSArray arrayWithObjects: date,
+                                     (realPath ? (id)realPath : (id)[NSNull null]),
+                                     nil];
+
+  [appImageNodePathsLock lock];
+  if ([appImageNodePaths count] >= APPIMAGE_NODE_PATHS_MAX) {
+    [appImageNodePaths removeAllObjects];
+  }
+  [appImageNodePaths setObject: entry forKey: nodepath];
+  [appImageNodePathsLock unlock];
+
+  return realPath;
+}
+
 static BOOL AppImageValidateSquashfsOffset(int fd, off_t offset, off_t fileSize);
 
 typedef struct {
@@ -519,73 +575,6 @@ static BOOL AppImageSuperblockLooksValid(const unsigned char *buf,
   return YES;
 }
 
-static NSString *AppImageCopySquashfsToTemp(NSString *appImagePath,
-                                            off_t offset,
-                                            sqfs_u64 size)
-{
-  NSString *tempDir = NSTemporaryDirectory();
-  NSString *templatePath = [tempDir stringByAppendingPathComponent: @"appimage-sqfs-XXXXXX"];
-  const char *tmpl = [templatePath fileSystemRepresentation];
-  char *tmpPath = strdup(tmpl);
-  int outfd = -1;
-  int infd = -1;
-  NSString *result = nil;
-
-  if (tmpPath == NULL) {
-    return nil;
-  }
-
-  outfd = mkstemp(tmpPath);
-  if (outfd < 0) {
-    free(tmpPath);
-    return nil;
-  }
-
-  infd = open([appImagePath fileSystemRepresentation], O_RDONLY);
-  if (infd < 0) {
-    close(outfd);
-    unlink(tmpPath);
-    free(tmpPath);
-    return nil;
-  }
-
-  if (lseek(infd, offset, SEEK_SET) < 0) {
-    close(infd);
-    close(outfd);
-    unlink(tmpPath);
-    free(tmpPath);
-    return nil;
-  }
-
-  sqfs_u64 remaining = size;
-  unsigned char buffer[8192];
-  while (remaining > 0) {
-    size_t toRead = (remaining > sizeof(buffer)) ? sizeof(buffer) : (size_t)remaining;
-    ssize_t rd = read(infd, buffer, toRead);
-    if (rd <= 0) {
-      break;
-    }
-    ssize_t wr = write(outfd, buffer, (size_t)rd);
-    if (wr != rd) {
-      break;
-    }
-    remaining -= (sqfs_u64)rd;
-  }
-
-  close(infd);
-  close(outfd);
-
-  if (remaining != 0) {
-    unlink(tmpPath);
-    free(tmpPath);
-    return nil;
-  }
-
-  result = [NSString stringWithUTF8String: tmpPath];
-  free(tmpPath);
-  return result;
-}
-
 static BOOL AppImageValidateSquashfsOffset(int fd, off_t offset, off_t fileSize)
 {
   unsigned char buffer[sizeof(sqfs_super_t)];
@@ -833,7 +822,7 @@ static void AppImageLogMagic(NSData *data, NSString *label)
 
 static NSData *AppImageExtractIconData(NSString *appImagePath, off_t offset)
 {
-  AppImageSqfsFile *fallbackFile = NULL;
+  AppImageSqfsFile *sqfsFile = NULL;
   int fd = -1;
   sqfs_super_t super;
   sqfs_compressor_config_t meta_cfg;
@@ -845,10 +834,8 @@ static NSData *AppImageExtractIconData(NSString *appImagePath, off_t offset)
   sqfs_inode_generic_t *inode = NULL;
   sqfs_file_t *file = NULL;
   NSData *iconData = nil;
-  NSString *tempSqfsPath = nil;
   BOOL fragmentTableReady = NO;
   struct stat st;
-  sqfs_u64 copySize = 0;
 
   fd = open([appImagePath fileSystemRepresentation], O_RDONLY);
   if (fd < 0) {
@@ -866,23 +853,14 @@ static NSData *AppImageExtractIconData(NSString *appImagePath, off_t offset)
     return nil;
   }
 
-  copySize = (sqfs_u64)(st.st_size - offset);
-  tempSqfsPath = AppImageCopySquashfsToTemp(appImagePath, offset, copySize);
-  if (tempSqfsPath == nil) {
-    fallbackFile = AppImageSqfsFileCreate(fd, offset, (sqfs_u64)(st.st_size - offset));
-    if (fallbackFile == NULL) {
-      close(fd);
-      return nil;
-    }
-    file = (sqfs_file_t *)fallbackFile;
-  } else {
-    file = sqfs_open_file([tempSqfsPath fileSystemRepresentation], SQFS_FILE_OPEN_READ_ONLY);
-    if (file == NULL) {
-      NSDebugLLog(@"gwspace", @"%@: failed to open temp squashfs image", APPIMAGE_ICON_LOG_PREFIX);
-      close(fd);
-      return nil;
-    }
+  // The squashfs is read in place, at its offset in the AppImage; the
+  // file owns the descriptor from here
+  sqfsFile = AppImageSqfsFileCreate(fd, offset, (sqfs_u64)(st.st_size - offset));
+  if (sqfsFile == NULL) {
+    close(fd);
+    return nil;
   }
+  file = (sqfs_file_t *)sqfsFile;
 
   if (sqfs_super_read(&super, file) != 0) {
     NSDebugLLog(@"gwspace", @"%@: failed to read squashfs superblock", APPIMAGE_ICON_LOG_PREFIX);
@@ -1013,16 +991,83 @@ cleanup:
   if (file) {
     sqfs_destroy(file);
   }
-  if (fallbackFile == NULL && fd >= 0) {
-    close(fd);
-  }
-  if (tempSqfsPath != nil) {
-    [[NSFileManager defaultManager] removeFileAtPath: tempSqfsPath handler: nil];
-  }
 
   return iconData;
 }
 
+// The icons extracted from AppImages are kept across sessions in a store
+// of the Workspace cache directory, keyed like the thumbnails by the
+// device, inode, modification time and size of the AppImage.  The data
+// the store returns points into its mapped file, so all the calls, and
+// the copy of what they return, go under one lock.
+static FSNThumbnailStore *AppImageIconStore(void)
+{
+  static dispatch_once_t once;
+
+  dispatch_once(&once, ^{
+    NSFileManager *fm = [NSFileManager defaultManager];
+    NSString *dir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+                                                         NSUserDomainMask, YES) lastObject];
+    BOOL isdir = NO;
+
+    dir = [dir stringByAppendingPathComponent: @"Workspace"];
+    dir = [dir stringByAppendingPathComponent: @"AppImageIcons"];
+
+    appImageIconStoreLock = [NSLock new];
+
+    if (([fm fileExistsAtPath: dir isDirectory: &isdir] && isdir)
+        || [fm createDirectoryAtPath: dir
+         withIntermediateDirectories: YES
+                          attributes: nil
+                               error: NULL]) {
+      appImageIconStore = [[FSNThumbnailStore alloc] initWithDirectory: dir
+                                                              writable: YES];
+    }
+
+    if (appImageIconStore == nil) {
+      NSDebugLLog(@"gwspace", @"%@: no icon cache in %@", APPIMAGE_ICON_LOG_PREFIX, dir);
+    } else if ([appImageIconStore needsCompaction]) {
+      // Drops the icons of AppImages removed or replaced since
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        CREATE_AUTORELEASE_POOL(arp);
+        [appImageIconStoreLock lock];
+        [appImageIconStore compact];
+        [appImageIconStoreLock unlock];
+        RELEASE (arp);
+      });
+    }
+  });
+
+  return appImageIconStore;
+}
+
+static NSData *AppImageCachedIconData(NSString *path)
+{
+  FSNThumbnailStore *store = AppImageIconStore();
+  NSData *data = nil;
+
+  if (store != nil) {
+    [appImageIconStoreLock lock];
+    data = [[store thumbnailDataForPath: path] copy];
+    [appImageIconStoreLock unlock];
+  }
+
+  return AUTORELEASE (data);
+}
+
+static void AppImageCacheIconData(NSData *data, NSString *path)
+{
+  FSNThumbnailStore *store = AppImageIconStore();
+
+  if (store != nil) {
+    [appImageIconStoreLock lock];
+    if ([store setThumbnailData: data forPath: path]) {
+      [store synchronize];
+    }
+    [appImageIconStoreLock unlock];
+  }
+}
+
 static NSData *AppImageCopyIconData(NSString *path)
 {
   off_t offset = 0;
@@ -1032,6 +1077,15 @@ static NSData *AppImageCopyIconData(NSString *path)
     return nil;
   }
 
+  iconData = AppImageCachedIconData(path);
+  if (iconData != nil) {
+    if (AppImageDataIsUsableImage(iconData)) {
+      NSDebugLLog(@"gwspace", @"%@: cached icon for %@", APPIMAGE_ICON_LOG_PREFIX, path);
+      return iconData;
+    }
+    iconData = nil;
+  }
+
   offset = AppImageFindSquashfsOffsetViaElfSize(path);
   if (offset == 0) {
     offset = AppImageFindSquashfsOffsetByScan(path);
@@ -1053,9 +1107,77 @@ static NSData *AppImageCopyIconData(NSString *path)
     return nil;
   }
 
+  AppImageCacheIconData(iconData, path);
+
   return iconData;
 }
 
+// The icon from its largest bitmap, scaled to fit `size` with the box
+// filter of FSNRaster.  No focus is locked, so it can be made on a
+// worker thread.  nil when the data has no 8 bit meshed bitmap.
+static NSImage *AppImageScaledIconFromData(NSData *data, int size)
+{
+  NSArray *reps = [NSBitmapImageRep imageRepsWithData: data];
+  NSBitmapImageRep *srcRep = nil;
+  NSBitmapImageRep *dstRep;
+  NSImage *image;
+  NSUInteger i;
+
+  for (i = 0; i < [reps count]; i++) {
+    NSBitmapImageRep *rep = [reps objectAtIndex: i];
+
+    if ([rep isKindOfClass: [NSBitmapImageRep class]]
+        && (srcRep == nil || [rep pixelsWide] > [srcRep pixelsWide])) {
+      srcRep = rep;
+    }
+  }
+
+  if (srcRep == nil || [srcRep pixelsWide] <= 0 || [srcRep pixelsHigh] <= 0) {
+    return nil;
+  }
+
+  NSInteger sw = [srcRep pixelsWide];
+  NSInteger sh = [srcRep pixelsHigh];
+
+  if (sw <= size && sh <= size) {
+    dstRep = srcRep;
+  } else {
+    if ([srcRep isPlanar] || [srcRep bitsPerSample] != 8
+        || [srcRep samplesPerPixel] < 1 || [srcRep samplesPerPixel] > 4) {
+      return nil;
+    }
+
+    float fact = (sw >= sh) ? ((float)sw / size) : ((float)sh / size);
+    NSInteger dw = MAX(1, MIN(sw, (NSInteger)floor(sw / fact + 0.5)));
+    NSInteger dh = MAX(1, MIN(sh, (NSInteger)floor(sh / fact + 0.5)));
+
+    dstRep = [[NSBitmapImageRep alloc]
+               initWithBitmapDataPlanes: NULL
+                             pixelsWide: dw
+                             pixelsHigh: dh
+                          bitsPerSample: 8
+                        samplesPerPixel: [srcRep samplesPerPixel]
+                               hasAlpha: [srcRep hasAlpha]
+                               isPlanar: NO
+                         colorSpaceName: [srcRep colorSpaceName]
+                            bytesPerRow: 0
+                           bitsPerPixel: 0];
+    AUTORELEASE (dstRep);
+
+    if (FSNRasterDownscale([srcRep bitmapData], sw, sh, [srcRep bytesPerRow],
+                           [dstRep bitmapData], dw, dh, [dstRep bytesPerRow],
+                           (unsigned)[srcRep samplesPerPixel]) == NO) {
+      return nil;
+    }
+  }
+
+  image = [[NSImage alloc] initWithSize:
+            NSMakeSize([dstRep pixelsWide], [dstRep pixelsHigh])];
+  [image addRepresentation: dstRep];
+
+  return AUTORELEASE (image);
+}
+
 static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
 {
   NSString *lower = [path lowercaseString];
@@ -1105,12 +1227,10 @@ static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
 
 - (void)gw_appImage_drawRect:(NSRect)rect
 {
-  // Check if this is an AppImage and if we need to update the icon
+  // Check if this is an AppImage and if we need to update the icon; a
+  // new icon is drawn as a change of what FSNIcon composed
   if (node != nil && [node isDirectory] == NO) {
-    NSString *nodepath = [node path];
-    NSString *realPath = [nodepath stringByResolvingSymlinksInPath];
-
-    if (AppImageHasType2Magic([realPath fileSystemRepresentation])) {
+    if (AppImageRealPathOfNode(node)) {
       // Check if the proper icon is now available
       FSNodeRep *fsnodeRepShared = [FSNodeRep sharedInstance];
       NSImage *currentIcon = [fsnodeRepShared iconOfSize: iconSize forNode: node];
@@ -1145,6 +1265,9 @@ static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
   installed = YES;
 
   appImageLoadingState = [[NSMutableDictionary alloc] init];
+  appImageNodePaths = [[NSMutableDictionary alloc] init];
+  appImageNodePathsLock = [[NSLock alloc] init];
+  appImageIconQueue = dispatch_queue_create("org.gnustep.Workspace.AppImageIcons", NULL);
 
   Class cls = NSClassFromString(@"FSNodeRep");
   if (cls == Nil) {
@@ -1192,13 +1315,12 @@ static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
 - (NSImage *)gw_appImage_iconOfSize:(int)size forNode:(FSNode *)node
 {
   if (node != nil && [node isDirectory] == NO) {
-    NSString *nodepath = [node path];
-    NSString *realPath = [nodepath stringByResolvingSymlinksInPath];
+    NSString *realPath = AppImageRealPathOfNode(node);
 
-    if (AppImageHasType2Magic([realPath fileSystemRepresentation])) {
+    if (realPath) {
       // Check if we have the proper icon cached
       NSString *key = realPath;
-      NSMutableDictionary *iconDict = [iconsCache objectForKey: key];
+      NSMutableDictionary *iconDict = [self cachedIconsForKey: key];
       
       if (iconDict != nil) {
         NSNumber *sizeKey = [NSNumber numberWithInt: 48];
@@ -1248,17 +1370,34 @@ static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
       // Start loading
       [appImageLoadingState setObject: [NSNumber numberWithBool: YES] forKey: key];
       
-      // Start async loading
-      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        NSImage *properIcon = [[NSWorkspace sharedWorkspace] iconForFile: realPath];
-        if (properIcon != nil) {
-          // Update cache with proper icon on main thread (resizing is done on main thread
-          // since NSImage lockFocus/unlockFocus may not be thread-safe in GNUstep)
-          dispatch_async(dispatch_get_main_queue(), ^{
-            // Resize to standard base size (48) before caching so positioning is consistent
+      // Read the icon and scale it on a thumbnail worker, the visible
+      // AppImages first; only the cache update is left to the main thread
+      void (^work)(void) = ^{
+        CREATE_AUTORELEASE_POOL(arp);
+        NSData *iconData = AppImageCopyIconData(realPath);
+        NSImage *properIcon = nil;
+        BOOL scaled = NO;
+
+        if (iconData != nil) {
+          properIcon = AppImageScaledIconFromData(iconData, 48);
+          scaled = (properIcon != nil);
+          if (properIcon == nil) {
+            properIcon = AUTORELEASE ([[NSImage alloc] initWithData: iconData]);
+          }
+        } else {
+          // The icon NSWorkspace had before the swizzle, so an AppImage
+          // without one is not read again at every redraw
+          properIcon = [[NSWorkspace sharedWorkspace] gw_appImage_iconForFile: realPath];
+        }
+        RETAIN (properIcon);
+
+        dispatch_async(dispatch_get_main_queue(), ^{
+          if (properIcon != nil) {
+            // Resize to standard base size (48) before caching so positioning
+            // is consistent; done here only for what the worker could not scale
             NSImage *cachedIcon = properIcon;
             NSSize icnsize = [cachedIcon size];
-            if ((icnsize.width > 48) || (icnsize.height > 48)) {
+            if (scaled == NO && ((icnsize.width > 48) || (icnsize.height > 48))) {
               NSImage *resized = [self resizedIcon: cachedIcon ofSize: 48];
               if (resized != nil) {
                 cachedIcon = resized;
@@ -1266,22 +1405,26 @@ static BOOL GWAppImagePathLooksLikeAppImage(NSString *path)
             }
             NSMutableDictionary *updateDict = [NSMutableDictionary dictionary];
             [updateDict setObject: cachedIcon forKey: [NSNumber numberWithInt: 48]];
-            [iconsCache setObject: updateDict forKey: key];
-            [appImageLoadingState removeObjectForKey: key];
-            
+            [self setCachedIcons: updateDict forKey: key];
+            RELEASE (properIcon);
+
             // Trigger redraw of all windows so FSNIcon views pick up the new icon
             NSArray *windows = [NSApp windows];
             for (NSWindow *win in windows) {
               [[win contentView] setNeedsDisplay: YES];
             }
-          });
-        } else {
-          // Loading failed, remove loading state
-          dispatch_async(dispatch_get_main_queue(), ^{
-            [appImageLoadingState removeObjectForKey: key];
-          });
-        }
-      });
+          }
+          [appImageLoadingState removeObjectForKey: key];
+        });
+        RELEASE (arp);
+      };
+      id scheduler = [self thumbnailScheduler];
+
+      if ([scheduler respondsToSelector: @selector(scheduleWork:forPath:)]) {
+        [scheduler scheduleWork: work forPath: [node path]];
+      } else {
+        dispatch_async(appImageIconQueue, work);
+      }
       
       // Return generic icon while loading
       NSImage *icon = [NSImage imageNamed: @"UnknownTool"];
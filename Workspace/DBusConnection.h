@@ -11,8 +11,13 @@
 // Forward declaration for DBusMessage
 typedef struct DBusMessage DBusMessage;
 
-// DBus connection wrapper for GNUstep
+// DBus connection wrapper for GNUstep.  Once connected, it is served
+// from the main run loop: incoming messages reach the handlers as soon
+// as the bus socket is readable.
 @interface GNUDBusConnection : NSObject
+{
+    BOOL dispatchScheduled;
+}
 
 @property (nonatomic, assign) void *connection; // DBusConnection pointer (opaque)
 @property (nonatomic, assign) BOOL connected;
@@ -36,6 +41,7 @@ typedef struct DBusMessage DBusMessage;
                platformData:(NSDictionary *)platformData
                   onService:(NSString *)serviceName
                  objectPath:(NSString *)objectPath;
+// Dispatches the messages already queued; no longer needed to receive
 - (void)processMessages;
 - (void *)rawConnection;
 - (int)getFileDescriptor;
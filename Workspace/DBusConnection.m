@@ -77,11 +77,255 @@ static DBusHandlerResult dbusObjectPathMessageHandler(DBusConnection *connection
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
+// The run loop modes the bus is served in, so that method calls are
+// answered while a menu is tracked or a panel is modal
+static NSArray *dbusRunLoopModes(void)
+{
+    static NSArray *modes = nil;
+    if (modes == nil) {
+        modes = [[NSArray alloc] initWithObjects:NSDefaultRunLoopMode,
+                                                 NSModalPanelRunLoopMode,
+                                                 NSEventTrackingRunLoopMode, nil];
+    }
+    return modes;
+}
+
 // Forward declaration for internal method
 @interface GNUDBusConnection (Private)
 - (id)parseDBusMessageIterator:(DBusMessageIter *)iter;
+- (BOOL)attachToRunLoop;
+- (void)scheduleDispatch;
+- (void)dispatchPendingMessages;
+@end
+
+// A libdbus watch on the main run loop: its descriptor is watched for
+// reading and/or writing while libdbus keeps the watch enabled.
+// libdbus may add or toggle watches from any thread, so the run loop
+// is always updated from the main thread, from the watch's state at
+// that time.
+@interface GNUDBusWatch : NSObject <RunLoopEvents>
+{
+    DBusWatch *watch;
+    GNUDBusConnection *owner;
+    int fd;
+    BOOL readWatched;
+    BOOL writeWatched;
+}
+- (id)initWithWatch:(DBusWatch *)w owner:(GNUDBusConnection *)c;
+- (void)forget;
+- (void)update;
 @end
 
+@implementation GNUDBusWatch
+
+- (id)initWithWatch:(DBusWatch *)w owner:(GNUDBusConnection *)c
+{
+    self = [super init];
+    if (self) {
+        watch = w;
+        owner = c;
+        fd = dbus_watch_get_unix_fd(w);
+    }
+    return self;
+}
+
+- (void)forget
+{
+    watch = NULL;
+}
+
+- (void)update
+{
+    NSRunLoop *loop = [NSRunLoop currentRunLoop];
+    NSArray *modes = dbusRunLoopModes();
+    BOOL wantRead = NO;
+    BOOL wantWrite = NO;
+    NSUInteger i;
+
+    if (watch && dbus_watch_get_enabled(watch)) {
+        unsigned int flags = dbus_watch_get_flags(watch);
+        wantRead = (flags & DBUS_WATCH_READABLE) != 0;
+        wantWrite = (flags & DBUS_WATCH_WRITABLE) != 0;
+    }
+
+    for (i = 0; i < [modes count]; i++) {
+        NSString *mode = [modes objectAtIndex:i];
+
+        if (wantRead != readWatched) {
+            if (wantRead) {
+                [loop addEvent:(void *)(uintptr_t)fd type:ET_RDESC watcher:self forMode:mode];
+            } else {
+                [loop removeEvent:(void *)(uintptr_t)fd type:ET_RDESC forMode:mode all:NO];
+            }
+        }
+        if (wantWrite != writeWatched) {
+            if (wantWrite) {
+                [loop addEvent:(void *)(uintptr_t)fd type:ET_WDESC watcher:self forMode:mode];
+            } else {
+                [loop removeEvent:(void *)(uintptr_t)fd type:ET_WDESC forMode:mode all:NO];
+            }
+        }
+    }
+
+    readWatched = wantRead;
+    writeWatched = wantWrite;
+}
+
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+    if (watch == NULL) {
+        return;
+    }
+
+    dbus_watch_handle(watch, (type == ET_WDESC) ? DBUS_WATCH_WRITABLE : DBUS_WATCH_READABLE);
+    [owner dispatchPendingMessages];
+}
+
+@end
+
+// A libdbus timeout as a repeating timer on the main run loop
+@interface GNUDBusTimeout : NSObject
+{
+    DBusTimeout *timeout;
+    GNUDBusConnection *owner;
+    NSTimer *timer;
+}
+- (id)initWithTimeout:(DBusTimeout *)t owner:(GNUDBusConnection *)c;
+- (void)forget;
+- (void)update;
+@end
+
+@implementation GNUDBusTimeout
+
+- (id)initWithTimeout:(DBusTimeout *)t owner:(GNUDBusConnection *)c
+{
+    self = [super init];
+    if (self) {
+        timeout = t;
+        owner = c;
+        timer = nil;
+    }
+    return self;
+}
+
+- (void)forget
+{
+    timeout = NULL;
+}
+
+- (void)update
+{
+    NSUInteger i;
+
+    [timer invalidate];
+    timer = nil;
+
+    if (timeout && dbus_timeout_get_enabled(timeout)) {
+        NSTimeInterval interval = dbus_timeout_get_interval(timeout) / 1000.0;
+        NSArray *modes = dbusRunLoopModes();
+
+        timer = [NSTimer timerWithTimeInterval:interval
+                                        target:self
+                                      selector:@selector(fire:)
+                                      userInfo:nil
+                                       repeats:YES];
+        for (i = 0; i < [modes count]; i++) {
+            [[NSRunLoop currentRunLoop] addTimer:timer forMode:[modes objectAtIndex:i]];
+        }
+    }
+}
+
+- (void)fire:(NSTimer *)t
+{
+    if (timeout == NULL) {
+        [timer invalidate];
+        timer = nil;
+        return;
+    }
+
+    dbus_timeout_handle(timeout);
+    [owner dispatchPendingMessages];
+}
+
+@end
+
+static void updateOnMainThread(id obj)
+{
+    if ([NSThread isMainThread]) {
+        [obj update];
+    } else {
+        [obj performSelectorOnMainThread:@selector(update) withObject:nil waitUntilDone:NO];
+    }
+}
+
+static void releaseRunLoopObject(void *data)
+{
+    [(id)data release];
+}
+
+static dbus_bool_t dbusAddWatch(DBusWatch *watch, void *data)
+{
+    GNUDBusWatch *w = [[GNUDBusWatch alloc] initWithWatch:watch owner:(GNUDBusConnection *)data];
+    dbus_watch_set_data(watch, w, releaseRunLoopObject);
+    updateOnMainThread(w);
+    return TRUE;
+}
+
+static void dbusRemoveWatch(DBusWatch *watch, void *data)
+{
+    GNUDBusWatch *w = (GNUDBusWatch *)dbus_watch_get_data(watch);
+    if (w) {
+        [w forget];
+        updateOnMainThread(w);
+    }
+}
+
+static void dbusToggleWatch(DBusWatch *watch, void *data)
+{
+    GNUDBusWatch *w = (GNUDBusWatch *)dbus_watch_get_data(watch);
+    if (w) {
+        updateOnMainThread(w);
+    }
+}
+
+static dbus_bool_t dbusAddTimeout(DBusTimeout *timeout, void *data)
+{
+    GNUDBusTimeout *t = [[GNUDBusTimeout alloc] initWithTimeout:timeout owner:(GNUDBusConnection *)data];
+    dbus_timeout_set_data(timeout, t, releaseRunLoopObject);
+    updateOnMainThread(t);
+    return TRUE;
+}
+
+static void dbusRemoveTimeout(DBusTimeout *timeout, void *data)
+{
+    GNUDBusTimeout *t = (GNUDBusTimeout *)dbus_timeout_get_data(timeout);
+    if (t) {
+        [t forget];
+        updateOnMainThread(t);
+    }
+}
+
+static void dbusToggleTimeout(DBusTimeout *timeout, void *data)
+{
+    GNUDBusTimeout *t = (GNUDBusTimeout *)dbus_timeout_get_data(timeout);
+    if (t) {
+        updateOnMainThread(t);
+    }
+}
+
+// Messages can also be queued by a blocking call on another thread
+static void dbusDispatchStatusChanged(DBusConnection *connection,
+                                      DBusDispatchStatus status,
+                                      void *data)
+{
+    if (status == DBUS_DISPATCH_DATA_REMAINS) {
+        [(GNUDBusConnection *)data scheduleDispatch];
+    }
+}
+
 @implementation GNUDBusConnection
 
 + (GNUDBusConnection *)sessionBus
@@ -141,6 +385,10 @@ static DBusHandlerResult dbusObjectPathMessageHandler(DBusConnection *connection
     NSDebugLLog(@"gwspace", @"DBusConnection: Added message filter");
     
     self.connected = YES;
+    
+    if (![self attachToRunLoop]) {
+        NSDebugLLog(@"gwspace", @"DBusConnection: Failed to attach to the run loop");
+    }
     // NSLog(@"DBusConnection: Successfully connected to session bus");
     return YES;
 }
@@ -148,6 +396,11 @@ static DBusHandlerResult dbusObjectPathMessageHandler(DBusConnection *connection
 - (void)disconnect
 {
     if (self.connection) {
+        DBusConnectionStruct *conn = (DBusConnectionStruct *)self.connection;
+        
+        dbus_connection_set_dispatch_status_function(conn, NULL, NULL, NULL);
+        dbus_connection_set_watch_functions(conn, NULL, NULL, NULL, NULL, NULL);
+        dbus_connection_set_timeout_functions(conn, NULL, NULL, NULL, NULL, NULL);
         dbus_connection_unref((DBusConnectionStruct *)self.connection);
         self.connection = NULL;
     }
@@ -781,26 +1034,64 @@ static DBusHandlerResult dbusObjectPathMessageHandler(DBusConnection *connection
     }
 }
 
+// Messages arrive through the watches on the run loop; this only
+// dispatches what is already queued
 - (void)processMessages
 {
+    [self dispatchPendingMessages];
+}
+
+// libdbus tells us which descriptors and timeouts to wait on, so the
+// connection is served only when the socket is ready instead of polled
+- (BOOL)attachToRunLoop
+{
+    DBusConnectionStruct *conn = (DBusConnectionStruct *)self.connection;
+    
+    if (!dbus_connection_set_watch_functions(conn, dbusAddWatch, dbusRemoveWatch,
+                                             dbusToggleWatch, (void *)self, NULL)) {
+        return NO;
+    }
+    if (!dbus_connection_set_timeout_functions(conn, dbusAddTimeout, dbusRemoveTimeout,
+                                               dbusToggleTimeout, (void *)self, NULL)) {
+        dbus_connection_set_watch_functions(conn, NULL, NULL, NULL, NULL, NULL);
+        return NO;
+    }
+    dbus_connection_set_dispatch_status_function(conn, dbusDispatchStatusChanged,
+                                                 (void *)self, NULL);
+    
+    // Whatever came in while connecting
+    [self scheduleDispatch];
+    return YES;
+}
+
+- (void)scheduleDispatch
+{
+    @synchronized(self) {
+        if (dispatchScheduled) {
+            return;
+        }
+        dispatchScheduled = YES;
+    }
+    [self performSelectorOnMainThread:@selector(dispatchPendingMessages)
+                           withObject:nil
+                        waitUntilDone:NO];
+}
+
+- (void)dispatchPendingMessages
+{
+    @synchronized(self) {
+        dispatchScheduled = NO;
+    }
+    
     if (!self.connected || !self.connection) {
         return;
     }
     
     @try {
-        // Process pending messages with timeout
-        dbus_connection_read_write_dispatch((DBusConnectionStruct *)self.connection, 0);
-        
-        // Check for incoming messages
-        DBusMessage *message;
-        while ((message = dbus_connection_pop_message((DBusConnectionStruct *)self.connection)) != NULL) {
-            // Recheck connection validity in case it closed during processing
-            if (!self.connected || !self.connection) {
-                dbus_message_unref(message);
-                break;
-            }
-            [self handleIncomingMessage:message];
-            dbus_message_unref(message);
+        // The filter and the object path handlers get each message
+        while (self.connection
+               && dbus_connection_dispatch((DBusConnectionStruct *)self.connection)
+                    == DBUS_DISPATCH_DATA_REMAINS) {
         }
     }
     @catch (NSException *exception) {
@@ -987,6 +1278,23 @@ static DBusHandlerResult dbusObjectPathMessageHandler(DBusConnection *connection
                @"  </interface>\n"
                @"</node>";
     }
+
+    if ([path isEqualToString:@"/org/gnustep/GWorkspace/FileOperations"]) {
+        return @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
+               @"\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
+               @"<node name=\"/org/gnustep/GWorkspace/FileOperations\">\n"
+               @"  <interface name=\"org.freedesktop.DBus.Introspectable\">\n"
+               @"    <method name=\"Introspect\">\n"
+               @"      <arg name=\"xml_data\" type=\"s\" direction=\"out\"/>\n"
+               @"    </method>\n"
+               @"  </interface>\n"
+               @"  <interface name=\"org.gnustep.GWorkspace.FileOperations\">\n"
+               @"    <method name=\"ListOperations\">\n"
+               @"      <arg name=\"operations\" type=\"a(usssuuttdd)\" direction=\"out\"/>\n"
+               @"    </method>\n"
+               @"  </interface>\n"
+               @"</node>";
+    }
     
     return @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n"
            @"\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n"
@@ -56,6 +56,9 @@ typedef enum DockStyle
   int dragdelay;
   int targetIndex;
   NSRect targetRect;
+
+  NSMutableArray *removedAppChecks;
+  NSTimer *removedAppTimer;
   
   GWDesktopManager *manager; 
   Workspace *gw;
@@ -128,6 +131,8 @@ typedef enum DockStyle
 
 - (void)updateDefaults;
 
+- (void)scheduleRemovedAppCheck:(DockIcon *)icon;
+
 - (void)checkRemovedApp:(id)sender;
 
 @end
@@ -139,6 +144,8 @@ typedef enum DockStyle
 
 - (void)watchedPathChanged:(NSDictionary *)info;
 
+- (void)trashContentsDidChange:(NSNotification *)notif;
+
 - (void)unselectOtherReps:(id)arep;
 
 - (FSNSelectionMask)selectionMask;
@@ -67,6 +67,9 @@
 #if HAVE_DBUS
   DockServiceDBusStop();
 #endif
+  [removedAppTimer invalidate];
+  RELEASE (removedAppTimer);
+  RELEASE (removedAppChecks);
   RELEASE (icons);
   RELEASE (backColor);
   
@@ -100,6 +103,8 @@
       ws = [NSWorkspace sharedWorkspace];
 
       icons = [NSMutableArray new];
+      removedAppChecks = [NSMutableArray new];
+      removedAppTimer = nil;
       iconSize = MAX_ICN_SIZE;
                                 
       dndSourceIcon = nil;
@@ -205,6 +210,10 @@
                                                selector: @selector(dragMountpointEnded:)
                                                    name: @"GWDragMountpointEnded"
                                                   object: nil];
+      [[NSNotificationCenter defaultCenter] addObserver: self
+                                               selector: @selector(trashContentsDidChange:)
+                                                   name: @"GWTrashContentsDidChangeNotification"
+                                                 object: nil];
      
       DockServiceStart(self);
 #if HAVE_DBUS
@@ -326,6 +335,7 @@
 {
   [manager removeWatcherForPath: [[icon node] path]];
   
+  [icon stopBouncing];
   if ([icon superview]) {
     [icon removeFromSuperview];
   }
@@ -909,12 +919,36 @@
   [manager removeWatcherForPath: [manager trashPath]];
 }
 
+- (void)scheduleRemovedAppCheck:(DockIcon *)icon
+{
+  /* The checks of a second share one timer, however many apps went away */
+  if ([removedAppChecks containsObject: icon] == NO) {
+    [removedAppChecks addObject: icon];
+  }
+  if (removedAppTimer == nil) {
+    removedAppTimer = [NSTimer scheduledTimerWithTimeInterval: 1.0
+                                                       target: self
+                                                     selector: @selector(checkRemovedApp:)
+                                                     userInfo: nil
+                                                      repeats: NO];
+    RETAIN (removedAppTimer);
+  }
+}
+
 - (void)checkRemovedApp:(id)sender
 {
-  DockIcon *icon = (DockIcon *)[sender userInfo];
-  
-  if ([[icon node] isValid] == NO) {
-    [self removeIcon: icon];
+  NSArray *checks = AUTORELEASE ([removedAppChecks copy]);
+  NSUInteger i;
+
+  DESTROY (removedAppTimer);
+  [removedAppChecks removeAllObjects];
+
+  for (i = 0; i < [checks count]; i++) {
+    DockIcon *icon = [checks objectAtIndex: i];
+
+    if ([icons containsObject: icon] && ([[icon node] isValid] == NO)) {
+      [self removeIcon: icon];
+    }
   }
 }
 
@@ -942,7 +976,6 @@
 {
   NSString *operation = [info objectForKey: @"operation"];
 	NSString *source = [info objectForKey: @"source"];	  
-	NSString *destination = [info objectForKey: @"destination"];	 
 	NSArray *files = [info objectForKey: @"files"];	 
   NSUInteger i, count;
   
@@ -968,48 +1001,7 @@
     }
   }  
   
-  if ([operation isEqual: NSWorkspaceMoveOperation]
-      || [operation isEqual: NSWorkspaceCopyOperation]
-			|| [operation isEqual: NSWorkspaceRecycleOperation]) { 
-    DockIcon *icon = [self trashIcon];
-    NSString *trashPath = [[icon node] path];
-    
-    if ([destination isEqual: trashPath]) {
-      [icon setTrashFull: YES];
-    }
-  }
-
-  if ([operation isEqual: @"WorkspaceRecycleOutOperation"]
-			    || [operation isEqual: @"WorkspaceemptyTrashOperation"]
-          || [operation isEqual: NSWorkspaceMoveOperation]
-          || [operation isEqual: NSWorkspaceDestroyOperation]) { 
-    DockIcon *icon = [self trashIcon];
-    FSNode *node = [icon node];
-    NSString *trashPath = [node path];
-    NSString *basePath;
-    
-    if ([operation isEqual: @"WorkspaceemptyTrashOperation"]
-                || [operation isEqual: NSWorkspaceDestroyOperation]) { 
-      basePath = destination;  
-    } else {
-      basePath = source;  
-    }
-    
-    if ([basePath isEqual: trashPath]) {
-      NSArray *subNodes = [node subNodes];
-      NSUInteger count = [subNodes count];
-    
-      for (i = 0; i < [subNodes count]; i++) {
-        if ([[subNodes objectAtIndex: i] isReserved]) {
-          count --;
-        }
-      }
-      
-      if (count == 0) {
-        [icon setTrashFull: NO];
-      }
-    }
-  }
+  /* the trash icon follows GWTrashContentsDidChangeNotification */
 }
 
 - (void)watchedPathChanged:(NSDictionary *)info
@@ -1029,11 +1021,7 @@
 	  FSNode *node = [icon node];
         
 	  if ([path isEqual: [node path]]) {
-	    [NSTimer scheduledTimerWithTimeInterval: 1.0
-					     target: self
-					   selector: @selector(checkRemovedApp:)
-					   userInfo: icon
-					    repeats: NO];
+	    [self scheduleRemovedAppCheck: icon];
 	  }
 	}
       }
@@ -1054,11 +1042,7 @@
               FSNode *node = [icon node];
               
               if ([oldpath isEqual: [node path]]) {
-                [NSTimer scheduledTimerWithTimeInterval: 1.0
-                                                 target: self
-                                               selector: @selector(checkRemovedApp:)
-                                               userInfo: icon
-                                                repeats: NO];
+                [self scheduleRemovedAppCheck: icon];
               }
             }
           }
@@ -1084,59 +1068,23 @@
 
 		if ([fullpath isEqual: [node path]])
 		  {
-		    [NSTimer scheduledTimerWithTimeInterval: 1.0
-						     target: self
-						   selector: @selector(checkRemovedApp:)
-						   userInfo: icon
-						    repeats: NO];
+		    [self scheduleRemovedAppCheck: icon];
 		  }
 	      }
 	    }
 	}
-    
-      if ([path isEqual: [manager trashPath]])
-	{
-	  DockIcon *icon = [self trashIcon];
-	  FSNode *node = [icon node];
-	  NSArray *subNodes = [node subNodes];
-	  int count = [subNodes count];
-	  int i;
-
-	  for (i = 0; i < [subNodes count]; i++) {
-	    if ([[subNodes objectAtIndex: i] isReserved]) {
-	      count --;
-	    }
-	  }
-      
-	  if (count == 0) {
-	    [icon setTrashFull: NO];
-	  }
-	}
-    
-    }
-  else if ([event isEqual: @"GWFileCreatedInWatchedDirectory"])
-    {
-      if ([path isEqual: [manager trashPath]])
-	{
-	  DockIcon *icon = [self trashIcon];
-	  FSNode *node = [icon node];
-	  NSArray *subNodes = [node subNodes];
-	  NSUInteger i;
-
-	  for (i = 0; i < [subNodes count]; i++)
-	    {
-	      if ([[subNodes objectAtIndex: i] isReserved] == NO)
-		{
-		  [icon setTrashFull: YES];
-		  break;
-		}
-	    }
-	}
     }
   
   RELEASE (arp);
 }
 
+- (void)trashContentsDidChange:(NSNotification *)notif
+{
+  NSNumber *count = [[notif userInfo] objectForKey: @"count"];
+
+  [[self trashIcon] setTrashFull: ([count unsignedIntegerValue] != 0)];
+}
+
 - (void)unselectOtherReps:(id)arep
 {
   NSUInteger i;
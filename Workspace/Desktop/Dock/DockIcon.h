@@ -26,11 +26,12 @@
 
 #import <AppKit/NSView.h>
 #import "FSNIcon.h"
+#import "GWAnimationClock.h"
 
 @class NSColor;
 @class NSImage;
 
-@interface DockIcon : FSNIcon
+@interface DockIcon : FSNIcon <GWAnimation>
 {
   NSString *appName;
 
@@ -61,11 +62,10 @@
 
   /* Bounce animation tracking */
   BOOL isBouncing;
-  NSTimer *bounceTimer;
   float bounceVelocity;
   float bounceOffset;
   float bounceGravity;
-  int pauseCounter;  /* Tracks pause between bounces (counts down in timer frames) */
+  int pauseCounter;  /* Tracks pause between bounces (counts down in clock frames) */
 
   /* Unity Launcher API state */
   int64_t badgeCount;
@@ -119,8 +119,6 @@
 
 - (void)stopBouncing;
 
-- (void)_bounceTimerFired:(NSTimer *)timer;
-
 - (void)setHighlightColor:(NSColor *)color;
 
 - (void)setHighlightImage:(NSImage *)image;
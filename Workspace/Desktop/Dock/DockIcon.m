@@ -44,12 +44,9 @@
 
 - (void)dealloc
 {
-  /* Stop bouncing and clean up timer */
+  /* Take the bounce off the animation clock */
   isBouncing = NO;
-  if (bounceTimer) {
-    [bounceTimer invalidate];
-    bounceTimer = nil;
-  }
+  [[GWAnimationClock sharedClock] removeAnimation: self];
   RELEASE (appName);
   RELEASE (highlightColor);
   RELEASE (darkerColor);
@@ -105,7 +102,6 @@
 
     /* Initialize bounce animation variables */
     isBouncing = NO;
-    bounceTimer = nil;
     bounceVelocity = 0.0;
     bounceOffset = 0.0;
     bounceGravity = 1.0;  /* Doubled gravity for twice as fast animation */
@@ -156,9 +152,6 @@
     isTrashIcon = value;
 
     if (isTrashIcon) {
-      NSArray *subNodes;
-      NSUInteger i, count;
-
       ASSIGN (icon, [fsnodeRep trashIconOfSize: ceil(icnBounds.size.width)]);
       ASSIGN (trashFullIcon, [fsnodeRep trashFullIconOfSize: ceil(icnBounds.size.width)]);
       
@@ -168,16 +161,7 @@
         ASSIGN (ejectIcon, [[NSImage alloc] initWithContentsOfFile: ejectPath]);
       }
       
-      subNodes = [node subNodes];
-      count = [subNodes count];
-      
-      for (i = 0; i < [subNodes count]; i++) {
-        if ([[subNodes objectAtIndex: i] isReserved]) {
-          count --;
-        }
-      }
-      
-      [self setTrashFull: !(count == 0)];
+      [self setTrashFull: ([[Workspace gworkspace] trashItemCount] != 0)];
     
     } else {
       ASSIGN (icon, [fsnodeRep iconOfSize: ceil(icnBounds.size.width) 
@@ -264,26 +248,23 @@
   bounceVelocity = 6.32;  /* Initial upward velocity for 20px bounce height */
   bounceOffset = 0.0;
   
-  /* Create a timer to update the animation 30 times per second (half as fast) */
-  if (!bounceTimer) {
-    bounceTimer = [NSTimer scheduledTimerWithTimeInterval: 0.033333
-                                                   target: self
-                                                 selector: @selector(_bounceTimerFired:)
-                                                 userInfo: nil
-                                                  repeats: YES];
-  }
+  /* The shared clock advances the bounce GW_ANIMATION_FPS times per second */
+  [[GWAnimationClock sharedClock] addAnimation: self];
 }
 
 - (void)stopBouncing
 {
-  /* Just set the flag; let the timer callback check it */
+  BOOL wasBouncing = isBouncing;
+
   isBouncing = NO;
-  [bounceTimer invalidate];
-  bounceTimer = nil;
+  [[GWAnimationClock sharedClock] removeAnimation: self];
   bounceOffset = 0.0;
   bounceVelocity = 0.0;
   pauseCounter = 0;
   [self setNeedsDisplay: YES];
+  if (wasBouncing && container) {
+    [container setNeedsDisplayInRect: [self animationRect]];
+  }
 }
 
 #pragma mark - Unity Launcher API
@@ -368,61 +349,71 @@
   return urgent;
 }
 
-- (void)_bounceTimerFired:(NSTimer *)timer
+- (BOOL)animationClock:(GWAnimationClock *)clock
+         advanceFrames:(NSUInteger)frames
 {
   /* Check if we should still be bouncing */
   if (!isBouncing) {
-    return;
+    return NO;
   }
-  
-  /* Handle pause between bounces (500ms pause between iterations) */
-  /* At 30fps (0.033s per frame), 500ms = ~15 frames */
-  if (pauseCounter > 0) {
-    pauseCounter--;
-    [self setNeedsDisplay: YES];
-    if (container) {
-      [container setNeedsDisplayInRect: [self frame]];
+
+  while (frames-- > 0) {
+    /* Handle pause between bounces (500ms pause between iterations) */
+    if (pauseCounter > 0) {
+      pauseCounter--;
+      continue;
     }
-    return;
-  }
   
-  /* Apply gravity to velocity */
-  bounceVelocity -= bounceGravity;
+    /* Apply gravity to velocity */
+    bounceVelocity -= bounceGravity;
   
-  /* Update position */
-  bounceOffset += bounceVelocity;
+    /* Update position */
+    bounceOffset += bounceVelocity;
   
-  /* Bounce off the ground (y = 0) - repeat bouncing with pause */
-  if (bounceOffset <= 0.0) {
-    bounceOffset = 0.0;
-    /* Bounce completed - set pause counter for 500ms pause */
-    /* 500ms / 33.333ms per frame ≈ 15 frames */
-    pauseCounter = 15;
-    /* Reset velocity for next bounce cycle */
-    bounceVelocity = 6.32;  /* Initial upward velocity for 20px bounce height */
-  }
-  
-  /* Request redraw */
-  [self setNeedsDisplay: YES];
-  if (container) {
-    NSRect f = [self frame];
-    DockPosition pos = DockPositionBottom;
-    
-    if ([container respondsToSelector: @selector(position)]) {
-      pos = [(Dock *)container position];
+    /* Bounce off the ground (y = 0) - repeat bouncing with pause */
+    if (bounceOffset <= 0.0) {
+      bounceOffset = 0.0;
+      /* Bounce completed - pause for 500ms worth of frames */
+      pauseCounter = GW_ANIMATION_FPS / 2;
+      /* Reset velocity for next bounce cycle */
+      bounceVelocity = 6.32;  /* Initial upward velocity for 20px bounce height */
     }
+  }
+
+  return YES;
+}
+
+- (NSView *)animationView
+{
+  return (container ? (NSView *)container : (NSView *)self);
+}
+
+- (NSRect)animationRect
+{
+  NSRect f;
+  DockPosition pos = DockPositionBottom;
+
+  if (container == nil) {
+    return [self bounds];
+  }
+
+  f = [self frame];
     
-    if (pos == DockPositionLeft) {
-      f.size.width += 25;
-    } else if (pos == DockPositionRight) {
-      f.origin.x -= 25;
-      f.size.width += 25;
-    } else {
-      f.size.height += 25;
-    }
+  if ([container respondsToSelector: @selector(position)]) {
+    pos = [(Dock *)container position];
+  }
     
-    [container setNeedsDisplayInRect: f];
+  /* Room for the icon 20px off the ground */
+  if (pos == DockPositionLeft) {
+    f.size.width += 25;
+  } else if (pos == DockPositionRight) {
+    f.origin.x -= 25;
+    f.size.width += 25;
+  } else {
+    f.size.height += 25;
   }
+
+  return f;
 }
 
 - (void)setHighlightColor:(NSColor *)color
@@ -936,7 +927,7 @@ x += 6; \
     NSString *fromPath = [[paths objectAtIndex: 0] stringByDeletingLastPathComponent];
     BOOL accept = YES;
     
-    if ([fromPath isEqual: [[GWDesktopManager desktopManager] trashPath]] == NO) {
+    if ([[Workspace gworkspace] isTrashPath: fromPath] == NO) {
       NSArray *vpaths = [ws mountedLocalVolumePaths];
     
       for (i = 0; i < [paths count]; i++) {
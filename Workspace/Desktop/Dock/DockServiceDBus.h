@@ -13,9 +13,6 @@
 @class Dock;
 
 @interface DockServiceDBus : NSObject
-{
-  NSTimer *processTimer;
-}
 
 @property (nonatomic, assign) Dock *dock;
 @property (nonatomic, strong) GNUDBusConnection *dbusConnection;
@@ -32,8 +32,6 @@ static DockServiceDBus *sharedDBusService = nil;
 
 - (void)dealloc
 {
-  [processTimer invalidate];
-  processTimer = nil;
   self.dock = nil;
   self.dbusConnection = nil;
   [super dealloc];
@@ -64,23 +62,12 @@ static DockServiceDBus *sharedDBusService = nil;
       return NO;
     }
 
-  /* Start a 100ms timer to process incoming D-Bus messages independently
-     of FileManagerDBusInterface's file descriptor monitoring. */
-  processTimer = [NSTimer scheduledTimerWithTimeInterval:0.1
-                                                  target:self
-                                                selector:@selector(processDBusMessages:)
-                                                userInfo:nil
-                                                 repeats:YES];
-
+  /* The session bus connection dispatches the Update calls from the
+     run loop as they arrive. */
   NSDebugLLog(@"gwspace", @"DockServiceDBus: Registered com.canonical.Unity.LauncherEntry on DBus");
   return YES;
 }
 
-- (void)processDBusMessages:(NSTimer *)timer
-{
-  [self.dbusConnection processMessages];
-}
-
 - (void)handleDBusMethodCall:(NSDictionary *)callInfo
 {
   NSValue *messageValue = [callInfo objectForKey:@"message"];
@@ -0,0 +1,60 @@
+/* GWAnimationClock.h
+ *
+ * One clock for the animations of the Dock and the desktop.
+ *
+ * Every running animation is advanced from a single timer, and the views
+ * are asked to redraw the union of what their animations touched, once
+ * per frame.  The timer only exists while something is animating.
+ * GNUstep has no display link to align the frames with, so they come at
+ * a fixed rate; an animation that is late gets the frames it missed.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_ANIMATION_CLOCK_H
+#define GW_ANIMATION_CLOCK_H
+
+#import <Foundation/Foundation.h>
+#import <AppKit/NSView.h>
+
+/* Frames per second of every animation on the clock. */
+#define GW_ANIMATION_FPS 30
+
+@class GWAnimationClock;
+
+@protocol GWAnimation
+
+/* Moves the animation `frames` frames on, at least one.  Returns NO when
+ * it has ended; it is then taken off the clock. */
+- (BOOL)animationClock:(GWAnimationClock *)clock
+         advanceFrames:(NSUInteger)frames;
+
+/* The view the animation draws in, and the part of it that has to be
+ * redrawn, before and after a frame. */
+- (NSView *)animationView;
+
+- (NSRect)animationRect;
+
+@end
+
+@interface GWAnimationClock : NSObject
+{
+  NSMutableArray *animations;
+  NSTimer *timer;
+  NSTimeInterval lastFrame;
+}
+
++ (GWAnimationClock *)sharedClock;
+
+/* The animations are not retained: remove one before it goes away. */
+- (void)addAnimation:(id <GWAnimation>)anim;
+
+- (void)removeAnimation:(id <GWAnimation>)anim;
+
+- (BOOL)isRunningAnimation:(id <GWAnimation>)anim;
+
+- (BOOL)isRunning;
+
+@end
+
+#endif /* GW_ANIMATION_CLOCK_H */
@@ -0,0 +1,167 @@
+/* GWAnimationClock.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <math.h>
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#import "GWAnimationClock.h"
+
+/* The most frames a late tick catches up on; after a longer stall the
+ * animations just go on from where they were. */
+#define GW_ANIMATION_MAX_FRAMES 5
+
+@interface GWAnimationClock (Private)
+- (void)startTimer;
+- (void)stopTimer;
+- (void)tick:(NSTimer *)t;
+@end
+
+@implementation GWAnimationClock
+
++ (GWAnimationClock *)sharedClock
+{
+  static GWAnimationClock *shared = nil;
+
+  if (shared == nil)
+    shared = [[self alloc] init];
+  return shared;
+}
+
+- (void)dealloc
+{
+  [self stopTimer];
+  RELEASE (animations);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+  if (self)
+    {
+      animations = [NSMutableArray new];
+      timer = nil;
+    }
+  return self;
+}
+
+- (void)addAnimation:(id <GWAnimation>)anim
+{
+  NSValue *value = [NSValue valueWithNonretainedObject: anim];
+
+  if ([animations containsObject: value] == NO)
+    {
+      [animations addObject: value];
+      [self startTimer];
+    }
+}
+
+- (void)removeAnimation:(id <GWAnimation>)anim
+{
+  [animations removeObject: [NSValue valueWithNonretainedObject: anim]];
+  if ([animations count] == 0)
+    [self stopTimer];
+}
+
+- (BOOL)isRunningAnimation:(id <GWAnimation>)anim
+{
+  return [animations containsObject: [NSValue valueWithNonretainedObject: anim]];
+}
+
+- (BOOL)isRunning
+{
+  return (timer != nil);
+}
+
+@end
+
+@implementation GWAnimationClock (Private)
+
+- (void)startTimer
+{
+  if (timer == nil)
+    {
+      lastFrame = [NSDate timeIntervalSinceReferenceDate];
+      timer = [NSTimer scheduledTimerWithTimeInterval: 1.0 / GW_ANIMATION_FPS
+                                               target: self
+                                             selector: @selector(tick:)
+                                             userInfo: nil
+                                              repeats: YES];
+      RETAIN (timer);
+    }
+}
+
+- (void)stopTimer
+{
+  if (timer)
+    {
+      [timer invalidate];
+      DESTROY (timer);
+    }
+}
+
+- (void)tick:(NSTimer *)t
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSUInteger frames = (NSUInteger)floor((now - lastFrame) * GW_ANIMATION_FPS + 0.5);
+  NSArray *running = [NSArray arrayWithArray: animations];
+  NSUInteger count = [running count];
+  NSMutableArray *views = [NSMutableArray arrayWithCapacity: count];
+  NSRect *rects = NSZoneMalloc (NSDefaultMallocZone(), sizeof(NSRect) * (count + 1));
+  NSUInteger i;
+
+  frames = MAX (frames, 1);
+  frames = MIN (frames, GW_ANIMATION_MAX_FRAMES);
+  lastFrame = now;
+
+  for (i = 0; i < count; i++)
+    {
+      NSValue *value = [running objectAtIndex: i];
+      id <GWAnimation> anim = [value nonretainedObjectValue];
+      NSView *view;
+      NSRect r;
+      NSUInteger index;
+
+      /* taken off by an animation before it */
+      if ([animations containsObject: value] == NO)
+        continue;
+
+      view = [anim animationView];
+      r = [anim animationRect];
+
+      if ([anim animationClock: self advanceFrames: frames] == NO)
+        [animations removeObject: value];
+
+      if (view == nil)
+        continue;
+
+      r = NSUnionRect (r, [anim animationRect]);
+      index = [views indexOfObjectIdenticalTo: view];
+
+      if (index == NSNotFound)
+        {
+          rects[[views count]] = r;
+          [views addObject: view];
+        }
+      else
+        {
+          rects[index] = NSUnionRect (rects[index], r);
+        }
+    }
+
+  for (i = 0; i < [views count]; i++)
+    [[views objectAtIndex: i] setNeedsDisplayInRect: rects[i]];
+
+  NSZoneFree (NSDefaultMallocZone(), rects);
+
+  if ([animations count] == 0)
+    [self stopTimer];
+
+  RELEASE (arp);
+}
+
+@end
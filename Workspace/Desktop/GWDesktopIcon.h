@@ -28,8 +28,6 @@
 #include "FSNIcon.h"
 
 @interface GWDesktopIcon : FSNIcon
-{
-}
 
 @end
 
@@ -149,6 +149,8 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath;
 
 - (void)mountedVolumeDidUnmount:(NSNotification *)notif;
 
+- (void)volumeHealthDidChange:(NSNotification *)notif;
+
 - (void)mountedVolumesDidChange;
 
 - (void)unlockVolumeAtPath:(NSString *)volpath;
@@ -186,11 +188,12 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath;
 @end
 
 
-@interface MPointWatcher : NSObject
+@interface MPointWatcher : NSObject <RunLoopEvents>
 {
   NSArray *mountedRemovableVolumes;
   NSMutableSet *watchedMountRoots;  /* Tracks paths being watched for mount changes */
-  NSTimer *timer;
+  int mountTableFd;                 /* /proc/self/mountinfo, -1 without it */
+  NSTimer *timer;                   /* polls when there is no mount table to watch */
   BOOL active;
   GWDesktopManager *manager;
   NSFileManager *fm;
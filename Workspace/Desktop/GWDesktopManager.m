@@ -33,6 +33,7 @@
 #import "Dock.h"
 #import "GWDockWindow.h"
 #import "FSNFunctions.h"
+#import "FSNVolumeHealth.h"
 #import "Workspace.h"
 #import "GWViewersManager.h"
 #import "Thumbnailer/GWThumbnailer.h"
@@ -40,9 +41,29 @@
 #include <X11/Xatom.h>
 #include <math.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
 
 #define RESV_MARGIN 10
 
+/* The kernel flags this file with POLLPRI whenever a mount or unmount
+   changes the mount table of the process. */
+#define MOUNT_TABLE_PATH "/proc/self/mountinfo"
+#define MOUNT_POLL_INTERVAL 1.5
+
+static NSArray *mountTableRunLoopModes(void)
+{
+  static NSArray *modes = nil;
+
+  if (modes == nil)
+    {
+      modes = [[NSArray alloc] initWithObjects: NSDefaultRunLoopMode,
+                                                NSModalPanelRunLoopMode,
+                                                NSEventTrackingRunLoopMode, nil];
+    }
+  return modes;
+}
+
 static GWDesktopManager *desktopManager = nil;
 
 @implementation GWDesktopManager
@@ -152,6 +173,11 @@ static GWDesktopManager *desktopManager = nil;
            selector: @selector(watcherNotification:) 
                name: @"GWFileWatcherFileDidChangeNotification"
              object: nil];    
+
+    [nc addObserver: self
+           selector: @selector(volumeHealthDidChange:)
+               name: FSNVolumeHealthDidChangeNotification
+             object: nil];
     
     [[ws notificationCenter] addObserver: self 
 				selector: @selector(newVolumeMounted:)
@@ -799,6 +825,14 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath
   }
 }
 
+- (void)volumeHealthDidChange:(NSNotification *)notif
+{
+  NSString *mpoint = [notif object];
+  BOOL unresponsive = [[FSNVolumeHealth sharedHealth] isUnresponsiveVolumeAtPath: mpoint];
+
+  [[self desktopView] volumeAtPath: mpoint setUnresponsive: unresponsive];
+}
+
 - (void)mountedVolumeDidUnmount:(NSNotification *)notif
 {
   NSDebugLLog(@"gwspace", @"GWDesktopManager: mountedVolumeDidUnmount notification received: %@", [notif userInfo]);
@@ -1132,11 +1166,39 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath
       [timer invalidate];
     }
 
+  if (mountTableFd >= 0)
+    {
+      NSArray *modes = mountTableRunLoopModes();
+      NSUInteger i;
+
+      for (i = 0; i < [modes count]; i++)
+        {
+          [[NSRunLoop currentRunLoop] removeEvent: (void *)(uintptr_t)mountTableFd
+                                             type: ET_EDESC
+                                          forMode: [modes objectAtIndex: i]
+                                              all: NO];
+        }
+      close(mountTableFd);
+    }
+
   RELEASE (mountedRemovableVolumes);
   RELEASE (watchedMountRoots);
   [super dealloc];
 }
 
+/* Reads the table to its end, which is what the kernel expects before
+   it flags the next change. */
+- (void)readMountTable
+{
+  char buf[4096];
+
+  if (lseek(mountTableFd, 0, SEEK_SET) < 0)
+    return;
+
+  while (read(mountTableFd, buf, sizeof(buf)) > 0)
+    ;
+}
+
 - (id)initForManager:(GWDesktopManager *)mngr
 {
   self = [super init];
@@ -1147,12 +1209,35 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath
       active = NO;
       fm = [NSFileManager defaultManager];
       watchedMountRoots = [[NSMutableSet alloc] init];
+      timer = nil;
+
+      /* Mounts are seen when they happen where the kernel reports them;
+         elsewhere (the BSDs) the volumes are compared periodically. */
+      mountTableFd = open(MOUNT_TABLE_PATH, O_RDONLY | O_CLOEXEC);
+
+      if (mountTableFd >= 0)
+        {
+          NSArray *modes = mountTableRunLoopModes();
+          NSUInteger i;
 
-      timer = [NSTimer scheduledTimerWithTimeInterval: 1.5
-					       target: self
-					     selector: @selector(watchMountPoints:)
-					     userInfo: nil
-					      repeats: YES];
+          [self readMountTable];
+
+          for (i = 0; i < [modes count]; i++)
+            {
+              [[NSRunLoop currentRunLoop] addEvent: (void *)(uintptr_t)mountTableFd
+                                              type: ET_EDESC
+                                           watcher: self
+                                           forMode: [modes objectAtIndex: i]];
+            }
+        }
+      else
+        {
+          timer = [NSTimer scheduledTimerWithTimeInterval: MOUNT_POLL_INTERVAL
+                                                   target: self
+                                                 selector: @selector(watchMountPoints:)
+                                                 userInfo: nil
+                                                  repeats: YES];
+        }
     }
   
   return self;
@@ -1251,6 +1336,15 @@ inFileViewerRootedAtPath:(NSString *)rootFullpath
   return [watchedMountRoots containsObject: path];
 }
 
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  [self readMountTable];
+  [self watchMountPoints: nil];
+}
+
 /**
  * Returns the effective list of desktop volumes by combining mountedRemovableMedia
  * (which works on Linux via sysfs) with any volumes from mountedLocalVolumePaths
@@ -47,6 +47,9 @@ typedef enum BackImageStyle
   BOOL dragLocalIcon;
 
   NSImage *backImage;
+  /* backImage scaled to every monitor, the size of the view; rebuilt
+     when the wallpaper, its style or the screens change */
+  NSImage *backCache;
   NSString *imagePath;
   BackImageStyle backImageStyle;
   BOOL useBackImage;
@@ -70,6 +73,9 @@ typedef enum BackImageStyle
 
 - (void)unlockVolumeAtPath:(NSString *)path;
 
+/* Dims the icon of a network volume that stopped answering. */
+- (void)volumeAtPath:(NSString *)vpath setUnresponsive:(BOOL)flag;
+
 - (void)showMountedVolumes;
 
 - (void)dockPositionDidChange;
@@ -32,16 +32,20 @@
 #import "FSNFunctions.h"
 #import "FSNMetadataProvider.h"
 #import "FSNIconPositionStore.h"
+#import "FSNHiddenMatcher.h"
 #import "GWDesktopView.h"
 #import "GWDesktopIcon.h"
 #import "GWDesktopManager.h"
 #import "DSStoreInfo.h"
 #import "GWViewSettingsManager.h"
+#import "GWIconPositionStore.h"
 #import "Dock.h"
 #import "Workspace.h"
 #import "GWViewersManager.h"
+#import "GWWatchDispatcher.h"
 #import "../Network/NetworkVolumeManager.h"
 #import "Thumbnailer/GWThumbnailer.h"
+#import "FSNTrace.h"
 
 #define DEF_ICN_SIZE 48
 #define DEF_TEXT_SIZE 12
@@ -73,6 +77,7 @@
   RELEASE (expectedUnmountPaths);
   RELEASE (desktopInfo);
   RELEASE (backImage);
+  RELEASE (backCache);
   RELEASE (imagePath);
   RELEASE (dragIcon);
 
@@ -274,19 +279,17 @@
           [[NSNotificationCenter defaultCenter] postNotificationName:@"GWFileSystemDidChangeNotification" object:opinfo];
         }
 
-      /* Also trigger sidebar rebuild by posting a file watcher notification
-         for each mount root that contains this path.  The sidebar listens
-         to GWFileWatcherFileDidChangeNotification and rebuilds its Volumes
-         section when a path under a mount root changes.  This is the most
-         reliable way to update the sidebar after desktop icon removal. */
+      /* Also trigger sidebar rebuild by dispatching a file watcher event
+         for each mount root that contains this path.  The sidebar takes
+         the events under the mount roots from GWWatchDispatcher and
+         rebuilds its Volumes section.  This is the most reliable way to
+         update the sidebar after desktop icon removal. */
       {
         NSArray *roots = [Workspace volumeMountRoots];
         for (NSString *root in roots) {
           if ([vpath isEqualToString: root] || [vpath hasPrefix: [root stringByAppendingString: @"/"]]) {
             NSDictionary *winfo = @{ @"path": root };
-            [[NSNotificationCenter defaultCenter]
-              postNotificationName: @"GWFileWatcherFileDidChangeNotification"
-                            object: winfo];
+            [[GWWatchDispatcher sharedDispatcher] dispatchWatcherInfo: winfo];
             break;
           }
         }
@@ -308,6 +311,14 @@
   [self checkLockedReps];
 }
 
+- (void)volumeAtPath:(NSString *)vpath setUnresponsive:(BOOL)flag
+{
+  FSNIcon *icon = [self repOfSubnodePath: vpath];
+
+  if (icon)
+    [icon setLocked: (flag || [[icon node] isLocked])];
+}
+
 - (void)showMountedVolumes
 {
   NSArray *rvPaths;
@@ -654,6 +665,8 @@
   /* The content view's origin in window coordinates is always (0,0);
    * only the size changes when the screen configuration changes. */
   [self setFrame: NSMakeRect(0, 0, screenFrame.size.width, screenFrame.size.height)];
+  /* the monitors may have moved within the same size */
+  DESTROY (backCache);
   _gridCached = NO;
   [self tile];
   [self setNeedsDisplay: YES];
@@ -908,7 +921,7 @@
     return;
 
   apply(info);
-  [sm writeSettings: info];
+  [[GWIconPositionStore sharedStore] writeSettings: info forFolder: [node path]];
 }
 
 - (void)setIconSize:(int)size
@@ -1204,16 +1217,20 @@ static void GWHighlightFrameRect(NSRect aRect)
 
   r = NSMakeRect(x, y, w, h);
 
-  for (i = 0; i < [icons count]; i++)
-    {
-      FSNIcon *icon = [icons objectAtIndex: i];
-      NSRect iconBounds = [self convertRect: [icon iconBounds] fromView: icon];
+  {
+    NSArray *candidates = [self iconsIntersectingRect: r];
 
-      if (NSIntersectsRect(r, iconBounds))
-	{
-	  [icon select];
-	}
-    }
+    for (i = 0; i < [candidates count]; i++)
+      {
+        FSNIcon *icon = [candidates objectAtIndex: i];
+        NSRect iconBounds = [self convertRect: [icon iconBounds] fromView: icon];
+
+        if (NSIntersectsRect(r, iconBounds))
+          {
+            [icon select];
+          }
+      }
+  }
 
   selectionMask = NSSingleSelectionMask;
 
@@ -1332,110 +1349,133 @@ static void GWHighlightFrameRect(NSRect aRect)
   [super mouseMoved: theEvent];
 }
 
-- (void)drawRect:(NSRect)rect
+/* Scales the wallpaper of every monitor meeting rect, in the current
+ * focus; done once into backCache, which drawRect: then composites. */
+- (void)drawBackImageInRect:(NSRect)rect
 {
-  [super drawRect: rect];
+  // Draw the wallpaper independently for each monitor so it repeats
+  // properly rather than being stretched across the virtual desktop.
+  NSArray *screens = [NSScreen screens];
 
-  if (backImage && useBackImage)
+  for (NSUInteger si = 0; si < [screens count]; si++)
     {
-      // Draw the wallpaper independently for each monitor so it repeats
-      // properly rather than being stretched across the virtual desktop.
-      NSArray *screens = [NSScreen screens];
+      NSRect monFrame = [[screens objectAtIndex:si] frame];
+      // Convert from screen coordinates to view-local coordinates
+      // (screenFrame.origin is the view's origin in screen coords)
+      NSRect localRect = NSMakeRect(monFrame.origin.x - screenFrame.origin.x,
+                                    monFrame.origin.y - screenFrame.origin.y,
+                                    monFrame.size.width,
+                                    monFrame.size.height);
 
-      for (NSUInteger si = 0; si < [screens count]; si++)
-        {
-          NSRect monFrame = [[screens objectAtIndex:si] frame];
-          // Convert from screen coordinates to view-local coordinates
-          // (screenFrame.origin is the view's origin in screen coords)
-          NSRect localRect = NSMakeRect(monFrame.origin.x - screenFrame.origin.x,
-                                        monFrame.origin.y - screenFrame.origin.y,
-                                        monFrame.size.width,
-                                        monFrame.size.height);
-
-          // Only draw if this monitor intersects the dirty rect
-          if (!NSIntersectsRect(localRect, rect))
-            continue;
+      // Only draw if this monitor intersects the dirty rect
+      if (!NSIntersectsRect(localRect, rect))
+        continue;
 
-          NSSize imsize = [backImage size];
-          BackImageStyle style = backImageStyle;
+      NSSize imsize = [backImage size];
+      BackImageStyle style = backImageStyle;
 
-          if ((imsize.width >= localRect.size.width) || (imsize.height >= localRect.size.height))
-            {
-              if (style == BackImageTileStyle)
-                style = BackImageCenterStyle;
-            }
+      if ((imsize.width >= localRect.size.width) || (imsize.height >= localRect.size.height))
+        {
+          if (style == BackImageTileStyle)
+            style = BackImageCenterStyle;
+        }
 
-          [NSGraphicsContext saveGraphicsState];
-          NSBezierPath *clipPath = [NSBezierPath bezierPathWithRect:localRect];
-          [clipPath addClip];
+      [NSGraphicsContext saveGraphicsState];
+      NSBezierPath *clipPath = [NSBezierPath bezierPathWithRect:localRect];
+      [clipPath addClip];
 
-          if (style == BackImageFitStyle)
-            {
-              [backImage drawInRect: localRect
-                           fromRect: NSZeroRect
-                          operation: NSCompositeSourceOver
-                           fraction: 1.0
-                     respectFlipped: YES
-                              hints: nil];
-            }
-          else if (style == BackImageTileStyle)
-            {
-              CGFloat x = localRect.origin.x;
-              CGFloat y = NSMaxY(localRect) - imsize.height;
+      if (style == BackImageFitStyle)
+        {
+          [backImage drawInRect: localRect
+                       fromRect: NSZeroRect
+                      operation: NSCompositeSourceOver
+                       fraction: 1.0
+                 respectFlipped: YES
+                          hints: nil];
+        }
+      else if (style == BackImageTileStyle)
+        {
+          CGFloat x = localRect.origin.x;
+          CGFloat y = NSMaxY(localRect) - imsize.height;
 
-              while (y > (localRect.origin.y - imsize.height))
+          while (y > (localRect.origin.y - imsize.height))
+            {
+              [backImage compositeToPoint: NSMakePoint(x, y)
+                                operation: NSCompositeSourceOver];
+              x += imsize.width;
+              if (x >= NSMaxX(localRect))
                 {
-                  [backImage compositeToPoint: NSMakePoint(x, y)
-                                    operation: NSCompositeSourceOver];
-                  x += imsize.width;
-                  if (x >= NSMaxX(localRect))
-                    {
-                      y -= imsize.height;
-                      x = localRect.origin.x;
-                    }
+                  y -= imsize.height;
+                  x = localRect.origin.x;
                 }
             }
-          else if (style == BackImageScaleStyle)
-            {
-              float imRatio = imsize.width / imsize.height;
-              float monRatio = localRect.size.width / localRect.size.height;
-              float scale;
-              NSPoint imagePoint;
+        }
+      else if (style == BackImageScaleStyle)
+        {
+          float imRatio = imsize.width / imsize.height;
+          float monRatio = localRect.size.width / localRect.size.height;
+          float scale;
+          NSPoint imagePoint;
 
-              if (imRatio > monRatio)
-                {
-                  scale = imsize.width / localRect.size.width;
-                  imagePoint = NSMakePoint(localRect.origin.x,
-                    localRect.origin.y + (localRect.size.height - imsize.height/scale) / 2);
-                }
-              else
-                {
-                  scale = imsize.height / localRect.size.height;
-                  imagePoint = NSMakePoint(
-                    localRect.origin.x + (localRect.size.width - imsize.width/scale) / 2,
-                    localRect.origin.y);
-                }
-              [backImage drawInRect: NSMakeRect(imagePoint.x, imagePoint.y,
-                                                imsize.width / scale, imsize.height / scale)
-                           fromRect: NSZeroRect
-                          operation: NSCompositeSourceOver
-                           fraction: 1.0
-                     respectFlipped: YES
-                              hints: nil];
+          if (imRatio > monRatio)
+            {
+              scale = imsize.width / localRect.size.width;
+              imagePoint = NSMakePoint(localRect.origin.x,
+                localRect.origin.y + (localRect.size.height - imsize.height/scale) / 2);
             }
           else
             {
-              /* Center style */
-              NSPoint imagePoint;
+              scale = imsize.height / localRect.size.height;
               imagePoint = NSMakePoint(
-                localRect.origin.x + (localRect.size.width - imsize.width) / 2,
-                localRect.origin.y + (localRect.size.height - imsize.height) / 2);
-              [backImage compositeToPoint: imagePoint
-                                operation: NSCompositeSourceOver];
+                localRect.origin.x + (localRect.size.width - imsize.width/scale) / 2,
+                localRect.origin.y);
             }
+          [backImage drawInRect: NSMakeRect(imagePoint.x, imagePoint.y,
+                                            imsize.width / scale, imsize.height / scale)
+                       fromRect: NSZeroRect
+                      operation: NSCompositeSourceOver
+                       fraction: 1.0
+                 respectFlipped: YES
+                          hints: nil];
+        }
+      else
+        {
+          /* Center style */
+          NSPoint imagePoint;
+          imagePoint = NSMakePoint(
+            localRect.origin.x + (localRect.size.width - imsize.width) / 2,
+            localRect.origin.y + (localRect.size.height - imsize.height) / 2);
+          [backImage compositeToPoint: imagePoint
+                            operation: NSCompositeSourceOver];
+        }
+
+      [NSGraphicsContext restoreGraphicsState];
+    }
+}
+
+- (void)drawRect:(NSRect)rect
+{
+  [super drawRect: rect];
+
+  if (backImage && useBackImage)
+    {
+      NSRect bounds = [self bounds];
+
+      if (backCache && (NSEqualSizes([backCache size], bounds.size) == NO))
+        DESTROY (backCache);
 
-          [NSGraphicsContext restoreGraphicsState];
+      if (backCache == nil)
+        {
+          backCache = [[NSImage alloc] initWithSize: bounds.size];
+          [backCache lockFocus];
+          [self drawBackImageInRect: bounds];
+          [backCache unlockFocus];
         }
+
+      [backCache drawInRect: rect
+                   fromRect: rect
+                  operation: NSCompositeSourceOver
+                   fraction: 1.0];
     }
 
   if (dragIcon)
@@ -1537,6 +1577,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 
 - (void)showContentsOfNode:(FSNode *)anode
 {
+  FSN_TRACE_SCOPE ("GWDesktopView showContentsOfNode");
   CREATE_AUTORELEASE_POOL(arp);
   NSArray *subNodes = [anode subNodes];
   NSMutableArray *unsorted = [NSMutableArray array];
@@ -1554,6 +1595,8 @@ static void GWHighlightFrameRect(NSRect aRect)
 	}
       i--;
     }
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
 
   ASSIGN (node, anode);
 
@@ -1666,6 +1709,8 @@ static void GWHighlightFrameRect(NSRect aRect)
       [icons addObject: icon];
       [self addSubview: icon];
     }
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
 
 
   [self tile];
@@ -1674,7 +1719,7 @@ static void GWHighlightFrameRect(NSRect aRect)
   if ([[NSUserDefaults standardUserDefaults] boolForKey: @"use_thumbnails"])
     {
       Thumbnailer *t = [Thumbnailer sharedThumbnailer];
-      if (t) [t makeThumbnails: [node path]];
+      if (t) [t makeThumbnails: [node path] forRequester: self];
     }
 
   RELEASE (arp);
@@ -2075,6 +2120,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 - (void)createBackImage:(NSImage *)image
 {
   ASSIGN(backImage, image);
+  DESTROY (backCache);
 }
 
 - (NSImage *)backImage
@@ -2145,10 +2191,7 @@ static void GWHighlightFrameRect(NSRect aRect)
 - (id)addRepForSubnode:(FSNode *)anode
 {
   /* Never display internal metadata files */
-  NSString *fname = [anode name];
-  if ([fname isEqualToString: @".DS_Store"]
-      || [fname hasPrefix: @"._"]
-      || [fname isEqualToString: @"__MACOSX"])
+  if ([[FSNHiddenMatcher sharedMatcher] isMetadataName: [anode name]])
     return nil;
 
   CREATE_AUTORELEASE_POOL(arp);
@@ -2164,6 +2207,8 @@ static void GWHighlightFrameRect(NSRect aRect)
                                                  acceptDnd: YES
                                                  slideBack: YES];
   [icons addObject: icon];
+  [self invalidateSpatialIndex];
+  [self invalidatePrefixIndex];
   [self addSubview: icon];
   RELEASE (icon);
   RELEASE (arp);
@@ -0,0 +1,200 @@
+/* FSWEventBatch.h
+ *
+ * The batched form of fswatcher notifications: one NSData per flush,
+ * holding a sequence number and a packed array of (event, path)
+ * records, shared by fswatcher and its clients.
+ *
+ * Layout, in host byte order since both ends run on the same host:
+ *   uint32 magic, uint32 version, uint64 sequence, uint32 count,
+ *   then count records of
+ *   uint8 type, uint32 length, path bytes, uint32 length, extra bytes.
+ * The extra string is the file name of a directory event, the old path
+ * of a rename, or empty.  A global event has FSWBatchGlobal set in its
+ * type.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef FSW_EVENT_BATCH_H
+#define FSW_EVENT_BATCH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#import <Foundation/Foundation.h>
+
+#define FSW_BATCH_MAGIC 0x46535742   /* "FSWB" */
+#define FSW_BATCH_VERSION 1
+
+enum {
+  FSWBatchFileCreated = 1,
+  FSWBatchFileDeleted = 2,
+  FSWBatchFileModified = 3,
+  FSWBatchPathRenamed = 4,
+  FSWBatchPathDeleted = 5,
+  /* the client fell behind: whatever it shows under the path is stale */
+  FSWBatchRescan = 6,
+  FSWBatchFileModifiedInDirectory = 7
+};
+
+#define FSWBatchGlobal 0x80
+
+/* The event string a rescan record decodes to. */
+#define FSWRescanEvent @"GWWatchedSubtreeNeedsRescan"
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sequence;
+  uint32_t count;
+} fsw_batch_header;
+
+static inline NSMutableData *FSWBatchCreate(void)
+{
+  NSMutableData *batch = [NSMutableData dataWithLength: sizeof(fsw_batch_header)];
+  fsw_batch_header *h = [batch mutableBytes];
+
+  h->magic = FSW_BATCH_MAGIC;
+  h->version = FSW_BATCH_VERSION;
+
+  return batch;
+}
+
+static inline void FSWBatchSetSequence(NSMutableData *batch, uint64_t sequence)
+{
+  ((fsw_batch_header *)[batch mutableBytes])->sequence = sequence;
+}
+
+static inline NSUInteger FSWBatchCount(NSData *batch)
+{
+  return ((const fsw_batch_header *)[batch bytes])->count;
+}
+
+static inline void FSWBatchAppendString(NSMutableData *batch, NSString *str)
+{
+  const char *s = (str != nil) ? [str UTF8String] : "";
+  uint32_t len = (uint32_t)strlen(s);
+
+  [batch appendBytes: &len length: sizeof(len)];
+  [batch appendBytes: s length: len];
+}
+
+static inline void FSWBatchAppend(NSMutableData *batch, uint8_t type,
+                                  NSString *path, NSString *extra)
+{
+  [batch appendBytes: &type length: 1];
+  FSWBatchAppendString(batch, path);
+  FSWBatchAppendString(batch, extra);
+  ((fsw_batch_header *)[batch mutableBytes])->count++;
+}
+
+static inline NSString *FSWBatchEventName(uint8_t type)
+{
+  switch (type & ~FSWBatchGlobal) {
+    case FSWBatchFileCreated: return @"GWFileCreatedInWatchedDirectory";
+    case FSWBatchFileDeleted: return @"GWFileDeletedInWatchedDirectory";
+    case FSWBatchFileModified: return @"GWWatchedFileModified";
+    case FSWBatchPathRenamed: return @"GWWatchedPathRenamed";
+    case FSWBatchPathDeleted: return @"GWWatchedPathDeleted";
+    case FSWBatchRescan: return FSWRescanEvent;
+    case FSWBatchFileModifiedInDirectory: return @"GWFileModifiedInWatchedDirectory";
+    default: return nil;
+  }
+}
+
+static inline uint8_t FSWBatchEventType(NSString *event)
+{
+  if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]) {
+    return FSWBatchFileCreated;
+  } else if ([event isEqual: @"GWFileDeletedInWatchedDirectory"]) {
+    return FSWBatchFileDeleted;
+  } else if ([event isEqual: @"GWWatchedFileModified"]) {
+    return FSWBatchFileModified;
+  } else if ([event isEqual: @"GWWatchedPathRenamed"]) {
+    return FSWBatchPathRenamed;
+  } else if ([event isEqual: @"GWWatchedPathDeleted"]) {
+    return FSWBatchPathDeleted;
+  } else if ([event isEqual: @"GWFileModifiedInWatchedDirectory"]) {
+    return FSWBatchFileModifiedInDirectory;
+  }
+  return 0;
+}
+
+static inline NSString *FSWBatchReadString(const uint8_t **p, const uint8_t *end)
+{
+  uint32_t len;
+  NSString *str;
+
+  if (end - *p < (long)sizeof(len)) {
+    return nil;
+  }
+  memcpy(&len, *p, sizeof(len));
+  *p += sizeof(len);
+  if ((uint32_t)(end - *p) < len) {
+    return nil;
+  }
+  str = [[NSString alloc] initWithBytes: *p length: len
+                               encoding: NSUTF8StringEncoding];
+  *p += len;
+
+  return [str autorelease];
+}
+
+/*
+ * The records as the dictionaries the one-event messages carry: "event"
+ * and "path", "files" for a directory event, "oldpath" for a rename,
+ * and "global" for an event meant for global watchers.  nil if the
+ * data is not a batch.
+ */
+static inline NSArray *FSWBatchDecode(NSData *batch, uint64_t *sequence)
+{
+  const uint8_t *p = [batch bytes];
+  const uint8_t *end = p + [batch length];
+  fsw_batch_header h;
+  NSMutableArray *records;
+  uint32_t i;
+
+  if ([batch length] < sizeof(h)) {
+    return nil;
+  }
+  memcpy(&h, p, sizeof(h));
+  if (h.magic != FSW_BATCH_MAGIC || h.version != FSW_BATCH_VERSION) {
+    return nil;
+  }
+  p += sizeof(h);
+  if (sequence) {
+    *sequence = h.sequence;
+  }
+
+  records = [NSMutableArray arrayWithCapacity: h.count];
+
+  for (i = 0; i < h.count && p < end; i++) {
+    uint8_t type = *p++;
+    NSString *event = FSWBatchEventName(type);
+    NSString *path = FSWBatchReadString(&p, end);
+    NSString *extra = FSWBatchReadString(&p, end);
+    NSMutableDictionary *dict;
+
+    if (event == nil || path == nil || extra == nil) {
+      break;
+    }
+
+    dict = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                  event, @"event", path, @"path", nil];
+    if ([extra length] > 0) {
+      if ((type & ~FSWBatchGlobal) == FSWBatchPathRenamed) {
+        [dict setObject: extra forKey: @"oldpath"];
+      } else {
+        [dict setObject: [NSArray arrayWithObject: extra] forKey: @"files"];
+      }
+    }
+    if (type & FSWBatchGlobal) {
+      [dict setObject: [NSNumber numberWithBool: YES] forKey: @"global"];
+    }
+    [records addObject: dict];
+  }
+
+  return records;
+}
+
+#endif /* FSW_EVENT_BATCH_H */
@@ -19,6 +19,16 @@
  * - Service: org.freedesktop.FileManager1
  * - Object Path: /org/freedesktop/FileManager1
  * - Interface: org.freedesktop.FileManager1
+ *
+ * Progress of running file operations is published next to it, for
+ * monitoring, at:
+ * - Object Path: /org/gnustep/GWorkspace/FileOperations
+ * - Interface: org.gnustep.GWorkspace.FileOperations
+ *
+ * and the live object and cache counters (Workspace+Diagnostics.m), with
+ * a method writing the trace of FSNTrace.h, at:
+ * - Object Path: /org/gnustep/GWorkspace/Diagnostics
+ * - Interface: org.gnustep.GWorkspace.Diagnostics
  */
 @interface FileManagerDBusInterface : NSObject
 
@@ -11,6 +11,7 @@
 #import "../FSNode/FSNode.h"
 #import "FileViewer/GWViewersManager.h"
 #import "Desktop/GWDesktopManager.h"
+#import "FSNTrace.h"
 #import <dispatch/dispatch.h>
 #include <unistd.h>
 #include <string.h>
@@ -19,6 +20,32 @@
 // Use typedef to avoid naming conflicts
 typedef struct DBusConnection DBusConnectionStruct;
 
+static NSString * const FileOperationsObjectPath = @"/org/gnustep/GWorkspace/FileOperations";
+static NSString * const FileOperationsInterface = @"org.gnustep.GWorkspace.FileOperations";
+static NSString * const DiagnosticsObjectPath = @"/org/gnustep/GWorkspace/Diagnostics";
+static NSString * const DiagnosticsInterface = @"org.gnustep.GWorkspace.Diagnostics";
+
+/* Requests arriving this close together (a tool revealing its hits one
+   call at a time) are shown as one batch */
+#define SHOW_BATCH_DELAY 0.05
+
+@interface FileManagerDBusInterface ()
+{
+    dispatch_queue_t resolveQueue;      /* URIs decoded and stat'ed off the bus */
+    /* main thread only */
+    NSMutableArray *pendingFolders;
+    NSMutableArray *pendingParents;     /* in the order first asked for */
+    NSMutableDictionary *pendingItems;  /* parent -> items */
+    NSMutableSet *pendingPaths;
+    BOOL flushScheduled;
+}
+- (void)queueFolders:(NSArray *)folders;
+- (void)queueItems:(NSArray *)paths;
+- (void)scheduleFlush;
+- (void)flushPendingRequests;
+- (void)selectItems:(NSArray *)items inFolder:(NSString *)parentPath;
+@end
+
 @implementation FileManagerDBusInterface
 
 - (id)initWithWorkspace:(Workspace *)workspace
@@ -27,12 +54,26 @@ typedef struct DBusConnection DBusConnectionStruct;
     if (self) {
         self.workspace = workspace;
         self.dbusConnection = [GNUDBusConnection sessionBus];
+        resolveQueue = dispatch_queue_create("Workspace.fileManagerResolve",
+                                             DISPATCH_QUEUE_SERIAL);
+        pendingFolders = [NSMutableArray new];
+        pendingParents = [NSMutableArray new];
+        pendingItems = [NSMutableDictionary new];
+        pendingPaths = [NSMutableSet new];
     }
     return self;
 }
 
 - (void)dealloc
 {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self];
+    if (resolveQueue) {
+        dispatch_release(resolveQueue);
+    }
+    [pendingFolders release];
+    [pendingParents release];
+    [pendingItems release];
+    [pendingPaths release];
     self.workspace = nil;
     self.dbusConnection = nil;
     [super dealloc];
@@ -61,6 +102,18 @@ typedef struct DBusConnection DBusConnectionStruct;
         return NO;
     }
     
+    // Progress monitoring is optional; FileManager1 works without it
+    if (![self.dbusConnection registerObjectPath:FileOperationsObjectPath
+                                       interface:FileOperationsInterface
+                                         handler:self]) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Failed to register %@", FileOperationsObjectPath);
+    }
+    if (![self.dbusConnection registerObjectPath:DiagnosticsObjectPath
+                                       interface:DiagnosticsInterface
+                                         handler:self]) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Failed to register %@", DiagnosticsObjectPath);
+    }
+    
     NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Successfully registered org.freedesktop.FileManager1 on DBus");
     return YES;
 }
@@ -84,6 +137,28 @@ typedef struct DBusConnection DBusConnectionStruct;
     
     DBusMessage *message = (DBusMessage *)[messageValue pointerValue];
     
+    if ([interface isEqualToString:FileOperationsInterface]) {
+        if ([method isEqualToString:@"ListOperations"]) {
+            [self sendOperationsReply:message];
+        } else {
+            [self sendErrorReply:message errorName:"org.freedesktop.DBus.Error.UnknownMethod"
+                    errorMessage:[[NSString stringWithFormat:@"Unknown method: %@", method] UTF8String]];
+        }
+        return;
+    }
+    
+    if ([interface isEqualToString:DiagnosticsInterface]) {
+        if ([method isEqualToString:@"Counters"]) {
+            [self sendDiagnosticsReply:message];
+        } else if ([method isEqualToString:@"WriteTrace"]) {
+            [self sendTraceReply:message];
+        } else {
+            [self sendErrorReply:message errorName:"org.freedesktop.DBus.Error.UnknownMethod"
+                    errorMessage:[[NSString stringWithFormat:@"Unknown method: %@", method] UTF8String]];
+        }
+        return;
+    }
+    
     // Parse method arguments
     DBusMessageIter iter;
     if (!dbus_message_iter_init(message, &iter)) {
@@ -127,22 +202,26 @@ typedef struct DBusConnection DBusConnectionStruct;
     NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Method %@ called with %lu URIs, startupId='%@'",
           method, (unsigned long)[uris count], startupId);
     
-    // Dispatch to appropriate handler
-    if ([method isEqualToString:@"ShowFolders"]) {
-        [self showFolders:uris startupId:startupId];
-    } else if ([method isEqualToString:@"ShowItems"]) {
-        [self showItems:uris startupId:startupId];
-    } else if ([method isEqualToString:@"ShowItemProperties"]) {
-        [self showItemProperties:uris startupId:startupId];
-    } else {
+    if (![method isEqualToString:@"ShowFolders"]
+        && ![method isEqualToString:@"ShowItems"]
+        && ![method isEqualToString:@"ShowItemProperties"]) {
         NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Unknown method: %@", method);
         [self sendErrorReply:message errorName:"org.freedesktop.DBus.Error.UnknownMethod"
                 errorMessage:[[NSString stringWithFormat:@"Unknown method: %@", method] UTF8String]];
         return;
     }
     
-    // Send empty success reply
+    // Reply before any work: the caller does not wait for the paths to be
+    // checked or the viewers to load
     [self sendEmptyReply:message];
+    
+    if ([method isEqualToString:@"ShowFolders"]) {
+        [self showFolders:uris startupId:startupId];
+    } else if ([method isEqualToString:@"ShowItems"]) {
+        [self showItems:uris startupId:startupId];
+    } else {
+        [self showItemProperties:uris startupId:startupId];
+    }
 }
 
 - (NSString *)pathFromURI:(NSString *)uri
@@ -251,33 +330,45 @@ typedef struct DBusConnection DBusConnectionStruct;
 {
     NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: ShowFolders called with %lu URIs", (unsigned long)[uris count]);
     
-    for (NSString *uri in uris) {
-        NSString *path = [self pathFromURI:uri];
-        if (!path) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Skipping invalid URI: %@", uri);
-            continue;
-        }
-        
-        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Opening folder: %@", path);
-        
-        // Check if path exists and is a directory
-        BOOL isDirectory;
-        if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDirectory]) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path does not exist: %@", path);
-            continue;
-        }
-        
-        if (!isDirectory) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path is not a directory: %@", path);
-            continue;
-        }
-        
-        // Open the folder in Workspace
-        // Use the main thread to interact with the UI
-        dispatch_async(dispatch_get_main_queue(), ^{
-          [self openFolderOnMainThread:path];
-        });
-    }
+    NSArray *requested = [[uris copy] autorelease];
+    
+    dispatch_async(resolveQueue, ^{
+      NSAutoreleasePool *pool = [NSAutoreleasePool new];
+      NSMutableArray *folders = [NSMutableArray array];
+      NSMutableSet *seen = [NSMutableSet set];
+      
+      for (NSString *uri in requested) {
+          NSString *path = [self pathFromURI:uri];
+          if (!path) {
+              NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Skipping invalid URI: %@", uri);
+              continue;
+          }
+          
+          // Check if path exists and is a directory
+          BOOL isDirectory;
+          if (![[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:&isDirectory]) {
+              NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path does not exist: %@", path);
+              continue;
+          }
+          
+          if (!isDirectory) {
+              NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path is not a directory: %@", path);
+              continue;
+          }
+          
+          if (![seen containsObject:path]) {
+              [seen addObject:path];
+              [folders addObject:path];
+          }
+      }
+      
+      if ([folders count]) {
+          dispatch_async(dispatch_get_main_queue(), ^{
+            [self queueFolders:folders];
+          });
+      }
+      [pool drain];
+    });
 }
 
 - (void)openFolderOnMainThread:(NSString *)path
@@ -383,95 +474,139 @@ typedef struct DBusConnection DBusConnectionStruct;
 {
     NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: ShowItems called with %lu URIs", (unsigned long)[uris count]);
     
-    NSMutableArray *paths = [NSMutableArray array];
-    
-    for (NSString *uri in uris) {
-        NSString *path = [self pathFromURI:uri];
-        if (!path) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Skipping invalid URI: %@", uri);
-            continue;
-        }
-        
-        // Check if path exists
-        if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path does not exist: %@", path);
-            continue;
+    NSArray *requested = [[uris copy] autorelease];
+    
+    dispatch_async(resolveQueue, ^{
+      NSAutoreleasePool *pool = [NSAutoreleasePool new];
+      NSMutableArray *paths = [NSMutableArray array];
+      
+      for (NSString *uri in requested) {
+          NSString *path = [self pathFromURI:uri];
+          if (!path) {
+              NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Skipping invalid URI: %@", uri);
+              continue;
+          }
+          
+          // Check if path exists
+          if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+              NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Path does not exist: %@", path);
+              continue;
+          }
+          
+          [paths addObject:path];
+      }
+      
+      if ([paths count] == 0) {
+          NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: No valid paths to show");
+      } else {
+          dispatch_async(dispatch_get_main_queue(), ^{
+            [self queueItems:paths];
+          });
+      }
+      [pool drain];
+    });
+}
+
+- (void)queueFolders:(NSArray *)folders
+{
+    for (NSString *folder in folders) {
+        if (![pendingFolders containsObject:folder]) {
+            [pendingFolders addObject:folder];
         }
-        
-        [paths addObject:path];
     }
     
-    if ([paths count] == 0) {
-        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: No valid paths to show");
-        return;
+    [self scheduleFlush];
+}
+
+- (void)scheduleFlush
+{
+    if (!flushScheduled) {
+        flushScheduled = YES;
+        [self performSelector:@selector(flushPendingRequests)
+                   withObject:nil
+                   afterDelay:SHOW_BATCH_DELAY];
     }
-    
+}
+
+- (void)queueItems:(NSArray *)paths
+{
     // For ShowItems, we need to:
     // 1. Open the parent directory
     // 2. Select the items within it
-    
-    // Group items by parent directory
-    NSMutableDictionary *itemsByParent = [NSMutableDictionary dictionary];
+    // so the items are grouped by parent directory
     for (NSString *path in paths) {
         NSString *parentPath = [path stringByDeletingLastPathComponent];
-        NSMutableArray *items = [itemsByParent objectForKey:parentPath];
+        NSMutableArray *items;
+        
+        if ([pendingPaths containsObject:path]) {
+            continue;
+        }
+        [pendingPaths addObject:path];
+        
+        items = [pendingItems objectForKey:parentPath];
         if (!items) {
             items = [NSMutableArray array];
-            [itemsByParent setObject:items forKey:parentPath];
+            [pendingItems setObject:items forKey:parentPath];
+            [pendingParents addObject:parentPath];
         }
         [items addObject:path];
     }
     
-    // Open parent directories and select items
-    dispatch_async(dispatch_get_main_queue(), ^{
-      [self showItemsOnMainThread:itemsByParent];
-    });
+    [self scheduleFlush];
 }
 
-- (void)showItemsOnMainThread:(NSDictionary *)itemsByParent
+/* Each folder asked for is opened once, and each parent gets its items
+ * selected in a single call, however many requests they came in. */
+- (void)flushPendingRequests
 {
-    for (NSString *parentPath in itemsByParent) {
-        NSArray *items = [itemsByParent objectForKey:parentPath];
-        @try {
-            // For each item, try to select them in an existing viewer; if that fails,
-            // open the parent folder and retry, then fall back to root viewer selection
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Selecting %lu files in viewer rooted at %@", 
-                  (unsigned long)[items count], parentPath);
-
-            // Verify parent exists and is a directory
-            BOOL isDir = NO;
-            if (![[NSFileManager defaultManager] fileExistsAtPath:parentPath isDirectory:&isDir] || !isDir) {
-                NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Parent path does not exist or is not a directory: %@", parentPath);
-                continue;
-            }
-
-            BOOL success = [self.workspace selectFiles:items inFileViewerRootedAtPath:parentPath];
-            if (!success) {
-                NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Initial select failed for %@, attempting to open viewer and retry", parentPath);
-
-                // Open the parent folder in a new viewer and try again
-                [self.workspace newViewerAtPath:parentPath];
-
-                // Retry the selection
-                success = [self.workspace selectFiles:items inFileViewerRootedAtPath:parentPath];
-                if (success) {
-                    NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Selection succeeded after opening viewer at %@", parentPath);
-                    continue;
-                }
+    NSArray *folders = [[pendingFolders copy] autorelease];
+    NSArray *parents = [[pendingParents copy] autorelease];
+    NSDictionary *items = [[pendingItems copy] autorelease];
+    
+    flushScheduled = NO;
+    [pendingFolders removeAllObjects];
+    [pendingParents removeAllObjects];
+    [pendingItems removeAllObjects];
+    [pendingPaths removeAllObjects];
+    
+    NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Showing %lu folders and items in %lu folders",
+          (unsigned long)[folders count], (unsigned long)[parents count]);
+    
+    for (NSString *folder in folders) {
+        // a folder to select items in is opened by the selection
+        if ([items objectForKey:folder] == nil) {
+            [self openFolderOnMainThread:folder];
+        }
+    }
+    
+    for (NSString *parentPath in parents) {
+        [self selectItems:[items objectForKey:parentPath] inFolder:parentPath];
+    }
+}
 
-                // Try selecting in the root viewer as a further fallback
-                NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Retry select failed for %@; attempting root viewer selection", parentPath);
-                [self.workspace rootViewerSelectFiles:items];
+- (void)selectItems:(NSArray *)items inFolder:(NSString *)parentPath
+{
+    @try {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Selecting %lu files in viewer rooted at %@", 
+              (unsigned long)[items count], parentPath);
 
-                // As a last resort set the selected paths directly (inspector/selection based fallbacks)
-                [self.workspace setSelectedPaths:items];
+        // Verify parent exists and is a directory
+        BOOL isDir = NO;
+        if (![[NSFileManager defaultManager] fileExistsAtPath:parentPath isDirectory:&isDir] || !isDir) {
+            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Parent path does not exist or is not a directory: %@", parentPath);
+            return;
+        }
 
-                NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Finished fallback sequence for %@", parentPath);
-            }
-        } @catch (NSException *exception) {
-            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Exception showing items in %@: %@", 
-                  parentPath, exception);
+        // Opens the viewer for the folder if there is none, and selects
+        // all the items at once; it only fails for a folder that cannot
+        // have a viewer of its own (a package), shown in the root viewer
+        if (![self.workspace selectFiles:items inFileViewerRootedAtPath:parentPath]) {
+            NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Select failed for %@; selecting in the root viewer", parentPath);
+            [self.workspace rootViewerSelectFiles:items];
         }
+    } @catch (NSException *exception) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Exception showing items in %@: %@", 
+              parentPath, exception);
     }
 }
 
@@ -533,6 +668,136 @@ typedef struct DBusConnection DBusConnectionStruct;
     }
 }
 
+// ListOperations: one (usssuuttdd) struct per running file operation - ref, type,
+// source, destination, files done and total, bytes done and total, bytes per
+// second, and seconds remaining (-1 while unknown)
+- (void)sendOperationsReply:(DBusMessage *)message
+{
+    NSArray *operations = [self.workspace fileOperationsProgress];
+    DBusMessage *reply = dbus_message_new_method_return(message);
+    DBusMessageIter iter;
+    DBusMessageIter array;
+    
+    if (!reply) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Error - could not create method return");
+        return;
+    }
+    
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(usssuuttdd)", &array);
+    
+    for (NSDictionary *op in operations) {
+        DBusMessageIter entry;
+        NSString *destination = [op objectForKey:@"destination"];
+        dbus_uint32_t ref = [[op objectForKey:@"ref"] unsignedIntValue];
+        const char *type = [[op objectForKey:@"operation"] UTF8String];
+        const char *source = [[op objectForKey:@"source"] UTF8String];
+        const char *dest = destination ? [destination UTF8String] : "";
+        dbus_uint32_t filesDone = [[op objectForKey:@"filesDone"] unsignedIntValue];
+        dbus_uint32_t totalFiles = [[op objectForKey:@"totalFiles"] unsignedIntValue];
+        dbus_uint64_t bytesDone = [[op objectForKey:@"bytesDone"] unsignedLongLongValue];
+        dbus_uint64_t totalBytes = [[op objectForKey:@"totalBytes"] unsignedLongLongValue];
+        double throughput = [[op objectForKey:@"throughput"] doubleValue];
+        double remaining = [[op objectForKey:@"secondsRemaining"] doubleValue];
+        
+        dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &ref);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &type);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &source);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &dest);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &filesDone);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT32, &totalFiles);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &bytesDone);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &totalBytes);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_DOUBLE, &throughput);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_DOUBLE, &remaining);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    
+    dbus_message_iter_close_container(&iter, &array);
+    
+    void *conn = [self.dbusConnection rawConnection];
+    if (conn) {
+        dbus_connection_send((DBusConnectionStruct *)conn, reply, NULL);
+        dbus_connection_flush((DBusConnectionStruct *)conn);
+    } else {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Warning - could not get raw DBus connection");
+    }
+    dbus_message_unref(reply);
+}
+
+// Counters: a{st}, counter name -> value, as in -[Workspace diagnosticsReport]
+- (void)sendDiagnosticsReply:(DBusMessage *)message
+{
+    NSDictionary *report = [self.workspace diagnosticsReport];
+    NSArray *keys = [[report allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    DBusMessage *reply = dbus_message_new_method_return(message);
+    DBusMessageIter iter;
+    DBusMessageIter array;
+    
+    if (!reply) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Error - could not create method return");
+        return;
+    }
+    
+    dbus_message_iter_init_append(reply, &iter);
+    dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "{st}", &array);
+    
+    for (NSString *key in keys) {
+        DBusMessageIter entry;
+        const char *name = [key UTF8String];
+        dbus_uint64_t value = [[report objectForKey:key] unsignedLongLongValue];
+        
+        dbus_message_iter_open_container(&array, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &value);
+        dbus_message_iter_close_container(&array, &entry);
+    }
+    
+    dbus_message_iter_close_container(&iter, &array);
+    
+    void *conn = [self.dbusConnection rawConnection];
+    if (conn) {
+        dbus_connection_send((DBusConnectionStruct *)conn, reply, NULL);
+        dbus_connection_flush((DBusConnectionStruct *)conn);
+    } else {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Warning - could not get raw DBus connection");
+    }
+    dbus_message_unref(reply);
+}
+
+// WriteTrace: s, the path of the Chrome trace file written (see FSNTrace.h)
+- (void)sendTraceReply:(DBusMessage *)message
+{
+    NSString *tracePath = FSNTraceWrite(nil);
+    DBusMessage *reply;
+    const char *path;
+    
+    if (tracePath == nil) {
+        [self sendErrorReply:message errorName:"org.freedesktop.DBus.Error.Failed"
+                errorMessage:"Could not write the trace"];
+        return;
+    }
+    
+    reply = dbus_message_new_method_return(message);
+    if (!reply) {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Error - could not create method return");
+        return;
+    }
+    
+    path = [tracePath fileSystemRepresentation];
+    dbus_message_append_args(reply, DBUS_TYPE_STRING, &path, DBUS_TYPE_INVALID);
+    
+    void *conn = [self.dbusConnection rawConnection];
+    if (conn) {
+        dbus_connection_send((DBusConnectionStruct *)conn, reply, NULL);
+        dbus_connection_flush((DBusConnectionStruct *)conn);
+    } else {
+        NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Warning - could not get raw DBus connection");
+    }
+    dbus_message_unref(reply);
+}
+
 - (void)sendEmptyReply:(DBusMessage *)message
 {
     NSDebugLLog(@"gwspace", @"FileManagerDBusInterface: Sending empty reply");
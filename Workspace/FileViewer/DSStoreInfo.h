@@ -6,6 +6,16 @@
 #import <AppKit/AppKit.h>
 #import "../DSStore/DSStore.h"
 
+/**
+ * What +setFileProbe: takes.  Answers without a round trip whether a
+ * .DS_Store is known to be missing, e.g. on a network volume.
+ */
+@protocol DSStoreFileProbe <NSObject>
+- (BOOL)isKnownMissingFileAtPath:(NSString *)path;
+- (void)noteMissingFileAtPath:(NSString *)path;
+- (void)noteCreatedFileAtPath:(NSString *)path;
+@end
+
 /**
  * DSStoreIconInfo - Icon-specific information from DS_Store
  */
@@ -45,7 +55,7 @@
  * - Per-file icon positions (Iloc)
  * - Sidebar width (fwsw)
  */
-@interface DSStoreInfo : NSObject
+@interface DSStoreInfo : NSObject <NSCopying>
 {
     NSString *_directoryPath;
     BOOL _loaded;
@@ -136,8 +146,35 @@
 
 // Factory methods
 + (instancetype)infoForDirectoryPath:(NSString *)path;
+
+/**
+ * With load YES the parsed info is shared process-wide: a bounded cache
+ * keyed by the directory's (dev, ino) and validated by the mtime and size
+ * of its .DS_Store hands every viewer its own copy, so a folder opened by
+ * the desktop, a spatial viewer and a browser is parsed once.
+ */
 + (instancetype)infoForDirectoryPath:(NSString *)path loadImmediately:(BOOL)load;
 
+/**
+ * Drop the cached info for a directory, e.g. on an fswatcher event.
+ * Saving through -saveToPath: does this for the directory written.
+ */
++ (void)invalidateCachedInfoForDirectoryPath:(NSString *)path;
++ (void)removeAllCachedInfo;
+
+/**
+ * For the diagnostics: the instances alive, and the directories whose
+ * info is held in the shared cache.
+ */
++ (NSUInteger)liveCount;
++ (NSUInteger)cachedInfoCount;
+
+/**
+ * Asked before every .DS_Store lookup and told of the misses and of the
+ * stores saved.  Not retained; nil, the default, looks every one up.
+ */
++ (void)setFileProbe:(id <DSStoreFileProbe>)probe;
+
 // Initialization
 - (instancetype)initWithDirectoryPath:(NSString *)path;
 
@@ -200,6 +237,15 @@
 - (BOOL)hasAnyIconPositions;
 - (NSArray *)filenamesWithPositions;
 
+/**
+ * Icon positions as DSStoreIconLocation structs sorted by name hash, the
+ * layout -[DSStore iconLocationTable] produces.  The class method scans
+ * the folder's .DS_Store B-tree directly, without building a DSStoreInfo,
+ * and returns nil when there is no readable store.
+ */
+- (NSData *)iconLocationTable;
++ (NSData *)iconLocationTableForDirectoryPath:(NSString *)path;
+
 /**
  * Add or update the per-file icon info for @p filename.
  * This is the public write-side counterpart of the read-only
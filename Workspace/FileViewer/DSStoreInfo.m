@@ -4,8 +4,55 @@
  *
  */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #import "DSStoreInfo.h"
 #import "DSStore.h"
+#import "FSNTrace.h"
+
+// Loaded infos kept by +infoForDirectoryPath:loadImmediately:
+#define DSSTORE_INFO_CACHE_SIZE 64
+
+@interface DSStoreInfoCacheEntry : NSObject
+{
+@public
+    DSStoreInfo *info;
+    NSString *path;
+    BOOL hasStore;
+    time_t mtime;
+    off_t size;
+}
+@end
+
+@implementation DSStoreInfoCacheEntry
+
+- (void)dealloc
+{
+    [info release];
+    [path release];
+    [super dealloc];
+}
+
+@end
+
+static NSMutableDictionary *infoCache = nil;   // "dev:ino" -> DSStoreInfoCacheEntry
+static NSMutableArray *infoCacheOrder = nil;   // keys, least recently used first
+static NSLock *infoCacheLock = nil;
+static id <DSStoreFileProbe> fileProbe = nil;
+static long liveInfos = 0;
+
+@interface DSStoreInfo (SharedCache)
+- (id)copyForDirectoryPath:(NSString *)path;
+@end
+
+static int compareIconLocations(const void *a, const void *b)
+{
+    uint64_t ha = ((const DSStoreIconLocation *)a)->nameHash;
+    uint64_t hb = ((const DSStoreIconLocation *)b)->nameHash;
+
+    return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
 
 #pragma mark - DSStoreIconInfo Implementation
 
@@ -126,6 +173,15 @@
 @synthesize columnWidths = _columnWidths;
 @synthesize columnVisible = _columnVisible;
 
++ (void)initialize
+{
+    if (self == [DSStoreInfo class]) {
+        infoCache = [[NSMutableDictionary alloc] init];
+        infoCacheOrder = [[NSMutableArray alloc] init];
+        infoCacheLock = [[NSLock alloc] init];
+    }
+}
+
 #pragma mark - Factory Methods
 
 + (instancetype)infoForDirectoryPath:(NSString *)path
@@ -135,13 +191,112 @@
 
 + (instancetype)infoForDirectoryPath:(NSString *)path loadImmediately:(BOOL)load
 {
-    DSStoreInfo *info = [[[self alloc] initWithDirectoryPath:path] autorelease];
-    if (load) {
-        [info load];
+    NSString *dsStorePath;
+    NSString *key;
+    DSStoreInfoCacheEntry *entry;
+    struct stat dirst;
+    struct stat st;
+    BOOL hasStore;
+    DSStoreInfo *info;
+    
+    if (!load || self != [DSStoreInfo class] || path == nil
+        || stat([path fileSystemRepresentation], &dirst) != 0) {
+        info = [[[self alloc] initWithDirectoryPath:path] autorelease];
+        if (load) {
+            [info load];
+        }
+        return info;
+    }
+    
+    // Keyed by the directory itself, so that every path to it shares one
+    // entry; valid for as long as its .DS_Store keeps its mtime and size.
+    key = [NSString stringWithFormat:@"%llu:%llu",
+                    (unsigned long long)dirst.st_dev, (unsigned long long)dirst.st_ino];
+    dsStorePath = [path stringByAppendingPathComponent:@".DS_Store"];
+    hasStore = ([fileProbe isKnownMissingFileAtPath:dsStorePath] == NO
+                && stat([dsStorePath fileSystemRepresentation], &st) == 0);
+    if (!hasStore) {
+        [fileProbe noteMissingFileAtPath:dsStorePath];
     }
+    
+    [infoCacheLock lock];
+    entry = [infoCache objectForKey:key];
+    if (entry && entry->hasStore == hasStore
+        && (!hasStore || (entry->mtime == st.st_mtime && entry->size == st.st_size))) {
+        // Each caller gets its own copy to change and save
+        info = [[entry->info copyForDirectoryPath:path] autorelease];
+        [infoCacheOrder removeObject:key];
+        [infoCacheOrder addObject:key];
+        [infoCacheLock unlock];
+        return info;
+    }
+    [infoCacheLock unlock];
+    
+    info = [[[self alloc] initWithDirectoryPath:path] autorelease];
+    [info load];
+    
+    entry = [[DSStoreInfoCacheEntry alloc] init];
+    entry->info = [info copy];
+    entry->path = [path copy];
+    entry->hasStore = hasStore;
+    entry->mtime = hasStore ? st.st_mtime : 0;
+    entry->size = hasStore ? st.st_size : 0;
+    
+    [infoCacheLock lock];
+    [infoCacheOrder removeObject:key];
+    while ([infoCacheOrder count] >= DSSTORE_INFO_CACHE_SIZE) {
+        [infoCache removeObjectForKey:[infoCacheOrder objectAtIndex:0]];
+        [infoCacheOrder removeObjectAtIndex:0];
+    }
+    [infoCache setObject:entry forKey:key];
+    [infoCacheOrder addObject:key];
+    [infoCacheLock unlock];
+    [entry release];
+    
     return info;
 }
 
++ (void)invalidateCachedInfoForDirectoryPath:(NSString *)path
+{
+    NSMutableArray *stale = [NSMutableArray array];
+    struct stat dirst;
+    
+    if (path == nil) {
+        return;
+    }
+    
+    [infoCacheLock lock];
+    for (NSString *key in infoCache) {
+        DSStoreInfoCacheEntry *entry = [infoCache objectForKey:key];
+        if ([entry->path isEqualToString:path]) {
+            [stale addObject:key];
+        }
+    }
+    // Also reached through another path to the same directory
+    if (stat([path fileSystemRepresentation], &dirst) == 0) {
+        [stale addObject:[NSString stringWithFormat:@"%llu:%llu",
+                                   (unsigned long long)dirst.st_dev, (unsigned long long)dirst.st_ino]];
+    }
+    for (NSString *key in stale) {
+        [infoCache removeObjectForKey:key];
+        [infoCacheOrder removeObject:key];
+    }
+    [infoCacheLock unlock];
+}
+
++ (void)removeAllCachedInfo
+{
+    [infoCacheLock lock];
+    [infoCache removeAllObjects];
+    [infoCacheOrder removeAllObjects];
+    [infoCacheLock unlock];
+}
+
++ (void)setFileProbe:(id <DSStoreFileProbe>)probe
+{
+    fileProbe = probe;
+}
+
 #pragma mark - Sort Column Conversion
 
 + (int)infoTypeForSortColumnName:(NSString *)columnName
@@ -249,8 +404,30 @@
     return self;
 }
 
++ (id)allocWithZone:(NSZone *)zone
+{
+    __atomic_add_fetch(&liveInfos, 1, __ATOMIC_RELAXED);
+    return [super allocWithZone:zone];
+}
+
++ (NSUInteger)liveCount
+{
+    return (NSUInteger)__atomic_load_n(&liveInfos, __ATOMIC_RELAXED);
+}
+
++ (NSUInteger)cachedInfoCount
+{
+    NSUInteger count;
+
+    [infoCacheLock lock];
+    count = [infoCache count];
+    [infoCacheLock unlock];
+    return count;
+}
+
 - (void)dealloc
 {
+    __atomic_sub_fetch(&liveInfos, 1, __ATOMIC_RELAXED);
     [_directoryPath release];
     [_backgroundColor release];
     [_backgroundImagePath release];
@@ -265,6 +442,7 @@
 
 - (BOOL)load
 {
+    FSN_TRACE_SCOPE("DSStoreInfo load");
     NSString *dsStorePath = [_directoryPath stringByAppendingPathComponent:@".DS_Store"];
     
     NSDebugLLog(@"gwspace", @"╔══════════════════════════════════════════════════════════════════╗");
@@ -273,7 +451,9 @@
     NSDebugLLog(@"gwspace", @"║ Directory: %@", _directoryPath);
     NSDebugLLog(@"gwspace", @"║ DS_Store path: %@", dsStorePath);
     
-    if (![[NSFileManager defaultManager] fileExistsAtPath:dsStorePath]) {
+    if ([fileProbe isKnownMissingFileAtPath:dsStorePath]
+        || ![[NSFileManager defaultManager] fileExistsAtPath:dsStorePath]) {
+        [fileProbe noteMissingFileAtPath:dsStorePath];
         NSDebugLLog(@"gwspace", @"║ ✗ No .DS_Store file found");
         NSDebugLLog(@"gwspace", @"╚══════════════════════════════════════════════════════════════════╝");
         return NO;
@@ -331,6 +511,54 @@
     return [self load];
 }
 
+#pragma mark - Copying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+    return [self copyForDirectoryPath:_directoryPath];
+}
+
+- (id)copyForDirectoryPath:(NSString *)path
+{
+    DSStoreInfo *copy = [[DSStoreInfo allocWithZone:[self zone]] initWithDirectoryPath:path];
+    
+    copy->_loaded = _loaded;
+    copy->_windowFrame = _windowFrame;
+    copy->_hasWindowFrame = _hasWindowFrame;
+    copy->_viewStyle = _viewStyle;
+    copy->_hasViewStyle = _hasViewStyle;
+    copy->_iconSize = _iconSize;
+    copy->_hasIconSize = _hasIconSize;
+    copy->_iconArrangement = _iconArrangement;
+    copy->_hasIconArrangement = _hasIconArrangement;
+    copy->_labelPosition = _labelPosition;
+    copy->_hasLabelPosition = _hasLabelPosition;
+    copy->_gridSpacing = _gridSpacing;
+    copy->_hasGridSpacing = _hasGridSpacing;
+    copy->_backgroundType = _backgroundType;
+    copy.backgroundColor = _backgroundColor;
+    copy.backgroundImagePath = _backgroundImagePath;
+    copy->_sidebarWidth = _sidebarWidth;
+    copy->_hasSidebarWidth = _hasSidebarWidth;
+    copy->_listTextSize = _listTextSize;
+    copy->_hasListTextSize = _hasListTextSize;
+    copy->_listIconSize = _listIconSize;
+    copy->_hasListIconSize = _hasListIconSize;
+    copy.sortColumn = _sortColumn;
+    copy->_hasSortColumn = _hasSortColumn;
+    copy->_sortAscending = _sortAscending;
+    copy.columnWidths = _columnWidths;
+    copy.columnVisible = _columnVisible;
+    
+    for (NSString *filename in _iconInfoDict) {
+        DSStoreIconInfo *iconInfo = [[_iconInfoDict objectForKey:filename] copy];
+        [copy->_iconInfoDict setObject:iconInfo forKey:filename];
+        [iconInfo release];
+    }
+    
+    return copy;
+}
+
 #pragma mark - Manual population support
 
 - (void)markAsLoaded
@@ -557,14 +785,11 @@
         NSData *data = (NSData *)[entry value];
         NSDebugLLog(@"gwspace", @"║ ✓ bwsp (Browser Window Settings - Modern): %lu bytes", (unsigned long)[data length]);
         
-        NSError *error = nil;
-        NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data
-                                                                        options:NSPropertyListImmutable
-                                                                         format:NULL
-                                                                          error:&error];
-        if (plist && [plist isKindOfClass:[NSDictionary class]]) {
+        // Only scalars are read, so the plist is scanned, not built
+        DSPlistValue *plist = [entry plistValue];
+        if (plist) {
             // Extract WindowBounds if present
-            NSString *windowBounds = [plist objectForKey:@"WindowBounds"];
+            NSString *windowBounds = [plist scalarForKey:@"WindowBounds"];
             if (windowBounds && [windowBounds isKindOfClass:[NSString class]]) {
                 // Parse WindowBounds string format: "{{x, y}, {width, height}}"
                 NSRect rect = NSRectFromString(windowBounds);
@@ -580,7 +805,7 @@
             }
             
             // Extract sidebar width
-            id sidebarWidthObj = [plist objectForKey:@"SidebarWidth"];
+            id sidebarWidthObj = [plist scalarForKey:@"SidebarWidth"];
             if (sidebarWidthObj) {
                 _sidebarWidth = [sidebarWidthObj intValue];
                 _hasSidebarWidth = YES;
@@ -590,7 +815,7 @@
             NSDebugLLog(@"gwspace", @"║   Show sidebar: %@", [plist objectForKey:@"ShowSidebar"]);
             NSDebugLLog(@"gwspace", @"║   Show toolbar: %@", [plist objectForKey:@"ShowToolbar"]);
         } else {
-            NSDebugLLog(@"gwspace", @"║   ⚠ Failed to parse bwsp as plist: %@", error);
+            NSDebugLLog(@"gwspace", @"║   ⚠ bwsp is empty");
         }
     } else {
         NSDebugLLog(@"gwspace", @"║ ○ No bwsp (browser window settings) entry");
@@ -1134,6 +1359,50 @@
     return result;
 }
 
+- (NSData *)iconLocationTable
+{
+    NSMutableData *table = [NSMutableData data];
+    unichar buffer[1024];
+
+    for (NSString *filename in _iconInfoDict) {
+        DSStoreIconInfo *info = [_iconInfoDict objectForKey:filename];
+        NSUInteger length = [filename length];
+        DSStoreIconLocation loc;
+
+        if (!info.hasPosition || length > 1024) {
+            continue;
+        }
+        [filename getCharacters:buffer range:NSMakeRange(0, length)];
+        loc.nameHash = DSStoreFilenameHash(buffer, length);
+        loc.x = (int32_t)info.position.x;
+        loc.y = (int32_t)info.position.y;
+        [table appendBytes:&loc length:sizeof(loc)];
+    }
+
+    qsort([table mutableBytes], [table length] / sizeof(DSStoreIconLocation),
+          sizeof(DSStoreIconLocation), compareIconLocations);
+    return table;
+}
+
++ (NSData *)iconLocationTableForDirectoryPath:(NSString *)path
+{
+    NSString *dsStorePath = [path stringByAppendingPathComponent:@".DS_Store"];
+    DSStore *store;
+
+    if ([fileProbe isKnownMissingFileAtPath:dsStorePath]) {
+        return nil;
+    }
+    if (![[NSFileManager defaultManager] isReadableFileAtPath:dsStorePath]) {
+        [fileProbe noteMissingFileAtPath:dsStorePath];
+        return nil;
+    }
+    store = [DSStore storeWithPath:dsStorePath];
+    if (![store loadLazily]) {
+        return nil;
+    }
+    return [store iconLocationTable];
+}
+
 #pragma mark - Coordinate Conversion
 
 - (NSRect)gnustepWindowFrameForScreen:(NSScreen *)screen
@@ -1194,6 +1463,7 @@
 
 - (BOOL)saveToPath:(NSString *)dsStorePath
 {
+  FSN_TRACE_SCOPE ("DSStoreInfo save");
   if (!dsStorePath || [dsStorePath length] == 0) return NO;
 
   NSDebugLLog(@"gwspace", @"╔══════════════════════════════════════════════════════════════════╗");
@@ -1319,6 +1589,9 @@
 
   /* --- Write atomically --- */
   BOOL saved = [store save];
+  [fileProbe noteCreatedFileAtPath:dsStorePath];
+  [DSStoreInfo invalidateCachedInfoForDirectoryPath:
+                 [dsStorePath stringByDeletingLastPathComponent]];
   if (saved) {
     NSDebugLLog(@"gwspace", @"║ ✓ Successfully wrote %@", dsStorePath);
   } else {
@@ -0,0 +1,67 @@
+/* GWSpatialPreload.h
+ *
+ * What a spatial viewer reads before its first frame, read while its
+ * window is being made.
+ *
+ * A preload starts, on a global queue each, the DS_Store view settings
+ * of a folder (GWViewSettingsManager: the folder .DS_Store, then the
+ * per-volume cache) and a snapshot of its listing.  The viewer takes the
+ * settings when it configures the window, waiting for them if they are
+ * not in yet, and hands the listing to FSNodeRep's listing cache just
+ * before its node view shows the folder.  A listing that is not in after
+ * SPATIAL_PRELOAD_LISTING_WAIT seconds is left to the node view, which
+ * reads the folder as it always did.
+ *
+ * Folders on network volumes have their listing read through
+ * FSNVolumeHealth by the view, never here.  Main thread only, but for
+ * the reads themselves.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <dispatch/dispatch.h>
+#import "FSNodeRep.h"
+
+@class DSStoreInfo;
+@class GWViewSettingsManager;
+@class FSNDirectorySnapshot;
+
+@interface GWSpatialPreload : NSObject
+{
+  NSString *path;
+  dispatch_group_t settingsGroup;
+  dispatch_group_t listingGroup;
+  GWViewSettingsManager *settingsManager;
+  DSStoreInfo *settings;
+  FSNDirectorySnapshot *snapshot;
+  NSSet *hiddenNames;
+  BOOL readsListing;
+  BOOL listingTaken;
+}
+
+/**
+ * Starts reading the settings and, unless `apath` is on a network
+ * volume, the listing of the folder at `apath`.
+ */
++ (GWSpatialPreload *)preloadForPath:(NSString *)apath;
+
+- (NSString *)path;
+
+/**
+ * The settings manager of the folder, as -managerForDirectoryPath:
+ * makes it; waits for the read.
+ */
+- (GWViewSettingsManager *)settingsManager;
+
+/**
+ * The settings read by the manager; waits for the read.
+ */
+- (DSStoreInfo *)settings;
+
+/**
+ * Caches the listing in `rep`, if it was read in time; once.
+ */
+- (void)cacheListingInNodeRep:(FSNodeRep *)rep;
+
+@end
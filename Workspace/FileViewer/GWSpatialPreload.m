@@ -0,0 +1,105 @@
+/* GWSpatialPreload.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "GWSpatialPreload.h"
+#import "GWViewSettingsManager.h"
+#import "DSStoreInfo.h"
+#import "FSNDirectorySnapshot.h"
+#import "FSNVolumeHealth.h"
+
+/* past it the node view reads the folder itself */
+#define SPATIAL_PRELOAD_LISTING_WAIT 0.25
+
+
+@implementation GWSpatialPreload
+
++ (GWSpatialPreload *)preloadForPath:(NSString *)apath
+{
+  GWSpatialPreload *preload = [GWSpatialPreload new];
+  dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+  FSNLoadTier tier = [[FSNodeRep sharedInstance] defaultLoadTier];
+
+  preload->path = [apath copy];
+  preload->settingsGroup = dispatch_group_create();
+  preload->listingGroup = dispatch_group_create();
+  preload->readsListing = ([[FSNodeRep sharedInstance] hasCachedDirectoryListingAtPath: apath] == NO)
+                  && ([[FSNVolumeHealth sharedHealth] remoteMountPointForPath: apath] == nil);
+
+  /* the blocks keep the preload until they are done */
+  dispatch_group_async(preload->settingsGroup, queue, ^{
+    CREATE_AUTORELEASE_POOL(arp);
+    GWViewSettingsManager *manager = [GWViewSettingsManager managerForDirectoryPath: apath];
+
+    preload->settingsManager = RETAIN (manager);
+    preload->settings = RETAIN ([manager readSettings]);
+    RELEASE (arp);
+  });
+
+  if (preload->readsListing)
+    {
+      dispatch_group_async(preload->listingGroup, queue, ^{
+        CREATE_AUTORELEASE_POOL(arp);
+        FSNDirectorySnapshot *snap = [FSNDirectorySnapshot snapshotOfDirectoryAtPath: apath
+                                                                                tier: tier];
+
+        if ([snap statInfoForName: @".hidden"] != NULL)
+          preload->hiddenNames = RETAIN ([FSNodeRep hiddenNamesAtPath: apath]);
+
+        preload->snapshot = RETAIN (snap);
+        RELEASE (arp);
+      });
+    }
+
+  return AUTORELEASE (preload);
+}
+
+- (void)dealloc
+{
+  RELEASE (path);
+  RELEASE (settingsManager);
+  RELEASE (settings);
+  RELEASE (snapshot);
+  RELEASE (hiddenNames);
+  dispatch_release(settingsGroup);
+  dispatch_release(listingGroup);
+  [super dealloc];
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (GWViewSettingsManager *)settingsManager
+{
+  dispatch_group_wait(settingsGroup, DISPATCH_TIME_FOREVER);
+  return settingsManager;
+}
+
+- (DSStoreInfo *)settings
+{
+  dispatch_group_wait(settingsGroup, DISPATCH_TIME_FOREVER);
+  return settings;
+}
+
+- (void)cacheListingInNodeRep:(FSNodeRep *)rep
+{
+  if ((readsListing == NO) || listingTaken)
+    return;
+
+  listingTaken = YES;
+
+  /* the listing cache checks the folder's mtime before it answers, so a
+     folder that changed since is read again */
+  if (dispatch_group_wait(listingGroup,
+                          dispatch_time(DISPATCH_TIME_NOW,
+                                        (int64_t)(SPATIAL_PRELOAD_LISTING_WAIT * NSEC_PER_SEC))) == 0)
+    {
+      [rep cacheDirectorySnapshot: snapshot hiddenNames: hiddenNames];
+    }
+}
+
+@end
@@ -37,6 +37,7 @@
 @class GWViewerScrollView;
 @class DSStoreInfo;
 @class GWViewSettingsManager;
+@class GWSpatialPreload;
 
 @interface GWSpatialViewer : NSObject
 {
@@ -89,6 +90,13 @@
          inWindow:(GWViewerWindow *)win
          showType:(NSString *)stype
     showSelection:(BOOL)showsel;
+/* With the settings and listing `preload` read meanwhile, when it is of
+   the folder of `node`. */
+- (id)initForNode:(FSNode *)node
+         inWindow:(GWViewerWindow *)win
+         showType:(NSString *)stype
+    showSelection:(BOOL)showsel
+          preload:(GWSpatialPreload *)preload;
 - (void)createSubviews;
 - (FSNode *)baseNode;
 - (BOOL)isShowingNode:(FSNode *)anode;
@@ -182,6 +190,7 @@
 - (void)chooseLabelColor:(id)sender;
 - (void)chooseBackColor:(id)sender;
 - (void)selectAllInViewer;
+- (void)refreshViewer;
 - (void)showTerminal;
 - (void)showAttributesInspector:(id)sender;
 - (NSArray *)lastSelection;
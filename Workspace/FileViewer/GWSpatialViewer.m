@@ -29,6 +29,8 @@
 #import <AppKit/AppKit.h>
 #import "DSStoreInfo.h"
 #import "GWViewSettingsManager.h"
+#import "GWIconPositionStore.h"
+#import "GWSpatialPreload.h"
 #import "GWViewerPrefs.h"
 #import "GWSpatialViewer.h"
 #import "GWViewersManager.h"
@@ -51,15 +53,23 @@
 #import "NetworkFSNode.h"
 #import "Thumbnailer/GWThumbnailer.h"
 #import "NetworkServiceManager.h"
+#import "GWWatchDispatcher.h"
  
 #define DEFAULT_INCR 150
 #define MIN_W_HEIGHT 180
 
+@interface GWSpatialViewer (WatchedNodes)
+- (void)watchNodePath:(NSString *)path;
+- (void)unwatchNodePath:(NSString *)path;
+- (void)watchedNodeChanged:(NSDictionary *)info;
+@end
+
 @implementation GWSpatialViewer
 
 - (void)dealloc
 {
   [nc removeObserver: self];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self];
   [self teardownDSStoreWatcher];
   
   if (_x11Path) {
@@ -87,6 +97,19 @@
          inWindow:(GWViewerWindow *)win
          showType:(NSString *)stype
     showSelection:(BOOL)showsel
+{
+  return [self initForNode: node
+                  inWindow: win
+                  showType: stype
+             showSelection: showsel
+                   preload: nil];
+}
+
+- (id)initForNode:(FSNode *)node
+         inWindow:(GWViewerWindow *)win
+         showType:(NSString *)stype
+    showSelection:(BOOL)showsel
+          preload:(GWSpatialPreload *)preload
 {
   self = [super init];
   
@@ -156,13 +179,13 @@
     }
 
     if (viewerPrefs == nil) {
-      defEntry = [defaults dictionaryForKey: prefsname];
+      defEntry = [fsnodeRep viewerPrefsForKey: prefsname];
 
       if (defEntry == nil) {
         /* One-shot fallback to the pre-split key shared with the browser,
          * so existing users keep their shelf/geometry.  Writes always go
          * to the new spatial key. */
-        defEntry = [defaults dictionaryForKey:
+        defEntry = [fsnodeRep viewerPrefsForKey:
           GWViewerLegacySharedPrefsKey([node path], rootViewerKey)];
       }
 
@@ -179,12 +202,18 @@
     //   Tier 2: per-volume cache
     //   Tier 3: defaults
     // ================================================================
-    // Create the view-settings manager with the full read/write hierarchy
-    _settingsManager = [[GWViewSettingsManager managerForDirectoryPath:[baseNode path]] retain];
+    if (preload && [[preload path] isEqual: [baseNode path]]) {
+      // Read by the preload while the window was being made
+      _settingsManager = [[preload settingsManager] retain];
+      ASSIGN(dsStoreInfo, [preload settings]);
+    } else {
+      // Create the view-settings manager with the full read/write hierarchy
+      _settingsManager = [[GWViewSettingsManager managerForDirectoryPath:[baseNode path]] retain];
 
-    // Load working copy of view settings via the manager
-    // (readSettings returns autoreleased; ASSIGN retains it)
-    ASSIGN(dsStoreInfo, [_settingsManager readSettings]);
+      // Load working copy of view settings via the manager
+      // (readSettings returns autoreleased; ASSIGN retains it)
+      ASSIGN(dsStoreInfo, [_settingsManager readSettings]);
+    }
     if (dsStoreInfo == nil) {
       // Fallback: direct load (shouldn't normally happen)
       ASSIGN(dsStoreInfo, [DSStoreInfo infoForDirectoryPath:[baseNode path]]);
@@ -192,8 +221,9 @@
 
     /* One-time migration off the legacy per-folder .gwdir: fold its view
      * settings into .DS_Store (the single source of truth now) and keep the
-     * non-DS_Store remainder (shelf, last selection, geometry) in user
-     * defaults, then delete the .gwdir so it is never read or written again. */
+     * non-DS_Store remainder (shelf, last selection, geometry) in the
+     * viewer prefs store, then delete the .gwdir so it is never read or
+     * written again. */
     if ([baseNode isWritable] && (rootviewer == NO) && (rootViewerKey == nil)
         && ([[fsnodeRep volumes] containsObject: [baseNode path]] == NO)) {
       NSString *legacyPath = [[baseNode path] stringByAppendingPathComponent: @".gwdir"];
@@ -203,9 +233,9 @@
          * .gwdir only fills fields the .DS_Store does not already have. */
         [dsStoreInfo takeValuesFromViewerPrefs: viewerPrefs
                                 preservingExisting: YES];
-        [_settingsManager writeSettings: dsStoreInfo];
-        [[NSUserDefaults standardUserDefaults] setObject: viewerPrefs
-                                                  forKey: prefsname];
+        [[GWIconPositionStore sharedStore] writeSettings: dsStoreInfo
+                                               forFolder: [baseNode path]];
+        [fsnodeRep setViewerPrefs: viewerPrefs forKey: prefsname];
         [fmgr removeFileAtPath: legacyPath handler: nil];
         NSDebugLLog(@"gwspace",
           @"GWSpatialViewer: migrated legacy .gwdir at %@ into .DS_Store", legacyPath);
@@ -339,12 +369,13 @@
 	  [scroll setDocumentView: nodeView];	
     RELEASE (nodeView);
     [self applyContentBackgroundColor];
+    [preload cacheListingInNodeRep: fsnodeRep];
     [nodeView showContentsOfNode: baseNode];
 
     if ([[NSUserDefaults standardUserDefaults] boolForKey: @"use_thumbnails"])
       {
         Thumbnailer *t = [Thumbnailer sharedThumbnailer];
-        if (t) [t makeThumbnails: [baseNode path]];
+        if (t) [t makeThumbnails: [baseNode path] forRequester: self];
       }
 
     // ================================================================
@@ -721,22 +752,23 @@
         FSNode *ndcomp = [components objectAtIndex: i];
 
         if ([nd isEqual: ndcomp] == NO) {
-          [gworkspace removeWatcherForPath: [nd path]];
+          [self unwatchNodePath: [nd path]];
         } else {
           pos = i + 1;
         }
 
       } else {
-        [gworkspace removeWatcherForPath: [nd path]];
+        [self unwatchNodePath: [nd path]];
       }
     }
 
     for (i = pos; i < count; i++) {   
-      [gworkspace addWatcherForPath: [[components objectAtIndex: i] path]];
+      [self watchNodePath: [[components objectAtIndex: i] path]];
     }
 
     [watchedNodes removeAllObjects];
     [watchedNodes addObjectsFromArray: components];
+    [manager viewerDidChangeWatchedNodes: self];
   }  
 }
 
@@ -866,6 +898,28 @@
   return watchedNodes;
 }
 
+- (void)watchNodePath:(NSString *)path
+{
+  [gworkspace addWatcherForPath: path];
+  [[GWWatchDispatcher sharedDispatcher] addObserver: self
+                                           selector: @selector(watchedNodeChanged:)
+                                            forPath: path
+                                              scope: GWWatchPath];
+}
+
+- (void)unwatchNodePath:(NSString *)path
+{
+  [gworkspace removeWatcherForPath: path];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self
+                                               forPath: path
+                                                 scope: GWWatchPath];
+}
+
+- (void)watchedNodeChanged:(NSDictionary *)info
+{
+  [manager viewer: self watchedNodeChanged: info];
+}
+
 - (void)hideDotsFileChanged:(BOOL)hide
 {
   [self reloadFromNode: baseNode];
@@ -950,20 +1004,17 @@
     [baseNode checkWritable];
 
     /* Persist the non-DS_Store remainder (shelf, last selection, geometry
-     * fallback) to user defaults; view settings go to .DS_Store below.  The
-     * legacy per-folder .gwdir file is no longer written. */
-    {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-
-      [defaults setObject: updatedprefs
-                   forKey: GWViewerPrefsKey([baseNode path], YES,
-                                            rootViewerKey, NO)];
-
-      /* State now lives under the spatial-specific key; drop the pre-split
-       * shared entry so the one-shot read fallback can't later resurrect it. */
-      [defaults removeObjectForKey:
-        GWViewerLegacySharedPrefsKey([baseNode path], rootViewerKey)];
-    }
+     * fallback) to the viewer prefs store; view settings go to .DS_Store
+     * below.  The legacy per-folder .gwdir file is no longer written. */
+    [fsnodeRep setViewerPrefs: updatedprefs
+                       forKey: GWViewerPrefsKey([baseNode path], YES,
+                                                rootViewerKey, NO)];
+
+    /* State now lives under the spatial-specific key; drop the pre-split
+     * shared entry so the one-shot read fallback can't later resurrect it. */
+    [fsnodeRep setViewerPrefs: nil
+                       forKey: GWViewerLegacySharedPrefsKey([baseNode path],
+                                                            rootViewerKey)];
 
     // ================================================================
     // Save view settings to .DS_Store (interoperability, spec §3)
@@ -979,7 +1030,8 @@
       [dsStoreInfo takeValuesFromViewerPrefs:updatedprefs];
 
       // Write via the settings manager
-      [_settingsManager writeSettings:dsStoreInfo];
+      [[GWIconPositionStore sharedStore] writeSettings:dsStoreInfo
+                                             forFolder:[baseNode path]];
     }
 
     ASSIGN (viewerPrefs, [updatedprefs makeImmutableCopyOnFail: NO]);
@@ -1409,6 +1461,7 @@
 {
   if (invalidated == NO) {
     closing = YES;
+    [[Thumbnailer sharedThumbnailer] cancelThumbnailsForRequester: self];
     [self teardownDSStoreWatcher];
     [self updateDefaults];
     [vwrwin setDelegate: nil];
@@ -1706,9 +1759,10 @@
     [vwrwin makeFirstResponder: nodeView]; 
 
     for (i = 0; i < [watchedNodes count]; i++) {  
-      [gworkspace removeWatcherForPath: [[watchedNodes objectAtIndex: i] path]];
+      [self unwatchNodePath: [[watchedNodes objectAtIndex: i] path]];
     }
     [watchedNodes removeAllObjects];
+    [manager viewerDidChangeWatchedNodes: self];
     
     DESTROY (lastSelection);
     selection = [nodeView selectedNodes];
@@ -1861,7 +1915,8 @@
   /* Persist via settings manager (writable → .DS_Store, else → cache) */
   if (_settingsManager)
     {
-      [_settingsManager writeSettings: dsStoreInfo];
+      [[GWIconPositionStore sharedStore] writeSettings: dsStoreInfo
+                                             forFolder: [baseNode path]];
     }
 }
 
@@ -1876,6 +1931,14 @@
 	[nodeView selectAll];
 }
 
+/* Listings of network volumes are trusted for a while without asking the
+   server; this is how the user asks it now. */
+- (void)refreshViewer
+{
+  [fsnodeRep refreshCachesUnderPath: [baseNode path]];
+  [self reloadFromNode: baseNode];
+}
+
 - (void)showTerminal
 {
   NSString *path;
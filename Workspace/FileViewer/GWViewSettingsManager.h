@@ -62,6 +62,13 @@
  */
 - (DSStoreInfo *)readSettings;
 
+/**
+ * Just the icon positions, through the same hierarchy, as a
+ * -[DSStoreInfo iconLocationTable]: the folder .DS_Store is scanned in
+ * place rather than loaded.  Never nil; empty when nothing is stored.
+ */
+- (NSData *)readIconLocationTable;
+
 /**
  * Write view settings following the spec hierarchy:
  *   1. Try $FOLDER/.DS_Store (atomically)
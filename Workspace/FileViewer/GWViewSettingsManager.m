@@ -89,6 +89,30 @@
   return info;
 }
 
+- (NSData *)readIconLocationTable
+{
+  NSData *table = nil;
+
+  /* Tier 1: per-folder .DS_Store, scanned without a full load */
+  if ([[NSFileManager defaultManager] fileExistsAtPath:[self folderDSStorePath]]) {
+    table = [DSStoreInfo iconLocationTableForDirectoryPath:_directoryPath];
+    if (table) {
+      return table;
+    }
+  }
+
+  /* Tier 2: per-volume cache */
+  if (_volumeCache) {
+    DSStoreInfo *info = [_volumeCache readInfoForDirectoryPath:_directoryPath];
+    if (info) {
+      return [info iconLocationTable];
+    }
+  }
+
+  /* Tier 3: defaults — nothing stored */
+  return [NSData data];
+}
+
 /* ------------------------------------------------------------------ */
 #pragma mark - Write (spec §3)
 /* ------------------------------------------------------------------ */
@@ -191,6 +191,7 @@ typedef enum
 - (void)chooseLabelColor:(id)sender;
 - (void)chooseBackColor:(id)sender;
 - (void)selectAllInViewer;
+- (void)refreshViewer;
 - (void)showTerminal;
 - (void)showAttributesInspector:(id)sender;
 - (BOOL)validateItem:(id)menuItem;
@@ -51,7 +51,9 @@
 #import "NetworkFSNode.h"
 #import "DSStoreInfo.h"
 #import "GWViewSettingsManager.h"
+#import "GWIconPositionStore.h"
 #import "GWViewerPrefs.h"
+#import "GWWatchDispatcher.h"
 
 #define DEFAULT_INCR 150
 #define MIN_WIN_H 300
@@ -83,6 +85,12 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 }
 
 
+@interface GWViewer (WatchedNodes)
+- (void)watchNodePath:(NSString *)path;
+- (void)unwatchNodePath:(NSString *)path;
+- (void)watchedNodeChanged:(NSDictionary *)info;
+@end
+
 @implementation GWViewer
 
 /* Accessor for lastSelection used by GWViewerWindow quicklook guard */
@@ -94,6 +102,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 - (void)dealloc
 {
   [nc removeObserver: self];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self];
 
   RELEASE (baseNode);
   RELEASE (baseNodeArray);
@@ -182,7 +191,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 
     defaultsKeyStr = [prefsname retain];
     if (viewerPrefs == nil) {
-      defEntry = [defaults dictionaryForKey: defaultsKeyStr];
+      defEntry = [fsnodeRep viewerPrefsForKey: defaultsKeyStr];
       if (defEntry) {
         viewerPrefs = [defEntry copy];
       } else {
@@ -192,7 +201,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
     
     /* View settings come from .DS_Store (tiered via the settings manager,
      * the single store shared with the spatial viewer) as primary, with the
-     * user-defaults viewerPrefs as fallback.  This matches -updateDefaults,
+     * stored viewerPrefs as fallback.  This matches -updateDefaults,
      * which already writes these settings to .DS_Store. */
     DSStoreInfo *dsInfo =
       [[GWViewSettingsManager managerForDirectoryPath: [baseNode path]] readSettings];
@@ -201,7 +210,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
     }
 
     /* Precedence: an explicit caller-supplied type (stype != 0) wins; then the
-     * folder's remembered .DS_Store style; then the user-defaults viewerPrefs;
+     * folder's remembered .DS_Store style; then the stored viewerPrefs;
      * else Icon.  (The enum starts at GWViewTypeBrowser = 1, so 0 means "no
      * preference".) */
     viewType = GWViewTypeIcon;
@@ -351,7 +360,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
     if ([[NSUserDefaults standardUserDefaults] boolForKey: @"use_thumbnails"])
       {
         Thumbnailer *t = [Thumbnailer sharedThumbnailer];
-        if (t) [t makeThumbnails: [baseNode path]];
+        if (t) [t makeThumbnails: [baseNode path] forRequester: self];
       }
     
     if (showsel) {
@@ -740,22 +749,23 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
         FSNode *ndcomp = [components objectAtIndex: i];
 
         if ([nd isEqual: ndcomp] == NO) {
-          [gworkspace removeWatcherForPath: [nd path]];
+          [self unwatchNodePath: [nd path]];
         } else {
           pos = i + 1;
         }
 
       } else {
-        [gworkspace removeWatcherForPath: [nd path]];
+        [self unwatchNodePath: [nd path]];
       }
     }
 
     for (i = pos; i < count; i++) {   
-      [gworkspace addWatcherForPath: [[components objectAtIndex: i] path]];
+      [self watchNodePath: [[components objectAtIndex: i] path]];
     }
 
     [watchedNodes removeAllObjects];
     [watchedNodes addObjectsFromArray: components];
+    [manager viewerDidChangeWatchedNodes: self];
   }  
   
   [manager addNode: node toHistoryOfViewer: self];
@@ -977,6 +987,28 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
   return watchedNodes;
 }
 
+- (void)watchNodePath:(NSString *)path
+{
+  [gworkspace addWatcherForPath: path];
+  [[GWWatchDispatcher sharedDispatcher] addObserver: self
+                                           selector: @selector(watchedNodeChanged:)
+                                            forPath: path
+                                              scope: GWWatchPath];
+}
+
+- (void)unwatchNodePath:(NSString *)path
+{
+  [gworkspace removeWatcherForPath: path];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self
+                                               forPath: path
+                                                 scope: GWWatchPath];
+}
+
+- (void)watchedNodeChanged:(NSDictionary *)info
+{
+  [manager viewer: self watchedNodeChanged: info];
+}
+
 - (void)hideDotsFileChanged:(BOOL)hide
 {
   [self reloadFromNode: baseNode];
@@ -1068,18 +1100,14 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
 
     // Save view settings to .DS_Store for Mac interoperability
     {
-      GWViewSettingsManager *sm = [GWViewSettingsManager managerForDirectoryPath:[baseNode path]];
       DSStoreInfo *dsInfo = [DSStoreInfo infoForDirectoryPath:[baseNode path] loadImmediately:NO];
       [dsInfo takeValuesFromViewerPrefs:updatedprefs];
-      [sm writeSettings:dsInfo];
+      [[GWIconPositionStore sharedStore] writeSettings:dsInfo forFolder:[baseNode path]];
     }
 
     [baseNode checkWritable];
 
-    {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-      [defaults setObject: updatedprefs forKey: defaultsKeyStr];
-    }
+    [fsnodeRep setViewerPrefs: updatedprefs forKey: defaultsKeyStr];
     
     ASSIGN (viewerPrefs, [updatedprefs makeImmutableCopyOnFail: NO]);
   }
@@ -1099,6 +1127,11 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
   [self scrollToBeginning];
   [self selectionChanged: [NSArray arrayWithObject: node]];
 
+  if ([[NSUserDefaults standardUserDefaults] boolForKey: @"use_thumbnails"]) {
+    [[Thumbnailer sharedThumbnailer] makeThumbnails: [node path] 
+                                       forRequester: self];
+  }
+
   /* Update the window title to reflect the navigated location */
   NSString *path = [node path];
   if ([path isEqual: path_separator()]) {
@@ -1123,7 +1156,7 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
   /* Tear down watchers for the old base */
   NSUInteger i;
   for (i = 0; i < [watchedNodes count]; i++) {
-    [gworkspace removeWatcherForPath: [[watchedNodes objectAtIndex: i] path]];
+    [self unwatchNodePath: [[watchedNodes objectAtIndex: i] path]];
   }
   [watchedNodes removeAllObjects];
   DESTROY (lastSelection);
@@ -1135,6 +1168,8 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
     ASSIGN (baseNode, [FSNode nodeWithPath: [newBase path]]);
   }
   ASSIGN (baseNodeArray, [NSArray arrayWithObject: baseNode]);
+  [manager viewerDidChangeBaseNode: self];
+  [manager viewerDidChangeWatchedNodes: self];
 
   [history removeAllObjects];
   historyPosition = 0;
@@ -1165,6 +1200,11 @@ static BOOL getVolumeInfo(const char *path, unsigned long long *total,
   [self applyContentBackgroundColor];
   [nodeView showContentsOfNode: baseNode];
 
+  if ([[NSUserDefaults standardUserDefaults] boolForKey: @"use_thumbnails"]) {
+    [[Thumbnailer sharedThumbnailer] makeThumbnails: [baseNode path] 
+                                       forRequester: self];
+  }
+
   /* Window title */
   {
     NSString *path = [baseNode path];
@@ -1298,6 +1338,7 @@ constrainMinCoordinate:(CGFloat)proposedMin
 {
   if (invalidated == NO) {
     closing = YES;
+    [[Thumbnailer sharedThumbnailer] cancelThumbnailsForRequester: self];
     [self updateDefaults];
     [vwrwin setDelegate: nil];
     [manager viewerWillClose: self];
@@ -1648,9 +1689,10 @@ constrainMinCoordinate:(CGFloat)proposedMin
 
       for (i = 0; i < [watchedNodes count]; i++)
         {  
-          [gworkspace removeWatcherForPath: [[watchedNodes objectAtIndex: i] path]];
+          [self unwatchNodePath: [[watchedNodes objectAtIndex: i] path]];
         }
       [watchedNodes removeAllObjects];
+      [manager viewerDidChangeWatchedNodes: self];
       
       DESTROY (lastSelection);
       selection = [nodeView selectedNodes];
@@ -1791,9 +1833,8 @@ constrainMinCoordinate:(CGFloat)proposedMin
     }
 
   /* Persist via settings manager */
-  GWViewSettingsManager *sm;
-  sm = [GWViewSettingsManager managerForDirectoryPath: [baseNode path]];
-  [sm writeSettings: dsInfo];
+  [[GWIconPositionStore sharedStore] writeSettings: dsInfo
+                                         forFolder: [baseNode path]];
 }
 
 - (void)chooseBackColor:(id)sender
@@ -1808,6 +1849,14 @@ constrainMinCoordinate:(CGFloat)proposedMin
   [nodeView selectAll];
 }
 
+/* Listings of network volumes are trusted for a while without asking the
+   server; this is how the user asks it now. */
+- (void)refreshViewer
+{
+  [fsnodeRep refreshCachesUnderPath: [baseNode path]];
+  [self reloadFromNode: baseNode];
+}
+
 - (void)showTerminal
 {
   NSString *path;
@@ -31,6 +31,7 @@
 
 #import "FSNIcon.h"
 #import "FSNFunctions.h"
+#import "FSNFontWidths.h"
 #import "GWViewerIconsPath.h"
 #import "GWViewer.h"
 #import "Workspace.h"
@@ -222,18 +223,30 @@
   [self setNeedsDisplay: YES];
 }
 
+/* Arrowing through a tree changes the tail of the path: the icons of
+   the folders still on it keep their node, image and label. */
+- (void)showNode:(FSNode *)anode
+          inIcon:(FSNIcon *)icon
+{
+  if (([icon selection] != nil) || ([[icon node] isEqualToNode: anode] == NO)) {
+    [icon setNode: anode];
+  }
+}
+
 - (void)showPathComponents:(NSArray *)components
                  selection:(NSArray *)selection
 {
   FSNode *node = [selection objectAtIndex: 0];
   int count = [components count];
+  BOOL showsLeaf = ([node isEqual: [components objectAtIndex: (count -1)]] == NO);
+  int wanted = showsLeaf ? (count + 1) : count;
   FSNIcon *icon;
   int icncount;
   int i;
 
   [self stopRepNameEditing]; 
     
-  while ([icons count] > count) {
+  while ([icons count] > wanted) {
     icon = [self lastIcon];
     if (icon) {
       [self removeRep: icon];
@@ -247,7 +260,7 @@
   
     if (i < icncount) {
       icon = [icons objectAtIndex: i];
-      [icon setNode: component];
+      [self showNode: component inIcon: icon];
     } else {
       icon = [self addRepForSubnode: component];
     }
@@ -257,8 +270,14 @@
     [icon setGridIndex: i];
   }
 
-  if ([node isEqual: [components objectAtIndex: (count -1)]] == NO) {
-    icon = [self addRepForSubnode: node];
+  if (showsLeaf) {
+    if (count < icncount) {
+      icon = [icons objectAtIndex: count];
+      [icon setNameEdited: NO];
+      [icon setGridIndex: -1];
+    } else {
+      icon = [self addRepForSubnode: node];
+    }
   
     if ([selection count] > 1) {
       NSMutableArray *selnodes = [NSMutableArray array];
@@ -269,7 +288,9 @@
       }
       
       [icon showSelection: selnodes];
-    } 
+    } else {
+      [self showNode: node inIcon: icon];
+    }
   }
   
   icon = [self lastIcon];
@@ -370,10 +391,8 @@
     yOffset = myrintf((selfH - gridSize.height) / 2.0);
     if (yOffset < 0) yOffset = 0;
 
-    NSDictionary *attrs = labelFont
-        ? [NSDictionary dictionaryWithObject: labelFont
-                                      forKey: NSFontAttributeName]
-        : nil;
+    /* the advances of the characters are measured once per font */
+    FSNFontWidths *widths = labelFont ? [FSNFontWidths widthsForFont: labelFont] : nil;
     CGFloat hlightW = ceil((CGFloat)iconSize / 3.0 * 4.0);
     int lblmargin = [fsnodeRep labelMargin];
     /* Match FSNIcon's reserved space for the branch arrow on non-leaf
@@ -391,13 +410,13 @@
         leaf = [icon isLeaf];
       }
 
-      if (attrs && [icon respondsToSelector: @selector(shownInfo)]) {
+      if (widths && [icon respondsToSelector: @selector(shownInfo)]) {
         NSString *shown = [icon shownInfo];
         if ([shown length] == 0 && [icon respondsToSelector: @selector(node)]) {
           shown = [[icon node] name];
         }
         if (shown) {
-          lblW = ceil([shown sizeWithAttributes: attrs].width);
+          lblW = ceil([widths widthOfString: shown]);
         }
       }
 
@@ -1,7 +1,8 @@
 /* GWViewerPrefs.h
  *
- * Single source for the NSUserDefaults key under which a viewer persists its
- * per-folder remainder state (geometry fallback, shelf, last selection, ...).
+ * Single source for the key under which a viewer persists its per-folder
+ * remainder state (geometry fallback, shelf, last selection, ...) in the
+ * viewer prefs store.  The keys were user defaults keys before the store.
  *
  * Browser and spatial windows for the same folder are different window kinds
  * with different state shapes, so they get distinct keys — previously both
@@ -35,4 +36,8 @@ NSString *GWViewerPrefsKey(NSString *path, BOOL spatial,
  * never written to for spatial viewers anymore. */
 NSString *GWViewerLegacySharedPrefsKey(NSString *path, NSNumber *rootKey);
 
+/* YES for a key of any of the shapes above, legacy ones included: the
+ * user defaults keys moved to the viewer prefs store. */
+BOOL GWViewerPrefsIsFolderKey(NSString *key);
+
 #endif /* GW_VIEWER_PREFS_H */
@@ -35,3 +35,29 @@ GWViewerLegacySharedPrefsKey(NSString *path, NSNumber *rootKey)
                      path, [rootKey unsignedLongValue]];
   return [NSString stringWithFormat: @"viewer_at_%@", path];
 }
+
+BOOL
+GWViewerPrefsIsFolderKey(NSString *key)
+{
+  NSRange r;
+  NSUInteger i;
+
+  if ([key isEqual: @"root_viewer"]
+      || [key hasPrefix: @"viewer_at_"] || [key hasPrefix: @"spatial_at_"])
+    return YES;
+
+  /* "<key>_viewer_at_<path>" */
+  r = [key rangeOfString: @"_viewer_at_"];
+  if ((r.location == NSNotFound) || (r.location == 0))
+    return NO;
+
+  for (i = 0; i < r.location; i++)
+    {
+      unichar c = [key characterAtIndex: i];
+
+      if ((c < '0') || (c > '9'))
+        return NO;
+    }
+
+  return YES;
+}
@@ -0,0 +1,57 @@
+/* GWViewerPrefsStore.h
+ *
+ * The per-folder viewer prefs (the GWViewerPrefsKey dictionaries of the
+ * viewers and the view settings FSNode keeps with them) in a DBKit B-tree
+ * of their own, instead of one user defaults key each.  After months of
+ * browsing those were tens of thousands of keys, loaded and synced with
+ * the defaults domain by every GNUstep app of the session.
+ *
+ * The store is two files in ~/Library/Workspace/ViewerPrefs: "prefs",
+ * a record per key holding the key and its dictionary as a binary
+ * property list, and "prefs.index", the tree of the record offsets in
+ * key order.  A key is read from disk the first time it is asked for
+ * and kept; changes are kept too and written together a little later,
+ * or at -flushPendingWrites.  Registered on FSNodeRep as its
+ * FSNViewerPrefsStore.  Main thread only.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_VIEWER_PREFS_STORE_H
+#define GW_VIEWER_PREFS_STORE_H
+
+#import <Foundation/Foundation.h>
+#import "FSNViewerPrefsStore.h"
+#import "DBKBTree.h"
+
+@class DBKVarLenRecordsFile;
+
+@interface GWViewerPrefsStore : NSObject <FSNViewerPrefsStore, DBKBTreeDelegate>
+{
+  DBKBTree *tree;
+  DBKVarLenRecordsFile *vlfile;
+
+  NSMutableDictionary *loaded;    /* key -> prefs or NSNull, as read */
+  NSMutableDictionary *pending;   /* key -> prefs or NSNull, not written */
+  NSTimer *pendingTimer;
+
+  NSData *dummyKey;               /* the key looked up, as UTF-8 */
+  NSNumber *dummyOffset;
+}
+
+/* The store of the user's Library, nil when it cannot be opened. */
++ (GWViewerPrefsStore *)sharedStore;
+
+- (id)initWithDirectory:(NSString *)dir;
+
+/* Moves the folder keys (GWViewerPrefsIsFolderKey) of the persistent
+ * domain `domain` of `defaults` into the store, and returns how many. */
+- (NSUInteger)migrateDomain:(NSString *)domain
+             ofUserDefaults:(NSUserDefaults *)defaults;
+
+/* Writes every pending change now. */
+- (void)flushPendingWrites;
+
+@end
+
+#endif /* GW_VIEWER_PREFS_STORE_H */
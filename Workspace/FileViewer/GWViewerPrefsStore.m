@@ -0,0 +1,428 @@
+/* GWViewerPrefsStore.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#import <Foundation/Foundation.h>
+#import "GWViewerPrefsStore.h"
+#import "GWViewerPrefs.h"
+#import "DBKBTreeNode.h"
+#import "DBKKeyCodec.h"
+#import "DBKVarLenRecordsFile.h"
+
+/* How long changes are collected before they are written.  Closing a
+ * viewer writes its prefs and those of each of its views. */
+#define GW_VIEWER_PREFS_WRITE_DELAY 2.0
+
+/* Records are a uint32_t key length, the key as UTF-8, then the prefs. */
+#define KEY_LENGTH_SIZE sizeof(uint32_t)
+
+static NSData *
+recordKey(NSData *record)
+{
+  uint32_t len;
+
+  if ([record length] < KEY_LENGTH_SIZE)
+    return nil;
+
+  [record getBytes: &len length: KEY_LENGTH_SIZE];
+  if ([record length] < KEY_LENGTH_SIZE + len)
+    return nil;
+
+  return [record subdataWithRange: NSMakeRange(KEY_LENGTH_SIZE, len)];
+}
+
+static NSData *
+recordWithKey(NSData *key, NSDictionary *prefs)
+{
+  NSData *plist = [NSPropertyListSerialization
+                    dataFromPropertyList: prefs
+                                  format: NSPropertyListBinaryFormat_v1_0
+                        errorDescription: NULL];
+  NSMutableData *record;
+  uint32_t len = (uint32_t)[key length];
+
+  if (plist == nil)
+    return nil;
+
+  record = [NSMutableData dataWithCapacity: KEY_LENGTH_SIZE + len + [plist length]];
+  [record appendBytes: &len length: KEY_LENGTH_SIZE];
+  [record appendData: key];
+  [record appendData: plist];
+
+  return record;
+}
+
+static NSDictionary *
+recordPrefs(NSData *record)
+{
+  NSData *key = recordKey(record);
+  NSUInteger start;
+  id prefs;
+
+  if (key == nil)
+    return nil;
+
+  start = KEY_LENGTH_SIZE + [key length];
+  prefs = [NSPropertyListSerialization
+            propertyListFromData: [record subdataWithRange:
+                                    NSMakeRange(start, [record length] - start)]
+                mutabilityOption: NSPropertyListImmutable
+                          format: NULL
+                errorDescription: NULL];
+
+  return ([prefs isKindOfClass: [NSDictionary class]] ? prefs : nil);
+}
+
+static NSComparisonResult
+compareKeys(NSData *a, NSData *b)
+{
+  NSUInteger alen = [a length];
+  NSUInteger blen = [b length];
+  int r = memcmp([a bytes], [b bytes], MIN(alen, blen));
+
+  if (r == 0)
+    {
+      if (alen == blen)
+        return NSOrderedSame;
+      return (alen < blen) ? NSOrderedAscending : NSOrderedDescending;
+    }
+
+  return (r < 0) ? NSOrderedAscending : NSOrderedDescending;
+}
+
+
+@interface GWViewerPrefsStore (Private)
+- (NSDictionary *)readPrefsForKey:(NSString *)key;
+- (void)writePrefs:(id)prefs
+            forKey:(NSString *)key;
+- (void)pendingWriteTimerFired:(NSTimer *)timer;
+@end
+
+@implementation GWViewerPrefsStore
+
++ (GWViewerPrefsStore *)sharedStore
+{
+  static GWViewerPrefsStore *shared = nil;
+  static BOOL tried = NO;
+
+  if (tried == NO)
+    {
+      NSString *dir = [NSSearchPathForDirectoriesInDomains
+                        (NSLibraryDirectory, NSUserDomainMask, YES) lastObject];
+
+      tried = YES;
+      dir = [dir stringByAppendingPathComponent: @"Workspace"];
+      dir = [dir stringByAppendingPathComponent: @"ViewerPrefs"];
+
+      NS_DURING
+        shared = [[self alloc] initWithDirectory: dir];
+      NS_HANDLER
+        NSLog(@"the viewer prefs store at %@ cannot be opened: %@", dir, localException);
+        shared = nil;
+      NS_ENDHANDLER
+    }
+
+  return shared;
+}
+
+- (void)dealloc
+{
+  [pendingTimer invalidate];
+  RELEASE (pendingTimer);
+  RELEASE (pending);
+  RELEASE (loaded);
+  RELEASE (vlfile);
+  RELEASE (tree);
+  RELEASE (dummyKey);
+  RELEASE (dummyOffset);
+
+  [super dealloc];
+}
+
+- (id)initWithDirectory:(NSString *)dir
+{
+  self = [super init];
+
+  if (self)
+    {
+      NSFileManager *fm = [NSFileManager defaultManager];
+      BOOL isdir;
+
+      if (([fm fileExistsAtPath: dir isDirectory: &isdir] && isdir) == NO)
+        {
+          if ([fm createDirectoryAtPath: dir
+            withIntermediateDirectories: YES
+                             attributes: nil
+                                  error: NULL] == NO)
+            {
+              DESTROY (self);
+              return nil;
+            }
+        }
+
+      vlfile = [[DBKVarLenRecordsFile alloc]
+                 initWithPath: [dir stringByAppendingPathComponent: @"prefs"]
+                  cacheLength: 64];
+      [vlfile setAutoflush: NO];
+
+      tree = [[DBKBTree alloc]
+               initWithPath: [dir stringByAppendingPathComponent: @"prefs.index"]
+                      order: 16
+                   delegate: self];
+
+      loaded = [NSMutableDictionary new];
+      pending = [NSMutableDictionary new];
+
+      /* no record is ever written there */
+      ASSIGN (dummyOffset, [NSNumber numberWithUnsignedLong: ULONG_MAX]);
+    }
+
+  return self;
+}
+
+- (NSDictionary *)viewerPrefsForKey:(NSString *)key
+{
+  id prefs;
+
+  if (key == nil)
+    return nil;
+
+  prefs = [pending objectForKey: key];
+
+  if (prefs == nil)
+    prefs = [loaded objectForKey: key];
+
+  if (prefs == nil)
+    {
+      prefs = [self readPrefsForKey: key];
+      [loaded setObject: (prefs ? prefs : (id)[NSNull null]) forKey: key];
+    }
+
+  return ([prefs isKindOfClass: [NSDictionary class]] ? prefs : nil);
+}
+
+- (void)setViewerPrefs:(NSDictionary *)prefs
+                forKey:(NSString *)key
+{
+  if (key == nil)
+    return;
+
+  if (prefs)
+    [pending setObject: AUTORELEASE ([prefs copy]) forKey: key];
+  else
+    [pending setObject: [NSNull null] forKey: key];
+
+  if (pendingTimer == nil)
+    {
+      ASSIGN (pendingTimer,
+              [NSTimer scheduledTimerWithTimeInterval: GW_VIEWER_PREFS_WRITE_DELAY
+                                               target: self
+                                             selector: @selector(pendingWriteTimerFired:)
+                                             userInfo: nil
+                                              repeats: NO]);
+    }
+}
+
+- (void)flushPendingWrites
+{
+  NSEnumerator *enumerator;
+  NSString *key;
+
+  if (pendingTimer)
+    {
+      [pendingTimer invalidate];
+      DESTROY (pendingTimer);
+    }
+
+  if ([pending count] == 0)
+    return;
+
+  [tree begin];
+
+  enumerator = [pending keyEnumerator];
+  while ((key = [enumerator nextObject]) != nil)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      id prefs = [pending objectForKey: key];
+
+      [self writePrefs: prefs forKey: key];
+      [loaded setObject: prefs forKey: key];
+      RELEASE (arp);
+    }
+
+  [tree end];
+
+  /* a key never refers to a record that is not on disk */
+  [vlfile flush];
+  [tree synchronize];
+
+  [pending removeAllObjects];
+  DESTROY (dummyKey);
+}
+
+- (NSUInteger)migrateDomain:(NSString *)domain
+             ofUserDefaults:(NSUserDefaults *)defaults
+{
+  NSMutableDictionary *dict;
+  NSArray *keys;
+  NSUInteger migrated = 0;
+  NSUInteger i;
+
+  dict = AUTORELEASE ([[defaults persistentDomainForName: domain] mutableCopy]);
+  keys = [dict allKeys];
+
+  for (i = 0; i < [keys count]; i++)
+    {
+      NSString *key = [keys objectAtIndex: i];
+      id prefs = [dict objectForKey: key];
+
+      if (GWViewerPrefsIsFolderKey(key) == NO)
+        continue;
+
+      /* what the viewers wrote there last is newer than any copy here */
+      if ([prefs isKindOfClass: [NSDictionary class]])
+        {
+          [self setViewerPrefs: prefs forKey: key];
+          migrated++;
+        }
+      [dict removeObjectForKey: key];
+    }
+
+  if (migrated || ([dict count] != [keys count]))
+    {
+      [self flushPendingWrites];
+      /* one write of the domain, instead of one per key */
+      [defaults setPersistentDomain: dict forName: domain];
+      [defaults synchronize];
+    }
+
+  return migrated;
+}
+
+- (void)pendingWriteTimerFired:(NSTimer *)timer
+{
+  [self flushPendingWrites];
+}
+
+- (NSDictionary *)readPrefsForKey:(NSString *)key
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSDictionary *prefs = nil;
+  DBKBTreeNode *node;
+  NSUInteger index;
+  BOOL exists;
+
+  ASSIGN (dummyKey, [key dataUsingEncoding: NSUTF8StringEncoding]);
+
+  [tree begin];
+  node = [tree nodeOfKey: dummyOffset getIndex: &index didExist: &exists];
+
+  if (exists)
+    prefs = recordPrefs([vlfile dataAtOffset: [node keyAtIndex: index]]);
+
+  [tree end];
+
+  DESTROY (dummyKey);
+  RETAIN (prefs);
+  RELEASE (arp);
+
+  return AUTORELEASE (prefs);
+}
+
+/* Between -begin and -end of the tree. */
+- (void)writePrefs:(id)prefs
+            forKey:(NSString *)key
+{
+  DBKBTreeNode *node;
+  NSNumber *oldOffset = nil;
+  NSUInteger index;
+  BOOL exists;
+
+  ASSIGN (dummyKey, [key dataUsingEncoding: NSUTF8StringEncoding]);
+
+  node = [tree nodeOfKey: dummyOffset getIndex: &index didExist: &exists];
+  if (exists)
+    oldOffset = AUTORELEASE (RETAIN ([node keyAtIndex: index]));
+
+  if ([prefs isKindOfClass: [NSDictionary class]])
+    {
+      NSData *record = recordWithKey(dummyKey, prefs);
+      NSNumber *offset;
+
+      if (record == nil)
+        {
+          NSLog(@"the viewer prefs of %@ are not a property list", key);
+          return;
+        }
+
+      offset = [vlfile writeData: record];
+
+      if (exists)
+        {
+          /* same key, so the same place in the tree */
+          [node replaceKeyAtIndex: index withKey: offset];
+          [vlfile deleteDataAtOffset: oldOffset];
+        }
+      else
+        {
+          node = [tree insertKey: dummyOffset];
+          [node replaceKey: dummyOffset withKey: offset];
+        }
+    }
+  else if (exists)
+    {
+      [tree deleteKey: oldOffset];
+      [vlfile deleteDataAtOffset: oldOffset];
+    }
+}
+
+/*
+ * DBKBTreeDelegate
+ */
+
+- (unsigned long)nodesize
+{
+  return 512;
+}
+
+- (NSArray *)keysFromData:(NSData *)data
+               withLength:(unsigned *)dlen
+{
+  return [[DBKOffsetKeyCodec sharedCodec] keysFromData: data withLength: dlen];
+}
+
+- (NSData *)dataFromKeys:(NSArray *)keys
+{
+  return [[DBKOffsetKeyCodec sharedCodec] dataFromKeys: keys];
+}
+
+- (NSComparisonResult)compareNodeKey:(id)akey
+                             withKey:(id)bkey
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSData *a;
+  NSData *b;
+  NSComparisonResult result;
+
+  if ([akey isEqual: dummyOffset])
+    a = dummyKey;
+  else
+    a = recordKey([vlfile dataAtOffset: akey]);
+
+  if ([bkey isEqual: dummyOffset])
+    b = dummyKey;
+  else
+    b = recordKey([vlfile dataAtOffset: bkey]);
+
+  result = compareKeys(a, b);
+  RELEASE (arp);
+
+  return result;
+}
+
+@end
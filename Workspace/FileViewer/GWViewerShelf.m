@@ -29,6 +29,7 @@
 
 #import "GWViewerShelf.h"
 #import "GWViewer.h"
+#import "GWWatchDispatcher.h"
 #import "Workspace.h"
 #import "FSNTextCell.h"
 #import "FSNBrowser.h"
@@ -623,11 +624,19 @@
 - (void)setWatcherForPath:(NSString *)path
 {
   [gworkspace addWatcherForPath: path];
+  /* an icon goes with any directory above it */
+  [[GWWatchDispatcher sharedDispatcher] addObserver: self
+                                           selector: @selector(watchedPathChanged:)
+                                            forPath: path
+                                              scope: GWWatchPathAndAncestors];
 }
 
 - (void)unsetWatcherForPath:(NSString *)path
 {
   [gworkspace removeWatcherForPath: path];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self
+                                               forPath: path
+                                                 scope: GWWatchPathAndAncestors];
 }
 
 - (void)unsetWatchers
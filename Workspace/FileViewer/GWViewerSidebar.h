@@ -24,6 +24,10 @@
   NSMutableArray *rootItems;
   NSMutableSet *collapsedGroupTitles;
   id viewer;
+  NSTimer *busyTimer;
+  NSUInteger busyPhase;
+  BOOL modelBuildInFlight;
+  BOOL modelBuildAgain;
 }
 
 - (id)initWithFrame:(NSRect)frameRect
@@ -13,11 +13,17 @@
 #import <AppKit/AppKit.h>
 #import <sys/stat.h>
 #import <sys/types.h>
+#import <math.h>
+#import <dispatch/dispatch.h>
 #import "GWViewerSidebar.h"
 #import "GWViewer.h"
 #import "GWViewersManager.h"
+#import "GWWatchDispatcher.h"
 #import "FSNode.h"
 #import "FSNodeRep.h"
+#import "FSNMountTable.h"
+#import "FSNFunctions.h"
+#import "FSNPasteboardPaths.h"
 #import "NetworkFSNode.h"
 #import "NetworkServiceManager.h"
 #import "NetworkServiceItem.h"
@@ -28,6 +34,8 @@
 #define HEADER_HEIGHT 20.0
 #define ICON_SIZE 16
 #define INDENT 0.0
+#define BUSY_SPOKES 8
+#define BUSY_INTERVAL 0.1
 
 /* Sidebar item kinds */
 typedef enum {
@@ -40,6 +48,12 @@ typedef enum {
 #define EJECT_ICON_RIGHT_PADDING 6.0
 #define EJECT_ICON_LEFT_PADDING 10.0
 
+/* The last model a sidebar built, copied into each new sidebar so a
+   window shows its sidebar before the volumes and services are looked
+   at again. */
+static NSArray *cachedModel = nil;
+static dispatch_queue_t modelQueue = NULL;
+
 static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 {
   if (path == nil) return NO;
@@ -53,6 +67,40 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   return NO;
 }
 
+/* Whether `svc` is mounted: by Workspace, with the mount point in
+   `mountPoints`, or out of it (sshfs run by hand), as a mount of its
+   host in the mount table.  The mount point is stat()ed, so this is
+   only called while the model is built, off the main thread. */
+static BOOL GWSidebarServiceIsMounted(NetworkServiceItem *svc,
+                                      NSDictionary *mountPoints)
+{
+  NSString *mountPoint = [mountPoints objectForKey: [svc identifier]];
+  struct stat st;
+
+  if (mountPoint == nil) {
+    NSString *hostname = [svc hostName];
+
+    if ([hostname length] > 0) {
+      NSArray *mounts = [[FSNMountTable sharedTable] entries];
+      NSUInteger i;
+
+      for (i = 0; i < [mounts count]; i++) {
+        FSNMountEntry *entry = [mounts objectAtIndex: i];
+
+        if ([[entry source] rangeOfString: hostname].location != NSNotFound) {
+          mountPoint = [entry mountPoint];
+          break;
+        }
+      }
+    }
+  }
+
+  if (mountPoint == nil) return NO;
+  if (stat([mountPoint fileSystemRepresentation], &st) != 0) return NO;
+
+  return S_ISDIR(st.st_mode);
+}
+
 /* Outline view that forces a Snow-Leopard-style sidebar background.
    NSOutlineView/NSTableView's setBackgroundColor: isn't reliably honored
    in this GNUstep build, so we override the background paint directly. */
@@ -62,6 +110,7 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 }
 - (NSRect)ejectRectForRow:(NSInteger)row;
 - (void)drawEjectGlyphInRect:(NSRect)r;
+- (void)drawBusyGlyphInRect:(NSRect)r phase:(NSUInteger)phase;
 @end
 
 @implementation GWSidebarOutlineView
@@ -136,6 +185,28 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   NSRectFill(bar);
 }
 
+/* The spokes of a spinner, darkest at `phase` and fading behind it */
+- (void)drawBusyGlyphInRect:(NSRect)r phase:(NSUInteger)phase
+{
+  NSPoint c = NSMakePoint(NSMidX(r), NSMidY(r));
+  CGFloat outer = r.size.width / 2.0;
+  CGFloat inner = outer * 0.45;
+  NSUInteger i;
+
+  for (i = 0; i < BUSY_SPOKES; i++) {
+    NSUInteger age = (phase + BUSY_SPOKES - i) % BUSY_SPOKES;
+    CGFloat a = (2.0 * M_PI * i) / BUSY_SPOKES;
+    NSBezierPath *spoke = [NSBezierPath bezierPath];
+
+    [[[NSColor darkGrayColor] colorWithAlphaComponent:
+                                1.0 - (0.8 * age / (BUSY_SPOKES - 1))] set];
+    [spoke setLineWidth: 1.5];
+    [spoke moveToPoint: NSMakePoint(c.x + inner * sin(a), c.y + inner * cos(a))];
+    [spoke lineToPoint: NSMakePoint(c.x + outer * sin(a), c.y + outer * cos(a))];
+    [spoke stroke];
+  }
+}
+
 - (void)drawRect:(NSRect)rect
 {
   [super drawRect: rect];
@@ -160,6 +231,15 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   NSUInteger end = visible.location + visible.length;
   NSUInteger i;
   for (i = visible.location; i < end; i++) {
+    NSNumber *rowNum = [NSNumber numberWithInteger: (NSInteger)i];
+    if ([ds respondsToSelector: @selector(itemAtRowIsMounting:)]
+        && [[ds performSelector: @selector(itemAtRowIsMounting:)
+                     withObject: rowNum] boolValue]) {
+      [self drawBusyGlyphInRect: [self ejectRectForRow: (NSInteger)i]
+                          phase: [[ds performSelector: @selector(busyPhase)]
+                                     unsignedIntegerValue]];
+      continue;
+    }
     NSNumber *isVol = [ds performSelector: @selector(itemAtRowIsVolume:)
                               withObject: [NSNumber numberWithInteger: (NSInteger)i]];
     if ([isVol boolValue]) {
@@ -201,6 +281,7 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 - (NSImage *)icon;
 - (BOOL)isVolume;
 - (BOOL)isMountedNetworkService;
+- (BOOL)isMountingNetworkService;
 - (NSArray *)children;
 - (id)userInfo;
 - (void)setUserInfo:(id)obj;
@@ -273,10 +354,11 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 
   NSPasteboard *pb = [sender draggingPasteboard];
   NSDragOperation sourceDragMask = [sender draggingSourceOperationMask];
-  NSArray *sourcePaths = nil;
+  FSNPasteboardPaths *pbpaths = nil;
 
   if ([[pb types] containsObject: NSFilenamesPboardType]) {
-    sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
+    /* read once per drag, though this is called at every movement */
+    pbpaths = FSNPathsOnPasteboard(pb);
   } else if ([[pb types] containsObject: @"GWRemoteFilenamesPboardType"]) {
     if ([targetNode isWritable] == NO) {
       [self setDragHighlightRow: -1];
@@ -293,35 +375,27 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     return NSDragOperationCopy;
   }
 
-  if (sourcePaths == nil || [sourcePaths count] == 0) {
+  if ([pbpaths count] == 0) {
     [self setDragHighlightRow: -1];
     return NSDragOperationNone;
   }
 
-  NSString *fromPath = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+  NSString *fromPath = [pbpaths source];
+  if (fromPath == nil) {
+    fromPath = [[[pbpaths paths] objectAtIndex: 0] stringByDeletingLastPathComponent];
+  }
 
   if ([targetPath isEqual: fromPath]) {
     [self setDragHighlightRow: -1];
     return NSDragOperationNone;
   }
-  if ([sourcePaths containsObject: targetPath]) {
+
+  /* Check that target is not a source path or in one */
+  if ([pbpaths containsPathOrAncestorOfPath: targetPath]) {
     [self setDragHighlightRow: -1];
     return NSDragOperationNone;
   }
 
-  /* Check that target is not a subdirectory of a source path */
-  NSString *prePath = targetPath;
-  while (1) {
-    if ([sourcePaths containsObject: prePath]) {
-      [self setDragHighlightRow: -1];
-      return NSDragOperationNone;
-    }
-    if ([prePath isEqual: @"/"]) {
-      break;
-    }
-    prePath = [prePath stringByDeletingLastPathComponent];
-  }
-
   NSDragOperation result = NSDragOperationNone;
   if (sourceDragMask & NSDragOperationMove) {
     if ([[NSFileManager defaultManager] isWritableFileAtPath: fromPath]) {
@@ -426,17 +500,19 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     return;
   }
 
-  NSArray *sourcePaths = [pb propertyListForType: NSFilenamesPboardType];
-  if (sourcePaths == nil || [sourcePaths count] == 0) {
+  FSNPasteboardPaths *pbpaths = FSNPathsOnPasteboard(pb);
+  if ([pbpaths count] == 0) {
     return;
   }
 
-  NSString *source = [[sourcePaths objectAtIndex: 0] stringByDeletingLastPathComponent];
+  NSString *source = [pbpaths source];
+  if (source == nil) {
+    source = [[[pbpaths paths] objectAtIndex: 0] stringByDeletingLastPathComponent];
+  }
   NSString *operation = nil;
   Workspace *gw = [Workspace gworkspace];
-  NSString *trashPath = [gw trashPath];
 
-  if ([source isEqual: trashPath]) {
+  if ([gw isTrashPath: source]) {
     operation = @"WorkspaceRecycleOutOperation";
   } else {
     if (sourceDragMask & NSDragOperationMove) {
@@ -456,10 +532,15 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     return;
   }
 
-  NSMutableArray *files = [NSMutableArray arrayWithCapacity: [sourcePaths count]];
-  NSUInteger i;
-  for (i = 0; i < [sourcePaths count]; i++) {
-    [files addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+  NSArray *files = [pbpaths names];
+  if (files == nil) {
+    NSArray *sourcePaths = [pbpaths paths];
+    NSMutableArray *names = [NSMutableArray arrayWithCapacity: [sourcePaths count]];
+    NSUInteger i;
+    for (i = 0; i < [sourcePaths count]; i++) {
+      [names addObject: [[sourcePaths objectAtIndex: i] lastPathComponent]];
+    }
+    files = names;
   }
 
   NSMutableDictionary *opDict = [NSMutableDictionary dictionaryWithCapacity: 4];
@@ -482,6 +563,8 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   GWSidebarItemKind kind;
   NSMutableArray *children;
   id userInfo;
+  BOOL mounted;
+  BOOL reachable;
 }
 - (id)initHeaderWithTitle:(NSString *)aTitle;
 - (id)initPathItemWithTitle:(NSString *)aTitle path:(NSString *)aPath;
@@ -495,6 +578,12 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 - (BOOL)isHeader;
 - (id)userInfo;
 - (void)setUserInfo:(id)obj;
+- (void)setMounted:(BOOL)flag;
+- (void)setReachable:(BOOL)flag;
+- (NSString *)identity;
+- (BOOL)hasSameChildrenAs:(GWSidebarItem *)other;
+- (void)setChildren:(NSArray *)items;
+- (BOOL)takeStateFrom:(GWSidebarItem *)other;
 @end
 
 @implementation GWSidebarItem
@@ -518,6 +607,7 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     path = [aPath copy];
     kind = GWSidebarItemPath;
     children = nil;
+    reachable = YES;
   }
   return self;
 }
@@ -529,6 +619,7 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     title = [aTitle copy];
     kind = GWSidebarItemNetwork;
     children = nil;
+    reachable = YES;
   }
   return self;
 }
@@ -553,6 +644,92 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   ASSIGN (userInfo, obj);
 }
 
+- (id)copyWithZone:(NSZone *)zone
+{
+  GWSidebarItem *copy = [[GWSidebarItem allocWithZone: zone] init];
+  NSUInteger i;
+
+  copy->title = [title copy];
+  copy->path = [path copy];
+  copy->kind = kind;
+  copy->userInfo = RETAIN (userInfo);
+  copy->icon = RETAIN (icon);
+  copy->mounted = mounted;
+  copy->reachable = reachable;
+
+  if (children != nil) {
+    copy->children = [[NSMutableArray alloc] initWithCapacity: [children count]];
+    for (i = 0; i < [children count]; i++) {
+      GWSidebarItem *child = [[children objectAtIndex: i] copyWithZone: zone];
+      [copy->children addObject: child];
+      RELEASE (child);
+    }
+  }
+
+  return copy;
+}
+
+- (void)setMounted:(BOOL)flag
+{
+  mounted = flag;
+}
+
+- (void)setReachable:(BOOL)flag
+{
+  reachable = flag;
+}
+
+/* What a row stands for, to match the rows of two models */
+- (NSString *)identity
+{
+  if (kind == GWSidebarItemNetwork && [userInfo isKindOfClass: [NetworkServiceItem class]]) {
+    return [NSString stringWithFormat: @"%d:%@:%@", kind, [userInfo identifier], title];
+  }
+  return [NSString stringWithFormat: @"%d:%@:%@", kind, path, title];
+}
+
+- (BOOL)hasSameChildrenAs:(GWSidebarItem *)other
+{
+  NSArray *others = [other children];
+  NSUInteger i;
+
+  if ([children count] != [others count]) return NO;
+
+  for (i = 0; i < [children count]; i++) {
+    if ([[[children objectAtIndex: i] identity]
+          isEqual: [[others objectAtIndex: i] identity]] == NO) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+- (void)setChildren:(NSArray *)items
+{
+  [children setArray: items];
+}
+
+/* Takes the mount and reachability state of `other`, the same row in a
+   newer model; YES when the row has to be drawn again. */
+- (BOOL)takeStateFrom:(GWSidebarItem *)other
+{
+  BOOL changed = NO;
+
+  if (mounted != other->mounted) {
+    mounted = other->mounted;
+    changed = YES;
+  }
+  if (reachable != other->reachable) {
+    reachable = other->reachable;
+    DESTROY (icon);
+    changed = YES;
+  }
+  if (other->userInfo != userInfo) {
+    ASSIGN (userInfo, other->userInfo);
+  }
+  return changed;
+}
+
 - (void)addChild:(GWSidebarItem *)child
 {
   if (children == nil) {
@@ -572,55 +749,19 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
       && GWSidebarPathIsUnderVolumeRoot(path);
 }
 
+/* Worked out with the model, off the main thread, by
+   GWSidebarServiceIsMounted() */
 - (BOOL)isMountedNetworkService
+{
+  return (kind == GWSidebarItemNetwork) && mounted;
+}
+
+- (BOOL)isMountingNetworkService
 {
   if (kind != GWSidebarItemNetwork) return NO;
   if (userInfo == nil || ![userInfo isKindOfClass: [NetworkServiceItem class]]) return NO;
 
-  /* First check what NetworkVolumeManager says (its internal dictionary). */
-  NetworkVolumeManager *nvm = [NetworkVolumeManager sharedManager];
-  NSString *mountPoint = nil;
-
-  if ([nvm isServiceMounted: userInfo]) {
-    mountPoint = [nvm mountPointForService: userInfo];
-  }
-
-  /* If NetworkVolumeManager doesn't know about this mount, check /proc/mounts
-     directly — the volume may have been mounted externally (e.g. via sshfs
-     command or the umount(1) CLI tool's mount remount).  We look for a line
-     containing the service's hostname in the mount table. */
-  if (mountPoint == nil) {
-    NSString *hostname = [userInfo hostName];
-    if (hostname) {
-      NSString *procContent = [NSString stringWithContentsOfFile: @"/proc/mounts"
-                                                        encoding: NSUTF8StringEncoding
-                                                           error: NULL];
-      if (procContent) {
-        if ([procContent rangeOfString: hostname].location != NSNotFound) {
-          /* The service's hostname appears in a mount — try to extract path */
-          NSArray *lines = [procContent componentsSeparatedByString: @"\n"];
-          for (NSString *line in lines) {
-            if ([line rangeOfString: hostname].location != NSNotFound) {
-              NSArray *parts = [line componentsSeparatedByString: @" "];
-              if ([parts count] >= 2) {
-                mountPoint = [parts objectAtIndex: 1];
-                break;
-              }
-            }
-          }
-        }
-      }
-    }
-  }
-
-  if (mountPoint == nil) return NO;
-
-  NSFileManager *fm = [NSFileManager defaultManager];
-  BOOL isDir = NO;
-  if (![fm fileExistsAtPath: mountPoint isDirectory: &isDir]) return NO;
-  if (!isDir) return NO;
-
-  return YES;
+  return [[NetworkVolumeManager sharedManager] isMountingService: userInfo];
 }
 
 - (NSImage *)icon
@@ -629,7 +770,9 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     return icon;
   }
 
-  if (kind == GWSidebarItemPath && path != nil) {
+  /* a path the model found missing, or hanging, is not looked at again
+     here: it gets the generic folder icon */
+  if (kind == GWSidebarItemPath && path != nil && reachable) {
     FSNode *node = [FSNode nodeWithPath: path];
     if (node && [node isValid]) {
       NSImage *ic = [[FSNodeRep sharedInstance] iconOfSize: ICON_SIZE
@@ -641,6 +784,9 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
         return icon;
       }
     }
+  }
+
+  if (kind == GWSidebarItemPath) {
     /* Fallback to a generic folder icon */
     NSImage *fallback = [NSImage imageNamed: @"Folder"];
     if (fallback) {
@@ -677,10 +823,12 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 - (void)dealloc
 {
   /* Volume mount roots are watched by GWDesktopManager's MPointWatcher
-     for the desktop's lifetime; the sidebar just listens to the
-     broadcast GWFileWatcherFileDidChangeNotification, so there is
-     nothing to unregister with fswatcher here. */
+     for the desktop's lifetime; the sidebar just takes the
+     events under them from GWWatchDispatcher, so there is nothing to
+     unregister with fswatcher here. */
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: self];
   [[NSNotificationCenter defaultCenter] removeObserver: self];
+  [busyTimer invalidate];
   if (outlineView) {
     [outlineView setDataSource: nil];
     [outlineView setDelegate: nil];
@@ -702,7 +850,16 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     rootItems = [[NSMutableArray alloc] init];
     collapsedGroupTitles = [[NSMutableSet alloc] init];
 
-    [self buildModel];
+    /* what the last sidebar showed, until the model is built again */
+    if (cachedModel != nil) {
+      NSUInteger i;
+
+      for (i = 0; i < [cachedModel count]; i++) {
+        GWSidebarItem *item = [[cachedModel objectAtIndex: i] copy];
+        [rootItems addObject: item];
+        RELEASE (item);
+      }
+    }
 
     scrollView = [[NSScrollView alloc] initWithFrame: [self bounds]];
     [scrollView setHasVerticalScroller: NO];
@@ -752,14 +909,19 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     [self applySidebarWidthIfNeeded];
 
     /* Volume mount roots are already watched by GWDesktopManager's
-       MPointWatcher; just subscribe to the broadcast notification so
-       the Volumes section refreshes on real mount/unmount events. */
+       MPointWatcher; just take the events under them so the Volumes
+       section refreshes on real mount/unmount events. */
     {
-      [[NSNotificationCenter defaultCenter]
-          addObserver: self
-             selector: @selector(volumesWatcherNotification:)
-                 name: @"GWFileWatcherFileDidChangeNotification"
-               object: nil];
+      NSArray *roots = [Workspace volumeMountRoots];
+      NSUInteger i;
+
+      for (i = 0; i < [roots count]; i++) {
+        [[GWWatchDispatcher sharedDispatcher]
+            addObserver: self
+               selector: @selector(volumesWatcherEvent:)
+                forPath: [roots objectAtIndex: i]
+                  scope: GWWatchSubtree];
+      }
       [[NSNotificationCenter defaultCenter]
           addObserver: self
              selector: @selector(rebuildVolumesSection)
@@ -780,14 +942,32 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
              selector: @selector(networkServicesDidChange:)
                  name: NetworkServicesDidChangeNotification
                object: nil];
+      [[NSNotificationCenter defaultCenter]
+          addObserver: self
+             selector: @selector(mountStateDidChange:)
+                 name: NetworkVolumeMountDidStartNotification
+               object: nil];
+      [[NSNotificationCenter defaultCenter]
+          addObserver: self
+             selector: @selector(mountStateDidChange:)
+                 name: NetworkVolumeMountDidEndNotification
+               object: nil];
     }
+
+    [self scheduleModelBuild];
   }
 
   return self;
 }
 
-- (void)buildModel
+/* The sidebar model, built on modelQueue: every lookup that can wait on
+   a disk, a mount or the network is done here.  `mountPoints` and
+   `networkMountPaths` are NetworkVolumeManager's, taken on the main
+   thread. */
++ (NSArray *)modelWithMountPoints:(NSDictionary *)mountPoints
+                networkMountPaths:(NSSet *)networkMountPaths
 {
+  NSMutableArray *model = [NSMutableArray array];
   GWSidebarItem *userDomain;
   GWSidebarItem *domain;
   GWSidebarItem *volumesGroup;
@@ -796,8 +976,6 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   NSArray *favs;
   NSUInteger i;
 
-  [rootItems removeAllObjects];
-
   fm = [NSFileManager defaultManager];
   home = NSHomeDirectory();
 
@@ -855,7 +1033,7 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
     }
   }
 
-  [rootItems addObject: userDomain];
+  [model addObject: userDomain];
   RELEASE (userDomain);
 
   domain = [[GWSidebarItem alloc] initHeaderWithTitle:
@@ -891,15 +1069,13 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 
   /* Only add the Domains section if at least one domain directory exists */
   if ([[domain children] count] > 0) {
-    [rootItems addObject: domain];
+    [model addObject: domain];
   }
   RELEASE (domain);
 
   volumesGroup = [[GWSidebarItem alloc] initHeaderWithTitle:
                     NSLocalizedString(@"Volumes", @"")];
   {
-    NetworkVolumeManager *nvm = [NetworkVolumeManager sharedManager];
-    NSSet *networkMountPaths = [nvm allMountedPaths];
     NSArray *roots = [Workspace volumeMountRoots];
     NSMutableSet *seen = [NSMutableSet set];
     NSMutableArray *vols = [NSMutableArray array];
@@ -944,11 +1120,17 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
       GWSidebarItem *it = [[GWSidebarItem alloc]
           initPathItemWithTitle: [vol objectForKey: @"name"]
                            path: [vol objectForKey: @"path"]];
+      struct stat volSt;
+
+      /* into the volume: one that does not answer keeps its row, with
+         a generic icon */
+      [it setReachable: (stat([[vol objectForKey: @"path"] fileSystemRepresentation],
+                              &volSt) == 0)];
       [volumesGroup addChild: it];
       RELEASE (it);
     }
   }
-  [rootItems addObject: volumesGroup];
+  [model addObject: volumesGroup];
   RELEASE (volumesGroup);
 
   /* Network section: discovered services from mDNS */
@@ -958,10 +1140,11 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 
     /* Collect services from mDNS discovery.  Browsing is started
        automatically in the background by NetworkServiceManager
-       (on its own thread with its own run loop) — the sidebar
-       never blocks on network I/O.  As services are discovered
-       or removed, NetworkServicesDidChangeNotification triggers
-       a rebuild, so results appear incrementally.
+       (on its own thread with its own run loop), and the model is
+       built on modelQueue, so the sidebar never blocks on network
+       I/O.  As services are discovered or removed,
+       NetworkServicesDidChangeNotification triggers a rebuild, so
+       results appear incrementally.
 
        Wrap in @try/@catch to guard against any unexpected
        exceptions from NSNetServiceBrowser when the mDNS daemon
@@ -985,6 +1168,8 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
             [allServices addObject: svc];
           }
         }
+        /* They are shown now: resolve what has no fresh record */
+        [mgr resolveServices: allServices];
       }
 
       /* Deduplicate display names */
@@ -1007,15 +1192,18 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
         GWSidebarItem *it = [[GWSidebarItem alloc]
             initNetworkItemWithTitle: uniqueName];
         [it setUserInfo: svc];
+        [it setMounted: GWSidebarServiceIsMounted(svc, mountPoints)];
         [networkGroup addChild: it];
         RELEASE (it);
       }
     } @catch (NSException *exception) {
       NSWarnMLog(@"GWViewerSidebar: Failed to build network section: %@", exception);
     }
-    [rootItems addObject: networkGroup];
+    [model addObject: networkGroup];
     RELEASE (networkGroup);
   }
+
+  return model;
 }
 
 - (void)reloadData
@@ -1023,25 +1211,15 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   [outlineView reloadData];
 }
 
-- (void)volumesWatcherNotification:(NSNotification *)notif
+- (void)volumesWatcherEvent:(NSDictionary *)info
 {
-  NSDictionary *info = (NSDictionary *)[notif object];
-  NSString *path = [info objectForKey: @"path"];
-  if (path == nil) return;
-
   /* Rebuild the Volumes section whenever something changes inside
      any mount root directory (e.g. /media, /Volumes).  The file
      watcher reports the exact path that changed (e.g.
      /media/devuan/Asterisk), which is a *child* of the mount root,
-     not the root itself.  We therefore check if the changed path
-     has any mount root as a prefix. */
-  NSArray *roots = [Workspace volumeMountRoots];
-  for (NSString *root in roots) {
-    NSString *rootSlash = [root stringByAppendingString: @"/"];
-    if ([path isEqualToString: root] || [path hasPrefix: rootSlash]) {
-      [self rebuildModelPreservingExpansion];
-      return;
-    }
+     not the root itself: the registrations cover the whole subtree. */
+  if ([info objectForKey: @"path"] != nil) {
+    [self rebuildModelPreservingExpansion];
   }
 }
 
@@ -1057,10 +1235,113 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 
 - (void)rebuildModelPreservingExpansion
 {
-  [self buildModel];
-  [outlineView reloadData];
-  [self expandGroupsRespectingCollapsedSet];
-  [self applySidebarWidthIfNeeded];
+  [self scheduleModelBuild];
+}
+
+/* Builds the model on modelQueue; the events that come in while a build
+   runs are answered by one more build after it. */
+- (void)scheduleModelBuild
+{
+  NetworkVolumeManager *nvm;
+  NSDictionary *mountPoints;
+  NSSet *networkMountPaths;
+
+  if (modelBuildInFlight) {
+    modelBuildAgain = YES;
+    return;
+  }
+
+  if (modelQueue == NULL) {
+    modelQueue = dispatch_queue_create("Workspace.sidebarModel",
+                                       DISPATCH_QUEUE_SERIAL);
+  }
+
+  /* NetworkVolumeManager is kept on the main thread */
+  nvm = [NetworkVolumeManager sharedManager];
+  mountPoints = RETAIN ([nvm mountPointsByServiceIdentifier]);
+  networkMountPaths = RETAIN ([nvm allMountedPaths]);
+  modelBuildInFlight = YES;
+  modelBuildAgain = NO;
+
+  /* the blocks keep the sidebar until the model is in */
+  dispatch_async(modelQueue, ^{
+    CREATE_AUTORELEASE_POOL(arp);
+    NSArray *model = [GWViewerSidebar modelWithMountPoints: mountPoints
+                                         networkMountPaths: networkMountPaths];
+
+    RETAIN (model);
+    RELEASE (mountPoints);
+    RELEASE (networkMountPaths);
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self modelDidBuild: model];
+      RELEASE (model);
+    });
+    RELEASE (arp);
+  });
+}
+
+/* Takes a new model: the rows that are still there are updated in
+   place, a group whose rows changed is reloaded, and the whole outline
+   only when the groups did. */
+- (void)modelDidBuild:(NSArray *)model
+{
+  BOOL sameGroups = ([model count] == [rootItems count]);
+  BOOL changed = NO;
+  NSMutableArray *cache;
+  NSUInteger i, j;
+
+  for (i = 0; i < [model count] && sameGroups; i++) {
+    sameGroups = [[[model objectAtIndex: i] identity]
+                   isEqual: [[rootItems objectAtIndex: i] identity]];
+  }
+
+  if (sameGroups == NO) {
+    [rootItems setArray: model];
+    [outlineView reloadData];
+    changed = YES;
+  } else {
+    for (i = 0; i < [model count]; i++) {
+      GWSidebarItem *group = [rootItems objectAtIndex: i];
+      GWSidebarItem *newGroup = [model objectAtIndex: i];
+      NSArray *rows = [group children];
+
+      if ([group hasSameChildrenAs: newGroup] == NO) {
+        [group setChildren: [newGroup children]];
+        [outlineView reloadItem: group reloadChildren: YES];
+        changed = YES;
+        continue;
+      }
+
+      for (j = 0; j < [rows count]; j++) {
+        GWSidebarItem *row = [rows objectAtIndex: j];
+
+        if ([row takeStateFrom: [[newGroup children] objectAtIndex: j]]) {
+          [outlineView reloadItem: row];
+          changed = YES;
+        }
+      }
+    }
+  }
+
+  if (changed) {
+    [self expandGroupsRespectingCollapsedSet];
+    [self applySidebarWidthIfNeeded];
+    [outlineView setNeedsDisplay: YES];
+  }
+
+  cache = [NSMutableArray arrayWithCapacity: [rootItems count]];
+  for (i = 0; i < [rootItems count]; i++) {
+    GWSidebarItem *item = [[rootItems objectAtIndex: i] copy];
+    [cache addObject: item];
+    RELEASE (item);
+  }
+  ASSIGN (cachedModel, cache);
+
+  modelBuildInFlight = NO;
+  if (modelBuildAgain) {
+    [self scheduleModelBuild];
+  }
 }
 
 - (void)expandGroupsRespectingCollapsedSet
@@ -1149,6 +1430,58 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
   return [NSNumber numberWithBool: v];
 }
 
+- (NSNumber *)itemAtRowIsMounting:(NSNumber *)rowNum
+{
+  NSInteger row = [rowNum integerValue];
+  if (row < 0 || busyTimer == nil) return [NSNumber numberWithBool: NO];
+  id item = [outlineView itemAtRow: row];
+  return [NSNumber numberWithBool: (item
+                                    && [item respondsToSelector: @selector(isMountingNetworkService)]
+                                    && [item isMountingNetworkService])];
+}
+
+- (NSNumber *)busyPhase
+{
+  return [NSNumber numberWithUnsignedInteger: busyPhase];
+}
+
+- (void)busyTimerFired:(NSTimer *)timer
+{
+  busyPhase = (busyPhase + 1) % BUSY_SPOKES;
+  [outlineView setNeedsDisplay: YES];
+}
+
+/* The spinner turns while any network item of this sidebar is mounting */
+- (void)mountStateDidChange:(NSNotification *)notif
+{
+  NSInteger rows = [outlineView numberOfRows];
+  BOOL mounting = NO;
+  NSInteger i;
+
+  for (i = 0; i < rows && mounting == NO; i++) {
+    id item = [outlineView itemAtRow: i];
+    mounting = ([item respondsToSelector: @selector(isMountingNetworkService)]
+                && [item isMountingNetworkService]);
+  }
+
+  if (mounting && busyTimer == nil) {
+    busyTimer = [NSTimer scheduledTimerWithTimeInterval: BUSY_INTERVAL
+                                                 target: self
+                                               selector: @selector(busyTimerFired:)
+                                               userInfo: nil
+                                                repeats: YES];
+  } else if (mounting == NO && busyTimer != nil) {
+    [busyTimer invalidate];
+    busyTimer = nil;
+  }
+
+  if ([[notif name] isEqual: NetworkVolumeMountDidEndNotification]) {
+    [self scheduleModelBuild];
+  }
+
+  [outlineView setNeedsDisplay: YES];
+}
+
 - (void)ejectVolumeAtRow:(NSNumber *)rowNum
 {
   NSInteger row = [rowNum integerValue];
@@ -1265,7 +1598,23 @@ static BOOL GWSidebarPathIsUnderVolumeRoot(NSString *path)
 
   if ([item itemKind] == GWSidebarItemNetwork) {
     id svc = [item userInfo];
-    if (svc && [svc isKindOfClass: [NetworkServiceItem class]]) {
+    if (svc && [svc isKindOfClass: [NetworkServiceItem class]]
+        && [svc isSFTPService]) {
+      /* Connecting takes seconds: the row spins meanwhile, and the viewer
+         goes to the volume once it is there. */
+      [[NetworkVolumeManager sharedManager]
+          mountSFTPServiceInBackground: svc
+                            completion: ^(NSString *mountPoint) {
+          FSNode *mounted = mountPoint ? [FSNode nodeWithPath: mountPoint] : nil;
+
+          if (mounted && [mounted isValid]) {
+            [self performSelector: @selector(performOpenNodeInPlace:)
+                       withObject: mounted
+                       afterDelay: 0.05];
+          }
+        }];
+      return;
+    } else if (svc && [svc isKindOfClass: [NetworkServiceItem class]]) {
       NetworkFSNode *netNode = [NetworkFSNode nodeWithServiceItem: svc];
       NSString *mountPoint = [netNode openNetworkService];
       if (mountPoint) {
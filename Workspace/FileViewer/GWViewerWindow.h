@@ -52,6 +52,7 @@
 - (void)chooseLabelColor:(id)sender;
 - (void)chooseBackColor:(id)sender;
 - (void)selectAllInViewer:(id)sender;
+- (void)refreshViewer:(id)sender;
 - (void)showTerminal:(id)sender;
 - (void)openParentFolder:(id)sender;
 - (void)openParentFolder;
@@ -88,6 +89,7 @@
 - (void)chooseLabelColor:(id)sender;
 - (void)chooseBackColor:(id)sender;
 - (void)selectAllInViewer;
+- (void)refreshViewer;
 - (void)showTerminal;
 - (void)toggleHiddenFiles;
 - (void)quickLook:(id)sender;
@@ -158,6 +158,11 @@
   [[self delegate] selectAllInViewer];
 }
 
+- (void)refreshViewer:(id)sender
+{
+  [[self delegate] refreshViewer];
+}
+
 - (void)showTerminal:(id)sender
 {
   [[self delegate] showTerminal];
@@ -36,6 +36,12 @@
 @interface GWViewersManager : NSObject
 {
   NSMutableArray *viewers;
+  /* path -> viewers, in opening order; and, keyed by the non retained
+     viewer, the paths it is indexed under */
+  NSMutableDictionary *viewersByBasePath;
+  NSMutableDictionary *viewersByShownPath;
+  NSMutableDictionary *basePathOfViewer;
+  NSMutableDictionary *shownPathsOfViewer;
   NSMutableArray *rootViewersKeys;
   BOOL orderingViewers;
   Workspace *gworkspace;
@@ -47,10 +53,15 @@
   NSAttributedString *bviewerHelp;
   NSAttributedString *sviewerHelp;
   NSNotificationCenter *nc;
+  NSMutableArray *spareWindows;
 }
 
 + (GWViewersManager *)viewersManager;
 
+/* Makes the hidden windows the next viewers are opened in, one at a
+   time until there are a couple of them. */
+- (void)fillSpareWindows;
+
 
 - (void)showViewers;
 
@@ -112,6 +123,12 @@
 
 - (void)viewerWillClose:(id)aviewer;
 
+/* sent by a viewer when its watched nodes, the paths from its base node
+   to the node shown, or its base node change, for the lookups by path */
+- (void)viewerDidChangeWatchedNodes:(id)aviewer;
+
+- (void)viewerDidChangeBaseNode:(id)aviewer;
+
 - (void)closeInvalidViewers:(NSArray *)vwrs;
 
 - (void)selectedSpatialViewerChanged:(id)aviewer;
@@ -143,7 +160,14 @@
 
 - (void)fileSystemDidChange:(NSNotification *)notif;
 
-- (void)watcherNotification:(NSNotification *)notif;
+/* the fswatcher events at the nodes the viewer watches, sent by the
+   viewer as GWWatchDispatcher delivers them */
+- (void)viewer:(id)viewer
+    watchedNodeChanged:(NSDictionary *)info;
+
+/* fswatcher could not keep up with what happened under path: reload
+   every viewer showing something there. */
+- (void)rescanSubtreeAtPath:(NSString *)path;
 
 - (void)thumbnailsDidChangeInPaths:(NSArray *)paths;
 
@@ -158,6 +182,10 @@
 
 - (NSArray *)viewerWindows;
 
+/* For the diagnostics: viewers, reps (shown in all of them), maxReps
+   (in the fullest) and watchedNodes. */
+- (NSDictionary *)viewersStatistics;
+
 - (BOOL)orderingViewers;
 
 - (void)updateDesktop;
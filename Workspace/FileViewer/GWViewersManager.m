@@ -33,16 +33,33 @@
 #import "GWViewer.h"
 #import "GWSpatialViewer.h"
 #import "GWViewerWindow.h"
+#import "GWSpatialPreload.h"
 #import "GWViewerPrefs.h"
+#import "GWWatchDispatcher.h"
 #import "History.h"
 #import "FSNFunctions.h"
 #import "Workspace.h"
 #import "GWDesktopManager.h"
 #import "NetworkVolumeManager.h"
 
+/* hidden windows kept made for the next viewers, and how long after a
+   viewer opens they are made again */
+#define SPARE_VIEWER_WINDOWS 2
+#define SPARE_WINDOWS_DELAY 0.5
 
 static GWViewersManager *vwrsmanager = nil;
 
+@interface GWViewersManager (PathIndex)
+- (void)addViewer:(id)viewer toIndex:(NSMutableDictionary *)index forPath:(NSString *)path;
+- (void)removeViewer:(id)viewer fromIndex:(NSMutableDictionary *)index forPath:(NSString *)path;
+- (void)indexViewer:(id)viewer;
+- (void)unindexViewer:(id)viewer;
+@end
+
+@interface GWViewersManager (SpareWindows)
+- (GWViewerWindow *)newViewerWindow;
+@end
+
 @implementation GWViewersManager
 {
   NSRect pendingOpenAnimationRect;
@@ -63,7 +80,12 @@ static GWViewersManager *vwrsmanager = nil;
   [[NSDistributedNotificationCenter defaultCenter] removeObserver: self];
   [nc removeObserver: self];
   RELEASE (viewers);
+  RELEASE (viewersByBasePath);
+  RELEASE (viewersByShownPath);
+  RELEASE (basePathOfViewer);
+  RELEASE (shownPathsOfViewer);
   RELEASE (bviewerHelp);
+  RELEASE (spareWindows);
     
   [super dealloc];
 }
@@ -82,6 +104,11 @@ static GWViewersManager *vwrsmanager = nil;
       ASSIGN (bviewerHelp, [gworkspace contextHelpFromName: @"BViewer.rtfd"]);
       
       viewers = [NSMutableArray new];
+      viewersByBasePath = [NSMutableDictionary new];
+      viewersByShownPath = [NSMutableDictionary new];
+      basePathOfViewer = [NSMutableDictionary new];
+      shownPathsOfViewer = [NSMutableDictionary new];
+      spareWindows = [NSMutableArray new];
       orderingViewers = NO;
       
       historyWindow = [gworkspace historyWindow]; 
@@ -97,11 +124,6 @@ static GWViewersManager *vwrsmanager = nil;
                  name: @"GWFileSystemDidChangeNotification"
                object: nil];
       
-      [nc addObserver: self 
-             selector: @selector(watcherNotification:) 
-                 name: @"GWFileWatcherFileDidChangeNotification"
-               object: nil];    
-      
       [[NSDistributedNotificationCenter defaultCenter] addObserver: self 
                                                           selector: @selector(sortTypeDidChange:) 
                                                               name: @"GWSortTypeDidChangeNotification"
@@ -259,17 +281,23 @@ static GWViewersManager *vwrsmanager = nil;
                  withKey:(NSString *)key
           inheritedFrame:(NSRect)inheritedFrame
 {
-  GWViewerWindow *win = [GWViewerWindow new];
+  GWSpatialPreload *preload = nil;
+  GWViewerWindow *win;
   id viewer;
 
-  [win setReleasedWhenClosed: NO];
+  /* the settings and the listing are read while the window is made */
+  if ((vtype == SPATIAL) && ([node isKindOfClass: NSClassFromString(@"NetworkFSNode")] == NO))
+    preload = [GWSpatialPreload preloadForPath: [node path]];
+
+  win = [self newViewerWindow];
 
   if (vtype == SPATIAL)
     {
       viewer = [[GWSpatialViewer alloc] initForNode: node
                                            inWindow: win
                                            showType: sstype
-                                      showSelection: showsel];
+                                      showSelection: showsel
+                                            preload: preload];
     }
   else
     {
@@ -313,6 +341,7 @@ static GWViewersManager *vwrsmanager = nil;
     }
 
   [viewers addObject: viewer];
+  [self indexViewer: viewer];
   [win release];
   [viewer release];
 
@@ -326,6 +355,53 @@ static GWViewersManager *vwrsmanager = nil;
   return viewer;
 }
 
+/* A spare window when there is one, a new one otherwise; either way
+   the spares are made again once the viewer is up. */
+- (GWViewerWindow *)newViewerWindow
+{
+  GWViewerWindow *win;
+
+  if ([spareWindows count])
+    {
+      win = RETAIN ([spareWindows lastObject]);
+      [spareWindows removeLastObject];
+    }
+  else
+    {
+      win = [GWViewerWindow new];
+      [win setReleasedWhenClosed: NO];
+    }
+
+  [NSObject cancelPreviousPerformRequestsWithTarget: self
+                                           selector: @selector(fillSpareWindows)
+                                             object: nil];
+  [self performSelector: @selector(fillSpareWindows)
+             withObject: nil
+             afterDelay: SPARE_WINDOWS_DELAY];
+
+  return win;
+}
+
+- (void)fillSpareWindows
+{
+  GWViewerWindow *win;
+
+  if ([spareWindows count] >= SPARE_VIEWER_WINDOWS)
+    return;
+
+  /* a window made with defer: NO has its window server side already,
+     which is most of what opening a viewer used to wait for */
+  win = [GWViewerWindow new];
+  [win setReleasedWhenClosed: NO];
+  [spareWindows addObject: win];
+  RELEASE (win);
+
+  if ([spareWindows count] < SPARE_VIEWER_WINDOWS)
+    [self performSelector: @selector(fillSpareWindows)
+               withObject: nil
+               afterDelay: SPARE_WINDOWS_DELAY];
+}
+
 - (id)viewerForNode:(FSNode *)node
           showType:(GWViewType)stype
      showSelection:(BOOL)showsel
@@ -363,44 +439,26 @@ static GWViewersManager *vwrsmanager = nil;
 
 - (NSArray *)viewersForBaseNode:(FSNode *)node
 {
-  NSMutableArray *vwrs = [NSMutableArray array];
-  NSUInteger i;
-  
-  for (i = 0; i < [viewers count]; i++) {
-    id viewer = [viewers objectAtIndex: i];
-    
-    if ([[viewer baseNode] isEqual: node]) {
-      [vwrs addObject: viewer];
-    }
-  }
-  
-  return vwrs;
+  NSArray *vwrs = [viewersByBasePath objectForKey: [node path]];
+
+  return vwrs ? [NSArray arrayWithArray: vwrs] : [NSArray array];
 }
 
 - (id)viewerWithBaseNode:(FSNode *)node
 {
-  NSUInteger i;
+  NSArray *vwrs = [viewersByBasePath objectForKey: [node path]];
 
-  for (i = 0; i < [viewers count]; i++)
-    {
-      id viewer = [viewers objectAtIndex: i];
-
-      if ([[viewer baseNode] isEqual: node])
-        {
-          return viewer;
-        }
-    }
-
-  return nil;
+  return [vwrs count] ? [vwrs objectAtIndex: 0] : nil;
 }
 
 - (id)viewerShowingNode:(FSNode *)node
 {
+  NSArray *vwrs = [viewersByShownPath objectForKey: [node path]];
   NSUInteger i;
   
-  for (i = 0; i < [viewers count]; i++)
+  for (i = 0; i < [vwrs count]; i++)
     {
-      id viewer = [viewers objectAtIndex: i];
+      id viewer = [vwrs objectAtIndex: i];
 
       if ([viewer isShowingNode: node])
         {
@@ -438,16 +496,16 @@ static GWViewersManager *vwrsmanager = nil;
   
   if ([node isValid] == NO)
     {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];  
+      FSNodeRep *fsnodeRep = [FSNodeRep sharedInstance];
       NSString *prefsname;
       NSDictionary *vwrprefs;
 
       prefsname = [aviewer defaultsKey];
 
-      vwrprefs = [defaults dictionaryForKey: prefsname];
+      vwrprefs = [fsnodeRep viewerPrefsForKey: prefsname];
       if (vwrprefs)
         {
-          [defaults removeObjectForKey: prefsname];
+          [fsnodeRep setViewerPrefs: nil forKey: prefsname];
         } 
     
       [NSWindow removeFrameUsingName: prefsname]; 
@@ -455,19 +513,65 @@ static GWViewersManager *vwrsmanager = nil;
   
   for (i = 0; i < [watchedNodes count]; i++)
     [gworkspace removeWatcherForPath: [[watchedNodes objectAtIndex: i] path]];
+  [[GWWatchDispatcher sharedDispatcher] removeObserver: aviewer];
 
   if (aviewer == [historyWindow viewer])
     [self changeHistoryOwner: nil];
 
   [helpManager removeContextHelpForObject: [[aviewer win] contentView]];
   if ([viewers containsObject: aviewer]) {
+    [self unindexViewer: aviewer];
     [viewers removeObject: aviewer];
   }
 }
 
+- (void)viewerDidChangeWatchedNodes:(id)aviewer
+{
+  NSValue *key = [NSValue valueWithNonretainedObject: aviewer];
+  NSArray *oldPaths = [shownPathsOfViewer objectForKey: key];
+  NSArray *watchedNodes = [aviewer watchedNodes];
+  NSMutableArray *paths;
+  NSUInteger i;
+
+  /* not opened yet, or closing */
+  if ([basePathOfViewer objectForKey: key] == nil)
+    return;
+
+  for (i = 0; i < [oldPaths count]; i++)
+    [self removeViewer: aviewer
+             fromIndex: viewersByShownPath
+               forPath: [oldPaths objectAtIndex: i]];
+
+  paths = [NSMutableArray arrayWithCapacity: [watchedNodes count]];
+
+  for (i = 0; i < [watchedNodes count]; i++)
+    {
+      NSString *path = [[watchedNodes objectAtIndex: i] path];
+
+      [self addViewer: aviewer toIndex: viewersByShownPath forPath: path];
+      [paths addObject: path];
+    }
+
+  [shownPathsOfViewer setObject: paths forKey: key];
+}
+
+- (void)viewerDidChangeBaseNode:(id)aviewer
+{
+  NSValue *key = [NSValue valueWithNonretainedObject: aviewer];
+  NSString *oldPath = [basePathOfViewer objectForKey: key];
+  NSString *path = [[aviewer baseNode] path];
+
+  if ((oldPath == nil) || (path == nil))
+    return;
+
+  [self removeViewer: aviewer fromIndex: viewersByBasePath forPath: oldPath];
+  [self addViewer: aviewer toIndex: viewersByBasePath forPath: path];
+  [basePathOfViewer setObject: path forKey: key];
+}
+
 - (void)closeInvalidViewers:(NSArray *)vwrs
 {
-  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  FSNodeRep *fsnodeRep = [FSNodeRep sharedInstance];
   NSUInteger i, j;
 
   for (i = 0; i < [vwrs count]; i++)
@@ -483,14 +587,15 @@ static GWViewersManager *vwrsmanager = nil;
 
       for (k = 0; k < 2; k++)
         {
-          if ([defaults dictionaryForKey: keys[k]])
-            [defaults removeObjectForKey: keys[k]];
+          if ([fsnodeRep viewerPrefsForKey: keys[k]])
+            [fsnodeRep setViewerPrefs: nil forKey: keys[k]];
 
           [NSWindow removeFrameUsingName: keys[k]];
         }
     
       for (j = 0; j < [watchedNodes count]; j++)
         [gworkspace removeWatcherForPath: [[watchedNodes objectAtIndex: j] path]];
+      [[GWWatchDispatcher sharedDispatcher] removeObserver: viewer];
     }
       
   for (i = 0; i < [vwrs count]; i++)
@@ -509,6 +614,7 @@ static GWViewersManager *vwrsmanager = nil;
   for (i = 0; i < [vwrs count]; i++)
     {
       id viewer = [vwrs objectAtIndex: i];
+      [self unindexViewer: viewer];
       [viewers removeObject: viewer];
     }
 }
@@ -821,41 +927,59 @@ static GWViewersManager *vwrsmanager = nil;
   [self closeInvalidViewers: viewersToClose]; 
 }
 
-- (void)watcherNotification:(NSNotification *)notif
+- (void)viewer:(id)viewer
+    watchedNodeChanged:(NSDictionary *)info
 {
-  NSDictionary *info = (NSDictionary *)[notif object];
   NSString *event = [info objectForKey: @"event"];
   NSString *path = [info objectForKey: @"path"];
+  NSArray *watchedNodes = [viewer watchedNodes];
+  NSUInteger i;
+
+  if ([viewer invalidated]) {
+    return;
+  }
+
+  if ([event isEqual: @"GWWatchedPathDeleted"]) {  
+    FSNode *node = [viewer baseNode];
+
+    if (([[node path] isEqual: path]) || [node isSubnodeOfPath: path]) { 
+      [viewer invalidate];
+      [self closeInvalidViewers: [NSArray arrayWithObject: viewer]]; 
+      return;
+    }
+  }
+
+  /* the deletion of a directory above comes as well */
+  for (i = 0; i < [watchedNodes count]; i++) {
+    if ([[[watchedNodes objectAtIndex: i] path] isEqual: path]) {
+      [viewer watchedPathChanged: info];
+      break;
+    }
+  }
+}
+
+- (void)rescanSubtreeAtPath:(NSString *)path
+{
   NSMutableArray *viewersToClose = [NSMutableArray array];
-  int i, j;
+  NSUInteger i;
 
   for (i = 0; i < [viewers count]; i++) {
     id viewer = [viewers objectAtIndex: i];
     FSNode *node = [viewer baseNode];
-    NSArray *watchedNodes = [viewer watchedNodes];
-    
-    if ([event isEqual: @"GWWatchedPathDeleted"]) {  
-      if (([[node path] isEqual: path]) || [node isSubnodeOfPath: path]) { 
-        if ([viewer invalidated] == NO) {
-          [viewer invalidate];
-          [viewersToClose addObject: viewer];
-        }
-      }
-    }
-    
-    for (j = 0; j < [watchedNodes count]; j++) {
-      if ([[[watchedNodes objectAtIndex: j] path] isEqual: path]) {
-        [viewer watchedPathChanged: info];
-        break;
-      }
+
+    if ([viewer invalidated]) {
+      continue;
     }
-    
-    if ([viewer invalidated] == NO) {
-      id shelf = [viewer shelf];
-      
-      if (shelf) {
-        [shelf watchedPathChanged: info];
+
+    if ([[node path] isEqual: path] || [node isSubnodeOfPath: path]) {
+      if ([[NSFileManager defaultManager] fileExistsAtPath: [node path]] == NO) {
+        [viewer invalidate];
+        [viewersToClose addObject: viewer];
+      } else {
+        [viewer reloadFromNode: node];
       }
+    } else if ([viewer isShowingPath: path]) {
+      [viewer reloadFromNode: [FSNode nodeWithPath: path]];
     }
   }
 
@@ -991,6 +1115,30 @@ static GWViewersManager *vwrsmanager = nil;
   return wins;
 }
 
+- (NSDictionary *)viewersStatistics
+{
+  NSUInteger reps = 0;
+  NSUInteger maxReps = 0;
+  NSUInteger watched = 0;
+  NSUInteger i;
+
+  for (i = 0; i < [viewers count]; i++) {
+    id viewer = [viewers objectAtIndex: i];
+    NSUInteger count = [[[viewer nodeView] reps] count];
+
+    reps += count;
+    maxReps = MAX(maxReps, count);
+    watched += [[viewer watchedNodes] count];
+  }
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedInteger: [viewers count]], @"viewers",
+    [NSNumber numberWithUnsignedInteger: reps], @"reps",
+    [NSNumber numberWithUnsignedInteger: maxReps], @"maxReps",
+    [NSNumber numberWithUnsignedInteger: watched], @"watchedNodes",
+    nil];
+}
+
 - (BOOL)orderingViewers
 {
   return orderingViewers;
@@ -1386,6 +1534,7 @@ static GWViewersManager *vwrsmanager = nil;
     NSWindow *ow;
 
     RETAIN (oldvwr);
+    [self unindexViewer: oldvwr];
     [viewers removeObject: oldvwr];
 
     ow = [oldvwr win];
@@ -1470,15 +1619,15 @@ static GWViewersManager *vwrsmanager = nil;
   /* Return an existing viewer for this node *of the requested kind* — a
    * browser window must not satisfy a request for a spatial one (or vice
    * versa), or a mode switch / WM navigation would activate the wrong kind. */
+  NSArray *vwrs = [viewersByBasePath objectForKey: [node path]];
   NSUInteger i;
   BOOL wantSpatial = (type == SPATIAL);
 
-  for (i = 0; i < [viewers count]; i++)
+  for (i = 0; i < [vwrs count]; i++)
     {
-      id viewer = [viewers objectAtIndex: i];
+      id viewer = [vwrs objectAtIndex: i];
 
-      if ([[viewer baseNode] isEqual: node]
-          && ([viewer isSpatial] == wantSpatial))
+      if ([viewer isSpatial] == wantSpatial)
         return viewer;
     }
 
@@ -1870,3 +2019,74 @@ if (*pos >= i) *pos -= n; \
 }
 
 @end
+
+
+@implementation GWViewersManager (PathIndex)
+
+- (void)addViewer:(id)viewer
+          toIndex:(NSMutableDictionary *)index
+          forPath:(NSString *)path
+{
+  NSMutableArray *vwrs = [index objectForKey: path];
+
+  if (vwrs == nil)
+    {
+      vwrs = [NSMutableArray new];
+      [index setObject: vwrs forKey: path];
+      RELEASE (vwrs);
+    }
+
+  [vwrs addObject: viewer];
+}
+
+- (void)removeViewer:(id)viewer
+           fromIndex:(NSMutableDictionary *)index
+             forPath:(NSString *)path
+{
+  NSMutableArray *vwrs = [index objectForKey: path];
+  NSUInteger pos = [vwrs indexOfObjectIdenticalTo: viewer];
+
+  if (pos != NSNotFound)
+    {
+      [vwrs removeObjectAtIndex: pos];
+
+      if ([vwrs count] == 0)
+        [index removeObjectForKey: path];
+    }
+}
+
+- (void)indexViewer:(id)viewer
+{
+  NSValue *key = [NSValue valueWithNonretainedObject: viewer];
+  NSString *path = [[viewer baseNode] path];
+
+  if ((path == nil) || [basePathOfViewer objectForKey: key])
+    return;
+
+  [self addViewer: viewer toIndex: viewersByBasePath forPath: path];
+  [basePathOfViewer setObject: path forKey: key];
+  [self viewerDidChangeWatchedNodes: viewer];
+}
+
+- (void)unindexViewer:(id)viewer
+{
+  NSValue *key = [NSValue valueWithNonretainedObject: viewer];
+  NSString *path = [basePathOfViewer objectForKey: key];
+  NSArray *paths = [shownPathsOfViewer objectForKey: key];
+  NSUInteger i;
+
+  if (path == nil)
+    return;
+
+  [self removeViewer: viewer fromIndex: viewersByBasePath forPath: path];
+
+  for (i = 0; i < [paths count]; i++)
+    [self removeViewer: viewer
+             fromIndex: viewersByShownPath
+               forPath: [paths objectAtIndex: i]];
+
+  [basePathOfViewer removeObjectForKey: key];
+  [shownPathsOfViewer removeObjectForKey: key];
+}
+
+@end
@@ -108,22 +108,18 @@
   /* --- Window geometry (bwsp) --- */
   DSStoreEntry *bwsp = [store entryForFilename:key code:@"bwsp"];
   if (bwsp && [[bwsp type] isEqualToString:@"blob"]) {
-    NSData *data = (NSData *)[bwsp value];
-    NSError *err = nil;
-    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data
-                                                                    options:NSPropertyListImmutable
-                                                                     format:NULL
-                                                                      error:&err];
-    if (plist && [plist isKindOfClass:[NSDictionary class]]) {
-      NSString *bounds = [plist objectForKey:@"WindowBounds"];
-      if (bounds) {
+    /* Only scalars are read, so the plist is never built */
+    DSPlistValue *plist = [bwsp plistValue];
+    if (plist) {
+      id bounds = [plist scalarForKey:@"WindowBounds"];
+      if ([bounds isKindOfClass:[NSString class]]) {
         NSRect r = NSRectFromString(bounds);
         if (r.size.width > 0 && r.size.height > 0) {
           [info setWindowFrame:r];
           [info setHasWindowFrame:YES];
         }
       }
-      id sw = [plist objectForKey:@"SidebarWidth"];
+      id sw = [plist scalarForKey:@"SidebarWidth"];
       if (sw) {
         [info setSidebarWidth:[sw intValue]];
         [info setHasSidebarWidth:YES];
@@ -190,14 +186,9 @@
   /* Also check icvp plist for icon size */
   DSStoreEntry *icvp = [store entryForFilename:key code:@"icvp"];
   if (icvp && [[icvp type] isEqualToString:@"blob"]) {
-    NSData *data = (NSData *)[icvp value];
-    NSError *err = nil;
-    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData:data
-                                                                    options:NSPropertyListImmutable
-                                                                     format:NULL
-                                                                      error:&err];
-    if (plist && [plist isKindOfClass:[NSDictionary class]]) {
-      id sz = [plist objectForKey:@"iconSize"];
+    DSPlistValue *plist = [icvp plistValue];
+    if (plist) {
+      id sz = [plist scalarForKey:@"iconSize"];
       if (sz && !info.hasIconSize) {
         int v = [sz intValue];
         if (v > 0 && v <= 512) {
@@ -206,7 +197,7 @@
         }
       }
       /* Arrangement from plist */
-      id arr = [plist objectForKey:@"arrangeBy"];
+      id arr = [plist scalarForKey:@"arrangeBy"];
       if (arr) {
         NSString *a = [arr description];
         if ([a isEqualToString:@"grid"] || [a isEqualToString:@"1"]) {
@@ -217,14 +208,14 @@
         [info setHasIconArrangement:YES];
       }
       /* Label position */
-      id lbl = [plist objectForKey:@"labelOnBottom"];
+      id lbl = [plist scalarForKey:@"labelOnBottom"];
       if (lbl) {
         [info setLabelPosition:[lbl boolValue] ? DSStoreLabelPositionBottom
                            : DSStoreLabelPositionRight];
         [info setHasLabelPosition:YES];
       }
       /* Grid spacing */
-      id gs = [plist objectForKey:@"gridSpacing"];
+      id gs = [plist scalarForKey:@"gridSpacing"];
       if (gs) {
         [info setGridSpacing:[gs floatValue]];
         [info setHasGridSpacing:YES];
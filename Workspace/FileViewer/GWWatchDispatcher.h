@@ -0,0 +1,64 @@
+/* GWWatchDispatcher.h
+ *
+ * Delivery of the fswatcher events by path.  Every component that shows
+ * or keeps paths registers the paths it cares about, and each event goes
+ * only to the registrations it concerns, found through a hash map of the
+ * registered paths and a trie of their components, instead of being
+ * broadcast to every viewer, shelf and sidebar for them to test.
+ *
+ * The info dictionaries are the ones Workspace gets from fswatcher, with
+ * the "path" and "event" keys.  Registrations are counted: a path added
+ * twice must be removed twice.  Observers are not retained; one being
+ * removed while an event is dispatched gets no more of it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_WATCH_DISPATCHER_H
+#define GW_WATCH_DISPATCHER_H
+
+#import <Foundation/Foundation.h>
+
+typedef enum
+{
+  /* the events at the path, and the deletion of a directory holding it */
+  GWWatchPath,
+  /* the events at the path or at any directory holding it */
+  GWWatchPathAndAncestors,
+  /* the events at the path or anywhere beneath it */
+  GWWatchSubtree
+} GWWatchScope;
+
+@class GWWatchNode;
+
+@interface GWWatchDispatcher : NSObject
+{
+  GWWatchNode *root;
+  NSMutableDictionary *nodesByPath;
+}
+
++ (GWWatchDispatcher *)sharedDispatcher;
+
+/* `selector` takes the info dictionary of the event. */
+- (void)addObserver:(id)observer
+           selector:(SEL)selector
+            forPath:(NSString *)path
+              scope:(GWWatchScope)scope;
+
+- (void)removeObserver:(id)observer
+               forPath:(NSString *)path
+                 scope:(GWWatchScope)scope;
+
+/* every registration of the observer */
+- (void)removeObserver:(id)observer;
+
+/* Sends the event to the registrations it concerns, each observer and
+ * selector once. */
+- (void)dispatchWatcherInfo:(NSDictionary *)info;
+
+/* paths in the trie, registered or on the way to one */
+- (NSUInteger)nodesCount;
+
+@end
+
+#endif /* GW_WATCH_DISPATCHER_H */
@@ -0,0 +1,398 @@
+/* GWWatchDispatcher.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "GWWatchDispatcher.h"
+
+static GWWatchDispatcher *sharedDispatcher = nil;
+
+@interface GWWatchEntry : NSObject
+{
+@public
+  id observer;
+  SEL selector;
+  GWWatchScope scope;
+  NSUInteger count;
+  BOOL removed;
+}
+@end
+
+@implementation GWWatchEntry
+@end
+
+
+@interface GWWatchNode : NSObject
+{
+@public
+  NSString *path;
+  NSString *name;
+  GWWatchNode *parent;
+  NSMutableDictionary *children;
+  NSMutableArray *entries;
+  /* registrations strictly beneath, by scope, so that a branch nobody
+     below cares about is never walked */
+  NSUInteger pathsBelow;
+  NSUInteger ancestorsBelow;
+}
+@end
+
+@implementation GWWatchNode
+
+- (void)dealloc
+{
+  RELEASE (path);
+  RELEASE (name);
+  RELEASE (children);
+  RELEASE (entries);
+  [super dealloc];
+}
+
+@end
+
+
+/* "/a/b/" and "/a/b" are the same node */
+static NSString *canonicalPath(NSString *path)
+{
+  NSUInteger len = [path length];
+
+  while ((len > 1) && ([path characterAtIndex: len - 1] == '/')) {
+    len--;
+  }
+  if (len < [path length]) {
+    path = [path substringToIndex: len];
+  }
+
+  return (len == 0) ? @"/" : path;
+}
+
+static void adjustCountsAbove(GWWatchNode *node, GWWatchScope scope, int delta)
+{
+  GWWatchNode *n;
+
+  if (scope == GWWatchSubtree) {
+    return;
+  }
+  for (n = node->parent; n != nil; n = n->parent) {
+    if (scope == GWWatchPath) {
+      n->pathsBelow += delta;
+    } else {
+      n->ancestorsBelow += delta;
+    }
+  }
+}
+
+static void addEntries(NSMutableArray *found, GWWatchNode *node,
+                       BOOL pathEntries, BOOL ancestorEntries,
+                       BOOL subtreeEntries)
+{
+  NSUInteger i;
+
+  for (i = 0; i < [node->entries count]; i++) {
+    GWWatchEntry *entry = [node->entries objectAtIndex: i];
+
+    if (((entry->scope == GWWatchPath) && pathEntries)
+        || ((entry->scope == GWWatchPathAndAncestors) && ancestorEntries)
+        || ((entry->scope == GWWatchSubtree) && subtreeEntries)) {
+      [found addObject: entry];
+    }
+  }
+}
+
+static void addEntriesBeneath(NSMutableArray *found, GWWatchNode *node,
+                              BOOL deleted)
+{
+  NSEnumerator *enumerator = [node->children objectEnumerator];
+  GWWatchNode *child;
+
+  while ((child = [enumerator nextObject]) != nil) {
+    addEntries(found, child, deleted, YES, NO);
+
+    if ((deleted && child->pathsBelow) || child->ancestorsBelow) {
+      addEntriesBeneath(found, child, deleted);
+    }
+  }
+}
+
+
+@implementation GWWatchDispatcher
+
++ (GWWatchDispatcher *)sharedDispatcher
+{
+  if (sharedDispatcher == nil) {
+    sharedDispatcher = [GWWatchDispatcher new];
+  }
+  return sharedDispatcher;
+}
+
+- (void)dealloc
+{
+  RELEASE (root);
+  RELEASE (nodesByPath);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self) {
+    root = [GWWatchNode new];
+    root->path = @"/";
+    root->name = @"/";
+    root->children = [NSMutableDictionary new];
+    root->entries = [NSMutableArray new];
+    nodesByPath = [NSMutableDictionary new];
+    [nodesByPath setObject: root forKey: @"/"];
+  }
+
+  return self;
+}
+
+- (GWWatchNode *)nodeForPath:(NSString *)path
+                      create:(BOOL)create
+{
+  GWWatchNode *node = [nodesByPath objectForKey: path];
+  NSArray *components;
+  NSUInteger i;
+
+  if (node || (create == NO)) {
+    return node;
+  }
+
+  components = [path pathComponents];
+  node = root;
+
+  for (i = 0; i < [components count]; i++) {
+    NSString *cname = [components objectAtIndex: i];
+    GWWatchNode *child;
+
+    if ([cname isEqual: @"/"] || ([cname length] == 0)) {
+      continue;
+    }
+
+    child = [node->children objectForKey: cname];
+
+    if (child == nil) {
+      child = [GWWatchNode new];
+      child->name = [cname copy];
+      child->path = [[node->path stringByAppendingPathComponent: cname] copy];
+      child->parent = node;
+      child->children = [NSMutableDictionary new];
+      child->entries = [NSMutableArray new];
+      [node->children setObject: child forKey: cname];
+      [nodesByPath setObject: child forKey: child->path];
+      RELEASE (child);
+    }
+
+    node = child;
+  }
+
+  return node;
+}
+
+/* The node of the path itself when somebody watches it, else the
+   deepest of the directories holding it that somebody watches. */
+- (GWWatchNode *)deepestNodeForPath:(NSString *)path
+{
+  GWWatchNode *node = nil;
+
+  while (node == nil) {
+    node = [nodesByPath objectForKey: path];
+
+    if (node == nil) {
+      path = [path stringByDeletingLastPathComponent];
+
+      if (([path length] == 0) || [path isEqual: @"/"]) {
+        node = root;
+      }
+    }
+  }
+
+  return node;
+}
+
+- (void)pruneNode:(GWWatchNode *)node
+{
+  while ((node != root) && ([node->entries count] == 0)
+                        && ([node->children count] == 0)) {
+    GWWatchNode *parent = node->parent;
+
+    [nodesByPath removeObjectForKey: node->path];
+    [parent->children removeObjectForKey: node->name];
+    node = parent;
+  }
+}
+
+- (void)addObserver:(id)observer
+           selector:(SEL)selector
+            forPath:(NSString *)path
+              scope:(GWWatchScope)scope
+{
+  GWWatchNode *node;
+  GWWatchEntry *entry;
+  NSUInteger i;
+
+  if ((observer == nil) || (path == nil)) {
+    return;
+  }
+
+  node = [self nodeForPath: canonicalPath(path) create: YES];
+
+  for (i = 0; i < [node->entries count]; i++) {
+    entry = [node->entries objectAtIndex: i];
+
+    if ((entry->observer == observer) && (entry->selector == selector)
+                                      && (entry->scope == scope)) {
+      entry->count++;
+      return;
+    }
+  }
+
+  entry = [GWWatchEntry new];
+  entry->observer = observer;
+  entry->selector = selector;
+  entry->scope = scope;
+  entry->count = 1;
+  [node->entries addObject: entry];
+  RELEASE (entry);
+
+  adjustCountsAbove(node, scope, 1);
+}
+
+- (void)removeEntryAtIndex:(NSUInteger)index
+                  fromNode:(GWWatchNode *)node
+{
+  GWWatchEntry *entry = [node->entries objectAtIndex: index];
+
+  entry->removed = YES;
+  adjustCountsAbove(node, entry->scope, -1);
+  [node->entries removeObjectAtIndex: index];
+}
+
+- (void)removeObserver:(id)observer
+               forPath:(NSString *)path
+                 scope:(GWWatchScope)scope
+{
+  GWWatchNode *node;
+  NSUInteger i;
+
+  if ((observer == nil) || (path == nil)) {
+    return;
+  }
+
+  node = [self nodeForPath: canonicalPath(path) create: NO];
+
+  if (node == nil) {
+    return;
+  }
+
+  for (i = 0; i < [node->entries count]; i++) {
+    GWWatchEntry *entry = [node->entries objectAtIndex: i];
+
+    if ((entry->observer == observer) && (entry->scope == scope)) {
+      if (--entry->count == 0) {
+        [self removeEntryAtIndex: i fromNode: node];
+        [self pruneNode: node];
+      }
+      return;
+    }
+  }
+}
+
+- (void)removeObserver:(id)observer
+{
+  NSArray *nodes = [nodesByPath allValues];
+  NSMutableArray *emptied = [NSMutableArray array];
+  NSUInteger i, j;
+
+  for (i = 0; i < [nodes count]; i++) {
+    GWWatchNode *node = [nodes objectAtIndex: i];
+
+    j = [node->entries count];
+
+    while (j-- > 0) {
+      GWWatchEntry *entry = [node->entries objectAtIndex: j];
+
+      if (entry->observer == observer) {
+        [self removeEntryAtIndex: j fromNode: node];
+      }
+    }
+
+    if ([node->entries count] == 0) {
+      [emptied addObject: node];
+    }
+  }
+
+  for (i = 0; i < [emptied count]; i++) {
+    GWWatchNode *node = [emptied objectAtIndex: i];
+
+    /* an earlier prune may have taken it already */
+    if ([nodesByPath objectForKey: node->path] == node) {
+      [self pruneNode: node];
+    }
+  }
+}
+
+- (void)dispatchWatcherInfo:(NSDictionary *)info
+{
+  NSString *path = [info objectForKey: @"path"];
+  BOOL deleted = [[info objectForKey: @"event"] isEqual: @"GWWatchedPathDeleted"];
+  NSMutableArray *found;
+  NSMutableArray *delivered;
+  GWWatchNode *node;
+  GWWatchNode *n;
+  NSUInteger i, j;
+
+  if (path == nil) {
+    return;
+  }
+
+  path = canonicalPath(path);
+  node = [self deepestNodeForPath: path];
+  found = [NSMutableArray array];
+  delivered = [NSMutableArray array];
+
+  for (n = node; n != nil; n = n->parent) {
+    addEntries(found, n, NO, NO, YES);
+  }
+
+  if ([node->path isEqual: path]) {
+    addEntries(found, node, YES, YES, NO);
+
+    if ((deleted && node->pathsBelow) || node->ancestorsBelow) {
+      addEntriesBeneath(found, node, deleted);
+    }
+  }
+
+  for (i = 0; i < [found count]; i++) {
+    GWWatchEntry *entry = [found objectAtIndex: i];
+    BOOL sent = NO;
+
+    if (entry->removed) {
+      continue;
+    }
+
+    for (j = 0; j < [delivered count]; j++) {
+      GWWatchEntry *prev = [delivered objectAtIndex: j];
+
+      if ((prev->observer == entry->observer)
+                     && (prev->selector == entry->selector)) {
+        sent = YES;
+        break;
+      }
+    }
+
+    if (sent == NO) {
+      [delivered addObject: entry];
+      [entry->observer performSelector: entry->selector withObject: info];
+    }
+  }
+}
+
+- (NSUInteger)nodesCount
+{
+  return [nodesByPath count];
+}
+
+@end
@@ -3,8 +3,9 @@
  * Manages X11 atoms for spatial path communication between Workspace
  * and WindowManager.  Sets _GW_SPATIAL_PATH on the viewer window so
  * the WM can display a path-component popup when the user modifier-
- * clicks on the titlebar.  Polls _GW_SPATIAL_NAVIGATE to receive
- * navigation requests from the WM.
+ * clicks on the titlebar.  The navigation requests of the WM, written
+ * to _GW_SPATIAL_NAVIGATE, arrive as PropertyNotify events on a
+ * connection watched by the run loop, so nothing runs while idle.
  *
  * Author: Gershwin Team
  */
@@ -18,7 +19,8 @@
 {
   NSWindow *_window;
   NSString *_currentPath;
-  NSTimer *_pollTimer;
+  /* the X11 Window the events are selected on, 0 until then */
+  unsigned long _xid;
 }
 
 - (instancetype)initWithWindow:(NSWindow *)window path:(NSString *)path;
@@ -4,7 +4,8 @@
  *
  * On GNUstep's X11 backend, [NSWindow windowRef] returns the native
  * X11 Window ID.  We open our own Display connection to set/read
- * atoms so we don't interfere with the AppKit event loop.
+ * atoms so we don't interfere with the AppKit event loop, and select
+ * the property and focus events of the viewer windows on it.
  */
 
 #import "GWX11SpatialPath.h"
@@ -22,13 +23,13 @@
 #include <X11/Xatom.h>
 #include <X11/Xutil.h>
 
+#include <stdint.h>
+#include <string.h>
+
 /* Atom names */
 #define GW_ATOM_SPATIAL_PATH     "_GW_SPATIAL_PATH"
 #define GW_ATOM_SPATIAL_NAVIGATE "_GW_SPATIAL_NAVIGATE"
 
-/* Polling interval for navigation requests (seconds) */
-#define GW_NAVIGATE_POLL_INTERVAL 0.5
-
 /* Custom X error handler to prevent crashes from BadWindow */
 static int gwX11ErrorHandler(Display *dpy, XErrorEvent *event)
 {
@@ -49,7 +50,44 @@ static void ensureErrorHandler(void)
   }
 }
 
+/* One connection for every viewer window, open while one is tracked.
+ * Its descriptor is watched by the run loop; the events selected on it
+ * are ours alone, AppKit's connection does not see them. */
+static Display *eventDisplay = NULL;
+static Atom pathAtom = None;
+static Atom navigateAtom = None;
+static Atom utf8Atom = None;
+/* X11 Window -> non retained GWX11SpatialPath */
+static NSMutableDictionary *trackedWindows = nil;
+
+@interface GWX11SpatialPathEvents : NSObject <RunLoopEvents>
++ (GWX11SpatialPathEvents *)sharedEvents;
+- (Display *)display;
+- (void)closeIfUnused;
+- (void)processEvents;
+@end
+
+static NSArray *eventRunLoopModes(void)
+{
+  static NSArray *modes = nil;
+  if (modes == nil) {
+    modes = [[NSArray alloc] initWithObjects:NSDefaultRunLoopMode,
+                                             NSModalPanelRunLoopMode,
+                                             NSEventTrackingRunLoopMode, nil];
+  }
+  return modes;
+}
+
+static NSNumber *windowKey(Window win)
+{
+  return [NSNumber numberWithUnsignedLong:(unsigned long)win];
+}
+
 @interface GWX11SpatialPath (Private)
+- (Window)x11Window;
+- (void)updateAtomWithPath:(NSString *)path;
+- (void)clearNavigateAtom;
+- (void)readNavigateAtom;
 - (void)navigateToPath:(NSString *)targetPath;
 @end
 
@@ -62,6 +100,7 @@ static void ensureErrorHandler(void)
 
   _window = window;
   _currentPath = [path copy];
+  _xid = 0;
 
   /* Set the initial atom value after a short delay to ensure
    * the window is fully mapped and windowRef is valid. */
@@ -74,20 +113,29 @@ static void ensureErrorHandler(void)
 
 - (void)setInitialAtom
 {
-  if (!_window || !_currentPath)
+  Display *dpy;
+  Window xid;
+
+  if (!_window || !_currentPath || _xid)
     return;
 
-  ensureErrorHandler();
+  dpy = [[GWX11SpatialPathEvents sharedEvents] display];
+  xid = [self x11Window];
+
+  if (!dpy || !xid) {
+    [[GWX11SpatialPathEvents sharedEvents] closeIfUnused];
+    return;
+  }
+
+  /* Selected before the stale request is cleared, so a request written
+   * from now on is not missed */
+  _xid = (unsigned long)xid;
+  [trackedWindows setObject:[NSValue valueWithNonretainedObject:self]
+                     forKey:windowKey(xid)];
+  XSelectInput(dpy, xid, PropertyChangeMask | FocusChangeMask);
 
   [self updateAtomWithPath:_currentPath];
   [self clearNavigateAtom];
-
-  /* Start polling for navigation requests */
-  _pollTimer = [NSTimer scheduledTimerWithTimeInterval:GW_NAVIGATE_POLL_INTERVAL
-                                                target:self
-                                              selector:@selector(pollNavigateAtom:)
-                                              userInfo:nil
-                                               repeats:YES];
 }
 
 - (void)dealloc
@@ -109,13 +157,29 @@ static void ensureErrorHandler(void)
 
 - (void)invalidate
 {
-  if (_pollTimer) {
-    [_pollTimer invalidate];
-    _pollTimer = nil;
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(setInitialAtom)
+                                             object:nil];
+
+  if (_xid) {
+    /* the window may be gone already; the error handler takes the
+       BadWindow */
+    if (eventDisplay) {
+      XSelectInput(eventDisplay, (Window)_xid, NoEventMask);
+      XFlush(eventDisplay);
+    }
+    [trackedWindows removeObjectForKey:windowKey((Window)_xid)];
+    _xid = 0;
+    [[GWX11SpatialPathEvents sharedEvents] closeIfUnused];
   }
   _window = nil;
 }
 
+@end
+
+
+@implementation GWX11SpatialPath (Private)
+
 #pragma mark - X11 Atom Operations
 
 /* Get the X11 Window ID from the NSWindow.
@@ -126,96 +190,57 @@ static void ensureErrorHandler(void)
   return (Window)[_window windowRef];
 }
 
-/* Open a temporary display connection for X11 operations */
-- (Display *)openDisplay
-{
-  ensureErrorHandler();
-  return XOpenDisplay(NULL);
-}
-
 /* Set _GW_SPATIAL_PATH to the given path string */
 - (void)updateAtomWithPath:(NSString *)path
 {
-  Display *dpy = [self openDisplay];
-  if (!dpy) {
-    NSLog(@"GWX11SpatialPath: Cannot open display to set atom");
-    return;
-  }
+  Display *dpy = eventDisplay;
+  Window xid = (Window)_xid;
+  const char *cpath = [path UTF8String];
 
-  Window xid = [self x11Window];
-  if (!xid) {
-    XCloseDisplay(dpy);
+  if (!dpy || !xid)
     return;
-  }
-
-  Atom atom = XInternAtom(dpy, GW_ATOM_SPATIAL_PATH, False);
-  Atom utf8Atom = XInternAtom(dpy, "UTF8_STRING", False);
-  const char *cpath = [path UTF8String];
 
-  XChangeProperty(dpy, xid, atom, utf8Atom, 8, PropModeReplace,
+  XChangeProperty(dpy, xid, pathAtom, utf8Atom, 8, PropModeReplace,
                   (unsigned char *)cpath, (int)strlen(cpath));
-  XSync(dpy, False);
+  XFlush(dpy);
 
   NSDebugLLog(@"gwspace", @"GWX11SpatialPath: Set %s on window 0x%lx to '%@'",
               GW_ATOM_SPATIAL_PATH, (unsigned long)xid, path);
-
-  XCloseDisplay(dpy);
 }
 
 /* Delete _GW_SPATIAL_NAVIGATE to clear a stale request */
 - (void)clearNavigateAtom
 {
-  Display *dpy = [self openDisplay];
-  if (!dpy) return;
-
-  Window xid = [self x11Window];
-  if (!xid) {
-    XCloseDisplay(dpy);
+  if (!eventDisplay || !_xid)
     return;
-  }
-
-  Atom atom = XInternAtom(dpy, GW_ATOM_SPATIAL_NAVIGATE, False);
-  XDeleteProperty(dpy, xid, atom);
-  XSync(dpy, False);
 
-  XCloseDisplay(dpy);
+  XDeleteProperty(eventDisplay, (Window)_xid, navigateAtom);
+  XFlush(eventDisplay);
 }
 
-/* Poll for _GW_SPATIAL_NAVIGATE requests from the WM */
-- (void)pollNavigateAtom:(NSTimer *)timer
+/* Reads and deletes a navigation request of the WM */
+- (void)readNavigateAtom
 {
-  if (!_window) {
-    [timer invalidate];
-    return;
-  }
-
-  Display *dpy = [self openDisplay];
-  if (!dpy) return;
-
-  Window xid = [self x11Window];
-  if (!xid) {
-    XCloseDisplay(dpy);
-    return;
-  }
-
-  Atom navAtom = XInternAtom(dpy, GW_ATOM_SPATIAL_NAVIGATE, False);
-  Atom utf8Atom = XInternAtom(dpy, "UTF8_STRING", False);
+  Display *dpy = eventDisplay;
+  Window xid = (Window)_xid;
   Atom actual_type;
   int actual_format;
   unsigned long nitems, bytes_after;
   unsigned char *data = NULL;
   NSString *targetPath = nil;
 
-  if (XGetWindowProperty(dpy, xid, navAtom, 0, 4096, True,
+  if (!dpy || !xid || !_window)
+    return;
+
+  if (XGetWindowProperty(dpy, xid, navigateAtom, 0, 4096, True,
                          utf8Atom, &actual_type, &actual_format,
-                         &nitems, &bytes_after, &data) == Success && data && nitems > 0) {
-    targetPath = [[NSString alloc] initWithUTF8String:(const char *)data];
+                         &nitems, &bytes_after, &data) == Success && data) {
+    if (nitems > 0) {
+      targetPath = [[NSString alloc] initWithUTF8String:(const char *)data];
+    }
     XFree(data);
   }
 
-  XSync(dpy, False);
-  XCloseDisplay(dpy);
-
   if (targetPath) {
     if ([targetPath length] > 0) {
       NSDebugLLog(@"gwspace", @"GWX11SpatialPath: Navigate request to '%@'", targetPath);
@@ -293,3 +318,116 @@ static void ensureErrorHandler(void)
 }
 
 @end
+
+
+@implementation GWX11SpatialPathEvents
+
++ (GWX11SpatialPathEvents *)sharedEvents
+{
+  static GWX11SpatialPathEvents *sharedEvents = nil;
+
+  if (sharedEvents == nil) {
+    sharedEvents = [GWX11SpatialPathEvents new];
+    trackedWindows = [NSMutableDictionary new];
+  }
+  return sharedEvents;
+}
+
+- (Display *)display
+{
+  void *fd;
+  NSArray *modes;
+  NSUInteger i;
+
+  if (eventDisplay)
+    return eventDisplay;
+
+  ensureErrorHandler();
+  eventDisplay = XOpenDisplay(NULL);
+
+  if (!eventDisplay) {
+    NSLog(@"GWX11SpatialPath: Cannot open display");
+    return NULL;
+  }
+
+  pathAtom = XInternAtom(eventDisplay, GW_ATOM_SPATIAL_PATH, False);
+  navigateAtom = XInternAtom(eventDisplay, GW_ATOM_SPATIAL_NAVIGATE, False);
+  utf8Atom = XInternAtom(eventDisplay, "UTF8_STRING", False);
+
+  fd = (void *)(uintptr_t)ConnectionNumber(eventDisplay);
+  modes = eventRunLoopModes();
+
+  for (i = 0; i < [modes count]; i++) {
+    [[NSRunLoop currentRunLoop] addEvent:fd
+                                    type:ET_RDESC
+                                 watcher:self
+                                 forMode:[modes objectAtIndex:i]];
+  }
+
+  return eventDisplay;
+}
+
+- (void)closeIfUnused
+{
+  Display *dpy = eventDisplay;
+  void *fd;
+  NSArray *modes;
+  NSUInteger i;
+
+  if (!dpy || [trackedWindows count])
+    return;
+
+  fd = (void *)(uintptr_t)ConnectionNumber(dpy);
+  modes = eventRunLoopModes();
+
+  for (i = 0; i < [modes count]; i++) {
+    [[NSRunLoop currentRunLoop] removeEvent:fd
+                                       type:ET_RDESC
+                                    forMode:[modes objectAtIndex:i]
+                                        all:NO];
+  }
+
+  eventDisplay = NULL;
+  XCloseDisplay(dpy);
+}
+
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  [self processEvents];
+}
+
+/* A request is read when the WM writes it, and again when the window
+ * gets the focus, in case one was written before the events were
+ * selected.  Navigating can close the viewer and the connection with it,
+ * so the tracker is looked up again for every event. */
+- (void)processEvents
+{
+  XEvent event;
+
+  while (eventDisplay && XPending(eventDisplay) > 0) {
+    GWX11SpatialPath *tracker;
+    Window win = None;
+
+    XNextEvent(eventDisplay, &event);
+
+    if (event.type == PropertyNotify) {
+      if (event.xproperty.atom == navigateAtom
+            && event.xproperty.state == PropertyNewValue) {
+        win = event.xproperty.window;
+      }
+    } else if (event.type == FocusIn) {
+      win = event.xfocus.window;
+    }
+
+    if (win == None)
+      continue;
+
+    tracker = [[trackedWindows objectForKey:windowKey(win)] nonretainedObjectValue];
+    [tracker readNavigateAtom];
+  }
+}
+
+@end
@@ -77,6 +77,10 @@
 - (void)activate;
 
 - (void)loadModules;
+
+/* loads the modules and builds their views, done by -activate or, when
+   the application is idle after launch, by the Workspace */
+- (void)loadModulesIfNeeded;
                            
 - (NSArray *)modules;
 
@@ -35,6 +35,7 @@
 #import "FSNodeRep.h"
 #import "Workspace.h"
 #import "GWFunctions.h"
+#import "GWStartupTrace.h"
 
 #define WINH (262.0)
 #define FMVIEWH (34.0)
@@ -84,7 +85,6 @@ static Finder *finder = nil;
   if (self) {
     NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
     id defentry;
-    NSArray *usedModules;
     NSRect rect;
     NSSize cs, ms;
     NSUInteger i;
@@ -96,6 +96,7 @@ static Finder *finder = nil;
     } 
    
     fmviews = [NSMutableArray new];
+    /* the modules are loaded when the window is first shown */
     modules = nil;
     currentSelection = nil;
     searchResults = [NSMutableArray new];
@@ -154,29 +155,6 @@ static Finder *finder = nil;
 
     [removePlaceButt setEnabled: ([[placesMatrix cells] count] != 0)];
 
-    [self loadModules];
-
-    usedModules = [self usedModules];
- 
-    for (i = 0; i < [usedModules count]; i++) {
-      id module = [usedModules objectAtIndex: i];
-      id fmview = [[FindModuleView alloc] initWithDelegate: self];
-
-      [fmview setModule: module];
-
-      if ([usedModules count] == [modules count]) {
-        [fmview setAddEnabled: NO];    
-      }
-
-      [[modulesBox contentView] addSubview: [fmview mainBox]];
-      [fmviews insertObject: fmview atIndex: [fmviews count]];
-      RELEASE (fmview);
-    }
-
-    for (i = 0; i < [fmviews count]; i++) {
-      [[fmviews objectAtIndex: i] updateMenuForModules: modules];
-    }
-
     [recursiveSwitch setState: NSOnState];
 
     defentry = [defaults objectForKey: @"search_res_h"];
@@ -244,6 +222,7 @@ static Finder *finder = nil;
 
 - (void)activate
 {
+  [self loadModulesIfNeeded];
   [win makeKeyAndOrderFront: nil];
   [self tile];
 }
@@ -288,6 +267,7 @@ static Finder *finder = nil;
      
       if (bundle)
         {
+          GWStartupTraceBegin([bpath lastPathComponent]);
           Class principalClass = [bundle principalClass];
 
           if ([principalClass conformsToProtocol: @protocol(FinderModulesProtocol)]) {	
@@ -296,6 +276,7 @@ static Finder *finder = nil;
             [unsortedModules addObject: module];
             RELEASE ((id)module);			
           }
+          GWStartupTraceEnd([bpath lastPathComponent]);
         }
     
       RELEASE (arp);
@@ -345,8 +326,42 @@ static Finder *finder = nil;
   modules = [[unsortedModules sortedArrayUsingSelector: @selector(compareModule:)] mutableCopy];
 }
 
+- (void)loadModulesIfNeeded
+{
+  NSArray *usedModules;
+  NSUInteger i;
+
+  if (modules != nil) {
+    return;
+  }
+
+  [self loadModules];
+
+  usedModules = [self usedModules];
+ 
+  for (i = 0; i < [usedModules count]; i++) {
+    id module = [usedModules objectAtIndex: i];
+    id fmview = [[FindModuleView alloc] initWithDelegate: self];
+
+    [fmview setModule: module];
+
+    if ([usedModules count] == [modules count]) {
+      [fmview setAddEnabled: NO];    
+    }
+
+    [[modulesBox contentView] addSubview: [fmview mainBox]];
+    [fmviews insertObject: fmview atIndex: [fmviews count]];
+    RELEASE (fmview);
+  }
+
+  for (i = 0; i < [fmviews count]; i++) {
+    [[fmviews objectAtIndex: i] updateMenuForModules: modules];
+  }
+}
+
 - (NSArray *)modules
 {
+  [self loadModulesIfNeeded];
   return modules;
 }
 
@@ -1115,15 +1130,18 @@ static Finder *finder = nil;
 
   [defaults setObject: savedPlaces forKey: @"saved_places"];
   [defaults setBool: usesSearchPlaces forKey: @"uses_search_places"];
-  
-  for (i = 0; i < [fmviews count]; i++) {
-    FindModuleView *fmview = [fmviews objectAtIndex: i];
-    id module = [fmview module]; 
-    [dict setObject: [NSNumber numberWithInt: i]
-             forKey: [module moduleName]];    
-  }
 
-  [defaults setObject: dict forKey: @"last_used_modules"];  
+  /* modules never loaded keep the ones used last time */
+  if (modules != nil) {
+    for (i = 0; i < [fmviews count]; i++) {
+      FindModuleView *fmview = [fmviews objectAtIndex: i];
+      id module = [fmview module]; 
+      [dict setObject: [NSNumber numberWithInt: i]
+               forKey: [module moduleName]];    
+    }
+
+    [defaults setObject: dict forKey: @"last_used_modules"];  
+  }
 
   [defaults setObject: [NSNumber numberWithInt: searchResh] 
                forKey: @"search_res_h"];    
@@ -37,6 +37,7 @@
 @class FSNPathComponentsViewer;
 @class NSImage;
 @class ProgrView;
+@class FSNResultsStore;
 
 @protocol LSFUpdaterProtocol
 
@@ -106,6 +107,8 @@
   int visibleRows;
 
   NSMutableArray *foundObjects;
+  NSMutableSet *shownPaths;
+  FSNResultsStore *results;
   FSNInfoType currentOrder;
 }
 
@@ -147,6 +150,8 @@
 
 - (void)clearFoundPaths;
 
+- (void)applyResultsChanges;
+
 - (void)endUpdate;
 
 - (void)connectionDidDie:(NSNotification *)notification;
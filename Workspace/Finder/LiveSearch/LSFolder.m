@@ -36,6 +36,7 @@
 #import "FinderModulesProtocol.h"
 #import "Workspace.h"
 #import "GWFunctions.h"
+#import "FSNResultsStore.h"
 
 #define CELLS_HEIGHT (28.0)
 
@@ -71,6 +72,8 @@ BOOL isPathInResults(NSString *path, NSArray *results);
   RELEASE (lsfinfo);
   RELEASE (win);
   RELEASE (foundObjects);
+  RELEASE (shownPaths);
+  RELEASE (results);
   RELEASE (editor);      
   RELEASE (elementsStr);
   DESTROY (conn);
@@ -97,6 +100,9 @@ BOOL isPathInResults(NSString *path, NSArray *results);
     
     win = nil;
     forceclose = NO;
+    foundObjects = nil;
+    shownPaths = nil;
+    results = nil;
 
     finder = fndr;
     
@@ -332,6 +338,7 @@ BOOL isPathInResults(NSString *path, NSArray *results);
   }
   
   if ([self isOpen]) {
+    [self applyResultsChanges];
     [self updateShownData];
   }
 }
@@ -345,10 +352,10 @@ BOOL isPathInResults(NSString *path, NSArray *results);
 - (void)addFoundPath:(NSString *)path 
 {
   CREATE_AUTORELEASE_POOL(pool);
-  FSNode *nd = [FSNode nodeWithPath: path];
   
-  if ([foundObjects containsObject: nd] == NO) {
-    [foundObjects addObject: nd];
+  if (foundObjects && ([shownPaths containsObject: path] == NO)) {
+    [foundObjects addObject: [FSNode nodeWithPath: path]];
+    [shownPaths addObject: path];
 
     if ([foundObjects count] <= visibleRows) {
       [resultsView noteNumberOfRowsChanged];
@@ -365,6 +372,7 @@ BOOL isPathInResults(NSString *path, NSArray *results);
 {
   CREATE_AUTORELEASE_POOL(pool);
   [foundObjects removeObject: [FSNode nodeWithPath: path]];
+  [shownPaths removeObject: path];
   [elementsLabel setStringValue: [NSString stringWithFormat: @"%lu %@", 
                                            (unsigned long)[foundObjects count], elementsStr]];
   [resultsView noteNumberOfRowsChanged];
@@ -375,12 +383,57 @@ BOOL isPathInResults(NSString *path, NSArray *results);
 - (void)clearFoundPaths
 {
   [foundObjects removeAllObjects];
+  [shownPaths removeAllObjects];
   [elementsLabel setStringValue: [NSString stringWithFormat: @"%lu %@", 
                                            (unsigned long)[foundObjects count], elementsStr]];
   [resultsView noteNumberOfRowsChanged];
   [pathViewer showComponentsOfSelection: nil];
 }
 
+/* What the updater stored since the last look, added and removed at once
+   rather than one message each. */
+- (void)applyResultsChanges
+{
+  CREATE_AUTORELEASE_POOL(pool);
+  NSArray *added = nil;
+  NSArray *removed = nil;
+
+  if (results && [results refreshAddedPaths: &added removedPaths: &removed]) {
+    NSUInteger count = [foundObjects count];
+    NSUInteger i;
+
+    if ([removed count]) {
+      NSSet *gone = [NSSet setWithArray: removed];
+      NSMutableArray *kept = [NSMutableArray arrayWithCapacity: count];
+
+      for (i = 0; i < count; i++) {
+        FSNode *nd = [foundObjects objectAtIndex: i];
+
+        if ([gone containsObject: [nd path]] == NO) {
+          [kept addObject: nd];
+        }
+      }
+      [foundObjects setArray: kept];
+      [shownPaths minusSet: gone];
+    }
+
+    for (i = 0; i < [added count]; i++) {
+      NSString *path = [added objectAtIndex: i];
+
+      if ([shownPaths containsObject: path] == NO) {
+        [foundObjects addObject: [FSNode nodeWithPath: path]];
+        [shownPaths addObject: path];
+      }
+    }
+
+    [elementsLabel setStringValue: [NSString stringWithFormat: @"%lu %@", 
+                                             (unsigned long)[foundObjects count], elementsStr]];
+    [resultsView noteNumberOfRowsChanged];
+  }
+
+  RELEASE (pool);
+}
+
 - (void)endUpdate
 {
   if (updater) {
@@ -648,6 +701,12 @@ shouldMakeNewConnection:(NSConnection*)newConn
     [pathBox setContentView: pathViewer];
     RELEASE (pathViewer);
 
+    shownPaths = [NSMutableSet new];
+    results = [[FSNResultsStore alloc] initWithDirectory: [node path]
+                                                writable: NO];
+    [self applyResultsChanges];
+    [self updateShownData];
+
     [[NSDistributedNotificationCenter defaultCenter] addObserver: self
                         selector: @selector(fileSystemDidChange:) 
                 					  name: @"GWFileSystemDidChangeNotification"
@@ -781,6 +840,7 @@ shouldMakeNewConnection:(NSConnection*)newConn
     if ([nd isValid]) {
       [selected addObject: nd];
     } else {
+      [shownPaths removeObject: [nd path]];
       [foundObjects removeObject: nd];
       [resultsView noteNumberOfRowsChanged];
     }
@@ -906,7 +966,10 @@ shouldMakeNewConnection:(NSConnection*)newConn
   
   if ([deletedObjects count]) {
     for (i = 0; i < [deletedObjects count]; i++) {
-      [foundObjects removeObject: [deletedObjects objectAtIndex: i]];
+      FSNode *nd = [deletedObjects objectAtIndex: i];
+
+      [shownPaths removeObject: [nd path]];
+      [foundObjects removeObject: nd];
     }
     
     [resultsView deselectAll: self];
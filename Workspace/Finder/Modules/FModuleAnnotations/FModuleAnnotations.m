@@ -28,6 +28,10 @@
 
 static NSString *nibName = @"FModuleAnnotations";
 
+/* directories whose annotations are kept while their subdirectories
+   are searched */
+#define BATCHES_CACHE_SIZE 32
+
 @interface FModuleAnnotations : NSObject <FinderModulesProtocol>
 {  
   IBOutlet id win;
@@ -41,10 +45,13 @@ static NSString *nibName = @"FModuleAnnotations";
   NSInteger how;
   
   id searchtool;
+  NSMutableDictionary *batches;
 }
 
 - (IBAction)popUpAction:(id)sender; 
 
+- (NSString *)annotationsForPath:(NSString *)path;
+
 @end
 
 @implementation FModuleAnnotations
@@ -58,6 +65,7 @@ static NSString *nibName = @"FModuleAnnotations";
 {
   RELEASE (controlsBox);
   RELEASE (contentsStr);
+  RELEASE (batches);
   [super dealloc];
 }
 
@@ -112,6 +120,7 @@ static NSString *nibName = @"FModuleAnnotations";
     ASSIGN (contentsStr, [criteria objectForKey: @"what"]);
     how = [[criteria objectForKey: @"how"] integerValue];
     searchtool = tool;
+    batches = [NSMutableDictionary new];
   }
   
   return self;
@@ -182,7 +191,7 @@ static NSString *nibName = @"FModuleAnnotations";
    withAttributes:(NSDictionary *)attributes
 {
   CREATE_AUTORELEASE_POOL(pool);
-  NSString *annotations = [searchtool ddbdGetAnnotationsForPath: path];
+  NSString *annotations = [self annotationsForPath: path];
   NSRange range;
   BOOL found = NO;
   
@@ -231,6 +240,48 @@ static NSString *nibName = @"FModuleAnnotations";
   return found;
 }
 
+/*
+ * The annotations of all the entries of the directory of path are
+ * asked to ddbd at once, when the first of them is checked.
+ */
+- (NSString *)annotationsForPath:(NSString *)path
+{
+  NSString *parent = [path stringByDeletingLastPathComponent];
+  NSDictionary *batch = [batches objectForKey: parent];
+
+  if ([parent isEqual: path]) {
+    return [searchtool ddbdGetAnnotationsForPath: path];
+  }
+
+  if (batch == nil) {
+    NSArray *contents = [[NSFileManager defaultManager] directoryContentsAtPath: parent];
+    NSMutableArray *paths = [NSMutableArray array];
+    NSUInteger i;
+
+    for (i = 0; i < [contents count]; i++) {
+      [paths addObject: [parent stringByAppendingPathComponent: 
+                                            [contents objectAtIndex: i]]];
+    }
+
+    if ([paths containsObject: path] == NO) {
+      [paths addObject: path];
+    }
+
+    batch = [searchtool ddbdGetAnnotationsForPaths: paths];
+
+    if (batch == nil) {
+      batch = [NSDictionary dictionary];
+    }
+
+    if ([batches count] >= BATCHES_CACHE_SIZE) {
+      [batches removeAllObjects];
+    }
+    [batches setObject: batch forKey: parent];
+  }
+
+  return [batch objectForKey: path];
+}
+
 - (NSComparisonResult)compareModule:(id <FinderModulesProtocol>)module
 {
   NSInteger i1 = [self index];
@@ -255,5 +306,15 @@ static NSString *nibName = @"FModuleAnnotations";
   return YES;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostRoundTrip;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
 
@@ -26,7 +26,15 @@
 #import <AppKit/AppKit.h>
 #import "FinderModulesProtocol.h"
 
-#define MAXFSIZE 600000
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+/* files are read this much at a time, and not past the size cap */
+#define READ_CHUNK (65536)
+#define MAXFSIZE (64 * 1024 * 1024)
+/* a NUL in the first bytes of a file makes it binary */
+#define BINARY_TEST_LEN 256
 
 static NSString *nibName = @"FModuleContents";
 
@@ -40,18 +48,69 @@ static NSString *nibName = @"FModuleContents";
   BOOL used;
 
   NSString *searchStr;
-  const char *searchPtr;
   NSFileManager *fm;
+
+  unsigned char *pattern;
+  size_t patlen;
+  size_t skip[256];
+  unsigned char fold[256];
+  BOOL ignoreCase;
+  unsigned long long maxSize;
+  unsigned char *buffer;
 }
 
+- (BOOL)findPatternInFile:(NSString *)path;
+
 @end
 
+
+/*
+ * Boyer-Moore-Horspool over bytes mapped through fold, the identity
+ * or the ASCII lower case.  Returns the position of the first match
+ * in buf, or -1.
+ */
+static long horspool_search(const unsigned char *buf, size_t len,
+                            const unsigned char *pat, size_t plen,
+                            const size_t *skip, const unsigned char *fold)
+{
+  size_t pos = 0;
+
+  if (plen == 0 || len < plen) {
+    return -1;
+  }
+
+  while (pos <= (len - plen)) {
+    unsigned char last = fold[buf[pos + plen - 1]];
+
+    if (last == pat[plen - 1]) {
+      size_t i = 0;
+
+      while ((i < plen - 1) && (fold[buf[pos + i]] == pat[i])) {
+        i++;
+      }
+      if (i == plen - 1) {
+        return (long)pos;
+      }
+    }
+
+    pos += skip[last];
+  }
+
+  return -1;
+}
+
 @implementation FModuleContents
 
 - (void)dealloc
 {
   RELEASE (controlsBox);
   RELEASE (searchStr);
+  if (pattern) {
+    NSZoneFree (NSDefaultMallocZone(), pattern);
+  }
+  if (buffer) {
+    NSZoneFree (NSDefaultMallocZone(), buffer);
+  }
   [super dealloc];
 }
 
@@ -89,9 +148,42 @@ static NSString *nibName = @"FModuleContents";
   self = [super init];
 
   if (self) {
+    id entry;
+    const char *str;
+    size_t i;
+
     ASSIGN (searchStr, [criteria objectForKey: @"what"]);
-    searchPtr = [searchStr UTF8String];
     fm = [NSFileManager defaultManager];
+
+    entry = [criteria objectForKey: @"ignorecase"];
+    ignoreCase = (entry ? [entry boolValue] : NO);
+    entry = [criteria objectForKey: @"maxsize"];
+    maxSize = (entry ? [entry unsignedLongLongValue] : MAXFSIZE);
+
+    /* non-ASCII bytes are matched as they are in either case */
+    for (i = 0; i < 256; i++) {
+      fold[i] = (ignoreCase && (i >= 'A') && (i <= 'Z')) ? (i + ('a' - 'A')) : i;
+    }
+
+    str = [searchStr UTF8String];
+    patlen = (str ? strlen(str) : 0);
+    pattern = NSZoneMalloc (NSDefaultMallocZone(), patlen + 1);
+
+    for (i = 0; i < patlen; i++) {
+      pattern[i] = fold[(unsigned char)str[i]];
+    }
+    pattern[patlen] = 0;
+
+    for (i = 0; i < 256; i++) {
+      skip[i] = (patlen ? patlen : 1);
+    }
+    for (i = 0; (patlen > 0) && (i < patlen - 1); i++) {
+      skip[pattern[i]] = patlen - 1 - i;
+    }
+
+    /* a match can start at the end of a chunk: the next one begins
+       after the last patlen - 1 bytes of it */
+    buffer = NSZoneMalloc (NSDefaultMallocZone(), READ_CHUNK + patlen);
   }
   
 	return self;
@@ -141,7 +233,25 @@ static NSString *nibName = @"FModuleContents";
   NSString *str = [textField stringValue];
   
   if ([str length] != 0) {
-    return [NSDictionary dictionaryWithObject: str forKey: @"what"];
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSMutableDictionary *criteria = [NSMutableDictionary dictionary];
+    id entry;
+
+    [criteria setObject: str forKey: @"what"];
+
+    [criteria setObject: [NSNumber numberWithBool: 
+                              [defaults boolForKey: @"FModuleContentsIgnoreCase"]]
+                 forKey: @"ignorecase"];
+
+    /* 0 searches the files of any size */
+    entry = [defaults objectForKey: @"FModuleContentsMaxSize"];
+    if (entry) {
+      [criteria setObject: [NSNumber numberWithUnsignedLongLong: 
+                                                  [entry unsignedLongLongValue]]
+                   forKey: @"maxsize"];
+    }
+
+    return criteria;
   }
 
   return nil;
@@ -150,33 +260,78 @@ static NSString *nibName = @"FModuleContents";
 - (BOOL)checkPath:(NSString *)path 
    withAttributes:(NSDictionary *)attributes
 {
-  BOOL contains = NO;
-  
-  if (([attributes fileSize] < MAXFSIZE) 
-            && ([attributes fileType] == NSFileTypeRegular)) {
-    CREATE_AUTORELEASE_POOL(pool);
-    NSData *contents = [NSData dataWithContentsOfFile: path];
-    unsigned length = ((contents != nil) ? [contents length] : 0);
-    
-    if (length) {
-      const char *bytesStr = (const char *)[contents bytes];
-      unsigned testlen = ((length < 256) ? length : 256);
-      unsigned i;
-      
-      for (i = 0; i < testlen; i++) {
-        if (bytesStr[i] == 0x00) {
-          RELEASE (pool);
-          return NO; 
-        } 
+  if ((patlen == 0) || ([attributes fileType] != NSFileTypeRegular)) {
+    return NO;
+  }
+
+  if ((maxSize > 0) && ([attributes fileSize] > maxSize)) {
+    return NO;
+  }
+
+  return [self findPatternInFile: path];
+}
+
+/*
+ * Reads the file a chunk at a time, up to the size cap, and stops at
+ * the first match.
+ */
+- (BOOL)findPatternInFile:(NSString *)path
+{
+  const char *cpath = [fm fileSystemRepresentationWithPath: path];
+  unsigned long long total = 0;
+  size_t kept = 0;
+  size_t filled;
+  BOOL first = YES;
+  BOOL found = NO;
+  int fd;
+
+  fd = open(cpath, O_RDONLY);
+
+  if (fd < 0) {
+    return NO;
+  }
+
+  while (1) {
+    size_t want = READ_CHUNK;
+    ssize_t got;
+
+    if ((maxSize > 0) && ((total + want) > maxSize)) {
+      want = (size_t)(maxSize - total);
+    }
+    if (want == 0) {
+      break;
+    }
+
+    got = read(fd, buffer + kept, want);
+
+    if (got <= 0) {
+      break;
+    }
+
+    if (first) {
+      size_t testlen = ((size_t)got < BINARY_TEST_LEN) ? (size_t)got : BINARY_TEST_LEN;
+
+      if (memchr(buffer, 0, testlen) != NULL) {
+        break;
       }
-    
-      contains = (strstr(bytesStr, searchPtr) != NULL);
+      first = NO;
     }
-    
-    RELEASE (pool);
+
+    total += got;
+    filled = kept + got;
+
+    if (horspool_search(buffer, filled, pattern, patlen, skip, fold) >= 0) {
+      found = YES;
+      break;
+    }
+
+    kept = (filled < (patlen - 1)) ? filled : (patlen - 1);
+    memmove(buffer, buffer + filled - kept, kept);
   }
-  
-  return contains;
+
+  close(fd);
+
+  return found;
 }
 
 - (NSComparisonResult)compareModule:(id <FinderModulesProtocol>)module
@@ -203,5 +358,28 @@ static NSString *nibName = @"FModuleContents";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostContents;
+}
+
+/*
+ * Only a single word is asked for: gmds keeps the words of the text
+ * it extracts, lowercased, and any of them holding the string
+ * selects the file.
+ */
+- (NSString *)indexQuery
+{
+  NSCharacterSet *set = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+
+  if (([searchStr length] == 0)
+        || ([searchStr rangeOfCharacterFromSet: set].location != NSNotFound)) {
+    return nil;
+  }
+
+  return [NSString stringWithFormat: @"GSMDItemTextContent == \"*%@*\"c", 
+                                                                  searchStr];
+}
+
 @end
 
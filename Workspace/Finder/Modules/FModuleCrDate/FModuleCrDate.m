@@ -482,4 +482,14 @@ static NSString *nibName = @"FModuleCrDate";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostMetadata;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
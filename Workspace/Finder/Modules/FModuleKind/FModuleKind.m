@@ -236,6 +236,16 @@ static NSString *nibName = @"FModuleKind";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostStat;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
 
 
@@ -484,4 +484,14 @@ static NSString *nibName = @"FModuleModDate";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostMetadata;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
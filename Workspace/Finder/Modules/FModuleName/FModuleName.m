@@ -238,4 +238,42 @@ static NSString *nibName = @"FModuleName";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostMetadata;
+}
+
+/* the index compares the names without case, which is a superset */
+- (NSString *)indexQuery
+{
+  NSString *format;
+
+  if ([searchStr rangeOfString: @"\""].location != NSNotFound) {
+    return nil;
+  }
+
+  switch(how) {
+    case IS:
+      format = @"GSMDItemFSName == \"%@\"c";
+      break;
+
+    case CONTAINS:
+      format = @"GSMDItemFSName == \"*%@*\"c";
+      break;
+
+    case STARTS:
+      format = @"GSMDItemFSName == \"%@*\"c";
+      break;
+
+    case ENDS:
+      format = @"GSMDItemFSName == \"*%@\"c";
+      break;
+
+    default:
+      return nil;
+  }
+
+  return [NSString stringWithFormat: format, searchStr];
+}
+
 @end
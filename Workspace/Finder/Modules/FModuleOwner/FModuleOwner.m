@@ -199,6 +199,16 @@ static NSString *nibName = @"FModuleOwner";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostMetadata;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
 
 
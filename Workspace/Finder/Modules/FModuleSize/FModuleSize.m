@@ -209,6 +209,16 @@ static NSString *nibName = @"FModuleSize";
   return NO;
 }
 
+- (NSInteger)evaluationCost
+{
+  return FModuleCostMetadata;
+}
+
+- (NSString *)indexQuery
+{
+  return nil;
+}
+
 @end
 
 
@@ -25,6 +25,15 @@
 #ifndef FINDER_MODULES_PROTOCOL_H
 #define FINDER_MODULES_PROTOCOL_H
 
+/* what a module does to check a path, cheapest first: the modules of
+   a search run in this order, and the first one that fails stops it */
+enum {
+  FModuleCostMetadata = 0,    /* the name or the attributes it is given */
+  FModuleCostStat = 1,        /* more calls to the file system */
+  FModuleCostRoundTrip = 2,   /* a question to ddbd */
+  FModuleCostContents = 3     /* reading the file */
+};
+
 @protocol FinderModulesProtocol
 
 - (id)initInterface;
@@ -57,6 +66,12 @@
 
 - (BOOL)metadataModule;
 
+- (NSInteger)evaluationCost;
+
+/* a gmds query that selects at least the paths the module accepts,
+   or nil when the index can't answer for it */
+- (NSString *)indexQuery;
+
 @end 
 
 
@@ -64,6 +79,8 @@
 
 - (NSString *)ddbdGetAnnotationsForPath:(NSString *)path;
 
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths;
+
 @end
 
 #endif // FINDER_MODULES_PROTOCOL_H
@@ -78,7 +78,12 @@
   
   int visibleRows;
   
-  NSMutableArray *foundObjects;
+  NSMutableArray *foundPaths;
+  NSMutableDictionary *sortKeys;
+  NSMutableDictionary *nodesCache;
+  NSMutableArray *nodesCacheOrder;
+  NSMutableArray *pendingResults;
+  NSTimer *resultsTmr;
   FSNInfoType currentOrder;
   
   Finder *finder;
@@ -108,6 +113,19 @@
 
 - (void)nextResult:(NSString *)path;
 
+- (void)nextResults:(NSData *)info;
+
+- (void)flushPendingResults:(id)sender;
+
+- (void)insertResults:(NSArray *)paths;
+
+- (FSNode *)nodeAtIndex:(NSUInteger)index;
+
+- (id)sortKeyOfPath:(NSString *)path;
+
+- (NSComparisonResult)compareResult:(NSString *)p1
+                         withResult:(NSString *)p2;
+
 - (void)endOfSearch;
 
 - (BOOL)searching;
@@ -34,24 +34,42 @@
 #import "FinderModulesProtocol.h"
 #import "FSNode.h"
 #import "FSNodeRep.h"
+#import "FSNSortKeys.h"
+#import "FSNTypeResolver.h"
 #import "FSNPathComponentsViewer.h"
+#import "FSNResultsStore.h"
 #import "GWFunctions.h"
 #import "Dialogs/Dialogs.h"
 
 #define CELLS_HEIGHT (28.0)
 
+/* the nodes of the rows shown lately, the others are made when asked */
+#define NODES_CACHE_SIZE 256
+/* the results are put in the table this often, or when so many */
+#define RESULTS_TIME (0.1)
+#define RESULTS_BATCH 1024
+
 #define LSF_INFO(x) [x stringByAppendingPathComponent: @"lsf.info"]
-#define LSF_FOUND(x) [x stringByAppendingPathComponent: @"lsf.found"]
 
 static NSString *nibName = @"SearchResults";
 static NSString *lsfname = @"LiveSearch.lsf";
 
+static NSComparisonResult compareResults(id p1, id p2, void *context)
+{
+  return [(SearchResults *)context compareResult: p1 withResult: p2];
+}
+
 @implementation SearchResults
 
 - (void)dealloc
 {
   [nc removeObserver: self];
 
+  if (resultsTmr && [resultsTmr isValid]) {
+    [resultsTmr invalidate];
+  }
+  DESTROY (resultsTmr);
+
   if (toolConn != nil) {
     if (searchtool != nil) {
       [searchtool terminate];
@@ -62,7 +80,11 @@ static NSString *lsfname = @"LiveSearch.lsf";
 
   RELEASE (win);
   RELEASE (searchCriteria);
-  RELEASE (foundObjects);
+  RELEASE (foundPaths);
+  RELEASE (sortKeys);
+  RELEASE (nodesCache);
+  RELEASE (nodesCacheOrder);
+  RELEASE (pendingResults);
   RELEASE (searchPaths);
   RELEASE (elementsStr);
   DESTROY (conn);
@@ -190,7 +212,12 @@ static NSString *lsfname = @"LiveSearch.lsf";
     [resultsView setTarget: self];
     [resultsView setDoubleAction: @selector(doubleClickOnResultsView:)];
 
-    foundObjects = [NSMutableArray new];
+    foundPaths = [NSMutableArray new];
+    sortKeys = [NSMutableDictionary new];
+    nodesCache = [NSMutableDictionary new];
+    nodesCacheOrder = [NSMutableArray new];
+    pendingResults = [NSMutableArray new];
+    resultsTmr = nil;
 
     defaults = [NSUserDefaults standardUserDefaults];
     
@@ -350,21 +377,225 @@ static NSString *lsfname = @"LiveSearch.lsf";
 }
                             
 - (void)nextResult:(NSString *)path
+{
+  [self nextResults: [NSArchiver archivedDataWithRootObject: 
+                                       [NSArray arrayWithObject: path]]];
+}
+
+/*
+ * The results found since the last call, archived in an array.  They
+ * wait for the next batch, so the rows and the label are updated once
+ * for many of them.
+ */
+- (void)nextResults:(NSData *)info
+{
+  [pendingResults addObjectsFromArray: 
+                      [NSUnarchiver unarchiveObjectWithData: info]];
+
+  if ([pendingResults count] >= RESULTS_BATCH) {
+    [self flushPendingResults: nil];
+
+  } else if (resultsTmr == nil) {
+    resultsTmr = [NSTimer scheduledTimerWithTimeInterval: RESULTS_TIME
+                                                  target: self
+                                                selector: @selector(flushPendingResults:)
+                                                userInfo: nil
+                                                 repeats: NO];
+    RETAIN (resultsTmr);
+  }
+}
+
+- (void)flushPendingResults:(id)sender
+{
+  if (resultsTmr && [resultsTmr isValid]) {
+    [resultsTmr invalidate];
+  }
+  DESTROY (resultsTmr);
+
+  if ([pendingResults count]) {
+    NSArray *paths = [pendingResults copy];
+
+    [pendingResults removeAllObjects];
+    [self insertResults: paths];
+    RELEASE (paths);
+  }
+}
+
+/*
+ * The batch is sorted and merged in from the first row it goes before,
+ * found with a binary search, so the rows stay in order as they come.
+ */
+- (void)insertResults:(NSArray *)paths
 {
   CREATE_AUTORELEASE_POOL(pool);
-  FSNode *node = [FSNode nodeWithPath: path];
+  NSMutableArray *batch = [NSMutableArray arrayWithArray: paths];
+  NSUInteger count = [foundPaths count];
+  NSMutableArray *selected = [NSMutableArray array];
+  NSEnumerator *enumerator;
+  NSNumber *row;
+  NSArray *tail;
+  NSUInteger lo, hi;
+  NSUInteger i, j;
 
-  [foundObjects addObject: node];
+  [batch sortUsingFunction: compareResults context: self];
 
-  if ([foundObjects count] <= visibleRows) {
-    [resultsView noteNumberOfRowsChanged];
+  lo = 0;
+  hi = count;
+
+  while (lo < hi) {
+    NSUInteger mid = (lo + hi) / 2;
+
+    if ([self compareResult: [foundPaths objectAtIndex: mid]
+                 withResult: [batch objectAtIndex: 0]] == NSOrderedDescending) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
   }
 
+  /* the selected rows move with the ones inserted before them */
+  if (lo < count) {
+    enumerator = [resultsView selectedRowEnumerator];
+
+    while ((row = [enumerator nextObject])) {
+      [selected addObject: [foundPaths objectAtIndex: [row intValue]]];
+    }
+  }
+
+  tail = [foundPaths subarrayWithRange: NSMakeRange(lo, count - lo)];
+  [foundPaths removeObjectsInRange: NSMakeRange(lo, count - lo)];
+
+  i = 0;
+  j = 0;
+
+  while ((i < [tail count]) || (j < [batch count])) {
+    if ((j == [batch count]) 
+          || ((i < [tail count]) 
+               && ([self compareResult: [tail objectAtIndex: i]
+                            withResult: [batch objectAtIndex: j]] 
+                                            != NSOrderedDescending))) {
+      [foundPaths addObject: [tail objectAtIndex: i++]];
+    } else {
+      [foundPaths addObject: [batch objectAtIndex: j++]];
+    }
+  }
+
+  [resultsView noteNumberOfRowsChanged];
+
+  if ([selected count]) {
+    [resultsView deselectAll: self];
+
+    for (i = 0; i < [selected count]; i++) {
+      NSUInteger index = [foundPaths indexOfObject: [selected objectAtIndex: i]];
+
+      [resultsView selectRow: index byExtendingSelection: (i != 0)];
+    }
+  }
+
+  [resultsView reloadData];
+
   [elementsLabel setStringValue: [NSString stringWithFormat: @"%lu %@", 
-                                           (unsigned long)[foundObjects count], elementsStr]];
+                                           (unsigned long)[foundPaths count], elementsStr]];
   RELEASE (pool);
 }
 
+- (FSNode *)nodeAtIndex:(NSUInteger)index
+{
+  NSString *path = [foundPaths objectAtIndex: index];
+  FSNode *node = [nodesCache objectForKey: path];
+
+  if (node) {
+    [nodesCacheOrder removeObject: path];
+
+  } else {
+    node = [FSNode nodeWithPath: path];
+
+    if ([nodesCacheOrder count] >= NODES_CACHE_SIZE) {
+      [nodesCache removeObjectForKey: [nodesCacheOrder objectAtIndex: 0]];
+      [nodesCacheOrder removeObjectAtIndex: 0];
+    }
+
+    [nodesCache setObject: node forKey: path];
+  }
+
+  [nodesCacheOrder addObject: path];
+
+  return node;
+}
+
+/* what the rows are sorted by in the current order */
+- (id)sortKeyOfPath:(NSString *)path
+{
+  id key = [sortKeys objectForKey: path];
+
+  if (key == nil) {
+    CREATE_AUTORELEASE_POOL(arp);
+    FSNode *node = [nodesCache objectForKey: path];
+
+    if (node == nil) {
+      node = [FSNode nodeWithPath: path];
+    }
+
+    switch(currentOrder) {
+      case FSNInfoKindType:
+        key = [NSArray arrayWithObjects: 
+              [NSNumber numberWithUnsignedInteger: 
+                [[FSNTypeResolver sharedResolver] rankOfKind: [node kindIdentifier]]],
+                                          [node nameSortKey], nil];
+        break;
+      case FSNInfoDateType:
+        key = [node modificationDate];
+        if (key == nil) {
+          key = [NSDate distantPast];
+        }
+        break;
+      case FSNInfoSizeType:
+        key = [NSNumber numberWithUnsignedLongLong: [node fileSize]];
+        break;
+      default:
+        key = [node nameSortKey];
+        break;
+    }
+
+    [sortKeys setObject: key forKey: path];
+    RELEASE (arp);
+  }
+
+  return key;
+}
+
+/* the orders of the FSNode -compareAccordingTo... methods */
+- (NSComparisonResult)compareResult:(NSString *)p1
+                         withResult:(NSString *)p2
+{
+  id k1, k2;
+
+  if (currentOrder == FSNInfoParentType) {
+    return [[p1 stringByDeletingLastPathComponent] 
+                  compare: [p2 stringByDeletingLastPathComponent]];
+  }
+
+  k1 = [self sortKeyOfPath: p1];
+  k2 = [self sortKeyOfPath: p2];
+
+  switch(currentOrder) {
+    case FSNInfoKindType:
+      {
+        NSComparisonResult r = [[k1 objectAtIndex: 0] compare: [k2 objectAtIndex: 0]];
+
+        if (r == NSOrderedSame) {
+          r = FSNCompareSortKeys([k1 objectAtIndex: 1], [k2 objectAtIndex: 1]);
+        }
+        return r;
+      }
+    case FSNInfoDateType:
+    case FSNInfoSizeType:
+      return [k2 compare: k1];
+    default:
+      return FSNCompareSortKeys(k1, k2);
+  }
+}
+
 - (void)endOfSearch
 {
   [stopButt setEnabled: NO];
@@ -381,7 +612,9 @@ static NSString *lsfname = @"LiveSearch.lsf";
     DESTROY (toolConn);
   }
 
-  [self updateShownData];
+  /* the rows are already in order */
+  [self flushPendingResults: nil];
+  [resultsView reloadData];
 }
 
 - (BOOL)searching
@@ -400,7 +633,11 @@ static NSString *lsfname = @"LiveSearch.lsf";
 {
   if (searchtool == nil) {
     [pathViewer showComponentsOfSelection: nil];
-    [foundObjects removeAllObjects];
+    [foundPaths removeAllObjects];
+    [pendingResults removeAllObjects];
+    [sortKeys removeAllObjects];
+    [nodesCache removeAllObjects];
+    [nodesCacheOrder removeAllObjects];
     [resultsView reloadData];
     [self activateForSelection: searchPaths
             withSearchCriteria: searchCriteria
@@ -410,37 +647,32 @@ static NSString *lsfname = @"LiveSearch.lsf";
 
 - (void)updateShownData
 {
-  SEL sortingSel;
   NSTableColumn *column;
 
   switch(currentOrder) {
     case FSNInfoNameType:
-      sortingSel = @selector(compareAccordingToName:);
       column = nameColumn;
       break;
     case FSNInfoParentType:
-      sortingSel = @selector(compareAccordingToParent:);
       column = parentColumn;
       break;
     case FSNInfoKindType:
-      sortingSel = @selector(compareAccordingToKind:);
       column = kindColumn;
       break;
     case FSNInfoDateType:
-      sortingSel = @selector(compareAccordingToDate:);
       column = dateColumn;
       break;
     case FSNInfoSizeType:
-      sortingSel = @selector(compareAccordingToSize:);
       column = sizeColumn;
       break;
     default:
-      sortingSel = @selector(compareAccordingToName:);
       column = nameColumn;
       break;
   }
 
-  [foundObjects sortUsingSelector: sortingSel];
+  /* the keys are of the order they were made for */
+  [sortKeys removeAllObjects];
+  [foundPaths sortUsingFunction: compareResults context: self];
   [resultsView setHighlightedTableColumn: column];
   [resultsView reloadData];
 }
@@ -457,11 +689,11 @@ static NSString *lsfname = @"LiveSearch.lsf";
   NSNumber *row;
   
   while ((row = [enumerator nextObject])) {
-	  FSNode *node = [foundObjects objectAtIndex: [row intValue]];
+	  FSNode *node = [self nodeAtIndex: [row intValue]];
     if ([node isValid]) {
       [selected addObject: node];
     } else {
-      [foundObjects removeObject: node];
+      [foundPaths removeObject: [node path]];
       [resultsView noteNumberOfRowsChanged];
     }
   }
@@ -480,7 +712,7 @@ static NSString *lsfname = @"LiveSearch.lsf";
   
   for (i = 0; i < [objects count]; i++) {
     FSNode *node = [objects objectAtIndex: i];
-    int index = [foundObjects indexOfObject: node];
+    int index = [foundPaths indexOfObject: [node path]];
     
     [resultsView selectRow: index byExtendingSelection: (i != 0)];
   }
@@ -494,7 +726,7 @@ static NSString *lsfname = @"LiveSearch.lsf";
   NSString *destination = [info objectForKey: @"destination"];
   NSArray *files = [info objectForKey: @"files"];
   NSMutableArray *deletedObjects = [NSMutableArray array];
-  NSUInteger i, j;
+  NSUInteger i;
 
   if ([operation isEqual: @"WorkspaceRenameOperation"]) {
     files = [NSArray arrayWithObject: [destination lastPathComponent]];
@@ -513,34 +745,29 @@ static NSString *lsfname = @"LiveSearch.lsf";
       NSString *fname = [files objectAtIndex: i];
       NSString *fullPath = [source stringByAppendingPathComponent: fname];
       
-      for (j = 0; j < [foundObjects count]; j++) {
-        FSNode *node = [foundObjects objectAtIndex: j];
-        NSString *path = [node path];
-      
-        if ([fullPath isEqual: path]) {
-          [deletedObjects addObject: node];
-        }
+      if ([foundPaths containsObject: fullPath]) {
+        [deletedObjects addObject: fullPath];
       }
     }
     
   } else if ([operation isEqual: @"WorkspaceRenameOperation"]) {
-    for (i = 0; i < [foundObjects count]; i++) {
-      FSNode *node = [foundObjects objectAtIndex: i];
-      NSString *path = [node path];
-
-      if ([source isEqual: path]) {
-        [deletedObjects addObject: node];
-      }
+    if ([foundPaths containsObject: source]) {
+      [deletedObjects addObject: source];
     }
   }
   
   if ([deletedObjects count]) {
     for (i = 0; i < [deletedObjects count]; i++) {
-      [foundObjects removeObject: [deletedObjects objectAtIndex: i]];
+      NSString *path = [deletedObjects objectAtIndex: i];
+
+      [foundPaths removeObject: path];
+      [sortKeys removeObjectForKey: path];
+      [nodesCache removeObjectForKey: path];
+      [nodesCacheOrder removeObject: path];
     }
     
     [resultsView deselectAll: self];
-    [self updateShownData];
+    [resultsView reloadData];
   }
 }
 
@@ -658,13 +885,8 @@ static NSString *lsfname = @"LiveSearch.lsf";
                      userInfo: notifDict];
 
     if ([fm createDirectoryAtPath: lsfpath attributes: nil]) {
-      NSMutableArray *foundPaths = [NSMutableArray array];
       NSMutableDictionary *lsfdict = [NSMutableDictionary dictionary];
-      int i;
-   
-      for (i = 0; i < [foundObjects count]; i++) {
-        [foundPaths addObject: [[foundObjects objectAtIndex: i] path]];
-      }
+      FSNResultsStore *results;
    
       [lsfdict setObject: searchPaths forKey: @"searchpaths"];	
       [lsfdict setObject: searchCriteria forKey: @"criteria"];	
@@ -673,7 +895,10 @@ static NSString *lsfname = @"LiveSearch.lsf";
       [lsfdict setObject: [[NSDate date] description] forKey: @"lastupdate"];	
    
       lsfdone = [lsfdict writeToFile: LSF_INFO(lsfpath) atomically: YES];
-      lsfdone = [foundPaths writeToFile: LSF_FOUND(lsfpath) atomically: YES];
+      results = [[FSNResultsStore alloc] initWithDirectory: lsfpath
+                                                  writable: YES];
+      lsfdone = (lsfdone && [results setPaths: foundPaths]);
+      RELEASE (results);
     } else {
       lsfdone = NO;
     }
@@ -733,14 +958,14 @@ static NSString *lsfname = @"LiveSearch.lsf";
 //
 - (NSInteger)numberOfRowsInTableView:(NSTableView *)aTableView
 {
-  return [foundObjects count];
+  return [foundPaths count];
 }
 
 - (id)tableView:(NSTableView *)aTableView
           objectValueForTableColumn:(NSTableColumn *)aTableColumn
                                 row:(NSInteger)rowIndex
 {
-  FSNode *node = [foundObjects objectAtIndex: rowIndex];
+  FSNode *node = [self nodeAtIndex: rowIndex];
   
   if (aTableColumn == nameColumn) {
     return [node name];
@@ -767,7 +992,7 @@ static NSString *lsfname = @"LiveSearch.lsf";
 
   for (i = 0; i < [rows count]; i++) {
     int index = [[rows objectAtIndex: i] intValue];
-    FSNode *node = [foundObjects objectAtIndex: index];
+    FSNode *node = [self nodeAtIndex: index];
     NSString *parentPath = [node parentPath];
     
     if (([parentPaths containsObject: parentPath] == NO) && (i != 0)) {
@@ -811,7 +1036,7 @@ static NSString *lsfname = @"LiveSearch.lsf";
 {
   if (aTableColumn == nameColumn) {
     FSNTextCell *cell = (FSNTextCell *)[nameColumn dataCell];
-    FSNode *node = [foundObjects objectAtIndex: rowIndex];
+    FSNode *node = [self nodeAtIndex: rowIndex];
 
     [cell setIcon: [[FSNodeRep sharedInstance] iconOfSize: 24 forNode: node]];
     
@@ -855,7 +1080,7 @@ static NSString *lsfname = @"LiveSearch.lsf";
     return [[FSNodeRep sharedInstance] multipleSelectionIconOfSize: 24];
   } else {
     int index = [[dragRows objectAtIndex: 0] intValue];
-    FSNode *node = [foundObjects objectAtIndex: index];
+    FSNode *node = [self nodeAtIndex: index];
     
     return [[FSNodeRep sharedInstance] iconOfSize: 24 forNode: node];
   }
@@ -11,7 +11,7 @@
 #import <Foundation/Foundation.h>
 #include <X11/Xlib.h>
 
-@interface GSGlobalShortcutsManager : NSObject
+@interface GSGlobalShortcutsManager : NSObject <RunLoopEvents>
 {
     NSMutableDictionary *shortcuts;
     Display *display;
@@ -23,7 +23,10 @@
     BOOL verbose;
     time_t lastDefaultsModTime;
     NSString *defaultsDomain;
-    NSTimer *eventProcessingTimer;
+    // Is the X connection watched from the run loop?
+    BOOL watchingConnection;
+    // Grabbed (keycode, modifiers) -> key combo string, built by -grabKeys
+    NSMutableDictionary *grabbedCombos;
 
     // Power key handling
     // Keycode for XF86PowerOff (0 if not available)
@@ -58,6 +58,27 @@ static KeySym keysymFromName(NSString *name)
     return XStringToKeysym([name UTF8String]);
 }
 
+// Key of a grabbed combination in the lookup table: the lock keys are
+// masked out of the modifiers before
+static NSNumber *comboKey(unsigned int keycode, unsigned int modifiers)
+{
+    return [NSNumber numberWithUnsignedLongLong:
+                       (((unsigned long long)keycode) << 32) | modifiers];
+}
+
+// The run loop modes the X connection is watched in, so shortcuts work
+// while a menu is tracked or a panel is modal
+static NSArray *x11RunLoopModes(void)
+{
+    static NSArray *modes = nil;
+    if (modes == nil) {
+        modes = [[NSArray alloc] initWithObjects:NSDefaultRunLoopMode,
+                                                 NSModalPanelRunLoopMode,
+                                                 NSEventTrackingRunLoopMode, nil];
+    }
+    return modes;
+}
+
 // Return YES if the given key combo represents Alt (or Mod1) + Space
 static BOOL isAltSpaceCombo(NSString *keyCombo)
 {
@@ -102,7 +123,8 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
         verbose = NO;
         lastDefaultsModTime = 0;
         defaultsDomain = @"GlobalShortcuts";
-        eventProcessingTimer = nil;
+        watchingConnection = NO;
+        grabbedCombos = [[NSMutableDictionary alloc] init];
 
         // Power key initial state
         powerKeyCode = 0;
@@ -148,6 +170,7 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
     [[NSDistributedNotificationCenter defaultCenter] removeObserver:self];
     [self stop];
     [shortcuts release];
+    [grabbedCombos release];
     [defaultsDomain release];
     [super dealloc];
 }
@@ -191,9 +214,17 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
     if (running) {
         running = NO;
         
-        if (eventProcessingTimer) {
-            [eventProcessingTimer invalidate];
-            DESTROY(eventProcessingTimer);
+        if (watchingConnection) {
+            void *fd = (void *)(uintptr_t)ConnectionNumber(display);
+            NSArray *modes = x11RunLoopModes();
+
+            for (NSUInteger i = 0; i < [modes count]; i++) {
+                [[NSRunLoop currentRunLoop] removeEvent:fd
+                                                   type:ET_RDESC
+                                                forMode:[modes objectAtIndex:i]
+                                                    all:NO];
+            }
+            watchingConnection = NO;
         }
 
         if (powerKeyTimer) {
@@ -205,6 +236,7 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
         }
         
         [self ungrabKeys];
+        [grabbedCombos removeAllObjects];
         if (display) {
             XCloseDisplay(display);
             display = NULL;
@@ -394,6 +426,12 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
     // at the X11 level before the window manager can intercept it.
     [self grabCloseWindowShortcut];
 
+    // The round trips of the grabs may have queued events in Xlib that
+    // the descriptor will not announce
+    if (watchingConnection) {
+        [self performSelector:@selector(processX11Events) withObject:nil afterDelay:0.0];
+    }
+
     // Consider the manager started if either we grabbed any user shortcuts
     // or we successfully grabbed the power key (so Workspace can always handle power presses)
     return (successCount > 0) || (powerKeyCode != 0);
@@ -469,6 +507,9 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
     for (int i = 0; i < 8; i++) {
         XGrabKey(display, keycode, modifiers[i], rootWindow, True, GrabModeAsync, GrabModeAsync);
     }
+
+    // A key press finds its combo here instead of parsing every combo string
+    [grabbedCombos setObject:keyCombo forKey:comboKey(keycode, modifier)];
     
     if (verbose) {
         NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Grabbed key combo: %@", keyCombo);
@@ -487,6 +528,8 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
         return;
     }
 
+    [grabbedCombos removeObjectsForKeys:[grabbedCombos allKeysForObject:keyCombo]];
+
     NSArray *parts = parseKeyCombo(keyCombo);
     if (!parts || [parts count] < 1) {
         if (verbose) {
@@ -567,69 +610,59 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
     }
 }
 
-- (BOOL)matchesEvent:(XKeyEvent *)keyEvent withKeyCombo:(NSString *)keyCombo
+// The combo grabbed for the event's keycode and modifiers (lock keys
+// ignored), from the table -grabKeys built
+- (NSString *)keyComboForEvent:(XKeyEvent *)keyEvent
 {
-    NSArray *parts = parseKeyCombo(keyCombo);
-    if (!parts || [parts count] < 1) return NO;
-    
-    unsigned int modifier = 0;
-    NSString *keyString = nil;
-    
-    for (int i = 0; i < [parts count] - 1; i++) {
-        NSString *part = [parts objectAtIndex:i];
-        if ([part isEqualToString:@"ctrl"]) {
-            modifier |= ControlMask;
-        } else if ([part isEqualToString:@"shift"]) {
-            modifier |= ShiftMask;
-        } else if ([part isEqualToString:@"alt"] || [part isEqualToString:@"mod1"]) {
-            modifier |= Mod1Mask;
-        } else if ([part isEqualToString:@"super"] || [part isEqualToString:@"mod4"]) {
-            modifier |= Mod4Mask;
-        }
-    }
-    
-    keyString = [parts objectAtIndex:[parts count] - 1];
-    KeySym keysym = keysymFromName(keyString);
-    if (keysym == NoSymbol) return NO;
-    
-    KeyCode keycode = XKeysymToKeycode(display, keysym);
-    if (keycode == 0) return NO;
-    
-    // Check if keycode matches
-    if (keyEvent->keycode != keycode) return NO;
-    
-    // Check if modifiers match (ignoring lock keys)
     unsigned int eventMods = keyEvent->state & ~(numlock_mask | capslock_mask | scrolllock_mask);
-    if (eventMods != modifier) return NO;
-    
-    return YES;
+    return [grabbedCombos objectForKey:comboKey(keyEvent->keycode, eventMods)];
+}
+
+- (BOOL)matchesEvent:(XKeyEvent *)keyEvent withKeyCombo:(NSString *)keyCombo
+{
+    return [[self keyComboForEvent:keyEvent] isEqualToString:keyCombo];
 }
 
 - (BOOL)setupEventProcessing
 {
-    // Create a timer that periodically processes X11 events
-    // This integrates with the NSApplication event loop
-    eventProcessingTimer = [[NSTimer scheduledTimerWithTimeInterval:0.05
-                                                             target:self
-                                                           selector:@selector(processX11Events)
-                                                           userInfo:nil
-                                                            repeats:YES] retain];
-    
-    NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Event processing timer started (50ms interval)");
+    // Watch the X connection from the run loop: events are read only
+    // when the server sent some, with no periodic wakeups
+    void *fd = (void *)(uintptr_t)ConnectionNumber(display);
+    NSArray *modes = x11RunLoopModes();
+
+    for (NSUInteger i = 0; i < [modes count]; i++) {
+        [[NSRunLoop currentRunLoop] addEvent:fd
+                                        type:ET_RDESC
+                                     watcher:self
+                                     forMode:[modes objectAtIndex:i]];
+    }
+    watchingConnection = YES;
+
+    // Xlib may already hold events read during the setup
+    [self processX11Events];
+
+    NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Watching X connection (fd %d)", ConnectionNumber(display));
     return YES;
 }
 
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+    [self processX11Events];
+}
+
 - (void)processX11Events
 {
     if (!display || !rootWindow) return;
     
     XEvent event;
-    int eventsProcessed = 0;
-    const int maxEventsPerCall = 10; // Limit to prevent CPU hogging
     
-    while (XPending(display) > 0 && eventsProcessed < maxEventsPerCall) {
+    // Drain everything: what Xlib has queued is not announced by the
+    // descriptor again
+    while (XPending(display) > 0) {
         XNextEvent(display, &event);
-        eventsProcessed++;
         
         if (event.type == KeyPress) {
             if (verbose) {
@@ -661,22 +694,18 @@ static BOOL isAltSpaceCombo(NSString *keyCombo)
             event.xkey.state &= ~(numlock_mask | capslock_mask | scrolllock_mask);
             
             // Find matching shortcut
-            NSEnumerator *enumerator = [shortcuts keyEnumerator];
-            NSString *keyCombo;
+            NSString *keyCombo = [self keyComboForEvent:&event.xkey];
+            NSDictionary *shortcutDict = keyCombo ? [shortcuts objectForKey:keyCombo] : nil;
             
-            while ((keyCombo = [enumerator nextObject])) {
-                if ([self matchesEvent:&event.xkey withKeyCombo:keyCombo]) {
-                    NSDictionary *shortcutDict = [shortcuts objectForKey:keyCombo];
-                    NSString *command = [shortcutDict objectForKey:@"command"];
-                    NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Executing command for %@: %@",
-                        keyCombo, command);
-                    
-                    if (![self runCommand:command]) {
-                        NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Warning: Failed to execute command: %@",
-                            command);
-                        [self showCommandFailureAlert:command shortcut:keyCombo];
-                    }
-                    break;
+            if (shortcutDict) {
+                NSString *command = [shortcutDict objectForKey:@"command"];
+                NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Executing command for %@: %@",
+                    keyCombo, command);
+                
+                if (![self runCommand:command]) {
+                    NSDebugLLog(@"gwspace", @"GSGlobalShortcutsManager: Warning: Failed to execute command: %@",
+                        command);
+                    [self showCommandFailureAlert:command shortcut:keyCombo];
                 }
             }
         } else if (event.type == KeyRelease) {
@@ -0,0 +1,96 @@
+/* GWAppRegistry.h
+ *
+ * The installed applications, indexed once by the extensions and MIME
+ * types they declare, for the Open With menus.
+ *
+ * The application directories of every domain, and the folders directly
+ * in them, are read for .app bundles; the types each one takes come from
+ * its Info-gnustep.plist (NSTypes: NSUnixExtensions, NSMIMETypes) or its
+ * Info.plist (CFBundleDocumentTypes).  Workspace watches those directories
+ * with fswatcher and hands their events to -applicationDirectoryDidChange:,
+ * which reads that directory again.  An application whose Info.plist is
+ * edited in place, or still being written when its bundle appears, is
+ * seen at the next change to its directory or at the end of the file
+ * operation that copied it.
+ *
+ * Answers are precomputed sets, and the answer for a set of types is kept
+ * until the registry changes.  Safe to use from any thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GWAPPREGISTRY_H
+#define GWAPPREGISTRY_H
+
+#import <Foundation/Foundation.h>
+
+@interface GWAppRegistry : NSObject
+{
+  NSRecursiveLock *lock;
+  NSArray *rootDirectories;
+  NSMutableDictionary *directoryApps;   /* directory -> { app name -> types } */
+  NSMutableDictionary *appsByExtension; /* extension -> NSSet of app names */
+  NSMutableDictionary *appsByMIMEType;  /* MIME type -> NSSet of app names */
+  NSMutableDictionary *answers;         /* sorted types -> NSArray */
+  BOOL built;
+  unsigned long generation;
+}
+
++ (GWAppRegistry *)sharedRegistry;
+
+/**
+ * The extensions and MIME types an application's info dictionary
+ * declares, lowercased: { "extensions" = (...); "mimetypes" = (...); }.
+ */
++ (NSDictionary *)typesOfApplicationWithInfo:(NSDictionary *)info;
+
+/**
+ * The type a file is matched by: its extension, lowercased, or its whole
+ * name when it has none ("makefile").
+ */
++ (NSString *)typeOfFileAtPath:(NSString *)path;
+
+/**
+ * A registry of the applications in `dirs` and the folders in them; the
+ * shared one reads the application directories of every domain.
+ */
+- (id)initWithDirectories:(NSArray *)dirs;
+
+/**
+ * Reads the application directories, if they have not been read yet.
+ */
+- (void)build;
+
+/**
+ * The directories read, the roots and the folders in them, to be
+ * watched.
+ */
+- (NSArray *)watchedDirectories;
+
+- (BOOL)isWatchedDirectory:(NSString *)path;
+
+/**
+ * Reads `path` again after an fswatcher event in it; YES when the
+ * applications it holds, or their types, changed.
+ */
+- (BOOL)applicationDirectoryDidChange:(NSString *)path;
+
+/**
+ * The application names ("TextEdit.app") that open every one of `types`,
+ * extensions or MIME types, sorted by name.
+ */
+- (NSArray *)applicationsForTypes:(NSSet *)types;
+
+/**
+ * -applicationsForTypes: for the types of the files at `paths`.
+ */
+- (NSArray *)applicationsForFiles:(NSArray *)paths;
+
+/**
+ * Bumped each time the registry changes.
+ */
+- (unsigned long)generation;
+
+@end
+
+#endif /* GWAPPREGISTRY_H */
@@ -0,0 +1,457 @@
+/* GWAppRegistry.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import "GWAppRegistry.h"
+
+/* past it the answers go, all of them */
+#define REGISTRY_MAX_ANSWERS 256
+
+static GWAppRegistry *sharedRegistry = nil;
+
+
+static void
+addTypes(NSMutableSet *to, id types)
+{
+  NSUInteger i;
+
+  if ([types isKindOfClass: [NSString class]])
+    types = [NSArray arrayWithObject: types];
+
+  if ([types isKindOfClass: [NSArray class]] == NO)
+    return;
+
+  for (i = 0; i < [types count]; i++)
+    {
+      id type = [types objectAtIndex: i];
+
+      /* "*" is any file, which is not a reason to be offered */
+      if ([type isKindOfClass: [NSString class]]
+          && [type length] && ([type isEqual: @"*"] == NO))
+        [to addObject: [type lowercaseString]];
+    }
+}
+
+static void
+addApp(NSMutableDictionary *index, NSArray *types, NSString *app)
+{
+  NSUInteger i;
+
+  for (i = 0; i < [types count]; i++)
+    {
+      NSString *type = [types objectAtIndex: i];
+      NSMutableSet *apps = [index objectForKey: type];
+
+      if (apps == nil)
+        {
+          apps = [NSMutableSet new];
+          [index setObject: apps forKey: type];
+          RELEASE (apps);
+        }
+      [apps addObject: app];
+    }
+}
+
+
+@interface GWAppRegistry (Private)
+- (NSDictionary *)appsInDirectory:(NSString *)dir
+                       subfolders:(NSMutableArray *)subfolders;
+- (BOOL)readDirectory:(NSString *)dir;
+- (void)reindex;
+@end
+
+
+@implementation GWAppRegistry
+
++ (GWAppRegistry *)sharedRegistry
+{
+  if (sharedRegistry == nil)
+    {
+      sharedRegistry = [GWAppRegistry new];
+    }
+  return sharedRegistry;
+}
+
++ (NSDictionary *)typesOfApplicationWithInfo:(NSDictionary *)info
+{
+  NSMutableSet *exts = [NSMutableSet set];
+  NSMutableSet *mimes = [NSMutableSet set];
+  id entry = [info objectForKey: @"NSTypes"];
+  NSUInteger i;
+
+  if ([entry isKindOfClass: [NSArray class]])
+    {
+      for (i = 0; i < [entry count]; i++)
+        {
+          id dict = [entry objectAtIndex: i];
+
+          if ([dict isKindOfClass: [NSDictionary class]] == NO)
+            continue;
+
+          addTypes(exts, [dict objectForKey: @"NSUnixExtensions"]);
+          addTypes(exts, [dict objectForKey: @"NSDOSExtensions"]);
+          addTypes(mimes, [dict objectForKey: @"NSMIMETypes"]);
+        }
+    }
+
+  entry = [info objectForKey: @"CFBundleDocumentTypes"];
+
+  if ([entry isKindOfClass: [NSArray class]])
+    {
+      for (i = 0; i < [entry count]; i++)
+        {
+          id dict = [entry objectAtIndex: i];
+
+          if ([dict isKindOfClass: [NSDictionary class]] == NO)
+            continue;
+
+          addTypes(exts, [dict objectForKey: @"CFBundleTypeExtensions"]);
+          addTypes(mimes, [dict objectForKey: @"CFBundleTypeMIMETypes"]);
+        }
+    }
+
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         [[exts allObjects] sortedArrayUsingSelector: @selector(compare:)],
+                         @"extensions",
+                         [[mimes allObjects] sortedArrayUsingSelector: @selector(compare:)],
+                         @"mimetypes",
+                         nil];
+}
+
++ (NSString *)typeOfFileAtPath:(NSString *)path
+{
+  NSString *ext = [[path pathExtension] lowercaseString];
+
+  if ([ext length] == 0)
+    ext = [[path lastPathComponent] lowercaseString];
+
+  return ext;
+}
+
+- (void)dealloc
+{
+  RELEASE (lock);
+  RELEASE (rootDirectories);
+  RELEASE (directoryApps);
+  RELEASE (appsByExtension);
+  RELEASE (appsByMIMEType);
+  RELEASE (answers);
+  [super dealloc];
+}
+
+- (id)init
+{
+  return [self initWithDirectories:
+                 NSSearchPathForDirectoriesInDomains(NSAllApplicationsDirectory,
+                                                     NSAllDomainsMask, YES)];
+}
+
+- (id)initWithDirectories:(NSArray *)dirs
+{
+  self = [super init];
+
+  if (self)
+    {
+      NSMutableArray *roots = [NSMutableArray array];
+      NSUInteger i;
+
+      for (i = 0; i < [dirs count]; i++)
+        {
+          NSString *dir = [[dirs objectAtIndex: i] stringByStandardizingPath];
+
+          if ([roots containsObject: dir] == NO)
+            [roots addObject: dir];
+        }
+
+      lock = [NSRecursiveLock new];
+      rootDirectories = [roots copy];
+      directoryApps = [NSMutableDictionary new];
+      appsByExtension = [NSMutableDictionary new];
+      appsByMIMEType = [NSMutableDictionary new];
+      answers = [NSMutableDictionary new];
+      built = NO;
+      generation = 0;
+    }
+
+  return self;
+}
+
+- (void)build
+{
+  NSUInteger i;
+
+  [lock lock];
+
+  if (built == NO)
+    {
+      for (i = 0; i < [rootDirectories count]; i++)
+        [self readDirectory: [rootDirectories objectAtIndex: i]];
+
+      [self reindex];
+      built = YES;
+    }
+
+  [lock unlock];
+}
+
+- (NSArray *)watchedDirectories
+{
+  NSArray *dirs;
+
+  [lock lock];
+  dirs = [[directoryApps allKeys] sortedArrayUsingSelector: @selector(compare:)];
+  [lock unlock];
+
+  return dirs;
+}
+
+- (BOOL)isWatchedDirectory:(NSString *)path
+{
+  BOOL watched;
+
+  [lock lock];
+  watched = ([directoryApps objectForKey: path] != nil);
+  [lock unlock];
+
+  return watched;
+}
+
+- (BOOL)applicationDirectoryDidChange:(NSString *)path
+{
+  BOOL changed = NO;
+
+  [lock lock];
+
+  if (built && ([directoryApps objectForKey: path] != nil))
+    {
+      changed = [self readDirectory: path];
+
+      if (changed)
+        [self reindex];
+    }
+
+  [lock unlock];
+
+  return changed;
+}
+
+- (NSArray *)applicationsForTypes:(NSSet *)types
+{
+  NSArray *sorted = [[types allObjects] sortedArrayUsingSelector: @selector(compare:)];
+  NSArray *apps;
+
+  if ([sorted count] == 0)
+    return [NSArray array];
+
+  [self build];
+  [lock lock];
+
+  apps = [answers objectForKey: sorted];
+
+  if (apps == nil)
+    {
+      NSMutableSet *common = nil;
+      NSUInteger i;
+
+      for (i = 0; i < [sorted count]; i++)
+        {
+          NSString *type = [[sorted objectAtIndex: i] lowercaseString];
+          NSMutableSet *matching = [NSMutableSet set];
+          NSSet *set;
+
+          if ((set = [appsByExtension objectForKey: type]))
+            [matching unionSet: set];
+          if ((set = [appsByMIMEType objectForKey: type]))
+            [matching unionSet: set];
+
+          if (common == nil)
+            common = matching;
+          else
+            [common intersectSet: matching];
+
+          if ([common count] == 0)
+            break;
+        }
+
+      apps = [[common allObjects] sortedArrayUsingSelector:
+                                    @selector(caseInsensitiveCompare:)];
+
+      if ([answers count] >= REGISTRY_MAX_ANSWERS)
+        [answers removeAllObjects];
+
+      [answers setObject: apps forKey: sorted];
+    }
+
+  RETAIN (apps);
+  [lock unlock];
+
+  return AUTORELEASE (apps);
+}
+
+- (NSArray *)applicationsForFiles:(NSArray *)paths
+{
+  NSMutableSet *types = [NSMutableSet set];
+  NSUInteger i;
+
+  for (i = 0; i < [paths count]; i++)
+    [types addObject: [GWAppRegistry typeOfFileAtPath: [paths objectAtIndex: i]]];
+
+  return [self applicationsForTypes: types];
+}
+
+- (unsigned long)generation
+{
+  unsigned long gen;
+
+  [lock lock];
+  gen = generation;
+  [lock unlock];
+
+  return gen;
+}
+
+@end
+
+
+@implementation GWAppRegistry (Private)
+
+/* The types of the .app bundles in `dir`; the plain folders beside them
+   go in `subfolders`. */
+- (NSDictionary *)appsInDirectory:(NSString *)dir
+                       subfolders:(NSMutableArray *)subfolders
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSArray *contents = [fm directoryContentsAtPath: dir];
+  NSMutableDictionary *apps = [NSMutableDictionary dictionary];
+  NSUInteger i;
+
+  for (i = 0; i < [contents count]; i++)
+    {
+      NSString *name = [contents objectAtIndex: i];
+      NSString *path = [dir stringByAppendingPathComponent: name];
+      BOOL isdir;
+
+      if ([name hasPrefix: @"."]
+          || ([fm fileExistsAtPath: path isDirectory: &isdir] == NO)
+          || (isdir == NO))
+        continue;
+
+      if ([[name pathExtension] isEqual: @"app"])
+        {
+          /* read as files, not with NSBundle, which keeps what it read */
+          NSArray *plists = [NSArray arrayWithObjects:
+                                       @"Resources/Info-gnustep.plist",
+                                       @"Contents/Info.plist",
+                                       @"Resources/Info.plist",
+                                       nil];
+          NSDictionary *info = nil;
+          NSUInteger j;
+
+          for (j = 0; (j < [plists count]) && (info == nil); j++)
+            {
+              info = [NSDictionary dictionaryWithContentsOfFile:
+                        [path stringByAppendingPathComponent: [plists objectAtIndex: j]]];
+            }
+
+          [apps setObject: (info ? [GWAppRegistry typesOfApplicationWithInfo: info]
+                                 : [NSDictionary dictionary])
+                   forKey: name];
+        }
+      else if (subfolders)
+        {
+          [subfolders addObject: path];
+        }
+    }
+
+  return apps;
+}
+
+/* Reads `dir` again, and a root's folders; YES when anything changed. */
+- (BOOL)readDirectory:(NSString *)dir
+{
+  BOOL isroot = [rootDirectories containsObject: dir];
+  NSMutableArray *subfolders = isroot ? [NSMutableArray array] : nil;
+  NSFileManager *fm = [NSFileManager defaultManager];
+  BOOL changed = NO;
+  BOOL isdir;
+
+  if (([fm fileExistsAtPath: dir isDirectory: &isdir] == NO) || (isdir == NO))
+    {
+      changed = ([directoryApps objectForKey: dir] != nil);
+      [directoryApps removeObjectForKey: dir];
+    }
+  else
+    {
+      NSDictionary *apps = [self appsInDirectory: dir subfolders: subfolders];
+
+      if ([apps isEqual: [directoryApps objectForKey: dir]] == NO)
+        {
+          [directoryApps setObject: apps forKey: dir];
+          changed = YES;
+        }
+    }
+
+  if (isroot)
+    {
+      NSString *prefix = [dir stringByAppendingString: @"/"];
+      NSArray *known = [directoryApps allKeys];
+      NSUInteger i;
+
+      /* the folders that went away */
+      for (i = 0; i < [known count]; i++)
+        {
+          NSString *path = [known objectAtIndex: i];
+
+          if ([path hasPrefix: prefix] && ([subfolders containsObject: path] == NO))
+            {
+              [directoryApps removeObjectForKey: path];
+              changed = YES;
+            }
+        }
+
+      /* and those that came, each read once */
+      for (i = 0; i < [subfolders count]; i++)
+        {
+          NSString *path = [subfolders objectAtIndex: i];
+
+          if ([directoryApps objectForKey: path] == nil)
+            {
+              [directoryApps setObject: [self appsInDirectory: path subfolders: nil]
+                                forKey: path];
+              changed = YES;
+            }
+        }
+    }
+
+  return changed;
+}
+
+- (void)reindex
+{
+  NSEnumerator *enumerator = [directoryApps objectEnumerator];
+  NSDictionary *apps;
+
+  [appsByExtension removeAllObjects];
+  [appsByMIMEType removeAllObjects];
+  [answers removeAllObjects];
+
+  while ((apps = [enumerator nextObject]))
+    {
+      NSEnumerator *names = [apps keyEnumerator];
+      NSString *name;
+
+      while ((name = [names nextObject]))
+        {
+          NSDictionary *types = [apps objectForKey: name];
+
+          addApp(appsByExtension, [types objectForKey: @"extensions"], name);
+          addApp(appsByMIMEType, [types objectForKey: @"mimetypes"], name);
+        }
+    }
+
+  generation++;
+}
+
+@end
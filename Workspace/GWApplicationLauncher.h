@@ -5,6 +5,7 @@
  */
 
 #import <Foundation/Foundation.h>
+#include <sys/types.h>
 
 /**
  * GWApplicationLauncher provides centralized error handling for launching
@@ -23,6 +24,19 @@
  */
 + (void)launchAndMonitor:(NSString *)path withArguments:(NSArray *)args;
 
+/**
+ * Launch an executable with posix_spawn and monitor it until it exits.
+ * Its stderr is appended to ~/Library/Logs/<name>.log and it inherits no
+ * other descriptor.  The exit is seen through a pidfd watched by the main
+ * run loop, so no thread or signal handler waits for it.  Where posix_spawn
+ * cannot close the inherited descriptors this launches through NSTask.
+ *
+ * @param path The full path to the executable to launch
+ * @param args Array of arguments to pass (can be nil or empty)
+ * @return The process identifier, or 0 if it could not be launched
+ */
++ (pid_t)spawnAndMonitor:(NSString *)path withArguments:(NSArray *)args;
+
 /**
  * Launch an NSTask with error monitoring.
  * Monitors the task for 10 seconds and shows an error alert if it exits
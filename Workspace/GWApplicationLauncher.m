@@ -4,23 +4,364 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include "config.h"
+
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import <dispatch/dispatch.h>
 #import "GWApplicationLauncher.h"
 #import <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#endif
+
+extern char **environ;
+
+/* How often the processes without a pidfd are asked whether they exited */
+#define EXIT_POLL_INTERVAL 0.5
+
+@interface GWApplicationLauncher (Private)
++ (void)_handleExitOfPath:(NSString *)path
+                   status:(int)status
+                  logPath:(NSString *)logPath;
++ (void)_showErrorAlert:(NSDictionary *)info;
+@end
+
+/* ~/Library/Logs, made once a session rather than on every launch; made
+   again if it is found gone. */
+static NSString *logDirectory = nil;
+
+/* The log of the app, or /dev/null with *logPath nil when the log
+   directory cannot be made or the log opened. */
+static int
+openLogForApp(NSString *appName, NSString **logPath)
+{
+  NSString *path;
+  BOOL retried = NO;
+  int fd;
+
+  while (1) {
+    if (logDirectory == nil) {
+      NSString *dir = [NSHomeDirectory()
+                        stringByAppendingPathComponent:@"Library/Logs"];
+
+      if ([[NSFileManager defaultManager] createDirectoryAtPath:dir
+                                    withIntermediateDirectories:YES
+                                                     attributes:nil
+                                                          error:NULL] == NO) {
+        break;
+      }
+      logDirectory = [dir retain];
+    }
+
+    path = [logDirectory stringByAppendingPathComponent:
+                           [appName stringByAppendingPathExtension:@"log"]];
+
+    fd = open([path fileSystemRepresentation],
+              O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+
+    if (fd >= 0) {
+      *logPath = path;
+      return fd;
+    }
+    if ((errno != ENOENT) || retried) {
+      break;
+    }
+    /* the directory went away since it was made */
+    DESTROY (logDirectory);
+    retried = YES;
+  }
+
+  *logPath = nil;
+  return open("/dev/null", O_WRONLY | O_CLOEXEC);
+}
+
+static int
+openPidfd(pid_t pid)
+{
+#if defined(HAVE_PIDFD_OPEN)
+  return pidfd_open(pid, 0);
+#elif defined(SYS_pidfd_open)
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static NSArray *
+monitorRunLoopModes(void)
+{
+  static NSArray *modes = nil;
+
+  if (modes == nil) {
+    modes = [[NSArray alloc] initWithObjects:NSDefaultRunLoopMode,
+                                             NSModalPanelRunLoopMode,
+                                             NSEventTrackingRunLoopMode, nil];
+  }
+  return modes;
+}
+
+
+/* One spawned process, until it is reaped.  The pidfd becomes readable
+ * when the process exits; without one (no pidfd_open, or a kernel older
+ * than 5.3) the process is polled with the others on one timer. */
+@interface GWLaunchMonitor : NSObject <RunLoopEvents>
+{
+  pid_t pid;
+  int pidfd;
+  NSString *path;
+  NSString *logPath;
+}
++ (void)monitorProcess:(pid_t)apid
+                  path:(NSString *)apath
+               logPath:(NSString *)alogPath;
+- (BOOL)reap;
+@end
+
+static NSMutableSet *activeMonitors = nil;
+static NSMutableArray *polledMonitors = nil;
+static NSTimer *pollTimer = nil;
+
+@implementation GWLaunchMonitor
+
++ (void)monitorProcess:(pid_t)apid
+                  path:(NSString *)apath
+               logPath:(NSString *)alogPath
+{
+  GWLaunchMonitor *monitor = [[self alloc] init];
+  NSArray *modes = monitorRunLoopModes();
+  NSUInteger i;
+
+  monitor->pid = apid;
+  monitor->path = [apath copy];
+  monitor->logPath = [alogPath copy];
+  monitor->pidfd = openPidfd(apid);
+
+  if (activeMonitors == nil) {
+    activeMonitors = [NSMutableSet new];
+    polledMonitors = [NSMutableArray new];
+  }
+  [activeMonitors addObject:monitor];
+
+  if (monitor->pidfd >= 0) {
+    for (i = 0; i < [modes count]; i++) {
+      [[NSRunLoop currentRunLoop] addEvent:(void *)(intptr_t)monitor->pidfd
+                                      type:ET_RDESC
+                                   watcher:monitor
+                                   forMode:[modes objectAtIndex:i]];
+    }
+  } else {
+    [polledMonitors addObject:monitor];
+
+    if (pollTimer == nil) {
+      pollTimer = [[NSTimer scheduledTimerWithTimeInterval:EXIT_POLL_INTERVAL
+                                                    target:self
+                                                  selector:@selector(pollExits:)
+                                                  userInfo:nil
+                                                   repeats:YES] retain];
+    }
+  }
+
+  [monitor release];
+}
+
++ (void)pollExits:(NSTimer *)timer
+{
+  NSArray *monitors = [NSArray arrayWithArray:polledMonitors];
+  NSUInteger i;
+
+  for (i = 0; i < [monitors count]; i++) {
+    GWLaunchMonitor *monitor = [monitors objectAtIndex:i];
+
+    if ([monitor reap]) {
+      [polledMonitors removeObject:monitor];
+    }
+  }
+
+  if ([polledMonitors count] == 0) {
+    [pollTimer invalidate];
+    DESTROY (pollTimer);
+  }
+}
+
+- (void)dealloc
+{
+  [path release];
+  [logPath release];
+  [super dealloc];
+}
+
+/* YES once the process is gone and has been dealt with. */
+- (BOOL)reap
+{
+  int status = 0;
+  pid_t r;
+
+  do {
+    r = waitpid(pid, &status, WNOHANG);
+  } while ((r < 0) && (errno == EINTR));
+
+  if (r == 0) {
+    return NO;
+  }
+
+  [self retain];
+
+  if (pidfd >= 0) {
+    NSArray *modes = monitorRunLoopModes();
+    NSUInteger i;
+
+    for (i = 0; i < [modes count]; i++) {
+      [[NSRunLoop currentRunLoop] removeEvent:(void *)(intptr_t)pidfd
+                                         type:ET_RDESC
+                                      forMode:[modes objectAtIndex:i]
+                                          all:NO];
+    }
+    close(pidfd);
+    pidfd = -1;
+  }
+
+  [activeMonitors removeObject:self];
+
+  /* ECHILD: reaped elsewhere, the status went with it */
+  if (r == pid) {
+    int code = WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status);
+
+    [GWApplicationLauncher _handleExitOfPath:path
+                                      status:code
+                                     logPath:logPath];
+  }
+
+  [self release];
+  return YES;
+}
+
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+  [self reap];
+}
+
+@end
+
 
 @implementation GWApplicationLauncher
 
 + (void)launchAndMonitor:(NSString *)path withArguments:(NSArray *)args
 {
+  [self spawnAndMonitor:path withArguments:args];
+}
+
++ (pid_t)spawnAndMonitor:(NSString *)path withArguments:(NSArray *)args
+{
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSUInteger count = [args count];
+  char **argv = malloc((count + 2) * sizeof(char *));
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  NSString *logPath = nil;
+  sigset_t none, all;
+  pid_t pid = 0;
+  NSUInteger i;
+  int err;
+  int fd;
+
+  argv[0] = (char *)[path fileSystemRepresentation];
+  for (i = 0; i < count; i++) {
+    argv[i + 1] = (char *)[[[args objectAtIndex:i] description] UTF8String];
+  }
+  argv[count + 1] = NULL;
+
+  /* stderr as in -launchAndMonitorTask:, the log or /dev/null; nothing
+     else of Workspace's (X, DO sockets, fswatcher) reaches the child */
+  fd = openLogForApp([path lastPathComponent], &logPath);
+  if (fd < 0) {
+    logPath = nil;
+    fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  }
+
+  posix_spawn_file_actions_init(&actions);
+  if (fd >= 0) {
+    posix_spawn_file_actions_adddup2(&actions, fd, STDERR_FILENO);
+  }
+  posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+
+  /* default signals, none blocked, and a process group of its own */
+  sigemptyset(&none);
+  sigfillset(&all);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setsigdefault(&attr, &all);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK
+                                  | POSIX_SPAWN_SETSIGDEF
+                                  | POSIX_SPAWN_SETPGROUP);
+
+  err = posix_spawn(&pid, argv[0], &actions, &attr, argv, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (fd >= 0) {
+    close(fd);
+  }
+  free(argv);
+
+  if (err != 0) {
+    NSDictionary *errorInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+                               path, @"path",
+                               [NSNumber numberWithInt:-1], @"status",
+                               [NSString stringWithUTF8String:strerror(err)], @"stderr",
+                               nil];
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self _showErrorAlert:errorInfo];
+    });
+    [pool drain];
+    return 0;
+  }
+
+  /* the run loop events belong to the main thread's run loop */
+  if ([NSThread isMainThread]) {
+    [GWLaunchMonitor monitorProcess:pid path:path logPath:logPath];
+  } else {
+    NSString *p = [path copy];
+    NSString *l = [logPath copy];
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [GWLaunchMonitor monitorProcess:pid path:p logPath:l];
+      [p release];
+      [l release];
+    });
+  }
+
+  [pool drain];
+  return pid;
+#else
   NSTask *task = [[NSTask alloc] init];
+  pid_t pid = 0;
+
   [task setLaunchPath:path];
   [task setArguments:args ? args : [NSArray array]];
-  
-  [self launchAndMonitorTask:task];
+
+  if ([self launchAndMonitorTask:task]) {
+    pid = [task processIdentifier];
+  }
   [task release];
+
+  return pid;
+#endif
 }
 
 + (BOOL)launchAndMonitorTask:(NSTask *)task
@@ -32,19 +373,10 @@
        child's UI (this was the prior design flaw). A failed open falls
        through to /dev/null rather than a blocking pipe. */
     NSString *appName = [[task launchPath] lastPathComponent];
-    NSString *logDir  = [NSHomeDirectory()
-                         stringByAppendingPathComponent:@"Library/Logs"];
-    NSString *logPath = [logDir stringByAppendingPathComponent:
-                          [appName stringByAppendingPathExtension:@"log"]];
-
-    [[NSFileManager defaultManager] createDirectoryAtPath:logDir
-                              withIntermediateDirectories:YES
-                                               attributes:nil
-                                                    error:NULL];
-
+    NSString *logPath = nil;
     NSFileHandle *errHandle;
-    int fd = open([logPath fileSystemRepresentation],
-                  O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
+    int fd = openLogForApp(appName, &logPath);
+
     if (fd >= 0) {
       errHandle = [[[NSFileHandle alloc]
                      initWithFileDescriptor:fd
@@ -101,23 +433,30 @@
 
 + (void)_handleTaskExit:(id)anObject
 {
-  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
   NSDictionary *info = (NSDictionary *)anObject;
   NSTask *task = [info objectForKey:@"task"];
-  NSString *path = [info objectForKey:@"path"];
-  NSString *logPath = [info objectForKey:@"logPath"];
+
+  [self _handleExitOfPath:[info objectForKey:@"path"]
+                   status:[task terminationStatus]
+                  logPath:[info objectForKey:@"logPath"]];
+}
+
++ (void)_handleExitOfPath:(NSString *)path
+                   status:(int)status
+                  logPath:(NSString *)logPath
+{
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
 
   @try {
-    /* Invoked from DISPATCH_PROC_EXIT handler — the child is gone. */
-    int status = [task terminationStatus];
+    /* The child is gone. */
     if (status == 0) {
       return;
     }
 
     NSString *s = nil;
-    NSData *d = [NSData dataWithContentsOfFile:logPath
-                                       options:NSDataReadingMappedIfSafe
-                                         error:NULL];
+    NSData *d = logPath ? [NSData dataWithContentsOfFile:logPath
+                                                 options:NSDataReadingMappedIfSafe
+                                                   error:NULL] : nil;
     if (d) {
       /* Bound the alert payload to the last 64 KiB even if the log file
          has accumulated across prior invocations. */
@@ -11,13 +11,16 @@
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
+#import "GWMetaArchive.h"
 
 @interface GWArchiveOperation : NSObject
 {
   /* Operation parameters */
-  NSString      *operationType;   /* "compress" or "extract"    */
+  NSString      *operationType;   /* "compress", "extract",
+                                     "index" or "entry"         */
   NSArray       *paths;           /* source paths               */
   NSString      *outputPath;      /* dest zip / dest directory  */
+  GWArchiveFormat format;         /* when compressing           */
 
   /* Progress window */
   NSWindow      *progressWindow;
@@ -29,6 +32,8 @@
   BOOL           running;
   BOOL           cancelled;
   NSError       *error;
+  NSString      *browsedRoot;     /* of an "index" operation    */
+  NSTimeInterval lastUpdate;      /* of the panel, by the worker */
 }
 
 /**
@@ -40,11 +45,39 @@
 + (BOOL)compressPaths:(NSArray *)paths toArchive:(NSString *)outputPath;
 
 /**
- * Convenience: extract a zip archive with progress.
- * @param archivePath Path to the .zip file.
+ * Convenience: compress file paths into an archive of the given format.
+ * The tar formats compress on all cores where libarchive can.
+ * @param paths      Files/directories to compress.
+ * @param outputPath Path for the output archive.
+ * @param format     A GWArchiveFormat.
+ * @return YES on success.
+ */
++ (BOOL)compressPaths:(NSArray *)paths
+            toArchive:(NSString *)outputPath
+               format:(GWArchiveFormat)format;
+
+/**
+ * Convenience: extract an archive with progress.
+ * @param archivePath Path to the archive.
  * @param destDir     Directory to extract into.
  * @return YES on success.
  */
 + (BOOL)extractArchive:(NSString *)archivePath toDirectory:(NSString *)destDir;
 
+/**
+ * Convenience: read the index of an archive for browsing, with progress
+ * when it is not cached yet (see GWArchiveIndex).
+ * @param archivePath Path to the archive.
+ * @return The directory standing in for the archive, nil on failure.
+ */
++ (NSString *)browseArchive:(NSString *)archivePath;
+
+/**
+ * Convenience: extract the entry behind a file of a browsed archive
+ * into place, with progress.
+ * @param path A file beneath a directory returned by +browseArchive:.
+ * @return YES on success.
+ */
++ (BOOL)extractBrowsedEntry:(NSString *)path;
+
 @end
@@ -7,9 +7,14 @@
 
 #import "GWArchiveOperation.h"
 #import "GWMetaArchive.h"
+#import "GWArchiveIndex.h"
+#import "FSNFunctions.h"
 
 #include <dispatch/dispatch.h>
 
+/* the worker updates the panel no more often than this */
+#define PROGRESS_INTERVAL 0.1
+
 /* =================================================================
  * Private helpers
  * ================================================================= */
@@ -42,11 +47,21 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
  * ================================================================= */
 
 + (BOOL)compressPaths:(NSArray *)paths toArchive:(NSString *)outputPath
+{
+  return [self compressPaths: paths
+                   toArchive: outputPath
+                      format: GWArchiveFormatZip];
+}
+
++ (BOOL)compressPaths:(NSArray *)paths
+            toArchive:(NSString *)outputPath
+               format:(GWArchiveFormat)format
 {
   GWArchiveOperation *op = [[self alloc] init];
   op->operationType = @"compress";
   op->paths         = paths;
   op->outputPath    = outputPath;
+  op->format        = format;
 
   BOOL ok = [op run];
   RELEASE(op);
@@ -65,6 +80,37 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
   return ok;
 }
 
++ (NSString *)browseArchive:(NSString *)archivePath
+{
+  NSString *root = nil;
+  GWArchiveIndex *index;
+
+  /* a cached index opens at once, without the panel */
+  index = [GWArchiveIndex cachedIndexForArchiveAtPath: archivePath];
+  if (index)
+    return [index rootPath];
+
+  GWArchiveOperation *op = [[self alloc] init];
+  op->operationType = @"index";
+  op->paths         = @[archivePath];
+
+  if ([op run])
+    root = AUTORELEASE(RETAIN(op->browsedRoot));
+  RELEASE(op);
+  return root;
+}
+
++ (BOOL)extractBrowsedEntry:(NSString *)path
+{
+  GWArchiveOperation *op = [[self alloc] init];
+  op->operationType = @"entry";
+  op->paths         = @[path];
+
+  BOOL ok = [op run];
+  RELEASE(op);
+  return ok;
+}
+
 /* =================================================================
  * Instance — build the progress window
  * ================================================================= */
@@ -77,6 +123,8 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
       running   = NO;
       cancelled = NO;
       error     = nil;
+      format    = GWArchiveFormatZip;
+      lastUpdate = 0.0;
     }
   return self;
 }
@@ -84,6 +132,7 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
 - (void)dealloc
 {
   RELEASE(error);
+  RELEASE(browsedRoot);
   RELEASE(progressWindow);
   [super dealloc];
 }
@@ -100,9 +149,12 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
               styleMask: NSTitledWindowMask
                 backing: NSBackingStoreBuffered
                   defer: YES];
-  [progressWindow setTitle: ([operationType isEqual: @"compress"]
-                             ? NSLocalizedString(@"Compressing...", @"")
-                             : NSLocalizedString(@"Extracting...", @""))];
+  if ([operationType isEqual: @"compress"])
+    [progressWindow setTitle: NSLocalizedString(@"Compressing...", @"")];
+  else if ([operationType isEqual: @"index"])
+    [progressWindow setTitle: NSLocalizedString(@"Reading archive...", @"")];
+  else
+    [progressWindow setTitle: NSLocalizedString(@"Extracting...", @"")];
   [progressWindow center];
 
   NSView *content = [progressWindow contentView];
@@ -151,6 +203,61 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
     [statusField setStringValue: status];
 }
 
+/* Called by GWMetaArchive on the worker.  Bytes read from the files when
+ * compressing, bytes of the archive read when extracting; the panel gets
+ * them at most every PROGRESS_INTERVAL.  NO stops the operation. */
+- (BOOL)reportStage:(GWArchiveStage)stage
+          processed:(unsigned long long)processed
+              total:(unsigned long long)total
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+  if (cancelled)
+    return NO;
+
+  if ((now - lastUpdate) >= PROGRESS_INTERVAL || processed >= total)
+    {
+      double value = (total > 0) ? (100.0 * processed / total) : 0.0;
+      NSString *status;
+
+      lastUpdate = now;
+
+      if (stage == GWArchiveStageScanning)
+        {
+          status = NSLocalizedString(@"Reading archive...", @"");
+        }
+      else
+        {
+          NSString *fmt = (stage == GWArchiveStageCompressing)
+                            ? NSLocalizedString(@"Compressing... %@ of %@", @"")
+                            : NSLocalizedString(@"Extracting... %@ of %@", @"");
+
+          status = [NSString stringWithFormat: fmt,
+                             sizeDescription(processed),
+                             sizeDescription(total)];
+        }
+
+      /* the scan is a first, quicker pass over the archive: half the bar,
+         unless it is the whole operation */
+      if ([operationType isEqual: @"extract"])
+        {
+          if (stage == GWArchiveStageScanning)
+            value /= 2.0;
+          else if (stage == GWArchiveStageExtracting)
+            value = 50.0 + value / 2.0;
+        }
+
+      RETAIN (status);
+      dispatch_async(dispatch_get_main_queue(), ^{
+        if (!cancelled)
+          [self updateProgress: value status: status];
+        RELEASE (status);
+      });
+    }
+
+  return !cancelled;
+}
+
 - (void)doneWithSuccess:(BOOL)ok
 {
   running = NO;
@@ -182,6 +289,10 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
 
     if ([operationType isEqual: @"compress"])
       ok = [self runCompress];
+    else if ([operationType isEqual: @"index"])
+      ok = [self runIndex];
+    else if ([operationType isEqual: @"entry"])
+      ok = [self runExtractEntry];
     else
       ok = [self runExtract];
 
@@ -221,7 +332,7 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
 {
   NSFileManager *fm = [NSFileManager defaultManager];
 
-  /* Count total items */
+  /* Anything to compress at all */
   NSUInteger totalItems = 0;
   for (NSString *p in paths)
     count_items(p, &totalItems, fm);
@@ -235,7 +346,6 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
     }
 
   dispatch_async(dispatch_get_main_queue(), ^{
-    [progressBar setMaxValue: (double)totalItems];
     [self updateProgress: 0.0 status: NSLocalizedString(@"Compressing...", @"")];
   });
 
@@ -243,9 +353,17 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
 
   /* Compress via GWMetaArchive, which enumerates the tree itself. */
   NSError *compressError = nil;
-  BOOL ok = [GWMetaArchive compressPaths: paths toArchiveAt: outputPath error: &compressError];
+  BOOL ok = [GWMetaArchive compressPaths: paths
+                             toArchiveAt: outputPath
+                                  format: format
+                                progress: ^BOOL (GWArchiveStage stage,
+                                                 unsigned long long processed,
+                                                 unsigned long long total) {
+      return [self reportStage: stage processed: processed total: total];
+    }
+                                   error: &compressError];
 
-  if (!ok)
+  if (!ok && !cancelled)
     ASSIGN(error, compressError);
 
   dispatch_async(dispatch_get_main_queue(), ^{
@@ -266,21 +384,24 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
   NSString *archivePath = [paths objectAtIndex: 0];
 
   dispatch_async(dispatch_get_main_queue(), ^{
-    [progressBar setIndeterminate: YES];
-    [progressBar startAnimation: nil];
     [self updateProgress: 0.0 status: NSLocalizedString(@"Extracting...", @"")];
   });
 
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
   NSError *extractError = nil;
-  BOOL ok = [GWMetaArchive extractArchive: archivePath toDir: outputPath error: &extractError];
+  BOOL ok = [GWMetaArchive extractArchive: archivePath
+                                    toDir: outputPath
+                                 progress: ^BOOL (GWArchiveStage stage,
+                                                  unsigned long long processed,
+                                                  unsigned long long total) {
+      return [self reportStage: stage processed: processed total: total];
+    }
+                                    error: &extractError];
 
-  if (!ok)
+  if (!ok && !cancelled)
     ASSIGN(error, extractError);
 
   dispatch_async(dispatch_get_main_queue(), ^{
-    [progressBar setIndeterminate: NO];
-    [progressBar stopAnimation: nil];
     [self updateProgress: 100.0 status: (ok ? NSLocalizedString(@"Done.", @"")
                                            : NSLocalizedString(@"Failed.", @""))];
   });
@@ -289,4 +410,75 @@ count_items(NSString *path, NSUInteger *total, NSFileManager *fm)
   return ok;
 }
 
+/* =================================================================
+ * Browse workers — run on background thread
+ * ================================================================= */
+
+- (BOOL)runIndex
+{
+  NSString *archivePath = [paths objectAtIndex: 0];
+
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self updateProgress: 0.0 status: NSLocalizedString(@"Reading archive...", @"")];
+  });
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSError *indexError = nil;
+  GWArchiveIndex *index;
+
+  index = [GWArchiveIndex indexForArchiveAtPath: archivePath
+                                       progress: ^BOOL (GWArchiveStage stage,
+                                                        unsigned long long processed,
+                                                        unsigned long long total) {
+      return [self reportStage: stage processed: processed total: total];
+    }
+                                          error: &indexError];
+
+  if (index)
+    ASSIGN(browsedRoot, [index rootPath]);
+  else if (!cancelled)
+    ASSIGN(error, indexError);
+
+  [pool release];
+
+  return (index != nil);
+}
+
+- (BOOL)runExtractEntry
+{
+  NSString *path = [paths objectAtIndex: 0];
+
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self updateProgress: 0.0 status: [path lastPathComponent]];
+  });
+
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSError *extractError = nil;
+  GWArchiveIndex *index = [GWArchiveIndex indexForBrowsedPath: path];
+  BOOL ok = NO;
+
+  if (index)
+    ok = [index extractEntryAtPath: path
+                          progress: ^BOOL (GWArchiveStage stage,
+                                           unsigned long long processed,
+                                           unsigned long long total) {
+        return [self reportStage: stage processed: processed total: total];
+      }
+                             error: &extractError];
+
+  if (!ok && !cancelled)
+    {
+      if (extractError == nil)
+        extractError = [NSError errorWithDomain: @"GWArchiveOperation"
+                                           code: 2
+                                       userInfo: @{NSLocalizedDescriptionKey:
+                                                     @"Not in a browsed archive"}];
+      ASSIGN(error, extractError);
+    }
+
+  [pool release];
+
+  return ok;
+}
+
 @end
@@ -11,13 +11,37 @@
  */
 
 #import <Foundation/Foundation.h>
+#import <dispatch/dispatch.h>
 #import "FSNIconPositionStore.h"
 
+@class DSStoreInfo;
+
 @interface GWIconPositionStore : NSObject <FSNIconPositionStore>
+{
+  NSMutableDictionary *pendingByFolder;
+  NSTimer *pendingTimer;
+  dispatch_queue_t writeQueue;
+}
 
 + (instancetype)sharedStore;
 
+/* Saves are write-behind: positions are merged per folder for a short
+ * window and then written on a background queue.  Call these on the main
+ * thread. */
+
 /* Convenience for a single file (top-left iloc CENTER coordinates). */
 - (void)saveIconPosition:(NSPoint)ilocCenter forFileAtPath:(NSString *)path;
 
+/* Write one folder's batch now, on the calling thread. */
+- (void)writeBatch:(NSArray *)batch toFolder:(NSString *)folder;
+
+/* Write every pending position and wait until it is on disk. */
+- (void)flushPendingWrites;
+
+/* The one way to write the view settings of a folder, as it shares its
+ * .DS_Store (or the volume cache) with the positions: the write waits for
+ * those on the write queue, and the folder's pending ones go right after
+ * it.  The positions `info` may hold are left as they are on disk. */
+- (BOOL)writeSettings:(DSStoreInfo *)info forFolder:(NSString *)folder;
+
 @end
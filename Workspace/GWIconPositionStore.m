@@ -9,6 +9,16 @@
 #import "GWViewSettingsManager.h"
 #import "DSStoreInfo.h"
 
+/* How long position updates are collected before they are written.  A
+ * multi-icon drag posts one batch per folder, Clean Up one per icon row. */
+#define GW_POSITION_WRITE_DELAY 0.3
+
+@interface GWIconPositionStore (WriteBehind)
+- (void)queueBatch:(NSArray *)batch forFolder:(NSString *)folder;
+- (void)pendingWriteTimerFired:(NSTimer *)timer;
+- (void)dispatchPendingWrites;
+@end
+
 @implementation GWIconPositionStore
 
 + (instancetype)sharedStore
@@ -19,6 +29,28 @@
   return shared;
 }
 
+- (id)init
+{
+  self = [super init];
+  if (self)
+    {
+      pendingByFolder = [NSMutableDictionary new];
+      writeQueue = dispatch_queue_create ("Workspace.iconPositionWrites",
+                                          DISPATCH_QUEUE_SERIAL);
+    }
+  return self;
+}
+
+- (void)dealloc
+{
+  [pendingTimer invalidate];
+  RELEASE (pendingTimer);
+  RELEASE (pendingByFolder);
+  if (writeQueue)
+    dispatch_release (writeQueue);
+  [super dealloc];
+}
+
 /* Write one folder's batch of iloc entries (@[name, ilocX, ilocY]).
  *
  * Combines persistence into three distinct phases so that all reads happen
@@ -78,7 +110,48 @@
 - (void)saveIconPositionsByFolder:(NSDictionary *)positionsByFolder
 {
   for (NSString *folder in positionsByFolder)
-    [self writeBatch: [positionsByFolder objectForKey: folder] toFolder: folder];
+    [self queueBatch: [positionsByFolder objectForKey: folder] forFolder: folder];
+}
+
+- (void)flushPendingWrites
+{
+  [self dispatchPendingWrites];
+  /* Wait for everything already handed to the write queue. */
+  dispatch_sync (writeQueue, ^{ });
+}
+
+- (BOOL)writeSettings:(DSStoreInfo *)info forFolder:(NSString *)folder
+{
+  NSArray *batch = [[pendingByFolder objectForKey: folder] allValues];
+  __block BOOL wrote = NO;
+
+  if (info == nil || folder == nil)
+    return NO;
+
+  [pendingByFolder removeObjectForKey: folder];
+
+  dispatch_sync (writeQueue, ^{
+    NSArray *names = [info filenamesWithPositions];
+    NSUInteger i;
+
+    /* what the caller read may be older than the last batch written */
+    for (i = 0; i < [names count]; i++)
+      [[info iconInfoForFilename: [names objectAtIndex: i]] setHasPosition: NO];
+
+    NS_DURING
+      wrote = [[GWViewSettingsManager managerForDirectoryPath: folder] writeSettings: info];
+      if (batch)
+        [self writeBatch: batch toFolder: folder];
+    NS_HANDLER
+      NSLog (@"GWIconPositionStore: writing settings for %@ failed: %@",
+             folder, [localException reason]);
+    NS_ENDHANDLER
+
+    for (i = 0; i < [names count]; i++)
+      [[info iconInfoForFilename: [names objectAtIndex: i]] setHasPosition: YES];
+  });
+
+  return wrote;
 }
 
 - (NSDictionary *)storedIconPositionsForFolder:(NSString *)folder
@@ -87,6 +160,12 @@
   if (folder == nil)
     return result;
 
+  /* A write for this folder may still be on its way to disk. */
+  if ([pendingByFolder objectForKey: folder])
+    [self flushPendingWrites];
+  else
+    dispatch_sync (writeQueue, ^{ });
+
   /* Read through the settings manager's hierarchy (folder .DS_Store, then
    * per-volume cache, then empty defaults) and pull out the iloc positions. */
   GWViewSettingsManager *sm = [GWViewSettingsManager managerForDirectoryPath: folder];
@@ -103,6 +182,20 @@
   return result;
 }
 
+- (NSData *)storedIconLocationTableForFolder:(NSString *)folder
+{
+  if (folder == nil)
+    return nil;
+
+  if ([pendingByFolder objectForKey: folder])
+    [self flushPendingWrites];
+  else
+    dispatch_sync (writeQueue, ^{ });
+
+  /* DSStoreIconLocation and FSNIconLocation share one layout */
+  return [[GWViewSettingsManager managerForDirectoryPath: folder] readIconLocationTable];
+}
+
 - (void)saveIconPosition:(NSPoint)ilocCenter forFileAtPath:(NSString *)path
 {
   if (!path)
@@ -115,7 +208,86 @@
   NSArray *entry = @[name,
                      [NSNumber numberWithInt: (int)ilocCenter.x],
                      [NSNumber numberWithInt: (int)ilocCenter.y]];
-  [self writeBatch: [NSArray arrayWithObject: entry] toFolder: folder];
+  [self queueBatch: [NSArray arrayWithObject: entry] forFolder: folder];
+}
+
+@end
+
+/* Write-behind.  Batches arrive on the main thread and are merged per folder
+ * and per file (the last position wins) until the timer fires; the merged
+ * batches are then written, one folder at a time, on a serial background
+ * queue so that a slow disk does not stall the drag that caused them. */
+@implementation GWIconPositionStore (WriteBehind)
+
+- (void)queueBatch:(NSArray *)batch forFolder:(NSString *)folder
+{
+  NSMutableDictionary *entries;
+  NSUInteger i;
+
+  if ([batch count] == 0 || [folder length] == 0)
+    return;
+
+  entries = [pendingByFolder objectForKey: folder];
+  if (entries == nil)
+    {
+      entries = [NSMutableDictionary dictionary];
+      [pendingByFolder setObject: entries forKey: folder];
+    }
+  for (i = 0; i < [batch count]; i++)
+    {
+      NSArray *entry = [batch objectAtIndex: i];
+      [entries setObject: entry forKey: [entry objectAtIndex: 0]];
+    }
+
+  if (pendingTimer == nil)
+    {
+      ASSIGN (pendingTimer,
+              [NSTimer scheduledTimerWithTimeInterval: GW_POSITION_WRITE_DELAY
+                                               target: self
+                                             selector: @selector(pendingWriteTimerFired:)
+                                             userInfo: nil
+                                              repeats: NO]);
+    }
+}
+
+- (void)pendingWriteTimerFired:(NSTimer *)timer
+{
+  [self dispatchPendingWrites];
+}
+
+- (void)dispatchPendingWrites
+{
+  NSMutableDictionary *batches;
+
+  if (pendingTimer)
+    {
+      [pendingTimer invalidate];
+      DESTROY (pendingTimer);
+    }
+  if ([pendingByFolder count] == 0)
+    return;
+
+  batches = [NSMutableDictionary dictionaryWithCapacity: [pendingByFolder count]];
+  for (NSString *folder in pendingByFolder)
+    [batches setObject: [[pendingByFolder objectForKey: folder] allValues]
+                forKey: folder];
+  [pendingByFolder removeAllObjects];
+
+  /* The block retains self and batches until it has run. */
+  dispatch_async (writeQueue, ^{
+    for (NSString *folder in batches)
+      {
+        NSAutoreleasePool *pool = [NSAutoreleasePool new];
+
+        NS_DURING
+          [self writeBatch: [batches objectForKey: folder] toFolder: folder];
+        NS_HANDLER
+          NSLog (@"GWIconPositionStore: writing positions for %@ failed: %@",
+                 folder, [localException reason]);
+        NS_ENDHANDLER
+        [pool release];
+      }
+  });
 }
 
 @end
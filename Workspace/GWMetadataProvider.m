@@ -6,6 +6,7 @@
 #import <AppKit/AppKit.h>
 #import "GWMetadataProvider.h"
 #import "GSFileMetadata.h"
+#import "FSNFolderMetadata.h"
 
 @implementation GWMetadataProvider
 
@@ -53,4 +54,47 @@
   [GSFileMetadata invalidateAllCachedMetadata];
 }
 
+- (void)invalidateCachesForPaths:(NSArray *)paths
+{
+  NSUInteger i;
+
+  for (i = 0; i < [paths count]; i++)
+    [GSFileMetadata invalidateCachedMetadataForPath: [paths objectAtIndex: i]];
+}
+
+- (void)prefetchMetadataForDirectory:(NSString *)path
+{
+  [GSFileMetadata prefetchMetadataForDirectory: path];
+}
+
+- (FSNFolderMetadata *)folderMetadataAtPath:(NSString *)path
+{
+  NSDictionary *found = [GSFileMetadata prefetchMetadataForDirectory: path];
+  FSNFolderMetadata *table = [[FSNFolderMetadata alloc] initWithPath: path];
+  NSEnumerator *e = [found keyEnumerator];
+  NSString *name;
+  NSInteger label;
+
+  for (label = 1; label < 8; label++)
+    {
+      [table setColor: [GSFileMetadata colorForLabel: (GSFileLabel)label]
+       forLabelNumber: label];
+    }
+
+  while ((name = [e nextObject]) != nil)
+    {
+      GSFileMetadata *md = [found objectForKey: name];
+      FSNMetadataRecord rec;
+
+      rec.iconPosition = [md iconPosition];
+      rec.labelNumber = [md labelNumber];
+      rec.invisible = [md isInvisible];
+      rec.hasCustomIcon = [md hasCustomIcon];
+
+      [table setRecord: rec forName: name];
+    }
+
+  return AUTORELEASE (table);
+}
+
 @end
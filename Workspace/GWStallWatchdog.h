@@ -0,0 +1,31 @@
+/* GWStallWatchdog.h
+ *
+ * Notices when the main run loop of Workspace has not turned for longer
+ * than a threshold, and logs where the main thread is stuck: its
+ * backtrace, taken by a signal sent to it, and the trace spans open on
+ * it (see FSNTrace.h), with their operation IDs.  The end of the stall
+ * is logged too, with how long it lasted, and both show up as marks in
+ * the trace.
+ *
+ * A thread of its own sends the main thread a message every threshold
+ * and waits as long for the answer, so a stall is reported once it has
+ * lasted between one and two thresholds.  The threshold is the
+ * "GWStallThreshold" default, in milliseconds, or the GW_STALL_THRESHOLD
+ * environment variable; 250 when neither is set, 0 turns the watchdog
+ * off.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_STALL_WATCHDOG_H
+#define GW_STALL_WATCHDOG_H
+
+#import <Foundation/Foundation.h>
+
+/* Called on the main thread, once its run loop is about to run. */
+void GWStallWatchdogStart(void);
+
+/* The stalls reported so far. */
+unsigned long GWStallWatchdogStallCount(void);
+
+#endif /* GW_STALL_WATCHDOG_H */
@@ -0,0 +1,239 @@
+/* GWStallWatchdog.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include "config.h"
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#import "GWStallWatchdog.h"
+#import "FSNTrace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#define DEFAULT_THRESHOLD 250
+#define MAX_FRAMES 64
+/* how long the main thread gets to take its backtrace, in milliseconds */
+#define CAPTURE_WAIT 100
+/* how often a stall is checked for its end */
+#define END_POLL 50
+
+#ifdef SIGRTMIN
+#define STALL_SIGNAL (SIGRTMIN + 1)
+#else
+/* ignored by default, so a stray one does no harm */
+#define STALL_SIGNAL SIGURG
+#endif
+
+static BOOL started = NO;
+static unsigned long threshold = 0;
+static pthread_t mainThread;
+static FSNTraceThread mainTraceThread = NULL;
+
+static unsigned long pingsSent = 0;
+static unsigned long pingsAnswered = 0;
+static unsigned long stallCount = 0;
+
+static void *frames[MAX_FRAMES];
+static int framesCount = 0;
+static int framesTaken = 0;
+
+@interface GWStallWatchdog : NSObject
++ (void)answer:(id)sender;
++ (void)watch:(id)arg;
+@end
+
+static uint64_t monotonicMilliseconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void sleepMilliseconds(unsigned long ms)
+{
+  struct timespec ts;
+
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (long)(ms % 1000) * 1000000;
+
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+}
+
+/* Runs on the main thread, wherever it is stuck. */
+static void takeBacktrace(int sig)
+{
+  int saved = errno;
+
+#ifdef HAVE_EXECINFO_H
+  framesCount = backtrace(frames, MAX_FRAMES);
+#endif
+  __atomic_store_n(&framesTaken, 1, __ATOMIC_RELEASE);
+  errno = saved;
+}
+
+static NSString *mainThreadBacktrace(void)
+{
+  NSMutableString *desc = [NSMutableString string];
+  uint64_t until = monotonicMilliseconds() + CAPTURE_WAIT;
+
+  __atomic_store_n(&framesTaken, 0, __ATOMIC_RELEASE);
+  pthread_kill(mainThread, STALL_SIGNAL);
+
+  while (__atomic_load_n(&framesTaken, __ATOMIC_ACQUIRE) == 0)
+    {
+      if (monotonicMilliseconds() >= until)
+        return @"  (the main thread did not take its backtrace)\n";
+      sleepMilliseconds(1);
+    }
+
+#ifdef HAVE_EXECINFO_H
+  {
+    char **symbols = backtrace_symbols(frames, framesCount);
+    int i;
+
+    /* the first two are the handler and the signal trampoline */
+    for (i = 2; i < framesCount; i++)
+      {
+        if (symbols)
+          [desc appendFormat: @"  %s\n", symbols[i]];
+        else
+          [desc appendFormat: @"  %p\n", frames[i]];
+      }
+    free(symbols);
+  }
+#else
+  [desc appendString: @"  (no backtrace() on this system)\n"];
+#endif
+
+  return desc;
+}
+
+static unsigned long readThreshold(void)
+{
+  const char *env = getenv("GW_STALL_THRESHOLD");
+  id entry;
+
+  if (env && *env)
+    return strtoul(env, NULL, 10);
+
+  entry = [[NSUserDefaults standardUserDefaults] objectForKey: @"GWStallThreshold"];
+  if ([entry respondsToSelector: @selector(intValue)])
+    return (unsigned long)MAX([entry intValue], 0);
+
+  return DEFAULT_THRESHOLD;
+}
+
+@implementation GWStallWatchdog
+
++ (void)answer:(id)sender
+{
+  __atomic_store_n(&pingsAnswered, [sender unsignedLongValue], __ATOMIC_RELEASE);
+}
+
++ (void)reportStallOfMilliseconds:(unsigned long)ms
+                           number:(unsigned long)number
+{
+  NSString *spans = FSNTraceOpenSpans(mainTraceThread);
+
+  if (spans == nil)
+    spans = (FSNTraceIsEnabled() ? @"none" : @"unknown, tracing is off (GW_TRACE)");
+
+  FSN_TRACE_MARK ("main thread stall", number);
+
+  NSLog(@"main thread stall %lu: the run loop has not turned for %lu ms\n"
+        @"open trace spans: %@\nbacktrace:\n%@",
+        number, ms, spans, mainThreadBacktrace());
+}
+
++ (void)watch:(id)arg
+{
+  NSArray *modes = [NSArray arrayWithObjects: NSDefaultRunLoopMode,
+                            NSModalPanelRunLoopMode,
+                            NSEventTrackingRunLoopMode,
+                            NSConnectionReplyMode, nil];
+
+  RETAIN (modes);
+
+  for (;;)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      unsigned long ping = ++pingsSent;
+      uint64_t sent = monotonicMilliseconds();
+
+      [self performSelectorOnMainThread: @selector(answer:)
+                             withObject: [NSNumber numberWithUnsignedLong: ping]
+                          waitUntilDone: NO
+                                  modes: modes];
+
+      sleepMilliseconds(threshold);
+
+      if (__atomic_load_n(&pingsAnswered, __ATOMIC_ACQUIRE) != ping)
+        {
+          unsigned long number = __atomic_add_fetch(&stallCount, 1, __ATOMIC_RELAXED);
+
+          [self reportStallOfMilliseconds: (unsigned long)(monotonicMilliseconds() - sent)
+                                   number: number];
+
+          while (__atomic_load_n(&pingsAnswered, __ATOMIC_ACQUIRE) != ping)
+            sleepMilliseconds(END_POLL);
+
+          FSN_TRACE_MARK ("main thread stall end", number);
+          NSLog(@"main thread stall %lu ended after at least %lu ms",
+                number, (unsigned long)(monotonicMilliseconds() - sent));
+        }
+
+      RELEASE (arp);
+    }
+}
+
+@end
+
+void GWStallWatchdogStart(void)
+{
+  struct sigaction sa;
+
+  if (started)
+    return;
+
+  threshold = readThreshold();
+  if (threshold == 0)
+    return;
+
+  started = YES;
+  mainThread = pthread_self();
+  mainTraceThread = FSNTraceCurrentThread();
+
+#ifdef HAVE_EXECINFO_H
+  /* the first call loads the unwinder, which must not happen in the
+     handler */
+  backtrace(frames, 1);
+#endif
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = takeBacktrace;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(STALL_SIGNAL, &sa, NULL);
+
+  [NSThread detachNewThreadSelector: @selector(watch:)
+                           toTarget: [GWStallWatchdog class]
+                         withObject: nil];
+}
+
+unsigned long GWStallWatchdogStallCount(void)
+{
+  return __atomic_load_n(&stallCount, __ATOMIC_RELAXED);
+}
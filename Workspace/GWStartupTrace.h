@@ -0,0 +1,37 @@
+/* GWStartupTrace.h
+ *
+ * Startup trace of Workspace: the phases of the launch and the bundles
+ * loaded meanwhile, with monotonic timestamps, written as a Chrome
+ * trace-event JSON file (chrome://tracing, Perfetto) once the first run
+ * loop pass after -applicationDidFinishLaunching: is done.
+ *
+ * Enabled by the GW_STARTUP_TRACE environment variable, which is a
+ * path for the file or "1", or by the "GWStartupTrace" default, with the
+ * path in "GWStartupTracePath".  Without a path the file goes to the
+ * temporary directory as Workspace-startup-<pid>.json.  When tracing is
+ * off every call returns at once.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_STARTUP_TRACE_H
+#define GW_STARTUP_TRACE_H
+
+#import <Foundation/Foundation.h>
+
+/* Reads the environment and the defaults; called first thing in main. */
+void GWStartupTraceStart(void);
+
+BOOL GWStartupTraceIsEnabled(void);
+
+/* A phase ends with the name it began with; phases nest. */
+void GWStartupTraceBegin(NSString *name);
+
+void GWStartupTraceEnd(NSString *name);
+
+void GWStartupTraceMark(NSString *name);
+
+/* Writes the file after the current run loop pass and stops tracing. */
+void GWStartupTraceFinish(void);
+
+#endif /* GW_STARTUP_TRACE_H */
@@ -0,0 +1,217 @@
+/* GWStartupTrace.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <dispatch/dispatch.h>
+#import "GWStartupTrace.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static BOOL traceEnabled = NO;
+static NSString *tracePath = nil;
+static NSMutableArray *traceEvents = nil;
+static NSLock *traceLock = nil;
+
+@interface GWStartupTraceObserver : NSObject
++ (void)bundleDidLoad:(NSNotification *)notif;
+@end
+
+static double monotonicMicroseconds(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/* The main thread is 1, so it sorts first in the viewers */
+static NSNumber *currentThreadId(void)
+{
+  if ([NSThread isMainThread])
+    return [NSNumber numberWithInt: 1];
+  return [NSNumber numberWithUnsignedLong:
+                     (unsigned long)((uintptr_t)pthread_self() & 0xffffffff)];
+}
+
+static void addEvent(NSString *phase, NSString *name, NSDictionary *args)
+{
+  NSMutableDictionary *event;
+
+  if (traceEnabled == NO)
+    return;
+
+  event = [NSMutableDictionary dictionaryWithCapacity: 7];
+  [event setObject: phase forKey: @"ph"];
+  [event setObject: name forKey: @"name"];
+  [event setObject: @"startup" forKey: @"cat"];
+  [event setObject: [NSNumber numberWithDouble: monotonicMicroseconds()]
+            forKey: @"ts"];
+  [event setObject: [NSNumber numberWithInt: (int)getpid()] forKey: @"pid"];
+  [event setObject: currentThreadId() forKey: @"tid"];
+  if ([phase isEqual: @"i"])
+    [event setObject: @"t" forKey: @"s"];
+  if (args)
+    [event setObject: args forKey: @"args"];
+
+  [traceLock lock];
+  [traceEvents addObject: event];
+  [traceLock unlock];
+}
+
+void GWStartupTraceStart(void)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  const char *env = getenv("GW_STARTUP_TRACE");
+  NSString *path = nil;
+
+  if (traceEnabled)
+    {
+      RELEASE (arp);
+      return;
+    }
+
+  if (env && *env && strcmp(env, "0") != 0)
+    {
+      traceEnabled = YES;
+      if (strcmp(env, "1") != 0)
+        path = [NSString stringWithUTF8String: env];
+    }
+  else if ([defaults boolForKey: @"GWStartupTrace"])
+    {
+      traceEnabled = YES;
+      path = [defaults stringForKey: @"GWStartupTracePath"];
+    }
+
+  if (traceEnabled == NO)
+    {
+      RELEASE (arp);
+      return;
+    }
+
+  if ([path length] == 0)
+    {
+      NSString *name = [NSString stringWithFormat: @"Workspace-startup-%d.json",
+                                 (int)getpid()];
+      path = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+    }
+  tracePath = [[path stringByExpandingTildeInPath] copy];
+  traceEvents = [[NSMutableArray alloc] initWithCapacity: 256];
+  traceLock = [NSLock new];
+
+  [[NSNotificationCenter defaultCenter]
+    addObserver: [GWStartupTraceObserver class]
+       selector: @selector(bundleDidLoad:)
+           name: NSBundleDidLoadNotification
+         object: nil];
+
+  addEvent(@"i", @"main", nil);
+  RELEASE (arp);
+}
+
+BOOL GWStartupTraceIsEnabled(void)
+{
+  return traceEnabled;
+}
+
+void GWStartupTraceBegin(NSString *name)
+{
+  addEvent(@"B", name, nil);
+}
+
+void GWStartupTraceEnd(NSString *name)
+{
+  addEvent(@"E", name, nil);
+}
+
+void GWStartupTraceMark(NSString *name)
+{
+  addEvent(@"i", name, nil);
+}
+
+static void writeTrace(void)
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSMutableArray *events;
+  NSDictionary *meta;
+  NSDictionary *trace;
+  NSData *data;
+  NSError *error = nil;
+
+  addEvent(@"i", @"first run loop pass", nil);
+
+  [[NSNotificationCenter defaultCenter]
+    removeObserver: [GWStartupTraceObserver class]
+              name: NSBundleDidLoadNotification
+            object: nil];
+
+  [traceLock lock];
+  traceEnabled = NO;
+  events = AUTORELEASE ([traceEvents mutableCopy]);
+  DESTROY (traceEvents);
+  [traceLock unlock];
+
+  meta = [NSDictionary dictionaryWithObjectsAndKeys:
+                         @"M", @"ph",
+                         @"process_name", @"name",
+                         [NSNumber numberWithInt: (int)getpid()], @"pid",
+                         [NSNumber numberWithInt: 1], @"tid",
+                         [NSDictionary dictionaryWithObject: @"Workspace"
+                                                     forKey: @"name"], @"args",
+                         nil];
+  [events insertObject: meta atIndex: 0];
+
+  trace = [NSDictionary dictionaryWithObjectsAndKeys:
+                          events, @"traceEvents",
+                          @"ms", @"displayTimeUnit",
+                          nil];
+  data = [NSJSONSerialization dataWithJSONObject: trace
+                                         options: 0
+                                           error: &error];
+
+  if (data && [data writeToFile: tracePath atomically: YES])
+    {
+      NSLog(@"Workspace: startup trace written to %@", tracePath);
+    }
+  else
+    {
+      NSLog(@"Workspace: cannot write the startup trace to %@ %@",
+            tracePath, error ? [error localizedDescription] : @"");
+    }
+
+  DESTROY (tracePath);
+  RELEASE (arp);
+}
+
+void GWStartupTraceFinish(void)
+{
+  if (traceEnabled == NO)
+    return;
+
+  /* queued behind what the launch left for the run loop */
+  dispatch_async(dispatch_get_main_queue(), ^{
+    writeTrace();
+  });
+}
+
+
+@implementation GWStartupTraceObserver
+
++ (void)bundleDidLoad:(NSNotification *)notif
+{
+  NSBundle *bundle = [notif object];
+  NSString *path = [bundle bundlePath];
+
+  addEvent(@"i",
+           [NSString stringWithFormat: @"load %@", [path lastPathComponent]],
+           path ? [NSDictionary dictionaryWithObject: path forKey: @"path"] : nil);
+}
+
+@end
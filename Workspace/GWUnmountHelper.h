@@ -62,4 +62,27 @@
  */
 + (BOOL)unmountPath:(NSString *)mountPoint;
 
+/**
+ * Unmount independent volumes at the same time, without ejecting.
+ * Each volume has at most `timeout` seconds for all of its umount
+ * attempts: a command still running then is killed and the volume
+ * counts as failed.  Call it on the main thread, where the will-unmount
+ * notifications are posted.  Returns the mount points that could not be
+ * unmounted; the processes holding them are logged.
+ */
++ (NSArray *)unmountPaths:(NSArray *)mountPoints timeout:(NSTimeInterval)timeout;
+
+/**
+ * The processes with a working directory, root, executable or open file
+ * on one of the volumes, found in a single scan of /proc that is spread
+ * over the CPUs.  Maps each mount point in use to an NSArray of NSNumber
+ * pids.  Empty where there is no /proc.
+ */
++ (NSDictionary *)processesUsingMountPoints:(NSArray *)mountPoints;
+
+/**
+ * "name (pid), ..." for the processes, for logs and error messages
+ */
++ (NSString *)descriptionOfProcesses:(NSArray *)pids;
+
 @end
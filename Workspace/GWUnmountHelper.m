@@ -6,7 +6,19 @@
  */
 
 #import "GWUnmountHelper.h"
+#import "FSNMountTable.h"
 #import <AppKit/AppKit.h>
+#import <dispatch/dispatch.h>
+#import <sys/stat.h>
+#import <dirent.h>
+#import <signal.h>
+#import <unistd.h>
+#ifdef __linux__
+#import <sys/sysmacros.h>
+#endif
+
+/* Seconds a timed-out command has to exit after SIGTERM before SIGKILL */
+#define GW_UNMOUNT_KILL_GRACE 1.0
 
 static NSString *GWTrimmedString(NSString *s)
 {
@@ -16,6 +28,90 @@ static NSString *GWTrimmedString(NSString *s)
   return [s stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
 }
 
+/* YES without a deadline, or while it has not passed */
+static BOOL GWDeadlineIsPending(NSDate *deadline)
+{
+  return (deadline == nil || [deadline timeIntervalSinceNow] > 0);
+}
+
+#ifdef __linux__
+/* YES if `path` is `mountPoint` or inside it */
+static BOOL GWPathIsOnMountPoint(const char *path, const char *mountPoint)
+{
+  size_t len = strlen(mountPoint);
+
+  if (len == 1 && mountPoint[0] == '/') {
+    return (path[0] == '/');
+  }
+  return (strncmp(path, mountPoint, len) == 0
+          && (path[len] == '/' || path[len] == '\0'));
+}
+
+/* Marks the volumes the file behind the /proc link `link` is on.  A file
+   whose path is on one of them is not stat()ed: a dead network volume
+   would block the call. */
+static void GWMarkVolumesOfLink(const char *link, const char **paths,
+                                const dev_t *devs, NSUInteger count, BOOL *hits)
+{
+  char target[PATH_MAX];
+  ssize_t len = readlink(link, target, sizeof(target) - 1);
+  BOOL onPath = NO;
+  struct stat st;
+  NSUInteger i;
+
+  /* sockets, pipes and anonymous inodes have no path */
+  if (len <= 0 || target[0] != '/') {
+    return;
+  }
+  target[len] = '\0';
+
+  for (i = 0; i < count; i++) {
+    if (GWPathIsOnMountPoint(target, paths[i])) {
+      hits[i] = YES;
+      onPath = YES;
+    }
+  }
+
+  if (onPath == NO && stat(link, &st) == 0) {
+    for (i = 0; i < count; i++) {
+      if (devs[i] != 0 && st.st_dev == devs[i]) {
+        hits[i] = YES;
+      }
+    }
+  }
+}
+
+/* The mapped files of a process, by the device in /proc/<pid>/maps */
+static void GWMarkVolumesOfMaps(const char *mapsPath, const dev_t *devs,
+                                NSUInteger count, BOOL *hits)
+{
+  FILE *fp = fopen(mapsPath, "r");
+  char line[1024];
+
+  if (fp == NULL) {
+    return;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    unsigned int maj, min;
+    unsigned long inode;
+    NSUInteger i;
+
+    /* start-end perms offset maj:min inode path */
+    if (sscanf(line, "%*s %*s %*s %x:%x %lu", &maj, &min, &inode) != 3 || inode == 0) {
+      continue;
+    }
+    for (i = 0; i < count; i++) {
+      if (devs[i] != 0 && makedev(maj, min) == devs[i]) {
+        hits[i] = YES;
+      }
+    }
+  }
+
+  fclose(fp);
+}
+#endif
+
 @implementation GWUnmountHelper
 
 + (NSString *)findSudoPath
@@ -87,9 +183,40 @@ static NSString *GWTrimmedString(NSString *s)
     NSDebugLLog(@"gwspace", @"GWUnmountHelper: Unmount-only mode (no eject), using umount command");
   }
 
+  NSString *lastOutput = nil;
+  unmounted = [self runUnmountCommandsForPath:mountPoint deadline:nil output:&lastOutput];
+  if (unmounted) {
+    return YES;
+  }
+
+  NSArray *holders = [[self processesUsingMountPoints:@[mountPoint]] objectForKey:mountPoint];
+  if ([holders count] > 0) {
+    NSString *inUse = [NSString stringWithFormat:NSLocalizedString(@"In use by %@.", @""),
+                                [self descriptionOfProcesses:holders]];
+    NSDebugLLog(@"gwspace", @"GWUnmountHelper: %@ %@", mountPoint, inUse);
+    lastOutput = GWTrimmedString(lastOutput) ? [NSString stringWithFormat:@"%@\n%@", lastOutput, inUse] : inUse;
+  }
+  if (errorString) {
+    if (GWTrimmedString(lastOutput)) {
+      *errorString = lastOutput;
+    } else {
+      *errorString = NSLocalizedString(@"Unmount failed.", @"");
+    }
+  }
+  return NO;
+}
+
+/* umount, sudo umount, sudo umount -f and, on Linux, sudo umount -l, until
+   one succeeds or `deadline` (if any) has passed. */
++ (BOOL)runUnmountCommandsForPath:(NSString *)mountPoint
+                         deadline:(NSDate *)deadline
+                           output:(NSString **)output
+{
+  BOOL unmounted = NO;
+
   /* First try unmount without sudo (works for user-mounted volumes). */
   NSString *lastOutput = nil;
-  unmounted = [self runCommand:@"umount" arguments:@[mountPoint] output:&lastOutput];
+  unmounted = [self runCommand:@"umount" arguments:@[mountPoint] output:&lastOutput deadline:deadline];
   if (unmounted) {
     NSDebugLLog(@"gwspace", @"GWUnmountHelper: umount succeeded (no sudo)");
     return YES;
@@ -100,31 +227,37 @@ static NSString *GWTrimmedString(NSString *s)
 
   /* Try with sudo umount command (askpass if configured via env). */
   NSString *sudoPath = [self findSudoPath];
-  unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", mountPoint] output:&lastOutput];
+  if (GWDeadlineIsPending(deadline)) {
+    unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", mountPoint] output:&lastOutput deadline:deadline];
   
-  if (unmounted) {
-    NSDebugLLog(@"gwspace", @"GWUnmountHelper: sudo umount succeeded");
-    return YES;
+    if (unmounted) {
+      NSDebugLLog(@"gwspace", @"GWUnmountHelper: sudo umount succeeded");
+      return YES;
+    }
   }
   
   /* Try force unmount */
-  NSDebugLLog(@"gwspace", @"GWUnmountHelper: Normal unmount failed, trying force unmount (sudo umount -f)");
-  unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", @"-f", mountPoint] output:&lastOutput];
+  if (GWDeadlineIsPending(deadline)) {
+    NSDebugLLog(@"gwspace", @"GWUnmountHelper: Normal unmount failed, trying force unmount (sudo umount -f)");
+    unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", @"-f", mountPoint] output:&lastOutput deadline:deadline];
   
-  if (unmounted) {
-    NSDebugLLog(@"gwspace", @"GWUnmountHelper: Force unmount succeeded");
-    return YES;
+    if (unmounted) {
+      NSDebugLLog(@"gwspace", @"GWUnmountHelper: Force unmount succeeded");
+      return YES;
+    }
   }
   
 
 #if defined(__linux__)
   /* Last resort: lazy unmount (Linux only) */
-  NSDebugLLog(@"gwspace", @"GWUnmountHelper: Force unmount failed, trying lazy unmount (sudo umount -l)");
-  unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", @"-l", mountPoint] output:&lastOutput];
+  if (GWDeadlineIsPending(deadline)) {
+    NSDebugLLog(@"gwspace", @"GWUnmountHelper: Force unmount failed, trying lazy unmount (sudo umount -l)");
+    unmounted = [self runCommand:sudoPath arguments:@[@"-A", @"-E", @"umount", @"-l", mountPoint] output:&lastOutput deadline:deadline];
 
-  if (unmounted) {
-    NSDebugLLog(@"gwspace", @"GWUnmountHelper: Lazy unmount succeeded");
-    return YES;
+    if (unmounted) {
+      NSDebugLLog(@"gwspace", @"GWUnmountHelper: Lazy unmount succeeded");
+      return YES;
+    }
   }
 #endif
   
@@ -133,17 +266,23 @@ static NSString *GWTrimmedString(NSString *s)
   } else {
     NSDebugLLog(@"gwspace", @"GWUnmountHelper: ERROR - All unmount attempts failed for %@", mountPoint);
   }
-  if (errorString) {
-    if (GWTrimmedString(lastOutput)) {
-      *errorString = lastOutput;
-    } else {
-      *errorString = NSLocalizedString(@"Unmount failed.", @"");
-    }
+  if (output) {
+    *output = lastOutput;
   }
   return NO;
 }
 
 + (BOOL)runCommand:(NSString *)launchPath arguments:(NSArray *)arguments output:(NSString **)output
+{
+  return [self runCommand:launchPath arguments:arguments output:output deadline:nil];
+}
+
+/* A command still running at `deadline` is terminated, then killed, and
+   counts as failed; its output is not read. */
++ (BOOL)runCommand:(NSString *)launchPath
+         arguments:(NSArray *)arguments
+            output:(NSString **)output
+          deadline:(NSDate *)deadline
 {
   if (output) {
     *output = nil;
@@ -173,9 +312,30 @@ static NSString *GWTrimmedString(NSString *s)
   
   @try {
     [task launch];
-    [task waitUntilExit];
-    data = [[pipe fileHandleForReading] readDataToEndOfFile];
-    success = ([task terminationStatus] == 0);
+    if (deadline == nil) {
+      [task waitUntilExit];
+    } else {
+      while ([task isRunning] && [deadline timeIntervalSinceNow] > 0) {
+        usleep(20000);
+      }
+      if ([task isRunning]) {
+        NSDate *grace = [NSDate dateWithTimeIntervalSinceNow:GW_UNMOUNT_KILL_GRACE];
+
+        NSDebugLLog(@"gwspace", @"GWUnmountHelper: %@ %@ timed out, terminating it", launchPath, arguments);
+        [task terminate];
+        while ([task isRunning] && [grace timeIntervalSinceNow] > 0) {
+          usleep(20000);
+        }
+        if ([task isRunning]) {
+          kill([task processIdentifier], SIGKILL);
+        }
+      }
+    }
+    /* a command stuck in the kernel may outlive SIGKILL: it is left behind */
+    if ([task isRunning] == NO) {
+      data = [[pipe fileHandleForReading] readDataToEndOfFile];
+      success = ([task terminationStatus] == 0);
+    }
   } @catch (NSException *e) {
     NSDebugLLog(@"gwspace", @"GWUnmountHelper: Exception running command %@: %@", launchPath, e);
     success = NO;
@@ -198,4 +358,207 @@ static NSString *GWTrimmedString(NSString *s)
   return success;
 }
 
++ (NSArray *)unmountPaths:(NSArray *)mountPoints timeout:(NSTimeInterval)timeout
+{
+  NSMutableDictionary *results = [NSMutableDictionary dictionary];
+  NSMutableArray *failed = [NSMutableArray array];
+  NSLock *lock = [[NSLock alloc] init];
+  dispatch_group_t group = dispatch_group_create();
+  dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+  NSUInteger i;
+
+  for (i = 0; i < [mountPoints count]; i++) {
+    NSString *mountPoint = [mountPoints objectAtIndex:i];
+
+    NSDebugLLog(@"gwspace", @"GWUnmountHelper: Unmounting %@ (in parallel, %.0fs)", mountPoint, timeout);
+    [[NSNotificationCenter defaultCenter]
+      postNotificationName:NSWorkspaceWillUnmountNotification
+                    object:[NSWorkspace sharedWorkspace]
+                  userInfo:[NSDictionary dictionaryWithObject:mountPoint forKey:@"NSDevicePath"]];
+
+    dispatch_group_async(group, queue, ^{
+      CREATE_AUTORELEASE_POOL(arp);
+      NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+      BOOL unmounted = [self runUnmountCommandsForPath:mountPoint deadline:deadline output:NULL];
+
+      [lock lock];
+      [results setObject:[NSNumber numberWithBool:unmounted] forKey:mountPoint];
+      [lock unlock];
+      RELEASE(arp);
+    });
+  }
+
+  /* A command that outlives SIGKILL does not hold up the others */
+  dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW,
+                      (int64_t)((timeout + 2 * GW_UNMOUNT_KILL_GRACE) * NSEC_PER_SEC)));
+  dispatch_release(group);
+
+  [lock lock];
+  for (i = 0; i < [mountPoints count]; i++) {
+    NSString *mountPoint = [mountPoints objectAtIndex:i];
+
+    if ([[results objectForKey:mountPoint] boolValue] == NO) {
+      [failed addObject:mountPoint];
+    }
+  }
+  [lock unlock];
+  RELEASE(lock);
+
+  if ([failed count] > 0) {
+    NSDictionary *holders = [self processesUsingMountPoints:failed];
+
+    for (i = 0; i < [failed count]; i++) {
+      NSString *mountPoint = [failed objectAtIndex:i];
+      NSArray *pids = [holders objectForKey:mountPoint];
+
+      if ([pids count] > 0) {
+        NSLog(@"GWUnmountHelper: could not unmount %@, in use by %@",
+              mountPoint, [self descriptionOfProcesses:pids]);
+      } else {
+        NSLog(@"GWUnmountHelper: could not unmount %@", mountPoint);
+      }
+    }
+  }
+
+  return failed;
+}
+
++ (NSDictionary *)processesUsingMountPoints:(NSArray *)mountPoints
+{
+  NSMutableDictionary *holders = [NSMutableDictionary dictionary];
+#ifdef __linux__
+  NSUInteger count = [mountPoints count];
+  FSNMountTable *table = [FSNMountTable sharedTable];
+  const char **paths;
+  dev_t *devs;
+  pid_t *pids;
+  size_t npids = 0;
+  size_t capacity = 512;
+  NSLock *lock;
+  DIR *proc;
+  struct dirent *entry;
+  NSUInteger i;
+
+  if (count == 0) {
+    return holders;
+  }
+
+  proc = opendir("/proc");
+  if (proc == NULL) {
+    return holders;
+  }
+
+  paths = malloc(sizeof(char *) * count);
+  devs = malloc(sizeof(dev_t) * count);
+  for (i = 0; i < count; i++) {
+    NSString *mountPoint = [mountPoints objectAtIndex:i];
+    FSNMountEntry *mount = [table entryForMountPoint:mountPoint];
+
+    paths[i] = strdup([mountPoint fileSystemRepresentation]);
+    /* the table has the device without a stat() of the volume */
+    devs[i] = mount ? [mount device] : 0;
+  }
+
+  pids = malloc(sizeof(pid_t) * capacity);
+  while ((entry = readdir(proc)) != NULL) {
+    char *end;
+    long pid = strtol(entry->d_name, &end, 10);
+
+    if (*end != '\0' || pid <= 0) {
+      continue;
+    }
+    if (npids == capacity) {
+      capacity *= 2;
+      pids = realloc(pids, sizeof(pid_t) * capacity);
+    }
+    pids[npids++] = (pid_t)pid;
+  }
+  closedir(proc);
+
+  lock = [[NSLock alloc] init];
+
+  /* one pass over the processes, on all the CPUs */
+  dispatch_apply(npids, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t n) {
+    BOOL *hits = calloc(count, sizeof(BOOL));
+    char link[64];
+    DIR *fds;
+    NSUInteger j;
+
+    snprintf(link, sizeof(link), "/proc/%d/cwd", (int)pids[n]);
+    GWMarkVolumesOfLink(link, paths, devs, count, hits);
+    snprintf(link, sizeof(link), "/proc/%d/root", (int)pids[n]);
+    GWMarkVolumesOfLink(link, paths, devs, count, hits);
+    snprintf(link, sizeof(link), "/proc/%d/exe", (int)pids[n]);
+    GWMarkVolumesOfLink(link, paths, devs, count, hits);
+    snprintf(link, sizeof(link), "/proc/%d/maps", (int)pids[n]);
+    GWMarkVolumesOfMaps(link, devs, count, hits);
+
+    snprintf(link, sizeof(link), "/proc/%d/fd", (int)pids[n]);
+    fds = opendir(link);
+    if (fds) {
+      struct dirent *fd;
+
+      while ((fd = readdir(fds)) != NULL) {
+        char fdLink[96];
+
+        if (fd->d_name[0] == '.') {
+          continue;
+        }
+        snprintf(fdLink, sizeof(fdLink), "%s/%s", link, fd->d_name);
+        GWMarkVolumesOfLink(fdLink, paths, devs, count, hits);
+      }
+      closedir(fds);
+    }
+
+    for (j = 0; j < count; j++) {
+      if (hits[j]) {
+        NSString *mountPoint = [mountPoints objectAtIndex:j];
+        NSMutableArray *list;
+
+        [lock lock];
+        list = [holders objectForKey:mountPoint];
+        if (list == nil) {
+          list = [NSMutableArray array];
+          [holders setObject:list forKey:mountPoint];
+        }
+        [list addObject:[NSNumber numberWithInt:(int)pids[n]]];
+        [lock unlock];
+      }
+    }
+    free(hits);
+  });
+
+  RELEASE(lock);
+  for (i = 0; i < count; i++) {
+    free((char *)paths[i]);
+  }
+  free(paths);
+  free(devs);
+  free(pids);
+#endif
+  return holders;
+}
+
++ (NSString *)descriptionOfProcesses:(NSArray *)pids
+{
+  NSMutableArray *names = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [pids count]; i++) {
+    int pid = [[pids objectAtIndex:i] intValue];
+    NSString *commPath = [NSString stringWithFormat:@"/proc/%d/comm", pid];
+    NSString *comm = GWTrimmedString([NSString stringWithContentsOfFile:commPath
+                                                               encoding:NSUTF8StringEncoding
+                                                                  error:NULL]);
+
+    if ([comm length] > 0) {
+      [names addObject:[NSString stringWithFormat:@"%@ (%d)", comm, pid]];
+    } else {
+      [names addObject:[NSString stringWithFormat:@"%d", pid]];
+    }
+  }
+
+  return [names componentsJoinedByString:@", "];
+}
+
 @end
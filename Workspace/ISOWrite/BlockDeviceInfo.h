@@ -80,7 +80,9 @@ typedef NS_ENUM(NSInteger, PartitionTableType) {
 @property (nonatomic, assign, readonly) BOOL isValid;
 
 /**
- * Create a BlockDeviceInfo from a device path (e.g., /dev/sdb)
+ * Create a BlockDeviceInfo from a device path (e.g., /dev/sdb).
+ * The info comes from BlockDeviceRegistry, which scans each device once
+ * and again only after it or the mount table changed.
  */
 + (instancetype)infoForDevicePath:(NSString *)devicePath;
 
@@ -5,6 +5,7 @@
  */
 
 #import "BlockDeviceInfo.h"
+#import "BlockDeviceRegistry.h"
 #import <sys/stat.h>
 #import <sys/param.h>
 #if defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
@@ -149,6 +150,11 @@
 }
 
 + (instancetype)infoForDevicePath:(NSString *)devicePath
+{
+  return [[BlockDeviceRegistry sharedRegistry] infoForDevicePath:devicePath];
+}
+
++ (instancetype)scannedInfoForDevicePath:(NSString *)devicePath
 {
   if (!devicePath || [devicePath length] == 0) {
     return nil;
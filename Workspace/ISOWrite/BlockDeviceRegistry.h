@@ -0,0 +1,54 @@
+/*
+ * BlockDeviceRegistry.h
+ *
+ * The BlockDeviceInfo of each block device, scanned once and kept until
+ * the device or the mount table changes.
+ *
+ * A scan reads sysfs, runs lsblk for the partition table and parses the
+ * mount table, which is too slow to repeat for every drag over a volume
+ * or every dialog.  On Linux the kernel's block uevents are read from a
+ * netlink socket (or, without one, inotify on /dev) and drop the cache;
+ * everywhere, a new FSNMountTable generation drops it as well.  Nothing
+ * runs in the background: pending events are drained on the next lookup.
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef BLOCKDEVICEREGISTRY_H
+#define BLOCKDEVICEREGISTRY_H
+
+#import <Foundation/Foundation.h>
+
+@class BlockDeviceInfo;
+
+@interface BlockDeviceRegistry : NSObject
+{
+  NSLock *_lock;
+  NSMutableDictionary *_infoByPath;
+  unsigned long _mountGeneration;
+  int _eventFd;
+  BOOL _eventsAreUevents;
+}
+
++ (BlockDeviceRegistry *)sharedRegistry;
+
+/**
+ * The cached info of a device, scanned now if there is none or the
+ * device may have changed since.  nil if it is not a block device.
+ */
+- (BlockDeviceInfo *)infoForDevicePath:(NSString *)devicePath;
+
+/**
+ * Scans the device again whatever the cache holds; used right before
+ * a device is written.
+ */
+- (BlockDeviceInfo *)rescanDevicePath:(NSString *)devicePath;
+
+/**
+ * Forgets every device, e.g. after a device was written or formatted.
+ */
+- (void)invalidate;
+
+@end
+
+#endif /* BLOCKDEVICEREGISTRY_H */
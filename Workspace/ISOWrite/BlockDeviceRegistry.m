@@ -0,0 +1,232 @@
+/*
+ * BlockDeviceRegistry.m
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#import "BlockDeviceRegistry.h"
+#import "BlockDeviceInfo.h"
+#import "FSNMountTable.h"
+
+#import <unistd.h>
+#import <errno.h>
+#ifdef __linux__
+#import <sys/socket.h>
+#import <sys/inotify.h>
+#import <linux/netlink.h>
+#endif
+
+@interface BlockDeviceInfo (Scan)
++ (instancetype)scannedInfoForDevicePath:(NSString *)devicePath;
+@end
+
+#ifdef __linux__
+/* A kernel uevent is "ACTION@DEVPATH" and then KEY=VALUE fields, each
+   ended by a NUL. */
+static BOOL
+ueventIsForBlockDevice(const char *buf, size_t len)
+{
+  static const char key[] = "SUBSYSTEM=block";
+  size_t i = 0;
+
+  while (i < len) {
+    size_t n = strnlen(buf + i, len - i);
+
+    if (n == sizeof(key) - 1 && memcmp(buf + i, key, n) == 0) {
+      return YES;
+    }
+    i += n + 1;
+  }
+
+  return NO;
+}
+#endif
+
+@implementation BlockDeviceRegistry
+
++ (BlockDeviceRegistry *)sharedRegistry
+{
+  static BlockDeviceRegistry *shared = nil;
+
+  @synchronized(self) {
+    if (shared == nil) {
+      shared = [[BlockDeviceRegistry alloc] init];
+    }
+  }
+  return shared;
+}
+
+- (void)dealloc
+{
+  if (_eventFd >= 0) {
+    close(_eventFd);
+  }
+  [_infoByPath release];
+  [_lock release];
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+  if (self) {
+    _lock = [[NSLock alloc] init];
+    _infoByPath = [[NSMutableDictionary alloc] init];
+    _mountGeneration = [[FSNMountTable sharedTable] generation];
+    _eventFd = -1;
+    _eventsAreUevents = NO;
+
+#ifdef __linux__
+    {
+      int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                      NETLINK_KOBJECT_UEVENT);
+      if (fd >= 0) {
+        struct sockaddr_nl addr;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = 1;  /* the kernel's own events */
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+          _eventFd = fd;
+          _eventsAreUevents = YES;
+        } else {
+          NSDebugLLog(@"gwspace", @"BlockDeviceRegistry: cannot bind uevent socket: %s", strerror(errno));
+          close(fd);
+        }
+      }
+
+      if (_eventFd < 0) {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0) {
+          if (inotify_add_watch(fd, "/dev", IN_CREATE | IN_DELETE | IN_ATTRIB
+                                | IN_MOVED_FROM | IN_MOVED_TO) >= 0) {
+            _eventFd = fd;
+          } else {
+            close(fd);
+          }
+        }
+      }
+
+      if (_eventFd < 0) {
+        NSDebugLLog(@"gwspace", @"BlockDeviceRegistry: no device events, devices are scanned on every lookup");
+      }
+    }
+#endif
+  }
+  return self;
+}
+
+/* Drains the pending events; YES if any of them may be about a block
+   device.  Called with the lock held. */
+- (BOOL)drainDeviceEvents
+{
+  BOOL changed = NO;
+
+#ifdef __linux__
+  char buf[8192];
+
+  if (_eventFd < 0) {
+    return NO;
+  }
+
+  while (1) {
+    ssize_t n = read(_eventFd, buf, sizeof(buf));
+
+    if (n > 0) {
+      if (changed == NO) {
+        changed = (_eventsAreUevents == NO) || ueventIsForBlockDevice(buf, (size_t)n);
+      }
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && errno == ENOBUFS) {
+      /* the socket overflowed and events were lost */
+      changed = YES;
+    } else {
+      break;
+    }
+  }
+#endif
+
+  return changed;
+}
+
+/* Drops the cache when something changed since the last lookup, and
+   then returns YES.  Called with the lock held. */
+- (BOOL)validateCache
+{
+  unsigned long generation = [[FSNMountTable sharedTable] generation];
+  BOOL changed = [self drainDeviceEvents];
+
+  if (generation != _mountGeneration) {
+    _mountGeneration = generation;
+    changed = YES;
+  }
+
+#ifdef __linux__
+  /* without events nothing tells us a cached device is still the same */
+  if (_eventFd < 0) {
+    changed = YES;
+  }
+#endif
+
+  if (changed && [_infoByPath count] > 0) {
+    NSDebugLLog(@"gwspace", @"BlockDeviceRegistry: devices or mounts changed, dropping %lu cached devices",
+                (unsigned long)[_infoByPath count]);
+    [_infoByPath removeAllObjects];
+  }
+
+  return changed;
+}
+
+- (BlockDeviceInfo *)infoForDevicePath:(NSString *)devicePath
+{
+  BlockDeviceInfo *info;
+
+  if (!devicePath || [devicePath length] == 0) {
+    return nil;
+  }
+
+  [_lock lock];
+  [self validateCache];
+  info = [[_infoByPath objectForKey:devicePath] retain];
+  [_lock unlock];
+
+  if (info) {
+    return [info autorelease];
+  }
+
+  return [self rescanDevicePath:devicePath];
+}
+
+- (BlockDeviceInfo *)rescanDevicePath:(NSString *)devicePath
+{
+  BlockDeviceInfo *info;
+
+  if (!devicePath || [devicePath length] == 0) {
+    return nil;
+  }
+
+  /* scanned outside the lock: lsblk may take a while */
+  info = [BlockDeviceInfo scannedInfoForDevicePath:devicePath];
+
+  [_lock lock];
+  /* what changed during the scan may not be in it */
+  if ([self validateCache] == NO && info) {
+    [_infoByPath setObject:info forKey:devicePath];
+  } else {
+    [_infoByPath removeObjectForKey:devicePath];
+  }
+  [_lock unlock];
+
+  return info;
+}
+
+- (void)invalidate
+{
+  [_lock lock];
+  [self drainDeviceEvents];
+  [_infoByPath removeAllObjects];
+  [_lock unlock];
+}
+
+@end
@@ -7,6 +7,7 @@
 
 #import "DiskFormatOperation.h"
 #import "BlockDeviceInfo.h"
+#import "BlockDeviceRegistry.h"
 #import "../GWUnmountHelper.h"
 
 #import <Foundation/Foundation.h>
@@ -221,6 +222,15 @@
     return NO;
   }
 
+  /* The device about to be erased is checked as it is now, not as cached */
+  deviceInfo = [[BlockDeviceRegistry sharedRegistry] rescanDevicePath:deviceInfo.devicePath];
+  if (!deviceInfo || !deviceInfo.isValid) {
+    if (errorMessage) {
+      *errorMessage = NSLocalizedString(@"Cannot read information for the selected device.", @"");
+    }
+    return NO;
+  }
+
   NSString *devicePath = deviceInfo.devicePath;
 
   NSString *safetyError = [deviceInfo safetyCheckForWriting];
@@ -300,6 +310,7 @@
     return NO;
   }
 
+  [[BlockDeviceRegistry sharedRegistry] invalidate];
   NSDebugLLog(@"gwspace", @"DiskFormatOperation: Successfully formatted %@", devicePath);
   return YES;
 }
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2026 Simon Peter
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef ISOIMAGEDIGEST_H
+#define ISOIMAGEDIGEST_H
+
+/*
+ * The digest isowrite-helper takes of the image while writing it and
+ * ISOWriteOperation takes of the device when reading it back.  It finds
+ * corrupted or short writes, it is not meant to resist tampering; four
+ * independent 64-bit lanes keep it well above USB bandwidth.  Header
+ * only, so that the helper does not link against Workspace.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#define ISO_DIGEST_BLOCK 32
+#define ISO_DIGEST_PRIME 0x9e3779b97f4a7c15ULL
+
+typedef struct {
+  uint64_t lanes[4];
+  uint64_t length;
+  unsigned char tail[ISO_DIGEST_BLOCK];
+  size_t tailLength;
+} ISOImageDigest;
+
+static inline void ISOImageDigestInit(ISOImageDigest *d)
+{
+  d->lanes[0] = 0xcbf29ce484222325ULL;
+  d->lanes[1] = 0x84222325cbf29ce4ULL;
+  d->lanes[2] = 0x2325cbf29ce48422ULL;
+  d->lanes[3] = 0x9ce484222325cbf2ULL;
+  d->length = 0;
+  d->tailLength = 0;
+}
+
+static inline void ISOImageDigestBlock(ISOImageDigest *d, const unsigned char *p)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    uint64_t w;
+
+    memcpy(&w, p + (i * 8), 8);
+    d->lanes[i] = (d->lanes[i] ^ w) * ISO_DIGEST_PRIME;
+    d->lanes[i] ^= d->lanes[i] >> 29;
+  }
+}
+
+static inline void ISOImageDigestUpdate(ISOImageDigest *d, const void *bytes, size_t len)
+{
+  const unsigned char *p = (const unsigned char *)bytes;
+
+  d->length += len;
+
+  if (d->tailLength > 0) {
+    size_t n = ISO_DIGEST_BLOCK - d->tailLength;
+
+    if (n > len) {
+      n = len;
+    }
+    memcpy(d->tail + d->tailLength, p, n);
+    d->tailLength += n;
+    p += n;
+    len -= n;
+    if (d->tailLength < ISO_DIGEST_BLOCK) {
+      return;
+    }
+    ISOImageDigestBlock(d, d->tail);
+    d->tailLength = 0;
+  }
+
+  while (len >= ISO_DIGEST_BLOCK) {
+    ISOImageDigestBlock(d, p);
+    p += ISO_DIGEST_BLOCK;
+    len -= ISO_DIGEST_BLOCK;
+  }
+
+  if (len > 0) {
+    memcpy(d->tail, p, len);
+    d->tailLength = len;
+  }
+}
+
+static inline uint64_t ISOImageDigestFinal(ISOImageDigest *d)
+{
+  uint64_t h = d->length * ISO_DIGEST_PRIME;
+  size_t i;
+
+  for (i = 0; i < d->tailLength; i++) {
+    h = (h ^ d->tail[i]) * 0x100000001b3ULL;
+  }
+  for (i = 0; i < 4; i++) {
+    h = (h ^ d->lanes[i]) * ISO_DIGEST_PRIME;
+    h ^= h >> 31;
+  }
+
+  return h;
+}
+
+#endif /* ISOIMAGEDIGEST_H */
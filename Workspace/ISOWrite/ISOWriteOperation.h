@@ -59,7 +59,8 @@ typedef NS_ENUM(NSInteger, ISOWriteState) {
  * - Requires multi-step user confirmation
  * - Unmounts all partitions before writing
  * - Provides cancellation support
- * - Performs optional verification after write
+ * - Performs optional verification after write, comparing the digest
+ *   of the device read-back with the one taken while writing
  */
 @interface ISOWriteOperation : NSObject <ISOWriteProgressDelegate>
 {
@@ -70,6 +71,11 @@ typedef NS_ENUM(NSInteger, ISOWriteState) {
   unsigned long long _isoSize;
   unsigned long long _bytesWritten;
   
+  /* Digest of the image isowrite-helper wrote, see ISOImageDigest.h */
+  unsigned long long _imageDigest;
+  unsigned long long _imageDigestLength;
+  BOOL _hasImageDigest;
+  
   ISOWriteState _state;
   BOOL _cancelled;
   BOOL _verifyAfterWrite;
@@ -6,8 +6,10 @@
 
 #import "ISOWriteOperation.h"
 #import "BlockDeviceInfo.h"
+#import "BlockDeviceRegistry.h"
 #import "DeviceEraseConfirmation.h"
 #import "ISOWriteProgressWindow.h"
+#import "ISOImageDigest.h"
 #import "../GWUnmountHelper.h"
 
 #import <AppKit/AppKit.h>
@@ -32,6 +34,10 @@
 /* Buffer size for copying: 1MB for optimal throughput */
 #define ISO_WRITE_BUFFER_SIZE (1024 * 1024)
 
+/* Read-back when verifying the digest; a multiple of the O_DIRECT alignment */
+#define VERIFY_BUFFER_SIZE (4 * 1024 * 1024)
+#define VERIFY_ALIGNMENT 4096
+
 /* Progress update interval in seconds */
 #define PROGRESS_UPDATE_INTERVAL 0.25
 
@@ -210,7 +216,7 @@
   NSDebugLLog(@"gwspace", @"ISOWriteOperation: ISO size: %llu bytes (%@)", _isoSize, [[self class] sizeDescription:_isoSize]);
   
   /* Get device info */
-  _deviceInfo = [[BlockDeviceInfo infoForDevicePath:_devicePath] retain];
+  _deviceInfo = [[[BlockDeviceRegistry sharedRegistry] rescanDevicePath:_devicePath] retain];
   if (!_deviceInfo || !_deviceInfo.isValid) {
     NSDebugLLog(@"gwspace", @"ISOWriteOperation: ERROR - Cannot determine device information");
     [self failWithError:@"Cannot determine device information."];
@@ -416,6 +422,27 @@
   return YES;
 }
 
+/* "DIGEST: 3849ed86197267d8 13000017", printed once all is synced */
+- (BOOL)scanDigestLine:(NSString *)line
+{
+  NSScanner *scanner;
+  unsigned long long digest;
+  long long length;
+
+  if (![line hasPrefix:@"DIGEST:"]) {
+    return NO;
+  }
+
+  scanner = [NSScanner scannerWithString:line];
+  [scanner scanString:@"DIGEST:" intoString:NULL];
+  if ([scanner scanHexLongLong:&digest] && [scanner scanLongLong:&length]) {
+    _imageDigest = digest;
+    _imageDigestLength = (unsigned long long)length;
+    _hasImageDigest = YES;
+  }
+  return YES;
+}
+
 - (void)writeThread
 {
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
@@ -423,6 +450,7 @@
   NSDebugLLog(@"gwspace", @"ISOWriteOperation: Write thread started");
   _state = ISOWriteStateWriting;
   _bytesWritten = 0;
+  _hasImageDigest = NO;
   _startTime = [[NSDate date] retain];
   
   /* Update UI on main thread */
@@ -620,6 +648,9 @@
               _bytesWritten = (unsigned long long)bytes;
             }
           }
+          else if ([self scanDigestLine:line]) {
+            continue;
+          }
           else if ([line hasPrefix:@"ERROR:"]) {
             if (!errorMessage) {
               errorMessage = [[line substringFromIndex:7] retain];
@@ -669,6 +700,9 @@
                                                   encoding:NSUTF8StringEncoding];
         if (output) {
           NSDebugLLog(@"gwspace", @"isowrite-helper final output: %@", output);
+          for (NSString *line in [output componentsSeparatedByString:@"\n"]) {
+            [self scanDigestLine:line];
+          }
           [output release];
         }
       }
@@ -725,6 +759,7 @@
     /* Trigger partition table rescan before verification/completion */
     NSDebugLLog(@"gwspace", @"ISOWriteOperation: Triggering partition table rescan");
     [self rescanPartitionTable];
+    [[BlockDeviceRegistry sharedRegistry] invalidate];
     
     /* Optionally verify */
     if (_verifyAfterWrite) {
@@ -782,16 +817,118 @@
   usleep(1000000); /* Wait 1 second */
 }
 
-- (void)performVerification
+/* The whole image is read back and hashed; the helper hashed it on its
+   way to the device, so nothing has to be compared byte by byte. */
+- (void)verifyImageDigest
 {
-  NSDebugLLog(@"gwspace", @"ISOWriteOperation: Beginning verification");
-  _state = ISOWriteStateVerifying;
-  
-  dispatch_sync(dispatch_get_main_queue(), ^{
-    [self verifyDidStart];
+  if (_imageDigestLength != _isoSize) {
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: ERROR - Helper wrote %llu of %llu bytes", 
+                _imageDigestLength, _isoSize);
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self failWithError:@"Verification failed: the image was not written completely."];
+    });
+    return;
+  }
+
+  int devFd = open([_devicePath UTF8String], O_RDONLY | O_DIRECT);
+  if (devFd < 0 && errno == EINVAL) {
+    /* O_DIRECT not supported, try without it */
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: O_DIRECT not supported, retrying without it");
+    devFd = open([_devicePath UTF8String], O_RDONLY);
+  }
+  if (devFd < 0) {
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: WARNING - Cannot open device for verification (errno=%d)", errno);
+    _state = ISOWriteStateCompleted;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self writeDidComplete];
+    });
+    return;
+  }
+
+  void *devBuffer = NULL;
+  if (posix_memalign(&devBuffer, VERIFY_ALIGNMENT, VERIFY_BUFFER_SIZE) != 0) {
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: ERROR - Failed to allocate verification buffer");
+    close(devFd);
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self failWithError:@"Memory allocation failed during verification"];
+    });
+    return;
+  }
+
+  posix_fadvise(devFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  ISOImageDigest digest;
+  unsigned long long verified = 0;
+  double lastProgress = 0.0;
+  BOOL readFailed = NO;
+
+  ISOImageDigestInit(&digest);
+  [self updateVerificationProgress:0.0 status:@"Verifying written data..."];
+
+  while (verified < _imageDigestLength && !_cancelled) {
+    unsigned long long left = _imageDigestLength - verified;
+    size_t wanted = (left < VERIFY_BUFFER_SIZE) ? (size_t)left : VERIFY_BUFFER_SIZE;
+    /* O_DIRECT reads whole blocks; the device is larger than the image */
+    size_t request = (wanted + VERIFY_ALIGNMENT - 1) & ~((size_t)VERIFY_ALIGNMENT - 1);
+    ssize_t readBytes = read(devFd, devBuffer, request);
+
+    if (readBytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (readBytes <= 0) {
+      NSDebugLLog(@"gwspace", @"ISOWriteOperation: ERROR - Read-back failed at %llu: %s", 
+                  verified, strerror(errno));
+      readFailed = YES;
+      break;
+    }
+    if ((size_t)readBytes > wanted) {
+      readBytes = wanted;
+    }
+
+    ISOImageDigestUpdate(&digest, devBuffer, (size_t)readBytes);
+    verified += readBytes;
+
+    double progress = (double)verified / (double)_imageDigestLength * 100.0;
+    if (progress - lastProgress >= 1.0) {
+      [self updateVerificationProgress:progress status:nil];
+      lastProgress = progress;
+    }
+  }
+
+  free(devBuffer);
+  close(devFd);
+
+  if (_cancelled) {
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: Verification was cancelled");
+    _state = ISOWriteStateCancelled;
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self writeWasCancelled];
+    });
+    return;
+  }
+
+  if (readFailed || ISOImageDigestFinal(&digest) != _imageDigest) {
+    NSDebugLLog(@"gwspace", @"ISOWriteOperation: ERROR - Verification failed after %llu bytes", verified);
+    NSString *errorMsg = readFailed
+      ? @"Verification failed: the device could not be read back.\n\nThe device may be defective."
+      : @"Verification failed!\n\nThe written data does not match the ISO file. The device may be defective.";
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [self failWithError:errorMsg];
+    });
+    return;
+  }
+
+  NSDebugLLog(@"gwspace", @"ISOWriteOperation: Verification successful");
+  _state = ISOWriteStateCompleted;
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self writeDidComplete];
   });
-  
-  /* Verify by reading first 10MB, middle 10MB, and last 10MB for balance of speed vs thoroughness */
+}
+
+/* Without a digest from the helper: the first, middle and last 10MB are
+   compared, for a balance of speed vs thoroughness */
+- (void)verifySampledRegions
+{
   NSDebugLLog(@"gwspace", @"ISOWriteOperation: Opening files for verification");
   NSFileHandle *isoHandle = [NSFileHandle fileHandleForReadingAtPath:_isoPath];
   int devFd = open([_devicePath UTF8String], O_RDONLY | O_DIRECT);
@@ -914,6 +1051,22 @@
   });
 }
 
+- (void)performVerification
+{
+  NSDebugLLog(@"gwspace", @"ISOWriteOperation: Beginning verification");
+  _state = ISOWriteStateVerifying;
+  
+  dispatch_sync(dispatch_get_main_queue(), ^{
+    [self verifyDidStart];
+  });
+
+  if (_hasImageDigest) {
+    [self verifyImageDigest];
+  } else {
+    [self verifySampledRegions];
+  }
+}
+
 #pragma mark - UI Updates (Main Thread)
 
 - (void)writeDidStart
@@ -9,10 +9,16 @@
 
 #import <Foundation/Foundation.h>
 
+/* The free space is checked again sooner the closer the disk gets to
+ * the warning level at its current rate of filling, and rarely when it
+ * is not filling at all. */
 @interface LowDiskWarn : NSObject
 {
   NSTimer *timer;
   BOOL checking;
+  /* the previous check, to measure how fast the disk fills */
+  double lastFreePercent;
+  NSTimeInterval lastCheckTime;
 }
 
 - (void)startMonitoring;
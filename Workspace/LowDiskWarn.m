@@ -12,6 +12,32 @@
 #import <GNUstepBase/GNUstep.h>
 #include <sys/statvfs.h>
 
+#define LOW_DISK_PERCENT 3.0
+#define MIN_CHECK_INTERVAL 10.0
+#define MAX_CHECK_INTERVAL 900.0
+#define LOW_CHECK_INTERVAL 120.0
+
+/* A quarter of the time the disk would take at its current rate to reach
+   the warning level, so the check is not late when the rate rises. */
+static NSTimeInterval nextCheckInterval(double freePercent, double percentPerSecond)
+{
+  NSTimeInterval interval;
+
+  if (freePercent < LOW_DISK_PERCENT)
+    return LOW_CHECK_INTERVAL;
+
+  if (percentPerSecond <= 0.0)
+    return MAX_CHECK_INTERVAL;
+
+  interval = (freePercent - LOW_DISK_PERCENT) / percentPerSecond / 4.0;
+
+  if (interval < MIN_CHECK_INTERVAL)
+    return MIN_CHECK_INTERVAL;
+  if (interval > MAX_CHECK_INTERVAL)
+    return MAX_CHECK_INTERVAL;
+  return interval;
+}
+
 @implementation LowDiskWarn
 
 - (void)dealloc
@@ -24,12 +50,9 @@
 {
   [NSApplication sharedApplication];
   checking = NO;
+  lastFreePercent = -1.0;
+  lastCheckTime = 0.0;
   [self checkDiskSpace: nil];
-  timer = [NSTimer scheduledTimerWithTimeInterval: 120.0
-                                           target: self
-                                         selector: @selector(checkDiskSpace:)
-                                         userInfo: nil
-                                          repeats: YES];
 }
 
 - (void)stopMonitoring
@@ -41,6 +64,25 @@
   timer = nil;
 }
 
+- (void)scheduleCheckForFreePercent:(double)freePercent
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  double rate = 0.0;
+
+  if ((lastFreePercent >= 0.0) && (now > lastCheckTime))
+    rate = (lastFreePercent - freePercent) / (now - lastCheckTime);
+
+  lastFreePercent = freePercent;
+  lastCheckTime = now;
+
+  [self stopMonitoring];
+  timer = [NSTimer scheduledTimerWithTimeInterval: nextCheckInterval(freePercent, rate)
+                                           target: self
+                                         selector: @selector(checkDiskSpace:)
+                                         userInfo: nil
+                                          repeats: NO];
+}
+
 - (void)checkDiskSpace:(NSTimer *)aTimer
 {
   if (checking)
@@ -49,13 +91,16 @@
 
   struct statvfs buf;
   int ret = statvfs("/", &buf);
+  double freePercent = -1.0;
 
   if (ret == 0)
     {
-      /* Skip read-only volumes (e.g. live/install media, overlay roots). */
+      /* Skip read-only volumes (e.g. live/install media, overlay roots);
+         they do not fill, so they are checked seldom. */
       if (buf.f_flag & ST_RDONLY)
         {
           checking = NO;
+          [self scheduleCheckForFreePercent: 100.0];
           return;
         }
 
@@ -66,9 +111,9 @@
 
       if (total > 0)
         {
-          double freePercent = ((double)available / (double)total) * 100.0;
+          freePercent = ((double)available / (double)total) * 100.0;
 
-          if (freePercent < 3.0)
+          if (freePercent < LOW_DISK_PERCENT)
             {
               NSAlert *alert = [[NSAlert alloc] init];
               [alert setMessageText: _(@"Low Disk Space")];
@@ -85,6 +130,9 @@
     }
 
   checking = NO;
+
+  /* an unreadable disk is tried again at the low disk pace */
+  [self scheduleCheckForFreePercent: (freePercent >= 0.0) ? freePercent : 0.0];
 }
 
 @end
@@ -154,6 +154,9 @@ NSString * const NetworkVirtualPath = @"/Network";
   
   NSDebugLLog(@"gwspace", @"NetworkFSNode: Getting subnodes, %lu services available", 
         (unsigned long)[services count]);
+
+  /* The services are resolved once they are listed */
+  [manager resolveServices:services];
   
   /* Ensure unique visible names by appending -2, -3, ... for duplicates */
   NSMutableDictionary *nameCounts = [NSMutableDictionary dictionaryWithCapacity:[services count]];
@@ -0,0 +1,79 @@
+/* NetworkServiceCache.h
+ *
+ * The resolved records of the mDNS services seen, kept across sessions.
+ *
+ * A record holds what resolving a service gave (host name, port,
+ * addresses, TXT record), the date it was resolved and the time it
+ * stays valid for.  NSNetService does not pass on the TTLs of the DNS
+ * records, so the ones RFC 6762 recommends are used: a record is fresh
+ * for the 120 seconds of the host and SRV records, and is then only a
+ * hint to show the service with until it has been resolved again.
+ * Records are kept for a week after they were last resolved.
+ *
+ * Not thread-safe: NetworkServiceManager uses it on its network thread.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef NETWORKSERVICECACHE_H
+#define NETWORKSERVICECACHE_H
+
+#import <Foundation/Foundation.h>
+
+/* How long a resolved record is fresh, and how long it is kept */
+#define NETWORK_SERVICE_RECORD_TTL 120.0
+#define NETWORK_SERVICE_RECORD_KEEP (7 * 24 * 3600.0)
+
+@interface NetworkServiceCache : NSObject
+{
+  NSString *path;
+  NSMutableDictionary *records;   /* service identifier -> record */
+  BOOL changed;
+}
+
+/**
+ * A record of what resolving a service gave, resolved at `date` and
+ * fresh for `ttl` seconds from then.
+ */
++ (NSDictionary *)recordWithHostName:(NSString *)hostName
+                                port:(int)port
+                           addresses:(NSArray *)addresses
+                       TXTRecordData:(NSData *)txtData
+                                date:(NSDate *)date
+                                 ttl:(NSTimeInterval)ttl;
+
+/**
+ * YES while `record` has not outlived its TTL at `date`.
+ */
++ (BOOL)isRecordFresh:(NSDictionary *)record atDate:(NSDate *)date;
+
+/**
+ * The cache kept in `file`; the records older than
+ * NETWORK_SERVICE_RECORD_KEEP are dropped as it is read.
+ */
+- (id)initWithPath:(NSString *)file;
+
+/**
+ * The record of a service, fresh or not, or nil.
+ */
+- (NSDictionary *)recordForIdentifier:(NSString *)identifier;
+
+- (void)setRecord:(NSDictionary *)record forIdentifier:(NSString *)identifier;
+
+- (void)removeRecordForIdentifier:(NSString *)identifier;
+
+/**
+ * Writes the records back to the file, if they changed since it was
+ * read or last written.
+ */
+- (BOOL)synchronize;
+
+@end
+
+/* The keys of a record */
+extern NSString * const NetworkServiceRecordHostName;
+extern NSString * const NetworkServiceRecordPort;
+extern NSString * const NetworkServiceRecordAddresses;
+extern NSString * const NetworkServiceRecordTXTData;
+
+#endif /* NETWORKSERVICECACHE_H */
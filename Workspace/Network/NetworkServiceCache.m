@@ -0,0 +1,130 @@
+/* NetworkServiceCache.m
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import "NetworkServiceCache.h"
+
+NSString * const NetworkServiceRecordHostName = @"hostName";
+NSString * const NetworkServiceRecordPort = @"port";
+NSString * const NetworkServiceRecordAddresses = @"addresses";
+NSString * const NetworkServiceRecordTXTData = @"txt";
+
+/* seconds since 1970, so that the file needs no date encoding */
+static NSString * const NetworkServiceRecordDate = @"date";
+static NSString * const NetworkServiceRecordTTL = @"ttl";
+
+@implementation NetworkServiceCache
+
++ (NSDictionary *)recordWithHostName:(NSString *)hostName
+                                port:(int)port
+                           addresses:(NSArray *)addresses
+                       TXTRecordData:(NSData *)txtData
+                                date:(NSDate *)date
+                                 ttl:(NSTimeInterval)ttl
+{
+  NSMutableDictionary *record = [NSMutableDictionary dictionary];
+
+  if (hostName) {
+    [record setObject:hostName forKey:NetworkServiceRecordHostName];
+  }
+  [record setObject:[NSNumber numberWithInt:port] forKey:NetworkServiceRecordPort];
+  [record setObject:(addresses ? addresses : [NSArray array])
+             forKey:NetworkServiceRecordAddresses];
+  if ([txtData length] > 0) {
+    [record setObject:txtData forKey:NetworkServiceRecordTXTData];
+  }
+  [record setObject:[NSNumber numberWithDouble:[date timeIntervalSince1970]]
+             forKey:NetworkServiceRecordDate];
+  [record setObject:[NSNumber numberWithDouble:ttl] forKey:NetworkServiceRecordTTL];
+
+  return record;
+}
+
++ (BOOL)isRecordFresh:(NSDictionary *)record atDate:(NSDate *)date
+{
+  double resolved = [[record objectForKey:NetworkServiceRecordDate] doubleValue];
+  double ttl = [[record objectForKey:NetworkServiceRecordTTL] doubleValue];
+  double now = [date timeIntervalSince1970];
+
+  /* a clock set back does not make records fresh for longer */
+  return (record != nil) && (now >= resolved) && (now < resolved + ttl);
+}
+
+- (id)initWithPath:(NSString *)file
+{
+  self = [super init];
+  if (self) {
+    NSDictionary *stored = [NSDictionary dictionaryWithContentsOfFile:file];
+    double oldest = [[NSDate date] timeIntervalSince1970] - NETWORK_SERVICE_RECORD_KEEP;
+
+    path = [file copy];
+    records = [[NSMutableDictionary alloc] init];
+    changed = NO;
+
+    for (NSString *identifier in stored) {
+      NSDictionary *record = [stored objectForKey:identifier];
+
+      if (![record isKindOfClass:[NSDictionary class]]
+          || ![[record objectForKey:NetworkServiceRecordAddresses] isKindOfClass:[NSArray class]]) {
+        changed = YES;
+        continue;
+      }
+      if ([[record objectForKey:NetworkServiceRecordDate] doubleValue] < oldest) {
+        changed = YES;
+        continue;
+      }
+      [records setObject:record forKey:identifier];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc
+{
+  [path release];
+  [records release];
+  [super dealloc];
+}
+
+- (NSDictionary *)recordForIdentifier:(NSString *)identifier
+{
+  return [records objectForKey:identifier];
+}
+
+- (void)setRecord:(NSDictionary *)record forIdentifier:(NSString *)identifier
+{
+  [records setObject:record forKey:identifier];
+  changed = YES;
+}
+
+- (void)removeRecordForIdentifier:(NSString *)identifier
+{
+  if ([records objectForKey:identifier]) {
+    [records removeObjectForKey:identifier];
+    changed = YES;
+  }
+}
+
+- (BOOL)synchronize
+{
+  NSData *data;
+
+  if (!changed) {
+    return YES;
+  }
+
+  data = [NSPropertyListSerialization dataWithPropertyList:records
+                                                    format:NSPropertyListBinaryFormat_v1_0
+                                                   options:0
+                                                     error:NULL];
+  if (data && [data writeToFile:path atomically:YES]) {
+    changed = NO;
+    return YES;
+  }
+
+  NSDebugLLog(@"gwspace", @"NetworkServiceCache: could not write %@", path);
+  return NO;
+}
+
+@end
@@ -21,6 +21,7 @@
   NSArray *addresses;
   NSNetService *netService;
   BOOL resolved;
+  NSData *txtRecordData;  /* from the record cache, until resolved */
   
   /* Manual connection support - these override TXT record values if set */
   NSString *manualUsername;
@@ -82,6 +83,13 @@
  */
 - (BOOL)isLocalMachine;
 
+/**
+ * Returns the TXT record of the service: the one its NSNetService
+ * resolved, or else the one last cached for it.
+ */
+- (NSData *)TXTRecordData;
+- (void)setTXTRecordData:(NSData *)data;
+
 /**
  * Returns the remote path from the TXT record, if available.
  * For SFTP services, this is often in the 'path' key.
@@ -52,6 +52,7 @@
   [hostName release];
   [addresses release];
   [netService release];
+  [txtRecordData release];
   [manualUsername release];
   [manualRemotePath release];
   [super dealloc];
@@ -68,6 +69,7 @@
   copy.addresses = [[self.addresses copy] autorelease];
   copy.netService = self.netService;
   copy.resolved = self.resolved;
+  [copy setTXTRecordData:txtRecordData];
   [copy setUsername:manualUsername];
   [copy setRemotePath:manualRemotePath];
   return copy;
@@ -151,6 +153,24 @@
   return @"Network";
 }
 
+- (NSData *)TXTRecordData
+{
+  NSData *data = [netService TXTRecordData];
+
+  if (data && [data length] > 0) {
+    return data;
+  }
+  return txtRecordData;
+}
+
+- (void)setTXTRecordData:(NSData *)data
+{
+  if (txtRecordData != data) {
+    [txtRecordData release];
+    txtRecordData = [data copy];
+  }
+}
+
 - (NSString *)remotePath
 {
   /* Check if manually set first */
@@ -158,12 +178,8 @@
     return manualRemotePath;
   }
   
-  if (!netService) {
-    return nil;
-  }
-  
   /* Get TXT record data from the service */
-  NSData *txtData = [netService TXTRecordData];
+  NSData *txtData = [self TXTRecordData];
   if (!txtData || [txtData length] == 0) {
     return nil;
   }
@@ -195,12 +211,8 @@
     return manualUsername;
   }
   
-  if (!netService) {
-    return nil;
-  }
-  
   /* Get TXT record data from the service */
-  NSData *txtData = [netService TXTRecordData];
+  NSData *txtData = [self TXTRecordData];
   if (!txtData || [txtData length] == 0) {
     return nil;
   }
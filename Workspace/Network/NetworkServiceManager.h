@@ -8,6 +8,7 @@
 #import <Foundation/Foundation.h>
 
 @class NetworkServiceItem;
+@class NetworkServiceCache;
 
 /**
  * Notification posted when the list of discovered services changes.
@@ -39,6 +40,9 @@ extern NSString * const NetworkServiceDidResolveNotification;
   NSNetServiceBrowser *webdavsBrowser;  /* WebDAV over HTTPS */
   NSMutableArray *services;           // Array of NetworkServiceItem
   NSMutableArray *pendingResolutions; // Array of NSNetService being resolved
+  NSMutableArray *resolveQueue;       // NSNetService waiting for a free slot
+  NetworkServiceCache *recordCache;   // resolved records, across sessions
+  NSCondition *resolutionCondition;   // broadcast as resolutions end
   BOOL isSearching;
   BOOL mDNSAvailable;
 
@@ -112,4 +116,28 @@ extern NSString * const NetworkServiceDidResolveNotification;
  */
 - (NetworkServiceItem *)serviceWithIdentifier:(NSString *)identifier;
 
+/**
+ * Services are not resolved when they are found: they are shown with
+ * the record cached from the last time they were resolved, if any, and
+ * resolved when they are shown or opened, a few at a time.
+ *
+ * Asks for a service to be resolved, unless its cached record is still
+ * fresh.  The last one asked for is resolved first.  Any thread.
+ */
+- (void)resolveService:(NetworkServiceItem *)item;
+
+/**
+ * Asks for the services being shown to be resolved, the first ones first.
+ */
+- (void)resolveServices:(NSArray *)items;
+
+/**
+ * Asks for a service to be resolved, and waits up to `timeout` seconds
+ * for it, unless it already has a host name (cached or resolved), which
+ * it is then used with while it is resolved again.  Returns whether the
+ * item has a host name.  Not for the network thread.
+ */
+- (BOOL)waitForResolutionOfService:(NetworkServiceItem *)item
+                           timeout:(NSTimeInterval)timeout;
+
 @end
@@ -7,6 +7,7 @@
 
 #import "NetworkServiceManager.h"
 #import "NetworkServiceItem.h"
+#import "NetworkServiceCache.h"
 #import <signal.h>
 #import <setjmp.h>
 
@@ -15,6 +16,34 @@ NSString * const NetworkServiceDidResolveNotification = @"NetworkServiceDidResol
 
 static NetworkServiceManager *sharedManager = nil;
 
+/* How many services are resolved at once, and for how long at most */
+#define MAX_CONCURRENT_RESOLUTIONS 4
+#define RESOLVE_TIMEOUT 10.0
+/* A resolution is stopped this long after its first address, to take
+   in the other addresses of the host */
+#define RESOLVE_SETTLE_DELAY 1.0
+/* The record cache is written this long after the last change to it */
+#define RECORD_CACHE_SAVE_DELAY 5.0
+
+/* The identifier NetworkServiceItem has for the service */
+static NSString *NetServiceIdentifier(NSNetService *netService)
+{
+  return [NSString stringWithFormat:@"%@.%@.%@",
+                   [netService name], [netService type], [netService domain]];
+}
+
+static NSUInteger IndexOfNetService(NSArray *list, NSString *identifier)
+{
+  NSUInteger i;
+
+  for (i = 0; i < [list count]; i++) {
+    if ([NetServiceIdentifier([list objectAtIndex:i]) isEqual:identifier]) {
+      return i;
+    }
+  }
+  return NSNotFound;
+}
+
 /* Signal handling for crash-safe Avahi/mDNS probe.
 
    Backends such as Avahi on Linux abort the process via assert() when
@@ -38,6 +67,11 @@ static void mdnsAbortHandler(int sig)
   }
 }
 
+@interface NetworkServiceManager (Private)
+- (NSString *)recordCachePath;
+- (void)broadcastResolutionEnded;
+@end
+
 @implementation NetworkServiceManager
 
 + (instancetype)sharedManager
@@ -54,6 +88,9 @@ static void mdnsAbortHandler(int sig)
   if (self) {
     services = [[NSMutableArray alloc] init];
     pendingResolutions = [[NSMutableArray alloc] init];
+    resolveQueue = [[NSMutableArray alloc] init];
+    resolutionCondition = [[NSCondition alloc] init];
+    recordCache = [[NetworkServiceCache alloc] initWithPath:[self recordCachePath]];
     isSearching = NO;
     threadShouldStop = NO;
 
@@ -101,6 +138,9 @@ static void mdnsAbortHandler(int sig)
   [self stopBrowsing];
   [services release];
   [pendingResolutions release];
+  [resolveQueue release];
+  [resolutionCondition release];
+  [recordCache release];
   [super dealloc];
 }
 
@@ -189,6 +229,8 @@ static void mdnsAbortHandler(int sig)
       [webdavBrowser stop];  [webdavBrowser release];  webdavBrowser = nil;
       [webdavsBrowser stop]; [webdavsBrowser release]; webdavsBrowser = nil;
       [pendingResolutions removeAllObjects];
+      [resolveQueue removeAllObjects];
+      [self broadcastResolutionEnded];
 
       sigaction(SIGABRT, &oldAct, NULL);
 
@@ -328,6 +370,9 @@ static void mdnsAbortHandler(int sig)
     [svc stop];
   }
   [pendingResolutions removeAllObjects];
+  [resolveQueue removeAllObjects];
+  [self broadcastResolutionEnded];
+  [recordCache synchronize];
 
   isSearching = NO;
 }
@@ -414,8 +459,183 @@ static void mdnsAbortHandler(int sig)
   }
 }
 
+#pragma mark - Lazy Resolution
+
+- (void)resolveService:(NetworkServiceItem *)item
+{
+  if (item) {
+    [self resolveServices:[NSArray arrayWithObject:item]];
+  }
+}
+
+- (void)resolveServices:(NSArray *)items
+{
+  if ([items count] == 0 || !mDNSAvailable
+      || networkThread == nil || [networkThread isFinished]) {
+    return;
+  }
+  [self performSelector:@selector(enqueueResolutions:)
+               onThread:networkThread
+             withObject:items
+          waitUntilDone:NO];
+}
+
+- (BOOL)waitForResolutionOfService:(NetworkServiceItem *)item
+                           timeout:(NSTimeInterval)timeout
+{
+  NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  BOOL known;
+
+  [self resolveService:item];
+
+  [resolutionCondition lock];
+  @synchronized(services) {
+    known = ([[item hostName] length] > 0);
+  }
+  if ([item netService] && mDNSAvailable) {
+    while (!known && [resolutionCondition waitUntilDate:limit]) {
+      @synchronized(services) {
+        known = ([[item hostName] length] > 0);
+      }
+    }
+  }
+  [resolutionCondition unlock];
+
+  return known;
+}
+
 #pragma mark - Private Methods
 
+- (NSString *)recordCachePath
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory,
+                                                       NSUserDomainMask, YES) lastObject];
+  BOOL isdir = NO;
+
+  dir = [dir stringByAppendingPathComponent:@"Workspace"];
+  if (!([fm fileExistsAtPath:dir isDirectory:&isdir] && isdir)) {
+    [fm createDirectoryAtPath:dir
+  withIntermediateDirectories:YES
+                   attributes:nil
+                        error:NULL];
+  }
+  return [dir stringByAppendingPathComponent:@"NetworkServices.plist"];
+}
+
+/* The methods below run on the network thread. */
+
+- (void)enqueueResolutions:(NSArray *)items
+{
+  NSDate *now = [NSDate date];
+  NSEnumerator *e = [items reverseObjectEnumerator];
+  NetworkServiceItem *item;
+
+  if (!isSearching) {
+    return;
+  }
+
+  /* Each one goes to the front of the queue, the last first, so that
+     the first of them is resolved first, and what was asked for last
+     before what is still waiting. */
+  while ((item = [e nextObject]) != nil) {
+    NSNetService *netService = [item netService];
+    NSString *identifier = [item identifier];
+    NSDictionary *record = [recordCache recordForIdentifier:identifier];
+    NSUInteger index;
+
+    if (netService == nil
+        || IndexOfNetService(pendingResolutions, identifier) != NSNotFound) {
+      continue;
+    }
+    if ([item resolved] && [NetworkServiceCache isRecordFresh:record atDate:now]) {
+      continue;
+    }
+
+    index = IndexOfNetService(resolveQueue, identifier);
+    if (index != NSNotFound) {
+      [resolveQueue removeObjectAtIndex:index];
+    }
+    [resolveQueue insertObject:netService atIndex:0];
+  }
+
+  [self startQueuedResolutions];
+}
+
+- (void)startQueuedResolutions
+{
+  while ([pendingResolutions count] < MAX_CONCURRENT_RESOLUTIONS
+         && [resolveQueue count] > 0) {
+    NSNetService *netService = [[resolveQueue objectAtIndex:0] retain];
+
+    [resolveQueue removeObjectAtIndex:0];
+    [pendingResolutions addObject:netService];
+    [netService setDelegate:self];
+    [netService resolveWithTimeout:RESOLVE_TIMEOUT];
+    NSDebugLLog(@"gwspace", @"NetworkServiceManager: Starting resolution for: %@ (%lu waiting)",
+          [netService name], (unsigned long)[resolveQueue count]);
+    [netService release];
+  }
+}
+
+/* Stops resolving a service, or takes it off the queue, and starts the
+   next one in its slot. */
+- (void)endResolutionOfNetService:(NSNetService *)netService
+{
+  NSString *identifier = NetServiceIdentifier(netService);
+  NSUInteger index = IndexOfNetService(pendingResolutions, identifier);
+
+  if (index != NSNotFound) {
+    NSNetService *pending = [[pendingResolutions objectAtIndex:index] retain];
+
+    [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                             selector:@selector(endResolutionOfNetService:)
+                                               object:pending];
+    [pendingResolutions removeObjectAtIndex:index];
+    [pending stop];
+    [pending autorelease];
+  }
+
+  index = IndexOfNetService(resolveQueue, identifier);
+  if (index != NSNotFound) {
+    [resolveQueue removeObjectAtIndex:index];
+  }
+
+  [self broadcastResolutionEnded];
+  [self startQueuedResolutions];
+}
+
+- (void)broadcastResolutionEnded
+{
+  [resolutionCondition lock];
+  [resolutionCondition broadcast];
+  [resolutionCondition unlock];
+}
+
+- (void)applyRecord:(NSDictionary *)record toItem:(NetworkServiceItem *)item
+{
+  item.hostName = [record objectForKey:NetworkServiceRecordHostName];
+  item.port = [[record objectForKey:NetworkServiceRecordPort] intValue];
+  item.addresses = [record objectForKey:NetworkServiceRecordAddresses];
+  [item setTXTRecordData:[record objectForKey:NetworkServiceRecordTXTData]];
+  item.resolved = ([[item hostName] length] > 0);
+}
+
+- (void)saveRecordCache
+{
+  [recordCache synchronize];
+}
+
+- (void)scheduleRecordCacheSave
+{
+  [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                           selector:@selector(saveRecordCache)
+                                             object:nil];
+  [self performSelector:@selector(saveRecordCache)
+             withObject:nil
+             afterDelay:RECORD_CACHE_SAVE_DELAY];
+}
+
 - (NetworkServiceItem *)existingServiceMatchingNetService:(NSNetService *)netService
 {
   NSString *serviceName = [netService name];
@@ -484,6 +704,9 @@ static void mdnsAbortHandler(int sig)
     item.hostName = [netService hostName];
     item.port = [netService port];
     item.addresses = [netService addresses];
+    if ([[netService TXTRecordData] length] > 0) {
+      [item setTXTRecordData:[netService TXTRecordData]];
+    }
     item.resolved = YES;
 
     NSDebugLLog(@"gwspace", @"NetworkServiceManager: Resolved service: %@ -> %@:%d",
@@ -554,15 +777,24 @@ static void mdnsAbortHandler(int sig)
   NSDebugLLog(@"gwspace", @"NetworkServiceManager: %@ browser found service: %@ (type: %@, domain: %@)",
         browserType, [netService name], [netService type], [netService domain]);
 
-  /* Create a service item and add it */
+  /* Create a service item and add it.  It is not resolved here: it
+     gets the record cached for it, if any, and is resolved when it is
+     shown or opened (see -resolveServices:). */
   NetworkServiceItem *item = [NetworkServiceItem itemWithNetService:netService];
-  [self addServiceItem:item];
+  NSDictionary *record = [recordCache recordForIdentifier:[item identifier]];
+
+  if (record && ![item resolved]) {
+    [self applyRecord:record toItem:item];
+
+    /* what resolving it would take off the list, see below */
+    if ([item isLocalMachine]) {
+      NSDebugLLog(@"gwspace", @"NetworkServiceManager: Cached record of %@ is the local machine",
+            [item displayName]);
+      return;
+    }
+  }
 
-  /* Start resolving the service to get host/port info */
-  [netService setDelegate:self];
-  [netService resolveWithTimeout:10.0];
-  [pendingResolutions addObject:netService];
-  NSDebugLLog(@"gwspace", @"NetworkServiceManager: Starting resolution for: %@", [netService name]);
+  [self addServiceItem:item];
 }
 
 - (void)netServiceBrowser:(NSNetServiceBrowser *)browser
@@ -579,7 +811,7 @@ static void mdnsAbortHandler(int sig)
         browserType, [netService name]);
 
   [self removeServiceMatchingNetService:netService];
-  [pendingResolutions removeObject:netService];
+  [self endResolutionOfNetService:netService];
 }
 
 - (void)netServiceBrowser:(NSNetServiceBrowser *)browser
@@ -607,6 +839,13 @@ static void mdnsAbortHandler(int sig)
     NetworkServiceItem *item = [self existingServiceMatchingNetService:netService];
     if (item) {
       [self updateServiceItem:item fromNetService:netService];
+      [recordCache setRecord:[NetworkServiceCache recordWithHostName:[item hostName]
+                                                                port:[item port]
+                                                           addresses:[item addresses]
+                                                       TXTRecordData:[item TXTRecordData]
+                                                                date:[NSDate date]
+                                                                 ttl:NETWORK_SERVICE_RECORD_TTL]
+               forIdentifier:[item identifier]];
 
       /* If the resolved service is on the local machine itself
          (hostName is localhost/127.0.0.1, or has a loopback address),
@@ -624,7 +863,19 @@ static void mdnsAbortHandler(int sig)
     }
   }
 
-  [pendingResolutions removeObject:netService];
+  [self scheduleRecordCacheSave];
+  [self broadcastResolutionEnded];
+
+  /* The other addresses of the host may follow this one: the slot is
+     given to the next service a little later. */
+  if ([pendingResolutions indexOfObjectIdenticalTo:netService] != NSNotFound) {
+    [NSObject cancelPreviousPerformRequestsWithTarget:self
+                                             selector:@selector(endResolutionOfNetService:)
+                                               object:netService];
+    [self performSelector:@selector(endResolutionOfNetService:)
+               withObject:netService
+               afterDelay:RESOLVE_SETTLE_DELAY];
+  }
 }
 
 - (void)netService:(NSNetService *)netService
@@ -633,7 +884,7 @@ static void mdnsAbortHandler(int sig)
   NSDebugLLog(@"gwspace", @"NetworkServiceManager: Failed to resolve service %@: %@",
         [netService name], errorDict);
 
-  [pendingResolutions removeObject:netService];
+  [self endResolutionOfNetService:netService];
 }
 
 @end
@@ -10,6 +10,11 @@
 
 @class NetworkServiceItem;
 
+/* Posted on the main thread around a background mount, with the
+   NetworkServiceItem as the object. */
+extern NSString * const NetworkVolumeMountDidStartNotification;
+extern NSString * const NetworkVolumeMountDidEndNotification;
+
 /**
  * NetworkVolumeManager handles the mounting and unmounting of network
  * volumes using platform-specific tools like FUSE sshfs on Linux/BSD,
@@ -26,6 +31,7 @@
   NSFileManager *fm;
   NSString *lastErrorMessage;  /* Last mount error for callers to retrieve */
   NSMutableSet *recentlyUnmountedPaths;  /* Paths recently unmounted, for dialog suppression */
+  NSMutableSet *mountingServices;  /* Identifiers of the services being mounted in the background */
 }
 
 /**
@@ -64,6 +70,21 @@
                       username:(NSString *)user
                       password:(NSString *)pass;
 
+/**
+ * Mounts an SFTP service on a worker thread.  The username is taken from
+ * the TXT record or asked for on the calling (main) thread first; the
+ * completion block runs on the main thread with the mount point, or nil
+ * after the failure was shown.  A request for a service already being
+ * mounted is ignored.
+ */
+- (void)mountSFTPServiceInBackground:(NetworkServiceItem *)serviceItem
+                          completion:(void (^)(NSString *mountPoint))completion;
+
+/**
+ * Returns YES while a background mount of the service is under way.
+ */
+- (BOOL)isMountingService:(NetworkServiceItem *)serviceItem;
+
 /**
  * Unmounts a previously mounted network service.
  *
@@ -90,6 +111,12 @@
  */
 - (BOOL)isServiceMounted:(NetworkServiceItem *)serviceItem;
 
+/**
+ * Returns the mount points of the mounted services, keyed by service
+ * identifier.  A copy, for callers that look at it off the main thread.
+ */
+- (NSDictionary *)mountPointsByServiceIdentifier;
+
 /**
  * Checks if sshfs (FUSE) is available on the system.
  *
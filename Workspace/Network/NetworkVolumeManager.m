@@ -10,23 +10,36 @@
 #import <signal.h>
 #import <errno.h>
 #import <unistd.h>
+#import <dispatch/dispatch.h>
 #import "NetworkVolumeManager.h"
 #import "NetworkServiceItem.h"
+#import "NetworkServiceManager.h"
 #import "SFTPMount.h"
 #import "../AVFSMount.h"
 #import "../Workspace.h"
 #import "../FSNode/FSNode.h"
 #import "../FSNode/FSNodeRep.h"
+#import "../FSNode/FSNMountTable.h"
 #import "../Desktop/GWDesktopManager.h"
 #import "../Desktop/GWDesktopView.h"
+#import "../GWUnmountHelper.h"
 
 // Forward declare setAccessoryView for NSAlert (available in newer GNUstep)
 @interface NSAlert (AccessoryView)
 - (void)setAccessoryView:(NSView *)view;
 @end
 
+NSString * const NetworkVolumeMountDidStartNotification = @"NetworkVolumeMountDidStartNotification";
+NSString * const NetworkVolumeMountDidEndNotification = @"NetworkVolumeMountDidEndNotification";
+
 static NetworkVolumeManager *sharedInstance = nil;
 
+/* Seconds the network volumes have, together, to unmount at logout */
+#define NETWORK_UNMOUNT_TIMEOUT 10.0
+
+/* Seconds a service that never was resolved is waited for, to mount it */
+#define NETWORK_RESOLVE_TIMEOUT 10.0
+
 @implementation NetworkVolumeManager
 
 + (NetworkVolumeManager *)sharedManager
@@ -45,6 +58,7 @@ static NetworkVolumeManager *sharedInstance = nil;
     mountedVolumesPIDs = [[NSMutableDictionary alloc] init];
     webdavMounts = [[NSMutableDictionary alloc] init];
     recentlyUnmountedPaths = [[NSMutableSet alloc] init];
+    mountingServices = [[NSMutableSet alloc] init];
     fm = [NSFileManager defaultManager];
     lastErrorMessage = nil;
     
@@ -65,37 +79,15 @@ static NetworkVolumeManager *sharedInstance = nil;
   [mountedVolumesPIDs release];
   [webdavMounts release];
   [recentlyUnmountedPaths release];
+  [mountingServices release];
   RELEASE(lastErrorMessage);
   [super dealloc];
 }
 
 - (BOOL)isSshfsAvailable
 {
-  /* Check if sshfs command exists in PATH */
-  NSTask *task = [[NSTask alloc] init];
-  [task setLaunchPath:@"/usr/bin/which"];
-  [task setArguments:@[@"sshfs"]];
-  [task setStandardOutput:[NSPipe pipe]];
-  [task setStandardError:[NSPipe pipe]];
-  
-  @try {
-    [task launch];
-    [task waitUntilExit];
-    int status = [task terminationStatus];
-    [task release];
-    
-    if (status == 0) {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: sshfs is available");
-      return YES;
-    } else {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: sshfs not found in PATH");
-      return NO;
-    }
-  } @catch (NSException *exception) {
-    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Error checking for sshfs: %@", exception);
-    [task release];
-    return NO;
-  }
+  /* Shared with SFTPMount, which remembers the answer */
+  return [SFTPMount isToolAvailable:@"sshfs"];
 }
 
 - (void)showSshfsNotInstalledAlert
@@ -116,31 +108,7 @@ static NetworkVolumeManager *sharedInstance = nil;
 
 - (BOOL)isSshpassAvailable
 {
-  /* Check if sshpass command exists in PATH */
-  NSTask *task = [[NSTask alloc] init];
-  [task setLaunchPath:@"/usr/bin/which"];
-  [task setArguments:@[@"sshpass"]];
-  [task setStandardOutput:[NSPipe pipe]];
-  [task setStandardError:[NSPipe pipe]];
-  
-  @try {
-    [task launch];
-    [task waitUntilExit];
-    int status = [task terminationStatus];
-    [task release];
-    
-    if (status == 0) {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: sshpass is available");
-      return YES;
-    } else {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: sshpass not found in PATH");
-      return NO;
-    }
-  } @catch (NSException *exception) {
-    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Error checking for sshpass: %@", exception);
-    [task release];
-    return NO;
-  }
+  return [SFTPMount isToolAvailable:@"sshpass"];
 }
 
 - (void)showSshpassNotInstalledAlert
@@ -171,30 +139,26 @@ static NetworkVolumeManager *sharedInstance = nil;
   return [self mountPointForService:serviceItem] != nil;
 }
 
+- (NSDictionary *)mountPointsByServiceIdentifier
+{
+  return [[mountedVolumes copy] autorelease];
+}
+
 - (NSSet *)allMountedPaths
 {
   NSMutableSet *paths = [NSMutableSet setWithArray: [mountedVolumes allValues]];
 
-  /* Also scan /proc/mounts for fuse.sshfs mounts that may have survived
-     from a previous session and aren't in our tracked dictionary yet. */
-  NSString *procMounts = @"/proc/mounts";
-  NSString *mountsContent = [NSString stringWithContentsOfFile: procMounts
-                                                     encoding: NSUTF8StringEncoding
-                                                        error: NULL];
-  if (mountsContent) {
-    NSArray *lines = [mountsContent componentsSeparatedByString: @"\n"];
-    for (NSString *line in lines) {
-      if ([line length] == 0) continue;
-      NSArray *parts = [line componentsSeparatedByString: @" "];
-      if ([parts count] < 3) continue;
-      NSString *fstype = [parts objectAtIndex: 2];
-      /* Match any FUSE-based network filesystem type */
-      if ([fstype hasPrefix: @"fuse."]) {
-        NSString *target = [parts objectAtIndex: 1];
-        if (target) {
-          [paths addObject: target];
-        }
-      }
+  /* Also pick up FUSE network mounts that may have survived from a
+     previous session and aren't in our tracked dictionary yet. */
+  NSArray *mounts = [[FSNMountTable sharedTable] entries];
+  NSUInteger i;
+
+  for (i = 0; i < [mounts count]; i++) {
+    FSNMountEntry *entry = [mounts objectAtIndex: i];
+
+    /* Match any FUSE-based network filesystem type */
+    if ([entry isNetwork] && [[entry fileSystemType] hasPrefix: @"fuse."]) {
+      [paths addObject: [entry mountPoint]];
     }
   }
 
@@ -208,38 +172,23 @@ static NetworkVolumeManager *sharedInstance = nil;
 
 - (NSString *)findExistingMountForHost:(NSString *)hostname username:(NSString *)username
 {
-  /* Check /proc/mounts to see if this server is already mounted */
-  NSString *procMounts = @"/proc/mounts";
-  NSError *readError = nil;
-  NSString *mountsContent = [NSString stringWithContentsOfFile:procMounts 
-                                                      encoding:NSUTF8StringEncoding 
-                                                         error:&readError];
-  if (!mountsContent) {
-    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Could not read /proc/mounts: %@", readError);
-    return nil;
-  }
-  
-  /* Look for a line that matches: user@hostname:... on <mountpoint> type fuse.sshfs */
-  NSArray *lines = [mountsContent componentsSeparatedByString:@"\n"];
+  /* Check the mount table to see if this server is already mounted */
+  NSArray *mounts = [[FSNMountTable sharedTable] entries];
   NSString *expectedPrefix = [NSString stringWithFormat:@"%@@%@:", username, hostname];
-  
-  for (NSString *line in lines) {
-    if ([line length] == 0) continue;
-    
-    NSArray *parts = [line componentsSeparatedByString:@" "];
-    if ([parts count] < 3) continue;
-    
-    NSString *source = [parts objectAtIndex:0];  /* e.g., user@hostname:/path */
-    NSString *target = [parts objectAtIndex:1];  /* mount point */
-    NSString *fstype = [parts objectAtIndex:2];  /* filesystem type */
-    
-    /* Check if this is an sshfs mount to our target server */
-    if ([fstype isEqual:@"fuse.sshfs"] && [source hasPrefix:expectedPrefix]) {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Found existing mount of %@ at %@", source, target);
-      return target;
+  NSUInteger i;
+
+  /* Look for an entry that matches: user@hostname:... on <mountpoint> type fuse.sshfs */
+  for (i = 0; i < [mounts count]; i++) {
+    FSNMountEntry *entry = [mounts objectAtIndex:i];
+
+    if ([[entry fileSystemType] isEqual:@"fuse.sshfs"]
+        && [[entry source] hasPrefix:expectedPrefix]) {
+      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Found existing mount of %@ at %@",
+                  [entry source], [entry mountPoint]);
+      return [entry mountPoint];
     }
   }
-  
+
   return nil;
 }
 
@@ -332,6 +281,74 @@ static NetworkVolumeManager *sharedInstance = nil;
   return [self mountSFTPService:serviceItem username:nil password:nil];
 }
 
+/* The "u" key of the service's TXT record, if it has one */
+- (NSString *)advertisedUsernameForService:(NetworkServiceItem *)serviceItem
+{
+  NSData *txtData = [serviceItem TXTRecordData];
+
+  if (txtData && [txtData length] > 0) {
+    NSDictionary *txtDict = [NSNetService dictionaryFromTXTRecordData:txtData];
+    NSData *usernameData = [txtDict objectForKey:@"u"];
+    if (usernameData) {
+      return [[[NSString alloc] initWithData:usernameData 
+                                    encoding:NSUTF8StringEncoding] autorelease];
+    }
+  }
+  return nil;
+}
+
+/* Records a working mount and tells the views about it.  Always on the
+   main thread: the mounts may be made on a worker. */
+- (void)registerMount:(NSDictionary *)info
+{
+  NSString *identifier = [info objectForKey:@"identifier"];
+  NSString *mountPoint = [info objectForKey:@"mountPoint"];
+  int pid = [[info objectForKey:@"pid"] intValue];
+
+  [mountedVolumes setObject:mountPoint forKey:identifier];
+
+  /* Store the sshfs process ID for proper unmounting; there is none for
+     mounts we did not start */
+  if (pid > 0) {
+    [mountedVolumesPIDs setObject:[NSNumber numberWithInt:pid] forKey:identifier];
+    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Stored sshfs PID %d for service %@", pid, identifier);
+  }
+
+  /* Mark the mount point in the FSNode cache so UI displays mountpoint icons */
+  @try {
+    FSNode *vnode = [FSNode nodeWithPath: mountPoint];
+    if (vnode) {
+      [vnode setMountPoint: YES];
+    }
+    [[FSNodeRep sharedInstance] addVolumeAt: mountPoint];
+    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: FSNodeRep volumes now: %@", [[FSNodeRep sharedInstance] volumes]);
+  } @catch (NSException *e) {
+    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Error marking volume: %@", e);
+  }
+
+  /* Notify parent directory that a new entry has appeared so viewers refresh */
+  NSString *parent = [mountPoint stringByDeletingLastPathComponent];
+  NSString *name = [mountPoint lastPathComponent];
+  NSDictionary *opinfo = @{ @"operation": @"MountOperation",
+                            @"source": parent,
+                            @"destination": parent,
+                            @"files": @[name] };
+
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName:@"GWFileSystemDidChangeNotification"
+                  object:opinfo];
+  
+  /* Also notify desktop manager directly so the volume appears on the desktop */
+  NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Notifying desktop manager directly for mount %@", mountPoint);
+  id gworkspace = [Workspace gworkspace];
+  if (gworkspace) {
+    id desktopManager = [gworkspace desktopManager];
+    if (desktopManager && [[desktopManager desktopView] respondsToSelector:@selector(newVolumeMountedAtPath:)]) {
+      [[desktopManager desktopView] newVolumeMountedAtPath: mountPoint];
+    }
+  }
+}
+
 - (NSString *)mountSFTPService:(NetworkServiceItem *)serviceItem
                       username:(NSString *)providedUsername
                       password:(NSString *)providedPassword
@@ -344,26 +361,16 @@ static NetworkVolumeManager *sharedInstance = nil;
     return existingMount;
   }
   
+  /* Services are resolved lazily: this one may not have been yet */
+  [[NetworkServiceManager sharedManager] waitForResolutionOfService:serviceItem
+                                                            timeout:NETWORK_RESOLVE_TIMEOUT];
+
   /* Get details early to check for existing system mounts */
   NSString *hostName = [serviceItem hostName];
   int port = [serviceItem port];
-  NSString *username = nil;
-  
-  /* First try to get username from TXT record */
   NSNetService *netService = [serviceItem netService];
-  if (netService) {
-    NSData *txtData = [netService TXTRecordData];
-    if (txtData && [txtData length] > 0) {
-      NSDictionary *txtDict = [NSNetService dictionaryFromTXTRecordData:txtData];
-      if (txtDict) {
-        NSData *usernameData = [txtDict objectForKey:@"u"];
-        if (usernameData) {
-          username = [[[NSString alloc] initWithData:usernameData 
-                                            encoding:NSUTF8StringEncoding] autorelease];
-        }
-      }
-    }
-  }
+  /* First try to get username from TXT record */
+  NSString *username = [self advertisedUsernameForService:serviceItem];
   
   /* For duplicate mount check, use username from TXT or current user as default */
   NSString *checkUsername = (username && [username length] > 0) ? username : NSUserName();
@@ -381,42 +388,11 @@ static NetworkVolumeManager *sharedInstance = nil;
     if (!testError) {
       /* Mount is working - reuse it */
       NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Reusing existing working mount at %@", existingSystemMount);
-      NSString *identifier = [serviceItem identifier];
-      [mountedVolumes setObject:existingSystemMount forKey:identifier];
       /* Note: We don't store PID for existing mounts since we didn't start the process */
-
-      /* Mark as volume in FSNodeRep for icon updates and notify parent directory */
-      @try {
-        FSNode *vnode = [FSNode nodeWithPath: existingSystemMount];
-        if (vnode) {
-          [vnode setMountPoint: YES];
-        }
-        [[FSNodeRep sharedInstance] addVolumeAt: existingSystemMount];
-        NSDebugLLog(@"gwspace", @"NetworkVolumeManager: FSNodeRep volumes now: %@", [[FSNodeRep sharedInstance] volumes]);
-      } @catch (NSException *e) {
-        NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Error marking existing mount: %@", e);
-      }
-
-      NSString *parent = [existingSystemMount stringByDeletingLastPathComponent];
-      NSString *name = [existingSystemMount lastPathComponent];
-      NSDictionary *opinfo = @{ @"operation": @"MountOperation",
-                                @"source": parent,
-                                @"destination": parent,
-                                @"files": @[name] };
-
-      [[NSNotificationCenter defaultCenter] 
-        postNotificationName:@"GWFileSystemDidChangeNotification"
-                      object:opinfo];
-      
-      /* Also notify desktop manager directly so the volume appears on the desktop */
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Notifying desktop manager directly for existing mount %@", existingSystemMount);
-      id gworkspace = [Workspace gworkspace];
-      if (gworkspace) {
-        id desktopManager = [gworkspace desktopManager];
-        if (desktopManager && [[desktopManager desktopView] respondsToSelector:@selector(newVolumeMountedAtPath:)]) {
-          [[desktopManager desktopView] newVolumeMountedAtPath: existingSystemMount];
-        }
-      }
+      [self performSelectorOnMainThread:@selector(registerMount:)
+                             withObject:@{ @"identifier": [serviceItem identifier],
+                                           @"mountPoint": existingSystemMount }
+                          waitUntilDone:YES];
 
       return existingSystemMount;
     } else {
@@ -550,52 +526,14 @@ static NetworkVolumeManager *sharedInstance = nil;
   
   if ([result success]) {
     /* Mount successful */
-    NSString *identifier = [serviceItem identifier];
-    [mountedVolumes setObject:mountPoint forKey:identifier];
-    
-    /* Store the sshfs process ID for proper unmounting */
-    int pid = [result pid];
-    if (pid > 0) {
-      [mountedVolumesPIDs setObject:[NSNumber numberWithInt:pid] forKey:identifier];
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Stored sshfs PID %d for service %@", pid, identifier);
-    }
-
     NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Successfully mounted %@ at %@", 
           [serviceItem name], mountPoint);
 
-    /* Mark the mount point in the FSNode cache so UI displays mountpoint icons */
-    @try {
-      FSNode *vnode = [FSNode nodeWithPath: mountPoint];
-      if (vnode) {
-        [vnode setMountPoint: YES];
-      }
-      [[FSNodeRep sharedInstance] addVolumeAt: mountPoint];
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: FSNodeRep volumes now: %@", [[FSNodeRep sharedInstance] volumes]);
-    } @catch (NSException *e) {
-      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Error marking volume: %@", e);
-    }
-
-    /* Notify parent directory that a new entry has appeared so viewers refresh */
-    NSString *parent = [mountPoint stringByDeletingLastPathComponent];
-    NSString *name = [mountPoint lastPathComponent];
-    NSDictionary *opinfo = @{ @"operation": @"MountOperation",
-                              @"source": parent,
-                              @"destination": parent,
-                              @"files": @[name] };
-
-    [[NSNotificationCenter defaultCenter]
-      postNotificationName:@"GWFileSystemDidChangeNotification"
-                    object:opinfo];
-    
-    /* Also notify desktop manager directly so the volume appears on the desktop */
-    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Notifying desktop manager directly for mount %@", mountPoint);
-    id gworkspace = [Workspace gworkspace];
-    if (gworkspace) {
-      id desktopManager = [gworkspace desktopManager];
-      if (desktopManager && [[desktopManager desktopView] respondsToSelector:@selector(newVolumeMountedAtPath:)]) {
-        [[desktopManager desktopView] newVolumeMountedAtPath: mountPoint];
-      }
-    }
+    [self performSelectorOnMainThread:@selector(registerMount:)
+                           withObject:@{ @"identifier": [serviceItem identifier],
+                                         @"mountPoint": mountPoint,
+                                         @"pid": [NSNumber numberWithInt:[result pid]] }
+                        waitUntilDone:YES];
 
     return mountPoint;
   } else {
@@ -630,6 +568,130 @@ static NetworkVolumeManager *sharedInstance = nil;
   }
 }
 
+- (BOOL)isMountingService:(NetworkServiceItem *)serviceItem
+{
+  return [mountingServices containsObject:[serviceItem identifier]];
+}
+
+- (void)mountSFTPServiceInBackground:(NetworkServiceItem *)serviceItem
+                          completion:(void (^)(NSString *mountPoint))completion
+{
+  NSString *identifier = [serviceItem identifier];
+  NSString *hostName;
+  NSString *username;
+  NSString *password = nil;
+  NSString *existingMount = [self mountPointForService:serviceItem];
+  void (^done)(NSString *);
+
+  if (existingMount) {
+    if (completion) {
+      completion(existingMount);
+    }
+    return;
+  }
+
+  /* A second click while connecting does not start another sshfs */
+  if ([mountingServices containsObject:identifier]) {
+    NSDebugLLog(@"gwspace", @"NetworkVolumeManager: %@ is already being mounted", [serviceItem name]);
+    return;
+  }
+
+  /* Only a service never resolved, nor cached, is waited for here */
+  [[NetworkServiceManager sharedManager] waitForResolutionOfService:serviceItem
+                                                            timeout:NETWORK_RESOLVE_TIMEOUT];
+  hostName = [serviceItem hostName];
+  username = [self advertisedUsernameForService:serviceItem];
+
+  /* What may need the user is asked here, on the main thread; the worker
+     only connects. */
+  if (![self isSshfsAvailable]) {
+    [self showSshfsNotInstalledAlert];
+    if (completion) {
+      completion(nil);
+    }
+    return;
+  }
+
+  if (hostName == nil || [hostName length] == 0) {
+    /* the synchronous path has the alert */
+    NSString *mountPoint = [self mountSFTPService:serviceItem];
+    if (completion) {
+      completion(mountPoint);
+    }
+    return;
+  }
+
+  if (username == nil || [username length] == 0) {
+    NSDictionary *creds = [NetworkVolumeManager runCredentialsPanelWithTitle:
+      NSLocalizedString(@"Connect to SFTP Server", @"") hostname: hostName];
+
+    username = [creds objectForKey:@"username"];
+    password = [creds objectForKey:@"password"];
+    if (username == nil || [username length] == 0) {
+      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: User cancelled connection");
+      if (completion) {
+        completion(nil);
+      }
+      return;
+    }
+    if ([password length] == 0) {
+      password = nil;
+    }
+  }
+
+  [mountingServices addObject:identifier];
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName:NetworkVolumeMountDidStartNotification
+                  object:serviceItem];
+
+  done = [completion copy];
+  [serviceItem retain];
+  [username retain];
+  [password retain];
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    NSString *mountPoint = [self mountSFTPService:serviceItem
+                                         username:username
+                                         password:password];
+    NSString *errorMessage = mountPoint ? nil : [[self lastErrorMessage] copy];
+
+    [mountPoint retain];
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [mountingServices removeObject:identifier];
+      [[NSNotificationCenter defaultCenter]
+        postNotificationName:NetworkVolumeMountDidEndNotification
+                      object:serviceItem];
+
+      if (mountPoint == nil && errorMessage) {
+        NSAlert *alert = [[NSAlert alloc] init];
+        [alert setMessageText:NSLocalizedString(@"Mount Failed", @"")];
+        [alert setInformativeText:[NSString stringWithFormat:
+          NSLocalizedString(@"Failed to mount SFTP volume:\n\n%@", @""), 
+          errorMessage]];
+        [alert setAlertStyle:NSWarningAlertStyle];
+        [alert addButtonWithTitle:NSLocalizedString(@"OK", @"")];
+        [alert runModal];
+        [alert release];
+      }
+
+      if (done) {
+        done(mountPoint);
+      }
+
+      [done release];
+      [mountPoint release];
+      [errorMessage release];
+      [serviceItem release];
+      [username release];
+      [password release];
+    });
+
+    [pool release];
+  });
+}
+
 - (BOOL)unmountService:(NetworkServiceItem *)serviceItem
 {
   NSString *mountPoint = [self mountPointForService:serviceItem];
@@ -941,7 +1003,9 @@ static NetworkVolumeManager *sharedInstance = nil;
     return nil;
   }
   
-  /* Get hostname and port */
+  /* Get hostname and port, once the service is resolved */
+  [[NetworkServiceManager sharedManager] waitForResolutionOfService:serviceItem
+                                                            timeout:NETWORK_RESOLVE_TIMEOUT];
   NSString *hostname = [serviceItem hostName];
   int port = [serviceItem port];
   NSString *remotePath = [serviceItem remotePath];
@@ -1107,7 +1171,14 @@ static NetworkVolumeManager *sharedInstance = nil;
 - (void)unmountAll
 {
   NSArray *identifiers = [mountedVolumes allKeys];
-  
+  NSMutableArray *tasks = [NSMutableArray array];
+  NSMutableArray *mountPoints = [NSMutableArray array];
+  NSMutableArray *failed = [NSMutableArray array];
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:NETWORK_UNMOUNT_TIMEOUT];
+  NSUInteger i;
+
+  /* Every fusermount runs at the same time: one dead server does not hold
+     up the other volumes, and none may take longer than the timeout. */
   for (NSString *identifier in identifiers) {
     NSString *mountPoint = [mountedVolumes objectForKey:identifier];
     
@@ -1119,15 +1190,47 @@ static NetworkVolumeManager *sharedInstance = nil;
     
     @try {
       [task launch];
-      [task waitUntilExit];
-      [task release];
-      
-      /* Remove the mount point directory */
-      [fm removeItemAtPath:mountPoint error:nil];
+      [tasks addObject:task];
+      [mountPoints addObject:mountPoint];
     } @catch (NSException *exception) {
       NSDebugLLog(@"gwspace", @"NetworkVolumeManager: Exception while unmounting %@: %@", 
             mountPoint, exception);
-      [task release];
+      [failed addObject:mountPoint];
+    }
+    [task release];
+  }
+
+  for (i = 0; i < [tasks count]; i++) {
+    NSTask *task = [tasks objectAtIndex:i];
+    NSString *mountPoint = [mountPoints objectAtIndex:i];
+
+    while ([task isRunning] && [deadline timeIntervalSinceNow] > 0) {
+      usleep(20000);
+    }
+    if ([task isRunning]) {
+      NSDebugLLog(@"gwspace", @"NetworkVolumeManager: fusermount timed out for %@", mountPoint);
+      [task terminate];
+      [failed addObject:mountPoint];
+    } else if ([task terminationStatus] != 0) {
+      [failed addObject:mountPoint];
+    } else {
+      /* Remove the mount point directory */
+      [fm removeItemAtPath:mountPoint error:nil];
+    }
+  }
+
+  if ([failed count] > 0) {
+    NSDictionary *holders = [GWUnmountHelper processesUsingMountPoints:failed];
+
+    for (NSString *mountPoint in failed) {
+      NSArray *pids = [holders objectForKey:mountPoint];
+
+      if ([pids count] > 0) {
+        NSLog(@"NetworkVolumeManager: could not unmount %@, in use by %@",
+              mountPoint, [GWUnmountHelper descriptionOfProcesses:pids]);
+      } else {
+        NSLog(@"NetworkVolumeManager: could not unmount %@", mountPoint);
+      }
     }
   }
   
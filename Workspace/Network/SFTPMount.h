@@ -50,6 +50,18 @@
   NSString *tempSSHConfigFile;
 }
 
+/**
+ * Returns YES if the command is in PATH.  The answer is shared by every
+ * mount; a missing tool is looked for again after half a minute.
+ */
++ (BOOL)isToolAvailable:(NSString *)tool;
+
+/**
+ * Drop the host key algorithms remembered for a host, so that the next
+ * mount scans it again.
+ */
++ (void)forgetHostKeyAlgorithmsForHost:(NSString *)host port:(int)p;
+
 /**
  * Mount an SFTP service with the given credentials
  * Returns SFTPMountResult with success status and mount path or error
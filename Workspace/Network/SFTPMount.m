@@ -61,9 +61,30 @@
 
 @end
 
+/* a missing sshfs or sshpass is looked for again after this many seconds */
+#define TOOL_RECHECK_INTERVAL 30.0
+/* the master connection stays this many seconds after its last mount */
+#define CONTROL_PERSIST_SECONDS 600
+
+/* Shared by every mount, which may run on any thread. */
+static NSLock *cacheLock = nil;
+static NSMutableDictionary *toolAvailability = nil;   /* tool -> NSNumber */
+static NSTimeInterval missingToolsCheckTime = 0;
+static NSMutableDictionary *hostKeyAlgorithms = nil;  /* "host:port" -> NSString */
+static int sshfsMajor = -1;
+
 /* SFTPMount implementation */
 @implementation SFTPMount
 
++ (void)initialize
+{
+  if (self == [SFTPMount class]) {
+    cacheLock = [[NSLock alloc] init];
+    toolAvailability = [[NSMutableDictionary alloc] init];
+    hostKeyAlgorithms = [[NSMutableDictionary alloc] init];
+  }
+}
+
 - (id)init
 {
   self = [super init];
@@ -110,64 +131,156 @@
   [super dealloc];
 }
 
-- (BOOL)isSshfsAvailable
++ (BOOL)isToolAvailable:(NSString *)tool
 {
-  /* Check if sshfs command exists in PATH */
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSNumber *cached;
+  BOOL available = NO;
+
+  [cacheLock lock];
+  cached = [toolAvailability objectForKey:tool];
+  /* a tool once found stays; a missing one is looked for again later,
+     so installing it does not need a restart */
+  if (cached && ([cached boolValue] || (now - missingToolsCheckTime) < TOOL_RECHECK_INTERVAL)) {
+    available = [cached boolValue];
+    [cacheLock unlock];
+    return available;
+  }
+  [cacheLock unlock];
+
+  /* Check if the command exists in PATH */
   NSTask *checkTask = [[NSTask alloc] init];
   @try {
     [checkTask setLaunchPath:@"/usr/bin/which"];
-    [checkTask setArguments:@[@"sshfs"]];
+    [checkTask setArguments:@[tool]];
+    [checkTask setStandardOutput:[NSPipe pipe]];
+    [checkTask setStandardError:[NSPipe pipe]];
     [checkTask launch];
     [checkTask waitUntilExit];
-    
-    if ([checkTask terminationStatus] == 0) {
-      NSDebugLLog(@"gwspace", @"SFTPMount: sshfs is available");
-      return YES;
-    } else {
-      NSDebugLLog(@"gwspace", @"SFTPMount: sshfs not found in PATH");
-      return NO;
-    }
+    available = ([checkTask terminationStatus] == 0);
   }
   @catch (NSException *exception) {
-    NSDebugLLog(@"gwspace", @"SFTPMount: Error checking for sshfs: %@", exception);
-    return NO;
+    NSDebugLLog(@"gwspace", @"SFTPMount: Error checking for %@: %@", tool, exception);
+    available = NO;
   }
   @finally {
     [checkTask release];
   }
+
+  NSDebugLLog(@"gwspace", @"SFTPMount: %@ %@", tool, available ? @"is available" : @"not found in PATH");
+
+  [cacheLock lock];
+  [toolAvailability setObject:[NSNumber numberWithBool:available] forKey:tool];
+  if (available == NO) {
+    missingToolsCheckTime = now;
+  }
+  [cacheLock unlock];
+
+  return available;
+}
+
++ (void)forgetHostKeyAlgorithmsForHost:(NSString *)host port:(int)p
+{
+  if (host == nil) return;
+
+  [cacheLock lock];
+  [hostKeyAlgorithms removeObjectForKey:[NSString stringWithFormat:@"%@:%d", host, p]];
+  [cacheLock unlock];
+}
+
+- (BOOL)isSshfsAvailable
+{
+  return [SFTPMount isToolAvailable:@"sshfs"];
 }
 
 - (BOOL)isSshpassAvailable
 {
-  NSTask *checkTask = [[NSTask alloc] init];
+  return [SFTPMount isToolAvailable:@"sshpass"];
+}
+
+- (int)sshfsMajorVersion
+{
+  /* "SSHFS version 3.7.3"; sshfs 2 prints it on stderr */
+  NSTask *task;
+  NSPipe *outPipe;
+  int major = 0;
+
+  [cacheLock lock];
+  major = sshfsMajor;
+  [cacheLock unlock];
+  if (major >= 0) {
+    return major;
+  }
+  major = 0;
+
+  task = [[NSTask alloc] init];
+  outPipe = [NSPipe pipe];
+
   @try {
-    [checkTask setLaunchPath:@"/usr/bin/which"];
-    [checkTask setArguments:@[@"sshpass"]];
-    [checkTask launch];
-    [checkTask waitUntilExit];
-    
-    BOOL available = ([checkTask terminationStatus] == 0);
-    if (available) {
-      NSDebugLLog(@"gwspace", @"SFTPMount: sshpass is available");
-    } else {
-      NSDebugLLog(@"gwspace", @"SFTPMount: sshpass not found");
+    [task setLaunchPath:@"/usr/bin/env"];
+    [task setArguments:@[@"sshfs", @"-V"]];
+    [task setStandardOutput:outPipe];
+    [task setStandardError:outPipe];
+    [task launch];
+
+    NSData *outData = [[outPipe fileHandleForReading] readDataToEndOfFile];
+    [task waitUntilExit];
+
+    NSString *outString = [[[NSString alloc] initWithData:outData encoding:NSUTF8StringEncoding] autorelease];
+    NSRange range = [outString rangeOfString:@"SSHFS version "];
+    if (range.location != NSNotFound) {
+      major = [[outString substringFromIndex:NSMaxRange(range)] intValue];
     }
-    return available;
   }
   @catch (NSException *exception) {
-    NSDebugLLog(@"gwspace", @"SFTPMount: Error checking for sshpass: %@", exception);
-    return NO;
+    NSDebugLLog(@"gwspace", @"SFTPMount: Error reading the sshfs version: %@", exception);
   }
   @finally {
-    [checkTask release];
+    [task release];
   }
-}
 
+  [cacheLock lock];
+  sshfsMajor = major;
+  [cacheLock unlock];
 
-- (NSString *)detectHostKeyAlgorithmsForHost:(NSString *)host port:(int)p
+  return major;
+}
+
+/* With the "GWSSHFSTunedOptions" default set: sshfs keeps the attributes
+   and listings it got for as long as FSNodeRep trusts its own listings of
+   network volumes, the kernel keeps the pages of files it read, and reads
+   go in 64 KB requests instead of the 4 KB of older FUSE versions. */
+- (NSArray *)tunedOptions
 {
-  if (!host || [host length] == 0) return nil;
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  id entry = [defaults objectForKey:@"FSNRemoteListingTTL"];
+  int ttl = entry ? [entry intValue] : 30;
+  NSMutableArray *options = [NSMutableArray array];
+
+  if ([defaults boolForKey:@"GWSSHFSTunedOptions"] == NO) {
+    return options;
+  }
+
+  if (ttl <= 0) {
+    ttl = 30;
+  }
+
+  /* sshfs 3 renamed the caching options */
+  if ([self sshfsMajorVersion] >= 3) {
+    [options addObject:@"dir_cache=yes"];
+    [options addObject:[NSString stringWithFormat:@"dcache_timeout=%d", ttl]];
+  } else {
+    [options addObject:@"cache=yes"];
+    [options addObject:[NSString stringWithFormat:@"cache_timeout=%d", ttl]];
+  }
+  [options addObject:@"kernel_cache"];
+  [options addObject:@"max_read=65536"];
+
+  return options;
+}
 
+- (NSString *)scanHostKeyAlgorithmsForHost:(NSString *)host port:(int)p
+{
   NSString *sshKeyscan = @"/usr/bin/ssh-keyscan";
   NSFileManager *fm = [NSFileManager defaultManager];
   if (![fm isExecutableFileAtPath:sshKeyscan]) {
@@ -257,6 +370,78 @@
   }
 }
 
+/* Where ssh keeps the sockets of its master connections, one per user,
+   host and port (%C); nil when the "GWSSHControlMaster" default is off
+   or the directory cannot be made private. */
+- (NSString *)controlSocketDirectory
+{
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir;
+  NSDictionary *attrs;
+  BOOL isDir = NO;
+
+  if ([defaults objectForKey:@"GWSSHControlMaster"]
+      && [defaults boolForKey:@"GWSSHControlMaster"] == NO) {
+    return nil;
+  }
+
+  /* socket paths are limited to about 100 bytes: keep it short */
+  dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+                                  [NSString stringWithFormat:@"gw-ssh-%d", (int)getuid()]];
+
+  if ([fm fileExistsAtPath:dir isDirectory:&isDir] == NO) {
+    if ([fm createDirectoryAtPath:dir
+      withIntermediateDirectories:YES
+                       attributes:@{NSFilePosixPermissions: @0700}
+                            error:NULL] == NO) {
+      return nil;
+    }
+  } else if (isDir == NO) {
+    return nil;
+  }
+
+  /* anyone who can reach the sockets can use the connections */
+  attrs = [fm attributesOfItemAtPath:dir error:NULL];
+  if ([[attrs fileOwnerAccountID] intValue] != (int)getuid()
+      || ([attrs filePosixPermissions] & 077) != 0) {
+    NSDebugLLog(@"gwspace", @"SFTPMount: %@ is not private, not sharing connections", dir);
+    return nil;
+  }
+
+  return dir;
+}
+
+/* ssh-keyscan waits up to 5 seconds on every mount otherwise; host keys
+   change seldom, and a failed mount drops what was found for its host. */
+- (NSString *)detectHostKeyAlgorithmsForHost:(NSString *)host port:(int)p
+{
+  NSString *key;
+  NSString *algs;
+
+  if (!host || [host length] == 0) return nil;
+
+  key = [NSString stringWithFormat:@"%@:%d", host, p];
+  [cacheLock lock];
+  algs = [[[hostKeyAlgorithms objectForKey:key] retain] autorelease];
+  [cacheLock unlock];
+
+  if (algs) {
+    NSDebugLLog(@"gwspace", @"SFTPMount: Reusing host key algorithms of %@: %@", key, algs);
+    return algs;
+  }
+
+  algs = [self scanHostKeyAlgorithmsForHost:host port:p];
+
+  if (algs) {
+    [cacheLock lock];
+    [hostKeyAlgorithms setObject:algs forKey:key];
+    [cacheLock unlock];
+  }
+
+  return algs;
+}
+
 - (NSString *)improveErrorMessage:(NSString *)rawError 
                         hostname:(NSString *)host 
                         username:(NSString *)user
@@ -506,6 +691,12 @@
   [args addObject:@"-v"];
   [args addObject:@"-v"];
   [args addObject:@"-v"];
+
+  /* Throughput options, when the user allows them */
+  for (NSString *option in [self tunedOptions]) {
+    [args addObject:@"-o"];
+    [args addObject:option];
+  }
   
   /* Build SSH options via a temporary SSH config file.
      sshfs splits ALL -o values on commas, which breaks SSH options that
@@ -534,6 +725,13 @@
   [sshConfig appendString:@"    ConnectTimeout 10\n"];
   [sshConfig appendString:@"    ServerAliveInterval 15\n"];
   [sshConfig appendString:@"    ServerAliveCountMax 3\n"];
+  /* Later mounts of the host go over the connection already made */
+  NSString *controlDir = [self controlSocketDirectory];
+  if (controlDir) {
+    [sshConfig appendString:@"    ControlMaster auto\n"];
+    [sshConfig appendFormat:@"    ControlPath %@/%%C\n", controlDir];
+    [sshConfig appendFormat:@"    ControlPersist %d\n", CONTROL_PERSIST_SECONDS];
+  }
   /* Support keyboard-interactive (FreeBSD etc.), password, and publickey auth */
   [sshConfig appendString:@"    PreferredAuthentications keyboard-interactive,password,publickey\n"];
   /* Host key algorithms */
@@ -693,13 +891,14 @@
       
       NSDebugLLog(@"gwspace", @"SFTPMount: Waiting for mount...");
       
-      /* Wait up to 10 seconds for mount to become accessible */
-      int maxAttempts = 20;
+      /* Wait up to 10 seconds for mount to become accessible; over a
+         shared connection it is often ready in a tenth of a second */
+      int maxAttempts = 100;
       int attempt = 0;
       BOOL mounted = NO;
       
       while (attempt < maxAttempts && !mounted) {
-        usleep(500000); // 0.5 seconds
+        usleep(100000); // 0.1 seconds
         attempt++;
         
         /* Check if process is still running */
@@ -793,6 +992,9 @@
     /* Remove the mount point directory */
     [fm removeItemAtPath:mountPoint error:nil];
     
+    /* The host may have changed keys */
+    [SFTPMount forgetHostKeyAlgorithmsForHost:hostname port:port];
+
     /* Make sure we have a valid error string before using it */
     if (!errorString || [errorString length] == 0) {
       errorString = @"Mount failed - sshfs exited without providing error details";
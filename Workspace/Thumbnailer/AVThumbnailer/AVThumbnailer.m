@@ -28,9 +28,163 @@
 #import <AppKit/AppKit.h>
 #import <AVFoundation/AVFoundation.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #import "AVThumbnailer.h"
 
+extern char **environ;
+
+/* Video frames come from ffmpeg helpers, at most this many at a time
+ * whatever the number of thumbnail workers, each killed when it runs over
+ * the "AVThumbnailerTimeLimit" default (seconds). */
+#define MAX_HELPERS 2
+#define DEFAULT_TIME_LIMIT 5.0
+
+/* where in the stream the frame is taken, past the usual black intro */
+#define SEEK_FRACTION 0.1
+
+/* no sane PNG of a thumbnail gets near this */
+#define MAX_HELPER_OUTPUT (4 * 1024 * 1024)
+
 static NSArray *supportedExtensions = nil;
+static NSArray *videoExtensions = nil;
+
+static NSCondition *helpersCondition = nil;
+static NSUInteger helpersRunning = 0;
+static NSMutableSet *failedFiles = nil;
+static NSString *ffmpegPath = nil;
+static NSString *ffprobePath = nil;
+static BOOL helpersLookedUp = NO;
+
+/* Runs `argv` with its output in `output`, waiting no more than `limit`
+ * seconds: a helper stuck on a broken file is killed.  Returns the exit
+ * status, -1 when the helper could not run or was killed. */
+static int runHelper(const char *tool, char *const argv[],
+                     NSMutableData *output, NSTimeInterval limit)
+{
+  posix_spawn_file_actions_t actions;
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow: limit];
+  int fds[2];
+  pid_t pid;
+  int status;
+  BOOL killed = NO;
+
+  if (pipe(fds) != 0)
+    return -1;
+
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+  posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addclose(&actions, fds[1]);
+
+  if (posix_spawn(&pid, tool, &actions, NULL, argv, environ) != 0)
+    {
+      posix_spawn_file_actions_destroy(&actions);
+      close(fds[0]);
+      close(fds[1]);
+      return -1;
+    }
+
+  posix_spawn_file_actions_destroy(&actions);
+  close(fds[1]);
+
+  while (1)
+    {
+      struct pollfd pfd;
+      int remaining = (int)([deadline timeIntervalSinceNow] * 1000);
+      char buf[16384];
+      ssize_t n;
+
+      if (remaining <= 0)
+        {
+          killed = YES;
+          break;
+        }
+
+      pfd.fd = fds[0];
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+
+      if (poll(&pfd, 1, remaining) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          killed = YES;
+          break;
+        }
+      if (pfd.revents == 0)
+        continue;
+
+      n = read(fds[0], buf, sizeof(buf));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+
+      [output appendBytes: buf length: n];
+      if ([output length] > MAX_HELPER_OUTPUT)
+        {
+          killed = YES;
+          break;
+        }
+    }
+
+  close(fds[0]);
+
+  if (killed)
+    kill(pid, SIGKILL);
+
+  while (waitpid(pid, &status, 0) < 0)
+    {
+      if (errno != EINTR)
+        return -1;
+    }
+
+  if (killed || WIFEXITED(status) == 0)
+    return -1;
+
+  return WEXITSTATUS(status);
+}
+
+static NSString *findTool(NSString *name)
+{
+  NSString *pathEnv = [[[NSProcessInfo processInfo] environment] objectForKey: @"PATH"];
+  NSArray *dirs = [(pathEnv ? pathEnv : @"/usr/local/bin:/usr/bin:/bin")
+                     componentsSeparatedByString: @":"];
+  NSFileManager *fm = [NSFileManager defaultManager];
+
+  for (NSString *dir in dirs)
+    {
+      NSString *path;
+
+      if ([dir length] == 0)
+        continue;
+      path = [dir stringByAppendingPathComponent: name];
+      if ([fm isExecutableFileAtPath: path])
+        return path;
+    }
+
+  return nil;
+}
+
+
+@interface AVThumbnailer (Private)
+
+- (NSData *)videoThumbnailForPath:(NSString *)path;
+
+- (NSData *)audioThumbnailForPath:(NSString *)path;
+
+@end
+
 
 @implementation AVThumbnailer
 
@@ -40,6 +194,11 @@ static NSArray *supportedExtensions = nil;
     {
       supportedExtensions = [[NSArray alloc] initWithObjects:
         @"mp3", @"m4a", @"m4r", @"flac", @"ogg", @"wav", @"aiff", @"aif", nil];
+      videoExtensions = [[NSArray alloc] initWithObjects:
+        @"mp4", @"m4v", @"mov", @"mkv", @"webm", @"avi", @"mpg", @"mpeg",
+        @"ogv", @"wmv", @"flv", @"3gp", @"ts", @"mts", @"m2ts", nil];
+      helpersCondition = [NSCondition new];
+      failedFiles = [NSMutableSet new];
     }
 }
 
@@ -51,7 +210,25 @@ static NSArray *supportedExtensions = nil;
 - (BOOL)canProvideThumbnailForPath:(NSString *)path
 {
   NSString *ext = [[path pathExtension] lowercaseString];
-  return (ext && [supportedExtensions containsObject: ext]);
+  if (ext == nil)
+    return NO;
+  if ([supportedExtensions containsObject: ext])
+    return YES;
+  if ([videoExtensions containsObject: ext])
+    {
+      [helpersCondition lock];
+      if (helpersLookedUp == NO)
+        {
+          ASSIGN (ffmpegPath, findTool(@"ffmpeg"));
+          ASSIGN (ffprobePath, findTool(@"ffprobe"));
+          helpersLookedUp = YES;
+        }
+      [helpersCondition unlock];
+
+      return (ffmpegPath != nil);
+    }
+
+  return NO;
 }
 
 - (NSData *)makeThumbnailForPath:(NSString *)path
@@ -59,6 +236,138 @@ static NSArray *supportedExtensions = nil;
   if (path == nil)
     return nil;
 
+  if ([videoExtensions containsObject: [[path pathExtension] lowercaseString]])
+    return [self videoThumbnailForPath: path];
+
+  return [self audioThumbnailForPath: path];
+}
+
+- (NSString *)fileNameExtension
+{
+  return @"tiff";
+}
+
+- (NSString *)description
+{
+  return @"Audio and Video Thumbnailer";
+}
+
+@end
+
+
+@implementation AVThumbnailer (Private)
+
+/* One frame near SEEK_FRACTION of the duration.  The seek goes before
+ * the input, so ffmpeg jumps to the keyframe before it instead of
+ * decoding up to it; only keyframes are decoded, without the loop
+ * filter, and scaled to the thumbnail inside the helper, which gives
+ * back a PNG.  A file whose helper failed or ran over the time limit is
+ * not tried again until it changes. */
+- (NSData *)videoThumbnailForPath:(NSString *)path
+{
+  NSDictionary *attrs = [[NSFileManager defaultManager] fileAttributesAtPath: path
+                                                               traverseLink: YES];
+  NSString *fileKey;
+  NSTimeInterval limit;
+  NSTimeInterval seek = 0.0;
+  NSMutableData *output;
+  NSString *input;
+  NSString *scale;
+  NSString *seekArg;
+  int status;
+
+  if (attrs == nil || ffmpegPath == nil)
+    return nil;
+
+  fileKey = [NSString stringWithFormat: @"%@:%@:%@", path,
+                      [attrs fileModificationDate],
+                      [attrs objectForKey: NSFileSize]];
+
+  limit = [[NSUserDefaults standardUserDefaults] doubleForKey: @"AVThumbnailerTimeLimit"];
+  if (limit <= 0)
+    limit = DEFAULT_TIME_LIMIT;
+
+  [helpersCondition lock];
+  if ([failedFiles containsObject: fileKey])
+    {
+      [helpersCondition unlock];
+      return nil;
+    }
+  while (helpersRunning >= MAX_HELPERS)
+    [helpersCondition wait];
+  helpersRunning++;
+  [helpersCondition unlock];
+
+  input = [@"file:" stringByAppendingString: path];
+
+  if (ffprobePath)
+    {
+      const char *probeArgv[] = {
+        "ffprobe", "-v", "error",
+        "-show_entries", "format=duration",
+        "-of", "default=noprint_wrappers=1:nokey=1",
+        [input fileSystemRepresentation], NULL
+      };
+
+      output = [NSMutableData data];
+      if (runHelper([ffprobePath fileSystemRepresentation],
+                    (char *const *)probeArgv, output, limit) == 0)
+        {
+          NSString *str = [[NSString alloc] initWithData: output
+                                                encoding: NSASCIIStringEncoding];
+          double duration = [str doubleValue];
+
+          RELEASE (str);
+          if (duration > 0 && isfinite(duration))
+            seek = duration * SEEK_FRACTION;
+        }
+    }
+
+  scale = [NSString stringWithFormat:
+             @"scale=%d:%d:force_original_aspect_ratio=decrease",
+             (int)TMBMAX, (int)TMBMAX];
+  seekArg = [NSString stringWithFormat: @"%.3f", seek];
+
+  {
+    const char *argv[] = {
+      "ffmpeg", "-nostdin", "-hide_banner", "-loglevel", "error",
+      "-threads", "1",
+      "-skip_frame", "nokey", "-skip_loop_filter", "all", "-flags2", "fast",
+      "-noaccurate_seek", "-ss", [seekArg UTF8String],
+      "-i", [input fileSystemRepresentation],
+      "-map", "0:v:0", "-an", "-sn", "-dn",
+      "-frames:v", "1",
+      "-vf", [scale UTF8String],
+      "-f", "image2pipe", "-c:v", "png", "-",
+      NULL
+    };
+
+    output = [NSMutableData data];
+    status = runHelper([ffmpegPath fileSystemRepresentation],
+                       (char *const *)argv, output, limit);
+  }
+
+  [helpersCondition lock];
+  helpersRunning--;
+  if (status != 0 || [output length] == 0)
+    [failedFiles addObject: fileKey];
+  [helpersCondition signal];
+  [helpersCondition unlock];
+
+  if (status != 0 || [output length] == 0)
+    {
+      NSDebugLLog(@"gwspace", @"AVThumbnailer: no frame from %@", path);
+      return nil;
+    }
+
+  if ([NSBitmapImageRep imageRepWithData: output] == nil)
+    return nil;
+
+  return output;
+}
+
+- (NSData *)audioThumbnailForPath:(NSString *)path
+{
   NSURL *url = [NSURL fileURLWithPath: path];
   AVURLAsset *asset = [[AVURLAsset alloc] initWithURL: url options: nil];
   NSData *coverData = nil;
@@ -124,14 +433,4 @@ static NSArray *supportedExtensions = nil;
   return [tiffData autorelease];
 }
 
-- (NSString *)fileNameExtension
-{
-  return @"tiff";
-}
-
-- (NSString *)description
-{
-  return @"Audio Thumbnailer";
-}
-
 @end
@@ -39,46 +39,104 @@
 @end
 
 
+@class TMBJob;
+@class FSNThumbnailStore;
+@class GWXDGThumbnails;
+
 @interface Thumbnailer: NSObject
 {
   NSMutableArray *thumbnailers;
+  NSLock *loadLock;
+  BOOL thumbnailersLoaded;
   NSMutableDictionary *extProviders;
   id current;
   NSString *thumbnailDir;
-  NSString *dictPath;
-  NSMutableDictionary *thumbsDict;
-  long thumbref; 
+  FSNThumbnailStore *store;
+  GWXDGThumbnails *xdgThumbnails;
+  BOOL compacting;
   NSTimer *timer; 
   NSConnection *conn;
   NSFileManager *fm;
-  NSLock *dictLock;
   NSMutableArray *pathsInProcessing;
+
+  NSCondition *jobsCondition;
+  NSMutableArray *jobs;
+  NSMutableSet *queuedPaths;
+  NSMutableDictionary *requesterGenerations;
+  NSMutableDictionary *runningByDevice;
+  NSMutableDictionary *deviceLimits;
+  NSMutableArray *createdPaths;
+  NSMutableDictionary *viewHints;
+  NSMutableDictionary *pathRanks;
+  NSMutableArray *watchedFolders;
+  id pathWatcher;
+  NSMutableDictionary *remakeTimes;
+  NSMutableSet *deferredRemakes;
+  unsigned long long validateCursor;
+  BOOL validating;
+  NSMutableSet *deletionFolders;
+  NSMutableSet *sweptFolders;
+  NSUInteger workersCount;
+  NSUInteger runningJobs;
+  BOOL workersStarted;
 }
 
 + (Thumbnailer *)sharedThumbnailer;
 
-- (void)writeDictToFile;
-
 - (void)loadThumbnailers;
 
+/* the bundles are loaded by the first thumbnail asked for, from any
+   thread, or by this call, when the application is idle after launch */
+- (void)loadThumbnailersIfNeeded;
+
 - (BOOL)addThumbnailer:(id)tmb;
 
 - (id)thumbnailerForPath:(NSString *)path;
 
-- (NSString *)nextThumbName;
-
+/* compacts the store in the background when it wastes too much room,
+   dropping the thumbnails of the files gone or changed */
 - (void)checkThumbnails:(id)sender;
 
+/* on a timer: drops the thumbnails of the files gone or changed, the
+   next few records of the store at each call */
+- (void)validateThumbnails:(id)sender;
+
 - (BOOL)registerThumbnailData:(NSData *)data 
-                      forPath:(NSString *)path
-                nameExtension:(NSString *)ext;
+                      forPath:(NSString *)path;
 
 - (BOOL)removeThumbnailForPath:(NSString *)path;
 
 - (void)makeThumbnails:(NSString*)path;
 
+/* the jobs queued before for the requester are dropped: a viewer asks
+   for the folder it moves to, and cancels when it closes */
+- (void)makeThumbnails:(NSString *)path
+          forRequester:(id)requester;
+
+- (void)cancelThumbnailsForRequester:(id)requester;
+
+/* the visible paths of a view go first, then the ones it scrolls to,
+   then the rest of the queue at a lower thread priority */
+- (void)prioritizeVisiblePaths:(NSArray *)visible
+                    aheadPaths:(NSArray *)ahead
+                       forView:(id)view;
+
 - (void)removeThumbnails:(NSString*)path;
 
+/* the folders listed for thumbnails are watched through it (an object
+   answering -addWatcherForPath: and -removeWatcherForPath:, not
+   retained) */
+- (void)setPathWatcher:(id)watcher;
+
+/* the files of a watched folder written or moved in get their
+   thumbnails again, no more than once in a while each */
+- (void)watchedPathDidChange:(NSDictionary *)info;
+
+/* jobs for these files only, without listing the directory: for the
+   names a creation event carries */
+- (void)makeThumbnailsForFiles:(NSArray *)names
+                   inDirectory:(NSString *)dir;
+
 
 - (NSArray *)bundlesWithExtension:(NSString *)extension
 inDirectory:(NSString *)dirpath;
@@ -25,17 +25,227 @@
 
 #include <math.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #import <dispatch/dispatch.h>
 #import "GWThumbnailer.h"
+#import "FSNMountTable.h"
+#import "FSNThumbnailStore.h"
+#import "GWXDGThumbnails.h"
+#import "FSNThumbnailScheduler.h"
+#import "GWStartupTrace.h"
+
+/* the most thumbnails made at the same time */
+#define MAX_TMB_WORKERS 8
+/* the thumbnails announced in one notification */
+#define CREATED_BATCH 32
+
+/* job ranks, the lowest is taken first */
+#define RANK_VISIBLE 0
+#define RANK_AHEAD 1
+#define RANK_BACKGROUND 2
+
+/* the thread priorities of the workers by the rank of their job */
+#define FRONT_PRIORITY 0.5
+#define BACKGROUND_PRIORITY 0.2
+
+/* the folders listed last whose change events are followed */
+#define MAX_WATCHED_FOLDERS 32
+/* a file rewritten again and again gets a new thumbnail at most this
+   often (in seconds) */
+#define REMAKE_INTERVAL 2.0
+
+/* the store records checked against their files every VALIDATE_INTERVAL
+   seconds */
+#define VALIDATE_INTERVAL 30.0
+#define VALIDATE_COUNT 64
 
 static Thumbnailer *sharedThumbnailerInstance = nil;
 static NSInteger countInstances = 0;
 
 static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNotification";
 
+static BOOL isRotationalDevice(dev_t dev)
+{
+#ifdef __linux__
+  /* a partition keeps its queue/ in the parent disk's directory */
+  static const char *formats[] = {
+    "/sys/dev/block/%u:%u/queue/rotational",
+    "/sys/dev/block/%u:%u/../queue/rotational"
+  };
+  unsigned i;
+
+  for (i = 0; i < 2; i++) {
+    char path[64];
+    char c = '0';
+    int fd;
+
+    snprintf(path, sizeof(path), formats[i], major(dev), minor(dev));
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+      if (read(fd, &c, 1) != 1) {
+        c = '0';
+      }
+      close(fd);
+      return (c == '1');
+    }
+  }
+#endif
+  return NO;
+}
+
+
+/*
+ * A thumbnail to make, or a directory to list into them.  The
+ * generation is the one of the requester when the job was queued.
+ * A job with a work block runs it instead.
+ */
+@interface TMBJob: NSObject
+{
+  NSString *path;
+  NSValue *requester;
+  NSUInteger generation;
+  dev_t device;
+  BOOL directory;
+  void (^work)(void);
+}
+
+- (id)initWithPath:(NSString *)apath
+         requester:(NSValue *)areq
+        generation:(NSUInteger)gen
+            device:(dev_t)dev
+         directory:(BOOL)isdir;
+
+- (NSString *)path;
+
+- (NSValue *)requester;
+
+- (NSUInteger)generation;
+
+- (dev_t)device;
+
+- (BOOL)isDirectory;
+
+- (void)setWork:(void (^)(void))awork;
+
+- (void (^)(void))work;
+
+@end
+
+
+@implementation TMBJob
+
+- (void)dealloc
+{
+  RELEASE (path);
+  RELEASE (requester);
+  RELEASE (work);
+  [super dealloc];
+}
+
+- (id)initWithPath:(NSString *)apath
+         requester:(NSValue *)areq
+        generation:(NSUInteger)gen
+            device:(dev_t)dev
+         directory:(BOOL)isdir
+{
+  self = [super init];
+
+  if (self) {
+    ASSIGN (path, apath);
+    ASSIGN (requester, areq);
+    generation = gen;
+    device = dev;
+    directory = isdir;
+  }
+
+  return self;
+}
+
+- (NSString *)path
+{
+  return path;
+}
+
+- (NSValue *)requester
+{
+  return requester;
+}
+
+- (NSUInteger)generation
+{
+  return generation;
+}
+
+- (dev_t)device
+{
+  return device;
+}
+
+- (BOOL)isDirectory
+{
+  return directory;
+}
+
+- (void)setWork:(void (^)(void))awork
+{
+  RELEASE (work);
+  work = [awork copy];
+}
+
+- (void (^)(void))work
+{
+  return work;
+}
+
+@end
+
+
+/* declared here: the thumbnailer bundles include GWThumbnailer.h
+   without the FSNode headers */
+@interface Thumbnailer (FSNThumbnailScheduler) <FSNThumbnailScheduler>
+@end
+
+
+@interface Thumbnailer (Scheduler)
+
+- (void)startWorkers;
+
+- (void)thumbnailWorker:(id)sender;
+
+- (TMBJob *)nextJob;
+
+- (NSUInteger)rankOfJob:(TMBJob *)job;
+
+- (BOOL)isCancelledJob:(TMBJob *)job;
+
+- (NSUInteger)jobsLimitForDevice:(dev_t)dev;
+
+- (void)listDirectoryJob:(TMBJob *)job;
+
+- (BOOL)makeThumbnailForJob:(TMBJob *)job;
+
+- (void)thumbnailsCreated:(NSArray *)paths;
+
+- (void)importLegacyThumbnails;
+
+- (void)watchFolder:(NSString *)path;
+
+- (void)remakeThumbnailsForPaths:(NSArray *)paths;
+
+- (void)queueFileJobs:(NSArray *)fjobs;
+
+- (void)remakeDeferredThumbnails;
+
+@end
+
 
 
 @implementation Thumbnailer
@@ -77,13 +287,27 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
         [timer invalidate];
   
       RELEASE (thumbnailers);
+      RELEASE (loadLock);
       RELEASE (extProviders);
       RELEASE (thumbnailDir);
-      RELEASE (dictPath);
-      RELEASE (thumbsDict);
+      RELEASE (store);
+      RELEASE (xdgThumbnails);
       DESTROY (conn);
-      DESTROY (dictLock);
       RELEASE (pathsInProcessing);
+      RELEASE (jobsCondition);
+      RELEASE (jobs);
+      RELEASE (queuedPaths);
+      RELEASE (requesterGenerations);
+      RELEASE (runningByDevice);
+      RELEASE (deviceLimits);
+      RELEASE (createdPaths);
+      RELEASE (viewHints);
+      RELEASE (pathRanks);
+      RELEASE (watchedFolders);
+      RELEASE (remakeTimes);
+      RELEASE (deferredRemakes);
+      RELEASE (deletionFolders);
+      RELEASE (sweptFolders);
       sharedThumbnailerInstance = nil;
       [super dealloc];
     }
@@ -94,26 +318,40 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
   self = [super init];
 
   if (self) {
-    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-    id entry;
     BOOL isdir;
 
-    if (!dictLock)
-      dictLock = [[NSLock alloc] init];
-
     pathsInProcessing = [[NSMutableArray alloc] init];
 
+    jobsCondition = [NSCondition new];
+    jobs = [NSMutableArray new];
+    queuedPaths = [NSMutableSet new];
+    requesterGenerations = [NSMutableDictionary new];
+    runningByDevice = [NSMutableDictionary new];
+    deviceLimits = [NSMutableDictionary new];
+    createdPaths = [NSMutableArray new];
+    viewHints = [NSMutableDictionary new];
+    pathRanks = [NSMutableDictionary new];
+    watchedFolders = [NSMutableArray new];
+    remakeTimes = [NSMutableDictionary new];
+    deferredRemakes = [NSMutableSet new];
+    deletionFolders = [NSMutableSet new];
+    sweptFolders = [NSMutableSet new];
+    pathWatcher = nil;
+    runningJobs = 0;
+    workersStarted = NO;
+
+    /* decoding images keeps a core busy, the disks are limited apart */
+    workersCount = [[NSProcessInfo processInfo] processorCount];
+    workersCount = (workersCount < 1) ? 1 
+                       : ((workersCount > MAX_TMB_WORKERS) ? MAX_TMB_WORKERS : workersCount);
+
     fm = [NSFileManager defaultManager];
     extProviders = [NSMutableDictionary new];
-    [self loadThumbnailers];
+    /* no bundle is loaded before a thumbnail is needed */
+    thumbnailers = [NSMutableArray new];
+    loadLock = [NSLock new];
+    thumbnailersLoaded = NO;
 
-    entry = [defaults objectForKey: @"thumbref"];
-    if (entry) {
-      thumbref = [(NSNumber *)entry longValue];
-    } else {
-      thumbref = 0;
-    }
-    
     thumbnailDir = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject];
     thumbnailDir = [thumbnailDir stringByAppendingPathComponent: @"Thumbnails"];
     RETAIN (thumbnailDir);
@@ -125,43 +363,36 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
       }
     }
     
-    ASSIGN (dictPath, [thumbnailDir stringByAppendingPathComponent: @"thumbnails.plist"]);    
-    
-    if ([fm fileExistsAtPath: dictPath]) {
-      NSDictionary *dict = [NSDictionary dictionaryWithContentsOfFile: dictPath];
-    
-      if (dict) {
-        thumbsDict = [dict mutableCopy];
-      } else {
-        thumbsDict = [NSMutableDictionary new];
-      }
-    } else {
-      thumbsDict = [NSMutableDictionary new];
-    }  
-
-    [self writeDictToFile];
+    store = [[FSNThumbnailStore alloc] initWithDirectory: thumbnailDir
+                                                writable: YES];
+    if (store == nil) {
+      NSDebugLLog(@"gwspace", @"no thumbnail store");
+      return nil;
+    }
 
+    xdgThumbnails = [GWXDGThumbnails new];
 
+    /* the thumbnails of older versions were files listed in a plist */
+    if ([fm fileExistsAtPath: [thumbnailDir stringByAppendingPathComponent: @"thumbnails.plist"]]) {
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [self importLegacyThumbnails];
+      });
+    }
 
-    /* FIXME: this could be a problem with different instances for View
-    timer = [NSTimer scheduledTimerWithTimeInterval: 10.0 target: self 
-          										      selector: @selector(checkThumbnails:) 
-                                                userInfo: nil repeats: YES];   
-    */                                          
+    /* the store is checked a few records at a time, the whole of it
+       over hours: the watched folders tell their changes themselves */
+    validateCursor = 0;
+    validating = NO;
+    timer = [NSTimer scheduledTimerWithTimeInterval: VALIDATE_INTERVAL
+                                             target: self
+                                           selector: @selector(validateThumbnails:)
+                                           userInfo: nil
+                                            repeats: YES];
   }
 
   return self;
 }
 
-- (void)writeDictToFile
-{
-  [dictLock lock];
-  NSDebugLLog(@"gwspace", @"(%d) writing to: %@", (int)countInstances, dictPath);
-  [thumbsDict writeToFile: dictPath atomically: YES];
-  [dictLock unlock];
-}
-
-
 - (void)loadThumbnailers
 {
   NSString *bundlesDir;
@@ -199,6 +430,7 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
       
       if (bundle)
         {
+          GWStartupTraceBegin([bpath lastPathComponent]);
           Class principalClass = [bundle principalClass];
           
           if (principalClass)
@@ -220,6 +452,7 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
           {
             NSLog(@"Thumbnailer bundle %@ has no principal class", bpath);
           }
+          GWStartupTraceEnd([bpath lastPathComponent]);
       }
     else
       {
@@ -229,6 +462,19 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
   NSLog(@"Thumbnailers loaded: %lu", (unsigned long)[thumbnailers count]);
 }
 
+- (void)loadThumbnailersIfNeeded
+{
+  [loadLock lock];
+  if (thumbnailersLoaded == NO)
+    {
+      CREATE_AUTORELEASE_POOL(arp);
+      [self loadThumbnailers];
+      thumbnailersLoaded = YES;
+      RELEASE (arp);
+    }
+  [loadLock unlock];
+}
+
 - (BOOL)addThumbnailer:(id)tmb
 {
   NSString *description = [tmb description];
@@ -261,6 +507,8 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
 - (id)thumbnailerForPath:(NSString *)path
 {
   NSUInteger i;
+
+  [self loadThumbnailersIfNeeded];
   
   for (i = 0; i < [thumbnailers count]; i++)
     {
@@ -277,124 +525,211 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
 
 - (void)checkThumbnails:(id)sender
 {
-  if (thumbsDict && [thumbsDict count]) {
-    NSArray *paths = RETAIN ([thumbsDict allKeys]);
-    NSMutableArray *deleted = [NSMutableArray array];
-    NSUInteger i;
+  [jobsCondition lock];
 
-    for (i = 0; i < [paths count]; i++) {
-      NSString *path = [paths objectAtIndex: i];
-      NSString *tname = [thumbsDict objectForKey: path];
+  if ((compacting == NO) && [store needsCompaction]) {
+    compacting = YES;
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+      CREATE_AUTORELEASE_POOL(arp);
 
-      if ([fm fileExistsAtPath: path] == NO) {
-        NSString *tpath = [thumbnailDir stringByAppendingPathComponent: tname];
+      [store compact];
 
-        if ([fm fileExistsAtPath: tpath]) {
-          [fm removeFileAtPath: tpath handler: nil];
-        }
-        
-        [deleted addObject: path];
-        [thumbsDict removeObjectForKey: path];
-      }
+      [jobsCondition lock];
+      compacting = NO;
+      [jobsCondition unlock];
+      RELEASE (arp);
+    });
+  }
+
+  [jobsCondition unlock];
+}
+
+/*
+ * A file changed in a watched folder gets its thumbnail made again,
+ * which replaces the old one, so the records of those folders are left
+ * out; not those of a folder where files were deleted since the pass
+ * before this one started, as nothing else drops their thumbnails.
+ */
+- (void)validateThumbnails:(id)sender
+{
+  NSMutableSet *skipped;
+
+  [self checkThumbnails: nil];
+
+  [jobsCondition lock];
+  if (validating) {
+    [jobsCondition unlock];
+    return;
+  }
+  validating = YES;
+  [jobsCondition unlock];
+
+  if (validateCursor == 0) {
+    [sweptFolders setSet: deletionFolders];
+    [deletionFolders removeAllObjects];
+  }
+
+  skipped = [NSMutableSet new];
+  if (pathWatcher) {
+    [skipped addObjectsFromArray: watchedFolders];
+    [skipped minusSet: sweptFolders];
+    [skipped minusSet: deletionFolders];
+  }
+
+  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+    CREATE_AUTORELEASE_POOL(arp);
+    NSUInteger removed;
+
+    removed = [store removeStaleFromCursor: &validateCursor
+                                     count: VALIDATE_COUNT
+                           skippingFolders: skipped];
+    if (removed) {
+      NSDebugLLog(@"gwspace", @"%lu stale thumbnails removed", (unsigned long)removed);
     }
 
-    RELEASE (paths); 
-    
-    if ([deleted count])
-      {
-        NSMutableDictionary *info = [NSMutableDictionary dictionary];
+    RELEASE (skipped);
 
-        [info setObject: deleted forKey: @"deleted"];	
-        [info setObject: [NSArray array] forKey: @"created"];
+    [jobsCondition lock];
+    validating = NO;
+    [jobsCondition unlock];
+    RELEASE (arp);
+  });
+}
 
-        [self writeDictToFile];
-      
-        [[NSDistributedNotificationCenter defaultCenter] 
-            postNotificationName: GWThumbnailsDidChangeNotification
-                          object: nil 
-                        userInfo: info];
-      }
-  }   
+- (void)makeThumbnails:(NSString *)path
+{
+  [self makeThumbnails: path forRequester: nil];
 }
 
-- (NSString *)nextThumbName
+- (void)makeThumbnails:(NSString *)path
+          forRequester:(id)requester
 {
-  thumbref++;
-  if (thumbref >= (LONG_MAX - 1)) {
-    thumbref = 0;
+  NSValue *req = nil;
+  NSUInteger generation = 0;
+  struct stat st;
+  TMBJob *job;
+
+  if ((path == nil) || (stat([path fileSystemRepresentation], &st) != 0)
+                    || (S_ISDIR(st.st_mode) == 0)) {
+    return;
+  }
+
+  if (requester) {
+    [self cancelThumbnailsForRequester: requester];
+    req = [NSValue valueWithNonretainedObject: requester];
+  }
+
+  [jobsCondition lock];
+
+  if ([queuedPaths containsObject: path] == NO) {
+    if (req) {
+      generation = [[requesterGenerations objectForKey: req] unsignedIntegerValue];
+    }
+
+    job = [[TMBJob alloc] initWithPath: path
+                             requester: req
+                            generation: generation
+                                device: st.st_dev
+                             directory: YES];
+    [jobs addObject: job];
+    [queuedPaths addObject: path];
+    RELEASE (job);
+
+    [self startWorkers];
+    [jobsCondition broadcast];
   }
-  return [NSString stringWithFormat: @"%lx", thumbref];
+
+  [jobsCondition unlock];
 }
 
-- (void)_makeThumbnails:(NSString *)path
+/*
+ * The queued jobs of the requester go away, and the ones already
+ * taken by a worker are dropped by the generation they carry.
+ */
+- (void)cancelThumbnailsForRequester:(id)requester
 {
-  NSData *data;
-  NSMutableArray *added;
-  BOOL isdir;
+  NSValue *req;
+  NSUInteger generation;
   NSUInteger i;
-  NSAutoreleasePool *arp;
 
-  arp = [NSAutoreleasePool new];
-  NSDebugLLog(@"gwspace", @"_makeThumbnails (%u): %@", (int)countInstances, path);
-  added = [NSMutableArray array];
+  if (requester == nil) {
+    return;
+  }
 
-  if ([fm fileExistsAtPath: path isDirectory: &isdir] && isdir)
-    {
-      NSArray *contents = [fm directoryContentsAtPath: path];
-      
-      for (i = 0; i < [contents count]; i++)
-        {
-          NSString *fname = [contents objectAtIndex: i];
-          NSString *fullPath = [path stringByAppendingPathComponent: fname];
+  req = [NSValue valueWithNonretainedObject: requester];
 
-          if ([thumbsDict objectForKey: fullPath])
-            continue;
+  [jobsCondition lock];
 
-          id<TMBProtocol> tmb = [self thumbnailerForPath: fullPath];
-          
-          if (tmb)
-            {
-              data = [tmb makeThumbnailForPath: fullPath];
-              
-              if (data && [self registerThumbnailData: data 
-                                              forPath: fullPath
-                                        nameExtension: [tmb fileNameExtension]])
-                {
-                  [added addObject: fullPath];
-                }
-            }
-        }
-    }
-      
-    if ([added count]) {
-      NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
-      NSMutableDictionary *info = [NSMutableDictionary dictionary];
+  generation = [[requesterGenerations objectForKey: req] unsignedIntegerValue];
+  [requesterGenerations setObject: [NSNumber numberWithUnsignedInteger: generation + 1]
+                           forKey: req];
 
-      [defaults setObject: [NSNumber numberWithLong: thumbref] 
-                   forKey: @"thumbref"];
-      [defaults synchronize];
-	
-      [info setObject: added forKey: @"created"];	
+  i = [jobs count];
 
-      [self writeDictToFile];
+  while (i > 0) {
+    TMBJob *job = [jobs objectAtIndex: --i];
 
-      [[NSDistributedNotificationCenter defaultCenter] 
-	postNotificationName: GWThumbnailsDidChangeNotification
-	object: nil 
-	userInfo: info];
+    if ([[job requester] isEqual: req]) {
+      [queuedPaths removeObject: [job path]];
+      [jobs removeObjectAtIndex: i];
     }
-  [pathsInProcessing removeObject:path];
-  [arp drain];
+  }
+
+  [jobsCondition unlock];
 }
 
-- (void)makeThumbnails:(NSString *)path
+/*
+ * The ranks are rebuilt from the hints of all the views: a path one
+ * view shows is visible even if another one scrolls toward it.
+ */
+- (void)prioritizeVisiblePaths:(NSArray *)visible
+                    aheadPaths:(NSArray *)ahead
+                       forView:(id)view
 {
-  if ([pathsInProcessing containsObject:path])
+  NSValue *key;
+  NSNumber *rank;
+  NSArray *hints;
+  NSUInteger i, j;
+
+  if (view == nil) {
     return;
-  [pathsInProcessing addObject:path];
-  dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-    [self _makeThumbnails:path];
-  });
+  }
+
+  key = [NSValue valueWithNonretainedObject: view];
+
+  [jobsCondition lock];
+
+  if (visible || ahead) {
+    [viewHints setObject: [NSArray arrayWithObjects: 
+                                     (visible ? visible : [NSArray array]),
+                                     (ahead ? ahead : [NSArray array]), nil]
+                  forKey: key];
+  } else {
+    [viewHints removeObjectForKey: key];
+  }
+
+  [pathRanks removeAllObjects];
+  hints = [viewHints allValues];
+
+  rank = [NSNumber numberWithUnsignedInteger: RANK_AHEAD];
+  for (i = 0; i < [hints count]; i++) {
+    NSArray *paths = [[hints objectAtIndex: i] objectAtIndex: 1];
+
+    for (j = 0; j < [paths count]; j++) {
+      [pathRanks setObject: rank forKey: [paths objectAtIndex: j]];
+    }
+  }
+
+  rank = [NSNumber numberWithUnsignedInteger: RANK_VISIBLE];
+  for (i = 0; i < [hints count]; i++) {
+    NSArray *paths = [[hints objectAtIndex: i] objectAtIndex: 0];
+
+    for (j = 0; j < [paths count]; j++) {
+      [pathRanks setObject: rank forKey: [paths objectAtIndex: j]];
+    }
+  }
+
+  [jobsCondition unlock];
 }
 
 - (void)_removeThumbnails:(NSString *)path
@@ -407,7 +742,9 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
   arp = [NSAutoreleasePool new];
 
   
-    if ((thumbsDict == nil) || ([thumbsDict count] == 0)) {
+    if ([store count] == 0) {
+      [pathsInProcessing removeObject: path];
+      [arp drain];
       return;
     }
     
@@ -440,7 +777,7 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
       
       [info setObject: deleted forKey: @"deleted"];	
 
-      [self writeDictToFile];
+      [store synchronize];
       
       [[NSDistributedNotificationCenter defaultCenter] 
             postNotificationName: GWThumbnailsDidChangeNotification
@@ -463,57 +800,121 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
   });
 }
 
-- (BOOL)registerThumbnailData:(NSData *)data 
-                      forPath:(NSString *)path
-                nameExtension:(NSString *)ext
+- (void)setPathWatcher:(id)watcher
 {
-  if (data && [data length]) {
-    NSString *tname;
-    NSString *tpath;
+  NSUInteger i;
 
-    tname = [self nextThumbName];    
-    tname = [tname stringByAppendingPathExtension: ext];
-    tpath = [thumbnailDir stringByAppendingPathComponent: tname];
-    
-    if ([data writeToFile: tpath atomically: YES]) {
-      if ([[thumbsDict allKeys] containsObject: path]) {
-        NSString *oldtname = [thumbsDict objectForKey: path];
-        NSString *oldtpath = [thumbnailDir stringByAppendingPathComponent: oldtname];
-        
-        if ([fm fileExistsAtPath: oldtpath]) {
-          [fm removeFileAtPath: oldtpath handler: nil];
-        }
-      }
-    
-      [thumbsDict setObject: tname forKey: path];
-      return YES;
-    } else {
-      return NO;
+  if (pathWatcher) {
+    for (i = 0; i < [watchedFolders count]; i++) {
+      [pathWatcher removeWatcherForPath: [watchedFolders objectAtIndex: i]];
+    }
+  }
+
+  pathWatcher = watcher;
+
+  if (pathWatcher) {
+    for (i = 0; i < [watchedFolders count]; i++) {
+      [pathWatcher addWatcherForPath: [watchedFolders objectAtIndex: i]];
     }
   }
-  
-  return NO;
 }
 
-- (BOOL)removeThumbnailForPath:(NSString *)path
+/*
+ * The thumbnail of a file is keyed by its inode and modification time,
+ * so the one of a file written again is no longer found: here it is
+ * made again, with no sweep of the store.  The thumbnails of the files
+ * deleted go as -validateThumbnails: gets to them.
+ */
+- (void)watchedPathDidChange:(NSDictionary *)info
 {
-  NSArray *keys = RETAIN ([thumbsDict allKeys]);
+  NSString *event = [info objectForKey: @"event"];
+  NSString *path = [info objectForKey: @"path"];
+  NSArray *files = [info objectForKey: @"files"];
+  NSUInteger i;
+
+  if (path == nil) {
+    return;
+  }
 
-  if ([keys containsObject: path]) {
-    NSString *tname = [thumbsDict objectForKey: path];
-    NSString *tpath = [thumbnailDir stringByAppendingPathComponent: tname];
+  if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]
+        || [event isEqual: @"GWFileModifiedInWatchedDirectory"]) {
+    [self makeThumbnailsForFiles: files inDirectory: path];
 
-    if ([fm fileExistsAtPath: tpath]) {
-      [fm removeFileAtPath: tpath handler: nil];
+  } else if ([event isEqual: @"GWWatchedFileModified"]) {
+    [self remakeThumbnailsForPaths: [NSArray arrayWithObject: path]];
+
+  } else if ([event isEqual: @"GWFileDeletedInWatchedDirectory"]) {
+    [deletionFolders addObject: path];
+    for (i = 0; i < [files count]; i++) {
+      NSString *fpath = [path stringByAppendingPathComponent: 
+                                            [files objectAtIndex: i]];
+      [remakeTimes removeObjectForKey: fpath];
+      [deferredRemakes removeObject: fpath];
+    }
+
+  } else if ([event isEqual: @"GWWatchedPathDeleted"]) {
+    if ([watchedFolders containsObject: path]) {
+      [pathWatcher removeWatcherForPath: path];
+      [watchedFolders removeObject: path];
     }
-    [thumbsDict removeObjectForKey: path];
-    RELEASE (keys);
-    return YES;
   }
+}
 
-  RELEASE (keys);
-  return NO;
-}          
+- (void)makeThumbnailsForFiles:(NSArray *)names
+                   inDirectory:(NSString *)dir
+{
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity: [names count]];
+  NSUInteger i;
+
+  for (i = 0; i < [names count]; i++) {
+    [paths addObject: [dir stringByAppendingPathComponent: [names objectAtIndex: i]]];
+  }
+
+  [self remakeThumbnailsForPaths: paths];
+}
+
+/* not in queuedPaths: the work does not stand for the thumbnail of
+   the path, nor the other way round */
+- (void)scheduleWork:(void (^)(void))work
+             forPath:(NSString *)path
+{
+  struct stat st;
+  TMBJob *job;
+
+  if ((work == nil) || (path == nil)) {
+    return;
+  }
+  if (stat([path fileSystemRepresentation], &st) != 0) {
+    st.st_dev = 0;
+  }
+
+  job = [[TMBJob alloc] initWithPath: path
+                           requester: nil
+                          generation: 0
+                              device: st.st_dev
+                           directory: NO];
+  [job setWork: work];
+
+  [jobsCondition lock];
+  [jobs addObject: job];
+  [self startWorkers];
+  [jobsCondition broadcast];
+  [jobsCondition unlock];
+
+  RELEASE (job);
+}
+
+- (BOOL)registerThumbnailData:(NSData *)data 
+                      forPath:(NSString *)path
+{
+  /* the store takes the workers one at a time */
+  return (data && [data length] && [store setThumbnailData: data forPath: path]);
+}
+
+- (BOOL)removeThumbnailForPath:(NSString *)path
+{
+  return [store removeThumbnailForPath: path];
+}
 
 - (NSArray *)bundlesWithExtension:(NSString *)extension 
 		      inDirectory:(NSString *)dirpath
@@ -542,3 +943,453 @@ static NSString *GWThumbnailsDidChangeNotification = @"GWThumbnailsDidChangeNoti
 
 @end
 
+
+@implementation Thumbnailer (Scheduler)
+
+/* called with jobsCondition locked */
+- (void)startWorkers
+{
+  if (workersStarted == NO) {
+    NSUInteger i;
+
+    workersStarted = YES;
+
+    for (i = 0; i < workersCount; i++) {
+      [NSThread detachNewThreadSelector: @selector(thumbnailWorker:)
+                               toTarget: self
+                             withObject: nil];
+    }
+  }
+}
+
+- (void)thumbnailWorker:(id)sender
+{
+  while (1) {
+    CREATE_AUTORELEASE_POOL(arp);
+    NSArray *created = nil;
+    NSNumber *devkey;
+    TMBJob *job;
+    BOOL cancelled;
+    BOOL background;
+
+    [jobsCondition lock];
+
+    while ((job = [self nextJob]) == nil) {
+      [jobsCondition wait];
+    }
+
+    RETAIN (job);
+    [jobs removeObjectIdenticalTo: job];
+    cancelled = [self isCancelledJob: job];
+    background = ([self rankOfJob: job] == RANK_BACKGROUND);
+
+    devkey = [NSNumber numberWithUnsignedLongLong: (unsigned long long)[job device]];
+    [runningByDevice setObject: [NSNumber numberWithUnsignedInteger: 
+                [[runningByDevice objectForKey: devkey] unsignedIntegerValue] + 1]
+                        forKey: devkey];
+    runningJobs++;
+
+    [jobsCondition unlock];
+
+    [NSThread setThreadPriority: (background ? BACKGROUND_PRIORITY : FRONT_PRIORITY)];
+
+    if (cancelled == NO) {
+      if ([job work]) {
+        [job work]();
+      } else if ([job isDirectory]) {
+        [self listDirectoryJob: job];
+      } else if ([self makeThumbnailForJob: job]) {
+        [jobsCondition lock];
+        [createdPaths addObject: [job path]];
+        [jobsCondition unlock];
+      }
+    }
+
+    [jobsCondition lock];
+
+    [runningByDevice setObject: [NSNumber numberWithUnsignedInteger: 
+                [[runningByDevice objectForKey: devkey] unsignedIntegerValue] - 1]
+                        forKey: devkey];
+    runningJobs--;
+    if ([job work] == nil) {
+      [queuedPaths removeObject: [job path]];
+    }
+
+    if ([createdPaths count] 
+          && (([createdPaths count] >= CREATED_BATCH) 
+                || (([jobs count] == 0) && (runningJobs == 0)))) {
+      created = [createdPaths copy];
+      [createdPaths removeAllObjects];
+    }
+
+    /* a worker may wait for the device this job had */
+    [jobsCondition broadcast];
+    [jobsCondition unlock];
+
+    if (created) {
+      [self thumbnailsCreated: created];
+      RELEASE (created);
+    }
+
+    RELEASE (job);
+    RELEASE (arp);
+  }
+}
+
+/*
+ * The queued job of the lowest rank whose disk has room for one more:
+ * a disk that seeks or a network volume takes a job at a time, so the
+ * workers don't fight over it.  With the same rank, the one queued
+ * first.  Called with jobsCondition locked.
+ */
+- (TMBJob *)nextJob
+{
+  TMBJob *best = nil;
+  NSUInteger bestRank = RANK_BACKGROUND;
+  BOOL ranked = ([pathRanks count] != 0);
+  NSUInteger i;
+
+  for (i = 0; i < [jobs count]; i++) {
+    TMBJob *job = [jobs objectAtIndex: i];
+    dev_t dev = [job device];
+    NSNumber *devkey = [NSNumber numberWithUnsignedLongLong: (unsigned long long)dev];
+    NSUInteger running = [[runningByDevice objectForKey: devkey] unsignedIntegerValue];
+
+    if (running < [self jobsLimitForDevice: dev]) {
+      NSUInteger rank = [self rankOfJob: job];
+
+      if ((best == nil) || (rank < bestRank)) {
+        best = job;
+        bestRank = rank;
+      }
+      if ((ranked == NO) || (bestRank == RANK_VISIBLE)) {
+        break;
+      }
+    }
+  }
+
+  return best;
+}
+
+/*
+ * A directory is listed first, its files get their jobs from it.
+ * Called with jobsCondition locked.
+ */
+- (NSUInteger)rankOfJob:(TMBJob *)job
+{
+  NSNumber *rank;
+
+  if ([job isDirectory]) {
+    return RANK_VISIBLE;
+  }
+
+  rank = [pathRanks objectForKey: [job path]];
+
+  return rank ? [rank unsignedIntegerValue] : RANK_BACKGROUND;
+}
+
+/* called with jobsCondition locked */
+- (BOOL)isCancelledJob:(TMBJob *)job
+{
+  NSValue *req = [job requester];
+
+  if (req) {
+    return ([[requesterGenerations objectForKey: req] unsignedIntegerValue] 
+                                                      != [job generation]);
+  }
+
+  return NO;
+}
+
+- (NSUInteger)jobsLimitForDevice:(dev_t)dev
+{
+  NSNumber *devkey = [NSNumber numberWithUnsignedLongLong: (unsigned long long)dev];
+  NSNumber *limit = [deviceLimits objectForKey: devkey];
+
+  if (limit == nil) {
+    FSNMountEntry *entry = [[FSNMountTable sharedTable] entryForDevice: dev];
+
+    if ((entry && [entry isNetwork]) || isRotationalDevice(dev)) {
+      limit = [NSNumber numberWithUnsignedInteger: 1];
+    } else {
+      limit = [NSNumber numberWithUnsignedInteger: workersCount];
+    }
+
+    [deviceLimits setObject: limit forKey: devkey];
+  }
+
+  return [limit unsignedIntegerValue];
+}
+
+/* a job for each file of the directory that can have a thumbnail */
+- (void)listDirectoryJob:(TMBJob *)job
+{
+  NSFileManager *wfm = [NSFileManager new];
+  NSString *path = [job path];
+  NSArray *contents = [wfm directoryContentsAtPath: path];
+  NSMutableArray *newjobs = [NSMutableArray array];
+  NSUInteger i;
+
+  for (i = 0; i < [contents count]; i++) {
+    NSString *fullPath = [path stringByAppendingPathComponent: 
+                                              [contents objectAtIndex: i]];
+    if (([store hasThumbnailForPath: fullPath] == NO) 
+                      && [self thumbnailerForPath: fullPath]) {
+      TMBJob *fjob = [[TMBJob alloc] initWithPath: fullPath
+                                        requester: [job requester]
+                                       generation: [job generation]
+                                           device: [job device]
+                                        directory: NO];
+      [newjobs addObject: fjob];
+      RELEASE (fjob);
+    }
+  }
+
+  RELEASE (wfm);
+
+  [jobsCondition lock];
+
+  if ([self isCancelledJob: job] == NO) {
+    for (i = 0; i < [newjobs count]; i++) {
+      TMBJob *fjob = [newjobs objectAtIndex: i];
+
+      if ([queuedPaths containsObject: [fjob path]] == NO) {
+        [jobs addObject: fjob];
+        [queuedPaths addObject: [fjob path]];
+      }
+    }
+    [jobsCondition broadcast];
+  }
+
+  [jobsCondition unlock];
+
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self watchFolder: path];
+  });
+}
+
+/* another file manager may have made it already */
+- (BOOL)makeThumbnailForJob:(TMBJob *)job
+{
+  NSString *path = [job path];
+  NSData *data = [xdgThumbnails thumbnailForPath: path];
+  id<TMBProtocol> tmb;
+
+  if (data) {
+    return [self registerThumbnailData: data forPath: path];
+  }
+
+  tmb = [self thumbnailerForPath: path];
+
+  if (tmb) {
+    data = [tmb makeThumbnailForPath: path];
+
+    if (data && [self registerThumbnailData: data forPath: path]) {
+      [xdgThumbnails writeThumbnail: data forPath: path];
+      return YES;
+    }
+  }
+
+  return NO;
+}
+
+- (void)thumbnailsCreated:(NSArray *)paths
+{
+  NSMutableDictionary *info = [NSMutableDictionary dictionary];
+
+  [info setObject: paths forKey: @"created"];	
+
+  [store synchronize];
+  [self checkThumbnails: nil];
+
+  [[NSDistributedNotificationCenter defaultCenter] 
+            postNotificationName: GWThumbnailsDidChangeNotification
+                          object: nil 
+                        userInfo: info];
+}
+
+/* a folder listed again moves to the end, the oldest is let go */
+- (void)watchFolder:(NSString *)path
+{
+  NSUInteger index = [watchedFolders indexOfObject: path];
+
+  if (index != NSNotFound) {
+    RETAIN (path);
+    [watchedFolders removeObjectAtIndex: index];
+    [watchedFolders addObject: path];
+    RELEASE (path);
+    return;
+  }
+
+  if ([watchedFolders count] >= MAX_WATCHED_FOLDERS) {
+    [pathWatcher removeWatcherForPath: [watchedFolders objectAtIndex: 0]];
+    [watchedFolders removeObjectAtIndex: 0];
+  }
+
+  [watchedFolders addObject: path];
+  [pathWatcher addWatcherForPath: path];
+}
+
+/*
+ * A file whose current version has no thumbnail gets a job, unless it
+ * had one less than REMAKE_INTERVAL ago: then it waits for the end of
+ * the interval, and its stale thumbnail is dropped from the views
+ * meanwhile.  An empty file is left for the write that fills it, as a
+ * file being copied in is created empty.  Main thread only.
+ */
+- (void)remakeThumbnailsForPaths:(NSArray *)paths
+{
+  NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+  NSMutableArray *deferred = [NSMutableArray array];
+  NSMutableArray *fjobs = [NSMutableArray array];
+  NSTimeInterval wait = 0.0;
+  NSUInteger i;
+
+  for (i = 0; i < [paths count]; i++) {
+    NSString *path = [paths objectAtIndex: i];
+    NSNumber *last;
+    struct stat st;
+    TMBJob *job;
+
+    if (([self thumbnailerForPath: path] == nil)
+          || (stat([path fileSystemRepresentation], &st) != 0) 
+          || S_ISDIR(st.st_mode) || (st.st_size == 0)
+          || [store hasThumbnailForPath: path]) {
+      continue;
+    }
+
+    last = [remakeTimes objectForKey: path];
+
+    if (last && ((now - [last doubleValue]) < REMAKE_INTERVAL)) {
+      if ([deferredRemakes containsObject: path] == NO) {
+        [deferredRemakes addObject: path];
+        [deferred addObject: path];
+        wait = MAX(wait, REMAKE_INTERVAL - (now - [last doubleValue]));
+      }
+      continue;
+    }
+
+    [remakeTimes setObject: [NSNumber numberWithDouble: now] forKey: path];
+
+    job = [[TMBJob alloc] initWithPath: path
+                             requester: nil
+                            generation: 0
+                                device: st.st_dev
+                             directory: NO];
+    [fjobs addObject: job];
+    RELEASE (job);
+  }
+
+  [self queueFileJobs: fjobs];
+
+  /* the times older than the interval say nothing any more */
+  if ([remakeTimes count] > (4 * MAX_WATCHED_FOLDERS)) {
+    NSArray *keys = [remakeTimes allKeys];
+
+    for (i = 0; i < [keys count]; i++) {
+      NSString *key = [keys objectAtIndex: i];
+
+      if ((now - [[remakeTimes objectForKey: key] doubleValue]) >= REMAKE_INTERVAL) {
+        [remakeTimes removeObjectForKey: key];
+      }
+    }
+  }
+
+  if ([deferred count]) {
+    NSDictionary *info = [NSDictionary dictionaryWithObject: deferred
+                                                     forKey: @"deleted"];
+
+    [[NSDistributedNotificationCenter defaultCenter] 
+            postNotificationName: GWThumbnailsDidChangeNotification
+                          object: nil 
+                        userInfo: info];
+
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)),
+                   dispatch_get_main_queue(), ^{
+      [self remakeDeferredThumbnails];
+    });
+  }
+}
+
+/* the jobs of a batch of files go in under one lock, with one wakeup */
+- (void)queueFileJobs:(NSArray *)fjobs
+{
+  NSUInteger i;
+
+  if ([fjobs count] == 0) {
+    return;
+  }
+
+  [jobsCondition lock];
+
+  for (i = 0; i < [fjobs count]; i++) {
+    TMBJob *fjob = [fjobs objectAtIndex: i];
+
+    if ([queuedPaths containsObject: [fjob path]] == NO) {
+      [jobs addObject: fjob];
+      [queuedPaths addObject: [fjob path]];
+    }
+  }
+
+  [self startWorkers];
+  [jobsCondition broadcast];
+  [jobsCondition unlock];
+}
+
+- (void)remakeDeferredThumbnails
+{
+  NSArray *paths = [deferredRemakes allObjects];
+
+  [deferredRemakes removeAllObjects];
+  [self remakeThumbnailsForPaths: paths];
+}
+
+/* each thumbnail file goes into the store and away, then the plist */
+- (void)importLegacyThumbnails
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSFileManager *wfm = [NSFileManager new];
+  NSString *dictPath = [thumbnailDir stringByAppendingPathComponent: @"thumbnails.plist"];
+  NSDictionary *dict = [NSDictionary dictionaryWithContentsOfFile: dictPath];
+  NSArray *paths = [dict allKeys];
+  NSUInteger i;
+
+  for (i = 0; i < [paths count]; i++) {
+    CREATE_AUTORELEASE_POOL(arp1);
+    NSString *path = [paths objectAtIndex: i];
+    id tname = [dict objectForKey: path];
+
+    if ([tname isKindOfClass: [NSString class]]) {
+      NSString *tpath = [thumbnailDir stringByAppendingPathComponent: tname];
+      NSData *data = [NSData dataWithContentsOfFile: tpath];
+
+      if (data && ([store hasThumbnailForPath: path] == NO)) {
+        [store setThumbnailData: data forPath: path];
+      }
+      [wfm removeFileAtPath: tpath handler: nil];
+    }
+
+    RELEASE (arp1);
+  }
+
+  [store synchronize];
+  [wfm removeFileAtPath: dictPath handler: nil];
+  [[NSUserDefaults standardUserDefaults] removeObjectForKey: @"thumbref"];
+  RELEASE (wfm);
+
+  if ([paths count]) {
+    NSDictionary *info = [NSDictionary dictionaryWithObject: paths 
+                                                     forKey: @"created"];
+
+    dispatch_async(dispatch_get_main_queue(), ^{
+      [[NSDistributedNotificationCenter defaultCenter] 
+            postNotificationName: GWThumbnailsDidChangeNotification
+                          object: nil 
+                        userInfo: info];
+    });
+  }
+
+  RELEASE (arp);
+}
+
+@end
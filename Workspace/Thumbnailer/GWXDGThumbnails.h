@@ -0,0 +1,42 @@
+/* GWXDGThumbnails.h
+ *
+ * The thumbnail cache of the freedesktop.org Thumbnail Managing
+ * Standard, ~/.cache/thumbnails (or $XDG_CACHE_HOME/thumbnails), used
+ * as a second storage of the thumbnailer: the PNGs other file managers
+ * left there are taken instead of making them again, and the
+ * thumbnails made here are written back for them.
+ *
+ * A thumbnail is named by the MD5 of the file URI and is valid while
+ * its Thumb::URI and Thumb::MTime text chunks match the file.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#ifndef GW_XDG_THUMBNAILS_H
+#define GW_XDG_THUMBNAILS_H
+
+#import <Foundation/Foundation.h>
+
+@interface GWXDGThumbnails : NSObject
+{
+  NSString *cacheDir;
+  BOOL writesBack;
+}
+
+/* The file URI the standard names the thumbnails by. */
++ (NSString *)URIForPath:(NSString *)path;
+
+/* The PNG bytes of a valid thumbnail of the file, the normal size first,
+ * or nil. */
+- (NSData *)thumbnailForPath:(NSString *)path;
+
+/* Stores the thumbnail (any format NSBitmapImageRep reads, no larger
+ * than the normal size) as a PNG in the normal directory, with the text
+ * chunks the standard wants.  Does
+ * nothing when the "XDGThumbnailsWriteBack" default is NO. */
+- (BOOL)writeThumbnail:(NSData *)data
+               forPath:(NSString *)path;
+
+@end
+
+#endif /* GW_XDG_THUMBNAILS_H */
@@ -0,0 +1,373 @@
+/* GWXDGThumbnails.m
+ *
+ * The freedesktop.org thumbnail cache as a second thumbnail storage.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#import <GNUstepBase/NSData+GNUstepBase.h>
+#import "GWXDGThumbnails.h"
+
+/* the largest side of a normal thumbnail */
+#define XDG_NORMAL_SIZE 128
+
+static const uint8_t pngSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+/* filled in +initialize, before any worker writes a PNG */
+static uint32_t crcTable[256];
+
+static inline uint32_t
+readBE32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) 
+                           | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void
+writeBE32(uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+/* the CRC of the PNG chunks, over their type and data */
+static uint32_t
+pngCRC(const uint8_t *buf, size_t len)
+{
+  uint32_t crc = 0xffffffff;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    crc = crcTable[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+  }
+
+  return crc ^ 0xffffffff;
+}
+
+/* The text of the tEXt chunk named `key`, or nil. */
+static NSString *
+pngTextValue(NSData *png, const char *key)
+{
+  const uint8_t *bytes = [png bytes];
+  NSUInteger length = [png length];
+  size_t keylen = strlen(key);
+  NSUInteger pos = sizeof(pngSignature);
+
+  if ((length < pos) || (memcmp(bytes, pngSignature, pos) != 0)) {
+    return nil;
+  }
+
+  while (pos + 12 <= length) {
+    uint32_t clen = readBE32(bytes + pos);
+    const uint8_t *type = bytes + pos + 4;
+    const uint8_t *cdata = bytes + pos + 8;
+
+    if ((clen > length) || (pos + 12 + clen > length)) {
+      break;
+    }
+    if (memcmp(type, "IEND", 4) == 0) {
+      break;
+    }
+
+    if ((memcmp(type, "tEXt", 4) == 0) && (clen > keylen)
+              && (memcmp(cdata, key, keylen) == 0) && (cdata[keylen] == 0)) {
+      return AUTORELEASE ([[NSString alloc] initWithBytes: cdata + keylen + 1
+                                                   length: clen - keylen - 1
+                                                 encoding: NSISOLatin1StringEncoding]);
+    }
+
+    pos += 12 + clen;
+  }
+
+  return nil;
+}
+
+static void
+appendTextChunk(NSMutableData *png, NSString *key, NSString *value)
+{
+  NSData *kdata = [key dataUsingEncoding: NSISOLatin1StringEncoding];
+  NSData *vdata = [value dataUsingEncoding: NSISOLatin1StringEncoding 
+                      allowLossyConversion: YES];
+  NSUInteger clen = [kdata length] + 1 + [vdata length];
+  NSMutableData *chunk = [NSMutableData dataWithLength: 8 + clen + 4];
+  uint8_t *p = [chunk mutableBytes];
+
+  writeBE32(p, (uint32_t)clen);
+  memcpy(p + 4, "tEXt", 4);
+  memcpy(p + 8, [kdata bytes], [kdata length]);
+  p[8 + [kdata length]] = 0;
+  memcpy(p + 9 + [kdata length], [vdata bytes], [vdata length]);
+  writeBE32(p + 8 + clen, pngCRC(p + 4, 4 + clen));
+
+  [png appendData: chunk];
+}
+
+/* The PNG with the text chunks after its header chunk, or nil when it
+   is not one. */
+static NSData *
+pngWithTexts(NSData *png, NSDictionary *texts)
+{
+  const uint8_t *bytes = [png bytes];
+  NSUInteger length = [png length];
+  NSUInteger ihdrEnd;
+  NSMutableData *result;
+  NSEnumerator *enumerator;
+  NSString *key;
+
+  if ((length < sizeof(pngSignature) + 12) 
+            || (memcmp(bytes, pngSignature, sizeof(pngSignature)) != 0)
+            || (memcmp(bytes + sizeof(pngSignature) + 4, "IHDR", 4) != 0)) {
+    return nil;
+  }
+
+  ihdrEnd = sizeof(pngSignature) + 12 + readBE32(bytes + sizeof(pngSignature));
+  if (ihdrEnd > length) {
+    return nil;
+  }
+
+  result = [NSMutableData dataWithCapacity: length + 512];
+  [result appendBytes: bytes length: ihdrEnd];
+
+  enumerator = [texts keyEnumerator];
+  while ((key = [enumerator nextObject])) {
+    appendTextChunk(result, key, [texts objectForKey: key]);
+  }
+
+  [result appendBytes: bytes + ihdrEnd length: length - ihdrEnd];
+
+  return result;
+}
+
+static NSString *
+hexString(NSData *data)
+{
+  static const char digits[] = "0123456789abcdef";
+  const uint8_t *bytes = [data bytes];
+  NSUInteger length = [data length];
+  char buf[65];
+  NSUInteger i;
+
+  length = (length > 32) ? 32 : length;
+
+  for (i = 0; i < length; i++) {
+    buf[i * 2] = digits[bytes[i] >> 4];
+    buf[i * 2 + 1] = digits[bytes[i] & 0x0f];
+  }
+  buf[length * 2] = 0;
+
+  return [NSString stringWithUTF8String: buf];
+}
+
+
+@implementation GWXDGThumbnails
+
++ (void)initialize
+{
+  if (self == [GWXDGThumbnails class]) {
+    uint32_t n;
+
+    for (n = 0; n < 256; n++) {
+      uint32_t c = n;
+      int k;
+
+      for (k = 0; k < 8; k++) {
+        c = (c & 1) ? (0xedb88320 ^ (c >> 1)) : (c >> 1);
+      }
+      crcTable[n] = c;
+    }
+  }
+}
+
+- (void)dealloc
+{
+  RELEASE (cacheDir);
+  [super dealloc];
+}
+
+- (id)init
+{
+  self = [super init];
+
+  if (self) {
+    NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+    NSString *base = [[[NSProcessInfo processInfo] environment] 
+                                          objectForKey: @"XDG_CACHE_HOME"];
+    id entry;
+
+    /* the standard ignores a relative XDG_CACHE_HOME */
+    if ((base == nil) || ([base isAbsolutePath] == NO)) {
+      base = [NSHomeDirectory() stringByAppendingPathComponent: @".cache"];
+    }
+    ASSIGN (cacheDir, [base stringByAppendingPathComponent: @"thumbnails"]);
+
+    entry = [defaults objectForKey: @"XDGThumbnailsWriteBack"];
+    writesBack = entry ? [defaults boolForKey: @"XDGThumbnailsWriteBack"] : YES;
+  }
+
+  return self;
+}
+
+/* file:// and the path escaped as GLib escapes it, so the MD5 names
+   are the ones the other file managers use */
++ (NSString *)URIForPath:(NSString *)path
+{
+  static const char *allowed = "!$&'()*+,-./:=@_~";
+  const char *fspath = [path fileSystemRepresentation];
+  NSMutableString *uri = [NSMutableString stringWithString: @"file://"];
+  const unsigned char *p;
+
+  for (p = (const unsigned char *)fspath; *p; p++) {
+    if (((*p >= 'a') && (*p <= 'z')) || ((*p >= 'A') && (*p <= 'Z'))
+            || ((*p >= '0') && (*p <= '9')) || strchr(allowed, *p)) {
+      [uri appendFormat: @"%c", *p];
+    } else {
+      [uri appendFormat: @"%%%02X", *p];
+    }
+  }
+
+  return uri;
+}
+
+- (NSString *)thumbnailNameForURI:(NSString *)uri
+{
+  NSData *digest = [[uri dataUsingEncoding: NSUTF8StringEncoding] md5Digest];
+
+  return [hexString(digest) stringByAppendingPathExtension: @"png"];
+}
+
+- (NSData *)thumbnailForPath:(NSString *)path
+{
+  static NSString *sizes[] = { @"normal", @"large" };
+  NSString *uri;
+  NSString *name;
+  struct stat st;
+  unsigned i;
+
+  if (stat([path fileSystemRepresentation], &st) != 0) {
+    return nil;
+  }
+
+  uri = [GWXDGThumbnails URIForPath: path];
+  name = [self thumbnailNameForURI: uri];
+
+  for (i = 0; i < 2; i++) {
+    NSString *tpath = [[cacheDir stringByAppendingPathComponent: sizes[i]] 
+                                     stringByAppendingPathComponent: name];
+    NSData *data = [NSData dataWithContentsOfFile: tpath];
+
+    if (data) {
+      NSString *mtime = pngTextValue(data, "Thumb::MTime");
+      NSString *turi = pngTextValue(data, "Thumb::URI");
+
+      if (mtime && ([mtime longLongValue] == (long long)st.st_mtime)
+                && ((turi == nil) || [turi isEqual: uri])) {
+        return data;
+      }
+    }
+  }
+
+  return nil;
+}
+
+- (BOOL)writeThumbnail:(NSData *)data
+               forPath:(NSString *)path
+{
+  NSBitmapImageRep *rep;
+  NSMutableDictionary *texts;
+  NSString *uri;
+  NSString *dir;
+  NSString *tpath;
+  NSData *png;
+  struct stat st;
+  char *tmpl;
+  int fd;
+  BOOL done = NO;
+
+  if ((writesBack == NO) || (data == nil) 
+                  || (stat([path fileSystemRepresentation], &st) != 0)) {
+    return NO;
+  }
+
+  rep = [NSBitmapImageRep imageRepWithData: data];
+  if ((rep == nil) || ([rep pixelsWide] > XDG_NORMAL_SIZE) 
+                   || ([rep pixelsHigh] > XDG_NORMAL_SIZE)) {
+    return NO;
+  }
+
+  png = [rep representationUsingType: NSPNGFileType properties: nil];
+  if (png == nil) {
+    return NO;
+  }
+
+  uri = [GWXDGThumbnails URIForPath: path];
+
+  texts = [NSMutableDictionary dictionary];
+  [texts setObject: uri forKey: @"Thumb::URI"];
+  [texts setObject: [NSString stringWithFormat: @"%lld", (long long)st.st_mtime] 
+            forKey: @"Thumb::MTime"];
+  [texts setObject: [NSString stringWithFormat: @"%lld", (long long)st.st_size] 
+            forKey: @"Thumb::Size"];
+  [texts setObject: @"GWorkspace" forKey: @"Software"];
+
+  png = pngWithTexts(png, texts);
+  if (png == nil) {
+    return NO;
+  }
+
+  /* the standard wants the directories private to the user */
+  dir = [cacheDir stringByAppendingPathComponent: @"normal"];
+  mkdir([cacheDir fileSystemRepresentation], 0700);
+  mkdir([dir fileSystemRepresentation], 0700);
+
+  tpath = [dir stringByAppendingPathComponent: [self thumbnailNameForURI: uri]];
+
+  /* written aside and renamed, so a reader never sees half of it */
+  tmpl = strdup([[tpath stringByAppendingString: @".XXXXXX"] fileSystemRepresentation]);
+  if (tmpl == NULL) {
+    return NO;
+  }
+
+  fd = mkstemp(tmpl);
+
+  if (fd >= 0) {
+    const uint8_t *bytes = [png bytes];
+    NSUInteger left = [png length];
+
+    fchmod(fd, 0600);
+
+    while (left > 0) {
+      ssize_t n = write(fd, bytes, left);
+
+      if (n <= 0) {
+        break;
+      }
+      bytes += n;
+      left -= n;
+    }
+
+    close(fd);
+
+    done = ((left == 0) && (rename(tmpl, [tpath fileSystemRepresentation]) == 0));
+    if (done == NO) {
+      unlink(tmpl);
+    }
+  }
+
+  free(tmpl);
+
+  return done;
+}
+
+@end
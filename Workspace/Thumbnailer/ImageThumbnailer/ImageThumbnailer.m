@@ -26,9 +26,50 @@
 #import <Foundation/Foundation.h>
 #import <AppKit/AppKit.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
 #import "ImageThumbnailer.h"
+#import "FSNRaster.h"
+#import "FSNImageDecode.h"
+
+/* How much of a JPEG is read looking for the EXIF block (an APP1
+ * segment is at most 64K) and the frame header that follows it. */
+#define JPEG_HEAD_LEN (128 * 1024)
+
+/* The embedded thumbnail must keep the aspect of the image within this,
+ * or it is letterboxed or cropped and the image is decoded instead. */
+#define EXIF_ASPECT_TOLERANCE 0.02
+
+static inline unsigned readU16(const unsigned char *p, BOOL big)
+{
+  return big ? ((p[0] << 8) | p[1]) : ((p[1] << 8) | p[0]);
+}
+
+static inline unsigned long readU32(const unsigned char *p, BOOL big)
+{
+  return big ? (((unsigned long)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3])
+             : (((unsigned long)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
+}
+
+static BOOL isJPEGPath(NSString *path)
+{
+  NSString *ext = [[path pathExtension] lowercaseString];
+
+  return ([ext isEqual: @"jpg"] || [ext isEqual: @"jpeg"]
+          || [ext isEqual: @"jpe"] || [ext isEqual: @"jfif"]);
+}
+
+
+@interface ImageThumbnailer (Private)
+
+- (NSData *)thumbnailOfBitmap:(NSBitmapImageRep *)srcRep;
+
+- (NSData *)exifThumbnailOfJPEGAtPath:(NSString *)path;
+
+- (NSData *)scaledThumbnailOfJPEGAtPath:(NSString *)path;
+
+@end
 
-#define MIX_LIM 16
 
 @implementation ImageThumbnailer
 
@@ -46,14 +87,31 @@
 - (NSData *)makeThumbnailForPath:(NSString *)path
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSImage *image = [[NSImage alloc] initWithContentsOfFile: path];
+  NSData *data = nil;
+  NSImage *image;
+
+  /* A JPEG costs neither a full decode nor its memory: the camera's
+   * embedded thumbnail is taken when it is large enough, else libjpeg
+   * decodes at the smallest DCT scale that still covers the thumbnail. */
+  if (isJPEGPath(path))
+    {
+      data = [self exifThumbnailOfJPEGAtPath: path];
+      if (data == nil)
+        data = [self scaledThumbnailOfJPEGAtPath: path];
+      if (data)
+        {
+          RETAIN (data);
+          RELEASE (arp);
+          return AUTORELEASE (data);
+        }
+    }
+
+  image = [[NSImage alloc] initWithContentsOfFile: path];
 
   if (image && [image isValid])
     {
-      NSData *tiffData;
       NSEnumerator *repEnum;
       NSBitmapImageRep *srcRep;
-      NSInteger srcSpp;
       NSImageRep *imgRep;
  
       repEnum = [[image representations] objectEnumerator];
@@ -64,132 +122,11 @@
           if ([imgRep isKindOfClass:[NSBitmapImageRep class]])
             srcRep = (NSBitmapImageRep *)imgRep;
         }
-      if (nil == srcRep)
-        return nil;
-      
-      srcSpp = [srcRep samplesPerPixel];
-    
-      if (([srcRep pixelsWide] <= TMBMAX) && ([srcRep pixelsHigh]<= TMBMAX) 
-                              && ([srcRep pixelsWide] >= (TMBMAX - RESZLIM)) 
-                                      && ([srcRep pixelsHigh] >= (TMBMAX - RESZLIM)))
+      if (srcRep)
         {
-          tiffData = [srcRep TIFFRepresentation];
-          RETAIN (tiffData);
-          RELEASE (image);
-          RELEASE (arp);
-
-          return AUTORELEASE (tiffData);
+          data = [self thumbnailOfBitmap: srcRep];
+          RETAIN (data);
         }
-      else
-        {
-          NSInteger dstSizeW, dstSizeH;
-          float fact = ([srcRep pixelsWide] >= [srcRep pixelsHigh]) ? ([srcRep pixelsWide] / TMBMAX) : ([srcRep pixelsHigh] / TMBMAX);
-          	        
-          float xRatio;
-          float yRatio;
-          NSBitmapImageRep *dstRep;
-          unsigned x, y;
-          NSInteger i;
-          NSData *tiffData;
-	  NSInteger srcSizeW;
-	  NSInteger srcSizeH;
-
-	  srcSizeW = [srcRep pixelsWide];
-	  srcSizeH = [srcRep pixelsHigh];
-
-          dstSizeW = (NSInteger)floor([srcRep pixelsWide] / fact + 0.5);
-          dstSizeH = (NSInteger)floor([srcRep pixelsHigh] / fact + 0.5);
- 
-          xRatio = (float)[srcRep pixelsWide] / (float)dstSizeW;
-          yRatio = (float)[srcRep pixelsHigh] / (float)dstSizeH;
-          
-          dstRep = [[NSBitmapImageRep alloc]
-                     initWithBitmapDataPlanes:NULL
-                                   pixelsWide:dstSizeW
-                                   pixelsHigh:dstSizeH
-                                bitsPerSample:[srcRep bitsPerSample]
-                              samplesPerPixel:[srcRep samplesPerPixel]
-                                     hasAlpha:[srcRep hasAlpha]
-                                     isPlanar:[srcRep isPlanar]
-                               colorSpaceName:[srcRep colorSpaceName]
-                                  bytesPerRow:0
-                                 bitsPerPixel:0];
-          
-          for (y = 0; y < dstSizeH; y++)
-	    {
-	      for (x = 0; x < dstSizeW; x++)
-		{
-		  register NSInteger x0, y0;
-		  register float xDiff, yDiff;
-		  float xFloat, yFloat;
-		  NSInteger x1, y1;
-		  int xStep, yStep;
-		  NSUInteger srcPixel1[5];
-                  NSUInteger srcPixel2[5];
-                  NSUInteger srcPixel3[5];
-                  NSUInteger srcPixel4[5];
-                  NSUInteger destPixel[5];
-
-		  // we use integer part of the ratio, so that we can set the next pixel to at least one apart
-		  xStep = floorf(xRatio);
-		  yStep = floorf(yRatio);
-		  if (xStep == 0)
-		    xStep = 1;
-		  if (yStep == 0)
-		    yStep = 1;
-		  xFloat = (float)x * xRatio;
-		  yFloat = (float)y * yRatio;
-		  x0 = (NSInteger)floorf(xFloat);
-		  y0 = (NSInteger)floorf(yFloat);
-		  x1 = x0 + xStep;
-		  y1 = y0 + yStep;
-
-		  // these are the weight w and h, normalized to the distance 1 : x1-x0
-		  xDiff = (xFloat - (float)x0)/(float)xStep;
-		  yDiff = (yFloat - (float)y0)/(float)yStep;
-
-		  if (x1 >= srcSizeW )
-		    {
-		      x1 = srcSizeW-1;
-		      xDiff = 0;
-		    }
-		  if (y1 >= srcSizeH )
-		    {
-		      y1 = srcSizeH-1;
-		      yDiff = 0;
-		    }
-
-		  [srcRep getPixel: srcPixel1 atX:x0 y:y0];
-                  [srcRep getPixel: srcPixel2 atX:x1 y:y0];
-                  [srcRep getPixel: srcPixel3 atX:x0 y:y1];
-                  [srcRep getPixel: srcPixel4 atX:x1 y:y1];
-
-		  destPixel[0] = 0;
-		  destPixel[1] = 0;
-		  destPixel[2] = 0;
-		  destPixel[3] = 0;
-		  destPixel[4] = 0;
-		  for (i = 0; i < srcSpp; i++)
-		    {
-		      destPixel[i] = \
-			(NSUInteger)(srcPixel1[i]*(1-xDiff)*(1-yDiff) + \
-				     srcPixel2[i]*xDiff*(1-yDiff) +	\
-				     srcPixel3[i]*yDiff*(1-xDiff) +	\
-				     srcPixel4[i]*xDiff*yDiff);
-		    }
-                  [dstRep setPixel: destPixel atX: x y:y];
-		}
-	    }
-          
-          tiffData = [dstRep TIFFRepresentation];
-          RETAIN (tiffData);
-          
-          RELEASE (image);
-          RELEASE (dstRep);
-          RELEASE (arp);
-          
-	  return AUTORELEASE (tiffData);
-	}
     }
   else
     {
@@ -199,13 +136,13 @@
   RELEASE (image);  
   RELEASE (arp);
     
-  return nil;
+  return AUTORELEASE (data);
 }
 
 
 - (NSString *)fileNameExtension
 {
-  return @"tiff";
+  return @"png";
 }
 
 - (NSString *)description
@@ -214,3 +151,210 @@
 }
 
 @end
+
+
+@implementation ImageThumbnailer (Private)
+
+/* Scales the bitmap to fit TMBMAX with the box filter of FSNRaster and
+ * encodes it as PNG, which is several times smaller than the
+ * uncompressed TIFF thumbnails used to be.  A bitmap already of nearly
+ * the thumbnail size is only encoded. */
+- (NSData *)thumbnailOfBitmap:(NSBitmapImageRep *)srcRep
+{
+  NSInteger srcSizeW = [srcRep pixelsWide];
+  NSInteger srcSizeH = [srcRep pixelsHigh];
+  NSBitmapImageRep *dstRep;
+  NSData *data;
+
+  if (srcSizeW <= 0 || srcSizeH <= 0)
+    return nil;
+
+  if ((srcSizeW <= TMBMAX) && (srcSizeH <= TMBMAX)
+      && (srcSizeW >= (TMBMAX - RESZLIM)) && (srcSizeH >= (TMBMAX - RESZLIM)))
+    {
+      dstRep = srcRep;
+    }
+  else
+    {
+      NSBitmapImageRep *meshed = FSNMeshedBitmap(srcRep);
+      float fact = (srcSizeW >= srcSizeH) ? (srcSizeW / TMBMAX) : (srcSizeH / TMBMAX);
+      NSInteger dstSizeW = (NSInteger)floor(srcSizeW / fact + 0.5);
+      NSInteger dstSizeH = (NSInteger)floor(srcSizeH / fact + 0.5);
+
+      if (meshed == nil)
+        return nil;
+
+      dstSizeW = MAX(1, MIN(dstSizeW, srcSizeW));
+      dstSizeH = MAX(1, MIN(dstSizeH, srcSizeH));
+
+      dstRep = [[NSBitmapImageRep alloc]
+                 initWithBitmapDataPlanes: NULL
+                               pixelsWide: dstSizeW
+                               pixelsHigh: dstSizeH
+                            bitsPerSample: 8
+                          samplesPerPixel: [meshed samplesPerPixel]
+                                 hasAlpha: [meshed hasAlpha]
+                                 isPlanar: NO
+                           colorSpaceName: [meshed colorSpaceName]
+                              bytesPerRow: 0
+                             bitsPerPixel: 0];
+      AUTORELEASE (dstRep);
+
+      if (FSNRasterDownscale([meshed bitmapData], srcSizeW, srcSizeH,
+                             [meshed bytesPerRow],
+                             [dstRep bitmapData], dstSizeW, dstSizeH,
+                             [dstRep bytesPerRow],
+                             (unsigned)[meshed samplesPerPixel]) == NO)
+        return nil;
+    }
+
+  data = [dstRep representationUsingType: NSPNGFileType properties: nil];
+  if (data == nil)
+    data = [dstRep TIFFRepresentation];
+
+  return data;
+}
+
+/* The thumbnail cameras store in IFD1 of the EXIF block, when it covers
+ * TMBMAX and has the aspect of the image (from the frame header).  Only
+ * the head of the file is read. */
+- (NSData *)exifThumbnailOfJPEGAtPath:(NSString *)path
+{
+  NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath: path];
+  NSData *head;
+  const unsigned char *bytes;
+  NSUInteger length;
+  NSUInteger pos;
+  NSUInteger thumbStart = 0;
+  NSUInteger thumbLength = 0;
+  unsigned imageW = 0;
+  unsigned imageH = 0;
+  NSBitmapImageRep *rep;
+  float imageAspect, thumbAspect;
+
+  if (handle == nil)
+    return nil;
+
+  head = [handle readDataOfLength: JPEG_HEAD_LEN];
+  [handle closeFile];
+
+  bytes = [head bytes];
+  length = [head length];
+
+  if (length < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+    return nil;
+
+  pos = 2;
+
+  while (pos + 4 <= length && imageW == 0)
+    {
+      unsigned marker;
+      unsigned seglen;
+
+      if (bytes[pos] != 0xFF)
+        return nil;
+      marker = bytes[pos + 1];
+      if (marker == 0xFF)
+        {
+          pos++;
+          continue;
+        }
+      if (marker == 0xD9 || marker == 0xDA)
+        break;
+      seglen = readU16(bytes + pos + 2, YES);
+      if (seglen < 2)
+        return nil;
+
+      if (marker == 0xE1 && thumbLength == 0 && pos + 4 + seglen - 2 <= length
+          && seglen >= 16 && memcmp(bytes + pos + 4, "Exif\0\0", 6) == 0)
+        {
+          const unsigned char *tiff = bytes + pos + 10;
+          NSUInteger tiffLen = seglen - 8;
+          BOOL big = (tiff[0] == 'M');
+          unsigned long ifd;
+          unsigned entries, i;
+          unsigned long offset = 0, count = 0;
+
+          if ((tiff[0] == 'M' || tiff[0] == 'I') && tiff[1] == tiff[0]
+              && readU16(tiff + 2, big) == 42)
+            {
+              ifd = readU32(tiff + 4, big);
+              /* skip IFD0 to the offset of IFD1 */
+              if (ifd + 2 <= tiffLen)
+                {
+                  entries = readU16(tiff + ifd, big);
+                  if (ifd + 2 + entries * 12 + 4 <= tiffLen)
+                    ifd = readU32(tiff + ifd + 2 + entries * 12, big);
+                  else
+                    ifd = 0;
+                }
+              else
+                {
+                  ifd = 0;
+                }
+
+              if (ifd && ifd + 2 <= tiffLen)
+                {
+                  entries = readU16(tiff + ifd, big);
+                  for (i = 0; i < entries; i++)
+                    {
+                      const unsigned char *e = tiff + ifd + 2 + i * 12;
+                      unsigned tag;
+
+                      if (ifd + 2 + (i + 1) * 12 > tiffLen)
+                        break;
+                      tag = readU16(e, big);
+                      if (tag == 0x0201)
+                        offset = readU32(e + 8, big);
+                      else if (tag == 0x0202)
+                        count = readU32(e + 8, big);
+                    }
+                }
+
+              if (offset && count && offset + count <= tiffLen)
+                {
+                  thumbStart = (tiff - bytes) + offset;
+                  thumbLength = count;
+                }
+            }
+        }
+      else if ((marker >= 0xC0 && marker <= 0xCF)
+               && marker != 0xC4 && marker != 0xC8 && marker != 0xCC
+               && pos + 9 <= length)
+        {
+          imageH = readU16(bytes + pos + 5, YES);
+          imageW = readU16(bytes + pos + 7, YES);
+        }
+
+      pos += 2 + seglen;
+    }
+
+  if (thumbLength == 0 || imageW == 0 || imageH == 0)
+    return nil;
+
+  rep = [NSBitmapImageRep imageRepWithData:
+             [head subdataWithRange: NSMakeRange(thumbStart, thumbLength)]];
+  if (rep == nil || [rep pixelsWide] <= 0 || [rep pixelsHigh] <= 0)
+    return nil;
+  if (MAX([rep pixelsWide], [rep pixelsHigh]) < TMBMAX)
+    return nil;
+
+  imageAspect = (float)imageW / (float)imageH;
+  thumbAspect = (float)[rep pixelsWide] / (float)[rep pixelsHigh];
+  if (fabsf(thumbAspect - imageAspect) > imageAspect * EXIF_ASPECT_TOLERANCE)
+    return nil;
+
+  return [self thumbnailOfBitmap: rep];
+}
+
+/* Decodes the JPEG scaled down in the DCT, with FSNDecodeScaledJPEGAtPath,
+ * so a 40 megapixel photo is decoded as well under a megapixel.  CMYK
+ * files are left to the AppKit decoder. */
+- (NSData *)scaledThumbnailOfJPEGAtPath:(NSString *)path
+{
+  NSBitmapImageRep *rep = FSNDecodeScaledJPEGAtPath(path, TMBMAX, NULL, nil);
+
+  return rep ? [self thumbnailOfBitmap: rep] : nil;
+}
+
+@end
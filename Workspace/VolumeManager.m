@@ -19,12 +19,20 @@
 #import "Workspace.h"
 #import "FSNode.h"
 #import "FSNodeRep.h"
+#import "FSNMountTable.h"
 #import "Desktop/GWDesktopManager.h"
 #import "Desktop/GWDesktopView.h"
 #import "GWUnmountHelper.h"
 
 static VolumeManager *sharedInstance = nil;
 
+/* Seconds each disk image has to unmount at logout */
+#define VOLUME_UNMOUNT_TIMEOUT 10.0
+
+@interface VolumeManager (Private)
+- (BOOL)finishUnmountOfPath:(NSString *)mountPath unmounted:(BOOL)unmountSuccess;
+@end
+
 @implementation VolumeMountResult
 
 @synthesize success, mountPoint, errorMessage, processId;
@@ -210,6 +218,15 @@ static VolumeManager *sharedInstance = nil;
 
 - (BOOL)isMountPointActive:(NSString *)mountPoint
 {
+  FSNMountTable *mtable = [FSNMountTable sharedTable];
+
+  /* statfs() succeeds on the empty mount point directory as well;
+     the mount table tells whether something is mounted there. */
+  if ([mtable isAvailable]) {
+    return ([mtable isMountPointAtPath: mountPoint]
+            || [mtable isMountPointAtPath: [mountPoint stringByResolvingSymlinksInPath]]);
+  }
+
   struct statfs statbuf;
   if (statfs([mountPoint UTF8String], &statbuf) == 0) {
     return YES;
@@ -954,8 +971,6 @@ static VolumeManager *sharedInstance = nil;
   NSDebugLLog(@"gwspace", @"VolumeManager: Current PIDs: %@", mountedVolumesPIDs);
   
   /* Send will-unmount notification to grey out desktop icon */
-  NSString *parent = [mountPath stringByDeletingLastPathComponent];
-  NSString *name = [mountPath lastPathComponent];
   NSDictionary *unmountInfo = @{ @"NSDevicePath": mountPath };
   [[NSNotificationCenter defaultCenter]
     postNotificationName:NSWorkspaceWillUnmountNotification
@@ -973,7 +988,17 @@ static VolumeManager *sharedInstance = nil;
   } else {
     NSDebugLLog(@"gwspace", @"VolumeManager: GWUnmountHelper failed to unmount %@", mountPath);
   }
-  
+
+  return [self finishUnmountOfPath:mountPath unmounted:unmountSuccess];
+}
+
+/* The SIGKILL fallback for the FUSE process of a volume that did not
+   unmount, and the cleanup of one that did. */
+- (BOOL)finishUnmountOfPath:(NSString *)mountPath unmounted:(BOOL)unmountSuccess
+{
+  NSString *parent = [mountPath stringByDeletingLastPathComponent];
+  NSString *name = [mountPath lastPathComponent];
+
   /* Find the tracked volume for cleanup */
   NSDebugLLog(@"gwspace", @"VolumeManager: Searching for mount point in tracked volumes...");
   NSString *foundKey = nil;
@@ -1206,11 +1231,16 @@ static VolumeManager *sharedInstance = nil;
 
 - (void)unmountAll
 {
-  NSArray *imagePaths = [[mountedVolumes allKeys] copy];
-  for (NSString *imagePath in imagePaths) {
-    [self unmountImageFile:imagePath];
+  /* The images do not depend on each other: they are unmounted at the
+     same time, each with its own time limit, and cleaned up after. */
+  NSArray *mountPoints = [[mountedVolumes allValues] copy];
+  NSArray *failed = [GWUnmountHelper unmountPaths:mountPoints
+                                          timeout:VOLUME_UNMOUNT_TIMEOUT];
+  for (NSString *mountPoint in mountPoints) {
+    [self finishUnmountOfPath:mountPoint
+                    unmounted:([failed containsObject:mountPoint] == NO)];
   }
-  [imagePaths release];
+  [mountPoints release];
   
   /* Note: We don't stop AVFS daemon here as it may be used by other applications.
    * The daemon will be stopped when user logs out or explicitly unmounts ~/.avfs */
@@ -0,0 +1,88 @@
+/* Workspace+Diagnostics.m
+ *
+ * Where the memory of a long running Workspace is: the live counters of
+ * FSNode (see FSNDiagnostics.h) with those of the caches and components
+ * Workspace owns.  The report is published on D-Bus by
+ * FileManagerDBusInterface and logged on SIGUSR1:
+ *
+ *   kill -USR1 $(pidof GWorkspace)
+ *
+ * Reading it costs a few dictionary counts and takes no lock that a
+ * viewer waits for, so it can be asked for at any time.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later OR BSD-2-Clause
+ */
+
+#import <Foundation/Foundation.h>
+#import <AppKit/AppKit.h>
+#import <dispatch/dispatch.h>
+#include <signal.h>
+
+#import "Workspace.h"
+#import "FSNDiagnostics.h"
+#import "GWViewersManager.h"
+#import "GWWatchDispatcher.h"
+#import "GSFileMetadata.h"
+#import "DSStoreInfo.h"
+#import "GWStallWatchdog.h"
+
+static dispatch_source_t diagnosticsSignalSource = NULL;
+
+static void
+addCount(NSMutableDictionary *report, NSString *key, unsigned long long value)
+{
+  [report setObject: [NSNumber numberWithUnsignedLongLong: value] forKey: key];
+}
+
+@implementation Workspace (Diagnostics)
+
+- (NSDictionary *)diagnosticsReport
+{
+  NSMutableDictionary *report = FSNDiagnosticsReport();
+  NSDictionary *stats = [vwrsManager viewersStatistics];
+  NSEnumerator *enumerator = [stats keyEnumerator];
+  NSString *key;
+
+  while ((key = [enumerator nextObject]) != nil)
+    {
+      [report setObject: [stats objectForKey: key]
+                 forKey: [@"viewers." stringByAppendingString: key]];
+    }
+
+  addCount(report, @"GSFileMetadata.cacheEntries", [GSFileMetadata cachedMetadataCount]);
+  addCount(report, @"DSStoreInfo", [DSStoreInfo liveCount]);
+  addCount(report, @"DSStoreInfo.cacheEntries", [DSStoreInfo cachedInfoCount]);
+
+  addCount(report, @"fswatcher.watchedPaths", [watchedPaths count]);
+  addCount(report, @"fswatcher.events", fswEventsReceived);
+  addCount(report, @"fswatcher.batches", fswBatchesReceived);
+  addCount(report, @"watchDispatcher.nodes",
+           [[GWWatchDispatcher sharedDispatcher] nodesCount]);
+  addCount(report, @"mainThread.stalls", GWStallWatchdogStallCount());
+
+  return report;
+}
+
+- (void)installDiagnosticsSignalHandler
+{
+  if (diagnosticsSignalSource != NULL)
+    return;
+
+  /* the source gets the signal instead of its default action, which
+     would end the process */
+  signal(SIGUSR1, SIG_IGN);
+
+  diagnosticsSignalSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL,
+                                                   SIGUSR1, 0,
+                                                   dispatch_get_main_queue());
+  dispatch_source_set_event_handler(diagnosticsSignalSource, ^{
+    CREATE_AUTORELEASE_POOL(arp);
+
+    NSLog(@"Workspace diagnostics:\n%@",
+          FSNDiagnosticsDescription([self diagnosticsReport]));
+    RELEASE (arp);
+  });
+  dispatch_resume(diagnosticsSignalSource);
+}
+
+@end
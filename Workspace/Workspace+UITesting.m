@@ -17,6 +17,7 @@
  *  - Open menus and select items
  *  - Send keyboard shortcuts
  *  - Highlight failed elements in red for visual feedback
+ *  - Measure the latency of scenarios (open, scroll, select all, rename)
  */
 
 #import <Foundation/Foundation.h>
@@ -26,6 +27,7 @@
 #import <errno.h>
 #import "Workspace.h"
 #import "WorkspaceUITesting.h"
+#import "GWViewersManager.h"
 
 /* Global flag to track if debug mode is enabled */
 static BOOL uiTestingEnabled = NO;
@@ -561,6 +563,141 @@ static NSMutableDictionary* _buildWindowDict(NSWindow *window)
 }
 @end
 
+/* A scenario is over when nothing was dispatched nor drawn for this long */
+#define UITEST_IDLE_QUIET 0.1
+/* How long a measured scenario may take, when not told */
+#define UITEST_MEASURE_TIMEOUT 10.0
+
+/**
+ * Helper class that notes when the file operation of a measured
+ * scenario has been reported done
+ */
+@interface _UITestOperationProbe : NSObject
+{
+  NSString *_destination;
+  BOOL _done;
+}
+- (id)initWithDestination:(NSString *)destination;
+- (BOOL)isDone;
+@end
+
+@implementation _UITestOperationProbe
+- (id)initWithDestination:(NSString *)destination {
+  self = [super init];
+  if (self) {
+    _destination = [destination copy];
+    _done = NO;
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(fileSystemDidChange:)
+                                                 name:@"GWFileSystemDidChangeNotification"
+                                               object:nil];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [_destination release];
+  [super dealloc];
+}
+
+- (void)fileSystemDidChange:(NSNotification *)notif {
+  NSDictionary *info = (NSDictionary *)[notif object];
+
+  if ([[info objectForKey:@"destination"] isEqual:_destination]) {
+    _done = YES;
+  }
+}
+
+- (BOOL)isDone {
+  return _done;
+}
+@end
+
+/**
+ * Helper: Dispatch the pending events, draw the windows that need it and
+ * run the run loop once.  Returns YES when there was something to do.
+ */
+static BOOL _runOnePass(void)
+{
+  NSApplication *app = [NSApplication sharedApplication];
+  BOOL busy = NO;
+  NSEvent *event;
+
+  while ((event = [app nextEventMatchingMask:NSAnyEventMask
+                                   untilDate:[NSDate distantPast]
+                                      inMode:NSDefaultRunLoopMode
+                                     dequeue:YES]) != nil) {
+    [app sendEvent:event];
+    busy = YES;
+  }
+
+  for (NSWindow *window in [app windows]) {
+    if ([window isVisible] && [window viewsNeedDisplay]) {
+      [window displayIfNeeded];
+      busy = YES;
+    }
+  }
+
+  [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode
+                           beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.005]];
+
+  return busy;
+}
+
+/**
+ * Helper: Run until `done` (when given) returns YES and then nothing was
+ * dispatched nor drawn for UITEST_IDLE_QUIET seconds, or until `timeout`.
+ * Returns the uptime of the last pass that had work, the end of what the
+ * scenario caused, or -1 on timeout.  Timers that fire without drawing
+ * (a blinking cursor, an idle animation) do not keep it busy.
+ */
+static NSTimeInterval _settle(NSTimeInterval start, NSTimeInterval timeout,
+                              BOOL (^done)(void))
+{
+  NSProcessInfo *info = [NSProcessInfo processInfo];
+  NSTimeInterval lastBusy = start;
+  NSTimeInterval now = start;
+  BOOL reached = (done == nil);
+
+  while (now - start < timeout) {
+    NSAutoreleasePool *pool = [NSAutoreleasePool new];
+    BOOL busy = _runOnePass();
+
+    now = [info systemUptime];
+    [pool release];
+
+    if (reached == NO && done()) {
+      reached = YES;
+      busy = YES;
+    }
+    if (busy) {
+      lastBusy = now;
+    } else if (reached && (now - lastBusy >= UITEST_IDLE_QUIET)) {
+      return lastBusy;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Helper: The first scroll view under `view`, depth first
+ */
+static NSScrollView* _findScrollView(NSView *view)
+{
+  if ([view isKindOfClass:[NSScrollView class]]) {
+    return (NSScrollView *)view;
+  }
+  for (NSView *subview in [view subviews]) {
+    NSScrollView *found = _findScrollView(subview);
+    if (found) {
+      return found;
+    }
+  }
+  return nil;
+}
+
 /**
  * Category to add UI testing support to Workspace
  */
@@ -1217,6 +1354,161 @@ static NSMutableDictionary* _buildWindowDict(NSWindow *window)
   }
 }
 
+/**
+ * Measure the latency of one run of a scenario: the time from injecting it
+ * until the windows are drawn and the run loop is idle again.
+ *
+ * - open:       open a viewer on `argument` (a folder, default the home);
+ *               the viewer is closed again afterwards, untimed
+ * - scroll:     scroll the key window's file view a page down, or back to
+ *               the top when at the end
+ * - select-all: the Select All of the key viewer, after selecting nothing
+ * - rename:     rename the file `argument` as the name editor does, until
+ *               the views were told; it is renamed back afterwards, untimed
+ */
+- (NSDictionary *)measureScenario:(NSString *)scenario
+                         argument:(NSString *)argument
+                          timeout:(CGFloat)timeout
+{
+  if (!isUITestingEnabled()) {
+    return @{@"success": @NO, @"error": @"UI Testing disabled"};
+  }
+
+  @try {
+    NSProcessInfo *info = [NSProcessInfo processInfo];
+    NSWindow *keyWindow = [[NSApplication sharedApplication] keyWindow];
+    NSTimeInterval limit = (timeout > 0) ? timeout : UITEST_MEASURE_TIMEOUT;
+    NSTimeInterval start;
+    NSTimeInterval end;
+
+    /* what is left of the previous run must not be counted */
+    _settle([info systemUptime], limit, nil);
+
+    if ([scenario isEqualToString:@"open"]) {
+      NSString *path = ([argument length] ? argument : NSHomeDirectory());
+      NSArray *before = [[[NSApplication sharedApplication] windows] copy];
+      __block NSWindow *opened = nil;
+
+      start = [info systemUptime];
+      [self newViewerAtPath:path];
+      end = _settle(start, limit, ^BOOL {
+        for (NSWindow *window in [[NSApplication sharedApplication] windows]) {
+          if ([window isVisible] && ![before containsObject:window]) {
+            opened = window;
+            return YES;
+          }
+        }
+        return NO;
+      });
+      [before release];
+
+      if (opened) {
+        [opened close];
+        _settle([info systemUptime], limit, nil);
+      }
+
+    } else if ([scenario isEqualToString:@"scroll"]) {
+      NSScrollView *scroll = _findScrollView([keyWindow contentView]);
+      NSClipView *clip;
+      NSRect visible;
+      NSRect docFrame;
+      NSPoint origin;
+
+      if (scroll == nil) {
+        return @{@"success": @NO, @"error": @"No scroll view in the key window"};
+      }
+
+      clip = [scroll contentView];
+      visible = [clip documentVisibleRect];
+      docFrame = [[scroll documentView] frame];
+      origin = visible.origin;
+
+      /* flipped or not, the origin moves a page away from where it is */
+      if ([[scroll documentView] isFlipped]) {
+        origin.y += NSHeight(visible);
+        if (origin.y > NSMaxY(docFrame) - NSHeight(visible)) {
+          origin.y = (NSMaxY(visible) >= NSMaxY(docFrame)) ? NSMinY(docFrame)
+                                                          : NSMaxY(docFrame) - NSHeight(visible);
+        }
+      } else {
+        origin.y -= NSHeight(visible);
+        if (origin.y < NSMinY(docFrame)) {
+          origin.y = (NSMinY(visible) <= NSMinY(docFrame)) ? NSMaxY(docFrame) - NSHeight(visible)
+                                                          : NSMinY(docFrame);
+        }
+      }
+
+      start = [info systemUptime];
+      [clip scrollToPoint:[clip constrainScrollPoint:origin]];
+      [scroll reflectScrolledClipView:clip];
+      end = _settle(start, limit, nil);
+
+    } else if ([scenario isEqualToString:@"select-all"]) {
+      id viewer = ([vwrsManager hasViewerWithWindow:keyWindow]
+                   ? [vwrsManager viewerWithWindow:keyWindow] : nil);
+
+      if (viewer == nil) {
+        return @{@"success": @NO, @"error": @"The key window is not a viewer"};
+      }
+
+      [viewer unselectAllReps];
+      _settle([info systemUptime], limit, nil);
+
+      start = [info systemUptime];
+      [self selectAllInViewer:nil];
+      end = _settle(start, limit, nil);
+
+    } else if ([scenario isEqualToString:@"rename"]) {
+      NSString *source = argument;
+      NSString *destination = [source stringByAppendingString:@"-uitest"];
+      NSFileManager *fm = [NSFileManager defaultManager];
+      _UITestOperationProbe *probe;
+
+      if ([source length] == 0 || ![fm fileExistsAtPath:source]
+          || [fm fileExistsAtPath:destination]) {
+        return @{@"success": @NO,
+                 @"error": @"rename needs an existing file, without a \"-uitest\" sibling"};
+      }
+
+      probe = [[_UITestOperationProbe alloc] initWithDestination:destination];
+      start = [info systemUptime];
+      [self performFileOperation:@{@"operation": @"WorkspaceRenameOperation",
+                                   @"source": source,
+                                   @"destination": destination,
+                                   @"files": @[@""]}];
+      end = _settle(start, limit, ^BOOL { return [probe isDone]; });
+      [probe release];
+
+      /* back as it was, for the next run */
+      probe = [[_UITestOperationProbe alloc] initWithDestination:source];
+      [self performFileOperation:@{@"operation": @"WorkspaceRenameOperation",
+                                   @"source": destination,
+                                   @"destination": source,
+                                   @"files": @[@""]}];
+      _settle([info systemUptime], limit, ^BOOL { return [probe isDone]; });
+      [probe release];
+
+    } else {
+      return @{@"success": @NO,
+               @"error": [NSString stringWithFormat:@"Unknown scenario: %@", scenario]};
+    }
+
+    if (end < 0) {
+      return @{@"success": @NO, @"scenario": scenario,
+               @"error": [NSString stringWithFormat:@"Did not settle within %.1f seconds", limit]};
+    }
+
+    return @{
+      @"success": @YES,
+      @"scenario": scenario,
+      @"latency": [NSNumber numberWithDouble:(end - start) * 1000.0]
+    };
+
+  } @catch (NSException *e) {
+    return @{@"success": @NO, @"error": [e reason]};
+  }
+}
+
 /**
  * Get all menus and menu items with their enabled/disabled state
  * Returns a JSON string for distributed objects compatibility
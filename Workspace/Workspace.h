@@ -60,6 +60,8 @@
 
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo;
 
+- (oneway void)watchedPathsDidChange:(NSData *)batch;
+
 @end
 
 
@@ -76,6 +78,21 @@
 - (oneway void)client:(id <FSWClientProtocol>)client
                           removeWatcherForPath:(NSString *)path;
 
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setBatchedDelivery:(BOOL)flag;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          didProcessBatch:(unsigned long long)sequence;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setFilter:(bycopy NSDictionary *)filter;
+
+- (oneway void)client:(id <FSWClientProtocol>)client
+                          setCoalescingWindow:(double)seconds
+                          adaptive:(BOOL)flag;
+
+- (bycopy NSDictionary *)statistics;
+
 @end
 
 
@@ -87,6 +104,8 @@
 
 - (NSString *)annotationsForPath:(NSString *)path;
 
+- (NSData *)annotationsForPaths:(NSData *)info;
+
 - (oneway void)setAnnotations:(NSString *)annotations
                       forPath:(NSString *)path;
 
@@ -110,12 +129,17 @@
   FSNodeRep *fsnodeRep;
   
   NSArray *selectedPaths;
-  NSMutableArray *trashContents;
+  NSMutableDictionary *trashContents;    /* path -> FSNode, of every trash */
+  NSMutableDictionary *trashSizes;       /* path -> bytes */
+  unsigned long long trashBytes;
   NSString *trashPath;
+  NSArray *trashPaths;                   /* the home trash, then the volumes' */
   
   id fswatcher;
   BOOL fswnotifications;
   NSCountedSet *watchedPaths;
+  unsigned long long fswEventsReceived;
+  unsigned long long fswBatchesReceived;
   
   id ddbd;
   id mdextractor;
@@ -129,6 +153,7 @@
   GWDesktopManager *dtopManager;  
   Inspector *inspector;
   Finder *finder;
+  NSMutableArray *deferredLoads;
   Operation *fileOpsManager;
   
   BOOL dontWarnOnQuit;
@@ -138,6 +163,8 @@
   
   OpenWithController *openWithController;
   NSMenu *openWithMenu;
+  NSArray *openWithApps;
+  NSArray *appWatchedDirs;
   RunExternalController *runExtController;
   
   StartAppWin *startAppWin;
@@ -146,7 +173,6 @@
   
 #if HAVE_DBUS
   id fileManagerDBusInterface;
-  NSFileHandle *dbusFileHandle;
 #endif
   
   NSString *gwProcessName;  	      
@@ -306,6 +332,8 @@
 
 - (NSString *)ddbdGetAnnotationsForPath:(NSString *)path;
 
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths;
+
 - (void)ddbdSetAnnotations:(NSString *)annotations
                    forPath:(NSString *)path;
 
@@ -426,6 +454,8 @@
 
 - (void)setFilenamesCut:(BOOL)value;
 
+- (NSArray *)fileOperationsProgress;
+
 - (void)lsfolderDragOperation:(NSData *)opinfo
               concludedAtPath:(NSString *)path;
                           
@@ -440,6 +470,19 @@
 
 - (NSString *)trashPath;
 
+/** The home trash and the trashes of the mounted volumes, which
+    recycling from those volumes moves to (see FSNTrash.h).  The trash
+    contents and Empty Trash are of all of them. */
+- (NSArray *)trashPaths;
+
+- (BOOL)isTrashPath:(NSString *)path;
+
+/** The items in the trash, the reserved names left out. */
+- (NSUInteger)trashItemCount;
+
+/** The bytes they hold; the folders are added as their walks complete. */
+- (unsigned long long)trashSize;
+
 - (BOOL)isRootFilesystem:(NSString *)path;
 
 - (BOOL)pasteboardHasValidContent;
@@ -476,6 +519,18 @@
 @end
 
 
+@interface Workspace (Diagnostics)
+
+/* Live counts and approximate sizes of the nodes, icons, caches, viewers
+   and watchers, name -> NSNumber.  Main thread only. */
+- (NSDictionary *)diagnosticsReport;
+
+/* Logs the report whenever the process gets SIGUSR1. */
+- (void)installDiagnosticsSignalHandler;
+
+@end
+
+
 @interface Workspace (SharedInspector)
 
 - (oneway void)showExternalSelection:(NSArray *)selection;
@@ -45,6 +45,9 @@
 #import "GWFunctions.h"
 #import "FSNodeRep.h"
 #import "FSNFunctions.h"
+#import "FSNSizeCache.h"
+#import "FSNHiddenMatcher.h"
+#import "FSNTrash.h"
 #import "Workspace.h"
 
 /* Set of paths the user has recently unmounted via the GUI.
@@ -69,6 +72,7 @@ static NSTimeInterval recentUserUnmountTimeout = 5.0;
 #import "GWDockWindow.h"
 #import "Dock.h"
 #import "GWViewersManager.h"
+#import "GWWatchDispatcher.h"
 #import "GWViewer.h"
 #import "Finder.h"
 #import "Inspector.h"
@@ -80,18 +84,26 @@ static NSTimeInterval recentUserUnmountTimeout = 5.0;
 #import "GSFileMetadata.h"
 #import "DSStore.h"
 #import "DSStoreInfo.h"
+#import "FSNMountTable.h"
+#import "FSWEventBatch.h"
+#import "FSNTrace.h"
 #import "GWViewSettingsManager.h"
 #import "GWMetaArchive.h"
 #import "FSNIconsView.h"
 #import "GWMetadataProvider.h"
 #import "GWIconPositionStore.h"
+#import "GWViewerPrefsStore.h"
 #import "GWArchiveOperation.h"
+#import "GWArchiveIndex.h"
+#import "GWAppRegistry.h"
 #import "Network/NetworkFSNode.h"
 #import "Network/NetworkServiceManager.h"
 #import "Network/NetworkServiceItem.h"
 #import "Network/NetworkVolumeManager.h"
 #import "AVFSMount.h"
 #import "LowDiskWarn.h"
+#import "GWStartupTrace.h"
+#import "GWStallWatchdog.h"
 #if HAVE_DBUS
 #import "DBusConnection.h"
 #import "FileManagerDBusInterface.h"
@@ -103,6 +115,22 @@ static NSString *defaultxterm = @"xterm";
 
 static Workspace *gworkspace = nil;
 
+/* A .DS_Store is mapped only on a local, fixed disk: elsewhere another
+   machine or an unplugged stick can truncate it under the mapping. */
+static BOOL
+dsStoreMayBeMapped(NSString *path)
+{
+  FSNMountEntry *entry;
+  struct stat st;
+
+  if (stat([path fileSystemRepresentation], &st) != 0) {
+    return NO;
+  }
+  entry = [[FSNMountTable sharedTable] entryForDevice: st.st_dev];
+
+  return (entry != nil) && ([entry isNetwork] == NO) && ([entry isRemovable] == NO);
+}
+
 NSString *_pendingSystemActionCommand = nil;
 NSString *_pendingSystemActionTitle = nil;
 
@@ -119,6 +147,19 @@ NSString *_pendingSystemActionTitle = nil;
 
 @interface Workspace (PrivateMethods)
 - (void)_updateTrashContents;
+- (void)_updateTrashContentsForFiles:(NSArray *)files
+                             inTrash:(NSString *)trash;
+- (void)_setTrashPaths:(NSArray *)paths;
+- (void)_volumesDidChange:(NSNotification *)notif;
+- (BOOL)_syncTrashEntry:(NSString *)path;
+- (void)_trashNode:(FSNode *)node hasSize:(unsigned long long)bytes;
+- (void)_trashContentsDidChange;
+- (void)_updateApplicationWatchers;
+- (void)_applicationDirectoryDidChange:(NSString *)path;
+- (void)_watchedPathDidChange:(NSDictionary *)info;
+- (void)_createInspector;
+- (void)_startDeferredLoads;
+- (void)_deferredLoadWhenIdle:(NSNotification *)notif;
 @end
 
 @implementation Workspace
@@ -208,14 +249,19 @@ NSString *_pendingSystemActionTitle = nil;
   RELEASE (defXtermArgs);
   RELEASE (selectedPaths);
   RELEASE (trashContents);
+  RELEASE (trashSizes);
   RELEASE (trashPath);
+  RELEASE (trashPaths);
   RELEASE (watchedPaths);
   RELEASE (history);
   RELEASE (openWithController);
   RELEASE (openWithMenu);
+  RELEASE (openWithApps);
+  RELEASE (appWatchedDirs);
   RELEASE (vwrsManager);
   RELEASE (dtopManager);
   DESTROY (inspector);
+  RELEASE (deferredLoads);
   DESTROY (fileOpsManager);
   RELEASE (finder);
   RELEASE (launchedApps);
@@ -236,7 +282,6 @@ NSString *_pendingSystemActionTitle = nil;
 
 #if HAVE_DBUS
   DESTROY (fileManagerDBusInterface);
-  DESTROY (dbusFileHandle);
 #endif
     
   [super dealloc];
@@ -417,6 +462,10 @@ NSString *_pendingSystemActionTitle = nil;
   [menuItem setTag:GWViewTypeBrowser];
   [menuItem autorelease];
   [menu addItem:menuItem];
+
+  [menu addItem:[NSMenuItem separatorItem]];
+
+  [menu addItemWithTitle:_(@"Refresh") action:@selector(refreshViewer:) keyEquivalent:@"r"];
   
   //menuItem = [menu addItemWithTitle:_(@"as Gallery") action:@selector(notImplemented:) keyEquivalent:@"4"];
   //[menuItem setTarget:self];
@@ -764,21 +813,46 @@ NSString *_pendingSystemActionTitle = nil;
   NSString *lockpath;
   NSUInteger i;
   
+  GWStartupTraceBegin(@"applicationWillFinishLaunching");
+
+  GWStartupTraceBegin(@"menu");
   [self createMenu];
+  GWStartupTraceEnd(@"menu");
     
+  GWStartupTraceBegin(@"services");
   [[self class] registerForServices];
+  GWStartupTraceEnd(@"services");
   
   ASSIGN (gwProcessName, [[NSProcessInfo processInfo] processName]);
   ASSIGN (gwBundlePath, [[NSBundle mainBundle] bundlePath]);
   
   fm = [NSFileManager defaultManager];
   ws = [NSWorkspace sharedWorkspace];
+  GWStartupTraceBegin(@"FSNodeRep");
   fsnodeRep = [FSNodeRep sharedInstance];
   /* Supply FSNode with the Finder-metadata provider so cells/views can read
    * label colours, invisibility, custom icons and icon positions without
    * depending on the metadata implementation directly. */
   [fsnodeRep setMetadataProvider: [GWMetadataProvider sharedProvider]];
   [fsnodeRep setIconPositionStore: [GWIconPositionStore sharedStore]];
+  gDSStoreMappingFilter = dsStoreMayBeMapped;
+  /* the per-folder viewer prefs that were user defaults keys move to
+   * their own store, the first time and after an older version ran */
+  if ([GWViewerPrefsStore sharedStore])
+    {
+      [[GWViewerPrefsStore sharedStore] migrateDomain: gwProcessName
+                                       ofUserDefaults: [NSUserDefaults standardUserDefaults]];
+      [fsnodeRep setViewerPrefsStore: [GWViewerPrefsStore sharedStore]];
+    }
+  /* the .DS_Store and ._ lookups know the misses FSNodeRep remembers on
+   * network volumes */
+  [DSStoreInfo setFileProbe: (id)fsnodeRep];
+  [GSFileMetadata setFileProbe: (id)fsnodeRep];
+  GWStartupTraceEnd(@"FSNodeRep");
+  GWStartupTraceBegin(@"thumbnailer");
+  [fsnodeRep setThumbnailScheduler: [Thumbnailer sharedThumbnailer]];
+  [[Thumbnailer sharedThumbnailer] setPathWatcher: self];
+  GWStartupTraceEnd(@"thumbnailer");
 
 
   extendedInfo = [fsnodeRep availableExtendedInfoNames];
@@ -848,6 +922,11 @@ NSString *_pendingSystemActionTitle = nil;
     [fsnodeRep setHiddenPaths: entry];
 	} 
 
+	entry = [defaults objectForKey: @"hiddenpatterns"];
+	if (entry) {
+    [[fsnodeRep hiddenMatcher] setHiddenPatterns: entry];
+	} 
+
 	entry = [defaults objectForKey: @"history_cache"];
 	if (entry) {
     maxHistoryCache = [entry intValue];
@@ -864,20 +943,36 @@ NSString *_pendingSystemActionTitle = nil;
   [fsnodeRep setUseThumbnails: boolentry];
   
   selectedPaths = [[NSArray alloc] initWithObjects: NSHomeDirectory(), nil];
-  trashContents = [NSMutableArray new];
+  GWStartupTraceBegin(@"trash");
+  trashContents = [NSMutableDictionary new];
+  trashSizes = [NSMutableDictionary new];
   ASSIGN (trashPath, [self trashPath]);
   [self _updateTrashContents];
+  GWStartupTraceEnd(@"trash");
+
+  /* a volume brings its trash, and takes it away */
+  [[ws notificationCenter] addObserver: self
+                              selector: @selector(_volumesDidChange:)
+                                  name: NSWorkspaceDidMountNotification
+                                object: nil];
+  [[ws notificationCenter] addObserver: self
+                              selector: @selector(_volumesDidChange:)
+                                  name: NSWorkspaceDidUnmountNotification
+                                object: nil];
   
   startAppWin = [[StartAppWin alloc] init];
   
   // Create standard user directories in $HOME if they don't exist
   [self createStandardUserDirectories];
   
+  GWStartupTraceBegin(@"fswatcher");
   watchedPaths = [[NSCountedSet alloc] initWithCapacity: 1];
   fswatcher = nil;
   fswnotifications = YES;
   [self connectFSWatcher];
+  GWStartupTraceEnd(@"fswatcher");
     
+  GWStartupTraceBegin(@"desktop");
   dtopManager = [GWDesktopManager desktopManager];
     
   NSDebugLLog(@"gwspace", @"DEBUG: Workspace init - no_desktop setting: %d", [defaults boolForKey: @"no_desktop"]);
@@ -888,27 +983,39 @@ NSString *_pendingSystemActionTitle = nil;
     NSDebugLLog(@"gwspace", @"DEBUG: Workspace activateDesktop returned");
 
   }
+  GWStartupTraceEnd(@"desktop");
 
+  GWStartupTraceBegin(@"preferences");
   prefController = [PrefController new];  
+  GWStartupTraceEnd(@"preferences");
   
   history = [[History alloc] init];
   
   openWithController = [[OpenWithController alloc] init];
   runExtController = [[RunExternalController alloc] init];
   	    
+  GWStartupTraceBegin(@"finder");
   finder = [Finder finder];
+  GWStartupTraceEnd(@"finder");
   
   vwrsManager = [GWViewersManager viewersManager];
   // Don't open viewer windows on startup - just show desktop
   // [vwrsManager showViewers];
   
-  inspector = [Inspector new];
+  /* the inspector is made the first time it is shown */
   if ([defaults boolForKey: @"uses_inspector"]) {  
+    GWStartupTraceBegin(@"inspector");
     [self showInspector: nil]; 
+    GWStartupTraceEnd(@"inspector");
   }
   
   fileOpsManager = [Operation new];
+  /* once the desktop is up */
+  [fileOpsManager performSelector: @selector(resumeInterruptedOperations)
+                       withObject: nil
+                       afterDelay: 0.0];
   
+  GWStartupTraceBegin(@"services connections");
   ddbd = nil;
   [self connectDDBd];
   
@@ -916,6 +1023,7 @@ NSString *_pendingSystemActionTitle = nil;
   if ([defaults boolForKey: @"GSMetadataIndexingEnabled"]) {
     [self connectMDExtractor];
   }
+  GWStartupTraceEnd(@"services connections");
     
   [defaults synchronize];
   terminating = NO;
@@ -929,6 +1037,8 @@ NSString *_pendingSystemActionTitle = nil;
 
   launchedApps = [NSMutableArray new];   
   activeApplication = nil;   
+
+  GWStartupTraceEnd(@"applicationWillFinishLaunching");
 }
 
 static BOOL (*orig_getInfoForFile)(id, SEL, NSString*, NSString**, NSString**);
@@ -964,6 +1074,7 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 
 - (void)applicationDidFinishLaunching:(NSNotification *)aNotification
 {
+  GWStartupTraceBegin(@"applicationDidFinishLaunching");
   [self _swizzleGetInfoForFileForNoExtensionFiles];
 
   NSNotificationCenter *nc = [NSNotificationCenter defaultCenter];
@@ -1040,11 +1151,14 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
               name: @"GWWorkspaceDidUnmountNotification"
             object: nil];
 
+  GWStartupTraceBegin(@"initializeWorkspace");
   [self initializeWorkspace];
+  GWStartupTraceEnd(@"initializeWorkspace");
 
   lowDiskWarn = [[LowDiskWarn alloc] init];
   [lowDiskWarn startMonitoring];
 
+  GWStartupTraceBegin(@"global shortcuts");
   // Initialize global shortcuts manager only if this instance is rendering the desktop
   if ([dtopManager isActive]) {
     globalShortcutsManager = [[GSGlobalShortcutsManager sharedManager] retain];
@@ -1057,37 +1171,28 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   } else {
     NSDebugLLog(@"gwspace", @"Workspace: Not the desktop instance - global shortcuts disabled");
   }
+  GWStartupTraceEnd(@"global shortcuts");
   
 #if HAVE_DBUS
+  GWStartupTraceBegin(@"D-Bus interface");
   // Initialize and register the FileManager DBus interface
   fileManagerDBusInterface = [[FileManagerDBusInterface alloc] initWithWorkspace:self];
   if (![fileManagerDBusInterface registerOnDBus]) {
     NSDebugLLog(@"gwspace", @"Workspace: Warning - Failed to register FileManager DBus interface");
     DESTROY(fileManagerDBusInterface);
   } else {
+    /* the session bus connection serves it from the run loop */
     NSDebugLLog(@"gwspace", @"Workspace: FileManager DBus interface registered successfully");
-    
-    // Set up D-Bus file descriptor monitoring for asynchronous message handling
-    // This ensures FileManager1 receives messages immediately without blocking
-    int dbusFd = [[fileManagerDBusInterface dbusConnection] getFileDescriptor];
-    if (dbusFd >= 0) {
-      dbusFileHandle = [[NSFileHandle alloc] initWithFileDescriptor:dbusFd closeOnDealloc:NO];
-      if (dbusFileHandle) {
-        [[NSNotificationCenter defaultCenter] addObserver:self
-                                               selector:@selector(processDBusMessages:)
-                                                   name:NSFileHandleDataAvailableNotification
-                                                 object:dbusFileHandle];
-        [dbusFileHandle waitForDataInBackgroundAndNotify];
-        NSDebugLLog(@"gwspace", @"Workspace: D-Bus file descriptor monitoring enabled (fd: %d)", dbusFd);
-      } else {
-        NSDebugLLog(@"gwspace", @"Workspace: Warning - Failed to create NSFileHandle for D-Bus fd");
-      }
-    } else {
-      NSDebugLLog(@"gwspace", @"Workspace: Warning - Failed to get D-Bus file descriptor");
-    }
   }
+  GWStartupTraceEnd(@"D-Bus interface");
 #endif
 
+  [self installDiagnosticsSignalHandler];
+  GWStallWatchdogStart();
+  [self _startDeferredLoads];
+
+  GWStartupTraceEnd(@"applicationDidFinishLaunching");
+  GWStartupTraceFinish();
 }
 
 - (void)applicationDidBecomeActive:(NSNotification *)aNotification
@@ -1136,6 +1241,8 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   terminating = YES;
 
   [self updateDefaults];
+  [[GWIconPositionStore sharedStore] flushPendingWrites];
+  [[GWViewerPrefsStore sharedStore] flushPendingWrites];
   
   TEST_CLOSE (prefController, [prefController myWin]);
   TEST_CLOSE (history, [history myWin]); 
@@ -1397,9 +1504,7 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   [manager setContextHelp: (NSAttributedString *)help 
                 forObject: [[prefController myWin] contentView]];
 
-  help = @"Inspector.rtfd";
-  [manager setContextHelp: (NSAttributedString *)help 
-                forObject: [[inspector win] contentView]];
+  /* the inspector gets its help when it is made */
 }
 
 - (NSAttributedString *)contextHelpFromName:(NSString *)fileName
@@ -1642,9 +1747,27 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
     NSString *source = [info objectForKey: @"source"];
     NSString *destination = [info objectForKey: @"destination"];
   
-    if ([source isEqual: trashPath] || [destination isEqual: trashPath]) {    
+    /* the trash of a volume, made by recycling from it */
+    if ([FSNTrash isVolumeTrashPath: destination] && ([self isTrashPath: destination] == NO)) {
       [self _updateTrashContents];
     }
+
+    if ([self isTrashPath: source]) {
+      [self _updateTrashContentsForFiles: [info objectForKey: @"files"]
+                                 inTrash: source];
+    }
+    if ([self isTrashPath: destination] && ([destination isEqual: source] == NO)) {
+      [self _updateTrashContentsForFiles: [info objectForKey: @"files"]
+                                 inTrash: destination];
+    }
+
+    /* a bundle copied in is whole only now, not when fswatcher saw it */
+    if ([appWatchedDirs containsObject: source]) {
+      [self _applicationDirectoryDidChange: source];
+    }
+    if ([appWatchedDirs containsObject: destination]) {
+      [self _applicationDirectoryDidChange: destination];
+    }
     
     if (ddbd != nil) {
       [ddbd fileSystemDidChange: [NSArchiver archivedDataWithRootObject: info]];
@@ -1859,6 +1982,19 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 
   NSDebugLLog(@"gwspace", @"Workspace openFile: called with path: %@", fullPath);
 
+  /* a file of a browsed archive is extracted the first time it is opened */
+  if ([[GWArchiveIndex indexForBrowsedPath: fullPath] isPendingEntryAtPath: fullPath]) {
+    if ([GWArchiveOperation extractBrowsedEntry: fullPath] == NO) {
+      return NO;
+    }
+  }
+
+  /* the indexer brings what the user looks at up to date first */
+  [[NSDistributedNotificationCenter defaultCenter]
+    postNotificationName: @"GSMetadataPathViewedNotification"
+                  object: fullPath
+                userInfo: nil];
+
   /* Early ELF detection: catch executables regardless of the reported type
      so we can prompt the user before any external app (like TextEdit)
      opens the file. This mirrors the later ELF handling but runs first. */
@@ -2066,6 +2202,18 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
    * - Compressed: gz, bz2, xz, lzma, zstd, lzip
    * - Compressed archives: tar.gz, tar.bz2, tar.xz, tgz, tbz2, etc.
    */
+  /* Archives are browsed from a cached index of their entries, unless
+   * GWBrowseArchivesInPlace is turned off (see GWArchiveIndex). */
+  if ([GWArchiveIndex canBrowseArchiveAtPath:fullPath]
+      && ([[NSUserDefaults standardUserDefaults] objectForKey:@"GWBrowseArchivesInPlace"] == nil
+          || [[NSUserDefaults standardUserDefaults] boolForKey:@"GWBrowseArchivesInPlace"])) {
+    NSString *browsedRoot = [GWArchiveOperation browseArchive:fullPath];
+    if (browsedRoot) {
+      [self newViewerAtPath:browsedRoot];
+    }
+    return (browsedRoot != nil);
+  }
+
   VolumeManager *volMgr = [VolumeManager sharedManager];
   if ([volMgr isAvfsSupportedFile:fullPath]) {
     NSDebugLLog(@"gwspace", @"Workspace: Opening archive via AVFS: %@", fullPath);
@@ -2751,10 +2899,6 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   if ([fsnodeRep usesThumbnails] == NO)
     return;
 
-  NSString *thumbnailDir = [NSSearchPathForDirectoriesInDomains(NSLibraryDirectory, NSUserDomainMask, YES) lastObject];
-
-  thumbnailDir = [thumbnailDir stringByAppendingPathComponent: @"Thumbnails"];
-  
   if (deleted && [deleted count])
     {
       for (i = 0; i < [deleted count]; i++) {
@@ -2773,23 +2917,11 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
     }
 
     if (created && [created count]) {
-      NSString *dictName = @"thumbnails.plist";
-      NSString *dictPath = [thumbnailDir stringByAppendingPathComponent: dictName];
-      
-      if ([fm fileExistsAtPath: dictPath]) {
-        NSDictionary *tdict = [NSDictionary dictionaryWithContentsOfFile: dictPath];
-
-        for (i = 0; i < [created count]; i++) {
-          NSString *key = [created objectAtIndex: i];
-          NSString *dir = [key stringByDeletingLastPathComponent];
-          NSString *tumbname = [tdict objectForKey: key];
-          NSString *tumbpath = [thumbnailDir stringByAppendingPathComponent: tumbname]; 
-
-          if ([fm fileExistsAtPath: tumbpath]) {        
-            if ([tmbdirs containsObject: dir] == NO) {
-              [tmbdirs addObject: dir];
-            }
-          }
+      for (i = 0; i < [created count]; i++) {
+        NSString *dir = [[created objectAtIndex: i] stringByDeletingLastPathComponent];
+
+        if ([tmbdirs containsObject: dir] == NO) {
+          [tmbdirs addObject: dir];
         }
       }
       
@@ -2825,6 +2957,12 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 
 - (void)hiddenFilesDidChange:(NSArray *)paths
 {
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+
+  /* now, not at quit: the indexer and the search tools read them */
+  [defaults setObject: paths forKey: @"hiddendirs"];
+  [defaults synchronize];
+
   [vwrsManager hiddenFilesDidChange: paths];
   [dtopManager hiddenFilesDidChange: paths];
 }
@@ -2912,6 +3050,10 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
                        
 	    [fswatcher registerClient: (id <FSWClientProtocol>)self 
                 isGlobalWatcher: NO];
+      [fswatcher client: (id <FSWClientProtocol>)self setBatchedDelivery: YES];
+      [fswatcher client: (id <FSWClientProtocol>)self 
+            setCoalescingWindow: 0.0
+                       adaptive: YES];
     } else {
       fswnotifications = NO;
       NSDebugLLog(@"gwspace", @"Workspace: unable to contact fswatcher; notifications disabled");
@@ -2976,36 +3118,56 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 - (oneway void)watchedPathDidChange:(NSData *)dirinfo
 {
   CREATE_AUTORELEASE_POOL(arp);
-  NSDictionary *info = [NSUnarchiver unarchiveObjectWithData: dirinfo];
-  NSString *event = [info objectForKey: @"event"];
 
-  NSDebugLLog(@"gwspace", @"DEBUG: Workspace watchedPathDidChange called");
-  NSDebugLLog(@"gwspace", @"DEBUG: event = %@", event);
-  NSDebugLLog(@"gwspace", @"DEBUG: path = %@", [info objectForKey: @"path"]);
-  NSDebugLLog(@"gwspace", @"DEBUG: files = %@", [info objectForKey: @"files"]);
+  FSN_TRACE_SCOPE ("fswatcher dispatch");
 
-  if ([event isEqual: @"GWFileDeletedInWatchedDirectory"]
-            || [event isEqual: @"GWFileCreatedInWatchedDirectory"]) {
-    NSString *path = [info objectForKey: @"path"];
+  fswEventsReceived++;
+  [self _watchedPathDidChange: [NSUnarchiver unarchiveObjectWithData: dirinfo]];
+  RELEASE (arp);                       
+}
 
-    if ([path isEqual: trashPath]) {
-      NSDebugLLog(@"gwspace", @"DEBUG: Trash path changed, updating trash contents");
-      [self _updateTrashContents];
+- (oneway void)watchedPathsDidChange:(NSData *)batch
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  uint64_t sequence = 0;
+  NSArray *records = FSWBatchDecode(batch, &sequence);
+  NSUInteger i, j;
+
+  FSN_TRACE_SCOPE_OP ("fswatcher dispatch", sequence);
+
+  fswBatchesReceived++;
+  fswEventsReceived += [records count];
+
+  for (i = 0; i < [records count]; i++) {
+    NSDictionary *info = [records objectAtIndex: i];
+
+    if ([info objectForKey: @"global"] != nil) {
+      continue;
     }
 
-    if ([event isEqual: @"GWFileCreatedInWatchedDirectory"]
-        && [fsnodeRep usesThumbnails]) {
-      Thumbnailer *t = [Thumbnailer sharedThumbnailer];
-      [t makeThumbnails: path];
-      [t release];
+    if ([[info objectForKey: @"event"] isEqual: FSWRescanEvent]) {
+      NSString *path = [info objectForKey: @"path"];
+
+      NSDebugLLog(@"gwspace", @"Workspace: fswatcher fell behind, rescanning %@", path);
+      [DSStoreInfo invalidateCachedInfoForDirectoryPath: path];
+      for (j = 0; j < [trashPaths count]; j++) {
+        NSString *trash = [trashPaths objectAtIndex: j];
+
+        if ([trash isEqual: path] || isSubpathOfPath(path, trash)) {
+          [self _updateTrashContents];
+          break;
+        }
+      }
+      [vwrsManager rescanSubtreeAtPath: path];
+    } else {
+      [self _watchedPathDidChange: info];
     }
   }
-  
-  NSDebugLLog(@"gwspace", @"DEBUG: Posting GWFileWatcherFileDidChangeNotification");
-	[[NSNotificationCenter defaultCenter]
- 				 postNotificationName: @"GWFileWatcherFileDidChangeNotification"
-	 								     object: info];  
-  RELEASE (arp);                       
+
+  if (sequence > 0) {
+    [fswatcher client: (id <FSWClientProtocol>)self didProcessBatch: sequence];
+  }
+  RELEASE (arp);
 }
 
 - (oneway void)globalWatchedPathDidChange:(NSDictionary *)dirinfo
@@ -3104,6 +3266,20 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   return nil;
 }
 
+- (NSDictionary *)ddbdGetAnnotationsForPaths:(NSArray *)paths
+{
+  if (ddbd != nil && [[(NSDistantObject *)ddbd connectionForProxy] isValid]) {
+    NSData *data = [ddbd annotationsForPaths: 
+                      [NSArchiver archivedDataWithRootObject: paths]];
+
+    if (data) {
+      return [NSUnarchiver unarchiveObjectWithData: data];
+    }
+  }
+  
+  return nil;
+}
+
 - (void)ddbdSetAnnotations:(NSString *)annotations
                    forPath:(NSString *)path
 {
@@ -3167,6 +3343,8 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
                                                  name:NSConnectionDidDieNotification
                                                object:[fswatcher connectionForProxy]];
     [fswatcher registerClient:(id <FSWClientProtocol>)self isGlobalWatcher:NO];
+    [fswatcher client:(id <FSWClientProtocol>)self setBatchedDelivery:YES];
+    [fswatcher client:(id <FSWClientProtocol>)self setCoalescingWindow:0.0 adaptive:YES];
     fswnotifications = YES;
     
     // Register all queued watchers
@@ -3919,6 +4097,9 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 
 - (void)showInspector:(id)sender
 {
+  if (inspector == nil) {
+    [self _createInspector];
+  }
   [inspector activate];
   [inspector setCurrentSelection: selectedPaths];
 }
@@ -3981,10 +4162,7 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 	    {
 	      NSPasteboard *pb = [NSPasteboard generalPasteboard];
 
-	      [pb declareTypes: [NSArray arrayWithObject: NSFilenamesPboardType]
-			 owner: nil];
-
-	      if ([pb setPropertyList: selection forType: NSFilenamesPboardType])
+	      if (FSNWritePathsToPasteboard(selection, pb))
 		{
 		  [fileOpsManager setFilenamesCut: YES];
 		}
@@ -4016,10 +4194,7 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
       if ([selection count] && ([selection isEqual: basesel] == NO)) {
         NSPasteboard *pb = [NSPasteboard generalPasteboard];
 
-        [pb declareTypes: [NSArray arrayWithObject: NSFilenamesPboardType]
-                   owner: nil];
-
-        if ([pb setPropertyList: selection forType: NSFilenamesPboardType]) {
+        if (FSNWritePathsToPasteboard(selection, pb)) {
           [fileOpsManager setFilenamesCut: NO];
         }
       }
@@ -4064,7 +4239,7 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
             }  
 
             if (cut) {
-              if ([source isEqual: trashPath]) {
+              if ([self isTrashPath: source]) {
                 operation = @"WorkspaceRecycleOutOperation";
               } else {
 		            operation = NSWorkspaceMoveOperation;
@@ -4099,42 +4274,68 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 - (void)emptyTrash:(id)sender
 {
   CREATE_AUTORELEASE_POOL(arp);
-  FSNode *node = [FSNode nodeWithPath: trashPath];
-  NSMutableArray *subNodes = [[node subNodes] mutableCopy];
-  int count = [subNodes count];
-  NSUInteger i;  
-  
-  for (i = 0; i < count; i++)
-    {
-      FSNode *nd = [subNodes objectAtIndex: i];
+  NSMutableArray *opinfos = [NSMutableArray array];
+  NSArray *paths;
+  NSUInteger i;
 
-      if ([nd isReserved])
-	{
-	  [subNodes removeObjectAtIndex: i];
-	  i--;
-	  count --;
-	}
-    }
-  
-  if ([subNodes count])
+  /* what the operation removes is what is on disk, not what was seen */
+  [self _updateTrashContents];
+  paths = [trashContents allKeys];
+
+  /* one operation for each trash that has something */
+  for (i = 0; i < [trashPaths count]; i++)
     {
+      NSString *trash = [trashPaths objectAtIndex: i];
       NSMutableArray *files = [NSMutableArray array];
-      NSMutableDictionary *opinfo = [NSMutableDictionary dictionary];
+      NSUInteger j;
 
-      for (i = 0; i < [subNodes count]; i++)
-	{
-	  [files addObject: [[(FSNode *)[subNodes objectAtIndex: i] path] lastPathComponent]];
-	}
+      for (j = 0; j < [paths count]; j++)
+        {
+          NSString *path = [paths objectAtIndex: j];
 
-      [opinfo setObject: @"WorkspaceemptyTrashOperation" forKey: @"operation"];
-      [opinfo setObject: trashPath forKey: @"source"];
-      [opinfo setObject: trashPath forKey: @"destination"];
-      [opinfo setObject: files forKey: @"files"];
+          if ([[path stringByDeletingLastPathComponent] isEqual: trash])
+            [files addObject: [path lastPathComponent]];
+        }
 
-      [self performFileOperation: opinfo];
+      if ([files count])
+        {
+          NSMutableDictionary *opinfo = [NSMutableDictionary dictionary];
+
+          [opinfo setObject: @"WorkspaceemptyTrashOperation" forKey: @"operation"];
+          [opinfo setObject: trash forKey: @"source"];
+          [opinfo setObject: trash forKey: @"destination"];
+          [opinfo setObject: [files sortedArrayUsingSelector: @selector(compare:)]
+                     forKey: @"files"];
+          [opinfos addObject: opinfo];
+        }
+    }
+
+  /* asked once here rather than once for each of them */
+  if (([opinfos count] > 1)
+      && ([[NSUserDefaults standardUserDefaults]
+            boolForKey: @"WorkspaceemptyTrashOperationConfirm"] == NO))
+    {
+      if (NSRunAlertPanel(NSLocalizedString(@"Recycler", @""),
+                          NSLocalizedString(@"Empty the Recycler?", @""),
+                          NSLocalizedString(@"OK", @""),
+                          NSLocalizedString(@"Cancel", @""),
+                          nil) != NSAlertDefaultReturn)
+        {
+          [opinfos removeAllObjects];
+        }
+
+      for (i = 0; i < [opinfos count]; i++)
+        {
+          [[opinfos objectAtIndex: i] setObject: [NSNumber numberWithBool: YES]
+                                         forKey: @"confirmed"];
+        }
+    }
+
+  for (i = 0; i < [opinfos count]; i++)
+    {
+      [self performFileOperation: [opinfos objectAtIndex: i]];
     }
 
-  RELEASE (subNodes);
   RELEASE (arp);
 }
 
@@ -4158,41 +4359,29 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
 
 - (void)updateOpenWithMenu
 {
+  NSArray *apps = [NSArray array];
+  NSUInteger i;
+
   if (openWithMenu == nil)
     return;
 
-  while ([openWithMenu numberOfItems] > 0)
-    [openWithMenu removeItemAtIndex: 0];
+  if (selectedPaths && [selectedPaths count])
+    apps = [[GWAppRegistry sharedRegistry] applicationsForFiles: selectedPaths];
 
-  if (selectedPaths == nil || [selectedPaths count] == 0)
+  /* the items stay while the selection is opened by the same apps */
+  if (openWithApps && [apps isEqualToArray: openWithApps])
     return;
 
-  NSString *firstext = [[[selectedPaths objectAtIndex: 0] pathExtension] lowercaseString];
-  if ([firstext length] == 0)
-    {
-      firstext = [[[selectedPaths objectAtIndex: 0] lastPathComponent] lowercaseString];
-    }
-  for (NSUInteger i = 1; i < [selectedPaths count]; i++)
-    {
-      NSString *ext = [[[selectedPaths objectAtIndex: i] pathExtension] lowercaseString];
-      if ([ext length] == 0)
-        {
-          ext = [[[selectedPaths objectAtIndex: i] lastPathComponent] lowercaseString];
-        }
-      if ([ext isEqual: firstext] == NO)
-        return;
-    }
+  ASSIGN (openWithApps, apps);
 
-  NSDictionary *apps = [ws infoForExtension: firstext];
-  if (apps == nil || [apps count] == 0)
-    return;
+  while ([openWithMenu numberOfItems] > 0)
+    [openWithMenu removeItemAtIndex: 0];
 
-  NSEnumerator *appEnum = [[apps allKeys] objectEnumerator];
-  NSString *key;
-  while ((key = [appEnum nextObject]))
+  for (i = 0; i < [apps count]; i++)
     {
       NSMenuItem *appItem = [NSMenuItem new];
-      key = [key stringByDeletingPathExtension];
+      NSString *key = [[apps objectAtIndex: i] stringByDeletingPathExtension];
+
       [appItem setTitle: key];
       [appItem setTarget: self];
       [appItem setAction: @selector(openSelectionWithApp:)];
@@ -4270,6 +4459,11 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   [fileOpsManager setFilenamesCut: value];
 }
 
+- (NSArray *)fileOperationsProgress
+{
+  return [fileOpsManager operationsProgress];
+}
+
 - (void)lsfolderDragOperation:(NSData *)opinfo
               concludedAtPath:(NSString *)path
 {
@@ -4352,16 +4546,29 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   }
 }
 
+- (NSUInteger)trashItemCount
+{
+  return [trashContents count];
+}
+
+- (unsigned long long)trashSize
+{
+  return trashBytes;
+}
+
 - (NSString *)trashPath
 {
-  static NSString *tpath = nil;
-  
-  if (tpath == nil) {
-    tpath = [NSHomeDirectory() stringByAppendingPathComponent: @".Trash"]; 
-    RETAIN (tpath);
-  }
-  
-  return tpath;
+  return [FSNTrash homeTrashPath];
+}
+
+- (NSArray *)trashPaths
+{
+  return trashPaths;
+}
+
+- (BOOL)isTrashPath:(NSString *)path
+{
+  return (path && [trashPaths containsObject: path]);
 }
 
 - (BOOL)isRootFilesystem:(NSString *)path
@@ -4455,7 +4662,6 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
   NSMenu *menu;
   NSMenuItem *menuItem;
   NSString *firstext;
-  NSDictionary *apps;
   NSEnumerator *app_enum;
   id key;
   NSUInteger i;
@@ -4548,8 +4754,9 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
       [menuItem setEnabled: YES];
       NSMenu *owMenu = [[NSMenu alloc] initWithTitle: @""];
       
-      apps = [[NSWorkspace sharedWorkspace] infoForExtension: firstext];
-      app_enum = [[apps allKeys] objectEnumerator];
+      app_enum = [[[GWAppRegistry sharedRegistry]
+                    applicationsForTypes: [NSSet setWithObject: [firstext lowercaseString]]]
+                   objectEnumerator];
       
       while ((key = [app_enum nextObject])) {
         NSMenuItem *appItem = [NSMenuItem new];
@@ -4697,7 +4904,8 @@ static BOOL swizzled_getInfoForFile(id self, SEL _cmd, NSString *fullPath, NSStr
       NSString *nodePath = [node path];
       
       // Disable if item is in trash
-      if ([nodePath hasPrefix: trashPath]) {
+      if ([nodePath hasPrefix: trashPath]
+            || [self isTrashPath: [nodePath stringByDeletingLastPathComponent]]) {
         canRecycle = NO;
         break;
       }
@@ -4886,9 +5094,8 @@ static DSStoreLabelColor GSFileLabelToDSStoreLabelColor(GSFileLabel gsLabel)
             [dsInfo setIconInfo: iconInfo forFilename: filename];
           }
 
-        GWViewSettingsManager *sm;
-        sm = [GWViewSettingsManager managerForDirectoryPath: dirPath];
-        BOOL wrote = [sm writeSettings: dsInfo];
+        BOOL wrote = [[GWIconPositionStore sharedStore] writeSettings: dsInfo
+                                                            forFolder: dirPath];
         NSDebugLLog(@"gwspace", @"setLabelForNodes: wrote %s for %@ (%lu files)",
                     wrote ? "OK" : "FAIL", dirPath,
                     (unsigned long)[files count]);
@@ -5128,6 +5335,11 @@ static DSStoreLabelColor GSFileLabelToDSStoreLabelColor(GSFileLabel gsLabel)
   if (!selection || [selection count] == 0)
     return;
 
+  /* "zip", "tar.gz", "tar.xz" or "tar.zst"; the tar ones use all cores */
+  GWArchiveFormat format = [GWMetaArchive formatForExtension:
+    [[NSUserDefaults standardUserDefaults] stringForKey: @"GWArchiveFormat"]];
+  NSString *ext = [GWMetaArchive extensionForFormat: format];
+
   /* Build a default output name from the first item */
   NSString *firstName = [[selection objectAtIndex: 0] lastPathComponent];
   NSString *baseName  = [firstName stringByDeletingPathExtension];
@@ -5136,7 +5348,7 @@ static DSStoreLabelColor GSFileLabelToDSStoreLabelColor(GSFileLabel gsLabel)
 
   NSString *parentDir = [[selection objectAtIndex: 0] stringByDeletingLastPathComponent];
   NSString *outputPath = [parentDir stringByAppendingPathComponent:
-                           [baseName stringByAppendingPathExtension: @"zip"]];
+                           [baseName stringByAppendingPathExtension: ext]];
 
   /* If the default name already exists, append a number */
   NSFileManager *fileMgr = [NSFileManager defaultManager];
@@ -5146,15 +5358,17 @@ static DSStoreLabelColor GSFileLabelToDSStoreLabelColor(GSFileLabel gsLabel)
       do {
         NSString *tryName = [NSString stringWithFormat: @"%@ %lu", baseName, (unsigned long)n];
         outputPath = [parentDir stringByAppendingPathComponent:
-                       [tryName stringByAppendingPathExtension: @"zip"]];
+                       [tryName stringByAppendingPathExtension: ext]];
         n++;
       } while ([fileMgr fileExistsAtPath: outputPath]);
     }
 
   /* Run with progress panel */
-  [GWArchiveOperation compressPaths: selection toArchive: outputPath];
+  [GWArchiveOperation compressPaths: selection
+                          toArchive: outputPath
+                             format: format];
 
-  /* Refresh the viewer so the new .zip appears */
+  /* Refresh the viewer so the new archive appears */
   if ([vwrsManager hasViewerWithWindow: kwin])
     [[vwrsManager viewerWithWindow: kwin] reloadNodeContents];
   else if ([dtopManager hasWindow: kwin])
@@ -5735,23 +5949,6 @@ static BOOL GWWaitForTaskExit(NSTask *task, NSTimeInterval timeout)
   [self emptyTrash:nil];
 }
 
-#if HAVE_DBUS
-- (void)processDBusMessages:(NSNotification *)notification
-{
-  // Process D-Bus messages for FileManager1 service
-  // This is called automatically when data is available on the D-Bus file descriptor
-  if (fileManagerDBusInterface && [fileManagerDBusInterface dbusConnection]) {
-    [[fileManagerDBusInterface dbusConnection] processMessages];
-  }
-  
-  // Re-arm the notification for next message
-  NSFileHandle *fileHandle = [notification object];
-  if (fileHandle) {
-    [fileHandle waitForDataInBackgroundAndNotify];
-  }
-}
-#endif
-
 @end
 
 
@@ -5775,24 +5972,347 @@ static BOOL GWWaitForTaskExit(NSTask *task, NSTimeInterval timeout)
 
 @implementation	Workspace (PrivateMethods)
 
+- (void)_createInspector
+{
+  NSHelpManager *manager = [NSHelpManager sharedHelpManager];
+
+  inspector = [Inspector new];
+  [manager setContextHelp: (NSAttributedString *)@"Inspector.rtfd"
+                forObject: [[inspector win] contentView]];
+}
+
+/* The bundles nothing needs before the desktop is on screen are loaded
+   one at a time when the run loop has nothing else to do, the first use of
+   any of them loading it earlier. */
+- (void)_startDeferredLoads
+{
+  deferredLoads = [[NSMutableArray alloc] initWithObjects:
+                                            @"thumbnailers",
+                                            @"extended info",
+                                            @"finder modules",
+                                            @"applications",
+                                            @"viewer windows",
+                                            @"archive cache",
+                                            nil];
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(_deferredLoadWhenIdle:)
+                                               name: @"GWDeferredLoadNotification"
+                                             object: self];
+  [[NSNotificationQueue defaultQueue]
+    enqueueNotification: [NSNotification notificationWithName: @"GWDeferredLoadNotification"
+                                                       object: self]
+           postingStyle: NSPostWhenIdle];
+}
+
+- (void)_deferredLoadWhenIdle:(NSNotification *)notif
+{
+  NSString *what;
+
+  if ([deferredLoads count] == 0) {
+    return;
+  }
+
+  what = RETAIN ([deferredLoads objectAtIndex: 0]);
+  [deferredLoads removeObjectAtIndex: 0];
+
+  if ([what isEqual: @"thumbnailers"]) {
+    if ([fsnodeRep usesThumbnails]) {
+      /* the workers can load them as well, under the same lock */
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        CREATE_AUTORELEASE_POOL(arp);
+        [[Thumbnailer sharedThumbnailer] loadThumbnailersIfNeeded];
+        RELEASE (arp);
+      });
+    }
+  } else if ([what isEqual: @"extended info"]) {
+    [fsnodeRep availableExtendedInfoNames];
+  } else if ([what isEqual: @"finder modules"]) {
+    [finder loadModulesIfNeeded];
+  } else if ([what isEqual: @"applications"]) {
+    GWAppRegistry *registry = [GWAppRegistry sharedRegistry];
+
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+      CREATE_AUTORELEASE_POOL(arp);
+      [registry build];
+      dispatch_async(dispatch_get_main_queue(), ^{
+        [self _updateApplicationWatchers];
+      });
+      RELEASE (arp);
+    });
+  } else if ([what isEqual: @"viewer windows"]) {
+    [vwrsManager fillSpareWindows];
+  } else if ([what isEqual: @"archive cache"]) {
+    /* the browsed archives deleted since the last run */
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+      CREATE_AUTORELEASE_POOL(arp);
+      [GWArchiveIndex pruneCacheKeeping: nil];
+      RELEASE (arp);
+    });
+  }
+  RELEASE (what);
+
+  if ([deferredLoads count]) {
+    [[NSNotificationQueue defaultQueue] enqueueNotification: notif
+                                               postingStyle: NSPostWhenIdle];
+  } else {
+    [[NSNotificationCenter defaultCenter] removeObserver: self
+                                                    name: @"GWDeferredLoadNotification"
+                                                  object: self];
+    DESTROY (deferredLoads);
+  }
+}
+
+/*
+ * Every trash read again, the home trash and those of the mounted
+ * volumes: at launch, when a volume comes or goes, and when fswatcher
+ * fell behind.  What is recycled on a volume stays there, so it counts
+ * for the trash icons and goes with Empty Trash like the rest.
+ */
 - (void)_updateTrashContents
 {
-  FSNode *node = [FSNode nodeWithPath: trashPath];
+  NSUInteger i;
+
+  [self _setTrashPaths: [FSNTrash trashPathsOfVolumes: [ws mountedLocalVolumePaths]]];
 
   [trashContents removeAllObjects];
+  [trashSizes removeAllObjects];
+  trashBytes = 0;
 
-  if (node && [node isValid]) {
-    NSArray *subNodes = [node subNodes];
-    NSUInteger i;
+  for (i = 0; i < [trashPaths count]; i++) {
+    FSNode *node = [FSNode nodeWithPath: [trashPaths objectAtIndex: i]];
 
-    for (i = 0; i < [subNodes count]; i++) {
-      FSNode *subnode = [subNodes objectAtIndex: i];
+    if (node && [node isValid]) {
+      NSArray *subNodes = [node subNodes];
+      NSUInteger j;
 
-      if ([subnode isReserved] == NO) {
-	[trashContents addObject: subnode];
+      for (j = 0; j < [subNodes count]; j++) {
+        [self _syncTrashEntry: [[subNodes objectAtIndex: j] path]];
       }
     }
   }
+
+  [self _trashContentsDidChange];
+}
+
+/* Only the entries an event or an operation names are looked at again. */
+- (void)_updateTrashContentsForFiles:(NSArray *)files
+                             inTrash:(NSString *)trash
+{
+  BOOL changed = NO;
+  NSUInteger i;
+
+  if (files == nil) {
+    [self _updateTrashContents];
+    return;
+  }
+
+  for (i = 0; i < [files count]; i++) {
+    NSString *name = [files objectAtIndex: i];
+
+    if ([name length] && ([name rangeOfString: @"/"].location == NSNotFound)) {
+      changed |= [self _syncTrashEntry: [trash stringByAppendingPathComponent: name]];
+    }
+  }
+
+  if (changed) {
+    [self _trashContentsDidChange];
+  }
+}
+
+/* The volume trashes are watched here, the home trash by the Dock. */
+- (void)_setTrashPaths:(NSArray *)paths
+{
+  NSUInteger i;
+
+  for (i = 1; i < [trashPaths count]; i++) {
+    NSString *trash = [trashPaths objectAtIndex: i];
+
+    if ([paths containsObject: trash] == NO) {
+      [self removeWatcherForPath: trash];
+    }
+  }
+
+  for (i = 1; i < [paths count]; i++) {
+    NSString *trash = [paths objectAtIndex: i];
+
+    if ([trashPaths containsObject: trash] == NO) {
+      [self addWatcherForPath: trash];
+    }
+  }
+
+  ASSIGN (trashPaths, paths);
+}
+
+- (void)_volumesDidChange:(NSNotification *)notif
+{
+  [self _updateTrashContents];
+}
+
+/* Brings the entry for `path` in line with the trash on disk; YES when
+   it was added, removed or replaced. */
+- (BOOL)_syncTrashEntry:(NSString *)path
+{
+  FSNode *old = [trashContents objectForKey: path];
+  FSNode *node = nil;
+  struct stat st;
+
+  if ([fsnodeRep isReservedName: [path lastPathComponent]] == NO) {
+    if (lstat([path fileSystemRepresentation], &st) == 0) {
+      node = [FSNode nodeWithPath: path];
+    }
+  }
+
+  if ((old == nil) && (node == nil)) {
+    return NO;
+  }
+
+  if (old) {
+    trashBytes -= [[trashSizes objectForKey: path] unsignedLongLongValue];
+    [trashSizes removeObjectForKey: path];
+    [trashContents removeObjectForKey: path];
+  }
+
+  if (node) {
+    [trashContents setObject: node forKey: path];
+
+    if (S_ISDIR(st.st_mode)) {
+      /* what is beneath comes in when the walk completes, off this thread */
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        CREATE_AUTORELEASE_POOL(arp);
+        FSNSizeTotals totals;
+
+        [[FSNSizeCache sharedCache] computeTotals: &totals
+                                          ofPaths: [NSArray arrayWithObject: path]
+                                         interval: 1.0
+                                         progress: nil];
+        dispatch_async(dispatch_get_main_queue(), ^{
+          [self _trashNode: node hasSize: totals.apparent];
+        });
+        RELEASE (arp);
+      });
+    } else {
+      trashBytes += (unsigned long long)st.st_size;
+      [trashSizes setObject: [NSNumber numberWithUnsignedLongLong: st.st_size]
+                     forKey: path];
+    }
+  }
+
+  return YES;
+}
+
+- (void)_trashNode:(FSNode *)node hasSize:(unsigned long long)bytes
+{
+  NSString *path = [node path];
+
+  /* a walk for an entry that has gone, or was replaced, since */
+  if ([trashContents objectForKey: path] != node) {
+    return;
+  }
+
+  trashBytes -= [[trashSizes objectForKey: path] unsignedLongLongValue];
+  trashBytes += bytes;
+  [trashSizes setObject: [NSNumber numberWithUnsignedLongLong: bytes]
+                 forKey: path];
+
+  [self _trashContentsDidChange];
+}
+
+/* For the Dock and desktop trash icons, which no longer read the trash. */
+- (void)_trashContentsDidChange
+{
+  NSDictionary *info;
+
+  info = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithUnsignedInteger: [trashContents count]], @"count",
+                         [NSNumber numberWithUnsignedLongLong: trashBytes], @"size",
+                         nil];
+
+  [[NSNotificationCenter defaultCenter]
+       postNotificationName: @"GWTrashContentsDidChangeNotification"
+                     object: self
+                   userInfo: info];
+}
+
+/* Watches what the application registry read, and no more. */
+- (void)_updateApplicationWatchers
+{
+  NSArray *dirs = [[GWAppRegistry sharedRegistry] watchedDirectories];
+  NSUInteger i;
+
+  for (i = 0; i < [appWatchedDirs count]; i++) {
+    NSString *dir = [appWatchedDirs objectAtIndex: i];
+
+    if ([dirs containsObject: dir] == NO) {
+      [self removeWatcherForPath: dir];
+    }
+  }
+
+  for (i = 0; i < [dirs count]; i++) {
+    NSString *dir = [dirs objectAtIndex: i];
+
+    if ([appWatchedDirs containsObject: dir] == NO) {
+      [self addWatcherForPath: dir];
+    }
+  }
+
+  ASSIGN (appWatchedDirs, dirs);
+}
+
+- (void)_applicationDirectoryDidChange:(NSString *)path
+{
+  if ([[GWAppRegistry sharedRegistry] applicationDirectoryDidChange: path]) {
+    [self _updateApplicationWatchers];
+    [self updateOpenWithMenu];
+  }
+}
+
+- (void)_watchedPathDidChange:(NSDictionary *)info
+{
+  NSString *event = [info objectForKey: @"event"];
+
+  NSDebugLLog(@"gwspace", @"DEBUG: Workspace watchedPathDidChange called");
+  NSDebugLLog(@"gwspace", @"DEBUG: event = %@", event);
+  NSDebugLLog(@"gwspace", @"DEBUG: path = %@", [info objectForKey: @"path"]);
+  NSDebugLLog(@"gwspace", @"DEBUG: files = %@", [info objectForKey: @"files"]);
+
+  if ([event isEqual: @"GWFileDeletedInWatchedDirectory"]
+            || [event isEqual: @"GWFileCreatedInWatchedDirectory"]) {
+    NSString *path = [info objectForKey: @"path"];
+
+    if ([self isTrashPath: path]) {
+      NSDebugLLog(@"gwspace", @"DEBUG: Trash path changed, updating trash contents");
+      [self _updateTrashContentsForFiles: [info objectForKey: @"files"]
+                                 inTrash: path];
+    }
+
+    if ([appWatchedDirs containsObject: path]) {
+      [self _applicationDirectoryDidChange: path];
+    }
+  }
+
+  if ([fsnodeRep usesThumbnails]) {
+    [[Thumbnailer sharedThumbnailer] watchedPathDidChange: info];
+  }
+  
+  /* Whatever changed in the directory, its shared DSStoreInfo is suspect */
+  {
+    NSString *path = [info objectForKey: @"path"];
+
+    [DSStoreInfo invalidateCachedInfoForDirectoryPath: path];
+    if ([[path lastPathComponent] isEqual: @".DS_Store"]) {
+      [DSStoreInfo invalidateCachedInfoForDirectoryPath:
+                     [path stringByDeletingLastPathComponent]];
+    }
+  }
+
+  /* the viewers, their shelves and sidebars get the events at the paths
+     they registered; the notification is for those that want them all */
+  [[GWWatchDispatcher sharedDispatcher] dispatchWatcherInfo: info];
+
+  NSDebugLLog(@"gwspace", @"DEBUG: Posting GWFileWatcherFileDidChangeNotification");
+	[[NSNotificationCenter defaultCenter]
+ 				 postNotificationName: @"GWFileWatcherFileDidChangeNotification"
+	 								     object: info];  
 }
 
 @end
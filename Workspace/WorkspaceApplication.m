@@ -34,6 +34,7 @@
 #import "GWFunctions.h"
 #import "FSNodeRep.h"
 #import "FSNFunctions.h"
+#import "FSNTypeResolver.h"
 #import "Workspace.h"
 #import "GWDesktopManager.h"
 #import "Dock.h"
@@ -542,7 +543,6 @@
 		            arguments:(NSArray *)args
 {
   NSString *appPath, *appName;
-  NSTask *task;
   GWLaunchedApp *app;
   NSString *path;
   NSDictionary *userinfo;
@@ -586,6 +586,7 @@
   
   if (appPath == nil) {
     [ws findApplications];
+    [[FSNTypeResolver sharedResolver] invalidateApplications];
     [self applicationName: &appName andPath: &appPath forName: appname];
   }
 
@@ -647,28 +648,17 @@
 
   /* Use GWApplicationLauncher to get same error handling as ELF binaries */
   NSDebugLLog(@"gwspace", @"launchApplication: launching binary: %@ with args: %@", path, args);
-  task = [[NSTask alloc] init];
-  [task setLaunchPath:path];
-  [task setArguments:args];
+  pid_t pid = [GWApplicationLauncher spawnAndMonitor:path withArguments:args];
+  NSDebugLLog(@"gwspace", @"launchApplication: launched pid=%d", (int)pid);
 
-  BOOL launched = [GWApplicationLauncher launchAndMonitorTask:task];
-  NSDebugLLog(@"gwspace", @"launchApplication: launched=%d", launched);
-
-  if (!launched) {
+  if (pid == 0) {
     NSDebugLLog(@"gwspace", @"launchApplication: GWApplicationLauncher failed for %@", path);
-    [task release];
     return NO;
   }
   
-  /* Create GWLaunchedApp immediately with the PID from the task.
+  /* Create GWLaunchedApp immediately with the PID of the launch.
    * For GNUstep apps, the appDidLaunch notification will update this entry.
    * For non-GNUstep apps, we need this entry for X11AppManager registration. */
-  pid_t pid = 0;
-  @try {
-    pid = [task processIdentifier];
-  } @catch (NSException *ex) {
-    pid = 0;
-  }
   
   NSNumber *pidNumber = [NSNumber numberWithInt:(int)pid];
   app = [GWLaunchedApp appWithApplicationPath:appPath
@@ -694,7 +684,6 @@
     }
   }
   
-  [task release];
   return YES;    
 }
 
@@ -1060,6 +1049,25 @@
   [self _cancelLaunchDotFallbackForPath:appPath name:appName];
 }
 
+- (void)x11AppHiddenStateDidChange:(NSString *)appName
+                              path:(NSString *)appPath
+                            hidden:(BOOL)hidden
+{
+  GWLaunchedApp *app = [self launchedAppWithPath: appPath andName: appName];
+
+  /* GNUstep apps tell their hiding themselves */
+  if (app == nil || [app isX11App] == NO) return;
+
+  GWDebugLog(@"X11 app %@: %@", hidden ? @"hidden" : @"unhidden", appName);
+  [app setHidden: hidden];
+
+  if (hidden) {
+    [[dtopManager dock] appDidHide: appName];
+  } else {
+    [[dtopManager dock] appDidUnhide: appName];
+  }
+}
+
 #pragma mark - X11 Activation (non-GNUstep apps)
 
 - (BOOL)_x11ActivateForApp:(GWLaunchedApp *)app name:(NSString *)name
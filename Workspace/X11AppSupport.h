@@ -13,8 +13,9 @@
  * X11AppSupport provides native X11 window management for non-GNUstep
  * applications in the Dock.
  *
- * This uses Xlib directly for window operations and simple timer-based
- * polling (250ms) to monitor process lifecycle.
+ * This uses Xlib directly for window operations.  The windows of the
+ * registered applications are tracked from PropertyNotify events on the
+ * root window and on the client windows.
  */
 
 @class GWLaunchedApp;
@@ -32,6 +33,7 @@
     pid_t ownerPID;
     BOOL isHidden;
     BOOL isIconified;
+    BOOL skipsTaskbar;
 }
 
 @property (nonatomic, assign) unsigned long windowID;
@@ -40,6 +42,7 @@
 @property (nonatomic, assign) pid_t ownerPID;
 @property (nonatomic, assign) BOOL isHidden;
 @property (nonatomic, assign) BOOL isIconified;
+@property (nonatomic, assign) BOOL skipsTaskbar;
 
 + (instancetype)infoWithWindowID:(unsigned long)wid;
 
@@ -239,20 +242,37 @@
 - (void)x11AppDidTerminate:(NSString *)appName path:(NSString *)appPath;
 - (void)x11AppWindowsDidAppear:(NSString *)appName path:(NSString *)appPath;
 
+@optional
+/**
+ * Sent when all the windows of the app got iconified or hidden, or one of
+ * them came back.
+ */
+- (void)x11AppHiddenStateDidChange:(NSString *)appName
+                              path:(NSString *)appPath
+                            hidden:(BOOL)hidden;
+
 @end
 
 /**
  * Manages X11 (non-GNUstep) applications for dock integration,
  * window management, and process lifecycle monitoring.
  *
- * Uses simple 250ms timer polling to check process status - efficient
- * and portable across all Unix-like systems.
- */
-@interface GWX11AppManager : NSObject
+ * While apps are registered it keeps its own X connection, listening to
+ * PropertyNotify for _NET_CLIENT_LIST on the root window and for the state
+ * and name of each client window, and updates a table of the client
+ * windows by window ID and PID from the events.  Processes are checked
+ * when their windows go away; a one second liveness timer runs only while
+ * some registered app has no window.
+ */
+@interface GWX11AppManager : NSObject <RunLoopEvents>
 {
     NSMutableDictionary *x11Apps;
     NSTimer *monitorTimer;
     id<GWX11AppManagerDelegate> delegate;
+
+    void *display;
+    NSMutableDictionary *clientWindows;
+    NSMutableDictionary *pidWindows;
 }
 
 @property (nonatomic, assign) id<GWX11AppManagerDelegate> delegate;
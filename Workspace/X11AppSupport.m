@@ -18,6 +18,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <stdint.h>
 
 #pragma mark - X11 Error Handler
 
@@ -43,6 +44,20 @@ static void ensureX11ErrorHandler(void)
     }
 }
 
+#pragma mark - GWX11WindowManager Private Interface
+
+/* The helpers GWX11AppManager uses on its own connection */
+@interface GWX11WindowManager ()
+- (Display *)openDisplay;
+- (Window *)getClientList:(Display *)dpy count:(unsigned long *)count;
+- (pid_t)getPIDForWindow:(Display *)dpy window:(Window)win;
+- (NSString *)getWindowName:(Display *)dpy window:(Window)win;
+- (BOOL)isWindowHidden:(Display *)dpy window:(Window)win;
+- (BOOL)hasNetWmStateSkipTaskbar:(Display *)dpy window:(Window)win;
+- (BOOL)checkWindowIconified:(Display *)dpy window:(Window)win;
+- (GWX11WindowInfo *)infoForWindow:(Display *)dpy window:(Window)win;
+@end
+
 #pragma mark - GWX11WindowInfo Implementation
 
 @implementation GWX11WindowInfo
@@ -53,6 +68,7 @@ static void ensureX11ErrorHandler(void)
 @synthesize ownerPID;
 @synthesize isHidden;
 @synthesize isIconified;
+@synthesize skipsTaskbar;
 
 + (instancetype)infoWithWindowID:(unsigned long)wid
 {
@@ -301,6 +317,7 @@ static GWX11WindowManager *sharedWindowManager = nil;
     info.ownerPID = [self getPIDForWindow:dpy window:win];
     info.isHidden = [self isWindowHidden:dpy window:win];
     info.isIconified = [self checkWindowIconified:dpy window:win];
+    info.skipsTaskbar = [self hasNetWmStateSkipTaskbar:dpy window:win];
     return info;
 }
 
@@ -922,16 +939,18 @@ static BOOL stringStartsOrEndsWith(NSString *str, NSString *word)
     NSString *windowSearchString;
     pid_t pid;
     BOOL hasWindowAppeared;
+    BOOL windowsHidden;
 }
 @property (nonatomic, copy) NSString *appName;
 @property (nonatomic, copy) NSString *appPath;
 @property (nonatomic, copy) NSString *windowSearchString;
 @property (nonatomic, assign) pid_t pid;
 @property (nonatomic, assign) BOOL hasWindowAppeared;
+@property (nonatomic, assign) BOOL windowsHidden;
 @end
 
 @implementation GWX11AppInfo
-@synthesize appName, appPath, windowSearchString, pid, hasWindowAppeared;
+@synthesize appName, appPath, windowSearchString, pid, hasWindowAppeared, windowsHidden;
 
 - (void)dealloc
 {
@@ -942,6 +961,20 @@ static BOOL stringStartsOrEndsWith(NSString *str, NSString *word)
 }
 @end
 
+#pragma mark - GWX11AppManager Private Interface
+
+@interface GWX11AppManager ()
+- (void)startMonitoring;
+- (void)stopMonitoring;
+- (void)updateLivenessTimer;
+- (void)checkApps:(BOOL)clientListChanged;
+- (void)startWindowTracking;
+- (void)stopWindowTracking;
+- (void)updateClientList;
+- (void)rebuildPIDIndex;
+- (void)processX11Events;
+@end
+
 #pragma mark - GWX11AppManager Implementation
 
 @implementation GWX11AppManager
@@ -960,6 +993,36 @@ static GWX11AppManager *sharedX11AppManager = nil;
     return sharedX11AppManager;
 }
 
+/* Atoms of the window tracking connection */
+static Atom netClientListAtom = None;
+static Atom netWmStateAtom = None;
+static Atom netWmNameAtom = None;
+static Atom netWmPidAtom = None;
+static Atom wmStateAtom = None;
+
+/* The run loop modes the tracking connection is watched in, so the Dock
+ * follows the apps while a menu is tracked or a panel is modal */
+static NSArray *x11RunLoopModes(void)
+{
+    static NSArray *modes = nil;
+    if (modes == nil) {
+        modes = [[NSArray alloc] initWithObjects:NSDefaultRunLoopMode,
+                                                 NSModalPanelRunLoopMode,
+                                                 NSEventTrackingRunLoopMode, nil];
+    }
+    return modes;
+}
+
+static NSNumber *windowKey(Window win)
+{
+    return [NSNumber numberWithUnsignedLong:(unsigned long)win];
+}
+
+static NSNumber *pidKey(pid_t pid)
+{
+    return [NSNumber numberWithInt:(int)pid];
+}
+
 - (id)init
 {
     self = [super init];
@@ -967,14 +1030,20 @@ static GWX11AppManager *sharedX11AppManager = nil;
         x11Apps = [[NSMutableDictionary alloc] init];
         monitorTimer = nil;
         delegate = nil;
+        display = NULL;
+        clientWindows = [[NSMutableDictionary alloc] init];
+        pidWindows = [[NSMutableDictionary alloc] init];
     }
     return self;
 }
 
 - (void)dealloc
 {
+    [self stopWindowTracking];
     [monitorTimer invalidate];
     RELEASE(x11Apps);
+    RELEASE(clientWindows);
+    RELEASE(pidWindows);
     [super dealloc];
 }
 
@@ -986,27 +1055,81 @@ static GWX11AppManager *sharedX11AppManager = nil;
     return (errno == EPERM);
 }
 
-- (void)startMonitorTimer
+#pragma mark Monitoring
+
+- (void)startMonitoring
 {
-    if (monitorTimer == nil && [x11Apps count] > 0) {
-        /* Use faster initial polling (100ms) for quicker window detection */
-        monitorTimer = [NSTimer scheduledTimerWithTimeInterval:0.1
+    if ([x11Apps count] > 0) {
+        [self startWindowTracking];
+        [self checkApps:YES];
+    }
+}
+
+- (void)stopMonitoring
+{
+    if ([x11Apps count] == 0) {
+        [self stopWindowTracking];
+    }
+    [self updateLivenessTimer];
+}
+
+/* A process is checked when its last window leaves the client list.  One
+ * with no window in the table (still launching, windowless, or found by
+ * name only) can exit unnoticed, so the timer runs while there is one. */
+- (void)updateLivenessTimer
+{
+    BOOL needed = NO;
+
+    for (GWX11AppInfo *info in [x11Apps objectEnumerator]) {
+        if ([[pidWindows objectForKey:pidKey(info.pid)] count] == 0) {
+            needed = YES;
+            break;
+        }
+    }
+
+    if (needed && monitorTimer == nil) {
+        monitorTimer = [NSTimer scheduledTimerWithTimeInterval:1.0
                                                         target:self
                                                       selector:@selector(monitorTimerFired:)
                                                       userInfo:nil
                                                        repeats:YES];
+    } else if (!needed && monitorTimer) {
+        [monitorTimer invalidate];
+        monitorTimer = nil;
     }
 }
 
-- (void)stopMonitorTimer
+- (void)monitorTimerFired:(NSTimer *)timer
 {
-    if (monitorTimer && [x11Apps count] == 0) {
-        [monitorTimer invalidate];
-        monitorTimer = nil;
+    [self checkApps:NO];
+}
+
+- (void)updateHiddenStateOfApp:(GWX11AppInfo *)info
+{
+    NSArray *windows = [pidWindows objectForKey:pidKey(info.pid)];
+    BOOL hidden = YES;
+
+    if ([windows count] == 0) return;
+
+    for (GWX11WindowInfo *winInfo in windows) {
+        if (!winInfo.isIconified && !winInfo.isHidden) {
+            hidden = NO;
+            break;
+        }
+    }
+
+    if (hidden != info.windowsHidden) {
+        info.windowsHidden = hidden;
+
+        if (delegate && [delegate respondsToSelector:@selector(x11AppHiddenStateDidChange:path:hidden:)]) {
+            [delegate x11AppHiddenStateDidChange:info.appName path:info.appPath hidden:hidden];
+        }
     }
 }
 
-- (void)monitorTimerFired:(NSTimer *)timer
+/* Updates the apps from the window table.  Name matching queries the
+ * server, so it is only tried when the client list changed. */
+- (void)checkApps:(BOOL)clientListChanged
 {
     GWX11WindowManager *wm = [GWX11WindowManager sharedManager];
     NSMutableArray *terminatedApps = [NSMutableArray array];
@@ -1014,20 +1137,21 @@ static GWX11AppManager *sharedX11AppManager = nil;
     for (NSString *appName in [x11Apps allKeys]) {
         GWX11AppInfo *info = [x11Apps objectForKey:appName];
         if (info == nil) continue;
+
+        /* Priority 1: windows by PID (most reliable) */
+        NSArray *windows = [pidWindows objectForKey:pidKey(info.pid)];
         
-        /* Check if process still exists */
-        if (![self processExists:info.pid]) {
+        /* A listed window means the process is alive */
+        if ([windows count] == 0 && ![self processExists:info.pid]) {
             [terminatedApps addObject:appName];
             continue;
         }
         
         /* Check if windows have appeared for this app */
         if (!info.hasWindowAppeared) {
-            /* Priority 1: Try to find windows by PID (most reliable) */
-            NSArray *windows = [wm windowsForPID:info.pid];
-            
             /* Priority 2: Fall back to name matching if PID fails */
-            if ([windows count] == 0 && info.windowSearchString) {
+            if ([windows count] == 0 && clientListChanged
+                && display != NULL && info.windowSearchString) {
                 windows = [wm windowsMatchingName:info.windowSearchString];
             }
             
@@ -1039,6 +1163,10 @@ static GWX11AppManager *sharedX11AppManager = nil;
                 }
             }
         }
+
+        if (info.hasWindowAppeared) {
+            [self updateHiddenStateOfApp:info];
+        }
     }
     
     /* Handle terminated apps */
@@ -1054,9 +1182,203 @@ static GWX11AppManager *sharedX11AppManager = nil;
         }
     }
     
-    [self stopMonitorTimer];
+    [self stopMonitoring];
+}
+
+#pragma mark Window Tracking
+
+- (void)startWindowTracking
+{
+    if (display != NULL) return;
+
+    Display *dpy = [[GWX11WindowManager sharedManager] openDisplay];
+    if (dpy == NULL) return;
+
+    netClientListAtom = XInternAtom(dpy, "_NET_CLIENT_LIST", False);
+    netWmStateAtom = XInternAtom(dpy, "_NET_WM_STATE", False);
+    netWmNameAtom = XInternAtom(dpy, "_NET_WM_NAME", False);
+    netWmPidAtom = XInternAtom(dpy, "_NET_WM_PID", False);
+    wmStateAtom = XInternAtom(dpy, "WM_STATE", False);
+
+    display = dpy;
+    XSelectInput(dpy, DefaultRootWindow(dpy), PropertyChangeMask);
+
+    void *fd = (void *)(uintptr_t)ConnectionNumber(dpy);
+    NSArray *modes = x11RunLoopModes();
+
+    for (NSUInteger i = 0; i < [modes count]; i++) {
+        [[NSRunLoop currentRunLoop] addEvent:fd
+                                        type:ET_RDESC
+                                     watcher:self
+                                     forMode:[modes objectAtIndex:i]];
+    }
+
+    [self updateClientList];
+
+    /* Xlib may already hold events read during the setup */
+    [self processX11Events];
 }
 
+- (void)stopWindowTracking
+{
+    if (display == NULL) return;
+
+    Display *dpy = (Display *)display;
+    void *fd = (void *)(uintptr_t)ConnectionNumber(dpy);
+    NSArray *modes = x11RunLoopModes();
+
+    for (NSUInteger i = 0; i < [modes count]; i++) {
+        [[NSRunLoop currentRunLoop] removeEvent:fd
+                                           type:ET_RDESC
+                                        forMode:[modes objectAtIndex:i]
+                                            all:NO];
+    }
+
+    display = NULL;
+    XCloseDisplay(dpy);
+    [clientWindows removeAllObjects];
+    [pidWindows removeAllObjects];
+}
+
+/* Reads _NET_CLIENT_LIST again.  Only the windows new to the table are
+ * queried; their events are selected before, so no change in between is
+ * missed. */
+- (void)updateClientList
+{
+    Display *dpy = (Display *)display;
+    GWX11WindowManager *wm = [GWX11WindowManager sharedManager];
+    unsigned long count = 0;
+    Window *clients = [wm getClientList:dpy count:&count];
+    NSMutableDictionary *listed = [NSMutableDictionary dictionaryWithCapacity:count];
+
+    for (unsigned long i = 0; i < count; i++) {
+        NSNumber *key = windowKey(clients[i]);
+        GWX11WindowInfo *info = [clientWindows objectForKey:key];
+
+        if (info == nil) {
+            XSelectInput(dpy, clients[i], PropertyChangeMask);
+            info = [wm infoForWindow:dpy window:clients[i]];
+        }
+        [listed setObject:info forKey:key];
+    }
+    if (clients) {
+        XFree(clients);
+    }
+
+    /* Windows withdrawn but not destroyed would keep reporting */
+    for (NSNumber *key in [clientWindows allKeys]) {
+        if ([listed objectForKey:key] == nil) {
+            XSelectInput(dpy, (Window)[key unsignedLongValue], NoEventMask);
+        }
+    }
+    XFlush(dpy);
+
+    [clientWindows setDictionary:listed];
+    [self rebuildPIDIndex];
+}
+
+- (void)rebuildPIDIndex
+{
+    [pidWindows removeAllObjects];
+
+    for (GWX11WindowInfo *info in [clientWindows objectEnumerator]) {
+        /* No PID (WM root/decoration windows) or _NET_WM_STATE_SKIP_TASKBAR
+         * (dock panels, desktop, etc.) */
+        if (info.ownerPID <= 0 || info.skipsTaskbar) continue;
+
+        NSNumber *key = pidKey(info.ownerPID);
+        NSMutableArray *windows = [pidWindows objectForKey:key];
+
+        if (windows == nil) {
+            windows = [NSMutableArray array];
+            [pidWindows setObject:windows forKey:key];
+        }
+        [windows addObject:info];
+    }
+}
+
+/* Updates the table entry of the window; YES when the PID index or the
+ * hidden state may have changed. */
+- (BOOL)windowPropertyChanged:(XPropertyEvent *)event
+{
+    Display *dpy = (Display *)display;
+    GWX11WindowManager *wm = [GWX11WindowManager sharedManager];
+    GWX11WindowInfo *info = [clientWindows objectForKey:windowKey(event->window)];
+
+    if (info == nil) return NO;
+
+    if (event->atom == netWmStateAtom) {
+        info.isHidden = [wm isWindowHidden:dpy window:event->window];
+        info.skipsTaskbar = [wm hasNetWmStateSkipTaskbar:dpy window:event->window];
+        return YES;
+    } else if (event->atom == wmStateAtom) {
+        info.isIconified = [wm checkWindowIconified:dpy window:event->window];
+        return YES;
+    } else if (event->atom == netWmPidAtom) {
+        info.ownerPID = [wm getPIDForWindow:dpy window:event->window];
+        return YES;
+    } else if (event->atom == netWmNameAtom || event->atom == XA_WM_NAME) {
+        info.windowName = [wm getWindowName:dpy window:event->window];
+    }
+
+    return NO;
+}
+
+- (void)receivedEvent:(void *)data
+                 type:(RunLoopEventType)type
+                extra:(void *)extra
+              forMode:(NSString *)mode
+{
+    [self processX11Events];
+}
+
+- (void)processX11Events
+{
+    Display *dpy = (Display *)display;
+    BOOL changed = NO;
+    BOOL clientListChanged = NO;
+    XEvent event;
+
+    if (dpy == NULL) return;
+
+    /* Drain everything, again after each update: the replies read while
+     * updating can queue events the descriptor does not announce */
+    for (;;) {
+        BOOL listChanged = NO;
+        BOOL windowsChanged = NO;
+
+        while (XPending(dpy) > 0) {
+            XNextEvent(dpy, &event);
+
+            if (event.type != PropertyNotify) continue;
+
+            if (event.xproperty.window == DefaultRootWindow(dpy)) {
+                if (event.xproperty.atom == netClientListAtom) {
+                    listChanged = YES;
+                }
+            } else if ([self windowPropertyChanged:&event.xproperty]) {
+                windowsChanged = YES;
+            }
+        }
+
+        if (!listChanged && !windowsChanged) break;
+
+        if (listChanged) {
+            [self updateClientList];
+            clientListChanged = YES;
+        } else {
+            [self rebuildPIDIndex];
+        }
+        changed = YES;
+    }
+
+    if (changed) {
+        [self checkApps:clientListChanged];
+    }
+}
+
+#pragma mark Registration
+
 - (void)registerX11App:(NSString *)appName
                   path:(NSString *)appPath
                    pid:(pid_t)pid
@@ -1074,18 +1396,18 @@ static GWX11AppManager *sharedX11AppManager = nil;
     [x11Apps setObject:info forKey:appName];
     RELEASE(info);
     
-    [self startMonitorTimer];
-    
     if (delegate && [delegate respondsToSelector:@selector(x11AppDidLaunch:path:pid:)]) {
         [delegate x11AppDidLaunch:appName path:appPath pid:pid];
     }
+    
+    [self startMonitoring];
 }
 
 - (void)unregisterX11App:(NSString *)appName
 {
     if (!appName) return;
     [x11Apps removeObjectForKey:appName];
-    [self stopMonitorTimer];
+    [self stopMonitoring];
 }
 
 - (BOOL)isX11App:(NSString *)appName
@@ -1146,9 +1468,13 @@ static GWX11AppManager *sharedX11AppManager = nil;
     
     NSArray *windows = nil;
     
-    /* Priority 1: _NET_WM_PID */
+    /* Priority 1: _NET_WM_PID, from the window table while it is kept */
     if (info.pid > 0) {
-        windows = [wm windowsForPID:info.pid];
+        if (display != NULL) {
+            windows = [pidWindows objectForKey:pidKey(info.pid)];
+        } else {
+            windows = [wm windowsForPID:info.pid];
+        }
     }
     
     /* Priority 2: name/class matching */
@@ -37,6 +37,8 @@
 #include <errno.h>
 
 #include "Workspace.h"
+#include "GWStartupTrace.h"
+#include "FSNTrace.h"
 
 /* Forward declaration of UI testing enable function */
 extern void WorkspaceUITestingSetEnabled(BOOL enabled);
@@ -129,6 +131,9 @@ int main(int argc, char **argv, char **env)
     killOtherInstances(myBasename, myPid);
     
 	CREATE_AUTORELEASE_POOL (pool);
+
+  GWStartupTraceStart();
+  FSNTraceInstallDumpSignal(SIGUSR2);
   
   /* Check for debug/UI testing flag */
   BOOL debugMode = NO;
@@ -140,14 +145,18 @@ int main(int argc, char **argv, char **env)
     }
   }
   
+  GWStartupTraceBegin(@"Workspace init");
   Workspace *gw = [Workspace gworkspace];
+  GWStartupTraceEnd(@"Workspace init");
   
   /* Enable UI testing if debug mode is enabled */
   if (debugMode) {
     WorkspaceUITestingSetEnabled(YES);
   }
   
+  GWStartupTraceBegin(@"NSApplication init");
 	NSApplication *app = [NSApplication sharedApplication];
+  GWStartupTraceEnd(@"NSApplication init");
   
   [app setDelegate: gw];    
 	[app run];